@@ -212,6 +212,7 @@ struct cfdisk_extra {
 struct cfdisk_line {
 	char			*data;		/* line data */
 	struct libscols_table	*extra;		/* extra info ('X') */
+	char			*extra_str;	/* extra info as string */
 	WINDOW			*w;		/* window with extra info */
 };
 
@@ -462,6 +463,7 @@ static void cfdisk_free_lines(struct cfdisk *cf)
 	size_t i = 0;
 	while(i < cf->nlines) {
 		scols_unref_table(cf->lines[i].extra);
+		free(cf->lines[i].extra_str);
 
 		DBG(UI, ul_debug("delete window: %p",
 				cf->lines[i].w));
@@ -1388,8 +1390,9 @@ static int ui_draw_extra(struct cfdisk *cf)
 
 	assert(ln->extra);
 
+	/* don't use wclear(), it forces repaint of the whole screen */
 	if (cf->act_win) {
-		wclear(cf->act_win);
+		werase(cf->act_win);
 		touchwin(stdscr);
 	}
 
@@ -1418,21 +1421,26 @@ static int ui_draw_extra(struct cfdisk *cf)
 
 	win_ex = subwin(stdscr, win_height, ui_cols - 2, win_ex_start_line, 1);
 
-	scols_table_reduce_termwidth(ln->extra, 4);
-	scols_print_table_to_string(ln->extra, &tbstr);
-
-	end = tbstr;
-	while ((end = strchr(end, '\n')))
-		*end++ = '\0';
+	/* the string is cached until lines_refresh() */
+	if (!ln->extra_str) {
+		scols_table_reduce_termwidth(ln->extra, 4);
+		scols_print_table_to_string(ln->extra, &ln->extra_str);
+		if (!ln->extra_str) {
+			delwin(win_ex);
+			return 1;
+		}
+		end = ln->extra_str;
+		while ((end = strchr(end, '\n')))
+			*end++ = '\0';
+	}
 
 	box(win_ex, 0, 0);
 
-	end = tbstr;
+	tbstr = ln->extra_str;
 	while (--win_height > 1) {
 		mvwaddstr(win_ex, wline++, 1 /* window column*/, tbstr);
 		tbstr += strlen(tbstr) + 1;
 	}
-	free(end);
 
 	if (ln->w)
 		delwin(ln->w);
@@ -1626,7 +1634,7 @@ static int ui_draw_table(struct cfdisk *cf)
 {
 	int cl = ARROW_CURSOR_WIDTH;
 	size_t i, nparts = fdisk_table_get_nents(cf->table);
-	size_t curpg = cf->page_sz ? cf->lines_idx / cf->page_sz : 0;
+	size_t curpg, first = 0, last = nparts;
 
 	DBG(UI, ul_debug("draw table"));
 
@@ -1638,13 +1646,19 @@ static int ui_draw_table(struct cfdisk *cf)
 	if (nparts == 0 || (size_t) cf->lines_idx > nparts - 1)
 		cf->lines_idx = nparts ? nparts - 1 : 0;
 
+	curpg = cf->page_sz ? cf->lines_idx / cf->page_sz : 0;
+
 	/* print header */
 	attron(A_BOLD);
 	mvaddstr(TABLE_START_LINE, cl, cf->lines[0].data);
 	attroff(A_BOLD);
 
-	/* print partitions */
-	for (i = 0; i < nparts; i++)
+	/* print partitions on the current page only */
+	if (cf->page_sz) {
+		first = curpg * cf->page_sz;
+		last = min(nparts, first + cf->page_sz);
+	}
+	for (i = first; i < last; i++)
 		ui_draw_partition(cf, i);
 
 	if (curpg != 0) {
@@ -1707,7 +1721,9 @@ static int ui_refresh(struct cfdisk *cf)
 	lb = fdisk_get_label(cf->cxt, NULL);
 	assert(lb);
 
-	clear();
+	/* The screen is completely repainted only after resize or ^L (see
+	 * resize()), otherwise curses sends only the changed lines. */
+	erase();
 
 	/* header */
 	attron(A_BOLD);
@@ -2261,6 +2277,7 @@ static int main_menu_action(struct cfdisk *cf, int key)
 {
 	size_t n;
 	int ref = 0, rc, org_order = cf->wrong_order;
+	int changed = 0;	/* the partition table has been modified */
 	const char *info = NULL, *warn = NULL;
 	struct fdisk_partition *pa;
 
@@ -2302,7 +2319,7 @@ static int main_menu_action(struct cfdisk *cf, int key)
 		if (fl && fdisk_toggle_partition_flag(cf->cxt, n, fl))
 			warn = _("Could not toggle the flag.");
 		else if (fl)
-			ref = 1;
+			ref = changed = 1;
 		break;
 	}
 #ifdef KEY_DC
@@ -2311,8 +2328,10 @@ static int main_menu_action(struct cfdisk *cf, int key)
 	case 'd': /* Delete */
 		if (fdisk_delete_partition(cf->cxt, n) != 0)
 			warn = _("Could not delete partition %zu.");
-		else
+		else {
 			info = _("Partition %zu has been deleted.");
+			changed = 1;
+		}
 		ref = 1;
 		break;
 	case 'h': /* Help */
@@ -2358,7 +2377,7 @@ static int main_menu_action(struct cfdisk *cf, int key)
 		rc = fdisk_add_partition(cf->cxt, npa, NULL);
 		fdisk_unref_partition(npa);
 		if (rc == 0)
-			ref = 1;
+			ref = changed = 1;
 		break;
 	}
 	case 'q': /* Quit */
@@ -2373,9 +2392,10 @@ static int main_menu_action(struct cfdisk *cf, int key)
 		t = ui_get_parttype(cf, t);
 		ref = 1;
 
-		if (t && fdisk_set_partition_type(cf->cxt, n, t) == 0)
+		if (t && fdisk_set_partition_type(cf->cxt, n, t) == 0) {
 			info = _("Changed type of partition %zu.");
-		else
+			changed = 1;
+		} else
 			info = _("The type of partition %zu is unchanged.");
 		break;
 	}
@@ -2411,7 +2431,7 @@ static int main_menu_action(struct cfdisk *cf, int key)
 		rc = fdisk_set_partition(cf->cxt, n, npa);
 		fdisk_unref_partition(npa);
 		if (rc == 0) {
-			ref = 1;
+			ref = changed = 1;
 			info = _("Partition %zu resized.");
 		}
 		break;
@@ -2419,7 +2439,7 @@ static int main_menu_action(struct cfdisk *cf, int key)
 	case 's': /* Sort */
 		if (cf->wrong_order) {
 			fdisk_reorder_partitions(cf->cxt);
-			ref = 1;
+			ref = changed = 1;
 		}
 		break;
 	case 'u': /* dUmp */
@@ -2455,6 +2475,7 @@ static int main_menu_action(struct cfdisk *cf, int key)
 			else
 				fdisk_reread_partition_table(cf->cxt);
 			info = _("The partition table has been altered.");
+			changed = 1;
 		}
 		cf->nwrites++;
 		break;
@@ -2464,7 +2485,9 @@ static int main_menu_action(struct cfdisk *cf, int key)
 	}
 
 	if (ref) {
-		lines_refresh(cf);
+		/* the lines are cached until the partition table changes */
+		if (changed)
+			lines_refresh(cf);
 		ui_refresh(cf);
 		ui_draw_extra(cf);
 	} else
@@ -2495,7 +2518,7 @@ static void ui_resize_refresh(struct cfdisk *cf)
 static void toggle_show_extra(struct cfdisk *cf)
 {
 	if (cf->show_extra && cf->act_win) {
-		wclear(cf->act_win);
+		werase(cf->act_win);
 		touchwin(stdscr);
 	}
 	cf->show_extra = cf->show_extra ? 0 : 1;
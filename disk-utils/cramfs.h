@@ -19,6 +19,7 @@
 #ifndef __CRAMFS_H
 #define __CRAMFS_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define CRAMFS_MAGIC		0x28cd3d45	/* some random number */
@@ -1,6 +1,7 @@
 #include <libfdisk.h>
 #include <libsmartcols.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "c.h"
 #include "xalloc.h"
@@ -316,7 +317,8 @@ done:
 	fdisk_free_iter(itr);
 }
 
-char *next_proc_partition(FILE **f)
+/* returns the next whole disk from /proc/partitions (including CD-ROMs) */
+static char *next_proc_wholedisk(FILE **f)
 {
 	char line[128 + 1];
 
@@ -347,10 +349,7 @@ char *next_proc_partition(FILE **f)
 			continue;
 
 		cn = canonicalize_path(buf);
-		if (!cn)
-			continue;
-
-		if (!is_ide_cdrom_or_tape(cn))
+		if (cn)
 			return cn;
 	}
 	fclose(*f);
@@ -359,6 +358,163 @@ char *next_proc_partition(FILE **f)
 	return NULL;
 }
 
+char *next_proc_partition(FILE **f)
+{
+	char *cn;
+
+	while ((cn = next_proc_wholedisk(f))) {
+		if (!is_ide_cdrom_or_tape(cn))
+			return cn;
+		free(cn);
+	}
+	return NULL;
+}
+
+/*
+ * Listing of all devices. The devices are opened and the partition tables
+ * are read to the page cache by worker threads (the first open and read of
+ * the device may be very slow, for example on hosts with many SAS paths).
+ * The devices are listed by the main thread in the original order, so
+ * libfdisk is used by one thread only.
+ */
+#define PREFETCH_THREADS	8
+#define PREFETCH_BYTES		(256 * 1024)	/* begin and end of the device */
+
+enum {
+	PREFETCH_TODO = 0,
+	PREFETCH_DONE,
+	PREFETCH_SKIP		/* CD-ROM or tape */
+};
+
+struct prefetch {
+	char		**devs;
+	int		*state;		/* PREFETCH_* */
+	size_t		ndevs;
+	size_t		next;		/* the next device for the workers */
+
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	pthread_t	threads[PREFETCH_THREADS];
+	size_t		nthreads;
+};
+
+static int prefetch_device(const char *dev)
+{
+	unsigned char *buf;
+	unsigned long long size = 0;
+	int fd;
+
+	fd = open(dev, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return PREFETCH_DONE;	/* the error is reported later */
+	if (blkdev_is_cdrom(fd)) {
+		close(fd);
+		return PREFETCH_SKIP;
+	}
+
+	buf = malloc(PREFETCH_BYTES);
+	if (buf) {
+		ignore_result( pread(fd, buf, PREFETCH_BYTES, 0) );
+		if (blkdev_get_size(fd, &size) == 0
+		    && size > PREFETCH_BYTES)
+			ignore_result( pread(fd, buf, PREFETCH_BYTES,
+						size - PREFETCH_BYTES) );
+		free(buf);
+	}
+	close(fd);
+	return PREFETCH_DONE;
+}
+
+static void *prefetch_thread(void *data)
+{
+	struct prefetch *pf = data;
+
+	pthread_mutex_lock(&pf->lock);
+	while (pf->next < pf->ndevs) {
+		size_t i = pf->next++;
+		int st;
+
+		pthread_mutex_unlock(&pf->lock);
+		st = prefetch_device(pf->devs[i]);
+		pthread_mutex_lock(&pf->lock);
+
+		pf->state[i] = st;
+		pthread_cond_broadcast(&pf->cond);
+	}
+	pthread_mutex_unlock(&pf->lock);
+	return NULL;
+}
+
+static void prefetch_start(struct prefetch *pf)
+{
+	FILE *f = NULL;
+	size_t nalloc = 0;
+	char *dev;
+
+	memset(pf, 0, sizeof(*pf));
+	while ((dev = next_proc_wholedisk(&f))) {
+		if (pf->ndevs == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 32;
+			pf->devs = xrealloc(pf->devs, nalloc * sizeof(char *));
+		}
+		pf->devs[pf->ndevs++] = dev;
+	}
+	pf->state = xcalloc(pf->ndevs ? pf->ndevs : 1, sizeof(int));
+
+	pthread_mutex_init(&pf->lock, NULL);
+	pthread_cond_init(&pf->cond, NULL);
+
+	/* one device is not worth a thread */
+	if (pf->ndevs < 2)
+		return;
+
+	for (pf->nthreads = 0; pf->nthreads < PREFETCH_THREADS
+			       && pf->nthreads < pf->ndevs; pf->nthreads++) {
+		if (pthread_create(&pf->threads[pf->nthreads], NULL,
+				   prefetch_thread, pf) != 0)
+			break;
+	}
+}
+
+/* returns the next device or NULL, the device is prefetched */
+static char *prefetch_next(struct prefetch *pf, size_t *idx)
+{
+	while (*idx < pf->ndevs) {
+		size_t i = (*idx)++;
+		int st;
+
+		if (pf->nthreads) {
+			pthread_mutex_lock(&pf->lock);
+			while (pf->state[i] == PREFETCH_TODO)
+				pthread_cond_wait(&pf->cond, &pf->lock);
+			st = pf->state[i];
+			pthread_mutex_unlock(&pf->lock);
+		} else
+			st = is_ide_cdrom_or_tape(pf->devs[i]) ?
+					PREFETCH_SKIP : PREFETCH_DONE;
+
+		if (st == PREFETCH_DONE)
+			return pf->devs[i];
+	}
+	return NULL;
+}
+
+static void prefetch_finish(struct prefetch *pf)
+{
+	size_t i;
+
+	for (i = 0; i < pf->nthreads; i++)
+		pthread_join(pf->threads[i], NULL);
+
+	pthread_mutex_destroy(&pf->lock);
+	pthread_cond_destroy(&pf->cond);
+
+	for (i = 0; i < pf->ndevs; i++)
+		free(pf->devs[i]);
+	free(pf->devs);
+	free(pf->state);
+}
+
 int print_device_pt(struct fdisk_context *cxt, char *device, int warnme, int verify)
 {
 	if (fdisk_assign_device(cxt, device, 1) != 0) {	/* read-only */
@@ -393,32 +549,36 @@ int print_device_freespace(struct fdisk_context *cxt, char *device, int warnme)
 
 void print_all_devices_pt(struct fdisk_context *cxt, int verify)
 {
-	FILE *f = NULL;
+	struct prefetch pf;
+	size_t idx = 0;
 	int ct = 0;
 	char *dev;
 
-	while ((dev = next_proc_partition(&f))) {
+	prefetch_start(&pf);
+	while ((dev = prefetch_next(&pf, &idx))) {
 		if (ct)
 			fputs("\n\n", stdout);
 		if (print_device_pt(cxt, dev, 0, verify) == 0)
 			ct++;
-		free(dev);
 	}
+	prefetch_finish(&pf);
 }
 
 void print_all_devices_freespace(struct fdisk_context *cxt)
 {
-	FILE *f = NULL;
+	struct prefetch pf;
+	size_t idx = 0;
 	int ct = 0;
 	char *dev;
 
-	while ((dev = next_proc_partition(&f))) {
+	prefetch_start(&pf);
+	while ((dev = prefetch_next(&pf, &idx))) {
 		if (ct)
 			fputs("\n\n", stdout);
 		if (print_device_freespace(cxt, dev, 0) == 0)
 			ct++;
-		free(dev);
 	}
+	prefetch_finish(&pf);
 }
 
 /* usable for example in usage() */
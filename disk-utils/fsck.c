@@ -45,6 +45,9 @@
 #include <dirent.h>
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <blkid.h>
 #include <libmount.h>
 
@@ -55,6 +58,8 @@
 #include "fileutils.h"
 #include "monotonic.h"
 #include "strutils.h"
+#include "sysfs.h"
+#include "carefulputc.h"
 
 #define XALLOC_EXIT_CODE	FSCK_EX_ERROR
 #include "xalloc.h"
@@ -95,9 +100,33 @@ struct fsck_fs_data
 {
 	const char	*device;
 	dev_t		disk;
+	uint64_t	size;		/* device size in bytes */
+	uint64_t	mem;		/* estimated checker memory in bytes */
+	char		*controller;	/* disk controller name or NULL */
 	unsigned int	stacked:1,
 			done:1,
-			eval_device:1;
+			eval_device:1,
+			eval_sched:1;
+};
+
+/*
+ * Memory used by the checkers, base + size per TiB of the filesystem. The
+ * numbers are rough estimates, they are used for --mem-budget only.
+ */
+struct fsck_mem_estimate {
+	const char	*type;
+	uint64_t	base;		/* MiB */
+	uint64_t	per_tib;	/* MiB */
+};
+
+static const struct fsck_mem_estimate mem_estimates[] = {
+	{ "ext2",	16,	256 },
+	{ "ext3",	16,	256 },
+	{ "ext4",	16,	256 },
+	{ "ext4dev",	16,	256 },
+	{ "xfs",	64,	1024 },
+	{ "btrfs",	64,	1024 },
+	{ NULL,		16,	256 }	/* default */
 };
 
 /*
@@ -119,11 +148,21 @@ struct fsck_instance {
 	struct rusage rusage;
 	struct libmnt_fs *fs;
 	struct fsck_instance *next;
+
+	/* --progress-socket aggregation */
+	int	progress_pipe;	/* read end of checker -C fd or -1 */
+	char	progress_buf[PATH_MAX + 64];
+	size_t	progress_bufsz;
+	double	progress;	/* 0..1 */
+	int	pass;
 };
 
 #define FLAG_DONE 1
 #define FLAG_PROGRESS 2
 
+#define PROGRESS_POLL_MSEC	250	/* wait for child or progress data */
+#define PROGRESS_REPORT_SEC	1	/* min interval between reports */
+
 /*
  * Global variables for options
  */
@@ -142,12 +181,15 @@ static int notitle;
 static int parallel_root;
 static int progress;
 static int progress_fd;
+static char *progress_socket;
 static int force_all_parallel;
 static int report_stats;
 static FILE *report_stats_file;
 
 static int num_running;
 static int max_running;
+static int max_running_controller;
+static uint64_t mem_budget;
 
 static volatile int cancel_requested;
 static int kill_sent;
@@ -305,6 +347,84 @@ static void fs_set_done(struct libmnt_fs *fs)
 		data->done = 1;
 }
 
+static uint64_t estimate_mem(const char *type, uint64_t size)
+{
+	const struct fsck_mem_estimate *e;
+
+	for (e = mem_estimates; e->type; e++) {
+		if (type && strcmp(type, e->type) == 0)
+			break;
+	}
+	return (e->base << 20) + e->per_tib * (size >> 20);
+}
+
+static char *get_controller(dev_t disk)
+{
+	struct path_cxt *pc;
+	char buf[PATH_MAX], *res = NULL;
+	ssize_t len;
+	int host;
+
+	pc = ul_new_sysfs_path(disk, NULL, NULL);
+	if (!pc)
+		return NULL;
+
+	/* SCSI disks share the host adapter, others the parent device (e.g. nvme0) */
+	if (sysfs_blkdev_scsi_get_hctl(pc, &host, NULL, NULL, NULL) == 0)
+		xasprintf(&res, "host%d", host);
+	else if ((len = ul_path_readlink(pc, buf, sizeof(buf) - 1, "device")) > 0) {
+		char *p;
+
+		buf[len] = '\0';
+		p = strrchr(buf, '/');
+		res = xstrdup(p ? p + 1 : buf);
+	}
+
+	ul_unref_path(pc);
+	return res;
+}
+
+/*
+ * Reads the device size and the disk controller from sysfs and estimates
+ * the checker memory. Used for the check_all() scheduling.
+ */
+static struct fsck_fs_data *fs_get_sched_data(struct libmnt_fs *fs)
+{
+	struct fsck_fs_data *data = fs_create_data(fs);
+	const char *device;
+	struct stat st;
+	dev_t disk;
+
+	if (data->eval_sched)
+		return data;
+	data->eval_sched = 1;
+
+	disk = fs_get_disk(fs, 1);
+	device = fs_get_device(fs);
+
+	if (disk && device && stat(device, &st) == 0 && S_ISBLK(st.st_mode)) {
+		struct path_cxt *pc = ul_new_sysfs_path(st.st_rdev, NULL, NULL);
+		uint64_t sectors;
+
+		if (pc && ul_path_read_u64(pc, &sectors, "size") == 0)
+			data->size = sectors << 9;
+		ul_unref_path(pc);
+
+		data->controller = get_controller(disk);
+	}
+
+	data->mem = estimate_mem(mnt_fs_get_fstype(fs), data->size);
+	return data;
+}
+
+/* filesystems with unknown size are counted as 1GiB */
+static uint64_t progress_weight(struct libmnt_fs *fs)
+{
+	uint64_t size = fs_get_sched_data(fs)->size;
+
+	return size ? size : 1 << 30;
+}
+
 static int is_irrotational_disk(dev_t disk)
 {
 	char path[PATH_MAX];
@@ -421,6 +541,8 @@ static void free_instance(struct fsck_instance *i)
 {
 	if (lockdisk)
 		unlock_disk(i);
+	if (i->progress_pipe >= 0)
+		close(i->progress_pipe);
 	free(i->prog);
 	free(i->lockpath);
 	mnt_unref_fs(i->fs);
@@ -583,6 +705,248 @@ static int progress_active(void)
 	return 0;
 }
 
+/*
+ * Progress aggregation (--progress-socket)
+ *
+ * All ext[234] checkers write the progress to the pipes, the pipes are read
+ * by poll() when fsck waits for the children. The progress of all checkers
+ * is weighted by the device size, the ETA is based on the throughput since
+ * fsck start. The report is sent to the socket as one JSON object per line
+ * and, if -C is specified, to the progress file descriptor.
+ */
+static int progress_sock = -1;
+static struct timeval progress_start;
+static time_t progress_last;		/* last report */
+static uint64_t progress_done;		/* weight of finished filesystems */
+static uint64_t progress_pending;	/* weight of not yet started filesystems */
+static size_t progress_nfinished;
+
+static inline int progress_aggregated(void)
+{
+	return progress_socket != NULL;
+}
+
+static inline int is_ext_type(const char *type)
+{
+	return type && (strcmp(type, "ext2") == 0 ||
+			strcmp(type, "ext3") == 0 ||
+			strcmp(type, "ext4") == 0 ||
+			strcmp(type, "ext4dev") == 0);
+}
+
+static void progress_open_socket(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	gettime_monotonic(&progress_start);
+
+	if (strlen(progress_socket) >= sizeof(addr.sun_path))
+		errx(FSCK_EX_USAGE, _("socket path too long: %s"), progress_socket);
+	strcpy(addr.sun_path, progress_socket);
+
+	progress_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (progress_sock < 0
+	    || connect(progress_sock, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		/* not fatal, the checks are more important than the report */
+		warn(_("cannot connect to %s"), progress_socket);
+		if (progress_sock >= 0)
+			close(progress_sock);
+		progress_sock = -1;
+	}
+}
+
+/* e2fsck progress is "<pass> <current> <max> <device>" per line */
+static void progress_parse_line(struct fsck_instance *inst, const char *line)
+{
+	/* the same weights of the passes as e2fsck uses */
+	static const double pass_end[] = { 0, 0.70, 0.90, 0.92, 0.95, 1.0 };
+	unsigned long cur, max;
+	int pass;
+
+	if (sscanf(line, "%d %lu %lu", &pass, &cur, &max) != 3
+	    || pass < 1 || (size_t) pass >= ARRAY_SIZE(pass_end))
+		return;
+
+	inst->pass = pass;
+	inst->progress = pass_end[pass - 1];
+	if (max)
+		inst->progress += (pass_end[pass] - pass_end[pass - 1])
+					* (cur > max ? 1.0 : (double) cur / max);
+}
+
+static void progress_read(struct fsck_instance *inst)
+{
+	char *line, *end;
+	ssize_t sz;
+
+	sz = read(inst->progress_pipe, inst->progress_buf + inst->progress_bufsz,
+		  sizeof(inst->progress_buf) - inst->progress_bufsz - 1);
+	if (sz <= 0) {
+		if (sz == 0 || (errno != EINTR && errno != EAGAIN)) {
+			close(inst->progress_pipe);
+			inst->progress_pipe = -1;
+		}
+		return;
+	}
+	inst->progress_bufsz += sz;
+	inst->progress_buf[inst->progress_bufsz] = '\0';
+
+	for (line = inst->progress_buf; (end = strchr(line, '\n')); line = end + 1) {
+		*end = '\0';
+		progress_parse_line(inst, line);
+	}
+
+	/* keep incomplete line, drop too long line */
+	inst->progress_bufsz = strlen(line);
+	if (inst->progress_bufsz == sizeof(inst->progress_buf) - 1)
+		inst->progress_bufsz = 0;
+	else
+		memmove(inst->progress_buf, line, inst->progress_bufsz);
+}
+
+static void progress_report(int force)
+{
+	struct fsck_instance *inst;
+	struct timeval now, delta;
+	uint64_t total;
+	double done, percent;
+	long eta = -1;
+	size_t nrunning = 0;
+	char *buf = NULL;
+	size_t bufsz = 0;
+	FILE *f;
+
+	gettime_monotonic(&now);
+	if (!force && now.tv_sec - progress_last < PROGRESS_REPORT_SEC)
+		return;
+	progress_last = now.tv_sec;
+	timersub(&now, &progress_start, &delta);
+
+	done = progress_done;
+	total = progress_done + progress_pending;
+	for (inst = instance_list; inst; inst = inst->next) {
+		uint64_t w;
+
+		if (inst->flags & FLAG_DONE)
+			continue;
+		w = progress_weight(inst->fs);
+		total += w;
+		done += inst->progress * w;
+		nrunning++;
+	}
+
+	percent = total ? done * 100.0 / total : 100.0;
+	if (done > 0 && delta.tv_sec > 0)
+		eta = (long) ((total - done) * delta.tv_sec / done);
+
+	if (progress_sock >= 0 && (f = open_memstream(&buf, &bufsz))) {
+		fprintf(f, "{\"elapsed\": %ld, \"percent\": %.1f, \"eta\": %ld, "
+			   "\"finished\": %zu, \"running\": [",
+			(long) delta.tv_sec, percent, eta, progress_nfinished);
+
+		for (inst = instance_list; inst; inst = inst->next) {
+			if (inst->flags & FLAG_DONE)
+				continue;
+			fputs("{\"device\": ", f);
+			fputs_quoted_json(fs_get_device(inst->fs), f);
+			fputs(", \"type\": ", f);
+			fputs_quoted_json(inst->type, f);
+			fprintf(f, ", \"pass\": %d, \"percent\": %.1f}%s",
+				inst->pass, inst->progress * 100.0,
+				--nrunning ? ", " : "");
+		}
+		fputs("]}\n", f);
+		fclose(f);
+
+		if (buf && send(progress_sock, buf, bufsz, MSG_NOSIGNAL) < 0) {
+			warn(_("cannot write to %s"), progress_socket);
+			close(progress_sock);
+			progress_sock = -1;
+		}
+		free(buf);
+	}
+
+	if (progress) {
+		if (progress_fd)
+			dprintf(progress_fd, "%.1f %ld\n", percent, eta);
+		else if (eta >= 0)
+			printf(_("\rChecking: %5.1f%%, ETA %ld:%02ld:%02ld"),
+					percent, eta / 3600, (eta / 60) % 60, eta % 60);
+		else
+			printf(_("\rChecking: %5.1f%%"), percent);
+	}
+}
+
+/* reads the progress of the running checkers, returns after @timeout ms */
+static void progress_poll(int timeout)
+{
+	struct fsck_instance *inst;
+	struct pollfd *fds;
+	nfds_t n = 0;
+
+	for (inst = instance_list; inst; inst = inst->next)
+		n++;
+	fds = xcalloc(n + 1, sizeof(struct pollfd));
+
+	n = 0;
+	for (inst = instance_list; inst; inst = inst->next) {
+		if (inst->progress_pipe < 0)
+			continue;
+		fds[n].fd = inst->progress_pipe;
+		fds[n].events = POLLIN;
+		n++;
+	}
+
+	if (poll(fds, n, timeout) > 0) {
+		for (inst = instance_list; inst; inst = inst->next) {
+			nfds_t i;
+
+			if (inst->progress_pipe < 0)
+				continue;
+			for (i = 0; i < n; i++) {
+				if (fds[i].fd == inst->progress_pipe && fds[i].revents)
+					progress_read(inst);
+			}
+		}
+	}
+	free(fds);
+	progress_report(0);
+}
+
+static void progress_finish(struct fsck_instance *inst)
+{
+	/* the checker is dead, read the rest up to EOF */
+	while (inst->progress_pipe >= 0)
+		progress_read(inst);
+
+	progress_done += progress_weight(inst->fs);
+	progress_nfinished++;
+	progress_report(1);
+}
+
+/* @fs is started or skipped */
+static void progress_forget(struct libmnt_fs *fs)
+{
+	uint64_t w;
+
+	if (!progress_aggregated())
+		return;
+	w = progress_weight(fs);
+	progress_pending = progress_pending > w ? progress_pending - w : 0;
+}
+
+static void progress_close(void)
+{
+	if (!progress_aggregated())
+		return;
+	progress_report(1);
+	if (progress && !progress_fd)
+		fputc('\n', stdout);
+	if (progress_sock >= 0)
+		close(progress_sock);
+	progress_sock = -1;
+}
+
 /*
  * Process run statistics for finished fsck instances.
  *
@@ -631,6 +995,7 @@ static int execute(const char *progname, const char *progpath,
 {
 	char *argv[80];
 	int  argc, i;
+	int  wpipe[2] = { -1, -1 };
 	struct fsck_instance *inst, *p;
 	pid_t	pid;
 
@@ -642,11 +1007,18 @@ static int execute(const char *progname, const char *progpath,
 	for (i=0; i <num_args; i++)
 		argv[argc++] = xstrdup(args[i]);
 
-	if (progress &&
-	       ((strcmp(type, "ext2") == 0) ||
-		(strcmp(type, "ext3") == 0) ||
-		(strcmp(type, "ext4") == 0) ||
-		(strcmp(type, "ext4dev") == 0))) {
+	inst->progress_pipe = -1;
+
+	if (progress_aggregated() && is_ext_type(type) && !noexecute) {
+		char tmp[80];
+
+		/* all checkers report the progress to fsck */
+		if (pipe2(wpipe, O_CLOEXEC) == 0) {
+			snprintf(tmp, sizeof(tmp), "-C%d", wpipe[1]);
+			argv[argc++] = xstrdup(tmp);
+			inst->progress_pipe = wpipe[0];
+		}
+	} else if (progress && is_ext_type(type)) {
 
 		char tmp[80];
 		tmp[0] = 0;
@@ -685,15 +1057,22 @@ static int execute(const char *progname, const char *progpath,
 		pid = -1;
 	else if ((pid = fork()) < 0) {
 		warn(_("fork failed"));
+		if (wpipe[1] >= 0)
+			close(wpipe[1]);
 		free_instance(inst);
 		return errno;
 	} else if (pid == 0) {
 		if (!interactive)
 			close(0);
+		if (wpipe[1] >= 0)
+			fcntl(wpipe[1], F_SETFD, 0);	/* inherit -C fd */
 		execv(progpath, argv);
 		err(FSCK_EX_ERROR, _("%s: execute failed"), progpath);
 	}
 
+	if (wpipe[1] >= 0)
+		close(wpipe[1]);
+
 	for (i=0; i < argc; i++)
 		free(argv[i]);
 
@@ -768,13 +1147,19 @@ static struct fsck_instance *wait_one(int flags)
 	inst = prev = NULL;
 
 	do {
-		pid = wait4(-1, &status, flags, &rusage);
+		pid = wait4(-1, &status,
+			    progress_aggregated() ? flags | WNOHANG : flags, &rusage);
 		if (cancel_requested && !kill_sent) {
 			kill_all(SIGTERM);
 			kill_sent++;
 		}
 		if ((pid == 0) && (flags & WNOHANG))
 			return NULL;
+		if (pid == 0) {
+			/* still running, read the progress */
+			progress_poll(PROGRESS_POLL_MSEC);
+			continue;
+		}
 		if (pid < 0) {
 			if ((errno == EINTR) || (errno == EAGAIN))
 				continue;
@@ -816,6 +1201,9 @@ static struct fsck_instance *wait_one(int flags)
 	gettime_monotonic(&inst->end_time);
 	memcpy(&inst->rusage, &rusage, sizeof(struct rusage));
 
+	if (progress_aggregated())
+		progress_finish(inst);
+
 	if (progress && (inst->flags & FLAG_PROGRESS) &&
 	    !progress_active()) {
 		for (inst2 = instance_list; inst2; inst2 = inst2->next) {
@@ -1240,6 +1628,84 @@ static int disk_already_active(struct libmnt_fs *fs)
 	return 0;
 }
 
+/*
+ * Returns TRUE if the checker for @fs does not fit to the per-controller limit
+ * or to the memory budget. One checker is always allowed.
+ */
+static int over_budget(struct libmnt_fs *fs)
+{
+	struct fsck_instance *inst;
+	struct fsck_fs_data *data;
+	uint64_t mem = 0;
+	int ncontroller = 0;
+
+	if (!instance_list || (!max_running_controller && !mem_budget))
+		return 0;
+
+	data = fs_get_sched_data(fs);
+
+	for (inst = instance_list; inst; inst = inst->next) {
+		struct fsck_fs_data *idata = fs_get_sched_data(inst->fs);
+
+		mem += idata->mem;
+		if (data->controller && idata->controller &&
+		    strcmp(data->controller, idata->controller) == 0)
+			ncontroller++;
+	}
+
+	if (max_running_controller && ncontroller >= max_running_controller)
+		return 1;
+	if (mem_budget && mem + data->mem > mem_budget)
+		return 1;
+	return 0;
+}
+
+struct sched_entry {
+	struct libmnt_fs	*fs;
+	uint64_t		size;
+	size_t			pos;		/* in fstab */
+};
+
+/* the biggest filesystems first, otherwise keep the fstab order */
+static int cmp_sched_entries(const void *a, const void *b)
+{
+	const struct sched_entry *x = a, *y = b;
+
+	if (x->size != y->size)
+		return x->size > y->size ? -1 : 1;
+	return cmp_numbers(x->pos, y->pos);
+}
+
+/*
+ * Returns not yet checked filesystems in the order of the scheduling.
+ */
+static size_t get_sched_list(struct libmnt_iter *itr, struct libmnt_fs ***list)
+{
+	struct sched_entry *ents;
+	struct libmnt_fs *fs;
+	size_t i, n = 0;
+
+	ents = xcalloc(mnt_table_get_nents(fstab) + 1, sizeof(*ents));
+
+	mnt_reset_iter(itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(fstab, itr, &fs) == 0) {
+		if (fs_is_done(fs))
+			continue;
+		ents[n].fs = fs;
+		ents[n].size = fs_get_sched_data(fs)->size;
+		ents[n].pos = n;
+		n++;
+	}
+	qsort(ents, n, sizeof(*ents), cmp_sched_entries);
+
+	*list = xcalloc(n + 1, sizeof(struct libmnt_fs *));
+	for (i = 0; i < n; i++)
+		(*list)[i] = ents[i].fs;
+
+	free(ents);
+	return n;
+}
+
 /* Check all file systems, using the /etc/fstab table. */
 static int check_all(void)
 {
@@ -1247,8 +1713,9 @@ static int check_all(void)
 	int passno = 1;
 	int pass_done;
 	int status = FSCK_EX_OK;
+	size_t i, nfs;
 
-	struct libmnt_fs *fs;
+	struct libmnt_fs *fs, **fslist;
 	struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_FORWARD);
 
 	if (!itr)
@@ -1304,13 +1771,21 @@ static int check_all(void)
 		}
 	}
 
+	/*
+	 * The longest jobs are started first.
+	 */
+	nfs = get_sched_list(itr, &fslist);
+	if (progress_aggregated()) {
+		for (i = 0; i < nfs; i++)
+			progress_pending += progress_weight(fslist[i]);
+	}
+
 	while (not_done_yet) {
 		not_done_yet = 0;
 		pass_done = 1;
 
-		mnt_reset_iter(itr, MNT_ITER_FORWARD);
-
-		while(mnt_table_next_fs(fstab, itr, &fs) == 0) {
+		for (i = 0; i < nfs; i++) {
+			fs = fslist[i];
 
 			if (cancel_requested)
 				break;
@@ -1326,6 +1801,7 @@ static int check_all(void)
 				continue;
 			}
 			if (ignore_mounted && is_mounted(fs)) {
+				progress_forget(fs);
 				fs_set_done(fs);
 				continue;
 			}
@@ -1338,9 +1814,19 @@ static int check_all(void)
 				pass_done = 0;
 				continue;
 			}
+			/*
+			 * Defer the filesystem if the controller is busy or
+			 * there is not enough memory, a smaller filesystem
+			 * may still fit.
+			 */
+			if (over_budget(fs)) {
+				pass_done = 0;
+				continue;
+			}
 			/*
 			 * Spawn off the fsck process
 			 */
+			progress_forget(fs);
 			status |= fsck_device(fs, serialize);
 			fs_set_done(fs);
 
@@ -1376,6 +1862,8 @@ static int check_all(void)
 	}
 
 	status |= wait_many(FLAG_WAIT_ATLEAST_ONE);
+	progress_close();
+	free(fslist);
 	mnt_free_iter(itr);
 	return status;
 }
@@ -1406,6 +1894,10 @@ static void __attribute__((__noreturn__)) usage(void)
 		"            <type> is allowed to be a comma-separated list\n"), out);
 	fputs(_(" -V         explain what is being done\n"), out);
 
+	fputs(_("     --mem-budget <size>  limit the estimated memory of the checkers\n"), out);
+	fputs(_("     --progress-socket <path>\n"
+		"            send progress of all checkers to the unix socket\n"), out);
+
 	fputs(USAGE_SEPARATOR, out);
 	printf( " -?, --help     %s\n", USAGE_OPTSTR_HELP);
 	printf( "     --version  %s\n", USAGE_OPTSTR_VERSION);
@@ -1453,6 +1945,32 @@ static void parse_argv(int argc, char *argv[])
 		if (!opts_for_fsck && !strcmp(arg, "--version"))
 			print_version(FSCK_EX_OK);
 
+		if (!opts_for_fsck && startswith(arg, "--progress-socket")) {
+			if (arg[17] == '=')
+				progress_socket = xstrdup(arg + 18);
+			else if (!arg[17] && i + 1 < argc)
+				progress_socket = xstrdup(argv[++i]);
+			else if (!arg[17])
+				errx(FSCK_EX_USAGE,
+					_("option '%s' requires an argument"), "--progress-socket");
+			if (progress_socket)
+				continue;
+		}
+		if (!opts_for_fsck && startswith(arg, "--mem-budget")) {
+			tmp = NULL;
+			if (arg[12] == '=')
+				tmp = arg + 13;
+			else if (!arg[12] && i + 1 < argc)
+				tmp = argv[++i];
+			else if (!arg[12])
+				errx(FSCK_EX_USAGE,
+					_("option '%s' requires an argument"), "--mem-budget");
+			if (tmp) {
+				mem_budget = strtosize_or_err(tmp, _("invalid argument of --mem-budget"));
+				continue;
+			}
+		}
+
 		if ((arg[0] == '/' && !opts_for_fsck) || strchr(arg, '=')) {
 			if (num_devices >= MAX_DEVICES)
 				errx(FSCK_EX_ERROR, _("too many devices"));
@@ -1603,6 +2121,8 @@ static void parse_argv(int argc, char *argv[])
 		force_all_parallel++;
 	if ((tmp = getenv("FSCK_MAX_INST")))
 	    max_running = atoi(tmp);
+	if ((tmp = getenv("FSCK_MAX_CONTROLLER_INST")))
+	    max_running_controller = atoi(tmp);
 }
 
 int main(int argc, char *argv[])
@@ -1632,6 +2152,9 @@ int main(int argc, char *argv[])
 
 	load_fs_info();
 
+	if (progress_aggregated())
+		progress_open_socket();
+
 	fsck_path = xstrdup(path && *path ? path : FSCK_DEFAULT_PATH);
 
 	if ((num_devices == 1) || (serialize))
@@ -1667,6 +2190,14 @@ int main(int argc, char *argv[])
 			continue;
 		if (ignore_mounted && is_mounted(fs))
 			continue;
+		while (over_budget(fs)) {
+			struct fsck_instance *inst = wait_one(0);
+
+			if (!inst)
+				break;
+			status |= inst->exit_status;
+			free_instance(inst);
+		}
 		status |= fsck_device(fs, interactive);
 		if (serialize ||
 		    (max_running && (num_running >= max_running))) {
@@ -1682,6 +2213,7 @@ int main(int argc, char *argv[])
 		}
 	}
 	status |= wait_many(FLAG_WAIT_ALL);
+	progress_close();
 	free(fsck_path);
 	mnt_unref_cache(mntcache);
 	mnt_unref_table(fstab);
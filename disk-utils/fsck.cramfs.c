@@ -66,6 +66,7 @@
 
 #define XALLOC_EXIT_CODE FSCK_EX_ERROR
 #include "xalloc.h"
+#include "ranges.h"
 
 static int fd;			/* ROM image file descriptor */
 static char *filename;		/* ROM image filename */
@@ -372,13 +373,240 @@ static int uncompress_block(void *src, size_t len)
 #define lchown chown
 #endif
 
-static void do_uncompress(char *path, int outfd, unsigned long offset,
-			  unsigned long size)
+static void change_file_status(char *path, struct cramfs_inode *i)
+{
+	const struct timeval epoch[] = { {0,0}, {0,0} };
+
+	if (euid == 0) {
+		if (lchown(path, i->uid, i->gid) < 0)
+			err(FSCK_EX_ERROR, _("lchown failed: %s"), path);
+		if (S_ISLNK(i->mode))
+			return;
+		if (((S_ISUID | S_ISGID) & i->mode) && chmod(path, i->mode) < 0)
+			err(FSCK_EX_ERROR, _("chown failed: %s"), path);
+	}
+	if (S_ISLNK(i->mode))
+		return;
+	if (utimes(path, epoch) < 0)
+		err(FSCK_EX_ERROR, _("utimes failed: %s"), path);
+}
+
+/*
+ * The regular files are not uncompressed in the tree walk. The walk only
+ * checks the block pointers and adds the blocks to a batch, the batch blocks
+ * are uncompressed by more threads (every thread reads the image by pread()
+ * and has its own zlib stream) and then the results are checked and the
+ * files are written by one pwrite() per continuous data in the tree order.
+ */
+#define UNCOMPRESS_PERTHREAD	32	/* min number of blocks per thread */
+#define UNCOMPRESS_BATCH	4096	/* blocks per batch (larger for huge files) */
+
+struct uncompress_block {
+	unsigned long	curr;		/* compressed data */
+	unsigned long	next;
+	unsigned long	size;		/* expected uncompressed size */
+	unsigned long	out;		/* uncompressed size */
+	int		zerr;		/* inflate() result */
+	unsigned int	hole : 1,
+			toolarge : 1;
+};
+
+struct uncompress_file {
+	char			*path;
+	struct cramfs_inode	inode;
+	size_t			first;		/* first block in batch */
+	size_t			nblocks;
+};
+
+struct uncompress_batch {
+	struct uncompress_file	*files;
+	size_t			nfiles;
+	size_t			nfiles_alloc;
+
+	struct uncompress_block	*blocks;
+	size_t			nblocks;
+	size_t			nblocks_alloc;
+
+	char			*out;		/* blksize per block */
+	size_t			out_alloc;	/* in blocks */
+};
+
+static struct uncompress_batch batch;
+
+static void uncompress_blocks(void *data, size_t range __attribute__((__unused__)),
+			      size_t first, size_t last)
 {
+	struct uncompress_batch *ub = data;
+	unsigned char *in = xmalloc(blksize * 2), *tmp = xmalloc(blksize * 2);
+	z_stream zs;
+	size_t i;
+
+	memset(&zs, 0, sizeof(zs));
+	inflateInit(&zs);
+
+	for (i = first; i < last; i++) {
+		struct uncompress_block *b = &ub->blocks[i];
+		char *dst = ub->out + i * blksize;
+		unsigned long len = b->next - b->curr;
+		ssize_t rc;
+
+		if (b->hole) {
+			b->out = b->size;
+			memset(dst, 0, b->out);
+			continue;
+		}
+		if (len > blksize * 2) {
+			b->toolarge = 1;
+			continue;
+		}
+
+		rc = pread(fd, in, len, b->curr);
+		if (rc < (ssize_t) len)
+			memset(in + (rc > 0 ? rc : 0), 0, len - (rc > 0 ? rc : 0));
+
+		inflateReset(&zs);
+		zs.next_in = in;
+		zs.avail_in = len;
+		zs.next_out = tmp;
+		zs.avail_out = blksize * 2;
+
+		b->zerr = inflate(&zs, Z_FINISH);
+		if (b->zerr != Z_STREAM_END)
+			continue;
+		b->out = zs.total_out;
+		memcpy(dst, tmp, min(b->out, (unsigned long) blksize));
+	}
+
+	inflateEnd(&zs);
+	free(in);
+	free(tmp);
+}
+
+static void write_file_data(struct uncompress_file *f, int outfd)
+{
+	size_t i, end = f->first + f->nblocks;
+
+	if (ftruncate(outfd, f->inode.size) < 0)
+		err(FSCK_EX_ERROR, _("write failed: %s"), f->path);
+
+	/* continuous data, holes are skipped */
+	for (i = f->first; i < end; ) {
+		size_t j, sz = 0;
+		off_t off = (i - f->first) * blksize;
+		char *p = batch.out + i * blksize;
+
+		if (batch.blocks[i].hole) {
+			i++;
+			continue;
+		}
+		for (j = i; j < end && !batch.blocks[j].hole; j++)
+			sz += batch.blocks[j].out;
+		i = j;
+
+		while (sz) {
+			ssize_t rc = pwrite(outfd, p, sz, off);
+
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc < 0)
+				err(FSCK_EX_ERROR, _("write failed: %s"), f->path);
+			p += rc;
+			off += rc;
+			sz -= rc;
+		}
+	}
+}
+
+static void flush_batch(void)
+{
+	size_t i, j;
+
+	if (batch.nblocks > batch.out_alloc) {
+		free(batch.out);
+		batch.out_alloc = batch.nblocks_alloc;
+		batch.out = xmalloc(batch.out_alloc * blksize);
+	}
+	if (batch.nblocks)
+		ul_run_ranges(batch.nblocks, UNCOMPRESS_PERTHREAD, 0,
+			      uncompress_blocks, &batch);
+
+	for (i = 0; i < batch.nfiles; i++) {
+		struct uncompress_file *f = &batch.files[i];
+
+		for (j = f->first; j < f->first + f->nblocks; j++) {
+			struct uncompress_block *b = &batch.blocks[j];
+
+			if (b->toolarge)
+				errx(FSCK_EX_UNCORRECTED, _("data block too large"));
+			if (!b->hole && b->zerr != Z_STREAM_END)
+				errx(FSCK_EX_UNCORRECTED, _("decompression error: %s"),
+				     zError(b->zerr));
+			if (b->size == blksize) {
+				if (b->out != blksize)
+					errx(FSCK_EX_UNCORRECTED,
+					     _("non-block (%ld) bytes"), b->out);
+			} else if (b->out != b->size)
+				errx(FSCK_EX_UNCORRECTED,
+				     _("non-size (%ld vs %ld) bytes"), b->out,
+				     b->size);
+		}
+
+		if (*extract_dir != '\0') {
+			int outfd = open(f->path, O_WRONLY | O_CREAT | O_TRUNC,
+					 f->inode.mode);
+			if (outfd < 0)
+				err(FSCK_EX_ERROR, _("cannot open %s"), f->path);
+			write_file_data(f, outfd);
+			if (close_fd(outfd) != 0)
+				err(FSCK_EX_ERROR, _("write failed: %s"), f->path);
+			change_file_status(f->path, &f->inode);
+		}
+		free(f->path);
+	}
+	batch.nfiles = 0;
+	batch.nblocks = 0;
+}
+
+static void free_batch(void)
+{
+	free(batch.files);
+	free(batch.blocks);
+	free(batch.out);
+	memset(&batch, 0, sizeof(batch));
+}
+
+/* checks the block pointers and adds the file blocks to the batch */
+static void queue_file(char *path, struct cramfs_inode *i)
+{
+	unsigned long offset = i->offset << 2;
+	unsigned long size = i->size;
 	unsigned long curr = offset + 4 * ((size + blksize - 1) / blksize);
+	unsigned long nblocks = (size + blksize - 1) / blksize;
+	struct uncompress_file *f;
+
+	if (batch.nblocks && batch.nblocks + nblocks > UNCOMPRESS_BATCH)
+		flush_batch();
 
-	do {
-		unsigned long out = blksize;
+	if (batch.nfiles == batch.nfiles_alloc) {
+		batch.nfiles_alloc = batch.nfiles_alloc ? batch.nfiles_alloc * 2 : 256;
+		batch.files = xrealloc(batch.files,
+				batch.nfiles_alloc * sizeof(struct uncompress_file));
+	}
+	if (batch.nblocks + nblocks > batch.nblocks_alloc) {
+		batch.nblocks_alloc = max(batch.nblocks + nblocks,
+					  (unsigned long) UNCOMPRESS_BATCH);
+		batch.blocks = xrealloc(batch.blocks,
+				batch.nblocks_alloc * sizeof(struct uncompress_block));
+	}
+
+	f = &batch.files[batch.nfiles++];
+	f->path = xstrdup(path);
+	f->inode = *i;
+	f->first = batch.nblocks;
+	f->nblocks = nblocks;
+
+	while (size) {
+		struct uncompress_block *b = &batch.blocks[batch.nblocks++];
 		unsigned long next = u32_toggle_endianness(cramfs_is_big_endian,
 							   *(uint32_t *)
 							   romfs_read(offset));
@@ -386,52 +614,24 @@ static void do_uncompress(char *path, int outfd, unsigned long offset,
 		if (next > end_data)
 			end_data = next;
 
+		memset(b, 0, sizeof(*b));
+		b->curr = curr;
+		b->next = next;
+		b->size = min(size, (unsigned long) blksize);
+
 		offset += 4;
 		if (curr == next) {
 			if (opt_verbose > 1)
 				printf(_("  hole at %lu (%zu)\n"), curr,
 				       blksize);
-			if (size < blksize)
-				out = size;
-			memset(outbuffer, 0x00, out);
-		} else {
-			if (opt_verbose > 1)
-				printf(_("  uncompressing block at %lu to %lu (%lu)\n"),
-				       curr, next, next - curr);
-			out = uncompress_block(romfs_read(curr), next - curr);
-		}
-		if (size >= blksize) {
-			if (out != blksize)
-				errx(FSCK_EX_UNCORRECTED,
-				     _("non-block (%ld) bytes"), out);
-		} else {
-			if (out != size)
-				errx(FSCK_EX_UNCORRECTED,
-				     _("non-size (%ld vs %ld) bytes"), out,
-				     size);
-		}
-		size -= out;
-		if (*extract_dir != '\0' && write(outfd, outbuffer, out) < 0)
-			err(FSCK_EX_ERROR, _("write failed: %s"), path);
-		curr = next;
-	} while (size);
-}
-static void change_file_status(char *path, struct cramfs_inode *i)
-{
-	const struct timeval epoch[] = { {0,0}, {0,0} };
+			b->hole = 1;
+		} else if (opt_verbose > 1)
+			printf(_("  uncompressing block at %lu to %lu (%lu)\n"),
+			       curr, next, next - curr);
 
-	if (euid == 0) {
-		if (lchown(path, i->uid, i->gid) < 0)
-			err(FSCK_EX_ERROR, _("lchown failed: %s"), path);
-		if (S_ISLNK(i->mode))
-			return;
-		if (((S_ISUID | S_ISGID) & i->mode) && chmod(path, i->mode) < 0)
-			err(FSCK_EX_ERROR, _("chown failed: %s"), path);
+		size -= b->size;
+		curr = next;
 	}
-	if (S_ISLNK(i->mode))
-		return;
-	if (utimes(path, epoch) < 0)
-		err(FSCK_EX_ERROR, _("utimes failed: %s"), path);
 }
 
 static void do_directory(char *path, struct cramfs_inode *i)
@@ -493,7 +693,6 @@ static void do_directory(char *path, struct cramfs_inode *i)
 static void do_file(char *path, struct cramfs_inode *i)
 {
 	unsigned long offset = i->offset << 2;
-	int outfd = 0;
 
 	if (offset == 0 && i->size != 0)
 		errx(FSCK_EX_UNCORRECTED,
@@ -505,18 +704,8 @@ static void do_file(char *path, struct cramfs_inode *i)
 		start_data = offset;
 	if (opt_verbose)
 		print_node('f', i, path);
-	if (*extract_dir != '\0') {
-		outfd = open(path, O_WRONLY | O_CREAT | O_TRUNC, i->mode);
-		if (outfd < 0)
-			err(FSCK_EX_ERROR, _("cannot open %s"), path);
-	}
-	if (i->size)
-		do_uncompress(path, outfd, offset, i->size);
-	if ( *extract_dir != '\0') {
-		if (close_fd(outfd) != 0)
-			err(FSCK_EX_ERROR, _("write failed: %s"), path);
-		change_file_status(path, i);
-	}
+	if (i->size || *extract_dir != '\0')
+		queue_file(path, i);
 }
 
 static void do_symlink(char *path, struct cramfs_inode *i)
@@ -623,6 +812,8 @@ static void test_fs(int start)
 	stream.avail_in = 0;
 	inflateInit(&stream);
 	expand_fs(extract_dir, root);
+	flush_batch();
+	free_batch();
 	inflateEnd(&stream);
 	if (start_data != ~0UL) {
 		if (start_data < (sizeof(struct cramfs_super) + start))
@@ -1389,17 +1389,17 @@ main(int argc, char **argv) {
 		check();
 	}
 	if (verbose) {
-		unsigned long inode, free;
+		unsigned long free;
 
-		for (inode = 1, free = 0; inode <= get_ninodes(); inode++)
-			if (!inode_in_use(inode))
-				free++;
+		free = get_ninodes() - bitmap_count_range(inode_map, 1, get_ninodes() + 1);
 		printf(_("\n%6ld inodes used (%ld%%)\n"),
 		       (get_ninodes() - free),
 		       100 * (get_ninodes() - free) / get_ninodes());
-		for (inode = get_first_zone(), free = 0; inode < get_nzones(); inode++)
-			if (!zone_in_use(inode))
-				free++;
+		/* zone_map bit 1 is the first zone */
+		free = get_nzones() - get_first_zone();
+		if (get_nzones() > (unsigned long) get_first_zone())
+			free -= bitmap_count_range(zone_map, 1,
+					get_nzones() - get_first_zone() + 1);
 		printf(_("%6ld zones used (%ld%%)\n"), (get_nzones() - free),
 		       100 * (get_nzones() - free) / get_nzones());
 		printf(_("\n%6d regular files\n"
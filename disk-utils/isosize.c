@@ -34,30 +34,36 @@
 #define ISOSIZE_EXIT_ALLFAILED	32
 #define ISOSIZE_EXIT_SOMEOK	64
 
-static int is_iso(int fd)
-{
-	char label[8];
+/* the primary volume descriptor is the 16th 2048-byte sector */
+#define ISO_SECTOR_SIZE		2048
+#define ISO_PVD_OFFSET		(16 * ISO_SECTOR_SIZE)
 
-	if (pread(fd, &label, 8, 0x8000) == -1)
-		return 1;
-	return memcmp(&label, &"\1CD001\1", 8);
-}
+/* offsets within the primary volume descriptor */
+#define ISO_PVD_LABEL		0x00	/* type, "CD001" and version, 8 bytes */
+#define ISO_PVD_SPACE_SIZE	0x50	/* volume space size, 8 bytes */
+#define ISO_PVD_BLOCK_SIZE	0x80	/* logical block size, 4 bytes */
+#define ISO_PVD_MINSIZE		(ISO_PVD_BLOCK_SIZE + 4)
 
 static int isosize(int argc, char *filenamep, int xflag, long divisor)
 {
+	/* the whole sector is read by one pread(), aligned for block devices */
+	static unsigned char pvd[ISO_SECTOR_SIZE]
+			__attribute__((__aligned__(ISO_SECTOR_SIZE)));
 	int fd, nsecs, ssize, rc = -1;
-	unsigned char volume_space_size[8];
-	unsigned char logical_block_size[4];
+	ssize_t sz;
 
-	if ((fd = open(filenamep, O_RDONLY)) < 0) {
+	if ((fd = open(filenamep, O_RDONLY | O_CLOEXEC)) < 0) {
 		warn(_("cannot open %s"), filenamep);
 		goto done;
 	}
-	if (is_iso(fd))
+
+	errno = 0;
+	sz = pread(fd, pvd, sizeof(pvd), ISO_PVD_OFFSET);
+
+	if (sz < 8 || memcmp(pvd + ISO_PVD_LABEL, "\1CD001\1", 8) != 0)
 		warnx(_("%s: might not be an ISO filesystem"), filenamep);
 
-	if (pread(fd, volume_space_size, sizeof(volume_space_size), 0x8050) != sizeof(volume_space_size) ||
-	    pread(fd, logical_block_size, sizeof(logical_block_size), 0x8080) != sizeof(logical_block_size)) {
+	if (sz < ISO_PVD_MINSIZE) {
 		if (errno)
 			warn(_("read error on %s"), filenamep);
 		else
@@ -65,9 +71,9 @@ static int isosize(int argc, char *filenamep, int xflag, long divisor)
 		goto done;
 	}
 
-	nsecs = isonum_733(volume_space_size, xflag);
+	nsecs = isonum_733(pvd + ISO_PVD_SPACE_SIZE, xflag);
 	/* isonum_723 returns nowadays always 2048 */
-	ssize = isonum_723(logical_block_size, xflag);
+	ssize = isonum_723(pvd + ISO_PVD_BLOCK_SIZE, xflag);
 
 	if (1 < argc)
 		printf("%s: ", filenamep);
@@ -56,6 +56,7 @@
 
 #define XALLOC_EXIT_CODE MKFS_EX_ERROR
 #include "xalloc.h"
+#include "ranges.h"
 
 /* The kernel only supports PAD_SIZE of 0 and 512. */
 #define PAD_SIZE 512
@@ -105,6 +106,7 @@ struct entry {
 	char *path;
 	int fd;			    /* temporarily open files while mmapped */
 	struct entry *same;	    /* points to other identical file */
+	struct entry *hash_next;    /* files with the same size and md5 */
 	unsigned int offset;        /* pointer to compressed data in archive */
 	unsigned int dir_offset;    /* offset of directory entry in archive */
 
@@ -242,38 +244,110 @@ identical_file(struct entry *e1, struct entry *e2){
  */
 #define MAX_INPUT_NAMELEN 255
 
-static int find_identical_file(struct entry *orig, struct entry *new, loff_t *fslen_ub)
+#define DIGEST_PERTHREAD	16	/* min number of files per thread */
+#define DOUBLES_HASHSZ_MIN	64
+
+/* adds files with data in the tree order */
+static void collect_files(struct entry *e, struct entry ***files,
+			  size_t *nfiles, size_t *nalloc)
 {
-	if (orig == new)
-		return 1;
-	if (!orig)
-		return 0;
-	if (orig->size == new->size && orig->path) {
-		if (!orig->flags)
-			mdfile(orig);
-		if (!new->flags)
-			mdfile(new);
-
-		if ((orig->flags & CRAMFS_EFLAG_MD5) &&
-		    (new->flags & CRAMFS_EFLAG_MD5) &&
-		    !memcmp(orig->md5sum, new->md5sum, UL_MD5LENGTH) &&
-		    identical_file(orig, new)) {
-			new->same = orig;
-			*fslen_ub -= new->size;
-			return 1;
+	for (; e; e = e->next) {
+		if (e->size && e->path) {
+			if (*nfiles == *nalloc) {
+				*nalloc = *nalloc ? *nalloc * 2 : 1024;
+				*files = xrealloc(*files, *nalloc * sizeof(struct entry *));
+			}
+			(*files)[(*nfiles)++] = e;
 		}
+		if (e->child)
+			collect_files(e->child, files, nfiles, nalloc);
 	}
-	return find_identical_file(orig->child, new, fslen_ub) ||
-		   find_identical_file(orig->next, new, fslen_ub);
 }
 
-static void eliminate_doubles(struct entry *root, struct entry *orig, loff_t *fslen_ub) {
-	if (orig) {
-		if (orig->size && orig->path)
-			find_identical_file(root,orig, fslen_ub);
-		eliminate_doubles(root,orig->child, fslen_ub);
-		eliminate_doubles(root,orig->next, fslen_ub);
+static int cmp_entry_size(const void *a, const void *b)
+{
+	const struct entry *e1 = *(struct entry * const *) a;
+	const struct entry *e2 = *(struct entry * const *) b;
+
+	return e1->size < e2->size ? -1 : e1->size > e2->size ? 1 : 0;
+}
+
+static void digest_files(void *data, size_t range __attribute__((__unused__)),
+			 size_t first, size_t last)
+{
+	struct entry **files = data;
+	size_t i;
+
+	for (i = first; i < last; i++)
+		mdfile(files[i]);
+}
+
+static size_t doubles_hash(const struct entry *e, size_t hashsz)
+{
+	uint64_t x;
+
+	memcpy(&x, e->md5sum, sizeof(x));
+	x ^= e->size;
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x & (hashsz - 1);
+}
+
+/*
+ * Links every file to the first (in the tree order) identical file. Only
+ * the files with the same size as another file are digested (by more
+ * threads) and the candidates are found by (size, md5) hash.
+ */
+static void eliminate_doubles(struct entry *root, loff_t *fslen_ub)
+{
+	struct entry **files = NULL, **cands, **hash;
+	size_t i, nfiles = 0, nalloc = 0, ncands = 0, hashsz;
+
+	collect_files(root, &files, &nfiles, &nalloc);
+	if (nfiles < 2)
+		goto done;
+
+	/* files with unique size can't have a duplicate */
+	cands = xmalloc(nfiles * sizeof(struct entry *));
+	memcpy(cands, files, nfiles * sizeof(struct entry *));
+	qsort(cands, nfiles, sizeof(struct entry *), cmp_entry_size);
+	for (i = 0; i < nfiles; i++) {
+		if ((i > 0 && cands[i - 1]->size == cands[i]->size) ||
+		    (i + 1 < nfiles && cands[i + 1]->size == cands[i]->size))
+			cands[ncands++] = cands[i];
+	}
+	ul_run_ranges(ncands, DIGEST_PERTHREAD, 0, digest_files, cands);
+	free(cands);
+
+	for (hashsz = DOUBLES_HASHSZ_MIN; hashsz < ncands; )
+		hashsz *= 2;
+	hash = xcalloc(hashsz, sizeof(struct entry *));
+
+	for (i = 0; i < nfiles; i++) {
+		struct entry *e = files[i], **pp;
+
+		if (!(e->flags & CRAMFS_EFLAG_MD5))
+			continue;
+
+		/* the chain is in the tree order, the first identical wins */
+		for (pp = &hash[doubles_hash(e, hashsz)]; *pp; pp = &(*pp)->hash_next) {
+			struct entry *orig = *pp;
+
+			if (orig->size == e->size &&
+			    !memcmp(orig->md5sum, e->md5sum, UL_MD5LENGTH) &&
+			    identical_file(orig, e)) {
+				e->same = orig;
+				*fslen_ub -= e->size;
+				break;
+			}
+		}
+		if (!e->same)
+			*pp = e;	/* the first file with this content */
 	}
+	free(hash);
+done:
+	free(files);
 }
 
 /*
@@ -552,6 +626,93 @@ static int is_zero(unsigned char const *begin, unsigned len)
 		return 0;
 }
 
+/*
+ * The data blocks are compressed in batches by more threads. The files are
+ * mmapped and split to blocks in the tree order, every thread compresses a
+ * continuous range of the batch blocks to the per-block buffers, and then
+ * the batch is assembled to the image in the original order, so the result
+ * is the same as for the serial compression.
+ */
+#define COMPRESS_PERTHREAD	32	/* min number of blocks per thread */
+#define COMPRESS_BATCH		4096	/* blocks per batch (larger for huge files) */
+
+struct compress_block {
+	const Bytef	*src;
+	uLongf		srclen;
+	uLongf		len;		/* compressed size */
+	unsigned int	hole : 1;
+};
+
+struct compress_file {
+	struct entry	*entry;
+	char		*start;		/* mmapped data or NULL */
+	size_t		first;		/* first block in batch */
+	size_t		nblocks;
+};
+
+struct compress_batch {
+	struct compress_file	*files;
+	size_t			nfiles;
+	size_t			nfiles_alloc;
+
+	struct compress_block	*blocks;
+	size_t			nblocks;
+	size_t			nblocks_alloc;
+
+	Bytef			*out;		/* 2 * blksize per block */
+	size_t			out_alloc;	/* in blocks */
+};
+
+static inline Bytef *block_buffer(struct compress_batch *cb, size_t i)
+{
+	return cb->out + i * 2 * blksize;
+}
+
+static void compress_blocks(void *data, size_t range __attribute__((__unused__)),
+			    size_t first, size_t last)
+{
+	struct compress_batch *cb = data;
+	size_t i;
+
+	for (i = first; i < last; i++) {
+		struct compress_block *b = &cb->blocks[i];
+
+		b->len = 2 * blksize;
+		b->hole = is_zero(b->src, b->srclen) ? 1 : 0;
+		if (!b->hole)
+			compress(block_buffer(cb, i), &b->len, b->src, b->srclen);
+	}
+}
+
+/* adds file to the batch, @start is NULL for not readable or same files */
+static void batch_add_file(struct compress_batch *cb, struct entry *e, char *start)
+{
+	struct compress_file *f;
+	size_t i;
+
+	if (cb->nfiles == cb->nfiles_alloc) {
+		cb->nfiles_alloc = cb->nfiles_alloc ? cb->nfiles_alloc * 2 : 256;
+		cb->files = xrealloc(cb->files, cb->nfiles_alloc * sizeof(*f));
+	}
+	f = &cb->files[cb->nfiles++];
+	f->entry = e;
+	f->start = start;
+	f->first = cb->nblocks;
+	f->nblocks = start ? (e->size - 1) / blksize + 1 : 0;
+
+	if (cb->nblocks + f->nblocks > cb->nblocks_alloc) {
+		cb->nblocks_alloc = max(cb->nblocks + f->nblocks, (size_t) COMPRESS_BATCH);
+		cb->blocks = xrealloc(cb->blocks, cb->nblocks_alloc * sizeof(*cb->blocks));
+	}
+	for (i = 0; i < f->nblocks; i++) {
+		struct compress_block *b = &cb->blocks[cb->nblocks++];
+		size_t off = i * blksize;
+
+		b->src = (Bytef *) start + off;
+		b->srclen = min((size_t) blksize, e->size - off);
+	}
+}
+
 /*
  * One 4-byte pointer per block and then the actual blocked
  * output. The first block does not need an offset pointer,
@@ -563,52 +724,38 @@ static int is_zero(unsigned char const *begin, unsigned len)
  * have gotten here in the first place.
  */
 static unsigned int
-do_compress(char *base, unsigned int offset, unsigned char const *name,
-	    char *path, unsigned int size, unsigned int mode)
+write_compressed(struct compress_batch *cb, struct compress_file *f,
+		 char *base, unsigned int offset)
 {
-	unsigned long original_size, original_offset, new_size, blocks, curr;
+	unsigned long original_size, original_offset, new_size, curr;
+	struct entry *e = f->entry;
 	long change;
-	char *start;
-	Bytef *p;
-
-	/* get uncompressed data */
-	start = do_mmap(path, size, mode);
-	if (start == NULL)
-		return offset;
-	p = (Bytef *) start;
+	size_t i;
 
-	original_size = size;
+	original_size = e->size;
 	original_offset = offset;
-	blocks = (size - 1) / blksize + 1;
-	curr = offset + 4 * blocks;
-
-	total_blocks += blocks;
-
-	do {
-		uLongf len = 2 * blksize;
-		uLongf input = size;
-		if (input > blksize)
-			input = blksize;
-		size -= input;
-		if (!is_zero (p, input)) {
-			compress((Bytef *)(base + curr), &len, p, input);
-			curr += len;
-		}
-		p += input;
-
-		if (len > blksize*2) {
-			/* (I don't think this can happen with zlib.) */
-			printf(_("AIEEE: block \"compressed\" to > "
-				 "2*blocklength (%ld)\n"),
-			       len);
-			exit(MKFS_EX_ERROR);
+	curr = offset + 4 * f->nblocks;
+
+	total_blocks += f->nblocks;
+
+	for (i = f->first; i < f->first + f->nblocks; i++) {
+		struct compress_block *b = &cb->blocks[i];
+
+		if (!b->hole) {
+			if (b->len > blksize*2) {
+				/* (I don't think this can happen with zlib.) */
+				printf(_("AIEEE: block \"compressed\" to > "
+					 "2*blocklength (%ld)\n"),
+				       b->len);
+				exit(MKFS_EX_ERROR);
+			}
+			memcpy(base + curr, block_buffer(cb, i), b->len);
+			curr += b->len;
 		}
 
 		*(uint32_t *) (base + offset) = u32_toggle_endianness(cramfs_is_big_endian, curr);
 		offset += 4;
-	} while (size);
-
-	do_munmap(start, original_size, mode);
+	}
 
 	curr = (curr + 3) & ~3;
 	new_size = curr - original_offset;
@@ -618,11 +765,46 @@ do_compress(char *base, unsigned int offset, unsigned char const *name,
 	change = new_size - original_size;
 	if (verbose)
 		printf(_("%6.2f%% (%+ld bytes)\t%s\n"),
-		       (change * 100) / (double) original_size, change, name);
+		       (change * 100) / (double) original_size, change, e->name);
 
 	return curr;
 }
 
+/* compresses the batch blocks and writes the files to the image */
+static unsigned int
+write_batch(struct compress_batch *cb, char *base, unsigned int offset)
+{
+	size_t i;
+
+	if (cb->nblocks > cb->out_alloc) {
+		free(cb->out);
+		cb->out_alloc = cb->nblocks_alloc;
+		cb->out = xmalloc(cb->out_alloc * 2 * blksize);
+	}
+	if (cb->nblocks)
+		ul_run_ranges(cb->nblocks, COMPRESS_PERTHREAD, 0,
+			      compress_blocks, cb);
+
+	for (i = 0; i < cb->nfiles; i++) {
+		struct compress_file *f = &cb->files[i];
+		struct entry *e = f->entry;
+
+		if (e->same) {
+			set_data_offset(e, base, e->same->offset);
+			e->offset = e->same->offset;
+			continue;
+		}
+		set_data_offset(e, base, offset);
+		e->offset = offset;
+		if (f->start) {
+			offset = write_compressed(cb, f, base, offset);
+			do_munmap(f->start, e->size, e->mode);
+		}
+	}
+	cb->nfiles = 0;
+	cb->nblocks = 0;
+	return offset;
+}
 
 /*
  * Traverse the entry tree, writing data for every item that has
@@ -630,26 +812,43 @@ do_compress(char *base, unsigned int offset, unsigned char const *name,
  * regfile).
  */
 static unsigned int
-write_data(struct entry *entry, char *base, unsigned int offset) {
+queue_data(struct compress_batch *cb, struct entry *entry, char *base,
+	   unsigned int offset)
+{
 	struct entry *e;
 
 	for (e = entry; e; e = e->next) {
 		if (e->path) {
-			if (e->same) {
-				set_data_offset(e, base, e->same->offset);
-				e->offset = e->same->offset;
-			} else if (e->size) {
-				set_data_offset(e, base, offset);
-				e->offset = offset;
-				offset = do_compress(base, offset, e->name,
-						     e->path, e->size,e->mode);
+			if (e->same)
+				batch_add_file(cb, e, NULL);
+			else if (e->size) {
+				if (cb->nblocks >= COMPRESS_BATCH)
+					offset = write_batch(cb, base, offset);
+				batch_add_file(cb, e,
+					do_mmap(e->path, e->size, e->mode));
 			}
 		} else if (e->child)
-			offset = write_data(e->child, base, offset);
+			offset = queue_data(cb, e->child, base, offset);
 	}
 	return offset;
 }
 
+static unsigned int
+write_data(struct entry *entry, char *base, unsigned int offset)
+{
+	struct compress_batch cb;
+
+	memset(&cb, 0, sizeof(cb));
+
+	offset = queue_data(&cb, entry, base, offset);
+	offset = write_batch(&cb, base, offset);
+
+	free(cb.files);
+	free(cb.blocks);
+	free(cb.out);
+	return offset;
+}
+
 static unsigned int write_file(char *file, char *base, unsigned int offset)
 {
 	int fd;
@@ -806,7 +1005,7 @@ int main(int argc, char **argv)
 	root_entry->size = parse_directory(root_entry, dirname, &root_entry->child, &fslen_ub);
 
 	/* find duplicate files */
-	eliminate_doubles(root_entry,root_entry, &fslen_ub);
+	eliminate_doubles(root_entry, &fslen_ub);
 
 	/* always allocate a multiple of blksize bytes because that's
 	   what we're going to write later on */
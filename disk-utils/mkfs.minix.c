@@ -68,6 +68,7 @@
 #include <err.h>
 
 #include "blkdev.h"
+#include "bitops.h"
 #include "minix_programs.h"
 #include "nls.h"
 #include "pathnames.h"
@@ -225,8 +226,10 @@ static int get_free_block(struct fs_control *ctl) {
 		blk = good_blocks_table[ctl->fs_used_blocks - 1] + 1;
 	else
 		blk = first_zone;
-	while (blk < zones && zone_in_use(blk))
-		blk++;
+	/* zone_map bit 1 is the first zone */
+	if (blk < zones)
+		blk = bitmap_find_next(zone_map, blk - first_zone + 1,
+				       zones - first_zone + 1, 0) + first_zone - 1;
 	if (blk >= zones)
 		errx(MKFS_EX_ERROR, _("%s: not enough good blocks"), ctl->device_name);
 	good_blocks_table[ctl->fs_used_blocks] = blk;
@@ -247,10 +250,13 @@ static inline int next(unsigned long zone) {
 
 	if (!zone)
 		zone = first_zone-1;
-	while (++zone < zones)
-		if (zone_in_use(zone))
-			return zone;
-	return 0;
+	if (++zone >= zones)
+		return 0;
+
+	/* zone_map bit 1 is the first zone */
+	zone = bitmap_find_next(zone_map, zone - first_zone + 1,
+				zones - first_zone + 1, 1) + first_zone - 1;
+	return zone < zones ? zone : 0;
 }
 
 static void make_bad_inode_v1(struct fs_control *ctl)
@@ -494,7 +500,7 @@ static void super_set_magic(const struct fs_control *ctl)
 }
 
 static void setup_tables(const struct fs_control *ctl) {
-	unsigned long inodes, zmaps, imaps, zones, i;
+	unsigned long inodes, zmaps, imaps, zones;
 
 	super_block_buffer = xcalloc(1, MINIX_BLOCK_SIZE);
 
@@ -555,10 +561,9 @@ static void setup_tables(const struct fs_control *ctl) {
 	memset(inode_map,0xff,imaps * MINIX_BLOCK_SIZE);
 	memset(zone_map,0xff,zmaps * MINIX_BLOCK_SIZE);
 
-	for (i = get_first_zone() ; i<zones ; i++)
-		unmark_zone(i);
-	for (i = MINIX_ROOT_INO ; i<=inodes; i++)
-		unmark_inode(i);
+	if (zones > (unsigned long) get_first_zone())
+		bitmap_set_range(zone_map, 1, zones - get_first_zone() + 1, 0);
+	bitmap_set_range(inode_map, MINIX_ROOT_INO, inodes + 1, 0);
 
 	inode_buffer = xmalloc(get_inode_buffer_size());
 	memset(inode_buffer,0, get_inode_buffer_size());
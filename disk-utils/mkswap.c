@@ -35,6 +35,7 @@
 #include "c.h"
 #include "closestream.h"
 #include "ismounted.h"
+#include "uring.h"
 
 #ifdef HAVE_LIBUUID
 # include <uuid.h>
@@ -179,31 +180,181 @@ static void page_bad(struct mkswap_control *ctl, unsigned int page)
 	ctl->nbadpages++;
 }
 
+/*
+ * The area is read by large O_DIRECT chunks, CHECK_NBUFS reads are kept in
+ * flight by io_uring (if available). The pages are read one by one only
+ * within the chunks where the read failed.
+ */
+#define CHECK_CHUNK_SZ	(4 * 1024 * 1024)
+#define CHECK_NBUFS	4
+
+enum {
+	CHECK_CHUNK_FREE = 0,
+	CHECK_CHUNK_READING,
+	CHECK_CHUNK_DONE
+};
+
+struct check_chunk {
+	char			*buf;
+	unsigned long long	page;		/* first page */
+	size_t			size;		/* in bytes */
+	ssize_t			res;		/* read() result or -errno */
+	int			state;		/* CHECK_CHUNK_* */
+};
+
+struct check_data {
+	struct mkswap_control	*ctl;
+	int			fd;		/* O_DIRECT or ctl->fd */
+	struct ul_uring		ring;
+	size_t			chunk_pages;	/* pages per chunk */
+	unsigned long long	nchunks;
+	unsigned long long	nsubmitted;
+	unsigned long long	nchecked;
+	size_t			nqueued;	/* uring requests in flight */
+	int			progress;	/* last reported percent or -1 */
+
+	struct check_chunk	chunks[CHECK_NBUFS];
+};
+
+static void check_submit(struct check_data *cd, struct check_chunk *ck)
+{
+	struct mkswap_control *ctl = cd->ctl;
+	off_t off;
+
+	ck->page = cd->nsubmitted * cd->chunk_pages;
+	ck->size = min((unsigned long long) cd->chunk_pages, ctl->npages - ck->page)
+			* ctl->pagesize;
+	ck->state = CHECK_CHUNK_READING;
+	off = (off_t) ck->page * ctl->pagesize;
+
+	if (ul_uring_is_ready(&cd->ring)
+	    && ul_uring_prep_rw(&cd->ring, UL_URING_READ, cd->fd, ck->buf,
+				ck->size, off, ck - cd->chunks) == 0) {
+		cd->nqueued++;
+		return;
+	}
+
+	do {
+		ck->res = pread(cd->fd, ck->buf, ck->size, off);
+	} while (ck->res < 0 && errno == EINTR);
+	if (ck->res < 0)
+		ck->res = -errno;
+	ck->state = CHECK_CHUNK_DONE;
+}
+
+static void check_wait(struct check_data *cd)
+{
+	uint64_t id;
+	int res;
+
+	if (!cd->nqueued)
+		return;
+	if (ul_uring_submit(&cd->ring, 1) < 0)
+		err(EXIT_FAILURE, _("read failed in check_blocks"));
+
+	while (ul_uring_get_completion(&cd->ring, &id, &res) == 1) {
+		cd->nqueued--;
+		if (id < CHECK_NBUFS) {
+			cd->chunks[id].res = res;
+			cd->chunks[id].state = CHECK_CHUNK_DONE;
+		}
+	}
+}
+
+/* verifies the chunk, the pages of the failed chunk are read one by one */
+static void check_chunk(struct check_data *cd, struct check_chunk *ck)
+{
+	struct mkswap_control *ctl = cd->ctl;
+	size_t i, npages = ck->size / ctl->pagesize;
+
+	if (ck->res != (ssize_t) ck->size) {
+		i = ck->res > 0 ? (size_t) ck->res / ctl->pagesize : 0;
+
+		for (; i < npages; i++) {
+			off_t off = (off_t) (ck->page + i) * ctl->pagesize;
+
+			if (pread(ctl->fd, ck->buf, ctl->pagesize, off) != ctl->pagesize)
+				page_bad(ctl, ck->page + i);
+		}
+	}
+	ck->state = CHECK_CHUNK_FREE;
+}
+
+static void check_progress(struct check_data *cd)
+{
+	int percent;
+
+	if (cd->progress < 0)
+		return;
+	percent = cd->nchecked * 100 / cd->nchunks;
+	if (percent == cd->progress)
+		return;
+	cd->progress = percent;
+	printf(_("\rchecking for bad pages: %3d%%"), percent);
+	fflush(stdout);
+}
+
 static void check_blocks(struct mkswap_control *ctl)
 {
-	unsigned int current_page = 0;
-	int do_seek = 1;
-	char *buffer;
+	struct check_data cd = { .ctl = ctl, .fd = -1, .progress = -1 };
+	size_t i, align = max((size_t) getpagesize(), (size_t) ctl->pagesize);
 
 	assert(ctl);
 	assert(ctl->fd > -1);
 
-	buffer = xmalloc(ctl->pagesize);
-	while (current_page < ctl->npages) {
-		ssize_t rc;
-		off_t offset = (off_t) current_page * ctl->pagesize;
+	cd.chunk_pages = max(CHECK_CHUNK_SZ / ctl->pagesize, 1);
+	cd.nchunks = (ctl->npages + cd.chunk_pages - 1) / cd.chunk_pages;
 
-		if (do_seek && lseek(ctl->fd, offset, SEEK_SET) != offset)
-			errx(EXIT_FAILURE, _("seek failed in check_blocks"));
+	/* don't read the device by page cache; not supported by all files */
+	cd.fd = open(ctl->devname, O_RDONLY | O_DIRECT | O_CLOEXEC);
+	if (cd.fd < 0)
+		cd.fd = ctl->fd;
+	if (ul_uring_init(&cd.ring, CHECK_NBUFS) != 0)
+		memset(&cd.ring, 0, sizeof(cd.ring));
 
-		rc = read(ctl->fd, buffer, ctl->pagesize);
-		do_seek = (rc < 0 || rc != ctl->pagesize);
-		if (do_seek)
-			page_bad(ctl, current_page);
-		current_page++;
+	for (i = 0; i < CHECK_NBUFS; i++) {
+		if (posix_memalign((void **) &cd.chunks[i].buf, align,
+				   cd.chunk_pages * ctl->pagesize))
+			err(EXIT_FAILURE, _("cannot allocate memory"));
 	}
+	if (isatty(STDOUT_FILENO))
+		cd.progress = 0;
+
+	while (cd.nchecked < cd.nchunks) {
+		struct check_chunk *ck;
+
+		while (cd.nsubmitted < cd.nchunks
+		       && cd.nsubmitted - cd.nchecked < CHECK_NBUFS) {
+			ck = &cd.chunks[cd.nsubmitted % CHECK_NBUFS];
+			check_submit(&cd, ck);
+			cd.nsubmitted++;
+		}
+
+		ck = &cd.chunks[cd.nchecked % CHECK_NBUFS];
+		if (ck->state != CHECK_CHUNK_DONE)
+			check_wait(&cd);
+
+		/* the chunks are verified in order */
+		while (cd.nchecked < cd.nsubmitted) {
+			ck = &cd.chunks[cd.nchecked % CHECK_NBUFS];
+			if (ck->state != CHECK_CHUNK_DONE)
+				break;
+			check_chunk(&cd, ck);
+			cd.nchecked++;
+			check_progress(&cd);
+		}
+	}
+	if (cd.progress >= 0)
+		putchar('\n');
+
 	printf(P_("%lu bad page\n", "%lu bad pages\n", ctl->nbadpages), ctl->nbadpages);
-	free(buffer);
+
+	if (ul_uring_is_ready(&cd.ring))
+		ul_uring_deinit(&cd.ring);
+	if (cd.fd != ctl->fd)
+		close(cd.fd);
+	for (i = 0; i < CHECK_NBUFS; i++)
+		free(cd.chunks[i].buf);
 }
 
 /* return size in pages */
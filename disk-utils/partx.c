@@ -448,24 +448,133 @@ static void upd_parts_warnx(const char *device, int first, int last)
 				device, first, last);
 }
 
+/* partition as known by kernel */
+struct kernel_part {
+	int		partno;
+	uintmax_t	start;
+	uintmax_t	size;
+};
+
+static int cmp_kernel_parts(const void *a, const void *b)
+{
+	return cmp_numbers(((const struct kernel_part *) a)->partno,
+			   ((const struct kernel_part *) b)->partno);
+}
+
+/*
+ * Reads all partitions of the whole-disk @devno from /sys by one readdir(),
+ * the result is sorted by partition number. Returns 0 on success or <0 if
+ * the partitions are not available in /sys.
+ */
+static int read_kernel_parts(dev_t devno, struct kernel_part **parts, size_t *nparts)
+{
+	struct path_cxt *pc;
+	struct kernel_part *ary = NULL;
+	size_t n = 0, nalloc = 0;
+	struct dirent *d;
+	DIR *dir;
+
+	*parts = NULL;
+	*nparts = 0;
+
+	if (!devno)
+		return -EINVAL;
+	pc = ul_new_sysfs_path(devno, NULL, NULL);
+	if (!pc)
+		return -ENOMEM;
+	dir = ul_path_opendir(pc, NULL);
+	if (!dir) {
+		ul_unref_path(pc);
+		return -errno;
+	}
+
+	while ((d = readdir(dir))) {
+		char partno[32], start[32], size[32];
+		struct ul_path_attr attrs[] = {
+			{ .name = "partition", .buf = partno, .bufsz = sizeof(partno) },
+			{ .name = "start", .buf = start, .bufsz = sizeof(start) },
+			{ .name = "size", .buf = size, .bufsz = sizeof(size) }
+		};
+
+		if (!sysfs_blkdev_is_partition_dirent(dir, d, NULL))
+			continue;
+		if (ul_path_read_attrs(pc, d->d_name, attrs, ARRAY_SIZE(attrs))
+						!= ARRAY_SIZE(attrs))
+			continue;
+		if (n == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			ary = xrealloc(ary, nalloc * sizeof(struct kernel_part));
+		}
+		ary[n].partno = strtol(partno, NULL, 10);
+		ary[n].start = strtoumax(start, NULL, 10);
+		ary[n].size = strtoumax(size, NULL, 10);
+		n++;
+	}
+	closedir(dir);
+	ul_unref_path(pc);
+
+	if (n)
+		qsort(ary, n, sizeof(struct kernel_part), cmp_kernel_parts);
+	*parts = ary;
+	*nparts = n;
+	return 0;
+}
+
+/* update of one partition */
+struct upd_part {
+	int		partno;
+	uintmax_t	start;
+	uintmax_t	size;
+	uintmax_t	ksize;		/* size in kernel */
+
+	unsigned int	del : 1,	/* delete from kernel */
+			resize : 1,	/* resize in kernel */
+			add : 1,	/* add to kernel */
+			failed : 1;
+};
+
+static void upd_part_failed(const char *device, struct upd_part *up)
+{
+	up->failed = 1;
+	if (verbose)
+		warn(_("%s: updating partition #%d failed"), device, up->partno);
+}
+
+/*
+ * Updates partitions according to the diff between on-disk partitions and
+ * the partitions known by kernel; unchanged partitions are not touched,
+ * partitions with the same start are resized, partitions removed from disk
+ * are deleted. The deletes are done first, then shrinks, grows and adds, so
+ * the new layout never overlaps the old layout in the kernel.
+ *
+ * If the kernel partitions are unknown (no /sys) then all partitions in the
+ * range are deleted and added again (or resized if they are in use).
+ */
 static int upd_parts(int fd, const char *device, dev_t devno,
 		     blkid_partlist ls, int lower, int upper)
 {
-	int n, nparts, rc = 0, errfirst = 0, errlast = 0, err;
-	blkid_partition par;
-	uintmax_t start, size;
+	int n, nparts, rc = 0, errfirst = 0, errlast = 0;
+	struct kernel_part *kparts = NULL;
+	struct upd_part *ups;
+	size_t nk = 0, k = 0, nups = 0, i;
+	int sysfs, grow;
 
 	assert(fd >= 0);
 	assert(device);
 	assert(ls);
 
+	sysfs = read_kernel_parts(devno, &kparts, &nk) == 0;
+
 	/* recount range by information in /sys, if on disk number of
 	 * partitions is greater than in /sys the use on-disk limit */
 	nparts = blkid_partlist_numof_partitions(ls);
 	if (!lower)
 		lower = 1;
 	if (!upper || lower < 0 || upper < 0) {
-		n = get_max_partno(device, devno);
+		if (sysfs)
+			n = nk ? kparts[nk - 1].partno : 0;
+		else
+			n = get_max_partno(device, devno);
 		if (!upper)
 			upper = n > nparts ? n : nparts;
 		else if (upper < 0)
@@ -476,49 +585,123 @@ static int upd_parts(int fd, const char *device, dev_t devno,
 	if (lower > upper) {
 		warnx(_("specified range <%d:%d> "
 			"does not make sense"), lower, upper);
+		free(kparts);
 		return -1;
 	}
 
+	/* diff */
+	ups = xcalloc(upper - lower + 1, sizeof(struct upd_part));
+
 	for (n = lower; n <= upper; n++) {
+		struct upd_part *up = &ups[nups];
+		struct kernel_part *kp = NULL;
+		blkid_partition par;
+
+		if (sysfs) {
+			while (k < nk && kparts[k].partno < n)
+				k++;
+			if (k < nk && kparts[k].partno == n)
+				kp = &kparts[k];
+		}
+
+		up->partno = n;
 		par = blkid_partlist_get_partition_by_partno(ls, n);
 		if (!par) {
-			if (verbose)
-				warn(_("%s: no partition #%d"), device, n);
+			if (!kp) {
+				if (verbose)
+					warn(_("%s: no partition #%d"), device, n);
+				continue;
+			}
+			up->del = 1;		/* removed from disk */
+			nups++;
 			continue;
 		}
 
-		start = blkid_partition_get_start(par);
-		size =  blkid_partition_get_size(par);
-		if (blkid_partition_is_extended(par))
+		up->start = blkid_partition_get_start(par);
+		up->size =  blkid_partition_get_size(par);
+		if (blkid_partition_is_extended(par)) {
 			/*
 			 * Let's follow the Linux kernel and reduce
 			 * DOS extended partition to 1 or 2 sectors.
 			 */
-			size = min(size, (uintmax_t) 2);
+			up->size = min(up->size, (uintmax_t) 2);
 
-		err = partx_del_partition(fd, n);
-		if (err == -1 && errno == ENXIO)
-			err = 0; /* good, it already doesn't exist */
-		if (err == -1 && errno == EBUSY)
-		{
-			/* try to resize */
-			err = partx_resize_partition(fd, n, start, size);
-			if (verbose)
-				printf(_("%s: partition #%d resized\n"), device, n);
-			if (err == 0)
+			/* the kernel size depends on sector size */
+			if (kp && kp->start == up->start)
 				continue;
 		}
-		if (err == 0 && partx_add_partition(fd, n, start, size) == 0) {
-			if (verbose)
-				printf(_("%s: partition #%d added\n"), device, n);
+
+		if (!sysfs)
+			up->del = up->add = 1;
+		else if (!kp)
+			up->add = 1;
+		else if (kp->start != up->start)
+			up->del = up->add = 1;
+		else if (kp->size != up->size) {
+			up->resize = 1;
+			up->ksize = kp->size;
+		}
+		else
+			continue;	/* unchanged */
+		nups++;
+	}
+	free(kparts);
+
+	/* deletes */
+	for (i = 0; i < nups; i++) {
+		struct upd_part *up = &ups[i];
+
+		if (!up->del)
 			continue;
+		if (partx_del_partition(fd, up->partno) == 0) {
+			if (verbose && !up->add)
+				printf(_("%s: partition #%d removed\n"), device, up->partno);
+		} else if (!sysfs && errno == ENXIO)
+			;	/* good, it already doesn't exist */
+		else if (!sysfs && errno == EBUSY) {
+			/* try to resize */
+			up->add = 0;
+			up->resize = 1;
+		} else {
+			up->add = 0;
+			upd_part_failed(device, up);
+		}
+	}
+
+	/* shrinks and then grows */
+	for (grow = 0; grow < 2; grow++) {
+		for (i = 0; i < nups; i++) {
+			struct upd_part *up = &ups[i];
+
+			if (!up->resize || (up->size > up->ksize) != grow)
+				continue;
+			if (partx_resize_partition(fd, up->partno, up->start, up->size) == 0) {
+				if (verbose)
+					printf(_("%s: partition #%d resized\n"), device, up->partno);
+			} else
+				upd_part_failed(device, up);
 		}
+	}
+
+	/* adds */
+	for (i = 0; i < nups; i++) {
+		struct upd_part *up = &ups[i];
 
-		if (err == 0)
+		if (!up->add)
+			continue;
+		if (partx_add_partition(fd, up->partno, up->start, up->size) == 0) {
+			if (verbose)
+				printf(_("%s: partition #%d added\n"), device, up->partno);
+		} else
+			upd_part_failed(device, up);
+	}
+
+	for (i = 0; i < nups; i++) {
+		n = ups[i].partno;
+
+		if (!ups[i].failed)
 			continue;
 		rc = -1;
-		if (verbose)
-			warn(_("%s: updating partition #%d failed"), device, n);
 		if (!errfirst)
 			errlast = errfirst = n;
 		else if (errlast + 1 == n)
@@ -531,6 +714,7 @@ static int upd_parts(int fd, const char *device, dev_t devno,
 
 	if (errfirst)
 		upd_parts_warnx(device, errfirst, errlast);
+	free(ups);
 	return rc;
 }
 
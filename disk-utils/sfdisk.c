@@ -51,6 +51,7 @@
 #include "rpmatch.h"
 #include "optutils.h"
 #include "ttyutils.h"
+#include "uring.h"
 
 #include "libfdisk.h"
 #include "fdisk-list.h"
@@ -104,6 +105,7 @@ struct sfdisk {
 
 	struct fdisk_context	*cxt;		/* libfdisk context */
 	struct fdisk_partition  *orig_pa;	/* -N <partno> before the change */
+	struct fdisk_table	*orig_layout;	/* on-disk layout of the used device */
 
 	unsigned int verify : 1,	/* call fdisk_verify_disklabel() */
 		     quiet  : 1,	/* suppress extra messages */
@@ -253,6 +255,7 @@ static int sfdisk_deinit(struct sfdisk *sf)
 		sf->cxt = parent;
 	}
 
+	fdisk_unref_table(sf->orig_layout);
 	fdisk_unref_context(sf->cxt);
 	free(sf->prompt);
 
@@ -368,22 +371,412 @@ static void backup_partition_table(struct sfdisk *sf, const char *devname)
 	free(tpl);
 }
 
+/*
+ * Data move engine (--move-data)
+ *
+ * The area is copied in steps, up to MOVE_NBUFS steps are in flight. The
+ * steps are read in order, and the step is written when it has been read and
+ * all the previous steps are already submitted to write. This is enough to
+ * never overwrite not yet read data, because the target of the step never
+ * overlaps sources of the next steps (the copy direction is backward if the
+ * target is after the source).
+ *
+ * The steps are logged in order to the typescript after they have been
+ * written. If the typescript is used, the target of the step is also never
+ * allowed to overwrite the source of a not yet logged step, so an
+ * interrupted move is possible to resume from the log (the step size is
+ * reduced to the distance between the source and target if necessary).
+ *
+ * The I/O is done by io_uring if available, otherwise by pread() and
+ * pwrite(). The device is opened with O_DIRECT if possible.
+ */
+#define MOVE_NBUFS		8			/* steps in flight */
+#define MOVE_STEP_BYTES		(4 * 1024 * 1024)	/* preferred step size */
+
+enum {
+	MOVE_STEP_FREE = 0,
+	MOVE_STEP_READING,
+	MOVE_STEP_READ,
+	MOVE_STEP_WRITING,
+	MOVE_STEP_WRITTEN
+};
+
+struct move_step {
+	unsigned char	*buf;
+	uintmax_t	src;		/* offsets in bytes */
+	uintmax_t	dst;
+	size_t		size;
+	size_t		done;		/* already read or written bytes */
+	size_t		num;		/* step number, from zero */
+	int		state;		/* MOVE_STEP_* */
+};
+
+struct move_data {
+	struct sfdisk	*sf;
+	int		fd;
+	int		direct_fd;	/* O_DIRECT fd or -1 */
+	FILE		*log;
+	struct ul_uring	ring;
+
+	uintmax_t	src;		/* area offsets in bytes */
+	uintmax_t	dst;
+	uintmax_t	nbytes;
+	size_t		step_bytes;
+	size_t		nsteps;
+
+	size_t		nread;		/* steps submitted to read */
+	size_t		nwrite;		/* steps submitted to write */
+	size_t		nlogged;	/* steps written and logged */
+	size_t		nqueued;	/* uring requests in flight */
+
+	struct move_step steps[MOVE_NBUFS];
+
+	unsigned int	backward : 1,
+			journal : 1;	/* keep sources of not logged steps */
+};
+
+static void move_get_step(struct move_data *md, size_t num, struct move_step *st)
+{
+	uintmax_t off = (uintmax_t) num * md->step_bytes;
+
+	st->num = num;
+	st->size = min((uintmax_t) md->step_bytes, md->nbytes - off);
+	st->done = 0;
+
+	if (md->backward) {
+		st->src = md->src + md->nbytes - off - st->size;
+		st->dst = md->dst + md->nbytes - off - st->size;
+	} else {
+		st->src = md->src + off;
+		st->dst = md->dst + off;
+	}
+}
+
+/* returns 1 if a not yet logged step reads from the target of @st */
+static int move_is_unsafe(struct move_data *md, struct move_step *st)
+{
+	uintmax_t logged = (uintmax_t) md->nlogged * md->step_bytes;
+	uintmax_t beg, end;	/* sources of the not logged steps */
+
+	if (!md->journal)
+		return 0;
+	if (md->backward) {
+		beg = md->src;
+		end = md->src + md->nbytes - min(logged, md->nbytes);
+	} else {
+		beg = md->src + min(logged, md->nbytes);
+		end = md->src + md->nbytes;
+	}
+	return st->dst < end && beg < st->dst + st->size;
+}
+
+/* submits (or with classic I/O does) the rest of the step read or write */
+static int move_step_io(struct move_data *md, struct move_step *st)
+{
+	int wr = st->state == MOVE_STEP_WRITING;
+	uintmax_t off = (wr ? st->dst : st->src) + st->done;
+
+	if (ul_uring_is_ready(&md->ring)) {
+		int rc = ul_uring_prep_rw(&md->ring, wr ? UL_URING_WRITE : UL_URING_READ,
+				md->fd, st->buf + st->done, st->size - st->done,
+				off, st - md->steps);
+		if (rc == 0)
+			md->nqueued++;
+		return rc;
+	}
+
+	while (st->done < st->size) {
+		ssize_t rc = wr ?
+			pwrite(md->fd, st->buf + st->done, st->size - st->done, off) :
+			pread(md->fd, st->buf + st->done, st->size - st->done, off);
+		if (rc < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (rc <= 0)
+			return rc == 0 ? -EIO : -errno;
+		st->done += rc;
+		off += rc;
+	}
+	st->state = wr ? MOVE_STEP_WRITTEN : MOVE_STEP_READ;
+	return 0;
+}
+
+static int move_complete(struct move_data *md, struct move_step *st, int res)
+{
+	if (res <= 0)
+		return res == 0 ? -EIO : res;
+
+	st->done += res;
+	if (st->done < st->size)
+		return move_step_io(md, st);	/* short read or write */
+
+	st->state = st->state == MOVE_STEP_WRITING ? MOVE_STEP_WRITTEN : MOVE_STEP_READ;
+	return 0;
+}
+
+/* submits reads and writes of the steps, returns < 0 on error */
+static int move_queue(struct move_data *md)
+{
+	struct move_step *st;
+	int rc;
+
+	/* the next reads */
+	while (md->nread < md->nsteps && md->nread - md->nlogged < MOVE_NBUFS) {
+		st = &md->steps[md->nread % MOVE_NBUFS];
+		move_get_step(md, md->nread, st);
+		st->state = MOVE_STEP_READING;
+		if ((rc = move_step_io(md, st)) != 0)
+			return rc;
+		md->nread++;
+	}
+
+	/* the writes, in order */
+	while (md->nwrite < md->nread) {
+		st = &md->steps[md->nwrite % MOVE_NBUFS];
+		if (st->state != MOVE_STEP_READ || move_is_unsafe(md, st))
+			break;
+		st->state = MOVE_STEP_WRITING;
+		st->done = 0;
+		if ((rc = move_step_io(md, st)) != 0)
+			return rc;
+		md->nwrite++;
+	}
+	return 0;
+}
+
+/* waits for at least one request, returns < 0 on error */
+static int move_wait(struct move_data *md)
+{
+	uint64_t id;
+	int rc, res;
+
+	if (!ul_uring_is_ready(&md->ring))
+		return 0;		/* classic I/O is already done */
+
+	rc = ul_uring_submit(&md->ring, md->nqueued ? 1 : 0);
+	if (rc < 0)
+		return rc;
+
+	while (ul_uring_get_completion(&md->ring, &id, &res) == 1) {
+		md->nqueued--;
+		if (id >= MOVE_NBUFS)
+			return -EINVAL;
+		rc = move_complete(md, &md->steps[id], res);
+		if (rc)
+			return rc;
+	}
+	return 0;
+}
+
+/* logs written steps, returns number of the logged steps */
+static size_t move_log(struct move_data *md)
+{
+	size_t n = 0;
+
+	while (md->nlogged < md->nwrite) {
+		struct move_step *st = &md->steps[md->nlogged % MOVE_NBUFS];
+
+		if (st->state != MOVE_STEP_WRITTEN)
+			break;
+		if (md->sf->movefsync)
+			fsync(md->fd);
+		if (md->log) {
+			fprintf(md->log, "%05zu: %12ju %12ju\n", st->num + 1, st->src, st->dst);
+			fflush(md->log);
+		}
+		st->state = MOVE_STEP_FREE;
+		md->nlogged++;
+		n++;
+	}
+	return n;
+}
+
+static int move_init_io(struct move_data *md)
+{
+	size_t align = max((size_t) getpagesize(), fdisk_get_sector_size(md->sf->cxt));
+	size_t i;
+
+	md->fd = fdisk_get_devfd(md->sf->cxt);
+	md->direct_fd = -1;
+
+	if (!md->sf->noact) {
+		/* the partition table has to be on the disk before O_DIRECT */
+		fsync(md->fd);
+		md->direct_fd = open(fdisk_get_devname(md->sf->cxt),
+				     O_RDWR | O_DIRECT | O_CLOEXEC);
+		if (md->direct_fd >= 0)
+			md->fd = md->direct_fd;
+
+		if (ul_uring_init(&md->ring, MOVE_NBUFS * 2) != 0)
+			DBG(MISC, ul_debug(" io_uring unsupported, use classic I/O"));
+	}
+	DBG(MISC, ul_debug(" I/O: %s%s",
+			ul_uring_is_ready(&md->ring) ? "io_uring" : "read/write",
+			md->direct_fd >= 0 ? ", O_DIRECT" : ""));
+
+	for (i = 0; i < MOVE_NBUFS; i++) {
+		if (posix_memalign((void **) &md->steps[i].buf, align, md->step_bytes))
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static void move_deinit_io(struct move_data *md)
+{
+	size_t i;
+
+	if (ul_uring_is_ready(&md->ring))
+		ul_uring_deinit(&md->ring);
+	if (md->direct_fd >= 0) {
+		fsync(md->direct_fd);
+		close(md->direct_fd);
+	}
+	/* drop cached data read by the buffered fd before the move */
+	if (!md->sf->noact)
+		ioctl(fdisk_get_devfd(md->sf->cxt), BLKFLSBUF, 0);
+
+	for (i = 0; i < MOVE_NBUFS; i++)
+		free(md->steps[i].buf);
+}
+
+/*
+ * Typescript of interrupted move. The header is the same as written by
+ * move_partition_data(), the logged steps are in order.
+ */
+struct move_typescript {
+	char		disk[PATH_MAX];
+	size_t		partno;
+	size_t		ss;
+	uintmax_t	from;
+	uintmax_t	to;
+	uintmax_t	nsectors;
+	size_t		step;
+	size_t		nlogged;
+};
+
+static int read_move_typescript(const char *filename, struct move_typescript *ts)
+{
+	char line[PATH_MAX + 64];
+	uintmax_t x;
+	size_t n, found = 0;
+	FILE *f;
+
+	memset(ts, 0, sizeof(*ts));
+
+	f = fopen(filename, "r");
+	if (!f)
+		return -errno;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "# Disk: %4095s", ts->disk) == 1)
+			found |= 1;
+		else if (sscanf(line, "# Partition: %zu", &ts->partno) == 1)
+			found |= 2;
+		else if (sscanf(line, "# Sector size: %zu", &ts->ss) == 1)
+			found |= 4;
+		else if (sscanf(line, "# Original start offset (sectors/bytes): %ju/%ju", &ts->from, &x) == 2)
+			found |= 8;
+		else if (sscanf(line, "# New start offset (sectors/bytes): %ju/%ju", &ts->to, &x) == 2)
+			found |= 16;
+		else if (sscanf(line, "# Area size (sectors/bytes): %ju/%ju", &ts->nsectors, &x) == 2)
+			found |= 32;
+		else if (sscanf(line, "# Step size (sectors/bytes): %zu/%ju", &ts->step, &x) == 2)
+			found |= 64;
+		else if (sscanf(line, "%zu:", &n) == 1) {
+			if (n != ts->nlogged + 1)
+				break;		/* not in order, ignore the rest */
+			ts->nlogged = n;
+		}
+	}
+	fclose(f);
+
+	return found == 127 && ts->ss && ts->step ? 0 : -EINVAL;
+}
+
+static void move_progress(struct move_data *md, int final)
+{
+	static struct timeval prev_time;
+	static uintmax_t prev_bytes;
+	static uint64_t bytes_per_sec;
+	size_t ss = fdisk_get_sector_size(md->sf->cxt);
+	uintmax_t nsectors = md->nbytes / ss;
+	uintmax_t bytes = min(md->nbytes, (uintmax_t) md->nlogged * md->step_bytes);
+	uintmax_t i = bytes / ss;
+	struct timeval cur_time;
+
+	gettimeofday(&cur_time, NULL);
+	if (!prev_time.tv_sec) {
+		prev_time = cur_time;
+		prev_bytes = bytes;
+	}
+
+	if (final) {
+		int x = get_terminal_width(80);
+		for (; x > 0; x--)
+			fputc(' ', stdout);
+		fflush(stdout);
+		fputc('\r', stdout);
+		fprintf(stdout, _("Moved %ju from %ju sectors (%.0f%%)."),
+				i, nsectors,
+				100.0 / ((double) nsectors/(i+1)));
+		fputc('\n', stdout);
+		return;
+	}
+
+	if (cur_time.tv_sec - prev_time.tv_sec > 1) {
+		uint64_t elapsed = ((cur_time.tv_sec - prev_time.tv_sec) * 1000000) +
+				   (cur_time.tv_usec - prev_time.tv_usec);	/* usec */
+
+		bytes_per_sec = (bytes - prev_bytes) * 1000000 / elapsed;
+		prev_time = cur_time;
+		prev_bytes = bytes;
+	}
+
+	if (bytes_per_sec)
+		fprintf(stdout, _("Moved %ju from %ju sectors (%.3f%%, %.1f MiB/s)."),
+			i, nsectors,
+			100.0 / ((double) nsectors/(i+1)),
+			(double) bytes_per_sec / (1024 * 1024));
+	else
+		fprintf(stdout, _("Moved %ju from %ju sectors (%.3f%%)."),
+			i, nsectors,
+			100.0 / ((double) nsectors/(i+1)));
+	fflush(stdout);
+	fputc('\r', stdout);
+}
+
 static int move_partition_data(struct sfdisk *sf, size_t partno, struct fdisk_partition *orig_pa)
 {
 	struct fdisk_partition *pa = get_partition(sf->cxt, partno);
-	char *devname = NULL, *typescript = NULL, *buf = NULL;
-	FILE *f = NULL;
-	int ok = 0, fd, backward = 0;
-	fdisk_sector_t nsectors, from, to, step, i, prev;
-	size_t io, ss, step_bytes, cc;
-	uintmax_t src, dst, nbytes;
-	int errsv, progress = 0;
-	struct timeval prev_time;
-	uint64_t bytes_per_sec = 0;
+	struct move_typescript ts;
+	struct move_data md = { .sf = sf, .direct_fd = -1 };
+	char *devname = NULL, *typescript = NULL;
+	int ok = 0, resume = 0, rc = 0;
+	fdisk_sector_t nsectors, from, to, step;
+	size_t io, ss, step_bytes;
+	int progress = 0;
 
 	assert(sf->movedata);
 
-	if (!pa)
+	devname = fdisk_partname(fdisk_get_devname(sf->cxt), partno+1);
+	if (sf->move_typescript)
+		typescript = mk_backup_filename_tpl(sf->move_typescript, devname, ".move");
+	ss = fdisk_get_sector_size(sf->cxt);
+
+	/* the same partition and the log of the interrupted move */
+	if (typescript && pa && orig_pa
+	    && fdisk_partition_has_start(pa)
+	    && fdisk_partition_has_start(orig_pa)
+	    && fdisk_partition_get_start(pa) == fdisk_partition_get_start(orig_pa)
+	    && read_move_typescript(typescript, &ts) == 0
+	    && strcmp(ts.disk, devname) == 0
+	    && ts.partno == partno + 1
+	    && ts.ss == ss
+	    && ts.to == fdisk_partition_get_start(pa))
+		resume = 1;
+
+	if (resume)
+		ok = 1;
+	else if (!pa)
 		warnx(_("failed to read new partition from device; ignoring --move-data"));
 	else if (!fdisk_partition_has_size(pa))
 		warnx(_("failed to get size of the new partition; ignoring --move-data"));
@@ -399,50 +792,68 @@ static int move_partition_data(struct sfdisk *sf, size_t partno, struct fdisk_pa
 		warnx(_("new partition is smaller than original; ignoring --move-data"));
 	else
 		ok = 1;
-	if (!ok)
+	if (!ok) {
+		free(devname);
+		free(typescript);
 		return -EINVAL;
+	}
 
 	DBG(MISC, ul_debug("moving data"));
 
-	fd = fdisk_get_devfd(sf->cxt);
-
 	/* set move direction and overlay */
-	nsectors = fdisk_partition_get_size(orig_pa);
-	from = fdisk_partition_get_start(orig_pa);
-	to = fdisk_partition_get_start(pa);
-
+	if (resume) {
+		nsectors = ts.nsectors;
+		from = ts.from;
+		to = ts.to;
+	} else {
+		nsectors = fdisk_partition_get_size(orig_pa);
+		from = fdisk_partition_get_start(orig_pa);
+		to = fdisk_partition_get_start(pa);
+	}
 
 	if ((to >= from && from + nsectors >= to) ||
 	    (from >= to && to + nsectors >= from)) {
 		/* source and target overlay, check if we need to copy
 		 * backwardly from end of the source */
 		DBG(MISC, ul_debug("overlay between source and target"));
-		backward = from < to;
-		DBG(MISC, ul_debug(" copy order: %s", backward ? "backward" : "forward"));
+		md.backward = from < to;
+		md.journal = typescript ? 1 : 0;
+		DBG(MISC, ul_debug(" copy order: %s", md.backward ? "backward" : "forward"));
 	}
 
-	/* set optimal step size -- nearest to 1MiB aligned to optimal I/O */
-	io = fdisk_get_optimal_iosize(sf->cxt);
-	ss = fdisk_get_sector_size(sf->cxt);
-	if (!io)
-		io = ss;
-	if (io < 1024 * 1024)
-		step_bytes = ((1024 * 1024) + io/2) / io * io;
-	else
-		step_bytes = io;
+	if (resume)
+		step_bytes = ts.step * ss;
+	else {
+		/* set optimal step size -- nearest to MOVE_STEP_BYTES aligned to optimal I/O */
+		io = fdisk_get_optimal_iosize(sf->cxt);
+		if (!io)
+			io = ss;
+		if (io < MOVE_STEP_BYTES)
+			step_bytes = (MOVE_STEP_BYTES + io/2) / io * io;
+		else
+			step_bytes = io;
+
+		/* resumable move -- the step must not overwrite its own source */
+		if (md.journal) {
+			uintmax_t dist = (from < to ? to - from : from - to) * ss;
+
+			if (dist < step_bytes)
+				step_bytes = dist;
+		}
+		if ((uintmax_t) step_bytes > nsectors * ss)
+			step_bytes = nsectors * ss;
+	}
 
 	step = step_bytes / ss;
-	nbytes = nsectors * ss;
 
-	DBG(MISC, ul_debug(" step: %ju (%zu bytes)", (uintmax_t)step, step_bytes));
+	md.src = (uintmax_t) from * ss;
+	md.dst = (uintmax_t) to * ss;
+	md.nbytes = (uintmax_t) nsectors * ss;
+	md.step_bytes = step_bytes;
+	md.nsteps = (md.nbytes + step_bytes - 1) / step_bytes;
 
-#if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
-	if (!backward)
-		posix_fadvise(fd, from * ss, nsectors * ss, POSIX_FADV_SEQUENTIAL);
-#endif
-	devname = fdisk_partname(fdisk_get_devname(sf->cxt), partno+1);
-	if (sf->move_typescript)
-		typescript = mk_backup_filename_tpl(sf->move_typescript, devname, ".move");
+	DBG(MISC, ul_debug(" step: %ju (%zu bytes), steps: %zu",
+				(uintmax_t)step, step_bytes, md.nsteps));
 
 	if (!sf->quiet) {
 		fdisk_info(sf->cxt,"");
@@ -451,6 +862,8 @@ static int move_partition_data(struct sfdisk *sf, size_t partno, struct fdisk_pa
 		color_disable();
 		if (typescript)
 			fdisk_info(sf->cxt, _(" typescript file: %s"), typescript);
+		if (resume)
+			fdisk_info(sf->cxt, _(" resume after step: %zu"), ts.nlogged);
 		printf(_("  start sector: (from/to) %ju / %ju\n"), (uintmax_t) from, (uintmax_t) to);
 		printf(_("  sectors: %ju\n"), (uintmax_t) nsectors);
 	        printf(_("  step size: %zu bytes\n"), step_bytes);
@@ -466,16 +879,22 @@ static int move_partition_data(struct sfdisk *sf, size_t partno, struct fdisk_pa
 		fdisk_ask_yesno(sf->cxt, _("Do you want to move partition data?"), &yes);
 		if (!yes) {
 			fdisk_info(sf->cxt, _("Leaving."));
+			free(devname);
+			free(typescript);
 			return 0;
 		}
 	}
 
 	if (typescript) {
-		f = fopen(typescript, "w");
-		if (!f) {
+		md.log = fopen(typescript, resume ? "a" : "w");
+		if (!md.log) {
 			fdisk_warn(sf->cxt, _("cannot open %s"), typescript);
-			goto fail;
+			rc = -errno;
+			goto done;
 		}
+	}
+	if (typescript && !resume) {
+		FILE *f = md.log;
 
 		/* don't translate */
 		fprintf(f, "# sfdisk: " PACKAGE_STRING "\n");
@@ -489,123 +908,62 @@ static int move_partition_data(struct sfdisk *sf, size_t partno, struct fdisk_pa
 			(uintmax_t)to, (uintmax_t)to * ss);
 		fprintf(f, "# Area size (sectors/bytes): %ju/%ju\n",
 			(uintmax_t)nsectors, (uintmax_t)nsectors * ss);
-				fprintf(f, "# Step size (sectors/bytes): %zu/%zu\n", step, step_bytes);
-		fprintf(f, "# Steps: %ju\n", ((uintmax_t) nsectors / step) + 1);
+		fprintf(f, "# Step size (sectors/bytes): %zu/%zu\n", step, step_bytes);
+		fprintf(f, "# Steps: %zu\n", md.nsteps);
 		fprintf(f, "#\n");
 		fprintf(f, "# <step>: <from> <to> (step offsets in bytes)\n");
+		fflush(f);
 	}
 
-	src = (backward ? from + nsectors : from) * ss;
-	dst = (backward ? to + nsectors : to) * ss;
-	buf = xmalloc(step_bytes);
-
-	DBG(MISC, ul_debug(" initial: src=%ju dst=%ju", src, dst));
-
-	gettimeofday(&prev_time, NULL);
-	prev = 0;
-
-	for (cc = 1, i = 0; i < nsectors && nbytes > 0; i += step, cc++) {
-		ssize_t rc;
-
-		if (backward)
-			src -= step_bytes, dst -= step_bytes;
-
-		DBG(MISC, ul_debug("#%05zu: src=%ju dst=%ju", cc, src, dst));
-
-		if (nbytes < step_bytes) {
-			DBG(MISC, ul_debug(" aligning step from %ju to %ju",
-						step_bytes, nbytes));
-			step_bytes = nbytes;
-		}
-		nbytes -= step_bytes;
-
-		if (!sf->noact) {
-			/* read source */
-			if (lseek(fd, src, SEEK_SET) == (off_t) -1)
-				goto fail;
-			rc = read(fd, buf, step_bytes);
-			if (rc < 0 || rc != (ssize_t) step_bytes)
-				goto fail;
-
-			/* write target */
-			if (lseek(fd, dst, SEEK_SET) == (off_t) -1)
-				goto fail;
-			rc = write(fd, buf, step_bytes);
-			if (rc < 0 || rc != (ssize_t) step_bytes)
-				goto fail;
-			if (sf->movefsync)
-				fsync(fd);
-		}
-
-		/* write log */
-		if (f)
-			fprintf(f, "%05zu: %12ju %12ju\n", cc, src, dst);
-
-		if (progress && i % 10 == 0) {
-			unsigned int elapsed = 0;	/* usec */
-			struct timeval cur_time;
-
-			gettimeofday(&cur_time, NULL);
-			if (cur_time.tv_sec - prev_time.tv_sec > 1) {
-				elapsed = ((cur_time.tv_sec - prev_time.tv_sec) * 1000000) +
-					  (cur_time.tv_usec - prev_time.tv_usec);
+	rc = move_init_io(&md);
+	if (rc)
+		goto done;
 
-				bytes_per_sec = ((i - prev) * ss) / elapsed;	/* per usec */
-				bytes_per_sec *= 1000000;			/* per sec */
+	if (resume)
+		md.nlogged = md.nwrite = md.nread = min(ts.nlogged, md.nsteps);
 
-				prev_time = cur_time;
-				prev = i;
-			}
+#if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
+	if (!md.backward && md.direct_fd < 0)
+		posix_fadvise(md.fd, md.src, md.nbytes, POSIX_FADV_SEQUENTIAL);
+#endif
+	DBG(MISC, ul_debug(" initial: src=%ju dst=%ju", md.src, md.dst));
+
+	while (md.nlogged < md.nsteps) {
+		if (sf->noact) {
+			/* just log the steps */
+			move_get_step(&md, md.nlogged, &md.steps[0]);
+			md.steps[0].state = MOVE_STEP_WRITTEN;
+			md.nwrite = md.nlogged + 1;
+		} else if ((rc = move_queue(&md)) != 0 || (rc = move_wait(&md)) != 0)
+			break;
 
-			if (bytes_per_sec)
-				fprintf(stdout, _("Moved %ju from %ju sectors (%.3f%%, %.1f MiB/s)."),
-					i + 1, nsectors,
-					100.0 / ((double) nsectors/(i+1)),
-					(double) (bytes_per_sec / (1024 * 1024)));
-			else
-				fprintf(stdout, _("Moved %ju from %ju sectors (%.3f%%)."),
-					i + 1, nsectors,
-					100.0 / ((double) nsectors/(i+1)));
-			fflush(stdout);
-                        fputc('\r', stdout);
+		if (move_log(&md) && progress)
+			move_progress(&md, 0);
+	}
 
-		}
+	if (progress)
+		move_progress(&md, 1);
 
-		if (!backward)
-			src += step_bytes, dst += step_bytes;
+	/* the in-flight requests have to be finished before the buffers are freed */
+	while (rc && md.nqueued && ul_uring_submit(&md.ring, 1) >= 0) {
+		while (ul_uring_get_completion(&md.ring, NULL, NULL) == 1)
+			md.nqueued--;
 	}
-
-	if (progress) {
-		int x = get_terminal_width(80);
-		for (; x > 0; x--)
-			fputc(' ', stdout);
-		fflush(stdout);
-		fputc('\r', stdout);
-		fprintf(stdout, _("Moved %ju from %ju sectors (%.0f%%)."),
-				i, nsectors,
-				100.0 / ((double) nsectors/(i+1)));
-		fputc('\n', stdout);
+	move_deinit_io(&md);
+done:
+	if (rc) {
+		errno = -rc;
+		warn(_("%s: failed to move data"), devname);
 	}
-	if (f)
-		fclose(f);
-	free(buf);
+	if (md.log)
+		fclose(md.log);
 	free(devname);
 	free(typescript);
 
-	if (sf->noact)
+	if (!rc && sf->noact)
 		fdisk_info(sf->cxt, _("Your data has not been moved (--no-act)."));
 
-	return 0;
-fail:
-	errsv = -errno;
-	warn(_("%s: failed to move data"), devname);
-	if (f)
-		fclose(f);
-	free(buf);
-	free(devname);
-	free(typescript);
-
-	return errsv;
+	return rc;
 }
 
 static int write_changes(struct sfdisk *sf)
@@ -629,7 +987,12 @@ static int write_changes(struct sfdisk *sf)
 			 * related to the write to the device.
 			 */
 			xusleep(250000);
-			fdisk_reread_partition_table(sf->cxt);
+
+			/* the used device, modify the changed partitions only */
+			if (sf->orig_layout)
+				fdisk_reread_changes(sf->cxt, sf->orig_layout);
+			else
+				fdisk_reread_partition_table(sf->cxt);
 		}
 	}
 
@@ -1788,6 +2151,7 @@ static int command_fdisk(struct sfdisk *sf, int argc, char **argv)
 
 			if (!sf->force)
 				errx(EXIT_FAILURE, _("Use the --force flag to overrule all checks."));
+			fdisk_get_partitions(sf->cxt, &sf->orig_layout);
 		} else if (!sf->quiet)
 			fputs(_(" OK\n\n"), stdout);
 	}
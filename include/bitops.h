@@ -8,6 +8,7 @@
 #define BITOPS_H
 
 #include <stdint.h>
+#include <string.h>
 #include <sys/param.h>
 
 #if defined(HAVE_BYTESWAP_H)
@@ -146,5 +147,82 @@
 # define isclr(a,i)	(((a)[(i)/NBBY] & (1<<((i)%NBBY))) == 0)
 #endif
 
+/*
+ * Bit map scanning, the map is array of bytes where the bit @i is bit (i % 8)
+ * of the byte (i / 8) -- the same as the macros above. The map is scanned by
+ * 64-bit words, the ranges are [first, last).
+ */
+static inline uint64_t bitmap_get_word(const char *map, size_t bit)
+{
+	uint64_t w;
+
+	memcpy(&w, map + bit / NBBY, sizeof(w));
+	return le64_to_cpu(w);
+}
+
+/* returns the first bit >= @first which is set (or unset), or @last */
+static inline size_t bitmap_find_next(const char *map, size_t first,
+				      size_t last, int set)
+{
+	size_t i = first;
+
+	for (; i < last && i % 64; i++) {
+		if (!isset(map, i) == !set)
+			return i;
+	}
+	for (; i + 64 <= last; i += 64) {
+		uint64_t w = bitmap_get_word(map, i);
+
+		if (!set)
+			w = ~w;
+		if (w)
+			return i + __builtin_ctzll(w);
+	}
+	for (; i < last; i++) {
+		if (!isset(map, i) == !set)
+			return i;
+	}
+	return last;
+}
+
+/* returns number of the set bits */
+static inline size_t bitmap_count_range(const char *map, size_t first, size_t last)
+{
+	size_t i = first, n = 0;
+
+	for (; i < last && i % 64; i++)
+		n += isset(map, i) ? 1 : 0;
+	for (; i + 64 <= last; i += 64)
+		n += __builtin_popcountll(bitmap_get_word(map, i));
+	for (; i < last; i++)
+		n += isset(map, i) ? 1 : 0;
+	return n;
+}
+
+/* sets (or clears) all the bits */
+static inline void bitmap_set_range(char *map, size_t first, size_t last, int set)
+{
+	size_t i = first;
+
+	for (; i < last && i % NBBY; i++) {
+		if (set)
+			setbit(map, i);
+		else
+			clrbit(map, i);
+	}
+	if (i + NBBY <= last) {
+		size_t nbytes = (last - i) / NBBY;
+
+		memset(map + i / NBBY, set ? 0xff : 0, nbytes);
+		i += nbytes * NBBY;
+	}
+	for (; i < last; i++) {
+		if (set)
+			setbit(map, i);
+		else
+			clrbit(map, i);
+	}
+}
+
 #endif /* BITOPS_H */
 
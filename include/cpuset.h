@@ -52,6 +52,23 @@
 	  break;							      \
       __i == __imax; })
 
+# define __CPU_OP_S(setsize, destset, srcset1, srcset2, op) \
+  ({ cpu_set_t *__dest = (destset);					      \
+     const __cpu_mask *__arr1 = (srcset1)->__bits;			      \
+     const __cpu_mask *__arr2 = (srcset2)->__bits;			      \
+     size_t __imax = (setsize) / sizeof (__cpu_mask);			      \
+     size_t __i;							      \
+     for (__i = 0; __i < __imax; ++__i)					      \
+       ((__cpu_mask *) __dest->__bits)[__i] = __arr1[__i] op __arr2[__i];    \
+     __dest; })
+
+# define CPU_AND_S(setsize, destset, srcset1, srcset2) \
+	__CPU_OP_S(setsize, destset, srcset1, srcset2, &)
+# define CPU_OR_S(setsize, destset, srcset1, srcset2) \
+	__CPU_OP_S(setsize, destset, srcset1, srcset2, |)
+# define CPU_XOR_S(setsize, destset, srcset1, srcset2) \
+	__CPU_OP_S(setsize, destset, srcset1, srcset2, ^)
+
 extern int __cpuset_count_s(size_t setsize, const cpu_set_t *set);
 # define CPU_COUNT_S(setsize, cpusetp)	__cpuset_count_s(setsize, cpusetp)
 
@@ -65,6 +82,23 @@ extern int __cpuset_count_s(size_t setsize, const cpu_set_t *set);
 
 #define cpuset_nbits(setsize)	(8 * (setsize))
 
+/* cpu_set_t is array of unsigned long words (glibc __cpu_mask) */
+#define CPUSET_WORDBITS		(8 * sizeof(unsigned long))
+
+extern size_t cpuset_find_next(const cpu_set_t *set, size_t setsize,
+			       size_t cpu, int isset);
+
+/*
+ * Iterates over all CPUs in the set, for example:
+ *
+ *	cpuset_foreach(cpu, set, setsize)
+ *		printf("%zu\n", cpu);
+ */
+#define cpuset_foreach(cpu, set, setsize) \
+	for ((cpu) = cpuset_find_next(set, setsize, 0, 1); \
+	     (cpu) < cpuset_nbits(setsize); \
+	     (cpu) = cpuset_find_next(set, setsize, (cpu) + 1, 1))
+
 /*
  * The @idx parameter returns an index of the first mask from @ary array where
  * the @cpu is set.
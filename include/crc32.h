@@ -4,7 +4,10 @@
 #include <sys/types.h>
 #include <stdint.h>
 
+/* uses CPU acceleration if available */
 extern uint32_t ul_crc32(uint32_t seed, const unsigned char *buf, size_t len);
+extern uint32_t ul_crc32_sw(uint32_t seed, const unsigned char *buf, size_t len);
+extern const char *ul_crc32_get_impl(void);
 extern uint32_t ul_crc32_exclude_offset(uint32_t seed, const unsigned char *buf, size_t len,
 		                              size_t exclude_off, size_t exclude_len);
 
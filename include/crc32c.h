@@ -4,6 +4,9 @@
 #include <sys/types.h>
 #include <stdint.h>
 
+/* uses CPU acceleration if available */
 extern uint32_t crc32c(uint32_t crc, const void *buf, size_t size);
+extern uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t size);
+extern const char *crc32c_get_impl(void);
 
 #endif /* UL_NG_CRC32C_H */
@@ -0,0 +1,213 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#ifndef UTIL_LINUX_DEBUGTRACE_H
+#define UTIL_LINUX_DEBUGTRACE_H
+
+/*
+ * util-linux trace macros, a companion of debug.h
+ *
+ * The trace points are counters and scoped timers, nothing is printed when
+ * the trace point is executed, the results are aggregated in memory and the
+ * summary (number of calls, total/min/max time and log2 histogram of the
+ * times) is printed to stderr when the process (or library) terminates.
+ *
+ * The trace points use the same subsystems as DBG(), the mask is usually
+ * initialized by <NAME>_TRACE= env.variable (e.g. "LIBBLKID_TRACE=lowprobe"),
+ * and a disabled trace point costs one test of the mask.
+ *
+ * In the code is possible to use
+ *
+ *	TRACE_SCOPE(FOO, "read");	-- time the rest of the current block
+ *	TRACE_COUNT(FOO, "hits", 1);	-- add 1 to the counter
+ *
+ * where the TRACE_* macros are defined by the library or program like:
+ *
+ *	UL_TRACE_DECLARE(libfoo);
+ *	#define TRACE_SCOPE(m, n)	__UL_TRACE_SCOPE(libfoo, FOO_DEBUG_, m, n)
+ *	#define TRACE_COUNT(m, n, x)	__UL_TRACE_COUNT(libfoo, FOO_DEBUG_, m, n, x)
+ *
+ * and UL_TRACE_DEFINE(libfoo) and __UL_INIT_TRACE_FROM_ENV() are used
+ * together with UL_DEBUG_DEFINE_MASK() and __UL_INIT_DEBUG_FROM_ENV().
+ *
+ * See libblkid/src/init.c: blkid_init_debug()
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "debug.h"
+
+#define UL_TRACE_HISTSZ		40	/* 1ns .. 2^39ns (~9 minutes) */
+
+struct ul_trace_point {
+	const char		*name;
+	const char		*subsys;
+	struct ul_trace_point	*next;		/* registered points */
+	int			registered;
+
+	uint64_t		count;		/* calls or counter value */
+	uint64_t		total;		/* nanoseconds */
+	uint64_t		min;
+	uint64_t		max;
+	uint64_t		hist[UL_TRACE_HISTSZ];	/* calls per log2(ns) */
+	unsigned int		is_timer : 1;
+};
+
+struct ul_trace {
+	const char		*name;		/* library or program name */
+	int			mask;		/* enabled subsystems */
+	struct ul_trace_point	*points;
+};
+
+struct ul_trace_timer {
+	struct ul_trace_point	*point;		/* NULL if disabled */
+	uint64_t		start;
+};
+
+static inline uint64_t ul_trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* adds the point to the list of points printed by ul_trace_dump() */
+static inline void ul_trace_register(struct ul_trace *tr, struct ul_trace_point *tp)
+{
+	if (__atomic_load_n(&tp->registered, __ATOMIC_ACQUIRE)
+	    || __atomic_exchange_n(&tp->registered, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	tp->next = __atomic_load_n(&tr->points, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&tr->points, &tp->next, tp, 0,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+}
+
+static inline void ul_trace_count(struct ul_trace *tr, struct ul_trace_point *tp,
+				  uint64_t n)
+{
+	ul_trace_register(tr, tp);
+	__atomic_add_fetch(&tp->count, n, __ATOMIC_RELAXED);
+}
+
+static inline struct ul_trace_timer ul_trace_timer_start(struct ul_trace *tr,
+				int mask, struct ul_trace_point *tp)
+{
+	struct ul_trace_timer tt = { .point = NULL };
+
+	if (mask & tr->mask) {
+		tp->is_timer = 1;
+		ul_trace_register(tr, tp);
+		tt.point = tp;
+		tt.start = ul_trace_now();
+	}
+	return tt;
+}
+
+static inline void ul_trace_timer_end(struct ul_trace_timer *tt)
+{
+	struct ul_trace_point *tp = tt->point;
+	uint64_t ns, x;
+	size_t bucket = 0;
+
+	if (!tp)
+		return;
+
+	ns = ul_trace_now() - tt->start;
+	for (x = ns; x > 1 && bucket + 1 < UL_TRACE_HISTSZ; x >>= 1)
+		bucket++;
+
+	__atomic_add_fetch(&tp->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&tp->total, ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&tp->hist[bucket], 1, __ATOMIC_RELAXED);
+
+	x = __atomic_load_n(&tp->min, __ATOMIC_RELAXED);
+	while ((x == 0 || ns < x) &&
+	       !__atomic_compare_exchange_n(&tp->min, &x, ns, 0,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	x = __atomic_load_n(&tp->max, __ATOMIC_RELAXED);
+	while (ns > x &&
+	       !__atomic_compare_exchange_n(&tp->max, &x, ns, 0,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static inline void ul_trace_dump(struct ul_trace *tr, FILE *out)
+{
+	struct ul_trace_point *tp;
+	size_t i;
+
+	for (tp = tr->points; tp; tp = tp->next) {
+		if (!tp->is_timer) {
+			fprintf(out, "%d: %s: %8s: %s: %"PRIu64"\n",
+				getpid(), tr->name, tp->subsys, tp->name,
+				tp->count);
+			continue;
+		}
+		fprintf(out, "%d: %s: %8s: %s: calls=%"PRIu64" total=%"PRIu64"ns "
+			     "avg=%"PRIu64"ns min=%"PRIu64"ns max=%"PRIu64"ns\n",
+			getpid(), tr->name, tp->subsys, tp->name,
+			tp->count, tp->total,
+			tp->count ? tp->total / tp->count : 0,
+			tp->min, tp->max);
+
+		for (i = 0; i < UL_TRACE_HISTSZ; i++) {
+			if (!tp->hist[i])
+				continue;
+			fprintf(out, "%d: %s: %8s: %s:   < %"PRIu64"ns: %"PRIu64"\n",
+				getpid(), tr->name, tp->subsys, tp->name,
+				(uint64_t) 1 << (i + 1), tp->hist[i]);
+		}
+	}
+	fflush(out);
+}
+
+#define UL_TRACE(m)		m ## _trace
+
+/* defines the trace and the summary printed when the process terminates */
+#define UL_TRACE_DEFINE(m) \
+	struct ul_trace UL_TRACE(m) = { .name = # m }; \
+	static void __attribute__((__destructor__)) m ## _trace_summary(void) \
+	{ \
+		if (UL_TRACE(m).mask) \
+			ul_trace_dump(&UL_TRACE(m), stderr); \
+	}
+#define UL_TRACE_DECLARE(m)	extern struct ul_trace UL_TRACE(m)
+
+#define __UL_TRACE_ID2(x, y)	x ## y
+#define __UL_TRACE_ID1(x, y)	__UL_TRACE_ID2(x, y)
+#define __UL_TRACE_ID(x)	__UL_TRACE_ID1(x, __LINE__)
+
+/* l - library name, p - flag prefix, m - flag postfix, n - point name */
+#define __UL_TRACE_SCOPE(l, p, m, n) \
+	static struct ul_trace_point __UL_TRACE_ID(__ul_tp_) = \
+		{ .name = n, .subsys = # m }; \
+	struct ul_trace_timer __UL_TRACE_ID(__ul_tt_) \
+		__attribute__((__cleanup__(ul_trace_timer_end))) = \
+		ul_trace_timer_start(&UL_TRACE(l), (p ## m), &__UL_TRACE_ID(__ul_tp_))
+
+#define __UL_TRACE_COUNT(l, p, m, n, x) \
+	do { \
+		if ((p ## m) & UL_TRACE(l).mask) { \
+			static struct ul_trace_point __tp = \
+				{ .name = n, .subsys = # m }; \
+			ul_trace_count(&UL_TRACE(l), &__tp, x); \
+		} \
+	} while (0)
+
+#define __UL_INIT_TRACE_FROM_ENV(lib, env) \
+	do { \
+		const char *envstr = getenv(# env); \
+		if (envstr) \
+			UL_TRACE(lib).mask = ul_debug_parse_mask( \
+					UL_DEBUG_MASKNAMES(lib), envstr); \
+	} while (0)
+
+#endif /* UTIL_LINUX_DEBUGTRACE_H */
@@ -5,6 +5,7 @@
 #include <pwd.h>
 
 #define IDCACHE_FLAGS_NAMELEN	(1 << 1)
+#define IDCACHE_FLAGS_NEGATIVE	(1 << 2)	/* unknown ID has NULL name */
 
 struct identry {
 	unsigned long int	id;
@@ -15,12 +16,21 @@ struct identry {
 struct idcache {
 	struct identry	*ent;	/* first entry */
 	int		width;	/* name width */
+
+	struct identry	*last;	/* last entry */
+	struct identry	**hash;	/* open addressing, power of 2 */
+	size_t		hashsz;
+	size_t		nents;
+	int		flags;	/* IDCACHE_FLAGS_* */
 };
 
 
 extern struct idcache *new_idcache(void);
+extern void idcache_set_flags(struct idcache *ic, int flags);
 extern void add_gid(struct idcache *cache, unsigned long int id);
 extern void add_uid(struct idcache *cache, unsigned long int id);
+extern void add_gids(struct idcache *cache, const unsigned long int *ids, size_t nids);
+extern void add_uids(struct idcache *cache, const unsigned long int *ids, size_t nids);
 
 extern void free_idcache(struct idcache *ic);
 extern struct identry *get_id(struct idcache *ic, unsigned long int id);
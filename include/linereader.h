@@ -0,0 +1,46 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#ifndef UTIL_LINUX_LINEREADER_H
+#define UTIL_LINUX_LINEREADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+struct ul_linereader {
+	int	fd;
+	char	*buf;
+	size_t	bufsz;		/* allocated size */
+	size_t	begin;		/* not returned data in buf[begin..end) */
+	size_t	end;
+
+	unsigned int eof :1;
+};
+
+extern void ul_init_linereader(struct ul_linereader *lr, int fd);
+extern void ul_reset_linereader(struct ul_linereader *lr, int fd);
+extern void ul_free_linereader(struct ul_linereader *lr);
+extern ssize_t ul_linereader_next(struct ul_linereader *lr, char **line);
+
+/* returns 1 if there is no byte >= 0x80 in @str */
+static inline int ul_is_ascii(const char *str, size_t len)
+{
+	const char *end = str + len;
+	uint64_t x = 0;
+
+	for (; str + sizeof(x) <= end; str += sizeof(x)) {
+		uint64_t w;
+
+		memcpy(&w, str, sizeof(w));
+		x |= w;
+	}
+	for (; str < end; str++)
+		x |= (unsigned char) *str;
+
+	return !(x & UINT64_C(0x8080808080808080));
+}
+
+#endif /* UTIL_LINUX_LINEREADER_H */
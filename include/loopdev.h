@@ -25,6 +25,7 @@
 #define LOOP_SET_CAPACITY	0x4C07
 #define LOOP_SET_DIRECT_IO	0x4C08
 #define LOOP_SET_BLOCK_SIZE	0x4C09
+#define LOOP_CONFIGURE		0x4C0A	/* kernel >= 5.8 */
 
 /* /dev/loop-control interface */
 #ifndef LOOP_CTL_ADD
@@ -66,6 +67,17 @@ struct loop_info64 {
 	uint64_t	lo_init[2];
 };
 
+/*
+ * Linux LOOP_CONFIGURE ioctl struct, sets fd, block size and status by one
+ * ioctl
+ */
+struct loop_config {
+	uint32_t		fd;
+	uint32_t		block_size;
+	struct loop_info64	info;
+	uint64_t		__reserved[8];
+};
+
 #define LOOPDEV_MAJOR		7	/* loop major number */
 #define LOOPDEV_DEFAULT_NNODES	8	/* default number of loop devices */
 
@@ -88,6 +100,34 @@ enum {
 	LOOPITER_FL_USED	= (1 << 1)
 };
 
+struct loopdev_index;
+
+/*
+ * sysfs attributes read by loopcxt_read_attrs()
+ */
+struct loopdev_attrs {
+	char		*backing_file;
+	uint64_t	offset;
+	uint64_t	sizelimit;
+	uint64_t	blocksize;	/* logical sector size */
+	int		autoclear;
+	int		readonly;
+	int		dio;
+	int		partscan;
+	int		mask;		/* LOOPDEV_ATTR_* of the valid items */
+};
+
+enum {
+	LOOPDEV_ATTR_BACKING_FILE	= (1 << 0),
+	LOOPDEV_ATTR_OFFSET		= (1 << 1),
+	LOOPDEV_ATTR_SIZELIMIT		= (1 << 2),
+	LOOPDEV_ATTR_BLOCKSIZE		= (1 << 3),
+	LOOPDEV_ATTR_AUTOCLEAR		= (1 << 4),
+	LOOPDEV_ATTR_READONLY		= (1 << 5),
+	LOOPDEV_ATTR_DIO		= (1 << 6),
+	LOOPDEV_ATTR_PARTSCAN		= (1 << 7)
+};
+
 /*
  * handler for work with loop devices
  */
@@ -107,6 +147,8 @@ struct loopdev_cxt {
 	struct path_cxt		*sysfs; /* pointer to /sys/dev/block/<maj:min>/ */
 	struct loop_info64	info;	/* for GET/SET ioctl */
 	struct loopdev_iter	iter;	/* scans /sys or /dev for used/free devices */
+	struct loopdev_index	*index;	/* used devices by backing file */
+	struct loopdev_attrs	attrs;	/* cached sysfs attributes */
 };
 
 #define UL_LOOPDEVCXT_EMPTY { .fd = -1  }
@@ -139,6 +181,7 @@ extern int loopdev_is_used(const char *device, const char *filename,
 extern char *loopdev_find_by_backing_file(const char *filename,
 				uint64_t offset, uint64_t sizelimit, int flags);
 extern int loopcxt_find_unused(struct loopdev_cxt *lc);
+extern void loopcxt_busy_backoff(struct loopdev_cxt *lc, unsigned int attempt);
 extern int loopdev_delete(const char *device);
 extern int loopdev_count_by_backing_file(const char *filename, char **loopdev);
 
@@ -156,6 +199,7 @@ extern int loopcxt_add_device(struct loopdev_cxt *lc);
 extern char *loopcxt_strdup_device(struct loopdev_cxt *lc);
 extern const char *loopcxt_get_device(struct loopdev_cxt *lc);
 extern struct loop_info64 *loopcxt_get_info(struct loopdev_cxt *lc);
+extern int loopcxt_read_attrs(struct loopdev_cxt *lc);
 
 extern int loopcxt_get_fd(struct loopdev_cxt *lc);
 extern int loopcxt_set_fd(struct loopdev_cxt *lc, int fd, int mode);
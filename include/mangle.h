@@ -6,6 +6,7 @@
  */
 
 extern char *mangle(const char *s);
+extern const char *mangle_if_needed(const char *s, char **tofree);
 
 extern void unmangle_to_buffer(const char *s, char *buf, size_t len);
 extern size_t unhexmangle_to_buffer(const char *s, char *buf, size_t len);
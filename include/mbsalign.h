@@ -41,6 +41,7 @@ enum {
 };
 
 extern size_t mbs_truncate(char *str, size_t *width);
+extern size_t mbs_nfit(const char *str, size_t bytes, size_t *width);
 
 extern size_t mbsalign (const char *src, char *dest,
 			size_t dest_size,  size_t *width,
@@ -1,6 +1,7 @@
 #ifndef UTIL_LINUX_MD5_H
 #define UTIL_LINUX_MD5_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define UL_MD5LENGTH 16
@@ -15,6 +16,8 @@ void ul_MD5Init(struct UL_MD5Context *context);
 void ul_MD5Update(struct UL_MD5Context *context, unsigned char const *buf, unsigned len);
 void ul_MD5Final(unsigned char digest[UL_MD5LENGTH], struct UL_MD5Context *context);
 void ul_MD5Transform(uint32_t buf[4], uint32_t const in[16]);
+void ul_MD5Multi(unsigned char (*digest)[UL_MD5LENGTH],
+		 const unsigned char *const *data, const size_t *len, size_t n);
 
 /*
  * This is needed to make RSAREF happy on some MS-DOS compilers.
@@ -0,0 +1,224 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * statmount() and listmount() syscalls (Linux 6.8), open_tree(), move_mount()
+ * and mount_setattr() syscalls (Linux 5.12), the mount related part of statx()
+ * and the kernel ABI for libc and kernel headers without these syscalls.
+ */
+#ifndef UTIL_LINUX_MOUNT_API_UTILS
+#define UTIL_LINUX_MOUNT_API_UTILS
+
+#if defined(__linux__)
+# include <sys/syscall.h>
+
+/* mount attributes, statmount.mnt_attr and mount_setattr() */
+# define UL_MOUNT_ATTR_RDONLY		0x00000001
+# define UL_MOUNT_ATTR_NOSUID		0x00000002
+# define UL_MOUNT_ATTR_NODEV		0x00000004
+# define UL_MOUNT_ATTR_NOEXEC		0x00000008
+# define UL_MOUNT_ATTR__ATIME		0x00000070
+# define UL_MOUNT_ATTR_RELATIME		0x00000000
+# define UL_MOUNT_ATTR_NOATIME		0x00000010
+# define UL_MOUNT_ATTR_STRICTATIME	0x00000020
+# define UL_MOUNT_ATTR_NODIRATIME	0x00000080
+# define UL_MOUNT_ATTR_IDMAP		0x00100000
+# define UL_MOUNT_ATTR_NOSYMFOLLOW	0x00200000
+
+# if defined(SYS_open_tree) && defined(SYS_move_mount) && defined(SYS_mount_setattr)
+#  include <stdint.h>
+#  include <unistd.h>
+#  include <linux/types.h>
+
+struct ul_mount_attr {
+	__u64 attr_set;
+	__u64 attr_clr;
+	__u64 propagation;
+	__u64 userns_fd;
+};
+
+#  define UL_OPEN_TREE_CLONE		1
+#  define UL_OPEN_TREE_CLOEXEC		02000000	/* O_CLOEXEC */
+#  define UL_MOVE_MOUNT_F_EMPTY_PATH	0x00000004
+#  define UL_AT_EMPTY_PATH		0x1000
+#  define UL_AT_RECURSIVE		0x8000
+
+static inline int ul_open_tree(int dfd, const char *path, unsigned int flags)
+{
+	return syscall(SYS_open_tree, dfd, path, flags);
+}
+
+static inline int ul_move_mount(int from_dfd, const char *from_path,
+				int to_dfd, const char *to_path, unsigned int flags)
+{
+	return syscall(SYS_move_mount, from_dfd, from_path, to_dfd, to_path, flags);
+}
+
+static inline int ul_mount_setattr(int dfd, const char *path, unsigned int flags,
+				   struct ul_mount_attr *attr)
+{
+	return syscall(SYS_mount_setattr, dfd, path, flags, attr, sizeof(*attr));
+}
+
+#  define UL_HAVE_MOUNT_API_SETATTR 1
+
+# endif /* SYS_open_tree && SYS_move_mount && SYS_mount_setattr */
+
+# if defined(SYS_statmount) && defined(SYS_listmount)
+#  include <stdint.h>
+#  include <unistd.h>
+#  include <linux/types.h>
+
+/*
+ * The structs are private copies of the kernel ABI, the kernel headers
+ * are not always up to date and the fields are added by new kernels.
+ */
+
+/* the request for statmount() and listmount() */
+struct ul_mnt_id_req {
+	__u32 size;
+	__u32 spare;
+	__u64 mnt_id;
+	__u64 param;
+};
+
+struct ul_statmount {
+	__u32 size;		/* total size, including strings */
+	__u32 mnt_opts;		/* [str] options of the mount */
+	__u64 mask;		/* what results were written */
+	__u32 sb_dev_major;	/* device ID */
+	__u32 sb_dev_minor;
+	__u64 sb_magic;		/* ..._SUPER_MAGIC */
+	__u32 sb_flags;		/* SB_{RDONLY,SYNCHRONOUS,DIRSYNC,LAZYTIME} */
+	__u32 fs_type;		/* [str] filesystem type */
+	__u64 mnt_id;		/* unique ID of mount */
+	__u64 mnt_parent_id;	/* unique ID of parent (for root == mnt_id) */
+	__u32 mnt_id_old;	/* reused IDs used in /proc/#/mountinfo */
+	__u32 mnt_parent_id_old;
+	__u64 mnt_attr;		/* MOUNT_ATTR_... */
+	__u64 mnt_propagation;	/* MS_{SHARED,SLAVE,PRIVATE,UNBINDABLE} */
+	__u64 mnt_peer_group;	/* ID of shared peer group */
+	__u64 mnt_master;	/* mount receives propagation from this ID */
+	__u64 propagate_from;	/* propagation from in current namespace */
+	__u32 mnt_root;		/* [str] root of mount relative to root of fs */
+	__u32 mnt_point;	/* [str] mountpoint relative to current root */
+	__u64 mnt_ns_id;	/* ID of the mount namespace */
+	__u32 fs_subtype;	/* [str] subtype of fs_type (if any) */
+	__u32 sb_source;	/* [str] source string of the mount */
+	__u32 opt_num;		/* number of fs options */
+	__u32 opt_array;	/* [str] array of nul terminated fs options */
+	__u32 opt_sec_num;	/* number of security options */
+	__u32 opt_sec_array;	/* [str] array of nul terminated security options */
+	__u64 __spare2[46];
+	char str[];		/* variable size part containing strings */
+};
+
+#  define UL_MNT_ID_REQ_SIZE_VER0	24
+
+#  define UL_STATMOUNT_SB_BASIC		0x00000001U	/* want/got sb_... */
+#  define UL_STATMOUNT_MNT_BASIC	0x00000002U	/* want/got mnt_... */
+#  define UL_STATMOUNT_PROPAGATE_FROM	0x00000004U	/* want/got propagate_from */
+#  define UL_STATMOUNT_MNT_ROOT		0x00000008U	/* want/got mnt_root  */
+#  define UL_STATMOUNT_MNT_POINT	0x00000010U	/* want/got mnt_point */
+#  define UL_STATMOUNT_FS_TYPE		0x00000020U	/* want/got fs_type */
+#  define UL_STATMOUNT_MNT_OPTS		0x00000080U	/* want/got mnt_opts */
+#  define UL_STATMOUNT_FS_SUBTYPE	0x00000100U	/* want/got fs_subtype */
+#  define UL_STATMOUNT_SB_SOURCE	0x00000200U	/* want/got sb_source */
+
+#  define UL_LSMT_ROOT			0xffffffffffffffffULL	/* root mount */
+
+/* statmount.sb_flags */
+#  define UL_SB_RDONLY			0x00000001
+#  define UL_SB_SYNCHRONOUS		0x00000010
+#  define UL_SB_DIRSYNC			0x00000080
+#  define UL_SB_LAZYTIME		0x02000000
+
+/* statmount.mnt_propagation */
+#  define UL_MS_UNBINDABLE		0x00020000
+#  define UL_MS_PRIVATE			0x00040000
+#  define UL_MS_SLAVE			0x00080000
+#  define UL_MS_SHARED			0x00100000
+
+static inline int ul_statmount(uint64_t mnt_id, uint64_t mask,
+			       struct ul_statmount *buf, size_t bufsize)
+{
+	struct ul_mnt_id_req req = {
+		.size = UL_MNT_ID_REQ_SIZE_VER0,
+		.mnt_id = mnt_id,
+		.param = mask
+	};
+
+	return syscall(SYS_statmount, &req, buf, bufsize, 0);
+}
+
+/* lists mount IDs below @mnt_id (the mounts after @last_id if not zero) */
+static inline ssize_t ul_listmount(uint64_t mnt_id, uint64_t last_id,
+				   uint64_t *list, size_t num)
+{
+	struct ul_mnt_id_req req = {
+		.size = UL_MNT_ID_REQ_SIZE_VER0,
+		.mnt_id = mnt_id,
+		.param = last_id
+	};
+
+	return syscall(SYS_listmount, &req, list, num, 0);
+}
+
+#  define UL_HAVE_MOUNT_API_LISTMOUNT 1
+
+# endif	/* SYS_statmount && SYS_listmount */
+
+# if defined(SYS_statx)
+#  include <stdint.h>
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <linux/types.h>
+
+struct ul_statx_timestamp {
+	__s64 tv_sec;
+	__u32 tv_nsec;
+	__s32 __reserved;
+};
+
+/* the same layout as struct statx, only the fields known by Linux 6.8 */
+struct ul_statx {
+	__u32 stx_mask;
+	__u32 stx_blksize;
+	__u64 stx_attributes;
+	__u32 stx_nlink;
+	__u32 stx_uid;
+	__u32 stx_gid;
+	__u16 stx_mode;
+	__u16 __spare0[1];
+	__u64 stx_ino;
+	__u64 stx_size;
+	__u64 stx_blocks;
+	__u64 stx_attributes_mask;
+	struct ul_statx_timestamp stx_atime;
+	struct ul_statx_timestamp stx_btime;
+	struct ul_statx_timestamp stx_ctime;
+	struct ul_statx_timestamp stx_mtime;
+	__u32 stx_rdev_major;
+	__u32 stx_rdev_minor;
+	__u32 stx_dev_major;
+	__u32 stx_dev_minor;
+	__u64 stx_mnt_id;	/* STATX_MNT_ID or STATX_MNT_ID_UNIQUE */
+	__u64 __spare3[13];
+};
+
+#  define UL_STATX_MNT_ID		0x00001000U	/* want/got old stx_mnt_id */
+#  define UL_STATX_MNT_ID_UNIQUE	0x00004000U	/* want/got unique stx_mnt_id */
+
+#  define UL_STATX_ATTR_MOUNT_ROOT	0x00002000	/* root of a mount */
+
+static inline int ul_statx(int dfd, const char *path, int flags,
+			   unsigned int mask, struct ul_statx *stx)
+{
+	return syscall(SYS_statx, dfd, path, flags, mask, stx);
+}
+
+#  define UL_HAVE_STATX 1
+
+# endif	/* SYS_statx */
+#endif /* __linux__ */
+#endif /* UTIL_LINUX_MOUNT_API_UTILS */
@@ -9,10 +9,21 @@
 
 #include "c.h"
 
+/* number of cached subdirectories for each path_cxt */
+#define UL_PATH_NSUBDIRS	4
+
+struct path_subdir {
+	char	*name;		/* relative to path_cxt directory */
+	int	fd;		/* -1 if used only once */
+};
+
 struct path_cxt {
 	int	dir_fd;
 	char	*dir_path;
 
+	struct path_subdir subdirs[UL_PATH_NSUBDIRS];
+	size_t	nsubdirs;	/* number of subdirs requests, for slots rotation */
+
 	int	refcount;
 
 	char *prefix;
@@ -116,6 +127,17 @@ int ul_path_write_u64(struct path_cxt *pc, uint64_t num, const char *path);
 int ul_path_writef_u64(struct path_cxt *pc, uint64_t num, const char *path, ...)
 				__attribute__ ((__format__ (__printf__, 3, 4)));
 
+/* for ul_path_read_attrs() */
+struct ul_path_attr {
+	const char	*name;		/* file name */
+	char		*buf;		/* result, without the tailing newline */
+	size_t		bufsz;
+	int		rc;		/* size of the result or -errno */
+};
+
+int ul_path_read_attrs(struct path_cxt *pc, const char *subdir,
+			struct ul_path_attr *attrs, size_t nattrs);
+
 int ul_path_count_dirents(struct path_cxt *pc, const char *path);
 int ul_path_countf_dirents(struct path_cxt *pc, const char *path, ...)
 				__attribute__ ((__format__ (__printf__, 2, 3)));
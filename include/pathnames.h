@@ -113,9 +113,11 @@
 #define _PATH_SYS_DEVCHAR	"/sys/dev/char"
 #define _PATH_SYS_CLASS		"/sys/class"
 #define _PATH_SYS_SCSI		"/sys/bus/scsi"
+#define _PATH_SYS_CGROUP	"/sys/fs/cgroup"
 
 #define _PATH_SYS_SELINUX	"/sys/fs/selinux"
 #define _PATH_SYS_APPARMOR	"/sys/kernel/security/apparmor"
+#define _PATH_SYS_UEVENT_SEQNUM	"/sys/kernel/uevent_seqnum"
 
 #ifndef _PATH_MOUNTED
 # ifdef MOUNTED					/* deprecated */
@@ -154,6 +156,11 @@
 #define _PATH_DEV_BYPATH	"/dev/disk/by-path"
 #define _PATH_DEV_BYPARTLABEL	"/dev/disk/by-partlabel"
 #define _PATH_DEV_BYPARTUUID	"/dev/disk/by-partuuid"
+#define _PATH_UDEV_DATA		"/run/udev/data"
+#define _PATH_UDEV_LINKS	"/run/udev/links"
+
+/* mountsnapd(8) */
+#define _PATH_MOUNTSNAPD_SOCKET	"/run/mount/snapshot.sock"
 
 /* hwclock paths */
 #ifdef CONFIG_ADJTIME_PATH
@@ -191,6 +198,7 @@
 
 /* logger paths */
 #define _PATH_DEVLOG		"/dev/log"
+#define _PATH_JOURNAL_SOCKET	"/run/systemd/journal/socket"
 
 /* ctrlaltdel paths */
 #define _PATH_PROC_CTRL_ALT_DEL	"/proc/sys/kernel/ctrl-alt-del"
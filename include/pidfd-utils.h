@@ -5,8 +5,13 @@
 # include <sys/syscall.h>
 # if defined(SYS_pidfd_send_signal)
 #  include <sys/types.h>
+#  include <signal.h>
+#  ifdef HAVE_SYS_PIDFD_H
+#   include <sys/pidfd.h>
+#  endif
 
-#  ifndef HAVE_PIDFD_OPEN
+/* libc may provide the function, but not the header */
+#  if !defined(HAVE_PIDFD_SEND_SIGNAL) || !defined(HAVE_SYS_PIDFD_H)
 static inline int pidfd_send_signal(int pidfd, int sig, siginfo_t *info,
 				    unsigned int flags)
 {
@@ -14,7 +19,7 @@ static inline int pidfd_send_signal(int pidfd, int sig, siginfo_t *info,
 }
 #  endif
 
-#  ifndef HAVE_PIDFD_SEND_SIGNAL
+#  if !defined(HAVE_PIDFD_OPEN) || !defined(HAVE_SYS_PIDFD_H)
 static inline int pidfd_open(pid_t pid, unsigned int flags)
 {
 	return syscall(SYS_pidfd_open, pid, flags);
@@ -1,18 +1,40 @@
 #ifndef UTIL_LINUX_PROCUTILS
 #define UTIL_LINUX_PROCUTILS
 
+#include <stdio.h>
 #include <dirent.h>
+#include <sys/types.h>
 
 struct proc_tasks {
 	DIR *dir;
+	FILE *file;		/* cgroup.threads or list of tasks */
+
+	char *line;		/* proc_next_tid_param() buffer */
+	size_t linesz;
+
+	unsigned int own_file : 1;
 };
 
 extern struct proc_tasks *proc_open_tasks(pid_t pid);
+extern struct proc_tasks *proc_open_cgroup_tasks(const char *cgroup);
+extern struct proc_tasks *proc_open_cgroup_procs(const char *cgroup);
+extern struct proc_tasks *proc_open_tasks_stream(FILE *f);
 extern void proc_close_tasks(struct proc_tasks *tasks);
 extern int proc_next_tid(struct proc_tasks *tasks, pid_t *tid);
+extern int proc_next_tid_param(struct proc_tasks *tasks, pid_t *tid, char **param);
 
 struct proc_processes {
-	DIR *dir;
+	int fd;			/* /proc */
+	DIR *dir;		/* if getdents64() is not available */
+	char *dents;		/* getdents64() buffer */
+	size_t dents_pos;
+	size_t dents_len;
+
+	pid_t pid;		/* the last returned process */
+	int pidfd;		/* its directory or -1 */
+
+	char *buf;		/* proc_processes_read() buffer */
+	size_t bufsz;
 
 	const char *fltr_name;
 	uid_t fltr_uid;
@@ -28,6 +50,11 @@ extern void proc_processes_filter_by_name(struct proc_processes *ps, const char
 extern void proc_processes_filter_by_uid(struct proc_processes *ps, uid_t uid);
 extern int proc_next_pid(struct proc_processes *ps, pid_t *pid);
 
+extern int proc_processes_get_dirfd(struct proc_processes *ps);
+extern char *proc_processes_read(struct proc_processes *ps, const char *name, size_t *sz);
+extern char *proc_processes_get_command(struct proc_processes *ps);
+extern char *proc_processes_get_name(struct proc_processes *ps);
+
 extern char *proc_get_command(pid_t pid);
 extern char *proc_get_command_name(pid_t pid);
 
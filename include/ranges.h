@@ -0,0 +1,20 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#ifndef UTIL_LINUX_RANGES_H
+#define UTIL_LINUX_RANGES_H
+
+#include <stddef.h>
+
+#define UL_RANGES_MAX	64	/* max number of threads */
+
+/* called for items [first, last) of the range number @range */
+typedef void (*ul_range_fn)(void *data, size_t range, size_t first, size_t last);
+
+extern size_t ul_count_ranges(size_t nitems, size_t min_per_thread,
+			      size_t max_threads);
+extern size_t ul_run_ranges(size_t nitems, size_t min_per_thread,
+			    size_t max_threads, ul_range_fn fn, void *data);
+
+#endif /* UTIL_LINUX_RANGES_H */
@@ -7,6 +7,7 @@
    100% Public Domain
  */
 
+#include <stddef.h>
 #include "stdint.h"
 
 #define UL_SHA1LENGTH		20
@@ -19,9 +20,13 @@ typedef struct
 } UL_SHA1_CTX;
 
 void ul_SHA1Transform(uint32_t state[5], const unsigned char buffer[64]);
+void ul_SHA1Transform_sw(uint32_t state[5], const unsigned char buffer[64]);
+const char *ul_SHA1_get_impl(void);
 void ul_SHA1Init(UL_SHA1_CTX *context);
 void ul_SHA1Update(UL_SHA1_CTX *context, const unsigned char *data, uint32_t len);
 void ul_SHA1Final(unsigned char digest[UL_SHA1LENGTH], UL_SHA1_CTX *context);
 void ul_SHA1(char *hash_out, const char *str, unsigned len);
+void ul_SHA1Multi(unsigned char (*digest)[UL_SHA1LENGTH],
+		  const unsigned char *const *data, const size_t *len, size_t n);
 
 #endif /* UTIL_LINUX_SHA1_H */
@@ -67,6 +67,7 @@
 #define STATFS_NCP_MAGIC	0x564c
 #define STATFS_NFS_MAGIC	0x6969
 #define STATFS_NILFS_MAGIC	0x3434
+#define STATFS_NSFS_MAGIC	0x6e736673
 #define STATFS_NTFS_MAGIC	0x5346544e
 #define STATFS_OCFS2_MAGIC	0x7461636f
 #define STATFS_OMFS_MAGIC	0xC2993D87
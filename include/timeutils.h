@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <inttypes.h>
+#include <time.h>
 #include <sys/time.h>
 
 typedef uint64_t usec_t;
@@ -85,6 +86,37 @@ int strtime_iso(const time_t *t, int flags, char *buf, size_t bufsz);
 
 int strtime_short(const time_t *t, struct timeval *now, int flags, char *buf, size_t bufsz);
 
+/*
+ * Cache for localtime_r() (or gmtime_r()) of the timestamps which are close
+ * to each other (log records, utmp entries, etc.). The broken-down time and
+ * the timezone offset are cached for the current day (or minute or second
+ * around DST changes and leap seconds), and the time of the next timestamp
+ * within the interval is calculated without libc. The zero-initialized
+ * struct is an empty cache.
+ */
+struct ul_timecache {
+	time_t		start;		/* cached interval [start, end) */
+	time_t		end;
+	struct tm	tm;		/* broken-down @start */
+	int		gmtoff;		/* seconds east of UTC */
+	char		shortdate[32];	/* strtime_short() date, "%b%d" */
+
+	time_t		now;		/* strtime_short() current time */
+	struct tm	tmnow;
+
+	unsigned int	valid : 1,
+			gmtime : 1,
+			nowvalid : 1;
+};
+
+int ul_timecache_tm(struct ul_timecache *tc, time_t t, int gmt, struct tm *tm);
+int strtimeval_iso_cached(struct ul_timecache *tc, const struct timeval *tv,
+			  int flags, char *buf, size_t bufsz);
+int strtime_iso_cached(struct ul_timecache *tc, const time_t *t,
+		       int flags, char *buf, size_t bufsz);
+int strtime_short_cached(struct ul_timecache *tc, const time_t *t, struct timeval *now,
+			 int flags, char *buf, size_t bufsz);
+
 #ifndef HAVE_TIMEGM
 extern time_t timegm(struct tm *tm);
 #endif
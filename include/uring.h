@@ -0,0 +1,57 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * Minimal io_uring wrapper (without liburing) for batched reads and writes.
+ */
+#ifndef UTIL_LINUX_URING_H
+#define UTIL_LINUX_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ul_uring {
+	int		fd;
+
+	/* submission queue */
+	unsigned int	*sq_head;
+	unsigned int	*sq_tail;
+	unsigned int	*sq_mask;
+	unsigned int	*sq_entries;
+	unsigned int	*sq_array;
+	void		*sqes;
+	unsigned int	sq_pending;	/* prepared, but not submitted yet */
+
+	/* completion queue */
+	unsigned int	*cq_head;
+	unsigned int	*cq_tail;
+	unsigned int	*cq_mask;
+	void		*cqes;
+
+	/* mmaped areas */
+	void		*sq_ptr;
+	size_t		sq_sz;
+	void		*cq_ptr;
+	size_t		cq_sz;
+	size_t		sqes_sz;
+};
+
+enum {
+	UL_URING_READ = 0,
+	UL_URING_WRITE
+};
+
+extern int ul_uring_init(struct ul_uring *ring, unsigned int entries);
+extern void ul_uring_deinit(struct ul_uring *ring);
+extern int ul_uring_is_ready(struct ul_uring *ring);
+
+extern int ul_uring_prep_rw(struct ul_uring *ring, int op, int fd,
+			    void *buf, size_t len, uint64_t off,
+			    uint64_t user_data);
+extern int ul_uring_submit(struct ul_uring *ring, unsigned int wait_nr);
+extern int ul_uring_get_completion(struct ul_uring *ring,
+			    uint64_t *user_data, int *res);
+extern int ul_uring_wait_completion(struct ul_uring *ring,
+			    uint64_t *user_data, int *res);
+
+#endif /* UTIL_LINUX_URING_H */
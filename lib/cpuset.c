@@ -123,26 +123,58 @@ int __cpuset_count_s(size_t setsize, const cpu_set_t *set)
 
 		if (l == 0)
 			continue;
-# if LONG_BIT > 32
-		l = (l & 0x5555555555555555ul) + ((l >> 1) & 0x5555555555555555ul);
-		l = (l & 0x3333333333333333ul) + ((l >> 2) & 0x3333333333333333ul);
-		l = (l & 0x0f0f0f0f0f0f0f0ful) + ((l >> 4) & 0x0f0f0f0f0f0f0f0ful);
-		l = (l & 0x00ff00ff00ff00fful) + ((l >> 8) & 0x00ff00ff00ff00fful);
-		l = (l & 0x0000ffff0000fffful) + ((l >> 16) & 0x0000ffff0000fffful);
-		l = (l & 0x00000000fffffffful) + ((l >> 32) & 0x00000000fffffffful);
-# else
-		l = (l & 0x55555555ul) + ((l >> 1) & 0x55555555ul);
-		l = (l & 0x33333333ul) + ((l >> 2) & 0x33333333ul);
-		l = (l & 0x0f0f0f0ful) + ((l >> 4) & 0x0f0f0f0ful);
-		l = (l & 0x00ff00fful) + ((l >> 8) & 0x00ff00fful);
-		l = (l & 0x0000fffful) + ((l >> 16) & 0x0000fffful);
-# endif
-		s += l;
+		s += __builtin_popcountl(l);
 	}
 	return s;
 }
 #endif
 
+/*
+ * Returns the first CPU >= @cpu which is set (or unset if @isset is zero), or
+ * cpuset_nbits(@setsize) if there is no such CPU. The set is scanned by words,
+ * so it's cheap to iterate over sparse sets with many possible CPUs.
+ */
+size_t cpuset_find_next(const cpu_set_t *set, size_t setsize, size_t cpu, int isset)
+{
+	const unsigned long *bits = (const unsigned long *) set->__bits;
+	size_t nwords = setsize / sizeof(unsigned long);
+	size_t max = cpuset_nbits(setsize);
+	size_t i = cpu / CPUSET_WORDBITS;
+	unsigned long w;
+
+	if (cpu >= max)
+		return max;
+
+	w = isset ? bits[i] : ~bits[i];
+	w &= ~0UL << (cpu % CPUSET_WORDBITS);
+
+	while (!w) {
+		if (++i >= nwords)
+			return max;
+		w = isset ? bits[i] : ~bits[i];
+	}
+	return i * CPUSET_WORDBITS + __builtin_ctzl(w);
+}
+
+/* sets CPUs from @a to @b (inclusive) */
+static void set_range(cpu_set_t *set, size_t a, size_t b)
+{
+	unsigned long *bits = (unsigned long *) set->__bits;
+	size_t first = a / CPUSET_WORDBITS, last = b / CPUSET_WORDBITS;
+	unsigned long fmask = ~0UL << (a % CPUSET_WORDBITS);
+	unsigned long lmask = ~0UL >> (CPUSET_WORDBITS - 1 - b % CPUSET_WORDBITS);
+	size_t i;
+
+	if (first == last) {
+		bits[first] |= fmask & lmask;
+		return;
+	}
+	bits[first] |= fmask;
+	for (i = first + 1; i < last; i++)
+		bits[i] = ~0UL;
+	bits[last] |= lmask;
+}
+
 /*
  * Returns human readable representation of the cpuset. The output format is
  * a list of CPUs with ranges (for example, "0,1,3-9").
@@ -150,36 +182,32 @@ int __cpuset_count_s(size_t setsize, const cpu_set_t *set)
 char *cpulist_create(char *str, size_t len,
 			cpu_set_t *set, size_t setsize)
 {
-	size_t i;
+	size_t i, end;
 	char *ptr = str;
 	int entry_made = 0;
 	size_t max = cpuset_nbits(setsize);
 
-	for (i = 0; i < max; i++) {
-		if (CPU_ISSET_S(i, setsize, set)) {
-			int rlen;
-			size_t j, run = 0;
-			entry_made = 1;
-			for (j = i + 1; j < max; j++) {
-				if (CPU_ISSET_S(j, setsize, set))
-					run++;
-				else
-					break;
-			}
-			if (!run)
-				rlen = snprintf(ptr, len, "%zu,", i);
-			else if (run == 1) {
-				rlen = snprintf(ptr, len, "%zu,%zu,", i, i + 1);
-				i++;
-			} else {
-				rlen = snprintf(ptr, len, "%zu-%zu,", i, i + run);
-				i += run;
-			}
-			if (rlen < 0 || (size_t) rlen >= len)
-				return NULL;
-			ptr += rlen;
-			len -= rlen;
-		}
+	for (i = cpuset_find_next(set, setsize, 0, 1); i < max;
+	     i = cpuset_find_next(set, setsize, end, 1)) {
+		int rlen;
+		size_t run;
+
+		/* the first unset CPU after the range */
+		end = cpuset_find_next(set, setsize, i + 1, 0);
+		run = end - i - 1;
+		entry_made = 1;
+
+		if (!run)
+			rlen = snprintf(ptr, len, "%zu,", i);
+		else if (run == 1)
+			rlen = snprintf(ptr, len, "%zu,%zu,", i, i + 1);
+		else
+			rlen = snprintf(ptr, len, "%zu-%zu,", i, i + run);
+
+		if (rlen < 0 || (size_t) rlen >= len)
+			return NULL;
+		ptr += rlen;
+		len -= rlen;
 	}
 	ptr -= entry_made;
 	*ptr = '\0';
@@ -193,29 +221,26 @@ char *cpulist_create(char *str, size_t len,
 char *cpumask_create(char *str, size_t len,
 			cpu_set_t *set, size_t setsize)
 {
+	const unsigned long *bits = (const unsigned long *) set->__bits;
+	size_t i = setsize / sizeof(unsigned long);
 	char *ptr = str;
 	char *ret = NULL;
-	int cpu;
 
-	for (cpu = cpuset_nbits(setsize) - 4; cpu >= 0; cpu -= 4) {
-		char val = 0;
+	while (i > 0) {
+		unsigned long w = bits[--i];
+		int sh;
 
-		if (len == (size_t) (ptr - str))
-			break;
+		for (sh = CPUSET_WORDBITS - 4; sh >= 0; sh -= 4) {
+			int val = (w >> sh) & 0xf;
 
-		if (CPU_ISSET_S(cpu, setsize, set))
-			val |= 1;
-		if (CPU_ISSET_S(cpu + 1, setsize, set))
-			val |= 2;
-		if (CPU_ISSET_S(cpu + 2, setsize, set))
-			val |= 4;
-		if (CPU_ISSET_S(cpu + 3, setsize, set))
-			val |= 8;
-
-		if (!ret && val)
-			ret = ptr;
-		*ptr++ = val_to_char(val);
+			if (len == (size_t) (ptr - str) + 1)
+				goto done;
+			if (!ret && val)
+				ret = ptr;
+			*ptr++ = val_to_char(val);
+		}
 	}
+done:
 	*ptr = '\0';
 	return ret ? ret : ptr - 1;
 }
@@ -225,9 +250,11 @@ char *cpumask_create(char *str, size_t len,
  */
 int cpumask_parse(const char *str, cpu_set_t *set, size_t setsize)
 {
+	unsigned long *bits = (unsigned long *) set->__bits;
+	size_t max = cpuset_nbits(setsize);
 	int len = strlen(str);
 	const char *ptr = str + len - 1;
-	int cpu = 0;
+	size_t cpu = 0;
 
 	/* skip 0x, it's all hex anyway */
 	if (len > 1 && !memcmp(str, "0x", 2L))
@@ -236,23 +263,20 @@ int cpumask_parse(const char *str, cpu_set_t *set, size_t setsize)
 	CPU_ZERO_S(setsize, set);
 
 	while (ptr >= str) {
-		char val;
+		int val;
 
 		/* cpu masks in /sys uses comma as a separator */
 		if (*ptr == ',')
 			ptr--;
 
 		val = char_to_val(*ptr);
-		if (val == (char) -1)
+		if (val < 0)
 			return -1;
-		if (val & 1)
-			CPU_SET_S(cpu, setsize, set);
-		if (val & 2)
-			CPU_SET_S(cpu + 1, setsize, set);
-		if (val & 4)
-			CPU_SET_S(cpu + 2, setsize, set);
-		if (val & 8)
-			CPU_SET_S(cpu + 3, setsize, set);
+
+		/* the word size is a multiple of 4 bits, the digit is never
+		 * split between two words; CPUs above the set are ignored */
+		if (val && cpu < max)
+			bits[cpu / CPUSET_WORDBITS] |= (unsigned long) val << (cpu % CPUSET_WORDBITS);
 		ptr--;
 		cpu += 4;
 	}
@@ -321,6 +345,17 @@ int cpulist_parse(const char *str, cpu_set_t *set, size_t setsize, int fail)
 
 		if (!(a <= b))
 			return 1;
+		if (s == 1) {
+			/* continuous range, set by words */
+			if (b >= max) {
+				if (fail)
+					return 2;
+				b = max - 1;
+			}
+			if (a <= b)
+				set_range(set, a, b);
+			continue;
+		}
 		while (a <= b) {
 			if (fail && (a >= max))
 				return 2;
@@ -337,22 +372,85 @@ int cpulist_parse(const char *str, cpu_set_t *set, size_t setsize, int fail)
 #ifdef TEST_PROGRAM_CPUSET
 
 #include <getopt.h>
+#include <time.h>
 
-int main(int argc, char *argv[])
+/*
+ * For example, 8k CPUs:
+ *
+ *	test_cpuset --ncpus 8192 --bench 1000
+ */
+static void benchmark(int ncpus, int loops)
 {
 	cpu_set_t *set;
+	size_t setsize, nbits, buflen, cpu, n = 0;
+	char *buf, *mask, *list;
+	struct timespec a, b;
+	int i;
+
+	set = cpuset_alloc(ncpus, &setsize, &nbits);
+	if (!set)
+		err(EXIT_FAILURE, "failed to allocate cpu set");
+
+	buflen = 7 * nbits;
+	buf = malloc(buflen);
+	if (!buf)
+		err(EXIT_FAILURE, "failed to allocate cpu set buffer");
+
+	/* threads siblings like pattern: ranges and holes */
+	CPU_ZERO_S(setsize, set);
+	for (cpu = 0; cpu < nbits; cpu++)
+		if (cpu % 16 < 12)
+			CPU_SET_S(cpu, setsize, set);
+
+	mask = strdup(cpumask_create(buf, buflen, set, setsize));
+	list = strdup(cpulist_create(buf, buflen, set, setsize));
+	if (!mask || !list)
+		err(EXIT_FAILURE, "failed to allocate strings");
+
+#define BENCH(_name, _code) \
+	do { \
+		clock_gettime(CLOCK_MONOTONIC, &a); \
+		for (i = 0; i < loops; i++) \
+			_code; \
+		clock_gettime(CLOCK_MONOTONIC, &b); \
+		printf("%-15s %10.3f us\n", _name, \
+			((b.tv_sec - a.tv_sec) * 1e6 + (b.tv_nsec - a.tv_nsec) / 1e3) / loops); \
+	} while (0)
+
+	printf("%zu CPUs, %d loops\n", nbits, loops);
+	BENCH("cpumask_parse", cpumask_parse(mask, set, setsize));
+	BENCH("cpulist_parse", cpulist_parse(list, set, setsize, 0));
+	BENCH("cpumask_create", cpumask_create(buf, buflen, set, setsize));
+	BENCH("cpulist_create", cpulist_create(buf, buflen, set, setsize));
+	BENCH("CPU_COUNT_S", n += CPU_COUNT_S(setsize, set));
+	BENCH("cpuset_foreach", cpuset_foreach(cpu, set, setsize) n++);
+#undef BENCH
+
+	free(mask);
+	free(list);
+	free(buf);
+	cpuset_free(set);
+}
+
+int main(int argc, char *argv[])
+{
+	cpu_set_t *set, *set2 = NULL;
 	size_t setsize, buflen, nbits;
-	char *buf, *mask = NULL, *range = NULL;
-	int ncpus = 2048, rc, c;
+	char *buf, *mask = NULL, *range = NULL, *oplist = NULL;
+	int ncpus = 2048, rc, c, op = 0, loops = 0;
 
 	static const struct option longopts[] = {
 	    { "ncpus", 1, NULL, 'n' },
 	    { "mask",  1, NULL, 'm' },
 	    { "range", 1, NULL, 'r' },
+	    { "and",   1, NULL, 'A' },
+	    { "or",    1, NULL, 'O' },
+	    { "xor",   1, NULL, 'X' },
+	    { "bench", 1, NULL, 'b' },
 	    { NULL,    0, NULL, 0 }
 	};
 
-	while ((c = getopt_long(argc, argv, "n:m:r:", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "n:m:r:A:O:X:b:", longopts, NULL)) != -1) {
 		switch(c) {
 		case 'n':
 			ncpus = atoi(optarg);
@@ -363,11 +461,24 @@ int main(int argc, char *argv[])
 		case 'r':
 			range = strdup(optarg);
 			break;
+		case 'A':
+		case 'O':
+		case 'X':
+			op = c;
+			oplist = optarg;
+			break;
+		case 'b':
+			loops = atoi(optarg);
+			break;
 		default:
 			goto usage_err;
 		}
 	}
 
+	if (loops > 0) {
+		benchmark(ncpus, loops);
+		return EXIT_SUCCESS;
+	}
 	if (!mask && !range)
 		goto usage_err;
 
@@ -393,9 +504,27 @@ int main(int argc, char *argv[])
 	if (rc)
 		errx(EXIT_FAILURE, "failed to parse string: %s", mask ? : range);
 
+	if (op) {
+		set2 = cpuset_alloc(ncpus, NULL, NULL);
+		if (!set2)
+			err(EXIT_FAILURE, "failed to allocate cpu set");
+		if (cpulist_parse(oplist, set2, setsize, 0))
+			errx(EXIT_FAILURE, "failed to parse string: %s", oplist);
+		if (op == 'A')
+			CPU_AND_S(setsize, set, set, set2);
+		else if (op == 'O')
+			CPU_OR_S(setsize, set, set, set2);
+		else
+			CPU_XOR_S(setsize, set, set, set2);
+		cpuset_free(set2);
+	}
+
 	printf("%-15s = %15s ", mask ? : range,
 				cpumask_create(buf, buflen, set, setsize));
-	printf("[%s]\n", cpulist_create(buf, buflen, set, setsize));
+	printf("[%s]", cpulist_create(buf, buflen, set, setsize));
+	if (op)
+		printf(" (%d CPUs)", CPU_COUNT_S(setsize, set));
+	fputc('\n', stdout);
 
 	free(buf);
 	free(mask);
@@ -406,7 +535,10 @@ int main(int argc, char *argv[])
 
 usage_err:
 	fprintf(stderr,
-		"usage: %s [--ncpus <num>] --mask <mask> | --range <list>\n",
+		"usage: %s [--ncpus <num>] --mask <mask> | --range <list>\n"
+		"          [--and | --or | --xor <list>]\n"
+		"       %s [--ncpus <num>] --bench <loops>\n",
+		program_invocation_short_name,
 		program_invocation_short_name);
 	exit(EXIT_FAILURE);
 }
@@ -39,9 +39,27 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "crc32.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+# include <cpuid.h>
+# include <immintrin.h>
+# define HAVE_CRC32_PCLMUL 1
+#endif
+
+#if defined(__aarch64__) && defined(__linux__) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 6))
+# include <sys/auxv.h>
+# include <arm_acle.h>
+# ifndef HWCAP_CRC32
+#  define HWCAP_CRC32	(1 << 7)
+# endif
+# define HAVE_CRC32_ARMV8 1
+#endif
+
 
 static const uint32_t crc32_tab[] = {
 	0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
@@ -107,8 +125,10 @@ static inline uint32_t crc32_add_char(uint32_t crc, unsigned char c)
  * This a generic crc32() function, it takes seed as an argument,
  * and does __not__ xor at the end. Then individual users can do
  * whatever they need.
+ *
+ * The table based implementation; always available.
  */
-uint32_t ul_crc32(uint32_t seed, const unsigned char *buf, size_t len)
+uint32_t ul_crc32_sw(uint32_t seed, const unsigned char *buf, size_t len)
 {
 	uint32_t crc = seed;
 	const unsigned char *p = buf;
@@ -121,22 +141,316 @@ uint32_t ul_crc32(uint32_t seed, const unsigned char *buf, size_t len)
 	return crc;
 }
 
+#ifdef HAVE_CRC32_PCLMUL
+/*
+ * Folding by carry-less multiplication, see Intel's "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction". The constants are for the
+ * bit-reflected crc32 polynomial. The function requires @len >= 64 and
+ * @len % 16 == 0.
+ */
+static uint32_t __attribute__((target("sse4.1,pclmul")))
+crc32_pclmul_fold(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	static const uint64_t __attribute__((aligned(16))) k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+	static const uint64_t __attribute__((aligned(16))) k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+	static const uint64_t __attribute__((aligned(16))) k5k0[] = { 0x0163cd6124, 0x0000000000 };
+	static const uint64_t __attribute__((aligned(16))) poly[] = { 0x01db710641, 0x01f7011641 };
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	x1 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	x0 = _mm_load_si128((const __m128i *) k1k2);
+
+	buf += 64;
+	len -= 64;
+
+	/* parallel fold by 64 bytes */
+	while (len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		y5 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+		y6 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+		y7 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+		y8 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+		buf += 64;
+		len -= 64;
+	}
+
+	/* fold into 128 bits */
+	x0 = _mm_load_si128((const __m128i *) k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* single fold by 16 bytes */
+	while (len >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *) buf);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		buf += 16;
+		len -= 16;
+	}
+
+	/* fold 128 bits to 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((const __m128i *) k5k0);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x0 = _mm_load_si128((const __m128i *) poly);
+
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	if (len >= 64) {
+		size_t n = len & ~(size_t) 15;
+
+		crc = crc32_pclmul_fold(crc, buf, n);
+		buf += n;
+		len -= n;
+	}
+	return ul_crc32_sw(crc, buf, len);
+}
+
+static int has_pclmul(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+#endif /* HAVE_CRC32_PCLMUL */
+
+#ifdef HAVE_CRC32_ARMV8
+static uint32_t __attribute__((target("+crc")))
+crc32_armv8(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	while (len && ((uintptr_t) buf & 7)) {
+		crc = __crc32b(crc, *buf++);
+		len--;
+	}
+	while (len >= 8) {
+		uint64_t x;
+
+		memcpy(&x, buf, sizeof(x));
+		crc = __crc32d(crc, x);
+		buf += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = __crc32b(crc, *buf++);
+	return crc;
+}
+#endif /* HAVE_CRC32_ARMV8 */
+
+static uint32_t crc32_dispatch(uint32_t seed, const unsigned char *buf, size_t len);
+
+static uint32_t (*crc32_impl)(uint32_t, const unsigned char *, size_t) = crc32_dispatch;
+static const char *crc32_impl_name = "table";
+
+/* the first call selects the best implementation for the current CPU */
+static uint32_t crc32_dispatch(uint32_t seed, const unsigned char *buf, size_t len)
+{
+	uint32_t (*fn)(uint32_t, const unsigned char *, size_t) = ul_crc32_sw;
+
+#ifdef HAVE_CRC32_PCLMUL
+	if (has_pclmul()) {
+		fn = crc32_pclmul;
+		crc32_impl_name = "pclmul";
+	}
+#endif
+#ifdef HAVE_CRC32_ARMV8
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+		fn = crc32_armv8;
+		crc32_impl_name = "armv8";
+	}
+#endif
+	crc32_impl = fn;
+	return fn(seed, buf, len);
+}
+
+uint32_t ul_crc32(uint32_t seed, const unsigned char *buf, size_t len)
+{
+	return crc32_impl(seed, buf, len);
+}
+
+/* returns name of the implementation used by ul_crc32() */
+const char *ul_crc32_get_impl(void)
+{
+	if (crc32_impl == crc32_dispatch)
+		crc32_dispatch(0, NULL, 0);
+	return crc32_impl_name;
+}
+
 uint32_t ul_crc32_exclude_offset(uint32_t seed, const unsigned char *buf, size_t len,
 			      size_t exclude_off, size_t exclude_len)
+{
+	uint32_t crc;
+	size_t end;
+
+	if (exclude_off > len)
+		exclude_off = len;
+	end = exclude_len > len - exclude_off ? len : exclude_off + exclude_len;
+
+	crc = ul_crc32(seed, buf, exclude_off);
+	for (len -= end; exclude_off < end; exclude_off++)
+		crc = crc32_add_char(crc, 0);
+	return ul_crc32(crc, buf + end, len);
+}
+
+#ifdef TEST_PROGRAM_CRC32
+#include <stdlib.h>
+#include <time.h>
+#include "c.h"
+#include "crc32c.h"
+
+#define BENCH_BUFSZ	(64 * 1024)
+
+static double bench(uint32_t (*fn)(uint32_t, const unsigned char *, size_t),
+		    const unsigned char *buf, size_t len, size_t total)
+{
+	struct timespec a, b;
+	uint32_t crc = ~0U;
+	size_t n;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	for (n = 0; n < total; n += len)
+		crc = fn(crc, buf, len);
+	clock_gettime(CLOCK_MONOTONIC, &b);
+
+	/* don't optimize out */
+	if (crc == 0x12345678)
+		fputc('\n', stderr);
+
+	return (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+}
+
+/* the original byte-by-byte implementation */
+static uint32_t exclude_offset_ref(uint32_t seed, const unsigned char *buf, size_t len,
+				   size_t exclude_off, size_t exclude_len)
 {
 	uint32_t crc = seed;
-	const unsigned char *p = buf;
 	size_t i;
 
 	for (i = 0; i < len; i++) {
-		unsigned char x = *p++;
+		unsigned char x = buf[i];
 
 		if (i >= exclude_off && i < exclude_off + exclude_len)
 			x = 0;
-
 		crc = crc32_add_char(crc, x);
 	}
-
 	return crc;
 }
 
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	return crc32c(crc, buf, len);
+}
+
+static uint32_t crc32c_tab(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	return crc32c_sw(crc, buf, len);
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t sizes[] = { 92, 512, 16384, BENCH_BUFSZ };
+	unsigned char *buf;
+	size_t i, len, total = 256 * 1024 * 1024;
+	int errors = 0;
+
+	buf = malloc(BENCH_BUFSZ + 1);
+	if (!buf)
+		err(EXIT_FAILURE, "malloc failed");
+
+	srandom(1);
+	for (i = 0; i < BENCH_BUFSZ + 1; i++)
+		buf[i] = random();
+
+	/* compare with the table based implementations */
+	for (len = 0; len < 4096; len++) {
+		uint32_t seed = random();
+		const unsigned char *p = buf + (len & 1);	/* unaligned too */
+		size_t off = random() % (len + 1);
+
+		if (ul_crc32(seed, p, len) != ul_crc32_sw(seed, p, len) ||
+		    crc32c(seed, p, len) != crc32c_sw(seed, p, len))
+			errors++;
+		if (ul_crc32_exclude_offset(seed, p, len, off, 4) !=
+		    exclude_offset_ref(seed, p, len, off, 4))
+			errors++;
+	}
+	printf("crc32:  %s\ncrc32c: %s\nverify: %s\n",
+			ul_crc32_get_impl(), crc32c_get_impl(),
+			errors ? "FAILED" : "OK");
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		if (argc > 2)
+			total = strtoul(argv[2], NULL, 10) * 1024 * 1024;
+		printf("throughput in MiB/s, %zu MiB per test\n", total / (1024 * 1024));
+		printf("%-8s %10s %10s %10s %10s\n", "size",
+				"crc32-sw", "crc32", "crc32c-sw", "crc32c");
+		for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+			double t1 = bench(ul_crc32_sw, buf, sizes[i], total);
+			double t2 = bench(ul_crc32, buf, sizes[i], total);
+			double t3 = bench(crc32c_tab, buf, sizes[i], total);
+			double t4 = bench(crc32c_hw, buf, sizes[i], total);
+			double mib = total / (1024.0 * 1024.0);
+
+			printf("%-8zu %10.0f %10.0f %10.0f %10.0f\n",
+					sizes[i], mib / t1, mib / t2,
+					mib / t3, mib / t4);
+		}
+	}
+
+	free(buf);
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif /* TEST_PROGRAM_CRC32 */
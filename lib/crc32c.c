@@ -10,8 +10,27 @@
  *  code or tables extracted from it, as desired without restriction.
  */
 
+#include <string.h>
+
 #include "crc32c.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+# include <cpuid.h>
+# include <immintrin.h>
+# define HAVE_CRC32C_SSE42 1
+#endif
+
+#if defined(__aarch64__) && defined(__linux__) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 6))
+# include <sys/auxv.h>
+# include <arm_acle.h>
+# ifndef HWCAP_CRC32
+#  define HWCAP_CRC32	(1 << 7)
+# endif
+# define HAVE_CRC32C_ARMV8 1
+#endif
+
 static const uint32_t crc32Table[256] = {
 	0x00000000L, 0xF26B8303L, 0xE13B70F7L, 0x1350F3F4L,
 	0xC79A971FL, 0x35F1141CL, 0x26A1E7E8L, 0xD4CA64EBL,
@@ -91,7 +110,7 @@ static const uint32_t crc32Table[256] = {
  *
  */
 uint32_t
-crc32c(uint32_t crc, const void *buf, size_t size)
+crc32c_sw(uint32_t crc, const void *buf, size_t size)
 {
 	const uint8_t *p = buf;
 
@@ -100,3 +119,113 @@ crc32c(uint32_t crc, const void *buf, size_t size)
 
 	return crc;
 }
+
+#ifdef HAVE_CRC32C_SSE42
+/* SSE4.2 crc32 instruction calculates reflected crc32c without xor */
+static uint32_t __attribute__((target("sse4.2")))
+crc32c_sse42(uint32_t crc, const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+
+	while (size && ((uintptr_t) p & 7)) {
+		crc = _mm_crc32_u8(crc, *p++);
+		size--;
+	}
+# ifdef __x86_64__
+	while (size >= 8) {
+		uint64_t x;
+
+		memcpy(&x, p, sizeof(x));
+		crc = (uint32_t) _mm_crc32_u64(crc, x);
+		p += 8;
+		size -= 8;
+	}
+# endif
+	while (size >= 4) {
+		uint32_t x;
+
+		memcpy(&x, p, sizeof(x));
+		crc = _mm_crc32_u32(crc, x);
+		p += 4;
+		size -= 4;
+	}
+	while (size--)
+		crc = _mm_crc32_u8(crc, *p++);
+
+	return crc;
+}
+
+static int has_sse42(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return (ecx & bit_SSE4_2) != 0;
+}
+#endif /* HAVE_CRC32C_SSE42 */
+
+#ifdef HAVE_CRC32C_ARMV8
+static uint32_t __attribute__((target("+crc")))
+crc32c_armv8(uint32_t crc, const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+
+	while (size && ((uintptr_t) p & 7)) {
+		crc = __crc32cb(crc, *p++);
+		size--;
+	}
+	while (size >= 8) {
+		uint64_t x;
+
+		memcpy(&x, p, sizeof(x));
+		crc = __crc32cd(crc, x);
+		p += 8;
+		size -= 8;
+	}
+	while (size--)
+		crc = __crc32cb(crc, *p++);
+
+	return crc;
+}
+#endif /* HAVE_CRC32C_ARMV8 */
+
+static uint32_t crc32c_dispatch(uint32_t crc, const void *buf, size_t size);
+
+static uint32_t (*crc32c_impl)(uint32_t, const void *, size_t) = crc32c_dispatch;
+static const char *crc32c_impl_name = "table";
+
+/* the first call selects the best implementation for the current CPU */
+static uint32_t crc32c_dispatch(uint32_t crc, const void *buf, size_t size)
+{
+	uint32_t (*fn)(uint32_t, const void *, size_t) = crc32c_sw;
+
+#ifdef HAVE_CRC32C_SSE42
+	if (has_sse42()) {
+		fn = crc32c_sse42;
+		crc32c_impl_name = "sse4.2";
+	}
+#endif
+#ifdef HAVE_CRC32C_ARMV8
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+		fn = crc32c_armv8;
+		crc32c_impl_name = "armv8";
+	}
+#endif
+	crc32c_impl = fn;
+	return fn(crc, buf, size);
+}
+
+uint32_t
+crc32c(uint32_t crc, const void *buf, size_t size)
+{
+	return crc32c_impl(crc, buf, size);
+}
+
+/* returns name of the implementation used by crc32c() */
+const char *crc32c_get_impl(void)
+{
+	if (crc32c_impl == crc32c_dispatch)
+		crc32c_dispatch(0, NULL, 0);
+	return crc32c_impl_name;
+}
@@ -3,25 +3,48 @@
  * it what you wish.
  *
  * Written by Karel Zak <kzak@redhat.com>
+ *
+ * The entries are in a list (in order of addition) and in open addressing
+ * hash table, so the lookups do not depend on number of the entries. The
+ * unknown IDs are cached too, the name is the number or NULL (see
+ * IDCACHE_FLAGS_NEGATIVE), so getpwuid() or getgrgid() is never called
+ * more than once for the same ID.
  */
 #include <wchar.h>
 #include <pwd.h>
 #include <grp.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #include "c.h"
 #include "idcache.h"
 
+#define IDCACHE_HASHSZ_MIN	64
+
+/* add_uids() and add_gids() read whole database for more IDs */
+#define IDCACHE_ENUM_MIN	64
+
+static inline size_t idcache_hash(unsigned long int id)
+{
+	uint64_t x = id;
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x;
+}
+
 struct identry *get_id(struct idcache *ic, unsigned long int id)
 {
-	struct identry *ent;
+	size_t i, mask;
 
-	if (!ic)
+	if (!ic || !ic->hashsz)
 		return NULL;
 
-	for (ent = ic->ent; ent; ent = ent->next) {
-		if (ent->id == id)
-			return ent;
+	mask = ic->hashsz - 1;
+	for (i = idcache_hash(id) & mask; ic->hash[i]; i = (i + 1) & mask) {
+		if (ic->hash[i]->id == id)
+			return ic->hash[i];
 	}
 
 	return NULL;
@@ -32,6 +55,38 @@ struct idcache *new_idcache(void)
 	return calloc(1, sizeof(struct idcache));
 }
 
+void idcache_set_flags(struct idcache *ic, int flags)
+{
+	ic->flags = flags;
+}
+
+static void hash_insert(struct identry **hash, size_t hashsz, struct identry *ent)
+{
+	size_t i, mask = hashsz - 1;
+
+	for (i = idcache_hash(ent->id) & mask; hash[i]; i = (i + 1) & mask);
+	hash[i] = ent;
+}
+
+/* keeps the table at most half full */
+static int hash_grow(struct idcache *ic)
+{
+	struct identry **hash, *ent;
+	size_t sz = ic->hashsz ? ic->hashsz * 2 : IDCACHE_HASHSZ_MIN;
+
+	hash = calloc(sz, sizeof(struct identry *));
+	if (!hash)
+		return -1;
+
+	for (ent = ic->ent; ent; ent = ent->next)
+		hash_insert(hash, sz, ent);
+
+	free(ic->hash);
+	ic->hash = hash;
+	ic->hashsz = sz;
+	return 0;
+}
+
 void free_idcache(struct idcache *ic)
 {
 	struct identry *ent = ic->ent;
@@ -43,14 +98,18 @@ void free_idcache(struct idcache *ic)
 		ent = next;
 	}
 
+	free(ic->hash);
 	free(ic);
 }
 
 static void add_id(struct idcache *ic, char *name, unsigned long int id)
 {
-	struct identry *ent, *x;
+	struct identry *ent;
 	int w = 0;
 
+	if ((ic->nents + 1) * 2 > ic->hashsz && hash_grow(ic) != 0)
+		return;
+
 	ent = calloc(1, sizeof(struct identry));
 	if (!ent)
 		return;
@@ -76,6 +135,8 @@ static void add_id(struct idcache *ic, char *name, unsigned long int id)
 			free(ent);
 			return;
 		}
+	} else if (!name && (ic->flags & IDCACHE_FLAGS_NEGATIVE)) {
+		ent->name = NULL;
 	} else {
 		if (asprintf(&ent->name, "%lu", id) < 0) {
 			free(ent);
@@ -83,12 +144,14 @@ static void add_id(struct idcache *ic, char *name, unsigned long int id)
 		}
 	}
 
-	for (x = ic->ent; x && x->next; x = x->next);
-
-	if (x)
-		x->next = ent;
+	if (ic->last)
+		ic->last->next = ent;
 	else
 		ic->ent = ent;
+	ic->last = ent;
+
+	hash_insert(ic->hash, ic->hashsz, ent);
+	ic->nents++;
 
 	if (w <= 0)
 		w = ent->name ? strlen(ent->name) : 0;
@@ -116,3 +179,152 @@ void add_gid(struct idcache *cache, unsigned long int id)
 	}
 }
 
+
+static int cmp_ids(const void *a, const void *b)
+{
+	return cmp_numbers(*(const unsigned long int *) a,
+			   *(const unsigned long int *) b);
+}
+
+/* returns sorted unique IDs which are not in the cache yet */
+static unsigned long int *get_wanted_ids(struct idcache *ic,
+					 const unsigned long int *ids, size_t nids,
+					 size_t *nwanted)
+{
+	unsigned long int *wanted;
+	size_t i, n = 0;
+
+	*nwanted = 0;
+	if (!nids)
+		return NULL;
+
+	wanted = malloc(nids * sizeof(unsigned long int));
+	if (!wanted)
+		return NULL;
+
+	for (i = 0; i < nids; i++) {
+		if (!get_id(ic, ids[i]))
+			wanted[n++] = ids[i];
+	}
+	if (n) {
+		size_t j;
+
+		qsort(wanted, n, sizeof(unsigned long int), cmp_ids);
+		for (i = 1, j = 1; i < n; i++) {
+			if (wanted[i] != wanted[j - 1])
+				wanted[j++] = wanted[i];
+		}
+		n = j;
+	}
+	*nwanted = n;
+	return wanted;
+}
+
+static int is_wanted(const unsigned long int *wanted, size_t nwanted,
+		     unsigned long int id)
+{
+	return bsearch(&id, wanted, nwanted, sizeof(unsigned long int), cmp_ids) != NULL;
+}
+
+/*
+ * Resolves more IDs at once. For more IDs the whole database is read by one
+ * pass instead of a lookup for each ID. The first entry wins, the same as for
+ * getpwuid(). The IDs which are not found by the pass (databases which do
+ * not support enumeration) are resolved by getpwuid().
+ */
+void add_uids(struct idcache *cache, const unsigned long int *ids, size_t nids)
+{
+	unsigned long int *wanted;
+	size_t i, nwanted;
+
+	wanted = get_wanted_ids(cache, ids, nids, &nwanted);
+	if (!wanted)
+		return;
+
+	if (nwanted >= IDCACHE_ENUM_MIN) {
+		struct passwd *pw;
+
+		setpwent();
+		while ((pw = getpwent())) {
+			if (is_wanted(wanted, nwanted, pw->pw_uid)
+			    && !get_id(cache, pw->pw_uid))
+				add_id(cache, pw->pw_name, pw->pw_uid);
+		}
+		endpwent();
+	}
+
+	for (i = 0; i < nwanted; i++)
+		add_uid(cache, wanted[i]);
+	free(wanted);
+}
+
+/* the same as add_uids(), but for groups */
+void add_gids(struct idcache *cache, const unsigned long int *ids, size_t nids)
+{
+	unsigned long int *wanted;
+	size_t i, nwanted;
+
+	wanted = get_wanted_ids(cache, ids, nids, &nwanted);
+	if (!wanted)
+		return;
+
+	if (nwanted >= IDCACHE_ENUM_MIN) {
+		struct group *gr;
+
+		setgrent();
+		while ((gr = getgrent())) {
+			if (is_wanted(wanted, nwanted, gr->gr_gid)
+			    && !get_id(cache, gr->gr_gid))
+				add_id(cache, gr->gr_name, gr->gr_gid);
+		}
+		endgrent();
+	}
+
+	for (i = 0; i < nwanted; i++)
+		add_gid(cache, wanted[i]);
+	free(wanted);
+}
+
+#ifdef TEST_PROGRAM_IDCACHE
+#include <stdlib.h>
+
+int main(int argc, char *argv[])
+{
+	struct idcache *ic;
+	unsigned long int *ids;
+	int i, nids, gids;
+
+	if (argc < 3 || (strcmp(argv[1], "--uids") && strcmp(argv[1], "--gids"))) {
+		fprintf(stderr, "usage: %s --uids|--gids <id> ...\n",
+				program_invocation_short_name);
+		return EXIT_FAILURE;
+	}
+
+	gids = strcmp(argv[1], "--gids") == 0;
+	nids = argc - 2;
+	ids = calloc(nids, sizeof(unsigned long int));
+	ic = new_idcache();
+	if (!ids || !ic)
+		return EXIT_FAILURE;
+
+	idcache_set_flags(ic, IDCACHE_FLAGS_NEGATIVE);
+
+	for (i = 0; i < nids; i++)
+		ids[i] = strtoul(argv[i + 2], NULL, 10);
+
+	if (gids)
+		add_gids(ic, ids, nids);
+	else
+		add_uids(ic, ids, nids);
+
+	for (i = 0; i < nids; i++) {
+		struct identry *ent = get_id(ic, ids[i]);
+
+		printf("%lu: %s\n", ids[i], ent && ent->name ? ent->name : "<unknown>");
+	}
+
+	free(ids);
+	free_idcache(ic);
+	return EXIT_SUCCESS;
+}
+#endif /* TEST_PROGRAM_IDCACHE */
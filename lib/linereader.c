@@ -0,0 +1,98 @@
+/*
+ * Buffered line reader for the text filters. The input is read by large
+ * read() calls and split to lines by memchr(), the lines are returned as
+ * pointers to the buffer, so there is no copy and no locking as for stdio.
+ *
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#include <errno.h>
+#include <unistd.h>
+
+#include "c.h"
+#include "xalloc.h"
+#include "linereader.h"
+
+#define UL_LINEREADER_BUFSZ	(128 * 1024)
+
+void ul_init_linereader(struct ul_linereader *lr, int fd)
+{
+	memset(lr, 0, sizeof(*lr));
+	lr->fd = fd;
+}
+
+/* starts to read from another file, the buffer is reused */
+void ul_reset_linereader(struct ul_linereader *lr, int fd)
+{
+	lr->fd = fd;
+	lr->begin = lr->end = 0;
+	lr->eof = 0;
+}
+
+void ul_free_linereader(struct ul_linereader *lr)
+{
+	free(lr->buf);
+	memset(lr, 0, sizeof(*lr));
+	lr->fd = -1;
+}
+
+static int fill_buffer(struct ul_linereader *lr)
+{
+	ssize_t n;
+
+	if (lr->begin) {
+		/* move the incomplete line to the begin of the buffer */
+		memmove(lr->buf, lr->buf + lr->begin, lr->end - lr->begin);
+		lr->end -= lr->begin;
+		lr->begin = 0;
+	}
+	if (lr->end == lr->bufsz) {
+		lr->bufsz = lr->bufsz ? lr->bufsz * 2 : UL_LINEREADER_BUFSZ;
+		lr->buf = xrealloc(lr->buf, lr->bufsz);
+	}
+
+	do {
+		n = read(lr->fd, lr->buf + lr->end, lr->bufsz - lr->end);
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0)
+		return -errno;
+	if (n == 0)
+		lr->eof = 1;
+	lr->end += n;
+	return 0;
+}
+
+/*
+ * Returns size of the next line (including the terminating '\n', the last
+ * line does not have to be terminated), 0 at the end of the file or negative
+ * number on error. The @line is valid until the next call.
+ */
+ssize_t ul_linereader_next(struct ul_linereader *lr, char **line)
+{
+	size_t scanned = 0;
+
+	for (;;) {
+		char *p = NULL;
+		int rc;
+
+		if (lr->end > lr->begin + scanned)
+			p = memchr(lr->buf + lr->begin + scanned, '\n',
+				   lr->end - lr->begin - scanned);
+		if (p || (lr->eof && lr->end > lr->begin)) {
+			size_t sz = p ? (size_t) (p - (lr->buf + lr->begin)) + 1
+				      : lr->end - lr->begin;
+
+			*line = lr->buf + lr->begin;
+			lr->begin += sz;
+			return sz;
+		}
+		if (lr->eof)
+			return 0;
+
+		scanned = lr->end - lr->begin;
+		rc = fill_buffer(lr);
+		if (rc)
+			return rc;
+	}
+}
@@ -32,6 +32,7 @@
 #include <sys/mman.h>
 #include <inttypes.h>
 #include <dirent.h>
+#include <time.h>
 
 #include "linux_version.h"
 #include "c.h"
@@ -41,6 +42,7 @@
 #include "canonicalize.h"
 #include "blkdev.h"
 #include "debug.h"
+#include "all-io.h"
 
 /*
  * Debug stuff (based on include/debug.h)
@@ -66,6 +68,14 @@ static void loopdev_init_debug(void)
 	__UL_INIT_DEBUG_FROM_ENV(loopdev, LOOPDEV_DEBUG_, 0, LOOPDEV_DEBUG);
 }
 
+static void loopcxt_free_index(struct loopdev_cxt *lc);
+
+static void loopcxt_reset_attrs(struct loopdev_cxt *lc)
+{
+	free(lc->attrs.backing_file);
+	memset(&lc->attrs, 0, sizeof(lc->attrs));
+}
+
 /*
  * see loopcxt_init()
  */
@@ -101,6 +111,7 @@ int loopcxt_set_device(struct loopdev_cxt *lc, const char *device)
 	lc->info_failed = 0;
 	*lc->device = '\0';
 	memset(&lc->info, 0, sizeof(lc->info));
+	loopcxt_reset_attrs(lc);
 
 	/* set new */
 	if (device) {
@@ -213,6 +224,7 @@ void loopcxt_deinit(struct loopdev_cxt *lc)
 
 	ignore_result( loopcxt_set_device(lc, NULL) );
 	loopcxt_deinit_iterator(lc);
+	loopcxt_free_index(lc);
 
 	errno = errsv;
 }
@@ -678,6 +690,79 @@ struct loop_info64 *loopcxt_get_info(struct loopdev_cxt *lc)
 	return NULL;
 }
 
+static int attr_to_u64(const char *str, uint64_t *res)
+{
+	char *end = NULL;
+
+	errno = 0;
+	*res = strtoumax(str, &end, 10);
+	return errno || end == str ? -EINVAL : 0;
+}
+
+static int attr_to_int(const char *str, int *res)
+{
+	char *end = NULL;
+
+	errno = 0;
+	*res = strtol(str, &end, 10);
+	return errno || end == str ? -EINVAL : 0;
+}
+
+/*
+ * @lc: context
+ *
+ * Reads all sysfs attributes used by loopcxt_get_* and loopcxt_is_* functions
+ * by one call, the getters use the cached values until the device is modified
+ * or another device is set. This is useful if more attributes are necessary,
+ * for example to list devices.
+ *
+ * Returns: number of the read attributes or <0 on error.
+ */
+int loopcxt_read_attrs(struct loopdev_cxt *lc)
+{
+	struct path_cxt *sysfs = loopcxt_get_sysfs(lc);
+	struct loopdev_attrs *a = &lc->attrs;
+	char file[PATH_MAX], offset[32], sizelimit[32], blocksize[32],
+	     autoclear[8], ro[8], dio[8], partscan[8];
+	struct ul_path_attr attrs[] = {
+		{ .name = "loop/backing_file", .buf = file, .bufsz = sizeof(file) },
+		{ .name = "loop/offset", .buf = offset, .bufsz = sizeof(offset) },
+		{ .name = "loop/sizelimit", .buf = sizelimit, .bufsz = sizeof(sizelimit) },
+		{ .name = "queue/logical_block_size", .buf = blocksize, .bufsz = sizeof(blocksize) },
+		{ .name = "loop/autoclear", .buf = autoclear, .bufsz = sizeof(autoclear) },
+		{ .name = "ro", .buf = ro, .bufsz = sizeof(ro) },
+		{ .name = "loop/dio", .buf = dio, .bufsz = sizeof(dio) },
+		{ .name = "loop/partscan", .buf = partscan, .bufsz = sizeof(partscan) }
+	};
+	int rc;
+
+	loopcxt_reset_attrs(lc);
+	if (!sysfs)
+		return -EINVAL;
+
+	rc = ul_path_read_attrs(sysfs, NULL, attrs, ARRAY_SIZE(attrs));
+
+	if (attrs[0].rc > 0 && (a->backing_file = strdup(file)))
+		a->mask |= LOOPDEV_ATTR_BACKING_FILE;
+	if (attrs[1].rc > 0 && attr_to_u64(offset, &a->offset) == 0)
+		a->mask |= LOOPDEV_ATTR_OFFSET;
+	if (attrs[2].rc > 0 && attr_to_u64(sizelimit, &a->sizelimit) == 0)
+		a->mask |= LOOPDEV_ATTR_SIZELIMIT;
+	if (attrs[3].rc > 0 && attr_to_u64(blocksize, &a->blocksize) == 0)
+		a->mask |= LOOPDEV_ATTR_BLOCKSIZE;
+	if (attrs[4].rc > 0 && attr_to_int(autoclear, &a->autoclear) == 0)
+		a->mask |= LOOPDEV_ATTR_AUTOCLEAR;
+	if (attrs[5].rc > 0 && attr_to_int(ro, &a->readonly) == 0)
+		a->mask |= LOOPDEV_ATTR_READONLY;
+	if (attrs[6].rc > 0 && attr_to_int(dio, &a->dio) == 0)
+		a->mask |= LOOPDEV_ATTR_DIO;
+	if (attrs[7].rc > 0 && attr_to_int(partscan, &a->partscan) == 0)
+		a->mask |= LOOPDEV_ATTR_PARTSCAN;
+
+	DBG(CXT, ul_debugobj(lc, "read_attrs [rc=%d, mask=0x%x]", rc, a->mask));
+	return rc;
+}
+
 /*
  * @lc: context
  *
@@ -686,9 +771,13 @@ struct loop_info64 *loopcxt_get_info(struct loopdev_cxt *lc)
  */
 char *loopcxt_get_backing_file(struct loopdev_cxt *lc)
 {
-	struct path_cxt *sysfs = loopcxt_get_sysfs(lc);
+	struct path_cxt *sysfs;
 	char *res = NULL;
 
+	if (lc->attrs.mask & LOOPDEV_ATTR_BACKING_FILE)
+		return strdup(lc->attrs.backing_file);
+
+	sysfs = loopcxt_get_sysfs(lc);
 	if (sysfs)
 		/*
 		 * This is always preferred, the loop_info64
@@ -718,9 +807,16 @@ char *loopcxt_get_backing_file(struct loopdev_cxt *lc)
  */
 int loopcxt_get_offset(struct loopdev_cxt *lc, uint64_t *offset)
 {
-	struct path_cxt *sysfs = loopcxt_get_sysfs(lc);
+	struct path_cxt *sysfs;
 	int rc = -EINVAL;
 
+	if (lc->attrs.mask & LOOPDEV_ATTR_OFFSET) {
+		if (offset)
+			*offset = lc->attrs.offset;
+		return 0;
+	}
+
+	sysfs = loopcxt_get_sysfs(lc);
 	if (sysfs)
 		rc = ul_path_read_u64(sysfs, offset, "loop/offset");
 
@@ -746,9 +842,15 @@ int loopcxt_get_offset(struct loopdev_cxt *lc, uint64_t *offset)
  */
 int loopcxt_get_blocksize(struct loopdev_cxt *lc, uint64_t *blocksize)
 {
-	struct path_cxt *sysfs = loopcxt_get_sysfs(lc);
+	struct path_cxt *sysfs;
 	int rc = -EINVAL;
 
+	if (lc->attrs.mask & LOOPDEV_ATTR_BLOCKSIZE) {
+		*blocksize = lc->attrs.blocksize;
+		return 0;
+	}
+
+	sysfs = loopcxt_get_sysfs(lc);
 	if (sysfs)
 		rc = ul_path_read_u64(sysfs, blocksize, "queue/logical_block_size");
 
@@ -778,9 +880,16 @@ int loopcxt_get_blocksize(struct loopdev_cxt *lc, uint64_t *blocksize)
  */
 int loopcxt_get_sizelimit(struct loopdev_cxt *lc, uint64_t *size)
 {
-	struct path_cxt *sysfs = loopcxt_get_sysfs(lc);
+	struct path_cxt *sysfs;
 	int rc = -EINVAL;
 
+	if (lc->attrs.mask & LOOPDEV_ATTR_SIZELIMIT) {
+		if (size)
+			*size = lc->attrs.sizelimit;
+		return 0;
+	}
+
+	sysfs = loopcxt_get_sysfs(lc);
 	if (sysfs)
 		rc = ul_path_read_u64(sysfs, size, "loop/sizelimit");
 
@@ -927,8 +1036,12 @@ int loopmod_supports_partscan(void)
  */
 int loopcxt_is_partscan(struct loopdev_cxt *lc)
 {
-	struct path_cxt *sysfs = loopcxt_get_sysfs(lc);
+	struct path_cxt *sysfs;
+
+	if (lc->attrs.mask & LOOPDEV_ATTR_PARTSCAN)
+		return lc->attrs.partscan;
 
+	sysfs = loopcxt_get_sysfs(lc);
 	if (sysfs) {
 		/* kernel >= 3.2 */
 		int fl;
@@ -947,8 +1060,12 @@ int loopcxt_is_partscan(struct loopdev_cxt *lc)
  */
 int loopcxt_is_autoclear(struct loopdev_cxt *lc)
 {
-	struct path_cxt *sysfs = loopcxt_get_sysfs(lc);
+	struct path_cxt *sysfs;
+
+	if (lc->attrs.mask & LOOPDEV_ATTR_AUTOCLEAR)
+		return lc->attrs.autoclear;
 
+	sysfs = loopcxt_get_sysfs(lc);
 	if (sysfs) {
 		int fl;
 		if (ul_path_read_s32(sysfs, &fl, "loop/autoclear") == 0)
@@ -970,8 +1087,12 @@ int loopcxt_is_autoclear(struct loopdev_cxt *lc)
  */
 int loopcxt_is_readonly(struct loopdev_cxt *lc)
 {
-	struct path_cxt *sysfs = loopcxt_get_sysfs(lc);
+	struct path_cxt *sysfs;
+
+	if (lc->attrs.mask & LOOPDEV_ATTR_READONLY)
+		return lc->attrs.readonly;
 
+	sysfs = loopcxt_get_sysfs(lc);
 	if (sysfs) {
 		int fl;
 		if (ul_path_read_s32(sysfs, &fl, "ro") == 0)
@@ -993,8 +1114,12 @@ int loopcxt_is_readonly(struct loopdev_cxt *lc)
  */
 int loopcxt_is_dio(struct loopdev_cxt *lc)
 {
-	struct path_cxt *sysfs = loopcxt_get_sysfs(lc);
+	struct path_cxt *sysfs;
+
+	if (lc->attrs.mask & LOOPDEV_ATTR_DIO)
+		return lc->attrs.dio;
 
+	sysfs = loopcxt_get_sysfs(lc);
 	if (sysfs) {
 		int fl;
 		if (ul_path_read_s32(sysfs, &fl, "loop/dio") == 0)
@@ -1269,12 +1394,17 @@ static int loopcxt_check_size(struct loopdev_cxt *lc, int file_fd)
  * The device is also initialized read-only if the backing file is not
  * possible to open read-write (e.g. read-only FS).
  *
+ * The backing file, block size and status are set by one LOOP_CONFIGURE
+ * ioctl, so the device is never visible half-initialized. The old LOOP_SET_FD,
+ * LOOP_SET_BLOCK_SIZE and LOOP_SET_STATUS64 sequence is used for old kernels.
+ *
  * Returns: <0 on error, 0 on success.
  */
 int loopcxt_setup_device(struct loopdev_cxt *lc)
 {
 	int file_fd, dev_fd, mode = O_RDWR, rc = -1, cnt = 0, err, again;
 	int errsv = 0;
+	struct loop_config config;
 
 	if (!lc || !*lc->device || !lc->filename)
 		return -EINVAL;
@@ -1334,6 +1464,26 @@ int loopcxt_setup_device(struct loopdev_cxt *lc)
 
 	DBG(SETUP, ul_debugobj(lc, "device open: OK"));
 
+	/*
+	 * Set FD, block size and status by one ioctl
+	 */
+	memset(&config, 0, sizeof(config));
+	config.fd = file_fd;
+	config.block_size = lc->blocksize;
+	config.info = lc->info;
+
+	if (ioctl(dev_fd, LOOP_CONFIGURE, &config) == 0) {
+		DBG(SETUP, ul_debugobj(lc, "LOOP_CONFIGURE: OK"));
+		goto configured;
+	}
+	if (errno != EINVAL && errno != ENOTTY) {
+		rc = -errno;
+		errsv = errno;
+		DBG(SETUP, ul_debugobj(lc, "LOOP_CONFIGURE failed: %m"));
+		goto err;
+	}
+	DBG(SETUP, ul_debugobj(lc, "LOOP_CONFIGURE unsupported: %m"));
+
 	/*
 	 * Set FD
 	 */
@@ -1366,7 +1516,7 @@ int loopcxt_setup_device(struct loopdev_cxt *lc)
 	}
 
 	DBG(SETUP, ul_debugobj(lc, "LOOP_SET_STATUS64: OK"));
-
+configured:
 	if ((rc = loopcxt_check_size(lc, file_fd)))
 		goto err;
 
@@ -1375,6 +1525,8 @@ int loopcxt_setup_device(struct loopdev_cxt *lc)
 	memset(&lc->info, 0, sizeof(lc->info));
 	lc->has_info = 0;
 	lc->info_failed = 0;
+	loopcxt_reset_attrs(lc);
+	loopcxt_free_index(lc);
 
 	DBG(SETUP, ul_debugobj(lc, "success [rc=0]"));
 	return 0;
@@ -1427,6 +1579,7 @@ int loopcxt_ioctl_status(struct loopdev_cxt *lc)
 	}
 
 	DBG(SETUP, ul_debugobj(lc, "LOOP_SET_STATUS64: OK"));
+	loopcxt_reset_attrs(lc);
 	return 0;
 }
 
@@ -1445,6 +1598,7 @@ int loopcxt_ioctl_capacity(struct loopdev_cxt *lc)
 	}
 
 	DBG(CXT, ul_debugobj(lc, "capacity set"));
+	loopcxt_reset_attrs(lc);
 	return 0;
 }
 
@@ -1463,6 +1617,7 @@ int loopcxt_ioctl_dio(struct loopdev_cxt *lc, unsigned long use_dio)
 	}
 
 	DBG(CXT, ul_debugobj(lc, "direct io set"));
+	loopcxt_reset_attrs(lc);
 	return 0;
 }
 
@@ -1485,6 +1640,7 @@ int loopcxt_ioctl_blocksize(struct loopdev_cxt *lc, uint64_t blocksize)
 	}
 
 	DBG(CXT, ul_debugobj(lc, "logical block size set"));
+	loopcxt_reset_attrs(lc);
 	return 0;
 }
 
@@ -1499,6 +1655,8 @@ int loopcxt_delete_device(struct loopdev_cxt *lc)
 		DBG(CXT, ul_debugobj(lc, "LOOP_CLR_FD failed: %m"));
 		return -errno;
 	}
+	loopcxt_reset_attrs(lc);
+	loopcxt_free_index(lc);
 
 	DBG(CXT, ul_debugobj(lc, "device removed"));
 	return 0;
@@ -1580,6 +1738,35 @@ int loopcxt_find_unused(struct loopdev_cxt *lc)
 	return rc;
 }
 
+/*
+ * @lc: context
+ * @attempt: number of the failed attempts (starts from 0)
+ *
+ * Waits before the next loopcxt_find_unused() and loopcxt_setup_device() if
+ * the unused device has been stolen by another process (-EBUSY). The first
+ * retry is immediate (another device is already free), the next retries wait
+ * for a random time up to exponentially growing limit (max. 64ms), so many
+ * processes do not fight again for the same device.
+ */
+void loopcxt_busy_backoff(struct loopdev_cxt *lc, unsigned int attempt)
+{
+	static unsigned int seed;
+	unsigned int limit;
+	useconds_t usec;
+
+	if (attempt == 0)
+		return;
+	if (!seed)
+		seed = (getpid() << 16) ^ (unsigned int) time(NULL);
+
+	limit = 1000U << min(attempt, 6U);		/* usec */
+	usec = rand_r(&seed) % limit;
+
+	DBG(SETUP, ul_debugobj(lc, "device busy, attempt %u, waiting %uus",
+				attempt, (unsigned int) usec));
+	xusleep(usec);
+}
+
 
 
 /*
@@ -1663,105 +1850,388 @@ int loopdev_delete(const char *device)
 }
 
 /*
- * Returns: 0 = success, < 0 error, 1 not found
+ * Index of the used loop devices. All devices are scanned by one pass and
+ * the devices are sorted by backing file devno, inode and offset, so the
+ * lookups by backing file do not need to read sysfs or call ioctls for every
+ * device. The devices where LOOP_GET_STATUS64 is not permitted are at the end
+ * of the index and compared by backing file name only (see loopcxt_is_used()).
+ *
+ * The index is kept in the context until the context modifies a device or
+ * /sys/block is changed.
  */
-int loopcxt_find_by_backing_file(struct loopdev_cxt *lc, const char *filename,
-				 uint64_t offset, uint64_t sizelimit, int flags)
+struct loopdev_entry {
+	char		*device;	/* /dev/loop<N> */
+	char		*filename;	/* backing file */
+	int		nr;		/* loop number */
+	dev_t		devno;		/* backing file devno and inode */
+	ino_t		ino;
+	uint64_t	offset;
+	uint64_t	sizelimit;
+	unsigned int	has_info :1;	/* devno and ino are valid */
+};
+
+struct loopdev_index {
+	struct loopdev_entry	*ents;
+	size_t			nents;
+	size_t			ninfo;		/* number of ents[] with has_info */
+	size_t			nalloc;
+	struct timespec		mtime;		/* /sys/block mtime */
+};
+
+static void loopcxt_free_index(struct loopdev_cxt *lc)
 {
-	int rc, hasst;
-	struct stat st;
+	struct loopdev_index *idx = lc->index;
+	size_t i;
 
-	if (!filename)
-		return -EINVAL;
+	if (!idx)
+		return;
+	for (i = 0; i < idx->nents; i++) {
+		free(idx->ents[i].device);
+		free(idx->ents[i].filename);
+	}
+	free(idx->ents);
+	free(idx);
+	lc->index = NULL;
+}
+
+static int cmp_entries(const void *a, const void *b)
+{
+	const struct loopdev_entry *x = a, *y = b;
+
+	if (x->has_info != y->has_info)
+		return x->has_info ? -1 : 1;
+	if (x->has_info) {
+		if (x->devno != y->devno)
+			return x->devno < y->devno ? -1 : 1;
+		if (x->ino != y->ino)
+			return x->ino < y->ino ? -1 : 1;
+		if (x->offset != y->offset)
+			return x->offset < y->offset ? -1 : 1;
+	}
+	return cmp_numbers(x->nr, y->nr);
+}
+
+/* adds the current @lc device to the index */
+static int index_add_device(struct loopdev_index *idx, struct loopdev_cxt *lc,
+			    char *filename)
+{
+	struct loopdev_entry *e;
+	struct loop_info64 *lo;
+	const char *p;
+
+	if (idx->nents == idx->nalloc) {
+		size_t sz = idx->nalloc ? idx->nalloc * 2 : 32;
+
+		e = realloc(idx->ents, sz * sizeof(*e));
+		if (!e)
+			return -ENOMEM;
+		idx->ents = e;
+		idx->nalloc = sz;
+	}
+
+	e = &idx->ents[idx->nents];
+	memset(e, 0, sizeof(*e));
+
+	e->device = strdup(lc->device);
+	if (!e->device)
+		return -ENOMEM;
+	e->filename = filename;
+
+	p = lc->device + strlen(lc->device);
+	while (p > lc->device && isdigit((unsigned char) *(p - 1)))
+		p--;
+	e->nr = atoi(p);
+
+	lo = loopcxt_get_info(lc);
+	if (lo) {
+		e->has_info = 1;
+		e->devno = lo->lo_device;
+		e->ino = lo->lo_inode;
+		e->offset = lo->lo_offset;
+		e->sizelimit = lo->lo_sizelimit;
+		idx->ninfo++;
+	} else {
+		loopcxt_get_offset(lc, &e->offset);
+		loopcxt_get_sizelimit(lc, &e->sizelimit);
+	}
+
+	DBG(CXT, ul_debugobj(lc, "index: %s [%s]", e->device, e->filename));
+	idx->nents++;
+	return 0;
+}
+
+/* reads /sys/block/<name>/loop/backing_file, returns NULL for unused device */
+static char *read_backing_file(int dirfd, const char *name)
+{
+	char path[NAME_MAX + 18 + 1], buf[PATH_MAX];
+	ssize_t sz;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/loop/backing_file", name);
+	fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	sz = read_all(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (sz <= 0)
+		return NULL;
+	if (buf[sz - 1] == '\n')
+		sz--;
+	buf[sz] = '\0';
+	return strdup(buf);
+}
+
+/*
+ * The used devices in /sys/block are recognized by loop/backing_file, this
+ * is the only sysfs read per device. The rest is read by one
+ * LOOP_GET_STATUS64 ioctl. The devices without device node are ignored.
+ */
+static int index_scan_sysfs(struct loopdev_index *idx, struct loopdev_cxt *lc)
+{
+	struct dirent *d;
+	DIR *dir;
+	int rc = 0;
+
+	dir = opendir(_PATH_SYS_BLOCK);
+	if (!dir)
+		return -errno;
+
+	while ((d = readdir(dir))) {
+		char *filename;
+
+		if (strncmp(d->d_name, "loop", 4) != 0
+		    || !isdigit((unsigned char) d->d_name[4]))
+			continue;
+
+		filename = read_backing_file(dirfd(dir), d->d_name);
+		if (!filename)
+			continue;
+
+		rc = loopcxt_set_device(lc, d->d_name);
+		if (!rc && loopcxt_get_fd(lc) < 0 && errno == ENOENT) {
+			DBG(CXT, ul_debugobj(lc, "index: %s does not exist", lc->device));
+			free(filename);
+			continue;
+		}
+		if (!rc)
+			rc = index_add_device(idx, lc, filename);
+		if (rc) {
+			free(filename);
+			break;
+		}
+	}
+	closedir(dir);
+	return rc;
+}
 
-	hasst = !stat(filename, &st);
+/* old kernels without loop/ in sysfs, use iterator and ioctls */
+static int index_scan_iter(struct loopdev_index *idx, struct loopdev_cxt *lc)
+{
+	int rc;
 
 	rc = loopcxt_init_iterator(lc, LOOPITER_FL_USED);
 	if (rc)
 		return rc;
 
-	while ((rc = loopcxt_next(lc)) == 0) {
+	while (loopcxt_next(lc) == 0) {
+		char *filename = loopcxt_get_backing_file(lc);
 
-		if (loopcxt_is_used(lc, hasst ? &st : NULL,
-				    filename, offset, sizelimit, flags))
+		rc = index_add_device(idx, lc, filename);
+		if (rc) {
+			free(filename);
 			break;
+		}
+	}
+	loopcxt_deinit_iterator(lc);
+	return rc;
+}
+
+/*
+ * Returns index of the used devices, the index is rebuilt if /sys/block has
+ * been modified since the last scan.
+ */
+static int loopcxt_get_index(struct loopdev_cxt *lc, struct loopdev_index **res)
+{
+	struct loopdev_index *idx;
+	struct stat st;
+	int rc, hasst;
+
+	hasst = loopcxt_sysfs_available(lc) && stat(_PATH_SYS_BLOCK, &st) == 0;
+
+	if (lc->index && hasst
+	    && lc->index->mtime.tv_sec == st.st_mtim.tv_sec
+	    && lc->index->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+		*res = lc->index;
+		return 0;
 	}
+	loopcxt_free_index(lc);
 
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		return -ENOMEM;
+
+	/* initialize /dev/loop/<N> detection */
+	rc = loopcxt_init_iterator(lc, LOOPITER_FL_USED);
+	if (!rc)
+		rc = hasst ? index_scan_sysfs(idx, lc) : index_scan_iter(idx, lc);
 	loopcxt_deinit_iterator(lc);
+	ignore_result( loopcxt_set_device(lc, NULL) );
+
+	lc->index = idx;
+	if (rc) {
+		loopcxt_free_index(lc);
+		return rc;
+	}
+	if (hasst)
+		idx->mtime = st.st_mtim;
+	if (idx->nents > 1)
+		qsort(idx->ents, idx->nents, sizeof(*idx->ents), cmp_entries);
+
+	DBG(CXT, ul_debugobj(lc, "index: %zu used devices", idx->nents));
+	*res = idx;
+	return 0;
+}
+
+/*
+ * Returns the next device associated with the backing file (@st or
+ * @filename), @pos is the position in the index, start with zero.
+ */
+static struct loopdev_entry *index_next_used(struct loopdev_index *idx,
+		size_t *pos, const struct stat *st, const char *filename)
+{
+	size_t i = *pos;
+
+	if (st && i < idx->ninfo) {
+		size_t lo = 0, hi = idx->ninfo;
+
+		/* the first entry with the devno and inode */
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			struct loopdev_entry *e = &idx->ents[mid];
+
+			if (e->devno < st->st_dev
+			    || (e->devno == st->st_dev && e->ino < st->st_ino))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (i < lo)
+			i = lo;
+		if (i < idx->ninfo && idx->ents[i].devno == st->st_dev
+				   && idx->ents[i].ino == st->st_ino) {
+			*pos = i + 1;
+			return &idx->ents[i];
+		}
+
+		/* don't use filename if we have devno and inode */
+		i = idx->ninfo;
+	}
+
+	for (; filename && i < idx->nents; i++) {
+		struct loopdev_entry *e = &idx->ents[i];
+
+		if (e->filename && strcmp(e->filename, filename) == 0) {
+			*pos = i + 1;
+			return e;
+		}
+	}
+	*pos = idx->nents;
+	return NULL;
+}
+
+/* sets the @lc device, the device status is read as by the iterator */
+static int loopcxt_set_entry_device(struct loopdev_cxt *lc, struct loopdev_entry *e)
+{
+	int rc = loopcxt_set_device(lc, e->device);
+
+	if (!rc && e->has_info)
+		loopcxt_get_info(lc);
 	return rc;
 }
 
+/*
+ * Returns: 0 = success, < 0 error, 1 not found
+ */
+int loopcxt_find_by_backing_file(struct loopdev_cxt *lc, const char *filename,
+				 uint64_t offset, uint64_t sizelimit, int flags)
+{
+	struct loopdev_index *idx;
+	struct loopdev_entry *e;
+	struct stat st, *pst;
+	size_t pos = 0;
+	int rc;
+
+	if (!filename)
+		return -EINVAL;
+
+	pst = stat(filename, &st) == 0 ? &st : NULL;
+
+	rc = loopcxt_get_index(lc, &idx);
+	if (rc)
+		return rc;
+
+	while ((e = index_next_used(idx, &pos, pst, filename))) {
+		if ((flags & LOOPDEV_FL_OFFSET) && e->offset != offset)
+			continue;
+		if ((flags & LOOPDEV_FL_OFFSET) && (flags & LOOPDEV_FL_SIZELIMIT)
+		    && e->sizelimit != sizelimit)
+			continue;
+		return loopcxt_set_entry_device(lc, e);
+	}
+	return 1;
+}
+
 /*
  * Returns: 0 = not found, < 0 error, 1 found, 2 found full size and offset match
  */
 int loopcxt_find_overlap(struct loopdev_cxt *lc, const char *filename,
 			   uint64_t offset, uint64_t sizelimit)
 {
-	int rc, hasst;
-	struct stat st;
+	struct loopdev_index *idx;
+	struct loopdev_entry *e;
+	struct stat st, *pst;
+	size_t pos = 0;
+	int rc;
 
 	if (!filename)
 		return -EINVAL;
 
 	DBG(CXT, ul_debugobj(lc, "find_overlap requested"));
-	hasst = !stat(filename, &st);
+	pst = stat(filename, &st) == 0 ? &st : NULL;
 
-	rc = loopcxt_init_iterator(lc, LOOPITER_FL_USED);
+	rc = loopcxt_get_index(lc, &idx);
 	if (rc)
 		return rc;
 
-	while ((rc = loopcxt_next(lc)) == 0) {
-		uint64_t lc_sizelimit, lc_offset;
-
-		rc = loopcxt_is_used(lc, hasst ? &st : NULL,
-				     filename, offset, sizelimit, 0);
-		if (!rc)
-			continue;	/* unused */
-		if (rc < 0)
-			break;		/* error */
-
+	while ((e = index_next_used(idx, &pos, pst, filename))) {
 		DBG(CXT, ul_debugobj(lc, "found %s backed by %s",
-			loopcxt_get_device(lc), filename));
-
-		rc = loopcxt_get_offset(lc, &lc_offset);
-		if (rc) {
-			DBG(CXT, ul_debugobj(lc, "failed to get offset for device %s",
-				loopcxt_get_device(lc)));
-			break;
-		}
-		rc = loopcxt_get_sizelimit(lc, &lc_sizelimit);
-		if (rc) {
-			DBG(CXT, ul_debugobj(lc, "failed to get sizelimit for device %s",
-				loopcxt_get_device(lc)));
-			break;
-		}
+			e->device, filename));
 
 		/* full match */
-		if (lc_sizelimit == sizelimit && lc_offset == offset) {
+		if (e->sizelimit == sizelimit && e->offset == offset) {
 			DBG(CXT, ul_debugobj(lc, "overlapping loop device %s (full match)",
-						loopcxt_get_device(lc)));
+						e->device));
 			rc = 2;
 			goto found;
 		}
 
 		/* overlap */
-		if (lc_sizelimit != 0 && offset >= lc_offset + lc_sizelimit)
+		if (e->sizelimit != 0 && offset >= e->offset + e->sizelimit)
 			continue;
-		if (sizelimit != 0 && offset + sizelimit <= lc_offset)
+		if (sizelimit != 0 && offset + sizelimit <= e->offset)
 			continue;
 
 		DBG(CXT, ul_debugobj(lc, "overlapping loop device %s",
-			loopcxt_get_device(lc)));
-			rc = 1;
-			goto found;
+			e->device));
+		rc = 1;
+		goto found;
 	}
 
-	if (rc == 1)
-		rc = 0;	/* not found */
+	DBG(CXT, ul_debugobj(lc, "find_overlap done [not found]"));
+	return 0;
 found:
-	loopcxt_deinit_iterator(lc);
 	DBG(CXT, ul_debugobj(lc, "find_overlap done [rc=%d]", rc));
-	return rc;
+	return loopcxt_set_entry_device(lc, e) == 0 ? rc : -EINVAL;
 }
 
 /*
@@ -1792,6 +2262,9 @@ char *loopdev_find_by_backing_file(const char *filename, uint64_t offset, uint64
 int loopdev_count_by_backing_file(const char *filename, char **loopdev)
 {
 	struct loopdev_cxt lc;
+	struct loopdev_index *idx;
+	struct loopdev_entry *e;
+	size_t pos = 0;
 	int count = 0, rc;
 
 	if (!filename)
@@ -1800,20 +2273,14 @@ int loopdev_count_by_backing_file(const char *filename, char **loopdev)
 	rc = loopcxt_init(&lc, 0);
 	if (rc)
 		return rc;
-	if (loopcxt_init_iterator(&lc, LOOPITER_FL_USED))
+	if (loopcxt_get_index(&lc, &idx)) {
+		loopcxt_deinit(&lc);
 		return -1;
+	}
 
-	while(loopcxt_next(&lc) == 0) {
-		char *backing = loopcxt_get_backing_file(&lc);
-
-		if (!backing || strcmp(backing, filename)) {
-			free(backing);
-			continue;
-		}
-
-		free(backing);
+	while ((e = index_next_used(idx, &pos, NULL, filename))) {
 		if (loopdev && count == 0)
-			*loopdev = loopcxt_strdup_device(&lc);
+			*loopdev = strdup(e->device);
 		count++;
 	}
 
@@ -1826,3 +2293,116 @@ int loopdev_count_by_backing_file(const char *filename, char **loopdev)
 	return count;
 }
 
+
+#ifdef TEST_PROGRAM_LOOPDEV
+
+#include <sys/wait.h>
+
+struct bench_result {
+	unsigned int	retries;
+	double		usec;
+};
+
+static double usec_since(const struct timespec *a)
+{
+	struct timespec b;
+
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	return (b.tv_sec - a->tv_sec) * 1e6 + (b.tv_nsec - a->tv_nsec) / 1e3;
+}
+
+/* one process: find unused device, set it up and delete it again */
+static void bench_setup_delete(const char *file, int fd)
+{
+	struct loopdev_cxt lc;
+	struct bench_result res = { 0 };
+	struct timespec a;
+	int rc;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+
+	if (loopcxt_init(&lc, 0))
+		err(EXIT_FAILURE, "failed to initialize loopcxt");
+	do {
+		if (loopcxt_find_unused(&lc))
+			errx(EXIT_FAILURE, "cannot find an unused loop device");
+		if (loopcxt_set_backing_file(&lc, file))
+			err(EXIT_FAILURE, "%s: failed to use backing file", file);
+		errno = 0;
+		rc = loopcxt_setup_device(&lc);
+		if (rc == 0)
+			break;
+		if (errno != EBUSY)
+			err(EXIT_FAILURE, "%s: failed to set up loop device", file);
+		loopcxt_busy_backoff(&lc, res.retries++);
+	} while (1);
+
+	res.usec = usec_since(&a);
+
+	if (loopcxt_delete_device(&lc))
+		warn("%s: failed to delete", loopcxt_get_device(&lc));
+	loopcxt_deinit(&lc);
+
+	if (write_all(fd, &res, sizeof(res)))
+		err(EXIT_FAILURE, "write failed");
+	exit(EXIT_SUCCESS);
+}
+
+/*
+ * For example, 32 processes fighting for the devices:
+ *
+ *	truncate -s 1M img; test_loopdev --bench 32 img
+ */
+static int benchmark(int nprocs, const char *file)
+{
+	struct bench_result res;
+	struct timespec a;
+	unsigned int retries = 0, maxretries = 0;
+	double maxusec = 0, sumusec = 0;
+	int i, done = 0, fds[2];
+
+	if (pipe(fds))
+		err(EXIT_FAILURE, "pipe failed");
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+
+	for (i = 0; i < nprocs; i++) {
+		switch (fork()) {
+		case -1:
+			err(EXIT_FAILURE, "fork failed");
+		case 0:
+			close(fds[0]);
+			bench_setup_delete(file, fds[1]);
+			break;
+		default:
+			break;
+		}
+	}
+	close(fds[1]);
+
+	while (read_all(fds[0], (char *) &res, sizeof(res)) == sizeof(res)) {
+		retries += res.retries;
+		maxretries = max(maxretries, res.retries);
+		maxusec = max(maxusec, res.usec);
+		sumusec += res.usec;
+		done++;
+	}
+	while (wait(NULL) > 0);
+
+	printf("%d/%d processes, %.3f ms total\n", done, nprocs, usec_since(&a) / 1e3);
+	if (done)
+		printf("setup: %.3f ms avg, %.3f ms max, %u retries (max %u)\n",
+			sumusec / done / 1e3, maxusec / 1e3, retries, maxretries);
+	return done == nprocs ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 4 && strcmp(argv[1], "--bench") == 0)
+		return benchmark(atoi(argv[2]), argv[3]);
+
+	fprintf(stderr, "usage: %s --bench <nprocs> <file>\n",
+			program_invocation_short_name);
+	return EXIT_FAILURE;
+}
+#endif /* TEST_PROGRAM_LOOPDEV */
@@ -18,9 +18,12 @@
 
 #define from_hex(c)		(isdigit(c) ? c - '0' : tolower(c) - 'a' + 10)
 
-#define is_unwanted_char(x)	(strchr(" \t\n\\", (unsigned int) x) != NULL)
-
+#define UNWANTED_CHARS		" \t\n\\"
 
+/*
+ * The strings are scanned by strcspn() and memchr() (vectorized in libc) and
+ * the runs of the chars without escape are copied by memcpy().
+ */
 char *mangle(const char *s)
 {
 	char *ss, *sp;
@@ -32,76 +35,104 @@ char *mangle(const char *s)
 	if (!sp)
 		return NULL;
 	while(1) {
+		size_t n = strcspn(s, UNWANTED_CHARS);
+
+		sp = mempcpy(sp, s, n);
+		s += n;
 		if (!*s) {
 			*sp = '\0';
 			break;
 		}
-		if (is_unwanted_char(*s)) {
-			*sp++ = '\\';
-			*sp++ = '0' + ((*s & 0300) >> 6);
-			*sp++ = '0' + ((*s & 070) >> 3);
-			*sp++ = '0' + (*s & 07);
-		} else
-			*sp++ = *s;
+		*sp++ = '\\';
+		*sp++ = '0' + ((*s & 0300) >> 6);
+		*sp++ = '0' + ((*s & 070) >> 3);
+		*sp++ = '0' + (*s & 07);
 		s++;
 	}
 	return ss;
 }
 
+/*
+ * Returns @s if there is nothing to mangle, otherwise mangled copy of @s,
+ * which is also returned in @tofree. Returns NULL on error.
+ */
+const char *mangle_if_needed(const char *s, char **tofree)
+{
+	*tofree = NULL;
+	if (!s)
+		return NULL;
+	if (!s[strcspn(s, UNWANTED_CHARS)])
+		return s;
+	return *tofree = mangle(s);
+}
+
+/* copies @n bytes, in-place (@buf == @s) copy is no-op */
+static inline char *copy_run(char *buf, const char *s, size_t n)
+{
+	if (buf != s)
+		memmove(buf, s, n);
+	return buf + n;
+}
+
 
 void unmangle_to_buffer(const char *s, char *buf, size_t len)
 {
-	size_t sz = 0;
+	const char *end;
 
 	if (!s)
 		return;
 
-	while(*s && sz < len - 1) {
-		if (*s == '\\' && sz + 3 < len - 1 && isoctal(s[1]) &&
-		    isoctal(s[2]) && isoctal(s[3])) {
+	end = s + strnlen(s, len - 1);
+
+	while (s < end) {
+		const char *p = memchr(s, '\\', end - s);
+
+		if (!p)
+			p = end;
+		buf = copy_run(buf, s, p - s);
+		s = p;
+		if (s == end)
+			break;
 
+		if (end - s > 3 && isoctal(s[1]) && isoctal(s[2]) && isoctal(s[3])) {
 			*buf++ = 64*(s[1] & 7) + 8*(s[2] & 7) + (s[3] & 7);
 			s += 4;
-			sz += 4;
-		} else {
+		} else
 			*buf++ = *s++;
-			sz++;
-		}
 	}
 	*buf = '\0';
 }
 
 size_t unhexmangle_to_buffer(const char *s, char *buf, size_t len)
 {
-	size_t sz = 0;
-	const char *buf0 = buf;
+	const char *buf0 = buf, *end;
 
 	if (!s)
 		return 0;
 
-	while(*s && sz < len - 1) {
-		if (*s == '\\' && sz + 3 < len - 1 && s[1] == 'x' &&
-		    isxdigit(s[2]) && isxdigit(s[3])) {
+	end = s + strnlen(s, len - 1);
+
+	while (s < end) {
+		const char *p = memchr(s, '\\', end - s);
 
+		if (!p)
+			p = end;
+		buf = copy_run(buf, s, p - s);
+		s = p;
+		if (s == end)
+			break;
+
+		if (end - s > 3 && s[1] == 'x' &&
+		    isxdigit(s[2]) && isxdigit(s[3])) {
 			*buf++ = from_hex(s[2]) << 4 | from_hex(s[3]);
 			s += 4;
-			sz += 4;
-		} else {
+		} else
 			*buf++ = *s++;
-			sz++;
-		}
 	}
 	*buf = '\0';
 	return buf - buf0 + 1;
 }
 
-static inline const char *skip_nonspaces(const char *s)
-{
-	while (s && *s && !(*s == ' ' || *s == '\t'))
-		s++;
-	return s;
-}
-
 /*
  * Returns mallocated buffer or NULL in case of error.
  */
@@ -114,7 +145,7 @@ char *unmangle(const char *s, const char **end)
 	if (!s)
 		return NULL;
 
-	e = skip_nonspaces(s);
+	e = s + strcspn(s, " \t");
 	sz = e - s + 1;
 
 	if (end)
@@ -142,9 +173,16 @@ int main(int argc, char *argv[])
 	}
 
 	if (!strcmp(argv[1], "--mangle")) {
+		const char *x;
+
 		p = mangle(argv[2]);
 		printf("mangled: '%s'\n", p);
 		free(p);
+
+		x = mangle_if_needed(argv[2], &p);
+		printf("mangled-if-needed: '%s' (%s)\n", x,
+				x == argv[2] ? "not copied" : "copied");
+		free(p);
 	}
 
 	else if (!strcmp(argv[1], "--unmangle")) {
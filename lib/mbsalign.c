@@ -24,15 +24,45 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #include "c.h"
 #include "mbsalign.h"
 #include "strutils.h"
 #include "widechar.h"
 
-/* Replace non printable chars.
-   Note \t and \n etc. are non printable.
-   Return 1 if replacement made, 0 otherwise.  */
+/*
+ * Returns number of printable ASCII chars (except '\\' which maybe begins
+ * "\x" sequence) at the begin of @s, at most @n. The ASCII chars are single
+ * byte and single cell chars in all supported locales, so the callers do not
+ * need mbrtowc() and wcwidth() for them. The bytes are checked by words.
+ */
+static size_t ascii_printable_span(const char *s, size_t n)
+{
+	const uint64_t ones = UINT64_C(0x0101010101010101),
+		       highs = UINT64_C(0x8080808080808080);
+	size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+		uint64_t x, bs;
+
+		memcpy(&x, s + i, sizeof(x));
+		if (x & highs)
+			break;				/* >= 0x80 */
+		bs = x ^ (ones * '\\');
+		if (((x - ones * 0x20) & ~x & highs)	/* < 0x20 */
+		    || ((x + ones) & highs)		/* 0x7f */
+		    || ((bs - ones) & ~bs & highs))	/* '\\' */
+			break;
+	}
+	for (; i < n; i++) {
+		unsigned char c = s[i];
+
+		if (c < 0x20 || c >= 0x7f || c == '\\')
+			break;
+	}
+	return i;
+}
 
 /*
  * Counts number of cells in multibyte string. For all control and
@@ -54,6 +84,13 @@ size_t mbs_safe_nwidth(const char *buf, size_t bufsz, size_t *sz)
 		last = p + (bufsz - 1);
 
 	while (p && *p && p <= last) {
+		size_t n = ascii_printable_span(p, last - p + 1);
+
+		if (n) {
+			width += n, bytes += n;
+			p += n;
+			continue;
+		}
 		if ((p < last && *p == '\\' && *(p + 1) == 'x')
 		    || iscntrl((unsigned char) *p)) {
 			width += 4, bytes += 4;		/* *p encoded to \x?? */
@@ -116,21 +153,39 @@ size_t mbs_safe_width(const char *s)
  */
 char *mbs_safe_encode_to_buffer(const char *s, size_t *width, char *buf, const char *safechars)
 {
-	const char *p = s;
+	const char *p = s, *end = s + (s ? strlen(s) : 0);
 	char *r;
-	size_t sz = s ? strlen(s) : 0;
+	int ascii = 1;
 
 #ifdef HAVE_WIDECHAR
 	mbstate_t st;
 	memset(&st, 0, sizeof(st));
 #endif
-	if (!sz || !buf)
+	if (p == end || !buf)
 		return NULL;
 
+	/* the safe chars are not counted as cells, so no fast path for
+	 * printable safe chars */
+	if (safechars) {
+		const char *x;
+
+		for (x = safechars; *x && ascii; x++)
+			ascii = !ascii_printable_span(x, 1);
+	}
+
 	r = buf;
 	*width = 0;
 
 	while (p && *p) {
+		size_t n = ascii ? ascii_printable_span(p, end - p) : 0;
+
+		if (n) {
+			memcpy(r, p, n);
+			r += n;
+			*width += n;
+			p += n;
+			continue;
+		}
 		if (safechars && strchr(safechars, *p)) {
 			*r++ = *p++;
 			continue;
@@ -205,26 +260,35 @@ char *mbs_safe_encode_to_buffer(const char *s, size_t *width, char *buf, const c
  */
 char *mbs_invalid_encode_to_buffer(const char *s, size_t *width, char *buf)
 {
-	const char *p = s;
+	const char *p = s, *end = s + (s ? strlen(s) : 0);
 	char *r;
-	size_t sz = s ? strlen(s) : 0;
 
 #ifdef HAVE_WIDECHAR
 	mbstate_t st;
 	memset(&st, 0, sizeof(st));
 #endif
-	if (!sz || !buf)
+	if (p == end || !buf)
 		return NULL;
 
 	r = buf;
 	*width = 0;
 
 	while (p && *p) {
+		size_t len = ascii_printable_span(p, end - p);
 #ifdef HAVE_WIDECHAR
 		wchar_t wc;
-		size_t len = mbrtowc(&wc, p, MB_CUR_MAX, &st);
+#endif
+		if (len) {
+			memcpy(r, p, len);
+			r += len;
+			*width += len;
+			p += len;
+			continue;
+		}
+#ifdef HAVE_WIDECHAR
+		len = mbrtowc(&wc, p, MB_CUR_MAX, &st);
 #else
-		size_t len = 1;
+		len = 1;
 #endif
 
 		if (len == 0)
@@ -377,9 +441,19 @@ mbs_truncate(char *str, size_t *width)
 {
 	ssize_t bytes = strlen(str);
 #ifdef HAVE_WIDECHAR
-	ssize_t sz = mbstowcs(NULL, str, 0);
+	ssize_t sz;
 	wchar_t *wcs = NULL;
 
+	if (bytes && ascii_printable_span(str, bytes) == (size_t) bytes) {
+		/* one byte per cell */
+		if (*width < (size_t) bytes)
+			bytes = *width;
+		*width = bytes;
+		str[bytes] = '\0';
+		return bytes;
+	}
+
+	sz = mbstowcs(NULL, str, 0);
 	if (sz == (ssize_t) -1)
 		goto done;
 
@@ -402,6 +476,53 @@ done:
 	return bytes;
 }
 
+/*
+ * Returns number of bytes of the longest begin of @str (at most @bytes) that
+ * fits to @width cells, and in @width returns number of the used cells.
+ *
+ * Unlike mbs_truncate() the string is not modified and the function does not
+ * read behind the returned begin, so it's usable to split a long string to
+ * @width chunks in linear time.
+ */
+size_t mbs_nfit(const char *str, size_t bytes, size_t *width)
+{
+	size_t cells = 0, sz = 0;
+#ifdef HAVE_WIDECHAR
+	mbstate_t st;
+
+	memset(&st, 0, sizeof(st));
+#endif
+	while (sz < bytes && str[sz] && cells < *width) {
+		size_t len, n;
+		int w = 1;
+
+		n = ascii_printable_span(str + sz, min(bytes - sz, *width - cells));
+		if (n) {
+			sz += n, cells += n;
+			continue;
+		}
+		len = 1;
+#ifdef HAVE_WIDECHAR
+		{
+			wchar_t wc;
+
+			len = mbrtowc(&wc, str + sz, bytes - sz, &st);
+			if (len == 0 || len == (size_t) -1 || len == (size_t) -2) {
+				len = 1;
+				memset(&st, 0, sizeof(st));
+			} else if ((w = wcwidth(wc)) < 0)
+				w = 1;
+		}
+#endif
+		if (cells + w > *width)
+			break;
+		sz += len, cells += w;
+	}
+
+	*width = cells;
+	return sz;
+}
+
 /* Write N_SPACES space characters to DEST while ensuring
    nothing is written beyond DEST_END. A terminating NUL
    is always added to DEST.
@@ -461,8 +582,9 @@ mbsalign_with_padding (const char *src, char *dest, size_t dest_size,
 
   /* In multi-byte locales convert to wide characters
      to allow easy truncation. Also determine number
-     of screen columns used.  */
-  if (MB_CUR_MAX > 1)
+     of screen columns used. Printable ASCII string
+     is the same as unibyte string.  */
+  if (MB_CUR_MAX > 1 && ascii_printable_span (src, n_cols) != n_cols)
     {
       size_t src_chars = mbstowcs (NULL, src, 0);
       if (src_chars == (size_t) -1)
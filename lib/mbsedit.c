@@ -46,6 +46,12 @@ static size_t mbs_next(const char *str, size_t *ncells)
 	if (!str || !*str)
 		return 0;
 
+	/* printable ASCII */
+	if (*str >= 0x20 && *str < 0x7f) {
+		*ncells = 1;
+		return 1;
+	}
+
 	n = mbrtowc(&wc, str, MB_CUR_MAX, NULL);
 	*ncells = wcwidth(wc);
 	return n;
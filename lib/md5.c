@@ -13,11 +13,20 @@
  * MD5Context structure, pass it to MD5Init, call MD5Update as
  * needed on buffers full of bytes, and then call MD5Final, which
  * will fill a supplied 16-byte array with the digest.
+ *
+ * ul_MD5Multi() hashes more independent messages at once, by four SSE2
+ * lanes on x86.
  */
 #include <string.h>		/* for memcpy() */
+#include <stdint.h>
 
 #include "md5.h"
 
+#if defined(__SSE2__) && !defined(WORDS_BIGENDIAN)
+# include <emmintrin.h>
+# define HAVE_MD5_SSE2 1
+#endif
+
 #if !defined(WORDS_BIGENDIAN)
 # define byteReverse(buf, len)	/* Nothing */
 #else
@@ -255,3 +264,343 @@ void ul_MD5Transform(uint32_t buf[4], uint32_t const in[16])
 
 #endif
 
+/*
+ * Copies the last incomplete block of the message to @tail and adds the
+ * padding, returns number of the tail blocks (1 or 2).
+ */
+static size_t md5_tail(unsigned char tail[128], const unsigned char *data, size_t len)
+{
+    size_t rest = len & 63, n = rest < 56 ? 1 : 2, i;
+    uint64_t bits = (uint64_t) len << 3;
+
+    memcpy(tail, data + len - rest, rest);
+    tail[rest] = 0x80;
+    memset(tail + rest + 1, 0, n * 64 - rest - 1 - 8);
+    for (i = 0; i < 8; i++)
+	tail[n * 64 - 8 + i] = (unsigned char) (bits >> (i * 8));
+    return n;
+}
+
+static void md5_digest(unsigned char digest[UL_MD5LENGTH], const uint32_t buf[4])
+{
+    size_t i;
+
+    for (i = 0; i < UL_MD5LENGTH; i++)
+	digest[i] = (unsigned char) (buf[i >> 2] >> ((i & 3) * 8));
+}
+
+#ifdef HAVE_MD5_SSE2
+#define MD5_LANES	4
+
+#define F1_X4(x, y, z) _mm_xor_si128(z, _mm_and_si128(x, _mm_xor_si128(y, z)))
+#define F2_X4(x, y, z) F1_X4(z, x, y)
+#define F3_X4(x, y, z) _mm_xor_si128(_mm_xor_si128(x, y), z)
+#define F4_X4(x, y, z) _mm_xor_si128(y, _mm_or_si128(x, _mm_xor_si128(z, ones)))
+
+#define MD5STEP_X4(f, w, x, y, z, data, k, s) do { \
+	w = _mm_add_epi32(_mm_add_epi32(w, f(x, y, z)), \
+			  _mm_add_epi32(data, _mm_set1_epi32((int) k))); \
+	w = _mm_or_si128(_mm_slli_epi32(w, s), _mm_srli_epi32(w, 32 - (s))); \
+	w = _mm_add_epi32(w, x); \
+} while (0)
+
+static inline uint32_t le32(const unsigned char *p)
+{
+    uint32_t x;
+
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+/* hashes one block for every lane, st[word][lane] */
+static void md5_x4(uint32_t st[4][MD5_LANES], const unsigned char *blk[MD5_LANES])
+{
+    const __m128i ones = _mm_set1_epi32(-1);
+    __m128i a, b, c, d, sa, sb, sc, sd, in[16];
+    int i;
+
+    for (i = 0; i < 16; i++)
+	in[i] = _mm_set_epi32(le32(blk[3] + i * 4), le32(blk[2] + i * 4),
+			      le32(blk[1] + i * 4), le32(blk[0] + i * 4));
+
+    a = sa = _mm_loadu_si128((const __m128i *) st[0]);
+    b = sb = _mm_loadu_si128((const __m128i *) st[1]);
+    c = sc = _mm_loadu_si128((const __m128i *) st[2]);
+    d = sd = _mm_loadu_si128((const __m128i *) st[3]);
+
+    MD5STEP_X4(F1_X4, a, b, c, d, in[0], 0xd76aa478, 7);
+    MD5STEP_X4(F1_X4, d, a, b, c, in[1], 0xe8c7b756, 12);
+    MD5STEP_X4(F1_X4, c, d, a, b, in[2], 0x242070db, 17);
+    MD5STEP_X4(F1_X4, b, c, d, a, in[3], 0xc1bdceee, 22);
+    MD5STEP_X4(F1_X4, a, b, c, d, in[4], 0xf57c0faf, 7);
+    MD5STEP_X4(F1_X4, d, a, b, c, in[5], 0x4787c62a, 12);
+    MD5STEP_X4(F1_X4, c, d, a, b, in[6], 0xa8304613, 17);
+    MD5STEP_X4(F1_X4, b, c, d, a, in[7], 0xfd469501, 22);
+    MD5STEP_X4(F1_X4, a, b, c, d, in[8], 0x698098d8, 7);
+    MD5STEP_X4(F1_X4, d, a, b, c, in[9], 0x8b44f7af, 12);
+    MD5STEP_X4(F1_X4, c, d, a, b, in[10], 0xffff5bb1, 17);
+    MD5STEP_X4(F1_X4, b, c, d, a, in[11], 0x895cd7be, 22);
+    MD5STEP_X4(F1_X4, a, b, c, d, in[12], 0x6b901122, 7);
+    MD5STEP_X4(F1_X4, d, a, b, c, in[13], 0xfd987193, 12);
+    MD5STEP_X4(F1_X4, c, d, a, b, in[14], 0xa679438e, 17);
+    MD5STEP_X4(F1_X4, b, c, d, a, in[15], 0x49b40821, 22);
+
+    MD5STEP_X4(F2_X4, a, b, c, d, in[1], 0xf61e2562, 5);
+    MD5STEP_X4(F2_X4, d, a, b, c, in[6], 0xc040b340, 9);
+    MD5STEP_X4(F2_X4, c, d, a, b, in[11], 0x265e5a51, 14);
+    MD5STEP_X4(F2_X4, b, c, d, a, in[0], 0xe9b6c7aa, 20);
+    MD5STEP_X4(F2_X4, a, b, c, d, in[5], 0xd62f105d, 5);
+    MD5STEP_X4(F2_X4, d, a, b, c, in[10], 0x02441453, 9);
+    MD5STEP_X4(F2_X4, c, d, a, b, in[15], 0xd8a1e681, 14);
+    MD5STEP_X4(F2_X4, b, c, d, a, in[4], 0xe7d3fbc8, 20);
+    MD5STEP_X4(F2_X4, a, b, c, d, in[9], 0x21e1cde6, 5);
+    MD5STEP_X4(F2_X4, d, a, b, c, in[14], 0xc33707d6, 9);
+    MD5STEP_X4(F2_X4, c, d, a, b, in[3], 0xf4d50d87, 14);
+    MD5STEP_X4(F2_X4, b, c, d, a, in[8], 0x455a14ed, 20);
+    MD5STEP_X4(F2_X4, a, b, c, d, in[13], 0xa9e3e905, 5);
+    MD5STEP_X4(F2_X4, d, a, b, c, in[2], 0xfcefa3f8, 9);
+    MD5STEP_X4(F2_X4, c, d, a, b, in[7], 0x676f02d9, 14);
+    MD5STEP_X4(F2_X4, b, c, d, a, in[12], 0x8d2a4c8a, 20);
+
+    MD5STEP_X4(F3_X4, a, b, c, d, in[5], 0xfffa3942, 4);
+    MD5STEP_X4(F3_X4, d, a, b, c, in[8], 0x8771f681, 11);
+    MD5STEP_X4(F3_X4, c, d, a, b, in[11], 0x6d9d6122, 16);
+    MD5STEP_X4(F3_X4, b, c, d, a, in[14], 0xfde5380c, 23);
+    MD5STEP_X4(F3_X4, a, b, c, d, in[1], 0xa4beea44, 4);
+    MD5STEP_X4(F3_X4, d, a, b, c, in[4], 0x4bdecfa9, 11);
+    MD5STEP_X4(F3_X4, c, d, a, b, in[7], 0xf6bb4b60, 16);
+    MD5STEP_X4(F3_X4, b, c, d, a, in[10], 0xbebfbc70, 23);
+    MD5STEP_X4(F3_X4, a, b, c, d, in[13], 0x289b7ec6, 4);
+    MD5STEP_X4(F3_X4, d, a, b, c, in[0], 0xeaa127fa, 11);
+    MD5STEP_X4(F3_X4, c, d, a, b, in[3], 0xd4ef3085, 16);
+    MD5STEP_X4(F3_X4, b, c, d, a, in[6], 0x04881d05, 23);
+    MD5STEP_X4(F3_X4, a, b, c, d, in[9], 0xd9d4d039, 4);
+    MD5STEP_X4(F3_X4, d, a, b, c, in[12], 0xe6db99e5, 11);
+    MD5STEP_X4(F3_X4, c, d, a, b, in[15], 0x1fa27cf8, 16);
+    MD5STEP_X4(F3_X4, b, c, d, a, in[2], 0xc4ac5665, 23);
+
+    MD5STEP_X4(F4_X4, a, b, c, d, in[0], 0xf4292244, 6);
+    MD5STEP_X4(F4_X4, d, a, b, c, in[7], 0x432aff97, 10);
+    MD5STEP_X4(F4_X4, c, d, a, b, in[14], 0xab9423a7, 15);
+    MD5STEP_X4(F4_X4, b, c, d, a, in[5], 0xfc93a039, 21);
+    MD5STEP_X4(F4_X4, a, b, c, d, in[12], 0x655b59c3, 6);
+    MD5STEP_X4(F4_X4, d, a, b, c, in[3], 0x8f0ccc92, 10);
+    MD5STEP_X4(F4_X4, c, d, a, b, in[10], 0xffeff47d, 15);
+    MD5STEP_X4(F4_X4, b, c, d, a, in[1], 0x85845dd1, 21);
+    MD5STEP_X4(F4_X4, a, b, c, d, in[8], 0x6fa87e4f, 6);
+    MD5STEP_X4(F4_X4, d, a, b, c, in[15], 0xfe2ce6e0, 10);
+    MD5STEP_X4(F4_X4, c, d, a, b, in[6], 0xa3014314, 15);
+    MD5STEP_X4(F4_X4, b, c, d, a, in[13], 0x4e0811a1, 21);
+    MD5STEP_X4(F4_X4, a, b, c, d, in[4], 0xf7537e82, 6);
+    MD5STEP_X4(F4_X4, d, a, b, c, in[11], 0xbd3af235, 10);
+    MD5STEP_X4(F4_X4, c, d, a, b, in[2], 0x2ad7d2bb, 15);
+    MD5STEP_X4(F4_X4, b, c, d, a, in[9], 0xeb86d391, 21);
+
+    _mm_storeu_si128((__m128i *) st[0], _mm_add_epi32(a, sa));
+    _mm_storeu_si128((__m128i *) st[1], _mm_add_epi32(b, sb));
+    _mm_storeu_si128((__m128i *) st[2], _mm_add_epi32(c, sc));
+    _mm_storeu_si128((__m128i *) st[3], _mm_add_epi32(d, sd));
+}
+
+struct md5_lane {
+    size_t msg;			/* message index */
+    size_t blk;			/* next block */
+    size_t nfull;		/* blocks in the message data */
+    size_t nblocks;		/* nfull + tail blocks */
+    unsigned char tail[128];
+    unsigned int active : 1;
+};
+
+/* every lane hashes one message, the finished lanes get the next message */
+static void md5_multi_lanes(unsigned char (*digest)[UL_MD5LENGTH],
+			    const unsigned char *const *data, const size_t *len, size_t n)
+{
+    static const unsigned char zero[64];
+    struct md5_lane lanes[MD5_LANES];
+    uint32_t st[4][MD5_LANES];
+    size_t next = 0, i, j;
+
+    memset(lanes, 0, sizeof(lanes));
+
+    for (;;) {
+	const unsigned char *blk[MD5_LANES];
+	int nactive = 0;
+
+	for (i = 0; i < MD5_LANES; i++) {
+	    struct md5_lane *ln = &lanes[i];
+
+	    if (!ln->active && next < n) {
+		struct UL_MD5Context ctx;
+
+		ln->msg = next++;
+		ln->blk = 0;
+		ln->nfull = len[ln->msg] / 64;
+		ln->nblocks = ln->nfull + md5_tail(ln->tail,
+					data[ln->msg], len[ln->msg]);
+		ln->active = 1;
+		ul_MD5Init(&ctx);
+		for (j = 0; j < 4; j++)
+		    st[j][i] = ctx.buf[j];
+	    }
+	    if (!ln->active)
+		blk[i] = zero;
+	    else if (ln->blk < ln->nfull)
+		blk[i] = data[ln->msg] + ln->blk * 64;
+	    else
+		blk[i] = ln->tail + (ln->blk - ln->nfull) * 64;
+	    nactive += ln->active;
+	}
+	if (!nactive)
+	    break;
+
+	md5_x4(st, blk);
+
+	for (i = 0; i < MD5_LANES; i++) {
+	    struct md5_lane *ln = &lanes[i];
+	    uint32_t buf[4];
+
+	    if (!ln->active || ++ln->blk < ln->nblocks)
+		continue;
+	    for (j = 0; j < 4; j++)
+		buf[j] = st[j][i];
+	    md5_digest(digest[ln->msg], buf);
+	    ln->active = 0;
+	}
+    }
+}
+#endif /* HAVE_MD5_SSE2 */
+
+/*
+ * Hashes @n independent messages @data of @len bytes to @digest, the
+ * messages are hashed in parallel if supported.
+ */
+void ul_MD5Multi(unsigned char (*digest)[UL_MD5LENGTH],
+		 const unsigned char *const *data, const size_t *len, size_t n)
+{
+    size_t i;
+
+#ifdef HAVE_MD5_SSE2
+    if (n > 1) {
+	md5_multi_lanes(digest, data, len, n);
+	return;
+    }
+#endif
+    for (i = 0; i < n; i++) {
+	struct UL_MD5Context ctx;
+#if !defined(WORDS_BIGENDIAN)
+	unsigned char tail[128];
+	size_t j, nfull = len[i] / 64, ntail = md5_tail(tail, data[i], len[i]);
+
+	ul_MD5Init(&ctx);
+	for (j = 0; j < nfull + ntail; j++) {
+	    memcpy(ctx.in, j < nfull ? data[i] + j * 64 : tail + (j - nfull) * 64, 64);
+	    ul_MD5Transform(ctx.buf, (uint32_t *) ctx.in);
+	}
+	md5_digest(digest[i], ctx.buf);
+#else
+	size_t off;
+
+	ul_MD5Init(&ctx);
+	for (off = 0; off < len[i]; off += 1U << 30)
+	    ul_MD5Update(&ctx, data[i] + off,
+			 len[i] - off > 1U << 30 ? 1U << 30 : len[i] - off);
+	ul_MD5Final(digest[i], &ctx);
+#endif
+    }
+}
+
+#ifdef TEST_PROGRAM_MD5
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "c.h"
+
+#define TEST_NMSGS	1000
+
+static void md5_single(unsigned char (*digest)[UL_MD5LENGTH],
+		       const unsigned char *const *data, const size_t *len, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+	struct UL_MD5Context ctx;
+
+	ul_MD5Init(&ctx);
+	ul_MD5Update(&ctx, data[i], len[i]);
+	ul_MD5Final(digest[i], &ctx);
+    }
+}
+
+static double bench(void (*fn)(unsigned char (*)[UL_MD5LENGTH],
+			       const unsigned char *const *, const size_t *, size_t),
+		    unsigned char (*digest)[UL_MD5LENGTH],
+		    const unsigned char *const *data, const size_t *len, size_t n)
+{
+    struct timespec a, b;
+
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    fn(digest, data, len, n);
+    clock_gettime(CLOCK_MONOTONIC, &b);
+
+    return (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned char (*ref)[UL_MD5LENGTH], (*res)[UL_MD5LENGTH];
+    const unsigned char **data;
+    unsigned char *buf;
+    size_t *len, i, n = TEST_NMSGS;
+    int errors = 0;
+
+    if (argc > 2 && strcmp(argv[1], "--bench") == 0)
+	n = strtoul(argv[2], NULL, 10);
+    if (n < TEST_NMSGS)
+	n = TEST_NMSGS;
+
+    buf = malloc(n + 512);
+    data = malloc(n * sizeof(*data));
+    len = malloc(n * sizeof(*len));
+    ref = malloc(n * sizeof(*ref));
+    res = malloc(n * sizeof(*res));
+    if (!buf || !data || !len || !ref || !res)
+	err(EXIT_FAILURE, "malloc failed");
+
+    srandom(1);
+    for (i = 0; i < n + 512; i++)
+	buf[i] = random();
+
+    /* all lengths around the padding boundaries, then random */
+    for (i = 0; i < TEST_NMSGS; i++) {
+	data[i] = buf + i;
+	len[i] = i < 300 ? i : (size_t) random() % 512;
+    }
+    md5_single(ref, data, len, TEST_NMSGS);
+
+    for (i = 0; i <= TEST_NMSGS; i += TEST_NMSGS / 4 - 1) {
+	memset(res, 0, TEST_NMSGS * sizeof(*res));
+	ul_MD5Multi(res + i, data + i, len + i, TEST_NMSGS - i);
+	if (memcmp(ref + i, res + i, (TEST_NMSGS - i) * sizeof(*res)) != 0)
+	    errors++;
+    }
+    printf("verify: %s\n", errors ? "FAILED" : "OK");
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+	/* name-based UUIDs, namespace + name */
+	for (i = 0; i < n; i++) {
+	    data[i] = buf + (i % 512);
+	    len[i] = 16 + 8 + random() % 32;
+	}
+	printf("messages per second, %zu messages of %d-%d bytes\n", n, 24, 55);
+	printf("%-10s %12.0f\n", "single", n / bench(md5_single, res, data, len, n));
+	printf("%-10s %12.0f\n", "multi", n / bench(ul_MD5Multi, res, data, len, n));
+    }
+
+    free(buf);
+    free(data);
+    free(len);
+    free(ref);
+    free(res);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif /* TEST_PROGRAM_MD5 */
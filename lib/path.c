@@ -8,6 +8,11 @@
  * The ul_path_read_* API is possible to use without path_cxt handler. In this
  * case is not possible to use global prefix and printf-like formatting.
  *
+ * The subdirectories (e.g. "queue" for "queue/rotational") requested more
+ * than once are kept open in path_cxt, and files from them are opened by
+ * openat() relative to the subdirectory. The cache is closed together with
+ * the context directory by ul_path_close_dirfd().
+ *
  * No copyright is claimed.  This code is in the public domain; do with
  * it what you wish.
  *
@@ -49,9 +54,26 @@ void ul_path_init_debug(void)
 	__UL_INIT_DEBUG_FROM_ENV(ulpath, ULPATH_DEBUG_, 0, ULPATH_DEBUG);
 }
 
+static void close_subdirs(struct path_cxt *pc)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(pc->subdirs); i++) {
+		struct path_subdir *sd = &pc->subdirs[i];
+
+		if (sd->fd >= 0)
+			close(sd->fd);
+		free(sd->name);
+		sd->name = NULL;
+		sd->fd = -1;
+	}
+	pc->nsubdirs = 0;
+}
+
 struct path_cxt *ul_new_path(const char *dir, ...)
 {
 	struct path_cxt *pc = calloc(1, sizeof(*pc));
+	size_t i;
 
 	if (!pc)
 		return NULL;
@@ -60,6 +82,8 @@ struct path_cxt *ul_new_path(const char *dir, ...)
 
 	pc->refcount = 1;
 	pc->dir_fd = -1;
+	for (i = 0; i < ARRAY_SIZE(pc->subdirs); i++)
+		pc->subdirs[i].fd = -1;
 
 	if (dir) {
 		int rc;
@@ -135,10 +159,7 @@ int ul_path_set_dir(struct path_cxt *pc, const char *dir)
 			return -ENOMEM;
 	}
 
-	if (pc->dir_fd >= 0) {
-		close(pc->dir_fd);
-		pc->dir_fd = -1;
-	}
+	ul_path_close_dirfd(pc);
 
 	free(pc->dir_path);
 	pc->dir_path = p;
@@ -170,7 +191,7 @@ int ul_path_set_enoent_redirect(struct path_cxt *pc, int (*func)(struct path_cxt
 	return 0;
 }
 
-static const char *get_absdir(struct path_cxt *pc)
+static const char *__get_absdir(struct path_cxt *pc, char *buf, size_t bufsz)
 {
 	int rc;
 	const char *dirpath;
@@ -184,15 +205,20 @@ static const char *get_absdir(struct path_cxt *pc)
 	if (*dirpath == '/')
 		dirpath++;
 
-	rc = snprintf(pc->path_buffer, sizeof(pc->path_buffer), "%s/%s", pc->prefix, dirpath);
+	rc = snprintf(buf, bufsz, "%s/%s", pc->prefix, dirpath);
 	if (rc < 0)
 		return NULL;
-	if ((size_t)rc >= sizeof(pc->path_buffer)) {
+	if ((size_t)rc >= bufsz) {
 		errno = ENAMETOOLONG;
 		return NULL;
 	}
 
-	return pc->path_buffer;
+	return buf;
+}
+
+static inline const char *get_absdir(struct path_cxt *pc)
+{
+	return __get_absdir(pc, pc->path_buffer, sizeof(pc->path_buffer));
 }
 
 int ul_path_get_dirfd(struct path_cxt *pc)
@@ -201,7 +227,9 @@ int ul_path_get_dirfd(struct path_cxt *pc)
 	assert(pc->dir_path);
 
 	if (pc->dir_fd < 0) {
-		const char *path = get_absdir(pc);
+		/* don't use path_buffer, it may contain path for the lazy open */
+		char buf[PATH_MAX];
+		const char *path = __get_absdir(pc, buf, sizeof(buf));
 		if (!path)
 			return -errno;
 
@@ -222,6 +250,48 @@ void ul_path_close_dirfd(struct path_cxt *pc)
 		close(pc->dir_fd);
 		pc->dir_fd = -1;
 	}
+	close_subdirs(pc);
+}
+
+/*
+ * Returns FD of the cached subdirectory for @path (e.g. "queue" for
+ * "queue/rotational") and sets @file to the rest of the path. Returns -1 if
+ * the subdirectory is not cached (yet); the subdirectory is opened on the
+ * second request only, because many paths are used just once.
+ */
+static int get_subdir_fd(struct path_cxt *pc, int dir, const char *path, const char **file)
+{
+	struct path_subdir *sd;
+	const char *p = strrchr(path, '/');
+	size_t i, len;
+
+	if (!p || p == path || !*(p + 1))
+		return -1;
+	len = p - path;
+
+	for (i = 0; i < ARRAY_SIZE(pc->subdirs); i++) {
+		sd = &pc->subdirs[i];
+
+		if (!sd->name || strncmp(sd->name, path, len) != 0 || sd->name[len])
+			continue;
+		if (sd->fd < 0) {
+			sd->fd = openat(dir, sd->name, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+			if (sd->fd < 0)
+				return -1;
+			DBG(CXT, ul_debugobj(pc, "cache subdir: '%s'", sd->name));
+		}
+		*file = p + 1;
+		return sd->fd;
+	}
+
+	/* remember for the next time */
+	sd = &pc->subdirs[pc->nsubdirs++ % ARRAY_SIZE(pc->subdirs)];
+	if (sd->fd >= 0)
+		close(sd->fd);
+	free(sd->name);
+	sd->fd = -1;
+	sd->name = strndup(path, len);
+	return -1;
 }
 
 int ul_path_isopen_dirfd(struct path_cxt *pc)
@@ -364,10 +434,17 @@ int ul_path_open(struct path_cxt *pc, int flags, const char *path)
 		if (dir < 0)
 			return dir;
 
+		int sub;
+		const char *file = NULL;
+
 		if (*path == '/')
 			path++;
 
-		fdx = fd = openat(dir, path, flags);
+		sub = get_subdir_fd(pc, dir, path, &file);
+		if (sub >= 0)
+			fdx = fd = openat(sub, file, flags);
+		else
+			fdx = fd = openat(dir, path, flags);
 
 		if (fd < 0 && errno == ENOENT
 		    && pc->redirect_on_enoent
@@ -707,14 +784,50 @@ int ul_path_scanff(struct path_cxt *pc, const char *path, va_list ap, const char
 	return rc;
 }
 
+/*
+ * The numbers are read to a small buffer on stack and parsed by strtoX(),
+ * it's cheaper than fopen() and fscanf() for small sysfs attributes.
+ */
+static int read_number_string(struct path_cxt *pc, char *buf, size_t bufsz,
+			      const char *path)
+{
+	int rc = ul_path_read(pc, buf, bufsz - 1, path);
+
+	if (rc <= 0)
+		return -1;
+	buf[rc] = '\0';
+	return 0;
+}
+
+static int parse_signed(const char *str, intmax_t *res)
+{
+	char *end = NULL;
+
+	errno = 0;
+	*res = strtoimax(str, &end, 10);
+	if (errno || !end || end == str)
+		return -1;
+	return 0;
+}
+
+static int parse_unsigned(const char *str, uintmax_t *res)
+{
+	char *end = NULL;
+
+	errno = 0;
+	*res = strtoumax(str, &end, 10);
+	if (errno || !end || end == str)
+		return -1;
+	return 0;
+}
 
 int ul_path_read_s64(struct path_cxt *pc, int64_t *res, const char *path)
 {
-	int64_t x = 0;
-	int rc;
+	char buf[sizeof(stringify_value(LLONG_MIN)) + 2];
+	intmax_t x;
 
-	rc = ul_path_scanf(pc, path, "%"SCNd64, &x);
-	if (rc != 1)
+	if (read_number_string(pc, buf, sizeof(buf), path) != 0
+	    || parse_signed(buf, &x) != 0)
 		return -1;
 	if (res)
 		*res = x;
@@ -735,11 +848,11 @@ int ul_path_readf_s64(struct path_cxt *pc, int64_t *res, const char *path, ...)
 
 int ul_path_read_u64(struct path_cxt *pc, uint64_t *res, const char *path)
 {
-	uint64_t x = 0;
-	int rc;
+	char buf[sizeof(stringify_value(ULLONG_MAX)) + 2];
+	uintmax_t x;
 
-	rc = ul_path_scanf(pc, path, "%"SCNu64, &x);
-	if (rc != 1)
+	if (read_number_string(pc, buf, sizeof(buf), path) != 0
+	    || parse_unsigned(buf, &x) != 0)
 		return -1;
 	if (res)
 		*res = x;
@@ -760,13 +873,15 @@ int ul_path_readf_u64(struct path_cxt *pc, uint64_t *res, const char *path, ...)
 
 int ul_path_read_s32(struct path_cxt *pc, int *res, const char *path)
 {
-	int rc, x = 0;
+	char buf[sizeof(stringify_value(LLONG_MIN)) + 2];
+	intmax_t x;
 
-	rc = ul_path_scanf(pc, path, "%d", &x);
-	if (rc != 1)
+	if (read_number_string(pc, buf, sizeof(buf), path) != 0
+	    || parse_signed(buf, &x) != 0
+	    || x < INT_MIN || x > INT_MAX)
 		return -1;
 	if (res)
-		*res = x;
+		*res = (int) x;
 	return 0;
 }
 
@@ -784,14 +899,15 @@ int ul_path_readf_s32(struct path_cxt *pc, int *res, const char *path, ...)
 
 int ul_path_read_u32(struct path_cxt *pc, unsigned int *res, const char *path)
 {
-	int rc;
-	unsigned int x;
+	char buf[sizeof(stringify_value(ULLONG_MAX)) + 2];
+	uintmax_t x;
 
-	rc = ul_path_scanf(pc, path, "%u", &x);
-	if (rc != 1)
+	if (read_number_string(pc, buf, sizeof(buf), path) != 0
+	    || parse_unsigned(buf, &x) != 0
+	    || x > UINT_MAX)
 		return -1;
 	if (res)
-		*res = x;
+		*res = (unsigned int) x;
 	return 0;
 }
 
@@ -809,10 +925,16 @@ int ul_path_readf_u32(struct path_cxt *pc, unsigned int *res, const char *path,
 
 int ul_path_read_majmin(struct path_cxt *pc, dev_t *res, const char *path)
 {
-	int rc, maj, min;
+	char buf[2 * sizeof(stringify_value(UINT_MAX)) + 2];
+	uintmax_t maj, min;
+	char *end = NULL;
+
+	if (read_number_string(pc, buf, sizeof(buf), path) != 0
+	    || parse_unsigned(buf, &maj) != 0)
+		return -1;
 
-	rc = ul_path_scanf(pc, path, "%d:%d", &maj, &min);
-	if (rc != 2)
+	end = strchr(buf, ':');
+	if (!end || parse_unsigned(end + 1, &min) != 0)
 		return -1;
 	if (res)
 		*res = makedev(maj, min);
@@ -917,6 +1039,96 @@ int ul_path_writef_u64(struct path_cxt *pc, uint64_t num, const char *path, ...)
 
 }
 
+static int read_attr(struct path_cxt *pc, int dir, const char *subdir,
+		     struct ul_path_attr *attr)
+{
+	int fd = -1, rc, errsv;
+
+	if (dir >= 0) {
+		fd = openat(dir, attr->name, O_RDONLY|O_CLOEXEC);
+		if (fd < 0 && (errno != ENOENT || !pc->redirect_on_enoent))
+			return -errno;
+	}
+	if (fd < 0) {
+		/* redirect (or no subdirectory), use the full path */
+		char path[PATH_MAX];
+		const char *p = attr->name;
+
+		if (subdir) {
+			rc = snprintf(path, sizeof(path), "%s/%s", subdir, attr->name);
+			if (rc < 0 || (size_t) rc >= sizeof(path))
+				return -E2BIG;
+			p = path;
+		}
+		fd = ul_path_open(pc, O_RDONLY|O_CLOEXEC, p);
+		if (fd < 0)
+			return -errno;
+	}
+
+	rc = read_all(fd, attr->buf, attr->bufsz - 1);
+	errsv = errno;
+	close(fd);
+	if (rc < 0)
+		return -errsv;
+
+	/* Remove tailing newline (usual in sysfs) */
+	if (rc > 0 && attr->buf[rc - 1] == '\n')
+		--rc;
+	attr->buf[rc] = '\0';
+	return rc;
+}
+
+/*
+ * Reads small files (attributes) from @subdir, or from the context directory
+ * if @subdir is NULL. The subdirectory is opened only once and the files are
+ * opened by openat() relative to the subdirectory. The result for each
+ * attribute is zero terminated string without the tailing newline in
+ * attr->buf and attr->rc is size of the string or -errno.
+ *
+ * The attributes are independent, so the reads may be submitted together
+ * (e.g. by io_uring) in future without a change in the API.
+ *
+ * Returns number of successfully read attributes.
+ */
+int ul_path_read_attrs(struct path_cxt *pc, const char *subdir,
+			struct ul_path_attr *attrs, size_t nattrs)
+{
+	int dir, subfd = -1, count = 0, err = 0;
+	size_t i;
+
+	dir = ul_path_get_dirfd(pc);
+	if (dir < 0)
+		err = -errno;
+	else if (subdir) {
+		if (*subdir == '/')
+			subdir++;
+		subfd = openat(dir, subdir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+		if (subfd < 0 && (errno != ENOENT || !pc->redirect_on_enoent))
+			err = -errno;
+		dir = subfd;	/* -1 for redirect */
+	}
+
+	DBG(CXT, ul_debugobj(pc, "reading %zu attributes from '%s'", nattrs,
+				subdir ? subdir : "."));
+
+	for (i = 0; i < nattrs; i++) {
+		struct ul_path_attr *attr = &attrs[i];
+
+		if (err)
+			attr->rc = err;
+		else if (!attr->buf || !attr->bufsz)
+			attr->rc = -EINVAL;
+		else
+			attr->rc = read_attr(pc, dir, subdir, attr);
+		if (attr->rc >= 0)
+			count++;
+	}
+
+	if (subfd >= 0)
+		close(subfd);
+	return count;
+}
+
 int ul_path_count_dirents(struct path_cxt *pc, const char *path)
 {
 	DIR *dir;
@@ -1034,6 +1246,7 @@ int ul_path_readf_cpulist(struct path_cxt *pc, cpu_set_t **set, int maxcpus, con
 
 #ifdef TEST_PROGRAM_PATH
 #include <getopt.h>
+#include "xalloc.h"
 
 static void __attribute__((__noreturn__)) usage(void)
 {
@@ -1048,6 +1261,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(" read-string <file>         read string  from file\n", stdout);
 	fputs(" read-majmin <file>         read devno from file\n", stdout);
 	fputs(" read-link <file>           read symlink\n", stdout);
+	fputs(" read-attrs <dir> <file>... read files from directory\n", stdout);
 	fputs(" write-string <file> <str>  write string from file\n", stdout);
 	fputs(" write-u64 <file> <str>     write uint64_t from file\n", stdout);
 
@@ -1200,6 +1414,33 @@ int main(int argc, char *argv[])
 			err(EXIT_FAILURE, "readf symlink failed");
 		printf("readf: %s: %s\n", file, res);
 
+	} else if (strcmp(command, "read-attrs") == 0) {
+		struct ul_path_attr *attrs;
+		const char *subdir;
+		size_t i, nattrs;
+
+		if (optind + 1 >= argc)
+			errx(EXIT_FAILURE, "<dir> <file> not defined");
+		subdir = argv[optind++];
+		nattrs = argc - optind;
+
+		attrs = xcalloc(nattrs, sizeof(*attrs));
+		for (i = 0; i < nattrs; i++) {
+			attrs[i].name = argv[optind++];
+			attrs[i].bufsz = BUFSIZ;
+			attrs[i].buf = xmalloc(BUFSIZ);
+		}
+
+		printf("read:  %d attributes\n", ul_path_read_attrs(pc, subdir, attrs, nattrs));
+		for (i = 0; i < nattrs; i++) {
+			if (attrs[i].rc < 0)
+				printf("%s/%s: %s\n", subdir, attrs[i].name, strerror(-attrs[i].rc));
+			else
+				printf("%s/%s: %s\n", subdir, attrs[i].name, attrs[i].buf);
+			free(attrs[i].buf);
+		}
+		free(attrs);
+
 	} else if (strcmp(command, "write-string") == 0) {
 		char *str;
 
@@ -22,10 +22,17 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/syscall.h>
 
 #include "procutils.h"
 #include "fileutils.h"
 #include "all-io.h"
+#include "pathnames.h"
+#include "strutils.h"
 #include "c.h"
 
 /*
@@ -40,7 +47,7 @@ struct proc_tasks *proc_open_tasks(pid_t pid)
 
 	sprintf(path, "/proc/%d/task/", pid);
 
-	tasks = malloc(sizeof(struct proc_tasks));
+	tasks = calloc(1, sizeof(struct proc_tasks));
 	if (tasks) {
 		tasks->dir = opendir(path);
 		if (tasks->dir)
@@ -51,6 +58,74 @@ struct proc_tasks *proc_open_tasks(pid_t pid)
 	return NULL;
 }
 
+static struct proc_tasks *open_cgroup_file(const char *cgroup,
+					   const char *name, const char *v1name)
+{
+	struct proc_tasks *tasks;
+	char path[PATH_MAX];
+	const char *prefix = *cgroup == '/' ? "" : _PATH_SYS_CGROUP "/";
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s%s/%s", prefix, cgroup, name);
+	f = fopen(path, "r" UL_CLOEXECSTR);
+	if (!f && errno == ENOENT && v1name) {
+		snprintf(path, sizeof(path), "%s%s/%s", prefix, cgroup, v1name);
+		f = fopen(path, "r" UL_CLOEXECSTR);
+	}
+	if (!f)
+		return NULL;
+
+	tasks = proc_open_tasks_stream(f);
+	if (!tasks) {
+		fclose(f);
+		return NULL;
+	}
+	tasks->own_file = 1;
+	return tasks;
+}
+
+/*
+ * @cgroup: cgroup directory, relative path is relative to /sys/fs/cgroup
+ *
+ * The threads are read from cgroup.threads (cgroup v2) or from the tasks
+ * file (cgroup v1).
+ *
+ * Returns: newly allocated tasks structure
+ */
+struct proc_tasks *proc_open_cgroup_tasks(const char *cgroup)
+{
+	return open_cgroup_file(cgroup, "cgroup.threads", "tasks");
+}
+
+/*
+ * @cgroup: cgroup directory, relative path is relative to /sys/fs/cgroup
+ *
+ * The same as proc_open_cgroup_tasks(), but only the thread group leaders
+ * (processes) are returned, they are read from cgroup.procs.
+ *
+ * Returns: newly allocated tasks structure
+ */
+struct proc_tasks *proc_open_cgroup_procs(const char *cgroup)
+{
+	return open_cgroup_file(cgroup, "cgroup.procs", NULL);
+}
+
+/*
+ * @f: stream with "<tid> [<param>]" lines (e.g. stdin)
+ *
+ * The stream is not closed by proc_close_tasks().
+ *
+ * Returns: newly allocated tasks structure
+ */
+struct proc_tasks *proc_open_tasks_stream(FILE *f)
+{
+	struct proc_tasks *tasks = calloc(1, sizeof(struct proc_tasks));
+
+	if (tasks)
+		tasks->file = f;
+	return tasks;
+}
+
 /*
  * @tasks: allocated tasks structure
  *
@@ -58,8 +133,13 @@ struct proc_tasks *proc_open_tasks(pid_t pid)
  */
 void proc_close_tasks(struct proc_tasks *tasks)
 {
-	if (tasks && tasks->dir)
+	if (!tasks)
+		return;
+	if (tasks->dir)
 		closedir(tasks->dir);
+	if (tasks->file && tasks->own_file)
+		fclose(tasks->file);
+	free(tasks->line);
 	free(tasks);
 }
 
@@ -78,6 +158,15 @@ int proc_next_tid(struct proc_tasks *tasks, pid_t *tid)
 	if (!tasks || !tid)
 		return -EINVAL;
 
+	if (tasks->file) {
+		int rc;
+
+		do {
+			rc = proc_next_tid_param(tasks, tid, NULL);
+		} while (rc == -EINVAL);
+		return rc;
+	}
+
 	*tid = 0;
 	errno = 0;
 
@@ -98,6 +187,59 @@ int proc_next_tid(struct proc_tasks *tasks, pid_t *tid)
 	return 0;
 }
 
+/*
+ * @tasks: tasks structure from proc_open_cgroup_tasks() or proc_open_tasks_stream()
+ * @tid: [output] the thread ID from the line
+ * @param: [output] the rest of the line or NULL
+ *
+ * Reads the next "<tid> [<param>]" line, empty lines and lines starting
+ * with '#' are ignored. The @param is the rest of the line without the
+ * leading and trailing blanks, it's valid until the next call.
+ *
+ * Returns: 0 on success, 1 on end, -EINVAL on invalid line (@param is the
+ *          whole line, the next line may be read), or other negative
+ *          number on error
+ */
+int proc_next_tid_param(struct proc_tasks *tasks, pid_t *tid, char **param)
+{
+	if (!tasks || !tasks->file || !tid)
+		return -EINVAL;
+
+	*tid = 0;
+	if (param)
+		*param = NULL;
+
+	while (getline(&tasks->line, &tasks->linesz, tasks->file) != -1) {
+		char *p = tasks->line, *end = NULL;
+		size_t sz;
+		long x;
+
+		sz = strlen(p);
+		while (sz && isspace((unsigned char) p[sz - 1]))
+			p[--sz] = '\0';
+		p = (char *) skip_space(p);
+		if (!*p || *p == '#')
+			continue;
+
+		errno = 0;
+		x = strtol(p, &end, 10);
+		if (errno || end == p || x <= 0 || x > INT_MAX
+		    || (*end && !isspace((unsigned char) *end))) {
+			if (param)
+				*param = p;
+			return -EINVAL;
+		}
+		*tid = (pid_t) x;
+
+		end = (char *) skip_space(end);
+		if (param && *end)
+			*param = end;
+		return 0;
+	}
+
+	return ferror(tasks->file) ? -EIO : 1;
+}
+
 /* returns process command path, use free() for result */
 static char *proc_file_strdup(pid_t pid, const char *name)
 {
@@ -140,25 +282,65 @@ char *proc_get_command_name(pid_t pid)
 	return proc_file_strdup(pid, "comm");
 }
 
+/*
+ * The processes are enumerated by getdents64() with a large buffer, the
+ * per-process files are read relatively to the /proc (or to the process
+ * directory) file descriptor by one pread() to the reusable buffer, so no
+ * path is composed and no stdio is used.
+ */
+#define PROC_DENTS_BUFSZ	(64 * 1024)
+#define PROC_READ_BUFSZ		4096
+
 struct proc_processes *proc_open_processes(void)
 {
 	struct proc_processes *ps;
 
 	ps = calloc(1, sizeof(struct proc_processes));
-	if (ps) {
-		ps->dir = opendir("/proc");
-		if (ps->dir)
-			return ps;
-	}
-
+	if (!ps)
+		return NULL;
+
+	ps->pidfd = -1;
+	ps->fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (ps->fd < 0)
+		goto fail;
+#ifdef SYS_getdents64
+	ps->dents = malloc(PROC_DENTS_BUFSZ);
+	if (!ps->dents)
+		goto fail;
+#else
+	ps->dir = fdopendir(ps->fd);
+	if (!ps->dir)
+		goto fail;
+#endif
+	return ps;
+fail:
+	if (ps->fd >= 0)
+		close(ps->fd);
 	free(ps);
 	return NULL;
 }
 
+static void close_pidfd(struct proc_processes *ps)
+{
+	if (ps->pidfd >= 0)
+		close(ps->pidfd);
+	ps->pidfd = -1;
+}
+
 void proc_close_processes(struct proc_processes *ps)
 {
-	if (ps && ps->dir)
-		closedir(ps->dir);
+	if (!ps)
+		return;
+	close_pidfd(ps);
+#ifdef SYS_getdents64
+	if (ps->fd >= 0)
+		close(ps->fd);
+	free(ps->dents);
+#else
+	if (ps->dir)
+		closedir(ps->dir);	/* closes ps->fd too */
+#endif
+	free(ps->buf);
 	free(ps);
 }
 
@@ -174,33 +356,207 @@ void proc_processes_filter_by_uid(struct proc_processes *ps, uid_t uid)
 	ps->has_fltr_uid = 1;
 }
 
-int proc_next_pid(struct proc_processes *ps, pid_t *pid)
+#ifdef SYS_getdents64
+struct proc_dirent64 {
+	uint64_t	d_ino;
+	int64_t		d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[];
+};
+#endif
+
+/* returns the next /proc entry name, NULL on end-of-dir or error (errno set) */
+static const char *next_entry(struct proc_processes *ps)
 {
+#ifdef SYS_getdents64
+	struct proc_dirent64 *d;
+
+	if (ps->dents_pos >= ps->dents_len) {
+		long n = syscall(SYS_getdents64, ps->fd, ps->dents, PROC_DENTS_BUFSZ);
+
+		if (n <= 0) {
+			if (n == 0)
+				errno = 0;
+			return NULL;
+		}
+		ps->dents_len = n;
+		ps->dents_pos = 0;
+	}
+	d = (struct proc_dirent64 *) (ps->dents + ps->dents_pos);
+	ps->dents_pos += d->d_reclen;
+	return d->d_name;
+#else
 	struct dirent *d;
 
+	errno = 0;
+	d = readdir(ps->dir);
+	return d ? d->d_name : NULL;
+#endif
+}
+
+static pid_t name_to_pid(const char *name)
+{
+	pid_t pid = 0;
+
+	for (; *name; name++) {
+		if (!isdigit((unsigned char) *name))
+			return 0;
+		pid = pid * 10 + (*name - '0');
+	}
+	return pid;
+}
+
+/*
+ * Reads file @name of the current process (the last returned by
+ * proc_next_pid()) to the internal buffer. The result is terminated by
+ * zero and valid until the next proc_processes_read() call.
+ *
+ * Returns: data or NULL on error (errno set), @sz is optional.
+ */
+char *proc_processes_read(struct proc_processes *ps, const char *name, size_t *sz)
+{
+	char path[sizeof(stringify_value(INT_MAX)) + 1 + NAME_MAX];
+	ssize_t n;
+	int fd;
+
+	if (!ps || !ps->pid || !name) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (ps->pidfd >= 0) {
+		fd = openat(ps->pidfd, name, O_RDONLY | O_CLOEXEC);
+	} else {
+		snprintf(path, sizeof(path), "%d/%s", (int) ps->pid, name);
+		fd = openat(ps->fd, path, O_RDONLY | O_CLOEXEC);
+	}
+	if (fd < 0)
+		return NULL;
+
+	if (!ps->buf) {
+		ps->bufsz = PROC_READ_BUFSZ;
+		ps->buf = malloc(ps->bufsz);
+		if (!ps->buf)
+			goto fail;
+	}
+	for (;;) {
+		char *tmp;
+
+		do {
+			n = pread(fd, ps->buf, ps->bufsz - 1, 0);
+		} while (n < 0 && errno == EINTR);
+		if (n < 0)
+			goto fail;
+		if ((size_t) n < ps->bufsz - 1)
+			break;
+
+		/* the buffer is probably too small, read it again */
+		tmp = realloc(ps->buf, ps->bufsz * 2);
+		if (!tmp)
+			goto fail;
+		ps->buf = tmp;
+		ps->bufsz *= 2;
+	}
+	close(fd);
+
+	ps->buf[n] = '\0';
+	if (sz)
+		*sz = n;
+	return ps->buf;
+fail:
+	close(fd);
+	return NULL;
+}
+
+/*
+ * Returns command line of the current process with the arguments separated
+ * by spaces, or NULL (kernel threads). See proc_processes_read() for the
+ * buffer lifetime.
+ */
+char *proc_processes_get_command(struct proc_processes *ps)
+{
+	size_t i, sz = 0;
+	char *buf = proc_processes_read(ps, "cmdline", &sz);
+
+	if (!buf || !sz)
+		return NULL;
+	for (i = 0; i < sz - 1; i++) {
+		if (buf[i] == '\0')
+			buf[i] = ' ';
+	}
+	buf[sz - 1] = '\0';
+	return buf;
+}
+
+/*
+ * Returns the command name from the current process "stat" file. See
+ * proc_processes_read() for the buffer lifetime.
+ */
+char *proc_processes_get_name(struct proc_processes *ps)
+{
+	char *buf = proc_processes_read(ps, "stat", NULL);
+	char *b, *e;
+
+	if (!buf)
+		return NULL;
+
+	/* the name is in parentheses and may contain ')' too */
+	b = strchr(buf, '(');
+	e = strrchr(buf, ')');
+	if (!b || !e || e < b) {
+		errno = EINVAL;
+		return NULL;
+	}
+	*e = '\0';
+	return b + 1;
+}
+
+/*
+ * Returns the directory file descriptor of the current process (the last
+ * returned by proc_next_pid()), the descriptor is closed by the next
+ * proc_next_pid() or proc_close_processes() call.
+ */
+int proc_processes_get_dirfd(struct proc_processes *ps)
+{
+	char name[sizeof(stringify_value(INT_MAX))];
+
+	if (!ps || !ps->pid) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (ps->pidfd < 0) {
+		snprintf(name, sizeof(name), "%d", (int) ps->pid);
+		ps->pidfd = openat(ps->fd, name,
+				   O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	}
+	return ps->pidfd;
+}
+
+int proc_next_pid(struct proc_processes *ps, pid_t *pid)
+{
+	const char *name;
+
 	if (!ps || !pid)
 		return -EINVAL;
 
 	*pid = 0;
-	errno = 0;
-
 	do {
-		char buf[BUFSIZ], *p;
+		close_pidfd(ps);
+		ps->pid = 0;
 
-		errno = 0;
-		d = readdir(ps->dir);
-		if (!d)
+		name = next_entry(ps);
+		if (!name)
 			return errno ? -1 : 1;		/* error or end-of-dir */
 
-
-		if (!isdigit((unsigned char) *d->d_name))
+		ps->pid = name_to_pid(name);
+		if (!ps->pid)
 			continue;
 
 		/* filter out by UID */
 		if (ps->has_fltr_uid) {
 			struct stat st;
 
-			if (fstatat(dirfd(ps->dir), d->d_name, &st, 0))
+			if (fstatat(ps->fd, name, &st, 0))
 				continue;
 			if (ps->fltr_uid != st.st_uid)
 				continue;
@@ -208,33 +564,13 @@ int proc_next_pid(struct proc_processes *ps, pid_t *pid)
 
 		/* filter out by NAME */
 		if (ps->has_fltr_name) {
-			char procname[256];
-			FILE *f;
-
-			snprintf(buf, sizeof(buf), "%s/stat", d->d_name);
-			f = fopen_at(dirfd(ps->dir), buf, O_CLOEXEC|O_RDONLY, "r");
-			if (!f)
-				continue;
-
-			p = fgets(buf, sizeof(buf), f);
-			fclose(f);
-			if (!p)
-				continue;
+			const char *procname = proc_processes_get_name(ps);
 
-			if (sscanf(buf, "%*d (%255[^)])", procname) != 1)
-				continue;
-
-			/* ok, we got the process name. */
-			if (strcmp(procname, ps->fltr_name) != 0)
+			if (!procname || strcmp(procname, ps->fltr_name) != 0)
 				continue;
 		}
 
-		p = NULL;
-		errno = 0;
-		*pid = (pid_t) strtol(d->d_name, &p, 10);
-		if (errno || d->d_name == p || (p && *p))
-			return errno ? -errno : -1;
-
+		*pid = ps->pid;
 		return 0;
 	} while (1);
 
@@ -266,10 +602,32 @@ static int test_tasks(int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
+static int test_cgroup(int argc, char *argv[])
+{
+	pid_t tid;
+	struct proc_tasks *ts;
+
+	if (argc != 2)
+		return EXIT_FAILURE;
+
+	ts = proc_open_cgroup_tasks(argv[1]);
+	if (!ts)
+		err(EXIT_FAILURE, "open list of cgroup tasks failed");
+
+	printf("cgroup=%s, TIDs:", argv[1]);
+	while (proc_next_tid(ts, &tid) == 0)
+		printf(" %d", tid);
+
+	printf("\n");
+	proc_close_tasks(ts);
+	return EXIT_SUCCESS;
+}
+
 static int test_processes(int argc, char *argv[])
 {
 	pid_t pid;
 	struct proc_processes *ps;
+	int commands = 0;
 
 	ps = proc_open_processes();
 	if (!ps)
@@ -281,8 +639,17 @@ static int test_processes(int argc, char *argv[])
 	if (argc >= 3 && strcmp(argv[1], "--uid") == 0)
 		proc_processes_filter_by_uid(ps, (uid_t) atol(argv[2]));
 
-	while (proc_next_pid(ps, &pid) == 0)
-		printf(" %d", pid);
+	if (argc >= 2 && strcmp(argv[1], "--commands") == 0)
+		commands = 1;
+
+	while (proc_next_pid(ps, &pid) == 0) {
+		if (commands) {
+			char *cmd = proc_processes_get_command(ps);
+
+			printf("%d %s\n", pid, cmd ? cmd : "");
+		} else
+			printf(" %d", pid);
+	}
 
 	printf("\n");
         proc_close_processes(ps);
@@ -293,13 +660,16 @@ int main(int argc, char *argv[])
 {
 	if (argc < 2) {
 		fprintf(stderr, "usage: %1$s --tasks <pid>\n"
-				"       %1$s --processes [---name <name>] [--uid <uid>]\n",
+				"       %1$s --cgroup <path>\n"
+				"       %1$s --processes [---name <name>] [--uid <uid>] [--commands]\n",
 				program_invocation_short_name);
 		return EXIT_FAILURE;
 	}
 
 	if (strcmp(argv[1], "--tasks") == 0)
 		return test_tasks(argc - 1, argv + 1);
+	if (strcmp(argv[1], "--cgroup") == 0)
+		return test_cgroup(argc - 1, argv + 1);
 	if (strcmp(argv[1], "--processes") == 0)
 		return test_processes(argc - 1, argv + 1);
 
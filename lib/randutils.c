@@ -158,9 +158,13 @@ void random_get_bytes(void *buf, size_t nbytes)
 		}
 	}
 	/*
-	 * We do this all the time, but this is the only source of
-	 * randomness if /dev/random/urandom is out to lunch.
+	 * This is the only source of randomness if /dev/random/urandom is
+	 * out to lunch. It's useless (and expensive for big buffers) if
+	 * all the bytes have been read from the kernel.
 	 */
+	if (n == 0)
+		return;
+
 	crank_random();
 	for (cp = buf, i = 0; i < nbytes; i++)
 		*cp++ ^= (rand() >> 7) & 0xFF;
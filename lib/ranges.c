@@ -0,0 +1,143 @@
+/*
+ * Splits independent items to continuous ranges and processes the ranges by
+ * more threads. The function is called in the current thread for the first
+ * range and for the ranges where a new thread cannot be created, so the
+ * caller does not care about pthread_create() errors.
+ *
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "c.h"
+#include "ranges.h"
+
+struct ul_range {
+	void		*data;
+	ul_range_fn	fn;
+	size_t		range;
+	size_t		first;
+	size_t		last;
+	unsigned int	done : 1;
+};
+
+static void *range_thread(void *data)
+{
+	struct ul_range *rg = data;
+
+	rg->fn(rg->data, rg->range, rg->first, rg->last);
+	rg->done = 1;
+	return NULL;
+}
+
+/*
+ * Returns number of ranges (threads) for @nitems, at least @min_per_thread
+ * items per range and at most @max_threads ranges. The zero @max_threads
+ * means number of online CPUs. The result is never above UL_RANGES_MAX.
+ */
+size_t ul_count_ranges(size_t nitems, size_t min_per_thread, size_t max_threads)
+{
+	size_t nranges = min_per_thread ? nitems / min_per_thread : nitems;
+
+	if (!max_threads) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		max_threads = ncpus > 0 ? (size_t) ncpus : 1;
+	}
+	if (max_threads > UL_RANGES_MAX)
+		max_threads = UL_RANGES_MAX;
+	if (nranges > max_threads)
+		nranges = max_threads;
+	return nranges ? nranges : 1;
+}
+
+/*
+ * Calls @fn for all ranges of @nitems, see ul_count_ranges(). The range
+ * number 0 is always processed by the current thread. Returns number of
+ * the ranges.
+ */
+size_t ul_run_ranges(size_t nitems, size_t min_per_thread, size_t max_threads,
+		     ul_range_fn fn, void *data)
+{
+	struct ul_range ranges[UL_RANGES_MAX];
+	pthread_t threads[UL_RANGES_MAX];
+	size_t i, nranges, nthreads;
+
+	nranges = ul_count_ranges(nitems, min_per_thread, max_threads);
+	if (nranges == 1) {
+		fn(data, 0, 0, nitems);
+		return 1;
+	}
+
+	memset(ranges, 0, sizeof(ranges));
+	for (i = 0; i < nranges; i++) {
+		ranges[i].data = data;
+		ranges[i].fn = fn;
+		ranges[i].range = i;
+		ranges[i].first = nitems * i / nranges;
+		ranges[i].last = nitems * (i + 1) / nranges;
+	}
+
+	for (nthreads = 0; nthreads + 1 < nranges; nthreads++) {
+		if (pthread_create(&threads[nthreads], NULL,
+				   range_thread, &ranges[nthreads + 1]) != 0)
+			break;
+	}
+	range_thread(&ranges[0]);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	/* not started threads */
+	for (i = 1; i < nranges; i++) {
+		if (!ranges[i].done)
+			range_thread(&ranges[i]);
+	}
+	return nranges;
+}
+
+#ifdef TEST_PROGRAM_RANGES
+#include <stdio.h>
+#include <stdlib.h>
+
+static void count_range(void *data, size_t range __attribute__((__unused__)),
+			size_t first, size_t last)
+{
+	unsigned char *hits = data;
+	size_t i;
+
+	for (i = first; i < last; i++)
+		hits[i]++;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t i, nitems, perthread, nranges;
+	unsigned char *hits;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <items> <per-thread>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	nitems = strtoul(argv[1], NULL, 10);
+	perthread = strtoul(argv[2], NULL, 10);
+
+	hits = calloc(1, nitems + 1);
+	if (!hits)
+		return EXIT_FAILURE;
+
+	nranges = ul_run_ranges(nitems, perthread, UL_RANGES_MAX, count_range, hits);
+
+	for (i = 0; i < nitems; i++) {
+		if (hits[i] != 1) {
+			printf("item %zu processed %d times\n", i, hits[i]);
+			return EXIT_FAILURE;
+		}
+	}
+	printf("%zu items, %zu ranges\n", nitems, nranges);
+	free(hits);
+	return EXIT_SUCCESS;
+}
+#endif /* TEST_PROGRAM_RANGES */
@@ -6,6 +6,11 @@
  * 1) "abc": A9993E36 4706816A BA3E2571 7850C26C 9CD0D89D
  * 2) "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq":  84983E44 1C3BD26E BAAE4AA1 F95129E5 E54670F1
  * 3) A million repetitions of "a":  34AA973C D4C4DAA4 F61EEB2B DBAD2731 6534016F
+ *
+ * The blocks are hashed by SHA-NI instructions on x86 and by the SHA1
+ * instructions on ARMv8 if supported by the CPU; the implementation is
+ * selected on the first call. ul_SHA1Multi() hashes more independent
+ * messages at once, by four SSE2 lanes if there are no SHA instructions.
  */
 
 #define UL_SHA1HANDSOFF
@@ -16,6 +21,31 @@
 
 #include "sha1.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+# include <cpuid.h>
+# include <immintrin.h>
+# ifndef bit_SHA
+#  define bit_SHA	(1 << 29)
+# endif
+# define HAVE_SHA1_SHANI 1
+#endif
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+# define HAVE_SHA1_SSE2 1
+#endif
+
+#if defined(__aarch64__) && defined(__linux__) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8))
+# include <sys/auxv.h>
+# include <arm_neon.h>
+# ifndef HWCAP_SHA1
+#  define HWCAP_SHA1	(1 << 5)
+# endif
+# define HAVE_SHA1_ARMV8 1
+#endif
+
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
 /* blk0() and blk() perform the initial expand. */
@@ -38,7 +68,7 @@
 
 /* Hash a single 512-bit block. This is the core of the algorithm. */
 
-void ul_SHA1Transform(uint32_t state[5], const unsigned char buffer[64])
+void ul_SHA1Transform_sw(uint32_t state[5], const unsigned char buffer[64])
 {
 	uint32_t a, b, c, d, e;
 
@@ -159,6 +189,171 @@ void ul_SHA1Transform(uint32_t state[5], const unsigned char buffer[64])
 #endif
 }
 
+static void sha1_blocks_sw(uint32_t state[5], const unsigned char *data, size_t nblocks)
+{
+	for (; nblocks > 0; nblocks--, data += 64)
+		ul_SHA1Transform_sw(state, data);
+}
+
+#ifdef HAVE_SHA1_SHANI
+/*
+ * Four rounds @i (0..19) by SHA-NI, the message words are in m[i % 4], the
+ * words for the next rounds are calculated in parallel. The @f immediate is
+ * the round function (i / 5).
+ */
+#define SHANI_ROUNDS(i, f) do { \
+	__m128i *e = (i) & 1 ? &e1 : &e0, *o = (i) & 1 ? &e0 : &e1; \
+	if ((i) == 0) \
+		*e = _mm_add_epi32(*e, m[0]); \
+	else \
+		*e = _mm_sha1nexte_epu32(*e, m[(i) & 3]); \
+	*o = abcd; \
+	abcd = _mm_sha1rnds4_epu32(abcd, *e, f); \
+	if ((i) >= 3 && (i) <= 18) \
+		m[((i) + 1) & 3] = _mm_sha1msg2_epu32(m[((i) + 1) & 3], m[(i) & 3]); \
+	if ((i) >= 1 && (i) <= 16) \
+		m[((i) + 3) & 3] = _mm_sha1msg1_epu32(m[((i) + 3) & 3], m[(i) & 3]); \
+	if ((i) >= 2 && (i) <= 17) \
+		m[((i) + 2) & 3] = _mm_xor_si128(m[((i) + 2) & 3], m[(i) & 3]); \
+} while (0)
+
+static void __attribute__((target("sha,sse4.1,ssse3")))
+sha1_blocks_shani(uint32_t state[5], const unsigned char *data, size_t nblocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd, e0, e1, m[4];
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0x1B);
+	e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+	for (; nblocks > 0; nblocks--, data += 64) {
+		__m128i abcd_save = abcd, e_save = e0;
+		int i;
+
+		for (i = 0; i < 4; i++)
+			m[i] = _mm_shuffle_epi8(_mm_loadu_si128(
+					(const __m128i *) (data + i * 16)), mask);
+
+		SHANI_ROUNDS(0, 0);  SHANI_ROUNDS(1, 0);  SHANI_ROUNDS(2, 0);
+		SHANI_ROUNDS(3, 0);  SHANI_ROUNDS(4, 0);  SHANI_ROUNDS(5, 1);
+		SHANI_ROUNDS(6, 1);  SHANI_ROUNDS(7, 1);  SHANI_ROUNDS(8, 1);
+		SHANI_ROUNDS(9, 1);  SHANI_ROUNDS(10, 2); SHANI_ROUNDS(11, 2);
+		SHANI_ROUNDS(12, 2); SHANI_ROUNDS(13, 2); SHANI_ROUNDS(14, 2);
+		SHANI_ROUNDS(15, 3); SHANI_ROUNDS(16, 3); SHANI_ROUNDS(17, 3);
+		SHANI_ROUNDS(18, 3); SHANI_ROUNDS(19, 3);
+
+		/* e0 is "a" of the rounds 76..79 */
+		e0 = _mm_sha1nexte_epu32(e0, e_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i *) state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = _mm_extract_epi32(e0, 3);
+}
+
+static int has_shani(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+	    || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3))
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & bit_SHA) != 0;
+}
+#endif /* HAVE_SHA1_SHANI */
+
+#ifdef HAVE_SHA1_ARMV8
+static void __attribute__((target("+crypto")))
+sha1_blocks_armv8(uint32_t state[5], const unsigned char *data, size_t nblocks)
+{
+	static const uint32_t K[] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+	uint32x4_t abcd = vld1q_u32(state);
+	uint32_t e0 = state[4];
+
+	for (; nblocks > 0; nblocks--, data += 64) {
+		uint32x4_t abcd_save = abcd, m[4];
+		uint32_t e_save = e0;
+		int i;
+
+		for (i = 0; i < 4; i++)
+			m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+
+		/* four rounds per loop, m[] is the circular message schedule */
+		for (i = 0; i < 20; i++) {
+			uint32x4_t w;
+			uint32_t e1;
+
+			if (i >= 4)
+				m[i & 3] = vsha1su1q_u32(
+						vsha1su0q_u32(m[i & 3], m[(i + 1) & 3], m[(i + 2) & 3]),
+						m[(i + 3) & 3]);
+			w = vaddq_u32(m[i & 3], vdupq_n_u32(K[i / 5]));
+			e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+
+			if (i < 5)
+				abcd = vsha1cq_u32(abcd, e0, w);
+			else if (i >= 10 && i < 15)
+				abcd = vsha1mq_u32(abcd, e0, w);
+			else
+				abcd = vsha1pq_u32(abcd, e0, w);
+			e0 = e1;
+		}
+
+		abcd = vaddq_u32(abcd, abcd_save);
+		e0 += e_save;
+	}
+
+	vst1q_u32(state, abcd);
+	state[4] = e0;
+}
+#endif /* HAVE_SHA1_ARMV8 */
+
+static void sha1_blocks_dispatch(uint32_t state[5], const unsigned char *data, size_t nblocks);
+
+static void (*sha1_blocks)(uint32_t [5], const unsigned char *, size_t) = sha1_blocks_dispatch;
+static const char *sha1_impl_name = "generic";
+static int sha1_has_insn;	/* SHA instructions, no lanes for ul_SHA1Multi() */
+
+/* the first call selects the best implementation for the current CPU */
+static void sha1_blocks_dispatch(uint32_t state[5], const unsigned char *data, size_t nblocks)
+{
+	void (*fn)(uint32_t [5], const unsigned char *, size_t) = sha1_blocks_sw;
+
+#ifdef HAVE_SHA1_SHANI
+	if (has_shani()) {
+		fn = sha1_blocks_shani;
+		sha1_impl_name = "sha-ni";
+		sha1_has_insn = 1;
+	}
+#endif
+#ifdef HAVE_SHA1_ARMV8
+	if (getauxval(AT_HWCAP) & HWCAP_SHA1) {
+		fn = sha1_blocks_armv8;
+		sha1_impl_name = "armv8";
+		sha1_has_insn = 1;
+	}
+#endif
+	sha1_blocks = fn;
+	if (nblocks)
+		fn(state, data, nblocks);
+}
+
+void ul_SHA1Transform(uint32_t state[5], const unsigned char buffer[64])
+{
+	sha1_blocks(state, buffer, 1);
+}
+
+/* returns name of the implementation used by ul_SHA1Transform() */
+const char *ul_SHA1_get_impl(void)
+{
+	if (sha1_blocks == sha1_blocks_dispatch)
+		sha1_blocks_dispatch(NULL, NULL, 0);
+	return sha1_impl_name;
+}
+
 /* SHA1Init - Initialize new context */
 
 void ul_SHA1Init(UL_SHA1_CTX *context)
@@ -187,9 +382,10 @@ void ul_SHA1Update(UL_SHA1_CTX *context, const unsigned char *data, uint32_t len
 	j = (j >> 3) & 63;
 	if ((j + len) > 63) {
 		memcpy(&context->buffer[j], data, (i = 64 - j));
-		ul_SHA1Transform(context->state, context->buffer);
-		for (; i + 63 < len; i += 64) {
-			ul_SHA1Transform(context->state, &data[i]);
+		sha1_blocks(context->state, context->buffer, 1);
+		if (len - i >= 64) {
+			sha1_blocks(context->state, &data[i], (len - i) / 64);
+			i += (len - i) & ~63U;
 		}
 		j = 0;
 	} else
@@ -201,12 +397,11 @@ void ul_SHA1Update(UL_SHA1_CTX *context, const unsigned char *data, uint32_t len
 
 void ul_SHA1Final(unsigned char digest[20], UL_SHA1_CTX *context)
 {
-	unsigned i;
+	static const unsigned char padding[64] = { 0200 };
+	unsigned i, j;
 
 	unsigned char finalcount[8];
 
-	unsigned char c;
-
 #if 0				/* untested "improvement" by DHR */
 	/* Convert context->count to a sequence of bytes
 	 * in finalcount.  Second element first, but
@@ -227,12 +422,9 @@ void ul_SHA1Final(unsigned char digest[20], UL_SHA1_CTX *context)
 		finalcount[i] = (unsigned char)((context->count[(i >= 4 ? 0 : 1)] >> ((3 - (i & 3)) * 8)) & 255);	/* Endian independent */
 	}
 #endif
-	c = 0200;
-	ul_SHA1Update(context, &c, 1);
-	while ((context->count[0] & 504) != 448) {
-		c = 0000;
-		ul_SHA1Update(context, &c, 1);
-	}
+	/* pad to 56 mod 64 bytes */
+	j = (context->count[0] >> 3) & 63;
+	ul_SHA1Update(context, padding, j < 56 ? 56 - j : 120 - j);
 	ul_SHA1Update(context, finalcount, 8);	/* Should cause a SHA1Transform() */
 	for (i = 0; i < 20; i++) {
 		digest[i] = (unsigned char)
@@ -246,11 +438,314 @@ void ul_SHA1Final(unsigned char digest[20], UL_SHA1_CTX *context)
 void ul_SHA1(char *hash_out, const char *str, unsigned len)
 {
 	UL_SHA1_CTX ctx;
-	unsigned int ii;
 
 	ul_SHA1Init(&ctx);
-	for (ii = 0; ii < len; ii += 1)
-		ul_SHA1Update(&ctx, (const unsigned char *)str + ii, 1);
+	ul_SHA1Update(&ctx, (const unsigned char *)str, len);
 	ul_SHA1Final((unsigned char *)hash_out, &ctx);
 	hash_out[20] = '\0';
 }
+
+static const uint32_t sha1_iv[5] = {
+	0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
+/*
+ * Copies the last incomplete block of the message to @tail and adds the
+ * padding, returns number of the tail blocks (1 or 2).
+ */
+static size_t sha1_tail(unsigned char tail[128], const unsigned char *data, size_t len)
+{
+	size_t rest = len & 63, n = rest < 56 ? 1 : 2, i;
+	uint64_t bits = (uint64_t) len << 3;
+
+	memcpy(tail, data + len - rest, rest);
+	tail[rest] = 0200;
+	memset(tail + rest + 1, 0, n * 64 - rest - 1 - 8);
+	for (i = 0; i < 8; i++)
+		tail[n * 64 - 1 - i] = (unsigned char) (bits >> (i * 8));
+	return n;
+}
+
+static void sha1_digest(unsigned char digest[UL_SHA1LENGTH], const uint32_t state[5])
+{
+	size_t i;
+
+	for (i = 0; i < UL_SHA1LENGTH; i++)
+		digest[i] = (unsigned char) (state[i >> 2] >> ((3 - (i & 3)) * 8));
+}
+
+#ifdef HAVE_SHA1_SSE2
+#define SHA1_LANES	4
+
+#define ROL4(x, n)	_mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+
+#define SSE2_ROUND(f, k, t) do { \
+	__m128i tmp; \
+	if ((t) >= 16) \
+		w[(t) & 15] = ROL4(_mm_xor_si128( \
+			_mm_xor_si128(w[((t) - 3) & 15], w[((t) - 8) & 15]), \
+			_mm_xor_si128(w[((t) - 14) & 15], w[(t) & 15])), 1); \
+	tmp = _mm_add_epi32(_mm_add_epi32(ROL4(a, 5), f), \
+		_mm_add_epi32(_mm_add_epi32(e, k), w[(t) & 15])); \
+	e = d; d = c; c = ROL4(b, 30); b = a; a = tmp; \
+} while (0)
+
+#define F_CH	_mm_xor_si128(d, _mm_and_si128(b, _mm_xor_si128(c, d)))
+#define F_PAR	_mm_xor_si128(_mm_xor_si128(b, c), d)
+#define F_MAJ	_mm_or_si128(_mm_and_si128(b, c), _mm_and_si128(d, _mm_or_si128(b, c)))
+
+static inline uint32_t be32(const unsigned char *p)
+{
+	return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+/* hashes one block for every lane, st[word][lane] */
+static void sha1_x4(uint32_t st[5][SHA1_LANES], const unsigned char *blk[SHA1_LANES])
+{
+	__m128i a, b, c, d, e, w[16], k;
+	__m128i sa, sb, sc, sd, se;
+	int t;
+
+	for (t = 0; t < 16; t++)
+		w[t] = _mm_set_epi32(be32(blk[3] + t * 4), be32(blk[2] + t * 4),
+				     be32(blk[1] + t * 4), be32(blk[0] + t * 4));
+
+	a = sa = _mm_loadu_si128((const __m128i *) st[0]);
+	b = sb = _mm_loadu_si128((const __m128i *) st[1]);
+	c = sc = _mm_loadu_si128((const __m128i *) st[2]);
+	d = sd = _mm_loadu_si128((const __m128i *) st[3]);
+	e = se = _mm_loadu_si128((const __m128i *) st[4]);
+
+	k = _mm_set1_epi32(0x5A827999);
+	for (t = 0; t < 20; t++)
+		SSE2_ROUND(F_CH, k, t);
+	k = _mm_set1_epi32(0x6ED9EBA1);
+	for (; t < 40; t++)
+		SSE2_ROUND(F_PAR, k, t);
+	k = _mm_set1_epi32(0x8F1BBCDC);
+	for (; t < 60; t++)
+		SSE2_ROUND(F_MAJ, k, t);
+	k = _mm_set1_epi32(0xCA62C1D6);
+	for (; t < 80; t++)
+		SSE2_ROUND(F_PAR, k, t);
+
+	_mm_storeu_si128((__m128i *) st[0], _mm_add_epi32(a, sa));
+	_mm_storeu_si128((__m128i *) st[1], _mm_add_epi32(b, sb));
+	_mm_storeu_si128((__m128i *) st[2], _mm_add_epi32(c, sc));
+	_mm_storeu_si128((__m128i *) st[3], _mm_add_epi32(d, sd));
+	_mm_storeu_si128((__m128i *) st[4], _mm_add_epi32(e, se));
+}
+
+struct sha1_lane {
+	size_t		msg;		/* message index */
+	size_t		blk;		/* next block */
+	size_t		nfull;		/* blocks in the message data */
+	size_t		nblocks;	/* nfull + tail blocks */
+	unsigned char	tail[128];
+	unsigned int	active : 1;
+};
+
+/* every lane hashes one message, the finished lanes get the next message */
+static void sha1_multi_lanes(unsigned char (*digest)[UL_SHA1LENGTH],
+			     const unsigned char *const *data, const size_t *len, size_t n)
+{
+	static const unsigned char zero[64];
+	struct sha1_lane lanes[SHA1_LANES];
+	uint32_t st[5][SHA1_LANES];
+	size_t next = 0, i, j;
+
+	memset(lanes, 0, sizeof(lanes));
+
+	for (;;) {
+		const unsigned char *blk[SHA1_LANES];
+		int nactive = 0;
+
+		for (i = 0; i < SHA1_LANES; i++) {
+			struct sha1_lane *ln = &lanes[i];
+
+			if (!ln->active && next < n) {
+				ln->msg = next++;
+				ln->blk = 0;
+				ln->nfull = len[ln->msg] / 64;
+				ln->nblocks = ln->nfull + sha1_tail(ln->tail,
+						data[ln->msg], len[ln->msg]);
+				ln->active = 1;
+				for (j = 0; j < 5; j++)
+					st[j][i] = sha1_iv[j];
+			}
+			if (!ln->active)
+				blk[i] = zero;
+			else if (ln->blk < ln->nfull)
+				blk[i] = data[ln->msg] + ln->blk * 64;
+			else
+				blk[i] = ln->tail + (ln->blk - ln->nfull) * 64;
+			nactive += ln->active;
+		}
+		if (!nactive)
+			break;
+
+		sha1_x4(st, blk);
+
+		for (i = 0; i < SHA1_LANES; i++) {
+			struct sha1_lane *ln = &lanes[i];
+			uint32_t state[5];
+
+			if (!ln->active || ++ln->blk < ln->nblocks)
+				continue;
+			for (j = 0; j < 5; j++)
+				state[j] = st[j][i];
+			sha1_digest(digest[ln->msg], state);
+			ln->active = 0;
+		}
+	}
+}
+#endif /* HAVE_SHA1_SSE2 */
+
+/*
+ * Hashes @n independent messages @data of @len bytes to @digest. The
+ * messages are hashed in parallel if the CPU has no SHA instructions (the
+ * instructions are faster for one message than the parallel lanes).
+ */
+void ul_SHA1Multi(unsigned char (*digest)[UL_SHA1LENGTH],
+		  const unsigned char *const *data, const size_t *len, size_t n)
+{
+	unsigned char tail[128];
+	size_t i;
+
+	if (sha1_blocks == sha1_blocks_dispatch)
+		sha1_blocks_dispatch(NULL, NULL, 0);
+
+#ifdef HAVE_SHA1_SSE2
+	if (!sha1_has_insn && n > 1) {
+		sha1_multi_lanes(digest, data, len, n);
+		return;
+	}
+#endif
+	for (i = 0; i < n; i++) {
+		uint32_t state[5];
+		size_t ntail = sha1_tail(tail, data[i], len[i]);
+
+		memcpy(state, sha1_iv, sizeof(state));
+		if (len[i] >= 64)
+			sha1_blocks(state, data[i], len[i] / 64);
+		sha1_blocks(state, tail, ntail);
+		sha1_digest(digest[i], state);
+	}
+}
+
+#ifdef TEST_PROGRAM_SHA1
+#include <stdlib.h>
+#include <time.h>
+#include "c.h"
+
+#define TEST_NMSGS	1000
+
+static void sha1_single(unsigned char (*digest)[UL_SHA1LENGTH],
+			const unsigned char *const *data, const size_t *len, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		UL_SHA1_CTX ctx;
+
+		ul_SHA1Init(&ctx);
+		ul_SHA1Update(&ctx, data[i], len[i]);
+		ul_SHA1Final(digest[i], &ctx);
+	}
+}
+
+static double bench(void (*fn)(unsigned char (*)[UL_SHA1LENGTH],
+			       const unsigned char *const *, const size_t *, size_t),
+		    unsigned char (*digest)[UL_SHA1LENGTH],
+		    const unsigned char *const *data, const size_t *len, size_t n)
+{
+	struct timespec a, b;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	fn(digest, data, len, n);
+	clock_gettime(CLOCK_MONOTONIC, &b);
+
+	return (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char (*ref)[UL_SHA1LENGTH], (*res)[UL_SHA1LENGTH];
+	const unsigned char **data;
+	unsigned char *buf;
+	size_t *len, i, n = TEST_NMSGS;
+	int errors = 0;
+
+	if (argc > 2 && strcmp(argv[1], "--bench") == 0)
+		n = strtoul(argv[2], NULL, 10);
+	if (n < TEST_NMSGS)
+		n = TEST_NMSGS;
+
+	buf = malloc(n + 512);
+	data = malloc(n * sizeof(*data));
+	len = malloc(n * sizeof(*len));
+	ref = malloc(n * sizeof(*ref));
+	res = malloc(n * sizeof(*res));
+	if (!buf || !data || !len || !ref || !res)
+		err(EXIT_FAILURE, "malloc failed");
+
+	srandom(1);
+	for (i = 0; i < n + 512; i++)
+		buf[i] = random();
+
+	/* all lengths around the padding boundaries, then random */
+	for (i = 0; i < TEST_NMSGS; i++) {
+		data[i] = buf + i;
+		len[i] = i < 300 ? i : (size_t) random() % 512;
+	}
+	sha1_single(ref, data, len, TEST_NMSGS);
+
+	/* the dispatched blocks function and the generic code */
+	for (i = 1; i < 5; i++) {
+		uint32_t a[5], b[5];
+
+		memcpy(a, sha1_iv, sizeof(a));
+		memcpy(b, sha1_iv, sizeof(b));
+		sha1_blocks(a, buf + i, i);
+		sha1_blocks_sw(b, buf + i, i);
+		if (memcmp(a, b, sizeof(a)) != 0)
+			errors++;
+	}
+
+	for (i = 0; i <= TEST_NMSGS; i += TEST_NMSGS / 4 - 1) {
+		memset(res, 0, TEST_NMSGS * sizeof(*res));
+		ul_SHA1Multi(res + i, data + i, len + i, TEST_NMSGS - i);
+		if (memcmp(ref + i, res + i, (TEST_NMSGS - i) * sizeof(*res)) != 0)
+			errors++;
+#ifdef HAVE_SHA1_SSE2
+		memset(res, 0, TEST_NMSGS * sizeof(*res));
+		sha1_multi_lanes(res + i, data + i, len + i, TEST_NMSGS - i);
+		if (memcmp(ref + i, res + i, (TEST_NMSGS - i) * sizeof(*res)) != 0)
+			errors++;
+#endif
+	}
+	printf("sha1:   %s\nverify: %s\n", ul_SHA1_get_impl(),
+			errors ? "FAILED" : "OK");
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		/* name-based UUIDs, namespace + name */
+		for (i = 0; i < n; i++) {
+			data[i] = buf + (i % 512);
+			len[i] = 16 + 8 + random() % 32;
+		}
+		printf("messages per second, %zu messages of %d-%d bytes\n", n, 24, 55);
+		printf("%-10s %12.0f\n", "single", n / bench(sha1_single, res, data, len, n));
+		printf("%-10s %12.0f\n", "multi", n / bench(ul_SHA1Multi, res, data, len, n));
+#ifdef HAVE_SHA1_SSE2
+		printf("%-10s %12.0f\n", "sse2-x4", n / bench(sha1_multi_lanes, res, data, len, n));
+#endif
+	}
+
+	free(buf);
+	free(data);
+	free(len);
+	free(ref);
+	free(res);
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif /* TEST_PROGRAM_SHA1 */
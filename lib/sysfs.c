@@ -379,17 +379,111 @@ static char *get_subsystem(char *chain, char *buf, size_t bufsz)
 	return NULL;
 }
 
+/*
+ * Per-thread cache for the wholedisk and devchain resolution. The same
+ * devices are resolved again and again (libblkid topology, fstrim, lsblk,
+ * partx, ...) and every resolution requires readlink(), dm lookups, etc.
+ *
+ * The cache is invalidated when the kernel uevent sequence number is changed,
+ * it means after any device add, remove or change. The sequence number is
+ * read before the resolution, so a change during the resolution invalidates
+ * the result for the next call. Paths with prefix (sysfs dumps) are never
+ * cached.
+ */
+#ifdef HAVE_TLS
+# define SYSFS_CACHE_SIZE	16
+
+struct sysfs_cache_entry {
+	dev_t		devno;
+	dev_t		disk;		/* wholedisk devno */
+	char		*diskname;	/* wholedisk name */
+	char		*devchain;	/* sysfs_blkdev_get_devchain() result */
+};
+
+static __thread struct sysfs_cache_entry sysfs_cache[SYSFS_CACHE_SIZE];
+static __thread size_t sysfs_cache_next;
+static __thread uint64_t sysfs_cache_seqnum;
+
+static void sysfs_cache_reset_entry(struct sysfs_cache_entry *ce)
+{
+	free(ce->diskname);
+	free(ce->devchain);
+	memset(ce, 0, sizeof(*ce));
+}
+
+/*
+ * Returns cache entry for @devno. The new entry is allocated if @create is
+ * non-zero. Returns NULL if the cache cannot be used.
+ */
+static struct sysfs_cache_entry *sysfs_cache_get(struct path_cxt *pc,
+						 dev_t devno, int create)
+{
+	struct sysfs_cache_entry *ce;
+	uint64_t seqnum;
+	size_t i;
+
+	if (!devno || (pc && ul_path_get_prefix(pc)))
+		return NULL;
+	if (ul_path_read_u64(NULL, &seqnum, _PATH_SYS_UEVENT_SEQNUM) != 0)
+		return NULL;
+
+	if (seqnum != sysfs_cache_seqnum) {
+		DBG(CXT, ul_debug("cache: reset (uevent seqnum %ju)", (uintmax_t) seqnum));
+		for (i = 0; i < SYSFS_CACHE_SIZE; i++)
+			sysfs_cache_reset_entry(&sysfs_cache[i]);
+		sysfs_cache_seqnum = seqnum;
+		sysfs_cache_next = 0;
+	}
+
+	for (i = 0; i < SYSFS_CACHE_SIZE; i++) {
+		if (sysfs_cache[i].devno == devno)
+			return &sysfs_cache[i];
+	}
+	if (!create)
+		return NULL;
+
+	ce = &sysfs_cache[sysfs_cache_next++ % SYSFS_CACHE_SIZE];
+	sysfs_cache_reset_entry(ce);
+	ce->devno = devno;
+	return ce;
+}
+
+static int sysfs_cache_get_wholedisk(struct sysfs_cache_entry *ce,
+				     char *diskname, size_t len, dev_t *diskdevno)
+{
+	if (!ce || !ce->diskname)
+		return 1;
+	if (diskname && len) {
+		if (strlen(ce->diskname) >= len)
+			return -1;
+		xstrncpy(diskname, ce->diskname, len);
+	}
+	if (diskdevno)
+		*diskdevno = ce->disk;
+	return 0;
+}
+#endif /* HAVE_TLS */
+
 /*
  * Returns complete path to the device, the patch contains all subsystems
  * used for the device.
  */
 char *sysfs_blkdev_get_devchain(struct path_cxt *pc, char *buf, size_t bufsz)
 {
-	/* read /sys/dev/block/<maj>:<min> symlink */
-	ssize_t sz = ul_path_readlink(pc, buf, bufsz, NULL);
+	ssize_t sz;
 	const char *prefix;
 	size_t psz = 0;
+#ifdef HAVE_TLS
+	struct sysfs_cache_entry *ce = sysfs_cache_get(pc, sysfs_blkdev_get_devno(pc), 1);
 
+	if (ce && ce->devchain) {
+		if (strlen(ce->devchain) + 1 > bufsz)
+			return NULL;
+		return strcpy(buf, ce->devchain);
+	}
+#endif
+	/* read /sys/dev/block/<maj>:<min> symlink */
+	sz = ul_path_readlink(pc, buf, bufsz, NULL);
 	if (sz <= 0 || sz + sizeof(_PATH_SYS_DEVBLOCK "/") > bufsz)
 		return NULL;
 
@@ -404,6 +498,10 @@ char *sysfs_blkdev_get_devchain(struct path_cxt *pc, char *buf, size_t bufsz)
 		memcpy(buf, prefix, psz);
 
 	memcpy(buf + psz, _PATH_SYS_DEVBLOCK "/", sizeof(_PATH_SYS_DEVBLOCK "/") - 1);
+#ifdef HAVE_TLS
+	if (ce)
+		ce->devchain = strdup(buf);
+#endif
 	return buf;
 }
 
@@ -503,14 +601,10 @@ static int get_dm_wholedisk(struct path_cxt *pc, char *diskname,
     return rc;
 }
 
-/*
- * Returns by @diskdevno whole disk device devno and (optionally) by
- * @diskname the whole disk device name.
- */
-int sysfs_blkdev_get_wholedisk(	struct path_cxt *pc,
-				char *diskname,
-				size_t len,
-				dev_t *diskdevno)
+static int __get_wholedisk(struct path_cxt *pc,
+			   char *diskname,
+			   size_t len,
+			   dev_t *diskdevno)
 {
     int is_part = 0;
 
@@ -594,6 +688,38 @@ err:
     return -1;
 }
 
+/*
+ * Returns by @diskdevno whole disk device devno and (optionally) by
+ * @diskname the whole disk device name.
+ */
+int sysfs_blkdev_get_wholedisk(	struct path_cxt *pc,
+				char *diskname,
+				size_t len,
+				dev_t *diskdevno)
+{
+#ifdef HAVE_TLS
+	struct sysfs_cache_entry *ce;
+	char name[NAME_MAX + 1];
+	dev_t disk = 0;
+	int rc;
+
+	if (!pc)
+		return -1;
+
+	ce = sysfs_cache_get(pc, sysfs_blkdev_get_devno(pc), 1);
+	if (ce && !ce->diskname) {
+		if (__get_wholedisk(pc, name, sizeof(name), &disk) != 0)
+			return -1;
+		ce->disk = disk;
+		ce->diskname = strdup(name);
+	}
+	rc = sysfs_cache_get_wholedisk(ce, diskname, len, diskdevno);
+	if (rc <= 0)
+		return rc;
+#endif
+	return __get_wholedisk(pc, diskname, len, diskdevno);
+}
+
 int sysfs_devno_to_wholedisk(dev_t devno, char *diskname,
 		             size_t len, dev_t *diskdevno)
 {
@@ -602,6 +728,13 @@ int sysfs_devno_to_wholedisk(dev_t devno, char *diskname,
 
 	if (!devno)
 		return -EINVAL;
+#ifdef HAVE_TLS
+	/* don't open the sysfs directory at all if cached */
+	rc = sysfs_cache_get_wholedisk(sysfs_cache_get(NULL, devno, 0),
+				       diskname, len, diskdevno);
+	if (rc <= 0)
+		return rc;
+#endif
 	pc = ul_new_sysfs_path(devno, NULL, NULL);
 	if (!pc)
 		return -ENOMEM;
@@ -406,64 +406,77 @@ int get_gmtoff(const struct tm *tp)
 #endif
 }
 
-static int format_iso_time(struct tm *tm, suseconds_t usec, int flags, char *buf, size_t bufsz)
+/* as sprintf("%0*u", width, num) */
+static char *put_digits(char *p, unsigned int num, int width)
 {
-	char *p = buf;
-	int len;
+	int i;
+
+	for (i = width - 1; i >= 0; i--) {
+		p[i] = '0' + num % 10;
+		num /= 10;
+	}
+	return p + width;
+}
+
+static int format_iso_time(const struct tm *tm, long usec, int gmtoff, int flags,
+			   char *buf, size_t bufsz)
+{
+	char tmp[64], *p = tmp;
+	size_t len;
 
 	if (flags & ISO_DATE) {
-		len = snprintf(p, bufsz, "%4ld-%.2d-%.2d",
-			       tm->tm_year + (long) 1900,
-			       tm->tm_mon + 1, tm->tm_mday);
-		if (len < 0 || (size_t) len > bufsz)
-			goto err;
-		bufsz -= len;
-		p += len;
+		long year = tm->tm_year + 1900L;
+
+		if (year >= 1000 && year <= 9999)
+			p = put_digits(p, year, 4);
+		else
+			p += sprintf(p, "%4ld", year);
+		*p++ = '-';
+		p = put_digits(p, tm->tm_mon + 1, 2);
+		*p++ = '-';
+		p = put_digits(p, tm->tm_mday, 2);
 	}
 
-	if ((flags & ISO_DATE) && (flags & ISO_TIME)) {
-		if (bufsz < 1)
-			goto err;
+	if ((flags & ISO_DATE) && (flags & ISO_TIME))
 		*p++ = (flags & ISO_T) ? 'T' : ' ';
-		bufsz--;
-	}
 
 	if (flags & ISO_TIME) {
-		len = snprintf(p, bufsz, "%02d:%02d:%02d", tm->tm_hour,
-			       tm->tm_min, tm->tm_sec);
-		if (len < 0 || (size_t) len > bufsz)
-			goto err;
-		bufsz -= len;
-		p += len;
+		p = put_digits(p, tm->tm_hour, 2);
+		*p++ = ':';
+		p = put_digits(p, tm->tm_min, 2);
+		*p++ = ':';
+		p = put_digits(p, tm->tm_sec, 2);
 	}
 
-	if (flags & ISO_DOTUSEC) {
-		len = snprintf(p, bufsz, ".%06ld", (long) usec);
-		if (len < 0 || (size_t) len > bufsz)
-			goto err;
-		bufsz -= len;
-		p += len;
-
-	} else if (flags & ISO_COMMAUSEC) {
-		len = snprintf(p, bufsz, ",%06ld", (long) usec);
-		if (len < 0 || (size_t) len > bufsz)
-			goto err;
-		bufsz -= len;
-		p += len;
+	if (flags & (ISO_DOTUSEC | ISO_COMMAUSEC)) {
+		*p++ = (flags & ISO_DOTUSEC) ? '.' : ',';
+		if (usec >= 0 && usec < 1000000)
+			p = put_digits(p, usec, 6);
+		else
+			p += sprintf(p, "%06ld", usec);
 	}
 
 	if (flags & ISO_TIMEZONE) {
-		int tmin  = get_gmtoff(tm) / 60;
-		int zhour = tmin / 60;
-		int zmin  = abs(tmin % 60);
-		len = snprintf(p, bufsz, "%+03d:%02d", zhour,zmin);
-		if (len < 0 || (size_t) len > bufsz)
-			goto err;
+		int tmin = gmtoff / 60;
+
+		*p++ = tmin < 0 ? '-' : '+';
+		tmin = abs(tmin);
+		if (tmin / 60 < 100)
+			p = put_digits(p, tmin / 60, 2);
+		else
+			p += sprintf(p, "%d", tmin / 60);
+		*p++ = ':';
+		p = put_digits(p, tmin % 60, 2);
+	}
+
+	len = p - tmp;
+	if (len >= bufsz) {
+		warnx(_("format_iso_time: buffer overflow."));
+		return -1;
 	}
+	memcpy(buf, tmp, len);
+	buf[len] = '\0';
 	return 0;
- err:
-	warnx(_("format_iso_time: buffer overflow."));
-	return -1;
 }
 
 /* timeval to ISO 8601 */
@@ -478,7 +491,8 @@ int strtimeval_iso(struct timeval *tv, int flags, char *buf, size_t bufsz)
 		rc = localtime_r(&tv->tv_sec, &tm);
 
 	if (rc)
-		return format_iso_time(&tm, tv->tv_usec, flags, buf, bufsz);
+		return format_iso_time(&tm, tv->tv_usec, get_gmtoff(&tm),
+				       flags, buf, bufsz);
 
 	warnx(_("time %ld is out of range."), tv->tv_sec);
 	return -1;
@@ -487,7 +501,7 @@ int strtimeval_iso(struct timeval *tv, int flags, char *buf, size_t bufsz)
 /* struct tm to ISO 8601 */
 int strtm_iso(struct tm *tm, int flags, char *buf, size_t bufsz)
 {
-	return format_iso_time(tm, 0, flags, buf, bufsz);
+	return format_iso_time(tm, 0, get_gmtoff(tm), flags, buf, bufsz);
 }
 
 /* time_t to ISO 8601 */
@@ -502,7 +516,7 @@ int strtime_iso(const time_t *t, int flags, char *buf, size_t bufsz)
 		rc = localtime_r(t, &tm);
 
 	if (rc)
-		return format_iso_time(&tm, 0, flags, buf, bufsz);
+		return format_iso_time(&tm, 0, get_gmtoff(&tm), flags, buf, bufsz);
 
 	warnx(_("time %ld is out of range."), (long)t);
 	return -1;
@@ -550,6 +564,180 @@ int strtime_short(const time_t *t, struct timeval *now, int flags, char *buf, si
 	return rc <= 0 ? -1 : 0;
 }
 
+static inline int tm_daysec(const struct tm *tm)
+{
+	return tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec;
+}
+
+/*
+ * Returns 1 if all the times in [@start, @end) are calculable from @tm (the
+ * time of @start) and the @gmtoff, that is, there is no DST change and no
+ * leap second in the interval.
+ */
+static int timecache_is_linear(const struct tm *tm, time_t start, time_t end,
+			       int gmtoff, int gmt)
+{
+	struct tm x, y, z;
+
+	if (gmt ? !gmtime_r(&start, &x) || !gmtime_r(&(time_t) { end - 1 }, &y)
+		  || !gmtime_r(&end, &z)
+		: !localtime_r(&start, &x) || !localtime_r(&(time_t) { end - 1 }, &y)
+		  || !localtime_r(&end, &z))
+		return 0;
+
+	return get_gmtoff(&x) == gmtoff && get_gmtoff(&y) == gmtoff
+	       && x.tm_year == tm->tm_year && x.tm_yday == tm->tm_yday
+	       && tm_daysec(&x) == tm_daysec(tm)
+	       && y.tm_year == tm->tm_year && y.tm_yday == tm->tm_yday
+	       && tm_daysec(&y) == tm_daysec(tm) + (end - 1 - start)
+	       /* the next interval starts at @end */
+	       && z.tm_sec < 60 && tm_daysec(&z) == (tm_daysec(tm) + (end - start)) % (24 * 3600);
+}
+
+static int timecache_fill(struct ul_timecache *tc, time_t t, int gmt)
+{
+	struct tm tm;
+	int gmtoff;
+
+	if (gmt ? !gmtime_r(&t, &tm) : !localtime_r(&t, &tm))
+		return -1;
+
+	gmtoff = gmt ? 0 : get_gmtoff(&tm);
+	tc->valid = 0;
+
+	/* the whole day */
+	tc->tm = tm;
+	tc->tm.tm_hour = tc->tm.tm_min = tc->tm.tm_sec = 0;
+	tc->start = t - tm_daysec(&tm);
+	tc->end = tc->start + 24 * 3600;
+
+	/* DST change or leap second in the day, the minute or the second */
+	if (tm.tm_sec > 59
+	    || !timecache_is_linear(&tc->tm, tc->start, tc->end, gmtoff, gmt)) {
+		tc->tm = tm;
+		tc->tm.tm_sec = 0;
+		tc->start = t - tm.tm_sec;
+		tc->end = tc->start + 60;
+
+		if (tm.tm_sec > 59
+		    || !timecache_is_linear(&tc->tm, tc->start, tc->end, gmtoff, gmt)) {
+			tc->tm = tm;
+			tc->start = t;
+			tc->end = t + 1;
+		}
+	}
+
+	tc->gmtoff = gmtoff;
+	tc->gmtime = gmt ? 1 : 0;
+	tc->valid = 1;
+	*tc->shortdate = '\0';
+	return 0;
+}
+
+/*
+ * Returns localtime_r() (or gmtime_r() if @gmt is non-zero) of @t in @tm, the
+ * result is calculated from the cached interval if possible.
+ */
+int ul_timecache_tm(struct ul_timecache *tc, time_t t, int gmt, struct tm *tm)
+{
+	int sec;
+
+	if (!tc->valid || tc->gmtime != (gmt ? 1 : 0)
+	    || t < tc->start || t >= tc->end) {
+		if (timecache_fill(tc, t, gmt) != 0)
+			return -1;
+	}
+
+	*tm = tc->tm;
+	if (t != tc->start) {
+		sec = tm_daysec(tm) + (t - tc->start);
+		tm->tm_hour = sec / 3600;
+		tm->tm_min = sec / 60 % 60;
+		tm->tm_sec = sec % 60;
+	}
+	return 0;
+}
+
+/* as strtimeval_iso(), but localtime_r() is cached */
+int strtimeval_iso_cached(struct ul_timecache *tc, const struct timeval *tv,
+			  int flags, char *buf, size_t bufsz)
+{
+	struct tm tm;
+
+	if (ul_timecache_tm(tc, tv->tv_sec, flags & ISO_GMTIME, &tm) == 0)
+		return format_iso_time(&tm, tv->tv_usec, tc->gmtoff,
+				       flags, buf, bufsz);
+
+	warnx(_("time %ld is out of range."), tv->tv_sec);
+	return -1;
+}
+
+/* as strtime_iso(), but localtime_r() is cached */
+int strtime_iso_cached(struct ul_timecache *tc, const time_t *t,
+		       int flags, char *buf, size_t bufsz)
+{
+	struct tm tm;
+
+	if (ul_timecache_tm(tc, *t, flags & ISO_GMTIME, &tm) == 0)
+		return format_iso_time(&tm, 0, tc->gmtoff, flags, buf, bufsz);
+
+	warnx(_("time %ld is out of range."), (long) *t);
+	return -1;
+}
+
+/* as strtime_short(), but localtime_r() and strftime() are cached */
+int strtime_short_cached(struct ul_timecache *tc, const time_t *t, struct timeval *now,
+			 int flags, char *buf, size_t bufsz)
+{
+	char tmp[64], *p = tmp;
+	struct tm tm;
+	size_t len;
+
+	if (now->tv_sec == 0)
+		gettimeofday(now, NULL);
+
+	if (!tc->nowvalid || tc->now != now->tv_sec) {
+		if (!localtime_r(&now->tv_sec, &tc->tmnow))
+			return -1;
+		tc->now = now->tv_sec;
+		tc->nowvalid = 1;
+	}
+	if (ul_timecache_tm(tc, *t, 0, &tm) != 0)
+		return -1;
+
+	if (time_is_today(&tm, &tc->tmnow)) {
+		p = put_digits(p, tm.tm_hour, 2);
+		*p++ = ':';
+		p = put_digits(p, tm.tm_min, 2);
+	} else {
+		/* the same date for the whole cached interval */
+		if (!*tc->shortdate
+		    && strftime(tc->shortdate, sizeof(tc->shortdate), "%b%d", &tm) == 0)
+			return -1;
+
+		if (!time_is_thisyear(&tm, &tc->tmnow))
+			p += sprintf(p, "%ld-", tm.tm_year + 1900L);
+		len = strlen(tc->shortdate);
+		memcpy(p, tc->shortdate, len);
+		p += len;
+
+		if (time_is_thisyear(&tm, &tc->tmnow)
+		    && (flags & UL_SHORTTIME_THISYEAR_HHMM)) {
+			*p++ = '/';
+			p = put_digits(p, tm.tm_hour, 2);
+			*p++ = ':';
+			p = put_digits(p, tm.tm_min, 2);
+		}
+	}
+
+	len = p - tmp;
+	if (len >= bufsz)
+		return -1;
+	memcpy(buf, tmp, len);
+	buf[len] = '\0';
+	return 0;
+}
+
 #ifndef HAVE_TIMEGM
 time_t timegm(struct tm *tm)
 {
@@ -570,16 +758,56 @@ time_t timegm(struct tm *tm)
 
 #ifdef TEST_PROGRAM_TIMEUTILS
 
+/* compares the cached and not cached functions for @count times after @t */
+static int test_timecache(time_t t, long count, long step)
+{
+	struct ul_timecache tc = { 0 }, gtc = { 0 }, stc = { 0 };
+	struct timeval now = { .tv_sec = t + count * step / 2 };
+	char a[ISO_BUFSIZ], b[ISO_BUFSIZ];
+	long i, bad = 0;
+
+	for (i = 0; i < count; i++, t += step) {
+		struct timeval tv = { .tv_sec = t, .tv_usec = i % 1000000 };
+
+		strtimeval_iso(&tv, ISO_TIMESTAMP_COMMA_T, a, sizeof(a));
+		strtimeval_iso_cached(&tc, &tv, ISO_TIMESTAMP_COMMA_T, b, sizeof(b));
+		if (strcmp(a, b) != 0) {
+			printf("%ld: '%s' != '%s'\n", (long) t, a, b);
+			bad++;
+		}
+		strtime_iso(&t, ISO_TIMESTAMP_COMMA_GT, a, sizeof(a));
+		strtime_iso_cached(&gtc, &t, ISO_TIMESTAMP_COMMA_GT, b, sizeof(b));
+		if (strcmp(a, b) != 0) {
+			printf("%ld: '%s' != '%s' (gmtime)\n", (long) t, a, b);
+			bad++;
+		}
+		strtime_short(&t, &now, UL_SHORTTIME_THISYEAR_HHMM, a, sizeof(a));
+		strtime_short_cached(&stc, &t, &now, UL_SHORTTIME_THISYEAR_HHMM, b, sizeof(b));
+		if (strcmp(a, b) != 0) {
+			printf("%ld: '%s' != '%s' (short)\n", (long) t, a, b);
+			bad++;
+		}
+	}
+	printf("cache: %s\n", bad ? "FAILED" : "OK");
+	return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
 	struct timeval tv = { 0 };
 	char buf[ISO_BUFSIZ];
 
 	if (argc < 2) {
-		fprintf(stderr, "usage: %s [<time> [<usec>]] | [--timestamp <str>]\n", argv[0]);
+		fprintf(stderr, "usage: %s [<time> [<usec>]] | [--timestamp <str>]\n"
+				"       %s --cache <time> <count> <step>\n", argv[0], argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
+	if (strcmp(argv[1], "--cache") == 0 && argc == 5)
+		return test_timecache(strtos64_or_err(argv[2], "failed to parse <time>"),
+				      strtos64_or_err(argv[3], "failed to parse <count>"),
+				      strtos64_or_err(argv[4], "failed to parse <step>"));
+
 	if (strcmp(argv[1], "--timestamp") == 0) {
 		usec_t usec;
 
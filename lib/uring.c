@@ -0,0 +1,346 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * Minimal io_uring wrapper for batched reads and writes. The wrapper does not
+ * depend on liburing, it uses raw syscalls and kernel headers only. All the
+ * functions return -ENOSYS if io_uring is not supported by the build or by
+ * the kernel (and the caller is expected to fallback to the classic I/O).
+ */
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+# include <linux/io_uring.h>
+#endif
+
+#include "c.h"
+#include "uring.h"
+
+/* IORING_OP_READ and IORING_OP_WRITE are available since the same kernel
+ * version as IORING_FEAT_RW_CUR_POS (v5.6) */
+#if defined(HAVE_LINUX_IO_URING_H) && defined(SYS_io_uring_setup) \
+    && defined(SYS_io_uring_enter) && defined(IORING_FEAT_RW_CUR_POS)
+# define HAVE_UL_URING 1
+#endif
+
+#ifdef HAVE_UL_URING
+
+static inline unsigned int load_acquire(unsigned int *p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(unsigned int *p, unsigned int v)
+{
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+int ul_uring_init(struct ul_uring *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+	int fd;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+	ring->fd = -1;
+
+	fd = syscall(SYS_io_uring_setup, entries, &p);
+	if (fd < 0)
+		return -errno;
+
+	ring->fd = fd;
+	ring->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ring->sq_sz = ring->cq_sz = max(ring->sq_sz, ring->cq_sz);
+
+	ring->sq_ptr = mmap(NULL, ring->sq_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED) {
+		ring->sq_ptr = NULL;
+		goto err;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_ptr = ring->sq_ptr;
+	else {
+		ring->cq_ptr = mmap(NULL, ring->cq_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED) {
+			ring->cq_ptr = NULL;
+			goto err;
+		}
+	}
+
+	ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto err;
+	}
+
+	ring->sq_head = (unsigned int *) ((char *) ring->sq_ptr + p.sq_off.head);
+	ring->sq_tail = (unsigned int *) ((char *) ring->sq_ptr + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *) ((char *) ring->sq_ptr + p.sq_off.ring_mask);
+	ring->sq_entries = (unsigned int *) ((char *) ring->sq_ptr + p.sq_off.ring_entries);
+	ring->sq_array = (unsigned int *) ((char *) ring->sq_ptr + p.sq_off.array);
+
+	ring->cq_head = (unsigned int *) ((char *) ring->cq_ptr + p.cq_off.head);
+	ring->cq_tail = (unsigned int *) ((char *) ring->cq_ptr + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *) ((char *) ring->cq_ptr + p.cq_off.ring_mask);
+	ring->cqes = (char *) ring->cq_ptr + p.cq_off.cqes;
+
+	return 0;
+err:
+	fd = -errno;
+	ul_uring_deinit(ring);
+	return fd;
+}
+
+void ul_uring_deinit(struct ul_uring *ring)
+{
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_sz);
+	if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_sz);
+	if (ring->sq_ptr)
+		munmap(ring->sq_ptr, ring->sq_sz);
+	if (ring->fd >= 0)
+		close(ring->fd);
+
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+int ul_uring_is_ready(struct ul_uring *ring)
+{
+	return ring->fd >= 0 && ring->sqes;
+}
+
+/*
+ * Adds a new read or write request to the submission queue. The request is
+ * not sent to the kernel before ul_uring_submit(). Returns -EAGAIN if the
+ * queue is full.
+ */
+int ul_uring_prep_rw(struct ul_uring *ring, int op, int fd,
+		     void *buf, size_t len, uint64_t off,
+		     uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int tail, idx;
+
+	if (!ul_uring_is_ready(ring))
+		return -ENOSYS;
+
+	tail = *ring->sq_tail + ring->sq_pending;
+	if (tail - load_acquire(ring->sq_head) >= *ring->sq_entries)
+		return -EAGAIN;
+
+	idx = tail & *ring->sq_mask;
+	sqe = (struct io_uring_sqe *) ring->sqes + idx;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op == UL_URING_WRITE ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t) buf;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = user_data;
+
+	ring->sq_array[idx] = idx;
+	ring->sq_pending++;
+	return 0;
+}
+
+/*
+ * Sends all prepared requests to the kernel and waits for at least @wait_nr
+ * completions. Returns number of submitted requests or negative errno.
+ */
+int ul_uring_submit(struct ul_uring *ring, unsigned int wait_nr)
+{
+	unsigned int n = ring->sq_pending;
+	int rc;
+
+	if (!ul_uring_is_ready(ring))
+		return -ENOSYS;
+
+	store_release(ring->sq_tail, *ring->sq_tail + n);
+	ring->sq_pending = 0;
+
+	do {
+		rc = syscall(SYS_io_uring_enter, ring->fd, n, wait_nr,
+			     wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (rc < 0 && errno == EINTR);
+
+	return rc < 0 ? -errno : rc;
+}
+
+/*
+ * Returns 1 and result of the next completed request, or 0 if there is no
+ * completed request.
+ */
+int ul_uring_get_completion(struct ul_uring *ring, uint64_t *user_data, int *res)
+{
+	struct io_uring_cqe *cqe;
+	unsigned int head;
+
+	if (!ul_uring_is_ready(ring))
+		return -ENOSYS;
+
+	head = *ring->cq_head;
+	if (head == load_acquire(ring->cq_tail))
+		return 0;
+
+	cqe = (struct io_uring_cqe *) ring->cqes + (head & *ring->cq_mask);
+	if (user_data)
+		*user_data = cqe->user_data;
+	if (res)
+		*res = cqe->res;
+
+	store_release(ring->cq_head, head + 1);
+	return 1;
+}
+
+/*
+ * Returns 1 and result of the next completed request, waits for it if there
+ * is no completed request yet. Returns negative errno on error.
+ */
+int ul_uring_wait_completion(struct ul_uring *ring, uint64_t *user_data, int *res)
+{
+	int rc;
+
+	if (!ul_uring_is_ready(ring))
+		return -ENOSYS;
+
+	while ((rc = ul_uring_get_completion(ring, user_data, res)) == 0) {
+		rc = syscall(SYS_io_uring_enter, ring->fd, 0, 1,
+			     IORING_ENTER_GETEVENTS, NULL, 0);
+		if (rc < 0 && errno != EINTR)
+			return -errno;
+	}
+	return rc;
+}
+
+#else /* !HAVE_UL_URING */
+
+int ul_uring_init(struct ul_uring *ring, unsigned int entries __attribute__((__unused__)))
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+	return -ENOSYS;
+}
+
+void ul_uring_deinit(struct ul_uring *ring)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+int ul_uring_is_ready(struct ul_uring *ring __attribute__((__unused__)))
+{
+	return 0;
+}
+
+int ul_uring_prep_rw(struct ul_uring *ring __attribute__((__unused__)),
+		     int op __attribute__((__unused__)),
+		     int fd __attribute__((__unused__)),
+		     void *buf __attribute__((__unused__)),
+		     size_t len __attribute__((__unused__)),
+		     uint64_t off __attribute__((__unused__)),
+		     uint64_t user_data __attribute__((__unused__)))
+{
+	return -ENOSYS;
+}
+
+int ul_uring_submit(struct ul_uring *ring __attribute__((__unused__)),
+		    unsigned int wait_nr __attribute__((__unused__)))
+{
+	return -ENOSYS;
+}
+
+int ul_uring_get_completion(struct ul_uring *ring __attribute__((__unused__)),
+		    uint64_t *user_data __attribute__((__unused__)),
+		    int *res __attribute__((__unused__)))
+{
+	return -ENOSYS;
+}
+
+int ul_uring_wait_completion(struct ul_uring *ring __attribute__((__unused__)),
+		    uint64_t *user_data __attribute__((__unused__)),
+		    int *res __attribute__((__unused__)))
+{
+	return -ENOSYS;
+}
+
+#endif /* HAVE_UL_URING */
+
+#ifdef TEST_PROGRAM_URING
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+#define TEST_CHUNK	4096
+#define TEST_NCHUNKS	8
+
+int main(int argc, char *argv[])
+{
+	struct ul_uring ring;
+	char *buf, cmp[TEST_CHUNK];
+	int fd, rc, i, res, n = 0;
+	uint64_t id;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0)
+		err(EXIT_FAILURE, "open failed: %s", argv[1]);
+
+	rc = ul_uring_init(&ring, TEST_NCHUNKS);
+	if (rc) {
+		printf("io_uring not available: %s\n", strerror(-rc));
+		return EXIT_SUCCESS;
+	}
+
+	buf = malloc(TEST_CHUNK * TEST_NCHUNKS);
+	if (!buf)
+		err(EXIT_FAILURE, "malloc failed");
+
+	/* read chunks in reverse order */
+	for (i = TEST_NCHUNKS - 1; i >= 0; i--) {
+		rc = ul_uring_prep_rw(&ring, UL_URING_READ, fd,
+				buf + i * TEST_CHUNK, TEST_CHUNK,
+				(uint64_t) i * TEST_CHUNK, i);
+		if (rc)
+			errx(EXIT_FAILURE, "prepare failed: %s", strerror(-rc));
+	}
+
+	rc = ul_uring_submit(&ring, TEST_NCHUNKS);
+	if (rc < 0)
+		errx(EXIT_FAILURE, "submit failed: %s", strerror(-rc));
+
+	while (n < rc && ul_uring_wait_completion(&ring, &id, &res) == 1) {
+		ssize_t len = pread(fd, cmp, TEST_CHUNK, (off_t) id * TEST_CHUNK);
+
+		printf("chunk %2ju: %d bytes %s\n", id, res,
+			len == res && (res <= 0 ||
+				memcmp(cmp, buf + id * TEST_CHUNK, res) == 0) ?
+				"OK" : "MISMATCH");
+		n++;
+	}
+
+	ul_uring_deinit(&ring);
+	free(buf);
+	close(fd);
+	return n == TEST_NCHUNKS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif /* TEST_PROGRAM_URING */
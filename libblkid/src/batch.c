@@ -0,0 +1,297 @@
+/*
+ * batch.c - probe more devices in parallel
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#include "blkidP.h"
+
+/**
+ * SECTION:batch
+ * @title: Batch probing
+ * @short_description: probe many devices by one call
+ *
+ * The low-level probing of one device is mostly waiting for I/O. The batch
+ * API probes independent devices by a pool of threads, every device is probed
+ * by a private #blkid_probe. The results are returned to the caller by a
+ * callback function.
+ *
+ * <informalexample>
+ *  <programlisting>
+ *	static int done(blkid_probe pr, const char *devname, int rc, void *data)
+ *	{
+ *		const char *type;
+ *
+ *		if (pr && rc == 0 &&
+ *		    blkid_probe_lookup_value(pr, "TYPE", &type, NULL) == 0)
+ *			printf("%s: %s\n", devname, type);
+ *		return 0;
+ *	}
+ *
+ *	blkid_probe_devices(devnames, ndevs, 0, BLKID_PROBEDEVS_ORDERED,
+ *			    NULL, done, NULL);
+ *  </programlisting>
+ * </informalexample>
+ */
+
+/* the device result for BLKID_PROBEDEVS_ORDERED */
+struct batch_result {
+	blkid_probe	pr;
+	int		rc;
+	unsigned int	finished : 1;
+};
+
+struct batch {
+	const char			**devnames;
+	size_t				ndevs;
+
+	blkid_probe_devices_probe	probe;
+	blkid_probe_devices_done	done;
+	void				*data;
+
+	pthread_mutex_t			lock;
+	size_t				next;	/* the next device to probe */
+	size_t				ndone;	/* the next device to return */
+	int				stop;	/* non-zero done() return code */
+
+	struct batch_result		*res;	/* for BLKID_PROBEDEVS_ORDERED */
+};
+
+/*
+ * Opens and probes @devname. Returns probing return code, or negative errno
+ * if the device is not accessible; @pr is NULL in this case.
+ */
+static int probe_one(struct batch *b, const char *devname, blkid_probe *pr)
+{
+	int fd, rc;
+
+	*pr = NULL;
+
+	fd = open(devname, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+	if (fd < 0)
+		return -errno;
+
+	*pr = blkid_new_probe();
+	if (!*pr) {
+		close(fd);
+		return -ENOMEM;
+	}
+
+	errno = 0;
+	if (blkid_probe_set_device(*pr, fd, 0, 0)) {
+		rc = errno ? -errno : -EINVAL;
+		close(fd);
+		blkid_free_probe(*pr);
+		*pr = NULL;
+		return rc;
+	}
+	(*pr)->flags |= BLKID_FL_PRIVATE_FD;
+
+	DBG(LOWPROBE, ul_debug("batch: probing %s", devname));
+
+	rc = b->probe ? b->probe(*pr, b->data) : blkid_do_safeprobe(*pr);
+	return rc;
+}
+
+/* returns result to the caller; the batch has to be locked */
+static void deliver_result(struct batch *b, size_t idx, blkid_probe pr, int rc)
+{
+	if (!b->stop)
+		b->stop = b->done(pr, b->devnames[idx], rc, b->data);
+	blkid_free_probe(pr);
+}
+
+static void *batch_worker(void *data)
+{
+	struct batch *b = (struct batch *) data;
+
+	pthread_mutex_lock(&b->lock);
+
+	while (!b->stop && b->next < b->ndevs) {
+		size_t idx = b->next++;
+		blkid_probe pr;
+		int rc;
+
+		pthread_mutex_unlock(&b->lock);
+		rc = probe_one(b, b->devnames[idx], &pr);
+		pthread_mutex_lock(&b->lock);
+
+		if (!b->res) {
+			deliver_result(b, idx, pr, rc);
+			continue;
+		}
+
+		/* keep the result until all the previous devices are returned */
+		if (pr) {
+			blkid_probe_reset_buffers(pr);
+			blkid_probe_free_buffers_pool(pr);
+		}
+		b->res[idx].pr = pr;
+		b->res[idx].rc = rc;
+		b->res[idx].finished = 1;
+
+		while (b->ndone < b->ndevs && b->res[b->ndone].finished) {
+			struct batch_result *r = &b->res[b->ndone];
+
+			deliver_result(b, b->ndone, r->pr, r->rc);
+			r->pr = NULL;
+			b->ndone++;
+		}
+	}
+
+	pthread_mutex_unlock(&b->lock);
+	return NULL;
+}
+
+static unsigned int default_nthreads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n > 0 ? (unsigned int) n : 1;
+}
+
+/**
+ * blkid_probe_devices:
+ * @devnames: array with device names
+ * @ndevs: number of items in @devnames
+ * @nthreads: max number of probing threads or 0 for the number of CPUs
+ * @flags: BLKID_PROBEDEVS_* flags
+ * @probe: probing function or NULL
+ * @done: function to return results
+ * @data: caller's private data for @probe and @done
+ *
+ * Probes all the devices from @devnames by a pool of threads. Every device is
+ * opened and assigned to a new prober, and then @probe() is called (in the
+ * worker thread) to setup the prober and to do probing. The default is to
+ * call blkid_do_safeprobe() with the default prober setting.
+ *
+ * The result is returned by @done() callback. The @rc argument is the return
+ * code from @probe(). If the @pr argument is NULL then the device is not
+ * accessible and @rc is negative errno. The prober is deallocated after
+ * @done() returns. The @done() calls are serialized, but the callback is not
+ * always called from the same thread.
+ *
+ * The results are returned in completion order, or in order of @devnames if
+ * BLKID_PROBEDEVS_ORDERED flag is specified.
+ *
+ * If @done() returns non-zero then no more devices are probed and returned,
+ * and the value is used as the return code of blkid_probe_devices().
+ *
+ * Returns: 0 on success, the @done() non-zero return code or negative errno
+ *	    in case of error.
+ *
+ * Since: 2.36
+ */
+int blkid_probe_devices(const char **devnames, size_t ndevs,
+			unsigned int nthreads, int flags,
+			blkid_probe_devices_probe probe,
+			blkid_probe_devices_done done,
+			void *data)
+{
+	struct batch b = {
+		.devnames = devnames,
+		.ndevs = ndevs,
+		.probe = probe,
+		.done = done,
+		.data = data,
+		.lock = PTHREAD_MUTEX_INITIALIZER
+	};
+	pthread_t *threads = NULL;
+	unsigned int i, n = 0;
+	int rc = 0;
+
+	if (!ndevs)
+		return 0;
+
+	/* initialize debug mask before any thread is started */
+	blkid_init_debug(0);
+
+	if (!nthreads)
+		nthreads = default_nthreads();
+	if (nthreads > ndevs)
+		nthreads = ndevs;
+
+	DBG(LOWPROBE, ul_debug("batch: probing %zu devices by %u threads",
+				ndevs, nthreads));
+
+	if (nthreads > 1 && (flags & BLKID_PROBEDEVS_ORDERED)) {
+		b.res = calloc(ndevs, sizeof(struct batch_result));
+		if (!b.res)
+			return -ENOMEM;
+	}
+
+	if (nthreads > 1) {
+		threads = calloc(nthreads - 1, sizeof(pthread_t));
+		if (!threads) {
+			rc = -ENOMEM;
+			goto done;
+		}
+	}
+
+	/* the current thread is the last worker */
+	for (i = 0; i + 1 < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, batch_worker, &b) != 0) {
+			DBG(LOWPROBE, ul_debug("batch: failed to create thread"));
+			break;
+		}
+		n++;
+	}
+
+	batch_worker(&b);
+
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+
+	rc = b.stop;
+done:
+	if (b.res) {
+		size_t x;
+
+		/* unreturned results if stopped */
+		for (x = 0; x < ndevs; x++)
+			blkid_free_probe(b.res[x].pr);
+		free(b.res);
+	}
+	free(threads);
+	pthread_mutex_destroy(&b.lock);
+	return rc;
+}
+
+#ifdef TEST_PROGRAM
+static int test_done(blkid_probe pr, const char *devname, int rc,
+		     void *data __attribute__((__unused__)))
+{
+	const char *type = NULL;
+
+	if (!pr)
+		printf("%s: %s\n", devname, strerror(-rc));
+	else if (rc == 0 && blkid_probe_lookup_value(pr, "TYPE", &type, NULL) == 0)
+		printf("%s: %s\n", devname, type);
+	else
+		printf("%s: [rc=%d]\n", devname, rc);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <device> [...]\n"
+			"test batch probing\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	return blkid_probe_devices((const char **) argv + 1, argc - 1, 0,
+			BLKID_PROBEDEVS_ORDERED, NULL, test_done, NULL) == 0 ?
+				EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
@@ -0,0 +1,764 @@
+/*
+ * bincache.c - binary (mmap-able) version of the blkid cache
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * The binary cache is optional (see BINARY_CACHE= in blkid.conf) and it's
+ * always written together with the classic text cache file, the filename is
+ * <cachefile>.bin. The file is never parsed: the readers mmap() the file and
+ * use the hash index to find the device for NAME=value. blkid_read_cache()
+ * keeps the file mapped and a device is added to the in-memory cache only
+ * when requested by tag or by name; the whole file is loaded only for
+ * operations with all devices (iteration, probing, cache write).
+ *
+ * File layout:
+ *
+ *	struct bincache_header
+ *	struct bincache_dev	devs[ndevs]
+ *	struct bincache_slot	slots[nslots]	(hash index, nslots is power of 2)
+ *	char			strings[strsz]
+ *
+ * The device tags are stored in strings area as "NAME\0value\0" pairs. All
+ * numbers are in the host byte order, the file is not portable.
+ *
+ * The text cache starts with "# binary cache generation: <N>" comment (old
+ * libblkid ignores comments) and the binary cache is used only if its header
+ * generation is the same, so the binary cache is never used together with
+ * a newer text cache written without the binary file (or by old libblkid).
+ * The writers hold flock() on <cachefile>.lock from reading the generation
+ * until both files are renamed.
+ *
+ * The evaluation updates the record verification time in place, the fields
+ * are updated by atomic stores as more processes may share the mapping.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#include <stdint.h>
+#include <time.h>
+
+#include "blkidP.h"
+#include "all-io.h"
+#include "fileutils.h"
+
+#define BINCACHE_MAGIC		"BLKIDBIN"
+#define BINCACHE_VERSION	1
+#define BINCACHE_BOM		0x01020304
+#define BINCACHE_NOSLOT		UINT32_MAX
+
+struct bincache_header {
+	char		magic[8];	/* BINCACHE_MAGIC */
+	uint32_t	version;	/* BINCACHE_VERSION */
+	uint32_t	bom;		/* BINCACHE_BOM in host byte order */
+	uint32_t	ndevs;		/* number of devices */
+	uint32_t	nslots;		/* size of the hash index */
+	uint32_t	strsz;		/* size of the strings area */
+	uint32_t	reserved;
+	uint64_t	generation;	/* incremented by every write */
+};
+
+struct bincache_dev {
+	uint64_t	devno;
+	int64_t		time;		/* last verification */
+	int64_t		utime;
+	int32_t		pri;
+	uint32_t	name;		/* device name offset in strings */
+	uint32_t	tags;		/* the first tag offset in strings */
+	uint32_t	ntags;		/* number of tags */
+	uint32_t	changes;	/* number in-place updates */
+	uint32_t	reserved;
+};
+
+struct bincache_slot {
+	uint32_t	hash;		/* hash of the tag */
+	uint32_t	dev;		/* index in devs[] or BINCACHE_NOSLOT */
+	uint32_t	tag;		/* tag offset in strings */
+};
+
+struct bincache {
+	void				*map;
+	size_t				mapsz;
+	const struct bincache_header	*hdr;
+	struct bincache_dev		*devs;
+	const struct bincache_slot	*slots;
+	const char			*strs;
+};
+
+/* the binary cache mapped by blkid_read_cache() */
+struct blkid_bincache {
+	struct bincache	bc;
+	unsigned char	*loaded;	/* the device is in the in-memory cache */
+};
+
+/* FNV-1a of "NAME=value" */
+static uint32_t tag_hash(const char *name, const char *value)
+{
+	uint32_t h = 2166136261U;
+	const unsigned char *p;
+
+	for (p = (const unsigned char *) name; *p; p++)
+		h = (h ^ *p) * 16777619U;
+	h = (h ^ '=') * 16777619U;
+	for (p = (const unsigned char *) value; *p; p++)
+		h = (h ^ *p) * 16777619U;
+	return h;
+}
+
+char *blkid_get_bincache_filename(const char *cachefile)
+{
+	char *fn;
+
+	if (!cachefile)
+		return NULL;
+	fn = malloc(strlen(cachefile) + sizeof(".bin"));
+	if (fn)
+		sprintf(fn, "%s.bin", cachefile);
+	return fn;
+}
+
+/*
+ * Parses the generation from the first line of the text cache @f. The file
+ * position is not restored. Returns 0 on success.
+ */
+int blkid_read_cache_generation(FILE *f, uint64_t *generation)
+{
+	char buf[64];
+	char *end;
+
+	if (!fgets(buf, sizeof(buf), f)
+	    || strncmp(buf, BLKID_BINCACHE_GENERATION,
+			sizeof(BLKID_BINCACHE_GENERATION) - 1) != 0)
+		return -EINVAL;
+
+	errno = 0;
+	*generation = strtoull(buf + sizeof(BLKID_BINCACHE_GENERATION) - 1, &end, 10);
+	if (errno || *end != '\n' || !*generation)
+		return -EINVAL;
+	return 0;
+}
+
+int blkid_get_cache_generation(const char *cachefile, uint64_t *generation)
+{
+	FILE *f;
+	int rc;
+
+	if (!cachefile)
+		return -EINVAL;
+	f = fopen(cachefile, "r" UL_CLOEXECSTR);
+	if (!f)
+		return -errno;
+	rc = blkid_read_cache_generation(f, generation);
+	fclose(f);
+	return rc;
+}
+
+static void unmap_bincache(struct bincache *bc)
+{
+	if (bc->map)
+		munmap(bc->map, bc->mapsz);
+	memset(bc, 0, sizeof(*bc));
+}
+
+/*
+ * Maps the binary cache and checks that the file is consistent. Returns 0 on
+ * success.
+ */
+static int map_bincache(struct bincache *bc, const char *filename, int rdwr,
+			uint64_t generation)
+{
+	const struct bincache_header *hdr;
+	struct stat st;
+	size_t sz;
+	int fd;
+
+	memset(bc, 0, sizeof(*bc));
+
+	fd = open(filename, (rdwr ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+	    || (size_t) st.st_size < sizeof(struct bincache_header)) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	bc->mapsz = st.st_size;
+	bc->map = mmap(NULL, bc->mapsz, PROT_READ | (rdwr ? PROT_WRITE : 0),
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if (bc->map == MAP_FAILED) {
+		bc->map = NULL;
+		return -errno;
+	}
+
+	hdr = bc->hdr = bc->map;
+	if (memcmp(hdr->magic, BINCACHE_MAGIC, sizeof(hdr->magic)) != 0
+	    || hdr->version != BINCACHE_VERSION
+	    || hdr->bom != BINCACHE_BOM
+	    || (hdr->nslots & (hdr->nslots - 1)) != 0)
+		goto bad;
+	if (generation && hdr->generation != generation) {
+		DBG(CACHE, ul_debug("binary cache %s: generation %ju, expected %ju",
+					filename, (uintmax_t) hdr->generation,
+					(uintmax_t) generation));
+		unmap_bincache(bc);
+		return -ESTALE;
+	}
+
+	sz = sizeof(struct bincache_header)
+	     + (size_t) hdr->ndevs * sizeof(struct bincache_dev)
+	     + (size_t) hdr->nslots * sizeof(struct bincache_slot)
+	     + hdr->strsz;
+	if (sz != bc->mapsz || (hdr->strsz && ((char *) bc->map)[sz - 1] != '\0'))
+		goto bad;
+
+	bc->devs = (struct bincache_dev *) (hdr + 1);
+	bc->slots = (const struct bincache_slot *) (bc->devs + hdr->ndevs);
+	bc->strs = (const char *) (bc->slots + hdr->nslots);
+
+	DBG(CACHE, ul_debug("binary cache %s mapped [ndevs=%u, generation=%ju]",
+				filename, hdr->ndevs, (uintmax_t) hdr->generation));
+	return 0;
+bad:
+	DBG(CACHE, ul_debug("binary cache %s: unsupported or corrupted", filename));
+	unmap_bincache(bc);
+	return -EINVAL;
+}
+
+static inline const char *bincache_str(struct bincache *bc, uint32_t off)
+{
+	return off < bc->hdr->strsz ? bc->strs + off : NULL;
+}
+
+/*
+ * Returns index of the next device with @name=@value tag or -1. The @pos is
+ * number of already checked slots, it has to be zero for the first call.
+ */
+static int lookup_bincache(struct bincache *bc, const char *name,
+			   const char *value, uint32_t *pos)
+{
+	uint32_t h, i, mask;
+
+	if (!bc->hdr->nslots)
+		return -1;
+
+	h = tag_hash(name, value);
+	mask = bc->hdr->nslots - 1;
+
+	for (i = (h + *pos) & mask; *pos < bc->hdr->nslots; i = (i + 1) & mask) {
+		const struct bincache_slot *s = &bc->slots[i];
+		const char *tn, *tv;
+
+		(*pos)++;
+		if (s->dev == BINCACHE_NOSLOT) {
+			*pos = bc->hdr->nslots;
+			break;
+		}
+		if (s->hash != h || s->dev >= bc->hdr->ndevs)
+			continue;
+		tn = bincache_str(bc, s->tag);
+		if (!tn)
+			continue;
+		tv = bincache_str(bc, s->tag + strlen(tn) + 1);
+		if (tv && strcmp(tn, name) == 0 && strcmp(tv, value) == 0)
+			return s->dev;
+	}
+	return -1;
+}
+
+/*
+ * Does low-level probing of the device and checks that @name=@value is still
+ * valid.
+ */
+static int verify_tag(const char *devname, const char *name, const char *value)
+{
+	blkid_probe pr;
+	const char *data = NULL;
+	int rc = 0;
+
+	pr = blkid_new_probe_from_filename(devname);
+	if (!pr)
+		return 0;
+
+	blkid_probe_enable_superblocks(pr, TRUE);
+	blkid_probe_set_superblocks_flags(pr,
+			BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID | BLKID_SUBLKS_TYPE);
+	blkid_probe_enable_partitions(pr, TRUE);
+	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
+
+	if (blkid_do_safeprobe(pr) == 0 &&
+	    blkid_probe_lookup_value(pr, name, &data, NULL) == 0 &&
+	    strcmp(data, value) == 0)
+		rc = 1;
+
+	blkid_free_probe(pr);
+	return rc;
+}
+
+/*
+ * Returns device name for @token=@value from the binary cache @filename of
+ * the text cache @generation. The device is verified by devno and if the
+ * record is not recently verified then also by probing (the record is updated
+ * in place in this case).
+ */
+char *blkid_bincache_evaluate(const char *filename, uint64_t generation,
+			      const char *token, const char *value)
+{
+	struct bincache bc;
+	struct bincache_dev *dev;
+	const char *name;
+	char *res = NULL;
+	struct stat st;
+	time_t now;
+	int64_t verified;
+	uint32_t pos = 0;
+	int idx, rdwr;
+
+	if (!filename || !generation)
+		return NULL;
+
+	rdwr = access(filename, W_OK) == 0;
+	if (map_bincache(&bc, filename, rdwr, generation) != 0)
+		return NULL;
+
+	idx = lookup_bincache(&bc, token, value, &pos);
+	if (idx < 0) {
+		DBG(EVALUATE, ul_debug("binary cache: %s=%s not found", token, value));
+		goto done;
+	}
+
+	dev = &bc.devs[idx];
+	name = bincache_str(&bc, dev->name);
+	if (!name || stat(name, &st) != 0 || st.st_rdev != (dev_t) dev->devno) {
+		DBG(EVALUATE, ul_debug("binary cache: %s: devno does not match", name));
+		goto done;
+	}
+
+	now = time(NULL);
+	verified = __atomic_load_n(&dev->time, __ATOMIC_RELAXED);
+	if (now < verified || now - verified >= BLKID_PROBE_MIN
+	    || st.st_mtime > verified) {
+		if (!verify_tag(name, token, value)) {
+			DBG(EVALUATE, ul_debug("binary cache: %s: %s=%s not valid",
+						name, token, value));
+			goto done;
+		}
+		if (rdwr) {
+			/* update the record in place, the mapping is shared */
+			__atomic_store_n(&dev->utime, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&dev->time, (int64_t) now, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&dev->changes, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	res = strdup(name);
+	DBG(EVALUATE, ul_debug("binary cache: %s=%s is %s", token, value, res));
+done:
+	unmap_bincache(&bc);
+	return res;
+}
+
+/*
+ * Maps the binary cache for later use by blkid_bincache_load_*(). The binary
+ * cache has to match the text cache @generation. Returns 0 on success.
+ */
+int blkid_bincache_open(blkid_cache cache, const char *filename,
+			uint64_t generation)
+{
+	struct blkid_bincache *bin;
+	int rc;
+
+	blkid_bincache_close(cache);
+	if (!generation)
+		return -ESTALE;
+
+	bin = calloc(1, sizeof(*bin));
+	if (!bin)
+		return -ENOMEM;
+	rc = map_bincache(&bin->bc, filename, 0, generation);
+	if (rc == 0) {
+		bin->loaded = calloc(bin->bc.hdr->ndevs ? bin->bc.hdr->ndevs : 1, 1);
+		if (!bin->loaded) {
+			unmap_bincache(&bin->bc);
+			rc = -ENOMEM;
+		}
+	}
+	if (rc) {
+		free(bin);
+		return rc;
+	}
+
+	cache->bic_bincache = bin;
+	return 0;
+}
+
+void blkid_bincache_close(blkid_cache cache)
+{
+	struct blkid_bincache *bin = cache->bic_bincache;
+
+	if (!bin)
+		return;
+	unmap_bincache(&bin->bc);
+	free(bin->loaded);
+	free(bin);
+	cache->bic_bincache = NULL;
+}
+
+/* adds the device @idx from the binary cache to the in-memory cache */
+static int load_dev(blkid_cache cache, struct blkid_bincache *bin, uint32_t idx)
+{
+	const struct bincache_dev *d = &bin->bc.devs[idx];
+	const char *name;
+	struct list_head *p;
+	uint32_t off = d->tags, n;
+	blkid_dev dev;
+
+	if (bin->loaded[idx])
+		return 0;
+	bin->loaded[idx] = 1;
+
+	name = bincache_str(&bin->bc, d->name);
+	if (!name || *name != '/')
+		return 0;
+
+	/* already known device */
+	list_for_each(p, &cache->bic_devs) {
+		dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+		if (strcmp(dev->bid_name, name) == 0)
+			return 0;
+	}
+
+	dev = blkid_new_dev();
+	if (!dev)
+		return -BLKID_ERR_MEM;
+	dev->bid_name = strdup(name);
+	if (!dev->bid_name) {
+		blkid_free_dev(dev);
+		return -BLKID_ERR_MEM;
+	}
+	dev->bid_cache = cache;
+	list_add_tail(&dev->bid_devs, &cache->bic_devs);
+
+	dev->bid_devno = d->devno;
+	dev->bid_time = __atomic_load_n(&d->time, __ATOMIC_RELAXED);
+	dev->bid_utime = __atomic_load_n(&d->utime, __ATOMIC_RELAXED);
+	dev->bid_pri = d->pri;
+
+	for (n = 0; n < d->ntags; n++) {
+		const char *tn = bincache_str(&bin->bc, off);
+		const char *tv = tn ? bincache_str(&bin->bc, off + strlen(tn) + 1) : NULL;
+
+		if (!tv)
+			break;
+		blkid_set_tag(dev, tn, tv, strlen(tv));
+		off += strlen(tn) + strlen(tv) + 2;
+	}
+	if (!dev->bid_type)
+		blkid_free_dev(dev);
+
+	DBG(CACHE, ul_debug("binary cache: loaded %s", name));
+	return 0;
+}
+
+/* adds all devices with @name=@value tag to the in-memory cache */
+int blkid_bincache_load_tag(blkid_cache cache, const char *name,
+			    const char *value)
+{
+	struct blkid_bincache *bin = cache->bic_bincache;
+	uint32_t pos = 0;
+	int idx, rc = 0;
+
+	if (!bin)
+		return 0;
+	while (rc == 0 && (idx = lookup_bincache(&bin->bc, name, value, &pos)) >= 0)
+		rc = load_dev(cache, bin, idx);
+	return rc;
+}
+
+/* adds the device @devname to the in-memory cache */
+int blkid_bincache_load_devname(blkid_cache cache, const char *devname)
+{
+	struct blkid_bincache *bin = cache->bic_bincache;
+	uint32_t i;
+	int rc = 0;
+
+	if (!bin)
+		return 0;
+	for (i = 0; rc == 0 && i < bin->bc.hdr->ndevs; i++) {
+		const char *name = bincache_str(&bin->bc, bin->bc.devs[i].name);
+
+		if (name && strcmp(name, devname) == 0)
+			rc = load_dev(cache, bin, i);
+	}
+	return rc;
+}
+
+/*
+ * Adds all not yet loaded devices to the in-memory cache and unmaps the
+ * binary cache.
+ */
+int blkid_bincache_load_all(blkid_cache cache)
+{
+	struct blkid_bincache *bin = cache->bic_bincache;
+	uint32_t i;
+	int rc = 0;
+
+	if (!bin)
+		return 0;
+	for (i = 0; rc == 0 && i < bin->bc.hdr->ndevs; i++)
+		rc = load_dev(cache, bin, i);
+	if (rc == 0)
+		blkid_bincache_close(cache);
+	return rc;
+}
+
+static int cache_dev_is_saved(blkid_dev dev)
+{
+	return dev->bid_type && !(dev->bid_flags & BLKID_BID_FL_REMOVABLE)
+	       && dev->bid_name[0] == '/';
+}
+
+/*
+ * Locks the cache files for write. Returns the lock file descriptor (close it
+ * to unlock) or negative number in case of error.
+ */
+int blkid_bincache_lock(const char *cachefile)
+{
+	char *lockfile;
+	int fd;
+
+	lockfile = malloc(strlen(cachefile) + sizeof(".lock"));
+	if (!lockfile)
+		return -ENOMEM;
+	sprintf(lockfile, "%s.lock", cachefile);
+
+	fd = open(lockfile, O_RDONLY|O_CREAT|O_CLOEXEC,
+			    S_IWUSR|S_IRUSR|S_IRGRP|S_IROTH);
+	if (fd < 0) {
+		int rc = -errno;
+
+		DBG(SAVE, ul_debug("%s: cannot open lock file", lockfile));
+		free(lockfile);
+		return rc;
+	}
+	free(lockfile);
+
+	while (flock(fd, LOCK_EX) < 0) {
+		int rc = -errno;
+
+		if (rc == -EINTR)
+			continue;
+		close(fd);
+		return rc;
+	}
+	return fd;
+}
+
+/*
+ * Returns generation for the next write of the binary cache @filename. The
+ * generation is written to the text cache before the binary file, the caller
+ * has to hold blkid_bincache_lock().
+ */
+uint64_t blkid_bincache_next_generation(const char *filename)
+{
+	struct bincache old;
+	uint64_t generation = 0;
+
+	if (map_bincache(&old, filename, 0, 0) == 0) {
+		generation = old.hdr->generation;
+		unmap_bincache(&old);
+	}
+	return generation + 1;
+}
+
+/*
+ * Writes the binary version of the cache, @generation is the generation of
+ * the text cache. Returns 0 on success.
+ */
+int blkid_bincache_save(blkid_cache cache, const char *filename,
+			uint64_t generation)
+{
+	struct bincache_header hdr;
+	struct bincache_dev *devs = NULL;
+	struct bincache_slot *slots = NULL;
+	char *strs = NULL, *tmp = NULL;
+	size_t ndevs = 0, ntags = 0, strsz = 0, nslots = 1, d = 0, s = 0;
+	struct list_head *p, *t;
+	int fd = -1, rc = -ENOMEM;
+
+	/* count data */
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+
+		if (!cache_dev_is_saved(dev))
+			continue;
+		ndevs++;
+		strsz += strlen(dev->bid_name) + 1;
+		list_for_each(t, &dev->bid_tags) {
+			blkid_tag tag = list_entry(t, struct blkid_struct_tag, bit_tags);
+			strsz += strlen(tag->bit_name) + strlen(tag->bit_val) + 2;
+			ntags++;
+		}
+	}
+	if (ndevs >= BINCACHE_NOSLOT || strsz >= UINT32_MAX)
+		return -EINVAL;
+
+	while (nslots < ntags * 2)
+		nslots <<= 1;
+
+	devs = calloc(ndevs ? ndevs : 1, sizeof(struct bincache_dev));
+	slots = malloc(nslots * sizeof(struct bincache_slot));
+	strs = malloc(strsz ? strsz : 1);
+	if (!devs || !slots || !strs)
+		goto done;
+
+	for (s = 0; s < nslots; s++) {
+		slots[s].dev = BINCACHE_NOSLOT;
+		slots[s].hash = 0;
+		slots[s].tag = 0;
+	}
+	strsz = 0;
+
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+		struct bincache_dev *x;
+		size_t len;
+
+		if (!cache_dev_is_saved(dev))
+			continue;
+
+		x = &devs[d];
+		x->devno = dev->bid_devno;
+		x->time = dev->bid_time;
+		x->utime = dev->bid_utime;
+		x->pri = dev->bid_pri;
+		x->name = strsz;
+
+		len = strlen(dev->bid_name) + 1;
+		memcpy(strs + strsz, dev->bid_name, len);
+		strsz += len;
+		x->tags = strsz;
+
+		list_for_each(t, &dev->bid_tags) {
+			blkid_tag tag = list_entry(t, struct blkid_struct_tag, bit_tags);
+			uint32_t h = tag_hash(tag->bit_name, tag->bit_val);
+
+			/* add to the hash index */
+			for (s = h & (nslots - 1); slots[s].dev != BINCACHE_NOSLOT;
+			     s = (s + 1) & (nslots - 1))
+				;
+			slots[s].hash = h;
+			slots[s].dev = d;
+			slots[s].tag = strsz;
+
+			len = strlen(tag->bit_name) + 1;
+			memcpy(strs + strsz, tag->bit_name, len);
+			strsz += len;
+			len = strlen(tag->bit_val) + 1;
+			memcpy(strs + strsz, tag->bit_val, len);
+			strsz += len;
+			x->ntags++;
+		}
+		d++;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BINCACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = BINCACHE_VERSION;
+	hdr.bom = BINCACHE_BOM;
+	hdr.ndevs = ndevs;
+	hdr.nslots = nslots;
+	hdr.strsz = strsz;
+	hdr.generation = generation;
+
+	tmp = malloc(strlen(filename) + 8);
+	if (!tmp)
+		goto done;
+	sprintf(tmp, "%s-XXXXXX", filename);
+	fd = mkstemp_cloexec(tmp);
+	if (fd < 0) {
+		rc = -errno;
+		free(tmp);
+		tmp = NULL;
+		goto done;
+	}
+
+	if (fchmod(fd, 0644) != 0
+	    || write_all(fd, &hdr, sizeof(hdr)) != 0
+	    || write_all(fd, devs, ndevs * sizeof(struct bincache_dev)) != 0
+	    || write_all(fd, slots, nslots * sizeof(struct bincache_slot)) != 0
+	    || write_all(fd, strs, strsz) != 0) {
+		rc = -errno;
+		close(fd);
+		unlink(tmp);
+		goto done;
+	}
+	rc = close(fd);
+	fd = -1;
+	if (rc != 0) {
+		rc = -errno;
+		unlink(tmp);
+		goto done;
+	}
+
+	if (rename(tmp, filename) != 0) {
+		rc = -errno;
+		unlink(tmp);
+		goto done;
+	}
+
+	DBG(SAVE, ul_debug("binary cache %s written [ndevs=%zu, ntags=%zu]",
+				filename, ndevs, ntags));
+	rc = 0;
+done:
+	free(tmp);
+	free(devs);
+	free(slots);
+	free(strs);
+	return rc;
+}
+
+#ifdef TEST_PROGRAM
+int main(int argc, char **argv)
+{
+	char *res;
+
+	blkid_init_debug(BLKID_DEBUG_ALL);
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <cachefile> NAME=value\n"
+			"Test evaluation by binary cache\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	{
+		char *name = NULL, *value = NULL, *bin;
+		uint64_t generation = 0;
+
+		if (blkid_parse_tag_string(argv[2], &name, &value) != 0)
+			errx(EXIT_FAILURE, "cannot parse %s", argv[2]);
+		if (blkid_get_cache_generation(argv[1], &generation) != 0)
+			errx(EXIT_FAILURE, "%s: no binary cache generation", argv[1]);
+		bin = blkid_get_bincache_filename(argv[1]);
+		res = blkid_bincache_evaluate(bin, generation, name, value);
+		free(bin);
+		free(name);
+		free(value);
+	}
+
+	printf("%s\n", res ? res : "<not found>");
+	free(res);
+	return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
@@ -32,6 +32,7 @@
 #include "blkdev.h"
 
 #include "debug.h"
+#include "debugtrace.h"
 #include "blkid.h"
 #include "list.h"
 #include "encode.h"
@@ -57,11 +58,13 @@ struct blkid_struct_dev
 	unsigned int		bid_flags;	/* Device status bitflags */
 	char			*bid_label;	/* Shortcut to device LABEL */
 	char			*bid_uuid;	/* Shortcut to binary UUID */
+	uint64_t		bid_sectors;	/* sysfs size when probed */
 };
 
 #define BLKID_BID_FL_VERIFIED	0x0001	/* Device data validated from disk */
 #define BLKID_BID_FL_INVALID	0x0004	/* Device is invalid */
 #define BLKID_BID_FL_REMOVABLE	0x0008	/* Device added by blkid_probe_all_removable() */
+#define BLKID_BID_FL_PROBING	0x0010	/* Scheduled for probing by blkid_probe_all() */
 
 /*
  * Each tag defines a NAME=value pair for a particular device.  The tags
@@ -176,13 +179,45 @@ struct blkid_idinfo
  */
 #define BLKID_IDINFO_TOLERANT	(1 << 1)
 
+/*
+ * Entries of the idinfos[] tables. The library is possible to build with
+ * a subset of the probers (./configure --with-blkid-probers=<list>), then
+ * BLKID_PROBERS_FILTER is defined, BLKID_PROBER_<name> is defined for the
+ * wanted probers and the entries for the others expand to nothing.
+ */
+#ifdef BLKID_PROBERS_FILTER
+# define __BLKID_PROBER_ON(x)		&x,
+# define __BLKID_PROBER_OFF(x)
+# define __BLKID_PROBER_PLACEHOLDER_1	~,
+# define __blkid_prober_second(a, b, ...)	b
+# define ___blkid_prober_sel(arg)	__blkid_prober_second(arg __BLKID_PROBER_ON, __BLKID_PROBER_OFF, )
+# define __blkid_prober_sel2(val)	___blkid_prober_sel(__BLKID_PROBER_PLACEHOLDER_ ## val)
+# define __blkid_prober_sel(val)	__blkid_prober_sel2(val)
+# define BLKID_PROBER(n)		__blkid_prober_sel(BLKID_PROBER_ ## n)(n ## _idinfo)
+# define BLKID_PT_PROBER(n)		__blkid_prober_sel(BLKID_PROBER_ ## n)(n ## _pt_idinfo)
+#else
+# define BLKID_PROBER(n)		&n ## _idinfo,
+# define BLKID_PT_PROBER(n)		&n ## _pt_idinfo,
+#endif
+
 struct blkid_bufinfo {
 	unsigned char		*data;
 	uint64_t		off;
 	uint64_t		len;
+	uint64_t		size;	/* allocated space for data */
 	struct list_head	bufs;	/* list of buffers */
 };
 
+/*
+ * Requests within the first or last BLKID_READAHEAD_SIZE bytes of the probing
+ * area are served from one large read of the whole window, see
+ * blkid_probe_get_buffer().
+ */
+#define BLKID_READAHEAD_SIZE	(1024 * 1024)
+
+/* max number of unused buffers kept by prober for the next probing */
+#define BLKID_BUFPOOL_MAX	8
+
 /*
  * Low-level probing control struct
  */
@@ -205,6 +240,14 @@ struct blkid_struct_probe
 	struct blkid_chain	*wipe_chain;	/* superblock, partition, ... */
 
 	struct list_head	buffers;	/* list of buffers */
+	struct list_head	free_buffers;	/* unused buffers for reuse */
+	size_t			nfree_buffers;	/* number of unused buffers */
+
+	uint64_t		io_reads;	/* number of read() calls */
+	uint64_t		io_bytes;	/* number of read bytes */
+	uint64_t		io_syscalls;	/* number of I/O syscalls (lseek, read, ...) */
+	uint64_t		io_allocs;	/* number of allocated buffers */
+	struct blkid_fprint	*fprint;	/* see fingerprint.c */
 
 	struct blkid_chain	chains[BLKID_NCHAINS];	/* array of chains */
 	struct blkid_chain	*cur_chain;		/* current chain */
@@ -221,9 +264,13 @@ struct blkid_struct_probe
 #define BLKID_FL_CDROM_DEV	(1 << 3)	/* is a CD/DVD drive */
 #define BLKID_FL_NOSCAN_DEV	(1 << 4)	/* do not scan this device */
 #define BLKID_FL_MODIF_BUFF	(1 << 5)	/* cached bufferes has been modified */
+#define BLKID_FL_NORA_HEAD	(1 << 6)	/* begin of the area is not readable at once */
+#define BLKID_FL_NORA_TAIL	(1 << 7)	/* end of the area is not readable at once */
+#define BLKID_FL_NOURING	(1 << 8)	/* io_uring is not usable */
 
 /* private per-probing flags */
 #define BLKID_PROBE_FL_IGNORE_PT (1 << 1)	/* ignore partition table */
+#define BLKID_PROBE_FL_SYSFS_TP	 (1 << 2)	/* topology exported by sysfs */
 
 extern blkid_probe blkid_clone_probe(blkid_probe parent);
 extern blkid_probe blkid_probe_get_wholedisk_probe(blkid_probe pr);
@@ -234,6 +281,7 @@ extern blkid_probe blkid_probe_get_wholedisk_probe(blkid_probe pr);
 enum {
 	BLKID_EVAL_UDEV = 0,
 	BLKID_EVAL_SCAN,
+	BLKID_EVAL_UDEVDB,
 
 	__BLKID_EVAL_LAST
 };
@@ -242,14 +290,16 @@ enum {
  * Library config options
  */
 struct blkid_config {
-	int eval[__BLKID_EVAL_LAST];	/* array with EVALUATION=<udev,cache> options */
+	int eval[__BLKID_EVAL_LAST];	/* array with EVALUATION=<udev,scan,udevdb> options */
 	int nevals;			/* number of elems in eval array */
 	int uevent;			/* SEND_UEVENT=<yes|not> option */
 	char *cachefile;		/* CACHE_FILE=<path> option */
+	int bincache;			/* BINARY_CACHE=<yes|no> option */
 };
 
 extern struct blkid_config *blkid_read_config(const char *filename)
 			__ul_attribute__((warn_unused_result));
+extern const struct blkid_config *blkid_get_default_config(void);
 extern void blkid_free_config(struct blkid_config *conf);
 
 /*
@@ -281,10 +331,12 @@ struct blkid_struct_cache
 	unsigned int		bic_flags;	/* Status flags of the cache */
 	char			*bic_filename;	/* filename of cache */
 	blkid_probe		probe;		/* low-level probing stuff */
+	struct blkid_bincache	*bic_bincache;	/* mapped binary cache or NULL */
 };
 
 #define BLKID_BIC_FL_PROBED	0x0002	/* We probed /proc/partition devices */
 #define BLKID_BIC_FL_CHANGED	0x0004	/* Cache has changed from disk */
+#define BLKID_BIC_FL_BINARY	0x0008	/* Use also binary cache file */
 
 /* config file */
 #define BLKID_CONFIG_FILE	"/etc/blkid.conf"
@@ -337,6 +389,10 @@ UL_DEBUG_DECLARE_MASK(libblkid);
 #define DBG(m, x)	__UL_DBG(libblkid, BLKID_DEBUG_, m, x)
 #define ON_DBG(m, x)    __UL_DBG_CALL(libblkid, BLKID_DEBUG_, m, x)
 
+UL_TRACE_DECLARE(libblkid);
+#define TRACE_SCOPE(m, n)	__UL_TRACE_SCOPE(libblkid, BLKID_DEBUG_, m, n)
+#define TRACE_COUNT(m, n, x)	__UL_TRACE_COUNT(libblkid, BLKID_DEBUG_, m, n, x)
+
 #define UL_DEBUG_CURRENT_MASK	UL_DEBUG_MASK(libblkid)
 #include "debugobj.h"
 
@@ -356,6 +412,16 @@ extern int blkid_driver_has_major(const char *drvname, int major)
 /* lseek.c */
 extern blkid_loff_t blkid_llseek(int fd, blkid_loff_t offset, int whence);
 
+/* verify.c */
+extern void blkid_verify_setup_probe(blkid_probe pr)
+			__attribute__((nonnull));
+extern blkid_dev blkid_verify_update(blkid_cache cache, blkid_dev dev,
+			blkid_probe pr, int rc, dev_t devno)
+			__attribute__((nonnull));
+extern int blkid_verify_is_recent(blkid_dev dev, const struct stat *st,
+			time_t now)
+			__attribute__((nonnull));
+
 /* read.c */
 extern void blkid_read_cache(blkid_cache cache)
 			__attribute__((nonnull));
@@ -364,13 +430,47 @@ extern void blkid_read_cache(blkid_cache cache)
 extern int blkid_flush_cache(blkid_cache cache)
 			__attribute__((nonnull));
 
+/* bincache.c */
+#define BLKID_BINCACHE_GENERATION	"# binary cache generation: "
+
+extern char *blkid_get_bincache_filename(const char *cachefile)
+			__attribute__((warn_unused_result));
+extern int blkid_read_cache_generation(FILE *f, uint64_t *generation)
+			__attribute__((nonnull));
+extern int blkid_get_cache_generation(const char *cachefile, uint64_t *generation)
+			__attribute__((nonnull(2)));
+extern int blkid_bincache_lock(const char *cachefile)
+			__attribute__((nonnull));
+extern uint64_t blkid_bincache_next_generation(const char *filename)
+			__attribute__((nonnull));
+extern int blkid_bincache_open(blkid_cache cache, const char *filename,
+			uint64_t generation)
+			__attribute__((nonnull));
+extern void blkid_bincache_close(blkid_cache cache)
+			__attribute__((nonnull));
+extern int blkid_bincache_load_tag(blkid_cache cache, const char *name,
+			const char *value)
+			__attribute__((nonnull));
+extern int blkid_bincache_load_devname(blkid_cache cache, const char *devname)
+			__attribute__((nonnull));
+extern int blkid_bincache_load_all(blkid_cache cache)
+			__attribute__((nonnull));
+extern int blkid_bincache_save(blkid_cache cache, const char *filename,
+			uint64_t generation)
+			__attribute__((nonnull));
+extern char *blkid_bincache_evaluate(const char *filename, uint64_t generation,
+			const char *token, const char *value)
+			__attribute__((warn_unused_result));
+
 /* cache */
 extern char *blkid_safe_getenv(const char *arg)
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
 
-extern char *blkid_get_cache_filename(struct blkid_config *conf)
+extern char *blkid_get_cache_filename(const struct blkid_config *conf)
 			__attribute__((warn_unused_result));
+extern int blkid_get_cache_with_config(blkid_cache *ret_cache,
+			const char *filename, const struct blkid_config *conf);
 /*
  * Functions to create and find a specific tag type: tag.c
  */
@@ -398,11 +498,39 @@ extern int blkid_probe_is_cdrom(blkid_probe pr)
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
 
+extern void blkid_probe_free_buffers_pool(blkid_probe pr)
+			__attribute__((nonnull));
+
 extern unsigned char *blkid_probe_get_buffer(blkid_probe pr,
                                 uint64_t off, uint64_t len)
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
 
+extern void blkid_probe_fprint_start(blkid_probe pr)
+			__attribute__((nonnull));
+extern void blkid_probe_fprint_add(blkid_probe pr, uint64_t off, uint64_t len,
+			const unsigned char *data)
+			__attribute__((nonnull));
+extern void blkid_probe_fprint_add_disk(blkid_probe pr,
+			const struct blkid_fprint *disk, const char *diskname)
+			__attribute__((nonnull(1)));
+extern void blkid_probe_fprint_end(blkid_probe pr, int rc)
+			__attribute__((nonnull));
+extern void blkid_probe_fprint_reset(blkid_probe pr)
+			__attribute__((nonnull));
+extern void blkid_probe_free_fprint(blkid_probe pr)
+			__attribute__((nonnull));
+extern struct blkid_fprint *blkid_probe_fprint_detach(blkid_probe pr)
+			__attribute__((nonnull));
+extern int blkid_fprint_verify(struct blkid_fprint *fp, int fd)
+			__attribute__((nonnull));
+extern void blkid_free_fprint(struct blkid_fprint *fp);
+
+extern int blkid_probe_peek_buffer(blkid_probe pr, uint64_t off, uint64_t len,
+			unsigned char **data)
+			__attribute__((nonnull))
+			__attribute__((warn_unused_result));
+
 extern unsigned char *blkid_probe_get_sector(blkid_probe pr, unsigned int sector)
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
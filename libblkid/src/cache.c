@@ -58,27 +58,20 @@ static const char *get_default_cache_filename(void)
 	return BLKID_CACHE_FILE_OLD;	/* cache in /etc */
 }
 
-/* returns allocated path to cache */
-char *blkid_get_cache_filename(struct blkid_config *conf)
+/* returns allocated path to cache, @conf is NULL for the default config */
+char *blkid_get_cache_filename(const struct blkid_config *conf)
 {
 	char *filename;
 
 	filename = safe_getenv("BLKID_FILE");
 	if (filename)
-		filename = strdup(filename);
-	else if (conf)
-		filename = conf->cachefile ? strdup(conf->cachefile) : NULL;
-	else {
-		struct blkid_config *c = blkid_read_config(NULL);
-		if (!c)
-			filename = strdup(get_default_cache_filename());
-		else {
-			filename = c->cachefile;  /* already allocated */
-			c->cachefile = NULL;
-			blkid_free_config(c);
-		}
-	}
-	return filename;
+		return strdup(filename);
+	if (!conf)
+		conf = blkid_get_default_config();
+	if (conf)
+		return conf->cachefile ? strdup(conf->cachefile) : NULL;
+
+	return strdup(get_default_cache_filename());
 }
 
 /**
@@ -91,6 +84,13 @@ char *blkid_get_cache_filename(struct blkid_config *conf)
  * Returns: 0 on success or number less than zero in case of error.
  */
 int blkid_get_cache(blkid_cache *ret_cache, const char *filename)
+{
+	return blkid_get_cache_with_config(ret_cache, filename, NULL);
+}
+
+/* the same as blkid_get_cache(), @conf is NULL for the default config */
+int blkid_get_cache_with_config(blkid_cache *ret_cache, const char *filename,
+				const struct blkid_config *conf)
 {
 	blkid_cache cache;
 
@@ -108,10 +108,15 @@ int blkid_get_cache(blkid_cache *ret_cache, const char *filename)
 
 	if (filename && !*filename)
 		filename = NULL;
+
+	if (!conf)
+		conf = blkid_get_default_config();
 	if (filename)
 		cache->bic_filename = strdup(filename);
 	else
-		cache->bic_filename = blkid_get_cache_filename(NULL);
+		cache->bic_filename = blkid_get_cache_filename(conf);
+	if (conf && conf->bincache)
+		cache->bic_flags |= BLKID_BIC_FL_BINARY;
 
 	blkid_read_cache(cache);
 	*ret_cache = cache;
@@ -130,6 +135,7 @@ void blkid_put_cache(blkid_cache cache)
 		return;
 
 	(void) blkid_flush_cache(cache);
+	blkid_bincache_close(cache);
 
 	DBG(CACHE, ul_debugobj(cache, "freeing cache struct"));
 
@@ -180,6 +186,8 @@ void blkid_gc_cache(blkid_cache cache)
 	if (!cache)
 		return;
 
+	blkid_bincache_load_all(cache);
+
 	list_for_each_safe(p, pnext, &cache->bic_devs) {
 		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
 		if (stat(dev->bid_name, &st) < 0) {
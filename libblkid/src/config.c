@@ -22,6 +22,7 @@
 #endif
 #include <stdint.h>
 #include <stdarg.h>
+#include <pthread.h>
 
 #include "blkidP.h"
 #include "env.h"
@@ -40,6 +41,8 @@ static int parse_evaluate(struct blkid_config *conf, char *s)
 			conf->eval[conf->nevals] = BLKID_EVAL_UDEV;
 		else if (strcmp(s, "scan") == 0)
 			conf->eval[conf->nevals] = BLKID_EVAL_SCAN;
+		else if (strcmp(s, "udevdb") == 0)
+			conf->eval[conf->nevals] = BLKID_EVAL_UDEVDB;
 		else
 			goto err;
 		conf->nevals++;
@@ -97,6 +100,12 @@ static int parse_next(FILE *fd, struct blkid_config *conf)
 		s += 11;
 		if (*s)
 			conf->cachefile = strdup(s);
+	} else if (!strncmp(s, "BINARY_CACHE=", 13)) {
+		s += 13;
+		if (*s && !strcasecmp(s, "yes"))
+			conf->bincache = TRUE;
+		else if (*s)
+			conf->bincache = FALSE;
 	} else if (!strncmp(s, "EVALUATE=", 9)) {
 		s += 9;
 		if (*s && parse_evaluate(conf, s) == -1)
@@ -157,6 +166,24 @@ err:
 	return NULL;
 }
 
+static pthread_once_t default_config_once = PTHREAD_ONCE_INIT;
+static struct blkid_config *default_config;
+
+static void read_default_config(void)
+{
+	default_config = blkid_read_config(NULL);
+}
+
+/*
+ * Returns the default config, the file is parsed only once per process. The
+ * config is shared, don't modify or deallocate it.
+ */
+const struct blkid_config *blkid_get_default_config(void)
+{
+	pthread_once(&default_config_once, read_default_config);
+	return default_config;
+}
+
 void blkid_free_config(struct blkid_config *conf)
 {
 	if (!conf)
@@ -186,11 +213,13 @@ int main(int argc, char *argv[])
 
 	printf("EVALUATE:    ");
 	for (i = 0; i < conf->nevals; i++)
-		printf("%s ", conf->eval[i] == BLKID_EVAL_UDEV ? "udev" : "scan");
+		printf("%s ", conf->eval[i] == BLKID_EVAL_UDEV ? "udev" :
+			      conf->eval[i] == BLKID_EVAL_UDEVDB ? "udevdb" : "scan");
 	printf("\n");
 
 	printf("SEND UEVENT: %s\n", conf->uevent ? "TRUE" : "FALSE");
 	printf("CACHE_FILE:  %s\n", conf->cachefile);
+	printf("BINARY CACHE: %s\n", conf->bincache ? "TRUE" : "FALSE");
 
 	blkid_free_config(conf);
 	return EXIT_SUCCESS;
@@ -136,6 +136,8 @@ blkid_dev_iterate blkid_dev_iterate_begin(blkid_cache cache)
 		return NULL;
 	}
 
+	blkid_bincache_load_all(cache);
+
 	iter = malloc(sizeof(struct blkid_struct_dev_iterate));
 	if (iter) {
 		iter->magic = DEV_ITERATE_MAGIC;
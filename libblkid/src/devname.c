@@ -39,6 +39,7 @@
 #include "canonicalize.h"		/* $(top_srcdir)/include */
 #include "pathnames.h"
 #include "sysfs.h"
+#include "path.h"
 
 /*
  * Find a dev struct in the cache by device name, if available.
@@ -46,15 +47,58 @@
  * If there is no entry with the specified device name, and the create
  * flag is set, then create an empty device entry.
  */
+/*
+ * If the device is verified, then search the blkid cache for any entries
+ * that match on the type, uuid, and label, and verify them; if a cache entry
+ * can not be verified, then it's stale and so we remove it.
+ */
+static void verify_duplicates(blkid_cache cache, blkid_dev dev)
+{
+	struct list_head *p, *pnext;
+
+	/* the duplicates have the same UUID, LABEL or TYPE */
+	if (dev->bid_uuid)
+		blkid_bincache_load_tag(cache, "UUID", dev->bid_uuid);
+	else if (dev->bid_label)
+		blkid_bincache_load_tag(cache, "LABEL", dev->bid_label);
+	else if (dev->bid_type)
+		blkid_bincache_load_tag(cache, "TYPE", dev->bid_type);
+
+	list_for_each_safe(p, pnext, &cache->bic_devs) {
+		blkid_dev dev2 = list_entry(p, struct blkid_struct_dev, bid_devs);
+		if (dev2->bid_flags & BLKID_BID_FL_VERIFIED)
+			continue;
+		if (!dev->bid_type || !dev2->bid_type ||
+		    strcmp(dev->bid_type, dev2->bid_type))
+			continue;
+		if (dev->bid_label && dev2->bid_label &&
+		    strcmp(dev->bid_label, dev2->bid_label))
+			continue;
+		if (dev->bid_uuid && dev2->bid_uuid &&
+		    strcmp(dev->bid_uuid, dev2->bid_uuid))
+			continue;
+		if ((dev->bid_label && !dev2->bid_label) ||
+		    (!dev->bid_label && dev2->bid_label) ||
+		    (dev->bid_uuid && !dev2->bid_uuid) ||
+		    (!dev->bid_uuid && dev2->bid_uuid))
+			continue;
+		dev2 = blkid_verify(cache, dev2);
+		if (dev2 && !(dev2->bid_flags & BLKID_BID_FL_VERIFIED))
+			blkid_free_dev(dev2);
+	}
+}
+
 blkid_dev blkid_get_dev(blkid_cache cache, const char *devname, int flags)
 {
 	blkid_dev dev = NULL, tmp;
-	struct list_head *p, *pnext;
+	struct list_head *p;
 	char *cn = NULL;
 
 	if (!cache || !devname)
 		return NULL;
 
+	blkid_bincache_load_devname(cache, devname);
+
 	/* search by name */
 	list_for_each(p, &cache->bic_devs) {
 		tmp = list_entry(p, struct blkid_struct_dev, bid_devs);
@@ -68,6 +112,7 @@ blkid_dev blkid_get_dev(blkid_cache cache, const char *devname, int flags)
 	if (!dev && (cn = canonicalize_path(devname))) {
 		if (strcmp(cn, devname) != 0) {
 			DBG(DEVNAME, ul_debug("search canonical %s", cn));
+			blkid_bincache_load_devname(cache, cn);
 			list_for_each(p, &cache->bic_devs) {
 				tmp = list_entry(p, struct blkid_struct_dev, bid_devs);
 				if (strcmp(tmp->bid_name, cn))
@@ -108,35 +153,7 @@ blkid_dev blkid_get_dev(blkid_cache cache, const char *devname, int flags)
 		dev = blkid_verify(cache, dev);
 		if (!dev || !(dev->bid_flags & BLKID_BID_FL_VERIFIED))
 			goto done;
-		/*
-		 * If the device is verified, then search the blkid
-		 * cache for any entries that match on the type, uuid,
-		 * and label, and verify them; if a cache entry can
-		 * not be verified, then it's stale and so we remove
-		 * it.
-		 */
-		list_for_each_safe(p, pnext, &cache->bic_devs) {
-			blkid_dev dev2 = list_entry(p, struct blkid_struct_dev, bid_devs);
-			if (dev2->bid_flags & BLKID_BID_FL_VERIFIED)
-				continue;
-			if (!dev->bid_type || !dev2->bid_type ||
-			    strcmp(dev->bid_type, dev2->bid_type))
-				continue;
-			if (dev->bid_label && dev2->bid_label &&
-			    strcmp(dev->bid_label, dev2->bid_label))
-				continue;
-			if (dev->bid_uuid && dev2->bid_uuid &&
-			    strcmp(dev->bid_uuid, dev2->bid_uuid))
-				continue;
-			if ((dev->bid_label && !dev2->bid_label) ||
-			    (!dev->bid_label && dev2->bid_label) ||
-			    (dev->bid_uuid && !dev2->bid_uuid) ||
-			    (!dev->bid_uuid && dev2->bid_uuid))
-				continue;
-			dev2 = blkid_verify(cache, dev2);
-			if (dev2 && !(dev2->bid_flags & BLKID_BID_FL_VERIFIED))
-				blkid_free_dev(dev2);
-		}
+		verify_duplicates(cache, dev);
 	}
 done:
 	if (dev)
@@ -181,10 +198,87 @@ static int is_dm_leaf(const char *devname)
 }
 
 /*
- * Probe a single block device to add to the device cache.
+ * The devices found by blkid_probe_all() are not verified one by one, they
+ * are collected and the new or changed devices are probed in parallel by
+ * blkid_probe_devices(). The cache is modified only by the serialized done()
+ * callback.
+ */
+struct probe_dev {
+	blkid_dev	dev;
+	dev_t		devno;
+	uint64_t	sectors;	/* sysfs size */
+	unsigned int	dups : 1;	/* verify duplicates after probing */
+};
+
+struct probe_all {
+	blkid_cache		cache;
+	time_t			now;
+
+	struct probe_dev	*devs;
+	size_t			ndevs;
+	size_t			nalloc;
+	size_t			ndone;		/* the next probed device */
+};
+
+/*
+ * Returns 1 if the device has been probed recently (see blkid_verify()) and
+ * its size has not been changed since the time.
  */
-static void probe_one(blkid_cache cache, const char *ptname,
-		      dev_t devno, int pri, int only_if_new, int removable)
+static int is_unchanged(struct probe_all *pa, blkid_dev dev,
+			dev_t devno, uint64_t sectors)
+{
+	struct stat st;
+
+	if (dev->bid_devno != devno || dev->bid_sectors != sectors)
+		return 0;
+	if (stat(dev->bid_name, &st) != 0 || st.st_rdev != devno
+	    || !blkid_verify_is_recent(dev, &st, pa->now))
+		return 0;
+
+	DBG(DEVNAME, ul_debug(" %s unchanged", dev->bid_name));
+	dev->bid_flags |= BLKID_BID_FL_VERIFIED;
+	return 1;
+}
+
+/* schedule @dev for verification by probe_all_devices() */
+static int add_probe_dev(struct probe_all *pa, blkid_dev dev,
+			 dev_t devno, uint64_t sectors, int dups)
+{
+	struct probe_dev *pd;
+
+	if (dev->bid_flags & BLKID_BID_FL_PROBING)
+		return 0;
+	if (sysfs_devno_is_dm_private(devno, NULL)) {
+		blkid_free_dev(dev);
+		return -1;
+	}
+	if (pa->ndevs == pa->nalloc) {
+		size_t n = pa->nalloc ? pa->nalloc * 2 : 64;
+
+		pd = realloc(pa->devs, n * sizeof(struct probe_dev));
+		if (!pd)
+			return 0;	/* keep the current data */
+		pa->devs = pd;
+		pa->nalloc = n;
+	}
+
+	pd = &pa->devs[pa->ndevs++];
+	pd->dev = dev;
+	pd->devno = devno;
+	pd->sectors = sectors;
+	pd->dups = dups ? 1 : 0;
+
+	dev->bid_flags |= BLKID_BID_FL_PROBING;
+	return 0;
+}
+
+/*
+ * Probe a single block device to add to the device cache. If @pa is not NULL
+ * then the device is only added to the cache and scheduled for probing.
+ */
+static void probe_one(blkid_cache cache, struct probe_all *pa,
+		      const char *ptname, dev_t devno, uint64_t sectors,
+		      int pri, int only_if_new, int removable)
 {
 	blkid_dev dev = NULL;
 	struct list_head *p, *pnext;
@@ -196,8 +290,24 @@ static void probe_one(blkid_cache cache, const char *ptname,
 		blkid_dev tmp = list_entry(p, struct blkid_struct_dev,
 					   bid_devs);
 		if (tmp->bid_devno == devno) {
+			struct stat st;
+
 			if (only_if_new && !access(tmp->bid_name, F_OK))
 				return;
+			if (pa && is_unchanged(pa, tmp, devno, sectors)) {
+				dev = tmp;
+				break;
+			}
+			if (pa) {
+				/* don't probe another device by the old name */
+				if (stat(tmp->bid_name, &st) != 0
+				    || st.st_rdev != devno)
+					continue;
+				if (add_probe_dev(pa, tmp, devno, sectors, 0) != 0)
+					return;
+				dev = tmp;
+				break;
+			}
 			dev = blkid_verify(cache, tmp);
 			if (dev && (dev->bid_flags & BLKID_BID_FL_VERIFIED))
 				break;
@@ -251,9 +361,13 @@ static void probe_one(blkid_cache cache, const char *ptname,
 	}
 
 get_dev:
-	dev = blkid_get_dev(cache, devname, BLKID_DEV_NORMAL);
+	dev = blkid_get_dev(cache, devname, pa ? BLKID_DEV_CREATE : BLKID_DEV_NORMAL);
 	free(devname);
 
+	if (dev && pa && !is_unchanged(pa, dev, devno, sectors)
+	    && add_probe_dev(pa, dev, devno, sectors, 1) != 0)
+		return;
+
 set_pri:
 	if (dev) {
 		if (pri)
@@ -355,8 +469,8 @@ static void lvm_probe_all(blkid_cache cache, int only_if_new)
 			DBG(DEVNAME, ul_debug("LVM dev %s: devno 0x%04X",
 						  lvm_device,
 						  (unsigned int) dev));
-			probe_one(cache, lvm_device, dev, BLKID_PRI_LVM,
-				  only_if_new, 0);
+			probe_one(cache, NULL, lvm_device, dev, 0,
+				  BLKID_PRI_LVM, only_if_new, 0);
 			free(lvm_device);
 		}
 		closedir(lv_list);
@@ -387,8 +501,8 @@ evms_probe_all(blkid_cache cache, int only_if_new)
 		DBG(DEVNAME, ul_debug("Checking partition %s (%d, %d)",
 					  device, ma, mi));
 
-		probe_one(cache, device, makedev(ma, mi), BLKID_PRI_EVMS,
-			  only_if_new, 0);
+		probe_one(cache, NULL, device, makedev(ma, mi), 0,
+			  BLKID_PRI_EVMS, only_if_new, 0);
 		num++;
 	}
 	fclose(procpt);
@@ -436,46 +550,242 @@ ubi_probe_all(blkid_cache cache, int only_if_new)
 				continue;
 			DBG(DEVNAME, ul_debug("UBI vol %s/%s: devno 0x%04X",
 				  *dirname, name, (int) dev));
-			probe_one(cache, name, dev, BLKID_PRI_UBI, only_if_new, 0);
+			probe_one(cache, NULL, name, dev, 0, BLKID_PRI_UBI,
+				  only_if_new, 0);
 		}
 		closedir(dir);
 	}
 }
 
+/* removes the whole-disk device from the cache, the disk has partitions */
+static void remove_wholedisk(blkid_cache cache, dev_t devno)
+{
+	struct list_head *p, *pnext;
+
+	list_for_each_safe(p, pnext, &cache->bic_devs) {
+		blkid_dev tmp;
+
+		/* find blkid dev for the whole-disk devno */
+		tmp = list_entry(p, struct blkid_struct_dev, bid_devs);
+		if (tmp->bid_devno == devno
+		    && !(tmp->bid_flags & BLKID_BID_FL_PROBING)) {
+			DBG(DEVNAME, ul_debug(" freeing %s", tmp->bid_name));
+			blkid_free_dev(tmp);
+			cache->bic_flags |= BLKID_BIC_FL_CHANGED;
+			break;
+		}
+	}
+}
+
+/* probe_all_devices() callbacks, called from the batch threads */
+static int probe_dev_probe(blkid_probe pr,
+			   void *data __attribute__((__unused__)))
+{
+	blkid_verify_setup_probe(pr);
+	return blkid_do_safeprobe(pr);
+}
+
+static int probe_dev_done(blkid_probe pr,
+			  const char *devname __attribute__((__unused__)),
+			  int rc, void *data)
+{
+	struct probe_all *pa = (struct probe_all *) data;
+	struct probe_dev *pd = &pa->devs[pa->ndone++];
+
+	pd->dev->bid_flags &= ~BLKID_BID_FL_PROBING;
+
+	if (!pr) {
+		DBG(PROBE, ul_debug("%s: cannot open (rc=%d)", pd->dev->bid_name, rc));
+
+		/* We don't have read permission, just keep cache data. */
+		if (rc != -EPERM && rc != -EACCES && rc != -ENOENT) {
+			blkid_free_dev(pd->dev);
+			pd->dev = NULL;
+		}
+		return 0;
+	}
+
+	pd->dev = blkid_verify_update(pa->cache, pd->dev, pr, rc, pd->devno);
+	if (pd->dev) {
+		pd->dev->bid_sectors = pd->sectors;
+	}
+	return 0;
+}
+
+/* probes the scheduled devices in parallel */
+static void probe_all_devices(struct probe_all *pa)
+{
+	const char **names;
+	size_t i;
+
+	if (!pa->ndevs)
+		return;
+
+	names = malloc(pa->ndevs * sizeof(char *));
+	if (!names) {
+		for (i = 0; i < pa->ndevs; i++)
+			pa->devs[i].dev->bid_flags &= ~BLKID_BID_FL_PROBING;
+		return;
+	}
+	for (i = 0; i < pa->ndevs; i++)
+		names[i] = pa->devs[i].dev->bid_name;
+
+	DBG(DEVNAME, ul_debug("probing %zu new or changed devices", pa->ndevs));
+
+	/* the results are returned in order, pa->ndone is the device index */
+	blkid_probe_devices(names, pa->ndevs, 0, BLKID_PROBEDEVS_ORDERED,
+			    probe_dev_probe, probe_dev_done, pa);
+
+	/* not probed devices (e.g. failed thread setup) keep the old data */
+	for (i = pa->ndone; i < pa->ndevs; i++)
+		pa->devs[i].dev->bid_flags &= ~BLKID_BID_FL_PROBING;
+
+	for (i = 0; i < pa->ndone; i++) {
+		blkid_dev dev = pa->devs[i].dev;
+
+		if (dev && pa->devs[i].dups
+		    && (dev->bid_flags & BLKID_BID_FL_VERIFIED))
+			verify_duplicates(pa->cache, dev);
+	}
+	free(names);
+}
+
+static int cmp_devname(const void *a, const void *b)
+{
+	return strverscmp(*((const char **) a), *((const char **) b));
+}
+
 /*
- * Read the device data for all available block devices in the system.
+ * Read the block devices from /sys/class/block. Returns 1 if sysfs is not
+ * available.
  */
-static int probe_all(blkid_cache cache, int only_if_new)
+static int sysfs_probe_all(struct probe_all *pa, int only_if_new)
+{
+	struct dirent **namelist = NULL;
+	struct path_cxt *pc;
+	char **disks = NULL;	/* sorted names of disks with partitions */
+	size_t ndisks = 0;
+	int i, n;
+
+	pc = ul_new_path(_PATH_SYS_CLASS "/block");
+	if (!pc)
+		return -BLKID_ERR_MEM;
+
+	n = scandir(_PATH_SYS_CLASS "/block", &namelist, NULL, versionsort);
+	if (n <= 0) {
+		ul_unref_path(pc);
+		free(namelist);
+		return 1;
+	}
+
+	/* the disks with partitions are not probed */
+	for (i = 0; i < n; i++) {
+		char link[PATH_MAX], *parent, *x;
+		ssize_t len;
+
+		if (*namelist[i]->d_name == '.'
+		    || ul_path_accessf(pc, F_OK, "%s/partition", namelist[i]->d_name) != 0)
+			continue;
+
+		/* ../../devices/.../block/<disk>/<partition> */
+		len = ul_path_readlink(pc, link, sizeof(link), namelist[i]->d_name);
+		if (len <= 0 || !(x = strrchr(link, '/')))
+			continue;
+		*x = '\0';
+		parent = strrchr(link, '/');
+		parent = parent ? parent + 1 : link;
+
+		if (ndisks && strcmp(disks[ndisks - 1], parent) == 0)
+			continue;
+		x = strdup(parent);
+		if (x) {
+			char **tmp = realloc(disks, (ndisks + 1) * sizeof(char *));
+			if (!tmp) {
+				free(x);
+				continue;
+			}
+			disks = tmp;
+			disks[ndisks++] = x;
+		}
+	}
+	if (ndisks)
+		qsort(disks, ndisks, sizeof(char *), cmp_devname);
+
+	for (i = 0; i < n; i++) {
+		char *name = namelist[i]->d_name;
+		uint64_t sectors = 0;
+		int ispart, val = 0;
+		dev_t devno;
+
+		if (*name == '.')
+			goto next;
+		if (ul_path_readf_majmin(pc, &devno, "%s/dev", name) != 0
+		    || ul_path_readf_u64(pc, &sectors, "%s/size", name) != 0
+		    || !sectors)
+			goto next;
+
+		ispart = ul_path_accessf(pc, F_OK, "%s/partition", name) == 0;
+
+		if (ispart) {
+			/* Skip extended partitions. heuristic: size is 1K */
+			if (sectors <= 2)
+				goto next;
+		} else {
+			/* not in /proc/partitions, see blkid_probe_all_removable() */
+			if (ul_path_readf_s32(pc, &val, "%s/hidden", name) == 0 && val)
+				goto next;
+			if (ul_path_readf_s32(pc, &val, "%s/removable", name) == 0 && val
+			    && ul_path_readf_s32(pc, &val, "%s/ext_range", name) == 0
+			    && val == 1)
+				goto next;
+
+			if (ndisks && bsearch(&name, disks, ndisks,
+					      sizeof(char *), cmp_devname)) {
+				remove_wholedisk(pa->cache, devno);
+				goto next;
+			}
+		}
+
+		sysfs_devname_sys_to_dev(name);
+		DBG(DEVNAME, ul_debug(" %s dev %s, devno 0x%04X",
+				ispart ? "partition" : "whole", name,
+				(unsigned int) devno));
+
+		probe_one(pa->cache, pa, name, devno, sectors, 0, only_if_new, 0);
+next:
+		free(namelist[i]);
+	}
+
+	for (i = 0; (size_t) i < ndisks; i++)
+		free(disks[i]);
+	free(disks);
+	free(namelist);
+	ul_unref_path(pc);
+	return 0;
+}
+
+/*
+ * Read the block devices from /proc/partitions, used if sysfs is not
+ * available.
+ */
+static int proc_probe_all(struct probe_all *pa, int only_if_new)
 {
+	blkid_cache cache = pa->cache;
 	FILE *proc;
 	char line[1024];
 	char ptname0[128 + 1], ptname1[128 + 1], *ptname = NULL;
 	char *ptnames[2];
 	dev_t devs[2] = { 0, 0 };
+	unsigned long long szs[2] = { 0, 0 };
 	int iswhole[2] = { 0, 0 };
 	int ma, mi;
 	unsigned long long sz;
 	int lens[2] = { 0, 0 };
 	int which = 0, last = 0;
-	struct list_head *p, *pnext;
 
 	ptnames[0] = ptname0;
 	ptnames[1] = ptname1;
 
-	if (!cache)
-		return -BLKID_ERR_PARAM;
-
-	if (cache->bic_flags & BLKID_BIC_FL_PROBED &&
-	    time(NULL) - cache->bic_time < BLKID_PROBE_INTERVAL)
-		return 0;
-
-	blkid_read_cache(cache);
-	evms_probe_all(cache, only_if_new);
-#ifdef VG_DIR
-	lvm_probe_all(cache, only_if_new);
-#endif
-	ubi_probe_all(cache, only_if_new);
-
 	proc = fopen(PROC_PARTITIONS, "r" UL_CLOEXECSTR);
 	if (!proc)
 		return -BLKID_ERR_PROC;
@@ -489,6 +799,7 @@ static int probe_all(blkid_cache cache, int only_if_new)
 			   &ma, &mi, &sz, ptname) != 4)
 			continue;
 		devs[which] = makedev(ma, mi);
+		szs[which] = sz * 2;	/* 1K blocks to sectors */
 
 		DBG(DEVNAME, ul_debug("read device name %s", ptname));
 
@@ -511,8 +822,8 @@ static int probe_all(blkid_cache cache, int only_if_new)
 				   ptname, (unsigned int) devs[which]));
 
 			if (sz > 1)
-				probe_one(cache, ptname, devs[which], 0,
-					  only_if_new, 0);
+				probe_one(cache, pa, ptname, devs[which], szs[which],
+					  0, only_if_new, 0);
 			lens[which] = 0;	/* mark as checked */
 		}
 
@@ -523,21 +834,7 @@ static int probe_all(blkid_cache cache, int only_if_new)
 		 */
 		if (lens[last] && iswhole[last]
 		    && !strncmp(ptnames[last], ptname, lens[last])) {
-
-			list_for_each_safe(p, pnext, &cache->bic_devs) {
-				blkid_dev tmp;
-
-				/* find blkid dev for the whole-disk devno */
-				tmp = list_entry(p, struct blkid_struct_dev,
-						 bid_devs);
-				if (tmp->bid_devno == devs[last]) {
-					DBG(DEVNAME, ul_debug(" freeing %s",
-						       tmp->bid_name));
-					blkid_free_dev(tmp);
-					cache->bic_flags |= BLKID_BIC_FL_CHANGED;
-					break;
-				}
-			}
+			remove_wholedisk(cache, devs[last]);
 			lens[last] = 0;		/* mark as checked */
 		}
 		/*
@@ -548,8 +845,8 @@ static int probe_all(blkid_cache cache, int only_if_new)
 		if (lens[last] && strncmp(ptnames[last], ptname, lens[last])) {
 			DBG(DEVNAME, ul_debug(" whole dev %s, devno 0x%04X",
 				   ptnames[last], (unsigned int) devs[last]));
-			probe_one(cache, ptnames[last], devs[last], 0,
-				  only_if_new, 0);
+			probe_one(cache, pa, ptnames[last], devs[last], szs[last],
+				  0, only_if_new, 0);
 
 			lens[last] = 0;		/* mark as checked */
 		}
@@ -557,9 +854,48 @@ static int probe_all(blkid_cache cache, int only_if_new)
 
 	/* Handle the last device if it wasn't partitioned */
 	if (lens[which])
-		probe_one(cache, ptname, devs[which], 0, only_if_new, 0);
+		probe_one(cache, pa, ptname, devs[which], szs[which],
+			  0, only_if_new, 0);
 
 	fclose(proc);
+	return 0;
+}
+
+/*
+ * Read the device data for all available block devices in the system.
+ */
+static int probe_all(blkid_cache cache, int only_if_new)
+{
+	struct probe_all pa = { .cache = cache };
+	int rc;
+
+	if (!cache)
+		return -BLKID_ERR_PARAM;
+
+	if (cache->bic_flags & BLKID_BIC_FL_PROBED &&
+	    time(NULL) - cache->bic_time < BLKID_PROBE_INTERVAL)
+		return 0;
+
+	blkid_read_cache(cache);
+	blkid_bincache_load_all(cache);
+	evms_probe_all(cache, only_if_new);
+#ifdef VG_DIR
+	lvm_probe_all(cache, only_if_new);
+#endif
+	ubi_probe_all(cache, only_if_new);
+
+	pa.now = time(NULL);
+
+	rc = sysfs_probe_all(&pa, only_if_new);
+	if (rc == 1)
+		rc = proc_probe_all(&pa, only_if_new);
+
+	probe_all_devices(&pa);
+	free(pa.devs);
+
+	if (rc)
+		return rc;
+
 	blkid_flush_cache(cache);
 	return 0;
 }
@@ -575,6 +911,8 @@ static int probe_all_removable(blkid_cache cache)
 	if (!cache)
 		return -BLKID_ERR_PARAM;
 
+	blkid_bincache_load_all(cache);
+
 	dir = opendir(_PATH_SYS_BLOCK);
 	if (!dir)
 		return -BLKID_ERR_PROC;
@@ -603,7 +941,7 @@ static int probe_all_removable(blkid_cache cache)
 				removable = 0;
 
 		if (removable)
-			probe_one(cache, d->d_name, devno, 0, 0, 1);
+			probe_one(cache, NULL, d->d_name, devno, 0, 0, 0, 1);
 	}
 
 	ul_unref_path(pc);
@@ -616,7 +954,11 @@ static int probe_all_removable(blkid_cache cache)
  * blkid_probe_all:
  * @cache: cache handler
  *
- * Probes all block devices.
+ * Probes all block devices. The devices are read from /sys/class/block (or
+ * from /proc/partitions if sysfs is not available), the new or changed
+ * devices are probed in parallel. The device is not probed again if it has
+ * been probed less than two seconds ago, the device node has not been
+ * modified and its size has not been changed.
  *
  * Returns: 0 on success, or number less than zero in case of error.
  */
@@ -190,6 +190,27 @@ static int is_whitelisted(char c, const char *white)
 	return 0;
 }
 
+/* returns number of is_whitelisted(c, NULL) chars at the begin of @str */
+static size_t whitelisted_span(const char *str)
+{
+	const char *p = str;
+
+	for (;; p++) {
+		unsigned char c = *p;
+
+		if ((c >= '0' && c <= '9') ||
+		    ((c | 0x20) >= 'a' && (c | 0x20) <= 'z'))
+			continue;
+		switch (c) {
+		case '#': case '+': case '-': case '.':
+		case ':': case '=': case '@': case '_':
+			continue;
+		}
+		break;
+	}
+	return p - str;
+}
+
 /* allow chars in whitelist, plain ascii, hex-escaping and valid utf8 */
 static int replace_chars(char *str, const char *white)
 {
@@ -199,6 +220,10 @@ static int replace_chars(char *str, const char *white)
 	while (str[i] != '\0') {
 		int len;
 
+		i += whitelisted_span(&str[i]);
+		if (str[i] == '\0')
+			break;
+
 		if (is_whitelisted(str[i], white)) {
 			i++;
 			continue;
@@ -254,6 +279,17 @@ int blkid_encode_string(const char *str, char *str_enc, size_t len)
 
 	for (i = 0, j = 0; str[i] != '\0'; i++) {
 		int seqlen;
+		size_t n = whitelisted_span(&str[i]);
+
+		/* copy run of the safe chars, see j+3 check below */
+		if (n) {
+			if (j + 3 + n >= len)
+				goto err;
+			memcpy(&str_enc[j], &str[i], n);
+			j += n;
+			i += n - 1;
+			continue;
+		}
 
 		seqlen = utf8_encoded_valid_unichar(&str[i]);
 		if (seqlen > 1) {
@@ -21,6 +21,7 @@
 #endif
 #include <stdint.h>
 #include <stdarg.h>
+#include <dirent.h>
 
 #include "pathnames.h"
 #include "canonicalize.h"
@@ -36,11 +37,12 @@
  * This API provides very simple and portable way how evaluate LABEL and UUID
  * tags.  The blkid_evaluate_tag() and blkid_evaluate_spec() work on 2.4 and
  * 2.6 systems and on systems with or without udev. Currently, the libblkid
- * library supports "udev" and "scan" methods. The "udev" method uses udev
- * /dev/disk/by-* symlinks and the "scan" method scans all block devices from
- * the /proc/partitions file. The evaluation could be controlled by the
- * /etc/blkid.conf config file. The default is to try "udev" and then "scan"
- * method.
+ * library supports "udev", "udevdb" and "scan" methods. The "udev" method uses
+ * udev /dev/disk/by-* symlinks, the "udevdb" method searches in the udev
+ * database (/run/udev/data) and never reads the devices, and the "scan" method
+ * scans all block devices from the /proc/partitions file. The evaluation
+ * could be controlled by the /etc/blkid.conf config file. The default is to
+ * try "udev" and then "scan" method.
  *
  * The blkid_evaluate_tag() also automatically informs udevd when an obsolete
  * /dev/disk/by-* symlink is detected.
@@ -185,6 +187,229 @@ failed:
 	return NULL;
 }
 
+/*
+ * Returns udev property name for the tag. The property values are encoded by
+ * blkid_encode_string() in udev.
+ */
+static const char *tag_to_udev_property(const char *token)
+{
+	if (!strcmp(token, "UUID"))
+		return "ID_FS_UUID_ENC";
+	if (!strcmp(token, "LABEL"))
+		return "ID_FS_LABEL_ENC";
+	if (!strcmp(token, "TYPE"))
+		return "ID_FS_TYPE";
+	if (!strcmp(token, "PARTUUID"))
+		return "ID_PART_ENTRY_UUID";
+	if (!strcmp(token, "PARTLABEL"))
+		return "ID_PART_ENTRY_NAME";
+	return NULL;
+}
+
+/* returns /dev/disk/by-* directory for the tag or NULL */
+static const char *tag_to_udev_symlinks(const char *token)
+{
+	if (!strcmp(token, "UUID"))
+		return _PATH_DEV_BYUUID;
+	if (!strcmp(token, "LABEL"))
+		return _PATH_DEV_BYLABEL;
+	if (!strcmp(token, "PARTUUID"))
+		return _PATH_DEV_BYPARTUUID;
+	if (!strcmp(token, "PARTLABEL"))
+		return _PATH_DEV_BYPARTLABEL;
+	return NULL;
+}
+
+/* udev database records of one device */
+struct udevdb_dev {
+	char		*node;		/* "N:" device node */
+	int		prio;		/* "L:" symlinks priority */
+	unsigned int	match : 1;	/* "E:" record with the property */
+};
+
+/*
+ * Reads udev database file @filename and checks if the file contains
+ * @prop=@value property. Returns 0 on success.
+ */
+static int udevdb_read(int dirfd, const char *filename,
+		       const char *prop, const char *value,
+		       struct udevdb_dev *dev)
+{
+	char line[BUFSIZ];
+	size_t plen = strlen(prop);
+	int fd;
+	FILE *f;
+
+	memset(dev, 0, sizeof(*dev));
+
+	fd = openat(dirfd, filename, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	f = fdopen(fd, "r" UL_CLOEXECSTR);
+	if (!f) {
+		close(fd);
+		return -ENOMEM;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		char *p = strchr(line, '\n');
+
+		if (p)
+			*p = '\0';
+		if (line[1] != ':')
+			continue;
+		if (line[0] == 'N' && !dev->node)
+			dev->node = strdup(line + 2);
+		else if (line[0] == 'L')
+			dev->prio = atoi(line + 2);
+		else if (line[0] == 'E'
+			 && strncmp(line + 2, prop, plen) == 0
+			 && line[2 + plen] == '='
+			 && strcmp(line + 3 + plen, value) == 0)
+			dev->match = 1;
+	}
+	fclose(f);
+	return 0;
+}
+
+/*
+ * Selects the device with @prop=@value from the devices in @dir (the entries
+ * are "b<major>:<minor>" names of the udev database files). The device with
+ * the highest link priority wins like in udev. Returns the device name or
+ * NULL if no device matches or more devices match with the same priority.
+ */
+static char *udevdb_select(int datafd, DIR *dir, const char *prop,
+			   const char *value)
+{
+	struct udevdb_dev best = { .node = NULL };
+	struct dirent *d;
+	dev_t bestno = 0;
+	int nbest = 0;
+	char *res = NULL;
+
+	while ((d = readdir(dir))) {
+		struct udevdb_dev dev;
+		unsigned int maj, min;
+		char dummy;
+
+		/* block devices only, "b<major>:<minor>" */
+		if (d->d_name[0] != 'b' ||
+		    sscanf(d->d_name + 1, "%u:%u%c", &maj, &min, &dummy) != 2)
+			continue;
+		if (udevdb_read(datafd, d->d_name, prop, value, &dev) != 0)
+			continue;
+		if (!dev.match || (nbest && dev.prio < best.prio)) {
+			free(dev.node);
+			continue;
+		}
+		if (nbest && dev.prio == best.prio) {
+			DBG(EVALUATE, ul_debug("udev database: %s and %s match",
+					best.node, dev.node));
+			free(dev.node);
+			nbest++;
+			continue;
+		}
+		free(best.node);
+		best = dev;
+		bestno = makedev(maj, min);
+		nbest = 1;
+	}
+
+	if (nbest == 1 && best.node) {
+		res = malloc(sizeof("/dev/") + strlen(best.node));
+		if (res)
+			sprintf(res, "/dev/%s", best.node);
+	} else if (nbest == 1)
+		res = blkid_devno_to_devname(bestno);
+
+	free(best.node);
+	return res;
+}
+
+/*
+ * Opens udev directory with the devices claiming the symlink @dir/@enc, the
+ * directory name is the symlink path (without "/dev") with escaped '/' and
+ * '\' chars.
+ */
+static DIR *open_udev_links(const char *dir, const char *enc)
+{
+	char path[PATH_MAX], link[PATH_MAX], *p;
+	const char *s;
+	size_t sz = sizeof(path);
+	int len;
+
+	len = snprintf(link, sizeof(link), "%s/%s", dir + sizeof("/dev") - 1, enc);
+	if (len < 0 || (size_t) len >= sizeof(link))
+		return NULL;
+
+	len = snprintf(path, sz, _PATH_UDEV_LINKS "/");
+	p = path + len;
+	sz -= len;
+
+	for (s = link; *s; s++) {
+		if (sz < 5)
+			return NULL;
+		if (*s == '/' || *s == '\\') {
+			len = sprintf(p, "\\x%02x", (unsigned char) *s);
+			p += len;
+			sz -= len;
+		} else {
+			*p++ = *s;
+			sz--;
+		}
+	}
+	*p = '\0';
+
+	DBG(EVALUATE, ul_debug("udev links directory: %s", path));
+	return opendir(path);
+}
+
+/*
+ * The udev database is authoritative for this method; the devices are never
+ * opened. The tags with /dev/disk/by-* symlinks are resolved by the udev
+ * links directory (the devices claiming the symlink), only TYPE (or old
+ * udev without the links directory) requires to read whole database.
+ */
+static char *evaluate_by_udevdb(const char *token, const char *value)
+{
+	char enc[PATH_MAX];
+	const char *prop, *links;
+	char *res = NULL;
+	DIR *data, *dir;
+
+	DBG(EVALUATE, ul_debug("evaluating by udev database %s=%s", token, value));
+
+	prop = tag_to_udev_property(token);
+	if (!prop) {
+		DBG(EVALUATE, ul_debug("unsupported token %s", token));
+		return NULL;
+	}
+	if (blkid_encode_string(value, enc, sizeof(enc)) != 0)
+		return NULL;
+
+	data = opendir(_PATH_UDEV_DATA);
+	if (!data) {
+		DBG(EVALUATE, ul_debug("cannot open " _PATH_UDEV_DATA));
+		return NULL;
+	}
+
+	links = tag_to_udev_symlinks(token);
+	if (links && access(_PATH_UDEV_LINKS, F_OK) == 0) {
+		dir = open_udev_links(links, enc);
+		if (dir) {
+			res = udevdb_select(dirfd(data), dir, prop, enc);
+			closedir(dir);
+		}
+	} else
+		res = udevdb_select(dirfd(data), data, prop, enc);
+
+	closedir(data);
+
+	if (!res)
+		DBG(EVALUATE, ul_debug("failed to evaluate by udev database"));
+	return res;
+}
+
 static char *evaluate_by_scan(const char *token, const char *value,
 		blkid_cache *cache, struct blkid_config *conf)
 {
@@ -193,9 +418,24 @@ static char *evaluate_by_scan(const char *token, const char *value,
 
 	DBG(EVALUATE, ul_debug("evaluating by blkid scan %s=%s", token, value));
 
+	if (!c && conf->bincache) {
+		char *cachefile = blkid_get_cache_filename(conf);
+		char *bin = blkid_get_bincache_filename(cachefile);
+		uint64_t generation = 0;
+
+		/* resolve the tag by binary cache index without parsing */
+		if (blkid_get_cache_generation(cachefile, &generation) == 0)
+			res = blkid_bincache_evaluate(bin, generation, token, value);
+		else
+			res = NULL;
+		free(bin);
+		free(cachefile);
+		if (res)
+			return res;
+	}
 	if (!c) {
 		char *cachefile = blkid_get_cache_filename(conf);
-		blkid_get_cache(&c, cachefile);
+		blkid_get_cache_with_config(&c, cachefile, conf);
 		free(cachefile);
 	}
 	if (!c)
@@ -255,6 +495,8 @@ char *blkid_evaluate_tag(const char *token, const char *value, blkid_cache *cach
 			ret = evaluate_by_udev(token, value, conf->uevent);
 		else if (conf->eval[i] == BLKID_EVAL_SCAN)
 			ret = evaluate_by_scan(token, value, cache, conf);
+		else if (conf->eval[i] == BLKID_EVAL_UDEVDB)
+			ret = evaluate_by_udevdb(token, value);
 		if (ret)
 			break;
 	}
@@ -0,0 +1,451 @@
+/*
+ * fingerprint.c - cheap re-validation of the probing result
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * blkid_do_safeprobe() and blkid_do_fullprobe() record all areas of the device
+ * used by probing functions (also by cloned probers) together with a checksum
+ * of the data, as they have been read. The result of probing depends on the
+ * device size and the data only, so if the areas are not modified then the
+ * result is still valid.
+ *
+ * The PART_ENTRY_* values of a partition are read from the whole-disk
+ * partition table, so the fingerprint of the partition contains a copy of the
+ * whole-disk fingerprint too. The topology values are read by ioctls, from
+ * sysfs or by external tools, the result with topology is never revalidated.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#include "blkidP.h"
+#include "blkdev.h"
+#include "crc32.h"
+#include "all-io.h"
+
+struct blkid_fprint_area {
+	uint64_t	off;		/* offset from the begin of the device */
+	uint64_t	len;
+	uint32_t	crc;
+};
+
+struct blkid_fprint {
+	unsigned int	recording : 1,	/* probing in progress */
+			valid : 1;	/* ready for blkid_probe_revalidate() */
+
+	dev_t		devno;
+	uint64_t	devsize;	/* size of the device (not probing area) */
+
+	struct blkid_fprint_area *areas;
+	size_t		nareas;
+	size_t		nalloc;
+
+	struct blkid_fprint *disk;	/* whole-disk partition table */
+	char		*diskname;
+};
+
+static void reset_disk(struct blkid_fprint *fp)
+{
+	blkid_free_fprint(fp->disk);
+	free(fp->diskname);
+	fp->disk = NULL;
+	fp->diskname = NULL;
+}
+
+static int get_device_size(int fd, dev_t *devno, uint64_t *size)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+		return -errno;
+
+	*devno = S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode) ? st.st_rdev : 0;
+
+	if (S_ISBLK(st.st_mode)) {
+		unsigned long long sz;
+
+		if (blkdev_get_size(fd, &sz) != 0)
+			return -errno;
+		*size = sz;
+	} else
+		*size = S_ISREG(st.st_mode) ? (uint64_t) st.st_size : 0;
+	return 0;
+}
+
+void blkid_probe_fprint_start(blkid_probe pr)
+{
+	if (!pr->fprint) {
+		pr->fprint = calloc(1, sizeof(struct blkid_fprint));
+		if (!pr->fprint)
+			return;
+	}
+	pr->fprint->nareas = 0;
+	pr->fprint->valid = 0;
+	pr->fprint->recording = 1;
+	reset_disk(pr->fprint);
+}
+
+/* the fingerprint of @fp cannot be completed, the result cannot be revalidated */
+static void stop_recording(struct blkid_fprint *fp)
+{
+	fp->recording = 0;
+	fp->nareas = 0;
+	reset_disk(fp);
+}
+
+static void add_area(struct blkid_fprint *fp, uint64_t off, uint64_t len,
+		     uint32_t crc)
+{
+	struct blkid_fprint_area *a;
+
+	if (fp->nareas) {
+		a = &fp->areas[fp->nareas - 1];
+		if (a->off <= off && off + len <= a->off + a->len)
+			return;		/* the same area as the previous request */
+	}
+
+	if (fp->nareas == fp->nalloc) {
+		size_t n = fp->nalloc ? fp->nalloc * 2 : 32;
+
+		a = realloc(fp->areas, n * sizeof(struct blkid_fprint_area));
+		if (!a) {
+			stop_recording(fp);
+			return;
+		}
+		fp->areas = a;
+		fp->nalloc = n;
+	}
+
+	a = &fp->areas[fp->nareas++];
+	a->off = off;
+	a->len = len;
+	a->crc = crc;
+}
+
+/*
+ * Records the area used by probing, @off is offset from the begin of the
+ * device and @data are the data returned to the probing function. The cloned
+ * probers use the same device, so the area is recorded also to the parents.
+ */
+void blkid_probe_fprint_add(blkid_probe pr, uint64_t off, uint64_t len,
+			    const unsigned char *data)
+{
+	uint32_t crc = 0;
+	int has_crc = 0;
+
+	for (; pr; pr = pr->parent) {
+		struct blkid_fprint *fp = pr->fprint;
+
+		if (!fp || !fp->recording)
+			continue;
+		if (!has_crc) {
+			crc = ul_crc32(~0U, data, len);
+			has_crc = 1;
+		}
+		add_area(fp, off, len, crc);
+	}
+}
+
+/*
+ * Adds the whole-disk fingerprint @disk of the partition table used for
+ * PART_ENTRY_* values to the fingerprint of @pr. If @disk is NULL then the
+ * result of @pr cannot be revalidated.
+ */
+void blkid_probe_fprint_add_disk(blkid_probe pr, const struct blkid_fprint *disk,
+				 const char *diskname)
+{
+	struct blkid_fprint *fp = pr->fprint, *x;
+
+	if (!fp || !fp->recording)
+		return;
+
+	reset_disk(fp);
+	if (!disk || !diskname || disk->disk)
+		goto fail;
+
+	x = calloc(1, sizeof(*x));
+	if (!x)
+		goto fail;
+	fp->disk = x;
+
+	x->devno = disk->devno;
+	x->devsize = disk->devsize;
+	x->valid = 1;
+	if (disk->nareas) {
+		x->areas = malloc(disk->nareas * sizeof(struct blkid_fprint_area));
+		if (!x->areas)
+			goto fail;
+		memcpy(x->areas, disk->areas,
+		       disk->nareas * sizeof(struct blkid_fprint_area));
+		x->nareas = x->nalloc = disk->nareas;
+	}
+
+	fp->diskname = strdup(diskname);
+	if (!fp->diskname)
+		goto fail;
+	return;
+fail:
+	stop_recording(fp);
+}
+
+static int cmp_areas(const void *a, const void *b)
+{
+	const struct blkid_fprint_area *x = a, *y = b;
+
+	/* the larger area first, the next areas may be within it */
+	if (x->off == y->off)
+		return x->len > y->len ? -1 : x->len < y->len;
+	return x->off < y->off ? -1 : 1;
+}
+
+/*
+ * Ends recording; @rc is the probing return code. The areas are sorted and the
+ * areas within another area are removed. The data are not read again.
+ */
+void blkid_probe_fprint_end(blkid_probe pr, int rc)
+{
+	struct blkid_fprint *fp = pr->fprint;
+	size_t i, n;
+
+	if (!fp || !fp->recording)
+		return;
+	fp->recording = 0;
+
+	if (rc < 0 || !fp->nareas || (pr->flags & BLKID_FL_MODIF_BUFF)
+	    || pr->chains[BLKID_CHAIN_TOPLGY].enabled)
+		goto invalid;
+
+	qsort(fp->areas, fp->nareas, sizeof(struct blkid_fprint_area), cmp_areas);
+
+	for (i = 1, n = 0; i < fp->nareas; i++) {
+		struct blkid_fprint_area *last = &fp->areas[n];
+		struct blkid_fprint_area *a = &fp->areas[i];
+
+		if (a->off + a->len <= last->off + last->len)
+			continue;	/* verified by the last area */
+		fp->areas[++n] = *a;
+	}
+	fp->nareas = n + 1;
+
+	if (get_device_size(pr->fd, &fp->devno, &fp->devsize) != 0)
+		goto invalid;
+
+	fp->valid = 1;
+	DBG(LOWPROBE, ul_debug("fingerprint: %zu areas", fp->nareas));
+	return;
+invalid:
+	DBG(LOWPROBE, ul_debug("fingerprint: not available"));
+	fp->nareas = 0;
+	reset_disk(fp);
+}
+
+/* forget the fingerprint, the result has been modified */
+void blkid_probe_fprint_reset(blkid_probe pr)
+{
+	if (pr->fprint) {
+		pr->fprint->valid = 0;
+		pr->fprint->nareas = 0;
+		reset_disk(pr->fprint);
+	}
+}
+
+void blkid_free_fprint(struct blkid_fprint *fp)
+{
+	if (fp) {
+		reset_disk(fp);
+		free(fp->areas);
+		free(fp);
+	}
+}
+
+void blkid_probe_free_fprint(blkid_probe pr)
+{
+	blkid_free_fprint(pr->fprint);
+	pr->fprint = NULL;
+}
+
+/*
+ * Returns the fingerprint of the last probing and removes it from the prober,
+ * or NULL if not available.
+ */
+struct blkid_fprint *blkid_probe_fprint_detach(blkid_probe pr)
+{
+	struct blkid_fprint *fp = pr->fprint;
+
+	if (!fp || !fp->valid)
+		return NULL;
+	pr->fprint = NULL;
+	return fp;
+}
+
+/*
+ * Compares the fingerprint with the device @fd. Returns 0 if not modified, 1
+ * if modified or negative number in case of error. The read() calls are
+ * accounted to @pr if not NULL.
+ */
+static int verify_fprint(struct blkid_fprint *fp, int fd, blkid_probe pr)
+{
+	unsigned char *buf = NULL;
+	uint64_t devsize, bufsz = 0;
+	dev_t devno;
+	size_t i, k;
+	int rc;
+
+	rc = get_device_size(fd, &devno, &devsize);
+	if (rc)
+		return rc;
+	if (devno != fp->devno || devsize != fp->devsize) {
+		DBG(LOWPROBE, ul_debug("fingerprint: device size or devno changed"));
+		return 1;
+	}
+
+	/* the overlapping and adjacent areas are read by one read() */
+	for (i = 0; i < fp->nareas; i = k) {
+		uint64_t off = fp->areas[i].off;
+		uint64_t end = off + fp->areas[i].len;
+
+		for (k = i + 1; k < fp->nareas && fp->areas[k].off <= end; k++)
+			end = max(end, fp->areas[k].off + fp->areas[k].len);
+
+		if (end - off > bufsz) {
+			unsigned char *x = realloc(buf, end - off);
+
+			if (!x) {
+				free(buf);
+				return -ENOMEM;
+			}
+			buf = x;
+			bufsz = end - off;
+		}
+
+		if (lseek(fd, off, SEEK_SET) == (off_t) -1
+		    || read_all(fd, (char *) buf, end - off) != (ssize_t) (end - off)) {
+			DBG(LOWPROBE, ul_debug("fingerprint: read failed"));
+			free(buf);
+			return 1;
+		}
+		if (pr) {
+			pr->io_syscalls += 2;
+			pr->io_reads++;
+			pr->io_bytes += end - off;
+		}
+
+		for (; i < k; i++) {
+			struct blkid_fprint_area *a = &fp->areas[i];
+
+			if (ul_crc32(~0U, buf + (a->off - off), a->len) != a->crc) {
+				DBG(LOWPROBE, ul_debug("fingerprint: [off=%"PRIu64", len=%"PRIu64"] modified",
+							a->off, a->len));
+				free(buf);
+				return 1;
+			}
+		}
+	}
+	free(buf);
+
+	if (fp->disk) {
+		int diskfd = open(fp->diskname, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+
+		if (diskfd < 0) {
+			DBG(LOWPROBE, ul_debug("fingerprint: cannot open %s", fp->diskname));
+			return 1;
+		}
+		rc = verify_fprint(fp->disk, diskfd, pr);
+		close(diskfd);
+		if (rc)
+			DBG(LOWPROBE, ul_debug("fingerprint: %s modified", fp->diskname));
+	}
+	return rc;
+}
+
+int blkid_fprint_verify(struct blkid_fprint *fp, int fd)
+{
+	return verify_fprint(fp, fd, NULL);
+}
+
+/**
+ * blkid_probe_revalidate:
+ * @pr: prober
+ *
+ * Checks whether the result of the last blkid_do_safeprobe() or
+ * blkid_do_fullprobe() is still valid. The function does not run probing
+ * functions, it compares the device number, the device size and checksums of
+ * all the device areas used by the last probing. Only these areas are read
+ * from the device. For a partition the whole-disk partition table used for
+ * PART_ENTRY_* values is verified too.
+ *
+ * The result of probing with enabled topology chain is never revalidated, the
+ * function returns 1.
+ *
+ * The probing result and filters are not modified by this function, all
+ * cached buffers are reset.
+ *
+ * Returns: 0 if the result is still valid, 1 if it's necessary to probe the
+ *	    device again, or negative number in case of error.
+ *
+ * Since: 2.36
+ */
+int blkid_probe_revalidate(blkid_probe pr)
+{
+	struct blkid_fprint *fp = pr->fprint;
+	int rc;
+
+	if (!fp || !fp->valid || pr->fd < 0) {
+		DBG(LOWPROBE, ul_debug("revalidate: no fingerprint"));
+		return 1;
+	}
+
+	/* don't use data from the previous probing */
+	blkid_probe_reset_buffers(pr);
+
+	rc = verify_fprint(fp, pr->fd, pr);
+	if (rc == 0)
+		DBG(LOWPROBE, ul_debug("revalidate: result valid (%zu areas)", fp->nareas));
+	else if (rc == 1)
+		blkid_probe_fprint_reset(pr);
+	return rc;
+}
+
+#ifdef TEST_PROGRAM
+int main(int argc, char *argv[])
+{
+	blkid_probe pr;
+	int rc;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <device>\n"
+			"probe the device and revalidate the result\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	blkid_init_debug(0);
+
+	pr = blkid_new_probe_from_filename(argv[1]);
+	if (!pr)
+		err(EXIT_FAILURE, "%s: cannot create prober", argv[1]);
+
+	blkid_probe_enable_partitions(pr, 1);
+	rc = blkid_do_safeprobe(pr);
+	printf("probe:      rc=%d, %"PRIu64" bytes by %"PRIu64" reads\n",
+			rc, pr->io_bytes, pr->io_reads);
+	blkid_probe_reset_buffers(pr);
+
+	rc = blkid_probe_revalidate(pr);
+	printf("revalidate: rc=%d, %"PRIu64" bytes by %"PRIu64" reads\n",
+			rc, pr->io_bytes, pr->io_reads);
+
+	blkid_free_probe(pr);
+	return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
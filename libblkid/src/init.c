@@ -16,6 +16,7 @@
 #include "blkidP.h"
 
 UL_DEBUG_DEFINE_MASK(libblkid);
+UL_TRACE_DEFINE(libblkid);
 UL_DEBUG_DEFINE_MASKNAMES(libblkid) =
 {
 	{ "all", BLKID_DEBUG_ALL,	"info about all subsystems" },
@@ -51,6 +52,7 @@ void blkid_init_debug(int mask)
 		return;
 
 	__UL_INIT_DEBUG_FROM_ENV(libblkid, BLKID_DEBUG_, mask, LIBBLKID_DEBUG);
+	__UL_INIT_TRACE_FROM_ENV(libblkid, LIBBLKID_TRACE);
 
 	if (libblkid_debug_mask != BLKID_DEBUG_INIT
 	    && libblkid_debug_mask != (BLKID_DEBUG_HELP|BLKID_DEBUG_INIT)) {
@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdarg.h>
+#include <pthread.h>
 
 #include "partitions.h"
 #include "sysfs.h"
@@ -123,19 +124,19 @@ static void partitions_free_data(blkid_probe pr, void *data);
  */
 static const struct blkid_idinfo *idinfos[] =
 {
-	&aix_pt_idinfo,
-	&sgi_pt_idinfo,
-	&sun_pt_idinfo,
-	&dos_pt_idinfo,
-	&gpt_pt_idinfo,
-	&pmbr_pt_idinfo,	/* always after GPT */
-	&mac_pt_idinfo,
-	&ultrix_pt_idinfo,
-	&bsd_pt_idinfo,
-	&unixware_pt_idinfo,
-	&solaris_x86_pt_idinfo,
-	&minix_pt_idinfo,
-	&atari_pt_idinfo
+	BLKID_PT_PROBER(aix)
+	BLKID_PT_PROBER(sgi)
+	BLKID_PT_PROBER(sun)
+	BLKID_PT_PROBER(dos)
+	BLKID_PT_PROBER(gpt)
+	BLKID_PT_PROBER(pmbr)	/* always after GPT */
+	BLKID_PT_PROBER(mac)
+	BLKID_PT_PROBER(ultrix)
+	BLKID_PT_PROBER(bsd)
+	BLKID_PT_PROBER(unixware)
+	BLKID_PT_PROBER(solaris_x86)
+	BLKID_PT_PROBER(minix)
+	BLKID_PT_PROBER(atari)
 };
 
 /*
@@ -204,6 +205,32 @@ struct blkid_struct_partlist {
 
 static int blkid_partitions_probe_partition(blkid_probe pr);
 
+/*
+ * Whole-disk partition tables cache. The partition entry probing
+ * (PART_ENTRY_*) needs the partition table of the whole-disk, the cache allows
+ * to parse the table only once per process if more partitions on the same
+ * disk are probed. The entry is validated by fingerprint (device size and
+ * checksums of the areas used by the partition table parser) before used.
+ *
+ * The entries are never modified after added to the cache, the invalid entry
+ * is removed from the cache and deallocated by the last user.
+ */
+struct ptcache_entry {
+	dev_t			devno;		/* whole-disk */
+	char			*devname;
+	blkid_partlist		ls;		/* copy of the list */
+	struct blkid_fprint	*fprint;
+
+	int			refcount;
+	struct list_head	entries;
+};
+
+#define BLKID_PTCACHE_MAX	32
+
+static struct list_head ptcache = { &ptcache, &ptcache };
+static size_t ptcache_nentries;
+static pthread_mutex_t ptcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * blkid_probe_enable_partitions:
  * @pr: probe
@@ -403,6 +430,189 @@ static void partitions_free_data(blkid_probe pr __attribute__((__unused__)),
 	free(ls);
 }
 
+/* returns deep copy of the list */
+static blkid_partlist dup_partlist(blkid_partlist ls)
+{
+	blkid_partlist x;
+	struct list_head *p;
+	int i;
+
+	x = calloc(1, sizeof(struct blkid_struct_partlist));
+	if (!x)
+		return NULL;
+	INIT_LIST_HEAD(&x->l_tabs);
+
+	if (ls->nparts) {
+		x->parts = calloc(ls->nparts, sizeof(struct blkid_struct_partition));
+		if (!x->parts)
+			goto err;
+		memcpy(x->parts, ls->parts, ls->nparts * sizeof(struct blkid_struct_partition));
+		x->nparts = x->nparts_max = ls->nparts;
+	}
+	x->next_partno = ls->next_partno;
+
+	list_for_each(p, &ls->l_tabs) {
+		blkid_parttable tab = list_entry(p, struct blkid_struct_parttable, t_tabs);
+		blkid_parttable t = malloc(sizeof(struct blkid_struct_parttable));
+
+		if (!t)
+			goto err;
+		memcpy(t, tab, sizeof(*t));
+		t->nparts = 0;
+		t->parent = tab->parent ? &x->parts[tab->parent - ls->parts] : NULL;
+		list_add_tail(&t->t_tabs, &x->l_tabs);
+
+		for (i = 0; i < x->nparts; i++) {
+			if (ls->parts[i].tab == tab) {
+				x->parts[i].tab = t;
+				ref_parttable(t);
+			}
+		}
+	}
+	return x;
+err:
+	partitions_free_data(NULL, x);
+	return NULL;
+}
+
+static void ptcache_unref_entry(struct ptcache_entry *e)
+{
+	if (--e->refcount > 0)
+		return;
+
+	DBG(LOWPROBE, ul_debug("parts: ptcache: free entry for %u:%u",
+				major(e->devno), minor(e->devno)));
+	partitions_free_data(NULL, e->ls);
+	blkid_free_fprint(e->fprint);
+	free(e->devname);
+	free(e);
+}
+
+/* the cache has to be locked */
+static void ptcache_remove_entry(struct ptcache_entry *e)
+{
+	list_del_init(&e->entries);
+	ptcache_nentries--;
+	ptcache_unref_entry(e);
+}
+
+/*
+ * Returns valid cache entry for the whole-disk or NULL. Use
+ * ptcache_put_entry() to release the entry.
+ */
+static struct ptcache_entry *ptcache_get_entry(dev_t disk)
+{
+	struct ptcache_entry *e = NULL;
+	struct list_head *p;
+	int fd, rc = 1;
+
+	pthread_mutex_lock(&ptcache_lock);
+	list_for_each(p, &ptcache) {
+		struct ptcache_entry *x = list_entry(p, struct ptcache_entry, entries);
+
+		if (x->devno == disk) {
+			e = x;
+			e->refcount++;
+			/* LRU, move to the begin */
+			list_del(&e->entries);
+			list_add(&e->entries, &ptcache);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ptcache_lock);
+
+	if (!e)
+		return NULL;
+
+	/* verify without lock, the entry is not modified in the cache */
+	fd = open(e->devname, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+	if (fd >= 0) {
+		rc = blkid_fprint_verify(e->fprint, fd);
+		close(fd);
+	}
+
+	if (rc != 0) {
+		DBG(LOWPROBE, ul_debug("parts: ptcache: %s modified", e->devname));
+		pthread_mutex_lock(&ptcache_lock);
+		if (!list_empty(&e->entries))
+			ptcache_remove_entry(e);
+		ptcache_unref_entry(e);
+		pthread_mutex_unlock(&ptcache_lock);
+		return NULL;
+	}
+
+	DBG(LOWPROBE, ul_debug("parts: ptcache: using cached %s", e->devname));
+	return e;
+}
+
+static void ptcache_put_entry(struct ptcache_entry *e)
+{
+	pthread_mutex_lock(&ptcache_lock);
+	ptcache_unref_entry(e);
+	pthread_mutex_unlock(&ptcache_lock);
+}
+
+/*
+ * Adds partitions from the whole-disk prober @disk_pr to the cache. The
+ * fingerprint is moved from the prober to the cache. Returns the new entry
+ * (use ptcache_put_entry() to release it) or NULL.
+ */
+static struct ptcache_entry *ptcache_add_entry(blkid_probe disk_pr,
+					       blkid_partlist ls)
+{
+	struct ptcache_entry *e;
+	struct blkid_fprint *fp;
+	struct list_head *p;
+
+	fp = blkid_probe_fprint_detach(disk_pr);
+	if (!fp)
+		return NULL;
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		goto err;
+
+	INIT_LIST_HEAD(&e->entries);
+	e->refcount = 2;		/* the cache and the caller */
+	e->devno = blkid_probe_get_devno(disk_pr);
+	e->fprint = fp;
+	e->devname = blkid_devno_to_devname(e->devno);
+	e->ls = dup_partlist(ls);
+	if (!e->devname || !e->ls)
+		goto err;
+
+	pthread_mutex_lock(&ptcache_lock);
+
+	/* remove old entry for the same disk */
+	list_for_each(p, &ptcache) {
+		struct ptcache_entry *x = list_entry(p, struct ptcache_entry, entries);
+
+		if (x->devno == e->devno) {
+			ptcache_remove_entry(x);
+			break;
+		}
+	}
+	if (ptcache_nentries >= BLKID_PTCACHE_MAX)
+		ptcache_remove_entry(list_entry(ptcache.prev,
+					struct ptcache_entry, entries));
+
+	list_add(&e->entries, &ptcache);
+	ptcache_nentries++;
+	pthread_mutex_unlock(&ptcache_lock);
+
+	DBG(LOWPROBE, ul_debug("parts: ptcache: added %s [%d partitions]",
+				e->devname, e->ls->nparts));
+	return e;
+err:
+	if (e) {
+		e->fprint = NULL;
+		e->refcount = 1;
+		ptcache_unref_entry(e);
+	}
+	blkid_free_fprint(fp);
+	return NULL;
+}
+
 blkid_parttable blkid_partlist_new_parttable(blkid_partlist ls,
 				const char *type, uint64_t offset)
 {
@@ -725,9 +935,10 @@ int blkid_partitions_do_subprobe(blkid_probe pr, blkid_partition parent,
 static int blkid_partitions_probe_partition(blkid_probe pr)
 {
 	blkid_probe disk_pr = NULL;
+	struct ptcache_entry *cached = NULL;
 	blkid_partlist ls;
 	blkid_partition par;
-	dev_t devno;
+	dev_t devno, disk;
 
 	DBG(LOWPROBE, ul_debug("parts: start probing for partition entry"));
 
@@ -735,17 +946,32 @@ static int blkid_partitions_probe_partition(blkid_probe pr)
 		goto nothing;
 
 	devno = blkid_probe_get_devno(pr);
-	if (!devno)
+	if (!devno || blkid_probe_is_wholedisk(pr))
 		goto nothing;
-
-	disk_pr = blkid_probe_get_wholedisk_probe(pr);
-	if (!disk_pr)
+	disk = blkid_probe_get_wholedisk_devno(pr);
+	if (!disk)
 		goto nothing;
 
-	/* parse PT */
-	ls = blkid_probe_get_partitions(disk_pr);
-	if (!ls)
-		goto nothing;
+	cached = ptcache_get_entry(disk);
+	if (cached)
+		ls = cached->ls;
+	else {
+		disk_pr = blkid_probe_get_wholedisk_probe(pr);
+		if (!disk_pr)
+			goto nothing_disk;
+
+		/* parse PT, record fingerprint for the cache */
+		blkid_probe_fprint_start(disk_pr);
+		ls = blkid_probe_get_partitions(disk_pr);
+		blkid_probe_fprint_end(disk_pr, ls ? 0 : -1);
+		if (!ls)
+			goto nothing_disk;
+		cached = ptcache_add_entry(disk_pr, ls);
+	}
+
+	/* the result depends on the whole-disk partition table */
+	blkid_probe_fprint_add_disk(pr, cached ? cached->fprint : NULL,
+					cached ? cached->devname : NULL);
 
 	par = blkid_partlist_devno_to_partition(ls, devno);
 	if (!par)
@@ -753,7 +979,6 @@ static int blkid_partitions_probe_partition(blkid_probe pr)
 	else {
 		const char *v;
 		blkid_parttable tab = blkid_partition_get_table(par);
-		dev_t disk = blkid_probe_get_devno(disk_pr);
 
 		if (tab) {
 			v = blkid_parttable_get_type(tab);
@@ -797,10 +1022,17 @@ static int blkid_partitions_probe_partition(blkid_probe pr)
 				major(disk), minor(disk));
 	}
 
+	if (cached)
+		ptcache_put_entry(cached);
 	DBG(LOWPROBE, ul_debug("parts: end probing for partition entry [success]"));
 	return BLKID_PROBE_OK;
 
+nothing_disk:
+	/* the whole-disk is not verifiable, don't revalidate the result */
+	blkid_probe_fprint_add_disk(pr, NULL, NULL);
 nothing:
+	if (cached)
+		ptcache_put_entry(cached);
 	DBG(LOWPROBE, ul_debug("parts: end probing for partition entry [nothing]"));
 	return BLKID_PROBE_NONE;
 
@@ -104,12 +104,14 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include "blkidP.h"
 #include "all-io.h"
 #include "sysfs.h"
 #include "strutils.h"
 #include "list.h"
+#include "uring.h"
 
 /*
  * All supported chains
@@ -146,6 +148,7 @@ blkid_probe blkid_new_probe(void)
 		pr->chains[i].enabled = chains_drvs[i]->dflt_enabled;
 	}
 	INIT_LIST_HEAD(&pr->buffers);
+	INIT_LIST_HEAD(&pr->free_buffers);
 	INIT_LIST_HEAD(&pr->values);
 	return pr;
 }
@@ -247,7 +250,9 @@ void blkid_free_probe(blkid_probe pr)
 	if ((pr->flags & BLKID_FL_PRIVATE_FD) && pr->fd >= 0)
 		close(pr->fd);
 	blkid_probe_reset_buffers(pr);
+	blkid_probe_free_buffers_pool(pr);
 	blkid_probe_reset_values(pr);
+	blkid_probe_free_fprint(pr);
 	blkid_free_probe(pr->disk_probe);
 
 	DBG(LOWPROBE, ul_debug("free probe"));
@@ -404,6 +409,7 @@ void blkid_reset_probe(blkid_probe pr)
 
 	blkid_probe_reset_values(pr);
 	blkid_probe_set_wiper(pr, 0, 0);
+	blkid_probe_fprint_reset(pr);
 
 	pr->cur_chain = NULL;
 
@@ -530,41 +536,109 @@ int __blkid_probe_filter_types(blkid_probe pr, int chain, int flag, char *names[
 	return 0;
 }
 
+/*
+ * Returns an unused buffer with space for at least @len bytes. The smallest
+ * suitable buffer from the probe pool is preferred, a new buffer is allocated
+ * only if there is nothing usable in the pool.
+ */
+static struct blkid_bufinfo *alloc_buffer(blkid_probe pr, uint64_t len)
+{
+	struct blkid_bufinfo *bf = NULL;
+	struct list_head *p;
+
+	list_for_each(p, &pr->free_buffers) {
+		struct blkid_bufinfo *x =
+				list_entry(p, struct blkid_bufinfo, bufs);
+
+		if (x->size >= len && (!bf || x->size < bf->size))
+			bf = x;
+	}
+
+	if (bf) {
+		list_del_init(&bf->bufs);
+		pr->nfree_buffers--;
+		DBG(BUFFER, ul_debug("\tpool: reuse size=%"PRIu64" (for len=%"PRIu64")",
+					bf->size, len));
+	} else {
+		/* someone trying to overflow some buffers? */
+		if (len > ULONG_MAX - sizeof(struct blkid_bufinfo)) {
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		/* allocate info and space for data by one malloc call */
+		bf = malloc(sizeof(struct blkid_bufinfo) + len);
+		if (!bf) {
+			errno = ENOMEM;
+			return NULL;
+		}
+		pr->io_allocs++;
+		bf->data = ((unsigned char *) bf) + sizeof(struct blkid_bufinfo);
+		bf->size = len;
+		INIT_LIST_HEAD(&bf->bufs);
+	}
+
+	bf->len = len;
+	bf->off = 0;
+	return bf;
+}
+
+/*
+ * Moves the buffer to the probe pool, or deallocates it if the pool is full.
+ */
+static void release_buffer(blkid_probe pr, struct blkid_bufinfo *bf)
+{
+	list_del_init(&bf->bufs);
+
+	if (pr->nfree_buffers >= BLKID_BUFPOOL_MAX) {
+		free(bf);
+		return;
+	}
+	list_add(&bf->bufs, &pr->free_buffers);
+	pr->nfree_buffers++;
+}
+
+void blkid_probe_free_buffers_pool(blkid_probe pr)
+{
+	while (!list_empty(&pr->free_buffers)) {
+		struct blkid_bufinfo *bf = list_entry(pr->free_buffers.next,
+						struct blkid_bufinfo, bufs);
+		list_del(&bf->bufs);
+		free(bf);
+	}
+	pr->nfree_buffers = 0;
+}
+
 static struct blkid_bufinfo *read_buffer(blkid_probe pr, uint64_t real_off, uint64_t len)
 {
 	ssize_t ret;
 	struct blkid_bufinfo *bf = NULL;
+	TRACE_SCOPE(LOWPROBE, "read_buffer");
 
+	pr->io_syscalls++;
 	if (blkid_llseek(pr->fd, real_off, SEEK_SET) < 0) {
 		errno = 0;
 		return NULL;
 	}
 
-	/* someone trying to overflow some buffers? */
-	if (len > ULONG_MAX - sizeof(struct blkid_bufinfo)) {
-		errno = ENOMEM;
+	bf = alloc_buffer(pr, len);
+	if (!bf)
 		return NULL;
-	}
 
-	/* allocate info and space for data by one malloc call */
-	bf = calloc(1, sizeof(struct blkid_bufinfo) + len);
-	if (!bf) {
-		errno = ENOMEM;
-		return NULL;
-	}
-
-	bf->data = ((unsigned char *) bf) + sizeof(struct blkid_bufinfo);
-	bf->len = len;
 	bf->off = real_off;
-	INIT_LIST_HEAD(&bf->bufs);
 
 	DBG(LOWPROBE, ul_debug("\tread: off=%"PRIu64" len=%"PRIu64"",
 	                       real_off, len));
 
 	ret = read(pr->fd, bf->data, len);
+	pr->io_syscalls++;
+	pr->io_reads++;
+	if (ret > 0)
+		pr->io_bytes += ret;
+
 	if (ret != (ssize_t) len) {
 		DBG(LOWPROBE, ul_debug("\tread failed: %m"));
-		free(bf);
+		release_buffer(pr, bf);
 
 		/* I/O errors on CDROMs are non-fatal to work with hybrid
 		 * audio+data disks */
@@ -589,6 +663,7 @@ static struct blkid_bufinfo *get_cached_buffer(blkid_probe pr, uint64_t off, uin
 				list_entry(p, struct blkid_bufinfo, bufs);
 
 		if (real_off >= x->off && real_off + len <= x->off + x->len) {
+			TRACE_COUNT(BUFFER, "reused_buffers", 1);
 			DBG(BUFFER, ul_debug("\treuse: off=%"PRIu64" len=%"PRIu64" (for off=%"PRIu64" len=%"PRIu64")",
 						x->off, x->len, real_off, len));
 			return x;
@@ -597,6 +672,232 @@ static struct blkid_bufinfo *get_cached_buffer(blkid_probe pr, uint64_t off, uin
 	return NULL;
 }
 
+/*
+ * Returns the read-ahead window for the requested area, @off is offset within
+ * the probing area, the window offset is from the begin of the device.
+ *
+ * Returns BLKID_FL_NORA_{HEAD,TAIL} or 0 if the request is out of the windows.
+ */
+static int get_readahead_window(blkid_probe pr, uint64_t off, uint64_t len,
+				uint64_t *woff, uint64_t *wlen)
+{
+	*wlen = BLKID_READAHEAD_SIZE;
+
+	if (S_ISCHR(pr->mode) || len >= *wlen)
+		return 0;
+
+	if (pr->size <= *wlen || off + len <= *wlen) {
+		/* begin of the area */
+		*woff = pr->off;
+		*wlen = min(*wlen, pr->size);
+		return BLKID_FL_NORA_HEAD;
+	}
+
+	/* end of the area, aligned to 4KiB on the device */
+	*woff = (pr->off + pr->size - *wlen) & ~((uint64_t) 4096 - 1);
+	if (*woff < pr->off)
+		*woff = pr->off;
+	if (pr->off + off < *woff)
+		return 0;
+	*wlen = pr->off + pr->size - *woff;
+	return BLKID_FL_NORA_TAIL;
+}
+
+/*
+ * Reads the whole read-ahead window if the requested area is within the
+ * first or the last BLKID_READAHEAD_SIZE bytes of the probing area. The next
+ * requests for the same window are served from memory by get_cached_buffer().
+ *
+ * Returns NULL if the request is out of the windows or if the window is not
+ * readable; the caller is expected to read the requested area only.
+ */
+static struct blkid_bufinfo *read_readahead_buffer(blkid_probe pr, uint64_t off, uint64_t len)
+{
+	uint64_t woff, wlen;
+	struct blkid_bufinfo *bf;
+	int flag;
+
+	flag = get_readahead_window(pr, off, len, &woff, &wlen);
+	if (!flag || (pr->flags & flag))
+		return NULL;
+
+	DBG(BUFFER, ul_debug("\tread-ahead: off=%"PRIu64" len=%"PRIu64" (for off=%"PRIu64" len=%"PRIu64")",
+				woff, wlen, pr->off + off, len));
+
+	bf = read_buffer(pr, woff, wlen);
+	if (!bf) {
+		/* don't try it again, read only requested areas */
+		pr->flags |= flag;
+		errno = 0;
+	}
+	return bf;
+}
+
+/*
+ * The io_uring instance is shared by all probes in the thread, the setup
+ * (syscall and three mmaps) is more expensive than the prefetch itself.
+ * There are never requests in the ring when prefetch_readahead_buffers()
+ * returns.
+ */
+static pthread_once_t uring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t uring_key;
+static int uring_key_ok;
+
+static void free_thread_uring(void *data)
+{
+	struct ul_uring *ring = data;
+
+	ul_uring_deinit(ring);
+	free(ring);
+}
+
+static void init_uring_key(void)
+{
+	uring_key_ok = pthread_key_create(&uring_key, free_thread_uring) == 0;
+}
+
+/* returns NULL if io_uring is not usable in the current thread */
+static struct ul_uring *get_thread_uring(void)
+{
+	struct ul_uring *ring;
+
+	pthread_once(&uring_once, init_uring_key);
+	if (!uring_key_ok)
+		return NULL;
+
+	ring = pthread_getspecific(uring_key);
+	if (!ring) {
+		ring = malloc(sizeof(struct ul_uring));
+		if (!ring)
+			return NULL;
+		if (ul_uring_init(ring, 2) != 0)
+			DBG(LOWPROBE, ul_debug("io_uring not available"));
+		if (pthread_setspecific(uring_key, ring) != 0) {
+			free_thread_uring(ring);
+			return NULL;
+		}
+	}
+	/* the failed setup is not repeated */
+	return ul_uring_is_ready(ring) ? ring : NULL;
+}
+
+/*
+ * Submits reads of all the read-ahead windows at once by io_uring, so the
+ * probing functions do not wait for more serial reads. This is
+ * important on devices with high latency (iSCSI, NVMe-oF, ...).
+ *
+ * It's a best effort prefetch only. If io_uring is not available or a read
+ * fails then the window is read by read_readahead_buffer() later.
+ */
+static void prefetch_readahead_buffers(blkid_probe pr)
+{
+	struct blkid_bufinfo *bufs[2] = { NULL, NULL };
+	struct ul_uring *ring;
+	uint64_t woff[2], wlen[2];
+	int i, n = 0, res, rc, submitted;
+	int pending[2] = { 0, 0 };
+	uint64_t id;
+
+	if (pr->flags & BLKID_FL_NOURING || pr->parent || pr->fd < 0
+	    || pr->size <= BLKID_READAHEAD_SIZE)
+		return;
+
+	/* only superblocks and partitions read data from the device */
+	if (!pr->chains[BLKID_CHAIN_SUBLKS].enabled &&
+	    !pr->chains[BLKID_CHAIN_PARTS].enabled)
+		return;
+
+	if (!get_readahead_window(pr, 0, 1, &woff[0], &wlen[0]) ||
+	    !get_readahead_window(pr, pr->size - 1, 1, &woff[1], &wlen[1]))
+		return;
+
+	if (pr->flags & (BLKID_FL_NORA_HEAD | BLKID_FL_NORA_TAIL) ||
+	    get_cached_buffer(pr, woff[0] - pr->off, wlen[0]) ||
+	    get_cached_buffer(pr, woff[1] - pr->off, wlen[1]))
+		return;
+
+	ring = get_thread_uring();
+	if (!ring) {
+		pr->flags |= BLKID_FL_NOURING;
+		return;
+	}
+
+	for (i = 0; i < 2; i++) {
+		bufs[i] = alloc_buffer(pr, wlen[i]);
+		if (!bufs[i])
+			break;
+		bufs[i]->off = woff[i];
+		if (ul_uring_prep_rw(ring, UL_URING_READ, pr->fd,
+				bufs[i]->data, wlen[i], woff[i], i) != 0)
+			break;
+		n++;
+	}
+	if (n < 2) {
+		/* drop the prepared requests */
+		ul_uring_deinit(ring);
+		pr->flags |= BLKID_FL_NOURING;
+		goto done;
+	}
+
+	DBG(LOWPROBE, ul_debug("\tprefetch: off=%"PRIu64" len=%"PRIu64", off=%"PRIu64" len=%"PRIu64,
+				woff[0], wlen[0], woff[1], wlen[1]));
+
+	rc = ul_uring_submit(ring, n);
+	pr->io_syscalls++;
+	submitted = rc > 0 ? rc : 0;
+	if (rc != n)
+		DBG(LOWPROBE, ul_debug("\tprefetch: submit failed [rc=%d]", rc));
+
+	/* the requests are submitted in order */
+	for (i = 0; i < submitted; i++)
+		pending[i] = 1;
+
+	/* all the submitted reads have to be completed before the buffers
+	 * are used or released */
+	for (i = 0; i < submitted; i++) {
+		struct blkid_bufinfo *bf;
+
+		rc = ul_uring_wait_completion(ring, &id, &res);
+		if (rc != 1 || id >= 2 || !pending[id]) {
+			DBG(LOWPROBE, ul_debug("\tprefetch: wait failed [rc=%d]", rc));
+			/* the kernel may still write to the pending buffers,
+			 * so they are never reused nor freed */
+			for (i = 0; i < 2; i++) {
+				if (pending[i])
+					bufs[i] = NULL;
+			}
+			n = -1;
+			break;
+		}
+		pending[id] = 0;
+		bf = bufs[id];
+
+		pr->io_reads++;
+		if (res > 0)
+			pr->io_bytes += res;
+
+		if (res != (int) bf->len) {
+			DBG(LOWPROBE, ul_debug("\tprefetch: read failed [off=%"PRIu64", rc=%d]",
+						bf->off, res));
+			continue;
+		}
+		list_add_tail(&bf->bufs, &pr->buffers);
+		bufs[id] = NULL;
+	}
+
+	if (submitted != n) {
+		/* the ring contains not submitted requests or requests in
+		 * unknown state, don't use it anymore */
+		ul_uring_deinit(ring);
+		pr->flags |= BLKID_FL_NOURING;
+	}
+done:
+	for (i = 0; i < 2; i++) {
+		if (bufs[i])
+			release_buffer(pr, bufs[i]);
+	}
+}
+
 /*
  * Zeroize in-memory data in already read buffer. The next blkid_probe_get_buffer()
  * will return modified buffer. This is usable when you want to call the same probing
@@ -675,7 +976,9 @@ unsigned char *blkid_probe_get_buffer(blkid_probe pr, uint64_t off, uint64_t len
 	/* try buffers we already have in memory or read from device */
 	bf = get_cached_buffer(pr, off, len);
 	if (!bf) {
-		bf = read_buffer(pr, real_off, len);
+		bf = read_readahead_buffer(pr, off, len);
+		if (!bf)
+			bf = read_buffer(pr, real_off, len);
 		if (!bf)
 			return NULL;
 
@@ -685,10 +988,45 @@ unsigned char *blkid_probe_get_buffer(blkid_probe pr, uint64_t off, uint64_t len
 	assert(bf->off <= real_off);
 	assert(bf->off + bf->len >= real_off + len);
 
+	blkid_probe_fprint_add(pr, real_off, len, bf->data + (real_off - bf->off));
+
 	errno = 0;
 	return real_off ? bf->data + (real_off - bf->off) : bf->data;
 }
 
+/*
+ * Returns already read data for the area (within the probing area), but
+ * never reads from the device.
+ *
+ * Returns: 0 and @data, 1 if the data are not in memory, or -EINVAL if the
+ * area is out of the probing area.
+ */
+int blkid_probe_peek_buffer(blkid_probe pr, uint64_t off, uint64_t len,
+			    unsigned char **data)
+{
+	struct blkid_bufinfo *bf;
+	uint64_t real_off = pr->off + off;
+
+	if (pr->size == 0 || len == 0 ||
+	    (!S_ISCHR(pr->mode) && pr->off + pr->size < real_off + len))
+		return -EINVAL;
+
+	if (pr->parent &&
+	    pr->parent->devno == pr->devno &&
+	    pr->parent->off <= pr->off &&
+	    pr->parent->off + pr->parent->size >= pr->off + pr->size)
+		return blkid_probe_peek_buffer(pr->parent,
+				pr->off + off - pr->parent->off, len, data);
+
+	bf = get_cached_buffer(pr, off, len);
+	if (!bf)
+		return 1;
+
+	*data = bf->data + (real_off - bf->off);
+	blkid_probe_fprint_add(pr, real_off, len, *data);
+	return 0;
+}
+
 /**
  * blkid_probe_reset_buffers:
  * @pr: prober
@@ -698,13 +1036,16 @@ unsigned char *blkid_probe_get_buffer(blkid_probe pr, uint64_t off, uint64_t len
  * cached bufferes. The next blkid_do_probe() will read all data from the
  * device.
  *
+ * Note that the memory of the buffers is internally reused by the next
+ * probing.
+ *
  * Returns: <0 in case of failure, or 0 on success.
  */
 int blkid_probe_reset_buffers(blkid_probe pr)
 {
 	uint64_t ct = 0, len = 0;
 
-	pr->flags &= ~BLKID_FL_MODIF_BUFF;
+	pr->flags &= ~(BLKID_FL_MODIF_BUFF | BLKID_FL_NORA_HEAD | BLKID_FL_NORA_TAIL);
 
 	if (list_empty(&pr->buffers))
 		return 0;
@@ -720,13 +1061,18 @@ int blkid_probe_reset_buffers(blkid_probe pr)
 
 		DBG(BUFFER, ul_debug(" remove buffer: [off=%"PRIu64", len=%"PRIu64"]",
 		                     bf->off, bf->len));
-		free(bf);
+		release_buffer(pr, bf);
 	}
 
-	DBG(LOWPROBE, ul_debug(" buffers summary: %"PRIu64" bytes by %"PRIu64" read() calls",
-			len, ct));
+	DBG(LOWPROBE, ul_debug(" buffers summary: %"PRIu64" bytes in %"PRIu64" buffers, "
+			      "%"PRIu64" bytes by %"PRIu64" read() calls",
+			len, ct, pr->io_bytes, pr->io_reads));
 
 	INIT_LIST_HEAD(&pr->buffers);
+	pr->io_reads = 0;
+	pr->io_bytes = 0;
+	pr->io_syscalls = 0;
+	pr->io_allocs = 0;
 
 	return 0;
 }
@@ -1051,6 +1397,7 @@ static inline void blkid_probe_start(blkid_probe pr)
 	pr->cur_chain = NULL;
 	pr->prob_flags = 0;
 	blkid_probe_set_wiper(pr, 0, 0);
+	prefetch_readahead_buffers(pr);
 }
 
 static inline void blkid_probe_end(blkid_probe pr)
@@ -1111,6 +1458,7 @@ int blkid_do_probe(blkid_probe pr)
 		struct blkid_chain *chn = pr->cur_chain;
 
 		if (!chn) {
+			blkid_probe_fprint_reset(pr);
 			blkid_probe_start(pr);
 			chn = pr->cur_chain = &pr->chains[0];
 		}
@@ -1364,11 +1712,13 @@ int blkid_probe_step_back(blkid_probe pr)
 int blkid_do_safeprobe(blkid_probe pr)
 {
 	int i, count = 0, rc = 0;
+	TRACE_SCOPE(LOWPROBE, "safeprobe");
 
 	if (pr->flags & BLKID_FL_NOSCAN_DEV)
 		return 1;
 
 	blkid_probe_start(pr);
+	blkid_probe_fprint_start(pr);
 
 	for (i = 0; i < BLKID_NCHAINS; i++) {
 		struct blkid_chain *chn;
@@ -1397,6 +1747,7 @@ int blkid_do_safeprobe(blkid_probe pr)
 	}
 
 done:
+	blkid_probe_fprint_end(pr, rc);
 	blkid_probe_end(pr);
 	if (rc < 0)
 		return rc;
@@ -1423,6 +1774,7 @@ int blkid_do_fullprobe(blkid_probe pr)
 		return 1;
 
 	blkid_probe_start(pr);
+	blkid_probe_fprint_start(pr);
 
 	for (i = 0; i < BLKID_NCHAINS; i++) {
 		struct blkid_chain *chn;
@@ -1451,6 +1803,7 @@ int blkid_do_fullprobe(blkid_probe pr)
 	}
 
 done:
+	blkid_probe_fprint_end(pr, rc);
 	blkid_probe_end(pr);
 	if (rc < 0)
 		return rc;
@@ -2031,3 +2384,107 @@ void blkid_probe_use_wiper(blkid_probe pr, uint64_t off, uint64_t size)
 		blkid_probe_chain_reset_values(pr, chn);
 	}
 }
+
+#ifdef TEST_PROGRAM
+/*
+ * Probing cost statistics for regression tests and benchmarks:
+ *
+ *   test_blkid_probe [--uring] [--repeat <N>] <image> [...]
+ *
+ * The io_uring prefetch is disabled by default, so the numbers do not depend
+ * on the kernel. The wall time is reported only with --repeat.
+ */
+#include <getopt.h>
+#include <time.h>
+
+static int probe_image(const char *filename, int uring, unsigned int repeat)
+{
+	uint64_t start = 0, total = 0;
+	struct timespec ts;
+	unsigned int i;
+	const char *type = NULL;
+	blkid_probe pr = NULL;
+
+	for (i = 0; i < (repeat ? repeat : 1); i++) {
+		blkid_free_probe(pr);
+
+		pr = blkid_new_probe_from_filename(filename);
+		if (!pr) {
+			warn("%s: cannot create prober", filename);
+			return -1;
+		}
+		if (!uring)
+			pr->flags |= BLKID_FL_NOURING;
+
+		blkid_probe_enable_superblocks(pr, 1);
+		blkid_probe_set_superblocks_flags(pr, BLKID_SUBLKS_LABEL |
+				BLKID_SUBLKS_UUID | BLKID_SUBLKS_TYPE |
+				BLKID_SUBLKS_SECTYPE | BLKID_SUBLKS_USAGE |
+				BLKID_SUBLKS_VERSION);
+		blkid_probe_enable_partitions(pr, 1);
+		blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		start = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+		blkid_do_safeprobe(pr);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		total += ts.tv_sec * 1000000000ULL + ts.tv_nsec - start;
+	}
+
+	if (blkid_probe_lookup_value(pr, "TYPE", &type, NULL) != 0 &&
+	    blkid_probe_lookup_value(pr, "PTTYPE", &type, NULL) != 0)
+		type = "<none>";
+
+	printf("%s: type=%s syscalls=%"PRIu64" reads=%"PRIu64" bytes=%"PRIu64" buffers=%"PRIu64,
+			filename, type, pr->io_syscalls, pr->io_reads,
+			pr->io_bytes, pr->io_allocs);
+	if (repeat)
+		printf(" time=%.1fus", total / 1000.0 / repeat);
+	fputc('\n', stdout);
+
+	blkid_free_probe(pr);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int repeat = 0;
+	int c, uring = 0, rc = EXIT_SUCCESS;
+
+	static const struct option longopts[] = {
+		{ "uring",  no_argument,       NULL, 'u' },
+		{ "repeat", required_argument, NULL, 'r' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((c = getopt_long(argc, argv, "ur:", longopts, NULL)) != -1) {
+		switch (c) {
+		case 'u':
+			uring = 1;
+			break;
+		case 'r':
+			repeat = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [--uring] [--repeat <N>] <image> [...]\n",
+					program_invocation_short_name);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind == argc) {
+		fprintf(stderr, "no image specified\n");
+		return EXIT_FAILURE;
+	}
+
+	blkid_init_debug(0);
+
+	for (; optind < argc; optind++) {
+		if (probe_image(argv[optind], uring, repeat) != 0)
+			rc = EXIT_FAILURE;
+	}
+	return rc;
+}
+#endif /* TEST_PROGRAM */
@@ -43,6 +43,10 @@
  *	                 read from disk
  *	<TYPE="type">	(detected) type of filesystem/data for this partition
  *
+ *	The following tags are optional
+ *	<SECTORS="num">	sysfs size of the device (512-byte sectors) when
+ *			the device was probed
+ *
  *	The following tags may be present, depending on the device contents
  *	<LABEL="label">	(user supplied) label (volume name, etc)
  *	<UUID="uuid">	(generated) universally unique identifier (serial no)
@@ -302,6 +306,8 @@ static int parse_tag(blkid_cache cache, blkid_dev dev, char **cp)
 		dev->bid_devno = strtoull(value, NULL, 0);
 	else if (!strcmp(name, "PRI"))
 		dev->bid_pri = strtol(value, NULL, 0);
+	else if (!strcmp(name, "SECTORS"))
+		dev->bid_sectors = strtoull(value, NULL, 0);
 	else if (!strcmp(name, "TIME")) {
 		char *end = NULL;
 		dev->bid_time = strtoull(value, &end, 0);
@@ -382,13 +388,33 @@ void blkid_read_cache(blkid_cache cache)
 		goto errout;
 	}
 
-	DBG(CACHE, ul_debug("reading cache file %s",
-				cache->bic_filename));
-
 	file = fdopen(fd, "r" UL_CLOEXECSTR);
 	if (!file)
 		goto errout;
 
+	/* the new file is merged with all the already known devices */
+	blkid_bincache_load_all(cache);
+
+	if (cache->bic_flags & BLKID_BIC_FL_BINARY) {
+		char *bin = blkid_get_bincache_filename(cache->bic_filename);
+		uint64_t generation = 0;
+		int rc = -1;
+
+		/* the binary cache is usable only if written with the text file,
+		 * the devices are read from the mapped file when requested */
+		if (bin && blkid_read_cache_generation(file, &generation) == 0)
+			rc = blkid_bincache_open(cache, bin, generation);
+		free(bin);
+		if (rc == 0) {
+			fclose(file);
+			goto done;
+		}
+		rewind(file);
+	}
+
+	DBG(CACHE, ul_debug("reading cache file %s",
+				cache->bic_filename));
+
 	while (fgets(buf, sizeof(buf), file)) {
 		blkid_dev dev;
 		unsigned int end;
@@ -410,7 +436,7 @@ void blkid_read_cache(blkid_cache cache)
 		}
 	}
 	fclose(file);
-
+done:
 	/*
 	 * Initially we do not need to write out the cache file.
 	 */
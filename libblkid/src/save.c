@@ -59,6 +59,8 @@ static int save_dev(blkid_dev dev, FILE *file)
 
 	if (dev->bid_pri)
 		fprintf(file, " PRI=\"%d\"", dev->bid_pri);
+	if (dev->bid_sectors)
+		fprintf(file, " SECTORS=\"%ju\"", (uintmax_t) dev->bid_sectors);
 
 	list_for_each(p, &dev->bid_tags) {
 		blkid_tag tag = list_entry(p, struct blkid_struct_tag, bit_tags);
@@ -82,8 +84,10 @@ int blkid_flush_cache(blkid_cache cache)
 	char *tmp = NULL;
 	char *opened = NULL;
 	char *filename;
+	char *bin = NULL;
 	FILE *file = NULL;
-	int fd, ret = 0;
+	uint64_t generation = 0;
+	int fd, lockfd = -1, ret = 0;
 	struct stat st;
 
 	if (list_empty(&cache->bic_devs) ||
@@ -92,6 +96,10 @@ int blkid_flush_cache(blkid_cache cache)
 		return 0;
 	}
 
+	/* write all devices, not only the devices already used */
+	if (blkid_bincache_load_all(cache) != 0)
+		return -BLKID_ERR_MEM;
+
 	filename = cache->bic_filename ? cache->bic_filename :
 					 blkid_get_cache_filename(NULL);
 	if (!filename)
@@ -120,6 +128,17 @@ int blkid_flush_cache(blkid_cache cache)
 		return 0;
 	}
 
+	/*
+	 * The generation, both files and the renames are serialized by the
+	 * lock, so the files with the same generation have the same content.
+	 * Without the lock the binary cache is not written.
+	 */
+	if (cache->bic_flags & BLKID_BIC_FL_BINARY) {
+		lockfd = blkid_bincache_lock(filename);
+		if (lockfd >= 0)
+			bin = blkid_get_bincache_filename(filename);
+	}
+
 	/*
 	 * Try and create a temporary file in the same directory so
 	 * that in case of error we don't overwrite the cache file.
@@ -156,6 +175,13 @@ int blkid_flush_cache(blkid_cache cache)
 		goto errout;
 	}
 
+	/* the binary cache is used only with the same generation */
+	if (bin) {
+		generation = blkid_bincache_next_generation(bin);
+		fprintf(file, BLKID_BINCACHE_GENERATION "%ju\n",
+				(uintmax_t) generation);
+	}
+
 	list_for_each(p, &cache->bic_devs) {
 		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
 		if (!dev->bid_type || (dev->bid_flags & BLKID_BID_FL_REMOVABLE))
@@ -199,7 +225,15 @@ int blkid_flush_cache(blkid_cache cache)
 		}
 	}
 
+	if (ret == 1 && generation
+	    && stat(filename, &st) == 0 && S_ISREG(st.st_mode)
+	    && blkid_bincache_save(cache, bin, generation) != 0)
+		DBG(SAVE, ul_debug("can't write binary cache %s", bin));
+
 errout:
+	if (lockfd >= 0)
+		close(lockfd);
+	free(bin);
 	free(tmp);
 	if (filename != cache->bic_filename)
 		free(filename);
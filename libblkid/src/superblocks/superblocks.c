@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <pthread.h>
 
 #include "superblocks.h"
 
@@ -90,86 +91,173 @@ static int blkid_probe_set_usage(blkid_probe pr, int usage);
 static const struct blkid_idinfo *idinfos[] =
 {
 	/* RAIDs */
-	&linuxraid_idinfo,
-	&ddfraid_idinfo,
-	&iswraid_idinfo,
-	&lsiraid_idinfo,
-	&viaraid_idinfo,
-	&silraid_idinfo,
-	&nvraid_idinfo,
-	&pdcraid_idinfo,
-	&highpoint45x_idinfo,
-	&highpoint37x_idinfo,
-	&adraid_idinfo,
-	&jmraid_idinfo,
-
-	&bcache_idinfo,
-	&bluestore_idinfo,
-	&drbd_idinfo,
-	&drbdmanage_idinfo,
-	&drbdproxy_datalog_idinfo,
-	&lvm2_idinfo,
-	&lvm1_idinfo,
-	&snapcow_idinfo,
-	&verity_hash_idinfo,
-	&integrity_idinfo,
-	&luks_idinfo,
-	&vmfs_volume_idinfo,
-	&ubi_idinfo,
-	&vdo_idinfo,
-	&stratis_idinfo,
-	&bitlocker_idinfo,
+	BLKID_PROBER(linuxraid)
+	BLKID_PROBER(ddfraid)
+	BLKID_PROBER(iswraid)
+	BLKID_PROBER(lsiraid)
+	BLKID_PROBER(viaraid)
+	BLKID_PROBER(silraid)
+	BLKID_PROBER(nvraid)
+	BLKID_PROBER(pdcraid)
+	BLKID_PROBER(highpoint45x)
+	BLKID_PROBER(highpoint37x)
+	BLKID_PROBER(adraid)
+	BLKID_PROBER(jmraid)
+
+	BLKID_PROBER(bcache)
+	BLKID_PROBER(bluestore)
+	BLKID_PROBER(drbd)
+	BLKID_PROBER(drbdmanage)
+	BLKID_PROBER(drbdproxy_datalog)
+	BLKID_PROBER(lvm2)
+	BLKID_PROBER(lvm1)
+	BLKID_PROBER(snapcow)
+	BLKID_PROBER(verity_hash)
+	BLKID_PROBER(integrity)
+	BLKID_PROBER(luks)
+	BLKID_PROBER(vmfs_volume)
+	BLKID_PROBER(ubi)
+	BLKID_PROBER(vdo)
+	BLKID_PROBER(stratis)
+	BLKID_PROBER(bitlocker)
 
 	/* Filesystems */
-	&vfat_idinfo,
-	&swsuspend_idinfo,
-	&swap_idinfo,
-	&xfs_idinfo,
-	&xfs_log_idinfo,
-	&exfs_idinfo,
-	&ext4dev_idinfo,
-	&ext4_idinfo,
-	&ext3_idinfo,
-	&ext2_idinfo,
-	&jbd_idinfo,
-	&reiser_idinfo,
-	&reiser4_idinfo,
-	&jfs_idinfo,
-	&udf_idinfo,
-	&iso9660_idinfo,
-	&zfs_idinfo,
-	&hfsplus_idinfo,
-	&hfs_idinfo,
-	&ufs_idinfo,
-	&hpfs_idinfo,
-	&sysv_idinfo,
-        &xenix_idinfo,
-	&ntfs_idinfo,
-	&refs_idinfo,
-	&cramfs_idinfo,
-	&romfs_idinfo,
-	&minix_idinfo,
-	&gfs_idinfo,
-	&gfs2_idinfo,
-	&ocfs_idinfo,
-	&ocfs2_idinfo,
-	&oracleasm_idinfo,
-	&vxfs_idinfo,
-	&squashfs_idinfo,
-	&squashfs3_idinfo,
-	&netware_idinfo,
-	&btrfs_idinfo,
-	&ubifs_idinfo,
-	&bfs_idinfo,
-	&vmfs_fs_idinfo,
-	&befs_idinfo,
-	&nilfs2_idinfo,
-	&exfat_idinfo,
-	&f2fs_idinfo,
-	&mpool_idinfo,
-	&apfs_idinfo
+	BLKID_PROBER(vfat)
+	BLKID_PROBER(swsuspend)
+	BLKID_PROBER(swap)
+	BLKID_PROBER(xfs)
+	BLKID_PROBER(xfs_log)
+	BLKID_PROBER(exfs)
+	BLKID_PROBER(ext4dev)
+	BLKID_PROBER(ext4)
+	BLKID_PROBER(ext3)
+	BLKID_PROBER(ext2)
+	BLKID_PROBER(jbd)
+	BLKID_PROBER(reiser)
+	BLKID_PROBER(reiser4)
+	BLKID_PROBER(jfs)
+	BLKID_PROBER(udf)
+	BLKID_PROBER(iso9660)
+	BLKID_PROBER(zfs)
+	BLKID_PROBER(hfsplus)
+	BLKID_PROBER(hfs)
+	BLKID_PROBER(ufs)
+	BLKID_PROBER(hpfs)
+	BLKID_PROBER(sysv)
+	BLKID_PROBER(xenix)
+	BLKID_PROBER(ntfs)
+	BLKID_PROBER(refs)
+	BLKID_PROBER(cramfs)
+	BLKID_PROBER(romfs)
+	BLKID_PROBER(minix)
+	BLKID_PROBER(gfs)
+	BLKID_PROBER(gfs2)
+	BLKID_PROBER(ocfs)
+	BLKID_PROBER(ocfs2)
+	BLKID_PROBER(oracleasm)
+	BLKID_PROBER(vxfs)
+	BLKID_PROBER(squashfs)
+	BLKID_PROBER(squashfs3)
+	BLKID_PROBER(netware)
+	BLKID_PROBER(btrfs)
+	BLKID_PROBER(ubifs)
+	BLKID_PROBER(bfs)
+	BLKID_PROBER(vmfs_fs)
+	BLKID_PROBER(befs)
+	BLKID_PROBER(nilfs2)
+	BLKID_PROBER(exfat)
+	BLKID_PROBER(f2fs)
+	BLKID_PROBER(mpool)
+	BLKID_PROBER(apfs)
 };
 
+/*
+ * Magic strings index -- all magic strings from idinfos[] sorted by offset.
+ * The index is used to check all magic strings in already read buffers by one
+ * pass before the probing loop, so the loop skips probers without any chance
+ * to match.
+ */
+#define MAGIC_INDEX_MAX		256
+
+struct magic_index_entry {
+	uint64_t			off;	/* 1KiB aligned offset of the buffer */
+	unsigned int			sboff;	/* offset of the magic within the buffer */
+	const struct blkid_idmag	*mag;
+	size_t				idx;	/* idinfos[] index */
+};
+
+static struct magic_index_entry magic_index[MAGIC_INDEX_MAX];
+static size_t magic_index_sz;
+static pthread_once_t magic_index_once = PTHREAD_ONCE_INIT;
+
+static int cmp_magic_index_entry(const void *a, const void *b)
+{
+	const struct magic_index_entry *x = a, *y = b;
+
+	if (x->off == y->off)
+		return x->idx < y->idx ? -1 : x->idx > y->idx;
+	return x->off < y->off ? -1 : 1;
+}
+
+static void init_magic_index(void)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag;
+
+		for (mag = &idinfos[i]->magics[0]; mag->magic; mag++) {
+			if (n == MAGIC_INDEX_MAX) {
+				/* too many magic strings, don't use the index */
+				magic_index_sz = 0;
+				return;
+			}
+			magic_index[n].off = (mag->kboff + (mag->sboff >> 10)) << 10;
+			magic_index[n].sboff = mag->sboff & 0x3ff;
+			magic_index[n].mag = mag;
+			magic_index[n].idx = i;
+			n++;
+		}
+	}
+
+	qsort(magic_index, n, sizeof(struct magic_index_entry),
+			cmp_magic_index_entry);
+	magic_index_sz = n;
+}
+
+/*
+ * Marks in @nomagic all probers where no magic string could match the data
+ * already in memory. The probers with magic strings in not yet read areas are
+ * not marked, as well as probers without magic strings.
+ */
+static void mark_impossible_magics(blkid_probe pr, unsigned long *nomagic)
+{
+	unsigned char *buf = NULL;
+	uint64_t off = 0;
+	size_t i;
+	int rc = -EINVAL;
+
+	pthread_once(&magic_index_once, init_magic_index);
+
+	for (i = 0; i < magic_index_sz; i++)
+		blkid_bmp_set_item(nomagic, magic_index[i].idx);
+
+	for (i = 0; i < magic_index_sz; i++) {
+		const struct magic_index_entry *e = &magic_index[i];
+
+		if (i == 0 || e->off != off) {
+			off = e->off;
+			rc = blkid_probe_peek_buffer(pr, off, 1024, &buf);
+		}
+
+		if (rc == -EINVAL)
+			continue;		/* out of device */
+		if (rc == 1 || memcmp(e->mag->magic, buf + e->sboff, e->mag->len) == 0)
+			/* not read yet or found */
+			blkid_bmp_unset_item(nomagic, e->idx);
+	}
+}
+
 /*
  * Driver definition
  */
@@ -339,6 +427,7 @@ int blkid_superblocks_get_name(size_t idx, const char **name, int *usage)
  */
 static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 {
+	unsigned long nomagic[blkid_bmp_nwords(ARRAY_SIZE(idinfos))];
 	size_t i;
 	int rc = BLKID_PROBE_NONE;
 
@@ -363,6 +452,14 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 	DBG(LOWPROBE, ul_debug("--> starting probing loop [SUBLKS idx=%d]",
 		chn->idx));
 
+	/* read the begin of the device (likely the whole read-ahead window)
+	 * to check the most of the magic strings at once */
+	if (!blkid_probe_get_buffer(pr, 0, 1024))
+		errno = 0;
+
+	memset(nomagic, 0, sizeof(nomagic));
+	mark_impossible_magics(pr, nomagic);
+
 	i = chn->idx < 0 ? 0 : chn->idx + 1U;
 
 	for ( ; i < ARRAY_SIZE(idinfos); i++) {
@@ -397,6 +494,11 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 			continue;
 		}
 
+		if (blkid_bmp_get_item(nomagic, i)) {
+			rc = BLKID_PROBE_NONE;
+			continue;	/* magic strings do not match */
+		}
+
 		DBG(LOWPROBE, ul_debug("[%zd] %s:", i, id->name));
 
 		rc = blkid_probe_get_idmag(pr, id, &off, &mag);
@@ -332,6 +332,7 @@ blkid_dev blkid_find_dev_with_tag(blkid_cache cache,
 		return NULL;
 
 	blkid_read_cache(cache);
+	blkid_bincache_load_tag(cache, type, value);
 
 	DBG(TAG, ul_debug("looking for %s=%s in cache", type, value));
 
@@ -39,6 +39,13 @@ static struct topology_val {
 	{ "queue/physical_block_size", blkid_topology_set_physical_sector_size },
 };
 
+static int read_val(struct path_cxt *pc, struct topology_val *val, int64_t *data)
+{
+	if (val->set_ulong)
+		return ul_path_read_u64(pc, (uint64_t *) data, val->attr);
+	return ul_path_read_s64(pc, data, val->attr);
+}
+
 static int probe_sysfs_tp(blkid_probe pr,
 		const struct blkid_idmag *mag __attribute__((__unused__)))
 {
@@ -56,9 +63,14 @@ static int probe_sysfs_tp(blkid_probe pr,
 
 	rc = 1;		/* nothing (default) */
 
+	/*
+	 * The attributes are read relative to the device directory file
+	 * descriptor, without access() before every read.
+	 */
 	for (i = 0; i < ARRAY_SIZE(topology_vals); i++) {
 		struct topology_val *val = &topology_vals[i];
-		int ok = ul_path_access(pc, F_OK, val->attr) == 0;
+		int64_t data;
+		int ok = read_val(pc, val, &data) == 0;
 
 		rc = 1;	/* nothing */
 
@@ -80,26 +92,20 @@ static int probe_sysfs_tp(blkid_probe pr,
 				ul_unref_path(parent);
 
 				/* try it again */
-				ok = ul_path_access(pc, F_OK, val->attr) == 0;
+				ok = read_val(pc, val, &data) == 0;
 			}
 		}
 		if (!ok)
 			continue;	/* attribute does not exist */
 
-		if (val->set_ulong) {
-			uint64_t data;
+		/* the kernel knows the topology, the fallbacks are useless */
+		if (strncmp(val->attr, "queue/", 6) == 0)
+			pr->prob_flags |= BLKID_PROBE_FL_SYSFS_TP;
 
-			if (ul_path_read_u64(pc, &data, val->attr) != 0)
-				continue;
-			rc = val->set_ulong(pr, (unsigned long) data);
-
-		} else if (val->set_int) {
-			int64_t data;
-
-			if (ul_path_read_s64(pc, &data, val->attr) != 0)
-				continue;
+		if (val->set_ulong)
+			rc = val->set_ulong(pr, (unsigned long) (uint64_t) data);
+		else if (val->set_int)
 			rc = val->set_int(pr, (int) data);
-		}
 
 		if (rc < 0)
 			goto done;	/* error */
@@ -71,12 +71,17 @@ struct blkid_struct_topology {
 
 /*
  * Topology chain probing functions
+ *
+ * The sysfs attributes are the primary source, the ioctls are used if sysfs
+ * is not available (e.g. in a container). The other probers are fallbacks
+ * for old kernels, they are not used if the kernel exports the topology by
+ * sysfs (see BLKID_PROBE_FL_SYSFS_TP).
  */
 static const struct blkid_idinfo *idinfos[] =
 {
 #ifdef __linux__
-	&ioctl_tp_idinfo,
 	&sysfs_tp_idinfo,
+	&ioctl_tp_idinfo,
 	&md_tp_idinfo,
 	&dm_tp_idinfo,
 	&lvm_tp_idinfo,
@@ -84,6 +89,109 @@ static const struct blkid_idinfo *idinfos[] =
 #endif
 };
 
+/* the fallbacks for kernels without topology in sysfs */
+static int is_fallback_prober(const struct blkid_idinfo *id)
+{
+#ifdef __linux__
+	return id == &md_tp_idinfo || id == &dm_tp_idinfo
+	       || id == &lvm_tp_idinfo || id == &evms_tp_idinfo;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Per-thread cache of the results, the topology is probed by mkfs-like
+ * programs again and again for the same device. The cache is used for the
+ * lifetime of the process (thread), the device size is part of the key to
+ * detect re-used device numbers (e.g. loop devices).
+ */
+#ifdef HAVE_TLS
+# define TOPOLOGY_CACHE_SIZE	8
+
+struct topology_cache_entry {
+	dev_t				devno;
+	uint64_t			size;
+	int				rc;	/* BLKID_PROBE_{OK,NONE} */
+	struct blkid_struct_topology	tp;
+};
+
+static __thread struct topology_cache_entry topology_cache[TOPOLOGY_CACHE_SIZE];
+static __thread size_t topology_cache_next;
+
+static struct topology_cache_entry *topology_cache_get(blkid_probe pr, int create)
+{
+	dev_t devno = blkid_probe_get_devno(pr);
+	struct topology_cache_entry *ce;
+	size_t i;
+
+	if (!devno)
+		return NULL;
+	for (i = 0; i < TOPOLOGY_CACHE_SIZE; i++) {
+		ce = &topology_cache[i];
+		if (ce->devno == devno && ce->size == (uint64_t) pr->size)
+			return ce;
+	}
+	if (!create)
+		return NULL;
+
+	ce = &topology_cache[topology_cache_next++ % TOPOLOGY_CACHE_SIZE];
+	memset(ce, 0, sizeof(*ce));
+	ce->devno = devno;
+	ce->size = pr->size;
+	return ce;
+}
+
+static unsigned long lookup_ulong(blkid_probe pr, const char *name)
+{
+	struct blkid_prval *v = __blkid_probe_lookup_value(pr, name);
+
+	return v && v->data ? strtoul((char *) v->data, NULL, 10) : 0;
+}
+
+/* stores the probing result to the cache */
+static void topology_cache_save(blkid_probe pr, struct blkid_chain *chn, int rc)
+{
+	struct topology_cache_entry *ce = topology_cache_get(pr, 1);
+
+	if (!ce)
+		return;
+	ce->rc = rc;
+	if (rc != BLKID_PROBE_OK)
+		return;
+
+	if (chn->binary && chn->data)
+		memcpy(&ce->tp, chn->data, sizeof(ce->tp));
+	else {
+		ce->tp.alignment_offset = lookup_ulong(pr, "ALIGNMENT_OFFSET");
+		ce->tp.minimum_io_size = lookup_ulong(pr, "MINIMUM_IO_SIZE");
+		ce->tp.optimal_io_size = lookup_ulong(pr, "OPTIMAL_IO_SIZE");
+		ce->tp.physical_sector_size = lookup_ulong(pr, "PHYSICAL_SECTOR_SIZE");
+	}
+}
+
+/* returns the probing result from the cache or -1 */
+static int topology_cache_load(blkid_probe pr)
+{
+	struct topology_cache_entry *ce = topology_cache_get(pr, 0);
+
+	if (!ce)
+		return -1;
+	if (ce->rc != BLKID_PROBE_OK)
+		return ce->rc;
+
+	DBG(LOWPROBE, ul_debug("topology: use cached result"));
+
+	if (blkid_topology_set_alignment_offset(pr, (int) ce->tp.alignment_offset)
+	    || blkid_topology_set_minimum_io_size(pr, ce->tp.minimum_io_size)
+	    || blkid_topology_set_optimal_io_size(pr, ce->tp.optimal_io_size)
+	    || blkid_topology_set_physical_sector_size(pr, ce->tp.physical_sector_size)
+	    || topology_set_logical_sector_size(pr))
+		return -1;
+	return BLKID_PROBE_OK;
+}
+#endif /* HAVE_TLS */
+
 
 /*
  * Driver definition
@@ -143,6 +251,7 @@ blkid_topology blkid_probe_get_topology(blkid_probe pr)
 static int topology_probe(blkid_probe pr, struct blkid_chain *chn)
 {
 	size_t i;
+	int first = chn->idx < 0;	/* not continuing by blkid_do_probe() */
 
 	if (chn->idx < -1)
 		return -1;
@@ -167,6 +276,22 @@ static int topology_probe(blkid_probe pr, struct blkid_chain *chn)
 
 	blkid_probe_chain_reset_values(pr, chn);
 
+#ifdef HAVE_TLS
+	if (first) {
+		int rc = topology_cache_load(pr);
+
+		if (rc >= 0) {
+			chn->idx = ARRAY_SIZE(idinfos) - 1;
+			return rc;
+		}
+		/* failed, probe again */
+		blkid_probe_chain_reset_values(pr, chn);
+		if (chn->binary && chn->data)
+			memset(chn->data, 0, sizeof(struct blkid_struct_topology));
+	}
+#endif
+	pr->prob_flags &= ~BLKID_PROBE_FL_SYSFS_TP;
+
 	DBG(LOWPROBE, ul_debug("--> starting probing loop [TOPOLOGY idx=%d]",
 		chn->idx));
 
@@ -177,6 +302,10 @@ static int topology_probe(blkid_probe pr, struct blkid_chain *chn)
 
 		chn->idx = i;
 
+		if ((pr->prob_flags & BLKID_PROBE_FL_SYSFS_TP)
+		    && is_fallback_prober(id))
+			continue;
+
 		if (id->probefunc) {
 			DBG(LOWPROBE, ul_debug("%s: call probefunc()", id->name));
 			if (id->probefunc(pr, NULL) != 0)
@@ -191,11 +320,19 @@ static int topology_probe(blkid_probe pr, struct blkid_chain *chn)
 
 		DBG(LOWPROBE, ul_debug("<-- leaving probing loop (type=%s) [TOPOLOGY idx=%d]",
 			id->name, chn->idx));
+#ifdef HAVE_TLS
+		if (first)
+			topology_cache_save(pr, chn, BLKID_PROBE_OK);
+#endif
 		return BLKID_PROBE_OK;
 	}
 
 	DBG(LOWPROBE, ul_debug("<-- leaving probing loop (failed) [TOPOLOGY idx=%d]",
 		chn->idx));
+#ifdef HAVE_TLS
+	if (first)
+		topology_cache_save(pr, chn, BLKID_PROBE_NONE);
+#endif
 	return BLKID_PROBE_NONE;
 }
 
@@ -22,6 +22,8 @@
 
 #include "blkidP.h"
 #include "sysfs.h"
+#include "path.h"
+#include "pathnames.h"
 
 static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
 {
@@ -49,6 +51,101 @@ static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
 	}
 }
 
+/* reads the sysfs size of the device, or 0 */
+static uint64_t read_sectors(dev_t devno)
+{
+	char path[sizeof(_PATH_SYS_DEVBLOCK) + 64];
+	uint64_t sectors;
+
+	snprintf(path, sizeof(path), _PATH_SYS_DEVBLOCK "/%u:%u/size",
+		 major(devno), minor(devno));
+
+	if (ul_path_read_u64(NULL, &sectors, path) != 0)
+		return 0;
+	return sectors;
+}
+
+/*
+ * Returns 1 if @dev has been probed less than BLKID_PROBE_MIN seconds ago
+ * and the device node @st has not been modified since the time.
+ *
+ * Note that writes to the block device don't have to generate any event (the
+ * uevent seqnum is not changed without udev's inotify watch), so the cached
+ * data are never trusted for a longer time.
+ */
+int blkid_verify_is_recent(blkid_dev dev, const struct stat *st, time_t now)
+{
+	return now >= dev->bid_time &&
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	    (st->st_mtime < dev->bid_time ||
+	        (st->st_mtime == dev->bid_time &&
+		 st->st_mtim.tv_nsec / 1000 <= dev->bid_utime)) &&
+#else
+	    st->st_mtime <= dev->bid_time &&
+#endif
+	    now - dev->bid_time < BLKID_PROBE_MIN;
+}
+
+/* setup @pr to probe the information stored in the cache */
+void blkid_verify_setup_probe(blkid_probe pr)
+{
+	/* enable superblocks probing */
+	blkid_probe_enable_superblocks(pr, TRUE);
+	blkid_probe_set_superblocks_flags(pr,
+		BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
+		BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE);
+
+	/* enable partitions probing */
+	blkid_probe_enable_partitions(pr, TRUE);
+	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
+}
+
+/*
+ * Replaces the cached information about @dev by result from @pr, @rc is
+ * the blkid_do_safeprobe() return code. The @dev is deallocated if nothing
+ * has been found. Returns @dev or NULL.
+ */
+blkid_dev blkid_verify_update(blkid_cache cache, blkid_dev dev,
+			      blkid_probe pr, int rc, dev_t devno)
+{
+	blkid_tag_iterate iter;
+	const char *type, *value;
+
+	if (rc) {
+		/* found nothing or error */
+		blkid_free_dev(dev);
+		return NULL;
+	}
+
+	/* remove old cache info */
+	iter = blkid_tag_iterate_begin(dev);
+	while (blkid_tag_next(iter, &type, &value) == 0)
+		blkid_set_tag(dev, type, NULL, 0);
+	blkid_tag_iterate_end(iter);
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	{
+		struct timeval tv;
+		if (!gettimeofday(&tv, NULL)) {
+			dev->bid_time = tv.tv_sec;
+			dev->bid_utime = tv.tv_usec;
+		} else
+			dev->bid_time = time(NULL);
+	}
+#else
+	dev->bid_time = time(NULL);
+#endif
+	dev->bid_devno = devno;
+	dev->bid_flags |= BLKID_BID_FL_VERIFIED;
+	cache->bic_flags |= BLKID_BIC_FL_CHANGED;
+
+	blkid_probe_to_tags(pr, dev);
+
+	DBG(PROBE, ul_debug("%s: devno 0x%04llx, type %s",
+		   dev->bid_name, (long long) devno, dev->bid_type));
+	return dev;
+}
+
 /*
  * Verify that the data in dev is consistent with what is on the actual
  * block device (using the devname field only).  Normally this will be
@@ -60,10 +157,9 @@ static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
  */
 blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 {
-	blkid_tag_iterate iter;
-	const char *type, *value;
 	struct stat st;
 	time_t diff, now;
+	uint64_t sectors = 0;
 	int fd;
 
 	if (!dev || !cache)
@@ -87,19 +183,14 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 		return NULL;
 	}
 
-	if (now >= dev->bid_time &&
-#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
-	    (st.st_mtime < dev->bid_time ||
-	        (st.st_mtime == dev->bid_time &&
-		 st.st_mtim.tv_nsec / 1000 <= dev->bid_utime)) &&
-#else
-	    st.st_mtime <= dev->bid_time &&
-#endif
-	    diff < BLKID_PROBE_MIN) {
+	if (blkid_verify_is_recent(dev, &st, now)) {
 		dev->bid_flags |= BLKID_BID_FL_VERIFIED;
 		return dev;
 	}
 
+	if (S_ISBLK(st.st_mode))
+		sectors = read_sectors(st.st_rdev);
+
 #ifndef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
 	DBG(PROBE, ul_debug("need to revalidate %s (cache time %lu, stat time %lu,\t"
 		   "time since last check %lu)",
@@ -141,48 +232,11 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 		return NULL;
 	}
 
-	/* remove old cache info */
-	iter = blkid_tag_iterate_begin(dev);
-	while (blkid_tag_next(iter, &type, &value) == 0)
-		blkid_set_tag(dev, type, NULL, 0);
-	blkid_tag_iterate_end(iter);
-
-	/* enable superblocks probing */
-	blkid_probe_enable_superblocks(cache->probe, TRUE);
-	blkid_probe_set_superblocks_flags(cache->probe,
-		BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
-		BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE);
-
-	/* enable partitions probing */
-	blkid_probe_enable_partitions(cache->probe, TRUE);
-	blkid_probe_set_partitions_flags(cache->probe, BLKID_PARTS_ENTRY_DETAILS);
-
-	/* probe */
-	if (blkid_do_safeprobe(cache->probe)) {
-		/* found nothing or error */
-		blkid_free_dev(dev);
-		dev = NULL;
-	}
-
-	if (dev) {
-#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
-		struct timeval tv;
-		if (!gettimeofday(&tv, NULL)) {
-			dev->bid_time = tv.tv_sec;
-			dev->bid_utime = tv.tv_usec;
-		} else
-#endif
-			dev->bid_time = time(NULL);
-
-		dev->bid_devno = st.st_rdev;
-		dev->bid_flags |= BLKID_BID_FL_VERIFIED;
-		cache->bic_flags |= BLKID_BIC_FL_CHANGED;
-
-		blkid_probe_to_tags(cache->probe, dev);
-
-		DBG(PROBE, ul_debug("%s: devno 0x%04llx, type %s",
-			   dev->bid_name, (long long)st.st_rdev, dev->bid_type));
-	}
+	blkid_verify_setup_probe(cache->probe);
+	dev = blkid_verify_update(cache, dev, cache->probe,
+				  blkid_do_safeprobe(cache->probe), st.st_rdev);
+	if (dev)
+		dev->bid_sectors = sectors;
 
 	/* reset prober */
 	blkid_probe_reset_superblocks_filter(cache->probe);
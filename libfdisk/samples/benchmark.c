@@ -0,0 +1,572 @@
+/*
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * Creates a sparse image with a large partition table and measures the
+ * library; create and add partitions, write, read (probe), list and
+ * free space. For example:
+ *
+ *	sample-fdisk-benchmark --label gpt --nparts 4096 --bulk
+ *
+ * The report contains time, number of allocations, read and write syscalls
+ * (from /proc/self/io) and read and written bytes for each phase. The image
+ * is removed at the end, unless specified by --image.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "c.h"
+#include "nls.h"
+#include "strutils.h"
+#include "xalloc.h"
+
+#include "libfdisk.h"
+
+/*
+ * Allocation counter; the library functions are interposed by the program
+ * and the glibc internal functions are used for the real allocations.
+ */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+# define HAVE_ALLOC_COUNTER 1
+
+extern void *__libc_malloc(size_t sz);
+extern void *__libc_calloc(size_t n, size_t sz);
+extern void *__libc_realloc(void *p, size_t sz);
+extern void *__libc_memalign(size_t align, size_t sz);
+
+static size_t nallocs;
+
+void *malloc(size_t sz)
+{
+	nallocs++;
+	return __libc_malloc(sz);
+}
+
+void *calloc(size_t n, size_t sz)
+{
+	nallocs++;
+	return __libc_calloc(n, sz);
+}
+
+void *realloc(void *p, size_t sz)
+{
+	nallocs++;
+	return __libc_realloc(p, sz);
+}
+
+int posix_memalign(void **p, size_t align, size_t sz)
+{
+	nallocs++;
+	*p = __libc_memalign(align, sz);
+	return *p ? 0 : ENOMEM;
+}
+#endif /* __GLIBC__ */
+
+struct bench_ctl {
+	const char	*label;		/* gpt, dos, sun, sgi or bsd */
+	const char	*image;
+	size_t		nparts;		/* requested number of partitions */
+	size_t		nadded;		/* really added partitions */
+	uint64_t	partsize;	/* in bytes */
+	uint64_t	size;		/* image size in bytes */
+
+	unsigned int	bulk : 1,	/* use fdisk_apply_table() */
+			keep : 1;	/* don't remove the image */
+};
+
+/* I/O counters from /proc/self/io */
+struct bench_io {
+	uint64_t	rchar;
+	uint64_t	wchar;
+	uint64_t	syscr;
+	uint64_t	syscw;
+};
+
+struct bench_phase {
+	const char	*name;
+	double		time;
+	size_t		nallocs;
+	struct bench_io	io;
+	size_t		iosz;		/* counters read at start */
+};
+
+static double get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t get_nallocs(void)
+{
+#ifdef HAVE_ALLOC_COUNTER
+	return nallocs;
+#else
+	return 0;
+#endif
+}
+
+/* returns number of bytes read from /proc/self/io */
+static size_t get_io(struct bench_io *io)
+{
+	char buf[BUFSIZ];
+	ssize_t sz;
+	char *p;
+	int fd;
+
+	memset(io, 0, sizeof(*io));
+
+	fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	sz = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (sz <= 0)
+		return 0;
+	buf[sz] = '\0';
+
+	for (p = buf; p && *p; p = strchr(p, '\n'), p = p ? p + 1 : NULL) {
+		uint64_t *x = NULL;
+
+		if (startswith(p, "rchar:"))
+			x = &io->rchar;
+		else if (startswith(p, "wchar:"))
+			x = &io->wchar;
+		else if (startswith(p, "syscr:"))
+			x = &io->syscr;
+		else if (startswith(p, "syscw:"))
+			x = &io->syscw;
+		if (x)
+			*x = strtoull(strchr(p, ':') + 1, NULL, 10);
+	}
+	return sz;
+}
+
+static void phase_start(struct bench_phase *ph, const char *name)
+{
+	ph->name = name;
+	ph->iosz = get_io(&ph->io);
+	ph->nallocs = get_nallocs();
+	ph->time = get_time();
+}
+
+static void phase_end(struct bench_phase *ph)
+{
+	struct bench_io io;
+
+	ph->time = get_time() - ph->time;
+	ph->nallocs = get_nallocs() - ph->nallocs;
+
+	/* the read of the counters at start is not measured */
+	get_io(&io);
+	ph->io.rchar = io.rchar - ph->io.rchar - ph->iosz;
+	ph->io.wchar = io.wchar - ph->io.wchar;
+	ph->io.syscr = io.syscr - ph->io.syscr - (ph->iosz ? 1 : 0);
+	ph->io.syscw = io.syscw - ph->io.syscw;
+}
+
+/*
+ * The benchmark is not interactive, all dialogs (e.g. SUN geometry) use
+ * the default answers.
+ */
+static int ask_callback(struct fdisk_context *cxt __attribute__((__unused__)),
+			struct fdisk_ask *ask,
+			void *data __attribute__((__unused__)))
+{
+	switch(fdisk_ask_get_type(ask)) {
+	case FDISK_ASKTYPE_NUMBER:
+	case FDISK_ASKTYPE_OFFSET:
+		fdisk_ask_number_set_result(ask, fdisk_ask_number_get_default(ask));
+		break;
+	case FDISK_ASKTYPE_YESNO:
+		fdisk_ask_yesno_set_result(ask, 1);
+		break;
+	case FDISK_ASKTYPE_MENU:
+		fdisk_ask_menu_set_result(ask, fdisk_ask_menu_get_default(ask));
+		break;
+	case FDISK_ASKTYPE_WARNX:
+		fputs(fdisk_ask_print_get_mesg(ask), stderr);
+		fputc('\n', stderr);
+		break;
+	case FDISK_ASKTYPE_WARN:
+		fputs(fdisk_ask_print_get_mesg(ask), stderr);
+		errno = fdisk_ask_print_get_errno(ask);
+		fprintf(stderr, ": %m\n");
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+static struct fdisk_context *new_context(void)
+{
+	struct fdisk_context *cxt = fdisk_new_context();
+
+	if (!cxt)
+		err_oom();
+	fdisk_set_ask(cxt, ask_callback, NULL);
+	return cxt;
+}
+
+static void create_image(struct bench_ctl *ctl)
+{
+	int fd;
+
+	if (!ctl->image) {
+		static char tmpl[] = "/tmp/fdisk-benchmark-XXXXXX";
+
+		fd = mkstemp(tmpl);
+		ctl->image = tmpl;
+	} else {
+		fd = open(ctl->image, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		ctl->keep = 1;
+	}
+	if (fd < 0)
+		err(EXIT_FAILURE, "cannot create %s", ctl->image);
+	if (ftruncate(fd, ctl->size) != 0)
+		err(EXIT_FAILURE, "cannot resize %s", ctl->image);
+	close(fd);
+}
+
+/*
+ * BSD label has to be nested in a DOS partition; creates the parent DOS label
+ * and returns the nested context.
+ */
+static struct fdisk_context *create_bsd_parent(struct fdisk_context *cxt)
+{
+	struct fdisk_context *bsd;
+	struct fdisk_partition *pa;
+	struct fdisk_parttype *type;
+
+	if (fdisk_create_disklabel(cxt, "dos"))
+		err(EXIT_FAILURE, "failed to create DOS label");
+
+	pa = fdisk_new_partition();
+	type = fdisk_label_parse_parttype(fdisk_get_label(cxt, NULL), "a5");
+	if (!pa || !type)
+		err_oom();
+	fdisk_partition_set_partno(pa, 0);
+	fdisk_partition_start_follow_default(pa, 1);
+	fdisk_partition_end_follow_default(pa, 1);
+	fdisk_partition_set_type(pa, type);
+
+	if (fdisk_add_partition(cxt, pa, NULL) || fdisk_write_disklabel(cxt))
+		errx(EXIT_FAILURE, "failed to create BSD parent partition");
+	fdisk_unref_parttype(type);
+	fdisk_unref_partition(pa);
+
+	bsd = fdisk_new_nested_context(cxt, "bsd");
+	if (!bsd)
+		err(EXIT_FAILURE, "failed to create nested context");
+	return bsd;
+}
+
+static struct fdisk_partition *new_template(struct bench_ctl *ctl,
+					    struct fdisk_context *cxt, size_t n)
+{
+	struct fdisk_partition *pa = fdisk_new_partition();
+	size_t sectorsize = fdisk_get_sector_size(cxt);
+
+	if (!pa)
+		err_oom();
+
+	fdisk_partition_start_follow_default(pa, 1);
+	fdisk_partition_set_size(pa, ctl->partsize / sectorsize);
+
+	if (fdisk_is_label(cxt, DOS)) {
+		/* primary, primary, primary, extended (rest of the disk) and logical */
+		fdisk_partition_set_partno(pa, n);
+		if (n == 3) {
+			struct fdisk_parttype *type = fdisk_label_parse_parttype(
+					fdisk_get_label(cxt, NULL), "05");
+			if (!type)
+				err_oom();
+			fdisk_partition_set_type(pa, type);
+			fdisk_unref_parttype(type);
+			fdisk_partition_unset_size(pa);
+			fdisk_partition_end_follow_default(pa, 1);
+		}
+	} else
+		fdisk_partition_partno_follow_default(pa, 1);
+
+	return pa;
+}
+
+static void add_partitions(struct bench_ctl *ctl, struct fdisk_context *cxt)
+{
+	struct fdisk_table *tb = NULL;
+	size_t i, max = fdisk_get_npartitions(cxt);
+
+	/* partitions created by label (e.g. SUN whole disk) */
+	for (i = 0; i < max; i++) {
+		if (fdisk_is_partition_used(cxt, i))
+			fdisk_delete_partition(cxt, i);
+	}
+
+	if (ctl->bulk) {
+		tb = fdisk_new_table();
+		if (!tb)
+			err_oom();
+	}
+
+	for (i = 0; i < ctl->nparts; i++) {
+		struct fdisk_partition *pa;
+		int rc;
+
+		/* DOS logical partitions are not limited */
+		if (i >= max && !fdisk_is_label(cxt, DOS))
+			break;
+
+		pa = new_template(ctl, cxt, i);
+
+		if (tb)
+			rc = fdisk_table_add_partition(tb, pa);
+		else
+			rc = fdisk_add_partition(cxt, pa, NULL);
+		fdisk_unref_partition(pa);
+		if (rc == -ERANGE && i)
+			break;		/* label is full */
+		if (rc)
+			errx(EXIT_FAILURE, "failed to add #%zu partition", i + 1);
+	}
+
+	if (tb) {
+		int rc = fdisk_apply_table(cxt, tb);
+
+		if (rc == -ERANGE)
+			errx(EXIT_FAILURE, "too many partitions for %s label", ctl->label);
+		if (rc)
+			errx(EXIT_FAILURE, "failed to apply partitions");
+		fdisk_unref_table(tb);
+	}
+}
+
+static size_t count_partitions(struct fdisk_context *cxt)
+{
+	size_t i, n = 0, max = fdisk_get_npartitions(cxt);
+
+	for (i = 0; i < max; i++) {
+		if (fdisk_is_partition_used(cxt, i))
+			n++;
+	}
+	return n;
+}
+
+static void list_partitions(struct fdisk_context *cxt)
+{
+	static const int fields[] = {
+		FDISK_FIELD_DEVICE, FDISK_FIELD_START, FDISK_FIELD_END,
+		FDISK_FIELD_SECTORS, FDISK_FIELD_SIZE, FDISK_FIELD_TYPE
+	};
+	struct fdisk_table *tb = NULL;
+	struct fdisk_partition *pa;
+	struct fdisk_iter *itr;
+	size_t i;
+
+	itr = fdisk_new_iter(FDISK_ITER_FORWARD);
+	if (!itr || fdisk_get_partitions(cxt, &tb))
+		errx(EXIT_FAILURE, "failed to read partitions");
+
+	while (fdisk_table_next_partition(tb, itr, &pa) == 0) {
+		for (i = 0; i < ARRAY_SIZE(fields); i++) {
+			char *data = NULL;
+
+			fdisk_partition_to_string(pa, cxt, fields[i], &data);
+			free(data);
+		}
+	}
+	fdisk_free_iter(itr);
+	fdisk_unref_table(tb);
+}
+
+static void list_freespace(struct fdisk_context *cxt)
+{
+	struct fdisk_table *tb = NULL;
+
+	if (fdisk_get_freespaces(cxt, &tb))
+		errx(EXIT_FAILURE, "failed to read free space");
+	fdisk_unref_table(tb);
+}
+
+static void print_report(struct bench_ctl *ctl, struct bench_phase *phases,
+			 size_t nphases)
+{
+	struct rusage ru;
+	size_t i;
+
+	printf("label: %s, partitions: %zu, image: %s\n", ctl->label,
+			ctl->nadded, ctl->image);
+	printf("%-10s %10s %8s %8s %8s %12s %12s\n",
+			"PHASE", "TIME", "ALLOCS", "READS", "WRITES",
+			"READ-BYTES", "WRITE-BYTES");
+
+	for (i = 0; i < nphases; i++) {
+		struct bench_phase *ph = &phases[i];
+
+		printf("%-10s %9.3fs %8zu %8ju %8ju %12ju %12ju\n",
+				ph->name, ph->time, ph->nallocs,
+				(uintmax_t) ph->io.syscr, (uintmax_t) ph->io.syscw,
+				(uintmax_t) ph->io.rchar, (uintmax_t) ph->io.wchar);
+	}
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		printf("peak RSS: %ld KiB\n", ru.ru_maxrss);
+}
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	FILE *out = stdout;
+	fprintf(out,
+		"\n %s [options]\n\n", program_invocation_short_name);
+
+	fputs(" -x, --label <name>             gpt, dos, sun, sgi or bsd (default gpt)\n", out);
+	fputs(" -n, --nparts <num>             number of partitions (default 128)\n", out);
+	fputs(" -p, --partsize <size>          size of the partitions (default 1M)\n", out);
+	fputs(" -s, --size <size>              size of the image (default by partitions)\n", out);
+	fputs(" -b, --bulk                     add partitions by fdisk_apply_table()\n", out);
+	fputs(" -i, --image <file>             use and keep the image file\n", out);
+	fputs(" -h, --help                     this help\n", out);
+	fputs("\n", out);
+
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_ctl ctl = {
+		.label = "gpt",
+		.nparts = 128,
+		.partsize = 1024 * 1024
+	};
+	struct bench_phase phases[6];
+	struct fdisk_context *cxt, *parent = NULL;
+	size_t nphases = 0;
+	int c, bsd;
+
+	static const struct option longopts[] = {
+		{ "label",    1, NULL, 'x' },
+		{ "nparts",   1, NULL, 'n' },
+		{ "partsize", 1, NULL, 'p' },
+		{ "size",     1, NULL, 's' },
+		{ "bulk",     0, NULL, 'b' },
+		{ "image",    1, NULL, 'i' },
+		{ "help",     0, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+
+	setlocale(LC_ALL, "");	/* just to have enable UTF8 chars */
+	fdisk_init_debug(0);
+
+	while((c = getopt_long(argc, argv, "bhi:n:p:s:x:", longopts, NULL)) != -1) {
+		switch(c) {
+		case 'x':
+			ctl.label = optarg;
+			break;
+		case 'n':
+			ctl.nparts = strtou32_or_err(optarg, "failed to parse number of partitions");
+			break;
+		case 'p':
+			ctl.partsize = strtosize_or_err(optarg, "failed to parse partition size");
+			break;
+		case 's':
+			ctl.size = strtosize_or_err(optarg, "failed to parse image size");
+			break;
+		case 'b':
+			ctl.bulk = 1;
+			break;
+		case 'i':
+			ctl.image = optarg;
+			break;
+		case 'h':
+			usage();
+		default:
+			errtryhelp(EXIT_FAILURE);
+		}
+	}
+
+	bsd = strcmp(ctl.label, "bsd") == 0;
+	if (!ctl.size)
+		/* the partitions, metadata and alignment */
+		ctl.size = (ctl.nparts + 2) * ctl.partsize
+			   + (ctl.nparts + 64) * 1024 * 1024;
+
+	create_image(&ctl);
+
+	/* create */
+	cxt = new_context();
+	phase_start(&phases[nphases], "create");
+	if (fdisk_assign_device(cxt, ctl.image, 0))
+		err(EXIT_FAILURE, "failed to assign %s", ctl.image);
+	if (bsd) {
+		parent = cxt;
+		cxt = create_bsd_parent(parent);
+	}
+	if (fdisk_create_disklabel(cxt, ctl.label))
+		err(EXIT_FAILURE, "failed to create %s label", ctl.label);
+	if (fdisk_is_label(cxt, GPT) && ctl.nparts > fdisk_get_npartitions(cxt)
+	    && fdisk_gpt_set_npartitions(cxt, ctl.nparts))
+		errx(EXIT_FAILURE, "failed to resize GPT entries array");
+	phase_end(&phases[nphases++]);
+
+	/* add */
+	fdisk_disable_dialogs(cxt, 1);
+	phase_start(&phases[nphases], ctl.bulk ? "apply" : "add");
+	add_partitions(&ctl, cxt);
+	phase_end(&phases[nphases++]);
+
+	/* write */
+	phase_start(&phases[nphases], "write");
+	if (fdisk_write_disklabel(cxt))
+		err(EXIT_FAILURE, "failed to write disk label");
+	if (fdisk_deassign_device(parent ? parent : cxt, 0))
+		err(EXIT_FAILURE, "failed to close %s", ctl.image);
+	phase_end(&phases[nphases++]);
+
+	fdisk_unref_context(cxt);
+	fdisk_unref_context(parent);
+	parent = NULL;
+
+	/* read */
+	cxt = new_context();
+	phase_start(&phases[nphases], "read");
+	if (fdisk_assign_device(cxt, ctl.image, 1))
+		err(EXIT_FAILURE, "failed to assign %s", ctl.image);
+	if (bsd) {
+		parent = cxt;
+		cxt = fdisk_new_nested_context(parent, "bsd");
+		if (!cxt)
+			err(EXIT_FAILURE, "failed to create nested context");
+	}
+	if (!fdisk_has_label(cxt)
+	    || strcmp(fdisk_label_get_name(fdisk_get_label(cxt, NULL)), ctl.label) != 0)
+		errx(EXIT_FAILURE, "%s label not found", ctl.label);
+	phase_end(&phases[nphases++]);
+
+	/* list */
+	phase_start(&phases[nphases], "list");
+	list_partitions(cxt);
+	phase_end(&phases[nphases++]);
+
+	/* free space */
+	phase_start(&phases[nphases], "freespace");
+	list_freespace(cxt);
+	phase_end(&phases[nphases++]);
+
+	ctl.nadded = count_partitions(cxt);
+
+	fdisk_unref_context(cxt);
+	fdisk_unref_context(parent);
+
+	print_report(&ctl, phases, nphases);
+
+	if (!ctl.keep)
+		unlink(ctl.image);
+	return EXIT_SUCCESS;
+}
@@ -670,6 +670,7 @@ int fdisk_assign_device(struct fdisk_context *cxt,
 			const char *fname, int readonly)
 {
 	int fd, rc;
+	TRACE_SCOPE(CXT, "assign_device");
 
 	DBG(CXT, ul_debugobj(cxt, "assigning device %s", fname));
 	assert(cxt);
@@ -10,6 +10,7 @@
 #include "randutils.h"
 #include "pt-mbr.h"
 #include "strutils.h"
+#include "all-io.h"
 
 #include "fdiskP.h"
 
@@ -18,6 +19,9 @@
 #define MAXIMUM_PARTS	60
 #define ACTIVE_FLAG     0x80
 
+#define EBR_WINDOW_MAX	(1024 * 1024)	/* max. size of the EBR read-ahead */
+#define EBR_WINDOW_NUM	8		/* EBRs in one read-ahead */
+
 /**
  * SECTION: dos
  * @title: DOS
@@ -50,6 +54,19 @@ struct pte {
 		     private_sectorbuffer : 1;
 };
 
+/*
+ * EBR read-ahead used when the extended partition is read. If the distance
+ * between the EBRs is regular then the next EBRs are read together with the
+ * current one by one read() and the next read_pte() calls copy the sectors
+ * from the buffer.
+ */
+struct ebr_window {
+	unsigned char	*buf;
+	size_t		bufsz;		/* allocated size */
+	fdisk_sector_t	start;		/* first sector in the buffer */
+	fdisk_sector_t	nsects;		/* number of sectors in the buffer */
+};
+
 /*
  * in-memory fdisk GPT stuff
  */
@@ -244,8 +261,64 @@ static int read_sector(struct fdisk_context *cxt, fdisk_sector_t secno,
 	return -1;
 }
 
-/* Allocate a buffer and read a partition table sector */
-static int read_pte(struct fdisk_context *cxt, size_t pno, fdisk_sector_t offset)
+/*
+ * Reads sectors from @offset to the window, the size of the window is
+ * EBR_WINDOW_NUM * @stride aligned to I/O size. Returns 0 if the sector
+ * @offset is in the window.
+ */
+static int read_ebr_window(struct fdisk_context *cxt, struct ebr_window *win,
+			   fdisk_sector_t offset, fdisk_sector_t stride)
+{
+	fdisk_sector_t max = EBR_WINDOW_MAX / cxt->sector_size;
+	fdisk_sector_t grain = max(cxt->io_size / cxt->sector_size, 1UL);
+	fdisk_sector_t start, end;
+	size_t sz;
+	ssize_t r;
+
+	win->nsects = 0;
+
+	if (stride > max / 2)
+		return 1;		/* read-ahead for one EBR only */
+
+	start = offset - (offset % grain);
+	end = offset + min(stride * (EBR_WINDOW_NUM - 1) + 1, max);
+	end = ((end + grain - 1) / grain) * grain;
+	end = min(end, start + max);
+	if (end > cxt->total_sectors)
+		end = cxt->total_sectors;
+	if (end <= offset)
+		return 1;
+
+	sz = (end - start) * cxt->sector_size;
+	if (sz > win->bufsz) {
+		unsigned char *tmp = realloc(win->buf, sz);
+
+		if (!tmp)
+			return -ENOMEM;
+		win->buf = tmp;
+		win->bufsz = sz;
+	}
+
+	DBG(LABEL, ul_debug("DOS: EBR read-ahead: start=%ju, sectors=%ju",
+				(uintmax_t) start, (uintmax_t) (end - start)));
+
+	if (seek_sector(cxt, start) < 0)
+		return -errno;
+	r = read_all(cxt->dev_fd, (char *) win->buf, sz);
+	if (r < 0)
+		return -errno;
+
+	win->start = start;
+	win->nsects = r / cxt->sector_size;
+
+	return offset < win->start + win->nsects ? 0 : 1;
+}
+
+/* Allocate a buffer and read a partition table sector, @win (may be NULL) is
+ * used for EBRs read in advance, the @stride is expected distance to the
+ * next EBR or zero */
+static int read_pte(struct fdisk_context *cxt, size_t pno, fdisk_sector_t offset,
+		    struct ebr_window *win, fdisk_sector_t stride)
 {
 	int rc;
 	unsigned char *buf;
@@ -265,7 +338,17 @@ static int read_pte(struct fdisk_context *cxt, size_t pno, fdisk_sector_t offset
 	pe->sectorbuffer = buf;
 	pe->private_sectorbuffer = 1;
 
-	rc = read_sector(cxt, offset, pe->sectorbuffer);
+	if (win && !(offset >= win->start && offset < win->start + win->nsects)
+	    && stride && read_ebr_window(cxt, win, offset, stride) != 0)
+		win->nsects = 0;
+
+	if (win && offset >= win->start && offset < win->start + win->nsects) {
+		memcpy(pe->sectorbuffer,
+		       win->buf + (offset - win->start) * cxt->sector_size,
+		       cxt->sector_size);
+		rc = 0;
+	} else
+		rc = read_sector(cxt, offset, pe->sectorbuffer);
 	if (rc) {
 		fdisk_warn(cxt, _("Failed to read extended partition table "
 				"(offset=%ju)"), (uintmax_t) offset);
@@ -520,6 +603,8 @@ static void read_extended(struct fdisk_context *cxt, size_t ext)
 	struct pte *pex, *pe;
 	struct dos_partition *p, *q;
 	struct fdisk_dos_label *l = self_label(cxt);
+	struct ebr_window win = { .buf = NULL };
+	fdisk_sector_t last = 0, last_stride = 0;
 
 	l->ext_index = ext;
 	pex = self_pte(cxt, ext);
@@ -538,6 +623,8 @@ static void read_extended(struct fdisk_context *cxt, size_t ext)
 	DBG(LABEL, ul_debug("DOS: Reading extended %zu", ext));
 
 	while (IS_EXTENDED (p->sys_ind)) {
+		fdisk_sector_t offset, stride = 0;
+
 		if (cxt->label->nparts_max >= MAXIMUM_PARTS) {
 			/* This is not a Linux restriction, but
 			   this program uses arrays of size MAXIMUM_PARTS.
@@ -554,16 +641,31 @@ static void read_extended(struct fdisk_context *cxt, size_t ext)
 				partition_set_changed(cxt,
 						cxt->label->nparts_max - 1, 1);
 			}
+			free(win.buf);
 			return;
 		}
 
 		pe = self_pte(cxt, cxt->label->nparts_max);
-		if (!pe)
+		if (!pe) {
+			free(win.buf);
 			return;
+		}
+
+		/* read-ahead only for the chain with the same distance
+		 * between the last three EBRs */
+		offset = l->ext_offset + dos_partition_get_start(p);
+		if (last && offset > last) {
+			if (offset - last == last_stride)
+				stride = last_stride;
+			last_stride = offset - last;
+		} else
+			last_stride = 0;
+		last = offset;
 
-		if (read_pte(cxt, cxt->label->nparts_max, l->ext_offset +
-						dos_partition_get_start(p)))
+		if (read_pte(cxt, cxt->label->nparts_max, offset, &win, stride)) {
+			free(win.buf);
 			return;
+		}
 
 		if (!l->ext_offset)
 			l->ext_offset = dos_partition_get_start(p);
@@ -623,6 +725,8 @@ static void read_extended(struct fdisk_context *cxt, size_t ext)
 
 	}
 
+	free(win.buf);
+
 	/* remove last empty EBR */
 	pe = self_pte(cxt, cxt->label->nparts_max - 1);
 	if (pe &&
@@ -1370,7 +1474,11 @@ static int add_logical(struct fdisk_context *cxt,
 
 	DBG(LABEL, ul_debug("DOS: nparts max: %zu", cxt->label->nparts_max));
 	pe = self_pte(cxt, cxt->label->nparts_max);
-	assert(pe);
+	if (!pe) {
+		fdisk_info(cxt, _("The maximum number of partitions has "
+				  "been created."));
+		return -ERANGE;
+	}
 
 	if (!pe->sectorbuffer) {
 		pe->sectorbuffer = calloc(1, cxt->sector_size);
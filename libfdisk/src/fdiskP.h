@@ -23,6 +23,7 @@
 
 #include "list.h"
 #include "debug.h"
+#include "debugtrace.h"
 #include <stdio.h>
 #include <stdarg.h>
 
@@ -46,6 +47,10 @@
 UL_DEBUG_DECLARE_MASK(libfdisk);
 #define DBG(m, x)	__UL_DBG(libfdisk, LIBFDISK_DEBUG_, m, x)
 #define ON_DBG(m, x)	__UL_DBG_CALL(libfdisk, LIBFDISK_DEBUG_, m, x)
+
+UL_TRACE_DECLARE(libfdisk);
+#define TRACE_SCOPE(m, n)	__UL_TRACE_SCOPE(libfdisk, LIBFDISK_DEBUG_, m, n)
+#define TRACE_COUNT(m, n, x)	__UL_TRACE_COUNT(libfdisk, LIBFDISK_DEBUG_, m, n, x)
 #define DBG_FLUSH	__UL_DBG_FLUSH(libfdisk, LIBFDISK_DEBUG_)
 
 #define UL_DEBUG_CURRENT_MASK	UL_DEBUG_MASK(libfdisk)
@@ -227,6 +232,8 @@ struct fdisk_label_operations {
 	/* new partition */
 	int (*add_part)(struct fdisk_context *cxt, struct fdisk_partition *pa,
 						size_t *partno);
+	/* end of bulk add, see fdisk_apply_table() */
+	int (*add_part_done)(struct fdisk_context *cxt);
 	/* delete partition */
 	int (*del_part)(struct fdisk_context *cxt, size_t partnum);
 
@@ -280,6 +287,7 @@ struct fdisk_label {
 
 	size_t			nparts_max;	/* maximal number of partitions */
 	size_t			nparts_cur;	/* number of currently used partitions */
+	size_t			bulk_partno;	/* bulk add: all partitions below are used */
 
 	int			flags;		/* FDISK_LABEL_FL_* flags */
 
@@ -287,7 +295,8 @@ struct fdisk_label {
 	struct fdisk_geometry	geom_max;	/* maximal geometry */
 
 	unsigned int		changed:1,	/* label has been modified */
-				disabled:1;	/* this driver is disabled at all */
+				disabled:1,	/* this driver is disabled at all */
+				bulk:1;		/* fdisk_apply_table() in progress */
 
 	const struct fdisk_field *fields;	/* all possible fields */
 	size_t			nfields;
@@ -13,6 +13,7 @@
 #include <sys/stat.h>
 #include <sys/utsname.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -165,6 +166,8 @@ static struct fdisk_parttype gpt_parttypes[] =
 /*
  * in-memory fdisk GPT stuff
  */
+struct gpt_layout;
+
 struct fdisk_gpt_label {
 	struct fdisk_label	head;		/* generic part */
 
@@ -174,6 +177,8 @@ struct fdisk_gpt_label {
 
 	unsigned char *ents;			/* entries (partitions) */
 
+	struct gpt_layout *bulk_layout;		/* free space, cached by bulk add */
+
 	unsigned int no_relocate :1,		/* do not fix backup location */
 		     minimize :1;
 };
@@ -891,7 +896,7 @@ static int valid_pmbr(struct fdisk_context *cxt)
 					   "will be corrected by write."),
 					sz_lba, cxt->total_sectors - 1ULL);
 
-			/* Note that gpt_write_pmbr() overwrites PMBR, but we want to keep it valid already
+			/* Note that gpt_init_pmbr() overwrites PMBR, but we want to keep it valid already
 			 * in memory too to disable warnings when valid_pmbr() called next time */
 			pmbr->partition_record[part].size_in_lba  =
 				cpu_to_le32((uint32_t) min( cxt->total_sectors - 1ULL, 0xFFFFFFFFULL) );
@@ -928,26 +933,55 @@ static uint64_t last_lba(struct fdisk_context *cxt)
 	return sectors;
 }
 
+/* reads @bytes by pread(), returns 0 on success */
+static int read_bytes(struct fdisk_context *cxt, uint64_t offset,
+		      void *buffer, size_t bytes)
+{
+	unsigned char *p = buffer;
+
+	while (bytes > 0) {
+		ssize_t ret = pread(cxt->dev_fd, p, bytes, (off_t) offset);
+
+		if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (ret <= 0)
+			return -1;
+		p += ret;
+		offset += ret;
+		bytes -= ret;
+	}
+	return 0;
+}
+
 static ssize_t read_lba(struct fdisk_context *cxt, uint64_t lba,
 			void *buffer, const size_t bytes)
 {
-	off_t offset = lba * cxt->sector_size;
-
-	if (lseek(cxt->dev_fd, offset, SEEK_SET) == (off_t) -1)
-		return -1;
-	return (size_t)read(cxt->dev_fd, buffer, bytes) != bytes;
+	return read_bytes(cxt, lba * cxt->sector_size, buffer, bytes) != 0;
 }
 
+/*
+ * The header and the default size entries array are usually adjacent (the
+ * array is behind the primary header and in front of the backup header), so
+ * both are read by one read() and gpt_read_entries() uses the already read
+ * data if possible.
+ */
+#define GPT_READAHEAD_BYTES	(GPT_NPARTITIONS * sizeof(struct gpt_entry))
+
+struct gpt_readahead {
+	unsigned char	*buf;
+	uint64_t	offset;		/* in bytes */
+	size_t		size;
+};
 
 /* Returns the GPT entry array */
 static unsigned char *gpt_read_entries(struct fdisk_context *cxt,
-					 struct gpt_header *header)
+				       struct gpt_header *header,
+				       struct gpt_readahead *ra)
 {
 	size_t sz = 0;
-	ssize_t ssz;
 
 	unsigned char *ret = NULL;
-	off_t offset;
+	uint64_t offset;
 
 	assert(cxt);
 	assert(header);
@@ -960,18 +994,18 @@ static unsigned char *gpt_read_entries(struct fdisk_context *cxt,
 		return NULL;
 	}
 
-	ret = calloc(1, sz);
+	ret = malloc(sz);
 	if (!ret)
 		return NULL;
 
-	offset = (off_t) le64_to_cpu(header->partition_entry_lba) *
-		       cxt->sector_size;
+	offset = le64_to_cpu(header->partition_entry_lba) * cxt->sector_size;
 
-	if (offset != lseek(cxt->dev_fd, offset, SEEK_SET))
-		goto fail;
-
-	ssz = read(cxt->dev_fd, ret, sz);
-	if (ssz < 0 || (size_t) ssz != sz)
+	if (ra && ra->buf && offset >= ra->offset
+	    && offset - ra->offset <= ra->size
+	    && sz <= ra->size - (offset - ra->offset)) {
+		DBG(GPT, ul_debug("entries array already read"));
+		memcpy(ret, ra->buf + (offset - ra->offset), sz);
+	} else if (read_bytes(cxt, offset, ret, sz) != 0)
 		goto fail;
 
 	return ret;
@@ -1108,7 +1142,9 @@ static struct gpt_header *gpt_read_header(struct fdisk_context *cxt,
 					  unsigned char **_ents)
 {
 	struct gpt_header *header = NULL;
+	struct gpt_readahead ra = { .buf = NULL };
 	unsigned char *ents = NULL;
+	uint64_t nsects;
 	uint32_t hsz;
 
 	if (!cxt)
@@ -1122,8 +1158,28 @@ static struct gpt_header *gpt_read_header(struct fdisk_context *cxt,
 	if (!header)
 		return NULL;
 
+	/* read the header together with the entries array */
+	nsects = (GPT_READAHEAD_BYTES + cxt->sector_size - 1) / cxt->sector_size;
+	if (lba == GPT_PRIMARY_PARTITION_TABLE_LBA)
+		ra.offset = lba * cxt->sector_size;
+	else if (lba > nsects)
+		ra.offset = (lba - nsects) * cxt->sector_size;
+	else
+		nsects = 0;
+	if (nsects) {
+		ra.size = (nsects + 1) * cxt->sector_size;
+		ra.buf = malloc(ra.size);
+		if (ra.buf && read_bytes(cxt, ra.offset, ra.buf, ra.size) != 0) {
+			free(ra.buf);
+			ra.buf = NULL;
+		}
+	}
+
 	/* read and verify header */
-	if (read_lba(cxt, lba, header, cxt->sector_size) != 0)
+	if (ra.buf)
+		memcpy(header, ra.buf + (lba * cxt->sector_size - ra.offset),
+		       cxt->sector_size);
+	else if (read_lba(cxt, lba, header, cxt->sector_size) != 0)
 		goto invalid;
 
 	if (!gpt_check_signature(header))
@@ -1138,7 +1194,7 @@ static struct gpt_header *gpt_read_header(struct fdisk_context *cxt,
 		goto invalid;
 
 	/* read and verify entries */
-	ents = gpt_read_entries(cxt, header);
+	ents = gpt_read_entries(cxt, header, &ra);
 	if (!ents)
 		goto invalid;
 
@@ -1156,12 +1212,14 @@ static struct gpt_header *gpt_read_header(struct fdisk_context *cxt,
 		*_ents = ents;
 	else
 		free(ents);
+	free(ra.buf);
 
 	DBG(GPT, ul_debug("found valid header on LBA %"PRIu64"", lba));
 	return header;
 invalid:
 	free(header);
 	free(ents);
+	free(ra.buf);
 
 	DBG(GPT, ul_debug("read header on LBA %"PRIu64" failed", lba));
 	return NULL;
@@ -1343,136 +1401,196 @@ static inline int partition_overlap(struct gpt_entry *e1, struct gpt_entry *e2)
 }
 
 /*
- * Find any partitions that overlap.
+ * Free space layout. The used areas are sorted and merged once, and all the
+ * free space queries are binary searches in the sorted arrays. The original
+ * gdisk based code scanned all the entries (again and again) for every
+ * query, which is too slow for tables with thousands of partitions.
  */
-static uint32_t check_overlap_partitions(struct fdisk_gpt_label *gpt)
+struct gpt_area {
+	uint64_t start;
+	uint64_t end;
+};
+
+struct gpt_layout {
+	struct gpt_area	*areas;		/* used entries, sorted by start */
+	size_t		nareas;
+	struct gpt_area	*merged;	/* used space, sorted, not overlapping */
+	size_t		nmerged;
+
+	uint64_t	first_usable;
+	uint64_t	last_usable;
+};
+
+static int cmp_areas(const void *a, const void *b)
 {
-	size_t i, j;
+	const struct gpt_area *x = a, *y = b;
+
+	if (x->start != y->start)
+		return cmp_numbers(x->start, y->start);
+	return cmp_numbers(x->end, y->end);
+}
+
+static void gpt_free_layout(struct gpt_layout *ly)
+{
+	free(ly->areas);
+	free(ly->merged);
+	memset(ly, 0, sizeof(*ly));
+}
+
+static int gpt_read_layout(struct fdisk_gpt_label *gpt, struct gpt_layout *ly)
+{
+	size_t i, n = gpt_get_nentries(gpt);
 
 	assert(gpt);
 	assert(gpt->pheader);
 	assert(gpt->ents);
 
-	for (i = 0; i < gpt_get_nentries(gpt); i++)
-		for (j = 0; j < i; j++) {
-			struct gpt_entry *ei = gpt_get_entry(gpt, i);
-			struct gpt_entry *ej = gpt_get_entry(gpt, j);
+	memset(ly, 0, sizeof(*ly));
+	ly->first_usable = le64_to_cpu(gpt->pheader->first_usable_lba);
+	ly->last_usable = le64_to_cpu(gpt->pheader->last_usable_lba);
 
-			if (!gpt_entry_is_used(ei) || !gpt_entry_is_used(ej))
-				continue;
-			if (partition_overlap(ei, ej)) {
-				DBG(GPT, ul_debug("partitions overlap detected [%zu vs. %zu]", i, j));
-				return i + 1;
-			}
-		}
+	if (!n)
+		return 0;
+
+	ly->areas = malloc(n * sizeof(struct gpt_area));
+	ly->merged = malloc(n * sizeof(struct gpt_area));
+	if (!ly->areas || !ly->merged) {
+		gpt_free_layout(ly);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct gpt_entry *e = gpt_get_entry(gpt, i);
+
+		if (!gpt_entry_is_used(e))
+			continue;
+		ly->areas[ly->nareas].start = gpt_partition_start(e);
+		ly->areas[ly->nareas].end = gpt_partition_end(e);
+		ly->nareas++;
+	}
+	qsort(ly->areas, ly->nareas, sizeof(struct gpt_area), cmp_areas);
+
+	for (i = 0; i < ly->nareas; i++) {
+		struct gpt_area *last = ly->nmerged ? &ly->merged[ly->nmerged - 1] : NULL;
+		const struct gpt_area *a = &ly->areas[i];
+
+		if (last && a->start <= last->end + 1) {
+			if (a->end > last->end)
+				last->end = a->end;
+		} else
+			ly->merged[ly->nmerged++] = *a;
+	}
+
+	DBG(GPT, ul_debug("layout: %zu used entries, %zu used areas",
+				ly->nareas, ly->nmerged));
+	return 0;
+}
+
+/* returns index of the first area which starts after @lba */
+static size_t layout_find_next(const struct gpt_area *ary, size_t n, uint64_t lba)
+{
+	size_t lo = 0, hi = n;
 
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (ary[mid].start <= lba)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* adds a new used area to (cached) layout */
+static int gpt_layout_add(struct gpt_layout *ly, uint64_t start, uint64_t end)
+{
+	struct gpt_area *m;
+	size_t i, j;
+
+	/* the arrays are allocated for all the entries */
+	i = layout_find_next(ly->areas, ly->nareas, start);
+	memmove(&ly->areas[i + 1], &ly->areas[i],
+			(ly->nareas - i) * sizeof(struct gpt_area));
+	ly->areas[i].start = start;
+	ly->areas[i].end = end;
+	ly->nareas++;
+
+	/* merge with the previous area ... */
+	i = layout_find_next(ly->merged, ly->nmerged, start);
+	if (i > 0 && start <= ly->merged[i - 1].end + 1)
+		i--;
+	else {
+		memmove(&ly->merged[i + 1], &ly->merged[i],
+				(ly->nmerged - i) * sizeof(struct gpt_area));
+		ly->merged[i].start = start;
+		ly->merged[i].end = end;
+		ly->nmerged++;
+	}
+	m = &ly->merged[i];
+	if (end > m->end)
+		m->end = end;
+
+	/* ... and with the next areas */
+	for (j = i + 1; j < ly->nmerged && ly->merged[j].start <= m->end + 1; j++) {
+		if (ly->merged[j].end > m->end)
+			m->end = ly->merged[j].end;
+	}
+	if (j > i + 1) {
+		memmove(&ly->merged[i + 1], &ly->merged[j],
+				(ly->nmerged - j) * sizeof(struct gpt_area));
+		ly->nmerged -= j - i - 1;
+	}
 	return 0;
 }
 
 /*
  * Find the first available block after the starting point; returns 0 if
- * there are no available blocks left, or error. From gdisk.
+ * there are no available blocks left, or error.
  */
-static uint64_t find_first_available(struct fdisk_gpt_label *gpt, uint64_t start)
+static uint64_t find_first_available(struct gpt_layout *ly, uint64_t start)
 {
-	int first_moved = 0;
 	uint64_t first;
-	uint64_t fu, lu;
-
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
-
-	fu = le64_to_cpu(gpt->pheader->first_usable_lba);
-	lu = le64_to_cpu(gpt->pheader->last_usable_lba);
+	size_t i;
 
 	/*
 	 * Begin from the specified starting point or from the first usable
 	 * LBA, whichever is greater...
 	 */
-	first = start < fu ? fu : start;
+	first = start < ly->first_usable ? ly->first_usable : start;
 
-	/*
-	 * Now search through all partitions; if first is within an
-	 * existing partition, move it to the next sector after that
-	 * partition and repeat. If first was moved, set firstMoved
-	 * flag; repeat until firstMoved is not set, so as to catch
-	 * cases where partitions are out of sequential order....
-	 */
-	do {
-		size_t i;
-
-		first_moved = 0;
-		for (i = 0; i < gpt_get_nentries(gpt); i++) {
-			struct gpt_entry *e = gpt_get_entry(gpt, i);
-
-			if (!gpt_entry_is_used(e))
-				continue;
-			if (first < gpt_partition_start(e))
-				continue;
-			if (first <= gpt_partition_end(e)) {
-				first = gpt_partition_end(e) + 1;
-				first_moved = 1;
-			}
-		}
-	} while (first_moved == 1);
+	/* ...and skip the used area (merged, so the next one is not continuous) */
+	i = layout_find_next(ly->merged, ly->nmerged, first);
+	if (i > 0 && first <= ly->merged[i - 1].end)
+		first = ly->merged[i - 1].end + 1;
 
-	if (first > lu)
+	if (first > ly->last_usable)
 		first = 0;
 
 	return first;
 }
 
 
-/* Returns last available sector in the free space pointed to by start. From gdisk. */
-static uint64_t find_last_free(struct fdisk_gpt_label *gpt, uint64_t start)
+/* Returns last available sector in the free space pointed to by start. */
+static uint64_t find_last_free(struct gpt_layout *ly, uint64_t start)
 {
-	size_t i;
-	uint64_t nearest_start;
-
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
-
-	nearest_start = le64_to_cpu(gpt->pheader->last_usable_lba);
-
-	for (i = 0; i < gpt_get_nentries(gpt); i++) {
-		struct gpt_entry *e = gpt_get_entry(gpt, i);
-		uint64_t ps = gpt_partition_start(e);
+	size_t i = layout_find_next(ly->areas, ly->nareas, start);
 
-		if (nearest_start > ps && ps > start)
-			nearest_start = ps - 1ULL;
-	}
+	if (i < ly->nareas && ly->areas[i].start < ly->last_usable)
+		return ly->areas[i].start - 1ULL;
 
-	return nearest_start;
+	return ly->last_usable;
 }
 
-/* Returns the last free sector on the disk. From gdisk. */
-static uint64_t find_last_free_sector(struct fdisk_gpt_label *gpt)
+/* Returns the last free sector on the disk. */
+static uint64_t find_last_free_sector(struct gpt_layout *ly)
 {
-	int last_moved;
-	uint64_t last = 0;
-
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
-
 	/* start by assuming the last usable LBA is available */
-	last = le64_to_cpu(gpt->pheader->last_usable_lba);
-	do {
-		size_t i;
+	uint64_t last = ly->last_usable;
+	size_t i = layout_find_next(ly->merged, ly->nmerged, last);
 
-		last_moved = 0;
-		for (i = 0; i < gpt_get_nentries(gpt); i++) {
-			struct gpt_entry *e = gpt_get_entry(gpt, i);
-
-			if (last >= gpt_partition_start(e) &&
-			    last <= gpt_partition_end(e)) {
-				last = gpt_partition_start(e) - 1ULL;
-				last_moved = 1;
-			}
-		}
-	} while (last_moved == 1);
+	if (i > 0 && last <= ly->merged[i - 1].end)
+		last = ly->merged[i - 1].start - 1ULL;
 
 	return last;
 }
@@ -1480,21 +1598,16 @@ static uint64_t find_last_free_sector(struct fdisk_gpt_label *gpt)
 /*
  * Finds the first available sector in the largest block of unallocated
  * space on the disk. Returns 0 if there are no available blocks left.
- * From gdisk.
  */
-static uint64_t find_first_in_largest(struct fdisk_gpt_label *gpt)
+static uint64_t find_first_in_largest(struct gpt_layout *ly)
 {
 	uint64_t start = 0, first_sect, last_sect;
 	uint64_t segment_size, selected_size = 0, selected_segment = 0;
 
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
-
 	do {
-		first_sect = find_first_available(gpt, start);
+		first_sect = find_first_available(ly, start);
 		if (first_sect != 0) {
-			last_sect = find_last_free(gpt, first_sect);
+			last_sect = find_last_free(ly, first_sect);
 			segment_size = last_sect - first_sect + 1ULL;
 
 			if (segment_size > selected_size) {
@@ -1510,10 +1623,10 @@ static uint64_t find_first_in_largest(struct fdisk_gpt_label *gpt)
 
 /*
  * Find the total number of free sectors, the number of segments in which
- * they reside, and the size of the largest of those segments. From gdisk.
+ * they reside, and the size of the largest of those segments.
  */
 static uint64_t get_free_sectors(struct fdisk_context *cxt,
-				 struct fdisk_gpt_label *gpt,
+				 struct gpt_layout *ly,
 				 uint32_t *nsegments,
 				 uint64_t *largest_segment)
 {
@@ -1525,14 +1638,10 @@ static uint64_t get_free_sectors(struct fdisk_context *cxt,
 	if (!cxt->total_sectors)
 		goto done;
 
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
-
 	do {
-		first_sect = find_first_available(gpt, start);
+		first_sect = find_first_available(ly, start);
 		if (first_sect) {
-			last_sect = find_last_free(gpt, first_sect);
+			last_sect = find_last_free(ly, first_sect);
 			segment_sz = last_sect - first_sect + 1;
 
 			if (segment_sz > largest_seg)
@@ -1552,6 +1661,55 @@ done:
 	return totfound;
 }
 
+/*
+ * Find any partitions that overlap.
+ */
+static uint32_t check_overlap_partitions(struct fdisk_gpt_label *gpt)
+{
+	struct gpt_layout ly;
+	size_t i, j;
+
+	assert(gpt);
+	assert(gpt->pheader);
+	assert(gpt->ents);
+
+	/* usual case, sort the entries to check there is no overlap at all */
+	if (gpt_read_layout(gpt, &ly) == 0) {
+		uint64_t maxend = 0;
+		int overlap = 0;
+
+		for (i = 0; overlap == 0 && i < ly.nareas; i++) {
+			const struct gpt_area *a = &ly.areas[i];
+
+			if (!a->start || a->start > a->end)
+				overlap = -1;	/* broken entry, use the full check */
+			else if (i > 0 && a->start <= maxend)
+				overlap = 1;
+			else if (a->end > maxend)
+				maxend = a->end;
+		}
+		gpt_free_layout(&ly);
+		if (!overlap)
+			return 0;
+	}
+
+	/* find the overlapping entry */
+	for (i = 0; i < gpt_get_nentries(gpt); i++)
+		for (j = 0; j < i; j++) {
+			struct gpt_entry *ei = gpt_get_entry(gpt, i);
+			struct gpt_entry *ej = gpt_get_entry(gpt, j);
+
+			if (!gpt_entry_is_used(ei) || !gpt_entry_is_used(ej))
+				continue;
+			if (partition_overlap(ei, ej)) {
+				DBG(GPT, ul_debug("partitions overlap detected [%zu vs. %zu]", i, j));
+				return i + 1;
+			}
+		}
+
+	return 0;
+}
+
 static int gpt_probe_label(struct fdisk_context *cxt)
 {
 	int mbr_type;
@@ -1938,59 +2096,60 @@ static int gpt_set_partition(struct fdisk_context *cxt, size_t n,
 	return rc;
 }
 
-static int gpt_write(struct fdisk_context *cxt, off_t offset, void *buf, size_t count)
+/*
+ * Writes @iov buffers to the continuous area at @offset by one pwritev().
+ * The buffers are always whole sectors, so the write is sector aligned. The
+ * device is not synced here, see gpt_write_disklabel().
+ */
+static int gpt_writev(struct fdisk_context *cxt, off_t offset,
+		      struct iovec *iov, int iovcnt)
 {
-	if (offset != lseek(cxt->dev_fd, offset, SEEK_SET))
-		return -errno;
+	size_t count = 0;
+	int i;
 
-	if (write_all(cxt->dev_fd, buf, count))
-		return -errno;
+	for (i = 0; i < iovcnt; i++)
+		count += iov[i].iov_len;
+
+	while (iovcnt > 0) {
+		ssize_t ret = pwritev(cxt->dev_fd, iov, iovcnt, offset);
+
+		if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (ret <= 0) {
+			if (ret == 0)
+				errno = EIO;
+			return -errno;
+		}
+		offset += ret;
 
-	fsync(cxt->dev_fd);
+		/* short write, skip the written buffers */
+		while (iovcnt > 0 && (size_t) ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
 
 	DBG(GPT, ul_debug("  write OK [offset=%zu, size=%zu]",
-				(size_t) offset, count));
+				(size_t) offset - count, count));
 	return 0;
 }
 
-/*
- * Write partitions.
- * Returns 0 on success, or corresponding error otherwise.
- */
-static int gpt_write_partitions(struct fdisk_context *cxt,
-				struct gpt_header *header, unsigned char *ents)
+static int gpt_write(struct fdisk_context *cxt, off_t offset, void *buf, size_t count)
 {
-	size_t esz = 0;
-	int rc;
+	struct iovec iov = { .iov_base = buf, .iov_len = count };
 
-	rc = gpt_sizeof_entries(header, &esz);
-	if (rc)
-		return rc;
-
-	return gpt_write(cxt,
-			(off_t) le64_to_cpu(header->partition_entry_lba) * cxt->sector_size,
-			ents, esz);
+	return gpt_writev(cxt, offset, &iov, 1);
 }
 
 /*
- * Write a GPT header to a specified LBA.
- *
- * We read all sector, so we have to write all sector back
- * to the device -- never ever rely on sizeof(struct gpt_header)!
- *
- * Returns 0 on success, or corresponding error otherwise.
+ * Prepares the protective MBR in cxt->firstsector.
  */
-static int gpt_write_header(struct fdisk_context *cxt,
-			    struct gpt_header *header, uint64_t lba)
-{
-	return gpt_write(cxt, lba * cxt->sector_size, header, cxt->sector_size);
-}
-
-/*
- * Write the protective MBR.
- * Returns 0 on success, or corresponding error otherwise.
- */
-static int gpt_write_pmbr(struct fdisk_context *cxt)
+static void gpt_init_pmbr(struct fdisk_context *cxt)
 {
 	struct gpt_legacy_mbr *pmbr;
 
@@ -2020,10 +2179,67 @@ static int gpt_write_pmbr(struct fdisk_context *cxt)
 	else
 		pmbr->partition_record[0].size_in_lba =
 			cpu_to_le32((uint32_t) (cxt->total_sectors - 1ULL));
+}
+
+/*
+ * Writes the GPT header at @lba, its partition entries and optionally the
+ * protective MBR (for the primary header). The adjacent areas (usually all
+ * of them) are written by one pwritev(), otherwise the entries are written
+ * first.
+ *
+ * We read all header sector, so we have to write all sector back
+ * to the device -- never ever rely on sizeof(struct gpt_header)!
+ *
+ * Returns 0 on success, or corresponding error otherwise.
+ */
+static int gpt_write_area(struct fdisk_context *cxt, struct gpt_header *header,
+			  uint64_t lba, unsigned char *ents, int pmbr)
+{
+	struct iovec iov[3];
+	off_t hoff = (off_t) lba * cxt->sector_size;
+	off_t eoff = (off_t) le64_to_cpu(header->partition_entry_lba) * cxt->sector_size;
+	off_t off = hoff;
+	size_t esz = 0;
+	int n = 0, rc;
+
+	rc = gpt_sizeof_entries(header, &esz);
+	if (rc)
+		return rc;
+
+	if (pmbr && lba == GPT_PMBR_LBA + 1) {
+		iov[n].iov_base = cxt->firstsector;
+		iov[n++].iov_len = cxt->sector_size;
+		off -= cxt->sector_size;
+	} else if (pmbr) {
+		rc = gpt_write(cxt, GPT_PMBR_LBA * cxt->sector_size,
+				cxt->firstsector, cxt->sector_size);
+		if (rc)
+			return rc;
+	}
 
-	/* pMBR covers the first sector (LBA) of the disk */
-	return gpt_write(cxt, GPT_PMBR_LBA * cxt->sector_size,
-			 pmbr, cxt->sector_size);
+	if (eoff == hoff + (off_t) cxt->sector_size) {
+		/* [pMBR] header entries */
+		iov[n].iov_base = header;
+		iov[n++].iov_len = cxt->sector_size;
+		iov[n].iov_base = ents;
+		iov[n++].iov_len = esz;
+
+	} else if (eoff + (off_t) esz == hoff && n == 0) {
+		/* entries header */
+		iov[n].iov_base = ents;
+		iov[n++].iov_len = esz;
+		iov[n].iov_base = header;
+		iov[n++].iov_len = cxt->sector_size;
+		off = eoff;
+	} else {
+		rc = gpt_write(cxt, eoff, ents, esz);
+		if (rc)
+			return rc;
+		iov[n].iov_base = header;
+		iov[n++].iov_len = cxt->sector_size;
+	}
+
+	return gpt_writev(cxt, off, iov, n);
 }
 
 /*
@@ -2071,21 +2287,26 @@ static int gpt_write_disklabel(struct fdisk_context *cxt)
 	 *   4) primary GPT header
 	 *   5) protective MBR
 	 *
+	 * The backup area and the primary area are written by one vectored
+	 * write for each, the backup is synced before the primary area is
+	 * overwritten (the final fsync() is in fdisk_deassign_device()).
+	 *
 	 * If any write fails, we abort the rest.
 	 */
-	if (gpt_write_partitions(cxt, gpt->bheader, gpt->ents) != 0)
+	if (gpt_write_area(cxt, gpt->bheader,
+			   le64_to_cpu(gpt->pheader->alternative_lba),
+			   gpt->ents, 0) != 0)
 		goto err1;
-	if (gpt_write_header(cxt, gpt->bheader,
-			     le64_to_cpu(gpt->pheader->alternative_lba)) != 0)
-		goto err1;
-	if (gpt_write_partitions(cxt, gpt->pheader, gpt->ents) != 0)
-		goto err1;
-	if (gpt_write_header(cxt, gpt->pheader, GPT_PRIMARY_PARTITION_TABLE_LBA) != 0)
+	if (fsync(cxt->dev_fd) != 0 && errno != EINVAL)
 		goto err1;
 
 	if (mbr_type == GPT_MBR_HYBRID)
 		fdisk_warnx(cxt, _("The device contains hybrid MBR -- writing GPT only."));
-	else if (gpt_write_pmbr(cxt) != 0)
+	else
+		gpt_init_pmbr(cxt);
+
+	if (gpt_write_area(cxt, gpt->pheader, GPT_PRIMARY_PARTITION_TABLE_LBA,
+			   gpt->ents, mbr_type != GPT_MBR_HYBRID) != 0)
 		goto err1;
 
 	DBG(GPT, ul_debug("...write success"));
@@ -2194,6 +2415,7 @@ static int gpt_verify_disklabel(struct fdisk_context *cxt)
 	if (!nerror) { /* yay :-) */
 		uint32_t nsegments = 0;
 		uint64_t free_sectors = 0, largest_segment = 0;
+		struct gpt_layout ly;
 		char *strsz = NULL;
 
 		fdisk_info(cxt, _("No errors detected."));
@@ -2202,7 +2424,10 @@ static int gpt_verify_disklabel(struct fdisk_context *cxt)
 		       partitions_in_use(gpt),
 		       gpt_get_nentries(gpt));
 
-		free_sectors = get_free_sectors(cxt, gpt, &nsegments, &largest_segment);
+		if (gpt_read_layout(gpt, &ly) == 0) {
+			free_sectors = get_free_sectors(cxt, &ly, &nsegments, &largest_segment);
+			gpt_free_layout(&ly);
+		}
 		if (largest_segment)
 			strsz = size_to_human_string(SIZE_SUFFIX_SPACE | SIZE_SUFFIX_3LETTER,
 					largest_segment * cxt->sector_size);
@@ -2266,6 +2491,7 @@ static int gpt_add_partition(
 	struct gpt_header *pheader;
 	struct gpt_entry *e;
 	struct fdisk_ask *ask = NULL;
+	struct gpt_layout tmp = { .nareas = 0 }, *ly = &tmp;
 	size_t partnum;
 	int rc;
 
@@ -2294,14 +2520,11 @@ static int gpt_add_partition(
 			           "Delete it before re-adding it."), partnum +1);
 		return -ERANGE;
 	}
-	if (gpt_get_nentries(gpt) == partitions_in_use(gpt)) {
+	if (gpt_get_nentries(gpt) == (cxt->label->bulk ?
+				cxt->label->nparts_cur : partitions_in_use(gpt))) {
 		fdisk_warnx(cxt, _("All partitions are already in use."));
 		return -ENOSPC;
 	}
-	if (!get_free_sectors(cxt, gpt, NULL, NULL)) {
-		fdisk_warnx(cxt, _("No free sectors available."));
-		return -ENOSPC;
-	}
 
 	rc = string_to_guid(pa && pa->type && pa->type->typestr ?
 				pa->type->typestr:
@@ -2309,7 +2532,32 @@ static int gpt_add_partition(
 	if (rc)
 		return rc;
 
-	disk_f = find_first_available(gpt, le64_to_cpu(pheader->first_usable_lba));
+	if (cxt->label->bulk) {
+		if (!gpt->bulk_layout) {
+			gpt->bulk_layout = calloc(1, sizeof(struct gpt_layout));
+			if (!gpt->bulk_layout)
+				return -ENOMEM;
+			rc = gpt_read_layout(gpt, gpt->bulk_layout);
+			if (rc) {
+				free(gpt->bulk_layout);
+				gpt->bulk_layout = NULL;
+				return rc;
+			}
+		}
+		ly = gpt->bulk_layout;
+	} else {
+		rc = gpt_read_layout(gpt, ly);
+		if (rc)
+			return rc;
+	}
+
+	if (!cxt->total_sectors || !find_first_available(ly, 0)) {
+		fdisk_warnx(cxt, _("No free sectors available."));
+		rc = -ENOSPC;
+		goto done;
+	}
+
+	disk_f = find_first_available(ly, le64_to_cpu(pheader->first_usable_lba));
 	e = gpt_get_entry(gpt, 0);
 
 	/* if first sector no explicitly defined then ignore small gaps before
@@ -2321,10 +2569,10 @@ static int gpt_add_partition(
 		do {
 			uint64_t x;
 			DBG(GPT, ul_debug("testing first sector %"PRIu64"", disk_f));
-			disk_f = find_first_available(gpt, disk_f);
+			disk_f = find_first_available(ly, disk_f);
 			if (!disk_f)
 				break;
-			x = find_last_free(gpt, disk_f);
+			x = find_last_free(ly, disk_f);
 			if (x - disk_f >= cxt->grain / cxt->sector_size)
 				break;
 			DBG(GPT, ul_debug("first sector %"PRIu64" addresses to small space, continue...", disk_f));
@@ -2332,18 +2580,21 @@ static int gpt_add_partition(
 		} while(1);
 
 		if (disk_f == 0)
-			disk_f = find_first_available(gpt, le64_to_cpu(pheader->first_usable_lba));
+			disk_f = find_first_available(ly, le64_to_cpu(pheader->first_usable_lba));
 	}
 
 	e = NULL;
-	disk_l = find_last_free_sector(gpt);
+	disk_l = find_last_free_sector(ly);
 
-	/* the default is the largest free space */
-	dflt_f = find_first_in_largest(gpt);
-	dflt_l = find_last_free(gpt, dflt_f);
+	/* the default is the largest free space (unnecessary for explicit start) */
+	if (!pa || !fdisk_partition_has_start(pa) || pa->start_follow_default) {
+		dflt_f = find_first_in_largest(ly);
+		dflt_l = find_last_free(ly, dflt_f);
 
-	/* align the default in range <dflt_f,dflt_l>*/
-	dflt_f = fdisk_align_lba_in_range(cxt, dflt_f, dflt_f, dflt_l);
+		/* align the default in range <dflt_f,dflt_l>*/
+		dflt_f = fdisk_align_lba_in_range(cxt, dflt_f, dflt_f, dflt_l);
+	} else
+		dflt_f = 0;
 
 	/* first sector */
 	if (pa && pa->start_follow_default) {
@@ -2351,9 +2602,10 @@ static int gpt_add_partition(
 
 	} else if (pa && fdisk_partition_has_start(pa)) {
 		DBG(GPT, ul_debug("first sector defined: %ju",  (uintmax_t)pa->start));
-		if (pa->start != find_first_available(gpt, pa->start)) {
+		if (pa->start != find_first_available(ly, pa->start)) {
 			fdisk_warnx(cxt, _("Sector %ju already used."),  (uintmax_t)pa->start);
-			return -ERANGE;
+			rc = -ERANGE;
+			goto done;
 		}
 		user_f = pa->start;
 	} else {
@@ -2363,8 +2615,10 @@ static int gpt_add_partition(
 				ask = fdisk_new_ask();
 			else
 				fdisk_reset_ask(ask);
-			if (!ask)
-				return -ENOMEM;
+			if (!ask) {
+				rc = -ENOMEM;
+				goto done;
+			}
 
 			/* First sector */
 			fdisk_ask_set_query(ask, _("First sector"));
@@ -2378,7 +2632,7 @@ static int gpt_add_partition(
 				goto done;
 
 			user_f = fdisk_ask_number_get_result(ask);
-			if (user_f != find_first_available(gpt, user_f)) {
+			if (user_f != find_first_available(ly, user_f)) {
 				fdisk_warnx(cxt, _("Sector %ju already used."), user_f);
 				continue;
 			}
@@ -2388,7 +2642,7 @@ static int gpt_add_partition(
 
 
 	/* Last sector */
-	dflt_l = find_last_free(gpt, user_f);
+	dflt_l = find_last_free(ly, user_f);
 
 	if (pa && pa->end_follow_default) {
 		user_l = dflt_l;
@@ -2413,8 +2667,10 @@ static int gpt_add_partition(
 				ask = fdisk_new_ask();
 			else
 				fdisk_reset_ask(ask);
-			if (!ask)
-				return -ENOMEM;
+			if (!ask) {
+				rc = -ENOMEM;
+				goto done;
+			}
 
 			fdisk_ask_set_query(ask, _("Last sector, +/-sectors or +/-size{K,M,G,T,P}"));
 			fdisk_ask_set_type(ask, FDISK_ASKTYPE_OFFSET);
@@ -2505,8 +2761,16 @@ static int gpt_add_partition(
 				gpt_partition_end(e),
 				gpt_partition_size(e)));
 
-	gpt_recompute_crc(gpt->pheader, gpt->ents);
-	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	/* the bulk add updates the layout and the checksums are calculated
+	 * only once by gpt_add_partition_done() */
+	if (ly == gpt->bulk_layout) {
+		rc = gpt_layout_add(ly, user_f, user_l);
+		if (rc)
+			goto done;
+	} else {
+		gpt_recompute_crc(gpt->pheader, gpt->ents);
+		gpt_recompute_crc(gpt->bheader, gpt->ents);
+	}
 
 	/* report result */
 	{
@@ -2524,10 +2788,34 @@ static int gpt_add_partition(
 	if (partno)
 		*partno = partnum;
 done:
+	if (ly == &tmp)
+		gpt_free_layout(ly);
 	fdisk_unref_ask(ask);
 	return rc;
 }
 
+/* end of the bulk add, see fdisk_apply_table() */
+static int gpt_add_partition_done(struct fdisk_context *cxt)
+{
+	struct fdisk_gpt_label *gpt;
+
+	assert(cxt);
+	assert(cxt->label);
+	assert(fdisk_is_label(cxt, GPT));
+
+	gpt = self_label(cxt);
+	if (!gpt->bulk_layout)
+		return 0;
+
+	gpt_free_layout(gpt->bulk_layout);
+	free(gpt->bulk_layout);
+	gpt->bulk_layout = NULL;
+
+	gpt_recompute_crc(gpt->pheader, gpt->ents);
+	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	return 0;
+}
+
 /*
  * Create a new GPT disklabel - destroys any previous data.
  */
@@ -3075,6 +3363,12 @@ static void gpt_deinit(struct fdisk_label *lb)
 	gpt->ents = NULL;
 	gpt->pheader = NULL;
 	gpt->bheader = NULL;
+
+	if (gpt->bulk_layout) {
+		gpt_free_layout(gpt->bulk_layout);
+		free(gpt->bulk_layout);
+		gpt->bulk_layout = NULL;
+	}
 }
 
 static const struct fdisk_label_operations gpt_operations =
@@ -3090,6 +3384,7 @@ static const struct fdisk_label_operations gpt_operations =
 	.get_part	= gpt_get_partition,
 	.set_part	= gpt_set_partition,
 	.add_part	= gpt_add_partition,
+	.add_part_done	= gpt_add_partition_done,
 	.del_part	= gpt_delete_partition,
 	.reorder	= gpt_reorder,
 
@@ -10,6 +10,7 @@
  */
 
 UL_DEBUG_DEFINE_MASK(libfdisk);
+UL_TRACE_DEFINE(libfdisk);
 UL_DEBUG_DEFINE_MASKNAMES(libfdisk) =
 {
 	{ "all",	LIBFDISK_DEBUG_ALL,	"info about all subsystems" },
@@ -45,6 +46,7 @@ void fdisk_init_debug(int mask)
 		return;
 
 	__UL_INIT_DEBUG_FROM_ENV(libfdisk, LIBFDISK_DEBUG_, mask, LIBFDISK_DEBUG);
+	__UL_INIT_TRACE_FROM_ENV(libfdisk, LIBFDISK_TRACE);
 
 
 	if (libfdisk_debug_mask != LIBFDISK_DEBUG_INIT
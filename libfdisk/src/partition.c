@@ -745,9 +745,13 @@ int fdisk_partition_next_partno(
 
 		DBG(PART, ul_debugobj(pa, "next partno (follow default)"));
 
-		for (i = 0; i < cxt->label->nparts_max; i++) {
+		/* the bulk add only adds partitions, don't check them again */
+		i = cxt->label->bulk ? cxt->label->bulk_partno : 0;
+		for (; i < cxt->label->nparts_max; i++) {
 			if (!fdisk_is_partition_used(cxt, i)) {
 				*n = i;
+				if (cxt->label->bulk)
+					cxt->label->bulk_partno = i;
 				return 0;
 			}
 		}
@@ -1,8 +1,12 @@
 
+#include <fcntl.h>
+
 #include "fdiskP.h"
 #include "strutils.h"
 #include "carefulputc.h"
 #include "mangle.h"
+#include "canonicalize.h"
+#include "linereader.h"
 
 /**
  * SECTION: script
@@ -62,6 +66,7 @@ struct fdisk_script {
 };
 
 static struct fdisk_parttype *translate_type_shortcuts(struct fdisk_script *dp, char *str);
+static int script_read_fd(struct fdisk_script *dp, int fd);
 
 
 static void fdisk_script_free_header(struct fdisk_scriptheader *fi)
@@ -114,23 +119,22 @@ struct fdisk_script *fdisk_new_script(struct fdisk_context *cxt)
 struct fdisk_script *fdisk_new_script_from_file(struct fdisk_context *cxt,
 						 const char *filename)
 {
-	int rc;
-	FILE *f;
+	int rc, fd;
 	struct fdisk_script *dp, *res = NULL;
 
 	assert(cxt);
 	assert(filename);
 
 	DBG(SCRIPT, ul_debug("opening %s", filename));
-	f = fopen(filename, "r");
-	if (!f)
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
 		return NULL;
 
 	dp = fdisk_new_script(cxt);
 	if (!dp)
 		goto done;
 
-	rc = fdisk_script_read_file(dp, f);
+	rc = script_read_fd(dp, fd);
 	if (rc) {
 		errno = -rc;
 		goto done;
@@ -138,7 +142,7 @@ struct fdisk_script *fdisk_new_script_from_file(struct fdisk_context *cxt,
 
 	res = dp;
 done:
-	fclose(f);
+	close(fd);
 	if (!res)
 		fdisk_unref_script(dp);
 	else
@@ -700,12 +704,106 @@ done:
 	return 0;
 }
 
+/*
+ * The sfdisk dump lines are composed in one reused buffer and written by one
+ * fwrite(). After an allocation error the buffer ignores all appends and
+ * @failed is set.
+ */
+struct script_line {
+	char	*data;
+	size_t	len;
+	size_t	size;
+	int	failed;
+};
+
+static char *line_reserve(struct script_line *ln, size_t sz)
+{
+	if (ln->failed)
+		return NULL;
+	if (ln->len + sz + 1 > ln->size) {
+		size_t size = max(ln->size * 2, ln->len + sz + 1);
+		char *tmp = realloc(ln->data, max(size, (size_t) 256));
+
+		if (!tmp) {
+			ln->failed = 1;
+			return NULL;
+		}
+		ln->data = tmp;
+		ln->size = max(size, (size_t) 256);
+	}
+	return ln->data + ln->len;
+}
+
+static void line_append(struct script_line *ln, const char *str)
+{
+	size_t sz = strlen(str);
+	char *p = line_reserve(ln, sz);
+
+	if (p) {
+		memcpy(p, str, sz + 1);
+		ln->len += sz;
+	}
+}
+
+/* like printf("%*ju") */
+static void line_append_num(struct script_line *ln, uintmax_t num, size_t width)
+{
+	char tmp[sizeof(stringify_value(UINTMAX_MAX))], *n = tmp + sizeof(tmp);
+	size_t sz, pad;
+	char *p;
+
+	do {
+		*--n = '0' + num % 10;
+		num /= 10;
+	} while (num);
+
+	sz = tmp + sizeof(tmp) - n;
+	pad = width > sz ? width - sz : 0;
+
+	p = line_reserve(ln, pad + sz);
+	if (p) {
+		memset(p, ' ', pad);
+		memcpy(p + pad, n, sz);
+		ln->len += pad + sz;
+		ln->data[ln->len] = '\0';
+	}
+}
+
+/* the same as fputs_quoted() */
+static void line_append_quoted(struct script_line *ln, const char *str)
+{
+	char *p = line_reserve(ln, strlen(str) * 4 + 2);
+
+	if (!p)
+		return;
+	*p++ = '"';
+	for (; *str; str++) {
+		unsigned char c = (unsigned char) *str;
+
+		if (c == '"' || c == '\\' || c == '`' || c == '$'
+		    || !isprint(c) || iscntrl(c)) {
+			*p++ = '\\';
+			*p++ = 'x';
+			*p++ = "0123456789abcdef"[c >> 4];
+			*p++ = "0123456789abcdef"[c & 0xf];
+		} else
+			*p++ = c;
+	}
+	*p++ = '"';
+	*p = '\0';
+	ln->len = p - ln->data;
+}
+
 static int write_file_sfdisk(struct fdisk_script *dp, FILE *f)
 {
 	struct list_head *h;
 	struct fdisk_partition *pa;
 	struct fdisk_iter itr;
+	struct fdisk_label *lb;
+	struct script_line ln = { .data = NULL };
 	const char *devname = NULL;
+	char *mapped = NULL;
+	int rc = 0;
 
 	assert(dp);
 	assert(f);
@@ -729,49 +827,83 @@ static int write_file_sfdisk(struct fdisk_script *dp, FILE *f)
 
 	fputc('\n', f);
 
+	/* resolve /dev/dm-N only once rather than in fdisk_partname() for
+	 * each partition */
+	if (devname && strncmp(devname, "/dev/dm-", 8) == 0) {
+		mapped = canonicalize_dm_name(devname + 5);
+		if (mapped)
+			devname = mapped;
+	}
+	lb = script_get_label(dp);
+
 	fdisk_reset_iter(&itr, FDISK_ITER_FORWARD);
 	while (fdisk_table_next_partition(dp->table, &itr, &pa) == 0) {
 		char *p = NULL;
 
+		ln.len = 0;
+
 		if (devname)
 			p = fdisk_partname(devname, pa->partno + 1);
 		if (p) {
 			DBG(SCRIPT, ul_debugobj(dp, "write %s entry", p));
-			fprintf(f, "%s :", p);
+			line_append(&ln, p);
+			free(p);
 		} else
-			fprintf(f, "%zu :", pa->partno + 1);
+			line_append_num(&ln, pa->partno + 1, 0);
+		line_append(&ln, " :");
 
-		if (fdisk_partition_has_start(pa))
-			fprintf(f, " start=%12ju", (uintmax_t)pa->start);
-		if (fdisk_partition_has_size(pa))
-			fprintf(f, ", size=%12ju", (uintmax_t)pa->size);
+		if (fdisk_partition_has_start(pa)) {
+			line_append(&ln, " start=");
+			line_append_num(&ln, pa->start, 12);
+		}
+		if (fdisk_partition_has_size(pa)) {
+			line_append(&ln, ", size=");
+			line_append_num(&ln, pa->size, 12);
+		}
+
+		if (pa->type && fdisk_parttype_get_string(pa->type)) {
+			line_append(&ln, ", type=");
+			line_append(&ln, fdisk_parttype_get_string(pa->type));
+		} else if (pa->type) {
+			char code[sizeof(stringify_value(UINT_MAX))];
 
-		if (pa->type && fdisk_parttype_get_string(pa->type))
-			fprintf(f, ", type=%s", fdisk_parttype_get_string(pa->type));
-		else if (pa->type)
-			fprintf(f, ", type=%x", fdisk_parttype_get_code(pa->type));
+			snprintf(code, sizeof(code), "%x", fdisk_parttype_get_code(pa->type));
+			line_append(&ln, ", type=");
+			line_append(&ln, code);
+		}
 
-		if (pa->uuid)
-			fprintf(f, ", uuid=%s", pa->uuid);
+		if (pa->uuid) {
+			line_append(&ln, ", uuid=");
+			line_append(&ln, pa->uuid);
+		}
 		if (pa->name && *pa->name) {
-			fputs(", name=", f);
-			fputs_quoted(pa->name, f);
+			line_append(&ln, ", name=");
+			line_append_quoted(&ln, pa->name);
 		}
 
 		/* for MBR attr=80 means bootable */
 		if (pa->attrs) {
-			struct fdisk_label *lb = script_get_label(dp);
-
-			if (!lb || fdisk_label_get_type(lb) != FDISK_DISKLABEL_DOS)
-				fprintf(f, ", attrs=\"%s\"", pa->attrs);
+			if (!lb || fdisk_label_get_type(lb) != FDISK_DISKLABEL_DOS) {
+				line_append(&ln, ", attrs=\"");
+				line_append(&ln, pa->attrs);
+				line_append(&ln, "\"");
+			}
 		}
 		if (fdisk_partition_is_bootable(pa))
-			fprintf(f, ", bootable");
-		fputc('\n', f);
+			line_append(&ln, ", bootable");
+		line_append(&ln, "\n");
+
+		if (ln.failed) {
+			rc = -ENOMEM;
+			break;
+		}
+		fwrite(ln.data, 1, ln.len, f);
 	}
 
-	DBG(SCRIPT, ul_debugobj(dp, "write script done"));
-	return 0;
+	free(ln.data);
+	free(mapped);
+	DBG(SCRIPT, ul_debugobj(dp, "write script done [rc=%d]", rc));
+	return rc;
 }
 
 /**
@@ -1443,6 +1575,57 @@ int fdisk_script_read_file(struct fdisk_script *dp, FILE *f)
 	return rc;
 }
 
+/*
+ * Reads the whole script from @fd by large read()s, the lines are parsed
+ * in place in the read buffer.
+ */
+static int script_read_fd(struct fdisk_script *dp, int fd)
+{
+	struct ul_linereader lr;
+	ssize_t sz;
+	char *line;
+	int rc = 0;
+
+	DBG(SCRIPT, ul_debugobj(dp, "parsing file descriptor"));
+
+	ul_init_linereader(&lr, fd);
+
+	while ((sz = ul_linereader_next(&lr, &line)) > 0) {
+		char *s, *last = NULL;
+
+		dp->nlines++;
+		if (line[sz - 1] == '\n')
+			line[--sz] = '\0';
+		else {
+			/* no final newline, the buffer is not terminated */
+			DBG(SCRIPT, ul_debugobj(dp, "no final newline"));
+			line = last = strndup(line, sz);
+			if (!line) {
+				rc = -ENOMEM;
+				break;
+			}
+		}
+		if (sz && line[sz - 1] == '\r')
+			line[--sz] = '\0';
+
+		s = (char *) skip_blank(line);
+		if (*s && *s != '#')
+			rc = fdisk_script_read_buffer(dp, s);
+		free(last);
+		if (rc == -ENOTSUP)
+			rc = 0;
+		if (rc)
+			break;
+	}
+	if (sz < 0)
+		rc = sz;
+
+	ul_free_linereader(&lr);
+
+	DBG(SCRIPT, ul_debugobj(dp, "parsing done [rc=%d]", rc));
+	return rc;
+}
+
 /**
  * fdisk_set_script:
  * @cxt: context
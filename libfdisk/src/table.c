@@ -324,6 +324,9 @@ int fdisk_get_partitions(struct fdisk_context *cxt, struct fdisk_table **tb)
 	for (i = 0; i < cxt->label->nparts_max; i++) {
 		struct fdisk_partition *pa = NULL;
 
+		/* don't decode unused entries (e.g. thousands in GPT) */
+		if (cxt->label->op->part_is_used && !fdisk_is_partition_used(cxt, i))
+			continue;
 		if (fdisk_get_partition(cxt, i, &pa) != 0)
 			continue;
 		if (fdisk_partition_is_used(pa))
@@ -440,9 +443,105 @@ static int new_freespace(struct fdisk_context *cxt,
 }
 
 /* add freespace description to the right place within @tb */
+/*
+ * The free spaces are added in ascending order, so the position of a new
+ * free space (behind the entry with the greatest end before the free space)
+ * is possible to find by one sweep over the entries sorted by end.
+ */
+struct freespace_ent {
+	struct fdisk_partition	*pa;
+	fdisk_sector_t		end;
+	size_t			pos;		/* position in the table */
+};
+
+struct freespace_sweep {
+	struct freespace_ent	*ents;		/* original @tb entries sorted by end */
+	size_t			nents;
+	size_t			next;		/* the first entry behind the current start */
+
+	struct fdisk_partition	*best;		/* the greatest end before the current start */
+	fdisk_sector_t		best_end;
+	struct fdisk_partition	*last;		/* the last added free space */
+};
+
+static int cmp_freespace_ents(const void *a, const void *b)
+{
+	const struct freespace_ent *x = a, *y = b;
+
+	if (x->end != y->end)
+		return cmp_numbers(x->end, y->end);
+	return cmp_numbers(x->pos, y->pos);
+}
+
+static int init_freespace_sweep(struct fdisk_table *tb, struct freespace_sweep *sw)
+{
+	struct fdisk_partition *pa;
+	struct fdisk_iter itr;
+	size_t pos = 0;
+
+	memset(sw, 0, sizeof(*sw));
+	if (fdisk_table_is_empty(tb))
+		return 0;
+
+	sw->ents = calloc(tb->nents, sizeof(struct freespace_ent));
+	if (!sw->ents)
+		return -ENOMEM;
+
+	fdisk_reset_iter(&itr, FDISK_ITER_FORWARD);
+	while (fdisk_table_next_partition(tb, &itr, &pa) == 0) {
+		pos++;
+		if (!fdisk_partition_has_end(pa))
+			continue;
+		sw->ents[sw->nents].pa = pa;
+		sw->ents[sw->nents].end = fdisk_partition_get_end(pa);
+		sw->ents[sw->nents].pos = pos;
+		sw->nents++;
+	}
+	qsort(sw->ents, sw->nents, sizeof(struct freespace_ent), cmp_freespace_ents);
+	return 0;
+}
+
+/* returns 1 if @a is before @b in @tb */
+static int table_is_before(struct fdisk_table *tb,
+			   struct fdisk_partition *a, struct fdisk_partition *b)
+{
+	struct list_head *p;
+
+	for (p = a->parts.next; p != &tb->parts; p = p->next) {
+		if (list_entry(p, struct fdisk_partition, parts) == b)
+			return 1;
+	}
+	return 0;
+}
+
+/* returns entry with the greatest end before @start (the first one if more) */
+static struct fdisk_partition *sweep_freespace_best(
+			struct fdisk_table *tb,
+			struct freespace_sweep *sw,
+			fdisk_sector_t start)
+{
+	for (; sw->next < sw->nents && sw->ents[sw->next].end < start; sw->next++) {
+		if (!sw->best || sw->best_end < sw->ents[sw->next].end) {
+			sw->best = sw->ents[sw->next].pa;
+			sw->best_end = sw->ents[sw->next].end;
+		}
+	}
+
+	if (sw->last) {
+		fdisk_sector_t last_end = fdisk_partition_get_end(sw->last);
+
+		if (!sw->best || sw->best_end < last_end
+		    || (sw->best_end == last_end
+			&& table_is_before(tb, sw->last, sw->best)))
+			return sw->last;
+	}
+	return sw->best;
+}
+
 static int table_add_freespace(
 			struct fdisk_context *cxt,
 			struct fdisk_table *tb,
+			struct freespace_sweep *sw,
 			fdisk_sector_t start,
 			fdisk_sector_t end,
 			struct fdisk_partition *parent)
@@ -452,6 +551,7 @@ static int table_add_freespace(
 	int rc = 0;
 
 	assert(tb);
+	assert(sw);
 
 	rc = new_freespace(cxt, start, end, parent, &pa);
 	if (rc)
@@ -481,23 +581,30 @@ static int table_add_freespace(
 		}
 	}
 
-	while (fdisk_table_next_partition(tb, &itr, &x) == 0) {
-		fdisk_sector_t the_end, best_end = 0;
+	if (real_parent) {
+		/* nested free space, only entries behind the parent (the
+		 * number of nested partitions is small) */
+		while (fdisk_table_next_partition(tb, &itr, &x) == 0) {
+			fdisk_sector_t the_end, best_end = 0;
 
-		if (!fdisk_partition_has_end(x))
-			continue;
+			if (!fdisk_partition_has_end(x))
+				continue;
 
-		the_end = fdisk_partition_get_end(x);
-		if (best)
-			best_end = fdisk_partition_get_end(best);
+			the_end = fdisk_partition_get_end(x);
+			if (best)
+				best_end = fdisk_partition_get_end(best);
 
-		if (the_end < pa->start && (!best || best_end < the_end))
-			best = x;
-	}
+			if (the_end < pa->start && (!best || best_end < the_end))
+				best = x;
+		}
+		if (!best)
+			best = real_parent;
+	} else
+		best = sweep_freespace_best(tb, sw, pa->start);
 
-	if (!best && real_parent)
-		best = real_parent;
 	rc = table_insert_partition(tb, best, pa);
+	if (!rc)
+		sw->last = pa;
 
 	fdisk_unref_partition(pa);
 
@@ -510,6 +617,7 @@ static int table_add_freespace(
 static int check_container_freespace(struct fdisk_context *cxt,
 				     struct fdisk_table *parts,
 				     struct fdisk_table *tb,
+				     struct freespace_sweep *sw,
 				     struct fdisk_partition *cont)
 {
 	struct fdisk_iter itr;
@@ -548,7 +656,7 @@ static int check_container_freespace(struct fdisk_context *cxt,
 
 		lastplusoff = last + cxt->first_lba;
 		if (pa->start > lastplusoff && pa->start - lastplusoff > grain)
-			rc = table_add_freespace(cxt, tb, lastplusoff, pa->start, cont);
+			rc = table_add_freespace(cxt, tb, sw, lastplusoff, pa->start, cont);
 		if (rc)
 			goto done;
 		last = fdisk_partition_get_end(pa);
@@ -559,7 +667,7 @@ static int check_container_freespace(struct fdisk_context *cxt,
 	lastplusoff = last + cxt->first_lba;
 	if (lastplusoff < x && x - lastplusoff > grain) {
 		DBG(TAB, ul_debugobj(tb, "add remaining space in container 0x%p", cont));
-		rc = table_add_freespace(cxt, tb, lastplusoff, x, cont);
+		rc = table_add_freespace(cxt, tb, sw, lastplusoff, x, cont);
 	}
 
 done:
@@ -579,6 +687,9 @@ done:
  * Note that free space smaller than grain (see fdisk_get_grain_size()) is
  * ignored.
  *
+ * The partitions are sorted once and the free space is added by one pass,
+ * so it's usable for large tables too.
+ *
  * Returns: 0 on success, otherwise, a corresponding error.
  */
 int fdisk_get_freespaces(struct fdisk_context *cxt, struct fdisk_table **tb)
@@ -588,6 +699,7 @@ int fdisk_get_freespaces(struct fdisk_context *cxt, struct fdisk_table **tb)
 	fdisk_sector_t last, grain;
 	struct fdisk_table *parts = NULL;
 	struct fdisk_partition *pa;
+	struct freespace_sweep sw = { .nents = 0 };
 	struct fdisk_iter itr;
 
 	DBG(CXT, ul_debugobj(cxt, "-- get freespace --"));
@@ -598,6 +710,9 @@ int fdisk_get_freespaces(struct fdisk_context *cxt, struct fdisk_table **tb)
 		return -ENOMEM;
 
 	rc = fdisk_get_partitions(cxt, &parts);
+	if (rc)
+		goto done;
+	rc = init_freespace_sweep(*tb, &sw);
 	if (rc)
 		goto done;
 
@@ -630,13 +745,13 @@ int fdisk_get_freespaces(struct fdisk_context *cxt, struct fdisk_table **tb)
 		    || (nparts == 0 &&
 		        (fdisk_align_lba(cxt, last, FDISK_ALIGN_UP) <
 			 pa->start))) {
-			rc = table_add_freespace(cxt, *tb,
+			rc = table_add_freespace(cxt, *tb, &sw,
 				last + (nparts == 0 ? 0 : 1),
 				pa->start - 1, NULL);
 		}
 		/* add gaps between logical partitions */
 		if (fdisk_partition_is_container(pa))
-			rc = check_container_freespace(cxt, parts, *tb, pa);
+			rc = check_container_freespace(cxt, parts, *tb, &sw, pa);
 
 		if (fdisk_partition_has_end(pa)) {
 			fdisk_sector_t pa_end = fdisk_partition_get_end(pa);
@@ -661,6 +776,7 @@ int fdisk_get_freespaces(struct fdisk_context *cxt, struct fdisk_table **tb)
 
 done:
 	fdisk_unref_table(parts);
+	free(sw.ents);
 
 	DBG(CXT, ul_debugobj(cxt, "get freespace DONE [rc=%d]", rc));
 	return rc;
@@ -701,6 +817,10 @@ int fdisk_table_wrong_order(struct fdisk_table *tb)
  * that does not define start (or does not follow the default start)
  * are ignored.
  *
+ * The partitions are added in bulk; the label driver may keep the free
+ * space layout for all the partitions and postpone expensive updates
+ * (e.g. GPT checksums) to the end of the table.
+ *
  * Returns: 0 on success, <0 on error.
  */
 int fdisk_apply_table(struct fdisk_context *cxt, struct fdisk_table *tb)
@@ -714,6 +834,11 @@ int fdisk_apply_table(struct fdisk_context *cxt, struct fdisk_table *tb)
 
 	DBG(TAB, ul_debugobj(tb, "applying to context %p", cxt));
 
+	if (cxt->label) {
+		cxt->label->bulk = 1;
+		cxt->label->bulk_partno = 0;
+	}
+
 	fdisk_reset_iter(&itr, FDISK_ITER_FORWARD);
 	while (tb && fdisk_table_next_partition(tb, &itr, &pa) == 0) {
 		if (!fdisk_partition_has_start(pa) && !pa->start_follow_default)
@@ -723,6 +848,14 @@ int fdisk_apply_table(struct fdisk_context *cxt, struct fdisk_table *tb)
 			break;
 	}
 
+	if (cxt->label) {
+		cxt->label->bulk = 0;
+		if (cxt->label->op->add_part_done) {
+			int xrc = cxt->label->op->add_part_done(cxt);
+			if (!rc)
+				rc = xrc;
+		}
+	}
 	return rc;
 }
 
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * This file is part of libmount from util-linux project.
+ *
+ * libmount is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Strings arena -- the table parser stores all strings of the parsed entries
+ * in a few large chunks rather than in many small allocations. The arena is
+ * reference counted; the table and all entries with strings in the arena
+ * keep a reference, so an entry is still usable after the table is
+ * deallocated.
+ *
+ * The arena never frees or reallocates the strings, the entries convert their
+ * strings to private copies before the strings are modified (see
+ * mnt_fs_detach_arena()).
+ *
+ * The arena may also own an external buffer with the strings (e.g. mmap()ed
+ * mount table snapshot, see tab_snapshot.c).
+ */
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "mountP.h"
+
+#define MNT_ARENA_MINCHUNK	(16 * 1024)
+#define MNT_ARENA_MAXCHUNK	(1024 * 1024)
+
+struct libmnt_arena_chunk {
+	struct libmnt_arena_chunk *next;
+	size_t		size;		/* size of data[] */
+	size_t		used;		/* already used bytes of data[] */
+	char		data[];
+};
+
+struct libmnt_arena {
+	int		refcount;
+	size_t		nchunks;
+	struct libmnt_arena_chunk *chunks;	/* the first chunk is the current */
+
+	char		*extbuf;	/* external buffer or NULL */
+	size_t		extsz;
+	unsigned int	extmapped : 1;	/* munmap() the buffer rather than free() */
+};
+
+struct libmnt_arena *mnt_new_arena(void)
+{
+	struct libmnt_arena *ar = calloc(1, sizeof(*ar));
+
+	if (!ar)
+		return NULL;
+	ar->refcount = 1;
+	DBG(TAB, ul_debugobj(ar, "alloc arena"));
+	return ar;
+}
+
+/*
+ * Creates arena for strings in @buf. The buffer is owned by the arena, it's
+ * deallocated by munmap() if @mapped is true, otherwise by free().
+ */
+struct libmnt_arena *mnt_new_arena_from_buffer(char *buf, size_t sz, int mapped)
+{
+	struct libmnt_arena *ar = mnt_new_arena();
+
+	if (!ar)
+		return NULL;
+	ar->extbuf = buf;
+	ar->extsz = sz;
+	ar->extmapped = mapped ? 1 : 0;
+	return ar;
+}
+
+void mnt_ref_arena(struct libmnt_arena *ar)
+{
+	if (ar)
+		ar->refcount++;
+}
+
+void mnt_unref_arena(struct libmnt_arena *ar)
+{
+	struct libmnt_arena_chunk *ch;
+
+	if (!ar)
+		return;
+	if (--ar->refcount > 0)
+		return;
+
+	DBG(TAB, ul_debugobj(ar, "free arena [chunks=%zu]", ar->nchunks));
+	while ((ch = ar->chunks)) {
+		ar->chunks = ch->next;
+		free(ch);
+	}
+	if (ar->extbuf && ar->extmapped)
+		munmap(ar->extbuf, ar->extsz);
+	else
+		free(ar->extbuf);
+	free(ar);
+}
+
+/*
+ * Returns a pointer to at least @sz bytes of unused memory. The memory is
+ * not marked as used, the caller has to call mnt_arena_commit() with the
+ * really used size. The next mnt_arena_reserve() call returns the same
+ * memory if there is no mnt_arena_commit() in between.
+ */
+char *mnt_arena_reserve(struct libmnt_arena *ar, size_t sz)
+{
+	struct libmnt_arena_chunk *ch = ar->chunks;
+	size_t chsz;
+
+	if (ch && ch->size - ch->used >= sz)
+		return ch->data + ch->used;
+
+	/* the size of the chunks grows with the number of the chunks */
+	chsz = ch ? ch->size * 2 : MNT_ARENA_MINCHUNK;
+	if (chsz > MNT_ARENA_MAXCHUNK)
+		chsz = MNT_ARENA_MAXCHUNK;
+	if (chsz < sz)
+		chsz = sz;
+
+	ch = malloc(sizeof(*ch) + chsz);
+	if (!ch)
+		return NULL;
+	ch->size = chsz;
+	ch->used = 0;
+	ch->next = ar->chunks;
+	ar->chunks = ch;
+	ar->nchunks++;
+
+	return ch->data;
+}
+
+/* marks @sz bytes from the last mnt_arena_reserve() as used */
+void mnt_arena_commit(struct libmnt_arena *ar, size_t sz)
+{
+	assert(ar->chunks);
+	assert(ar->chunks->size - ar->chunks->used >= sz);
+
+	ar->chunks->used += sz;
+}
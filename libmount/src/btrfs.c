@@ -173,3 +173,34 @@ out:
 	closedir(dirstream);
 	return found;
 }
+
+/*
+ * btrfs_get_cached_default_subvol_id:
+ * @cache: paths cache or NULL
+ * @devno: device number of the filesystem mounted on @path or 0
+ * @path: Path to mounted btrfs volume
+ *
+ * The same as btrfs_get_default_subvol_id(), but the ID is cached in @cache,
+ * so the tree search ioctl is called once for the filesystem (mount -a and
+ * findmnt --verify ask for the same filesystem for every subvolume).
+ *
+ * Note that the cached ID is not invalidated, the default subvolume changed
+ * by "btrfs subvolume set-default" after the first lookup is not visible
+ * until a new cache is used.
+ */
+uint64_t btrfs_get_cached_default_subvol_id(struct libmnt_cache *cache,
+				dev_t devno, const char *path)
+{
+	uint64_t id;
+
+	if (mnt_cache_get_btrfs_default(cache, devno, &id) == 0) {
+		DBG(BTRFS, ul_debug("\"default\" id for %u:%u is %llu (cached)",
+				major(devno), minor(devno), (unsigned long long) id));
+		return id;
+	}
+
+	id = btrfs_get_default_subvol_id(path);
+	if (id != UINT64_MAX)
+		mnt_cache_set_btrfs_default(cache, devno, id);
+	return id;
+}
@@ -20,11 +20,20 @@
  * paths. The cache uses libblkid as a backend for TAGs resolution.
  *
  * All returned paths are always canonicalized.
+ *
+ * The cache is unlimited by default, long-running applications may limit the
+ * number of entries by mnt_cache_set_max_entries(). The least recently used
+ * entries are evicted from the cache if the limit is reached.
+ *
+ * The cache is thread-safe and it is possible to share one cache between more
+ * contexts (see mnt_context_set_cache()) and tables (see
+ * mnt_table_set_cache()) in more threads.
  */
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <limits.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -34,11 +43,12 @@
 #include "mountP.h"
 #include "loopdev.h"
 #include "strutils.h"
+#include "pathnames.h"
 
 /*
  * Canonicalized (resolved) paths & tags cache
  */
-#define MNT_CACHE_CHUNKSZ	128
+#define MNT_CACHE_MINBUCKETS	64
 
 #define MNT_CACHE_ISTAG		(1 << 1) /* entry is TAG */
 #define MNT_CACHE_ISPATH	(1 << 2) /* entry is path */
@@ -49,14 +59,40 @@ struct mnt_cache_entry {
 	char			*key;	/* search key (e.g. uncanonicalized path) */
 	char			*value;	/* value (e.g. canonicalized path) */
 	int			flag;
+
+	uint32_t		keyhash;
+	uint32_t		devhash;	/* value hash (tags only) */
+	struct mnt_cache_entry	*keynext;	/* key hash chain */
+	struct mnt_cache_entry	*devnext;	/* value hash chain */
+
+	struct list_head	lru;	/* cache->lru or cache->evicted */
+};
+
+/* btrfs default subvolume ID of the filesystem @devno (st_dev in mountinfo) */
+struct mnt_cache_btrfs {
+	dev_t			devno;
+	uint64_t		id;
 };
 
 struct libmnt_cache {
-	struct mnt_cache_entry	*ents;
+	struct list_head	lru;	/* all entries, the most recently used first */
 	size_t			nents;
-	size_t			nallocs;
+	size_t			maxents;	/* zero for unlimited cache */
 	int			refcount;
 
+	struct mnt_cache_entry	**keyhash;
+	struct mnt_cache_entry	**devhash;
+	size_t			nbuckets;	/* power of 2 */
+
+	/* The evicted entries are not deallocated immediately, the strings
+	 * returned by the cache are still valid until next maxents entries
+	 * are evicted.
+	 */
+	struct list_head	evicted;
+	size_t			nevicted;
+
+	pthread_mutex_t		lock;
+
 	/* blkid_evaluate_tag() works in two ways:
 	 *
 	 * 1/ all tags are evaluated by udev /dev/disk/by-* symlinks,
@@ -68,9 +104,15 @@ struct libmnt_cache {
 	 */
 	blkid_cache		bc;
 
+	struct mnt_cache_btrfs	*btrfs;
+	size_t			nbtrfs;
+
 	struct libmnt_table	*mtab;
 };
 
+#define cache_lock(_c)		pthread_mutex_lock(&(_c)->lock)
+#define cache_unlock(_c)	pthread_mutex_unlock(&(_c)->lock)
+
 /**
  * mnt_new_cache:
  *
@@ -83,9 +125,21 @@ struct libmnt_cache *mnt_new_cache(void)
 		return NULL;
 	DBG(CACHE, ul_debugobj(cache, "alloc"));
 	cache->refcount = 1;
+	INIT_LIST_HEAD(&cache->lru);
+	INIT_LIST_HEAD(&cache->evicted);
+	pthread_mutex_init(&cache->lock, NULL);
 	return cache;
 }
 
+static void free_entry(struct mnt_cache_entry *e)
+{
+	list_del(&e->lru);
+	if (e->value != e->key)
+		free(e->value);
+	free(e->key);
+	free(e);
+}
+
 /**
  * mnt_free_cache:
  * @cache: pointer to struct libmnt_cache instance
@@ -95,22 +149,22 @@ struct libmnt_cache *mnt_new_cache(void)
  */
 void mnt_free_cache(struct libmnt_cache *cache)
 {
-	size_t i;
-
 	if (!cache)
 		return;
 
 	DBG(CACHE, ul_debugobj(cache, "free [refcount=%d]", cache->refcount));
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (e->value != e->key)
-			free(e->value);
-		free(e->key);
-	}
-	free(cache->ents);
+	while (!list_empty(&cache->lru))
+		free_entry(list_entry(cache->lru.next, struct mnt_cache_entry, lru));
+	while (!list_empty(&cache->evicted))
+		free_entry(list_entry(cache->evicted.next, struct mnt_cache_entry, lru));
+
+	free(cache->keyhash);
+	free(cache->devhash);
+	free(cache->btrfs);
 	if (cache->bc)
 		blkid_put_cache(cache->bc);
+	pthread_mutex_destroy(&cache->lock);
 	free(cache);
 }
 
@@ -123,7 +177,9 @@ void mnt_free_cache(struct libmnt_cache *cache)
 void mnt_ref_cache(struct libmnt_cache *cache)
 {
 	if (cache) {
+		cache_lock(cache);
 		cache->refcount++;
+		cache_unlock(cache);
 		/*DBG(CACHE, ul_debugobj(cache, "ref=%d", cache->refcount));*/
 	}
 }
@@ -138,9 +194,13 @@ void mnt_ref_cache(struct libmnt_cache *cache)
 void mnt_unref_cache(struct libmnt_cache *cache)
 {
 	if (cache) {
-		cache->refcount--;
+		int refcount;
+
+		cache_lock(cache);
+		refcount = --cache->refcount;
+		cache_unlock(cache);
 		/*DBG(CACHE, ul_debugobj(cache, "unref=%d", cache->refcount));*/
-		if (cache->refcount <= 0) {
+		if (refcount <= 0) {
 			mnt_unref_table(cache->mtab);
 
 			mnt_free_cache(cache);
@@ -165,11 +225,121 @@ int mnt_cache_set_targets(struct libmnt_cache *cache,
 		return -EINVAL;
 
 	mnt_ref_table(mtab);
+	cache_lock(cache);
 	mnt_unref_table(cache->mtab);
 	cache->mtab = mtab;
+	cache_unlock(cache);
+	return 0;
+}
+
+static inline uint32_t hash_str(uint32_t h, const char *p)
+{
+	for (; *p; p++)
+		h = (h ^ (unsigned char) *p) * 16777619U;
+	return h;
+}
+
+/* TAG key is "TAG_NAME\0TAG_VALUE\0" */
+static inline uint32_t hash_tag(const char *token, const char *value)
+{
+	uint32_t h = hash_str(2166136261U, token);
+
+	h *= 16777619U;		/* '\0' */
+	return hash_str(h, value);
+}
+
+static void hash_entry(struct libmnt_cache *cache, struct mnt_cache_entry *e)
+{
+	size_t mask = cache->nbuckets - 1;
+
+	e->keynext = cache->keyhash[e->keyhash & mask];
+	cache->keyhash[e->keyhash & mask] = e;
+
+	if (e->flag & MNT_CACHE_ISTAG) {
+		e->devnext = cache->devhash[e->devhash & mask];
+		cache->devhash[e->devhash & mask] = e;
+	}
+}
+
+static void unhash_entry(struct libmnt_cache *cache, struct mnt_cache_entry *e)
+{
+	size_t mask = cache->nbuckets - 1;
+	struct mnt_cache_entry **pp;
+
+	for (pp = &cache->keyhash[e->keyhash & mask]; *pp; pp = &(*pp)->keynext) {
+		if (*pp == e) {
+			*pp = e->keynext;
+			break;
+		}
+	}
+	if (!(e->flag & MNT_CACHE_ISTAG))
+		return;
+	for (pp = &cache->devhash[e->devhash & mask]; *pp; pp = &(*pp)->devnext) {
+		if (*pp == e) {
+			*pp = e->devnext;
+			break;
+		}
+	}
+}
+
+/* the hash has at least as many buckets as entries */
+static int rehash_cache(struct libmnt_cache *cache, size_t nbuckets)
+{
+	struct mnt_cache_entry **kh, **dh;
+	struct list_head *p;
+
+	kh = calloc(nbuckets, sizeof(*kh));
+	dh = calloc(nbuckets, sizeof(*dh));
+	if (!kh || !dh) {
+		free(kh);
+		free(dh);
+		return -ENOMEM;
+	}
+
+	free(cache->keyhash);
+	free(cache->devhash);
+	cache->keyhash = kh;
+	cache->devhash = dh;
+	cache->nbuckets = nbuckets;
+
+	/* backward to keep the most recently used entries first in the chains */
+	list_for_each_backwardly(p, &cache->lru)
+		hash_entry(cache, list_entry(p, struct mnt_cache_entry, lru));
+
+	DBG(CACHE, ul_debugobj(cache, "rehashed to %zu buckets", nbuckets));
 	return 0;
 }
 
+/* moves the least recently used entries to the evicted list */
+static void evict_entries(struct libmnt_cache *cache)
+{
+	while (cache->maxents && cache->nents > cache->maxents) {
+		struct mnt_cache_entry *e = list_entry(cache->lru.prev,
+						struct mnt_cache_entry, lru);
+
+		DBG(CACHE, ul_debugobj(cache, "evict entry: %s", e->value));
+		unhash_entry(cache, e);
+		list_del(&e->lru);
+		list_add(&e->lru, &cache->evicted);
+		cache->nents--;
+		cache->nevicted++;
+	}
+
+	while (cache->nevicted > cache->maxents) {
+		free_entry(list_entry(cache->evicted.prev,
+					struct mnt_cache_entry, lru));
+		cache->nevicted--;
+	}
+}
+
+static inline void touch_entry(struct libmnt_cache *cache,
+			       struct mnt_cache_entry *e)
+{
+	if (cache->lru.next != &e->lru) {
+		list_del(&e->lru);
+		list_add(&e->lru, &cache->lru);
+	}
+}
 
 /* note that the @key could be the same pointer as @value */
 static int cache_add_entry(struct libmnt_cache *cache, char *key,
@@ -181,26 +351,35 @@ static int cache_add_entry(struct libmnt_cache *cache, char *key,
 	assert(value);
 	assert(key);
 
-	if (cache->nents == cache->nallocs) {
-		size_t sz = cache->nallocs + MNT_CACHE_CHUNKSZ;
+	if (cache->nents >= cache->nbuckets
+	    && rehash_cache(cache, max(cache->nbuckets * 2,
+				       (size_t) MNT_CACHE_MINBUCKETS)))
+		return -ENOMEM;
 
-		e = realloc(cache->ents, sz * sizeof(struct mnt_cache_entry));
-		if (!e)
-			return -ENOMEM;
-		cache->ents = e;
-		cache->nallocs = sz;
-	}
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return -ENOMEM;
 
-	e = &cache->ents[cache->nents];
 	e->key = key;
 	e->value = value;
 	e->flag = flag;
+
+	if (flag & MNT_CACHE_ISTAG) {
+		e->keyhash = hash_tag(key, key + strlen(key) + 1);
+		e->devhash = hash_str(2166136261U, value);
+	} else
+		e->keyhash = mnt_hash_path(key);
+
+	list_add(&e->lru, &cache->lru);
+	hash_entry(cache, e);
 	cache->nents++;
 
 	DBG(CACHE, ul_debugobj(cache, "add entry [%2zd] (%s): %s: %s",
 			cache->nents,
 			(flag & MNT_CACHE_ISPATH) ? "path" : "tag",
 			value, key));
+
+	evict_entries(cache);
 	return 0;
 }
 
@@ -239,23 +418,52 @@ static int cache_add_tag(struct libmnt_cache *cache, const char *tagname,
 	return rc;
 }
 
+/**
+ * mnt_cache_set_max_entries:
+ * @cache: cache pointer
+ * @max: maximal number of the entries or zero for unlimited cache
+ *
+ * Limits number of the cached paths and tags. The least recently used entries
+ * are evicted from the cache if the limit is reached. The strings returned
+ * by the cache (e.g. by mnt_resolve_path()) are not deallocated immediately
+ * after eviction, they are valid until next @max entries are evicted.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ *
+ * Since: 2.36
+ */
+int mnt_cache_set_max_entries(struct libmnt_cache *cache, size_t max)
+{
+	if (!cache)
+		return -EINVAL;
+
+	cache_lock(cache);
+	cache->maxents = max;
+	evict_entries(cache);
+	cache_unlock(cache);
+
+	DBG(CACHE, ul_debugobj(cache, "max entries set to %zu", max));
+	return 0;
+}
 
 /*
  * Returns cached canonicalized path or NULL.
  */
 static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
 
-	if (!cache || !path)
+	if (!cache || !path || !cache->nbuckets)
 		return NULL;
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
+	e = cache->keyhash[mnt_hash_path(path) & (cache->nbuckets - 1)];
+	for (; e; e = e->keynext) {
 		if (!(e->flag & MNT_CACHE_ISPATH))
 			continue;
-		if (streq_paths(path, e->key))
+		if (streq_paths(path, e->key)) {
+			touch_entry(cache, e);
 			return e->value;
+		}
 	}
 	return NULL;
 }
@@ -266,21 +474,47 @@ static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 static const char *cache_find_tag(struct libmnt_cache *cache,
 			const char *token, const char *value)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
 	size_t tksz;
 
-	if (!cache || !token || !value)
+	if (!cache || !token || !value || !cache->nbuckets)
 		return NULL;
 
 	tksz = strlen(token);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
+	e = cache->keyhash[hash_tag(token, value) & (cache->nbuckets - 1)];
+	for (; e; e = e->keynext) {
 		if (!(e->flag & MNT_CACHE_ISTAG))
 			continue;
 		if (strcmp(token, e->key) == 0 &&
-		    strcmp(value, e->key + tksz + 1) == 0)
+		    strcmp(value, e->key + tksz + 1) == 0) {
+			touch_entry(cache, e);
 			return e->value;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Returns the first tag entry for @devname which matches @flag.
+ */
+static struct mnt_cache_entry *cache_find_device(struct libmnt_cache *cache,
+			const char *devname, const char *token, int flag)
+{
+	struct mnt_cache_entry *e;
+
+	if (!cache->nbuckets)
+		return NULL;
+
+	e = cache->devhash[hash_str(2166136261U, devname) & (cache->nbuckets - 1)];
+	for (; e; e = e->devnext) {
+		if ((e->flag & flag) != flag)
+			continue;
+		if (strcmp(e->value, devname) == 0 &&		/* dev name */
+		    (!token || strcmp(token, e->key) == 0)) {	/* tag name */
+			touch_entry(cache, e);
+			return e;
+		}
 	}
 	return NULL;
 }
@@ -288,35 +522,21 @@ static const char *cache_find_tag(struct libmnt_cache *cache,
 static char *cache_find_tag_value(struct libmnt_cache *cache,
 			const char *devname, const char *token)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
 
 	assert(cache);
 	assert(devname);
 	assert(token);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISTAG))
-			continue;
-		if (strcmp(e->value, devname) == 0 &&	/* dev name */
-		    strcmp(token, e->key) == 0)	/* tag name */
-			return e->key + strlen(token) + 1;	/* tag value */
-	}
+	e = cache_find_device(cache, devname, token, MNT_CACHE_ISTAG);
+	if (e)
+		return e->key + strlen(token) + 1;	/* tag value */
 
 	return NULL;
 }
 
-/**
- * mnt_cache_read_tags
- * @cache: pointer to struct libmnt_cache instance
- * @devname: path device
- *
- * Reads @devname LABEL and UUID to the @cache.
- *
- * Returns: 0 if at least one tag was added, 1 if no tag was added or
- *          negative number in case of error.
- */
-int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
+/* the cache has to be locked */
+static int cache_read_tags(struct libmnt_cache *cache, const char *devname)
 {
 	blkid_probe pr;
 	size_t i, ntags = 0;
@@ -324,20 +544,12 @@ int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
 	const char *tags[] = { "LABEL", "UUID", "TYPE", "PARTUUID", "PARTLABEL" };
 	const char *blktags[] = { "LABEL", "UUID", "TYPE", "PART_ENTRY_UUID", "PART_ENTRY_NAME" };
 
-	if (!cache || !devname)
-		return -EINVAL;
-
 	DBG(CACHE, ul_debugobj(cache, "tags for %s requested", devname));
 
 	/* check if device is already cached */
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_TAGREAD))
-			continue;
-		if (strcmp(e->value, devname) == 0)
-			/* tags have already been read */
-			return 0;
-	}
+	if (cache_find_device(cache, devname, NULL, MNT_CACHE_TAGREAD))
+		/* tags have already been read */
+		return 0;
 
 	pr =  blkid_new_probe_from_filename(devname);
 	if (!pr)
@@ -387,6 +599,29 @@ error:
 	return rc < 0 ? rc : -1;
 }
 
+/**
+ * mnt_cache_read_tags
+ * @cache: pointer to struct libmnt_cache instance
+ * @devname: path device
+ *
+ * Reads @devname LABEL and UUID to the @cache.
+ *
+ * Returns: 0 if at least one tag was added, 1 if no tag was added or
+ *          negative number in case of error.
+ */
+int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
+{
+	int rc;
+
+	if (!cache || !devname)
+		return -EINVAL;
+
+	cache_lock(cache);
+	rc = cache_read_tags(cache, devname);
+	cache_unlock(cache);
+	return rc;
+}
+
 /**
  * mnt_cache_device_has_tag:
  * @cache: paths cache
@@ -401,11 +636,18 @@ error:
 int mnt_cache_device_has_tag(struct libmnt_cache *cache, const char *devname,
 				const char *token, const char *value)
 {
-	const char *path = cache_find_tag(cache, token, value);
+	const char *path;
+	int rc = 0;
 
+	if (!cache)
+		return 0;
+
+	cache_lock(cache);
+	path = cache_find_tag(cache, token, value);
 	if (path && devname && strcmp(path, devname) == 0)
-		return 1;
-	return 0;
+		rc = 1;
+	cache_unlock(cache);
+	return rc;
 }
 
 static int __mnt_cache_find_tag_value(struct libmnt_cache *cache,
@@ -416,12 +658,15 @@ static int __mnt_cache_find_tag_value(struct libmnt_cache *cache,
 	if (!cache || !devname || !token || !data)
 		return -EINVAL;
 
-	rc = mnt_cache_read_tags(cache, devname);
-	if (rc)
-		return rc;
-
-	*data = cache_find_tag_value(cache, devname, token);
-	return *data ? 0 : -1;
+	cache_lock(cache);
+	rc = cache_read_tags(cache, devname);
+	if (rc == 0) {
+		*data = cache_find_tag_value(cache, devname, token);
+		if (!*data)
+			rc = -1;
+	}
+	cache_unlock(cache);
+	return rc;
 }
 
 /**
@@ -498,24 +743,36 @@ static char *canonicalize_path_and_cache(const char *path,
 	char *p;
 	char *key;
 	char *value;
+	const char *cached;
 
 	DBG(CACHE, ul_debugobj(cache, "canonicalize path %s", path));
 	p = canonicalize_path(path);
 
-	if (p && cache) {
-		value = p;
-		key = strcmp(path, p) == 0 ? value : strdup(path);
-
-		if (!key || !value)
-			goto error;
+	if (!p || !cache)
+		return p;
 
-		if (cache_add_entry(cache, key, value,
-				MNT_CACHE_ISPATH))
-			goto error;
+	/* the path is canonicalized without the lock, another thread
+	 * may add the same path in the meantime */
+	cache_lock(cache);
+	cached = cache_find_path(cache, path);
+	if (cached) {
+		cache_unlock(cache);
+		free(p);
+		return (char *) cached;
 	}
 
+	value = p;
+	key = strcmp(path, p) == 0 ? value : strdup(path);
+
+	if (!key)
+		goto error;
+	if (cache_add_entry(cache, key, value, MNT_CACHE_ISPATH))
+		goto error;
+
+	cache_unlock(cache);
 	return p;
 error:
+	cache_unlock(cache);
 	if (value != key)
 		free(value);
 	free(key);
@@ -542,8 +799,11 @@ char *mnt_resolve_path(const char *path, struct libmnt_cache *cache)
 
 	if (!path)
 		return NULL;
-	if (cache)
+	if (cache) {
+		cache_lock(cache);
 		p = (char *) cache_find_path(cache, path);
+		cache_unlock(cache);
+	}
 	if (!p)
 		p = canonicalize_path_and_cache(path, cache);
 
@@ -572,13 +832,17 @@ char *mnt_resolve_target(const char *path, struct libmnt_cache *cache)
 
 	/*DBG(CACHE, ul_debugobj(cache, "resolving target %s", path));*/
 
-	if (!cache || !cache->mtab)
+	if (!cache)
+		return mnt_resolve_path(path, cache);
+
+	cache_lock(cache);
+	if (!cache->mtab) {
+		cache_unlock(cache);
 		return mnt_resolve_path(path, cache);
+	}
 
 	p = (char *) cache_find_path(cache, path);
-	if (p)
-		return p;
-	else {
+	if (!p) {
 		struct libmnt_iter itr;
 		struct libmnt_fs *fs = NULL;
 
@@ -592,15 +856,16 @@ char *mnt_resolve_target(const char *path, struct libmnt_cache *cache)
 
 			p = strdup(path);
 			if (!p)
-				return NULL;	/* ENOMEM */
+				break;		/* ENOMEM */
 
 			if (cache_add_entry(cache, p, p, MNT_CACHE_ISPATH)) {
 				free(p);
-				return NULL;	/* ENOMEM */
+				p = NULL;	/* ENOMEM */
 			}
 			break;
 		}
 	}
+	cache_unlock(cache);
 
 	if (!p)
 		p = canonicalize_path_and_cache(path, cache);
@@ -677,22 +942,24 @@ char *mnt_resolve_tag(const char *token, const char *value,
 	if (!token || !value)
 		return NULL;
 
-	if (cache)
-		p = (char *) cache_find_tag(cache, token, value);
+	if (!cache)
+		/* returns newly allocated string */
+		return blkid_evaluate_tag(token, value, NULL);
 
+	/* keep locked also for blkid_evaluate_tag(), blkid_cache is not
+	 * thread-safe */
+	cache_lock(cache);
+	p = (char *) cache_find_tag(cache, token, value);
 	if (!p) {
-		/* returns newly allocated string */
-		p = blkid_evaluate_tag(token, value, cache ? &cache->bc : NULL);
+		p = blkid_evaluate_tag(token, value, &cache->bc);
 
-		if (p && cache &&
-		    cache_add_tag(cache, token, value, p, 0))
-				goto error;
+		if (p && cache_add_tag(cache, token, value, p, 0)) {
+			free(p);
+			p = NULL;
+		}
 	}
-
+	cache_unlock(cache);
 	return p;
-error:
-	free(p);
-	return NULL;
 }
 
 
@@ -724,6 +991,67 @@ char *mnt_resolve_spec(const char *spec, struct libmnt_cache *cache)
 }
 
 
+/*
+ * The btrfs default subvolume is the same for all subvolumes of the
+ * filesystem, so it's cached by the device number of the filesystem (all
+ * mountinfo entries of the filesystem have the same st_dev).
+ *
+ * The cached IDs are never invalidated. A change by "btrfs subvolume
+ * set-default" (or umount and mount of another btrfs with the same anonymous
+ * device number) is not detected within the cache lifetime, so long-living
+ * applications should not keep the cache longer than one task.
+ *
+ * Returns: 0 if @id found, 1 if not cached.
+ */
+int mnt_cache_get_btrfs_default(struct libmnt_cache *cache, dev_t devno, uint64_t *id)
+{
+	size_t i;
+	int rc = 1;
+
+	if (!cache || !devno)
+		return 1;
+
+	cache_lock(cache);
+	for (i = 0; i < cache->nbtrfs; i++) {
+		if (cache->btrfs[i].devno == devno) {
+			*id = cache->btrfs[i].id;
+			rc = 0;
+			break;
+		}
+	}
+	cache_unlock(cache);
+	return rc;
+}
+
+int mnt_cache_set_btrfs_default(struct libmnt_cache *cache, dev_t devno, uint64_t id)
+{
+	struct mnt_cache_btrfs *x;
+	size_t i;
+
+	if (!cache || !devno)
+		return -EINVAL;
+
+	cache_lock(cache);
+	for (i = 0; i < cache->nbtrfs; i++) {
+		if (cache->btrfs[i].devno == devno) {
+			cache->btrfs[i].id = id;
+			goto done;
+		}
+	}
+	x = realloc(cache->btrfs, (cache->nbtrfs + 1) * sizeof(*x));
+	if (!x) {
+		cache_unlock(cache);
+		return -ENOMEM;
+	}
+	cache->btrfs = x;
+	x[cache->nbtrfs].devno = devno;
+	x[cache->nbtrfs].id = id;
+	cache->nbtrfs++;
+done:
+	cache_unlock(cache);
+	return 0;
+}
+
 #ifdef TEST_PROGRAM
 
 static int test_resolve_path(struct libmnt_test *ts, int argc, char *argv[])
@@ -776,7 +1104,7 @@ static int test_read_tags(struct libmnt_test *ts, int argc, char *argv[])
 {
 	char line[BUFSIZ];
 	struct libmnt_cache *cache;
-	size_t i;
+	struct list_head *p;
 
 	cache = mnt_new_cache();
 	if (!cache)
@@ -811,8 +1139,8 @@ static int test_read_tags(struct libmnt_test *ts, int argc, char *argv[])
 		}
 	}
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
+	list_for_each_backwardly(p, &cache->lru) {
+		struct mnt_cache_entry *e = list_entry(p, struct mnt_cache_entry, lru);
 		if (!(e->flag & MNT_CACHE_ISTAG))
 			continue;
 
@@ -825,12 +1153,114 @@ static int test_read_tags(struct libmnt_test *ts, int argc, char *argv[])
 
 }
 
+static int test_lru(struct libmnt_test *ts, int argc, char *argv[])
+{
+	char line[BUFSIZ];
+	struct libmnt_cache *cache;
+	struct list_head *p;
+
+	if (argc != 2)
+		return -EINVAL;
+
+	cache = mnt_new_cache();
+	if (!cache)
+		return -ENOMEM;
+
+	mnt_cache_set_max_entries(cache, strtou32_or_err(argv[1], "invalid max"));
+
+	while(fgets(line, sizeof(line), stdin)) {
+		size_t sz = strlen(line);
+		const char *cached, *res;
+
+		if (sz > 0 && line[sz - 1] == '\n')
+			line[sz - 1] = '\0';
+
+		cache_lock(cache);
+		cached = cache_find_path(cache, line);
+		cache_unlock(cache);
+
+		res = mnt_resolve_path(line, cache);
+		printf("%s : %s [%s]\n", line, res, cached ? "cached" : "new");
+	}
+
+	printf("entries (%zu):\n", cache->nents);
+	list_for_each(p, &cache->lru) {
+		struct mnt_cache_entry *e = list_entry(p, struct mnt_cache_entry, lru);
+		printf("  %s\n", e->key);
+	}
+
+	mnt_unref_cache(cache);
+	return 0;
+}
+
+#ifdef HAVE_BTRFS_SUPPORT
+/*
+ * The arguments are <mountpoint>[=<id>]. The <id> is stored to the cache
+ * before the lookup, so the cache is testable also without btrfs (the ioctl
+ * is not called for the cached filesystems).
+ */
+static int test_btrfs_default(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_cache *cache;
+	struct libmnt_table *tb;
+	int i, rc = 0;
+
+	tb = mnt_new_table_from_file(_PATH_PROC_MOUNTINFO);
+	if (!tb)
+		return -errno;
+	cache = mnt_new_cache();
+	if (!cache) {
+		mnt_unref_table(tb);
+		return -ENOMEM;
+	}
+
+	for (i = 1; i < argc; i++) {
+		char *path = argv[i], *id_str = strchr(path, '=');
+		struct libmnt_fs *fs;
+		uint64_t id;
+		dev_t devno;
+		int cached;
+
+		if (id_str)
+			*id_str++ = '\0';
+
+		fs = mnt_table_find_target(tb, path, MNT_ITER_BACKWARD);
+		if (!fs) {
+			warnx("%s: not a mountpoint", path);
+			rc = -EINVAL;
+			continue;
+		}
+		devno = mnt_fs_get_devno(fs);
+
+		if (id_str)
+			mnt_cache_set_btrfs_default(cache, devno,
+					strtou64_or_err(id_str, "invalid ID"));
+		cached = mnt_cache_get_btrfs_default(cache, devno, &id) == 0;
+
+		id = btrfs_get_cached_default_subvol_id(cache, devno, path);
+		if (id == UINT64_MAX)
+			printf("%s : failed\n", path);
+		else
+			printf("%s : %ju [%s]\n", path, (uintmax_t) id,
+					cached ? "cached" : "new");
+	}
+
+	mnt_unref_cache(cache);
+	mnt_unref_table(tb);
+	return rc;
+}
+#endif /* HAVE_BTRFS_SUPPORT */
+
 int main(int argc, char *argv[])
 {
 	struct libmnt_test ts[] = {
 		{ "--resolve-path", test_resolve_path, "  resolve paths from stdin" },
+		{ "--lru", test_lru, "<max>  resolve paths from stdin by cache limited to <max> entries" },
 		{ "--resolve-spec", test_resolve_spec, "  evaluate specs from stdin" },
 		{ "--read-tags", test_read_tags,       "  read devname or TAG from stdin (\"quit\" to exit)" },
+#ifdef HAVE_BTRFS_SUPPORT
+		{ "--btrfs-default", test_btrfs_default, "<mountpoint>[=<id>] ...  btrfs default subvolume ID by cache" },
+#endif
 		{ NULL }
 	};
 
@@ -188,6 +188,7 @@ int mnt_reset_context(struct libmnt_context *cxt)
 	cxt->flags |= (fl & MNT_FL_FORK);
 	cxt->flags |= (fl & MNT_FL_FORCE);
 	cxt->flags |= (fl & MNT_FL_NOCANONICALIZE);
+	cxt->flags |= (fl & MNT_FL_FAST);
 	cxt->flags |= (fl & MNT_FL_RDONLY_UMOUNT);
 	cxt->flags |= (fl & MNT_FL_RWONLY_MOUNT);
 	cxt->flags |= (fl & MNT_FL_NOSWAPMATCH);
@@ -537,7 +538,55 @@ int mnt_context_disable_canonicalize(struct libmnt_context *cxt, int disable)
  */
 int mnt_context_is_nocanonicalize(struct libmnt_context *cxt)
 {
-	return cxt->flags & MNT_FL_NOCANONICALIZE ? 1 : 0;
+	return (cxt->flags & MNT_FL_NOCANONICALIZE) || mnt_context_is_fast(cxt) ? 1 : 0;
+}
+
+/**
+ * mnt_context_enable_fast:
+ * @cxt: mount context
+ * @enable: TRUE or FALSE
+ *
+ * Enable/disable the fast mode for the applications which call many bind
+ * mounts and remounts (e.g. container runtimes) with one context and
+ * mnt_reset_context() between the mounts. The caller promises that the
+ * source and target are canonical paths and that the mount does not need
+ * fstab, mtab, /sbin/mount.<type> helpers or userspace mount options.
+ *
+ * In the fast mode the context does not canonicalize paths or evaluate tags
+ * (as mnt_context_disable_canonicalize()), does not search for helpers (as
+ * mnt_context_disable_helpers()), does not lock and update utab (as
+ * mnt_context_disable_mtab()) and does not read fstab or mountinfo for
+ * remount if the target is specified.
+ *
+ * The bind mounts with VFS flags (e.g. "bind,ro") and the bind remounts are
+ * done by open_tree(), mount_setattr() and move_mount() syscalls if
+ * supported by the kernel, so the bind mount is attached with the flags
+ * already applied and the flags are applied to the whole tree for recursive
+ * (rbind) operations. The classic mount(2) changes the flags on the top
+ * level mount only.
+ *
+ * The fast mode is ignored for restricted (suid) mounts.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ *
+ * Since: 2.36
+ */
+int mnt_context_enable_fast(struct libmnt_context *cxt, int enable)
+{
+	return set_flag(cxt, MNT_FL_FAST, enable);
+}
+
+/**
+ * mnt_context_is_fast:
+ * @cxt: mount context
+ *
+ * Returns: 1 if the fast mode is enabled or 0
+ *
+ * Since: 2.36
+ */
+int mnt_context_is_fast(struct libmnt_context *cxt)
+{
+	return (cxt->flags & MNT_FL_FAST) && !mnt_context_is_restricted(cxt) ? 1 : 0;
 }
 
 /**
@@ -715,7 +764,7 @@ int mnt_context_disable_helpers(struct libmnt_context *cxt, int disable)
  */
 int mnt_context_is_nohelpers(struct libmnt_context *cxt)
 {
-	return cxt->flags & MNT_FL_NOHELPERS ? 1 : 0;
+	return (cxt->flags & MNT_FL_NOHELPERS) || mnt_context_is_fast(cxt) ? 1 : 0;
 }
 
 
@@ -791,7 +840,7 @@ int mnt_context_disable_mtab(struct libmnt_context *cxt, int disable)
  */
 int mnt_context_is_nomtab(struct libmnt_context *cxt)
 {
-	return cxt->flags & MNT_FL_NOMTAB ? 1 : 0;
+	return (cxt->flags & MNT_FL_NOMTAB) || mnt_context_is_fast(cxt) ? 1 : 0;
 }
 
 /**
@@ -913,9 +962,16 @@ int mnt_context_is_loopdel(struct libmnt_context *cxt)
  */
 int mnt_context_set_fs(struct libmnt_context *cxt, struct libmnt_fs *fs)
 {
+	int rc;
+
 	if (!cxt)
 		return -EINVAL;
 
+	/* the context modifies the strings in place */
+	rc = mnt_fs_detach_arena(fs);
+	if (rc)
+		return rc;
+
 	DBG(CXT, ul_debugobj(cxt, "setting new FS"));
 	mnt_ref_fs(fs);			/* new */
 	mnt_unref_fs(cxt->fs);		/* old */
@@ -1298,6 +1354,7 @@ int mnt_context_get_mtab(struct libmnt_context *cxt, struct libmnt_table **tb)
 					cxt->table_fltrcb_data);
 
 		mnt_table_set_cache(cxt->mtab, mnt_context_get_cache(cxt));
+		mnt_table_enable_listmount(cxt->mtab, MNT_STATMNT_ALL);
 
 		/*
 		 * Note that mtab_path is NULL if mtab is useless or unsupported
@@ -2473,6 +2530,12 @@ int mnt_context_apply_fstab(struct libmnt_context *cxt)
 		return 0;
 	}
 
+	/* the fast mode does not use fstab/mtab at all */
+	if (tgt && mnt_context_is_fast(cxt)) {
+		DBG(CXT, ul_debugobj(cxt, "fast mode; fstab/mtab not required -- skip"));
+		return 0;
+	}
+
 	if (!src && tgt
 	    && !(cxt->optsmode & MNT_OMODE_FSTAB)
 	    && !(cxt->optsmode & MNT_OMODE_MTAB)) {
@@ -3244,6 +3307,10 @@ static int test_mount(struct libmnt_test *ts, int argc, char *argv[])
 	if (!cxt)
 		return -ENOMEM;
 
+	if (!strcmp(argv[idx], "--fast")) {
+		mnt_context_enable_fast(cxt, TRUE);
+		idx++;
+	}
 	if (!strcmp(argv[idx], "-o")) {
 		mnt_context_set_options(cxt, argv[idx + 1]);
 		idx += 2;
@@ -3425,7 +3492,7 @@ static int test_mountall(struct libmnt_test *ts, int argc, char *argv[])
 int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
-	{ "--mount",  test_mount,  "[-o <opts>] [-t <type>] <spec>|<src> <target>" },
+	{ "--mount",  test_mount,  "[--fast] [-o <opts>] [-t <type>] <spec>|<src> <target>" },
 	{ "--umount", test_umount, "[-t <type>] [-f][-l][-r] <src>|<target>" },
 	{ "--mount-all", test_mountall,  "[-O <pattern>] [-t <pattern] mount all filesystems from fstab" },
 	{ "--flags", test_flags,   "[-o <opts>] <spec>" },
@@ -155,6 +155,7 @@ int mnt_context_setup_loopdev(struct libmnt_context *cxt)
 	size_t len;
 	struct loopdev_cxt lc;
 	int rc = 0, lo_flags = 0;
+	unsigned int attempt = 0;
 	uint64_t offset = 0, sizelimit = 0;
 	bool reuse = FALSE;
 
@@ -346,6 +347,7 @@ int mnt_context_setup_loopdev(struct libmnt_context *cxt)
 			goto done;
 		}
 		DBG(LOOP, ul_debugobj(cxt, "device stolen...trying again"));
+		loopcxt_busy_backoff(&lc, attempt++);
 	} while (1);
 
 success:
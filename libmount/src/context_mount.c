@@ -25,6 +25,7 @@
 #include <sys/mount.h>
 
 #include "linux_version.h"
+#include "mount-api-utils.h"
 #include "mountP.h"
 #include "strutils.h"
 
@@ -75,27 +76,20 @@ static int mnt_context_append_additional_mount(struct libmnt_context *cxt,
  * add additional mount(2) syscall requests when necessary to set propagation flags
  * after regular mount(2).
  */
-static int init_propagation(struct libmnt_context *cxt)
+static int init_propagation(struct libmnt_context *cxt,
+			    struct libmnt_optlist *vfs)
 {
-	char *name;
-	char *opts = (char *) mnt_fs_get_vfs_options(cxt->fs);
-	size_t namesz;
-	struct libmnt_optmap const *maps[1];
 	int rec_count = 0;
-
-	if (!opts)
-		return 0;
+	size_t i;
 
 	DBG(CXT, ul_debugobj(cxt, "mount: initialize additional propagation mounts"));
 
-	maps[0] = mnt_get_builtin_optmap(MNT_LINUX_MAP);
-
-	while (!mnt_optstr_next_option(&opts, &name, &namesz, NULL, NULL)) {
-		const struct libmnt_optmap *ent;
+	for (i = 0; i < vfs->nents; i++) {
+		const struct libmnt_optmap *ent = vfs->ents[i].mapent;
 		struct libmnt_addmount *ad;
 		int rc;
 
-		if (!mnt_optmap_get_entry(maps, 1, name, namesz, &ent) || !ent)
+		if (vfs->ents[i].removed || !vfs->ents[i].map || !ent)
 			continue;
 
 		DBG(CXT, ul_debugobj(cxt, " checking %s", ent->name));
@@ -186,16 +180,34 @@ static int is_option(const char *name, size_t namesz,
 }
 #endif /* HAVE_LIBSELINUX || HAVE_SMACK */
 
+/* replaces @optstr with the options from the list, empty list is NULL */
+static int set_optstr(char **optstr, struct libmnt_optlist *ol)
+{
+	char *p = NULL;
+	int rc = mnt_optlist_to_string(ol, &p);
+
+	if (rc)
+		return rc;
+	free(*optstr);
+	*optstr = p;
+	return 0;
+}
+
 /*
  * this has to be called after mnt_context_evaluate_permissions()
+ *
+ * The VFS, userspace and FS options are parsed only once and all the
+ * changes are done in the options lists, the strings in the fs are updated
+ * at the end.
  */
 static int fix_optstr(struct libmnt_context *cxt)
 {
 	int rc = 0;
 	struct libmnt_ns *ns_old;
-	char *next;
-	char *name, *val;
-	size_t namesz, valsz;
+	struct libmnt_optlist vl, ul, fl;	/* VFS, userspace and FS options */
+	struct libmnt_optmap const *maps[1];
+	char *val;
+	size_t valsz, i;
 	struct libmnt_fs *fs;
 #ifdef HAVE_LIBSELINUX
 	int se_fix = 0, se_rem = 0;
@@ -227,6 +239,10 @@ static int fix_optstr(struct libmnt_context *cxt)
 
 	fs = cxt->fs;
 
+	memset(&vl, 0, sizeof(vl));
+	memset(&ul, 0, sizeof(ul));
+	memset(&fl, 0, sizeof(fl));
+
 	DBG(CXT, ul_debugobj(cxt, "mount: fixing options, current "
 		"vfs: '%s' fs: '%s' user: '%s', optstr: '%s'",
 		fs->vfs_optstr, fs->fs_optstr, fs->user_optstr, fs->optstr));
@@ -253,39 +269,39 @@ static int fix_optstr(struct libmnt_context *cxt)
 	 * Sync mount options with mount flags
 	 */
 	DBG(CXT, ul_debugobj(cxt, "mount: fixing vfs optstr"));
-	rc = mnt_optstr_apply_flags(&fs->vfs_optstr, cxt->mountflags,
-				mnt_get_builtin_optmap(MNT_LINUX_MAP));
+	maps[0] = mnt_get_builtin_optmap(MNT_LINUX_MAP);
+	rc = mnt_init_optlist(&vl, fs->vfs_optstr, maps, 1);
+	if (!rc)
+		rc = mnt_optlist_apply_flags(&vl, cxt->mountflags, maps[0]);
+	if (!rc)
+		rc = set_optstr(&fs->vfs_optstr, &vl);
 	if (rc)
 		goto done;
 
 	DBG(CXT, ul_debugobj(cxt, "mount: fixing user optstr"));
-	rc = mnt_optstr_apply_flags(&fs->user_optstr, cxt->user_mountflags,
-				mnt_get_builtin_optmap(MNT_USERSPACE_MAP));
+	maps[0] = mnt_get_builtin_optmap(MNT_USERSPACE_MAP);
+	rc = mnt_init_optlist(&ul, fs->user_optstr, maps, 1);
+	if (!rc)
+		rc = mnt_optlist_apply_flags(&ul, cxt->user_mountflags, maps[0]);
 	if (rc)
 		goto done;
 
-	if (fs->vfs_optstr && *fs->vfs_optstr == '\0') {
-		free(fs->vfs_optstr);
-		fs->vfs_optstr = NULL;
-	}
-	if (fs->user_optstr && *fs->user_optstr == '\0') {
-		free(fs->user_optstr);
-		fs->user_optstr = NULL;
-	}
 	if (cxt->mountflags & MS_PROPAGATION) {
-		rc = init_propagation(cxt);
+		rc = init_propagation(cxt, &vl);
 		if (rc)
-			return rc;
+			goto err;
 	}
 	if ((cxt->mountflags & MS_BIND)
 	    && (cxt->mountflags & MNT_BIND_SETTABLE)
 	    && !(cxt->mountflags & MS_REMOUNT)) {
 		rc = init_bind_remount(cxt);
 		if (rc)
-			return rc;
+			goto err;
 	}
 
-	next = fs->fs_optstr;
+	rc = mnt_init_optlist(&fl, fs->fs_optstr, NULL, 0);
+	if (rc)
+		goto done;
 
 #ifdef HAVE_LIBSELINUX
 	if (!is_selinux_enabled())
@@ -310,44 +326,40 @@ static int fix_optstr(struct libmnt_context *cxt)
 		/* de-duplicate SELinux options */
 		const struct libmnt_optname *p;
 		for (p = selinux_options; p && p->name; p++)
-			mnt_optstr_deduplicate_option(&fs->fs_optstr, p->name);
+			mnt_optlist_deduplicate_option(&fl, p->name);
 	}
 #endif
 #ifdef HAVE_SMACK
 	if (access("/sys/fs/smackfs", F_OK) != 0)
 		sm_rem = 1;
 #endif
-	while (!mnt_optstr_next_option(&next, &name, &namesz, &val, &valsz)) {
+	for (i = 0; i < fl.nents; i++) {
+		struct libmnt_optent *oe = &fl.ents[i];
+		const char *name = fl.buf + oe->name;
+		size_t namesz = oe->namesz;
+
+		if (oe->removed)
+			continue;
 
 		if (namesz == 3 && !strncmp(name, "uid", 3))
-			rc = mnt_optstr_fix_uid(&fs->fs_optstr, val, valsz, &next);
+			rc = mnt_optlist_fix_uid(&fl, oe);
 		else if (namesz == 3 && !strncmp(name, "gid", 3))
-			rc = mnt_optstr_fix_gid(&fs->fs_optstr, val, valsz, &next);
+			rc = mnt_optlist_fix_gid(&fl, oe);
 #ifdef HAVE_LIBSELINUX
 		else if ((se_rem || se_fix)
 			 && is_option(name, namesz, selinux_options)) {
 
-			if (se_rem) {
+			if (se_rem)
 				/* remove context= option */
-				next = name;
-				rc = mnt_optstr_remove_option_at(&fs->fs_optstr,
-						name,
-						val ? val + valsz :
-						      name + namesz);
-			} else if (se_fix && val && valsz)
+				mnt_optlist_remove_option(&fl, oe);
+			else if (se_fix && oe->has_value && oe->valsz)
 				/* translate selinux contexts */
-				rc = mnt_optstr_fix_secontext(&fs->fs_optstr,
-							val, valsz, &next);
+				rc = mnt_optlist_fix_secontext(&fl, oe);
 		}
 #endif
 #ifdef HAVE_SMACK
-		else if (sm_rem && is_option(name, namesz, smack_options)) {
-
-			next = name;
-			rc = mnt_optstr_remove_option_at(&fs->fs_optstr,
-					name,
-					val ? val + valsz : name + namesz);
-		}
+		else if (sm_rem && is_option(name, namesz, smack_options))
+			mnt_optlist_remove_option(&fl, oe);
 #endif
 		if (rc)
 			goto done;
@@ -356,15 +368,24 @@ static int fix_optstr(struct libmnt_context *cxt)
 
 	if (!rc && mnt_context_is_restricted(cxt) && (cxt->user_mountflags & MNT_MS_USER)) {
 		ns_old = mnt_context_switch_origin_ns(cxt);
-		if (!ns_old)
-			return -MNT_ERR_NAMESPACE;
+		if (!ns_old) {
+			rc = -MNT_ERR_NAMESPACE;
+			goto err;
+		}
 
-		rc = mnt_optstr_fix_user(&fs->user_optstr);
+		rc = mnt_optlist_fix_user(&ul);
 
-		if (!mnt_context_switch_ns(cxt, ns_old))
-			return -MNT_ERR_NAMESPACE;
+		if (!mnt_context_switch_ns(cxt, ns_old)) {
+			rc = -MNT_ERR_NAMESPACE;
+			goto err;
+		}
 	}
 
+	if (!rc)
+		rc = set_optstr(&fs->user_optstr, &ul);
+	if (!rc)
+		rc = set_optstr(&fs->fs_optstr, &fl);
+
 	/* refresh merged optstr */
 	free(fs->optstr);
 	fs->optstr = NULL;
@@ -378,6 +399,10 @@ done:
 
 	if (rc)
 		rc = -MNT_ERR_MOUNTOPT;
+err:
+	mnt_reset_optlist(&vl);
+	mnt_reset_optlist(&ul);
+	mnt_reset_optlist(&fl);
 	return rc;
 }
 
@@ -388,8 +413,9 @@ done:
 static int generate_helper_optstr(struct libmnt_context *cxt, char **optstr)
 {
 	struct libmnt_optmap const *maps[2];
-	char *next, *name, *val;
-	size_t namesz, valsz;
+	struct libmnt_optlist ol;
+	char *o;
+	size_t i;
 	int rc = 0;
 
 	assert(cxt);
@@ -398,10 +424,19 @@ static int generate_helper_optstr(struct libmnt_context *cxt, char **optstr)
 
 	DBG(CXT, ul_debugobj(cxt, "mount: generate helper mount options"));
 
-	*optstr = mnt_fs_strdup_options(cxt->fs);
-	if (!*optstr)
+	*optstr = NULL;
+
+	o = mnt_fs_strdup_options(cxt->fs);
+	if (!o)
 		return -ENOMEM;
 
+	maps[0] = mnt_get_builtin_optmap(MNT_USERSPACE_MAP);
+	maps[1] = mnt_get_builtin_optmap(MNT_LINUX_MAP);
+	rc = mnt_init_optlist(&ol, o, maps, 2);
+	free(o);
+	if (rc)
+		return rc;
+
 	if ((cxt->user_mountflags & MNT_MS_USER) ||
 	    (cxt->user_mountflags & MNT_MS_USERS)) {
 		/*
@@ -417,41 +452,28 @@ static int generate_helper_optstr(struct libmnt_context *cxt, char **optstr)
 		 * mount string in libmount for VFS options).
 		 */
 		if (!(cxt->mountflags & MS_NOEXEC))
-			mnt_optstr_append_option(optstr, "exec", NULL);
-		if (!(cxt->mountflags & MS_NOSUID))
-			mnt_optstr_append_option(optstr, "suid", NULL);
-		if (!(cxt->mountflags & MS_NODEV))
-			mnt_optstr_append_option(optstr, "dev", NULL);
+			rc = mnt_optlist_append_option(&ol, "exec", NULL);
+		if (!rc && !(cxt->mountflags & MS_NOSUID))
+			rc = mnt_optlist_append_option(&ol, "suid", NULL);
+		if (!rc && !(cxt->mountflags & MS_NODEV))
+			rc = mnt_optlist_append_option(&ol, "dev", NULL);
 	}
 
-
-	if (cxt->flags & MNT_FL_SAVED_USER)
-		rc = mnt_optstr_set_option(optstr, "user", cxt->orig_user);
-	if (rc)
-		goto err;
+	if (!rc && (cxt->flags & MNT_FL_SAVED_USER))
+		rc = mnt_optlist_set_option(&ol, "user", cxt->orig_user);
 
 	/* remove userspace options with MNT_NOHLPS flag */
-	maps[0] = mnt_get_builtin_optmap(MNT_USERSPACE_MAP);
-	maps[1] = mnt_get_builtin_optmap(MNT_LINUX_MAP);
-	next = *optstr;
-
-	while (!mnt_optstr_next_option(&next, &name, &namesz, &val, &valsz)) {
-		const struct libmnt_optmap *ent;
-
-		mnt_optmap_get_entry(maps, 2, name, namesz, &ent);
-		if (ent && ent->id && (ent->mask & MNT_NOHLPS)) {
-			next = name;
-			rc = mnt_optstr_remove_option_at(optstr, name,
-					val ? val + valsz : name + namesz);
-			if (rc)
-				goto err;
-		}
+	for (i = 0; !rc && i < ol.nents; i++) {
+		const struct libmnt_optmap *ent = ol.ents[i].mapent;
+
+		if (ent && ent->id && (ent->mask & MNT_NOHLPS))
+			mnt_optlist_remove_option(&ol, &ol.ents[i]);
 	}
 
-	return rc;
-err:
-	free(*optstr);
-	*optstr = NULL;
+	if (!rc)
+		rc = mnt_optlist_to_string(&ol, optstr);
+
+	mnt_reset_optlist(&ol);
 	return rc;
 }
 
@@ -716,6 +738,121 @@ static int exec_helper(struct libmnt_context *cxt)
 	return rc;
 }
 
+#ifdef UL_HAVE_MOUNT_API_SETATTR
+/* MS_* flags for "remount,bind" to MOUNT_ATTR_* */
+static void mflags_to_attr(unsigned long flags, struct ul_mount_attr *attr)
+{
+	memset(attr, 0, sizeof(*attr));
+
+	attr->attr_clr = UL_MOUNT_ATTR_RDONLY | UL_MOUNT_ATTR_NOSUID |
+			 UL_MOUNT_ATTR_NODEV | UL_MOUNT_ATTR_NOEXEC |
+			 UL_MOUNT_ATTR_NODIRATIME;
+	if (flags & MS_RDONLY)
+		attr->attr_set |= UL_MOUNT_ATTR_RDONLY;
+	if (flags & MS_NOSUID)
+		attr->attr_set |= UL_MOUNT_ATTR_NOSUID;
+	if (flags & MS_NODEV)
+		attr->attr_set |= UL_MOUNT_ATTR_NODEV;
+	if (flags & MS_NOEXEC)
+		attr->attr_set |= UL_MOUNT_ATTR_NOEXEC;
+	if (flags & MS_NODIRATIME)
+		attr->attr_set |= UL_MOUNT_ATTR_NODIRATIME;
+
+	/* atime is preserved by bind remount if not specified */
+	if (flags & (MS_NOATIME | MS_STRICTATIME | MS_RELATIME)) {
+		attr->attr_clr |= UL_MOUNT_ATTR__ATIME;
+		if (flags & MS_NOATIME)
+			attr->attr_set |= UL_MOUNT_ATTR_NOATIME;
+		else if (flags & MS_STRICTATIME)
+			attr->attr_set |= UL_MOUNT_ATTR_STRICTATIME;
+		else
+			attr->attr_set |= UL_MOUNT_ATTR_RELATIME;
+	}
+}
+#endif
+
+/*
+ * The fast mode "remount,bind,<flags>" by mount_setattr(), the flags are
+ * applied to the whole tree for MS_REC.
+ *
+ * Returns: 0 on success, -ENOSYS if unsupported (use mount(2)) or -errno.
+ */
+static int do_setattr(struct libmnt_context *cxt, const char *target,
+		      unsigned long flags)
+{
+#ifdef UL_HAVE_MOUNT_API_SETATTR
+	struct ul_mount_attr attr;
+
+	mflags_to_attr(flags, &attr);
+
+	DBG(CXT, ul_debugobj(cxt, "mount_setattr(2) [target=%s, set=0x%08" PRIx64
+				  ", clr=0x%08" PRIx64 "%s]",
+				  target, (uint64_t) attr.attr_set,
+				  (uint64_t) attr.attr_clr,
+				  flags & MS_REC ? ", recursive" : ""));
+
+	if (ul_mount_setattr(AT_FDCWD, target,
+			     flags & MS_REC ? UL_AT_RECURSIVE : 0, &attr) == 0)
+		return 0;
+	DBG(CXT, ul_debugobj(cxt, "mount_setattr(2) failed [errno=%d %m]", errno));
+	return -errno;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/*
+ * The fast mode "bind,<flags>" by open_tree(), mount_setattr() and
+ * move_mount(), the tree is attached with the flags already applied.
+ *
+ * Returns: 0 on success, -ENOSYS if unsupported (use mount(2)) or -errno.
+ */
+static int do_bind_setattr(struct libmnt_context *cxt, const char *src,
+			   const char *target, unsigned long flags)
+{
+#ifdef UL_HAVE_MOUNT_API_SETATTR
+	struct ul_mount_attr attr;
+	unsigned int rec = flags & MS_REC ? UL_AT_RECURSIVE : 0;
+	int fd, rc = 0;
+
+	mflags_to_attr(flags, &attr);
+
+	DBG(CXT, ul_debugobj(cxt, "open_tree(2) [source=%s, target=%s%s]",
+				  src, target, rec ? ", recursive" : ""));
+
+	fd = ul_open_tree(AT_FDCWD, src,
+			  UL_OPEN_TREE_CLONE | UL_OPEN_TREE_CLOEXEC | rec);
+	if (fd < 0)
+		rc = -errno;
+	else if (ul_mount_setattr(fd, "", UL_AT_EMPTY_PATH | rec, &attr) != 0
+		 || ul_move_mount(fd, "", AT_FDCWD, target,
+				  UL_MOVE_MOUNT_F_EMPTY_PATH) != 0)
+		rc = -errno;
+	if (fd >= 0)
+		close(fd);
+	if (rc)
+		DBG(CXT, ul_debugobj(cxt, "new mount API failed [rc=%d]", rc));
+	return rc;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/* returns the "remount,bind,<flags>" request added by init_bind_remount() */
+static struct libmnt_addmount *get_bind_remount(struct libmnt_context *cxt)
+{
+	struct list_head *p;
+
+	list_for_each(p, &cxt->addmounts) {
+		struct libmnt_addmount *ad =
+				list_entry(p, struct libmnt_addmount, mounts);
+
+		if ((ad->mountflags & (MS_REMOUNT | MS_BIND)) == (MS_REMOUNT | MS_BIND))
+			return ad;
+	}
+	return NULL;
+}
+
 static int do_mount_additional(struct libmnt_context *cxt,
 			       const char *target,
 			       unsigned long flags,
@@ -734,6 +871,18 @@ static int do_mount_additional(struct libmnt_context *cxt,
 		struct libmnt_addmount *ad =
 				list_entry(p, struct libmnt_addmount, mounts);
 
+		if (mnt_context_is_fast(cxt)
+		    && (ad->mountflags & (MS_REMOUNT | MS_BIND)) == (MS_REMOUNT | MS_BIND)) {
+			rc = do_setattr(cxt, target, ad->mountflags);
+			if (rc == 0)
+				continue;
+			if (rc != -ENOSYS) {
+				if (syserr)
+					*syserr = rc;
+				return rc;
+			}
+		}
+
 		DBG(CXT, ul_debugobj(cxt, "mount(2) changing flag: 0x%08lx %s",
 				ad->mountflags,
 				ad->mountflags & MS_REC ? " (recursive)" : ""));
@@ -826,6 +975,36 @@ static int do_mount(struct libmnt_context *cxt, const char *try_type)
 		if (do_mount_additional(cxt, target, flags, &cxt->syscall_status))
 			return -MNT_ERR_APPLYFLAGS;
 	} else {
+		struct libmnt_addmount *ad = NULL;
+
+		/*
+		 * fast mode bind with flags or bind remount
+		 */
+		rc = -ENOSYS;
+		if (mnt_context_is_fast(cxt) && (flags & MS_BIND)) {
+			if (flags & MS_REMOUNT)
+				rc = do_setattr(cxt, target, flags);
+			else if ((ad = get_bind_remount(cxt)))
+				rc = do_bind_setattr(cxt, src, target, ad->mountflags);
+		}
+
+		if (rc == 0) {
+			DBG(CXT, ul_debugobj(cxt, "  success"));
+			cxt->syscall_status = 0;
+
+			/* the flags are already applied */
+			mnt_free_addmount(ad);
+			if (!list_empty(&cxt->addmounts)
+			    && do_mount_additional(cxt, target, flags, NULL))
+				return -MNT_ERR_APPLYFLAGS;
+			goto done;
+		}
+		if (rc != -ENOSYS) {
+			cxt->syscall_status = rc;
+			return -rc;
+		}
+		rc = 0;
+
 		/*
 		 * regular mount
 		 */
@@ -848,7 +1027,7 @@ static int do_mount(struct libmnt_context *cxt, const char *try_type)
 			return -MNT_ERR_APPLYFLAGS;
 		}
 	}
-
+done:
 	if (try_type && cxt->update) {
 		struct libmnt_fs *fs = mnt_update_get_fs(cxt->update);
 		if (fs)
@@ -1286,9 +1465,8 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 			   int *mntrc,
 			   int *ignored)
 {
-	struct libmnt_table *fstab, *mtab;
-	const char *o, *tgt;
-	int rc, mounted = 0;
+	struct libmnt_table *fstab;
+	int rc, ign = 0;
 
 	if (ignored)
 		*ignored = 0;
@@ -1306,13 +1484,55 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 	if (rc != 0)
 		return rc;	/* more filesystems (or error) */
 
-	o = mnt_fs_get_user_options(*fs);
-	tgt = mnt_fs_get_target(*fs);
+	rc = mnt_context_check_next_mount(cxt, *fs, &ign);
+	if (rc || ign) {
+		if (ignored)
+			*ignored = ign;
+		return rc;
+	}
+
+	mnt_context_prepare_next_mount(cxt);
+
+	if (mnt_context_is_fork(cxt)) {
+		rc = mnt_fork_context(cxt);
+		if (rc)
+			return rc;		/* fork error */
+
+		if (mnt_context_is_parent(cxt)) {
+			return 0;		/* parent */
+		}
+	}
+
+	/*
+	 * child or non-forked
+	 */
+	rc = mnt_context_mount_fstab_entry(cxt, *fs, mntrc);
+
+	if (mnt_context_is_child(cxt)) {
+		DBG(CXT, ul_debugobj(cxt, "next-mount: child exit [rc=%d]", rc));
+		DBG_FLUSH;
+		_exit(rc);
+	}
+	return 0;
+}
+
+/*
+ * Checks if the fstab entry should be mounted by mnt_context_next_mount(),
+ * @ignored returns 1 for non-matching and 2 for already mounted filesystems.
+ */
+int mnt_context_check_next_mount(struct libmnt_context *cxt,
+				 struct libmnt_fs *fs, int *ignored)
+{
+	const char *o, *tgt;
+	int rc, mounted = 0;
+
+	o = mnt_fs_get_user_options(fs);
+	tgt = mnt_fs_get_target(fs);
 
 	DBG(CXT, ul_debugobj(cxt, "next-mount: trying %s", tgt));
 
 	/*  ignore swap */
-	if (mnt_fs_is_swaparea(*fs) ||
+	if (mnt_fs_is_swaparea(fs) ||
 
 	/* ignore root filesystem */
 	   (tgt && (strcmp(tgt, "/") == 0 || strcmp(tgt, "root") == 0)) ||
@@ -1321,32 +1541,38 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 	   (o && mnt_optstr_get_option(o, "noauto", NULL, NULL) == 0) ||
 
 	/* ignore filesystems which don't match options patterns */
-	   (cxt->fstype_pattern && !mnt_fs_match_fstype(*fs,
+	   (cxt->fstype_pattern && !mnt_fs_match_fstype(fs,
 					cxt->fstype_pattern)) ||
 
 	/* ignore filesystems which don't match type patterns */
-	   (cxt->optstr_pattern && !mnt_fs_match_options(*fs,
+	   (cxt->optstr_pattern && !mnt_fs_match_options(fs,
 					cxt->optstr_pattern))) {
-		if (ignored)
-			*ignored = 1;
+		*ignored = 1;
 		DBG(CXT, ul_debugobj(cxt, "next-mount: not-match "
 				"[fstype: %s, t-pattern: %s, options: %s, O-pattern: %s]",
-				mnt_fs_get_fstype(*fs),
+				mnt_fs_get_fstype(fs),
 				cxt->fstype_pattern,
-				mnt_fs_get_options(*fs),
+				mnt_fs_get_options(fs),
 				cxt->optstr_pattern));
 		return 0;
 	}
 
 	/* ignore already mounted filesystems */
-	rc = mnt_context_is_fs_mounted(cxt, *fs, &mounted);
+	rc = mnt_context_is_fs_mounted(cxt, fs, &mounted);
 	if (rc)
 		return rc;
-	if (mounted) {
-		if (ignored)
-			*ignored = 2;
-		return 0;
-	}
+	if (mounted)
+		*ignored = 2;
+	return 0;
+}
+
+/*
+ * Resets @cxt before the next mnt_context_mount_fstab_entry() call. The
+ * template and mtab are kept.
+ */
+void mnt_context_prepare_next_mount(struct libmnt_context *cxt)
+{
+	struct libmnt_table *mtab;
 
 	/* Save mount options, etc. -- this is effective for the first
 	 * mnt_context_next_mount() call only. Make sure that cxt has not set
@@ -1364,23 +1590,20 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 	cxt->mtab = NULL;
 	mnt_reset_context(cxt);
 	cxt->mtab = mtab;
+}
 
-	if (mnt_context_is_fork(cxt)) {
-		rc = mnt_fork_context(cxt);
-		if (rc)
-			return rc;		/* fork error */
-
-		if (mnt_context_is_parent(cxt)) {
-			return 0;		/* parent */
-		}
-	}
-
-	/*
-	 * child or non-forked
-	 */
+/*
+ * Mounts fstab entry @fs by context prepared by
+ * mnt_context_prepare_next_mount(). The @mntrc returns mnt_context_mount()
+ * return code.
+ */
+int mnt_context_mount_fstab_entry(struct libmnt_context *cxt,
+				  struct libmnt_fs *fs, int *mntrc)
+{
+	int rc;
 
 	/* copy stuff from fstab to context */
-	rc = mnt_context_apply_fs(cxt, *fs);
+	rc = mnt_context_apply_fs(cxt, fs);
 	if (!rc) {
 		/*
 		 * "-t <pattern>" is used to filter out fstab entries, but for ordinary
@@ -1397,13 +1620,7 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 		if (mntrc)
 			*mntrc = rc;
 	}
-
-	if (mnt_context_is_child(cxt)) {
-		DBG(CXT, ul_debugobj(cxt, "next-mount: child exit [rc=%d]", rc));
-		DBG_FLUSH;
-		_exit(rc);
-	}
-	return 0;
+	return rc;
 }
 
 
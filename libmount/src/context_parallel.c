@@ -0,0 +1,815 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * This file is part of libmount from util-linux project.
+ *
+ * libmount is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * SECTION: context-parallel
+ * @title: Parallel mount and umount
+ * @short_description: mount or umount all filesystems by more processes
+ *
+ * The functions mount (or umount) all filesystems like mnt_context_next_mount()
+ * (or mnt_context_next_umount()) loop, but the operations are executed by
+ * forked children at the same time. The filesystems are ordered by the
+ * mountpoints, all parental filesystems are mounted before the filesystem
+ * (and umounted after the filesystem). The independent subtrees are mounted
+ * in parallel.
+ *
+ * The standard output and standard error output of the children are
+ * captured and written in the original fstab (or mountinfo) order, so the
+ * output is the same as from the sequential mount.
+ *
+ * The recursive umount (see mnt_context_umount_tree_parallel()) uses the
+ * parent-child relations from mountinfo rather than the mountpoint paths, the
+ * filesystem is umounted when all its children are umounted and the leaves
+ * from the independent branches are umounted at the same time.
+ */
+
+#include <stdio.h>
+#include <sys/wait.h>
+
+#include "mountP.h"
+#include "all-io.h"
+#include "pathnames.h"
+
+enum {
+	MNT_JOB_PENDING = 0,
+	MNT_JOB_RUNNING,
+	MNT_JOB_DONE
+};
+
+struct mnt_job {
+	struct libmnt_fs	*fs;
+	pid_t			pid;
+	int			state;
+	int			ignored;	/* see mnt_context_next_mount() */
+	int			status;		/* child exit status */
+	size_t			ndeps;		/* number of unfinished dependencies */
+	size_t			parent;		/* parental job in the tree mode */
+
+	FILE			*out;		/* captured stdout and stderr */
+	FILE			*err;
+	char			*outbuf;
+	char			*errbuf;
+	size_t			outsz;
+	size_t			errsz;
+};
+
+struct mnt_jobs {
+	struct mnt_job		*jobs;
+	size_t			njobs;
+	size_t			nrunning;
+	size_t			nreported;	/* jobs reported in the table order */
+	int			umount;
+
+	struct libmnt_table	*tb;		/* tree mode mountinfo */
+	unsigned int		tree : 1;	/* deps by mnt_fs_get_parent_id() */
+};
+
+#define MNT_JOB_NOPARENT	((size_t) -1)
+
+/*
+ * Returns 1 if the @path is @dir or a path below the @dir. The paths do not
+ * have to exist, so canonicalization is not possible. The duplicate slashes
+ * are ignored.
+ */
+static int path_is_below(const char *dir, const char *path)
+{
+	if (!dir || !path || *dir != '/' || *path != '/')
+		return 0;
+
+	while (1) {
+		size_t dl, pl;
+
+		while (*dir == '/')
+			dir++;
+		while (*path == '/')
+			path++;
+		if (!*dir)
+			return 1;
+
+		dl = strcspn(dir, "/");
+		pl = strcspn(path, "/");
+		if (dl != pl || strncmp(dir, path, dl) != 0)
+			return 0;
+		dir += dl;
+		path += pl;
+	}
+}
+
+/*
+ * Returns 1 if the job @b (later in the table order) has to wait for the job @a.
+ */
+static int job_depends_on(struct mnt_jobs *js, struct mnt_job *b, struct mnt_job *a)
+{
+	if (a->ignored || b->ignored)
+		return 0;
+
+	if (js->umount)
+		/* umount children before the parent */
+		return path_is_below(mnt_fs_get_target(b->fs),
+				     mnt_fs_get_target(a->fs));
+
+	/* mount parent before the children; and mount the filesystem
+	 * before bind mounts or loop devices from the filesystem */
+	return path_is_below(mnt_fs_get_target(a->fs), mnt_fs_get_target(b->fs))
+	    || path_is_below(mnt_fs_get_target(a->fs), mnt_fs_get_srcpath(b->fs));
+}
+
+static void free_jobs(struct mnt_jobs *js)
+{
+	size_t i;
+
+	for (i = 0; i < js->njobs; i++) {
+		struct mnt_job *j = &js->jobs[i];
+
+		if (j->out)
+			fclose(j->out);
+		if (j->err)
+			fclose(j->err);
+		free(j->outbuf);
+		free(j->errbuf);
+		mnt_unref_fs(j->fs);
+	}
+	free(js->jobs);
+}
+
+static int add_job(struct mnt_jobs *js, struct libmnt_fs *fs, int ignored)
+{
+	struct mnt_job *jobs, *j;
+	size_t i;
+
+	jobs = realloc(js->jobs, (js->njobs + 1) * sizeof(struct mnt_job));
+	if (!jobs)
+		return -ENOMEM;
+	js->jobs = jobs;
+
+	j = &js->jobs[js->njobs];
+	memset(j, 0, sizeof(*j));
+	j->fs = fs;
+	mnt_ref_fs(fs);
+	j->ignored = ignored;
+	j->parent = MNT_JOB_NOPARENT;
+	if (ignored)
+		j->state = MNT_JOB_DONE;
+
+	for (i = 0; !js->tree && i < js->njobs; i++) {
+		if (job_depends_on(js, j, &js->jobs[i]))
+			j->ndeps++;
+	}
+	js->njobs++;
+	return 0;
+}
+
+/*
+ * Adds jobs for @fs and all its children in the post-order, the order is the
+ * same as for the sequential "umount --recursive" (the last mounted child
+ * first). The dependencies are the direct children of the filesystem.
+ */
+static int add_tree_jobs(struct mnt_jobs *js, struct libmnt_table *tb,
+			 struct libmnt_fs *fs)
+{
+	struct libmnt_iter itr;
+	struct libmnt_fs *child;
+	size_t i, first = js->njobs, me;
+	int rc;
+
+	mnt_reset_iter(&itr, MNT_ITER_BACKWARD);
+	while ((rc = mnt_table_next_child_fs(tb, &itr, fs, &child)) == 0) {
+		rc = add_tree_jobs(js, tb, child);
+		if (rc)
+			return rc;
+	}
+	if (rc < 0)
+		return rc;
+
+	rc = add_job(js, fs, 0);
+	if (rc)
+		return rc;
+
+	/* jobs without parent are direct children, the grandchildren
+	 * already have the parents */
+	me = js->njobs - 1;
+	for (i = first; i < me; i++) {
+		if (js->jobs[i].parent != MNT_JOB_NOPARENT)
+			continue;
+		js->jobs[i].parent = me;
+		js->jobs[me].ndeps++;
+	}
+	return 0;
+}
+
+/* reads the captured output to the memory, the file is closed */
+static int read_capture(FILE **f, char **buf, size_t *bufsz)
+{
+	struct stat st;
+	int fd, rc = 0;
+
+	if (!*f)
+		return 0;
+	fd = fileno(*f);
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		*buf = malloc(st.st_size);
+		if (!*buf)
+			rc = -ENOMEM;
+		else if (lseek(fd, 0, SEEK_SET) != 0
+			 || read_all(fd, *buf, st.st_size) != st.st_size)
+			rc = -errno;
+		else
+			*bufsz = st.st_size;
+	}
+	fclose(*f);
+	*f = NULL;
+	return rc;
+}
+
+static void job_finished(struct mnt_jobs *js, struct mnt_job *j, int status)
+{
+	size_t i;
+
+	j->state = MNT_JOB_DONE;
+	j->status = status;
+	j->pid = 0;
+
+	read_capture(&j->out, &j->outbuf, &j->outsz);
+	read_capture(&j->err, &j->errbuf, &j->errsz);
+
+	if (js->tree) {
+		struct mnt_job *p;
+
+		if (j->parent == MNT_JOB_NOPARENT)
+			return;
+		p = &js->jobs[j->parent];
+		if (p->ndeps)
+			p->ndeps--;
+
+		/* the parent is busy if any child is still mounted, don't
+		 * try it and report it as skipped */
+		if (status && p->state == MNT_JOB_PENDING) {
+			p->ignored = 3;
+			job_finished(js, p, status);
+		}
+		return;
+	}
+
+	for (i = j - js->jobs + 1; i < js->njobs; i++) {
+		struct mnt_job *x = &js->jobs[i];
+
+		if (x->ndeps && job_depends_on(js, x, j))
+			x->ndeps--;
+	}
+}
+
+/* returns 1 if the mount ID of @fs is still in the kernel mount table */
+static int is_still_mounted(struct libmnt_context *cxt, struct libmnt_fs *fs)
+{
+	struct libmnt_table *tb;
+	struct libmnt_ns *ns_old;
+	int id = mnt_fs_get_id(fs), rc = 1;
+
+	if (id <= 0)
+		return 1;
+
+	ns_old = mnt_context_switch_target_ns(cxt);
+	if (!ns_old)
+		return 1;
+
+	tb = mnt_new_table_from_file(_PATH_PROC_MOUNTINFO);
+	if (tb) {
+		struct libmnt_iter itr;
+		struct libmnt_fs *x;
+
+		rc = 0;
+		mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+		while (rc == 0 && mnt_table_next_fs(tb, &itr, &x) == 0)
+			rc = mnt_fs_get_id(x) == id;
+		mnt_unref_table(tb);
+	}
+	mnt_context_switch_ns(cxt, ns_old);
+	return rc;
+}
+
+/*
+ * Umounts the filesystem in the child process. In the tree mode the lazy
+ * umount is used only if the filesystem is busy, and the filesystem
+ * umounted by propagation (e.g. from a peer) is not an error.
+ *
+ * Returns: 1 if the filesystem is not mounted anymore, 0 or umount(2) error.
+ */
+static int job_umount(struct libmnt_context *cxt, struct mnt_jobs *js,
+		      struct mnt_job *j, int *mntrc)
+{
+	struct libmnt_table *mtab;
+	int rc, lazy = js->tree && mnt_context_is_lazy(cxt);
+
+	mtab = cxt->mtab;
+	cxt->mtab = NULL;		/* do not reset mtab */
+	mnt_reset_context(cxt);
+	cxt->mtab = mtab;
+
+	if (lazy)
+		mnt_context_enable_lazy(cxt, 0);
+
+	rc = mnt_context_set_fs(cxt, j->fs);
+	if (!rc)
+		rc = *mntrc = mnt_context_umount(cxt);
+	if (!rc || !js->tree || !mnt_context_syscall_called(cxt))
+		return rc;
+
+	switch (mnt_context_get_syscall_errno(cxt)) {
+	case EINVAL:
+		if (is_still_mounted(cxt, j->fs))
+			break;
+		DBG(CXT, ul_debugobj(cxt, "parallel: %s already umounted",
+					mnt_fs_get_target(j->fs)));
+		return 1;
+	case EBUSY:
+		if (!lazy)
+			break;
+		DBG(CXT, ul_debugobj(cxt, "parallel: %s busy, trying lazy umount",
+					mnt_fs_get_target(j->fs)));
+		cxt->mtab = NULL;
+		mnt_reset_context(cxt);
+		cxt->mtab = mtab;
+
+		mnt_context_enable_lazy(cxt, 1);
+		rc = mnt_context_set_fs(cxt, j->fs);
+		if (!rc)
+			rc = *mntrc = mnt_context_umount(cxt);
+		break;
+	}
+	return rc;
+}
+
+static void job_run_child(struct libmnt_context *cxt,
+			struct mnt_jobs *js, struct mnt_job *j,
+			int (*excode)(struct libmnt_context *, struct libmnt_fs *, int, void *),
+			void *data)
+{
+	int rc, mntrc = 0;
+
+	cxt->pid = getpid();
+
+	if (j->out)
+		dup2(fileno(j->out), STDOUT_FILENO);
+	if (j->err)
+		dup2(fileno(j->err), STDERR_FILENO);
+
+	DBG(CXT, ul_debugobj(cxt, "parallel: child for %s", mnt_fs_get_target(j->fs)));
+
+	if (js->umount) {
+		if (js->tree && !cxt->mtab) {
+			mnt_ref_table(js->tb);
+			cxt->mtab = js->tb;
+		}
+		rc = job_umount(cxt, js, j, &mntrc);
+	} else
+		rc = mnt_context_mount_fstab_entry(cxt, j->fs, &mntrc);
+
+	if (rc == 1)
+		rc = MNT_EX_SUCCESS;		/* already umounted */
+	else
+		rc = excode ? excode(cxt, j->fs, mntrc, data) : rc;
+
+	DBG(CXT, ul_debugobj(cxt, "parallel: child exit [rc=%d]", rc));
+	DBG_FLUSH;
+	fflush(stdout);
+	fflush(stderr);
+	_exit(rc);
+}
+
+static int job_start(struct libmnt_context *cxt,
+		     struct mnt_jobs *js, struct mnt_job *j,
+		     int (*excode)(struct libmnt_context *, struct libmnt_fs *, int, void *),
+		     void *data)
+{
+	pid_t pid;
+
+	j->out = tmpfile();
+	j->err = tmpfile();
+
+	DBG_FLUSH;
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	switch (pid) {
+	case -1:
+	{
+		int errsv = errno;
+
+		DBG(CXT, ul_debugobj(cxt, "parallel: fork failed %m"));
+		if (j->out)
+			fclose(j->out);
+		if (j->err)
+			fclose(j->err);
+		j->out = j->err = NULL;
+		return -errsv;
+	}
+	case 0:
+		job_run_child(cxt, js, j, excode, data);
+		break;
+	default:
+		DBG(CXT, ul_debugobj(cxt, "parallel: %s started [pid=%d]",
+					mnt_fs_get_target(j->fs), pid));
+		j->pid = pid;
+		j->state = MNT_JOB_RUNNING;
+		js->nrunning++;
+		break;
+	}
+	return 0;
+}
+
+static int job_wait(struct libmnt_context *cxt, struct mnt_jobs *js)
+{
+	size_t i;
+	pid_t pid;
+	int ret = 0;
+
+	do {
+		errno = 0;
+		pid = waitpid(-1, &ret, 0);
+	} while (pid == -1 && errno == EINTR);
+
+	if (pid == -1)
+		return -errno;
+
+	for (i = 0; i < js->njobs; i++) {
+		struct mnt_job *j = &js->jobs[i];
+
+		if (j->state != MNT_JOB_RUNNING || j->pid != pid)
+			continue;
+
+		DBG(CXT, ul_debugobj(cxt, "parallel: %s finished [pid=%d]",
+					mnt_fs_get_target(j->fs), pid));
+		js->nrunning--;
+		job_finished(js, j,
+			WIFEXITED(ret) ? WEXITSTATUS(ret) : MNT_EX_SYSERR);
+		break;
+	}
+	return 0;
+}
+
+/* writes output and calls report callback for finished jobs in table order */
+static void report_jobs(struct libmnt_context *cxt, struct mnt_jobs *js,
+			void (*report)(struct libmnt_context *, struct libmnt_fs *,
+					int, int, void *),
+			void *data)
+{
+	while (js->nreported < js->njobs) {
+		struct mnt_job *j = &js->jobs[js->nreported];
+
+		if (j->state != MNT_JOB_DONE)
+			break;
+		if (j->outsz) {
+			fwrite(j->outbuf, 1, j->outsz, stdout);
+			fflush(stdout);
+		}
+		if (j->errsz) {
+			fwrite(j->errbuf, 1, j->errsz, stderr);
+			fflush(stderr);
+		}
+		if (report)
+			report(cxt, j->fs, j->status, j->ignored, data);
+
+		free(j->outbuf);
+		free(j->errbuf);
+		j->outbuf = j->errbuf = NULL;
+		js->nreported++;
+	}
+}
+
+static int run_jobs(struct libmnt_context *cxt, struct mnt_jobs *js,
+		size_t nworkers,
+		int (*excode)(struct libmnt_context *, struct libmnt_fs *, int, void *),
+		void (*report)(struct libmnt_context *, struct libmnt_fs *, int, int, void *),
+		void *data)
+{
+	int rc = 0;
+
+	if (!nworkers)
+		nworkers = 1;
+
+	DBG(CXT, ul_debugobj(cxt, "parallel: %zu jobs, %zu workers",
+				js->njobs, nworkers));
+
+	while (js->nreported < js->njobs) {
+		size_t i;
+
+		for (i = 0; i < js->njobs && js->nrunning < nworkers; i++) {
+			struct mnt_job *j = &js->jobs[i];
+
+			if (j->state != MNT_JOB_PENDING || j->ndeps)
+				continue;
+			if (job_start(cxt, js, j, excode, data) != 0) {
+				if (js->nrunning)
+					break;		/* try it later */
+				job_finished(js, j, MNT_EX_SYSERR);
+			}
+		}
+
+		report_jobs(cxt, js, report, data);
+		if (!js->nrunning)
+			continue;
+
+		rc = job_wait(cxt, js);
+		if (rc)
+			break;
+	}
+
+	return rc;
+}
+
+/**
+ * mnt_context_mount_parallel:
+ * @cxt: context
+ * @nworkers: maximal number of concurrently running mounts
+ * @excode: returns exit code for the child process
+ * @report: reports the result in the parent process
+ * @data: callbacks data
+ *
+ * Mounts all filesystems from fstab (see mnt_context_next_mount() for more
+ * details about filtering). The mounts are executed by forked children, the
+ * @excode callback is called in the child after mnt_context_mount() with
+ * the mnt_context_mount() return code and it returns exit status of the child
+ * (usually mnt_context_get_excode()).
+ *
+ * The @report callback is called in the parent process for all fstab entries
+ * in the fstab order with the exit status of the child or with non-zero
+ * @ignored argument (1 for non-matching and 2 for already mounted
+ * filesystems).
+ *
+ * Returns: 0 on success, negative number in case of error (!= mount(2) errors).
+ *
+ * Since: 2.36
+ */
+int mnt_context_mount_parallel(struct libmnt_context *cxt, size_t nworkers,
+		int (*excode)(struct libmnt_context *, struct libmnt_fs *, int, void *),
+		void (*report)(struct libmnt_context *, struct libmnt_fs *, int, int, void *),
+		void *data)
+{
+	struct mnt_jobs js = { .umount = 0 };
+	struct libmnt_table *fstab;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	int rc;
+
+	if (!cxt || mnt_context_is_fork(cxt) || mnt_context_is_child(cxt))
+		return -EINVAL;
+
+	rc = mnt_context_get_fstab(cxt, &fstab);
+	if (rc)
+		return rc;
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(fstab, &itr, &fs) == 0) {
+		int ignored = 0;
+
+		rc = mnt_context_check_next_mount(cxt, fs, &ignored);
+		if (!rc)
+			rc = add_job(&js, fs, ignored);
+		if (rc)
+			goto done;
+	}
+
+	/* save template and reset the context in the parent, the children
+	 * need only the fstab entry */
+	mnt_context_prepare_next_mount(cxt);
+
+	rc = run_jobs(cxt, &js, nworkers, excode, report, data);
+done:
+	free_jobs(&js);
+	return rc;
+}
+
+/**
+ * mnt_context_umount_parallel:
+ * @cxt: context
+ * @nworkers: maximal number of concurrently running umounts
+ * @excode: returns exit code for the child process
+ * @report: reports the result in the parent process
+ * @data: callbacks data
+ *
+ * Umounts all filesystems from mtab in reverse order, see
+ * mnt_context_mount_parallel() and mnt_context_next_umount() for more
+ * details.
+ *
+ * Returns: 0 on success, negative number in case of error (!= umount(2) errors).
+ *
+ * Since: 2.36
+ */
+int mnt_context_umount_parallel(struct libmnt_context *cxt, size_t nworkers,
+		int (*excode)(struct libmnt_context *, struct libmnt_fs *, int, void *),
+		void (*report)(struct libmnt_context *, struct libmnt_fs *, int, int, void *),
+		void *data)
+{
+	struct mnt_jobs js = { .umount = 1 };
+	struct libmnt_table *mtab;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	int rc;
+
+	if (!cxt || mnt_context_is_fork(cxt) || mnt_context_is_child(cxt))
+		return -EINVAL;
+
+	rc = mnt_context_get_mtab(cxt, &mtab);
+	if (rc)
+		return rc;
+
+	mnt_reset_iter(&itr, MNT_ITER_BACKWARD);
+	while (mnt_table_next_fs(mtab, &itr, &fs) == 0) {
+		if (!mnt_fs_get_target(fs))
+			continue;
+		rc = add_job(&js, fs, mnt_context_match_next_umount(cxt, fs) ? 0 : 1);
+		if (rc)
+			goto done;
+	}
+
+	rc = run_jobs(cxt, &js, nworkers, excode, report, data);
+done:
+	free_jobs(&js);
+	return rc;
+}
+
+/**
+ * mnt_context_umount_tree_parallel:
+ * @cxt: context
+ * @tb: mountinfo table
+ * @fs: the top-level filesystem from @tb
+ * @nworkers: maximal number of concurrently running umounts
+ * @excode: returns exit code for the child process
+ * @report: reports the result in the parent process
+ * @data: callbacks data
+ *
+ * Umounts @fs and all its submounts (like "umount --recursive"). The tree is
+ * built from the mount and parent IDs in @tb, every filesystem is umounted
+ * after its children and the independent branches are umounted in parallel.
+ * The @report callback is called in the same order as the sequential
+ * recursive umount uses (the last mounted child first, the top-level
+ * filesystem last).
+ *
+ * If the umount fails, the parental filesystems are not umounted and they are
+ * reported with @ignored argument 3. The filesystems umounted in the meantime
+ * (for example by mount propagation) are not reported as errors. If lazy
+ * umount is enabled, the usual umount is tried first and the lazy umount is
+ * used only for the busy filesystems.
+ *
+ * See mnt_context_mount_parallel() for more details about the callbacks.
+ *
+ * Returns: 0 on success, negative number in case of error (!= umount(2) errors).
+ *
+ * Since: 2.36
+ */
+int mnt_context_umount_tree_parallel(struct libmnt_context *cxt,
+		struct libmnt_table *tb, struct libmnt_fs *fs, size_t nworkers,
+		int (*excode)(struct libmnt_context *, struct libmnt_fs *, int, void *),
+		void (*report)(struct libmnt_context *, struct libmnt_fs *, int, int, void *),
+		void *data)
+{
+	struct mnt_jobs js = { .umount = 1, .tree = 1, .tb = tb };
+	int rc;
+
+	if (!cxt || !tb || !fs || mnt_context_is_fork(cxt) || mnt_context_is_child(cxt))
+		return -EINVAL;
+
+	rc = add_tree_jobs(&js, tb, fs);
+	if (!rc)
+		rc = run_jobs(cxt, &js, nworkers, excode, report, data);
+
+	free_jobs(&js);
+	return rc;
+}
+
+#ifdef TEST_PROGRAM
+
+static int test_below(struct libmnt_test *ts, int argc, char *argv[])
+{
+	if (argc != 3)
+		return -EINVAL;
+
+	printf("%s %s below %s\n", argv[2],
+		path_is_below(argv[1], argv[2]) ? "is" : "is not", argv[1]);
+	return 0;
+}
+
+static int test_order(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct mnt_jobs js = { .umount = 0 };
+	struct libmnt_table *tb;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	size_t i, round = 0, ndone = 0;
+	int rc = 0;
+
+	if (argc < 2)
+		return -EINVAL;
+	if (argc > 2 && strcmp(argv[2], "umount") == 0)
+		js.umount = 1;
+
+	tb = mnt_new_table_from_file(argv[1]);
+	if (!tb)
+		return -EINVAL;
+
+	mnt_reset_iter(&itr, js.umount ? MNT_ITER_BACKWARD : MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0)
+		add_job(&js, fs, 0);
+
+	/* simulate unlimited number of workers, print the rounds */
+	while (ndone < js.njobs) {
+		struct mnt_job *ready[js.njobs];
+		size_t nready = 0;
+
+		for (i = 0; i < js.njobs; i++) {
+			if (js.jobs[i].state == MNT_JOB_PENDING && !js.jobs[i].ndeps)
+				ready[nready++] = &js.jobs[i];
+		}
+		if (!nready) {
+			rc = -EINVAL;
+			break;
+		}
+		printf("round %zu:", ++round);
+		for (i = 0; i < nready; i++) {
+			printf(" %s", mnt_fs_get_target(ready[i]->fs));
+			job_finished(&js, ready[i], 0);
+		}
+		printf("\n");
+		ndone += nready;
+	}
+
+	free_jobs(&js);
+	mnt_unref_table(tb);
+	return rc;
+}
+
+/* like test_order(), but uses the parent IDs (without failures) */
+static int test_tree(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct mnt_jobs js = { .umount = 1, .tree = 1 };
+	struct libmnt_table *tb;
+	struct libmnt_fs *fs;
+	size_t i, round = 0, ndone = 0;
+	int rc;
+
+	if (argc != 3)
+		return -EINVAL;
+
+	tb = mnt_new_table_from_file(argv[1]);
+	if (!tb)
+		return -EINVAL;
+	js.tb = tb;
+
+	fs = mnt_table_find_target(tb, argv[2], MNT_ITER_BACKWARD);
+	rc = fs ? add_tree_jobs(&js, tb, fs) : -EINVAL;
+	if (rc)
+		goto done;
+
+	printf("order:");
+	for (i = 0; i < js.njobs; i++)
+		printf(" %d", mnt_fs_get_id(js.jobs[i].fs));
+	printf("\n");
+
+	while (ndone < js.njobs) {
+		struct mnt_job *ready[js.njobs];
+		size_t nready = 0;
+
+		for (i = 0; i < js.njobs; i++) {
+			if (js.jobs[i].state == MNT_JOB_PENDING && !js.jobs[i].ndeps)
+				ready[nready++] = &js.jobs[i];
+		}
+		if (!nready) {
+			rc = -EINVAL;
+			break;
+		}
+		printf("round %zu:", ++round);
+		for (i = 0; i < nready; i++) {
+			printf(" %d", mnt_fs_get_id(ready[i]->fs));
+			job_finished(&js, ready[i], 0);
+		}
+		printf("\n");
+		ndone += nready;
+	}
+done:
+	free_jobs(&js);
+	mnt_unref_table(tb);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct libmnt_test tss[] = {
+	{ "--below", test_below, "<dir> <path>  check if path is below dir" },
+	{ "--order", test_order, "<file> [umount]  print mount (or umount) rounds for fstab" },
+	{ "--tree", test_tree, "<mountinfo> <target>  print recursive umount rounds" },
+	{ NULL }
+	};
+
+	return mnt_run_test(tss, argc, argv);
+}
+
+#endif /* TEST_PROGRAM */
@@ -202,7 +202,7 @@ static int has_utab_entry(struct libmnt_context *cxt, const char *target)
 	if (!cxt->utab) {
 		const char *path = mnt_get_utab_path();
 
-		if (!path || is_file_empty(path))
+		if (!path || mnt_utab_is_empty(path))
 			return 0;
 		cxt->utab = mnt_new_table();
 		if (!cxt->utab)
@@ -1147,20 +1147,9 @@ int mnt_context_next_umount(struct libmnt_context *cxt,
 		tgt = mnt_fs_get_target(*fs);
 	} while (!tgt);
 
-	DBG(CXT, ul_debugobj(cxt, "next-umount: trying %s [fstype: %s, t-pattern: %s, options: %s, O-pattern: %s]", tgt,
-				 mnt_fs_get_fstype(*fs), cxt->fstype_pattern, mnt_fs_get_options(*fs), cxt->optstr_pattern));
-
-	/* ignore filesystems which don't match options patterns */
-	if ((cxt->fstype_pattern && !mnt_fs_match_fstype(*fs,
-					cxt->fstype_pattern)) ||
-
-	/* ignore filesystems which don't match type patterns */
-	   (cxt->optstr_pattern && !mnt_fs_match_options(*fs,
-					cxt->optstr_pattern))) {
+	if (!mnt_context_match_next_umount(cxt, *fs)) {
 		if (ignored)
 			*ignored = 1;
-
-		DBG(CXT, ul_debugobj(cxt, "next-umount: not-match"));
 		return 0;
 	}
 
@@ -1174,6 +1163,31 @@ int mnt_context_next_umount(struct libmnt_context *cxt,
 }
 
 
+/*
+ * Returns 1 if the mounted filesystem matches patterns used by
+ * mnt_context_next_umount(), or 0.
+ */
+int mnt_context_match_next_umount(struct libmnt_context *cxt,
+				  struct libmnt_fs *fs)
+{
+	DBG(CXT, ul_debugobj(cxt, "next-umount: trying %s [fstype: %s, t-pattern: %s, options: %s, O-pattern: %s]",
+				 mnt_fs_get_target(fs), mnt_fs_get_fstype(fs),
+				 cxt->fstype_pattern, mnt_fs_get_options(fs),
+				 cxt->optstr_pattern));
+
+	/* ignore filesystems which don't match options patterns */
+	if ((cxt->fstype_pattern && !mnt_fs_match_fstype(fs,
+					cxt->fstype_pattern)) ||
+
+	/* ignore filesystems which don't match type patterns */
+	   (cxt->optstr_pattern && !mnt_fs_match_options(fs,
+					cxt->optstr_pattern))) {
+		DBG(CXT, ul_debugobj(cxt, "next-umount: not-match"));
+		return 0;
+	}
+	return 1;
+}
+
 int mnt_context_get_umount_excode(
 			struct libmnt_context *cxt,
 			int rc,
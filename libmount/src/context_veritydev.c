@@ -44,14 +44,97 @@ static size_t crypt_hex_to_bytes(const char *hex, char **result)
 	return i;
 }
 
+/*
+ * Checks already active @mapper_device. The device is reused if it has the
+ * same root hash, and it has been opened with a signature if @is_signed is
+ * true (and vice versa). The kernel does the refcounting for us.
+ *
+ * Returns: 0 if the device is reusable, 1 if the device is not active,
+ *          -EINVAL if the device does not match, -EEXIST if not possible to
+ *          verify the device, or other negative number on error.
+ */
+static int verity_reuse_device(struct libmnt_context *cxt,
+				const char *mapper_device, const char *root_hash,
+				int is_signed __attribute__((__unused__)))
+{
+	struct crypt_params_verity crypt_params = {};
+	struct crypt_device *crypt_dev = NULL;
+	char *key = NULL, *root_hash_binary = NULL;
+	size_t hash_size, keysize;
+	int rc;
+
+	switch (crypt_status(NULL, mapper_device)) {
+	case CRYPT_ACTIVE:
+	case CRYPT_BUSY:
+		break;
+	default:
+		return 1;
+	}
+
+	DBG(VERITY, ul_debugobj(cxt, "/dev/mapper/%s already active", mapper_device));
+
+	rc = crypt_init_by_name(&crypt_dev, mapper_device);
+	if (!rc)
+		rc = crypt_get_verity_info(crypt_dev, &crypt_params);
+	if (rc) {
+		rc = -EEXIST;
+		goto done;
+	}
+
+	hash_size = crypt_get_volume_key_size(crypt_dev);
+	if (crypt_hex_to_bytes(root_hash, &root_hash_binary) != hash_size) {
+		DBG(VERITY, ul_debugobj(cxt, "root hash %s is not of length %zu", root_hash, hash_size));
+		rc = -EINVAL;
+		goto done;
+	}
+
+	key = calloc(hash_size, 1);
+	if (!key) {
+		rc = -ENOMEM;
+		goto done;
+	}
+	keysize = hash_size;
+	rc = crypt_volume_key_get(crypt_dev, CRYPT_ANY_SLOT, key, &keysize, NULL, 0);
+	if (rc) {
+		DBG(VERITY, ul_debugobj(cxt, "libcryptsetup does not support extracting root hash of existing device"));
+		rc = -EEXIST;
+		goto done;
+	}
+
+	DBG(VERITY, ul_debugobj(cxt, "comparing root hash of existing device with %s", root_hash));
+	if (memcmp(key, root_hash_binary, hash_size)) {
+		DBG(VERITY, ul_debugobj(cxt, "existing device's hash does not match with %s", root_hash));
+		rc = -EINVAL;
+		goto done;
+	}
+#ifdef HAVE_CRYPT_ACTIVATE_BY_SIGNED_KEY
+	/*
+	 * Ensure that, if signatures are supported, we only reuse the device if the previous mount
+	 * used the same settings, so that a previous unsigned mount will not be reused if the user
+	 * asks to use signing for the new one, and viceversa.
+	 */
+	if (!!is_signed != !!(crypt_params.flags & CRYPT_VERITY_ROOT_HASH_SIGNATURE)) {
+		DBG(VERITY, ul_debugobj(cxt, "existing device and new mount have to either be both opened with signature or both without"));
+		rc = -EINVAL;
+		goto done;
+	}
+#endif
+	DBG(VERITY, ul_debugobj(cxt, "root hash of %s matches %s, reusing device", mapper_device, root_hash));
+done:
+	crypt_free(crypt_dev);
+	free(root_hash_binary);
+	free(key);
+	return rc;
+}
+
 
 int mnt_context_setup_veritydev(struct libmnt_context *cxt)
 {
 	const char *backing_file, *optstr;
-	char *val = NULL, *key = NULL, *root_hash_binary = NULL, *mapper_device = NULL,
+	char *val = NULL, *root_hash_binary = NULL, *mapper_device = NULL,
 		*mapper_device_full = NULL, *backing_file_basename = NULL, *root_hash = NULL,
 		*hash_device = NULL, *root_hash_file = NULL, *fec_device = NULL, *hash_sig = NULL;
-	size_t len, hash_size, hash_sig_size = 0, keysize = 0;
+	size_t len, hash_size, hash_sig_size = 0;
 	struct crypt_params_verity crypt_params = {};
 	struct crypt_device *crypt_dev = NULL;
 	int rc = 0;
@@ -189,6 +272,16 @@ int mnt_context_setup_veritydev(struct libmnt_context *cxt)
 	if (rc)
 		goto done;
 
+	/*
+	 * The same image with the same root hash is often already mapped (the
+	 * image is mounted repeatedly, or container layers are shared). Check
+	 * the active device first, it's cheaper than reading the verity
+	 * superblock from the hash device and trying to activate a new device.
+	 */
+	rc = verity_reuse_device(cxt, mapper_device, root_hash, !!hash_sig);
+	if (rc != 1)
+		goto ready;
+
 	rc = crypt_init_data_device(&crypt_dev, hash_device, backing_file);
 	if (rc)
 		goto done;
@@ -221,62 +314,17 @@ int mnt_context_setup_veritydev(struct libmnt_context *cxt)
 		rc = crypt_activate_by_volume_key(crypt_dev, mapper_device, root_hash_binary, hash_size,
 				CRYPT_ACTIVATE_READONLY);
 	/*
-	 * If the mapper device already exists, and if libcryptsetup supports it, get the root
-	 * hash associated with the existing one and compare it with the parameter passed by
-	 * the user. If they match, then we can be sure the user intended to mount the exact
-	 * same device, and simply reuse it and return success.
-	 * The kernel does the refcounting for us.
-	 * If libcryptsetup does not support getting the root hash out of an existing device,
-	 * then return an error and tell the user that the device is already in use.
-	 * Pass through only OOM errors or mismatching root hash errors.
+	 * The mapper device has been activated in the meantime (for example by
+	 * another process mounting the same image), reuse it if it matches.
 	 */
 	if (rc == -EEXIST) {
 		DBG(VERITY, ul_debugobj(cxt, "%s already in use as /dev/mapper/%s", backing_file, mapper_device));
-		crypt_free(crypt_dev);
-		rc = crypt_init_by_name(&crypt_dev, mapper_device);
-		if (!rc) {
-			rc = crypt_get_verity_info(crypt_dev, &crypt_params);
-			if (!rc) {
-				key = calloc(hash_size, 1);
-				if (!key) {
-					rc = -ENOMEM;
-					goto done;
-				}
-			}
-			if (!rc) {
-				keysize = hash_size;
-				rc = crypt_volume_key_get(crypt_dev, CRYPT_ANY_SLOT, key, &keysize, NULL, 0);
-			}
-			if (!rc) {
-				DBG(VERITY, ul_debugobj(cxt, "comparing root hash of existing device with %s", root_hash));
-				if (memcmp(key, root_hash_binary, hash_size)) {
-					DBG(VERITY, ul_debugobj(cxt, "existing device's hash does not match with %s", root_hash));
-					rc = -EINVAL;
-					goto done;
-				}
-			} else {
-				DBG(VERITY, ul_debugobj(cxt, "libcryptsetup does not support extracting root hash of existing device"));
-			}
-		}
-		if (rc) {
+		rc = verity_reuse_device(cxt, mapper_device, root_hash, !!hash_sig);
+		if (rc == 1)
 			rc = -EEXIST;
-		} else {
-			/*
-			 * Ensure that, if signatures are supported, we only reuse the device if the previous mount
-			 * used the same settings, so that a previous unsigned mount will not be reused if the user
-			 * asks to use signing for the new one, and viceversa.
-			 */
-#ifdef HAVE_CRYPT_ACTIVATE_BY_SIGNED_KEY
-			if (!!hash_sig != !!(crypt_params.flags & CRYPT_VERITY_ROOT_HASH_SIGNATURE)) {
-				rc = -EINVAL;
-				DBG(VERITY, ul_debugobj(cxt, "existing device and new mount have to either be both opened with signature or both without"));
-				goto done;
-			}
-#endif
-			DBG(VERITY, ul_debugobj(cxt, "root hash of %s matches %s, reusing device", mapper_device, root_hash));
-		}
 	}
 
+ready:
 	if (!rc) {
 		cxt->flags |= MNT_FL_VERITYDEV_READY;
 		mapper_device_full = calloc(strlen(mapper_device) + strlen("/dev/mapper/") + 1, sizeof(char));
@@ -299,7 +347,6 @@ done:
 	free(root_hash_file);
 	free(fec_device);
 	free(hash_sig);
-	free(key);
 	return rc;
 }
 
@@ -22,6 +22,7 @@
 
 #include "mountP.h"
 #include "strutils.h"
+#include "mangle.h"
 
 /**
  * mnt_new_fs:
@@ -63,6 +64,202 @@ void mnt_free_fs(struct libmnt_fs *fs)
 	free(fs);
 }
 
+/* all strings in struct libmnt_fs which may be allocated in the arena */
+static const size_t fs_arena_strings[] = {
+	offsetof(struct libmnt_fs, source),
+	offsetof(struct libmnt_fs, root),
+	offsetof(struct libmnt_fs, target),
+	offsetof(struct libmnt_fs, fstype),
+	offsetof(struct libmnt_fs, optstr),
+	offsetof(struct libmnt_fs, vfs_optstr),
+	offsetof(struct libmnt_fs, opt_fields),
+	offsetof(struct libmnt_fs, fs_optstr),
+	offsetof(struct libmnt_fs, lazy_line)
+};
+
+static inline int is_arena_string(struct libmnt_fs *fs, const char *str)
+{
+	return fs->arena && str
+		&& str >= fs->arena_buf
+		&& str < fs->arena_buf + fs->arena_bufsz;
+}
+
+/* frees @str if the string is not in the arena */
+static inline void free_string(struct libmnt_fs *fs, char *str)
+{
+	if (!is_arena_string(fs, str))
+		free(str);
+}
+
+/* set all strings from the arena to NULL */
+static void reset_arena_strings(struct libmnt_fs *fs)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(fs_arena_strings); i++) {
+		char **str = (char **) ((char *) fs + fs_arena_strings[i]);
+
+		if (is_arena_string(fs, *str))
+			*str = NULL;
+	}
+}
+
+/*
+ * Used by the parser only. Connects @fs with the arena @ar and returns a
+ * buffer for @sz bytes of the strings. The strings of one entry are stored
+ * in one continuous buffer. The buffer has to be finalized by
+ * mnt_fs_commit_arena().
+ */
+char *mnt_fs_attach_arena(struct libmnt_fs *fs, struct libmnt_arena *ar, size_t sz)
+{
+	char *buf;
+
+	assert(!fs->arena);
+
+	buf = mnt_arena_reserve(ar, sz);
+	if (!buf)
+		return NULL;
+
+	mnt_ref_arena(ar);
+	fs->arena = ar;
+	fs->arena_buf = buf;
+	fs->arena_bufsz = sz;
+	return buf;
+}
+
+/*
+ * Connects @fs with the arena @ar where are already stored the strings of the
+ * entry in @buf.
+ */
+void mnt_fs_attach_arena_buffer(struct libmnt_fs *fs, struct libmnt_arena *ar,
+				char *buf, size_t sz)
+{
+	assert(!fs->arena);
+
+	mnt_ref_arena(ar);
+	fs->arena = ar;
+	fs->arena_buf = buf;
+	fs->arena_bufsz = sz;
+}
+
+/* Used by the parser only. @end is the end of the really used buffer. */
+void mnt_fs_commit_arena(struct libmnt_fs *fs, char *end)
+{
+	assert(fs->arena);
+	assert(end >= fs->arena_buf);
+	assert(end <= fs->arena_buf + fs->arena_bufsz);
+
+	fs->arena_bufsz = end - fs->arena_buf;
+	mnt_arena_commit(fs->arena, fs->arena_bufsz);
+}
+
+/*
+ * Converts all strings from the arena to private copies. It's necessary to
+ * call this function before any string in @fs is modified or deallocated.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_fs_detach_arena(struct libmnt_fs *fs)
+{
+	size_t i;
+	int rc;
+
+	if (!fs)
+		return 0;
+
+	/* the lazy parser would overwrite the modified strings */
+	rc = mnt_fs_parse_lazy(fs, MNT_LAZY_ALL);
+	if (rc || !fs->arena)
+		return rc;
+
+	for (i = 0; i < ARRAY_SIZE(fs_arena_strings); i++) {
+		char **str = (char **) ((char *) fs + fs_arena_strings[i]);
+
+		if (is_arena_string(fs, *str)) {
+			char *p = strdup(*str);
+
+			if (!p)
+				return -ENOMEM;
+			*str = p;
+		}
+	}
+
+	mnt_unref_arena(fs->arena);
+	fs->arena = NULL;
+	fs->arena_buf = NULL;
+	fs->arena_bufsz = 0;
+	return 0;
+}
+
+static char *strdup_lazy_field(struct libmnt_fs *fs,
+				struct libmnt_lazyfield *f, int unmangle)
+{
+	const char *s = fs->lazy_line + f->off;
+	char *p = malloc(f->len + 1);
+
+	if (!p)
+		return NULL;
+	if (unmangle)
+		unmangle_to_buffer(s, p, f->len + 1);
+	else {
+		memcpy(p, s, f->len);
+		p[f->len] = '\0';
+	}
+	return p;
+}
+
+/*
+ * Parses the mountinfo fields (MNT_LAZY_* @mask) skipped by the lazy parser,
+ * see mnt_table_enable_lazy_parse(). The raw line is deallocated when all
+ * fields are parsed.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int __mnt_fs_parse_lazy(struct libmnt_fs *fs, unsigned int mask)
+{
+	mask &= fs->lazy_mask;
+	if (mask & MNT_LAZY_OPTSTR)
+		mask |= fs->lazy_mask & (MNT_LAZY_VFSOPTS | MNT_LAZY_FSOPTS);
+
+	if (mask & MNT_LAZY_ROOT) {
+		fs->root = strdup_lazy_field(fs, &fs->lazy_root, 1);
+		if (!fs->root)
+			return -ENOMEM;
+		fs->lazy_mask &= ~MNT_LAZY_ROOT;
+	}
+	if (mask & MNT_LAZY_VFSOPTS) {
+		fs->vfs_optstr = strdup_lazy_field(fs, &fs->lazy_vfsopts, 1);
+		if (!fs->vfs_optstr)
+			return -ENOMEM;
+		fs->lazy_mask &= ~MNT_LAZY_VFSOPTS;
+	}
+	if (mask & MNT_LAZY_OPTFIELDS) {
+		fs->opt_fields = strdup_lazy_field(fs, &fs->lazy_optfields, 0);
+		if (!fs->opt_fields)
+			return -ENOMEM;
+		fs->lazy_mask &= ~MNT_LAZY_OPTFIELDS;
+	}
+	if (mask & MNT_LAZY_FSOPTS) {
+		fs->fs_optstr = strdup_lazy_field(fs, &fs->lazy_fsopts, 1);
+		if (!fs->fs_optstr)
+			return -ENOMEM;
+		fs->lazy_mask &= ~MNT_LAZY_FSOPTS;
+	}
+	if (mask & MNT_LAZY_OPTSTR) {
+		/* merge VFS and FS options to one string */
+		fs->optstr = mnt_fs_strdup_options(fs);
+		if (!fs->optstr)
+			return -ENOMEM;
+		fs->lazy_mask &= ~MNT_LAZY_OPTSTR;
+	}
+
+	if (!fs->lazy_mask) {
+		free_string(fs, fs->lazy_line);
+		fs->lazy_line = NULL;
+	}
+	return 0;
+}
+
 /**
  * mnt_reset_fs:
  * @fs: fs pointer
@@ -79,6 +276,10 @@ void mnt_reset_fs(struct libmnt_fs *fs)
 	ref = fs->refcount;
 
 	list_del(&fs->ents);
+	if (fs->arena) {
+		reset_arena_strings(fs);
+		mnt_unref_arena(fs->arena);
+	}
 	free(fs->source);
 	free(fs->bindsrc);
 	free(fs->tagname);
@@ -94,6 +295,7 @@ void mnt_reset_fs(struct libmnt_fs *fs)
 	free(fs->attrs);
 	free(fs->opt_fields);
 	free(fs->comment);
+	free(fs->lazy_line);
 
 	memset(fs, 0, sizeof(*fs));
 	INIT_LIST_HEAD(&fs->ents);
@@ -186,6 +388,10 @@ struct libmnt_fs *mnt_copy_fs(struct libmnt_fs *dest,
 
 	if (!src)
 		return NULL;
+	/* the lazy parser does not modify the entry from the user's point of view */
+	if (mnt_fs_parse_lazy((struct libmnt_fs *) src, MNT_LAZY_ALL)
+	    || mnt_fs_parse_lazy(dest, MNT_LAZY_ALL))
+		return NULL;
 	if (!dest) {
 		dest = mnt_new_fs();
 		if (!dest)
@@ -194,9 +400,12 @@ struct libmnt_fs *mnt_copy_fs(struct libmnt_fs *dest,
 		dest->tab	 = NULL;
 	}
 
+	mnt_table_invalidate_index(dest->tab);
+
 	dest->id         = src->id;
 	dest->parent     = src->parent;
 	dest->devno      = src->devno;
+	dest->uniq_id    = src->uniq_id;
 	dest->tid        = src->tid;
 
 	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, source)))
@@ -249,9 +458,12 @@ err:
  */
 struct libmnt_fs *mnt_copy_mtab_fs(const struct libmnt_fs *fs)
 {
-	struct libmnt_fs *n = mnt_new_fs();
+	struct libmnt_fs *n;
 
 	assert(fs);
+	if (mnt_fs_parse_lazy((struct libmnt_fs *) fs, MNT_LAZY_ALL))
+		return NULL;
+	n = mnt_new_fs();
 	if (!n)
 		return NULL;
 
@@ -380,7 +592,7 @@ int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 	}
 
 	if (fs->source != source)
-		free(fs->source);
+		free_string(fs, fs->source);
 
 	free(fs->tagname);
 	free(fs->tagval);
@@ -388,6 +600,8 @@ int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 	fs->source = source;
 	fs->tagname = t;
 	fs->tagval = v;
+
+	mnt_table_invalidate_index(fs->tab);
 	return 0;
 }
 
@@ -549,6 +763,11 @@ const char *mnt_fs_get_target(struct libmnt_fs *fs)
  */
 int mnt_fs_set_target(struct libmnt_fs *fs, const char *tgt)
 {
+	int rc = fs ? mnt_fs_detach_arena(fs) : -EINVAL;
+
+	if (rc)
+		return rc;
+	mnt_table_invalidate_index(fs->tab);
 	return strdup_to_struct_member(fs, target, tgt);
 }
 
@@ -575,6 +794,8 @@ int mnt_fs_get_propagation(struct libmnt_fs *fs, unsigned long *flags)
 
 	*flags = 0;
 
+	if (mnt_fs_parse_lazy(fs, MNT_LAZY_OPTFIELDS))
+		return -ENOMEM;
 	if (!fs->opt_fields)
 		return 0;
 
@@ -653,7 +874,7 @@ int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 	assert(fs);
 
 	if (fstype != fs->fstype)
-		free(fs->fstype);
+		free_string(fs, fs->fstype);
 
 	fs->fstype = fstype;
 	fs->flags &= ~MNT_FS_PSEUDO;
@@ -662,9 +883,11 @@ int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 
 	/* save info about pseudo filesystems */
 	if (fs->fstype) {
-		if (mnt_fstype_is_pseudofs(fs->fstype))
+		int class = mnt_fstype_get_class(fs->fstype);
+
+		if (class & MNT_FSTYPE_PSEUDO)
 			fs->flags |= MNT_FS_PSEUDO;
-		else if (mnt_fstype_is_netfs(fs->fstype))
+		else if (class & MNT_FSTYPE_NET)
 			fs->flags |= MNT_FS_NET;
 		else if (!strcmp(fs->fstype, "swap"))
 			fs->flags |= MNT_FS_SWAP;
@@ -765,6 +988,9 @@ char *mnt_fs_strdup_options(struct libmnt_fs *fs)
 	if (!fs)
 		return NULL;
 
+	if (mnt_fs_parse_lazy(fs, MNT_LAZY_VFSOPTS | MNT_LAZY_FSOPTS))
+		return NULL;
+
 	errno = 0;
 	if (fs->optstr)
 		return strdup(fs->optstr);
@@ -788,6 +1014,8 @@ char *mnt_fs_strdup_options(struct libmnt_fs *fs)
  */
 const char *mnt_fs_get_options(struct libmnt_fs *fs)
 {
+	if (mnt_fs_parse_lazy(fs, MNT_LAZY_OPTSTR))
+		return NULL;
 	return fs ? fs->optstr : NULL;
 }
 
@@ -800,6 +1028,8 @@ const char *mnt_fs_get_options(struct libmnt_fs *fs)
  */
 const char *mnt_fs_get_optional_fields(struct libmnt_fs *fs)
 {
+	if (mnt_fs_parse_lazy(fs, MNT_LAZY_OPTFIELDS))
+		return NULL;
 	return fs ? fs->opt_fields : NULL;
 }
 
@@ -832,10 +1062,11 @@ int mnt_fs_set_options(struct libmnt_fs *fs, const char *optstr)
 		}
 	}
 
-	free(fs->fs_optstr);
-	free(fs->vfs_optstr);
+	free_string(fs, fs->fs_optstr);
+	free_string(fs, fs->vfs_optstr);
 	free(fs->user_optstr);
-	free(fs->optstr);
+	free_string(fs, fs->optstr);
+	fs->lazy_mask &= ~(MNT_LAZY_VFSOPTS | MNT_LAZY_FSOPTS | MNT_LAZY_OPTSTR);
 
 	fs->fs_optstr = f;
 	fs->vfs_optstr = v;
@@ -867,7 +1098,9 @@ int mnt_fs_append_options(struct libmnt_fs *fs, const char *optstr)
 	if (!optstr)
 		return 0;
 
-	rc = mnt_split_optstr(optstr, &u, &v, &f, 0, 0);
+	rc = mnt_fs_detach_arena(fs);
+	if (!rc)
+		rc = mnt_split_optstr(optstr, &u, &v, &f, 0, 0);
 	if (rc)
 		return rc;
 
@@ -909,7 +1142,9 @@ int mnt_fs_prepend_options(struct libmnt_fs *fs, const char *optstr)
 	if (!optstr)
 		return 0;
 
-	rc = mnt_split_optstr(optstr, &u, &v, &f, 0, 0);
+	rc = mnt_fs_detach_arena(fs);
+	if (!rc)
+		rc = mnt_split_optstr(optstr, &u, &v, &f, 0, 0);
 	if (rc)
 		return rc;
 
@@ -937,6 +1172,8 @@ int mnt_fs_prepend_options(struct libmnt_fs *fs, const char *optstr)
  */
 const char *mnt_fs_get_fs_options(struct libmnt_fs *fs)
 {
+	if (mnt_fs_parse_lazy(fs, MNT_LAZY_FSOPTS))
+		return NULL;
 	return fs ? fs->fs_optstr : NULL;
 }
 
@@ -948,6 +1185,8 @@ const char *mnt_fs_get_fs_options(struct libmnt_fs *fs)
  */
 const char *mnt_fs_get_vfs_options(struct libmnt_fs *fs)
 {
+	if (mnt_fs_parse_lazy(fs, MNT_LAZY_VFSOPTS))
+		return NULL;
 	return fs ? fs->vfs_optstr : NULL;
 }
 
@@ -1090,6 +1329,8 @@ int mnt_fs_set_passno(struct libmnt_fs *fs, int passno)
  */
 const char *mnt_fs_get_root(struct libmnt_fs *fs)
 {
+	if (mnt_fs_parse_lazy(fs, MNT_LAZY_ROOT))
+		return NULL;
 	return fs ? fs->root : NULL;
 }
 
@@ -1102,7 +1343,9 @@ const char *mnt_fs_get_root(struct libmnt_fs *fs)
  */
 int mnt_fs_set_root(struct libmnt_fs *fs, const char *path)
 {
-	return strdup_to_struct_member(fs, root, path);
+	int rc = fs ? mnt_fs_detach_arena(fs) : -EINVAL;
+
+	return rc ? rc : strdup_to_struct_member(fs, root, path);
 }
 
 /**
@@ -1249,6 +1492,8 @@ int mnt_fs_get_option(struct libmnt_fs *fs, const char *name,
 
 	if (!fs)
 		return -EINVAL;
+	if (mnt_fs_parse_lazy(fs, MNT_LAZY_VFSOPTS | MNT_LAZY_FSOPTS))
+		return -ENOMEM;
 	if (fs->fs_optstr)
 		rc = mnt_optstr_get_option(fs->fs_optstr, name, value, valsz);
 	if (rc == 1 && fs->vfs_optstr)
@@ -21,6 +21,7 @@
 #include "mountP.h"
 
 UL_DEBUG_DEFINE_MASK(libmount);
+UL_TRACE_DEFINE(libmount);
 UL_DEBUG_DEFINE_MASKNAMES(libmount) =
 {
 	{ "all", MNT_DEBUG_ALL,		"info about all subsystems" },
@@ -58,6 +59,7 @@ void mnt_init_debug(int mask)
 		return;
 
 	__UL_INIT_DEBUG_FROM_ENV(libmount, MNT_DEBUG_, mask, LIBMOUNT_DEBUG);
+	__UL_INIT_TRACE_FROM_ENV(libmount, LIBMOUNT_TRACE);
 
 	if (libmount_debug_mask != MNT_DEBUG_INIT
 	    && libmount_debug_mask != (MNT_DEBUG_HELP|MNT_DEBUG_INIT)) {
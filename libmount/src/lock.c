@@ -42,7 +42,8 @@ struct libmnt_lock {
 
 	unsigned int	locked :1,	/* do we own the lock? */
 			sigblock :1,	/* block signals when locked */
-			simplelock :1;	/* use flock rather than normal mtab lock */
+			simplelock :1,	/* use flock rather than normal mtab lock */
+			shared :1;	/* flock(LOCK_SH) rather than LOCK_EX */
 
 	sigset_t oldsigmask;
 };
@@ -166,6 +167,23 @@ int mnt_lock_use_simplelock(struct libmnt_lock *ml, int enable)
 	return 0;
 }
 
+/* don't export this to API
+ *
+ * The shared lock is supported for flock only, it's used by utab journal
+ * writers (more writers may append to the file at the same time).
+ */
+int mnt_lock_use_shared(struct libmnt_lock *ml, int enable)
+{
+	if (!ml)
+		return -EINVAL;
+
+	assert(!ml->locked);
+
+	DBG(LOCKS, ul_debugobj(ml, "shared: %s", enable ? "ENABLED" : "DISABLED"));
+	ml->shared = enable ? 1 : 0;
+	return 0;
+}
+
 /*
  * Returns path to lockfile.
  */
@@ -231,7 +249,7 @@ static int lock_simplelock(struct libmnt_lock *ml)
 		goto err;
 	}
 
-	while (flock(ml->lockfile_fd, LOCK_EX) < 0) {
+	while (flock(ml->lockfile_fd, ml->shared ? LOCK_SH : LOCK_EX) < 0) {
 		int errsv;
 		if ((errno == EAGAIN) || (errno == EINTR))
 			continue;
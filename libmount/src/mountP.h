@@ -27,6 +27,7 @@
 #include "c.h"
 #include "list.h"
 #include "debug.h"
+#include "debugtrace.h"
 #include "libmount.h"
 
 /*
@@ -53,6 +54,10 @@
 UL_DEBUG_DECLARE_MASK(libmount);
 #define DBG(m, x)	__UL_DBG(libmount, MNT_DEBUG_, m, x)
 #define ON_DBG(m, x)	__UL_DBG_CALL(libmount, MNT_DEBUG_, m, x)
+
+UL_TRACE_DECLARE(libmount);
+#define TRACE_SCOPE(m, n)	__UL_TRACE_SCOPE(libmount, MNT_DEBUG_, m, n)
+#define TRACE_COUNT(m, n, x)	__UL_TRACE_COUNT(libmount, MNT_DEBUG_, m, n, x)
 #define DBG_FLUSH	__UL_DBG_FLUSH(libmount, MNT_DEBUG_)
 
 #define UL_DEBUG_CURRENT_MASK	UL_DEBUG_MASK(libmount)
@@ -95,6 +100,7 @@ extern int mnt_run_test(struct libmnt_test *tests, int argc, char *argv[]);
 
 /* utils.c */
 extern int mnt_valid_tagname(const char *tagname);
+extern uint32_t mnt_hash_path(const char *p);
 extern int append_string(char **a, const char *b);
 
 extern const char *mnt_statfs_get_fstype(struct statfs *vfs);
@@ -117,6 +123,11 @@ extern int mnt_open_uniq_filename(const char *filename, char **name);
 
 extern int mnt_has_regular_utab(const char **utab, int *writable);
 extern const char *mnt_get_utab_path(void);
+extern const char *mnt_get_snapshot_socket_path(void);
+
+#define MNT_FSTYPE_PSEUDO	(1 << 1)
+#define MNT_FSTYPE_NET		(1 << 2)
+extern int mnt_fstype_get_class(const char *type);
 
 extern int mnt_get_filesystems(char ***filesystems, const char *pattern);
 extern void mnt_free_filesystems(char **filesystems);
@@ -171,6 +182,14 @@ struct libmnt_iter {
 	} while(0)
 
 
+/*
+ * Position of a mountinfo field in the raw line, see mnt_table_enable_lazy_parse()
+ */
+struct libmnt_lazyfield {
+	unsigned int	off;
+	unsigned int	len;
+};
+
 /*
  * This struct represents one entry in a mtab/fstab/mountinfo file.
  * (note that fstab[1] means the first column from fstab, and so on...)
@@ -183,6 +202,8 @@ struct libmnt_fs {
 	int		id;		/* mountinfo[1]: ID */
 	int		parent;		/* mountinfo[2]: parent */
 	dev_t		devno;		/* mountinfo[3]: st_dev */
+	uint64_t	uniq_id;	/* statmount(): unique mount ID */
+	size_t		idxpos;		/* position in the table index */
 
 	char		*bindsrc;	/* utab, full path from fstab[1] for bind mounts */
 
@@ -217,8 +238,29 @@ struct libmnt_fs {
 	char		*comment;	/* fstab comment */
 
 	void		*userdata;	/* library independent data */
+
+	struct libmnt_arena *arena;	/* strings arena or NULL */
+	char		*arena_buf;	/* strings of the entry in the arena */
+	size_t		arena_bufsz;
+
+	char		*lazy_line;	/* raw mountinfo line or NULL */
+	unsigned int	lazy_mask;	/* MNT_LAZY_* not parsed yet */
+	struct libmnt_lazyfield lazy_root;
+	struct libmnt_lazyfield lazy_vfsopts;
+	struct libmnt_lazyfield lazy_optfields;
+	struct libmnt_lazyfield lazy_fsopts;
 };
 
+/*
+ * mountinfo fields parsed on demand
+ */
+#define MNT_LAZY_ROOT		(1 << 0)
+#define MNT_LAZY_VFSOPTS	(1 << 1)
+#define MNT_LAZY_OPTFIELDS	(1 << 2)
+#define MNT_LAZY_FSOPTS		(1 << 3)
+#define MNT_LAZY_OPTSTR		(1 << 4)	/* merged VFS and FS options */
+#define MNT_LAZY_ALL		((1 << 5) - 1)
+
 /*
  * fs flags
  */
@@ -240,10 +282,16 @@ struct libmnt_table {
 	int		nents;		/* number of entries */
 	int		refcount;	/* reference counter */
 	int		comms;		/* enable/disable comment parsing */
+	int		use_arena;	/* enable/disable strings arena */
+	int		lazy_parse;	/* enable/disable lazy mountinfo parsing */
+	unsigned int	listmount_mask;	/* MNT_STATMNT_* for mnt_table_parse_mtab() */
 	char		*comm_intro;	/* First comment in file */
 	char		*comm_tail;	/* Last comment in file */
 
 	struct libmnt_cache *cache;		/* canonicalized paths/tags cache */
+	struct libmnt_arena *arena;		/* strings of the parsed entries */
+	struct libmnt_tabindex *index;		/* lookup hash indexes */
+	int		nlookups;		/* lookups without index */
 
         int		(*errcb)(struct libmnt_table *tb,
 				 const char *filename, int line);
@@ -369,6 +417,7 @@ struct libmnt_context
 #define MNT_FL_FORK		(1 << 12)
 #define MNT_FL_NOSWAPMATCH	(1 << 13)
 #define MNT_FL_RWONLY_MOUNT	(1 << 14)	/* explicit mount -w; never try read-only  */
+#define MNT_FL_FAST		(1 << 15)	/* see mnt_context_enable_fast() */
 
 #define MNT_FL_MOUNTDATA	(1 << 20)
 #define MNT_FL_TAB_APPLIED	(1 << 21)	/* mtab/fstab merged to cxt->fs */
@@ -390,6 +439,7 @@ struct libmnt_context
 
 /* lock.c */
 extern int mnt_lock_use_simplelock(struct libmnt_lock *ml, int enable);
+extern int mnt_lock_use_shared(struct libmnt_lock *ml, int enable);
 
 /* optmap.c */
 extern const struct libmnt_optmap *mnt_optmap_get_entry(
@@ -401,12 +451,134 @@ extern const struct libmnt_optmap *mnt_optmap_get_entry(
 
 /* optstr.c */
 extern int mnt_optstr_remove_option_at(char **optstr, char *begin, char *end);
-extern int mnt_optstr_fix_gid(char **optstr, char *value, size_t valsz, char **next);
-extern int mnt_optstr_fix_uid(char **optstr, char *value, size_t valsz, char **next);
-extern int mnt_optstr_fix_secontext(char **optstr, char *value, size_t valsz, char **next);
-extern int mnt_optstr_fix_user(char **optstr);
+
+/* optlist.c */
+struct libmnt_optent {
+	size_t		name;		/* offset of the name in libmnt_optlist->buf */
+	size_t		namesz;
+	size_t		value;		/* offset of the value (if has_value) */
+	size_t		valsz;
+
+	const struct libmnt_optmap *map;	/* map with the option or NULL */
+	const struct libmnt_optmap *mapent;	/* the option in the map */
+
+	unsigned int	has_value : 1,	/* name=value */
+			removed : 1;
+};
+
+struct libmnt_optlist {
+	char		*buf;		/* original string and added names and values */
+	size_t		bufsz;
+	size_t		buflen;
+
+	struct libmnt_optent *ents;
+	size_t		nents;
+	size_t		nalloc;
+	size_t		nremoved;
+
+	struct libmnt_optmap const *maps[2];
+	int		nmaps;
+};
+
+extern int mnt_init_optlist(struct libmnt_optlist *ol, const char *optstr,
+			    struct libmnt_optmap const **maps, int nmaps);
+extern void mnt_reset_optlist(struct libmnt_optlist *ol);
+extern int mnt_optlist_is_empty(struct libmnt_optlist *ol);
+extern struct libmnt_optent *mnt_optlist_get_option(struct libmnt_optlist *ol,
+			const char *name);
+extern int mnt_optlist_append_option(struct libmnt_optlist *ol,
+			const char *name, const char *value);
+extern int mnt_optlist_prepend_option(struct libmnt_optlist *ol,
+			const char *name, const char *value);
+extern int mnt_optlist_set_value(struct libmnt_optlist *ol,
+			struct libmnt_optent *ent, const char *value);
+extern int mnt_optlist_set_option(struct libmnt_optlist *ol,
+			const char *name, const char *value);
+extern void mnt_optlist_remove_option(struct libmnt_optlist *ol,
+			struct libmnt_optent *ent);
+extern int mnt_optlist_deduplicate_option(struct libmnt_optlist *ol,
+			const char *name);
+extern int mnt_optlist_apply_flags(struct libmnt_optlist *ol,
+			unsigned long flags, const struct libmnt_optmap *map);
+extern int mnt_optlist_fix_uid(struct libmnt_optlist *ol, struct libmnt_optent *ent);
+extern int mnt_optlist_fix_gid(struct libmnt_optlist *ol, struct libmnt_optent *ent);
+extern int mnt_optlist_fix_secontext(struct libmnt_optlist *ol, struct libmnt_optent *ent);
+extern int mnt_optlist_fix_user(struct libmnt_optlist *ol);
+extern int mnt_optlist_to_string(struct libmnt_optlist *ol, char **optstr);
+
+/* tab_index.c */
+enum {
+	MNT_INDEX_TARGET = 0,
+	MNT_INDEX_SRCPATH,
+	MNT_INDEX_DEVNO,
+	MNT_INDEX_ID,
+	__MNT_INDEX_MAX
+};
+
+struct libmnt_tabindex;
+extern void mnt_table_invalidate_index(struct libmnt_table *tb);
+extern struct libmnt_tabindex *mnt_table_get_index(struct libmnt_table *tb)
+			__attribute__((nonnull));
+extern size_t mnt_tabindex_get_ntags(struct libmnt_tabindex *idx);
+extern size_t mnt_tabindex_get_nresolve(struct libmnt_tabindex *idx);
+extern struct libmnt_fs *mnt_tabindex_find(struct libmnt_tabindex *idx, int kind,
+			const void *key, int direction,
+			int (*match)(struct libmnt_fs *, void *), void *data,
+			size_t *pos);
+extern struct libmnt_fs *mnt_tabindex_find_from(struct libmnt_tabindex *idx, int kind,
+			const void *key, int direction, struct libmnt_fs *from,
+			int (*match)(struct libmnt_fs *, void *), void *data);
+extern struct libmnt_fs *mnt_tabindex_next_child(struct libmnt_tabindex *idx,
+			int parent_id, int lastchld_id);
+
+/* tab_snapshot.c */
+extern int mnt_table_fetch_snapshot(struct libmnt_table *tb, const char *socket_path);
+
+/* tab_parse.c */
+extern int mnt_kernel_fs_postparse(struct libmnt_table *tb,
+			struct libmnt_fs *fs, pid_t *tid,
+			const char *filename);
+
+/*
+ * utab journal, the updates are appended to <utab>.journal and merged to utab
+ * by compaction. Both files start with the generation header, the journal is
+ * valid for utab with the same generation. See tab_update.c.
+ */
+#define MNT_UTAB_JOURNAL_SUFFIX	".journal"
+#define MNT_UTAB_GENERATION	"# utab generation: "
+
+extern int mnt_get_utab_generation(const char *filename, uint64_t *gen);
+extern int mnt_utab_is_empty(const char *utab);
+
+/* arena.c */
+extern struct libmnt_arena *mnt_new_arena(void);
+extern struct libmnt_arena *mnt_new_arena_from_buffer(char *buf, size_t sz,
+			int mapped);
+extern void mnt_ref_arena(struct libmnt_arena *ar);
+extern void mnt_unref_arena(struct libmnt_arena *ar);
+extern char *mnt_arena_reserve(struct libmnt_arena *ar, size_t sz)
+			__attribute__((nonnull));
+extern void mnt_arena_commit(struct libmnt_arena *ar, size_t sz)
+			__attribute__((nonnull));
 
 /* fs.c */
+extern char *mnt_fs_attach_arena(struct libmnt_fs *fs, struct libmnt_arena *ar,
+			size_t sz)
+			__attribute__((nonnull));
+extern void mnt_fs_commit_arena(struct libmnt_fs *fs, char *end)
+			__attribute__((nonnull));
+extern void mnt_fs_attach_arena_buffer(struct libmnt_fs *fs,
+			struct libmnt_arena *ar, char *buf, size_t sz)
+			__attribute__((nonnull));
+extern int mnt_fs_detach_arena(struct libmnt_fs *fs);
+extern int __mnt_fs_parse_lazy(struct libmnt_fs *fs, unsigned int mask)
+			__attribute__((nonnull));
+
+/* parses the @mask fields of @fs if not parsed yet */
+static inline int mnt_fs_parse_lazy(struct libmnt_fs *fs, unsigned int mask)
+{
+	return fs && (fs->lazy_mask & mask) ? __mnt_fs_parse_lazy(fs, mask) : 0;
+}
 extern struct libmnt_fs *mnt_copy_mtab_fs(const struct libmnt_fs *fs)
 			__attribute__((nonnull));
 extern int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
@@ -465,6 +637,14 @@ extern int mnt_context_save_template(struct libmnt_context *cxt);
 
 extern int mnt_context_apply_fs(struct libmnt_context *cxt, struct libmnt_fs *fs);
 
+extern int mnt_context_check_next_mount(struct libmnt_context *cxt,
+				 struct libmnt_fs *fs, int *ignored);
+extern void mnt_context_prepare_next_mount(struct libmnt_context *cxt);
+extern int mnt_context_mount_fstab_entry(struct libmnt_context *cxt,
+				  struct libmnt_fs *fs, int *mntrc);
+extern int mnt_context_match_next_umount(struct libmnt_context *cxt,
+				  struct libmnt_fs *fs);
+
 extern int mnt_context_is_veritydev(struct libmnt_context *cxt)
 			__attribute__((nonnull));
 extern int mnt_context_setup_veritydev(struct libmnt_context *cxt);
@@ -476,9 +656,17 @@ extern int mnt_update_set_filename(struct libmnt_update *upd,
 extern int mnt_update_already_done(struct libmnt_update *upd,
 				   struct libmnt_lock *lc);
 
+/* cache.c */
+extern int mnt_cache_get_btrfs_default(struct libmnt_cache *cache, dev_t devno,
+			uint64_t *id);
+extern int mnt_cache_set_btrfs_default(struct libmnt_cache *cache, dev_t devno,
+			uint64_t id);
+
 #if __linux__
 /* btrfs.c */
 extern uint64_t btrfs_get_default_subvol_id(const char *path);
+extern uint64_t btrfs_get_cached_default_subvol_id(struct libmnt_cache *cache,
+			dev_t devno, const char *path);
 #endif
 
 #endif /* _LIBMOUNT_PRIVATE_H */
@@ -0,0 +1,827 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * This file is part of libmount from util-linux project.
+ *
+ * libmount is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Parsed options string.
+ *
+ * The options string is parsed only once to the vector of the options. The
+ * options are spans (offsets) in one buffer, new names and values are added
+ * to the end of the buffer and removed options are only marked. It means
+ * that an edit does not reallocate and rescan the string. The result is
+ * composed by mnt_optlist_to_string() when all the edits are done.
+ */
+#include <ctype.h>
+
+#ifdef HAVE_LIBSELINUX
+#include <selinux/selinux.h>
+#include <selinux/context.h>
+#endif
+
+#include "mountP.h"
+
+#define mnt_optmap_entry_novalue(e) \
+		(e && (e)->name && !strchr((e)->name, '=') && !((e)->mask & MNT_PREFIX))
+
+/* returns offset of the copy of @str in the buffer */
+static int optlist_add_string(struct libmnt_optlist *ol, const char *str,
+			      size_t sz, size_t *off)
+{
+	if (ol->buflen + sz > ol->bufsz) {
+		size_t bufsz = max(ol->bufsz * 2, ol->buflen + sz + 64);
+		char *p = realloc(ol->buf, bufsz);
+
+		if (!p)
+			return -ENOMEM;
+		ol->buf = p;
+		ol->bufsz = bufsz;
+	}
+
+	if (sz)
+		memcpy(ol->buf + ol->buflen, str, sz);
+	*off = ol->buflen;
+	ol->buflen += sz;
+	return 0;
+}
+
+/* returns a new (zeroized) entry at position @idx */
+static struct libmnt_optent *optlist_insert_entry(struct libmnt_optlist *ol,
+						  size_t idx)
+{
+	struct libmnt_optent *ent;
+
+	if (ol->nents == ol->nalloc) {
+		size_t nalloc = ol->nalloc ? ol->nalloc * 2 : 16;
+
+		ent = realloc(ol->ents, nalloc * sizeof(*ent));
+		if (!ent)
+			return NULL;
+		ol->ents = ent;
+		ol->nalloc = nalloc;
+	}
+
+	ent = &ol->ents[idx];
+	if (idx < ol->nents)
+		memmove(ent + 1, ent, (ol->nents - idx) * sizeof(*ent));
+	ol->nents++;
+
+	memset(ent, 0, sizeof(*ent));
+	return ent;
+}
+
+static void optlist_lookup_entry(struct libmnt_optlist *ol,
+				 struct libmnt_optent *ent)
+{
+	ent->map = NULL;
+	ent->mapent = NULL;
+
+	if (ol->nmaps)
+		ent->map = mnt_optmap_get_entry(ol->maps, ol->nmaps,
+				ol->buf + ent->name, ent->namesz, &ent->mapent);
+}
+
+static int optlist_insert_option(struct libmnt_optlist *ol, size_t idx,
+				 const char *name, size_t namesz,
+				 const char *value, size_t valsz)
+{
+	struct libmnt_optent *ent;
+	size_t noff, voff = 0;
+	int rc;
+
+	rc = optlist_add_string(ol, name, namesz, &noff);
+	if (!rc && value)
+		rc = optlist_add_string(ol, value, valsz, &voff);
+	if (rc)
+		return rc;
+
+	ent = optlist_insert_entry(ol, idx);
+	if (!ent)
+		return -ENOMEM;
+
+	ent->name = noff;
+	ent->namesz = namesz;
+	ent->value = voff;
+	ent->valsz = valsz;
+	ent->has_value = value ? 1 : 0;
+
+	optlist_lookup_entry(ol, ent);
+	return 0;
+}
+
+/*
+ * mnt_init_optlist:
+ * @ol: options list
+ * @optstr: options string or NULL
+ * @maps: options maps or NULL
+ * @nmaps: number of @maps
+ *
+ * Parses @optstr to @ol. The options are looked up in @maps, the map entry
+ * is accessible by the libmnt_optent->map and libmnt_optent->mapent. Use
+ * mnt_reset_optlist() to deallocate the list.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_init_optlist(struct libmnt_optlist *ol, const char *optstr,
+		     struct libmnt_optmap const **maps, int nmaps)
+{
+	char *p, *name, *val;
+	size_t namesz, valsz, sz;
+	int rc = 0;
+
+	assert(ol);
+	assert(nmaps >= 0 && (size_t) nmaps <= ARRAY_SIZE(ol->maps));
+
+	memset(ol, 0, sizeof(*ol));
+	if (nmaps)
+		memcpy(ol->maps, maps, nmaps * sizeof(*maps));
+	ol->nmaps = nmaps;
+
+	if (!optstr || !*optstr)
+		return 0;
+
+	/* the original string is the first part of the buffer */
+	sz = strlen(optstr) + 1;
+	ol->buf = malloc(sz + 64);
+	if (!ol->buf)
+		return -ENOMEM;
+	ol->bufsz = sz + 64;
+	memcpy(ol->buf, optstr, sz);
+	ol->buflen = sz;
+
+	p = ol->buf;
+	while ((rc = mnt_optstr_next_option(&p, &name, &namesz, &val, &valsz)) == 0) {
+		struct libmnt_optent *ent = optlist_insert_entry(ol, ol->nents);
+
+		if (!ent) {
+			rc = -ENOMEM;
+			break;
+		}
+		ent->name = name - ol->buf;
+		ent->namesz = namesz;
+		if (val) {
+			ent->value = val - ol->buf;
+			ent->valsz = valsz;
+			ent->has_value = 1;
+		}
+		optlist_lookup_entry(ol, ent);
+	}
+
+	if (rc < 0) {
+		mnt_reset_optlist(ol);
+		return rc;
+	}
+	return 0;
+}
+
+/*
+ * mnt_reset_optlist:
+ * @ol: options list
+ *
+ * Deallocates the list.
+ */
+void mnt_reset_optlist(struct libmnt_optlist *ol)
+{
+	if (!ol)
+		return;
+	free(ol->buf);
+	free(ol->ents);
+	memset(ol, 0, sizeof(*ol));
+}
+
+/*
+ * mnt_optlist_is_empty:
+ * @ol: options list
+ *
+ * Returns: 1 if there is no (not removed) option in the list.
+ */
+int mnt_optlist_is_empty(struct libmnt_optlist *ol)
+{
+	return ol->nents == ol->nremoved;
+}
+
+/*
+ * Returns 1 if the option name is @name.
+ */
+static int optent_is(struct libmnt_optlist *ol, struct libmnt_optent *ent,
+		     const char *name, size_t namesz)
+{
+	return !ent->removed && ent->namesz == namesz
+		&& strncmp(ol->buf + ent->name, name, namesz) == 0;
+}
+
+/*
+ * mnt_optlist_get_option:
+ * @ol: options list
+ * @name: option name
+ *
+ * Note that the returned pointer is valid only until the next option is
+ * added to the list.
+ *
+ * Returns: the first option of the @name or NULL.
+ */
+struct libmnt_optent *mnt_optlist_get_option(struct libmnt_optlist *ol,
+					     const char *name)
+{
+	size_t i, namesz = strlen(name);
+
+	for (i = 0; i < ol->nents; i++) {
+		if (optent_is(ol, &ol->ents[i], name, namesz))
+			return &ol->ents[i];
+	}
+	return NULL;
+}
+
+/*
+ * mnt_optlist_append_option:
+ * @ol: options list
+ * @name: option name
+ * @value: option value or NULL
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_optlist_append_option(struct libmnt_optlist *ol, const char *name,
+			      const char *value)
+{
+	if (!name || !*name)
+		return 0;
+	return optlist_insert_option(ol, ol->nents, name, strlen(name),
+				     value, value ? strlen(value) : 0);
+}
+
+/*
+ * mnt_optlist_prepend_option:
+ * @ol: options list
+ * @name: option name
+ * @value: option value or NULL
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_optlist_prepend_option(struct libmnt_optlist *ol, const char *name,
+			       const char *value)
+{
+	if (!name || !*name)
+		return 0;
+	return optlist_insert_option(ol, 0, name, strlen(name),
+				     value, value ? strlen(value) : 0);
+}
+
+/*
+ * mnt_optlist_set_value:
+ * @ol: options list
+ * @ent: option
+ * @value: new value or NULL
+ *
+ * Sets or removes (if @value is NULL) the option value.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_optlist_set_value(struct libmnt_optlist *ol, struct libmnt_optent *ent,
+			  const char *value)
+{
+	size_t sz, off;
+	int rc;
+
+	if (!value) {
+		ent->has_value = 0;
+		ent->value = ent->valsz = 0;
+		return 0;
+	}
+
+	sz = strlen(value);
+	if (ent->has_value && sz <= ent->valsz) {
+		/* rewrite the old value */
+		memcpy(ol->buf + ent->value, value, sz);
+		ent->valsz = sz;
+		return 0;
+	}
+
+	rc = optlist_add_string(ol, value, sz, &off);
+	if (rc)
+		return rc;
+	ent->value = off;
+	ent->valsz = sz;
+	ent->has_value = 1;
+	return 0;
+}
+
+/*
+ * mnt_optlist_set_option:
+ * @ol: options list
+ * @name: option name
+ * @value: new value or NULL
+ *
+ * Sets or removes (if @value is NULL) value of the first option @name. The
+ * option is appended if not found.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_optlist_set_option(struct libmnt_optlist *ol, const char *name,
+			   const char *value)
+{
+	struct libmnt_optent *ent = mnt_optlist_get_option(ol, name);
+
+	if (!ent)
+		return mnt_optlist_append_option(ol, name, value);
+	return mnt_optlist_set_value(ol, ent, value);
+}
+
+/*
+ * mnt_optlist_remove_option:
+ * @ol: options list
+ * @ent: option
+ *
+ * Removes the option from the list.
+ */
+void mnt_optlist_remove_option(struct libmnt_optlist *ol,
+			       struct libmnt_optent *ent)
+{
+	if (ent->removed)
+		return;
+	ent->removed = 1;
+	ol->nremoved++;
+}
+
+/*
+ * mnt_optlist_deduplicate_option:
+ * @ol: options list
+ * @name: option name
+ *
+ * Removes all instances of @name except the last one.
+ *
+ * Returns: 0 on success, 1 when not found the @name.
+ */
+int mnt_optlist_deduplicate_option(struct libmnt_optlist *ol, const char *name)
+{
+	struct libmnt_optent *last = NULL;
+	size_t i, namesz = strlen(name);
+
+	for (i = 0; i < ol->nents; i++) {
+		struct libmnt_optent *ent = &ol->ents[i];
+
+		if (!optent_is(ol, ent, name, namesz))
+			continue;
+		if (last)
+			mnt_optlist_remove_option(ol, last);
+		last = ent;
+	}
+	return last ? 0 : 1;
+}
+
+/*
+ * mnt_optlist_apply_flags:
+ * @ol: options list
+ * @flags: mount flags
+ * @map: options map
+ *
+ * Removes/adds options to the @ol according to flags, see
+ * mnt_optstr_apply_flags().
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_optlist_apply_flags(struct libmnt_optlist *ol, unsigned long flags,
+			    const struct libmnt_optmap *map)
+{
+	struct libmnt_optmap const *maps[1];
+	const struct libmnt_optmap *ent;
+	unsigned long fl = flags;
+	size_t i = 0;
+	int rc = 0;
+
+	assert(ol);
+	assert(map);
+
+	DBG(CXT, ul_debug("applying 0x%08lu flags to options list", flags));
+
+	maps[0] = map;
+
+	/*
+	 * There is a convention that 'rw/ro' flags are always at the beginning of
+	 * the string (although the 'rw' is unnecessary).
+	 */
+	if (map == mnt_get_builtin_optmap(MNT_LINUX_MAP)) {
+		const char *o = (fl & MS_RDONLY) ? "ro" : "rw";
+		struct libmnt_optent *first = NULL;
+
+		for (i = 0; i < ol->nents && !first; i++) {
+			if (!ol->ents[i].removed)
+				first = &ol->ents[i];
+		}
+
+		if (first && !first->has_value &&
+		    (optent_is(ol, first, "rw", 2) || optent_is(ol, first, "ro", 2))) {
+			/* already set, be paranoid and fix it */
+			memcpy(ol->buf + first->name, o, 2);
+			optlist_lookup_entry(ol, first);
+		} else {
+			rc = mnt_optlist_prepend_option(ol, o, NULL);
+			if (rc)
+				return rc;
+			i = 1;
+		}
+		fl &= ~MS_RDONLY;
+	}
+
+	/* remove options that are missing in @flags */
+	for (; i < ol->nents; i++) {
+		struct libmnt_optent *oe = &ol->ents[i];
+
+		if (oe->removed)
+			continue;
+		if (!mnt_optmap_get_entry(maps, 1, ol->buf + oe->name,
+					  oe->namesz, &ent))
+			continue;
+		if (!ent || !ent->id)
+			continue;
+		/* ignore name=<value> if options map expects <name> only */
+		if (oe->has_value && oe->valsz && mnt_optmap_entry_novalue(ent))
+			continue;
+
+		/* remove unwanted option (rw/ro is already set) */
+		if (ent->id == MS_RDONLY ||
+		    (ent->mask & MNT_INVERT) ||
+		    (fl & ent->id) != (unsigned long) ent->id)
+			mnt_optlist_remove_option(ol, oe);
+
+		if (!(ent->mask & MNT_INVERT)) {
+			fl &= ~ent->id;
+			if (ent->id & MS_REC)
+				fl |= MS_REC;
+		}
+	}
+
+	/* add missing options (but ignore fl if contains MS_REC only) */
+	if (fl && fl != MS_REC) {
+		for (ent = map; ent && ent->name; ent++) {
+			const char *p;
+			size_t sz;
+
+			if ((ent->mask & MNT_INVERT)
+			    || ent->id == 0
+			    || (fl & ent->id) != (unsigned long) ent->id)
+				continue;
+
+			/* don't add options which require values (e.g. offset=%d) */
+			p = strchr(ent->name, '=');
+			if (p) {
+				if (p > ent->name && *(p - 1) == '[')
+					p--;			/* name[=] */
+				else
+					continue;		/* name= */
+				sz = p - ent->name;
+			} else
+				sz = strlen(ent->name);
+
+			rc = optlist_insert_option(ol, ol->nents, ent->name, sz,
+						   NULL, 0);
+			if (rc)
+				break;
+		}
+	}
+
+	return rc;
+}
+
+static int optlist_set_uint_value(struct libmnt_optlist *ol,
+				  struct libmnt_optent *ent, unsigned int num)
+{
+	char buf[40];
+
+	snprintf(buf, sizeof(buf), "%u", num);
+	return mnt_optlist_set_value(ol, ent, buf);
+}
+
+/*
+ * mnt_optlist_fix_uid:
+ * @ol: options list
+ * @ent: uid= option
+ *
+ * Translates "username" or "useruid" to the real UID.
+ *
+ * Returns: 0 on success, a negative number in case of error.
+ */
+int mnt_optlist_fix_uid(struct libmnt_optlist *ol, struct libmnt_optent *ent)
+{
+	const char *value = ol->buf + ent->value;
+
+	if (!ent->has_value || !ent->valsz)
+		return -EINVAL;
+
+	DBG(CXT, ul_debug("fixing uid"));
+
+	if (ent->valsz == 7 && !strncmp(value, "useruid", 7))
+		return optlist_set_uint_value(ol, ent, getuid());
+
+	if (!isdigit(*value)) {
+		uid_t id;
+		int rc;
+		char *p = strndup(value, ent->valsz);
+
+		if (!p)
+			return -ENOMEM;
+		rc = mnt_get_uid(p, &id);
+		free(p);
+
+		if (!rc)
+			return optlist_set_uint_value(ol, ent, id);
+	}
+	return 0;
+}
+
+/*
+ * mnt_optlist_fix_gid:
+ * @ol: options list
+ * @ent: gid= option
+ *
+ * Translates "groupname" or "usergid" to the real GID.
+ *
+ * Returns: 0 on success, a negative number in case of error.
+ */
+int mnt_optlist_fix_gid(struct libmnt_optlist *ol, struct libmnt_optent *ent)
+{
+	const char *value = ol->buf + ent->value;
+
+	if (!ent->has_value || !ent->valsz)
+		return -EINVAL;
+
+	DBG(CXT, ul_debug("fixing gid"));
+
+	if (ent->valsz == 7 && !strncmp(value, "usergid", 7))
+		return optlist_set_uint_value(ol, ent, getgid());
+
+	if (!isdigit(*value)) {
+		gid_t id;
+		int rc;
+		char *p = strndup(value, ent->valsz);
+
+		if (!p)
+			return -ENOMEM;
+		rc = mnt_get_gid(p, &id);
+		free(p);
+
+		if (!rc)
+			return optlist_set_uint_value(ol, ent, id);
+	}
+	return 0;
+}
+
+/*
+ * mnt_optlist_fix_secontext:
+ * @ol: options list
+ * @ent: SELinux context option
+ *
+ * Translates SELinux context from human to raw format. The function does not
+ * modify @ol and returns zero if libmount is compiled without SELinux
+ * support.
+ *
+ * Returns: 0 on success, a negative number in case of error.
+ */
+#ifndef HAVE_LIBSELINUX
+int mnt_optlist_fix_secontext(struct libmnt_optlist *ol __attribute__ ((__unused__)),
+			      struct libmnt_optent *ent __attribute__ ((__unused__)))
+{
+	return 0;
+}
+#else
+int mnt_optlist_fix_secontext(struct libmnt_optlist *ol, struct libmnt_optent *ent)
+{
+	security_context_t raw = NULL;
+	const char *value = ol->buf + ent->value;
+	size_t valsz = ent->valsz;
+	char *p;
+	int rc;
+
+	if (!ent->has_value || !valsz)
+		return -EINVAL;
+
+	DBG(CXT, ul_debug("fixing SELinux context"));
+
+	/* the selinux contexts are quoted */
+	if (*value == '"') {
+		if (valsz <= 2 || *(value + valsz - 1) != '"')
+			return -EINVAL;		/* improperly quoted option string */
+		value++;
+		valsz -= 2;
+	}
+
+	p = strndup(value, valsz);
+	if (!p)
+		return -ENOMEM;
+
+	/* translate the context */
+	rc = selinux_trans_to_raw_context((security_context_t) p, &raw);
+
+	DBG(CXT, ul_debug("SELinux context '%s' translated to '%s'",
+			p, rc == -1 ? "FAILED" : (char *) raw));
+
+	free(p);
+	if (rc == -1 ||	!raw)
+		return -EINVAL;
+
+	/* create a quoted string from the raw context */
+	if (!*raw) {
+		freecon(raw);
+		return -EINVAL;
+	}
+	rc = asprintf(&p, "\"%s\"", (char *) raw);
+	freecon(raw);
+	if (rc < 0)
+		return -ENOMEM;
+
+	rc = mnt_optlist_set_value(ol, ent, p);
+	free(p);
+	return rc;
+}
+#endif
+
+/*
+ * mnt_optlist_fix_user:
+ * @ol: options list
+ *
+ * Converts "user" to "user=<username>".
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_optlist_fix_user(struct libmnt_optlist *ol)
+{
+	struct libmnt_optent *ent;
+	char *username;
+	int rc = 0;
+
+	DBG(CXT, ul_debug("fixing user"));
+
+	ent = mnt_optlist_get_option(ol, "user");
+	if (!ent)
+		return 0;
+
+	username = mnt_get_username(getuid());
+	if (!username)
+		return -ENOMEM;
+
+	if (!ent->valsz || strncmp(ol->buf + ent->value, username, ent->valsz) != 0
+			|| username[ent->valsz] != '\0')
+		rc = mnt_optlist_set_value(ol, ent, username);
+
+	free(username);
+	return rc;
+}
+
+/*
+ * mnt_optlist_to_string:
+ * @ol: options list
+ * @optstr: returns a newly allocated options string or NULL if the list is
+ *          empty
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_optlist_to_string(struct libmnt_optlist *ol, char **optstr)
+{
+	size_t i, sz = 0;
+	char *p;
+
+	assert(ol);
+	assert(optstr);
+
+	*optstr = NULL;
+	if (mnt_optlist_is_empty(ol))
+		return 0;
+
+	for (i = 0; i < ol->nents; i++) {
+		struct libmnt_optent *ent = &ol->ents[i];
+
+		if (ent->removed)
+			continue;
+		sz += ent->namesz + 1;		/* 1: ',' or '\0' */
+		if (ent->has_value)
+			sz += ent->valsz + 1;	/* 1: '=' */
+	}
+
+	p = *optstr = malloc(sz);
+	if (!p)
+		return -ENOMEM;
+
+	for (i = 0; i < ol->nents; i++) {
+		struct libmnt_optent *ent = &ol->ents[i];
+
+		if (ent->removed)
+			continue;
+		if (p > *optstr)
+			*p++ = ',';
+		memcpy(p, ol->buf + ent->name, ent->namesz);
+		p += ent->namesz;
+		if (ent->has_value) {
+			*p++ = '=';
+			memcpy(p, ol->buf + ent->value, ent->valsz);
+			p += ent->valsz;
+		}
+	}
+	*p = '\0';
+	return 0;
+}
+
+#ifdef TEST_PROGRAM
+
+/*
+ * Applies all the edits to one list and prints the result, for example:
+ *
+ *	--edit "aaa,bbb=BBB" append:ccc=CCC set:bbb=X remove:aaa
+ */
+static int test_edit(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_optlist ol;
+	char *optstr = NULL;
+	int i, rc;
+
+	if (argc < 2)
+		return -EINVAL;
+
+	rc = mnt_init_optlist(&ol, argv[1], NULL, 0);
+	for (i = 2; rc == 0 && i < argc; i++) {
+		char *cmd = argv[i], *name, *value;
+		struct libmnt_optent *ent;
+
+		name = strchr(cmd, ':');
+		if (!name) {
+			rc = -EINVAL;
+			break;
+		}
+		*name++ = '\0';
+		value = strchr(name, '=');
+		if (value)
+			*value++ = '\0';
+
+		if (strcmp(cmd, "append") == 0)
+			rc = mnt_optlist_append_option(&ol, name, value);
+		else if (strcmp(cmd, "prepend") == 0)
+			rc = mnt_optlist_prepend_option(&ol, name, value);
+		else if (strcmp(cmd, "set") == 0)
+			rc = mnt_optlist_set_option(&ol, name, value);
+		else if (strcmp(cmd, "dedup") == 0)
+			rc = mnt_optlist_deduplicate_option(&ol, name);
+		else if (strcmp(cmd, "remove") == 0) {
+			ent = mnt_optlist_get_option(&ol, name);
+			if (ent)
+				mnt_optlist_remove_option(&ol, ent);
+			else
+				rc = 1;
+		} else
+			rc = -EINVAL;
+	}
+	if (!rc)
+		rc = mnt_optlist_to_string(&ol, &optstr);
+	if (!rc)
+		printf("result: >%s<\n", optstr ? optstr : "");
+	free(optstr);
+	mnt_reset_optlist(&ol);
+	return rc;
+}
+
+static int test_apply(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_optlist ol;
+	const struct libmnt_optmap *map;
+	char *optstr = NULL;
+	unsigned long flags;
+	int rc;
+
+	if (argc < 4)
+		return -EINVAL;
+
+	if (!strcmp(argv[1], "--user"))
+		map = mnt_get_builtin_optmap(MNT_USERSPACE_MAP);
+	else if (!strcmp(argv[1], "--linux"))
+		map = mnt_get_builtin_optmap(MNT_LINUX_MAP);
+	else {
+		fprintf(stderr, "unknown option '%s'\n", argv[1]);
+		return -1;
+	}
+
+	flags = strtoul(argv[3], NULL, 16);
+
+	rc = mnt_init_optlist(&ol, argv[2], &map, 1);
+	if (!rc)
+		rc = mnt_optlist_apply_flags(&ol, flags, map);
+	if (!rc)
+		rc = mnt_optlist_to_string(&ol, &optstr);
+	if (!rc)
+		printf("result: >%s<\n", optstr ? optstr : "");
+	free(optstr);
+	mnt_reset_optlist(&ol);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct libmnt_test tss[] = {
+		{ "--edit",  test_edit,  "<optstr> <cmd>:<name>[=<value>] ...  edit options (append, prepend, set, remove, dedup)" },
+		{ "--apply", test_apply, "--{linux,user} <optstr> <mask>    apply mask to options" },
+		{ NULL }
+	};
+	return mnt_run_test(tss, argc, argv);
+}
+#endif /* TEST_PROGRAM */
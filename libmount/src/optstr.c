@@ -18,13 +18,6 @@
  * This is a simple and low-level API to working with mount options that are stored
  * in a string.
  */
-#include <ctype.h>
-
-#ifdef HAVE_LIBSELINUX
-#include <selinux/selinux.h>
-#include <selinux/context.h>
-#endif
-
 #include "strutils.h"
 #include "mountP.h"
 
@@ -41,6 +34,26 @@ struct libmnt_optloc {
 
 #define mnt_init_optloc(_ol)	(memset((_ol), 0, sizeof(struct libmnt_optloc)))
 
+/*
+ * Replaces @optstr with the options from @ol, the empty list is returned as
+ * an empty string if @optstr is not NULL.
+ */
+static int optlist_replace_optstr(struct libmnt_optlist *ol, char **optstr)
+{
+	char *p = NULL;
+	int rc = mnt_optlist_to_string(ol, &p);
+
+	if (rc)
+		return rc;
+	if (!p && *optstr)
+		**optstr = '\0';
+	else {
+		free(*optstr);
+		*optstr = p;
+	}
+	return 0;
+}
+
 #define mnt_optmap_entry_novalue(e) \
 		(e && (e)->name && !strchr((e)->name, '=') && !((e)->mask & MNT_PREFIX))
 
@@ -217,6 +230,40 @@ static int __mnt_optstr_append_option(char **optstr,
 	return 0;
 }
 
+/*
+ * Appends the option to @subset allocated for the whole original options
+ * string (@maxsz), the subset string is never reallocated.
+ */
+static int append_subset_option(char **subset, size_t *len, size_t maxsz,
+			const char *name, size_t nsz,
+			const char *value, size_t vsz)
+{
+	char *p;
+
+	if (!*subset) {
+		*subset = malloc(maxsz);
+		if (!*subset)
+			return -ENOMEM;
+		*len = 0;
+	}
+
+	p = *subset + *len;
+	if (*len)
+		*p++ = ',';
+
+	memcpy(p, name, nsz);
+	p += nsz;
+
+	if (value) {
+		*p++ = '=';
+		memcpy(p, value, vsz);
+		p += vsz;
+	}
+	*p = '\0';
+	*len = p - *subset;
+	return 0;
+}
+
 /**
  * mnt_optstr_append_option:
  * @optstr: option string or NULL, returns a reallocated string
@@ -322,40 +369,20 @@ int mnt_optstr_get_option(const char *optstr, const char *name,
  */
 int mnt_optstr_deduplicate_option(char **optstr, const char *name)
 {
+	struct libmnt_optlist ol;
 	int rc;
-	char *begin = NULL, *end = NULL, *opt;
 
 	if (!optstr || !name)
 		return -EINVAL;
 
-	opt = *optstr;
-	do {
-		struct libmnt_optloc ol;
-
-		mnt_init_optloc(&ol);
-
-		rc = mnt_optstr_locate_option(opt, name, &ol);
-		if (!rc) {
-			if (begin) {
-				/* remove the previous instance */
-				size_t shift = strlen(*optstr);
-
-				mnt_optstr_remove_option_at(optstr, begin, end);
-
-				/* now all the offsets are not valid anymore - recount */
-				shift -= strlen(*optstr);
-				ol.begin -= shift;
-				ol.end -= shift;
-			}
-			begin = ol.begin;
-			end = ol.end;
-			opt = end && *end ? end + 1 : NULL;
-		}
-		if (opt == NULL)
-			break;
-	} while (rc == 0 && *opt);
+	rc = mnt_init_optlist(&ol, *optstr, NULL, 0);
+	if (!rc)
+		rc = mnt_optlist_deduplicate_option(&ol, name);
+	if (!rc)
+		rc = optlist_replace_optstr(&ol, optstr);
 
-	return rc < 0 ? rc : begin ? 0 : 1;
+	mnt_reset_optlist(&ol);
+	return rc;
 }
 
 /*
@@ -527,12 +554,14 @@ int mnt_split_optstr(const char *optstr, char **user, char **vfs,
 		     char **fs, int ignore_user, int ignore_vfs)
 {
 	char *name, *val, *str = (char *) optstr;
-	size_t namesz, valsz;
+	size_t namesz, valsz, maxsz, ulen = 0, vlen = 0, flen = 0;
 	struct libmnt_optmap const *maps[2];
 
 	if (!optstr)
 		return -EINVAL;
 
+	maxsz = strlen(optstr) + 1;
+
 	maps[0] = mnt_get_builtin_optmap(MNT_LINUX_MAP);
 	maps[1] = mnt_get_builtin_optmap(MNT_USERSPACE_MAP);
 
@@ -559,16 +588,16 @@ int mnt_split_optstr(const char *optstr, char **user, char **vfs,
 		if (ent && m && m == maps[0] && vfs) {
 			if (ignore_vfs && (ent->mask & ignore_vfs))
 				continue;
-			rc = __mnt_optstr_append_option(vfs, name, namesz,
-								val, valsz);
+			rc = append_subset_option(vfs, &vlen, maxsz,
+						name, namesz, val, valsz);
 		} else if (ent && m && m == maps[1] && user) {
 			if (ignore_user && (ent->mask & ignore_user))
 				continue;
-			rc = __mnt_optstr_append_option(user, name, namesz,
-								val, valsz);
+			rc = append_subset_option(user, &ulen, maxsz,
+						name, namesz, val, valsz);
 		} else if (!m && fs)
-			rc = __mnt_optstr_append_option(fs, name, namesz,
-								val, valsz);
+			rc = append_subset_option(fs, &flen, maxsz,
+						name, namesz, val, valsz);
 		if (rc) {
 			if (vfs) {
 				free(*vfs);
@@ -612,11 +641,13 @@ int mnt_optstr_get_options(const char *optstr, char **subset,
 {
 	struct libmnt_optmap const *maps[1];
 	char *name, *val, *str = (char *) optstr;
-	size_t namesz, valsz;
+	size_t namesz, valsz, maxsz, len = 0;
 
 	if (!optstr || !subset)
 		return -EINVAL;
 
+	maxsz = strlen(optstr) + 1;
+
 	maps[0] = map;
 	*subset = NULL;
 
@@ -636,7 +667,8 @@ int mnt_optstr_get_options(const char *optstr, char **subset,
 		if (valsz && mnt_optmap_entry_novalue(ent))
 			continue;
 
-		rc = __mnt_optstr_append_option(subset, name, namesz, val, valsz);
+		rc = append_subset_option(subset, &len, maxsz,
+					  name, namesz, val, valsz);
 		if (rc) {
 			free(*subset);
 			return rc;
@@ -736,357 +768,26 @@ int mnt_optstr_get_flags(const char *optstr, unsigned long *flags,
 int mnt_optstr_apply_flags(char **optstr, unsigned long flags,
 				const struct libmnt_optmap *map)
 {
-	struct libmnt_optmap const *maps[1];
-	char *name, *next, *val;
-	size_t namesz = 0, valsz = 0;
-	unsigned long fl;
-	int rc = 0;
+	struct libmnt_optlist ol;
+	int rc;
 
 	if (!optstr || !map)
 		return -EINVAL;
 
 	DBG(CXT, ul_debug("applying 0x%08lu flags to '%s'", flags, *optstr));
 
-	maps[0] = map;
-	next = *optstr;
-	fl = flags;
-
-	/*
-	 * There is a convention that 'rw/ro' flags are always at the beginning of
-	 * the string (although the 'rw' is unnecessary).
-	 */
-	if (map == mnt_get_builtin_optmap(MNT_LINUX_MAP)) {
-		const char *o = (fl & MS_RDONLY) ? "ro" : "rw";
-
-		if (next &&
-		    (!strncmp(next, "rw", 2) || !strncmp(next, "ro", 2)) &&
-		    (*(next + 2) == '\0' || *(next + 2) == ',')) {
-
-			/* already set, be paranoid and fix it */
-			memcpy(next, o, 2);
-		} else {
-			rc = mnt_optstr_prepend_option(optstr, o, NULL);
-			if (rc)
-				goto err;
-			next = *optstr;		/* because realloc() */
-		}
-		fl &= ~MS_RDONLY;
-		next += 2;
-		if (*next == ',')
-			next++;
-	}
-
-	if (next && *next) {
-		/*
-		 * scan @optstr and remove options that are missing in
-		 * @flags
-		 */
-		while(!mnt_optstr_next_option(&next, &name, &namesz,
-							&val, &valsz)) {
-			const struct libmnt_optmap *ent;
-
-			if (mnt_optmap_get_entry(maps, 1, name, namesz, &ent)) {
-				/*
-				 * remove unwanted option (rw/ro is already set)
-				 */
-				if (!ent || !ent->id)
-					continue;
-				/* ignore name=<value> if options map expects <name> only */
-				if (valsz && mnt_optmap_entry_novalue(ent))
-					continue;
-
-				if (ent->id == MS_RDONLY ||
-				    (ent->mask & MNT_INVERT) ||
-				    (fl & ent->id) != (unsigned long) ent->id) {
-
-					char *end = val ? val + valsz :
-							  name + namesz;
-					next = name;
-					rc = mnt_optstr_remove_option_at(
-							optstr, name, end);
-					if (rc)
-						goto err;
-				}
-				if (!(ent->mask & MNT_INVERT)) {
-					fl &= ~ent->id;
-					if (ent->id & MS_REC)
-						fl |= MS_REC;
-				}
-			}
-		}
-	}
-
-	/* add missing options (but ignore fl if contains MS_REC only) */
-	if (fl && fl != MS_REC) {
-		const struct libmnt_optmap *ent;
-		char *p;
-
-		for (ent = map; ent && ent->name; ent++) {
-			if ((ent->mask & MNT_INVERT)
-			    || ent->id == 0
-			    || (fl & ent->id) != (unsigned long) ent->id)
-				continue;
-
-			/* don't add options which require values (e.g. offset=%d) */
-			p = strchr(ent->name, '=');
-			if (p) {
-				if (p > ent->name && *(p - 1) == '[')
-					p--;			/* name[=] */
-				else
-					continue;		/* name= */
-
-				p = strndup(ent->name, p - ent->name);
-				if (!p) {
-					rc = -ENOMEM;
-					goto err;
-				}
-				mnt_optstr_append_option(optstr, p, NULL);
-				free(p);
-			} else
-				mnt_optstr_append_option(optstr, ent->name, NULL);
-		}
-	}
-
-	DBG(CXT, ul_debug("new optstr '%s'", *optstr));
-	return rc;
-err:
-	DBG(CXT, ul_debug("failed to apply flags [rc=%d]", rc));
-	return rc;
-}
-
-/*
- * @optstr: string with comma separated list of options
- * @value: pointer to the begin of the context value
- * @valsz: size of the value
- * @next: returns pointer to the next option (optional argument)
- *
- * Translates SELinux context from human to raw format. The function does not
- * modify @optstr and returns zero if libmount is compiled without SELinux
- * support.
- *
- * Returns: 0 on success, a negative number in case of error.
- */
-#ifndef HAVE_LIBSELINUX
-int mnt_optstr_fix_secontext(char **optstr __attribute__ ((__unused__)),
-			     char *value   __attribute__ ((__unused__)),
-			     size_t valsz  __attribute__ ((__unused__)),
-			     char **next   __attribute__ ((__unused__)))
-{
-	return 0;
-}
-#else
-int mnt_optstr_fix_secontext(char **optstr,
-			     char *value,
-			     size_t valsz,
-			     char **next)
-{
-	int rc = 0;
-
-	security_context_t raw = NULL;
-	char *p, *val, *begin, *end;
-	size_t sz;
-
-	if (!optstr || !*optstr || !value || !valsz)
-		return -EINVAL;
-
-	DBG(CXT, ul_debug("fixing SELinux context"));
-
-	begin = value;
-	end = value + valsz;
-
-	/* the selinux contexts are quoted */
-	if (*value == '"') {
-		if (valsz <= 2 || *(value + valsz - 1) != '"')
-			return -EINVAL;		/* improperly quoted option string */
-		value++;
-		valsz -= 2;
-	}
-
-	p = strndup(value, valsz);
-	if (!p)
-		return -ENOMEM;
-
-
-	/* translate the context */
-	rc = selinux_trans_to_raw_context((security_context_t) p, &raw);
-
-	DBG(CXT, ul_debug("SELinux context '%s' translated to '%s'",
-			p, rc == -1 ? "FAILED" : (char *) raw));
-
-	free(p);
-	if (rc == -1 ||	!raw)
-		return -EINVAL;
-
-
-	/* create a quoted string from the raw context */
-	sz = strlen((char *) raw);
-	if (!sz)
-		return -EINVAL;
-
-	p = val = malloc(valsz + 3);
-	if (!val)
-		return -ENOMEM;
-
-	*p++ = '"';
-	memcpy(p, raw, sz);
-	p += sz;
-	*p++ = '"';
-	*p = '\0';
-
-	freecon(raw);
-
-	/* set new context */
-	mnt_optstr_remove_option_at(optstr, begin, end);
-	rc = insert_value(optstr, begin, val, next);
-	free(val);
-
-	return rc;
-}
-#endif
-
-static int set_uint_value(char **optstr, unsigned int num,
-			char *begin, char *end, char **next)
-{
-	char buf[40];
-	snprintf(buf, sizeof(buf), "%u", num);
-
-	mnt_optstr_remove_option_at(optstr, begin, end);
-	return insert_value(optstr, begin, buf, next);
-}
-
-/*
- * @optstr: string with a comma separated list of options
- * @value: pointer to the beginning of the uid value
- * @valsz: size of the value
- * @next: returns pointer to the next option (optional argument)
-
- * Translates "username" or "useruid" to the real UID.
- *
- * For example:
- *	if (!mnt_optstr_get_option(optstr, "uid", &val, &valsz))
- *		mnt_optstr_fix_uid(&optstr, val, valsz, NULL);
- *
- * Returns: 0 on success, a negative number in case of error.
- */
-int mnt_optstr_fix_uid(char **optstr, char *value, size_t valsz, char **next)
-{
-	char *end;
-
-	if (!optstr || !*optstr || !value || !valsz)
-		return -EINVAL;
-
-	DBG(CXT, ul_debug("fixing uid"));
-
-	end = value + valsz;
-
-	if (valsz == 7 && !strncmp(value, "useruid", 7) &&
-	    (*(value + 7) == ',' || !*(value + 7)))
-		return set_uint_value(optstr, getuid(), value, end, next);
-
-	else if (!isdigit(*value)) {
-		uid_t id;
-		int rc;
-		char *p = strndup(value, valsz);
-		if (!p)
-			return -ENOMEM;
-		rc = mnt_get_uid(p, &id);
-		free(p);
-
-		if (!rc)
-			return set_uint_value(optstr, id, value, end, next);
-	}
-
-	if (next) {
-		/* no change, let's keep the original value */
-		*next = value + valsz;
-		if (**next == ',')
-			(*next)++;
-	}
-
-	return 0;
-}
-
-/*
- * @optstr: string with a comma separated list of options
- * @value: pointer to the beginning of the uid value
- * @valsz: size of the value
- * @next: returns pointer to the next option (optional argument)
-
- * Translates "groupname" or "usergid" to the real GID.
- *
- * Returns: 0 on success, a negative number in case of error.
- */
-int mnt_optstr_fix_gid(char **optstr, char *value, size_t valsz, char **next)
-{
-	char *end;
-
-	if (!optstr || !*optstr || !value || !valsz)
-		return -EINVAL;
-
-	DBG(CXT, ul_debug("fixing gid"));
-
-	end = value + valsz;
-
-	if (valsz == 7 && !strncmp(value, "usergid", 7) &&
-	    (*(value + 7) == ',' || !*(value + 7)))
-		return set_uint_value(optstr, getgid(), value, end, next);
-
-	else if (!isdigit(*value)) {
-		int rc;
-		gid_t id;
-		char *p = strndup(value, valsz);
-		if (!p)
-			return -ENOMEM;
-		rc = mnt_get_gid(p, &id);
-		free(p);
-
-		if (!rc)
-			return set_uint_value(optstr, id, value, end, next);
-
-	}
-
-	if (next) {
-		/* nothing */
-		*next = value + valsz;
-		if (**next == ',')
-			(*next)++;
-	}
-	return 0;
-}
-
-/*
- * Converts "user" to "user=<username>".
- *
- * Returns: 0 on success, negative number in case of error.
- */
-int mnt_optstr_fix_user(char **optstr)
-{
-	char *username;
-	struct libmnt_optloc ol;
-	int rc = 0;
-
-	DBG(CXT, ul_debug("fixing user"));
+	rc = mnt_init_optlist(&ol, *optstr, NULL, 0);
+	if (!rc)
+		rc = mnt_optlist_apply_flags(&ol, flags, map);
+	if (!rc)
+		rc = optlist_replace_optstr(&ol, optstr);
 
-	mnt_init_optloc(&ol);
+	mnt_reset_optlist(&ol);
 
-	rc = mnt_optstr_locate_option(*optstr, "user", &ol);
 	if (rc)
-		return rc == 1 ? 0 : rc;	/* 1: user= not found */
-
-	username = mnt_get_username(getuid());
-	if (!username)
-		return -ENOMEM;
-
-	if (!ol.valsz || (ol.value && strncmp(ol.value, username, ol.valsz))) {
-		if (ol.valsz)
-			/* remove old value */
-			mnt_optstr_remove_option_at(optstr, ol.value, ol.end);
-
-		rc = insert_value(optstr, ol.value ? ol.value : ol.end,
-				  username, NULL);
-	}
-
-	free(username);
+		DBG(CXT, ul_debug("failed to apply flags [rc=%d]", rc));
+	else
+		DBG(CXT, ul_debug("new optstr '%s'", *optstr));
 	return rc;
 }
 
@@ -1388,37 +1089,39 @@ static int test_dedup(struct libmnt_test *ts, int argc, char *argv[])
 
 static int test_fix(struct libmnt_test *ts, int argc, char *argv[])
 {
-	char *optstr;
-	int rc = 0;
-	char *name, *val, *next;
-	size_t valsz, namesz;
+	struct libmnt_optlist ol;
+	char *optstr = NULL;
+	size_t i;
+	int rc;
 
 	if (argc < 2)
 		return -EINVAL;
 
-	next = optstr = strdup(argv[1]);
+	printf("optstr: %s\n", argv[1]);
 
-	printf("optstr: %s\n", optstr);
+	rc = mnt_init_optlist(&ol, argv[1], NULL, 0);
 
-	while (!mnt_optstr_next_option(&next, &name, &namesz, &val, &valsz)) {
+	for (i = 0; rc == 0 && i < ol.nents; i++) {
+		struct libmnt_optent *ent = &ol.ents[i];
+		const char *name = ol.buf + ent->name;
 
-		if (!strncmp(name, "uid", 3))
-			rc = mnt_optstr_fix_uid(&optstr, val, valsz, &next);
-		else if (!strncmp(name, "gid", 3))
-			rc = mnt_optstr_fix_gid(&optstr, val, valsz, &next);
-		else if (!strncmp(name, "context", 7))
-			rc = mnt_optstr_fix_secontext(&optstr, val, valsz, &next);
-		if (rc)
-			break;
+		if (ent->namesz == 3 && !strncmp(name, "uid", 3))
+			rc = mnt_optlist_fix_uid(&ol, ent);
+		else if (ent->namesz == 3 && !strncmp(name, "gid", 3))
+			rc = mnt_optlist_fix_gid(&ol, ent);
+		else if (ent->namesz == 7 && !strncmp(name, "context", 7))
+			rc = mnt_optlist_fix_secontext(&ol, ent);
 	}
-	if (rc)
-		rc = mnt_optstr_fix_user(&optstr);
+	if (!rc)
+		rc = mnt_optlist_fix_user(&ol);
+	if (!rc)
+		rc = mnt_optlist_to_string(&ol, &optstr);
 
 	printf("fixed:  %s\n", optstr);
 
 	free(optstr);
+	mnt_reset_optlist(&ol);
 	return rc;
-
 }
 
 int main(int argc, char *argv[])
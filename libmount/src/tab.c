@@ -169,7 +169,9 @@ void mnt_free_table(struct libmnt_table *tb)
 	mnt_reset_table(tb);
 	DBG(TAB, ul_debugobj(tb, "free [refcount=%d]", tb->refcount));
 
+	mnt_table_invalidate_index(tb);
 	mnt_unref_cache(tb->cache);
+	mnt_unref_arena(tb->arena);
 	free(tb->comm_intro);
 	free(tb->comm_tail);
 	free(tb);
@@ -259,6 +261,62 @@ void mnt_table_enable_comments(struct libmnt_table *tb, int enable)
 		tb->comms = enable;
 }
 
+/**
+ * mnt_table_enable_arena:
+ * @tb: pointer to tab
+ * @enable: TRUE or FALSE
+ *
+ * Enables the strings arena for the mountinfo parser. All strings of the
+ * parsed entries are stored in a few large memory chunks owned by the table
+ * rather than in separately allocated strings. The strings are still
+ * accessible by the usual mnt_fs_get_* functions, and the entries are still
+ * usable after mnt_unref_table(), the memory is deallocated when the last
+ * entry with strings in the arena is deallocated.
+ *
+ * The private copy of the strings is created if the entry is modified by
+ * mnt_fs_set_* or similar functions.
+ *
+ * The arena is recommended for large read-only tables (e.g. mountinfo on
+ * systems with many mount points).
+ *
+ * Returns: 0 on success, negative number in case of error.
+ *
+ * Since: 2.36
+ */
+int mnt_table_enable_arena(struct libmnt_table *tb, int enable)
+{
+	if (!tb)
+		return -EINVAL;
+	tb->use_arena = enable ? 1 : 0;
+	return 0;
+}
+
+/**
+ * mnt_table_enable_lazy_parse:
+ * @tb: pointer to tab
+ * @enable: TRUE or FALSE
+ *
+ * Enables the lazy mountinfo parser. The parser keeps the raw line of the
+ * entry and decodes only the mount IDs, device number, target, source and
+ * filesystem type. The other fields (root, mount options and optional fields)
+ * are decoded the first time they are requested by mnt_fs_get_root(),
+ * mnt_fs_get_options() and similar functions.
+ *
+ * The lazy parser is recommended for large tables where only targets and
+ * sources are necessary (e.g. to find a mountpoint).
+ *
+ * Returns: 0 on success, negative number in case of error.
+ *
+ * Since: 2.36
+ */
+int mnt_table_enable_lazy_parse(struct libmnt_table *tb, int enable)
+{
+	if (!tb)
+		return -EINVAL;
+	tb->lazy_parse = enable ? 1 : 0;
+	return 0;
+}
+
 /**
  * mnt_table_with_comments:
  * @tb: pointer to table
@@ -452,6 +510,7 @@ int mnt_table_add_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 	list_add_tail(&fs->ents, &tb->ents);
 	fs->tab = tb;
 	tb->nents++;
+	mnt_table_invalidate_index(tb);
 
 	DBG(TAB, ul_debugobj(tb, "add entry: %s %s",
 			mnt_fs_get_source(fs), mnt_fs_get_target(fs)));
@@ -471,6 +530,7 @@ static int __table_insert_fs(
 
 	fs->tab = tb;
 	tb->nents++;
+	mnt_table_invalidate_index(tb);
 
 	DBG(TAB, ul_debugobj(tb, "insert entry: %s %s",
 			mnt_fs_get_source(fs), mnt_fs_get_target(fs)));
@@ -542,6 +602,7 @@ int mnt_table_move_fs(struct libmnt_table *src, struct libmnt_table *dst,
 	/* remove from source */
 	list_del_init(&fs->ents);
 	src->nents--;
+	mnt_table_invalidate_index(src);
 
 	/* insert to the destination */
 	return __table_insert_fs(dst, before, pos, fs);
@@ -569,15 +630,22 @@ int mnt_table_remove_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 
 	mnt_unref_fs(fs);
 	tb->nents--;
+	mnt_table_invalidate_index(tb);
 	return 0;
 }
 
 static inline struct libmnt_fs *get_parent_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 {
 	struct libmnt_iter itr;
+	struct libmnt_tabindex *idx;
 	struct libmnt_fs *x;
 	int parent_id = mnt_fs_get_parent_id(fs);
 
+	idx = mnt_table_get_index(tb);
+	if (idx)
+		return mnt_tabindex_find(idx, MNT_INDEX_ID, &parent_id,
+					 MNT_ITER_FORWARD, NULL, NULL, NULL);
+
 	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
 	while (mnt_table_next_fs(tb, &itr, &x) == 0) {
 		if (mnt_fs_get_id(x) == parent_id)
@@ -657,6 +725,7 @@ int mnt_table_get_root_fs(struct libmnt_table *tb, struct libmnt_fs **root)
 int mnt_table_next_child_fs(struct libmnt_table *tb, struct libmnt_iter *itr,
 			struct libmnt_fs *parent, struct libmnt_fs **chld)
 {
+	struct libmnt_tabindex *idx;
 	struct libmnt_fs *fs;
 	int parent_id, lastchld_id = 0, chld_id = 0;
 
@@ -676,6 +745,12 @@ int mnt_table_next_child_fs(struct libmnt_table *tb, struct libmnt_iter *itr,
 
 	*chld = NULL;
 
+	idx = mnt_table_get_index(tb);
+	if (idx) {
+		*chld = mnt_tabindex_next_child(idx, parent_id, lastchld_id);
+		goto done;
+	}
+
 	mnt_reset_iter(itr, MNT_ITER_FORWARD);
 	while(mnt_table_next_fs(tb, itr, &fs) == 0) {
 		int id;
@@ -696,7 +771,7 @@ int mnt_table_next_child_fs(struct libmnt_table *tb, struct libmnt_iter *itr,
 			chld_id = id;
 		}
 	}
-
+done:
 	if (!*chld)
 		return 1;	/* end of iterator */
 
@@ -816,6 +891,90 @@ int mnt_table_find_next_fs(struct libmnt_table *tb, struct libmnt_iter *itr,
 	return 1;
 }
 
+/**
+ * mnt_table_find_next_target:
+ * @tb: table
+ * @itr: iterator
+ * @path: mountpoint directory
+ * @match_func: function returning 1 or 0, or NULL
+ * @userdata: extra data for match_func
+ * @fs: returns pointer to the next matching table entry
+ *
+ * The same as mnt_table_find_next_fs(), but only the entries where
+ * mnt_fs_match_target() returns true for @path (and the table cache) are
+ * returned. The table index is used for kernel tables, so all the entries
+ * mounted on @path are found without walking the whole table.
+ *
+ * Returns: negative number in case of error, 1 at end of table or 0 o success.
+ *
+ * Since: 2.36
+ */
+int mnt_table_find_next_target(struct libmnt_table *tb, struct libmnt_iter *itr,
+		const char *path,
+		int (*match_func)(struct libmnt_fs *, void *), void *userdata,
+		struct libmnt_fs **fs)
+{
+	struct libmnt_tabindex *idx;
+	struct libmnt_fs *from, *res = NULL;
+	const char *keys[2];
+	size_t i, nkeys = 0;
+
+	if (!tb || !itr || !path || !fs)
+		return -EINVAL;
+
+	DBG(TAB, ul_debugobj(tb, "lookup next TARGET: '%s'", path));
+
+	if (!itr->head)
+		MNT_ITER_INIT(itr, &tb->ents);
+
+	idx = mnt_table_get_index(tb);
+	if (!idx || mnt_tabindex_get_nresolve(idx)) {
+		/* small table or non-canonical paths, see mnt_fs_match_target() */
+		while (itr->p != itr->head) {
+			MNT_ITER_ITERATE(itr, *fs, struct libmnt_fs, ents);
+			if (mnt_fs_match_target(*fs, path, tb->cache)
+			    && (!match_func || match_func(*fs, userdata)))
+				return 0;
+		}
+		*fs = NULL;
+		return 1;
+	}
+
+	if (itr->p == itr->head) {
+		*fs = NULL;
+		return 1;
+	}
+	from = list_entry(itr->p, struct libmnt_fs, ents);
+
+	/* native and canonicalized @path */
+	keys[nkeys++] = path;
+	if (tb->cache) {
+		const char *cn = mnt_resolve_target(path, tb->cache);
+
+		if (cn && strcmp(cn, path) != 0)
+			keys[nkeys++] = cn;
+	}
+
+	for (i = 0; i < nkeys; i++) {
+		struct libmnt_fs *x = mnt_tabindex_find_from(idx, MNT_INDEX_TARGET,
+					keys[i], itr->direction, from,
+					match_func, userdata);
+		if (x && (!res || (IS_ITER_FORWARD(itr) ?
+				   x->idxpos < res->idxpos :
+				   x->idxpos > res->idxpos)))
+			res = x;
+	}
+
+	if (!res) {
+		itr->p = itr->head;
+		*fs = NULL;
+		return 1;
+	}
+	itr->p = IS_ITER_FORWARD(itr) ? res->ents.next : res->ents.prev;
+	*fs = res;
+	return 0;
+}
+
 static int mnt_table_move_parent(struct libmnt_table *tb, int oldid, int newid)
 {
 	struct libmnt_iter itr;
@@ -827,6 +986,7 @@ static int mnt_table_move_parent(struct libmnt_table *tb, int oldid, int newid)
 		return 0;
 
 	DBG(TAB, ul_debugobj(tb, "moving parent ID from %d -> %d", oldid, newid));
+	mnt_table_invalidate_index(tb);
 	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
 
 	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
@@ -993,9 +1153,30 @@ struct libmnt_fs *mnt_table_find_mountpoint(struct libmnt_table *tb,
  *
  * Returns: a tab entry or NULL.
  */
+/* returns the first entry with the target @path (see mnt_fs_streq_target()) */
+static struct libmnt_fs *find_target(struct libmnt_table *tb,
+				     struct libmnt_tabindex *idx,
+				     const char *path, int direction)
+{
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs = NULL;
+
+	if (idx)
+		return mnt_tabindex_find(idx, MNT_INDEX_TARGET, path,
+					 direction, NULL, NULL, NULL);
+
+	mnt_reset_iter(&itr, direction);
+	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		if (mnt_fs_streq_target(fs, path))
+			return fs;
+	}
+	return NULL;
+}
+
 struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *path, int direction)
 {
 	struct libmnt_iter itr;
+	struct libmnt_tabindex *idx;
 	struct libmnt_fs *fs = NULL;
 	char *cn;
 
@@ -1006,24 +1187,20 @@ struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *pat
 
 	DBG(TAB, ul_debugobj(tb, "lookup TARGET: '%s'", path));
 
+	idx = mnt_table_get_index(tb);
+
 	/* native @target */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_target(fs, path))
-			return fs;
-	}
+	fs = find_target(tb, idx, path, direction);
+	if (fs)
+		return fs;
 
 	/* try absolute path */
 	if (is_relative_path(path) && (cn = absolute_path(path))) {
 		DBG(TAB, ul_debugobj(tb, "lookup absolute TARGET: '%s'", cn));
-		mnt_reset_iter(&itr, direction);
-		while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
-			if (mnt_fs_streq_target(fs, cn)) {
-				free(cn);
-				return fs;
-			}
-		}
+		fs = find_target(tb, idx, cn, direction);
 		free(cn);
+		if (fs)
+			return fs;
 	}
 
 	if (!tb->cache || !(cn = mnt_resolve_path(path, tb->cache)))
@@ -1032,11 +1209,13 @@ struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *pat
 	DBG(TAB, ul_debugobj(tb, "lookup canonical TARGET: '%s'", cn));
 
 	/* canonicalized paths in struct libmnt_table */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_target(fs, cn))
-			return fs;
-	}
+	fs = find_target(tb, idx, cn, direction);
+	if (fs)
+		return fs;
+
+	/* all targets are from kernel */
+	if (idx && mnt_tabindex_get_nresolve(idx) == 0)
+		return NULL;
 
 	/* non-canonical path in struct libmnt_table
 	 * -- note that mountpoint in /proc/self/mountinfo is already
@@ -1080,9 +1259,43 @@ struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *pat
  *
  * Returns: a tab entry or NULL.
  */
+/*
+ * Returns 0 if @fs is btrfs and the mounted subvolume is not the default
+ * one, otherwise returns 1.
+ */
+static int is_default_btrfs_subvol(struct libmnt_fs *fs,
+			void *data __attribute__((__unused__)))
+{
+#ifdef HAVE_BTRFS_SUPPORT
+	if (fs->fstype && !strcmp(fs->fstype, "btrfs")) {
+		struct libmnt_cache *cache = (struct libmnt_cache *) data;
+		uint64_t default_id = btrfs_get_cached_default_subvol_id(cache,
+					mnt_fs_get_devno(fs), mnt_fs_get_target(fs));
+		char *val;
+		size_t len;
+
+		if (default_id == UINT64_MAX)
+			DBG(TAB, ul_debug("not found btrfs volume setting"));
+
+		else if (mnt_fs_get_option(fs, "subvolid", &val, &len) == 0) {
+			uint64_t subvol_id;
+
+			if (mnt_parse_offset(val, len, &subvol_id)) {
+				DBG(TAB, ul_debugobj(fs, "failed to parse subvolid="));
+				return 0;
+			}
+			if (subvol_id != default_id)
+				return 0;
+		}
+	}
+#endif /* HAVE_BTRFS_SUPPORT */
+	return 1;
+}
+
 struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *path, int direction)
 {
 	struct libmnt_iter itr;
+	struct libmnt_tabindex *idx;
 	struct libmnt_fs *fs = NULL;
 	int ntags = 0, nents;
 	char *cn;
@@ -1095,37 +1308,27 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 
 	DBG(TAB, ul_debugobj(tb, "lookup SRCPATH: '%s'", path));
 
-	/* native paths */
-	mnt_reset_iter(&itr, direction);
-
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-
-		if (mnt_fs_streq_srcpath(fs, path)) {
-#ifdef HAVE_BTRFS_SUPPORT
-			if (fs->fstype && !strcmp(fs->fstype, "btrfs")) {
-				uint64_t default_id = btrfs_get_default_subvol_id(mnt_fs_get_target(fs));
-				char *val;
-				size_t len;
-
-				if (default_id == UINT64_MAX)
-					DBG(TAB, ul_debug("not found btrfs volume setting"));
+	idx = mnt_table_get_index(tb);
 
-				else if (mnt_fs_get_option(fs, "subvolid", &val, &len) == 0) {
-					uint64_t subvol_id;
+	/* native paths */
+	if (idx) {
+		fs = mnt_tabindex_find(idx, MNT_INDEX_SRCPATH, path, direction,
+					is_default_btrfs_subvol, tb->cache, NULL);
+		if (fs)
+			return fs;
+		ntags = mnt_tabindex_get_ntags(idx);
+	} else {
+		mnt_reset_iter(&itr, direction);
 
-					if (mnt_parse_offset(val, len, &subvol_id)) {
-						DBG(TAB, ul_debugobj(tb, "failed to parse subvolid="));
-						continue;
-					}
-					if (subvol_id != default_id)
-						continue;
-				}
+		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
+			if (mnt_fs_streq_srcpath(fs, path)) {
+				if (!is_default_btrfs_subvol(fs, tb->cache))
+					continue;
+				return fs;
 			}
-#endif /* HAVE_BTRFS_SUPPORT */
-			return fs;
+			if (mnt_fs_get_tag(fs, NULL, NULL) == 0)
+				ntags++;
 		}
-		if (mnt_fs_get_tag(fs, NULL, NULL) == 0)
-			ntags++;
 	}
 
 	if (!path || !tb->cache || !(cn = mnt_resolve_path(path, tb->cache)))
@@ -1136,7 +1339,12 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 	nents = mnt_table_get_nents(tb);
 
 	/* canonicalized paths in struct libmnt_table */
-	if (ntags < nents) {
+	if (ntags < nents && idx) {
+		fs = mnt_tabindex_find(idx, MNT_INDEX_SRCPATH, cn, direction,
+					NULL, NULL, NULL);
+		if (fs)
+			return fs;
+	} else if (ntags < nents) {
 		mnt_reset_iter(&itr, direction);
 		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
 			if (mnt_fs_streq_srcpath(fs, cn))
@@ -1336,9 +1544,53 @@ struct libmnt_fs *mnt_table_find_source(struct libmnt_table *tb,
  *
  * Returns: a tab entry or NULL.
  */
+struct pair_match {
+	const char		*source;
+	struct libmnt_cache	*cache;
+};
+
+static int match_pair_source(struct libmnt_fs *fs, void *data)
+{
+	struct pair_match *pm = (struct pair_match *) data;
+
+	return mnt_fs_match_source(fs, pm->source, pm->cache);
+}
+
+/*
+ * The target of the entry matches if the target is equal to @target or to the
+ * canonicalized @target (see mnt_fs_match_target()), the other cases are
+ * impossible if all entries are from kernel.
+ */
+static struct libmnt_fs *index_find_pair(struct libmnt_table *tb,
+			struct libmnt_tabindex *idx, const char *source,
+			const char *target, int direction)
+{
+	struct pair_match pm = { .source = source, .cache = tb->cache };
+	struct libmnt_fs *fs, *cfs = NULL;
+	size_t pos = 0, cpos = 0;
+	char *cn;
+
+	fs = mnt_tabindex_find(idx, MNT_INDEX_TARGET, target, direction,
+				match_pair_source, &pm, &pos);
+
+	if (tb->cache && (cn = mnt_resolve_target(target, tb->cache)))
+		cfs = mnt_tabindex_find(idx, MNT_INDEX_TARGET, cn, direction,
+				match_pair_source, &pm, &cpos);
+	if (!fs)
+		return cfs;
+	if (!cfs)
+		return fs;
+
+	/* both found, return the first in the @direction */
+	if (direction == MNT_ITER_FORWARD)
+		return cpos < pos ? cfs : fs;
+	return cpos > pos ? cfs : fs;
+}
+
 struct libmnt_fs *mnt_table_find_pair(struct libmnt_table *tb, const char *source,
 				      const char *target, int direction)
 {
+	struct libmnt_tabindex *idx;
 	struct libmnt_fs *fs = NULL;
 	struct libmnt_iter itr;
 
@@ -1349,6 +1601,10 @@ struct libmnt_fs *mnt_table_find_pair(struct libmnt_table *tb, const char *sourc
 
 	DBG(TAB, ul_debugobj(tb, "lookup SOURCE: %s TARGET: %s", source, target));
 
+	idx = mnt_table_get_index(tb);
+	if (idx && mnt_tabindex_get_nresolve(idx) == 0)
+		return index_find_pair(tb, idx, source, target, direction);
+
 	mnt_reset_iter(&itr, direction);
 	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
 
@@ -1374,6 +1630,7 @@ struct libmnt_fs *mnt_table_find_pair(struct libmnt_table *tb, const char *sourc
 struct libmnt_fs *mnt_table_find_devno(struct libmnt_table *tb,
 				       dev_t devno, int direction)
 {
+	struct libmnt_tabindex *idx;
 	struct libmnt_fs *fs = NULL;
 	struct libmnt_iter itr;
 
@@ -1384,6 +1641,11 @@ struct libmnt_fs *mnt_table_find_devno(struct libmnt_table *tb,
 
 	DBG(TAB, ul_debugobj(tb, "lookup DEVNO: %d", (int) devno));
 
+	idx = mnt_table_get_index(tb);
+	if (idx)
+		return mnt_tabindex_find(idx, MNT_INDEX_DEVNO, &devno, direction,
+					 NULL, NULL, NULL);
+
 	mnt_reset_iter(&itr, direction);
 
 	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
@@ -1459,9 +1721,21 @@ static int get_btrfs_fs_root(struct libmnt_table *tb, struct libmnt_fs *fs, char
 
 		DBG(BTRFS, ul_debug(" subvolid/subvol not found, checking default"));
 
-		default_id = btrfs_get_default_subvol_id(mnt_fs_get_target(fs));
-		if (default_id == UINT64_MAX)
+		target = mnt_resolve_target(mnt_fs_get_target(fs), tb->cache);
+		if (!target)
+			goto err;
+
+		/* the devno of the mounted filesystem is the key for the cache */
+		f = tb->cache ? mnt_table_find_target(tb, target, MNT_ITER_BACKWARD) : NULL;
+
+		default_id = btrfs_get_cached_default_subvol_id(tb->cache,
+					f ? mnt_fs_get_devno(f) : 0,
+					mnt_fs_get_target(fs));
+		if (default_id == UINT64_MAX) {
+			if (!tb->cache)
+				free(target);
 			goto not_found;
+		}
 
 		/* Volume has default subvolume. Check if it matches to
 		 * the one in mountinfo.
@@ -1470,9 +1744,6 @@ static int get_btrfs_fs_root(struct libmnt_table *tb, struct libmnt_fs *fs, char
 		 * kernels, there is no reasonable way to detect which
 		 * subvolume was mounted.
 		 */
-		target = mnt_resolve_target(mnt_fs_get_target(fs), tb->cache);
-		if (!target)
-			goto err;
 
 		snprintf(default_id_str, sizeof(default_id_str), "%llu",
 				(unsigned long long int) default_id);
@@ -1850,7 +2121,8 @@ static int parser_errcb(struct libmnt_table *tb, const char *filename, int line)
 	return 1;	/* all errors are recoverable -- this is the default */
 }
 
-static struct libmnt_table *create_table(const char *file, int comments)
+static struct libmnt_table *create_table(const char *file, int comments,
+					 int arena, int lazy)
 {
 	struct libmnt_table *tb;
 
@@ -1861,6 +2133,8 @@ static struct libmnt_table *create_table(const char *file, int comments)
 		goto err;
 
 	mnt_table_enable_comments(tb, comments);
+	mnt_table_enable_arena(tb, arena);
+	mnt_table_enable_lazy_parse(tb, lazy);
 	mnt_table_set_parser_errcb(tb, parser_errcb);
 
 	if (mnt_table_parse_file(tb, file) != 0)
@@ -1878,7 +2152,7 @@ static int test_copy_fs(struct libmnt_test *ts, int argc, char *argv[])
 	struct libmnt_fs *fs;
 	int rc = -1;
 
-	tb = create_table(argv[1], FALSE);
+	tb = create_table(argv[1], FALSE, FALSE, FALSE);
 	if (!tb)
 		return -1;
 
@@ -1907,13 +2181,19 @@ static int test_parse(struct libmnt_test *ts, int argc, char *argv[])
 	struct libmnt_table *tb = NULL;
 	struct libmnt_iter *itr = NULL;
 	struct libmnt_fs *fs;
-	int rc = -1;
-	int parse_comments = FALSE;
-
-	if (argc == 3 && !strcmp(argv[2], "--comments"))
-		parse_comments = TRUE;
+	int rc = -1, i;
+	int parse_comments = FALSE, arena = FALSE, lazy = FALSE;
+
+	for (i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "--comments"))
+			parse_comments = TRUE;
+		else if (!strcmp(argv[i], "--arena"))
+			arena = TRUE;
+		else if (!strcmp(argv[i], "--lazy"))
+			lazy = TRUE;
+	}
 
-	tb = create_table(argv[1], parse_comments);
+	tb = create_table(argv[1], parse_comments, arena, lazy);
 	if (!tb)
 		return -1;
 
@@ -1953,7 +2233,7 @@ static int test_find_idx(struct libmnt_test *ts, int argc, char *argv[])
 
 	file = argv[1], what = argv[2];
 
-	tb = create_table(file, FALSE);
+	tb = create_table(file, FALSE, FALSE, FALSE);
 	if (!tb)
 		goto done;
 
@@ -1998,7 +2278,7 @@ static int test_find(struct libmnt_test *ts, int argc, char *argv[], int dr)
 
 	file = argv[1], find = argv[2], what = argv[3];
 
-	tb = create_table(file, FALSE);
+	tb = create_table(file, FALSE, FALSE, FALSE);
 	if (!tb)
 		goto done;
 
@@ -2042,7 +2322,7 @@ static int test_find_pair(struct libmnt_test *ts, int argc, char *argv[])
 	struct libmnt_cache *mpc = NULL;
 	int rc = -1;
 
-	tb = create_table(argv[1], FALSE);
+	tb = create_table(argv[1], FALSE, FALSE, FALSE);
 	if (!tb)
 		return -1;
 	mpc = mnt_new_cache();
@@ -2062,6 +2342,63 @@ done:
 	return rc;
 }
 
+static struct libmnt_fs *test_index_lookup(struct libmnt_table *tb,
+			const char *find, char *argv[], int dr)
+{
+	if (strcasecmp(find, "source") == 0)
+		return mnt_table_find_srcpath(tb, argv[0], dr);
+	if (strcasecmp(find, "target") == 0)
+		return mnt_table_find_target(tb, argv[0], dr);
+	if (strcasecmp(find, "devno") == 0) {
+		unsigned int maj, min;
+
+		if (sscanf(argv[0], "%u:%u", &maj, &min) != 2)
+			return NULL;
+		return mnt_table_find_devno(tb, makedev(maj, min), dr);
+	}
+	if (strcasecmp(find, "pair") == 0 && argv[1])
+		return mnt_table_find_pair(tb, argv[0], argv[1], dr);
+	return NULL;
+}
+
+/* compares the first (linear) and the second (indexed) lookup */
+static int test_find_index(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb;
+	const char *find;
+	int rc = 0, i;
+
+	if (argc < 4) {
+		fprintf(stderr, "try --help\n");
+		return -EINVAL;
+	}
+
+	find = argv[2];
+	tb = create_table(argv[1], FALSE, FALSE, FALSE);
+	if (!tb)
+		return -1;
+
+	for (i = 0; i < 2; i++) {
+		int dr = i == 0 ? MNT_ITER_FORWARD : MNT_ITER_BACKWARD;
+		struct libmnt_fs *fs = test_index_lookup(tb, find, argv + 3, dr);
+		struct libmnt_fs *ifs = test_index_lookup(tb, find, argv + 3, dr);
+
+		printf("%s: ", i == 0 ? "forward" : "backward");
+		if (fs)
+			printf("%d %s %s\n", mnt_fs_get_id(fs),
+				mnt_fs_get_source(fs), mnt_fs_get_target(fs));
+		else
+			printf("not found\n");
+		if (fs != ifs) {
+			printf("indexed lookup returns different entry\n");
+			rc = -1;
+		}
+	}
+
+	mnt_unref_table(tb);
+	return rc;
+}
+
 static int test_find_mountpoint(struct libmnt_test *ts, int argc, char *argv[])
 {
 	struct libmnt_table *tb;
@@ -2108,7 +2445,7 @@ static int test_is_mounted(struct libmnt_test *ts, int argc, char *argv[])
 		return -1;
 	}
 
-	fstab = create_table(argv[1], FALSE);
+	fstab = create_table(argv[1], FALSE, FALSE, FALSE);
 	if (!fstab)
 		goto done;
 
@@ -2161,7 +2498,7 @@ static int test_uniq(struct libmnt_test *ts, int argc, char *argv[])
 		return -EINVAL;
 	}
 
-	tb = create_table(argv[1], FALSE);
+	tb = create_table(argv[1], FALSE, FALSE, FALSE);
 	if (!tb)
 		goto done;
 
@@ -2180,19 +2517,102 @@ done:
 	return rc;
 }
 
+static int test_listmount_cmp(struct libmnt_fs *a, struct libmnt_fs *b)
+{
+	int diff = 0;
+
+#define cmp_str(_name, _x, _y) do { \
+		if (!((_x) == NULL && (_y) == NULL) && \
+		    ((_x) == NULL || (_y) == NULL || strcmp((_x), (_y)) != 0)) { \
+			printf("%d: %s differ: '%s' and '%s'\n", mnt_fs_get_id(a), \
+				_name, (_x) ? (_x) : "(null)", (_y) ? (_y) : "(null)"); \
+			diff++; \
+		} \
+	} while (0)
+
+	if (mnt_fs_get_id(a) != mnt_fs_get_id(b)
+	    || mnt_fs_get_parent_id(a) != mnt_fs_get_parent_id(b)
+	    || mnt_fs_get_devno(a) != mnt_fs_get_devno(b)) {
+		printf("%d: IDs or devno differ\n", mnt_fs_get_id(a));
+		diff++;
+	}
+	cmp_str("root", mnt_fs_get_root(a), mnt_fs_get_root(b));
+	cmp_str("target", mnt_fs_get_target(a), mnt_fs_get_target(b));
+	cmp_str("fstype", mnt_fs_get_fstype(a), mnt_fs_get_fstype(b));
+	cmp_str("source", mnt_fs_get_source(a), mnt_fs_get_source(b));
+	cmp_str("VFS options", mnt_fs_get_vfs_options(a), mnt_fs_get_vfs_options(b));
+	cmp_str("FS options", mnt_fs_get_fs_options(a), mnt_fs_get_fs_options(b));
+	cmp_str("optional fields", mnt_fs_get_optional_fields(a),
+				   mnt_fs_get_optional_fields(b));
+#undef cmp_str
+	return diff;
+}
+
+/* compare listmount() result with /proc/self/mountinfo */
+static int test_listmount(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb = NULL, *lm = NULL;
+	struct libmnt_iter *itr = NULL, *lmitr = NULL;
+	struct libmnt_fs *fs;
+	int rc = -1, diff = 0;
+
+	tb = create_table(_PATH_PROC_MOUNTINFO, FALSE, FALSE, FALSE);
+	lm = mnt_new_table();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	lmitr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!tb || !lm || !itr || !lmitr)
+		goto done;
+
+	rc = mnt_table_fetch_listmount(lm, argc > 1 ? MNT_STATMNT_TARGET : 0);
+	if (rc == -ENOSYS) {
+		printf("listmount: not supported\n");
+		rc = 0;
+		goto done;
+	}
+	if (rc)
+		goto done;
+
+	while (mnt_table_next_fs(tb, itr, &fs) == 0) {
+		struct libmnt_fs *x = NULL;
+
+		mnt_reset_iter(lmitr, MNT_ITER_FORWARD);
+		while (mnt_table_next_fs(lm, lmitr, &x) == 0 &&
+		       mnt_fs_get_id(x) != mnt_fs_get_id(fs))
+			x = NULL;
+		if (!x) {
+			printf("%d: not found\n", mnt_fs_get_id(fs));
+			diff++;
+		} else if (argc == 1)
+			diff += test_listmount_cmp(fs, x);
+	}
+	if (mnt_table_get_nents(tb) != mnt_table_get_nents(lm)) {
+		printf("number of entries differ\n");
+		diff++;
+	}
+	printf("listmount: %s\n", diff ? "FAILED" : "OK");
+	rc = diff ? -1 : 0;
+done:
+	mnt_free_iter(itr);
+	mnt_free_iter(lmitr);
+	mnt_unref_table(tb);
+	mnt_unref_table(lm);
+	return rc;
+}
 
 int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
-	{ "--parse",    test_parse,        "<file> [--comments] parse and print tab" },
+	{ "--parse",    test_parse,        "<file> [--comments] [--arena] [--lazy] parse and print tab" },
 	{ "--find-forward",  test_find_fw, "<file> <source|target> <string>" },
 	{ "--find-backward", test_find_bw, "<file> <source|target> <string>" },
 	{ "--uniq-target",   test_uniq,    "<file>" },
 	{ "--find-pair",     test_find_pair, "<file> <source> <target>" },
+	{ "--find-index",    test_find_index, "<file> <source|target|devno|pair> <string> [<target>]" },
 	{ "--find-fs",       test_find_idx, "<file> <target>" },
 	{ "--find-mountpoint", test_find_mountpoint, "<path>" },
 	{ "--copy-fs",       test_copy_fs, "<file>  copy root FS from the file" },
 	{ "--is-mounted",    test_is_mounted, "<fstab> check what from fstab is already mounted" },
+	{ "--listmount",     test_listmount, "[--target] compare listmount() with mountinfo" },
 	{ NULL }
 	};
 
@@ -16,6 +16,7 @@
  * @short_description: compare changes in the list of the mounted filesystems
  */
 #include "mountP.h"
+#include "monotonic.h"
 
 struct tabdiff_entry {
 	int	oper;			/* MNT_TABDIFF_* flags; */
@@ -92,7 +93,7 @@ void mnt_free_tabdiff(struct libmnt_tabdiff *df)
  * @itr: iterator
  * @old_fs: returns the old entry or NULL if new entry added
  * @new_fs: returns the new entry or NULL if old entry removed
- * @oper: MNT_TABDIFF_{MOVE,UMOUNT,REMOUNT,MOUNT} flags
+ * @oper: MNT_TABDIFF_{MOVE,UMOUNT,REMOUNT,MOUNT,PROPAGATION} flags
  *
  * The options @old_fs, @new_fs and @oper are optional.
  *
@@ -213,6 +214,173 @@ static struct tabdiff_entry *tabdiff_get_mount(struct libmnt_tabdiff *df,
 	return NULL;
 }
 
+/* the same as strcmp(), but NULL is equal to NULL only */
+static int strcmp_null(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b ? 0 : 1;
+	return strcmp(a, b);
+}
+
+/*
+ * Compares two entries with the same mount ID. Returns -1 if the entries
+ * describe different mounts (the ID has been reused by kernel), 0 if
+ * unchanged, or MNT_TABDIFF_{MOVE,REMOUNT,PROPAGATION}.
+ */
+static int fs_get_change(struct libmnt_fs *o, struct libmnt_fs *n)
+{
+	const char *v1, *v2, *f1, *f2;
+
+	if (o->uniq_id && n->uniq_id && o->uniq_id != n->uniq_id)
+		return -1;
+	if (o->devno != n->devno
+	    || strcmp_null(mnt_fs_get_root(o), mnt_fs_get_root(n))
+	    || strcmp_null(mnt_fs_get_source(o), mnt_fs_get_source(n)))
+		return -1;
+
+	if (strcmp_null(mnt_fs_get_target(o), mnt_fs_get_target(n)))
+		return MNT_TABDIFF_MOVE;
+
+	v1 = mnt_fs_get_vfs_options(o);
+	v2 = mnt_fs_get_vfs_options(n);
+	f1 = mnt_fs_get_fs_options(o);
+	f2 = mnt_fs_get_fs_options(n);
+
+	if ((v1 && v2 && strcmp(v1, v2)) || (f1 && f2 && strcmp(f1, f2)))
+		return MNT_TABDIFF_REMOUNT;
+
+	if (strcmp_null(mnt_fs_get_optional_fields(o),
+			mnt_fs_get_optional_fields(n)))
+		return MNT_TABDIFF_PROPAGATION;
+	return 0;
+}
+
+static int cmp_fs_id(const void *a, const void *b)
+{
+	const struct libmnt_fs *x = *((const struct libmnt_fs * const *) a);
+	const struct libmnt_fs *y = *((const struct libmnt_fs * const *) b);
+
+	if (x->id == y->id)
+		return 0;
+	return x->id < y->id ? -1 : 1;
+}
+
+/*
+ * Returns array with the table entries sorted by mount ID. The @ents is
+ * NULL if the table is empty. Returns -EINVAL if the IDs are not unique or
+ * not defined (the table is not a kernel mount table).
+ */
+static int table_sort_by_id(struct libmnt_table *tb, struct libmnt_fs ***ents,
+			    size_t *nents)
+{
+	struct libmnt_fs **x, *fs;
+	struct libmnt_iter itr;
+	size_t i, n = 0;
+
+	*ents = NULL;
+	*nents = 0;
+	if (!tb->nents)
+		return 0;
+
+	x = malloc(tb->nents * sizeof(struct libmnt_fs *));
+	if (!x)
+		return -ENOMEM;
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0)
+		x[n++] = fs;
+
+	qsort(x, n, sizeof(struct libmnt_fs *), cmp_fs_id);
+
+	for (i = 0; i < n; i++) {
+		if (x[i]->id <= 0 || (i && x[i - 1]->id == x[i]->id)) {
+			free(x);
+			return -EINVAL;
+		}
+	}
+	*ents = x;
+	*nents = n;
+	return 0;
+}
+
+/* returns index of the entry with @id in array sorted by IDs, or -1 */
+static ssize_t sorted_find_id(struct libmnt_fs **ents, size_t nents, int id)
+{
+	size_t lo = 0, hi = nents;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (ents[mid]->id == id)
+			return mid;
+		if (ents[mid]->id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+/*
+ * Compares arrays sorted by mount IDs in linear time. The unchanged entries
+ * from @o are stored to @keep (indexed in the same way as @n) if @keep is not
+ * NULL; the userspace options are compared too in this case.
+ */
+static int diff_sorted(struct libmnt_tabdiff *df,
+		       struct libmnt_fs **o, size_t no,
+		       struct libmnt_fs **n, size_t nn,
+		       struct libmnt_fs **keep)
+{
+	size_t i = 0, j = 0;
+	int rc = 0;
+
+	while (rc == 0 && (i < no || j < nn)) {
+		int oper;
+
+		if (j == nn || (i < no && o[i]->id < n[j]->id)) {
+			rc = tabdiff_add_entry(df, o[i++], NULL, MNT_TABDIFF_UMOUNT);
+			continue;
+		}
+		if (i == no || n[j]->id < o[i]->id) {
+			rc = tabdiff_add_entry(df, NULL, n[j++], MNT_TABDIFF_MOUNT);
+			continue;
+		}
+
+		oper = fs_get_change(o[i], n[j]);
+		if (oper < 0) {
+			rc = tabdiff_add_entry(df, o[i], NULL, MNT_TABDIFF_UMOUNT);
+			if (!rc)
+				rc = tabdiff_add_entry(df, NULL, n[j], MNT_TABDIFF_MOUNT);
+		} else if (oper > 0)
+			rc = tabdiff_add_entry(df, o[i], n[j], oper);
+		else if (keep && strcmp_null(mnt_fs_get_user_options(o[i]),
+					     mnt_fs_get_user_options(n[j])) == 0)
+			keep[j] = o[i];		/* unchanged */
+		i++, j++;
+	}
+	return rc;
+}
+
+/* compares kernel tables by mount IDs, returns -EINVAL for other tables */
+static int diff_tables_by_id(struct libmnt_tabdiff *df,
+			     struct libmnt_table *old_tab,
+			     struct libmnt_table *new_tab)
+{
+	struct libmnt_fs **o = NULL, **n = NULL;
+	size_t no, nn;
+	int rc;
+
+	rc = table_sort_by_id(old_tab, &o, &no);
+	if (!rc)
+		rc = table_sort_by_id(new_tab, &n, &nn);
+	if (!rc)
+		rc = diff_sorted(df, o, no, n, nn, NULL);
+
+	free(o);
+	free(n);
+	return rc;
+}
+
 /**
  * mnt_diff_tables:
  * @df: diff handler
@@ -222,6 +390,11 @@ static struct tabdiff_entry *tabdiff_get_mount(struct libmnt_tabdiff *df,
  * Compares @old_tab and @new_tab, the result is stored in @df and accessible by
  * mnt_tabdiff_next_change().
  *
+ * The kernel mount tables (with unique mount IDs) are sorted and compared by
+ * mount IDs in O(n log n) time, and moved, remounted filesystems and
+ * propagation changes are detected in the same pass. Other tables are
+ * compared by source and target pairs.
+ *
  * Returns: number of changes, negative number in case of error.
  */
 int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
@@ -229,7 +402,7 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 {
 	struct libmnt_fs *fs;
 	struct libmnt_iter itr;
-	int no, nn;
+	int no, nn, rc;
 
 	if (!df || !old_tab || !new_tab)
 		return -EINVAL;
@@ -260,6 +433,15 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 		goto done;
 	}
 
+	/* kernel tables, compare by mount IDs */
+	rc = diff_tables_by_id(df, old_tab, new_tab);
+	if (rc != -EINVAL) {
+		if (rc)
+			return rc;
+		goto done;
+	}
+	tabdiff_reset(df);
+
 	/* search newly mounted or modified */
 	while(mnt_table_next_fs(new_tab, &itr, &fs) == 0) {
 		struct libmnt_fs *o_fs;
@@ -306,30 +488,180 @@ done:
 	return df->nchanges;
 }
 
-#ifdef TEST_PROGRAM
+/* moves all entries from @src to @dst and removes old @dst entries */
+static int table_replace_all(struct libmnt_table *dst, struct libmnt_table *src)
+{
+	struct libmnt_fs *fs;
+	int rc = 0;
 
-static int test_diff(struct libmnt_test *ts, int argc, char *argv[])
+	while (!list_empty(&dst->ents)) {
+		fs = list_entry(dst->ents.next, struct libmnt_fs, ents);
+		mnt_table_remove_fs(dst, fs);
+	}
+	while (rc == 0 && !list_empty(&src->ents)) {
+		fs = list_entry(src->ents.next, struct libmnt_fs, ents);
+		rc = mnt_table_move_fs(src, dst, 0, NULL, fs);
+	}
+	return rc;
+}
+
+/*
+ * Merges @new_tab to @tb. The unchanged entries are kept in @tb, other
+ * entries are replaced by entries from @new_tab; the entries are in the
+ * @new_tab order.
+ */
+static int table_apply_changes(struct libmnt_tabdiff *df,
+			       struct libmnt_table *tb,
+			       struct libmnt_table *new_tab)
 {
-	struct libmnt_table *tb_old, *tb_new;
-	struct libmnt_tabdiff *diff;
-	struct libmnt_iter *itr;
-	struct libmnt_fs *old, *new;
-	int rc = -1, change;
+	struct libmnt_fs **o = NULL, **n = NULL, **keep = NULL, *fs;
+	size_t no, nn, j;
+	int rc;
+
+	rc = table_sort_by_id(tb, &o, &no);
+	if (!rc)
+		rc = table_sort_by_id(new_tab, &n, &nn);
+	if (rc)
+		goto done;
 
-	tb_old = mnt_new_table_from_file(argv[1]);
-	tb_new = mnt_new_table_from_file(argv[2]);
-	diff = mnt_new_tabdiff();
-	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (nn) {
+		keep = calloc(nn, sizeof(struct libmnt_fs *));
+		if (!keep) {
+			rc = -ENOMEM;
+			goto done;
+		}
+	}
 
-	if (!tb_old || !tb_new || !diff || !itr) {
-		warnx("failed to allocate resources");
+	rc = diff_sorted(df, o, no, n, nn, keep);
+	if (rc)
 		goto done;
+
+	/* keep the unchanged entries, use the new entries for the others */
+	for (j = 0; j < nn; j++) {
+		if (keep[j])
+			mnt_ref_fs(keep[j]);
+	}
+	while (!list_empty(&tb->ents)) {
+		fs = list_entry(tb->ents.next, struct libmnt_fs, ents);
+		mnt_table_remove_fs(tb, fs);
+	}
+	while (rc == 0 && !list_empty(&new_tab->ents)) {
+		ssize_t x;
+
+		fs = list_entry(new_tab->ents.next, struct libmnt_fs, ents);
+		x = sorted_find_id(n, nn, fs->id);
+		if (x >= 0 && keep[x]) {
+			mnt_table_remove_fs(new_tab, fs);
+			rc = mnt_table_add_fs(tb, keep[x]);
+		} else
+			rc = mnt_table_move_fs(new_tab, tb, 0, NULL, fs);
 	}
+	for (j = 0; j < nn; j++)
+		mnt_unref_fs(keep[j]);
+done:
+	free(o);
+	free(n);
+	free(keep);
+	return rc;
+}
 
-	rc = mnt_diff_tables(diff, tb_old, tb_new);
-	if (rc < 0)
+/**
+ * mnt_table_refresh:
+ * @tb: kernel mount table
+ * @filename: mountinfo file or NULL for the default
+ * @df: returns changes or NULL
+ *
+ * Reads the current kernel mount table (see mnt_table_parse_mtab()) and
+ * updates @tb in place. The entries are compared by mount IDs, so it's much
+ * cheaper than to read the new table and call mnt_diff_tables(). The
+ * entries of the unchanged mounts are kept in @tb (for example pointers to
+ * these entries are still valid), only the entries of the modified, mounted
+ * and umounted filesystems are replaced, added or removed. The parser
+ * settings of @tb (filter, error callback, cache, listmount(), arena and lazy
+ * parser) are used to read the new table.
+ *
+ * The changes are stored in @df and accessible by mnt_tabdiff_next_change()
+ * in the same way as the result of mnt_diff_tables(). It's usually called
+ * after mnt_monitor_wait() or mnt_monitor_next_change() detected a change of
+ * the kernel mount table:
+ *
+ * <informalexample>
+ *   <programlisting>
+ * mnt_table_parse_mtab(tb, NULL);
+ *
+ * while (mnt_monitor_wait(mn, -1) > 0) {
+ *    mnt_monitor_event_cleanup(mn);
+ *    mnt_table_refresh(tb, NULL, df);
+ *
+ *    while (mnt_tabdiff_next_change(df, itr, &old, &new, &oper) == 0)
+ *       ...
+ * }
+ *   </programlisting>
+ * </informalexample>
+ *
+ * Returns: number of changes, negative number in case of error.
+ *
+ * Since: 2.36
+ */
+int mnt_table_refresh(struct libmnt_table *tb, const char *filename,
+		      struct libmnt_tabdiff *df)
+{
+	struct libmnt_tabdiff *priv_df = NULL;
+	struct libmnt_table *new_tab;
+	int rc;
+
+	if (!tb)
+		return -EINVAL;
+	if (!df) {
+		df = priv_df = mnt_new_tabdiff();
+		if (!df)
+			return -ENOMEM;
+	}
+	tabdiff_reset(df);
+
+	new_tab = mnt_new_table();
+	if (!new_tab) {
+		rc = -ENOMEM;
+		goto done;
+	}
+	mnt_table_set_parser_errcb(new_tab, tb->errcb);
+	mnt_table_set_parser_fltrcb(new_tab, tb->fltrcb, tb->fltrcb_data);
+	mnt_table_set_cache(new_tab, tb->cache);
+	mnt_table_enable_arena(new_tab, tb->use_arena);
+	mnt_table_enable_lazy_parse(new_tab, tb->lazy_parse);
+	mnt_table_enable_listmount(new_tab, tb->listmount_mask);
+
+	rc = __mnt_table_parse_mtab(new_tab, filename, NULL);
+	if (rc)
 		goto done;
 
+	DBG(DIFF, ul_debugobj(df, "refresh table (old %d entries, new %d entries)",
+				tb->nents, new_tab->nents));
+
+	rc = table_apply_changes(df, tb, new_tab);
+	if (rc == -EINVAL) {
+		/* mount IDs are not unique, compare the whole tables */
+		rc = mnt_diff_tables(df, tb, new_tab);
+		if (rc >= 0)
+			rc = table_replace_all(tb, new_tab);
+	}
+done:
+	mnt_unref_table(new_tab);
+	if (rc == 0) {
+		rc = df->nchanges;
+		DBG(DIFF, ul_debugobj(df, "%d changes detected", rc));
+	}
+	mnt_free_tabdiff(priv_df);
+	return rc;
+}
+
+#ifdef TEST_PROGRAM
+
+static void print_changes(struct libmnt_tabdiff *diff, struct libmnt_iter *itr)
+{
+	struct libmnt_fs *old, *new;
+	int change;
+
 	while(mnt_tabdiff_next_change(diff, itr, &old, &new, &change) == 0) {
 
 		printf("%s on %s: ", mnt_fs_get_source(new ? new : old),
@@ -350,11 +682,39 @@ static int test_diff(struct libmnt_test *ts, int argc, char *argv[])
 		case MNT_TABDIFF_MOUNT:
 			printf("MOUNTED\n");
 			break;
+		case MNT_TABDIFF_PROPAGATION:
+			printf("PROPAGATION changed from '%s' to '%s'\n",
+					mnt_fs_get_optional_fields(old),
+					mnt_fs_get_optional_fields(new));
+			break;
 		default:
 			printf("unknown change!\n");
 		}
 	}
+}
 
+static int test_diff(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb_old, *tb_new;
+	struct libmnt_tabdiff *diff;
+	struct libmnt_iter *itr;
+	int rc = -1;
+
+	tb_old = mnt_new_table_from_file(argv[1]);
+	tb_new = mnt_new_table_from_file(argv[2]);
+	diff = mnt_new_tabdiff();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+
+	if (!tb_old || !tb_new || !diff || !itr) {
+		warnx("failed to allocate resources");
+		goto done;
+	}
+
+	rc = mnt_diff_tables(diff, tb_old, tb_new);
+	if (rc < 0)
+		goto done;
+
+	print_changes(diff, itr);
 	rc = 0;
 done:
 	mnt_unref_table(tb_old);
@@ -364,10 +724,162 @@ done:
 	return rc;
 }
 
+/* refresh table from <old> by <new> and compare the result with <new> */
+static int test_refresh(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb, *tb_new;
+	struct libmnt_tabdiff *diff;
+	struct libmnt_iter *itr, *itr_new;
+	struct libmnt_fs *fs, *fs_new;
+	int rc = -1;
+
+	tb = mnt_new_table();
+	tb_new = mnt_new_table();
+	diff = mnt_new_tabdiff();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	itr_new = mnt_new_iter(MNT_ITER_FORWARD);
+
+	if (!tb || !tb_new || !diff || !itr || !itr_new) {
+		warnx("failed to allocate resources");
+		goto done;
+	}
+	if (mnt_table_parse_mtab(tb, argv[1]) != 0 ||
+	    mnt_table_parse_mtab(tb_new, argv[2]) != 0) {
+		warnx("failed to parse tables");
+		goto done;
+	}
+
+	rc = mnt_table_refresh(tb, argv[2], diff);
+	if (rc < 0)
+		goto done;
+
+	print_changes(diff, itr);
+
+	/* the refreshed table has to be the same as the new table */
+	mnt_reset_iter(itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, itr, &fs) == 0) {
+		if (mnt_table_next_fs(tb_new, itr_new, &fs_new) != 0
+		    || fs_get_change(fs, fs_new) != 0) {
+			printf("refreshed table: FAILED on %s\n", mnt_fs_get_target(fs));
+			rc = -1;
+			goto done;
+		}
+	}
+	if (mnt_table_get_nents(tb) != mnt_table_get_nents(tb_new)) {
+		printf("refreshed table: FAILED, number of entries differ\n");
+		rc = -1;
+		goto done;
+	}
+	printf("refreshed table: OK\n");
+	rc = 0;
+done:
+	mnt_unref_table(tb);
+	mnt_unref_table(tb_new);
+	mnt_free_tabdiff(diff);
+	mnt_free_iter(itr);
+	mnt_free_iter(itr_new);
+	return rc;
+}
+
+/* creates table for the benchmark, @modified adds some changes */
+static struct libmnt_table *create_bench_table(int nents, int with_ids, int modified)
+{
+	struct libmnt_table *tb = mnt_new_table();
+	char buf[64];
+	int i, rc = 0;
+
+	if (!tb)
+		return NULL;
+
+	for (i = 1; rc == 0 && i <= nents + (modified ? nents / 100 : 0); i++) {
+		struct libmnt_fs *fs;
+
+		if (modified && i <= nents && i % 100 == 1)
+			continue;		/* umounted */
+
+		fs = mnt_new_fs();
+		if (!fs)
+			break;
+		fs->flags |= MNT_FS_KERNEL;
+		fs->id = with_ids ? i + 20 : 0;
+		fs->parent = with_ids ? 20 : 0;
+
+		snprintf(buf, sizeof(buf), "/dev/sd%d", i);
+		rc = mnt_fs_set_source(fs, buf);
+
+		if (modified && i <= nents && i % 100 == 2)
+			snprintf(buf, sizeof(buf), "/mnt/moved/%d", i);
+		else
+			snprintf(buf, sizeof(buf), "/mnt/%d", i);
+		if (!rc)
+			rc = mnt_fs_set_target(fs, buf);
+		if (!rc)
+			rc = mnt_fs_set_options(fs,
+				modified && i % 100 == 3 ? "ro,relatime" : "rw,relatime");
+		if (!rc)
+			rc = mnt_table_add_fs(tb, fs);
+		mnt_unref_fs(fs);
+	}
+	if (rc) {
+		mnt_unref_table(tb);
+		return NULL;
+	}
+	return tb;
+}
+
+static double bench_diff(struct libmnt_tabdiff *diff, int nents, int with_ids,
+			 int *nchanges)
+{
+	struct libmnt_table *tb_old, *tb_new;
+	struct timeval start, end;
+	double ms = -1;
+
+	tb_old = create_bench_table(nents, with_ids, 0);
+	tb_new = create_bench_table(nents, with_ids, 1);
+
+	if (tb_old && tb_new) {
+		gettime_monotonic(&start);
+		*nchanges = mnt_diff_tables(diff, tb_old, tb_new);
+		gettime_monotonic(&end);
+
+		ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+		     (end.tv_usec - start.tv_usec) / 1000.0;
+	}
+	mnt_unref_table(tb_old);
+	mnt_unref_table(tb_new);
+	return ms;
+}
+
+static int test_bench(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_tabdiff *diff;
+	int n, max = 32000, nchanges = 0;
+
+	if (argc == 2)
+		max = atoi(argv[1]);
+
+	diff = mnt_new_tabdiff();
+	if (!diff)
+		return -ENOMEM;
+
+	for (n = 1000; n <= max; n *= 2) {
+		double by_id = bench_diff(diff, n, 1, &nchanges);
+		double by_pair = bench_diff(diff, n, 0, &nchanges);
+
+		printf("%7d entries, %5d changes: by ID %9.3f ms, by pairs %9.3f ms\n",
+				n, nchanges, by_id, by_pair);
+	}
+
+	mnt_free_tabdiff(diff);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
 		{ "--diff", test_diff, "<old> <new> prints change" },
+		{ "--refresh", test_refresh, "<old> <new> refresh <old> table by <new> and prints change" },
+		{ "--bench", test_bench, "[<max-entries>] measure diff of generated tables" },
 		{ NULL }
 	};
 
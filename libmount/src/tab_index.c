@@ -0,0 +1,347 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * This file is part of libmount from util-linux project.
+ *
+ * libmount is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Hash indexes for libmnt_table lookups.
+ *
+ * The index is built on demand when the table is searched repeatedly and it
+ * is dropped whenever the table or any entry key is modified. The hash chains
+ * keep the entries in the table order, so the lookup returns the same entry
+ * as the linear walk in the forward as well as in the backward direction.
+ */
+#include <stdint.h>
+
+#include "mountP.h"
+
+/* don't build index for small tables */
+#define MNT_INDEX_MINENTS	32
+
+struct libmnt_idxent {
+	struct libmnt_fs	*fs;
+	size_t			pos;	/* position in the table */
+	uint32_t		hash;
+	struct libmnt_idxent	*next;	/* next in the hash chain */
+};
+
+struct libmnt_tabindex {
+	size_t		nents;
+	size_t		nbuckets;	/* power of 2 */
+	size_t		ntags;		/* number of entries with source TAG */
+	size_t		nresolve;	/* number of non-kernel entries */
+
+	struct libmnt_idxent **buckets[__MNT_INDEX_MAX];
+	struct libmnt_idxent *ents;	/* nents * __MNT_INDEX_MAX */
+
+	struct libmnt_fs **children;	/* sorted by parent ID and ID */
+};
+
+static inline uint32_t hash_num(uint64_t x)
+{
+	return (uint32_t) ((x * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static int get_key(struct libmnt_fs *fs, int kind, uint32_t *hash)
+{
+	const char *p;
+
+	switch (kind) {
+	case MNT_INDEX_TARGET:
+		p = mnt_fs_get_target(fs);
+		if (!p)
+			return 1;
+		*hash = mnt_hash_path(p);
+		break;
+	case MNT_INDEX_SRCPATH:
+		p = mnt_fs_get_srcpath(fs);
+		if (!p)
+			return 1;
+		*hash = mnt_hash_path(p);
+		break;
+	case MNT_INDEX_DEVNO:
+		*hash = hash_num(mnt_fs_get_devno(fs));
+		break;
+	case MNT_INDEX_ID:
+		*hash = hash_num(fs->id);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static uint32_t hash_key(int kind, const void *key)
+{
+	switch (kind) {
+	case MNT_INDEX_TARGET:
+	case MNT_INDEX_SRCPATH:
+		return mnt_hash_path((const char *) key);
+	case MNT_INDEX_DEVNO:
+		return hash_num(*((const dev_t *) key));
+	default:
+		return hash_num(*((const int *) key));
+	}
+}
+
+static int match_key(struct libmnt_fs *fs, int kind, const void *key)
+{
+	switch (kind) {
+	case MNT_INDEX_TARGET:
+		return mnt_fs_streq_target(fs, (const char *) key);
+	case MNT_INDEX_SRCPATH:
+		return mnt_fs_streq_srcpath(fs, (const char *) key);
+	case MNT_INDEX_DEVNO:
+		return mnt_fs_get_devno(fs) == *((const dev_t *) key);
+	case MNT_INDEX_ID:
+		return fs->id == *((const int *) key);
+	}
+	return 0;
+}
+
+static int cmp_children(const void *a, const void *b)
+{
+	const struct libmnt_fs *x = *((const struct libmnt_fs * const *) a);
+	const struct libmnt_fs *y = *((const struct libmnt_fs * const *) b);
+
+	if (x->parent != y->parent)
+		return x->parent < y->parent ? -1 : 1;
+	if (x->id != y->id)
+		return x->id < y->id ? -1 : 1;
+	return 0;
+}
+
+static void free_index(struct libmnt_tabindex *idx)
+{
+	size_t i;
+
+	if (!idx)
+		return;
+	for (i = 0; i < __MNT_INDEX_MAX; i++)
+		free(idx->buckets[i]);
+	free(idx->ents);
+	free(idx->children);
+	free(idx);
+}
+
+static struct libmnt_tabindex *build_index(struct libmnt_table *tb)
+{
+	struct libmnt_tabindex *idx;
+	struct libmnt_fs **fss = NULL;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	size_t i, n = 0;
+	int kind;
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		return NULL;
+
+	idx->nents = tb->nents;
+	idx->nbuckets = 1;
+	while (idx->nbuckets < idx->nents)
+		idx->nbuckets <<= 1;
+
+	fss = malloc(idx->nents * sizeof(struct libmnt_fs *));
+	idx->children = malloc(idx->nents * sizeof(struct libmnt_fs *));
+	idx->ents = calloc(idx->nents * __MNT_INDEX_MAX, sizeof(struct libmnt_idxent));
+	if (!fss || !idx->children || !idx->ents)
+		goto err;
+
+	for (kind = 0; kind < __MNT_INDEX_MAX; kind++) {
+		idx->buckets[kind] = calloc(idx->nbuckets, sizeof(struct libmnt_idxent *));
+		if (!idx->buckets[kind])
+			goto err;
+	}
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (n < idx->nents && mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		fss[n++] = fs;
+		if (mnt_fs_get_tag(fs, NULL, NULL) == 0)
+			idx->ntags++;
+		if (!mnt_fs_is_kernel(fs) && !mnt_fs_is_swaparea(fs))
+			idx->nresolve++;
+	}
+	idx->nents = n;
+
+	/* add in reverse order to keep the table order in the chains */
+	for (i = n; i > 0; i--) {
+		for (kind = 0; kind < __MNT_INDEX_MAX; kind++) {
+			struct libmnt_idxent *e = &idx->ents[(i - 1) * __MNT_INDEX_MAX + kind];
+			struct libmnt_idxent **b;
+
+			if (get_key(fss[i - 1], kind, &e->hash) != 0)
+				continue;
+			e->fs = fss[i - 1];
+			e->pos = i - 1;
+			e->fs->idxpos = i - 1;
+
+			b = &idx->buckets[kind][e->hash & (idx->nbuckets - 1)];
+			e->next = *b;
+			*b = e;
+		}
+	}
+
+	memcpy(idx->children, fss, n * sizeof(struct libmnt_fs *));
+	qsort(idx->children, n, sizeof(struct libmnt_fs *), cmp_children);
+
+	free(fss);
+	DBG(TAB, ul_debugobj(tb, "index: %zu entries, %zu buckets", n, idx->nbuckets));
+	return idx;
+err:
+	free(fss);
+	free_index(idx);
+	return NULL;
+}
+
+/*
+ * Drops the index, must be called whenever the table entries or entry keys
+ * (target, source, devno, id, parent id) are modified.
+ */
+void mnt_table_invalidate_index(struct libmnt_table *tb)
+{
+	if (!tb)
+		return;
+	tb->nlookups = 0;
+	if (tb->index) {
+		DBG(TAB, ul_debugobj(tb, "index: dropped"));
+		free_index(tb->index);
+		tb->index = NULL;
+	}
+}
+
+/*
+ * Returns index or NULL if the table is small or not searched repeatedly
+ * (then the linear walk is cheaper than building the index).
+ */
+struct libmnt_tabindex *mnt_table_get_index(struct libmnt_table *tb)
+{
+	if (tb->index)
+		return tb->index;
+	if (tb->nents < MNT_INDEX_MINENTS || ++tb->nlookups < 2)
+		return NULL;
+
+	tb->index = build_index(tb);
+	return tb->index;
+}
+
+size_t mnt_tabindex_get_ntags(struct libmnt_tabindex *idx)
+{
+	return idx->ntags;
+}
+
+size_t mnt_tabindex_get_nresolve(struct libmnt_tabindex *idx)
+{
+	return idx->nresolve;
+}
+
+/*
+ * Returns the first (MNT_ITER_FORWARD) or the last (MNT_ITER_BACKWARD) entry
+ * where @key matches and the optional @match() callback returns true. The
+ * @key is string for MNT_INDEX_TARGET and MNT_INDEX_SRCPATH, dev_t for
+ * MNT_INDEX_DEVNO, and int for the others.
+ *
+ * The position of the entry in the table is returned by @pos, if not NULL.
+ */
+struct libmnt_fs *mnt_tabindex_find(struct libmnt_tabindex *idx, int kind,
+			const void *key, int direction,
+			int (*match)(struct libmnt_fs *, void *), void *data,
+			size_t *pos)
+{
+	struct libmnt_idxent *e, *res = NULL;
+	uint32_t hash;
+
+	assert(kind >= 0 && kind < __MNT_INDEX_MAX);
+
+	hash = hash_key(kind, key);
+
+	for (e = idx->buckets[kind][hash & (idx->nbuckets - 1)]; e; e = e->next) {
+		if (e->hash != hash || !match_key(e->fs, kind, key))
+			continue;
+		if (match && !match(e->fs, data))
+			continue;
+		res = e;
+		if (direction == MNT_ITER_FORWARD)
+			break;
+	}
+
+	if (!res)
+		return NULL;
+	if (pos)
+		*pos = res->pos;
+	return res->fs;
+}
+
+/*
+ * Returns the first entry at or after @from (MNT_ITER_FORWARD) or the last
+ * entry at or before @from (MNT_ITER_BACKWARD) where @key matches and the
+ * optional @match() callback returns true. The whole table is searched if
+ * @from is NULL.
+ */
+struct libmnt_fs *mnt_tabindex_find_from(struct libmnt_tabindex *idx, int kind,
+			const void *key, int direction, struct libmnt_fs *from,
+			int (*match)(struct libmnt_fs *, void *), void *data)
+{
+	struct libmnt_idxent *e;
+	struct libmnt_fs *res = NULL;
+	uint32_t hash;
+
+	assert(kind >= 0 && kind < __MNT_INDEX_MAX);
+
+	hash = hash_key(kind, key);
+
+	/* the chain is in the table order */
+	for (e = idx->buckets[kind][hash & (idx->nbuckets - 1)]; e; e = e->next) {
+		if (from && direction == MNT_ITER_FORWARD && e->pos < from->idxpos)
+			continue;
+		if (from && direction == MNT_ITER_BACKWARD && e->pos > from->idxpos)
+			break;
+		if (e->hash != hash || !match_key(e->fs, kind, key))
+			continue;
+		if (match && !match(e->fs, data))
+			continue;
+		res = e->fs;
+		if (direction == MNT_ITER_FORWARD)
+			break;
+	}
+	return res;
+}
+
+/*
+ * Returns the child of @parent_id with the smallest ID greater than
+ * @lastchld_id (or the first child if @lastchld_id is zero).
+ */
+struct libmnt_fs *mnt_tabindex_next_child(struct libmnt_tabindex *idx,
+			int parent_id, int lastchld_id)
+{
+	size_t lo = 0, hi = idx->nents;
+
+	/* the first entry after (parent_id, lastchld_id) */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		struct libmnt_fs *fs = idx->children[mid];
+
+		if (fs->parent < parent_id ||
+		    (fs->parent == parent_id && lastchld_id && fs->id <= lastchld_id))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < idx->nents; lo++) {
+		struct libmnt_fs *fs = idx->children[lo];
+
+		if (fs->parent != parent_id)
+			break;
+		/* avoid an infinite loop, see mnt_table_next_child_fs() */
+		if (fs->id == parent_id)
+			continue;
+		return fs;
+	}
+	return NULL;
+}
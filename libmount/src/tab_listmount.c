@@ -0,0 +1,467 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * This file is part of libmount from util-linux project.
+ *
+ * libmount is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Kernel mount table by listmount() and statmount() syscalls (Linux 6.8).
+ *
+ * The syscalls return information about the mounts by the unique mount IDs
+ * in binary form, so it's not necessary to read and parse all the text from
+ * /proc/self/mountinfo, and only the requested fields are returned by kernel.
+ * The entries are compatible with the entries parsed from mountinfo.
+ */
+#include <inttypes.h>
+
+#include "mountP.h"
+#include "mount-api-utils.h"
+#include "pathnames.h"
+#include "strutils.h"
+
+#ifdef UL_HAVE_MOUNT_API_LISTMOUNT
+
+#define MNT_STATMNT_BUFSZ	(4 * 1024)
+#define MNT_STATMNT_MAXBUFSZ	(16 * 1024 * 1024)
+#define MNT_LISTMNT_NUM		512
+
+struct libmnt_statmnt {
+	struct ul_statmount	*sm;
+	size_t			bufsz;
+};
+
+static uint64_t statmnt_kernel_mask(unsigned int mask)
+{
+	uint64_t x = UL_STATMOUNT_SB_BASIC | UL_STATMOUNT_MNT_BASIC;
+
+	if (mask & MNT_STATMNT_ROOT)
+		x |= UL_STATMOUNT_MNT_ROOT;
+	if (mask & MNT_STATMNT_TARGET)
+		x |= UL_STATMOUNT_MNT_POINT;
+	if (mask & MNT_STATMNT_FSTYPE)
+		x |= UL_STATMOUNT_FS_TYPE | UL_STATMOUNT_FS_SUBTYPE;
+	if (mask & MNT_STATMNT_SOURCE)
+		x |= UL_STATMOUNT_SB_SOURCE;
+	if (mask & MNT_STATMNT_OPTIONS)
+		x |= UL_STATMOUNT_MNT_OPTS;
+	if (mask & MNT_STATMNT_PROPAGATION)
+		x |= UL_STATMOUNT_PROPAGATE_FROM;
+	return x;
+}
+
+/* calls statmount(), the buffer is enlarged if too small for the strings */
+static int statmnt_fetch(struct libmnt_statmnt *st, uint64_t id, uint64_t mask)
+{
+	if (!st->sm) {
+		st->sm = malloc(MNT_STATMNT_BUFSZ);
+		if (!st->sm)
+			return -ENOMEM;
+		st->bufsz = MNT_STATMNT_BUFSZ;
+	}
+
+	while (ul_statmount(id, mask, st->sm, st->bufsz) != 0) {
+		struct ul_statmount *x;
+
+		if (errno != EOVERFLOW || st->bufsz >= MNT_STATMNT_MAXBUFSZ)
+			return -errno;
+		x = realloc(st->sm, st->bufsz * 2);
+		if (!x)
+			return -ENOMEM;
+		st->sm = x;
+		st->bufsz *= 2;
+	}
+	return 0;
+}
+
+static const char *statmnt_string(struct ul_statmount *sm, uint64_t flag,
+				  uint32_t off)
+{
+	return sm->mask & flag ? sm->str + off : NULL;
+}
+
+static int set_string(char **str, const char *x)
+{
+	char *p = NULL;
+
+	if (x) {
+		p = strdup(x);
+		if (!p)
+			return -ENOMEM;
+	}
+	free(*str);
+	*str = p;
+	return 0;
+}
+
+/* the same as show_mountinfo() in kernel */
+static int statmnt_vfs_options(struct ul_statmount *sm, char **res)
+{
+	uint64_t attr = sm->mnt_attr;
+	char *o = NULL;
+	int rc;
+
+	rc = mnt_optstr_append_option(&o, attr & UL_MOUNT_ATTR_RDONLY ? "ro" : "rw", NULL);
+	if (!rc && (attr & UL_MOUNT_ATTR_NOSUID))
+		rc = mnt_optstr_append_option(&o, "nosuid", NULL);
+	if (!rc && (attr & UL_MOUNT_ATTR_NODEV))
+		rc = mnt_optstr_append_option(&o, "nodev", NULL);
+	if (!rc && (attr & UL_MOUNT_ATTR_NOEXEC))
+		rc = mnt_optstr_append_option(&o, "noexec", NULL);
+	if (!rc && (attr & UL_MOUNT_ATTR__ATIME) == UL_MOUNT_ATTR_NOATIME)
+		rc = mnt_optstr_append_option(&o, "noatime", NULL);
+	if (!rc && (attr & UL_MOUNT_ATTR_NODIRATIME))
+		rc = mnt_optstr_append_option(&o, "nodiratime", NULL);
+	if (!rc && (attr & UL_MOUNT_ATTR__ATIME) == UL_MOUNT_ATTR_RELATIME)
+		rc = mnt_optstr_append_option(&o, "relatime", NULL);
+	if (!rc && (attr & UL_MOUNT_ATTR_NOSYMFOLLOW))
+		rc = mnt_optstr_append_option(&o, "nosymfollow", NULL);
+	if (!rc && (attr & UL_MOUNT_ATTR_IDMAP))
+		rc = mnt_optstr_append_option(&o, "idmapped", NULL);
+	if (rc) {
+		free(o);
+		return rc;
+	}
+	*res = o;
+	return 0;
+}
+
+static int statmnt_fs_options(struct ul_statmount *sm, char **res)
+{
+	const char *opts = statmnt_string(sm, UL_STATMOUNT_MNT_OPTS, sm->mnt_opts);
+	uint32_t fl = sm->sb_flags;
+	char *o = NULL;
+	int rc;
+
+	rc = mnt_optstr_append_option(&o, fl & UL_SB_RDONLY ? "ro" : "rw", NULL);
+	if (!rc && (fl & UL_SB_SYNCHRONOUS))
+		rc = mnt_optstr_append_option(&o, "sync", NULL);
+	if (!rc && (fl & UL_SB_DIRSYNC))
+		rc = mnt_optstr_append_option(&o, "dirsync", NULL);
+	if (!rc && (fl & UL_SB_LAZYTIME))
+		rc = mnt_optstr_append_option(&o, "lazytime", NULL);
+	if (!rc && opts && *opts)
+		rc = mnt_optstr_append_option(&o, opts, NULL);
+	if (rc) {
+		free(o);
+		return rc;
+	}
+	*res = o;
+	return 0;
+}
+
+/* mountinfo optional fields */
+static int statmnt_opt_fields(struct ul_statmount *sm, char **res)
+{
+	char buf[128], *p = buf;
+	size_t sz = sizeof(buf);
+	int n;
+
+	*buf = '\0';
+	if (sm->mnt_propagation & UL_MS_SHARED) {
+		n = snprintf(p, sz, "shared:%" PRIu64 " ", (uint64_t) sm->mnt_peer_group);
+		p += n, sz -= n;
+	}
+	if (sm->mnt_propagation & UL_MS_SLAVE) {
+		n = snprintf(p, sz, "master:%" PRIu64 " ", (uint64_t) sm->mnt_master);
+		p += n, sz -= n;
+
+		if ((sm->mask & UL_STATMOUNT_PROPAGATE_FROM)
+		    && sm->propagate_from && sm->propagate_from != sm->mnt_master) {
+			n = snprintf(p, sz, "propagate_from:%" PRIu64 " ",
+					(uint64_t) sm->propagate_from);
+			p += n, sz -= n;
+		}
+	}
+	if (sm->mnt_propagation & UL_MS_UNBINDABLE) {
+		n = snprintf(p, sz, "unbindable ");
+		p += n;
+	}
+	if (p > buf)
+		*(p - 1) = '\0';	/* remove the last space */
+
+	return set_string(res, *buf ? buf : NULL);
+}
+
+static int statmnt_to_fs(struct ul_statmount *sm, struct libmnt_fs *fs,
+			 unsigned int mask)
+{
+	const char *p;
+	int rc = 0;
+
+	rc = mnt_fs_detach_arena(fs);
+	if (rc)
+		return rc;
+	mnt_table_invalidate_index(fs->tab);
+
+	fs->flags |= MNT_FS_KERNEL;
+	fs->uniq_id = sm->mnt_id;
+	fs->id = sm->mnt_id_old;
+	fs->parent = sm->mnt_parent_id_old;
+	fs->devno = makedev(sm->sb_dev_major, sm->sb_dev_minor);
+
+	if ((p = statmnt_string(sm, UL_STATMOUNT_MNT_ROOT, sm->mnt_root))) {
+		rc = mnt_fs_set_root(fs, p);
+		if (rc)
+			return rc;
+	}
+
+	if ((p = statmnt_string(sm, UL_STATMOUNT_MNT_POINT, sm->mnt_point))) {
+		char *x;
+
+		rc = mnt_fs_set_target(fs, p);
+		if (rc)
+			return rc;
+		/* remove " (deleted)" suffix */
+		x = (char *) endswith(fs->target, " (deleted)");
+		if (x && *x)
+			*x = '\0';
+	}
+
+	if ((p = statmnt_string(sm, UL_STATMOUNT_FS_TYPE, sm->fs_type))) {
+		const char *sub = statmnt_string(sm, UL_STATMOUNT_FS_SUBTYPE,
+						 sm->fs_subtype);
+		char *x;
+
+		if (sub && *sub)
+			rc = asprintf(&x, "%s.%s", p, sub) < 0 ? -ENOMEM : 0;
+		else
+			rc = (x = strdup(p)) ? 0 : -ENOMEM;
+		if (!rc)
+			rc = __mnt_fs_set_fstype_ptr(fs, x);
+		if (rc)
+			return rc;
+	}
+
+	if ((p = statmnt_string(sm, UL_STATMOUNT_SB_SOURCE, sm->sb_source))) {
+		rc = mnt_fs_set_source(fs, p);
+		if (rc)
+			return rc;
+	}
+
+	if (mask & MNT_STATMNT_OPTIONS) {
+		char *v = NULL, *f = NULL;
+
+		rc = statmnt_vfs_options(sm, &v);
+		if (!rc)
+			rc = statmnt_fs_options(sm, &f);
+		if (rc) {
+			free(v);
+			return rc;
+		}
+		free(fs->vfs_optstr);
+		free(fs->fs_optstr);
+		free(fs->optstr);
+		fs->vfs_optstr = v;
+		fs->fs_optstr = f;
+		fs->optstr = mnt_fs_strdup_options(fs);
+		if (!fs->optstr)
+			return -ENOMEM;
+	}
+
+	if (mask & MNT_STATMNT_PROPAGATION) {
+		rc = statmnt_opt_fields(sm, &fs->opt_fields);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * mnt_fs_fetch_statmount:
+ * @fs: filesystem
+ * @id: unique mount ID
+ * @mask: MNT_STATMNT_* fields to fetch, or zero for all fields
+ *
+ * Fills @fs with information about the mount @id by statmount() syscall. The
+ * IDs, the device number and the flags are always fetched; other fields are
+ * fetched only if requested by @mask and they are not modified otherwise.
+ *
+ * Returns: 0 on success, -ENOSYS if the syscall is not supported, or negative
+ *	    number in case of error.
+ *
+ * Since: 2.36
+ */
+int mnt_fs_fetch_statmount(struct libmnt_fs *fs, uint64_t id, unsigned int mask)
+{
+	struct libmnt_statmnt st = { .sm = NULL };
+	int rc;
+
+	if (!fs)
+		return -EINVAL;
+	if (!mask)
+		mask = MNT_STATMNT_ALL;
+
+	rc = statmnt_fetch(&st, id, statmnt_kernel_mask(mask));
+	if (!rc)
+		rc = statmnt_to_fs(st.sm, fs, mask);
+
+	DBG(FS, ul_debugobj(fs, "statmount %" PRIu64 " [rc=%d]", id, rc));
+	free(st.sm);
+	return rc;
+}
+
+/**
+ * mnt_table_fetch_listmount:
+ * @tb: table
+ * @mask: MNT_STATMNT_* fields to fetch, or zero for all fields
+ *
+ * Adds all mounts of the current mount namespace (below the process root
+ * directory) to the table. The mounts are listed by listmount() syscall and
+ * the entries are filled by statmount() syscall; see mnt_fs_fetch_statmount().
+ *
+ * The parser filter (see mnt_table_set_parser_fltrcb()) is used for the new
+ * entries. The table is not modified on error.
+ *
+ * Returns: 0 on success, -ENOSYS if the syscalls are not supported, or
+ *	    negative number in case of error.
+ *
+ * Since: 2.36
+ */
+int mnt_table_fetch_listmount(struct libmnt_table *tb, unsigned int mask)
+{
+	struct libmnt_statmnt st = { .sm = NULL };
+	struct libmnt_fs *fs = NULL, *last = NULL;
+	uint64_t ids[MNT_LISTMNT_NUM], kmask, lastid = 0;
+	pid_t tid = -1;
+	int rc = 0;
+	TRACE_SCOPE(TAB, "fetch_listmount");
+
+	if (!tb)
+		return -EINVAL;
+	if (!mask)
+		mask = MNT_STATMNT_ALL;
+	kmask = statmnt_kernel_mask(mask);
+
+	DBG(TAB, ul_debugobj(tb, "listmount: start [entries=%d, filter=%s]",
+				mnt_table_get_nents(tb),
+				tb->fltrcb ? "yes" : "not"));
+
+	/* the last entry before the new entries */
+	if (!list_empty(&tb->ents))
+		last = list_last_entry(&tb->ents, struct libmnt_fs, ents);
+
+	do {
+		ssize_t i, n = ul_listmount(UL_LSMT_ROOT, lastid, ids, MNT_LISTMNT_NUM);
+
+		if (n < 0) {
+			rc = -errno;
+			break;
+		}
+		for (i = 0; rc == 0 && i < n; i++) {
+			if (!fs) {
+				fs = mnt_new_fs();
+				if (!fs) {
+					rc = -ENOMEM;
+					break;
+				}
+			}
+			rc = statmnt_fetch(&st, ids[i], kmask);
+			if (rc == -ENOENT) {
+				rc = 0;		/* umounted in the meantime */
+				continue;
+			}
+			if (!rc)
+				rc = statmnt_to_fs(st.sm, fs, mask);
+			if (rc)
+				break;
+
+			if (tb->fltrcb && tb->fltrcb(fs, tb->fltrcb_data)) {
+				mnt_reset_fs(fs);
+				continue;	/* filtered out by callback... */
+			}
+
+			rc = mnt_table_add_fs(tb, fs);
+			if (!rc) {
+				rc = mnt_kernel_fs_postparse(tb, fs, &tid,
+						_PATH_PROC_MOUNTINFO);
+				if (rc)
+					mnt_table_remove_fs(tb, fs);
+			}
+			mnt_unref_fs(fs);
+			fs = NULL;
+		}
+		if (n < MNT_LISTMNT_NUM)
+			break;
+		lastid = ids[n - 1];
+	} while (rc == 0);
+
+	mnt_unref_fs(fs);
+	free(st.sm);
+
+	if (rc) {
+		/* remove the new entries */
+		while (!list_empty(&tb->ents)) {
+			fs = list_last_entry(&tb->ents, struct libmnt_fs, ents);
+			if (fs == last)
+				break;
+			mnt_table_remove_fs(tb, fs);
+		}
+		DBG(TAB, ul_debugobj(tb, "listmount: failed [rc=%d]", rc));
+		return rc;
+	}
+
+	if (tb->fmt == MNT_FMT_GUESS)
+		tb->fmt = MNT_FMT_MOUNTINFO;
+
+	DBG(TAB, ul_debugobj(tb, "listmount: stop (%d entries)",
+				mnt_table_get_nents(tb)));
+	return 0;
+}
+
+#else /* !UL_HAVE_MOUNT_API_LISTMOUNT */
+
+int mnt_fs_fetch_statmount(struct libmnt_fs *fs,
+			   uint64_t id __attribute__((__unused__)),
+			   unsigned int mask __attribute__((__unused__)))
+{
+	return fs ? -ENOSYS : -EINVAL;
+}
+
+int mnt_table_fetch_listmount(struct libmnt_table *tb,
+			      unsigned int mask __attribute__((__unused__)))
+{
+	return tb ? -ENOSYS : -EINVAL;
+}
+
+#endif /* UL_HAVE_MOUNT_API_LISTMOUNT */
+
+/**
+ * mnt_table_enable_listmount:
+ * @tb: table
+ * @mask: MNT_STATMNT_* fields to fetch, or zero to disable
+ *
+ * Enables listmount() and statmount() syscalls for mnt_table_parse_mtab() if
+ * the default kernel mount table is requested; see
+ * mnt_table_fetch_listmount(). The /proc/self/mountinfo file is still used
+ * if the syscalls are not supported by kernel.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ *
+ * Since: 2.36
+ */
+int mnt_table_enable_listmount(struct libmnt_table *tb, unsigned int mask)
+{
+	if (!tb)
+		return -EINVAL;
+	tb->listmount_mask = mask;
+	return 0;
+}
+
+/**
+ * mnt_fs_get_uniq_id:
+ * @fs: filesystem
+ *
+ * Returns: the unique 64-bit mount ID (never reused by kernel), or zero if
+ *	    the entry has not been filled by statmount() syscall.
+ *
+ * Since: 2.36
+ */
+uint64_t mnt_fs_get_uniq_id(struct libmnt_fs *fs)
+{
+	return fs ? fs->uniq_id : 0;
+}
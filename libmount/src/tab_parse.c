@@ -33,6 +33,17 @@ struct libmnt_parser {
 	char	*buf;		/* buffer (the current line content) */
 	size_t	bufsiz;		/* size of the buffer */
 	size_t	line;		/* current line */
+	int	utab_action;	/* UTAB_ACT_* of the current utab line */
+	int	journal;	/* utab journal, ACTION= records expected */
+};
+
+/* utab journal records (in <utab>.journal only), see utab_append() in
+ * tab_update.c */
+enum {
+	UTAB_ACT_MOUNT = 0,	/* new entry */
+	UTAB_ACT_UMOUNT,
+	UTAB_ACT_MOVE,
+	UTAB_ACT_REMOUNT
 };
 
 static void parser_cleanup(struct libmnt_parser *pa)
@@ -172,16 +183,95 @@ fail:
 
 
 /*
- * Parses one line from a mountinfo file
+ * Unmangles the next string from @s to the arena buffer @*ab (and moves the
+ * buffer pointer), or returns newly allocated string if @ab is NULL.
+ */
+static char *next_string(char **ab, const char *s, const char **end)
+{
+	const char *e;
+	char *p;
+
+	if (!ab)
+		return unmangle(s, end);
+
+	e = skip_nonspearator(s);
+	if (end)
+		*end = e;
+	if (e == s)
+		return NULL;	/* empty string */
+
+	p = *ab;
+	unmangle_to_buffer(s, p, e - s + 1);
+	*ab += strlen(p) + 1;
+	return p;
+}
+
+static char *strndup_to_arena(char **ab, const char *s, size_t n)
+{
+	char *p;
+
+	if (!ab)
+		return strndup(s, n);
+	p = *ab;
+	memcpy(p, s, n);
+	p[n] = '\0';
+	*ab += n + 1;
+	return p;
+}
+
+/*
+ * Records position of the next field for the lazy parser, returns 0 for empty
+ * field.
+ */
+static int next_lazy_field(struct libmnt_fs *fs, int id,
+			   struct libmnt_lazyfield *f, const char *line,
+			   const char **s)
+{
+	const char *e = skip_nonspearator(*s);
+
+	f->off = *s - line;
+	f->len = e - *s;
+	*s = e;
+
+	fs->lazy_mask |= id;
+	return f->len != 0;
+}
+
+/*
+ * Parses one line from a mountinfo file. If @ar is not NULL, then strings are
+ * stored to the arena. If @lazy is true, then only the numbers, target, source
+ * and fstype are parsed and the other fields are parsed by the mnt_fs_get_*
+ * functions (see mnt_fs_parse_lazy()).
  */
-static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
+static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s,
+				    struct libmnt_arena *ar, int lazy)
 {
 	int rc = 0;
 	unsigned int maj, min;
-	char *p;
+	char *p, *abuf = NULL, **ab = NULL;
+	const char *line = NULL;
 
 	fs->flags |= MNT_FS_KERNEL;
 
+	if (ar) {
+		/* all strings are shorter than the line, and the merged
+		 * options are shorter than the VFS and FS options */
+		abuf = mnt_fs_attach_arena(fs, ar, 2 * strlen(s) + 16);
+		if (!abuf)
+			return -ENOMEM;
+		ab = &abuf;
+	}
+
+	if (lazy) {
+		/* offsets of the fields in the line are the same in the copy */
+		line = s;
+		fs->lazy_line = strndup_to_arena(ab, s, strlen(s));
+		if (!fs->lazy_line) {
+			rc = -ENOMEM;
+			goto fail;
+		}
+	}
+
 	/* (1) id */
 	s = next_s32(s, &fs->id, &rc);
 	if (!s || !*s || rc) {
@@ -210,8 +300,8 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 	s = skip_separator(s);
 
 	/* (4) mountroot */
-	fs->root = unmangle(s, &s);
-	if (!fs->root) {
+	if (lazy ? !next_lazy_field(fs, MNT_LAZY_ROOT, &fs->lazy_root, line, &s)
+		 : !(fs->root = next_string(ab, s, &s))) {
 		DBG(TAB, ul_debug("tab parse error: [mountroot]"));
 		goto fail;
 	}
@@ -219,7 +309,7 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 	s = skip_separator(s);
 
 	/* (5) target */
-	fs->target = unmangle(s, &s);
+	fs->target = next_string(ab, s, &s);
 	if (!fs->target) {
 		DBG(TAB, ul_debug("tab parse error: [target]"));
 		goto fail;
@@ -233,8 +323,8 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 	s = skip_separator(s);
 
 	/* (6) vfs options (fs-independent) */
-	fs->vfs_optstr = unmangle(s, &s);
-	if (!fs->vfs_optstr) {
+	if (lazy ? !next_lazy_field(fs, MNT_LAZY_VFSOPTS, &fs->lazy_vfsopts, line, &s)
+		 : !(fs->vfs_optstr = next_string(ab, s, &s))) {
 		DBG(TAB, ul_debug("tab parse error: [VFS options]"));
 		goto fail;
 	}
@@ -245,16 +335,21 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 		DBG(TAB, ul_debug("mountinfo parse error: separator not found"));
 		return -EINVAL;
 	}
-	if (p > s + 1)
-		fs->opt_fields = strndup(s + 1, p - s - 1);
+	if (p > s + 1 && lazy) {
+		fs->lazy_optfields.off = s + 1 - line;
+		fs->lazy_optfields.len = p - s - 1;
+		fs->lazy_mask |= MNT_LAZY_OPTFIELDS;
+	} else if (p > s + 1)
+		fs->opt_fields = strndup_to_arena(ab, s + 1, p - s - 1);
 
 	s = skip_separator(p + 3);
 
 	/* (8) FS type */
-	p = unmangle(s, &s);
+	p = next_string(ab, s, &s);
 	if (!p || (rc = __mnt_fs_set_fstype_ptr(fs, p))) {
 		DBG(TAB, ul_debug("tab parse error: [fstype]"));
-		free(p);
+		if (!ab)
+			free(p);
 		goto fail;
 	}
 
@@ -269,10 +364,11 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 		}
 	} else {
 		s = skip_separator(s);
-		p = unmangle(s, &s);
+		p = next_string(ab, s, &s);
 		if (!p || (rc = __mnt_fs_set_source_ptr(fs, p))) {
 			DBG(TAB, ul_debug("tab parse error: [regular source]"));
-			free(p);
+			if (!ab)
+				free(p);
 			goto fail;
 		}
 	}
@@ -280,12 +376,19 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 	s = skip_separator(s);
 
 	/* (10) fs options (fs specific) */
-	fs->fs_optstr = unmangle(s, &s);
-	if (!fs->fs_optstr) {
+	if (lazy ? !next_lazy_field(fs, MNT_LAZY_FSOPTS, &fs->lazy_fsopts, line, &s)
+		 : !(fs->fs_optstr = next_string(ab, s, &s))) {
 		DBG(TAB, ul_debug("tab parse error: [FS options]"));
 		goto fail;
 	}
 
+	if (lazy) {
+		fs->lazy_mask |= MNT_LAZY_OPTSTR;
+		if (ab)
+			mnt_fs_commit_arena(fs, abuf);
+		return 0;
+	}
+
 	/* merge VFS and FS options to one string */
 	fs->optstr = mnt_fs_strdup_options(fs);
 	if (!fs->optstr) {
@@ -294,6 +397,12 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 		goto fail;
 	}
 
+	if (ab) {
+		p = fs->optstr;
+		fs->optstr = strndup_to_arena(ab, p, strlen(p));
+		free(p);
+		mnt_fs_commit_arena(fs, abuf);
+	}
 	return 0;
 fail:
 	if (rc == 0)
@@ -303,9 +412,10 @@ fail:
 }
 
 /*
- * Parses one line from utab file
+ * Parses one line from utab file, the @action is NULL if the ACTION=
+ * journal records are not expected (ignored like other unknown keys).
  */
-static int mnt_parse_utab_line(struct libmnt_fs *fs, const char *s)
+static int mnt_parse_utab_line(struct libmnt_fs *fs, const char *s, int *action)
 {
 	const char *p = s;
 
@@ -314,6 +424,9 @@ static int mnt_parse_utab_line(struct libmnt_fs *fs, const char *s)
 	assert(!fs->source);
 	assert(!fs->target);
 
+	if (action)
+		*action = UTAB_ACT_MOUNT;
+
 	while (p && *p) {
 		const char *end = NULL;
 
@@ -321,7 +434,17 @@ static int mnt_parse_utab_line(struct libmnt_fs *fs, const char *s)
 		if (!*p)
 			break;
 
-		if (!fs->source && !strncmp(p, "SRC=", 4)) {
+		if (action && !strncmp(p, "ACTION=", 7)) {
+			p += 7;
+			if (!strncmp(p, "umount", 6))
+				*action = UTAB_ACT_UMOUNT;
+			else if (!strncmp(p, "move", 4))
+				*action = UTAB_ACT_MOVE;
+			else if (!strncmp(p, "remount", 7))
+				*action = UTAB_ACT_REMOUNT;
+			while (*p && *p != ' ') p++;
+
+		} else if (!fs->source && !strncmp(p, "SRC=", 4)) {
 			char *v = unmangle(p + 4, &end);
 			if (!v)
 				goto enomem;
@@ -601,10 +724,11 @@ next_line:
 		rc = mnt_parse_table_line(fs, s);
 		break;
 	case MNT_FMT_MOUNTINFO:
-		rc = mnt_parse_mountinfo_line(fs, s);
+		rc = mnt_parse_mountinfo_line(fs, s, tb->arena, tb->lazy_parse);
 		break;
 	case MNT_FMT_UTAB:
-		rc = mnt_parse_utab_line(fs, s);
+		rc = mnt_parse_utab_line(fs, s,
+				pa->journal ? &pa->utab_action : NULL);
 		break;
 	case MNT_FMT_SWAPS:
 		if (strncmp(s, "Filename\t", 9) == 0)
@@ -659,9 +783,9 @@ done:
 	return tid;
 }
 
-static int kernel_fs_postparse(struct libmnt_table *tb,
-			       struct libmnt_fs *fs, pid_t *tid,
-			       const char *filename)
+int mnt_kernel_fs_postparse(struct libmnt_table *tb,
+			    struct libmnt_fs *fs, pid_t *tid,
+			    const char *filename)
 {
 	int rc = 0;
 	const char *src = mnt_fs_get_srcpath(fs);
@@ -698,13 +822,62 @@ static int kernel_fs_postparse(struct libmnt_table *tb,
 	return rc;
 }
 
-static int __table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filename)
+/*
+ * Applies utab journal record to the already parsed entries, the same as
+ * the original tab_update.c code did with the whole file.
+ *
+ * Returns: 1 if applied (@fs is unnecessary), 0 if @fs has to be added to
+ *          the table, negative number on error.
+ */
+static int apply_utab_action(struct libmnt_table *tb,
+			     struct libmnt_parser *pa, struct libmnt_fs *fs)
+{
+	struct libmnt_fs *cur = NULL;
+	int rc = 0, action = pa->utab_action;
+
+	pa->utab_action = UTAB_ACT_MOUNT;
+
+	switch (action) {
+	case UTAB_ACT_UMOUNT:
+		if (fs->target)
+			cur = mnt_table_find_target(tb, fs->target, MNT_ITER_BACKWARD);
+		if (cur)
+			rc = mnt_table_remove_fs(tb, cur);
+		break;
+	case UTAB_ACT_MOVE:
+		if (mnt_fs_get_srcpath(fs))
+			cur = mnt_table_find_target(tb, mnt_fs_get_srcpath(fs),
+						    MNT_ITER_BACKWARD);
+		if (cur)
+			rc = mnt_fs_set_target(cur, fs->target);
+		break;
+	case UTAB_ACT_REMOUNT:
+		if (fs->target)
+			cur = mnt_table_find_target(tb, fs->target, MNT_ITER_BACKWARD);
+		if (!cur)
+			return 0;		/* not found, add a new entry */
+		rc = mnt_fs_set_attributes(cur, fs->attrs);
+		if (!rc)
+			rc = mnt_fs_set_options(cur, fs->user_optstr);
+		break;
+	default:
+		return 0;
+	}
+
+	DBG(TAB, ul_debugobj(tb, "utab record %d for %s applied [rc=%d]",
+				action, fs->target, rc));
+	return rc < 0 ? rc : 1;
+}
+
+static int table_parse_stream(struct libmnt_table *tb, FILE *f,
+			      const char *filename, int journal)
 {
 	int rc = -1;
 	int flags = 0;
 	pid_t tid = -1;
 	struct libmnt_fs *fs = NULL;
 	struct libmnt_parser pa = { .line = 0 };
+	TRACE_SCOPE(TAB, "parse_stream");
 
 	assert(tb);
 	assert(f);
@@ -716,6 +889,13 @@ static int __table_parse_stream(struct libmnt_table *tb, FILE *f, const char *fi
 
 	pa.filename = filename;
 	pa.f = f;
+	pa.journal = journal;
+
+	if (tb->use_arena && !tb->arena) {
+		tb->arena = mnt_new_arena();
+		if (!tb->arena)
+			return -ENOMEM;
+	}
 
 	/* necessary for /proc/mounts only, the /proc/self/mountinfo
 	 * parser sets the flag properly
@@ -732,6 +912,9 @@ static int __table_parse_stream(struct libmnt_table *tb, FILE *f, const char *fi
 
 		rc = mnt_table_parse_next(&pa, tb, fs);
 
+		if (!rc && pa.utab_action)
+			rc = apply_utab_action(tb, &pa, fs);
+
 		if (!rc && tb->fltrcb && tb->fltrcb(fs, tb->fltrcb_data))
 			rc = 1;	/* filtered out by callback... */
 
@@ -740,7 +923,7 @@ static int __table_parse_stream(struct libmnt_table *tb, FILE *f, const char *fi
 			fs->flags |= flags;
 
 			if (rc == 0 && tb->fmt == MNT_FMT_MOUNTINFO) {
-				rc = kernel_fs_postparse(tb, fs, &tid, filename);
+				rc = mnt_kernel_fs_postparse(tb, fs, &tid, filename);
 				if (rc)
 					mnt_table_remove_fs(tb, fs);
 			}
@@ -772,6 +955,119 @@ err:
 	return rc;
 }
 
+static int __table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filename)
+{
+	return table_parse_stream(tb, f, filename, 0);
+}
+
+/* returns generation from the utab or journal header, or 0 */
+static uint64_t read_utab_generation(FILE *f)
+{
+	char buf[sizeof(MNT_UTAB_GENERATION) + 24];
+	uint64_t gen = 0;
+
+	if (fgets(buf, sizeof(buf), f)
+	    && strncmp(buf, MNT_UTAB_GENERATION, sizeof(MNT_UTAB_GENERATION) - 1) == 0) {
+		errno = 0;
+		gen = strtoull(buf + sizeof(MNT_UTAB_GENERATION) - 1, NULL, 10);
+		if (errno)
+			gen = 0;
+	}
+	rewind(f);
+	return gen;
+}
+
+/*
+ * Returns generation of utab or journal file. The missing file or header
+ * is generation 0.
+ */
+int mnt_get_utab_generation(const char *filename, uint64_t *gen)
+{
+	FILE *f = fopen(filename, "r" UL_CLOEXECSTR);
+
+	*gen = 0;
+	if (!f)
+		return errno == ENOENT ? 0 : -errno;
+	*gen = read_utab_generation(f);
+	fclose(f);
+	return 0;
+}
+
+/* returns 1 if there is nothing in utab and utab journal */
+int mnt_utab_is_empty(const char *utab)
+{
+	char *journal = NULL;
+	int rc;
+
+	if (!is_file_empty(utab))
+		return 0;
+	if (asprintf(&journal, "%s" MNT_UTAB_JOURNAL_SUFFIX, utab) < 0)
+		return 0;
+	rc = is_file_empty(journal);
+	free(journal);
+	return rc;
+}
+
+#define UTAB_PARSE_RETRIES	3
+
+/*
+ * Parses utab and applies the journal records. The utab and the journal are
+ * replaced (by rename) when compacted, and the reader does not lock. If
+ * utab is older than the journal, then utab has been compacted after it
+ * has been read, and the table is reset and read again.
+ *
+ * The journal is applied also when the generations do not match after
+ * retries; utab rewritten by an old libmount does not contain the header.
+ */
+static int table_parse_utab(struct libmnt_table *tb, const char *filename)
+{
+	char *journal = NULL;
+	int rc = 0, tries;
+
+	if (asprintf(&journal, "%s" MNT_UTAB_JOURNAL_SUFFIX, filename) < 0)
+		return -ENOMEM;
+
+	for (tries = 0; ; tries++) {
+		uint64_t gen = 0, jgen;
+		FILE *f;
+
+		f = fopen(filename, "r" UL_CLOEXECSTR);
+		if (f) {
+			gen = read_utab_generation(f);
+			rc = __table_parse_stream(tb, f, filename);
+			fclose(f);
+		} else if (errno != ENOENT)
+			rc = -errno;
+		if (rc)
+			break;
+
+		f = fopen(journal, "r" UL_CLOEXECSTR);
+		if (!f) {
+			if (errno != ENOENT)
+				rc = -errno;
+			break;
+		}
+		jgen = read_utab_generation(f);
+
+		if (jgen > gen && tries < UTAB_PARSE_RETRIES) {
+			DBG(TAB, ul_debugobj(tb, "%s: utab %ju older than journal %ju, retry",
+					filename, (uintmax_t) gen, (uintmax_t) jgen));
+			fclose(f);
+			mnt_reset_table(tb);
+			continue;
+		}
+
+		/* the old journal is already merged to utab */
+		if (jgen >= gen)
+			rc = table_parse_stream(tb, f, journal, 1);
+		fclose(f);
+		break;
+	}
+
+	free(journal);
+	return rc;
+}
+
 /**
  * mnt_table_parse_stream:
  * @tb: tab pointer
@@ -826,6 +1122,11 @@ int mnt_table_parse_file(struct libmnt_table *tb, const char *filename)
 	if (!filename || !tb)
 		return -EINVAL;
 
+	if (tb->fmt == MNT_FMT_UTAB) {
+		rc = table_parse_utab(tb, filename);
+		goto done;
+	}
+
 	/*
 	 * Try to use read()+poll() to realiably read all
 	 * /proc/#/{mount,mountinfo} file to memory
@@ -1000,7 +1301,8 @@ struct libmnt_table *__mnt_new_table_from_file(const char *filename, int fmt, in
 
 	if (!filename)
 		return NULL;
-	if (stat(filename, &st))
+	/* utab may be missing, but not the journal */
+	if (fmt != MNT_FMT_UTAB && stat(filename, &st))
 		return empty_for_enoent ? mnt_new_table() : NULL;
 
 	tb = mnt_new_table();
@@ -1250,6 +1552,27 @@ int __mnt_table_parse_mtab(struct libmnt_table *tb, const char *filename,
 		filename = NULL;	/* mtab useless */
 #endif
 
+	if (!filename && tb->listmount_mask) {
+		tb->fmt = MNT_FMT_MOUNTINFO;
+		DBG(TAB, ul_debugobj(tb, "mtab parse: #1 listmount"));
+
+		rc = mnt_table_fetch_listmount(tb, tb->listmount_mask);
+		if (rc == 0)
+			goto read_utab;
+		/* unsupported by kernel? ...try mountinfo */
+	}
+
+	if (!filename && mnt_get_snapshot_socket_path()) {
+		tb->fmt = MNT_FMT_MOUNTINFO;
+		DBG(TAB, ul_debugobj(tb, "mtab parse: #1 snapshot"));
+
+		/* utab is already merged in the snapshot */
+		rc = mnt_table_fetch_snapshot(tb, mnt_get_snapshot_socket_path());
+		if (rc == 0)
+			return 0;
+		/* no daemon or outdated? ...try mountinfo */
+	}
+
 	if (!filename || strcmp(filename, _PATH_PROC_MOUNTINFO) == 0) {
 		filename = _PATH_PROC_MOUNTINFO;
 		tb->fmt = MNT_FMT_MOUNTINFO;
@@ -1269,9 +1592,7 @@ int __mnt_table_parse_mtab(struct libmnt_table *tb, const char *filename,
 
 	if (!is_mountinfo(tb))
 		return 0;
-#ifdef USE_LIBMOUNT_SUPPORT_MTAB
 read_utab:
-#endif
 	DBG(TAB, ul_debugobj(tb, "mtab parse: #2 read utab"));
 
 	if (mnt_table_get_nents(tb) == 0)
@@ -1282,7 +1603,7 @@ read_utab:
 	if (!u_tb) {
 		const char *utab = mnt_get_utab_path();
 
-		if (!utab || is_file_empty(utab))
+		if (!utab || mnt_utab_is_empty(utab))
 			return 0;
 
 		u_tb = mnt_new_table();
@@ -0,0 +1,612 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * This file is part of libmount from util-linux project.
+ *
+ * libmount is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Mount table snapshots.
+ *
+ * The snapshot is a binary serialization of the parsed mount table (incl.
+ * the userspace mount options merged from utab). It's usually written to
+ * a sealed memfd by mountsnapd(8) and many processes map the same read-only
+ * memory rather than read and parse mountinfo on their own; the strings of
+ * the entries are used directly from the mapped memory (see arena.c).
+ *
+ * The snapshot format:
+ *
+ *	struct snapshot_header
+ *	struct snapshot_entry + strings (aligned to 8 bytes)
+ *	...
+ *
+ * The format is private and valid for the same libmount version only.
+ */
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <inttypes.h>
+
+#include "mountP.h"
+#include "all-io.h"
+#include "strutils.h"
+
+#define MNT_SNAPSHOT_MAGIC	"MNTSNAP"
+#define MNT_SNAPSHOT_VERSION	2
+
+/* max time to wait for the snapshot daemon */
+#define MNT_SNAPSHOT_TIMEOUT	1
+
+struct snapshot_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	nents;
+	uint64_t	size;		/* whole snapshot size */
+	uint64_t	mntns;		/* mount namespace inode of the writer */
+	uint64_t	root_dev;	/* root directory of the writer */
+	uint64_t	root_ino;
+};
+
+/* strings of the entry */
+enum {
+	SNAP_SOURCE = 0,
+	SNAP_ROOT,
+	SNAP_TARGET,
+	SNAP_FSTYPE,
+	SNAP_OPTSTR,
+	SNAP_VFS_OPTSTR,
+	SNAP_FS_OPTSTR,
+	SNAP_USER_OPTSTR,
+	SNAP_OPT_FIELDS,
+	SNAP_ATTRS,
+	SNAP_BINDSRC,
+	__SNAP_NSTRINGS
+};
+
+struct snapshot_entry {
+	uint32_t	size;		/* entry size incl. strings and padding */
+	uint32_t	strsz;		/* size of the strings */
+	int32_t		id;
+	int32_t		parent;
+	uint64_t	uniq_id;
+	uint64_t	devno;
+	int32_t		flags;		/* MNT_FS_* */
+	int32_t		tid;
+	int32_t		freq;		/* fstab only */
+	int32_t		passno;
+	uint32_t	str[__SNAP_NSTRINGS];	/* offset + 1, or 0 for NULL */
+	uint32_t	padding;
+};
+
+#define SNAP_ALIGN(x)	(((x) + 7) & ~((size_t) 7))
+
+static uint64_t get_mntns(void)
+{
+	struct stat st;
+
+	return stat("/proc/self/ns/mnt", &st) == 0 ? (uint64_t) st.st_ino : 0;
+}
+
+/* the paths in the mount table are relative to the root directory */
+static int get_root(uint64_t *dev, uint64_t *ino)
+{
+	struct stat st;
+
+	if (stat("/proc/self/root", &st) != 0)
+		return -errno;
+	*dev = st.st_dev;
+	*ino = st.st_ino;
+	return 0;
+}
+
+static const char *get_entry_string(struct libmnt_fs *fs, int id)
+{
+	switch (id) {
+	case SNAP_SOURCE:
+		return mnt_fs_get_source(fs);
+	case SNAP_ROOT:
+		return mnt_fs_get_root(fs);
+	case SNAP_TARGET:
+		return mnt_fs_get_target(fs);
+	case SNAP_FSTYPE:
+		return mnt_fs_get_fstype(fs);
+	case SNAP_OPTSTR:
+		return mnt_fs_get_options(fs);
+	case SNAP_VFS_OPTSTR:
+		return mnt_fs_get_vfs_options(fs);
+	case SNAP_FS_OPTSTR:
+		return mnt_fs_get_fs_options(fs);
+	case SNAP_USER_OPTSTR:
+		return mnt_fs_get_user_options(fs);
+	case SNAP_OPT_FIELDS:
+		return mnt_fs_get_optional_fields(fs);
+	case SNAP_ATTRS:
+		return mnt_fs_get_attributes(fs);
+	case SNAP_BINDSRC:
+		return mnt_fs_get_bindsrc(fs);
+	}
+	return NULL;
+}
+
+/* appends @fs to the snapshot buffer @buf */
+static int serialize_fs(struct libmnt_fs *fs, char **buf, size_t *bufsz, size_t *used)
+{
+	struct snapshot_entry *e;
+	const char *str[__SNAP_NSTRINGS];
+	size_t sz = 0, off = 0;
+	char *p;
+	int i;
+
+	for (i = 0; i < __SNAP_NSTRINGS; i++) {
+		str[i] = get_entry_string(fs, i);
+		if (str[i])
+			sz += strlen(str[i]) + 1;
+	}
+	if (sz > UINT32_MAX / 2)
+		return -EINVAL;
+
+	if (*used + sizeof(*e) + SNAP_ALIGN(sz) > *bufsz) {
+		size_t newsz = max(*bufsz * 2, *used + sizeof(*e) + SNAP_ALIGN(sz));
+
+		p = realloc(*buf, newsz);
+		if (!p)
+			return -ENOMEM;
+		*buf = p;
+		*bufsz = newsz;
+	}
+
+	e = (struct snapshot_entry *) (*buf + *used);
+	memset(e, 0, sizeof(*e));
+
+	e->size = sizeof(*e) + SNAP_ALIGN(sz);
+	e->strsz = sz;
+	e->id = fs->id;
+	e->parent = fs->parent;
+	e->uniq_id = fs->uniq_id;
+	e->devno = fs->devno;
+	e->flags = fs->flags;
+	e->tid = fs->tid;
+	e->freq = fs->freq;
+	e->passno = fs->passno;
+
+	p = (char *) (e + 1);
+	for (i = 0; i < __SNAP_NSTRINGS; i++) {
+		size_t len;
+
+		if (!str[i])
+			continue;
+		len = strlen(str[i]) + 1;
+		memcpy(p + off, str[i], len);
+		e->str[i] = off + 1;
+		off += len;
+	}
+	memset(p + off, 0, SNAP_ALIGN(sz) - sz);
+
+	*used += e->size;
+	return 0;
+}
+
+/**
+ * mnt_table_write_snapshot:
+ * @tb: mount table
+ * @fd: file descriptor
+ *
+ * Writes snapshot of the mount table @tb to @fd. The snapshot may be used by
+ * mnt_table_attach_snapshot() in the same mount namespace. The format is
+ * private and compatible with the same libmount version only.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ *
+ * Since: 2.36
+ */
+int mnt_table_write_snapshot(struct libmnt_table *tb, int fd)
+{
+	struct snapshot_header *hdr;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	size_t bufsz, used = sizeof(*hdr);
+	char *buf;
+	int rc = 0;
+
+	if (!tb || fd < 0)
+		return -EINVAL;
+
+	bufsz = sizeof(*hdr) + 256 * (size_t) (tb->nents + 1);
+	buf = malloc(bufsz);
+	if (!buf)
+		return -ENOMEM;
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (rc == 0 && mnt_table_next_fs(tb, &itr, &fs) == 0)
+		rc = serialize_fs(fs, &buf, &bufsz, &used);
+
+	if (!rc) {
+		hdr = (struct snapshot_header *) buf;
+		memset(hdr, 0, sizeof(*hdr));
+		memcpy(hdr->magic, MNT_SNAPSHOT_MAGIC, sizeof(MNT_SNAPSHOT_MAGIC));
+		hdr->version = MNT_SNAPSHOT_VERSION;
+		hdr->nents = tb->nents;
+		hdr->size = used;
+		hdr->mntns = get_mntns();
+		get_root(&hdr->root_dev, &hdr->root_ino);
+
+		if (write_all(fd, buf, used) != 0)
+			rc = -errno;
+	}
+
+	DBG(TAB, ul_debugobj(tb, "snapshot: write %zu bytes [rc=%d]", used, rc));
+	free(buf);
+	return rc;
+}
+
+/* returns 1 if @fd is memfd sealed against any modification */
+static int is_sealed(int fd)
+{
+#ifdef F_GET_SEALS
+	int seals = fcntl(fd, F_GET_SEALS);
+
+	return seals >= 0 && (seals & F_SEAL_WRITE) && (seals & F_SEAL_SHRINK);
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Returns the snapshot in the memory, it's mapped if the snapshot cannot be
+ * modified, otherwise it's copied to private memory.
+ */
+static char *read_snapshot(int fd, size_t *sz, int *mapped)
+{
+	struct stat st;
+	char *buf;
+
+	if (fstat(fd, &st) != 0)
+		return NULL;
+	if (st.st_size < (off_t) sizeof(struct snapshot_header)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	*sz = st.st_size;
+
+	if (is_sealed(fd)) {
+		buf = mmap(NULL, *sz, PROT_READ, MAP_SHARED, fd, 0);
+		if (buf != MAP_FAILED) {
+			*mapped = 1;
+			return buf;
+		}
+	}
+
+	*mapped = 0;
+	buf = malloc(*sz);
+	if (!buf)
+		return NULL;
+	if (lseek(fd, 0, SEEK_SET) != 0 || read_all(fd, buf, *sz) != (ssize_t) *sz) {
+		free(buf);
+		if (!errno)
+			errno = EINVAL;
+		return NULL;
+	}
+	return buf;
+}
+
+static int deserialize_fs(struct libmnt_fs *fs, struct libmnt_arena *ar,
+			  struct snapshot_entry *e)
+{
+	char *strs = (char *) (e + 1);
+	char *str[__SNAP_NSTRINGS] = { NULL };
+	int i, rc = 0;
+
+	if (e->strsz && strs[e->strsz - 1] != '\0')
+		return -EINVAL;
+	for (i = 0; i < __SNAP_NSTRINGS; i++) {
+		if (!e->str[i])
+			continue;
+		if (e->str[i] > e->strsz)
+			return -EINVAL;
+		str[i] = strs + e->str[i] - 1;
+	}
+
+	fs->id = e->id;
+	fs->parent = e->parent;
+	fs->uniq_id = e->uniq_id;
+	fs->devno = e->devno;
+	fs->tid = e->tid;
+	fs->freq = e->freq;
+	fs->passno = e->passno;
+
+	/* the strings are (read-only) in the arena */
+	mnt_fs_attach_arena_buffer(fs, ar, strs, e->strsz);
+
+	fs->root = str[SNAP_ROOT];
+	fs->target = str[SNAP_TARGET];
+	fs->optstr = str[SNAP_OPTSTR];
+	fs->vfs_optstr = str[SNAP_VFS_OPTSTR];
+	fs->fs_optstr = str[SNAP_FS_OPTSTR];
+	fs->opt_fields = str[SNAP_OPT_FIELDS];
+
+	if (str[SNAP_SOURCE])
+		rc = __mnt_fs_set_source_ptr(fs, str[SNAP_SOURCE]);
+	if (!rc && str[SNAP_FSTYPE])
+		rc = __mnt_fs_set_fstype_ptr(fs, str[SNAP_FSTYPE]);
+
+	/* the other strings are not in the arena */
+	if (!rc)
+		rc = strdup_to_struct_member(fs, user_optstr, str[SNAP_USER_OPTSTR]);
+	if (!rc)
+		rc = strdup_to_struct_member(fs, attrs, str[SNAP_ATTRS]);
+	if (!rc)
+		rc = strdup_to_struct_member(fs, bindsrc, str[SNAP_BINDSRC]);
+
+	fs->flags = e->flags;
+	return rc;
+}
+
+static int attach_snapshot(struct libmnt_table *tb, int fd, int check_ns)
+{
+	struct snapshot_header *hdr;
+	struct libmnt_arena *ar = NULL;
+	struct libmnt_fs *fs = NULL, *last = NULL;
+	size_t sz = 0, off;
+	uint32_t i;
+	int mapped = 0, rc = 0;
+	char *buf;
+
+	errno = 0;
+	buf = read_snapshot(fd, &sz, &mapped);
+	if (!buf)
+		return errno ? -errno : -ENOMEM;
+
+	hdr = (struct snapshot_header *) buf;
+	if (memcmp(hdr->magic, MNT_SNAPSHOT_MAGIC, sizeof(MNT_SNAPSHOT_MAGIC)) != 0
+	    || hdr->version != MNT_SNAPSHOT_VERSION
+	    || hdr->size != sz) {
+		DBG(TAB, ul_debugobj(tb, "snapshot: unsupported format"));
+		rc = -EINVAL;
+		goto done;
+	}
+	if (check_ns && hdr->mntns != get_mntns()) {
+		DBG(TAB, ul_debugobj(tb, "snapshot: another mount namespace"));
+		rc = -ESTALE;
+		goto done;
+	}
+	if (check_ns) {
+		uint64_t dev = 0, ino = 0;
+
+		if (get_root(&dev, &ino) != 0
+		    || dev != hdr->root_dev || ino != hdr->root_ino) {
+			DBG(TAB, ul_debugobj(tb, "snapshot: another root directory"));
+			rc = -ESTALE;
+			goto done;
+		}
+	}
+
+	ar = mnt_new_arena_from_buffer(buf, sz, mapped);
+	if (!ar) {
+		rc = -ENOMEM;
+		goto done;
+	}
+	buf = NULL;		/* owned by arena */
+
+	/* the last entry before the new entries */
+	if (!list_empty(&tb->ents))
+		last = list_last_entry(&tb->ents, struct libmnt_fs, ents);
+
+	off = sizeof(*hdr);
+	for (i = 0; rc == 0 && i < hdr->nents; i++) {
+		struct snapshot_entry *e = (struct snapshot_entry *) ((char *) hdr + off);
+
+		if (sz - off < sizeof(*e) || e->size < sizeof(*e)
+		    || e->size > sz - off || e->strsz > e->size - sizeof(*e)) {
+			rc = -EINVAL;
+			break;
+		}
+		off += e->size;
+
+		fs = mnt_new_fs();
+		if (!fs) {
+			rc = -ENOMEM;
+			break;
+		}
+		rc = deserialize_fs(fs, ar, e);
+
+		/* the table is not from mountinfo of any our task */
+		if (check_ns)
+			fs->tid = 0;
+		if (!rc && tb->fltrcb && tb->fltrcb(fs, tb->fltrcb_data)) {
+			mnt_unref_fs(fs);
+			continue;	/* filtered out by callback... */
+		}
+		if (!rc)
+			rc = mnt_table_add_fs(tb, fs);
+		mnt_unref_fs(fs);
+	}
+
+	if (rc) {
+		/* remove the new entries */
+		while (!list_empty(&tb->ents)) {
+			fs = list_last_entry(&tb->ents, struct libmnt_fs, ents);
+			if (fs == last)
+				break;
+			mnt_table_remove_fs(tb, fs);
+		}
+	} else if (tb->fmt == MNT_FMT_GUESS)
+		tb->fmt = MNT_FMT_MOUNTINFO;
+done:
+	mnt_unref_arena(ar);
+	if (buf) {
+		if (mapped)
+			munmap(buf, sz);
+		else
+			free(buf);
+	}
+	DBG(TAB, ul_debugobj(tb, "snapshot: attach %zu bytes [rc=%d, mapped=%d]",
+				sz, rc, mapped));
+	return rc;
+}
+
+/**
+ * mnt_table_attach_snapshot:
+ * @tb: mount table
+ * @fd: file descriptor
+ *
+ * Adds entries from the snapshot written by mnt_table_write_snapshot() to
+ * @tb. The strings of the entries are used directly from the mapped snapshot
+ * if @fd is memfd sealed against writing and shrinking, otherwise the snapshot
+ * is read to private memory. The file descriptor may be closed after this
+ * call.
+ *
+ * The parser filter (see mnt_table_set_parser_fltrcb()) is applied to the
+ * entries.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ *
+ * Since: 2.36
+ */
+int mnt_table_attach_snapshot(struct libmnt_table *tb, int fd)
+{
+	if (!tb || fd < 0)
+		return -EINVAL;
+	return attach_snapshot(tb, fd, 0);
+}
+
+/* receives snapshot file descriptor from the daemon */
+static int recv_snapshot_fd(const char *socket_path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct timeval tv = { .tv_sec = MNT_SNAPSHOT_TIMEOUT };
+	union {
+		struct cmsghdr	cmh;
+		char		buf[CMSG_SPACE(sizeof(int))];
+	} ctl;
+	struct msghdr msg = { .msg_name = NULL };
+	struct cmsghdr *cmh;
+	struct iovec iov;
+	char x;
+	int sock, fd = -1;
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+		return -EINVAL;
+	xstrncpy(addr.sun_path, socket_path, sizeof(addr.sun_path));
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -errno;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+		goto err;
+
+	iov.iov_base = &x;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+
+	if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+		goto err;
+
+	cmh = CMSG_FIRSTHDR(&msg);
+	if (cmh && cmh->cmsg_level == SOL_SOCKET && cmh->cmsg_type == SCM_RIGHTS
+	    && cmh->cmsg_len == CMSG_LEN(sizeof(int)))
+		memcpy(&fd, CMSG_DATA(cmh), sizeof(int));
+	close(sock);
+	return fd >= 0 ? fd : -EINVAL;
+err:
+	fd = errno ? -errno : -EINVAL;
+	close(sock);
+	return fd;
+}
+
+/*
+ * Adds entries from the snapshot provided by the daemon on @socket_path to
+ * @tb. The snapshot from another mount namespace or from another root
+ * directory (e.g. chroot) is ignored.
+ */
+int mnt_table_fetch_snapshot(struct libmnt_table *tb, const char *socket_path)
+{
+	int rc, fd;
+
+	assert(tb);
+	assert(socket_path);
+
+	DBG(TAB, ul_debugobj(tb, "snapshot: fetching from %s", socket_path));
+
+	fd = recv_snapshot_fd(socket_path);
+	if (fd < 0) {
+		DBG(TAB, ul_debugobj(tb, "snapshot: no file descriptor [rc=%d]", fd));
+		return fd;
+	}
+	rc = attach_snapshot(tb, fd, 1);
+	close(fd);
+	return rc;
+}
+
+#ifdef TEST_PROGRAM
+
+static int test_snapshot(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb, *snap = NULL;
+	struct libmnt_iter *itr = NULL;
+	struct libmnt_fs *fs;
+	FILE *f = NULL;
+	int rc = -1;
+
+	if (argc != 2)
+		return -EINVAL;
+
+	tb = mnt_new_table_from_file(argv[1]);
+	if (!tb) {
+		fprintf(stderr, "%s: parsing failed\n", argv[1]);
+		return -1;
+	}
+	f = tmpfile();
+	if (!f)
+		goto done;
+	rc = mnt_table_write_snapshot(tb, fileno(f));
+	if (rc) {
+		fprintf(stderr, "write snapshot failed: %s\n", strerror(-rc));
+		goto done;
+	}
+	/* snapshot entries are independent on the original table */
+	mnt_unref_table(tb);
+	tb = NULL;
+
+	snap = mnt_new_table();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!snap || !itr)
+		goto done;
+	rc = mnt_table_attach_snapshot(snap, fileno(f));
+	if (rc) {
+		fprintf(stderr, "attach snapshot failed: %s\n", strerror(-rc));
+		goto done;
+	}
+	fclose(f);
+	f = NULL;
+
+	while (mnt_table_next_fs(snap, itr, &fs) == 0)
+		mnt_fs_print_debug(fs, stdout);
+done:
+	if (f)
+		fclose(f);
+	mnt_free_iter(itr);
+	mnt_unref_table(snap);
+	mnt_unref_table(tb);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct libmnt_test tss[] = {
+	{ "--snapshot", test_snapshot, "<file>  write and attach snapshot, print the result" },
+	{ NULL }
+	};
+
+	return mnt_run_test(tss, argc, argv);
+}
+
+#endif /* TEST_PROGRAM */
@@ -21,6 +21,14 @@
  * file, the userspace mount options (e.g. user=) are stored in the /run/mount/utab
  * file.
  *
+ * The mount, umount, move and remount updates of the utab file are appended
+ * to the <utab>.journal file (see utab_append()) under a shared lock, so
+ * more mounts do not wait for each other. The parser reads utab and applies
+ * the journal records to the already parsed entries. The journal is merged
+ * to utab (compacted, under exclusive lock) when it grows larger than utab.
+ * The utab file itself keeps the old format, so an old libmount reads the
+ * state from the last compaction, but never the journal records.
+ *
  * It's recommended to use high-level struct libmnt_context API.
  */
 #include <sys/file.h>
@@ -30,6 +38,9 @@
 #include "mountP.h"
 #include "mangle.h"
 #include "pathnames.h"
+#include "all-io.h"
+
+#define UTAB_COMPACT_SIZE	(64 * 1024)	/* don't compact smaller journal */
 
 struct libmnt_update {
 	char		*target;
@@ -38,6 +49,7 @@ struct libmnt_update {
 	unsigned long	mountflags;
 	int		userspace_only;
 	int		ready;
+	uint64_t	generation;	/* utab generation written by compaction */
 
 	struct libmnt_table *mountinfo;
 };
@@ -413,7 +425,8 @@ err:
 static int fprintf_mtab_fs(FILE *f, struct libmnt_fs *fs)
 {
 	const char *o, *src, *fstype, *comm;
-	char *m1, *m2, *m3, *m4;
+	const char *m1, *m2, *m3, *m4;
+	char *f1 = NULL, *f2 = NULL, *f3 = NULL, *f4 = NULL;
 	int rc;
 
 	assert(fs);
@@ -424,10 +437,11 @@ static int fprintf_mtab_fs(FILE *f, struct libmnt_fs *fs)
 	fstype = mnt_fs_get_fstype(fs);
 	o = mnt_fs_get_options(fs);
 
-	m1 = src ? mangle(src) : "none";
-	m2 = mangle(mnt_fs_get_target(fs));
-	m3 = fstype ? mangle(fstype) : "none";
-	m4 = o ? mangle(o) : "rw";
+	/* the mangle_if_needed() results are not allocated for usual strings */
+	m1 = src ? mangle_if_needed(src, &f1) : "none";
+	m2 = mangle_if_needed(mnt_fs_get_target(fs), &f2);
+	m3 = fstype ? mangle_if_needed(fstype, &f3) : "none";
+	m4 = o ? mangle_if_needed(o, &f4) : "rw";
 
 	if (m1 && m2 && m3 && m4) {
 		if (comm)
@@ -441,63 +455,61 @@ static int fprintf_mtab_fs(FILE *f, struct libmnt_fs *fs)
 	} else
 		rc = -ENOMEM;
 
-	if (src)
-		free(m1);
-	free(m2);
-	if (fstype)
-		free(m3);
-	if (o)
-		free(m4);
+	free(f1);
+	free(f2);
+	free(f3);
+	free(f4);
 
 	return rc;
 }
 
 static int fprintf_utab_fs(FILE *f, struct libmnt_fs *fs)
 {
-	char *p;
+	const char *p;
+	char *tofree;
 	int rc = 0;
 
 	if (!fs || !f)
 		return -EINVAL;
 
-	p = mangle(mnt_fs_get_source(fs));
+	p = mangle_if_needed(mnt_fs_get_source(fs), &tofree);
 	if (p) {
 		rc = fprintf(f, "SRC=%s ", p);
-		free(p);
+		free(tofree);
 	}
 	if (rc >= 0) {
-		p = mangle(mnt_fs_get_target(fs));
+		p = mangle_if_needed(mnt_fs_get_target(fs), &tofree);
 		if (p) {
 			rc = fprintf(f, "TARGET=%s ", p);
-			free(p);
+			free(tofree);
 		}
 	}
 	if (rc >= 0) {
-		p = mangle(mnt_fs_get_root(fs));
+		p = mangle_if_needed(mnt_fs_get_root(fs), &tofree);
 		if (p) {
 			rc = fprintf(f, "ROOT=%s ", p);
-			free(p);
+			free(tofree);
 		}
 	}
 	if (rc >= 0) {
-		p = mangle(mnt_fs_get_bindsrc(fs));
+		p = mangle_if_needed(mnt_fs_get_bindsrc(fs), &tofree);
 		if (p) {
 			rc = fprintf(f, "BINDSRC=%s ", p);
-			free(p);
+			free(tofree);
 		}
 	}
 	if (rc >= 0) {
-		p = mangle(mnt_fs_get_attributes(fs));
+		p = mangle_if_needed(mnt_fs_get_attributes(fs), &tofree);
 		if (p) {
 			rc = fprintf(f, "ATTRS=%s ", p);
-			free(p);
+			free(tofree);
 		}
 	}
 	if (rc >= 0) {
-		p = mangle(mnt_fs_get_user_options(fs));
+		p = mangle_if_needed(mnt_fs_get_user_options(fs), &tofree);
 		if (p) {
 			rc = fprintf(f, "OPTS=%s", p);
-			free(p);
+			free(tofree);
 		}
 	}
 	if (rc >= 0)
@@ -534,6 +546,9 @@ static int update_table(struct libmnt_update *upd, struct libmnt_table *tb)
 		if (tb->comms && mnt_table_get_intro_comment(tb))
 			fputs(mnt_table_get_intro_comment(tb), f);
 
+		if (upd->userspace_only && upd->generation)
+			fprintf(f, MNT_UTAB_GENERATION "%ju\n", (uintmax_t) upd->generation);
+
 		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
 			if (upd->userspace_only)
 				rc = fprintf_utab_fs(f, fs);
@@ -673,6 +688,156 @@ leave:
 	return rc;
 }
 
+/* replaces the journal by an empty journal for utab upd->generation */
+static int utab_reset_journal(struct libmnt_update *upd, const char *journal)
+{
+	char *uq = NULL;
+	int fd, rc = 0;
+
+	fd = mnt_open_uniq_filename(journal, &uq);
+	if (fd < 0)
+		return fd;
+
+	if (dprintf(fd, MNT_UTAB_GENERATION "%ju\n", (uintmax_t) upd->generation) < 0
+	    || fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH) != 0)
+		rc = -errno;
+	if (close(fd) != 0 && !rc)
+		rc = -errno;
+	if (!rc && rename(uq, journal) != 0)
+		rc = -errno;
+
+	unlink(uq);	/* be paranoid */
+	free(uq);
+	return rc;
+}
+
+/*
+ * Merges the journal to utab. The new utab is renamed before the new
+ * journal, so readers without lock detect the compaction by the generation
+ * headers (see table_parse_utab()).
+ */
+static int utab_compact(struct libmnt_update *upd, struct libmnt_lock *lc,
+			const char *journal)
+{
+	struct libmnt_table *tb = NULL;
+	uint64_t gen, jgen;
+	int rc = 0;
+
+	DBG(UPDATE, ul_debugobj(upd, "%s: compact", upd->filename));
+
+	if (lc)
+		rc = mnt_lock_file(lc);
+	if (rc)
+		return -MNT_ERR_LOCK;
+
+	rc = mnt_get_utab_generation(upd->filename, &gen);
+	if (!rc)
+		rc = mnt_get_utab_generation(journal, &jgen);
+	if (!rc) {
+		tb = __mnt_new_table_from_file(upd->filename, MNT_FMT_UTAB, 1);
+		if (!tb)
+			rc = -errno;
+	}
+	if (!rc) {
+		upd->generation = max(gen, jgen) + 1;
+		rc = update_table(upd, tb);
+	}
+	if (!rc)
+		rc = utab_reset_journal(upd, journal);
+	if (lc)
+		mnt_unlock_file(lc);
+
+	mnt_unref_table(tb);
+	return rc;
+}
+
+/*
+ * Appends the record to utab journal; the @action is NULL for a new entry, or
+ * "umount" (upd->target), "move" (upd->fs source is the old target) and
+ * "remount" (upd->fs). The record is written by one write(2) to the file
+ * opened with O_APPEND, so more writers may append at the same time, the
+ * shared lock only protects the writers against compaction.
+ */
+static int utab_append(struct libmnt_update *upd, struct libmnt_lock *lc,
+		       const char *action)
+{
+	char *buf = NULL, *journal = NULL;
+	size_t bufsz = 0;
+	struct stat st = { .st_size = 0 }, ust = { .st_size = 0 };
+	FILE *f;
+	int fd, rc = 0;
+
+	DBG(UPDATE, ul_debugobj(upd, "%s: append %s record", upd->filename,
+				action ? action : "mount"));
+
+	if (asprintf(&journal, "%s" MNT_UTAB_JOURNAL_SUFFIX, upd->filename) < 0)
+		return -ENOMEM;
+
+	f = open_memstream(&buf, &bufsz);
+	if (!f) {
+		rc = -ENOMEM;
+		goto done;
+	}
+	if (action)
+		fprintf(f, "ACTION=%s ", action);
+	if (upd->fs)
+		rc = fprintf_utab_fs(f, upd->fs);
+	else {
+		char *tofree;
+		const char *p = mangle_if_needed(upd->target, &tofree);
+
+		if (p) {
+			fprintf(f, "TARGET=%s\n", p);
+			free(tofree);
+		}
+	}
+	if (fclose(f) != 0 && !rc)
+		rc = -errno;
+	if (rc || !buf)
+		goto done;
+
+	/* fprintf_utab_fs() ends the line by separator if OPTS= is missing */
+	if (bufsz >= 2 && buf[bufsz - 2] == ' ') {
+		buf[bufsz - 2] = '\n';
+		buf[--bufsz] = '\0';
+	}
+
+	if (lc) {
+		mnt_lock_use_shared(lc, TRUE);
+		rc = mnt_lock_file(lc);
+		if (rc) {
+			mnt_lock_use_shared(lc, FALSE);
+			rc = -MNT_ERR_LOCK;
+			goto done;
+		}
+	}
+
+	fd = open(journal, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+			S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if (fd < 0)
+		rc = -errno;
+	else {
+		if (write_all(fd, buf, bufsz) != 0)
+			rc = -errno;
+		if (!rc && fstat(fd, &st) == 0 && stat(upd->filename, &ust) != 0)
+			ust.st_size = 0;
+		close(fd);
+	}
+
+	if (lc) {
+		mnt_unlock_file(lc);
+		mnt_lock_use_shared(lc, FALSE);
+	}
+
+	if (!rc && st.st_size > max((off_t) UTAB_COMPACT_SIZE, ust.st_size))
+		rc = utab_compact(upd, lc, journal);
+done:
+	free(buf);
+	free(journal);
+	DBG(UPDATE, ul_debugobj(upd, "%s: append done [rc=%d]", upd->filename, rc));
+	return rc;
+}
+
 static int add_file_entry(struct libmnt_table *tb, struct libmnt_update *upd)
 {
 	struct libmnt_fs *fs;
@@ -699,6 +864,9 @@ static int update_add_entry(struct libmnt_update *upd, struct libmnt_lock *lc)
 
 	DBG(UPDATE, ul_debugobj(upd, "%s: add entry", upd->filename));
 
+	if (upd->userspace_only)
+		return utab_append(upd, lc, NULL);
+
 	if (lc)
 		rc = mnt_lock_file(lc);
 	if (rc)
@@ -725,6 +893,9 @@ static int update_remove_entry(struct libmnt_update *upd, struct libmnt_lock *lc
 
 	DBG(UPDATE, ul_debugobj(upd, "%s: remove entry", upd->filename));
 
+	if (upd->userspace_only)
+		return utab_append(upd, lc, "umount");
+
 	if (lc)
 		rc = mnt_lock_file(lc);
 	if (rc)
@@ -754,6 +925,9 @@ static int update_modify_target(struct libmnt_update *upd, struct libmnt_lock *l
 	assert(upd);
 	DBG(UPDATE, ul_debugobj(upd, "%s: modify target", upd->filename));
 
+	if (upd->userspace_only)
+		return utab_append(upd, lc, "move");
+
 	if (lc)
 		rc = mnt_lock_file(lc);
 	if (rc)
@@ -789,6 +963,9 @@ static int update_modify_options(struct libmnt_update *upd, struct libmnt_lock *
 
 	DBG(UPDATE, ul_debugobj(upd, "%s: modify options", upd->filename));
 
+	if (upd->userspace_only)
+		return utab_append(upd, lc, "remount");
+
 	fs = upd->fs;
 
 	if (lc)
@@ -1024,6 +1201,37 @@ static int test_remount(struct libmnt_test *ts, int argc, char *argv[])
 	return rc;
 }
 
+static int test_compact(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_update *upd;
+	struct libmnt_lock *lc = NULL;
+	int rc;
+
+	upd = mnt_new_update();
+	if (!upd)
+		return -ENOMEM;
+
+	rc = mnt_update_set_filename(upd, NULL, 0);
+	if (rc == 0 && !upd->userspace_only)
+		rc = -EINVAL;
+	if (rc == 0) {
+		char *journal = NULL;
+
+		lc = mnt_new_lock(upd->filename, 0);
+		if (lc)
+			mnt_lock_use_simplelock(lc, TRUE);
+		if (asprintf(&journal, "%s" MNT_UTAB_JOURNAL_SUFFIX, upd->filename) < 0)
+			rc = -ENOMEM;
+		else
+			rc = utab_compact(upd, lc, journal);
+		free(journal);
+	}
+
+	mnt_free_lock(lc);
+	mnt_free_update(upd);
+	return rc;
+}
+
 static int test_replace(struct libmnt_test *ts, int argc, char *argv[])
 {
 	struct libmnt_fs *fs = mnt_new_fs();
@@ -1055,6 +1263,7 @@ int main(int argc, char *argv[])
 	{ "--remove", test_remove,  "<target>                      MS_REMOUNT mtab change" },
 	{ "--move",   test_move,    "<old_target>  <target>        MS_MOVE mtab change" },
 	{ "--remount",test_remount, "<target>  <options>           MS_REMOUNT mtab change" },
+	{ "--compact",test_compact, "                              compact utab" },
 	{ "--replace",test_replace, "<src> <target>                Add a line to LIBMOUNT_FSTAB and replace the original file" },
 	{ NULL }
 	};
@@ -20,6 +20,7 @@
 #include <pwd.h>
 #include <grp.h>
 #include <poll.h>
+#include <pthread.h>
 #include <blkid.h>
 
 #include "strutils.h"
@@ -81,6 +82,22 @@ int mnt_valid_tagname(const char *tagname)
 	return 0;
 }
 
+/*
+ * FNV-1a hash compatible with streq_paths(), duplicate and trailing slashes
+ * are ignored.
+ */
+uint32_t mnt_hash_path(const char *p)
+{
+	uint32_t h = 2166136261U;
+
+	for (; *p; p++) {
+		if (*p == '/' && (*(p + 1) == '/' || *(p + 1) == '\0'))
+			continue;
+		h = (h ^ (unsigned char) *p) * 16777619U;
+	}
+	return h;
+}
+
 /**
  * mnt_tag_is_valid:
  * @tag: NAME=value string
@@ -115,15 +132,6 @@ int mnt_parse_offset(const char *str, size_t len, uintmax_t *res)
 	return rc;
 }
 
-/* used as a callback by bsearch in mnt_fstype_is_pseudofs() */
-static int fstype_cmp(const void *v1, const void *v2)
-{
-	const char *s1 = *(char * const *)v1;
-	const char *s2 = *(char * const *)v2;
-
-	return strcmp(s1, s2);
-}
-
 int mnt_stat_mountpoint(const char *target, struct stat *st)
 {
 #ifdef AT_NO_AUTOMOUNT
@@ -260,6 +268,127 @@ char *mnt_unmangle(const char *str)
 	return unmangle(str, NULL);
 }
 
+/*
+ * Filesystem types classification. The table is hashed into fstype_hash[] on
+ * the first use, so the classification is one hash and usually one strcmp()
+ * for every mnt_fs_set_fstype() call.
+ */
+struct fstype_class {
+	const char	*name;
+	int		flags;		/* MNT_FSTYPE_* */
+};
+
+static const struct fstype_class fstype_classes[] = {
+	{ "anon_inodefs",	MNT_FSTYPE_PSEUDO },
+	{ "autofs",		MNT_FSTYPE_PSEUDO },
+	{ "bdev",		MNT_FSTYPE_PSEUDO },
+	{ "binfmt_misc",	MNT_FSTYPE_PSEUDO },
+	{ "bpf",		MNT_FSTYPE_PSEUDO },
+	{ "cgroup",		MNT_FSTYPE_PSEUDO },
+	{ "cgroup2",		MNT_FSTYPE_PSEUDO },
+	{ "configfs",		MNT_FSTYPE_PSEUDO },
+	{ "cpuset",		MNT_FSTYPE_PSEUDO },
+	{ "debugfs",		MNT_FSTYPE_PSEUDO },
+	{ "devfs",		MNT_FSTYPE_PSEUDO },
+	{ "devpts",		MNT_FSTYPE_PSEUDO },
+	{ "devtmpfs",		MNT_FSTYPE_PSEUDO },
+	{ "dlmfs",		MNT_FSTYPE_PSEUDO },
+	{ "efivarfs",		MNT_FSTYPE_PSEUDO },
+	{ "fuse",		MNT_FSTYPE_PSEUDO },	/* Fallback name of fuse used by many poorly written drivers. */
+	{ "fuse.archivemount",	MNT_FSTYPE_PSEUDO },	/* Not a true pseudofs (has source), but source is not reported. */
+	{ "fuse.avfsd",		MNT_FSTYPE_PSEUDO },	/* Not a true pseudofs (has source), but source is not reported. */
+	{ "fuse.dumpfs",	MNT_FSTYPE_PSEUDO },	/* In fact, it is a netfs, but source is not reported. */
+	{ "fuse.encfs",		MNT_FSTYPE_PSEUDO },	/* Not a true pseudofs (has source), but source is not reported. */
+	{ "fuse.gvfs-fuse-daemon", MNT_FSTYPE_PSEUDO },	/* Old name, not used by gvfs any more. */
+	{ "fuse.gvfsd-fuse",	MNT_FSTYPE_PSEUDO },
+	{ "fuse.lxcfs",		MNT_FSTYPE_PSEUDO },
+	{ "fuse.rofiles-fuse",	MNT_FSTYPE_PSEUDO },
+	{ "fuse.vmware-vmblock", MNT_FSTYPE_PSEUDO },
+	{ "fuse.xwmfs",		MNT_FSTYPE_PSEUDO },
+	{ "fusectl",		MNT_FSTYPE_PSEUDO },
+	{ "hugetlbfs",		MNT_FSTYPE_PSEUDO },
+	{ "mqueue",		MNT_FSTYPE_PSEUDO },
+	{ "nfsd",		MNT_FSTYPE_PSEUDO },
+	{ "none",		MNT_FSTYPE_PSEUDO },
+	{ "nsfs",		MNT_FSTYPE_PSEUDO },
+	{ "overlay",		MNT_FSTYPE_PSEUDO },
+	{ "pipefs",		MNT_FSTYPE_PSEUDO },
+	{ "proc",		MNT_FSTYPE_PSEUDO },
+	{ "pstore",		MNT_FSTYPE_PSEUDO },
+	{ "ramfs",		MNT_FSTYPE_PSEUDO },
+	{ "rootfs",		MNT_FSTYPE_PSEUDO },
+	{ "rpc_pipefs",		MNT_FSTYPE_PSEUDO },
+	{ "securityfs",		MNT_FSTYPE_PSEUDO },
+	{ "selinuxfs",		MNT_FSTYPE_PSEUDO },
+	{ "sockfs",		MNT_FSTYPE_PSEUDO },
+	{ "spufs",		MNT_FSTYPE_PSEUDO },
+	{ "sysfs",		MNT_FSTYPE_PSEUDO },
+	{ "tmpfs",		MNT_FSTYPE_PSEUDO },
+
+	{ "afs",		MNT_FSTYPE_NET },
+	{ "cifs",		MNT_FSTYPE_NET },
+	{ "fuse.curlftpfs",	MNT_FSTYPE_NET },
+	{ "fuse.sshfs",		MNT_FSTYPE_NET },
+	{ "ncpfs",		MNT_FSTYPE_NET },
+	{ "smbfs",		MNT_FSTYPE_NET }
+};
+
+#define FSTYPE_HASH_SIZE	256	/* power of 2, at least 2x fstype_classes[] */
+
+static const struct fstype_class *fstype_hash[FSTYPE_HASH_SIZE];
+static pthread_once_t fstype_hash_once = PTHREAD_ONCE_INIT;
+
+/* FNV-1a */
+static unsigned int fstype_hashfn(const char *type)
+{
+	unsigned int h = 2166136261U;
+
+	for (; *type; type++) {
+		h ^= (unsigned char) *type;
+		h *= 16777619U;
+	}
+	return h & (FSTYPE_HASH_SIZE - 1);
+}
+
+static void init_fstype_hash(void)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(fstype_classes); i++) {
+		unsigned int h = fstype_hashfn(fstype_classes[i].name);
+
+		while (fstype_hash[h])
+			h = (h + 1) & (FSTYPE_HASH_SIZE - 1);
+		fstype_hash[h] = &fstype_classes[i];
+	}
+}
+
+/*
+ * Returns MNT_FSTYPE_* flags for the filesystem @type. Note that "nfsd" is
+ * pseudo filesystem as well as a network filesystem by the "nfs" prefix.
+ */
+int mnt_fstype_get_class(const char *type)
+{
+	const struct fstype_class *c;
+	unsigned int h;
+	int flags = 0;
+
+	assert(type);
+
+	pthread_once(&fstype_hash_once, init_fstype_hash);
+
+	for (h = fstype_hashfn(type); (c = fstype_hash[h]);
+	     h = (h + 1) & (FSTYPE_HASH_SIZE - 1)) {
+		if (strcmp(c->name, type) == 0) {
+			flags = c->flags;
+			break;
+		}
+	}
+	if (strncmp(type, "nfs", 3) == 0 || strncmp(type, "9p", 2) == 0)
+		flags |= MNT_FSTYPE_NET;
+	return flags;
+}
+
 /**
  * mnt_fstype_is_pseudofs:
  * @type: filesystem name
@@ -268,59 +397,7 @@ char *mnt_unmangle(const char *str)
  */
 int mnt_fstype_is_pseudofs(const char *type)
 {
-	/* This array must remain sorted when adding new fstypes */
-	static const char *pseudofs[] = {
-		"anon_inodefs",
-		"autofs",
-		"bdev",
-		"binfmt_misc",
-		"bpf",
-		"cgroup",
-		"cgroup2",
-		"configfs",
-		"cpuset",
-		"debugfs",
-		"devfs",
-		"devpts",
-		"devtmpfs",
-		"dlmfs",
-		"efivarfs",
-		"fuse", /* Fallback name of fuse used by many poorly written drivers. */
-		"fuse.archivemount", /* Not a true pseudofs (has source), but source is not reported. */
-		"fuse.avfsd", /* Not a true pseudofs (has source), but source is not reported. */
-		"fuse.dumpfs", /* In fact, it is a netfs, but source is not reported. */
-		"fuse.encfs", /* Not a true pseudofs (has source), but source is not reported. */
-		"fuse.gvfs-fuse-daemon", /* Old name, not used by gvfs any more. */
-		"fuse.gvfsd-fuse",
-		"fuse.lxcfs",
-		"fuse.rofiles-fuse",
-		"fuse.vmware-vmblock",
-		"fuse.xwmfs",
-		"fusectl",
-		"hugetlbfs",
-		"mqueue",
-		"nfsd",
-		"none",
-		"nsfs",
-		"overlay",
-		"pipefs",
-		"proc",
-		"pstore",
-		"ramfs",
-		"rootfs",
-		"rpc_pipefs",
-		"securityfs",
-		"selinuxfs",
-		"sockfs",
-		"spufs",
-		"sysfs",
-		"tmpfs"
-	};
-
-	assert(type);
-
-	return !(bsearch(&type, pseudofs, ARRAY_SIZE(pseudofs),
-				sizeof(char*), fstype_cmp) == NULL);
+	return mnt_fstype_get_class(type) & MNT_FSTYPE_PSEUDO ? 1 : 0;
 }
 
 /**
@@ -331,16 +408,7 @@ int mnt_fstype_is_pseudofs(const char *type)
  */
 int mnt_fstype_is_netfs(const char *type)
 {
-	if (strcmp(type, "cifs")   == 0 ||
-	    strcmp(type, "smbfs")  == 0 ||
-	    strncmp(type,"nfs", 3) == 0 ||
-	    strcmp(type, "afs")    == 0 ||
-	    strcmp(type, "ncpfs")  == 0 ||
-	    strcmp(type, "fuse.curlftpfs") == 0 ||
-	    strcmp(type, "fuse.sshfs") == 0 ||
-	    strncmp(type,"9p", 2)  == 0)
-		return 1;
-	return 0;
+	return mnt_fstype_get_class(type) & MNT_FSTYPE_NET ? 1 : 0;
 }
 
 const char *mnt_statfs_get_fstype(struct statfs *vfs)
@@ -506,40 +574,170 @@ err:
 	return -ENOMEM;
 }
 
-static int get_filesystems(const char *filename, char ***filesystems, const char *pattern)
+/*
+ * Parses the list of the filesystems in /etc/filesystems or /proc/filesystems
+ * format. Returns 1 if the list is terminated by "*" line.
+ */
+static int parse_filesystems(const char *buf, char ***filesystems)
 {
+	const char *line, *next;
 	int rc = 0;
-	FILE *f;
-	char line[129];
-
-	f = fopen(filename, "r" UL_CLOEXECSTR);
-	if (!f)
-		return 1;
 
-	DBG(UTILS, ul_debug("reading filesystems list from: %s", filename));
+	for (line = buf; line && *line; line = next) {
+		char name[129];
+		size_t sz;
 
-	while (fgets(line, sizeof(line), f)) {
-		char name[sizeof(line)];
+		next = strchr(line, '\n');
+		if (next)
+			next++;
 
 		if (*line == '#' || strncmp(line, "nodev", 5) == 0)
 			continue;
-		if (sscanf(line, " %128[^\n ]\n", name) != 1)
-			continue;
-		if (strcmp(name, "*") == 0) {
-			rc = 1;
-			break;		/* end of the /etc/filesystems */
-		}
-		if (pattern && !mnt_match_fstype(name, pattern))
+		line = skip_blank(line);
+		sz = strcspn(line, " \t\n");
+		if (!sz)
 			continue;
+		if (sz >= sizeof(name))
+			sz = sizeof(name) - 1;
+		memcpy(name, line, sz);
+		name[sz] = '\0';
+
+		if (strcmp(name, "*") == 0)
+			return 1;	/* end of the /etc/filesystems */
 		rc = add_filesystem(filesystems, name);
 		if (rc)
 			break;
 	}
-
-	fclose(f);
 	return rc;
 }
 
+/* returns NULL and errno if the file cannot be read */
+static char *read_filesystems_file(const char *filename)
+{
+	char *buf = NULL;
+	size_t bufsz = 0, len = 0;
+	int fd;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	DBG(UTILS, ul_debug("reading filesystems list from: %s", filename));
+
+	for (;;) {
+		ssize_t ret;
+
+		if (len + 1 >= bufsz) {
+			char *tmp;
+
+			bufsz = bufsz ? bufsz * 2 : 4096;
+			tmp = realloc(buf, bufsz);
+			if (!tmp)
+				goto err;
+			buf = tmp;
+		}
+		ret = read(fd, buf + len, bufsz - len - 1);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			goto err;
+		}
+		if (ret == 0)
+			break;
+		len += ret;
+	}
+	close(fd);
+	buf[len] = '\0';
+	return buf;
+err:
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+/*
+ * The list of the filesystems is cached per process, the cache is verified
+ * by stat() of /etc/filesystems and by comparison of /proc/filesystems with
+ * the content used for the list (the file is small and the kernel does not
+ * provide anything better, the content changes when a module is loaded).
+ */
+static struct fslist_cache {
+	pthread_mutex_t	lock;
+	char		**list;		/* all filesystems, no pattern */
+	int		rc;		/* mnt_get_filesystems() return code */
+
+	struct stat	etc_st;		/* zeroized if /etc/filesystems missing */
+	char		*proc;		/* /proc/filesystems content */
+	unsigned int	valid : 1,
+			use_proc : 1;	/* list contains /proc/filesystems */
+} fslist = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int is_same_stat(const struct stat *a, const struct stat *b)
+{
+	return a->st_dev == b->st_dev
+	    && a->st_ino == b->st_ino
+	    && a->st_size == b->st_size
+	    && a->st_mtim.tv_sec == b->st_mtim.tv_sec
+	    && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+static int update_fslist_cache(void)
+{
+	struct stat st;
+	char *proc = NULL;
+	int rc = 1;
+
+	if (stat(_PATH_FILESYSTEMS, &st) != 0)
+		memset(&st, 0, sizeof(st));
+
+	if (fslist.valid && is_same_stat(&st, &fslist.etc_st)) {
+		if (!fslist.use_proc)
+			return 0;
+		proc = read_filesystems_file(_PATH_PROC_FILESYSTEMS);
+		if (proc ? fslist.proc && strcmp(proc, fslist.proc) == 0 : !fslist.proc) {
+			free(proc);
+			return 0;
+		}
+	}
+
+	DBG(UTILS, ul_debug("refreshing filesystems list"));
+
+	mnt_free_filesystems(fslist.list);
+	fslist.list = NULL;
+	fslist.valid = 0;
+	fslist.use_proc = 0;
+	fslist.etc_st = st;
+
+	if (st.st_ino) {
+		char *buf = read_filesystems_file(_PATH_FILESYSTEMS);
+
+		if (buf) {
+			rc = parse_filesystems(buf, &fslist.list);
+			free(buf);
+		}
+	}
+	if (rc == 1) {
+		fslist.use_proc = 1;
+		if (!proc)
+			proc = read_filesystems_file(_PATH_PROC_FILESYSTEMS);
+		if (proc)
+			rc = parse_filesystems(proc, &fslist.list);
+		if (rc == 1 && fslist.list)
+			rc = 0;		/* /proc/filesystems not found */
+	}
+	free(fslist.proc);
+	fslist.proc = proc;
+
+	if (rc < 0) {
+		/* add_filesystem() deallocates the list on error */
+		fslist.list = NULL;
+		return rc;
+	}
+	fslist.rc = rc;
+	fslist.valid = 1;
+	return 0;
+}
+
 /*
  * Always check the @filesystems pointer!
  *
@@ -553,6 +751,8 @@ static int get_filesystems(const char *filename, char ***filesystems, const char
  */
 int mnt_get_filesystems(char ***filesystems, const char *pattern)
 {
+	char **res = NULL, **p;
+	size_t n = 0;
 	int rc;
 
 	if (!filesystems)
@@ -560,15 +760,38 @@ int mnt_get_filesystems(char ***filesystems, const char *pattern)
 
 	*filesystems = NULL;
 
-	rc = get_filesystems(_PATH_FILESYSTEMS, filesystems, pattern);
-	if (rc != 1)
-		return rc;
+	pthread_mutex_lock(&fslist.lock);
+
+	rc = update_fslist_cache();
+	if (rc || fslist.rc || !fslist.list)
+		goto done;
 
-	rc = get_filesystems(_PATH_PROC_FILESYSTEMS, filesystems, pattern);
-	if (rc == 1 && *filesystems)
-		rc = 0;			/* /proc/filesystems not found */
+	for (p = fslist.list; *p; p++)
+		n++;
+	res = calloc(n + 1, sizeof(char *));
+	if (!res)
+		goto nomem;
 
+	for (n = 0, p = fslist.list; *p; p++) {
+		if (pattern && !mnt_match_fstype(*p, pattern))
+			continue;
+		res[n] = strdup(*p);
+		if (!res[n++])
+			goto nomem;
+	}
+	if (n)
+		*filesystems = res;
+	else
+		free(res);
+done:
+	if (!rc)
+		rc = fslist.rc;
+	pthread_mutex_unlock(&fslist.lock);
 	return rc;
+nomem:
+	mnt_free_filesystems(res);
+	pthread_mutex_unlock(&fslist.lock);
+	return -ENOMEM;
 }
 
 /*
@@ -882,6 +1105,19 @@ const char *mnt_get_utab_path(void)
 }
 
 
+/*
+ * Don't export this to libmount API -- the snapshot daemon is optional.
+ *
+ * Returns: path to the mount table snapshot daemon socket ($LIBMOUNT_SNAPSHOT)
+ *          or NULL.
+ */
+const char *mnt_get_snapshot_socket_path(void)
+{
+	const char *p = safe_getenv("LIBMOUNT_SNAPSHOT");
+
+	return p && *p ? p : NULL;
+}
+
 /* returns file descriptor or -errno, @name returns a unique filename
  */
 int mnt_open_uniq_filename(const char *filename, char **name)
@@ -1317,6 +1553,22 @@ static int test_match_fstype(struct libmnt_test *ts, int argc, char *argv[])
 	return 0;
 }
 
+static int test_fstype_class(struct libmnt_test *ts, int argc, char *argv[])
+{
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		int class = mnt_fstype_get_class(argv[i]);
+
+		printf("%s: %s%s%s\n", argv[i],
+			class & MNT_FSTYPE_PSEUDO ? "pseudo" : "",
+			class == (MNT_FSTYPE_PSEUDO | MNT_FSTYPE_NET) ? "," : "",
+			class & MNT_FSTYPE_NET ? "net" :
+			class ? "" : "-");
+	}
+	return 0;
+}
+
 static int test_match_options(struct libmnt_test *ts, int argc, char *argv[])
 {
 	char *optstr = argv[1];
@@ -1479,6 +1731,7 @@ int main(int argc, char *argv[])
 	struct libmnt_test tss[] = {
 	{ "--match-fstype",  test_match_fstype,    "<type> <pattern>     FS types matching" },
 	{ "--match-options", test_match_options,   "<options> <pattern>  options matching" },
+	{ "--fstype-class",  test_fstype_class,    "<type> [...]         pseudo/net FS classification" },
 	{ "--filesystems",   test_filesystems,	   "[<pattern>] list /{etc,proc}/filesystems" },
 	{ "--starts-with",   test_startswith,      "<string> <prefix>" },
 	{ "--ends-with",     test_endswith,        "<string> <prefix>" },
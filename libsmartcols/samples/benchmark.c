@@ -0,0 +1,518 @@
+/*
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * Builds a synthetic table and measures the library. The table is printed to
+ * /dev/null (or --output file) and the report is printed to stdout.
+ *
+ * The time of the first write to the output stream is the end of the
+ * preparation (width calculation etc.), because the library does not write
+ * anything before all column widths are known.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "c.h"
+#include "nls.h"
+#include "strutils.h"
+#include "xalloc.h"
+
+#include "libsmartcols.h"
+
+/*
+ * Allocation counter; the library functions are interposed by the program
+ * and the glibc internal functions are used for the real allocations.
+ */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+# define HAVE_ALLOC_COUNTER 1
+
+extern void *__libc_malloc(size_t sz);
+extern void *__libc_calloc(size_t n, size_t sz);
+extern void *__libc_realloc(void *p, size_t sz);
+extern void *__libc_memalign(size_t align, size_t sz);
+
+static size_t nallocs;
+
+void *malloc(size_t sz)
+{
+	nallocs++;
+	return __libc_malloc(sz);
+}
+
+void *calloc(size_t n, size_t sz)
+{
+	nallocs++;
+	return __libc_calloc(n, sz);
+}
+
+void *realloc(void *p, size_t sz)
+{
+	nallocs++;
+	return __libc_realloc(p, sz);
+}
+
+int posix_memalign(void **p, size_t align, size_t sz)
+{
+	nallocs++;
+	*p = __libc_memalign(align, sz);
+	return *p ? 0 : ENOMEM;
+}
+#endif /* __GLIBC__ */
+
+enum {
+	FMT_HUMAN = 0,
+	FMT_RAW,
+	FMT_JSON,
+	FMT_EXPORT,
+	FMT_CBOR
+};
+
+struct bench_ctl {
+	size_t	nlines;
+	size_t	ncolumns;
+	size_t	fanout;		/* tree children per line, 0 for list */
+	size_t	limit;		/* scols_table_set_limit() */
+	int	format;		/* FMT_* */
+
+	int	out_fd;
+	size_t	out_bytes;	/* bytes written to the output */
+	double	first_write;	/* time of the first write */
+
+	unsigned int	groups : 1,
+			wrap : 1,
+			utf8 : 1,
+			numbers : 1,
+			sort : 1,
+			stream : 1;
+};
+
+struct bench_phase {
+	const char	*name;
+	double		time;
+	size_t		nallocs;
+};
+
+static double get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t get_nallocs(void)
+{
+#ifdef HAVE_ALLOC_COUNTER
+	return nallocs;
+#else
+	return 0;
+#endif
+}
+
+static void phase_start(struct bench_phase *ph, const char *name)
+{
+	ph->name = name;
+	ph->time = get_time();
+	ph->nallocs = get_nallocs();
+}
+
+static void phase_end(struct bench_phase *ph)
+{
+	ph->time = get_time() - ph->time;
+	ph->nallocs = get_nallocs() - ph->nallocs;
+}
+
+/* output stream */
+static ssize_t bench_write(void *cookie, const char *buf, size_t sz)
+{
+	struct bench_ctl *ctl = cookie;
+	size_t done = 0;
+
+	if (!ctl->out_bytes)
+		ctl->first_write = get_time();
+	ctl->out_bytes += sz;
+
+	while (done < sz) {
+		ssize_t rc = write(ctl->out_fd, buf + done, sz - done);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += rc;
+	}
+	return sz;
+}
+
+static FILE *open_output(struct bench_ctl *ctl, const char *filename)
+{
+	cookie_io_functions_t io = { .write = bench_write };
+	FILE *f;
+
+	ctl->out_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (ctl->out_fd < 0)
+		err(EXIT_FAILURE, "cannot open %s", filename);
+
+	f = fopencookie(ctl, "w", io);
+	if (!f)
+		err(EXIT_FAILURE, "cannot open output stream");
+	return f;
+}
+
+static void setup_columns(struct bench_ctl *ctl, struct libscols_table *tb)
+{
+	size_t i;
+
+	for (i = 0; i < ctl->ncolumns; i++) {
+		struct libscols_column *cl;
+		char name[32];
+		int fl = 0;
+
+		if (i == 0)
+			xstrncpy(name, "NAME", sizeof(name));
+		else if (i == 1)
+			xstrncpy(name, "SIZE", sizeof(name));
+		else
+			snprintf(name, sizeof(name), "DATA%zu", i - 1);
+
+		if (i == 0 && (ctl->fanout || ctl->groups))
+			fl |= SCOLS_FL_TREE;
+		if (i == 1)
+			fl |= SCOLS_FL_RIGHT;
+		if (i + 1 == ctl->ncolumns && ctl->wrap)
+			fl |= SCOLS_FL_WRAP;
+
+		cl = scols_table_new_column(tb, name, 0, fl);
+		if (!cl)
+			err(EXIT_FAILURE, "failed to create output column");
+		if (i == 1) {
+			scols_column_set_json_type(cl, SCOLS_JSON_NUMBER);
+			scols_column_set_cmpfunc(cl, ctl->numbers ?
+					scols_cmpnum_cells : scols_cmpstr_cells, NULL);
+		}
+		if (ctl->stream && i + 1 < ctl->ncolumns)
+			scols_column_set_whint(cl, i == 0 ? 24 : 12);
+	}
+}
+
+static void set_line_data(struct bench_ctl *ctl, struct libscols_line *ln, size_t n)
+{
+	size_t i;
+	char buf[256];
+
+	for (i = 0; i < ctl->ncolumns; i++) {
+		int rc;
+
+		if (i == 0)
+			snprintf(buf, sizeof(buf), ctl->utf8 ? "název-žluťoučký-%zu" :
+							       "name-%zu", n);
+		else if (i == 1) {
+			uint64_t x = (n * 2654435761U) % 1000000007;
+
+			if (ctl->numbers) {
+				rc = scols_cell_set_u64(scols_line_get_cell(ln, i), x);
+				if (rc)
+					goto fail;
+				continue;
+			}
+			snprintf(buf, sizeof(buf), "%" PRIu64, x);
+		} else if (i + 1 == ctl->ncolumns && ctl->wrap)
+			snprintf(buf, sizeof(buf), "Lorem ipsum dolor sit amet, consectetur "
+					"adipiscing elit, sed do eiusmod tempor incididunt ut "
+					"labore et dolore magna aliqua %zu", n);
+		else
+			snprintf(buf, sizeof(buf), ctl->utf8 ? "/sys/zařízení/%zu/příliš-%zu" :
+							       "/sys/devices/%zu/data-%zu",
+					n % 1000, i - 1);
+
+		rc = scols_line_set_data(ln, i, buf);
+		if (rc)
+			goto fail;
+	}
+	return;
+fail:
+	err(EXIT_FAILURE, "failed to set output data");
+}
+
+static void build_table(struct bench_ctl *ctl, struct libscols_table *tb)
+{
+	struct libscols_line **lines = NULL, *member = NULL;
+	size_t i;
+
+	if (ctl->fanout)
+		lines = xcalloc(ctl->nlines, sizeof(*lines));
+
+	for (i = 0; i < ctl->nlines; i++) {
+		struct libscols_line *ln, *parent = NULL;
+		size_t grp = i % 16;
+
+		/* every 16th line starts group with two members and one child */
+		if (ctl->groups && grp == 2) {
+			ln = scols_table_new_line(tb, NULL);
+			if (ln && scols_line_link_group(ln, member, 0))
+				err(EXIT_FAILURE, "failed to link group");
+		} else {
+			if (ctl->fanout && i && !(ctl->groups && grp < 3))
+				parent = lines[(i - 1) / ctl->fanout];
+			ln = scols_table_new_line(tb, parent);
+		}
+		if (!ln)
+			err(EXIT_FAILURE, "failed to create output line");
+
+		if (ctl->groups && grp == 0)
+			member = ln;
+		else if (ctl->groups && grp == 1
+			 && scols_table_group_lines(tb, ln, member, 0))
+			err(EXIT_FAILURE, "failed to group lines");
+
+		if (lines)
+			lines[i] = ln;
+		set_line_data(ctl, ln, i);
+	}
+	free(lines);
+}
+
+static void print_report(struct bench_ctl *ctl, struct bench_phase *phases,
+			 size_t nphases, double prepare)
+{
+	struct libscols_table *tb;
+	struct rusage ru;
+	size_t i;
+
+	tb = scols_new_table();
+	if (!tb)
+		err(EXIT_FAILURE, "failed to create output table");
+
+	if (!scols_table_new_column(tb, "PHASE", 0, 0) ||
+	    !scols_table_new_column(tb, "TIME", 0, SCOLS_FL_RIGHT) ||
+	    !scols_table_new_column(tb, "ALLOCS", 0, SCOLS_FL_RIGHT))
+		err(EXIT_FAILURE, "failed to create output column");
+
+	for (i = 0; i < nphases; i++) {
+		struct libscols_line *ln = scols_table_new_line(tb, NULL);
+		char buf[32];
+
+		if (!ln)
+			err(EXIT_FAILURE, "failed to create output line");
+
+		scols_line_set_data(ln, 0, phases[i].name);
+		snprintf(buf, sizeof(buf), "%.3fs", phases[i].time);
+		scols_line_set_data(ln, 1, buf);
+#ifdef HAVE_ALLOC_COUNTER
+		scols_cell_set_u64(scols_line_get_cell(ln, 2), phases[i].nallocs);
+#endif
+		/* the first write is the end of width calculation */
+		if (prepare >= 0 && strcmp(phases[i].name, "print") == 0) {
+			ln = scols_table_new_line(tb, NULL);
+			if (!ln)
+				err(EXIT_FAILURE, "failed to create output line");
+			scols_line_set_data(ln, 0, " calculate");
+			snprintf(buf, sizeof(buf), "%.3fs", prepare);
+			scols_line_set_data(ln, 1, buf);
+		}
+	}
+
+	printf("lines: %zu, columns: %zu, output: %zu bytes\n",
+			ctl->nlines, ctl->ncolumns, ctl->out_bytes);
+	scols_print_table(tb);
+	scols_unref_table(tb);
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		printf("peak RSS: %ld KiB\n", ru.ru_maxrss);
+}
+
+static int parse_format(const char *str)
+{
+	static const char *formats[] = {
+		[FMT_HUMAN] = "human",
+		[FMT_RAW] = "raw",
+		[FMT_JSON] = "json",
+		[FMT_EXPORT] = "export",
+		[FMT_CBOR] = "cbor"
+	};
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(formats); i++) {
+		if (strcmp(str, formats[i]) == 0)
+			return i;
+	}
+	errx(EXIT_FAILURE, "unsupported format: %s", str);
+}
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	FILE *out = stdout;
+	fprintf(out,
+		"\n %s [options]\n\n", program_invocation_short_name);
+
+	fputs(" -n, --nlines <num>             number of lines (default 100000)\n", out);
+	fputs(" -c, --ncolumns <num>           number of columns (default 6)\n", out);
+	fputs(" -t, --tree <num>               tree with <num> children per line\n", out);
+	fputs(" -g, --groups                   add lines groups\n", out);
+	fputs(" -w, --wrap                     wrap the last column (terminal width 120)\n", out);
+	fputs(" -u, --utf8                     use multibyte data\n", out);
+	fputs(" -N, --numbers                  use binary numbers for SIZE column\n", out);
+	fputs(" -s, --sort                     sort by SIZE column\n", out);
+	fputs(" -l, --limit <num>              print only first lines\n", out);
+	fputs(" -S, --stream                   streaming output\n", out);
+	fputs(" -f, --format <name>            human, raw, json, export or cbor\n", out);
+	fputs(" -o, --output <file>            write table to file (default /dev/null)\n", out);
+	fputs(" -h, --help                     this help\n", out);
+	fputs("\n", out);
+
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_ctl ctl = { .nlines = 100000, .ncolumns = 6 };
+	struct bench_phase phases[4];
+	struct libscols_table *tb;
+	const char *outfile = "/dev/null";
+	size_t nphases = 0;
+	double prepare = -1, start;
+	FILE *out;
+	int c;
+
+	static const struct option longopts[] = {
+		{ "nlines",   1, NULL, 'n' },
+		{ "ncolumns", 1, NULL, 'c' },
+		{ "tree",     1, NULL, 't' },
+		{ "groups",   0, NULL, 'g' },
+		{ "wrap",     0, NULL, 'w' },
+		{ "utf8",     0, NULL, 'u' },
+		{ "numbers",  0, NULL, 'N' },
+		{ "sort",     0, NULL, 's' },
+		{ "limit",    1, NULL, 'l' },
+		{ "stream",   0, NULL, 'S' },
+		{ "format",   1, NULL, 'f' },
+		{ "output",   1, NULL, 'o' },
+		{ "help",     0, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+
+	setlocale(LC_ALL, "");	/* just to have enable UTF8 chars */
+	scols_init_debug(0);
+
+	while((c = getopt_long(argc, argv, "c:f:ghl:Nn:o:Sst:uw", longopts, NULL)) != -1) {
+		switch(c) {
+		case 'n':
+			ctl.nlines = strtosize_or_err(optarg, "failed to parse number of lines");
+			break;
+		case 'c':
+			ctl.ncolumns = strtou32_or_err(optarg, "failed to parse number of columns");
+			if (ctl.ncolumns < 2)
+				errx(EXIT_FAILURE, "at least two columns required");
+			break;
+		case 't':
+			ctl.fanout = strtou32_or_err(optarg, "failed to parse number of children");
+			break;
+		case 'g':
+			ctl.groups = 1;
+			break;
+		case 'w':
+			ctl.wrap = 1;
+			break;
+		case 'u':
+			ctl.utf8 = 1;
+			break;
+		case 'N':
+			ctl.numbers = 1;
+			break;
+		case 's':
+			ctl.sort = 1;
+			break;
+		case 'l':
+			ctl.limit = strtosize_or_err(optarg, "failed to parse limit");
+			break;
+		case 'S':
+			ctl.stream = 1;
+			break;
+		case 'f':
+			ctl.format = parse_format(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'h':
+			usage();
+		default:
+			errtryhelp(EXIT_FAILURE);
+		}
+	}
+
+	/* streamed lines are printed when added to the table */
+	if (ctl.stream && (ctl.fanout || ctl.groups || (ctl.sort && !ctl.limit)))
+		errx(EXIT_FAILURE, "--stream is not supported for tree, groups or sort");
+
+	out = open_output(&ctl, outfile);
+
+	tb = scols_new_table();
+	if (!tb)
+		err(EXIT_FAILURE, "failed to create output table");
+
+	scols_table_set_stream(tb, out);
+	switch (ctl.format) {
+	case FMT_RAW:
+		scols_table_enable_raw(tb, 1);
+		break;
+	case FMT_JSON:
+		scols_table_enable_json(tb, 1);
+		break;
+	case FMT_EXPORT:
+		scols_table_enable_export(tb, 1);
+		break;
+	case FMT_CBOR:
+		scols_table_enable_cbor(tb, 1);
+		break;
+	}
+	if (ctl.format == FMT_JSON || ctl.format == FMT_CBOR)
+		scols_table_set_name(tb, "benchmark");
+	if (ctl.wrap) {
+		scols_table_set_termforce(tb, SCOLS_TERMFORCE_ALWAYS);
+		scols_table_set_termwidth(tb, 120);
+	}
+	if (ctl.stream)
+		scols_table_enable_streaming(tb, 1);
+
+	setup_columns(&ctl, tb);
+
+	/* the lines are selected when added and sorted before print */
+	if (ctl.limit && scols_table_set_limit(tb, ctl.limit,
+			ctl.sort ? scols_table_get_column(tb, 1) : NULL))
+		err(EXIT_FAILURE, "failed to set limit");
+
+	phase_start(&phases[nphases], ctl.stream ? "build+print" : "build");
+	build_table(&ctl, tb);
+	phase_end(&phases[nphases++]);
+
+	if (ctl.sort && !ctl.limit) {
+		phase_start(&phases[nphases], "sort");
+		scols_sort_table(tb, scols_table_get_column(tb, 1));
+		phase_end(&phases[nphases++]);
+	}
+
+	phase_start(&phases[nphases], "print");
+	start = phases[nphases].time;
+	scols_print_table(tb);
+	fflush(out);
+	phase_end(&phases[nphases++]);
+	if (!ctl.stream && ctl.out_bytes)
+		prepare = ctl.first_write - start;
+
+	phase_start(&phases[nphases], "free");
+	scols_unref_table(tb);
+	phase_end(&phases[nphases++]);
+
+	fclose(out);
+	print_report(&ctl, phases, nphases, prepare);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+/*
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "c.h"
+#include "nls.h"
+#include "strutils.h"
+#include "xalloc.h"
+
+#include "libsmartcols.h"
+
+enum { COL_NAME, COL_SIZE, COL_PATH };
+
+static const char *colnames[] = { "NAME", "SIZE", "PATH" };
+
+/* number of datafunc() calls for each column */
+static size_t ncalls[ARRAY_SIZE(colnames)];
+
+static char *get_size(struct libscols_column *cl __attribute__((__unused__)),
+		      struct libscols_line *ln,
+		      void *data __attribute__((__unused__)))
+{
+	size_t i = (size_t) scols_line_get_userdata(ln);
+	char *str = NULL;
+
+	ncalls[COL_SIZE]++;
+	xasprintf(&str, "%zu", (i * 7919) % 1000);
+	return str;
+}
+
+static char *get_path(struct libscols_column *cl __attribute__((__unused__)),
+		      struct libscols_line *ln,
+		      void *data)
+{
+	size_t i = (size_t) scols_line_get_userdata(ln);
+	char *str = NULL;
+
+	ncalls[COL_PATH]++;
+
+	/* every third line has no path */
+	if (i % 3 == 0)
+		return NULL;
+	xasprintf(&str, "%s/dev%zu", (char *) data, i);
+	return str;
+}
+
+static void setup_columns(struct libscols_table *tb, int hide)
+{
+	struct libscols_column *cl;
+
+	if (!scols_table_new_column(tb, "NAME", 0, 0))
+		goto fail;
+
+	cl = scols_table_new_column(tb, "SIZE", 0, SCOLS_FL_RIGHT
+				| (hide == COL_SIZE ? SCOLS_FL_HIDDEN : 0));
+	if (!cl)
+		goto fail;
+	scols_column_set_datafunc(cl, get_size, NULL);
+	scols_column_set_cmpfunc(cl, scols_cmpstr_cells, NULL);
+
+	cl = scols_table_new_column(tb, "PATH", 0,
+				hide == COL_PATH ? SCOLS_FL_HIDDEN : 0);
+	if (!cl)
+		goto fail;
+	scols_column_set_datafunc(cl, get_path, "/sys");
+	scols_column_set_cmpfunc(cl, scols_cmpstr_cells, NULL);
+	return;
+fail:
+	err(EXIT_FAILURE, "failed to create output column");
+}
+
+static void add_line(struct libscols_table *tb, size_t i)
+{
+	struct libscols_line *ln = scols_table_new_line(tb, NULL);
+	char buf[32];
+
+	if (!ln)
+		err(EXIT_FAILURE, "failed to create output line");
+
+	scols_line_set_userdata(ln, (void *) i);
+
+	snprintf(buf, sizeof(buf), "line-%zu", i);
+	if (scols_line_set_data(ln, COL_NAME, buf))
+		err(EXIT_FAILURE, "failed to set output data");
+
+	/* the data from application are not overwritten by datafunc() */
+	if (i == 4 && scols_line_set_data(ln, COL_PATH, "static"))
+		err(EXIT_FAILURE, "failed to set output data");
+}
+
+static int get_column_id(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(colnames); i++) {
+		if (strcmp(colnames[i], name) == 0)
+			return i;
+	}
+	errx(EXIT_FAILURE, "%s: unknown column", name);
+}
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	FILE *out = stdout;
+	fprintf(out,
+		"\n %s [options]\n\n", program_invocation_short_name);
+
+	fputs(" -H, --hide <column>            hide column\n", out);
+	fputs(" -s, --sort <column>            sort by column\n", out);
+	fputs(" -n, --nlines <num>             number of lines\n", out);
+	fputs(" -S, --stream                   streaming output\n", out);
+	fputs(" -J, --json                     JSON output format\n", out);
+	fputs(" -h, --help                     this help\n", out);
+	fputs("\n", out);
+
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct libscols_table *tb;
+	int c, hide = -1, sort = -1;
+	size_t i, nlines = 10;
+
+	static const struct option longopts[] = {
+		{ "hide",    1, NULL, 'H' },
+		{ "sort",    1, NULL, 's' },
+		{ "nlines",  1, NULL, 'n' },
+		{ "stream",  0, NULL, 'S' },
+		{ "json",    0, NULL, 'J' },
+		{ "help",    0, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+
+	scols_init_debug(0);
+
+	tb = scols_new_table();
+	if (!tb)
+		err(EXIT_FAILURE, "failed to create output table");
+
+	while((c = getopt_long(argc, argv, "hH:Jn:s:S", longopts, NULL)) != -1) {
+		switch(c) {
+		case 'H':
+			hide = get_column_id(optarg);
+			break;
+		case 's':
+			sort = get_column_id(optarg);
+			break;
+		case 'n':
+			nlines = strtou32_or_err(optarg, "failed to parse number of lines");
+			break;
+		case 'S':
+			scols_table_enable_streaming(tb, 1);
+			break;
+		case 'J':
+			scols_table_enable_json(tb, 1);
+			scols_table_set_name(tb, "lines");
+			break;
+		case 'h':
+			usage();
+		default:
+			errtryhelp(EXIT_FAILURE);
+		}
+	}
+
+	if (scols_table_is_streaming(tb)) {
+		/* all columns, except the last one, need width hint */
+		scols_table_enable_noheadings(tb, 1);
+		scols_table_enable_raw(tb, 1);
+	}
+
+	setup_columns(tb, hide);
+
+	for (i = 0; i < nlines; i++)
+		add_line(tb, i);
+
+	if (sort >= 0)
+		scols_sort_table(tb, scols_table_get_column(tb, sort));
+
+	scols_print_table(tb);
+	scols_unref_table(tb);
+
+	printf("calls: SIZE=%zu PATH=%zu\n", ncalls[COL_SIZE], ncalls[COL_PATH]);
+	return EXIT_SUCCESS;
+}
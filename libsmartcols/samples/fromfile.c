@@ -209,6 +209,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(" -c, --column <file>            column definition\n", out);
 	fputs(" -n, --nlines <num>             number of lines\n", out);
 	fputs(" -J, --json                     JSON output format\n", out);
+	fputs(" -B, --cbor                     CBOR output format\n", out);
 	fputs(" -r, --raw                      RAW output format\n", out);
 	fputs(" -E, --export                   use key=\"value\" output format\n", out);
 	fputs(" -C, --colsep <str>             set columns separator\n", out);
@@ -236,6 +237,7 @@ int main(int argc, char *argv[])
 		{ "tree-parent-column", 1, NULL, 'p' },
 		{ "tree-id-column",	1, NULL, 'i' },
 		{ "json",   0, NULL, 'J' },
+		{ "cbor",   0, NULL, 'B' },
 		{ "raw",    0, NULL, 'r' },
 		{ "export", 0, NULL, 'E' },
 		{ "colsep",  1, NULL, 'C' },
@@ -244,7 +246,7 @@ int main(int argc, char *argv[])
 	};
 
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
-		{ 'E', 'J', 'r' },
+		{ 'B', 'E', 'J', 'r' },
 		{ 'M', 'm' },
 		{ 0 }
 	};
@@ -257,7 +259,7 @@ int main(int argc, char *argv[])
 	if (!tb)
 		err(EXIT_FAILURE, "failed to create output table");
 
-	while((c = getopt_long(argc, argv, "hCc:Ei:JMmn:p:rw:", longopts, NULL)) != -1) {
+	while((c = getopt_long(argc, argv, "BhCc:Ei:JMmn:p:rw:", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -286,6 +288,10 @@ int main(int argc, char *argv[])
 			scols_table_enable_json(tb, 1);
 			scols_table_set_name(tb, "testtable");
 			break;
+		case 'B':
+			scols_table_enable_cbor(tb, 1);
+			scols_table_set_name(tb, "testtable");
+			break;
 		case 'm':
 			scols_table_enable_maxout(tb, TRUE);
 			break;
@@ -0,0 +1,186 @@
+/*
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "c.h"
+#include "nls.h"
+#include "strutils.h"
+
+#include "libsmartcols.h"
+
+enum { COL_NAME, COL_U64, COL_S64, COL_FLOAT };
+
+static const char *colnames[] = { "NAME", "U64", "S64", "FLOAT" };
+
+/* the same as scols_cmpnum_cells(), but forces list_sort() in the library */
+static int cmp_cells(struct libscols_cell *a,
+		     struct libscols_cell *b,
+		     void *data)
+{
+	return scols_cmpnum_cells(a, b, data);
+}
+
+static void setup_columns(struct libscols_table *tb)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(colnames); i++) {
+		struct libscols_column *cl = scols_table_new_column(tb,
+					colnames[i], 0, i ? SCOLS_FL_RIGHT : 0);
+		if (!cl)
+			err(EXIT_FAILURE, "failed to create output column");
+	}
+}
+
+static void add_line(struct libscols_table *tb, unsigned int i, unsigned int x)
+{
+	struct libscols_line *ln = scols_table_new_line(tb, NULL);
+	char buf[32];
+
+	if (!ln)
+		err(EXIT_FAILURE, "failed to create output line");
+
+	snprintf(buf, sizeof(buf), "line-%u", i);
+	if (scols_line_set_data(ln, COL_NAME, buf))
+		goto fail;
+
+	/* every 7th line has no numbers */
+	if (x % 7 == 0)
+		return;
+
+	/* formatted by library */
+	if (scols_cell_set_u64(scols_line_get_cell(ln, COL_U64),
+				(uint64_t) x * 1000003 % 100000000000ULL))
+		goto fail;
+	if (scols_cell_set_s64(scols_line_get_cell(ln, COL_S64),
+				(int64_t) (x % 2001) - 1000))
+		goto fail;
+
+	if (scols_cell_set_float(scols_line_get_cell(ln, COL_FLOAT),
+				((double) (x % 1999) - 999.0) / 8))
+		goto fail;
+
+	/* string is independent on the number */
+	if (x % 2) {
+		snprintf(buf, sizeof(buf), "<%u>", x % 1999);
+		if (scols_line_set_data(ln, COL_FLOAT, buf))
+			goto fail;
+	}
+	return;
+fail:
+	err(EXIT_FAILURE, "failed to set output data");
+}
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	FILE *out = stdout;
+	fprintf(out,
+		"\n %s [options]\n\n", program_invocation_short_name);
+
+	fputs(" -s, --sort <column>            sort by column\n", out);
+	fputs(" -c, --cmpfunc                  sort by compare function\n", out);
+	fputs(" -n, --nlines <num>             number of lines\n", out);
+	fputs(" -l, --limit <num>              print only first lines\n", out);
+	fputs(" -S, --stream                   streaming output\n", out);
+	fputs(" -J, --json                     JSON output format\n", out);
+	fputs(" -B, --cbor                     CBOR output format\n", out);
+	fputs(" -h, --help                     this help\n", out);
+	fputs("\n", out);
+
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct libscols_table *tb;
+	struct libscols_column *sort = NULL;
+	const char *sortname = NULL;
+	unsigned int i, x, nlines = 20, limit = 0;
+	int c, cmpfunc = 0;
+
+	static const struct option longopts[] = {
+		{ "sort",    1, NULL, 's' },
+		{ "cmpfunc", 0, NULL, 'c' },
+		{ "nlines",  1, NULL, 'n' },
+		{ "limit",   1, NULL, 'l' },
+		{ "stream",  0, NULL, 'S' },
+		{ "json",    0, NULL, 'J' },
+		{ "cbor",    0, NULL, 'B' },
+		{ "help",    0, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+
+	scols_init_debug(0);
+
+	tb = scols_new_table();
+	if (!tb)
+		err(EXIT_FAILURE, "failed to create output table");
+
+	while((c = getopt_long(argc, argv, "BchJl:n:Ss:", longopts, NULL)) != -1) {
+		switch(c) {
+		case 's':
+			sortname = optarg;
+			break;
+		case 'c':
+			cmpfunc = 1;
+			break;
+		case 'n':
+			nlines = strtou32_or_err(optarg, "failed to parse number of lines");
+			break;
+		case 'l':
+			limit = strtou32_or_err(optarg, "failed to parse limit");
+			break;
+		case 'S':
+			scols_table_enable_streaming(tb, 1);
+			break;
+		case 'J':
+			scols_table_enable_json(tb, 1);
+			scols_table_set_name(tb, "numbers");
+			break;
+		case 'B':
+			scols_table_enable_cbor(tb, 1);
+			scols_table_set_name(tb, "numbers");
+			break;
+		case 'h':
+			usage();
+		default:
+			errtryhelp(EXIT_FAILURE);
+		}
+	}
+
+	setup_columns(tb);
+
+	if (sortname) {
+		for (i = 0; i < ARRAY_SIZE(colnames); i++) {
+			if (strcmp(colnames[i], sortname) == 0)
+				sort = scols_table_get_column(tb, i);
+		}
+		if (!sort)
+			errx(EXIT_FAILURE, "%s: unknown column", sortname);
+
+		scols_column_set_cmpfunc(sort,
+				cmpfunc ? cmp_cells : scols_cmpnum_cells, NULL);
+	}
+
+	/* the lines are sorted by the library before print */
+	if (limit && scols_table_set_limit(tb, limit, sort))
+		err(EXIT_FAILURE, "failed to set limit");
+
+	/* deterministic pseudo-random numbers */
+	for (i = 0, x = 12345; i < nlines; i++) {
+		x = x * 1103515245 + 12345;
+		add_line(tb, i, (x >> 8) & 0xffffff);
+	}
+
+	if (sort && !limit)
+		scols_sort_table(tb, sort);
+
+	scols_print_table(tb);
+	scols_unref_table(tb);
+	return EXIT_SUCCESS;
+}
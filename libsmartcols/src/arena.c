@@ -0,0 +1,255 @@
+/*
+ * arena.c - table memory pool for lines, cells and cell strings
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * The arena is private for the library and owned by the table; every line
+ * allocated from the arena keeps a reference to it, so the memory is valid
+ * as long as any line exists.
+ *
+ * There are three kinds of memory:
+ *
+ * - chunks; cell arrays and cell data are allocated from ARENA_CHUNKSZ big
+ *   and ARENA_CHUNKSZ aligned chunks. The chunk header is found by the
+ *   pointer alignment, and every chunk counts live allocations. The chunk
+ *   is deallocated when the count falls to zero, so removed lines (e.g.
+ *   streaming or continuous output) do not waste the memory for ever.
+ *
+ * - slabs; the line structs are allocated in arrays, the unused lines are
+ *   kept in a free list and reused.
+ *
+ * - interned strings; colors are usually the same for many cells, so
+ *   the arena keeps one copy of each color for the whole table.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "smartcolsP.h"
+
+#define ARENA_CHUNKSZ		(64 * 1024)
+#define ARENA_MAXALLOC		(ARENA_CHUNKSZ / 8)	/* bigger requests use malloc() */
+#define ARENA_SLABSZ		64			/* lines per slab */
+#define ARENA_MAXCOLORS		32			/* max number of interned colors */
+
+struct arena_chunk {
+	struct libscols_arena	*arena;
+	struct list_head	chunks;		/* member of arena->chunks */
+	size_t			nlive;		/* number of allocations in use */
+	size_t			used;		/* bytes used (incl. header) */
+};
+
+struct arena_slab {
+	struct arena_slab	*next;
+	struct libscols_line	lines[ARENA_SLABSZ];
+};
+
+struct libscols_arena {
+	int			refcount;
+
+	struct list_head	chunks;		/* all chunks */
+	struct arena_chunk	*cur;		/* chunk for new allocations */
+
+	struct arena_slab	*slabs;
+	struct libscols_line	*free_lines;	/* linked by ln->parent */
+
+	char			*colors[ARENA_MAXCOLORS];
+	size_t			ncolors;
+};
+
+#define arena_chunk_of(_p) \
+	((struct arena_chunk *) ((uintptr_t) (_p) & ~((uintptr_t) ARENA_CHUNKSZ - 1)))
+
+struct libscols_arena *new_arena(void)
+{
+	struct libscols_arena *ar = calloc(1, sizeof(*ar));
+
+	if (!ar)
+		return NULL;
+
+	ar->refcount = 1;
+	INIT_LIST_HEAD(&ar->chunks);
+
+	DBG(ARENA, ul_debugobj(ar, "alloc"));
+	return ar;
+}
+
+void ref_arena(struct libscols_arena *ar)
+{
+	if (ar)
+		ar->refcount++;
+}
+
+void unref_arena(struct libscols_arena *ar)
+{
+	size_t i;
+
+	if (!ar || --ar->refcount > 0)
+		return;
+
+	DBG(ARENA, ul_debugobj(ar, "dealloc"));
+
+	while (!list_empty(&ar->chunks)) {
+		struct arena_chunk *ch = list_entry(ar->chunks.next,
+						struct arena_chunk, chunks);
+		list_del(&ch->chunks);
+		free(ch);
+	}
+	while (ar->slabs) {
+		struct arena_slab *sl = ar->slabs;
+
+		ar->slabs = sl->next;
+		free(sl);
+	}
+	for (i = 0; i < ar->ncolors; i++)
+		free(ar->colors[i]);
+	free(ar);
+}
+
+/* returns arena for memory allocated by arena_alloc() or arena_strdup() */
+struct libscols_arena *arena_of(const void *p)
+{
+	return arena_chunk_of(p)->arena;
+}
+
+static struct arena_chunk *new_chunk(struct libscols_arena *ar)
+{
+	struct arena_chunk *ch;
+
+	if (posix_memalign((void **) &ch, ARENA_CHUNKSZ, ARENA_CHUNKSZ) != 0)
+		return NULL;
+
+	ch->arena = ar;
+	ch->nlive = 0;
+	ch->used = sizeof(*ch);
+	list_add_tail(&ch->chunks, &ar->chunks);
+
+	DBG(ARENA, ul_debugobj(ar, "new chunk %p", ch));
+	return ch;
+}
+
+static void *chunk_alloc(struct libscols_arena *ar, size_t sz, size_t align)
+{
+	struct arena_chunk *ch = ar->cur;
+	size_t off;
+
+	if (!sz || sz > ARENA_MAXALLOC)
+		return NULL;
+
+	off = ch ? (ch->used + align - 1) & ~(align - 1) : 0;
+	if (!ch || off + sz > ARENA_CHUNKSZ) {
+		/* otherwise the old chunk is deallocated by the last arena_release() */
+		if (ch && ch->nlive == 0) {
+			list_del(&ch->chunks);
+			free(ch);
+		}
+		ch = ar->cur = new_chunk(ar);
+		if (!ch)
+			return NULL;
+		off = (ch->used + align - 1) & ~(align - 1);
+	}
+
+	ch->used = off + sz;
+	ch->nlive++;
+	return (char *) ch + off;
+}
+
+/*
+ * Returns zeroized memory aligned for structs or NULL if the arena cannot be
+ * used for the request; the caller is expected to use malloc() in this case.
+ */
+void *arena_alloc(struct libscols_arena *ar, size_t sz)
+{
+	void *p = chunk_alloc(ar, sz, sizeof(void *));
+
+	if (p)
+		memset(p, 0, sz);
+	return p;
+}
+
+/* The same as arena_alloc(), but for strings */
+char *arena_strdup(struct libscols_arena *ar, const char *str)
+{
+	size_t sz = strlen(str) + 1;
+	char *p = chunk_alloc(ar, sz, 1);
+
+	if (p)
+		memcpy(p, str, sz);
+	return p;
+}
+
+/* Releases memory from arena_alloc() or arena_strdup() */
+void arena_release(void *p)
+{
+	struct arena_chunk *ch;
+
+	if (!p)
+		return;
+
+	ch = arena_chunk_of(p);
+	if (--ch->nlive > 0)
+		return;
+	if (ch == ch->arena->cur)
+		ch->used = sizeof(*ch);		/* reuse */
+	else {
+		list_del(&ch->chunks);
+		free(ch);
+	}
+}
+
+/*
+ * Returns the arena copy of the @str. The string is deallocated together with
+ * the arena, so don't use arena_release() for it. Returns NULL if the
+ * string cannot be interned.
+ */
+char *arena_intern(struct libscols_arena *ar, const char *str)
+{
+	size_t i;
+
+	for (i = 0; i < ar->ncolors; i++) {
+		if (strcmp(ar->colors[i], str) == 0)
+			return ar->colors[i];
+	}
+	if (ar->ncolors == ARENA_MAXCOLORS)
+		return NULL;
+
+	ar->colors[ar->ncolors] = strdup(str);
+	if (!ar->colors[ar->ncolors])
+		return NULL;
+	return ar->colors[ar->ncolors++];
+}
+
+/* Returns zeroized line struct, the arena is not referenced by this function */
+struct libscols_line *arena_get_line(struct libscols_arena *ar)
+{
+	struct libscols_line *ln;
+
+	if (!ar->free_lines) {
+		struct arena_slab *sl = malloc(sizeof(*sl));
+		size_t i;
+
+		if (!sl)
+			return NULL;
+		sl->next = ar->slabs;
+		ar->slabs = sl;
+
+		for (i = 0; i < ARENA_SLABSZ; i++) {
+			sl->lines[i].parent = ar->free_lines;
+			ar->free_lines = &sl->lines[i];
+		}
+		DBG(ARENA, ul_debugobj(ar, "new slab %p", sl));
+	}
+
+	ln = ar->free_lines;
+	ar->free_lines = ln->parent;
+
+	memset(ln, 0, sizeof(*ln));
+	return ln;
+}
+
+void arena_put_line(struct libscols_arena *ar, struct libscols_line *ln)
+{
+	ln->parent = ar->free_lines;
+	ar->free_lines = ln;
+}
@@ -138,6 +138,64 @@ nothing:
 	return NULL;
 }
 
+/*
+ * The same as buffer_get_safe_data(), but the buffer is expected to contain
+ * the ascii art (if any) and @ce data. The cached cell width is used and the
+ * data are not encoded if they are already safe.
+ */
+char *buffer_get_safe_cell_data(struct libscols_table *tb,
+				struct libscols_buffer *buf,
+				struct libscols_cell *ce,
+				size_t *cells,
+				const char *safechars)
+{
+	char *data = buffer_get_data(buf);
+	size_t sz, artsz = 0, artw = 0;
+
+	if (!data || !ce)
+		return buffer_get_safe_data(tb, buf, cells, safechars);
+	if (!tb->no_encode && !scols_cell_is_safe(ce))
+		return buffer_get_safe_data(tb, buf, cells, safechars);
+	if (buf->art_idx) {
+		artw = mbs_safe_nwidth(data, buf->art_idx, &artsz);
+		if (artsz != buf->art_idx && !tb->no_encode)
+			return buffer_get_safe_data(tb, buf, cells, safechars);
+	}
+
+	sz = buf->cur - buf->begin;
+	if (!buf->encdata) {
+		buf->encdata = malloc(mbs_safe_encode_size(buf->bufsz) + 1);
+		if (!buf->encdata)
+			goto nothing;
+	}
+	memcpy(buf->encdata, data, sz + 1);
+
+	*cells = artw + scols_cell_get_safe_width(ce);
+	if (!*cells)
+		goto nothing;
+	return buf->encdata;
+nothing:
+	*cells = 0;
+	return NULL;
+}
+
+/* returns number of cells of the buffer with the ascii art and @ce data */
+size_t buffer_get_safe_cell_width(struct libscols_buffer *buf,
+				  struct libscols_cell *ce)
+{
+	char *data = buffer_get_data(buf);
+	size_t width = 0;
+
+	if (!data)
+		return 0;
+	if (!ce)
+		return mbs_safe_width(data);
+	if (buf->art_idx)
+		width = mbs_safe_nwidth(data, buf->art_idx, NULL);
+
+	return width + scols_cell_get_safe_width(ce);
+}
+
 /* returns size in bytes of the ascii art (according to art_idx) in safe encoding */
 size_t buffer_get_safe_art_size(struct libscols_buffer *buf)
 {
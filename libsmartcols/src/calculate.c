@@ -38,9 +38,23 @@ static int count_cell_width(struct libscols_table *tb,
 		struct libscols_buffer *buf)
 {
 	size_t len;
-	char *data;
+	const char *data;
 	int rc;
 
+	if (!scols_column_is_tree(cl)) {
+		/* no ascii art, the cell data are good enough */
+		struct libscols_cell *ce = scols_line_get_cell(ln, cl->seqnum);
+
+		data = ce ? scols_cell_get_output_data(ce) : NULL;
+		if (!data || !*data)
+			len = 0;
+		else if (scols_column_is_customwrap(cl))
+			len = cl->wrap_chunksize(cl, data, cl->wrapfunc_data);
+		else
+			len = scols_cell_get_safe_width(ce);
+		goto count;
+	}
+
 	rc = __cell_to_buffer(tb, ln, cl, buf);
 	if (rc)
 		return rc;
@@ -51,7 +65,9 @@ static int count_cell_width(struct libscols_table *tb,
 	else if (scols_column_is_customwrap(cl))
 		len = cl->wrap_chunksize(cl, data, cl->wrapfunc_data);
 	else
-		len = mbs_safe_width(data);
+		len = buffer_get_safe_cell_width(buf,
+				scols_line_get_cell(ln, cl->seqnum));
+count:
 
 	if (len == (size_t) -1)		/* ignore broken multibyte strings */
 		len = 0;
@@ -107,7 +123,7 @@ static int count_column_width(struct libscols_table *tb,
 				cl->width_min--;
 		}
 		if (scols_cell_get_data(&cl->header)) {
-			size_t len = mbs_safe_width(scols_cell_get_data(&cl->header));
+			size_t len = scols_cell_get_safe_width(&cl->header);
 			cl->width_min = max(cl->width_min, len);
 		} else
 			no_header = 1;
@@ -116,8 +132,9 @@ static int count_column_width(struct libscols_table *tb,
 			cl->width_min = 1;
 	}
 
-	if (scols_table_is_tree(tb)) {
-		/* Count width for tree */
+	if (scols_column_is_tree(cl) && scols_table_is_tree(tb)) {
+		/* Count width for tree; the other columns don't depend on
+		 * the order of the lines */
 		rc = scols_walk_tree(tb, cl, walk_count_cell_width, (void *) buf);
 		if (rc)
 			goto done;
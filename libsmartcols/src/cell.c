@@ -23,13 +23,39 @@
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <float.h>
 
 #include "smartcolsP.h"
+#include "mbsalign.h"
 
 /*
  * The cell has no ref-counting, free() and new() functions. All is
  * handled by libscols_line.
+ *
+ * The cells of the table lines are usually allocated in the table arena
+ * (see arena.c) and the cell data and color are allocated there too. The
+ * ce->{data,color}_arena bits tell how to deallocate the strings.
  */
+static void cell_free_data(struct libscols_cell *ce)
+{
+	if (ce->data_arena)
+		arena_release(ce->data);
+	else
+		free(ce->data);
+	ce->data = NULL;
+	ce->data_arena = 0;
+	ce->width_valid = 0;
+	ce->data_formatted = 0;
+}
+
+static void cell_free_color(struct libscols_cell *ce)
+{
+	if (!ce->color_arena)
+		free(ce->color);
+	ce->color = NULL;
+	ce->color_arena = 0;
+}
 
 /**
  * scols_reset_cell:
@@ -45,9 +71,13 @@ int scols_reset_cell(struct libscols_cell *ce)
 		return -EINVAL;
 
 	/*DBG(CELL, ul_debugobj(ce, "reset"));*/
-	free(ce->data);
-	free(ce->color);
-	memset(ce, 0, sizeof(*ce));
+	cell_free_data(ce);
+	cell_free_color(ce);
+	ce->userdata = NULL;
+	ce->flags = 0;
+	ce->datatype = SCOLS_DATA_NONE;
+	ce->num.u64 = 0;
+	ce->data_generated = 0;
 	return 0;
 }
 
@@ -56,13 +86,30 @@ int scols_reset_cell(struct libscols_cell *ce)
  * @ce: a pointer to a struct libscols_cell instance
  * @data: data (used for scols_print_table())
  *
- * Stores a copy of the @str in @ce, the old data are deallocated by free().
+ * Stores a copy of the @str in @ce, the old data are deallocated.
  *
  * Returns: 0, a negative value in case of an error.
  */
 int scols_cell_set_data(struct libscols_cell *ce, const char *data)
 {
-	return strdup_to_struct_member(ce, data, data);
+	char *p = NULL;
+	int pooled = 0;
+
+	if (!ce)
+		return -EINVAL;
+	if (data) {
+		if (ce->in_arena)
+			p = arena_strdup(arena_of(ce), data);
+		if (p)
+			pooled = 1;
+		else if (!(p = strdup(data)))
+			return -ENOMEM;
+	}
+
+	cell_free_data(ce);
+	ce->data = p;
+	ce->data_arena = pooled;
+	return 0;
 }
 
 /**
@@ -81,11 +128,53 @@ int scols_cell_refer_data(struct libscols_cell *ce, char *data)
 {
 	if (!ce)
 		return -EINVAL;
-	free(ce->data);
+	cell_free_data(ce);
 	ce->data = data;
 	return 0;
 }
 
+/*
+ * private API; returns number of terminal cells of the data in the safe
+ * encoding (see mbs_safe_width()). The result is cached in the cell, and
+ * printable ASCII (the usual case) does not need any multibyte magic.
+ */
+size_t scols_cell_get_safe_width(struct libscols_cell *ce)
+{
+	const unsigned char *p;
+
+	if (ce->width_valid)
+		return ce->width;
+
+	ce->width = 0;
+	ce->is_safe = 1;
+	ce->width_valid = 1;
+
+	if (!ce->data)
+		return 0;
+
+	for (p = (unsigned char *) ce->data; *p; p++) {
+		if (*p < 0x20 || *p >= 0x7f || (*p == '\\' && *(p + 1) == 'x'))
+			break;
+	}
+	ce->width = (char *) p - ce->data;
+
+	if (*p) {
+		/* the rest is not ASCII or has to be encoded */
+		size_t sz = strlen((char *) p), bytes = 0;
+
+		ce->width += mbs_safe_nwidth((char *) p, sz, &bytes);
+		ce->is_safe = bytes == sz;
+	}
+	return ce->width;
+}
+
+/* private API; returns 1 if mbs_safe_encode() does not modify the data */
+int scols_cell_is_safe(struct libscols_cell *ce)
+{
+	scols_cell_get_safe_width(ce);
+	return ce->is_safe;
+}
+
 /**
  * scols_cell_get_data:
  * @ce: a pointer to a struct libscols_cell instance
@@ -166,12 +255,29 @@ int scols_cmpstr_cells(struct libscols_cell *a,
  */
 int scols_cell_set_color(struct libscols_cell *ce, const char *color)
 {
+	char *p = NULL;
+	int pooled = 0;
+
 	if (color && isalpha(*color)) {
 		color = color_sequence_from_colorname(color);
 		if (!color)
 			return -EINVAL;
 	}
-	return strdup_to_struct_member(ce, color, color);
+	if (!ce)
+		return -EINVAL;
+	if (color) {
+		if (ce->in_arena)
+			p = arena_intern(arena_of(ce), color);
+		if (p)
+			pooled = 1;
+		else if (!(p = strdup(color)))
+			return -ENOMEM;
+	}
+
+	cell_free_color(ce);
+	ce->color = p;
+	ce->color_arena = pooled;
+	return 0;
 }
 
 /**
@@ -249,9 +355,233 @@ int scols_cell_copy_content(struct libscols_cell *dest,
 	rc = scols_cell_set_data(dest, scols_cell_get_data(src));
 	if (!rc)
 		rc = scols_cell_set_color(dest, scols_cell_get_color(src));
-	if (!rc)
+	if (!rc) {
 		dest->userdata = src->userdata;
+		dest->num = src->num;
+		dest->datatype = src->datatype;
+		dest->data_formatted = src->data_formatted;
+	}
 
 	DBG(CELL, ul_debugobj(src, "copy"));
 	return rc;
 }
+
+static int cell_set_datatype(struct libscols_cell *ce, int type)
+{
+	/* the old number as string is useless now */
+	if (ce->data_formatted)
+		cell_free_data(ce);
+	ce->datatype = type;
+	return 0;
+}
+
+/**
+ * scols_cell_set_u64:
+ * @ce: a pointer to a struct libscols_cell instance
+ * @num: number
+ *
+ * Stores @num in binary form in the cell. The number is used by
+ * scols_cmpnum_cells() for sorting. If the cell has no string data (see
+ * scols_cell_set_data()), then the number is converted to string when the
+ * table is printed, and it's printed as a number in JSON output (except for
+ * SCOLS_JSON_BOOLEAN columns).
+ *
+ * The string data are independent of the number, so it's possible to print
+ * for example human readable size and sort by the size in bytes.
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.36
+ */
+int scols_cell_set_u64(struct libscols_cell *ce, uint64_t num)
+{
+	if (!ce)
+		return -EINVAL;
+	ce->num.u64 = num;
+	return cell_set_datatype(ce, SCOLS_DATA_U64);
+}
+
+/**
+ * scols_cell_set_s64:
+ * @ce: a pointer to a struct libscols_cell instance
+ * @num: number
+ *
+ * The same as scols_cell_set_u64(), but for signed numbers (e.g. time_t).
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.36
+ */
+int scols_cell_set_s64(struct libscols_cell *ce, int64_t num)
+{
+	if (!ce)
+		return -EINVAL;
+	ce->num.s64 = num;
+	return cell_set_datatype(ce, SCOLS_DATA_S64);
+}
+
+/**
+ * scols_cell_set_float:
+ * @ce: a pointer to a struct libscols_cell instance
+ * @num: number
+ *
+ * The same as scols_cell_set_u64(), but for floating point numbers.
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.36
+ */
+int scols_cell_set_float(struct libscols_cell *ce, double num)
+{
+	if (!ce)
+		return -EINVAL;
+	ce->num.fl = num;
+	return cell_set_datatype(ce, SCOLS_DATA_FLOAT);
+}
+
+/**
+ * scols_cell_get_datatype:
+ * @ce: a pointer to a struct libscols_cell instance
+ *
+ * Returns: SCOLS_DATA_* type of the binary data, SCOLS_DATA_NONE if the cell
+ * contains only string data.
+ *
+ * Since: 2.36
+ */
+int scols_cell_get_datatype(const struct libscols_cell *ce)
+{
+	return ce ? ce->datatype : SCOLS_DATA_NONE;
+}
+
+/**
+ * scols_cell_get_u64:
+ * @ce: a pointer to a struct libscols_cell instance
+ * @num: returns number
+ *
+ * Returns: 0, or -EINVAL if the cell does not contain SCOLS_DATA_U64.
+ *
+ * Since: 2.36
+ */
+int scols_cell_get_u64(const struct libscols_cell *ce, uint64_t *num)
+{
+	if (!ce || !num || ce->datatype != SCOLS_DATA_U64)
+		return -EINVAL;
+	*num = ce->num.u64;
+	return 0;
+}
+
+/**
+ * scols_cell_get_s64:
+ * @ce: a pointer to a struct libscols_cell instance
+ * @num: returns number
+ *
+ * Returns: 0, or -EINVAL if the cell does not contain SCOLS_DATA_S64.
+ *
+ * Since: 2.36
+ */
+int scols_cell_get_s64(const struct libscols_cell *ce, int64_t *num)
+{
+	if (!ce || !num || ce->datatype != SCOLS_DATA_S64)
+		return -EINVAL;
+	*num = ce->num.s64;
+	return 0;
+}
+
+/**
+ * scols_cell_get_float:
+ * @ce: a pointer to a struct libscols_cell instance
+ * @num: returns number
+ *
+ * Returns: 0, or -EINVAL if the cell does not contain SCOLS_DATA_FLOAT.
+ *
+ * Since: 2.36
+ */
+int scols_cell_get_float(const struct libscols_cell *ce, double *num)
+{
+	if (!ce || !num || ce->datatype != SCOLS_DATA_FLOAT)
+		return -EINVAL;
+	*num = ce->num.fl;
+	return 0;
+}
+
+/*
+ * private API; returns cell data, the binary data are converted to string
+ * if the cell has no string data.
+ */
+const char *scols_cell_get_output_data(struct libscols_cell *ce)
+{
+	char buf[64];
+
+	if (ce->data || ce->datatype == SCOLS_DATA_NONE)
+		return ce->data;
+
+	switch (ce->datatype) {
+	case SCOLS_DATA_U64:
+		snprintf(buf, sizeof(buf), "%" PRIu64, ce->num.u64);
+		break;
+	case SCOLS_DATA_S64:
+		snprintf(buf, sizeof(buf), "%" PRId64, ce->num.s64);
+		break;
+	case SCOLS_DATA_FLOAT:
+		snprintf(buf, sizeof(buf), "%.*g", DBL_DIG, ce->num.fl);
+		break;
+	}
+
+	if (scols_cell_set_data(ce, buf) == 0)
+		ce->data_formatted = 1;
+	return ce->data;
+}
+
+/*
+ * private API; returns the binary data converted to unsigned number, the
+ * order of the numbers is the same as the order of the original values.
+ */
+uint64_t scols_cell_get_numkey(const struct libscols_cell *ce)
+{
+	uint64_t x;
+
+	switch (ce->datatype) {
+	case SCOLS_DATA_U64:
+		return ce->num.u64;
+	case SCOLS_DATA_S64:
+		return (uint64_t) ce->num.s64 ^ (UINT64_C(1) << 63);
+	case SCOLS_DATA_FLOAT:
+		memcpy(&x, &ce->num.fl, sizeof(x));
+		/* IEEE 754: negative numbers are in reverse order */
+		return x & (UINT64_C(1) << 63) ? ~x : x | (UINT64_C(1) << 63);
+	}
+	return 0;
+}
+
+/**
+ * scols_cmpnum_cells:
+ * @a: pointer to cell
+ * @b: pointer to cell
+ * @data: unused pointer to private data (defined by API)
+ *
+ * Compares binary data of the cells (see scols_cell_set_u64()). Cells without
+ * binary data are smaller than cells with a number. The function is designed
+ * for scols_column_set_cmpfunc() and scols_sort_table(); the table is sorted
+ * by radix sort rather than by calls of this function in this case.
+ *
+ * Returns: follows strcmp() return values.
+ *
+ * Since: 2.36
+ */
+int scols_cmpnum_cells(struct libscols_cell *a,
+		       struct libscols_cell *b,
+		       __attribute__((__unused__)) void *data)
+{
+	int ta = scols_cell_get_datatype(a),
+	    tb = scols_cell_get_datatype(b);
+	uint64_t ka, kb;
+
+	if (ta != tb)
+		return ta < tb ? -1 : 1;
+	if (ta == SCOLS_DATA_NONE)
+		return 0;
+
+	ka = scols_cell_get_numkey(a);
+	kb = scols_cell_get_numkey(b);
+	return ka == kb ? 0 : ka < kb ? -1 : 1;
+}
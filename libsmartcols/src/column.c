@@ -405,6 +405,64 @@ int scols_column_set_wrapfunc(struct libscols_column *cl,
 	return 0;
 }
 
+/**
+ * scols_column_set_datafunc:
+ * @cl: a pointer to a struct libscols_column instance
+ * @datafunc: function to return data for the column cell in the line
+ * @data: private data for datafunc function
+ *
+ * The @datafunc is called by the library for cells without data when the
+ * column is printed or when the table is sorted by the column, so the data
+ * for hidden or never printed columns do not have to be composed at all.
+ * The function has to return data allocated by malloc() (the library
+ * deallocates the data by free()) or NULL if the cell is empty. The function
+ * is called only once for each cell.
+ *
+ * Note that scols_cell_get_data() returns NULL for the cells until the data
+ * are generated, so don't use this function for columns which are
+ * read by the application itself.
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.36
+ */
+int scols_column_set_datafunc(struct libscols_column *cl,
+			char *(*datafunc)(struct libscols_column *,
+					  struct libscols_line *,
+					  void *),
+			void *data)
+{
+	if (!cl)
+		return -EINVAL;
+
+	cl->datafunc = datafunc;
+	cl->datafunc_data = data;
+	return 0;
+}
+
+/*
+ * private API; sets the @ln cell data by the column datafunc() if the cell
+ * has no data yet.
+ */
+void scols_column_generate_cell(struct libscols_column *cl, struct libscols_line *ln)
+{
+	struct libscols_cell *ce;
+	char *data;
+
+	if (!cl->datafunc)
+		return;
+
+	ce = scols_line_get_column_cell(ln, cl);
+	if (!ce || ce->data_generated || ce->data
+	    || ce->datatype != SCOLS_DATA_NONE)
+		return;
+
+	ce->data_generated = 1;
+	data = cl->datafunc(cl, ln, cl->datafunc_data);
+	if (data)
+		scols_cell_refer_data(ce, data);
+}
+
 /**
  * scols_column_set_safechars:
  * @cl: a pointer to a struct libscols_column instance
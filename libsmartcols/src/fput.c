@@ -1,26 +1,327 @@
-#include "carefulputc.h"
+#include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+
 #include "smartcolsP.h"
 
+/*
+ * Output buffer. All table output is composed in tb->outbuf and written to
+ * tb->out by large fwrite()s, rather than by many small stdio calls. The
+ * buffer has to be flushed by fput_flush() before the library returns to the
+ * application (or before the stream is changed).
+ */
+static int alloc_outbuf(struct libscols_table *tb)
+{
+	if (!tb->outbuf) {
+		tb->outbuf = malloc(SCOLS_OUTBUF_SIZE);
+		tb->outbuf_used = 0;
+	}
+	return tb->outbuf ? 0 : -ENOMEM;
+}
+
+void fput_flush(struct libscols_table *tb)
+{
+	if (tb->outbuf && tb->outbuf_used) {
+		fwrite(tb->outbuf, 1, tb->outbuf_used, tb->out);
+		tb->outbuf_used = 0;
+	}
+}
+
+/* called by fput_write() if the data don't fit into the buffer */
+void fput_write_slow(struct libscols_table *tb, const char *data, size_t sz)
+{
+	fput_flush(tb);
+
+	if (sz < SCOLS_OUTBUF_SIZE && alloc_outbuf(tb) == 0) {
+		memcpy(tb->outbuf, data, sz);
+		tb->outbuf_used = sz;
+	} else
+		fwrite(data, 1, sz, tb->out);
+}
+
+void fput_printf(struct libscols_table *tb, const char *fmt, ...)
+{
+	va_list ap;
+	int n, i;
+
+	for (i = 0; i < 2 && alloc_outbuf(tb) == 0; i++) {
+		size_t left = SCOLS_OUTBUF_SIZE - tb->outbuf_used;
+
+		va_start(ap, fmt);
+		n = vsnprintf(tb->outbuf + tb->outbuf_used, left, fmt, ap);
+		va_end(ap);
+
+		if (n >= 0 && (size_t) n < left) {
+			tb->outbuf_used += n;
+			return;
+		}
+		fput_flush(tb);		/* try again with empty buffer */
+	}
+
+	fput_flush(tb);
+	va_start(ap, fmt);
+	vfprintf(tb->out, fmt, ap);
+	va_end(ap);
+}
+
+static void fput_hex(struct libscols_table *tb, unsigned char c)
+{
+	static const char hex[] = "0123456789abcdef";
+	char buf[4] = { '\\', 'x', hex[c >> 4], hex[c & 0xf] };
+
+	fput_write(tb, buf, sizeof(buf));
+}
+
+/* The same as fputs_nonblank(), the unencoded parts are written at once */
+void fput_nonblank(struct libscols_table *tb, const char *data)
+{
+	const char *p, *start = data;
+
+	for (p = data; p && *p; p++) {
+		const unsigned char c = (unsigned char) *p;
+
+		if (isblank(c) || c == 0x5c || !isprint(c) || iscntrl(c)) {
+			fput_write(tb, start, p - start);
+			fput_hex(tb, c);
+			start = p + 1;
+		}
+	}
+	if (p)
+		fput_write(tb, start, p - start);
+}
+
+/* The same as fputs_quoted() */
+void fput_quoted(struct libscols_table *tb, const char *data)
+{
+	const char *p, *start = data;
+
+	fput_char(tb, '"');
+	for (p = data; p && *p; p++) {
+		const unsigned char c = (unsigned char) *p;
+
+		if (c == 0x22 ||		/* " */
+		    c == 0x5c ||		/* \ */
+		    c == 0x60 ||		/* ` */
+		    c == 0x24 ||		/* $ */
+		    !isprint(c) || iscntrl(c)) {
+			fput_write(tb, start, p - start);
+			fput_hex(tb, c);
+			start = p + 1;
+		}
+	}
+	if (p)
+		fput_write(tb, start, p - start);
+	fput_char(tb, '"');
+}
+
+/* The same as fputs_quoted_case_json() */
+void fput_quoted_json(struct libscols_table *tb, const char *data, int dir)
+{
+	const char *p, *start = data;
+
+	fput_char(tb, '"');
+	for (p = data; p && *p; p++) {
+		const unsigned char c = (unsigned char) *p;
+
+		/* see carefulputc.h for more details */
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			if (dir) {
+				fput_char(tb, dir == 1 ? toupper(c) : tolower(c));
+				start = p + 1;
+			}
+			continue;
+		}
+
+		fput_write(tb, start, p - start);
+		start = p + 1;
+
+		switch (c) {
+		case '"':
+		case '\\':
+			fput_char(tb, '\\');
+			fput_char(tb, c);
+			break;
+		case '\b':
+			fput_str(tb, "\\b");
+			break;
+		case '\t':
+			fput_str(tb, "\\t");
+			break;
+		case '\n':
+			fput_str(tb, "\\n");
+			break;
+		case '\f':
+			fput_str(tb, "\\f");
+			break;
+		case '\r':
+			fput_str(tb, "\\r");
+			break;
+		default:
+			fput_printf(tb, "\\u00%02x", c);
+			break;
+		}
+	}
+	if (p)
+		fput_write(tb, start, p - start);
+	fput_char(tb, '"');
+}
+
+/*
+ * CBOR (RFC 8949) output. The table is a map:
+ *
+ *   { "name": <table name>,
+ *     "columns": [ [<name>, <"string"|"number"|"boolean">], ... ],
+ *     "lines": [ [<value>, ... (, [<children lines>])], ... ] }
+ *
+ * The "name" is optional and the arrays with lines (and children) are
+ * indefinite-length, so the lines do not have to be counted in advance.
+ */
+void fput_cbor_head(struct libscols_table *tb, int major, uint64_t n)
+{
+	unsigned char buf[9];
+	size_t sz, i;
+
+	buf[0] = major << 5;
+	if (n < 24) {
+		buf[0] |= n;
+		sz = 1;
+	} else if (n <= UINT8_MAX) {
+		buf[0] |= 24;
+		sz = 2;
+	} else if (n <= UINT16_MAX) {
+		buf[0] |= 25;
+		sz = 3;
+	} else if (n <= UINT32_MAX) {
+		buf[0] |= 26;
+		sz = 5;
+	} else {
+		buf[0] |= 27;
+		sz = 9;
+	}
+	for (i = sz - 1; i > 0; i--) {
+		buf[i] = n & 0xff;
+		n >>= 8;
+	}
+	fput_write(tb, (char *) buf, sz);
+}
+
+/* returns 1 if the @data (of @sz bytes) is valid UTF-8 */
+static int is_utf8(const unsigned char *data, size_t sz)
+{
+	size_t i = 0;
+
+	while (i < sz) {
+		unsigned char c = data[i++];
+		size_t n;
+		uint32_t cp;
+
+		if (c < 0x80)
+			continue;
+		if (c >= 0xc2 && c <= 0xdf)
+			n = 1, cp = c & 0x1f;
+		else if (c >= 0xe0 && c <= 0xef)
+			n = 2, cp = c & 0x0f;
+		else if (c >= 0xf0 && c <= 0xf4)
+			n = 3, cp = c & 0x07;
+		else
+			return 0;
+		if (sz - i < n)
+			return 0;
+		while (n--) {
+			if ((data[i] & 0xc0) != 0x80)
+				return 0;
+			cp = (cp << 6) | (data[i++] & 0x3f);
+		}
+		if ((cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff
+		    || (c == 0xe0 && cp < 0x800) || (c == 0xf0 && cp < 0x10000))
+			return 0;
+	}
+	return 1;
+}
+
+/* writes text string, or byte string if the data are not valid UTF-8 */
+void fput_cbor_string(struct libscols_table *tb, const char *data)
+{
+	size_t sz = strlen(data);
+
+	fput_cbor_head(tb, is_utf8((const unsigned char *) data, sz) ?
+				SCOLS_CBOR_TEXT : SCOLS_CBOR_BYTES, sz);
+	fput_write(tb, data, sz);
+}
+
+/* column name in lower case, the same as JSON */
+static void fput_cbor_colname(struct libscols_table *tb, const char *name)
+{
+	const char *p;
+
+	fput_cbor_head(tb, SCOLS_CBOR_TEXT, strlen(name));
+	for (p = name; *p; p++)
+		fput_char(tb, tolower((unsigned char) *p));
+}
+
+static void fput_cbor_table_open(struct libscols_table *tb)
+{
+	struct libscols_column *cl;
+	struct libscols_iter itr;
+	size_t ncols = 0;
+
+	fput_char(tb, SCOLS_CBOR_MAP_INDEF);
+	if (tb->name) {
+		fput_cbor_string(tb, "name");
+		fput_cbor_string(tb, tb->name);
+	}
+
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_column(tb, &itr, &cl) == 0) {
+		if (!scols_column_is_hidden(cl))
+			ncols++;
+	}
+
+	fput_cbor_string(tb, "columns");
+	fput_cbor_head(tb, SCOLS_CBOR_ARRAY, ncols);
+
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_column(tb, &itr, &cl) == 0) {
+		const char *name = scols_cell_get_data(&cl->header);
+
+		if (scols_column_is_hidden(cl))
+			continue;
+		fput_cbor_head(tb, SCOLS_CBOR_ARRAY, 2);
+		fput_cbor_colname(tb, name ? name : "");
+		fput_cbor_string(tb,
+			cl->json_type == SCOLS_JSON_NUMBER ? "number" :
+			cl->json_type == SCOLS_JSON_BOOLEAN ? "boolean" :
+							      "string");
+	}
+
+	fput_cbor_string(tb, "lines");
+	fput_char(tb, SCOLS_CBOR_ARRAY_INDEF);
+}
+
 void fput_indent(struct libscols_table *tb)
 {
 	int i;
 
 	for (i = 0; i <= tb->indent; i++)
-		fputs("   ", tb->out);
+		fput_str(tb, "   ");
 }
 
 void fput_table_open(struct libscols_table *tb)
 {
 	tb->indent = 0;
 
-	if (scols_table_is_json(tb)) {
-		fputc('{', tb->out);
-		fputs(linesep(tb), tb->out);
+	if (scols_table_is_cbor(tb)) {
+		fput_cbor_table_open(tb);
+		tb->indent++;
+
+	} else if (scols_table_is_json(tb)) {
+		fput_char(tb, '{');
+		fput_str(tb, linesep(tb));
 
 		fput_indent(tb);
-		fputs_quoted(tb->name, tb->out);
-		fputs(": [", tb->out);
-		fputs(linesep(tb), tb->out);
+		fput_quoted(tb, tb->name);
+		fput_str(tb, ": [");
+		fput_str(tb, linesep(tb));
 
 		tb->indent++;
 		tb->indent_last_sep = 1;
@@ -31,26 +332,36 @@ void fput_table_close(struct libscols_table *tb)
 {
 	tb->indent--;
 
-	if (scols_table_is_json(tb)) {
+	if (scols_table_is_cbor(tb)) {
+		fput_char(tb, SCOLS_CBOR_BREAK);	/* lines */
+		fput_char(tb, SCOLS_CBOR_BREAK);	/* table */
+		tb->indent--;
+
+	} else if (scols_table_is_json(tb)) {
 		fput_indent(tb);
-		fputc(']', tb->out);
+		fput_char(tb, ']');
 		tb->indent--;
-		fputs(linesep(tb), tb->out);
-		fputc('}', tb->out);
+		fput_str(tb, linesep(tb));
+		fput_char(tb, '}');
 		tb->indent_last_sep = 1;
 	}
 }
 
 void fput_children_open(struct libscols_table *tb)
 {
+	if (scols_table_is_cbor(tb)) {
+		fput_char(tb, SCOLS_CBOR_ARRAY_INDEF);
+		tb->indent++;
+		return;
+	}
 	if (scols_table_is_json(tb)) {
-		fputc(',', tb->out);
-		fputs(linesep(tb), tb->out);
+		fput_char(tb, ',');
+		fput_str(tb, linesep(tb));
 		fput_indent(tb);
-		fputs("\"children\": [", tb->out);
+		fput_str(tb, "\"children\": [");
 	}
 	/* between parent and child is separator */
-	fputs(linesep(tb), tb->out);
+	fput_str(tb, linesep(tb));
 	tb->indent_last_sep = 1;
 	tb->indent++;
 	tb->termlines_used++;
@@ -60,19 +371,25 @@ void fput_children_close(struct libscols_table *tb)
 {
 	tb->indent--;
 
-	if (scols_table_is_json(tb)) {
+	if (scols_table_is_cbor(tb))
+		fput_char(tb, SCOLS_CBOR_BREAK);
+
+	else if (scols_table_is_json(tb)) {
 		fput_indent(tb);
-		fputc(']', tb->out);
-		fputs(linesep(tb), tb->out);
+		fput_char(tb, ']');
+		fput_str(tb, linesep(tb));
 		tb->indent_last_sep = 1;
 	}
 }
 
 void fput_line_open(struct libscols_table *tb)
 {
-	if (scols_table_is_json(tb)) {
+	if (scols_table_is_cbor(tb))
+		fput_char(tb, SCOLS_CBOR_ARRAY_INDEF);
+
+	else if (scols_table_is_json(tb)) {
 		fput_indent(tb);
-		fputc('{', tb->out);
+		fput_char(tb, '{');
 		tb->indent_last_sep = 0;
 	}
 	tb->indent++;
@@ -81,15 +398,18 @@ void fput_line_open(struct libscols_table *tb)
 void fput_line_close(struct libscols_table *tb, int last, int last_in_table)
 {
 	tb->indent--;
-	if (scols_table_is_json(tb)) {
+	if (scols_table_is_cbor(tb))
+		fput_char(tb, SCOLS_CBOR_BREAK);
+
+	else if (scols_table_is_json(tb)) {
 		if (tb->indent_last_sep)
 			fput_indent(tb);
-		fputs(last ? "}" : "},", tb->out);
+		fput_str(tb, last ? "}" : "},");
 		if (!tb->no_linesep)
-			fputs(linesep(tb), tb->out);
+			fput_str(tb, linesep(tb));
 
 	} else if (tb->no_linesep == 0 && last_in_table == 0) {
-		fputs(linesep(tb), tb->out);
+		fput_str(tb, linesep(tb));
 		tb->termlines_used++;
 	}
 
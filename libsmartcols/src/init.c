@@ -18,9 +18,11 @@
 #include "smartcolsP.h"
 
 UL_DEBUG_DEFINE_MASK(libsmartcols);
+UL_TRACE_DEFINE(libsmartcols);
 UL_DEBUG_DEFINE_MASKNAMES(libsmartcols) =
 {
 	{ "all", SCOLS_DEBUG_ALL,	"info about all subsystems" },
+	{ "arena", SCOLS_DEBUG_ARENA,	"lines memory pool" },
 	{ "buff", SCOLS_DEBUG_BUFF,	"output buffer utils" },
 	{ "cell", SCOLS_DEBUG_CELL,	"table cell utils" },
 	{ "col", SCOLS_DEBUG_COL,	"cols utils" },
@@ -47,6 +49,7 @@ void scols_init_debug(int mask)
 		return;
 
 	__UL_INIT_DEBUG_FROM_ENV(libsmartcols, SCOLS_DEBUG_, mask, LIBSMARTCOLS_DEBUG);
+	__UL_INIT_TRACE_FROM_ENV(libsmartcols, LIBSMARTCOLS_TRACE);
 
 	if (libsmartcols_debug_mask != SCOLS_DEBUG_INIT
 	    && libsmartcols_debug_mask != (SCOLS_DEBUG_HELP|SCOLS_DEBUG_INIT)) {
@@ -0,0 +1,226 @@
+/*
+ * limit.c - lines selection for scols_table_set_limit()
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * The line is selected when the next line is added to the table (the line is
+ * complete at this time, the same as for streaming output), or when the table
+ * is printed.
+ *
+ * Without the limit column the first lines are accepted and all others are
+ * immediately removed from the table.
+ *
+ * With the limit column the accepted lines are kept in a bounded max-heap
+ * with the worst line on the top. The new line replaces the top line if it
+ * is better, otherwise the new line is removed. The heap is ordered by the
+ * column cmpfunc and by insertion order, so the selected lines are the same
+ * as the first lines after stable sort of all lines.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "smartcolsP.h"
+
+struct libscols_limit_entry {
+	struct libscols_line	*ln;
+	size_t			seq;		/* insertion order */
+};
+
+/* group members and group children are never removed */
+static inline int is_limited_line(struct libscols_line *ln)
+{
+	return !ln->group && !ln->parent_group;
+}
+
+static int entry_cmp(struct libscols_table *tb,
+		     struct libscols_limit_entry *a,
+		     struct libscols_limit_entry *b)
+{
+	struct libscols_column *cl = tb->limit_column;
+	int rc = cl->cmpfunc(scols_line_get_cell(a->ln, cl->seqnum),
+			     scols_line_get_cell(b->ln, cl->seqnum),
+			     cl->cmpfunc_data);
+	if (rc)
+		return rc;
+	return a->seq < b->seq ? -1 : a->seq > b->seq ? 1 : 0;
+}
+
+static inline void heap_set(struct libscols_table *tb, size_t i,
+			    struct libscols_limit_entry *e)
+{
+	tb->limit_heap[i] = *e;
+	e->ln->limit_pos = i + 1;
+}
+
+static void heap_up(struct libscols_table *tb, size_t i)
+{
+	struct libscols_limit_entry e = tb->limit_heap[i];
+
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+
+		if (entry_cmp(tb, &tb->limit_heap[parent], &e) >= 0)
+			break;
+		heap_set(tb, i, &tb->limit_heap[parent]);
+		i = parent;
+	}
+	heap_set(tb, i, &e);
+}
+
+static void heap_down(struct libscols_table *tb, size_t i)
+{
+	struct libscols_limit_entry e = tb->limit_heap[i];
+	size_t n = tb->limit_nlines;
+
+	for (;;) {
+		size_t chld = 2 * i + 1;
+
+		if (chld >= n)
+			break;
+		if (chld + 1 < n && entry_cmp(tb, &tb->limit_heap[chld + 1],
+						  &tb->limit_heap[chld]) > 0)
+			chld++;
+		if (entry_cmp(tb, &tb->limit_heap[chld], &e) <= 0)
+			break;
+		heap_set(tb, i, &tb->limit_heap[chld]);
+		i = chld;
+	}
+	heap_set(tb, i, &e);
+}
+
+static void heap_delete(struct libscols_table *tb, size_t i)
+{
+	size_t last = --tb->limit_nlines;
+
+	tb->limit_heap[i].ln->limit_pos = 0;
+	if (i == last)
+		return;
+
+	heap_set(tb, i, &tb->limit_heap[last]);
+	heap_up(tb, i);
+	heap_down(tb, tb->limit_heap[i].ln->limit_pos - 1);
+}
+
+static int heap_grow(struct libscols_table *tb)
+{
+	struct libscols_limit_entry *x;
+	size_t sz;
+
+	if (tb->limit_nlines < tb->limit_heapsz)
+		return 0;
+
+	sz = tb->limit_heapsz ? tb->limit_heapsz * 2 : 64;
+	if (sz > tb->limit)
+		sz = tb->limit;
+
+	x = realloc(tb->limit_heap, sz * sizeof(*x));
+	if (!x)
+		return -ENOMEM;
+	tb->limit_heap = x;
+	tb->limit_heapsz = sz;
+	return 0;
+}
+
+static int select_line(struct libscols_table *tb, struct libscols_line *ln)
+{
+	struct libscols_limit_entry e;
+	int rc;
+
+	if (!is_limited_line(ln))
+		return 0;
+
+	if (!tb->limit_column) {
+		if (tb->limit_nlines < tb->limit) {
+			tb->limit_nlines++;
+			return 0;
+		}
+		DBG(TAB, ul_debugobj(tb, "limit: remove line"));
+		return scols_table_remove_line(tb, ln);
+	}
+
+	if (tb->limit_column->datafunc)
+		scols_column_generate_cell(tb->limit_column, ln);
+
+	e.ln = ln;
+	e.seq = tb->limit_seq++;
+
+	if (tb->limit_nlines < tb->limit) {
+		rc = heap_grow(tb);
+		if (rc)
+			return rc;
+		heap_set(tb, tb->limit_nlines++, &e);
+		heap_up(tb, tb->limit_nlines - 1);
+		return 0;
+	}
+
+	/* the new line is worse than all accepted lines */
+	if (entry_cmp(tb, &e, &tb->limit_heap[0]) > 0) {
+		DBG(TAB, ul_debugobj(tb, "limit: remove new line"));
+		return scols_table_remove_line(tb, ln);
+	}
+
+	DBG(TAB, ul_debugobj(tb, "limit: replace line"));
+	ln = tb->limit_heap[0].ln;
+	ln->limit_pos = 0;
+	heap_set(tb, 0, &e);
+	heap_down(tb, 0);
+
+	return scols_table_remove_line(tb, ln);
+}
+
+static inline int has_limit(struct libscols_table *tb)
+{
+	return tb->limit && !scols_table_is_tree(tb);
+}
+
+/* selects the previous line, @ln may be still incomplete */
+int __scols_limit_add_line(struct libscols_table *tb, struct libscols_line *ln)
+{
+	struct libscols_line *prev = tb->limit_pending;
+
+	if (!has_limit(tb))
+		return 0;
+
+	tb->limit_pending = ln;
+	return prev ? select_line(tb, prev) : 0;
+}
+
+void __scols_limit_remove_line(struct libscols_table *tb, struct libscols_line *ln)
+{
+	if (tb->limit_pending == ln)
+		tb->limit_pending = NULL;
+	if (ln->limit_pos)
+		heap_delete(tb, ln->limit_pos - 1);
+}
+
+/* selects the last line and sorts the table by the limit column */
+int __scols_limit_finish(struct libscols_table *tb)
+{
+	struct libscols_line *ln = tb->limit_pending;
+	int rc = 0;
+
+	if (!has_limit(tb))
+		return 0;
+
+	tb->limit_pending = NULL;
+	if (ln)
+		rc = select_line(tb, ln);
+	if (!rc && tb->limit_column)
+		rc = scols_sort_table(tb, tb->limit_column);
+	return rc;
+}
+
+/* the table has to be empty */
+void __scols_limit_reset(struct libscols_table *tb)
+{
+	free(tb->limit_heap);
+	tb->limit_heap = NULL;
+	tb->limit_heapsz = 0;
+	tb->limit_nlines = 0;
+	tb->limit_pending = NULL;
+
+	scols_unref_column(tb->limit_column);
+	tb->limit_column = NULL;
+	tb->limit = 0;
+}
@@ -24,6 +24,17 @@
 
 #include "smartcolsP.h"
 
+static struct libscols_line *init_line(struct libscols_line *ln)
+{
+	DBG(LINE, ul_debugobj(ln, "alloc"));
+	ln->refcount = 1;
+	INIT_LIST_HEAD(&ln->ln_lines);
+	INIT_LIST_HEAD(&ln->ln_children);
+	INIT_LIST_HEAD(&ln->ln_branch);
+	INIT_LIST_HEAD(&ln->ln_groups);
+	return ln;
+}
+
 /**
  * scols_new_line:
  *
@@ -42,13 +53,37 @@ struct libscols_line *scols_new_line(void)
 	if (!ln)
 		return NULL;
 
-	DBG(LINE, ul_debugobj(ln, "alloc"));
-	ln->refcount = 1;
-	INIT_LIST_HEAD(&ln->ln_lines);
-	INIT_LIST_HEAD(&ln->ln_children);
-	INIT_LIST_HEAD(&ln->ln_branch);
-	INIT_LIST_HEAD(&ln->ln_groups);
-	return ln;
+	return init_line(ln);
+}
+
+/*
+ * private API; the line, cells, and cells data are allocated in the arena
+ * @ar (usually table arena). Falls back to scols_new_line() on error.
+ */
+struct libscols_line *scols_new_arena_line(struct libscols_arena *ar)
+{
+	struct libscols_line *ln;
+
+	if (!ar)
+		return scols_new_line();
+
+	ln = arena_get_line(ar);
+	if (!ln)
+		return scols_new_line();
+
+	ln->slab = 1;
+	ln->arena = ar;
+	ref_arena(ar);
+
+	return init_line(ln);
+}
+
+static void line_free_color(struct libscols_line *ln)
+{
+	if (!ln->color_arena)
+		free(ln->color);
+	ln->color = NULL;
+	ln->color_arena = 0;
 }
 
 /**
@@ -79,8 +114,16 @@ void scols_unref_line(struct libscols_line *ln)
 		list_del(&ln->ln_groups);
 		scols_unref_group(ln->group);
 		scols_line_free_cells(ln);
-		free(ln->color);
-		free(ln);
+		line_free_color(ln);
+		if (ln->slab) {
+			struct libscols_arena *ar = ln->arena;
+
+			arena_put_line(ar, ln);
+			unref_arena(ar);
+		} else {
+			unref_arena(ln->arena);
+			free(ln);
+		}
 		return;
 	}
 }
@@ -103,9 +146,39 @@ void scols_line_free_cells(struct libscols_line *ln)
 	for (i = 0; i < ln->ncells; i++)
 		scols_reset_cell(&ln->cells[i]);
 
-	free(ln->cells);
+	if (ln->cells_arena)
+		arena_release(ln->cells);
+	else
+		free(ln->cells);
 	ln->ncells = 0;
 	ln->cells = NULL;
+	ln->cells_arena = 0;
+}
+
+/* moves cells to the new zeroized array @ce of @n cells */
+static int move_cells_to(struct libscols_line *ln, struct libscols_cell *ce,
+			 size_t n, int pooled)
+{
+	size_t i;
+
+	/* the rest is removed, it happens only for arena cells */
+	for (i = n; i < ln->ncells; i++)
+		scols_reset_cell(&ln->cells[i]);
+
+	if (ln->cells)
+		memcpy(ce, ln->cells, min(n, ln->ncells) * sizeof(struct libscols_cell));
+	for (i = 0; i < n; i++)
+		ce[i].in_arena = pooled;
+
+	if (ln->cells_arena)
+		arena_release(ln->cells);
+	else
+		free(ln->cells);
+
+	ln->cells = ce;
+	ln->ncells = n;
+	ln->cells_arena = pooled;
+	return 0;
 }
 
 /**
@@ -136,6 +209,19 @@ int scols_line_alloc_cells(struct libscols_line *ln, size_t n)
 
 	DBG(LINE, ul_debugobj(ln, "alloc %zu cells", n));
 
+	if (ln->arena && n > ln->ncells) {
+		/* arena memory cannot be resized */
+		ce = arena_alloc(ln->arena, n * sizeof(struct libscols_cell));
+		if (ce)
+			return move_cells_to(ln, ce, n, 1);
+	}
+	if (ln->cells_arena) {
+		ce = calloc(n, sizeof(struct libscols_cell));
+		if (!ce)
+			return -errno;
+		return move_cells_to(ln, ce, n, 0);
+	}
+
 	ce = realloc(ln->cells, n * sizeof(struct libscols_cell));
 	if (!ce)
 		return -errno;
@@ -364,12 +450,29 @@ int scols_line_is_ancestor(struct libscols_line *ln, struct libscols_line *paren
  */
 int scols_line_set_color(struct libscols_line *ln, const char *color)
 {
+	char *p = NULL;
+	int pooled = 0;
+
 	if (color && isalnum(*color)) {
 		color = color_sequence_from_colorname(color);
 		if (!color)
 			return -EINVAL;
 	}
-	return strdup_to_struct_member(ln, color, color);
+	if (!ln)
+		return -EINVAL;
+	if (color) {
+		if (ln->arena)
+			p = arena_intern(ln->arena, color);
+		if (p)
+			pooled = 1;
+		else if (!(p = strdup(color)))
+			return -ENOMEM;
+	}
+
+	line_free_color(ln);
+	ln->color = p;
+	ln->color_arena = pooled;
+	return 0;
 }
 
 /**
@@ -514,7 +617,7 @@ struct libscols_line *scols_copy_line(const struct libscols_line *ln)
 	if (!ln)
 		return NULL;
 
-	ret = scols_new_line();
+	ret = scols_new_arena_line(ln->arena);
 	if (!ret)
 		return NULL;
 	if (scols_line_set_color(ret, ln->color))
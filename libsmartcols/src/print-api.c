@@ -44,6 +44,7 @@ int scols_table_print_range(	struct libscols_table *tb,
 	rc = __scols_print_range(tb, buf, &itr, end);
 done:
 	__scols_cleanup_printing(tb, buf);
+	fput_flush(tb);
 	return rc;
 }
 
@@ -114,6 +115,22 @@ static int do_print_table(struct libscols_table *tb, int *is_empty)
 		DBG(TAB, ul_debugobj(tb, "error -- no columns"));
 		return -EINVAL;
 	}
+	if (tb->limit) {
+		rc = __scols_limit_finish(tb);
+		if (rc)
+			return rc;
+	}
+	if (tb->streaming) {
+		int printed = tb->stream_started || !list_empty(&tb->tb_lines);
+
+		rc = __scols_stream_finish(tb);
+		if (tb->streaming) {
+			if (is_empty)
+				*is_empty = !printed;
+			return rc;
+		}
+		/* streaming impossible, print the table in the standard way */
+	}
 	if (list_empty(&tb->tb_lines)) {
 		DBG(TAB, ul_debugobj(tb, "ignore -- no lines"));
 		if (is_empty)
@@ -150,17 +167,21 @@ done:
  * scols_print_table:
  * @tb: table
  *
- * Prints the table to the output stream and terminate by \n.
+ * Prints the table to the output stream and terminate by \n (except binary
+ * CBOR output).
  *
  * Returns: 0, a negative value in case of an error.
  */
 int scols_print_table(struct libscols_table *tb)
 {
-	int empty = 0;
-	int rc = do_print_table(tb, &empty);
+	int empty = 0, rc;
+	TRACE_SCOPE(TAB, "print_table");
+
+	rc = do_print_table(tb, &empty);
 
-	if (rc == 0 && !empty)
-		fputc('\n', tb->out);
+	if (rc == 0 && !empty && !scols_table_is_cbor(tb))
+		fput_char(tb, '\n');
+	fput_flush(tb);
 	return rc;
 }
 
@@ -193,6 +214,7 @@ int scols_print_table_to_string(struct libscols_table *tb, char **data)
 	old_stream = scols_table_get_stream(tb);
 	scols_table_set_stream(tb, stream);
 	rc = do_print_table(tb, NULL);
+	fput_flush(tb);
 	fclose(stream);
 	scols_table_set_stream(tb, old_stream);
 
@@ -21,6 +21,10 @@
 #include <string.h>
 #include <termios.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <float.h>
+#include <locale.h>
+#include <math.h>
 
 #include "mbsalign.h"
 #include "carefulputc.h"
@@ -81,13 +85,42 @@ static int is_next_columns_empty(
 
 		ce = scols_line_get_cell(ln, cl->seqnum);
 		if (ce)
-			data = scols_cell_get_data(ce);
+			data = scols_cell_get_output_data(ce);
 		if (data && *data)
 			return 0;
 	}
 	return 1;
 }
 
+/*
+ * Appends tree ASCII-art prefix of the @ln children to tb->walk_art. The
+ * prefix is kept by scols_walk_tree() for the current parent, so the printed
+ * lines append the prefix rather than walk up to the tree root.
+ */
+int __scols_walk_push_art(struct libscols_table *tb, struct libscols_line *ln)
+{
+	const char *art = "";
+	size_t sz;
+
+	if (ln->parent)
+		art = is_last_child(ln) ? "  " : vertical_symbol(tb);
+	sz = strlen(art);
+
+	if (tb->walk_artsz + sz + 1 > tb->walk_artmax) {
+		size_t max = max(tb->walk_artmax * 2, tb->walk_artsz + sz + 1);
+		char *tmp = realloc(tb->walk_art, max);
+
+		if (!tmp)
+			return -ENOMEM;
+		tb->walk_art = tmp;
+		tb->walk_artmax = max;
+	}
+	memcpy(tb->walk_art + tb->walk_artsz, art, sz + 1);
+	tb->walk_artsz += sz;
+	tb->walk_art_line = ln;
+	return 0;
+}
+
 /* returns pointer to the end of used data */
 static int tree_ascii_art_to_buffer(struct libscols_table *tb,
 				    struct libscols_line *ln,
@@ -102,6 +135,10 @@ static int tree_ascii_art_to_buffer(struct libscols_table *tb,
 	if (!ln->parent)
 		return 0;
 
+	/* precomputed by scols_walk_tree() */
+	if (ln == tb->walk_art_line)
+		return buffer_append_data(buf, tb->walk_art);
+
 	rc = tree_ascii_art_to_buffer(tb, ln->parent, buf);
 	if (rc)
 		return rc;
@@ -232,7 +269,7 @@ static void print_empty_cell(struct libscols_table *tb,
 		if (!ln->parent) {
 			/* only print symbols->vert if followed by child */
 			if (!list_empty(&ln->ln_branch)) {
-				fputs(vertical_symbol(tb), tb->out);
+				fput_str(tb, vertical_symbol(tb));
 				len_pad = mbs_safe_width(vertical_symbol(tb));
 			}
 		} else {
@@ -247,7 +284,7 @@ static void print_empty_cell(struct libscols_table *tb,
 					buffer_append_data(art, vertical_symbol(tb));
 				data = buffer_get_safe_data(tb, art, &len_pad, NULL);
 				if (data && len_pad)
-					fputs(data, tb->out);
+					fput_str(tb, data);
 				free_buffer(art);
 			}
 		}
@@ -263,10 +300,10 @@ static void print_empty_cell(struct libscols_table *tb,
 
 	/* fill rest of cell with space */
 	for(; len_pad < cl->width; ++len_pad)
-		fputs(cellpadding_symbol(tb), tb->out);
+		fput_str(tb, cellpadding_symbol(tb));
 
 	if (!is_last_column(cl))
-		fputs(colsep(tb), tb->out);
+		fput_str(tb, colsep(tb));
 }
 
 
@@ -311,7 +348,7 @@ static void print_newline_padding(struct libscols_table *tb,
 
 	DBG(LINE, ul_debugobj(ln, "printing newline padding"));
 
-	fputs(linesep(tb), tb->out);		/* line break */
+	fput_str(tb, linesep(tb));		/* line break */
 	tb->termlines_used++;
 
 	/* fill cells after line break */
@@ -375,7 +412,7 @@ static int print_pending_data(
 	const char *color = get_cell_color(tb, cl, ln, ce);
 	size_t width = cl->width, bytes;
 	size_t len = width, i;
-	char *data;
+	char *data, saved = 0;
 	char *nextchunk = NULL;
 
 	if (!cl->pending_data)
@@ -385,31 +422,37 @@ static int print_pending_data(
 
 	DBG(COL, ul_debugobj(cl, "printing pending data"));
 
-	data = strdup(cl->pending_data);
-	if (!data)
-		goto err;
+	/*
+	 * The chunk is terminated in place in pending_data_buf (our private
+	 * copy), so every chunk is scanned only once and the rest of the data
+	 * is not touched.
+	 */
+	data = cl->pending_data;
 
 	if (scols_column_is_customwrap(cl)
 	    && (nextchunk = cl->wrap_nextchunk(cl, data, cl->wrapfunc_data))) {
 		bytes = nextchunk - data;
 
 		len = mbs_safe_nwidth(data, bytes, NULL);
-	} else
-		bytes = mbs_truncate(data, &len);
+	} else {
+		bytes = mbs_nfit(data, cl->pending_data_sz, &len);
+		if (bytes < cl->pending_data_sz) {
+			saved = data[bytes];
+			data[bytes] = '\0';
+		}
+	}
 
-	if (bytes == (size_t) -1)
-		goto err;
+	if (color)
+		fput_str(tb, color);
+	fput_str(tb, data);
+	if (color)
+		fput_str(tb, UL_COLOR_RESET);
 
+	if (saved)
+		data[bytes] = saved;
 	if (bytes)
 		step_pending_data(cl, bytes);
 
-	if (color)
-		fputs(color, tb->out);
-	fputs(data, tb->out);
-	if (color)
-		fputs(UL_COLOR_RESET, tb->out);
-	free(data);
-
 	/* minout -- don't fill */
 	if (scols_table_is_minout(tb) && is_next_columns_empty(tb, cl, ln))
 		return 0;
@@ -420,15 +463,121 @@ static int print_pending_data(
 
 	/* fill rest of cell with space */
 	for(i = len; i < width; i++)
-		fputs(cellpadding_symbol(tb), tb->out);
+		fput_str(tb, cellpadding_symbol(tb));
 
 	if (!is_last_column(cl))
-		fputs(colsep(tb), tb->out);
+		fput_str(tb, colsep(tb));
 
 	return 0;
-err:
-	free(data);
-	return -errno;
+}
+
+/* prints binary data of the cell, the output does not depend on locale */
+static void fput_json_number(struct libscols_table *tb, struct libscols_cell *ce)
+{
+	const char *dp;
+	char buf[64], *p;
+
+	switch (ce->datatype) {
+	case SCOLS_DATA_U64:
+		fput_printf(tb, "%" PRIu64, ce->num.u64);
+		break;
+	case SCOLS_DATA_S64:
+		fput_printf(tb, "%" PRId64, ce->num.s64);
+		break;
+	case SCOLS_DATA_FLOAT:
+		if (!isfinite(ce->num.fl)) {
+			fput_str(tb, "null");
+			break;
+		}
+		snprintf(buf, sizeof(buf), "%.*g", DBL_DIG, ce->num.fl);
+
+		dp = localeconv()->decimal_point;
+		if (dp && *dp && strcmp(dp, ".") != 0 && (p = strstr(buf, dp))) {
+			size_t sz = strlen(dp);
+
+			*p++ = '.';
+			memmove(p, p + sz - 1, strlen(p + sz - 1) + 1);
+		}
+		fput_str(tb, buf);
+		break;
+	}
+}
+
+/*
+ * CBOR cell value; the same rules as for JSON, but the numbers are binary
+ * and NUMBER columns fallback to string if the data are not integer.
+ */
+static void fput_cbor_data(struct libscols_table *tb,
+			   struct libscols_column *cl,
+			   struct libscols_cell *ce,
+			   const char *data)
+{
+	if (ce && ce->data_formatted && cl->json_type != SCOLS_JSON_BOOLEAN) {
+		switch (ce->datatype) {
+		case SCOLS_DATA_U64:
+			fput_cbor_head(tb, SCOLS_CBOR_UINT, ce->num.u64);
+			return;
+		case SCOLS_DATA_S64:
+			if (ce->num.s64 < 0)
+				fput_cbor_head(tb, SCOLS_CBOR_NEGINT,
+						-1 - ce->num.s64);
+			else
+				fput_cbor_head(tb, SCOLS_CBOR_UINT, ce->num.s64);
+			return;
+		case SCOLS_DATA_FLOAT:
+		{
+			uint64_t x;
+			size_t i;
+			char buf[9];
+
+			memcpy(&x, &ce->num.fl, sizeof(x));
+			buf[0] = SCOLS_CBOR_FLOAT64;
+			for (i = 8; i > 0; i--) {
+				buf[i] = x & 0xff;
+				x >>= 8;
+			}
+			fput_write(tb, buf, sizeof(buf));
+			return;
+		}
+		}
+	}
+
+	switch (cl->json_type) {
+	case SCOLS_JSON_NUMBER:
+		if (*data) {
+			char *end = NULL;
+			uintmax_t num;
+
+			errno = 0;
+			if (*data == '-') {
+				intmax_t x = strtoimax(data, &end, 10);
+
+				if (!errno && end && !*end && x < 0) {
+					fput_cbor_head(tb, SCOLS_CBOR_NEGINT, -1 - x);
+					return;
+				}
+			} else if (isdigit((unsigned char) *data)) {
+				num = strtoumax(data, &end, 10);
+				if (!errno && end && !*end) {
+					fput_cbor_head(tb, SCOLS_CBOR_UINT, num);
+					return;
+				}
+			}
+		}
+		/* fallthrough */
+	case SCOLS_JSON_STRING:
+		if (!*data)
+			fput_char(tb, SCOLS_CBOR_NULL);
+		else
+			fput_cbor_string(tb, data);
+		break;
+	case SCOLS_JSON_BOOLEAN:
+		fput_char(tb, !*data ? SCOLS_CBOR_FALSE :
+			 *data == '0' ? SCOLS_CBOR_FALSE :
+			 *data == 'N' || *data == 'n' ? SCOLS_CBOR_FALSE :
+							SCOLS_CBOR_TRUE);
+		break;
+	}
 }
 
 static int print_data(struct libscols_table *tb,
@@ -453,43 +602,53 @@ static int print_data(struct libscols_table *tb,
 
 	switch (tb->format) {
 	case SCOLS_FMT_RAW:
-		fputs_nonblank(data, tb->out);
+		fput_nonblank(tb, data);
 		if (!is_last)
-			fputs(colsep(tb), tb->out);
+			fput_str(tb, colsep(tb));
 		return 0;
 
 	case SCOLS_FMT_EXPORT:
-		fprintf(tb->out, "%s=", scols_cell_get_data(&cl->header));
-		fputs_quoted(data, tb->out);
+		fput_str(tb, scols_cell_get_data(&cl->header));
+		fput_char(tb, '=');
+		fput_quoted(tb, data);
 		if (!is_last)
-			fputs(colsep(tb), tb->out);
+			fput_str(tb, colsep(tb));
 		return 0;
 
 	case SCOLS_FMT_JSON:
-		fputs_quoted_json_lower(scols_cell_get_data(&cl->header), tb->out);
-		fputs(":", tb->out);
+		fput_quoted_json(tb, scols_cell_get_data(&cl->header), -1);
+		fput_str(tb, ":");
+		if (ce && ce->data_formatted && cl->json_type != SCOLS_JSON_BOOLEAN) {
+			fput_json_number(tb, ce);
+			if (!is_last)
+				fput_str(tb, ", ");
+			return 0;
+		}
 		switch (cl->json_type) {
 			case SCOLS_JSON_STRING:
 				if (!*data)
-					fputs("null", tb->out);
+					fput_str(tb, "null");
 				else
-					fputs_quoted_json(data, tb->out);
+					fput_quoted_json(tb, data, 0);
 				break;
 			case SCOLS_JSON_NUMBER:
 				if (!*data)
-					fputs("null", tb->out);
+					fput_str(tb, "null");
 				else
-					fputs(data, tb->out);
+					fput_str(tb, data);
 				break;
 			case SCOLS_JSON_BOOLEAN:
-				fputs(!*data ? "false" :
-				      *data == '0' ? "false" :
-				      *data == 'N' || *data == 'n' ? "false" : "true",
-				      tb->out);
+				fput_str(tb, !*data ? "false" :
+					 *data == '0' ? "false" :
+					 *data == 'N' || *data == 'n' ? "false" : "true");
 				break;
 		}
 		if (!is_last)
-			fputs(", ", tb->out);
+			fput_str(tb, ", ");
+		return 0;
+
+	case SCOLS_FMT_CBOR:
+		fput_cbor_data(tb, cl, ce, data);
 		return 0;
 
 	case SCOLS_FMT_HUMAN:
@@ -500,7 +659,12 @@ static int print_data(struct libscols_table *tb,
 
 	/* Encode. Note that 'len' and 'width' are number of cells, not bytes.
 	 */
-	data = buffer_get_safe_data(tb, buf, &len, scols_column_get_safechars(cl));
+	if (ln)
+		data = buffer_get_safe_cell_data(tb, buf, ce, &len,
+					scols_column_get_safechars(cl));
+	else
+		data = buffer_get_safe_data(tb, buf, &len,
+					scols_column_get_safechars(cl));
 	if (!data)
 		data = "";
 	bytes = strlen(data);
@@ -532,8 +696,9 @@ static int print_data(struct libscols_table *tb,
 		set_pending_data(cl, data, bytes);
 
 		len = width;
-		bytes = mbs_truncate(data, &len);
-		if (bytes  != (size_t) -1 && bytes > 0)
+		bytes = mbs_nfit(data, bytes, &len);
+		data[bytes] = '\0';
+		if (bytes > 0)
 			step_pending_data(cl, bytes);
 	}
 
@@ -545,12 +710,12 @@ static int print_data(struct libscols_table *tb,
 	if (data && *data) {
 		if (scols_column_is_right(cl)) {
 			if (color)
-				fputs(color, tb->out);
+				fput_str(tb, color);
 			for (i = len; i < width; i++)
-				fputs(cellpadding_symbol(tb), tb->out);
-			fputs(data, tb->out);
+				fput_str(tb, cellpadding_symbol(tb));
+			fput_str(tb, data);
 			if (color)
-				fputs(UL_COLOR_RESET, tb->out);
+				fput_str(tb, UL_COLOR_RESET);
 			len = width;
 
 		} else if (color) {
@@ -559,15 +724,15 @@ static int print_data(struct libscols_table *tb,
 
 			/* we don't want to colorize tree ascii art */
 			if (scols_column_is_tree(cl) && art && art < bytes) {
-				fwrite(p, 1, art, tb->out);
+				fput_write(tb, p, art);
 				p += art;
 			}
 
-			fputs(color, tb->out);
-			fputs(p, tb->out);
-			fputs(UL_COLOR_RESET, tb->out);
+			fput_str(tb, color);
+			fput_str(tb, p);
+			fput_str(tb, UL_COLOR_RESET);
 		} else
-			fputs(data, tb->out);
+			fput_str(tb, data);
 	}
 
 	/* minout -- don't fill */
@@ -580,14 +745,14 @@ static int print_data(struct libscols_table *tb,
 
 	/* fill rest of cell with space */
 	for(i = len; i < width; i++)
-		fputs(cellpadding_symbol(tb), tb->out);
+		fput_str(tb, cellpadding_symbol(tb));
 
 	if (len > width && !scols_column_is_trunc(cl)) {
 		DBG(COL, ul_debugobj(cl, "*** data len=%zu > column width=%zu", len, width));
 		print_newline_padding(tb, cl, ln, buffer_get_size(buf));	/* next column starts on next line */
 
 	} else if (!is_last)
-		fputs(colsep(tb), tb->out);		/* columns separator */
+		fput_str(tb, colsep(tb));		/* columns separator */
 
 	return 0;
 }
@@ -610,7 +775,7 @@ int __cell_to_buffer(struct libscols_table *tb,
 	buffer_reset_data(buf);
 
 	ce = scols_line_get_cell(ln, cl->seqnum);
-	data = ce ? scols_cell_get_data(ce) : NULL;
+	data = ce ? scols_cell_get_output_data(ce) : NULL;
 
 	if (!scols_column_is_tree(cl))
 		return data ? buffer_set_data(buf, data) : 0;
@@ -618,13 +783,13 @@ int __cell_to_buffer(struct libscols_table *tb,
 	/*
 	 * Group stuff
 	 */
-	if (!scols_table_is_json(tb) && cl->is_groups)
+	if (!is_nested_format(tb) && cl->is_groups)
 		rc = groups_ascii_art_to_buffer(tb, ln, buf);
 
 	/*
 	 * Tree stuff
 	 */
-	if (!rc && ln->parent && !scols_table_is_json(tb)) {
+	if (!rc && ln->parent && !is_nested_format(tb)) {
 		rc = tree_ascii_art_to_buffer(tb, ln->parent, buf);
 
 		if (!rc && is_last_child(ln))
@@ -633,7 +798,7 @@ int __cell_to_buffer(struct libscols_table *tb,
 			rc = buffer_append_data(buf, branch_symbol(tb));
 	}
 
-	if (!rc && (ln->parent || cl->is_groups) && !scols_table_is_json(tb))
+	if (!rc && (ln->parent || cl->is_groups) && !is_nested_format(tb))
 		buffer_set_art_index(buf);
 
 	if (!rc && data)
@@ -675,7 +840,7 @@ static int print_line(struct libscols_table *tb,
 	while (rc == 0 && pending) {
 		DBG(LINE, ul_debugobj(ln, "printing pending data"));
 		pending = 0;
-		fputs(linesep(tb), tb->out);
+		fput_str(tb, linesep(tb));
 		tb->termlines_used++;
 		scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
 		while (rc == 0 && scols_table_next_column(tb, &itr, &cl) == 0) {
@@ -779,14 +944,14 @@ int __scols_print_title(struct libscols_table *tb)
 	if (tb->colors_wanted && tb->title.color)
 		color = 1;
 	if (color)
-		fputs(tb->title.color, tb->out);
+		fput_str(tb, tb->title.color);
 
-	fputs(title, tb->out);
+	fput_str(tb, title);
 
 	if (color)
-		fputs(UL_COLOR_RESET, tb->out);
+		fput_str(tb, UL_COLOR_RESET);
 
-	fputc('\n', tb->out);
+	fput_char(tb, '\n');
 	rc = 0;
 done:
 	free(buf);
@@ -806,7 +971,7 @@ int __scols_print_header(struct libscols_table *tb, struct libscols_buffer *buf)
 	if ((tb->header_printed == 1 && tb->header_repeat == 0) ||
 	    scols_table_is_noheadings(tb) ||
 	    scols_table_is_export(tb) ||
-	    scols_table_is_json(tb) ||
+	    is_nested_format(tb) ||
 	    list_empty(&tb->tb_lines))
 		return 0;
 
@@ -836,7 +1001,7 @@ int __scols_print_header(struct libscols_table *tb, struct libscols_buffer *buf)
 	}
 
 	if (rc == 0) {
-		fputs(linesep(tb), tb->out);
+		fput_str(tb, linesep(tb));
 		tb->termlines_used++;
 	}
 
@@ -910,8 +1075,8 @@ static int print_tree_line(struct libscols_table *tb,
 		int last_in_tree = scols_walk_is_last(tb, ln);
 		int last;
 
-		/* terminate all open last children for JSON */
-		if (scols_table_is_json(tb)) {
+		/* terminate all open last children for JSON and CBOR */
+		if (is_nested_format(tb)) {
 			do {
 				last = (is_child(ln) && is_last_child(ln)) ||
 				       (is_tree_root(ln) && is_last_tree_root(tb, ln));
@@ -952,7 +1117,7 @@ static size_t strlen_line(struct libscols_line *ln)
 
 	for (i = 0; i < ln->ncells; i++) {
 		struct libscols_cell *ce = scols_line_get_cell(ln, i);
-		const char *data = ce ? scols_cell_get_data(ce) : NULL;
+		const char *data = ce ? scols_cell_get_output_data(ce) : NULL;
 
 		sz += data ? strlen(data) : 0;
 	}
@@ -973,20 +1138,15 @@ void __scols_cleanup_printing(struct libscols_table *tb, struct libscols_buffer
 	}
 }
 
-int __scols_initialize_printing(struct libscols_table *tb, struct libscols_buffer **buf)
+/* initialize symbols and terminal stuff, returns minimal buffer size */
+static int initialize_output(struct libscols_table *tb, size_t *bufsz)
 {
-	size_t bufsz, extra_bufsz = 0;
-	struct libscols_line *ln;
-	struct libscols_iter itr;
 	int rc;
 
-	DBG(TAB, ul_debugobj(tb, "initialize printing"));
-	*buf = NULL;
-
 	if (!tb->symbols) {
 		rc = scols_table_set_default_symbols(tb);
 		if (rc)
-			goto err;
+			return rc;
 		tb->priv_symbols = 1;
 	} else
 		tb->priv_symbols = 0;
@@ -1003,17 +1163,51 @@ int __scols_initialize_printing(struct libscols_table *tb, struct libscols_buffe
 			width -= tb->termreduce;
 			scols_table_set_termwidth(tb, width);
 		}
-		bufsz = width;
+		*bufsz = width;
 	} else
-		bufsz = BUFSIZ;
+		*bufsz = BUFSIZ;
 
 	if (!tb->is_term || tb->format != SCOLS_FMT_HUMAN || scols_table_is_tree(tb))
 		tb->header_repeat = 0;
+	return 0;
+}
+
+/* returns 1 if any visible column has datafunc() */
+static int has_datafunc(struct libscols_table *tb)
+{
+	struct libscols_column *cl;
+	struct libscols_iter itr;
+
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_column(tb, &itr, &cl) == 0) {
+		if (cl->datafunc && !scols_column_is_hidden(cl))
+			return 1;
+	}
+	return 0;
+}
+
+/* generates data for the visible columns, see scols_column_set_datafunc() */
+static void generate_line_data(struct libscols_table *tb, struct libscols_line *ln)
+{
+	struct libscols_column *cl;
+	struct libscols_iter itr;
+
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_column(tb, &itr, &cl) == 0) {
+		if (!scols_column_is_hidden(cl))
+			scols_column_generate_cell(cl, ln);
+	}
+}
+
+/*
+ * Estimate extra space necessary for tree, JSON or another output
+ * decoration.
+ */
+static size_t estimate_extra_bufsz(struct libscols_table *tb)
+{
+	size_t extra_bufsz = 0;
+	struct libscols_iter itr;
 
-	/*
-	 * Estimate extra space necessary for tree, JSON or another output
-	 * decoration.
-	 */
 	if (scols_table_is_tree(tb))
 		extra_bufsz += tb->nlines * strlen(vertical_symbol(tb));
 
@@ -1039,9 +1233,29 @@ int __scols_initialize_printing(struct libscols_table *tb, struct libscols_buffe
 		}
 		break;
 	}
+	case SCOLS_FMT_CBOR:
 	case SCOLS_FMT_HUMAN:
 		break;
 	}
+	return extra_bufsz;
+}
+
+int __scols_initialize_printing(struct libscols_table *tb, struct libscols_buffer **buf)
+{
+	size_t bufsz, extra_bufsz;
+	struct libscols_line *ln;
+	struct libscols_iter itr;
+	int rc, gen;
+
+	DBG(TAB, ul_debugobj(tb, "initialize printing"));
+	*buf = NULL;
+
+	rc = initialize_output(tb, &bufsz);
+	if (rc)
+		goto err;
+
+	extra_bufsz = estimate_extra_bufsz(tb);
+	gen = has_datafunc(tb);
 
 	/*
 	 * Enlarge buffer if necessary, the buffer should be large enough to
@@ -1051,6 +1265,8 @@ int __scols_initialize_printing(struct libscols_table *tb, struct libscols_buffe
 	while (scols_table_next_line(tb, &itr, &ln) == 0) {
 		size_t sz;
 
+		if (gen)
+			generate_line_data(tb, ln);
 		sz = strlen_line(ln) + extra_bufsz;
 		if (sz > bufsz)
 			bufsz = sz;
@@ -1080,3 +1296,171 @@ err:
 	return rc;
 }
 
+/*
+ * Streaming output -- the lines are printed and removed from the table when
+ * the next line is added (the previous line is complete at this time). The
+ * column widths cannot be calculated from data, so for human readable output
+ * all columns (except the last one) need a width hint.
+ */
+static int stream_is_possible(struct libscols_table *tb)
+{
+	struct libscols_column *cl;
+	struct libscols_iter itr;
+
+	if (scols_table_is_tree(tb) || has_groups(tb))
+		return 0;
+	if (tb->format != SCOLS_FMT_HUMAN)
+		return 1;
+
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_column(tb, &itr, &cl) == 0) {
+		if (scols_column_is_hidden(cl) || is_last_column(cl))
+			continue;
+		if (cl->width_hint <= 0)
+			return 0;
+	}
+	return 1;
+}
+
+/* set columns width according to the width hints */
+static void stream_set_widths(struct libscols_table *tb)
+{
+	struct libscols_column *cl;
+	struct libscols_iter itr;
+
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_column(tb, &itr, &cl) == 0) {
+		const char *hdr = scols_cell_get_data(&cl->header);
+
+		if (scols_column_is_hidden(cl))
+			continue;
+
+		if (cl->width_hint >= 1)
+			cl->width = (size_t) cl->width_hint;
+		else
+			cl->width = (size_t) (cl->width_hint *
+					scols_table_get_termwidth(tb));
+		if (hdr)
+			cl->width = max(cl->width, mbs_safe_width(hdr));
+		if (!cl->width)
+			cl->width = 1;
+	}
+}
+
+static int stream_start(struct libscols_table *tb)
+{
+	size_t bufsz;
+	int rc;
+
+	if (!stream_is_possible(tb)) {
+		DBG(TAB, ul_debugobj(tb, "streaming impossible -- disable"));
+		tb->streaming = 0;
+		return 0;
+	}
+
+	DBG(TAB, ul_debugobj(tb, "streaming start"));
+
+	rc = initialize_output(tb, &bufsz);
+	if (rc)
+		return rc;
+
+	tb->stream_extra = estimate_extra_bufsz(tb);
+	tb->stream_bufsz = bufsz;
+	tb->stream_buf = new_buffer(bufsz + 1);
+	if (!tb->stream_buf)
+		return -ENOMEM;
+
+	tb->stream_started = 1;
+	tb->header_printed = 0;
+
+	if (tb->format == SCOLS_FMT_HUMAN)
+		stream_set_widths(tb);
+
+	fput_table_open(tb);
+
+	if (tb->format == SCOLS_FMT_HUMAN)
+		__scols_print_title(tb);
+
+	return __scols_print_header(tb, tb->stream_buf);
+}
+
+/*
+ * Prints and removes lines from the table; the last line is kept (it
+ * may be still incomplete) if @all is zero.
+ */
+int __scols_stream_lines(struct libscols_table *tb, int all)
+{
+	int rc = 0;
+
+	if (!tb->streaming || list_empty(&tb->tb_lines))
+		return 0;
+
+	/* the lines are selected by the limit column, print all at the end */
+	if (tb->limit_column && !all)
+		return 0;
+
+	if (!tb->stream_started) {
+		rc = stream_start(tb);
+		if (rc || !tb->streaming)
+			return rc;
+	}
+
+	while (rc == 0 && !list_empty(&tb->tb_lines)) {
+		struct libscols_line *ln = list_entry(tb->tb_lines.next,
+					struct libscols_line, ln_lines);
+		int last = ln->ln_lines.next == &tb->tb_lines;
+		size_t sz;
+
+		if (last && !all)
+			break;
+
+		/* the next line may be removed by limit, so @ln may be the last */
+		if (!all && tb->limit_pending
+		    && ln->ln_lines.next == &tb->limit_pending->ln_lines)
+			break;
+
+		generate_line_data(tb, ln);
+
+		/* the buffer has to be large enough for the line data */
+		sz = strlen_line(ln) + tb->stream_extra;
+		if (sz > tb->stream_bufsz) {
+			free_buffer(tb->stream_buf);
+			tb->stream_buf = new_buffer(sz + 1);
+			if (!tb->stream_buf)
+				return -ENOMEM;
+			tb->stream_bufsz = sz;
+		}
+
+		fput_line_open(tb);
+		rc = print_line(tb, ln, tb->stream_buf);
+		fput_line_close(tb, last, last);
+
+		if (!last && want_repeat_header(tb))
+			__scols_print_header(tb, tb->stream_buf);
+
+		scols_table_remove_line(tb, ln);
+	}
+
+	fput_flush(tb);
+	return rc;
+}
+
+/* prints the rest of the lines and closes the output */
+int __scols_stream_finish(struct libscols_table *tb)
+{
+	int rc;
+
+	rc = __scols_stream_lines(tb, 1);
+	if (!tb->stream_started)
+		return rc;
+
+	DBG(TAB, ul_debugobj(tb, "streaming finish"));
+	fput_table_close(tb);
+	fput_flush(tb);
+
+	__scols_cleanup_printing(tb, tb->stream_buf);
+	tb->stream_buf = NULL;
+	tb->stream_bufsz = 0;
+	tb->stream_started = 0;
+	return rc;
+}
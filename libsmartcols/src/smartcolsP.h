@@ -16,6 +16,7 @@
 #include "strutils.h"
 #include "color-names.h"
 #include "debug.h"
+#include "debugtrace.h"
 
 #include "libsmartcols.h"
 
@@ -30,11 +31,16 @@
 #define SCOLS_DEBUG_COL		(1 << 5)
 #define SCOLS_DEBUG_BUFF	(1 << 6)
 #define SCOLS_DEBUG_GROUP	(1 << 7)
+#define SCOLS_DEBUG_ARENA	(1 << 8)
 #define SCOLS_DEBUG_ALL		0xFFFF
 
 UL_DEBUG_DECLARE_MASK(libsmartcols);
 #define DBG(m, x)	__UL_DBG(libsmartcols, SCOLS_DEBUG_, m, x)
 #define ON_DBG(m, x)	__UL_DBG_CALL(libsmartcols, SCOLS_DEBUG_, m, x)
+
+UL_TRACE_DECLARE(libsmartcols);
+#define TRACE_SCOPE(m, n)	__UL_TRACE_SCOPE(libsmartcols, SCOLS_DEBUG_, m, n)
+#define TRACE_COUNT(m, n, x)	__UL_TRACE_COUNT(libsmartcols, SCOLS_DEBUG_, m, n, x)
 #define DBG_FLUSH	__UL_DBG_FLUSH(libsmartcols, SCOLS_DEBUG_)
 
 #define UL_DEBUG_CURRENT_MASK	UL_DEBUG_MASK(libsmartcols)
@@ -79,8 +85,32 @@ struct libscols_cell {
 	char	*color;
 	void    *userdata;
 	int	flags;
+
+	size_t	width;		/* cached scols_cell_get_safe_width() */
+
+	union {
+		uint64_t	u64;
+		int64_t		s64;
+		double		fl;
+	} num;			/* binary data, see SCOLS_DATA_* */
+
+	unsigned int	in_arena : 1,		/* the cell is allocated in arena */
+			data_arena : 1,		/* data allocated in arena */
+			color_arena : 1,	/* color interned in arena */
+			width_valid : 1,	/* width and is_safe are valid */
+			is_safe : 1,		/* data does not need encoding */
+			datatype : 2,		/* SCOLS_DATA_* */
+			data_formatted : 1,	/* data generated from num */
+			data_generated : 1;	/* column datafunc() already called */
 };
 
+extern size_t scols_cell_get_safe_width(struct libscols_cell *ce);
+extern int scols_cell_is_safe(struct libscols_cell *ce);
+extern const char *scols_cell_get_output_data(struct libscols_cell *ce);
+extern uint64_t scols_cell_get_numkey(const struct libscols_cell *ce);
+
+extern void scols_column_generate_cell(struct libscols_column *cl, struct libscols_line *ln);
+
 extern int scols_line_move_cells(struct libscols_line *ln, size_t newn, size_t oldn);
 
 /*
@@ -121,6 +151,9 @@ struct libscols_column {
 			char *, void *);
 	void *wrapfunc_data;
 
+	char *(*datafunc)(struct libscols_column *,
+			struct libscols_line *, void *);	/* lazy cells data */
+	void *datafunc_data;
 
 	struct libscols_cell	header;
 	struct list_head	cl_columns;
@@ -184,13 +217,21 @@ struct libscols_line {
 	struct libscols_line	*parent;
 	struct libscols_group	*parent_group;	/* for group childs */
 	struct libscols_group	*group;		/* for group members */
+
+	struct libscols_arena	*arena;		/* memory pool or NULL */
+	size_t			limit_pos;	/* index in table->limit_heap + 1, or 0 */
+
+	unsigned int	slab : 1,		/* the line is allocated in arena */
+			cells_arena : 1,	/* cells allocated in arena */
+			color_arena : 1;	/* color interned in arena */
 };
 
 enum {
 	SCOLS_FMT_HUMAN = 0,		/* default, human readable */
 	SCOLS_FMT_RAW,			/* space separated */
 	SCOLS_FMT_EXPORT,		/* COLNAME="data" ... */
-	SCOLS_FMT_JSON			/* http://en.wikipedia.org/wiki/JSON */
+	SCOLS_FMT_JSON,			/* http://en.wikipedia.org/wiki/JSON */
+	SCOLS_FMT_CBOR			/* RFC 8949, see fput.c */
 };
 
 /*
@@ -207,6 +248,10 @@ struct libscols_table {
 	size_t  termreduce;	/* extra blank space */
 	int	termforce;	/* SCOLS_TERMFORCE_* */
 	FILE	*out;		/* output stream */
+	char	*outbuf;	/* output buffer, see fput.c */
+	size_t	outbuf_used;
+
+	struct libscols_arena	*arena;	/* memory pool for lines */
 
 	char	*colsep;	/* column separator */
 	char	*linesep;	/* line separator */
@@ -221,6 +266,11 @@ struct libscols_table {
 	size_t			ngrpchlds_pending;	/* groups with not yet printed children */
 	struct libscols_line	*walk_last_tree_root;	/* last root, used by scols_walk_() */
 
+	char			*walk_art;	/* tree ASCII-art prefix of walk_art_line children */
+	size_t			walk_artsz;	/* used bytes */
+	size_t			walk_artmax;	/* allocated bytes */
+	struct libscols_line	*walk_art_line;
+
 	struct libscols_symbols	*symbols;
 	struct libscols_cell	title;		/* optional table title (for humans) */
 
@@ -231,6 +281,18 @@ struct libscols_table {
 	size_t	termlines_used;	/* printed line counter */
 	size_t	header_next;	/* where repeat header */
 
+	struct libscols_buffer *stream_buf;	/* streaming output buffer */
+	size_t	stream_bufsz;	/* size of stream_buf */
+	size_t	stream_extra;	/* extra space for output decoration */
+
+	size_t	limit;		/* max number of lines, see limit.c */
+	size_t	limit_nlines;	/* number of accepted lines */
+	size_t	limit_seq;	/* insertion order counter */
+	struct libscols_column		*limit_column;	/* keep the first lines in order */
+	struct libscols_limit_entry	*limit_heap;	/* accepted lines */
+	size_t				limit_heapsz;	/* allocated entries */
+	struct libscols_line		*limit_pending;	/* not yet selected line */
+
 	/* flags */
 	unsigned int	ascii		:1,	/* don't use unicode */
 			colors_wanted	:1,	/* enable colors */
@@ -246,7 +308,9 @@ struct libscols_table {
 			no_headings	:1,	/* don't print header */
 			no_encode	:1,	/* don't care about control and non-printable chars */
 			no_linesep	:1,	/* don't print line separator */
-			no_wrap		:1;	/* never wrap lines */
+			no_wrap		:1,	/* never wrap lines */
+			streaming	:1,	/* print lines when added */
+			stream_started	:1;	/* streamed output already opened */
 };
 
 #define IS_ITER_FORWARD(_i)	((_i)->direction == SCOLS_ITER_FORWARD)
@@ -290,6 +354,24 @@ int scols_table_next_group(struct libscols_table *tb,
                           struct libscols_iter *itr,
                           struct libscols_group **gr);
 
+/*
+ * arena.c
+ */
+struct libscols_arena;
+
+extern struct libscols_arena *new_arena(void);
+extern void ref_arena(struct libscols_arena *ar);
+extern void unref_arena(struct libscols_arena *ar);
+extern struct libscols_arena *arena_of(const void *p);
+extern void *arena_alloc(struct libscols_arena *ar, size_t sz);
+extern char *arena_strdup(struct libscols_arena *ar, const char *str);
+extern void arena_release(void *p);
+extern char *arena_intern(struct libscols_arena *ar, const char *str);
+extern struct libscols_line *arena_get_line(struct libscols_arena *ar);
+extern void arena_put_line(struct libscols_arena *ar, struct libscols_line *ln);
+
+extern struct libscols_line *scols_new_arena_line(struct libscols_arena *ar);
+
 /*
  * buffer.c
  */
@@ -307,6 +389,13 @@ extern char *buffer_get_safe_data(struct libscols_table *tb,
 				  struct libscols_buffer *buf,
 				  size_t *cells,
 				  const char *safechars);
+extern char *buffer_get_safe_cell_data(struct libscols_table *tb,
+				       struct libscols_buffer *buf,
+				       struct libscols_cell *ce,
+				       size_t *cells,
+				       const char *safechars);
+extern size_t buffer_get_safe_cell_width(struct libscols_buffer *buf,
+					 struct libscols_cell *ce);
 extern size_t buffer_get_safe_art_size(struct libscols_buffer *buf);
 
 /*
@@ -333,6 +422,16 @@ extern int scols_walk_tree(struct libscols_table *tb,
                     void *data);
 extern int scols_walk_is_last(struct libscols_table *tb, struct libscols_line *ln);
 
+/*
+ * limit.c
+ */
+struct libscols_limit_entry;
+
+extern int __scols_limit_add_line(struct libscols_table *tb, struct libscols_line *ln);
+extern void __scols_limit_remove_line(struct libscols_table *tb, struct libscols_line *ln);
+extern int __scols_limit_finish(struct libscols_table *tb);
+extern void __scols_limit_reset(struct libscols_table *tb);
+
 /*
  * calculate.c
  */
@@ -345,6 +444,7 @@ extern int __cell_to_buffer(struct libscols_table *tb,
                           struct libscols_line *ln,
                           struct libscols_column *cl,
                           struct libscols_buffer *buf);
+extern int __scols_walk_push_art(struct libscols_table *tb, struct libscols_line *ln);
 
 void __scols_cleanup_printing(struct libscols_table *tb, struct libscols_buffer *buf);
 int __scols_initialize_printing(struct libscols_table *tb, struct libscols_buffer **buf);
@@ -352,6 +452,8 @@ int __scols_print_tree(struct libscols_table *tb, struct libscols_buffer *buf);
 int __scols_print_table(struct libscols_table *tb, struct libscols_buffer *buf);
 int __scols_print_header(struct libscols_table *tb, struct libscols_buffer *buf);
 int __scols_print_title(struct libscols_table *tb);
+int __scols_stream_lines(struct libscols_table *tb, int all);
+int __scols_stream_finish(struct libscols_table *tb);
 int __scols_print_range(struct libscols_table *tb,
                         struct libscols_buffer *buf,
                         struct libscols_iter *itr,
@@ -360,6 +462,57 @@ int __scols_print_range(struct libscols_table *tb,
 /*
  * fput.c
  */
+#define SCOLS_OUTBUF_SIZE	(16 * 1024)
+
+extern void fput_flush(struct libscols_table *tb);
+extern void fput_write_slow(struct libscols_table *tb, const char *data, size_t sz);
+extern void fput_printf(struct libscols_table *tb, const char *fmt, ...)
+			__attribute__ ((__format__ (__printf__, 2, 3)));
+extern void fput_nonblank(struct libscols_table *tb, const char *data);
+extern void fput_quoted(struct libscols_table *tb, const char *data);
+extern void fput_quoted_json(struct libscols_table *tb, const char *data, int dir);
+
+static inline void fput_write(struct libscols_table *tb, const char *data, size_t sz)
+{
+	if (tb->outbuf && tb->outbuf_used + sz <= SCOLS_OUTBUF_SIZE) {
+		memcpy(tb->outbuf + tb->outbuf_used, data, sz);
+		tb->outbuf_used += sz;
+	} else
+		fput_write_slow(tb, data, sz);
+}
+
+static inline void fput_str(struct libscols_table *tb, const char *str)
+{
+	fput_write(tb, str, strlen(str));
+}
+
+static inline void fput_char(struct libscols_table *tb, char c)
+{
+	if (tb->outbuf && tb->outbuf_used < SCOLS_OUTBUF_SIZE)
+		tb->outbuf[tb->outbuf_used++] = c;
+	else
+		fput_write_slow(tb, &c, 1);
+}
+
+/* CBOR major types and special bytes */
+#define SCOLS_CBOR_UINT		0
+#define SCOLS_CBOR_NEGINT	1
+#define SCOLS_CBOR_BYTES	2
+#define SCOLS_CBOR_TEXT		3
+#define SCOLS_CBOR_ARRAY	4
+#define SCOLS_CBOR_MAP		5
+
+#define SCOLS_CBOR_FALSE	0xf4
+#define SCOLS_CBOR_TRUE		0xf5
+#define SCOLS_CBOR_NULL		0xf6
+#define SCOLS_CBOR_FLOAT64	0xfb
+#define SCOLS_CBOR_ARRAY_INDEF	0x9f
+#define SCOLS_CBOR_MAP_INDEF	0xbf
+#define SCOLS_CBOR_BREAK	0xff
+
+extern void fput_cbor_head(struct libscols_table *tb, int major, uint64_t n);
+extern void fput_cbor_string(struct libscols_table *tb, const char *data);
+
 extern void fput_indent(struct libscols_table *tb);
 extern void fput_table_open(struct libscols_table *tb);
 extern void fput_table_close(struct libscols_table *tb);
@@ -450,6 +603,12 @@ static inline int is_group_child(struct libscols_line *ln)
 	return ln && ln->parent_group;
 }
 
+/* JSON or CBOR; the tree is printed as nested objects, without ascii art */
+static inline int is_nested_format(struct libscols_table *tb)
+{
+	return tb->format == SCOLS_FMT_JSON || tb->format == SCOLS_FMT_CBOR;
+}
+
 static inline int has_groups(struct libscols_table *tb)
 {
 	return tb && !list_empty(&tb->tb_groups);
@@ -77,6 +77,12 @@ struct libscols_table *scols_new_table(void)
 	tb->refcount = 1;
 	tb->out = stdout;
 
+	tb->arena = new_arena();
+	if (!tb->arena) {
+		free(tb);
+		return NULL;
+	}
+
 	get_terminal_dimension(&c, &l);
 	tb->termwidth  = c > 0 ? c : 80;
 	tb->termheight = l > 0 ? l : 24;
@@ -128,9 +134,14 @@ void scols_unref_table(struct libscols_table *tb)
 		scols_table_remove_groups(tb);
 		scols_table_remove_lines(tb);
 		scols_table_remove_columns(tb);
+		__scols_limit_reset(tb);
+		unref_arena(tb->arena);
 		scols_unref_symbols(tb->symbols);
 		scols_reset_cell(&tb->title);
+		free_buffer(tb->stream_buf);
+		free(tb->outbuf);
 		free(tb->grpset);
+		free(tb->walk_art);
 		free(tb->linesep);
 		free(tb->colsep);
 		free(tb->name);
@@ -539,6 +550,7 @@ int scols_table_set_stream(struct libscols_table *tb, FILE *stream)
 		return -EINVAL;
 
 	DBG(TAB, ul_debugobj(tb, "setting alternative stream"));
+	fput_flush(tb);
 	tb->out = stream;
 	return 0;
 }
@@ -627,6 +639,12 @@ int scols_table_add_line(struct libscols_table *tb, struct libscols_line *ln)
 	if (!list_empty(&ln->ln_lines))
 		return -EINVAL;
 
+	/* use table memory pool for the line cells */
+	if (!ln->arena) {
+		ln->arena = tb->arena;
+		ref_arena(ln->arena);
+	}
+
 	if (tb->ncols > ln->ncells) {
 		int rc = scols_line_alloc_cells(ln, tb->ncols);
 		if (rc)
@@ -637,6 +655,17 @@ int scols_table_add_line(struct libscols_table *tb, struct libscols_line *ln)
 	list_add_tail(&ln->ln_lines, &tb->tb_lines);
 	ln->seqnum = tb->nlines++;
 	scols_ref_line(ln);
+
+	/* select the previous (already complete) line */
+	if (tb->limit) {
+		int rc = __scols_limit_add_line(tb, ln);
+		if (rc)
+			return rc;
+	}
+
+	/* print the previous (already complete) lines */
+	if (tb->streaming)
+		return __scols_stream_lines(tb, 0);
 	return 0;
 }
 
@@ -657,6 +686,8 @@ int scols_table_remove_line(struct libscols_table *tb,
 		return -EINVAL;
 
 	DBG(TAB, ul_debugobj(tb, "remove line"));
+	if (tb->limit)
+		__scols_limit_remove_line(tb, ln);
 	list_del_init(&ln->ln_lines);
 	tb->nlines--;
 	scols_unref_line(ln);
@@ -682,6 +713,9 @@ void scols_table_remove_lines(struct libscols_table *tb)
 			scols_line_remove_child(ln->parent, ln);
 		scols_table_remove_line(tb, ln);
 	}
+
+	/* the first lines are accepted again */
+	tb->limit_nlines = 0;
 }
 
 /**
@@ -736,7 +770,7 @@ struct libscols_line *scols_table_new_line(struct libscols_table *tb,
 	if (!tb)
 		return NULL;
 
-	ln = scols_new_line();
+	ln = scols_new_arena_line(tb->arena);
 	if (!ln)
 		return NULL;
 
@@ -1066,6 +1100,35 @@ int scols_table_enable_json(struct libscols_table *tb, int enable)
 	return 0;
 }
 
+/**
+ * scols_table_enable_cbor:
+ * @tb: table
+ * @enable: 1 or 0
+ *
+ * Enable/disable CBOR (RFC 8949) binary output format. The table is
+ * printed as a map with table name, columns names and types, and lines.
+ * The lines are arrays of the values; the numbers (see scols_cell_set_u64()
+ * and SCOLS_JSON_NUMBER) are encoded as binary numbers. The children of the
+ * line in tree are stored in the extra last item of the line array. The
+ * parsable output formats (export, raw, JSON, ...) are mutually exclusive.
+ *
+ * Returns: 0 on success, negative number in case of an error.
+ *
+ * Since: 2.36
+ */
+int scols_table_enable_cbor(struct libscols_table *tb, int enable)
+{
+	if (!tb)
+		return -EINVAL;
+
+	DBG(TAB, ul_debugobj(tb, "cbor: %s", enable ? "ENABLE" : "DISABLE"));
+	if (enable)
+		tb->format = SCOLS_FMT_CBOR;
+	else if (tb->format == SCOLS_FMT_CBOR)
+		tb->format = 0;
+	return 0;
+}
+
 /**
  * scols_table_enable_export:
  * @tb: table
@@ -1232,6 +1295,105 @@ int scols_table_is_nowrap(const struct libscols_table *tb)
 	return tb->no_wrap;
 }
 
+/**
+ * scols_table_enable_streaming:
+ * @tb: table
+ * @enable: 1 or 0
+ *
+ * Enable streaming output. The lines are printed immediately when the next
+ * line is added to the table and then removed from the table (and
+ * deallocated if there is no another reference to the line), so the memory
+ * usage does not depend on number of lines. The last line is printed by
+ * scols_print_table(). It means that the line has to be completely filled
+ * before the next line is added.
+ *
+ * The streaming is possible for raw, export and JSON output, and for human
+ * readable output if all columns (except the last one) have the width hint.
+ * The streaming is silently disabled for trees. The columns and output
+ * format cannot be modified after the first line is printed.
+ *
+ * Returns: 0 on success, negative number in case of an error.
+ *
+ * Since: 2.36
+ */
+int scols_table_enable_streaming(struct libscols_table *tb, int enable)
+{
+	if (!tb || tb->stream_started)
+		return -EINVAL;
+	DBG(TAB, ul_debugobj(tb, "streaming: %s", enable ? "ENABLE" : "DISABLE"));
+	tb->streaming = enable ? 1 : 0;
+	return 0;
+}
+
+/**
+ * scols_table_is_streaming:
+ * @tb: a pointer to a struct libscols_table instance
+ *
+ * Returns: 1 if streaming output is enabled.
+ *
+ * Since: 2.36
+ */
+int scols_table_is_streaming(const struct libscols_table *tb)
+{
+	return tb->streaming;
+}
+
+/**
+ * scols_table_set_limit:
+ * @tb: table
+ * @limit: maximal number of lines or 0 for unlimited
+ * @cl: order by this column or NULL
+ *
+ * Limits number of lines in the table. The line is selected when the next
+ * line is added to the table and the lines out of the limit are removed from
+ * the table (and deallocated if there is no another reference to the line),
+ * so the memory usage depends on @limit rather than on number of added
+ * lines. It means that the line has to be completely filled before the next
+ * line is added, the same as for streaming output.
+ *
+ * Without @cl the first @limit lines are kept. With @cl the first @limit
+ * lines in order defined by the column compare function are kept, and the
+ * table is sorted by the column before it is printed; the result is the
+ * same as scols_sort_table() for all lines and print of the first @limit
+ * lines. The streaming output is printed by scols_print_table() in this case.
+ *
+ * The limit is ignored for trees and group lines are never removed. The
+ * limit has to be set before the first line is added to the table.
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.36
+ */
+int scols_table_set_limit(struct libscols_table *tb, size_t limit,
+			  struct libscols_column *cl)
+{
+	if (!tb || !list_empty(&tb->tb_lines) || (cl && !cl->cmpfunc))
+		return -EINVAL;
+
+	DBG(TAB, ul_debugobj(tb, "set limit: %zu", limit));
+	__scols_limit_reset(tb);
+
+	tb->limit = limit;
+	if (limit && cl) {
+		scols_ref_column(cl);
+		tb->limit_column = cl;
+	}
+	return 0;
+}
+
+/**
+ * scols_table_get_limit:
+ * @tb: a pointer to a struct libscols_table instance
+ *
+ * Returns: maximal number of lines or 0 for unlimited table.
+ *
+ * Since: 2.36
+ */
+size_t scols_table_get_limit(const struct libscols_table *tb)
+{
+	return tb->limit;
+}
+
 /**
  * scols_table_enable_noencoding:
  * @tb: table
@@ -1344,6 +1506,19 @@ int scols_table_is_raw(const struct libscols_table *tb)
 	return tb->format == SCOLS_FMT_RAW;
 }
 
+/**
+ * scols_table_is_cbor:
+ * @tb: table
+ *
+ * Returns: 1 if CBOR output format is enabled.
+ *
+ * Since: 2.36
+ */
+int scols_table_is_cbor(const struct libscols_table *tb)
+{
+	return tb->format == SCOLS_FMT_CBOR;
+}
+
 /**
  * scols_table_is_json:
  * @tb: table
@@ -1478,6 +1653,101 @@ static int cells_cmp_wrapper_children(struct list_head *a, struct list_head *b,
 }
 
 
+struct sort_key {
+	uint64_t		key;		/* scols_cell_get_numkey() */
+	unsigned int		type;		/* SCOLS_DATA_* */
+	struct list_head	*p;
+};
+
+/* one pass of LSD radix sort, returns 0 if the pass is unnecessary */
+static int radix_pass(struct sort_key *src, struct sort_key *dst, size_t n,
+		      unsigned int shift)
+{
+	size_t count[256] = { 0 }, i, sum;
+
+#define sort_key_digit(_k) \
+	(shift < 64 ? ((_k)->key >> shift) & 0xff : (_k)->type)
+
+	for (i = 0; i < n; i++)
+		count[sort_key_digit(&src[i])]++;
+	if (count[sort_key_digit(&src[0])] == n)
+		return 0;
+
+	for (sum = 0, i = 0; i < ARRAY_SIZE(count); i++) {
+		size_t x = count[i];
+		count[i] = sum;
+		sum += x;
+	}
+	for (i = 0; i < n; i++)
+		dst[count[sort_key_digit(&src[i])]++] = src[i];
+#undef sort_key_digit
+	return 1;
+}
+
+/*
+ * Sorts lines by binary data of the cells in the same order as
+ * scols_cmpnum_cells(). The sort is stable as list_sort().
+ */
+static int sort_lines_by_number(struct list_head *head,
+				struct libscols_column *cl, int children)
+{
+	struct sort_key *keys, *src, *dst;
+	struct list_head *p;
+	unsigned int shift;
+	size_t n = 0, i;
+
+	list_for_each(p, head)
+		n++;
+	if (n < 2)
+		return 0;
+
+	keys = malloc(2 * n * sizeof(struct sort_key));
+	if (!keys)
+		return -ENOMEM;
+
+	i = 0;
+	list_for_each(p, head) {
+		struct libscols_line *ln = children ?
+				list_entry(p, struct libscols_line, ln_children) :
+				list_entry(p, struct libscols_line, ln_lines);
+		struct libscols_cell *ce = scols_line_get_cell(ln, cl->seqnum);
+		int type = scols_cell_get_datatype(ce);
+
+		keys[i].type = type;
+		keys[i].key = type ? scols_cell_get_numkey(ce) : 0;
+		keys[i].p = p;
+		i++;
+	}
+
+	/* the type is the most significant digit */
+	src = keys, dst = keys + n;
+	for (shift = 0; shift <= 64; shift += 8) {
+		if (radix_pass(src, dst, n, shift)) {
+			struct sort_key *x = src;
+			src = dst;
+			dst = x;
+		}
+	}
+
+	INIT_LIST_HEAD(head);
+	for (i = 0; i < n; i++)
+		list_add_tail(src[i].p, head);
+
+	free(keys);
+	return 0;
+}
+
+static void sort_lines(struct list_head *head, struct libscols_column *cl,
+		       int children)
+{
+	if (cl->cmpfunc == scols_cmpnum_cells
+	    && sort_lines_by_number(head, cl, children) == 0)
+		return;
+
+	list_sort(head, children ? cells_cmp_wrapper_children :
+				   cells_cmp_wrapper_lines, cl);
+}
+
 static int sort_line_children(struct libscols_line *ln, struct libscols_column *cl)
 {
 	struct list_head *p;
@@ -1489,7 +1759,7 @@ static int sort_line_children(struct libscols_line *ln, struct libscols_column *
 			sort_line_children(chld, cl);
 		}
 
-		list_sort(&ln->ln_branch, cells_cmp_wrapper_children, cl);
+		sort_lines(&ln->ln_branch, cl, 1);
 	}
 
 	if (is_first_group_member(ln)) {
@@ -1499,7 +1769,7 @@ static int sort_line_children(struct libscols_line *ln, struct libscols_column *
 			sort_line_children(chld, cl);
 		}
 
-		list_sort(&ln->group->gr_children, cells_cmp_wrapper_children, cl);
+		sort_lines(&ln->group->gr_children, cl, 1);
 	}
 
 	return 0;
@@ -1513,6 +1783,9 @@ static int sort_line_children(struct libscols_line *ln, struct libscols_column *
  * Orders the table by the column. See also scols_column_set_cmpfunc(). If the
  * tree output is enabled then children in the tree are recursively sorted too.
  *
+ * The columns with scols_cmpnum_cells() compare function are sorted by
+ * binary data of the cells (see scols_cell_set_u64()) by radix sort.
+ *
  * Returns: 0, a negative value in case of an error.
  */
 int scols_sort_table(struct libscols_table *tb, struct libscols_column *cl)
@@ -1521,7 +1794,17 @@ int scols_sort_table(struct libscols_table *tb, struct libscols_column *cl)
 		return -EINVAL;
 
 	DBG(TAB, ul_debugobj(tb, "sorting table"));
-	list_sort(&tb->tb_lines, cells_cmp_wrapper_lines, cl);
+
+	if (cl->datafunc) {
+		struct libscols_line *ln;
+		struct libscols_iter itr;
+
+		scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+		while (scols_table_next_line(tb, &itr, &ln) == 0)
+			scols_column_generate_cell(cl, ln);
+	}
+
+	sort_lines(&tb->tb_lines, cl, 0);
 
 	if (scols_table_is_tree(tb)) {
 		struct libscols_line *ln;
@@ -24,18 +24,28 @@ static int walk_line(struct libscols_table *tb,
 
 	/* children */
 	if (rc == 0 && has_children(ln)) {
+		struct libscols_line *art_line = tb->walk_art_line;
+		size_t art_sz = tb->walk_artsz;
 		struct list_head *p;
 
 		DBG(LINE, ul_debugobj(ln, " children walk"));
 
+		rc = __scols_walk_push_art(tb, ln);
+
 		list_for_each(p, &ln->ln_branch) {
 			struct libscols_line *chld = list_entry(p,
 					struct libscols_line, ln_children);
 
-			rc = walk_line(tb, chld, cl, callback, data);
 			if (rc)
 				break;
+			rc = walk_line(tb, chld, cl, callback, data);
 		}
+
+		/* restore prefix of the parent */
+		tb->walk_art_line = art_line;
+		tb->walk_artsz = art_sz;
+		if (tb->walk_art)
+			tb->walk_art[art_sz] = '\0';
 	}
 
 	DBG(LINE, ul_debugobj(ln, "<- walk line done [rc=%d]", rc));
@@ -96,6 +106,8 @@ int scols_walk_tree(struct libscols_table *tb,
 	tb->ngrpchlds_pending = 0;
 	tb->walk_last_tree_root = NULL;
 	tb->walk_last_done = 0;
+	tb->walk_art_line = NULL;
+	tb->walk_artsz = 0;
 
 	if (has_groups(tb))
 		scols_groups_reset_state(tb);
@@ -147,6 +159,7 @@ int scols_walk_tree(struct libscols_table *tb,
 
 	tb->ngrpchlds_pending = 0;
 	tb->walk_last_done = 0;
+	tb->walk_art_line = NULL;
 	DBG(TAB, ul_debugobj(tb, "<< walk end [rc=%d]", rc));
 	return rc;
 }
@@ -56,6 +56,10 @@
 #ifdef HAVE_SYS_FILE_H
 #include <sys/file.h>
 #endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <pthread.h>
+#endif
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
@@ -96,6 +100,36 @@
 #define THREAD_LOCAL static
 #endif
 
+/*
+ * Fork generation, incremented in the child after fork(). The per-process
+ * state (entropy pool, uuidd connection, time UUID ranges) is not used if
+ * the generation has been changed.
+ */
+#ifndef _WIN32
+static unsigned int fork_gen;
+
+static void atfork_child(void)
+{
+	__atomic_add_fetch(&fork_gen, 1, __ATOMIC_RELAXED);
+}
+
+static void init_atfork(void)
+{
+	static int registered;
+
+	if (!__atomic_exchange_n(&registered, 1, __ATOMIC_ACQ_REL))
+		pthread_atfork(NULL, NULL, atfork_child);
+}
+
+static inline unsigned int get_fork_gen(void)
+{
+	return __atomic_load_n(&fork_gen, __ATOMIC_RELAXED);
+}
+#else
+# define init_atfork()		do { } while (0)
+# define get_fork_gen()		0
+#endif
+
 #ifdef _WIN32
 static void gettimeofday (struct timeval *tv, void *dummy)
 {
@@ -210,6 +244,226 @@ static int get_node_id(unsigned char *node_id)
 /* Assume that the gettimeofday() has microsecond granularity */
 #define MAX_ADJUSTMENT 10
 
+/* number of clock sequence changes, see __uuid_get_clock_bumps() */
+static unsigned long clock_bumps;
+
+/* for uuidd statistics */
+unsigned long __uuid_get_clock_bumps(void)
+{
+	return __atomic_load_n(&clock_bumps, __ATOMIC_RELAXED);
+}
+
+#ifndef _WIN32
+/*
+ * Shared memory clock state; enabled by LIBUUID_CLOCK_SHM=<path> environment
+ * variable (e.g. /dev/shm/libuuid-clock). It has to be used by all processes
+ * which generate time based UUIDs on the host.
+ *
+ * The last used timestamp is updated by atomic compare-and-swap, so the
+ * processes are not serialized by flock() on LIBUUID_CLOCK_FILE. The clock
+ * never goes backwards -- if the system time is lower than the last used
+ * timestamp, then the next timestamp is used. It means that the clock
+ * sequence is modified only when the shared state is created (usually after
+ * reboot) and the clock file seems to be newer than the current time.
+ *
+ * The state is saved to LIBUUID_CLOCK_FILE every CLOCK_SHM_PERSIST ticks (100ns
+ * units), so it survives reboot.
+ */
+#define CLOCK_SHM_MAGIC		0x75756964	/* "uuid" */
+#define CLOCK_SHM_PERSIST	(10 * 10000000ULL)
+
+struct clock_shm {
+	uint32_t	magic;		/* CLOCK_SHM_MAGIC if initialized */
+	uint16_t	clock_seq;
+	uint16_t	reserved;
+	uint64_t	last;		/* last used timestamp */
+	uint64_t	persist;	/* last write to LIBUUID_CLOCK_FILE */
+};
+
+#define CLOCK_OFFSET	((((uint64_t) TIME_OFFSET_HIGH) << 32) + TIME_OFFSET_LOW)
+
+static uint64_t get_clock_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t) tv.tv_sec * 10000000 + tv.tv_usec * 10 + CLOCK_OFFSET;
+}
+
+/* the same format as get_clock() uses */
+static int read_clock_file(uint16_t *clock_seq, uint64_t *clock_reg)
+{
+	unsigned int cl;
+	unsigned long tv1, tv2;
+	int a, rc = -1;
+	FILE *f = fopen(LIBUUID_CLOCK_FILE, "r" UL_CLOEXECSTR);
+
+	if (!f)
+		return -1;
+	if (fscanf(f, "clock: %04x tv: %lu %lu adj: %d\n",
+		   &cl, &tv1, &tv2, &a) == 4) {
+		*clock_seq = cl & 0x3FFF;
+		*clock_reg = (uint64_t) tv1 * 10000000 + tv2 * 10 + a + CLOCK_OFFSET;
+		rc = 0;
+	}
+	fclose(f);
+	return rc;
+}
+
+static void write_clock_file(uint16_t clock_seq, uint64_t clock_reg)
+{
+	char buf[64];
+	uint64_t t = clock_reg - CLOCK_OFFSET;
+	mode_t save_umask;
+	int fd, len;
+
+	save_umask = umask(0);
+	fd = open(LIBUUID_CLOCK_FILE, O_WRONLY|O_CREAT|O_CLOEXEC, 0660);
+	(void) umask(save_umask);
+	if (fd < 0)
+		return;
+
+	len = snprintf(buf, sizeof(buf), "clock: %04x tv: %016ld %08ld adj: %08d\n",
+		       clock_seq, (long) (t / 10000000),
+		       (long) (t / 10 % 1000000), (int) (t % 10));
+
+	if (flock(fd, LOCK_EX) == 0) {
+		if (write_all(fd, buf, len) == 0)
+			ignore_result( ftruncate(fd, len) );
+		flock(fd, LOCK_UN);
+	}
+	close(fd);
+}
+
+/* initialize the state, the file is locked by caller */
+static void init_clock_shm(struct clock_shm *shm)
+{
+	uint64_t now = get_clock_now(), last;
+	uint16_t clock_seq;
+
+	if (read_clock_file(&clock_seq, &last) == 0) {
+		/* the clock file is not up to date, it may be newer than now */
+		if (now <= last + CLOCK_SHM_PERSIST) {
+			clock_seq = (clock_seq + 1) & 0x3FFF;
+			__atomic_add_fetch(&clock_bumps, 1, __ATOMIC_RELAXED);
+		}
+	} else {
+		random_get_bytes(&clock_seq, sizeof(clock_seq));
+		clock_seq &= 0x3FFF;
+	}
+
+	shm->clock_seq = clock_seq;
+	shm->last = 0;
+	shm->persist = 0;		/* save the new clock sequence ASAP */
+	__atomic_store_n(&shm->magic, CLOCK_SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+static struct clock_shm *open_clock_shm(void)
+{
+	struct clock_shm *shm = NULL;
+	const char *path;
+	struct stat st;
+	mode_t save_umask;
+	int fd;
+
+#ifdef HAVE_SECURE_GETENV
+	path = secure_getenv("LIBUUID_CLOCK_SHM");
+#else
+	path = getuid() == geteuid() ? getenv("LIBUUID_CLOCK_SHM") : NULL;
+#endif
+	if (!path || !*path)
+		return NULL;
+
+	save_umask = umask(0);
+	fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC|O_NOFOLLOW, 0660);
+	(void) umask(save_umask);
+	if (fd < 0)
+		return NULL;
+
+	while (flock(fd, LOCK_EX) < 0) {
+		if (errno != EAGAIN && errno != EINTR)
+			goto done;
+	}
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+		goto done;
+	if ((size_t) st.st_size < sizeof(*shm) && ftruncate(fd, sizeof(*shm)) != 0)
+		goto done;
+
+	shm = mmap(NULL, sizeof(*shm), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED)
+		shm = NULL;
+	else if (shm->magic != CLOCK_SHM_MAGIC)
+		init_clock_shm(shm);
+done:
+	close(fd);		/* unlock */
+	return shm;
+}
+
+/*
+ * Get clock from the shared memory state, see get_clock().
+ *
+ * Returns -1 if the shared state is not enabled or usable.
+ */
+static int get_clock_shm(uint32_t *clock_high, uint32_t *clock_low,
+			 uint16_t *ret_clock_seq, int *num)
+{
+	THREAD_LOCAL struct clock_shm	*shm;
+	THREAD_LOCAL int		shm_state = -2;
+	uint64_t			now, last, persist, clock_reg, n;
+
+	if (shm_state == -2) {
+		shm = open_clock_shm();
+		shm_state = shm ? 0 : -1;
+	}
+	if (shm_state < 0)
+		return -1;
+
+	n = num && *num > 1 ? (uint64_t) *num : 1;
+	now = get_clock_now();
+
+	/* reserve timestamps <clock_reg, clock_reg + n) */
+	last = __atomic_load_n(&shm->last, __ATOMIC_ACQUIRE);
+	do {
+		clock_reg = now > last ? now : last + 1;
+	} while (!__atomic_compare_exchange_n(&shm->last, &last, clock_reg + n - 1,
+				1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	persist = __atomic_load_n(&shm->persist, __ATOMIC_RELAXED);
+	if (now >= persist + CLOCK_SHM_PERSIST
+	    && __atomic_compare_exchange_n(&shm->persist, &persist, now,
+				0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		write_clock_file(shm->clock_seq, clock_reg + n - 1);
+
+	*clock_high = clock_reg >> 32;
+	*clock_low = clock_reg;
+	*ret_clock_seq = shm->clock_seq;
+	return 0;
+}
+#else
+static int get_clock_shm(uint32_t *clock_high __attribute__((__unused__)),
+			 uint32_t *clock_low __attribute__((__unused__)),
+			 uint16_t *ret_clock_seq __attribute__((__unused__)),
+			 int *num __attribute__((__unused__)))
+{
+	return -1;
+}
+#endif /* !_WIN32 */
+
+/*
+ * Returns 1 if @tv is before @last, but the difference is small enough to be
+ * caused by the range of the UUIDs reserved by the previous call (see @num in
+ * get_clock()) rather than by the clock set backwards.
+ */
+#define MAX_RESERVED_USEC	1000000
+
+static int is_reserved_time(const struct timeval *tv, const struct timeval *last)
+{
+	int64_t diff = ((int64_t) last->tv_sec - tv->tv_sec) * 1000000
+		       + ((int64_t) last->tv_usec - tv->tv_usec);
+
+	return diff > 0 && diff <= MAX_RESERVED_USEC;
+}
+
 /*
  * Get clock from global sequence clock counter.
  *
@@ -230,6 +484,9 @@ static int get_clock(uint32_t *clock_high, uint32_t *clock_low,
 	int				len;
 	int				ret = 0;
 
+	if (get_clock_shm(clock_high, clock_low, ret_clock_seq, num) == 0)
+		return 0;
+
 	if (state_fd == -1)
 		ret = -1;
 
@@ -283,10 +540,21 @@ static int get_clock(uint32_t *clock_high, uint32_t *clock_low,
 
 try_again:
 	gettimeofday(&tv, NULL);
-	if ((tv.tv_sec < last.tv_sec) ||
+	if (is_reserved_time(&tv, &last)) {
+		/* continue after the range reserved by the previous call */
+		if (++adjustment >= MAX_ADJUSTMENT) {
+			adjustment = 0;
+			if (++last.tv_usec >= 1000000) {
+				last.tv_usec = 0;
+				last.tv_sec++;
+			}
+		}
+		tv = last;
+	} else if ((tv.tv_sec < last.tv_sec) ||
 	    ((tv.tv_sec == last.tv_sec) &&
 	     (tv.tv_usec < last.tv_usec))) {
 		clock_seq = (clock_seq+1) & 0x3FFF;
+		__atomic_add_fetch(&clock_bumps, 1, __ATOMIC_RELAXED);
 		adjustment = 0;
 		last = tv;
 	} else if ((tv.tv_sec == last.tv_sec) &&
@@ -333,65 +601,284 @@ try_again:
 
 #if defined(HAVE_UUIDD) && defined(HAVE_SYS_UN_H)
 
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL	0
+#endif
+
 /*
- * Try using the uuidd daemon to generate the UUID
- *
- * Returns 0 on success, non-zero on failure.
+ * The connection to uuidd is kept open for the next requests. It's shared by
+ * all threads; a thread opens a temporary connection if the connection is in
+ * use. The connection is not used after fork() or if the file descriptor
+ * has been closed (or reused) by the application.
  */
-static int get_uuid_via_daemon(int op, uuid_t out, int *num)
+static int		daemon_fd = -1;
+static int		daemon_busy;
+static unsigned int	daemon_fork_gen;
+static dev_t		daemon_dev;
+static ino_t		daemon_ino;
+
+static int connect_daemon(void)
 {
-	char op_buf[64];
-	int op_len;
-	int s;
-	ssize_t ret;
-	int32_t reply_len = 0, expected = 16;
 	struct sockaddr_un srv_addr;
+	int s;
 
 	if (sizeof(UUIDD_SOCKET_PATH) > sizeof(srv_addr.sun_path))
 		return -1;
 
-	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+#ifdef SOCK_CLOEXEC
+	s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+	s = socket(AF_UNIX, SOCK_STREAM, 0);
+#endif
+	if (s < 0)
 		return -1;
 
 	srv_addr.sun_family = AF_UNIX;
 	xstrncpy(srv_addr.sun_path, UUIDD_SOCKET_PATH, sizeof(srv_addr.sun_path));
 
 	if (connect(s, (const struct sockaddr *) &srv_addr,
-		    sizeof(struct sockaddr_un)) < 0)
-		goto fail;
+		    sizeof(struct sockaddr_un)) < 0) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
 
-	op_buf[0] = op;
-	op_len = 1;
-	if (op == UUIDD_OP_BULK_TIME_UUID) {
-		memcpy(op_buf+1, num, sizeof(*num));
-		op_len += sizeof(*num);
-		expected += sizeof(*num);
+/* returns the kept connection or -1 */
+static int get_daemon_conn(void)
+{
+	struct stat st;
+	int ours;
+
+	if (daemon_fd < 0)
+		return -1;
+
+	ours = fstat(daemon_fd, &st) == 0 && S_ISSOCK(st.st_mode)
+		&& st.st_dev == daemon_dev && st.st_ino == daemon_ino;
+
+	if (ours && daemon_fork_gen == get_fork_gen())
+		return daemon_fd;
+
+	if (ours)
+		close(daemon_fd);	/* inherited from parent */
+	daemon_fd = -1;
+	return -1;
+}
+
+static void keep_daemon_conn(int s)
+{
+	struct stat st;
+
+	if (fstat(s, &st) != 0) {
+		close(s);
+		return;
 	}
+	init_atfork();
+	daemon_fd = s;
+	daemon_dev = st.st_dev;
+	daemon_ino = st.st_ino;
+	daemon_fork_gen = get_fork_gen();
+}
+
+static int daemon_request(int s, const char *op_buf, int op_len,
+			  char *reply_buf, int32_t expected)
+{
+	int32_t reply_len = 0;
+	ssize_t ret;
 
-	ret = write(s, op_buf, op_len);
-	if (ret < 1)
-		goto fail;
+	ret = send(s, op_buf, op_len, MSG_NOSIGNAL);
+	if (ret != op_len)
+		return -1;
 
 	ret = read_all(s, (char *) &reply_len, sizeof(reply_len));
-	if (ret < 0)
-		goto fail;
+	if (ret != sizeof(reply_len) || reply_len != expected)
+		return -1;
 
-	if (reply_len != expected)
-		goto fail;
+	ret = read_all(s, reply_buf, reply_len);
+	return ret == expected ? 0 : -1;
+}
 
-	ret = read_all(s, op_buf, reply_len);
+/*
+ * Shared memory ring with time UUID ranges from uuidd (see uuidd.h). The
+ * ring is requested by the kept uuidd connection after the first bulk
+ * request, and then the bulk requests are served from the ring without
+ * any syscall. The closed ring is never unmapped, because another thread
+ * may still read it.
+ */
+static struct uuidd_ring	*daemon_ring;
+static int			daemon_ring_tried;
 
-	if (op == UUIDD_OP_BULK_TIME_UUID)
-		memcpy(op_buf+16, num, sizeof(int));
+static void map_daemon_ring(int s)
+{
+	union {
+		struct cmsghdr	cmh;
+		char		buf[CMSG_SPACE(sizeof(int))];
+	} ctl;
+	struct msghdr msg = { .msg_name = NULL };
+	struct cmsghdr *cmh;
+	struct iovec iov;
+	struct uuidd_ring *ring;
+	char op = UUIDD_OP_GET_RING;
+	int32_t reply_len = 0;
+	uint32_t sz = 0;
+	int fd = -1;
+
+	if (send(s, &op, 1, MSG_NOSIGNAL) != 1 ||
+	    read_all(s, (char *) &reply_len, sizeof(reply_len)) != sizeof(reply_len) ||
+	    reply_len != sizeof(sz))
+		return;		/* ring not available */
+
+	iov.iov_base = &sz;
+	iov.iov_len = sizeof(sz);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+
+	if (recvmsg(s, &msg, MSG_CMSG_CLOEXEC) != sizeof(sz))
+		return;
+
+	cmh = CMSG_FIRSTHDR(&msg);
+	if (cmh && cmh->cmsg_level == SOL_SOCKET && cmh->cmsg_type == SCM_RIGHTS
+	    && cmh->cmsg_len == CMSG_LEN(sizeof(int)))
+		memcpy(&fd, CMSG_DATA(cmh), sizeof(int));
+	if (fd < 0)
+		return;
+
+	if (sz < sizeof(struct uuidd_ring)) {
+		close(fd);
+		return;
+	}
+	ring = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring == MAP_FAILED)
+		return;
+
+	if (ring->magic != UUIDD_RING_MAGIC || ring->nslots == 0 ||
+	    sz < sizeof(struct uuidd_ring)
+		 + ring->nslots * sizeof(struct uuidd_ring_slot)) {
+		munmap(ring, sz);
+		return;
+	}
+	__atomic_store_n(&daemon_ring, ring, __ATOMIC_RELEASE);
+}
 
-	memcpy(out, op_buf, 16);
+static int get_uuid_via_ring(struct uuidd_ring *ring, uuid_t out, int *num)
+{
+	uint32_t i, n = ring->nslots;
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	struct timeval tv;
+	int64_t now;
+
+	if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+		/* uuidd exited, get the new ring later */
+		if (__atomic_compare_exchange_n(&daemon_ring, &ring, NULL, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			__atomic_store_n(&daemon_ring_tried, 0, __ATOMIC_RELAXED);
+		return -1;
+	}
 
-	close(s);
-	return ((ret == expected) ? 0 : -1);
+	gettimeofday(&tv, NULL);
+	now = (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
 
-fail:
-	close(s);
-	return -1;
+	for (i = 0; i < n; i++) {
+		struct uuidd_ring_slot *sl = &ring->slots[(head + i) % n];
+		uint64_t st = __atomic_load_n(&sl->state, __ATOMIC_ACQUIRE);
+		uint64_t taken;
+		unsigned char uu[16];
+		int32_t count;
+		int64_t time;
+
+		if (UUIDD_SLOT_STATUS(st) != UUIDD_SLOT_READY)
+			continue;
+		taken = UUIDD_SLOT_STATE(st, UUIDD_SLOT_TAKEN);
+		if (!__atomic_compare_exchange_n(&sl->state, &st, taken, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			continue;
+
+		memcpy(uu, sl->uu, sizeof(uu));
+		count = sl->num;
+		time = sl->time;
+
+		/* the slot has been reclaimed by uuidd, the copy is not valid */
+		if (!__atomic_compare_exchange_n(&sl->state, &taken,
+					UUIDD_SLOT_STATE(st, UUIDD_SLOT_EMPTY), 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			continue;
+
+		__atomic_store_n(&ring->head, (head + i + 1) % n, __ATOMIC_RELAXED);
+		if (count <= 0 || now - time > UUIDD_RING_MAXAGE || now < time)
+			continue;
+
+		memcpy(out, uu, sizeof(uu));
+		*num = count;
+		return 0;
+	}
+	return -1;	/* empty ring */
+}
+
+/*
+ * Try using the uuidd daemon to generate the UUID
+ *
+ * Returns 0 on success, non-zero on failure.
+ */
+static int get_uuid_via_daemon(int op, uuid_t out, int *num)
+{
+	char op_buf[64];
+	int op_len, s, keep, rc;
+	int32_t expected = 16;
+
+	if (op == UUIDD_OP_BULK_TIME_UUID) {
+		struct uuidd_ring *ring = __atomic_load_n(&daemon_ring,
+							  __ATOMIC_ACQUIRE);
+		if (ring && get_uuid_via_ring(ring, out, num) == 0)
+			return 0;
+	}
+
+	op_buf[0] = op;
+	op_len = 1;
+	if (op == UUIDD_OP_BULK_TIME_UUID) {
+		memcpy(op_buf+1, num, sizeof(*num));
+		op_len += sizeof(*num);
+		expected += sizeof(*num);
+	}
+
+	keep = !__atomic_exchange_n(&daemon_busy, 1, __ATOMIC_ACQUIRE);
+	if (keep) {
+		s = get_daemon_conn();
+		if (s >= 0) {
+			rc = daemon_request(s, op_buf, op_len, op_buf, expected);
+			if (rc == 0)
+				goto done;
+			/* closed by uuidd (e.g. timeout), try new connection */
+			close(s);
+			daemon_fd = -1;
+		}
+	}
+
+	s = connect_daemon();
+	if (s < 0) {
+		rc = -1;
+		goto unlock;
+	}
+	rc = daemon_request(s, op_buf, op_len, op_buf, expected);
+	if (rc == 0 && keep)
+		keep_daemon_conn(s);
+	else
+		close(s);
+done:
+	if (rc == 0) {
+		if (op == UUIDD_OP_BULK_TIME_UUID)
+			memcpy(num, op_buf+16, sizeof(int));
+		memcpy(out, op_buf, 16);
+	}
+	if (rc == 0 && keep && daemon_fd >= 0 && op == UUIDD_OP_BULK_TIME_UUID
+	    && !__atomic_exchange_n(&daemon_ring_tried, 1, __ATOMIC_RELAXED))
+		map_daemon_ring(daemon_fd);
+unlock:
+	if (keep)
+		__atomic_store_n(&daemon_busy, 0, __ATOMIC_RELEASE);
+	return rc;
 }
 
 #else /* !defined(HAVE_UUIDD) && defined(HAVE_SYS_UN_H) */
@@ -432,6 +919,64 @@ int __uuid_generate_time(uuid_t out, int *num)
 	return ret;
 }
 
+#ifdef HAVE_TLS
+/*
+ * Thread local range of time based UUIDs. The range is reserved by uuidd (or
+ * by the global clock state counter if uuidd is not usable) and the UUIDs
+ * are generated without any syscall. The size of the next range depends on
+ * how fast the thread used the previous range.
+ */
+#define STASH_MIN	64
+#define STASH_DEFAULT	1000
+#define STASH_MAX	(1 << 20)
+
+struct uuid_stash {
+	struct uuid	uu;		/* the last UUID */
+	int		num;		/* number of not yet used UUIDs */
+	int		size;		/* size of the next range */
+	time_t		last_time;	/* when the range has been reserved */
+	int		unsafe;		/* the clock is not globally synchronized */
+	unsigned int	fork_gen;	/* the range is not used after fork() */
+};
+
+THREAD_LOCAL struct uuid_stash stash;
+
+static int stash_reserve(struct uuid_stash *st, uuid_t out, time_t now)
+{
+	int num, ret;
+
+	/* the range has been inherited from the parent process */
+	if (st->fork_gen != get_fork_gen())
+		memset(st, 0, sizeof(*st));
+
+	if (!st->size)
+		st->size = STASH_DEFAULT;
+	else if (st->num > st->size / 2)		/* expired */
+		st->size = max(st->size / 2, STASH_MIN);
+	else if (st->num == 0 && now == st->last_time)	/* used in one second */
+		st->size = min(st->size * 2, STASH_MAX);
+
+	init_atfork();
+	st->fork_gen = get_fork_gen();
+
+	num = st->size;
+	if (get_uuid_via_daemon(UUIDD_OP_BULK_TIME_UUID, out, &num) == 0)
+		ret = 0;
+	else if (st->unsafe)
+		ret = __uuid_generate_time(out, NULL);
+	else
+		ret = __uuid_generate_time(out, &num);
+
+	uuid_unpack(out, &st->uu);
+	st->last_time = now;
+
+	/* don't reserve ranges by thread local clock */
+	st->unsafe = ret != 0;
+	st->num = st->unsafe ? 0 : num - 1;
+	return ret;
+}
+#endif
+
 /*
  * Generate time-based UUID and store it to @out
  *
@@ -442,44 +987,27 @@ int __uuid_generate_time(uuid_t out, int *num)
  */
 static int uuid_generate_time_generic(uuid_t out) {
 #ifdef HAVE_TLS
-	THREAD_LOCAL int		num = 0;
-	THREAD_LOCAL struct uuid	uu;
-	THREAD_LOCAL time_t		last_time = 0;
-	time_t				now;
-
-	if (num > 0) {
-		now = time(NULL);
-		if (now > last_time+1)
-			num = 0;
-	}
-	if (num <= 0) {
-		num = 1000;
-		if (get_uuid_via_daemon(UUIDD_OP_BULK_TIME_UUID,
-					out, &num) == 0) {
-			last_time = time(NULL);
-			uuid_unpack(out, &uu);
-			num--;
-			return 0;
-		}
-		num = 0;
-	}
-	if (num > 0) {
-		uu.time_low++;
-		if (uu.time_low == 0) {
-			uu.time_mid++;
-			if (uu.time_mid == 0)
-				uu.time_hi_and_version++;
+	time_t now = time(NULL);
+
+	if (stash.num > 0 && now <= stash.last_time + 1
+	    && stash.fork_gen == get_fork_gen()) {
+		stash.uu.time_low++;
+		if (stash.uu.time_low == 0) {
+			stash.uu.time_mid++;
+			if (stash.uu.time_mid == 0)
+				stash.uu.time_hi_and_version++;
 		}
-		num--;
-		uuid_pack(&uu, out);
+		stash.num--;
+		uuid_pack(&stash.uu, out);
 		return 0;
 	}
+	return stash_reserve(&stash, out, now);
 #else
 	if (get_uuid_via_daemon(UUIDD_OP_TIME_UUID, out, 0) == 0)
 		return 0;
-#endif
 
 	return __uuid_generate_time(out, NULL);
+#endif
 }
 
 /*
@@ -498,28 +1026,101 @@ int uuid_generate_time_safe(uuid_t out)
 	return uuid_generate_time_generic(out);
 }
 
+/*
+ * Generate time-based UUID and store it to @out.
+ *
+ * The same as uuid_generate_time_safe(), but returns -1 also if the UUID
+ * timestamp is not greater than timestamp of the previous UUID generated
+ * by this function in the same thread.
+ */
+int uuid_generate_time_monotonic(uuid_t out)
+{
+	THREAD_LOCAL uint64_t	last;
+	struct uuid		uu;
+	uint64_t		clock_reg;
+	int			ret;
+
+	ret = uuid_generate_time_generic(out);
+
+	uuid_unpack(out, &uu);
+	clock_reg = ((uint64_t) (uu.time_hi_and_version & 0x0FFF) << 48)
+		    | ((uint64_t) uu.time_mid << 32) | uu.time_low;
+	if (clock_reg <= last)
+		ret = -1;
+	else
+		last = clock_reg;
+	return ret;
+}
+
+
+/*
+ * Per-thread entropy pool for random and time-ordered UUIDs.
+ *
+ * The pool is refilled by one random_get_bytes() call, so the syscall is
+ * not called for every UUID. The used bytes are zeroed. A fork() child
+ * handler increments the fork generation, so the child never uses the
+ * bytes inherited from the parent.
+ */
+#define ENTROPY_POOL_SIZE	4096
+
+#ifdef HAVE_TLS
+struct uuid_entropy_pool {
+	unsigned int	fork_gen;
+	size_t		avail;
+	unsigned char	data[ENTROPY_POOL_SIZE];
+};
+
+THREAD_LOCAL struct uuid_entropy_pool entropy_pool;
+
+static void get_entropy(void *buf, size_t sz)
+{
+	struct uuid_entropy_pool *pl = &entropy_pool;
+	unsigned int gen = get_fork_gen();
+	unsigned char *p;
+
+	if (sz > sizeof(pl->data)) {
+		random_get_bytes(buf, sz);
+		return;
+	}
+	if (pl->avail < sz || pl->fork_gen != gen) {
+		init_atfork();
+		random_get_bytes(pl->data, sizeof(pl->data));
+		pl->avail = sizeof(pl->data);
+		pl->fork_gen = gen;
+	}
+
+	p = pl->data + sizeof(pl->data) - pl->avail;
+	memcpy(buf, p, sz);
+	memset(p, 0, sz);
+	pl->avail -= sz;
+}
+#else
+/* the pool would be shared by all threads */
+# define get_entropy(_buf, _sz)		random_get_bytes(_buf, _sz)
+#endif /* HAVE_TLS */
+
+static void generate_random(uuid_t *out, size_t n)
+{
+	size_t i;
+
+	get_entropy(out, n * sizeof(uuid_t));
+
+	for (i = 0; i < n; i++) {
+		out[i][6] = (out[i][6] & 0x0F) | 0x40;
+		out[i][8] = (out[i][8] & 0x3F) | 0x80;
+	}
+}
 
 void __uuid_generate_random(uuid_t out, int *num)
 {
-	uuid_t	buf;
-	struct uuid uu;
-	int i, n;
+	int n;
 
 	if (!num || !*num)
 		n = 1;
 	else
 		n = *num;
 
-	for (i = 0; i < n; i++) {
-		random_get_bytes(buf, sizeof(buf));
-		uuid_unpack(buf, &uu);
-
-		uu.clock_seq = (uu.clock_seq & 0x3FFF) | 0x8000;
-		uu.time_hi_and_version = (uu.time_hi_and_version & 0x0FFF)
-			| 0x4000;
-		uuid_pack(&uu, out);
-		out += sizeof(uuid_t);
-	}
+	generate_random((uuid_t *) out, n);
 }
 
 void uuid_generate_random(uuid_t out)
@@ -530,6 +1131,98 @@ void uuid_generate_random(uuid_t out)
 	__uuid_generate_random(out, &num);
 }
 
+/*
+ * Generate @n random UUIDs to the @out array. Big arrays are filled by
+ * random_get_bytes() directly, without the entropy pool.
+ */
+void uuid_generate_random_bulk(uuid_t *out, size_t n)
+{
+	generate_random(out, n);
+}
+
+/*
+ * Time-ordered UUIDs (version 7, RFC 9562).
+ *
+ * The UUID is 48 bits of the Unix time in milliseconds, 12 bits of counter
+ * (rand_a) and 62 random bits (rand_b). The counter is seeded by a random
+ * value for every new millisecond and incremented for UUIDs generated in
+ * the same millisecond, so the UUIDs from one thread are strictly ascending.
+ * If the counter overflows, the timestamp is advanced by one millisecond.
+ * The random bits are read from the entropy pool.
+ */
+#define V7_COUNTER_MAX		0xFFF
+#define V7_COUNTER_SEED		0x7FF	/* keep space for UUIDs in the same ms */
+
+struct uuid_v7_state {
+	uint64_t	last_ms;
+	uint16_t	counter;
+};
+
+THREAD_LOCAL struct uuid_v7_state v7_state;
+
+static uint64_t v7_get_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void v7_new_counter(struct uuid_v7_state *st)
+{
+	unsigned char rnd[2];
+
+	get_entropy(rnd, sizeof(rnd));
+	st->counter = ((rnd[0] << 8) | rnd[1]) & V7_COUNTER_SEED;
+}
+
+static void v7_generate(struct uuid_v7_state *st, uuid_t out, uint64_t now)
+{
+	if (now > st->last_ms) {
+		st->last_ms = now;
+		v7_new_counter(st);
+	} else if (st->counter < V7_COUNTER_MAX)
+		st->counter++;		/* the same ms, or the clock goes backwards */
+	else {
+		st->last_ms++;
+		v7_new_counter(st);
+	}
+
+	out[0] = st->last_ms >> 40;
+	out[1] = st->last_ms >> 32;
+	out[2] = st->last_ms >> 24;
+	out[3] = st->last_ms >> 16;
+	out[4] = st->last_ms >> 8;
+	out[5] = st->last_ms;
+	out[6] = 0x70 | (st->counter >> 8);
+	out[7] = st->counter;
+
+	get_entropy(out + 8, 8);
+	out[8] = (out[8] & 0x3F) | 0x80;
+}
+
+/*
+ * Generate time-ordered UUID (version 7) and store it to @out. The UUIDs
+ * generated by the same thread are always ascending.
+ */
+void uuid_generate_time_v7(uuid_t out)
+{
+	v7_generate(&v7_state, out, v7_get_ms());
+}
+
+/*
+ * Generate @n time-ordered UUIDs to the @out array. The same as
+ * uuid_generate_time_v7(), but the time is read only once for all the UUIDs.
+ */
+void uuid_generate_time_v7_bulk(uuid_t *out, size_t n)
+{
+	uint64_t now = v7_get_ms();
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		v7_generate(&v7_state, out[i], now);
+}
+
 /*
  * Check whether good random source (/dev/random or /dev/urandom)
  * is available.
@@ -559,26 +1252,32 @@ void uuid_generate(uuid_t out)
  * Generate an MD5 hashed (predictable) UUID based on a well-known UUID
  * providing the namespace and an arbitrary binary string.
  */
+/* UUID from the first 16 bytes of the hash, @version is 3 (MD5) or 5 (SHA1) */
+static void uuid_from_hash(uuid_t out, const unsigned char *hash, int version)
+{
+	uuid_t buf;
+	struct uuid uu;
+
+	memcpy(buf, hash, sizeof(buf));
+	uuid_unpack(buf, &uu);
+
+	uu.clock_seq = (uu.clock_seq & 0x3FFF) | 0x8000;
+	uu.time_hi_and_version = (uu.time_hi_and_version & 0x0FFF) | (version << 12);
+	uuid_pack(&uu, out);
+}
+
 void uuid_generate_md5(uuid_t out, const uuid_t ns, const char *name, size_t len)
 {
 	UL_MD5_CTX ctx;
 	char hash[UL_MD5LENGTH];
-	uuid_t buf;
-	struct uuid uu;
 
 	ul_MD5Init(&ctx);
 	ul_MD5Update(&ctx, ns, sizeof(uuid_t));
 	ul_MD5Update(&ctx, (const unsigned char *)name, len);
 	ul_MD5Final((unsigned char *)hash, &ctx);
 
-	assert(sizeof(buf) <= sizeof(hash));
-
-	memcpy(buf, hash, sizeof(buf));
-	uuid_unpack(buf, &uu);
-
-	uu.clock_seq = (uu.clock_seq & 0x3FFF) | 0x8000;
-	uu.time_hi_and_version = (uu.time_hi_and_version & 0x0FFF) | 0x3000;
-	uuid_pack(&uu, out);
+	assert(sizeof(uuid_t) <= sizeof(hash));
+	uuid_from_hash(out, (unsigned char *) hash, 3);
 }
 
 /*
@@ -589,20 +1288,101 @@ void uuid_generate_sha1(uuid_t out, const uuid_t ns, const char *name, size_t le
 {
 	UL_SHA1_CTX ctx;
 	char hash[UL_SHA1LENGTH];
-	uuid_t buf;
-	struct uuid uu;
 
 	ul_SHA1Init(&ctx);
 	ul_SHA1Update(&ctx, ns, sizeof(uuid_t));
 	ul_SHA1Update(&ctx, (const unsigned char *)name, len);
 	ul_SHA1Final((unsigned char *)hash, &ctx);
 
-	assert(sizeof(buf) <= sizeof(hash));
+	assert(sizeof(uuid_t) <= sizeof(hash));
+	uuid_from_hash(out, (unsigned char *) hash, 5);
+}
 
-	memcpy(buf, hash, sizeof(buf));
-	uuid_unpack(buf, &uu);
+#define HASH_BULK_CHUNK		256	/* messages hashed at once */
 
-	uu.clock_seq = (uu.clock_seq & 0x3FFF) | 0x8000;
-	uu.time_hi_and_version = (uu.time_hi_and_version & 0x0FFF) | 0x5000;
-	uuid_pack(&uu, out);
+/*
+ * The namespace and the names are copied to one buffer, and the messages are
+ * hashed by ul_MD5Multi() or ul_SHA1Multi() in parallel.
+ */
+static void generate_hash_bulk(uuid_t *out, const uuid_t ns,
+			       const char * const *names, const size_t *lens,
+			       size_t n, int version)
+{
+	union {
+		unsigned char md5[HASH_BULK_CHUNK][UL_MD5LENGTH];
+		unsigned char sha1[HASH_BULK_CHUNK][UL_SHA1LENGTH];
+	} hash;
+	const unsigned char *msgs[HASH_BULK_CHUNK];
+	size_t mlens[HASH_BULK_CHUNK];
+	unsigned char *buf = NULL;
+	size_t bufsz = 0;
+
+	while (n > 0) {
+		size_t i, sz = 0, chunk = n < HASH_BULK_CHUNK ? n : HASH_BULK_CHUNK;
+		unsigned char *p;
+
+		for (i = 0; i < chunk; i++) {
+			mlens[i] = sizeof(uuid_t) + (lens ? lens[i] : strlen(names[i]));
+			sz += mlens[i];
+		}
+		if (sz > bufsz) {
+			unsigned char *tmp = realloc(buf, sz);
+
+			if (!tmp)
+				break;
+			buf = tmp;
+			bufsz = sz;
+		}
+		for (p = buf, i = 0; i < chunk; i++) {
+			msgs[i] = p;
+			memcpy(p, ns, sizeof(uuid_t));
+			memcpy(p + sizeof(uuid_t), names[i], mlens[i] - sizeof(uuid_t));
+			p += mlens[i];
+		}
+
+		if (version == 3) {
+			ul_MD5Multi(hash.md5, msgs, mlens, chunk);
+			for (i = 0; i < chunk; i++)
+				uuid_from_hash(out[i], hash.md5[i], 3);
+		} else {
+			ul_SHA1Multi(hash.sha1, msgs, mlens, chunk);
+			for (i = 0; i < chunk; i++)
+				uuid_from_hash(out[i], hash.sha1[i], 5);
+		}
+		out += chunk;
+		names += chunk;
+		if (lens)
+			lens += chunk;
+		n -= chunk;
+	}
+	free(buf);
+
+	/* out of memory */
+	for (; n > 0; n--, out++, names++) {
+		size_t len = lens ? *lens++ : strlen(*names);
+
+		if (version == 3)
+			uuid_generate_md5(*out, ns, *names, len);
+		else
+			uuid_generate_sha1(*out, ns, *names, len);
+	}
+}
+
+/*
+ * Generate @n MD5 hashed UUIDs from @names of @lens bytes (or zero terminated
+ * strings if @lens is NULL) in the namespace @ns.
+ */
+void uuid_generate_md5_bulk(uuid_t *out, const uuid_t ns,
+			    const char * const *names, const size_t *lens, size_t n)
+{
+	generate_hash_bulk(out, ns, names, lens, n, 3);
+}
+
+/*
+ * Generate @n SHA1 hashed UUIDs, see uuid_generate_md5_bulk().
+ */
+void uuid_generate_sha1_bulk(uuid_t *out, const uuid_t ns,
+			     const char * const *names, const size_t *lens, size_t n)
+{
+	generate_hash_bulk(out, ns, names, lens, n, 5);
 }
@@ -33,47 +33,81 @@
  */
 
 #include <stdlib.h>
-#include <stdio.h>
-#include <ctype.h>
 #include <string.h>
 
 #include "uuidP.h"
 
-int uuid_parse(const char *in, uuid_t uu)
+/* hex digit value with HEXVALID flag, zero for non-hex characters */
+#define HEXVALID	0x10
+#define X(v)		((v) | HEXVALID)
+
+static const unsigned char hexval[256] = {
+	['0'] = X(0), ['1'] = X(1), ['2'] = X(2), ['3'] = X(3), ['4'] = X(4),
+	['5'] = X(5), ['6'] = X(6), ['7'] = X(7), ['8'] = X(8), ['9'] = X(9),
+	['a'] = X(10), ['b'] = X(11), ['c'] = X(12),
+	['d'] = X(13), ['e'] = X(14), ['f'] = X(15),
+	['A'] = X(10), ['B'] = X(11), ['C'] = X(12),
+	['D'] = X(13), ['E'] = X(14), ['F'] = X(15),
+};
+#undef X
+
+/* offsets of the byte pairs in the string, dashes are at 8, 13, 18 and 23 */
+static const unsigned char hexoff[16] = {
+	0, 2, 4, 6, 9, 11, 14, 16, 19, 21, 24, 26, 28, 30, 32, 34
+};
+
+/*
+ * The string is read up to the first unexpected character, so the input does
+ * not have to be terminated right after the UUID for the failure case and
+ * strlen() is unnecessary.  The binary UUID is the bytes in the string
+ * order, see uuid_pack().
+ */
+static int parse_uuid(const unsigned char *in, uuid_t uu)
 {
-	struct uuid	uuid;
-	int 		i;
-	const char	*cp;
-	char		buf[3];
+	uuid_t tmp;
+	int i;
 
-	if (strlen(in) != 36)
-		return -1;
-	for (i=0, cp = in; i <= 36; i++,cp++) {
-		if ((i == 8) || (i == 13) || (i == 18) ||
-		    (i == 23)) {
-			if (*cp == '-')
-				continue;
-			else
-				return -1;
-		}
-		if (i== 36)
-			if (*cp == 0)
-				continue;
-		if (!isxdigit(*cp))
+	for (i = 0; i < 16; i++) {
+		unsigned int hi = hexval[in[hexoff[i]]];
+		unsigned int lo;
+
+		if (!(hi & HEXVALID))
+			return -1;
+		lo = hexval[in[hexoff[i] + 1]];
+		if (!(lo & HEXVALID))
+			return -1;
+		tmp[i] = ((hi & 0xf) << 4) | (lo & 0xf);
+
+		/* check the dash after the group */
+		if ((i == 3 || i == 5 || i == 7 || i == 9)
+		    && in[hexoff[i] + 2] != '-')
 			return -1;
 	}
-	uuid.time_low = strtoul(in, NULL, 16);
-	uuid.time_mid = strtoul(in+9, NULL, 16);
-	uuid.time_hi_and_version = strtoul(in+14, NULL, 16);
-	uuid.clock_seq = strtoul(in+19, NULL, 16);
-	cp = in+24;
-	buf[2] = 0;
-	for (i=0; i < 6; i++) {
-		buf[0] = *cp++;
-		buf[1] = *cp++;
-		uuid.node[i] = strtoul(buf, NULL, 16);
-	}
+	if (in[36] != '\0')
+		return -1;
 
-	uuid_pack(&uuid, uu);
+	memcpy(uu, tmp, sizeof(tmp));
 	return 0;
 }
+
+int uuid_parse(const char *in, uuid_t uu)
+{
+	return parse_uuid((const unsigned char *) in, uu);
+}
+
+/*
+ * Parses @n strings from @in[] to @out[]. The invalid strings are stored as
+ * null UUIDs. Returns the number of the invalid strings.
+ */
+size_t uuid_parse_many(const char * const *in, uuid_t *out, size_t n)
+{
+	size_t i, nfails = 0;
+
+	for (i = 0; i < n; i++) {
+		if (parse_uuid((const unsigned char *) in[i], out[i]) != 0) {
+			memset(out[i], 0, sizeof(uuid_t));
+			nfails++;
+		}
+	}
+	return nfails;
+}
@@ -43,6 +43,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #include "c.h"
 #include "uuid.h"
@@ -86,6 +87,232 @@ static int check_uuids_in_file(const char *file)
 	return ret;
 }
 
+/* time based UUIDs from uuid_generate_time_monotonic() have to be ordered */
+static int test_uuid_monotonic(int num)
+{
+	uint64_t last = 0;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		uuid_t uu;
+		uint64_t t;
+
+		uuid_generate_time_monotonic(uu);
+
+		t = ((uint64_t) (uu[6] & 0x0F) << 56) | ((uint64_t) uu[7] << 48)
+		    | ((uint64_t) uu[4] << 40) | ((uint64_t) uu[5] << 32)
+		    | ((uint64_t) uu[0] << 24) | ((uint64_t) uu[1] << 16)
+		    | ((uint64_t) uu[2] << 8) | uu[3];
+		if (t <= last) {
+			printf("%d time based UUIDs are not monotonic\n", num);
+			return 1;
+		}
+		last = t;
+	}
+	printf("%d time based UUIDs are monotonic, OK\n", num);
+	return 0;
+}
+
+/* random UUIDs have to be version 4, DCE and different */
+static int test_uuid_random(int num)
+{
+	uuid_t uu[64];
+	int i, k;
+
+	for (i = 0; i < num; i += ARRAY_SIZE(uu)) {
+		/* single and bulk generation */
+		if (i % 2)
+			uuid_generate_random_bulk(uu, ARRAY_SIZE(uu));
+		else {
+			for (k = 0; k < (int) ARRAY_SIZE(uu); k++)
+				uuid_generate_random(uu[k]);
+		}
+		for (k = 0; k < (int) ARRAY_SIZE(uu); k++) {
+			if (uuid_type(uu[k]) != UUID_TYPE_DCE_RANDOM ||
+			    uuid_variant(uu[k]) != UUID_VARIANT_DCE ||
+			    (k && uuid_compare(uu[k - 1], uu[k]) == 0)) {
+				printf("%d random UUIDs are not valid\n", num);
+				return 1;
+			}
+		}
+	}
+	printf("%d random UUIDs are valid, OK\n", num);
+	return 0;
+}
+
+/* UUIDs from uuid_generate_time_v7() have to be version 7, DCE and ascending */
+static int test_uuid_v7(int num)
+{
+	uuid_t last, uu[64];
+	int i, k;
+
+	memset(last, 0, sizeof(last));
+
+	for (i = 0; i < num; i += ARRAY_SIZE(uu)) {
+		/* single and bulk generation */
+		if (i % 2)
+			uuid_generate_time_v7_bulk(uu, ARRAY_SIZE(uu));
+		else {
+			for (k = 0; k < (int) ARRAY_SIZE(uu); k++)
+				uuid_generate_time_v7(uu[k]);
+		}
+		for (k = 0; k < (int) ARRAY_SIZE(uu); k++) {
+			if (uuid_type(uu[k]) != UUID_TYPE_DCE_TIME_V7 ||
+			    uuid_variant(uu[k]) != UUID_VARIANT_DCE ||
+			    memcmp(last, uu[k], sizeof(last)) >= 0) {
+				printf("%d time-v7 UUIDs are not valid\n", num);
+				return 1;
+			}
+			memcpy(last, uu[k], sizeof(last));
+		}
+	}
+	printf("%d time-v7 UUIDs are ascending, OK\n", num);
+	return 0;
+}
+
+/* uuid_unparse_many() and uuid_parse_many() have to be the same as single calls */
+static int test_uuid_strings(int num)
+{
+	uuid_t uu[64], res[64];
+	char str[ARRAY_SIZE(uu) * UUID_STR_LEN], one[UUID_STR_LEN];
+	const char *strs[ARRAY_SIZE(uu)];
+	int i, k;
+
+	for (k = 0; k < (int) ARRAY_SIZE(uu); k++)
+		strs[k] = str + k * UUID_STR_LEN;
+
+	for (i = 0; i < num; i += ARRAY_SIZE(uu)) {
+		uuid_generate_random_bulk(uu, ARRAY_SIZE(uu));
+		uuid_unparse_many((const uuid_t *) uu, str, ARRAY_SIZE(uu));
+
+		for (k = 0; k < (int) ARRAY_SIZE(uu); k++) {
+			uuid_unparse(uu[k], one);
+			if (strcmp(one, strs[k]) != 0)
+				goto fail;
+		}
+		/* one invalid string */
+		if (i % 2)
+			str[(i / 2) % ARRAY_SIZE(uu) * UUID_STR_LEN + 8] = 'x';
+
+		if (uuid_parse_many(strs, res, ARRAY_SIZE(uu)) != (size_t) (i % 2))
+			goto fail;
+		for (k = 0; k < (int) ARRAY_SIZE(uu); k++) {
+			if (i % 2 && k == (i / 2) % (int) ARRAY_SIZE(uu)) {
+				if (!uuid_is_null(res[k]))
+					goto fail;
+			} else if (uuid_compare(uu[k], res[k]) != 0)
+				goto fail;
+		}
+	}
+	printf("%d UUIDs are unparsed and parsed, OK\n", num);
+	return 0;
+fail:
+	printf("%d UUIDs are not unparsed and parsed\n", num);
+	return 1;
+}
+
+/* uuid_generate_{md5,sha1}_bulk() have to be the same as single calls */
+static int test_uuid_hash_bulk(int num)
+{
+	char **names = malloc(num * sizeof(char *));
+	size_t *lens = malloc(num * sizeof(size_t));
+	uuid_t *uu = malloc(num * sizeof(uuid_t)), one;
+	const uuid_t *ns = uuid_get_template("dns");
+	int i, k, rc = 1;
+
+	if (!names || !lens || !uu)
+		err(EXIT_FAILURE, "cannot allocate memory");
+
+	/* all name lengths around the hash block size */
+	for (i = 0; i < num; i++) {
+		lens[i] = i % 150;
+		names[i] = malloc(lens[i] + 1);
+		if (!names[i])
+			err(EXIT_FAILURE, "cannot allocate memory");
+		for (k = 0; k < (int) lens[i]; k++)
+			names[i][k] = 'a' + (i + k) % 26;
+		names[i][lens[i]] = '\0';
+	}
+
+	for (k = 0; k < 4; k++) {
+		const size_t *l = k % 2 ? lens : NULL;
+
+		if (k < 2)
+			uuid_generate_md5_bulk(uu, *ns,
+					(const char * const *) names, l, num);
+		else
+			uuid_generate_sha1_bulk(uu, *ns,
+					(const char * const *) names, l, num);
+		for (i = 0; i < num; i++) {
+			if (k < 2)
+				uuid_generate_md5(one, *ns, names[i], lens[i]);
+			else
+				uuid_generate_sha1(one, *ns, names[i], lens[i]);
+			if (uuid_compare(one, uu[i]) != 0)
+				goto done;
+		}
+	}
+	rc = 0;
+done:
+	printf("%d hash-based UUIDs are %ssame as single calls%s\n", num,
+			rc ? "not " : "", rc ? "" : ", OK");
+	for (i = 0; i < num; i++)
+		free(names[i]);
+	free(names);
+	free(lens);
+	free(uu);
+	return rc;
+}
+
+static double elapsed(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+/* test_uuid --bench [<num>] */
+static void bench_uuid_strings(int num)
+{
+	uuid_t *uu = malloc(num * sizeof(uuid_t));
+	char *str = malloc(num * UUID_STR_LEN);
+	const char **strs = malloc(num * sizeof(char *));
+	struct timeval start;
+	int i, bad = 0;
+
+	if (!uu || !str || !strs)
+		err(EXIT_FAILURE, "cannot allocate memory");
+
+	uuid_generate_random_bulk(uu, num);
+	for (i = 0; i < num; i++)
+		strs[i] = str + i * UUID_STR_LEN;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < num; i++)
+		uuid_unparse(uu[i], str + i * UUID_STR_LEN);
+	printf("uuid_unparse:      %.3f s\n", elapsed(&start));
+
+	gettimeofday(&start, NULL);
+	uuid_unparse_many((const uuid_t *) uu, str, num);
+	printf("uuid_unparse_many: %.3f s\n", elapsed(&start));
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < num; i++)
+		bad += uuid_parse(strs[i], uu[i]) != 0;
+	printf("uuid_parse:        %.3f s\n", elapsed(&start));
+
+	gettimeofday(&start, NULL);
+	bad += uuid_parse_many(strs, uu, num);
+	printf("uuid_parse_many:   %.3f s\n", elapsed(&start));
+
+	if (bad)
+		printf("%d invalid UUIDs\n", bad);
+	free(uu);
+	free(str);
+	free(strs);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -106,6 +333,13 @@ main(int argc, char **argv)
 		failed += test_uuid("00000000-0000-0000-0000-000000000000", 1);
 		failed += test_uuid("01234567-89ab-cdef-0134-567890abcedf", 1);
 		failed += test_uuid("ffffffff-ffff-ffff-ffff-ffffffffffff", 1);
+		failed += test_uuid_monotonic(100000);
+		failed += test_uuid_random(65536);
+		failed += test_uuid_v7(65536);
+		failed += test_uuid_strings(65536);
+		failed += test_uuid_hash_bulk(1000);
+	} else if (strcmp(argv[1], "--bench") == 0) {
+		bench_uuid_strings(argc > 2 ? atoi(argv[2]) : 1000000);
 	} else {
 		int i;
 
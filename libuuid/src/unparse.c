@@ -36,41 +36,52 @@
 
 #include "uuidP.h"
 
-static const char *fmt_lower =
-	"%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x";
-
-static const char *fmt_upper =
-	"%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X";
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
 
 #ifdef UUID_UNPARSE_DEFAULT_UPPER
-#define FMT_DEFAULT fmt_upper
+#define HEX_DEFAULT hex_upper
 #else
-#define FMT_DEFAULT fmt_lower
+#define HEX_DEFAULT hex_lower
 #endif
 
-static void uuid_unparse_x(const uuid_t uu, char *out, const char *fmt)
+/* the binary UUID is the bytes in the string order, see uuid_unpack() */
+static void uuid_unparse_x(const uuid_t uu, char *out, const char *hex)
 {
-	struct uuid uuid;
+	int i;
 
-	uuid_unpack(uu, &uuid);
-	sprintf(out, fmt,
-		uuid.time_low, uuid.time_mid, uuid.time_hi_and_version,
-		uuid.clock_seq >> 8, uuid.clock_seq & 0xFF,
-		uuid.node[0], uuid.node[1], uuid.node[2],
-		uuid.node[3], uuid.node[4], uuid.node[5]);
+	for (i = 0; i < 16; i++) {
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+			*out++ = '-';
+		*out++ = hex[uu[i] >> 4];
+		*out++ = hex[uu[i] & 0xf];
+	}
+	*out = '\0';
 }
 
 void uuid_unparse_lower(const uuid_t uu, char *out)
 {
-	uuid_unparse_x(uu, out,	fmt_lower);
+	uuid_unparse_x(uu, out,	hex_lower);
 }
 
 void uuid_unparse_upper(const uuid_t uu, char *out)
 {
-	uuid_unparse_x(uu, out,	fmt_upper);
+	uuid_unparse_x(uu, out,	hex_upper);
 }
 
 void uuid_unparse(const uuid_t uu, char *out)
 {
-	uuid_unparse_x(uu, out, FMT_DEFAULT);
+	uuid_unparse_x(uu, out, HEX_DEFAULT);
+}
+
+/*
+ * Unparses @n UUIDs from @in[] to @out; the strings are stored in
+ * UUID_STR_LEN bytes long slots, so @out has to be n * UUID_STR_LEN bytes.
+ */
+void uuid_unparse_many(const uuid_t *in, char *out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++, out += UUID_STR_LEN)
+		uuid_unparse_x(in[i], out, HEX_DEFAULT);
 }
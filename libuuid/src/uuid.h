@@ -58,6 +58,7 @@ typedef unsigned char uuid_t[16];
 #define UUID_TYPE_DCE_MD5    3
 #define UUID_TYPE_DCE_RANDOM 4
 #define UUID_TYPE_DCE_SHA1   5
+#define UUID_TYPE_DCE_TIME_V7 7
 
 #define UUID_TYPE_SHIFT      4
 #define UUID_TYPE_MASK     0xf
@@ -89,22 +90,32 @@ extern void uuid_copy(uuid_t dst, const uuid_t src);
 /* gen_uuid.c */
 extern void uuid_generate(uuid_t out);
 extern void uuid_generate_random(uuid_t out);
+extern void uuid_generate_random_bulk(uuid_t *out, size_t n);
 extern void uuid_generate_time(uuid_t out);
 extern int uuid_generate_time_safe(uuid_t out);
+extern int uuid_generate_time_monotonic(uuid_t out);
+extern void uuid_generate_time_v7(uuid_t out);
+extern void uuid_generate_time_v7_bulk(uuid_t *out, size_t n);
 
 extern void uuid_generate_md5(uuid_t out, const uuid_t ns, const char *name, size_t len);
 extern void uuid_generate_sha1(uuid_t out, const uuid_t ns, const char *name, size_t len);
+extern void uuid_generate_md5_bulk(uuid_t *out, const uuid_t ns,
+			const char * const *names, const size_t *lens, size_t n);
+extern void uuid_generate_sha1_bulk(uuid_t *out, const uuid_t ns,
+			const char * const *names, const size_t *lens, size_t n);
 
 /* isnull.c */
 extern int uuid_is_null(const uuid_t uu);
 
 /* parse.c */
 extern int uuid_parse(const char *in, uuid_t uu);
+extern size_t uuid_parse_many(const char * const *in, uuid_t *out, size_t n);
 
 /* unparse.c */
 extern void uuid_unparse(const uuid_t uu, char *out);
 extern void uuid_unparse_lower(const uuid_t uu, char *out);
 extern void uuid_unparse_upper(const uuid_t uu, char *out);
+extern void uuid_unparse_many(const uuid_t *in, char *out, size_t n);
 
 /* uuid_time.c */
 extern time_t uuid_time(const uuid_t uu, struct timeval *ret_tv);
@@ -62,13 +62,21 @@ time_t uuid_time(const uuid_t uu, struct timeval *ret_tv)
 
 	uuid_unpack(uu, &uuid);
 
+	if (((uuid.time_hi_and_version >> 12) & 0xF) == UUID_TYPE_DCE_TIME_V7) {
+		/* 48 bits of Unix time in milliseconds */
+		clock_reg = ((uint64_t) uuid.time_low << 16) | uuid.time_mid;
+		tv.tv_sec = clock_reg / 1000;
+		tv.tv_usec = (clock_reg % 1000) * 1000;
+		goto done;
+	}
+
 	high = uuid.time_mid | ((uuid.time_hi_and_version & 0xFFF) << 16);
 	clock_reg = uuid.time_low | ((uint64_t) high << 32);
 
 	clock_reg -= (((uint64_t) 0x01B21DD2) << 32) + 0x13814000;
 	tv.tv_sec = clock_reg / 10000000;
 	tv.tv_usec = (clock_reg % 10000000) / 10;
-
+done:
 	if (ret_tv)
 		*ret_tv = tv;
 
@@ -156,10 +164,13 @@ main(int argc, char **argv)
 	case 4:
 		printf(" (random)\n");
 		break;
+	case 7:
+		printf(" (time-ordered)\n");
+		break;
 	default:
 		printf("\n");
 	}
-	if (type != 1) {
+	if (type != 1 && type != 7) {
 		printf("Warning: not a time-based UUID, so UUID time "
 		       "decoding will likely not work!\n");
 	}
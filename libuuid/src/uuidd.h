@@ -46,9 +46,57 @@
 #define UUIDD_OP_RANDOM_UUID		3
 #define UUIDD_OP_BULK_TIME_UUID		4
 #define UUIDD_OP_BULK_RANDOM_UUID	5
-#define UUIDD_MAX_OP			UUIDD_OP_BULK_RANDOM_UUID
+#define UUIDD_OP_TIME_V7_UUID		6
+#define UUIDD_OP_BULK_TIME_V7_UUID	7
+#define UUIDD_OP_GET_RING		8
+#define UUIDD_OP_STATS			9
+#define UUIDD_MAX_OP			UUIDD_OP_STATS
+
+/*
+ * Shared memory ring with ranges of time UUIDs.
+ *
+ * The ring is created by uuidd for every client UID and sent to the client
+ * by UUIDD_OP_GET_RING (memfd in SCM_RIGHTS message, the reply is the ring
+ * size). uuidd refills the empty slots in the background and the clients
+ * take the ranges by atomic operations without any syscall:
+ *
+ *   client: READY -> TAKEN, copy the range, TAKEN -> EMPTY
+ *   uuidd:  EMPTY (or too old READY) -> FILLING, reserve range, -> READY
+ *
+ * The slot state contains generation incremented by every fill, the range
+ * is valid only if the client is able to switch TAKEN -> EMPTY with the
+ * same generation (uuidd reclaims slots that are TAKEN for too long time).
+ */
+#define UUIDD_RING_MAGIC		0x75726e67	/* "urng" */
+#define UUIDD_RING_NSLOTS		64
+#define UUIDD_RING_RANGE		1000		/* UUIDs in one slot */
+#define UUIDD_RING_MAXAGE		500000		/* usec */
+
+#define UUIDD_SLOT_EMPTY		0
+#define UUIDD_SLOT_FILLING		1
+#define UUIDD_SLOT_READY		2
+#define UUIDD_SLOT_TAKEN		3
+
+#define UUIDD_SLOT_STATUS(_s)		((_s) & 3)
+#define UUIDD_SLOT_STATE(_s, _st)	(((_s) & ~(uint64_t) 3) | (_st))
+
+struct uuidd_ring_slot {
+	uint64_t	state;		/* generation << 2 | status */
+	int64_t		time;		/* usec, when the range has been reserved */
+	int32_t		num;		/* number of UUIDs */
+	unsigned char	uu[16];		/* the first UUID */
+};
+
+struct uuidd_ring {
+	uint32_t	magic;
+	uint32_t	nslots;
+	uint32_t	closed;		/* set by uuidd on exit */
+	uint32_t	head;		/* hint for the next READY slot */
+	struct uuidd_ring_slot slots[];
+};
 
 extern int __uuid_generate_time(uuid_t out, int *num);
 extern void __uuid_generate_random(uuid_t out, int *num);
+extern unsigned long __uuid_get_clock_bumps(void);
 
 #endif /* _UUID_UUID_H */
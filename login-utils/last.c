@@ -26,6 +26,7 @@
  */
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <time.h>
 #include <stdio.h>
@@ -41,6 +42,8 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <libgen.h>
+#include <search.h>
+#include <pthread.h>
 
 #include "c.h"
 #include "nls.h"
@@ -69,7 +72,7 @@
 # define LAST_TIMESTAMP_LEN 32
 #endif
 
-#define UCHUNKSIZE	16384	/* How much we read at once. */
+#define LAST_DNS_THREADS	8	/* max number of resolver threads */
 
 struct last_control {
 	unsigned int lastb :1,	  /* Is this command 'lastb' */
@@ -92,11 +95,18 @@ struct last_control {
 	unsigned int time_fmt;	/* time format */
 };
 
-/* Double linked list of struct utmp's */
+/* The last logout (or login) record for every ut_line, tsearch() tree */
 struct utmplist {
 	struct utmpx ut;
-	struct utmplist *next;
-	struct utmplist *prev;
+};
+
+/* Resolved address, tsearch() tree */
+struct dns_entry {
+	int32_t addr[4];
+	char *name;
+	int rc;				/* getnameinfo() result */
+	unsigned int resolved :1,
+		     queued :1;
 };
 
 /* Types of listing */
@@ -156,6 +166,8 @@ static struct last_timefmt timefmts[] = {
 static unsigned int recsdone;	/* Number of records listed */
 static time_t lastdate;		/* Last date we've seen */
 static time_t currentdate;	/* date when we started processing the file */
+static void *dns_cache;		/* resolved addresses */
+static struct ul_timecache tcache;	/* localtime() of the records */
 
 /* --time-format=option parser */
 static int which_time_format(const char *s)
@@ -169,93 +181,38 @@ static int which_time_format(const char *s)
 	errx(EXIT_FAILURE, _("unknown time format: %s"), s);
 }
 
-/*
- *	Read one utmp entry, return in new format.
- *	Automatically reposition file pointer.
- */
-static int uread(FILE *fp, struct utmpx *u,  int *quit, const char *filename)
+static time_t utmp_time(const char *rec)
 {
-	static int utsize;
-	static char buf[UCHUNKSIZE];
-	char tmp[1024];
-	static off_t fpos;
-	static int bpos;
-	off_t o;
-
-	if (quit == NULL && u != NULL) {
-		/*
-		 *	Normal read.
-		 */
-		return fread(u, sizeof(struct utmpx), 1, fp);
-	}
-
-	if (u == NULL) {
-		/*
-		 *	Initialize and position.
-		 */
-		utsize = sizeof(struct utmpx);
-		fseeko(fp, 0, SEEK_END);
-		fpos = ftello(fp);
-		if (fpos == 0)
-			return 0;
-		o = ((fpos - 1) / UCHUNKSIZE) * UCHUNKSIZE;
-		if (fseeko(fp, o, SEEK_SET) < 0) {
-			warn(_("seek on %s failed"), filename);
-			return 0;
-		}
-		bpos = (int)(fpos - o);
-		if (fread(buf, bpos, 1, fp) != 1) {
-			warn(_("cannot read %s"), filename);
-			return 0;
-		}
-		fpos = o;
-		return 1;
-	}
+	struct utmpx ut;
 
-	/*
-	 *	Read one struct. From the buffer if possible.
-	 */
-	bpos -= utsize;
-	if (bpos >= 0) {
-		memcpy(u, buf + bpos, sizeof(struct utmpx));
-		return 1;
-	}
+	memcpy(&ut, rec, sizeof(ut));
+	return ut.ut_tv.tv_sec;
+}
 
-	/*
-	 *	Oops we went "below" the buffer. We should be able to
-	 *	seek back UCHUNKSIZE bytes.
-	 */
-	fpos -= UCHUNKSIZE;
-	if (fpos < 0)
-		return 0;
+/*
+ *	Returns index of the first record in @recs with time >= @t. The
+ *	records are expected in chronological order.
+ */
+static size_t utmp_bisect(const char *recs, size_t nrecs, time_t t)
+{
+	size_t lo = 0, hi = nrecs;
 
-	/*
-	 *	Copy whatever is left in the buffer.
-	 */
-	memcpy(tmp + (-bpos), buf, utsize + bpos);
-	if (fseeko(fp, fpos, SEEK_SET) < 0) {
-		warn(_("seek on %s failed"), filename);
-		return 0;
-	}
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
 
-	/*
-	 *	Read another UCHUNKSIZE bytes.
-	 */
-	if (fread(buf, UCHUNKSIZE, 1, fp) != 1) {
-		warn(_("cannot read %s"), filename);
-		return 0;
+		if (utmp_time(recs + mid * sizeof(struct utmpx)) < t)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+	return lo;
+}
 
-	/*
-	 *	The end of the UCHUNKSIZE byte buffer should be the first
-	 *	few bytes of the current struct utmp.
-	 */
-	memcpy(tmp, buf + UCHUNKSIZE + bpos, -bpos);
-	bpos += UCHUNKSIZE;
-
-	memcpy(u, tmp, sizeof(struct utmpx));
-
-	return 1;
+static int cmp_utmp_line(const void *a, const void *b)
+{
+	return strncmp(((const struct utmplist *) a)->ut.ut_line,
+		       ((const struct utmplist *) b)->ut.ut_line,
+		       sizeof(((struct utmpx *) 0)->ut_line));
 }
 
 /*
@@ -343,8 +300,8 @@ static int time_formatter(int fmt, char *dst, size_t dlen, time_t *when)
 	{
 		struct tm tm;
 
-		localtime_r(when, &tm);
-		if (!snprintf(dst, dlen, "%02d:%02d", tm.tm_hour, tm.tm_min))
+		if (ul_timecache_tm(&tcache, *when, 0, &tm) != 0
+		    || !snprintf(dst, dlen, "%02d:%02d", tm.tm_hour, tm.tm_min))
 			ret = -1;
 		break;
 	}
@@ -358,7 +315,7 @@ static int time_formatter(int fmt, char *dst, size_t dlen, time_t *when)
 		break;
 	}
 	case LAST_TIMEFTM_ISO8601:
-		ret = strtime_iso(when, ISO_TIMESTAMP_T, dst, dlen);
+		ret = strtime_iso_cached(&tcache, when, ISO_TIMESTAMP_T, dst, dlen);
 		break;
 	default:
 		abort();
@@ -366,6 +323,125 @@ static int time_formatter(int fmt, char *dst, size_t dlen, time_t *when)
 	return ret;
 }
 
+static int cmp_dns_entry(const void *a, const void *b)
+{
+	return memcmp(((const struct dns_entry *) a)->addr,
+		      ((const struct dns_entry *) b)->addr,
+		      sizeof(((struct dns_entry *) 0)->addr));
+}
+
+static void free_dns_entry(void *data)
+{
+	struct dns_entry *e = data;
+
+	free(e->name);
+	free(e);
+}
+
+static struct dns_entry *get_dns_entry(const int32_t *a)
+{
+	struct dns_entry *e = xcalloc(1, sizeof(*e)), **ep;
+
+	memcpy(e->addr, a, sizeof(e->addr));
+	ep = tsearch(e, &dns_cache, cmp_dns_entry);
+	if (!ep)
+		err_oom();
+	if (*ep != e)
+		free(e);
+	return *ep;
+}
+
+static void resolve_dns_entry(struct dns_entry *e)
+{
+	char buf[256];
+
+	e->rc = dns_lookup(buf, sizeof(buf), 0, e->addr);
+	if (e->rc == 0)
+		e->name = xstrdup(buf);
+	e->resolved = 1;
+}
+
+/*
+ *	Lookup a host with DNS, every address only once.
+ */
+static int dns_lookup_cached(char *result, int size, int useip, int32_t *a)
+{
+	struct dns_entry *e;
+
+	if (useip)
+		return dns_lookup(result, size, useip, a);
+
+	e = get_dns_entry(a);
+	if (!e->resolved)
+		resolve_dns_entry(e);
+	if (e->rc == 0)
+		xstrncpy(result, e->name, size);
+	return e->rc;
+}
+
+struct dns_queue {
+	struct dns_entry	**entries;
+	size_t			nentries;
+	size_t			next;
+	pthread_mutex_t		lock;
+};
+
+static void *dns_thread(void *data)
+{
+	struct dns_queue *q = data;
+
+	for (;;) {
+		struct dns_entry *e = NULL;
+
+		pthread_mutex_lock(&q->lock);
+		if (q->next < q->nentries)
+			e = q->entries[q->next++];
+		pthread_mutex_unlock(&q->lock);
+		if (!e)
+			break;
+		resolve_dns_entry(e);
+	}
+	return NULL;
+}
+
+/*
+ *	Resolve all distinct addresses of the records in parallel, the
+ *	records are listed later from the cache in the original order.
+ */
+static void dns_prefetch(const char *recs, size_t first, size_t last)
+{
+	struct dns_queue q = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	pthread_t threads[LAST_DNS_THREADS];
+	size_t i, nalloc = 0, nthreads;
+
+	for (i = first; i < last; i++) {
+		struct utmpx ut;
+		struct dns_entry *e;
+
+		memcpy(&ut, recs + i * sizeof(ut), sizeof(ut));
+		e = get_dns_entry((int32_t *) ut.ut_addr_v6);
+		if (e->resolved || e->queued)
+			continue;
+		e->queued = 1;
+		if (q.nentries == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			q.entries = xrealloc(q.entries, nalloc * sizeof(e));
+		}
+		q.entries[q.nentries++] = e;
+	}
+	for (nthreads = 0; nthreads < LAST_DNS_THREADS
+			   && nthreads < q.nentries; nthreads++) {
+		if (pthread_create(&threads[nthreads], NULL, dns_thread, &q) != 0)
+			break;
+	}
+	dns_thread(&q);		/* the rest if no thread started */
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	free(q.entries);
+}
+
 /*
  *	Remove trailing spaces from a string.
  */
@@ -515,7 +591,7 @@ static int list(const struct last_control *ctl, struct utmpx *p, time_t logout_t
 	 */
 	r = -1;
 	if (ctl->usedns || ctl->useip)
-		r = dns_lookup(domain, sizeof(domain), ctl->useip, (int32_t*)p->ut_addr_v6);
+		r = dns_lookup_cached(domain, sizeof(domain), ctl->useip, (int32_t*)p->ut_addr_v6);
 	if (r < 0)
 		mem2strcpy(domain, p->ut_host, sizeof(p->ut_host), sizeof(domain));
 
@@ -639,12 +715,14 @@ static int is_phantom(const struct last_control *ctl, struct utmpx *ut)
 static void process_wtmp_file(const struct last_control *ctl,
 			      const char *filename)
 {
-	FILE *fp;		/* File pointer of wtmp file */
+	int fd;			/* wtmp file */
+	char *map = NULL;	/* mmapped wtmp file */
+	const char *recs;	/* records aligned to the end of the file */
+	size_t nrecs = 0, first = 0, i;
 
 	struct utmpx ut;	/* Current utmp entry */
-	struct utmplist *ulist = NULL;	/* All entries */
-	struct utmplist *p;	/* Pointer into utmplist */
-	struct utmplist *next;	/* Pointer into utmplist */
+	void *ulist = NULL;	/* The last entry for every line */
+	struct utmplist *p, **pp;
 
 	time_t lastboot = 0;	/* Last boottime */
 	time_t lastrch = 0;	/* Last run level change */
@@ -670,41 +748,52 @@ static void process_wtmp_file(const struct last_control *ctl,
 	signal(SIGQUIT, quit_handler);
 
 	/*
-	 * Open the utmp file
+	 * Open and map the utmp file
 	 */
-	if ((fp = fopen(filename, "r")) == NULL)
+	if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0)
 		err(EXIT_FAILURE, _("cannot open %s"), filename);
-
-	/*
-	 * Optimize the buffer size.
-	 */
-	setvbuf(fp, NULL, _IOFBF, UCHUNKSIZE);
+	if (fstat(fd, &st) != 0)
+		err(EXIT_FAILURE, _("stat of %s failed"), filename);
+
+	if (st.st_size >= (off_t) sizeof(ut)) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+			err(EXIT_FAILURE, _("cannot read %s"), filename);
+		nrecs = st.st_size / sizeof(ut);
+	}
 
 	/*
 	 * Read first structure to capture the time field
 	 */
-	if (uread(fp, &ut, NULL, filename) == 1)
+	if (map) {
+		memcpy(&ut, map, sizeof(ut));
 		begintime = ut.ut_tv.tv_sec;
-	else {
-		if (fstat(fileno(fp), &st) != 0)
-			err(EXIT_FAILURE, _("stat of %s failed"), filename);
+	} else {
 		begintime = st.st_ctime;
 		quit = 1;
 	}
 
 	/*
-	 * Go to end of file minus one structure
-	 * and/or initialize utmp reading code.
+	 * The records are read backwards from the end of the file, records
+	 * out of the --since and --until range are skipped by bisection.
 	 */
-	uread(fp, NULL, NULL, filename);
+	recs = map ? map + st.st_size % sizeof(ut) : NULL;
+	i = nrecs;
+	if (ctl->until)
+		i = utmp_bisect(recs, nrecs, ctl->until + 1);
+	if (ctl->since)
+		first = utmp_bisect(recs, i, ctl->since);
+
+	/* with --limit it's probably faster to resolve the printed lines only */
+	if (ctl->usedns && !ctl->useip && !ctl->maxrecs)
+		dns_prefetch(recs, first, i);
 
 	/*
 	 * Read struct after struct backwards from the file.
 	 */
-	while (!quit) {
+	while (!quit && i > first) {
 
-		if (uread(fp, &ut, &quit, filename) != 1)
-			break;
+		memcpy(&ut, recs + --i * sizeof(ut), sizeof(ut));
 
 		if (ctl->since && ut.ut_tv.tv_sec < ctl->since)
 			continue;
@@ -804,23 +893,11 @@ static void process_wtmp_file(const struct last_control *ctl,
 			 * the same ut_line.
 			 */
 			c = 0;
-			for (p = ulist; p; p = next) {
-				next = p->next;
-				if (strncmp(p->ut.ut_line, ut.ut_line,
-				    sizeof(ut.ut_line)) == 0) {
-					/* Show it */
-					if (c == 0) {
-						quit = list(ctl, &ut, p->ut.ut_tv.tv_sec, R_NORMAL);
-						c = 1;
-					}
-					if (p->next)
-						p->next->prev = p->prev;
-					if (p->prev)
-						p->prev->next = p->next;
-					else
-						ulist = p->next;
-					free(p);
-				}
+			pp = tfind(&ut, &ulist, cmp_utmp_line);
+			if (pp) {
+				/* Show it, the record is replaced below */
+				quit = list(ctl, &ut, (*pp)->ut.ut_tv.tv_sec, R_NORMAL);
+				c = 1;
 			}
 			/*
 			 * Not found? Then crashed, down, still
@@ -847,11 +924,14 @@ static void process_wtmp_file(const struct last_control *ctl,
 				break;
 			p = xmalloc(sizeof(struct utmplist));
 			memcpy(&p->ut, &ut, sizeof(struct utmpx));
-			p->next  = ulist;
-			p->prev  = NULL;
-			if (ulist)
-				ulist->prev = p;
-			ulist = p;
+			pp = tsearch(p, &ulist, cmp_utmp_line);
+			if (!pp)
+				err_oom();
+			if (*pp != p) {
+				/* replace the older record for the line */
+				memcpy(&(*pp)->ut, &ut, sizeof(struct utmpx));
+				free(p);
+			}
 			break;
 
 		case EMPTY:
@@ -874,10 +954,7 @@ static void process_wtmp_file(const struct last_control *ctl,
 		if (down) {
 			lastboot = ut.ut_tv.tv_sec;
 			whydown = (ut.ut_type == SHUTDOWN_TIME) ? R_DOWN : R_CRASH;
-			for (p = ulist; p; p = next) {
-				next = p->next;
-				free(p);
-			}
+			tdestroy(ulist, free);
 			ulist = NULL;
 			down = 0;
 		}
@@ -896,12 +973,13 @@ static void process_wtmp_file(const struct last_control *ctl,
 		free(tmp);
 	}
 
-	fclose(fp);
+	if (map)
+		munmap(map, st.st_size);
+	close(fd);
 
-	for (p = ulist; p; p = next) {
-		next = p->next;
-		free(p);
-	}
+	tdestroy(ulist, free);
+	tdestroy(dns_cache, free_dns_entry);
+	dns_cache = NULL;
 }
 
 int main(int argc, char **argv)
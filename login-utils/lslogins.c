@@ -36,6 +36,7 @@
 #include <err.h>
 #include <limits.h>
 #include <search.h>
+#include <dirent.h>
 
 #include <libsmartcols.h>
 #ifdef HAVE_LIBSELINUX
@@ -57,6 +58,7 @@
 #include "logindefs.h"
 #include "procutils.h"
 #include "timeutils.h"
+#include "ranges.h"
 
 /*
  * column description
@@ -107,8 +109,8 @@ struct lslogins_user {
 	int pwd_lock;
 	int pwd_deny;
 
-	gid_t *sgroups;
-	size_t nsgroups;
+	char *sgroups;		/* names of the supplementary groups */
+	char *sgids;
 
 	char *pwd_ctime;
 	char *pwd_warn;
@@ -194,6 +196,16 @@ enum {
 #define is_btmp_col(x)	((x) == COL_FAILED_LOGIN   || \
 			 (x) == COL_FAILED_TTY)
 
+#define is_shadow_col(x) ((x) == COL_PWDEMPTY      || \
+			 (x) == COL_PWDDENY        || \
+			 (x) == COL_PWDLOCK        || \
+			 (x) == COL_PWDMETHOD      || \
+			 (x) == COL_PWD_WARN       || \
+			 (x) == COL_PWD_EXPIR      || \
+			 (x) == COL_PWD_CTIME      || \
+			 (x) == COL_PWD_CTIME_MIN  || \
+			 (x) == COL_PWD_CTIME_MAX)
+
 enum {
 	STATUS_FALSE = 0,
 	STATUS_TRUE,
@@ -245,12 +257,69 @@ static const struct lslogins_coldesc coldescs[] =
 	[COL_NPROCS]        = { "PROC",         N_("number of processes run by the user"), N_("Running processes"), 1, SCOLS_FL_RIGHT },
 };
 
+#define LSLOGINS_HASHSZ_MIN	64
+#define LSLOGINS_THREADS	8	/* max number of threads */
+#define LSLOGINS_PERTHREAD	32	/* min number of users per thread */
+
+/* gid to name cache, the name is NULL for unknown groups */
+struct lslogins_group {
+	gid_t			gid;
+	char			*name;
+	struct lslogins_group	*next;
+};
+
+/* /etc/group member (--local-only) */
+struct lslogins_member {
+	char		*name;
+	gid_t		gid;
+	size_t		idx;		/* order in the file */
+};
+
+/*
+ * The user database entry and data which are read by NSS lookups. The
+ * entries are collected first, the slow per-user lookups are done by more
+ * threads, then the lslogins_user structs are made in the main thread.
+ */
+struct lslogins_account {
+	struct passwd	pw;		/* private copy */
+	struct spwd	sp;		/* private copy, valid if has_shadow */
+	gid_t		*sgroups;
+	size_t		nsgroups;
+
+	unsigned int	has_shadow :1,
+			sgroups_failed :1;
+};
+
 struct lslogins_control {
 	struct utmpx *wtmp;
 	size_t wtmp_size;
+	struct utmpx **wtmp_index;	/* last entry for each user, by ut_user */
+	size_t wtmp_nindex;
 
 	struct utmpx *btmp;
 	size_t btmp_size;
+	struct utmpx **btmp_index;
+	size_t btmp_nindex;
+
+	struct lslogins_account *accounts;
+	size_t naccounts;
+
+	struct lslogins_group **groups;
+	size_t groups_hashsz;		/* power of 2 */
+	size_t ngroups;
+
+	uid_t *proc_uids;		/* owners of all processes, sorted */
+	size_t nproc_uids;
+
+	/* --local-only */
+	struct passwd *local_pw;
+	size_t local_npw;
+	struct passwd **local_pw_byname;
+	struct spwd *local_sp;
+	size_t local_nsp;
+	struct spwd **local_sp_byname;
+	struct lslogins_member *local_members;
+	size_t local_nmembers;
 
 	void *usertree;
 
@@ -272,7 +341,8 @@ struct lslogins_control {
 		     fail_on_unknown : 1,		/* fail if user does not exist */
 		     ulist_on : 1,
 		     noheadings : 1,
-		     notrunc : 1;
+		     notrunc : 1,
+		     local_only : 1;		/* don't use NSS */
 };
 
 /* these have to remain global since there's no other reasonable way to pass
@@ -313,6 +383,7 @@ static int column_name_to_id(const char *name, size_t namesz)
 }
 
 static struct timeval now;
+static struct ul_timecache tcache;
 
 static char *make_time(int mode, time_t time)
 {
@@ -324,7 +395,7 @@ static char *make_time(int mode, time_t time)
 	{
 		char *s;
 		struct tm tm;
-		localtime_r(&time, &tm);
+		ul_timecache_tm(&tcache, time, 0, &tm);
 
 		asctime_r(&tm, buf);
 		if (*(s = buf + strlen(buf) - 1) == '\n')
@@ -333,14 +404,14 @@ static char *make_time(int mode, time_t time)
 		break;
 	}
 	case TIME_SHORT:
-		rc = strtime_short(&time, &now, UL_SHORTTIME_THISYEAR_HHMM,
+		rc = strtime_short_cached(&tcache, &time, &now, UL_SHORTTIME_THISYEAR_HHMM,
 				buf, sizeof(buf));
 		break;
 	case TIME_ISO:
-		rc = strtime_iso(&time, ISO_TIMESTAMP_T, buf, sizeof(buf));
+		rc = strtime_iso_cached(&tcache, &time, ISO_TIMESTAMP_T, buf, sizeof(buf));
 		break;
 	case TIME_ISO_SHORT:
-		rc = strtime_iso(&time, ISO_DATE, buf, sizeof(buf));
+		rc = strtime_iso_cached(&tcache, &time, ISO_DATE, buf, sizeof(buf));
 		break;
 	default:
 		errx(EXIT_FAILURE, _("unsupported time type"));
@@ -367,7 +438,102 @@ static char *gidtostr(gid_t gid)
 	return str_gid;
 }
 
-static char *build_sgroups_string(gid_t *sgroups, size_t nsgroups, int want_names)
+static inline size_t lslogins_hash(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static struct lslogins_group *find_group(struct lslogins_control *ctl, gid_t gid)
+{
+	struct lslogins_group *g;
+
+	if (!ctl->groups_hashsz)
+		return NULL;
+
+	g = ctl->groups[lslogins_hash(gid) & (ctl->groups_hashsz - 1)];
+	for (; g; g = g->next) {
+		if (g->gid == gid)
+			return g;
+	}
+	return NULL;
+}
+
+static void groups_hash_link(struct lslogins_control *ctl, struct lslogins_group *g)
+{
+	size_t n = lslogins_hash(g->gid) & (ctl->groups_hashsz - 1);
+
+	g->next = ctl->groups[n];
+	ctl->groups[n] = g;
+}
+
+static struct lslogins_group *add_group(struct lslogins_control *ctl,
+					gid_t gid, const char *name)
+{
+	struct lslogins_group *g;
+
+	if (ctl->ngroups >= ctl->groups_hashsz) {
+		struct lslogins_group **old = ctl->groups;
+		size_t i, oldsz = ctl->groups_hashsz;
+
+		ctl->groups_hashsz = oldsz ? oldsz * 2 : LSLOGINS_HASHSZ_MIN;
+		ctl->groups = xcalloc(ctl->groups_hashsz, sizeof(*ctl->groups));
+
+		for (i = 0; i < oldsz; i++) {
+			struct lslogins_group *next;
+
+			for (g = old[i]; g; g = next) {
+				next = g->next;
+				groups_hash_link(ctl, g);
+			}
+		}
+		free(old);
+	}
+
+	g = xcalloc(1, sizeof(*g));
+	g->gid = gid;
+	g->name = name ? xstrdup(name) : NULL;
+	groups_hash_link(ctl, g);
+	ctl->ngroups++;
+	return g;
+}
+
+/* returns NULL for unknown group */
+static const char *get_group_name(struct lslogins_control *ctl, gid_t gid)
+{
+	struct lslogins_group *g = find_group(ctl, gid);
+
+	if (!g) {
+		struct group *grp = NULL;
+
+		/* with --local-only all groups are already in the cache */
+		if (!ctl->local_only)
+			grp = getgrgid(gid);
+		g = add_group(ctl, gid, grp ? grp->gr_name : NULL);
+	}
+	return g->name;
+}
+
+static void free_groups(struct lslogins_control *ctl)
+{
+	size_t i;
+
+	for (i = 0; i < ctl->groups_hashsz; i++) {
+		struct lslogins_group *g, *next;
+
+		for (g = ctl->groups[i]; g; g = next) {
+			next = g->next;
+			free(g->name);
+			free(g);
+		}
+	}
+	free(ctl->groups);
+}
+
+static char *build_sgroups_string(struct lslogins_control *ctl,
+				  gid_t *sgroups, size_t nsgroups, int want_names)
 {
 	size_t n = 0, maxlen, len;
 	char *res, *p;
@@ -384,12 +550,12 @@ again:
 		if (!want_names)
 			x = snprintf(p, len, "%u,", sgroups[n]);
 		else {
-			struct group *grp = getgrgid(sgroups[n]);
-			if (!grp) {
+			const char *name = get_group_name(ctl, sgroups[n]);
+			if (!name) {
 				free(res);
 				return NULL;
 			}
-			x = snprintf(p, len, "%s,", grp->gr_name);
+			x = snprintf(p, len, "%s,", name);
 		}
 
 		if (x < 0 || (size_t) x >= len) {
@@ -413,21 +579,66 @@ again:
 	return res;
 }
 
-static struct utmpx *get_last_wtmp(struct lslogins_control *ctl, const char *username)
+static int cmp_utmp_user(const void *a, const void *b)
 {
-	size_t n = 0;
+	const struct utmpx *x = *(const struct utmpx * const *) a;
+	const struct utmpx *z = *(const struct utmpx * const *) b;
+	int rc = strncmp(x->ut_user, z->ut_user, sizeof(x->ut_user));
+
+	/* keep the order of the file for the same user */
+	return rc ? rc : x < z ? -1 : x > z ? 1 : 0;
+}
+
+/*
+ * Creates index of the last entry for each user, so the entries are not
+ * searched for each user.
+ */
+static struct utmpx **index_utmp(struct utmpx *ents, size_t nents, size_t *nindex)
+{
+	struct utmpx **idx;
+	size_t i, n = 0;
+
+	*nindex = 0;
+	if (!nents)
+		return NULL;
+
+	idx = xmalloc(nents * sizeof(*idx));
+	for (i = 0; i < nents; i++)
+		idx[i] = &ents[i];
+
+	qsort(idx, nents, sizeof(*idx), cmp_utmp_user);
+
+	for (i = 0; i < nents; i++) {
+		/* the last entry of the user overwrites the previous */
+		if (n && strncmp(idx[n - 1]->ut_user, idx[i]->ut_user,
+				 sizeof(idx[i]->ut_user)) == 0)
+			n--;
+		idx[n++] = idx[i];
+	}
+
+	*nindex = n;
+	return idx;
+}
+
+static struct utmpx *get_last_utmp(struct utmpx **idx, size_t nidx, const char *username)
+{
+	size_t lo = 0, hi = nidx;
 
 	if (!username)
 		return NULL;
 
-	n = ctl->wtmp_size - 1;
-	do {
-		if (!strncmp(username, ctl->wtmp[n].ut_user,
-		             sizeof(ctl->wtmp[0].ut_user)))
-			return ctl->wtmp + n;
-	} while (n--);
-	return NULL;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int rc = strncmp(username, idx[mid]->ut_user, sizeof(idx[mid]->ut_user));
 
+		if (!rc)
+			return idx[mid];
+		if (rc < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
 }
 
 static int require_wtmp(void)
@@ -448,21 +659,22 @@ static int require_btmp(void)
 	return 0;
 }
 
-static struct utmpx *get_last_btmp(struct lslogins_control *ctl, const char *username)
+static int require_shadow(void)
 {
-	size_t n = 0;
-
-	if (!username)
-		return NULL;
-
-	n = ctl->btmp_size - 1;
-	do {
-		if (!strncmp(username, ctl->btmp[n].ut_user,
-		             sizeof(ctl->wtmp[0].ut_user)))
-			return ctl->btmp + n;
-	}while (n--);
-	return NULL;
+	size_t i;
+	for (i = 0; i < ncolumns; i++)
+		if (is_shadow_col(columns[i]))
+			return 1;
+	return 0;
+}
 
+static int require_column(int id)
+{
+	size_t i;
+	for (i = 0; i < ncolumns; i++)
+		if (columns[i] == id)
+			return 1;
+	return 0;
 }
 
 static int read_utmp(char const *file, size_t *nents, struct utmpx **res)
@@ -503,6 +715,7 @@ static int parse_wtmp(struct lslogins_control *ctl, char *path)
 	rc = read_utmp(path, &ctl->wtmp_size, &ctl->wtmp);
 	if (rc < 0 && errno != EACCES)
 		err(EXIT_FAILURE, "%s", path);
+	ctl->wtmp_index = index_utmp(ctl->wtmp, ctl->wtmp_size, &ctl->wtmp_nindex);
 	return rc;
 }
 
@@ -513,12 +726,27 @@ static int parse_btmp(struct lslogins_control *ctl, char *path)
 	rc = read_utmp(path, &ctl->btmp_size, &ctl->btmp);
 	if (rc < 0 && errno != EACCES)
 		err(EXIT_FAILURE, "%s", path);
+	ctl->btmp_index = index_utmp(ctl->btmp, ctl->btmp_size, &ctl->btmp_nindex);
 	return rc;
 }
 
-static int get_sgroups(gid_t **list, size_t *len, struct passwd *pwd)
+/* getgroups also returns the user's primary GID - dispose of it */
+static void remove_primary_gid(gid_t *list, size_t *len, gid_t gid)
 {
 	size_t n = 0;
+
+	while (n < *len) {
+		if (list[n] == gid)
+			break;
+		++n;
+	}
+
+	if (*len)
+		list[n] = list[--(*len)];
+}
+
+static int get_sgroups(gid_t **list, size_t *len, struct passwd *pwd)
+{
 	int ngroups = 0;
 
 	*len = 0;
@@ -536,33 +764,107 @@ static int get_sgroups(gid_t **list, size_t *len, struct passwd *pwd)
 		return -1;
 
 	*len = (size_t) ngroups;
+	remove_primary_gid(*list, len, pwd->pw_gid);
+	return 0;
+}
 
-	/* getgroups also returns the user's primary GID - dispose of it */
-	while (n < *len) {
-		if ((*list)[n] == pwd->pw_gid)
-			break;
-		++n;
+static int cmp_member_name(const void *a, const void *b)
+{
+	const struct lslogins_member *x = a, *z = b;
+	int rc = strcmp(x->name, z->name);
+
+	return rc ? rc : cmp_numbers(x->idx, z->idx);
+}
+
+/* the same as get_sgroups(), but /etc/group members only */
+static int get_local_sgroups(struct lslogins_control *ctl, gid_t **list, size_t *len,
+			     struct passwd *pwd)
+{
+	struct lslogins_member key = { .name = pwd->pw_name }, *m, *end;
+	size_t lo = 0, hi = ctl->local_nmembers;
+
+	/* the first member entry of the user */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (strcmp(ctl->local_members[mid].name, key.name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	if (*len)
-		(*list)[n] = (*list)[--(*len)];
+	*list = xcalloc(1 + ctl->local_nmembers - lo, sizeof(gid_t));
+	(*list)[0] = pwd->pw_gid;
+	*len = 1;
+
+	end = ctl->local_members + ctl->local_nmembers;
+	for (m = ctl->local_members + lo; m < end && !strcmp(m->name, key.name); m++) {
+		size_t i;
 
+		for (i = 0; i < *len; i++) {
+			if ((*list)[i] == m->gid)
+				break;
+		}
+		if (i == *len)
+			(*list)[(*len)++] = m->gid;
+	}
+
+	remove_primary_gid(*list, len, pwd->pw_gid);
 	return 0;
 }
 
-static int get_nprocs(const uid_t uid)
+static int cmp_uids(const void *a, const void *b)
 {
-	int nprocs = 0;
-	pid_t pid;
-	struct proc_processes *proc = proc_open_processes();
+	return cmp_numbers(*(const uid_t *) a, *(const uid_t *) b);
+}
 
-	proc_processes_filter_by_uid(proc, uid);
+/* reads owners of all processes by one /proc scan */
+static void read_proc_uids(struct lslogins_control *ctl)
+{
+	struct dirent *d;
+	size_t nalloc = 0;
+	DIR *dir;
+
+	dir = opendir("/proc");
+	if (!dir)
+		return;
 
-	while (!proc_next_pid(proc, &pid))
-		++nprocs;
+	while ((d = readdir(dir))) {
+		struct stat st;
 
-	proc_close_processes(proc);
-	return nprocs;
+		if (!isdigit((unsigned char) *d->d_name))
+			continue;
+		if (fstatat(dirfd(dir), d->d_name, &st, 0))
+			continue;
+
+		if (ctl->nproc_uids == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 256;
+			ctl->proc_uids = xrealloc(ctl->proc_uids,
+						  nalloc * sizeof(uid_t));
+		}
+		ctl->proc_uids[ctl->nproc_uids++] = st.st_uid;
+	}
+	closedir(dir);
+
+	if (ctl->nproc_uids)
+		qsort(ctl->proc_uids, ctl->nproc_uids, sizeof(uid_t), cmp_uids);
+}
+
+static int get_nprocs(struct lslogins_control *ctl, const uid_t uid)
+{
+	size_t lo = 0, hi = ctl->nproc_uids, n;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (ctl->proc_uids[mid] < uid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (n = lo; n < ctl->nproc_uids && ctl->proc_uids[n] == uid; n++);
+	return n - lo;
 }
 
 static const char *get_pwd_method(const char *str, const char **next, unsigned int *sz)
@@ -651,22 +953,215 @@ static int valid_pwd(const char *str)
 	return 1;
 }
 
-static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const char *username)
+static char *dup_str(const char *str)
 {
-	struct lslogins_user *user;
-	struct passwd *pwd;
-	struct group *grp;
-	struct spwd *shadow;
-	struct utmpx *user_wtmp = NULL, *user_btmp = NULL;
-	size_t n = 0;
-	time_t time;
-	uid_t uid;
-	errno = 0;
+	return str ? xstrdup(str) : NULL;
+}
 
-	errno = 0;
-	pwd = username ? getpwnam(username) : getpwent();
-	if (!pwd)
+static void copy_passwd(struct passwd *dst, const struct passwd *src)
+{
+	*dst = *src;
+	dst->pw_name = dup_str(src->pw_name);
+	dst->pw_passwd = dup_str(src->pw_passwd);
+	dst->pw_gecos = dup_str(src->pw_gecos);
+	dst->pw_dir = dup_str(src->pw_dir);
+	dst->pw_shell = dup_str(src->pw_shell);
+}
+
+static void free_passwd(struct passwd *pw)
+{
+	free(pw->pw_name);
+	free(pw->pw_passwd);
+	free(pw->pw_gecos);
+	free(pw->pw_dir);
+	free(pw->pw_shell);
+}
+
+static void copy_spwd(struct spwd *dst, const struct spwd *src)
+{
+	*dst = *src;
+	dst->sp_namp = dup_str(src->sp_namp);
+	dst->sp_pwdp = dup_str(src->sp_pwdp);
+}
+
+static void free_spwd(struct spwd *sp)
+{
+	free(sp->sp_namp);
+	free(sp->sp_pwdp);
+}
+
+static int cmp_passwd_name(const void *a, const void *b)
+{
+	const struct passwd *x = *(const struct passwd * const *) a;
+	const struct passwd *z = *(const struct passwd * const *) b;
+	int rc = strcmp(x->pw_name, z->pw_name);
+
+	return rc ? rc : x < z ? -1 : x > z ? 1 : 0;
+}
+
+static int cmp_spwd_name(const void *a, const void *b)
+{
+	const struct spwd *x = *(const struct spwd * const *) a;
+	const struct spwd *z = *(const struct spwd * const *) b;
+	int rc = strcmp(x->sp_namp, z->sp_namp);
+
+	return rc ? rc : x < z ? -1 : x > z ? 1 : 0;
+}
+
+/*
+ * --local-only: reads /etc/passwd, /etc/shadow and /etc/group directly. The
+ * entries are sorted by names for the lookups, the first entry wins as for
+ * the NSS "files" module.
+ */
+static void read_local_files(struct lslogins_control *ctl)
+{
+	struct passwd *pw;
+	struct spwd *sp;
+	struct group *gr;
+	size_t i, nalloc = 0;
+	FILE *f;
+
+	f = fopen(_PATH_PASSWD, "r" UL_CLOEXECSTR);
+	if (!f)
+		err(EXIT_FAILURE, _("cannot open %s"), _PATH_PASSWD);
+	while ((pw = fgetpwent(f))) {
+		if (ctl->local_npw == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 256;
+			ctl->local_pw = xrealloc(ctl->local_pw, nalloc * sizeof(*pw));
+		}
+		copy_passwd(&ctl->local_pw[ctl->local_npw++], pw);
+	}
+	fclose(f);
+
+	ctl->local_pw_byname = xcalloc(ctl->local_npw + 1, sizeof(struct passwd *));
+	for (i = 0; i < ctl->local_npw; i++)
+		ctl->local_pw_byname[i] = &ctl->local_pw[i];
+	if (ctl->local_npw)
+		qsort(ctl->local_pw_byname, ctl->local_npw, sizeof(struct passwd *),
+		      cmp_passwd_name);
+
+	/* not readable for non-root users, the same as getspnam() */
+	nalloc = 0;
+	f = require_shadow() ? fopen(_PATH_SHADOW_PASSWD, "r" UL_CLOEXECSTR) : NULL;
+	if (f) {
+		while ((sp = fgetspent(f))) {
+			if (ctl->local_nsp == nalloc) {
+				nalloc = nalloc ? nalloc * 2 : 256;
+				ctl->local_sp = xrealloc(ctl->local_sp, nalloc * sizeof(*sp));
+			}
+			copy_spwd(&ctl->local_sp[ctl->local_nsp++], sp);
+		}
+		fclose(f);
+	}
+
+	ctl->local_sp_byname = xcalloc(ctl->local_nsp + 1, sizeof(struct spwd *));
+	for (i = 0; i < ctl->local_nsp; i++)
+		ctl->local_sp_byname[i] = &ctl->local_sp[i];
+	if (ctl->local_nsp)
+		qsort(ctl->local_sp_byname, ctl->local_nsp, sizeof(struct spwd *),
+		      cmp_spwd_name);
+
+	nalloc = 0;
+	f = fopen(_PATH_GROUP, "r" UL_CLOEXECSTR);
+	if (!f)
+		err(EXIT_FAILURE, _("cannot open %s"), _PATH_GROUP);
+	while ((gr = fgetgrent(f))) {
+		char **m;
+
+		if (!find_group(ctl, gr->gr_gid))
+			add_group(ctl, gr->gr_gid, gr->gr_name);
+
+		for (m = gr->gr_mem; m && *m; m++) {
+			struct lslogins_member *x;
+
+			if (ctl->local_nmembers == nalloc) {
+				nalloc = nalloc ? nalloc * 2 : 256;
+				ctl->local_members = xrealloc(ctl->local_members,
+						nalloc * sizeof(*x));
+			}
+			x = &ctl->local_members[ctl->local_nmembers];
+			x->name = xstrdup(*m);
+			x->gid = gr->gr_gid;
+			x->idx = ctl->local_nmembers++;
+		}
+	}
+	fclose(f);
+
+	if (ctl->local_nmembers)
+		qsort(ctl->local_members, ctl->local_nmembers,
+		      sizeof(struct lslogins_member), cmp_member_name);
+}
+
+static void free_local_files(struct lslogins_control *ctl)
+{
+	size_t i;
+
+	for (i = 0; i < ctl->local_npw; i++)
+		free_passwd(&ctl->local_pw[i]);
+	for (i = 0; i < ctl->local_nsp; i++)
+		free_spwd(&ctl->local_sp[i]);
+	for (i = 0; i < ctl->local_nmembers; i++)
+		free(ctl->local_members[i].name);
+
+	free(ctl->local_pw);
+	free(ctl->local_pw_byname);
+	free(ctl->local_sp);
+	free(ctl->local_sp_byname);
+	free(ctl->local_members);
+}
+
+/* returns the first entry of @name */
+static void *find_local_entry(void **ary, size_t nmemb, const char *name,
+			      const char *(*get_name)(const void *))
+{
+	size_t lo = 0, hi = nmemb;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (strcmp(get_name(ary[mid]), name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < nmemb && strcmp(get_name(ary[lo]), name) == 0)
+		return ary[lo];
+	return NULL;
+}
+
+static const char *passwd_name(const void *p)
+{
+	return ((const struct passwd *) p)->pw_name;
+}
+
+static const char *spwd_name(const void *p)
+{
+	return ((const struct spwd *) p)->sp_namp;
+}
+
+static struct passwd *get_passwd(struct lslogins_control *ctl,
+				 const char *username, size_t *pos)
+{
+	if (ctl->local_only) {
+		if (username)
+			return find_local_entry((void **) ctl->local_pw_byname,
+					ctl->local_npw, username, passwd_name);
+		if (*pos < ctl->local_npw)
+			return &ctl->local_pw[(*pos)++];
+		errno = 0;
 		return NULL;
+	}
+	return username ? getpwnam(username) : getpwent();
+}
+
+/*
+ * Adds the user database entry to ctl->accounts. Returns 0 on success,
+ * or -1 and errno is EAGAIN if the user is filtered out.
+ */
+static int add_account(struct lslogins_control *ctl, struct passwd *pwd)
+{
+	struct lslogins_account *acc;
+	uid_t uid;
 
 	ctl->uid = uid = pwd->pw_uid;
 
@@ -677,30 +1172,150 @@ static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const c
 	    uid != 0) {
 		if (uid < ctl->UID_MIN || uid > ctl->UID_MAX) {
 			errno = EAGAIN;
-			return NULL;
+			return -1;
 		}
 
 	} else if ((lslogins_flag & F_SYSAC) &&
 		   (uid < ctl->SYS_UID_MIN || uid > ctl->SYS_UID_MAX)) {
 		errno = EAGAIN;
-		return NULL;
+		return -1;
 	}
 
 	errno = 0;
-	grp = getgrgid(pwd->pw_gid);
-	if (!grp)
-		return NULL;
+	if (!get_group_name(ctl, pwd->pw_gid))
+		return -1;
+
+	if (ctl->naccounts % 64 == 0)
+		ctl->accounts = xrealloc(ctl->accounts,
+				(ctl->naccounts + 64) * sizeof(*acc));
+	acc = &ctl->accounts[ctl->naccounts++];
+	memset(acc, 0, sizeof(*acc));
+	copy_passwd(&acc->pw, pwd);
+	return 0;
+}
+
+static void free_accounts(struct lslogins_control *ctl)
+{
+	size_t i;
+
+	for (i = 0; i < ctl->naccounts; i++) {
+		struct lslogins_account *acc = &ctl->accounts[i];
+
+		free_passwd(&acc->pw);
+		if (acc->has_shadow)
+			free_spwd(&acc->sp);
+		free(acc->sgroups);
+	}
+	free(ctl->accounts);
+	ctl->accounts = NULL;
+	ctl->naccounts = 0;
+}
+
+/* the slow NSS lookups, called by more threads */
+static void read_account_data(struct lslogins_control *ctl,
+			      struct lslogins_account *acc,
+			      int want_shadow, int want_sgroups)
+{
+	if (want_shadow) {
+		if (ctl->local_only) {
+			struct spwd *sp = find_local_entry((void **) ctl->local_sp_byname,
+					ctl->local_nsp, acc->pw.pw_name, spwd_name);
+			if (sp) {
+				copy_spwd(&acc->sp, sp);
+				acc->has_shadow = 1;
+			}
+		} else {
+			size_t bufsz = 1024;
+			struct spwd sp, *res = NULL;
+			char *buf = NULL;
+			int rc;
+
+			do {
+				buf = xrealloc(buf, bufsz);
+				rc = getspnam_r(acc->pw.pw_name, &sp, buf, bufsz, &res);
+				bufsz *= 2;
+			} while (rc == ERANGE);
+
+			if (rc == 0 && res) {
+				copy_spwd(&acc->sp, res);
+				acc->has_shadow = 1;
+			}
+			free(buf);
+		}
+	}
+
+	if (want_sgroups) {
+		int rc = ctl->local_only ?
+			get_local_sgroups(ctl, &acc->sgroups, &acc->nsgroups, &acc->pw) :
+			get_sgroups(&acc->sgroups, &acc->nsgroups, &acc->pw);
+		if (rc)
+			acc->sgroups_failed = 1;
+	}
+}
+
+struct lslogins_range {
+	struct lslogins_control	*ctl;
+	unsigned int		want_shadow :1,
+				want_sgroups :1;
+};
+
+/* reads ctl->accounts[first..last) */
+static void read_range(void *data, size_t range __attribute__((__unused__)),
+		       size_t first, size_t last)
+{
+	struct lslogins_range *rg = data;
+	size_t i;
+
+	for (i = first; i < last; i++)
+		read_account_data(rg->ctl, &rg->ctl->accounts[i],
+				  rg->want_shadow, rg->want_sgroups);
+}
+
+/*
+ * Reads shadow entries and supplementary groups of all the accounts. The
+ * lookups are slow for network databases (LDAP, ...), so every thread reads
+ * continuous range of the accounts.
+ */
+static void read_accounts_data(struct lslogins_control *ctl)
+{
+	struct lslogins_range rg = { .ctl = ctl };
+	int want_shadow = require_shadow(),
+	    want_sgroups = require_column(COL_SGROUPS) || require_column(COL_SGIDS);
+
+	if (!ctl->naccounts || (!want_shadow && !want_sgroups))
+		return;
+
+	rg.want_shadow = want_shadow;
+	rg.want_sgroups = want_sgroups;
+
+	if (want_shadow)
+		lckpwdf();
+
+	ul_run_ranges(ctl->naccounts, LSLOGINS_PERTHREAD, LSLOGINS_THREADS,
+		      read_range, &rg);
+
+	if (want_shadow)
+		ulckpwdf();
+}
+
+static struct lslogins_user *get_user_info(struct lslogins_control *ctl,
+					   struct lslogins_account *acc)
+{
+	struct lslogins_user *user;
+	struct passwd *pwd = &acc->pw;
+	struct spwd *shadow = acc->has_shadow ? &acc->sp : NULL;
+	struct utmpx *user_wtmp = NULL, *user_btmp = NULL;
+	size_t n = 0;
+	time_t time;
+
+	ctl->uid = pwd->pw_uid;
 
 	user = xcalloc(1, sizeof(struct lslogins_user));
 
 	if (ctl->wtmp)
-		user_wtmp = get_last_wtmp(ctl, pwd->pw_name);
+		user_wtmp = get_last_utmp(ctl->wtmp_index, ctl->wtmp_nindex, pwd->pw_name);
 	if (ctl->btmp)
-		user_btmp = get_last_btmp(ctl, pwd->pw_name);
-
-	lckpwdf();
-	shadow = getspnam(pwd->pw_name);
-	ulckpwdf();
+		user_btmp = get_last_utmp(ctl->btmp_index, ctl->btmp_nindex, pwd->pw_name);
 
 	/* required  by tseach() stuff */
 	user->uid = pwd->pw_uid;
@@ -714,15 +1329,21 @@ static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const c
 			user->uid = pwd->pw_uid;
 			break;
 		case COL_GROUP:
-			user->group = xstrdup(grp->gr_name);
+			user->group = xstrdup(get_group_name(ctl, pwd->pw_gid));
 			break;
 		case COL_GID:
 			user->gid = pwd->pw_gid;
 			break;
 		case COL_SGROUPS:
 		case COL_SGIDS:
-			if (get_sgroups(&user->sgroups, &user->nsgroups, pwd))
+			if (acc->sgroups_failed)
 				err(EXIT_FAILURE, _("failed to get supplementary groups"));
+			if (columns[n - 1] == COL_SGROUPS && !user->sgroups)
+				user->sgroups = build_sgroups_string(ctl, acc->sgroups,
+							acc->nsgroups, TRUE);
+			if (columns[n - 1] == COL_SGIDS && !user->sgids)
+				user->sgids = build_sgroups_string(ctl, acc->sgroups,
+							acc->nsgroups, FALSE);
 			break;
 		case COL_HOME:
 			user->homedir = xstrdup(pwd->pw_dir);
@@ -852,7 +1473,7 @@ static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const c
 #endif
 			break;
 		case COL_NPROCS:
-			xasprintf(&user->nprocs, "%d", get_nprocs(pwd->pw_uid));
+			xasprintf(&user->nprocs, "%d", get_nprocs(ctl, pwd->pw_uid));
 			break;
 		default:
 			/* something went very wrong here */
@@ -947,6 +1568,13 @@ static void free_ctl(struct lslogins_control *ctl)
 
 	free(ctl->wtmp);
 	free(ctl->btmp);
+	free(ctl->wtmp_index);
+	free(ctl->btmp_index);
+	free(ctl->proc_uids);
+	free_accounts(ctl);
+	free_groups(ctl);
+	if (ctl->local_only)
+		free_local_files(ctl);
 
 	while (n < ctl->ulsiz)
 		free(ctl->ulist[n++]);
@@ -955,32 +1583,42 @@ static void free_ctl(struct lslogins_control *ctl)
 	free(ctl);
 }
 
-static struct lslogins_user *get_next_user(struct lslogins_control *ctl)
-{
-	struct lslogins_user *u;
-	errno = 0;
-	while (!(u = get_user_info(ctl, NULL))) {
-		/* no "false" errno-s here, iff we're unable to
-		 * get a valid user entry for any reason, quit */
-		if (errno == EAGAIN)
-			continue;
-		return NULL;
-	}
-	return u;
-}
-
 /* some UNIX implementations set errno iff a passwd/grp/...
  * entry was not found. The original UNIX logins(1) utility always
  * ignores invalid login/group names, so we're going to as well.*/
 #define IS_REAL_ERRNO(e) !((e) == ENOENT || (e) == ESRCH || \
 		(e) == EBADF || (e) == EPERM || (e) == EAGAIN)
 
-static int get_user(struct lslogins_control *ctl, struct lslogins_user **user,
-		    const char *username)
+/* collects the wanted accounts, returns the number of added accounts */
+static int collect_accounts(struct lslogins_control *ctl)
 {
-	*user = get_user_info(ctl, username);
-	if (!*user && IS_REAL_ERRNO(errno))
-		return -1;
+	struct passwd *pwd;
+	size_t n, pos = 0;
+
+	if (ctl->ulist_on) {
+		for (n = 0; n < ctl->ulsiz; n++) {
+			int rc = -1;
+
+			errno = 0;
+			pwd = get_passwd(ctl, ctl->ulist[n], NULL);
+			if (pwd)
+				rc = add_account(ctl, pwd);
+
+			if (ctl->fail_on_unknown && rc) {
+				warnx(_("cannot found '%s'"), ctl->ulist[n]);
+				return -1;
+			}
+		}
+		return 0;
+	}
+
+	errno = 0;
+	while ((pwd = get_passwd(ctl, NULL, &pos))) {
+		/* skip filtered out users and users with unknown group */
+		if (add_account(ctl, pwd) && errno && IS_REAL_ERRNO(errno))
+			break;
+		errno = 0;
+	}
 	return 0;
 }
 
@@ -993,25 +1631,22 @@ static int cmp_uid(const void *a, const void *b)
 
 static int create_usertree(struct lslogins_control *ctl)
 {
-	struct lslogins_user *user = NULL;
-	size_t n = 0;
+	size_t n;
 
-	if (ctl->ulist_on) {
-		for (n = 0; n < ctl->ulsiz; n++) {
-			int rc = get_user(ctl, &user, ctl->ulist[n]);
+	if (ctl->local_only)
+		read_local_files(ctl);
+	if (require_column(COL_NPROCS))
+		read_proc_uids(ctl);
 
-			if (ctl->fail_on_unknown && !user) {
-				warnx(_("cannot found '%s'"), ctl->ulist[n]);
-				return -1;
-			}
-			if (rc || !user)
-				continue;
+	if (collect_accounts(ctl))
+		return -1;
 
-			tsearch(user, &ctl->usertree, cmp_uid);
-		}
-	} else {
-		while ((user = get_next_user(ctl)))
-			tsearch(user, &ctl->usertree, cmp_uid);
+	read_accounts_data(ctl);
+
+	for (n = 0; n < ctl->naccounts; n++) {
+		struct lslogins_user *user = get_user_info(ctl, &ctl->accounts[n]);
+
+		tsearch(user, &ctl->usertree, cmp_uid);
 	}
 	return 0;
 }
@@ -1114,16 +1749,10 @@ static void fill_table(const void *u, const VISIT which, const int depth __attri
 			rc = scols_line_refer_data(ln, n, gidtostr(user->gid));
 			break;
 		case COL_SGROUPS:
-			rc = scols_line_refer_data(ln, n,
-				build_sgroups_string(user->sgroups,
-						     user->nsgroups,
-						     TRUE));
+			rc = scols_line_set_data(ln, n, user->sgroups);
 			break;
 		case COL_SGIDS:
-			rc = scols_line_refer_data(ln, n,
-				build_sgroups_string(user->sgroups,
-						     user->nsgroups,
-						     FALSE));
+			rc = scols_line_set_data(ln, n, user->sgids);
 			break;
 		case COL_HOME:
 			rc = scols_line_set_data(ln, n, user->homedir);
@@ -1291,6 +1920,7 @@ static void free_user(void *f)
 	free(u->group);
 	free(u->gecos);
 	free(u->sgroups);
+	free(u->sgids);
 	free(u->pwd_ctime);
 	free(u->pwd_warn);
 	free(u->pwd_ctime_min);
@@ -1361,6 +1991,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -u, --user-accs          display user accounts\n"), out);
 	fputs(_(" -Z, --context            display SELinux contexts\n"), out);
 	fputs(_(" -z, --print0             delimit user entries with a nul character\n"), out);
+	fputs(_("     --local-only         read the local files rather than use NSS\n"), out);
 	fputs(_("     --wtmp-file <path>   set an alternate path for wtmp\n"), out);
 	fputs(_("     --btmp-file <path>   set an alternate path for btmp\n"), out);
 	fputs(USAGE_SEPARATOR, out);
@@ -1391,6 +2022,7 @@ int main(int argc, char *argv[])
 		OPT_NOHEAD,
 		OPT_TIME_FMT,
 		OPT_OUTPUT_ALL,
+		OPT_LOCAL,
 	};
 
 	static const struct option longopts[] = {
@@ -1415,6 +2047,7 @@ int main(int argc, char *argv[])
 		{ "version",        no_argument,	0, 'V' },
 		{ "pwd",            no_argument,	0, 'p' },
 		{ "print0",         no_argument,	0, 'z' },
+		{ "local-only",     no_argument,	0, OPT_LOCAL },
 		{ "wtmp-file",      required_argument,	0, OPT_WTMP },
 		{ "btmp-file",      required_argument,	0, OPT_BTMP },
 #ifdef HAVE_LIBSELINUX
@@ -1524,6 +2157,9 @@ int main(int argc, char *argv[])
 		case 'z':
 			outmode = OUT_NUL;
 			break;
+		case OPT_LOCAL:
+			ctl->local_only = 1;
+			break;
 		case OPT_WTMP:
 			path_wtmp = optarg;
 			break;
@@ -150,6 +150,7 @@ struct su_context {
 		     pam_has_session :1,	/* PAM session opened */
 		     pam_has_cred :1,		/* PAM cred established */
 		     force_pty :1,		/* create pseudo-terminal */
+		     no_session :1,		/* runuser --no-session, no PAM and no parent */
 		     restricted :1;		/* false for root user */
 };
 
@@ -319,6 +320,9 @@ static void supam_cleanup(struct su_context *su, int retcode)
 {
 	const int errsv = errno;
 
+	if (!su->pamh)
+		return;
+
 	DBG(PAM, ul_debug("cleanup"));
 
 	if (su->pam_has_session)
@@ -334,6 +338,9 @@ static void supam_export_environment(struct su_context *su)
 {
 	char **env;
 
+	if (!su->pamh)
+		return;
+
 	DBG(PAM, ul_debug("init environ[]"));
 
 	/* This is a copy but don't care to free as we exec later anyways.  */
@@ -756,6 +763,9 @@ static void init_groups(struct su_context *su, gid_t *groups, size_t ngroups)
 	}
 	endgrent();
 
+	if (!su->pamh)
+		return;
+
 	rc = pam_setcred(su->pamh, PAM_ESTABLISH_CRED);
 	if (is_pam_failure(rc))
 		errx(EXIT_FAILURE, _("failed to establish user credentials: %s"),
@@ -873,6 +883,7 @@ static void usage_runuser(void)
 
 	fputs(USAGE_OPTIONS, stdout);
 	fputs(_(" -u, --user <user>               username\n"), stdout);
+	fputs(_("     --no-session                no PAM and exec the command directly\n"), stdout);
 	usage_common();
 	fputs(USAGE_SEPARATOR, stdout);
 
@@ -970,6 +981,9 @@ int su_main(int argc, char **argv, int mode)
 	bool use_gid = false;
 	gid_t gid = 0;
 
+	enum {
+		OPT_NO_SESSION = CHAR_MAX + 1
+	};
 	static const struct option longopts[] = {
 		{"command", required_argument, NULL, 'c'},
 		{"session-command", required_argument, NULL, 'C'},
@@ -981,18 +995,19 @@ int su_main(int argc, char **argv, int mode)
 		{"group", required_argument, NULL, 'g'},
 		{"supp-group", required_argument, NULL, 'G'},
 		{"user", required_argument, NULL, 'u'},	/* runuser only */
+		{"no-session", no_argument, NULL, OPT_NO_SESSION},	/* runuser only */
 		{"whitelist-environment", required_argument, NULL, 'w'},
 		{"help", no_argument, 0, 'h'},
 		{"version", no_argument, 0, 'V'},
 		{NULL, 0, NULL, 0}
 	};
 	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
+		{ 'P', OPT_NO_SESSION },	/* pty, no-session */
 		{ 'm', 'w' },			/* preserve-environment, whitelist-environment */
 		{ 'p', 'w' },			/* preserve-environment, whitelist-environment */
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
-
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
 	textdomain(PACKAGE);
@@ -1063,6 +1078,12 @@ int su_main(int argc, char **argv, int mode)
 			su->new_user = optarg;
 			break;
 
+		case OPT_NO_SESSION:
+			if (!su->runuser)
+				errtryhelp(EXIT_FAILURE);
+			su->no_session = 1;
+			break;
+
 		case 'h':
 			usage(mode);
 
@@ -1112,9 +1133,12 @@ int su_main(int argc, char **argv, int mode)
 	if ((use_supp || use_gid) && su->restricted)
 		errx(EXIT_FAILURE,
 		     _("only root can specify alternative groups"));
+	if (su->no_session && su->restricted)
+		errx(EXIT_FAILURE, _("only root can use --no-session"));
 
 	logindefs_set_loader(load_config, (void *) su);
-	init_tty(su);
+	if (!su->no_session)
+		init_tty(su);
 
 	su->pwd = xgetpwnam(su->new_user, &su->pwdbuf);
 	if (!su->pwd
@@ -1126,7 +1150,8 @@ int su_main(int argc, char **argv, int mode)
 		       "contain all the required fields"), su->new_user);
 
 	su->new_user = su->pwd->pw_name;
-	su->old_user = xgetlogin();
+	if (!su->no_session)
+		su->old_user = xgetlogin();
 
 	if (!su->pwd->pw_shell || !*su->pwd->pw_shell)
 		su->pwd->pw_shell = DEFAULT_SHELL;
@@ -1136,7 +1161,12 @@ int su_main(int argc, char **argv, int mode)
 	else if (use_gid)
 		su->pwd->pw_gid = gid;
 
-	supam_authenticate(su);
+	/*
+	 * runuser --no-session is root -> user without authentication, so
+	 * nothing is done by PAM and there is no session to close by parent.
+	 */
+	if (!su->no_session)
+		supam_authenticate(su);
 
 	if (request_same_session || !command || !su->pwd->pw_uid)
 		su->same_session = 1;
@@ -1168,7 +1198,8 @@ int su_main(int argc, char **argv, int mode)
 	if (!su->simulate_login || command)
 		su->suppress_pam_info = 1;	/* don't print PAM info messages */
 
-	supam_open_session(su);
+	if (!su->no_session)
+		supam_open_session(su);
 
 #ifdef USE_PTY
 	if (su->force_pty) {
@@ -1179,7 +1210,8 @@ int su_main(int argc, char **argv, int mode)
 			err(EXIT_FAILURE, _("failed to allocate pty handler"));
 	}
 #endif
-	create_watching_parent(su);
+	if (!su->no_session)
+		create_watching_parent(su);
 	/* Now we're in the child.  */
 
 	change_identity(su->pwd);
@@ -44,7 +44,23 @@
 #include "nls.h"
 #include "xalloc.h"
 #include "closestream.h"
+#include "strutils.h"
 #include "timeutils.h"
+#include "linereader.h"
+
+/* number of records read by one fread() and size of the stdio buffers */
+#define UTMPDUMP_NRECS		1024
+#define UTMPDUMP_BUFSZ		(1024 * 1024)
+
+/* --since, --until and --user; the records out of the filter are not
+ * written, both for dump and undump */
+struct utmp_filter {
+	usec_t		since;
+	usec_t		until;
+	const char	*user;
+};
+
+static struct utmp_filter filter;
 
 static time_t strtotime(const char *s_time)
 {
@@ -71,6 +87,52 @@ static time_t strtotime(const char *s_time)
 	return timegm(&tm);
 }
 
+static int64_t days_from_civil(int y, int m, int d)
+{
+	int64_t era;
+	int yoe, doy, doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+static int get_digits(const char *s, int n)
+{
+	int x = 0;
+
+	for (; n > 0; n--, s++) {
+		if (!isdigit((unsigned char) *s))
+			return -1;
+		x = x * 10 + (*s - '0');
+	}
+	return x;
+}
+
+/* the usual "1998-09-01T01:00:00" timestamps are parsed without strptime()
+ * and timegm(), anything else is left to strtotime() */
+static time_t parse_time(const char *s_time)
+{
+	int year, mon, day, hour, min, sec;
+
+	if (strlen(s_time) < 19
+	    || s_time[4] != '-' || s_time[7] != '-' || s_time[10] != 'T'
+	    || s_time[13] != ':' || s_time[16] != ':'
+	    || (year = get_digits(s_time, 4)) < 1000
+	    || (mon  = get_digits(s_time + 5, 2)) < 1 || mon > 12
+	    || (day  = get_digits(s_time + 8, 2)) < 1 || day > 31
+	    || (hour = get_digits(s_time + 11, 2)) < 0 || hour > 23
+	    || (min  = get_digits(s_time + 14, 2)) < 0 || min > 59
+	    || (sec  = get_digits(s_time + 17, 2)) < 0 || sec > 60)
+		return strtotime(s_time);
+
+	return (time_t) (days_from_civil(year, mon, day) * 86400
+			 + hour * 3600 + min * 60 + sec);
+}
+
 static suseconds_t strtousec(const char *s_time)
 {
 	const char *s = strchr(s_time, ',');
@@ -87,11 +149,101 @@ static void xcleanse(char *s, int len)
 			*s = '?';
 }
 
+static int is_filtered(const struct utmpx *ut)
+{
+	usec_t t;
+
+	if (filter.user && strncmp(ut->ut_user, filter.user, sizeof(ut->ut_user)))
+		return 1;
+	if (!filter.since && !filter.until)
+		return 0;
+
+	t = (usec_t) ut->ut_tv.tv_sec * USEC_PER_SEC + ut->ut_tv.tv_usec;
+	return (filter.since && t < filter.since)
+	       || (filter.until && t > filter.until);
+}
+
+/* as sprintf("%-*.*s", width, maxsz, s) */
+static char *put_str(char *p, const char *s, size_t maxsz, size_t width)
+{
+	size_t len = strnlen(s, maxsz);
+
+	memcpy(p, s, len);
+	p += len;
+	for (; len < width; len++)
+		*p++ = ' ';
+	return p;
+}
+
+static char *put_sep(char *p)
+{
+	*p++ = ']';
+	*p++ = ' ';
+	*p++ = '[';
+	return p;
+}
+
+/* as sprintf("%0*d", width, num) */
+static char *put_num(char *p, long num, int width)
+{
+	char tmp[sizeof(long) * 3];
+	unsigned long x = num < 0 ? -(unsigned long) num : (unsigned long) num;
+	int n = 0;
+
+	do {
+		tmp[n++] = '0' + x % 10;
+		x /= 10;
+	} while (x);
+
+	if (num < 0) {
+		*p++ = '-';
+		width--;
+	}
+	for (; width > n; width--)
+		*p++ = '0';
+	while (n > 0)
+		*p++ = tmp[--n];
+	return p;
+}
+
+/* as strtimeval_iso(ISO_TIMESTAMP_COMMA_GT), but without snprintf() */
+static char *put_time(char *p, const struct timeval *tv)
+{
+	static struct ul_timecache tc;
+	struct tm tm;
+	time_t t = tv->tv_sec;
+
+	if (ul_timecache_tm(&tc, t, 1, &tm) != 0 || tm.tm_year < 1000 - 1900 || tm.tm_year > 9999 - 1900
+	    || tv->tv_usec < 0 || tv->tv_usec >= 1000000) {
+		if (strtimeval_iso((struct timeval *) tv, ISO_TIMESTAMP_COMMA_GT,
+				   p, ISO_BUFSIZ) != 0)
+			return NULL;
+		return p + strlen(p);
+	}
+
+	p = put_num(p, tm.tm_year + 1900, 4);
+	*p++ = '-';
+	p = put_num(p, tm.tm_mon + 1, 2);
+	*p++ = '-';
+	p = put_num(p, tm.tm_mday, 2);
+	*p++ = 'T';
+	p = put_num(p, tm.tm_hour, 2);
+	*p++ = ':';
+	p = put_num(p, tm.tm_min, 2);
+	*p++ = ':';
+	p = put_num(p, tm.tm_sec, 2);
+	*p++ = ',';
+	p = put_num(p, tv->tv_usec, 6);
+	memcpy(p, "+00:00", 6);
+	return p + 6;
+}
+
 static void print_utline(struct utmpx *ut, FILE *out)
 {
 	const char *addr_string;
 	char buffer[INET6_ADDRSTRLEN];
-	char time_string[40];
+	char time_string[ISO_BUFSIZ], *time_end;
+	char line[sizeof(*ut) + sizeof(buffer) + sizeof(time_string) + 64], *p;
 	struct timeval tv;
 
 	if (ut->ut_addr_v6[1] || ut->ut_addr_v6[2] || ut->ut_addr_v6[3])
@@ -102,21 +254,60 @@ static void print_utline(struct utmpx *ut, FILE *out)
 	tv.tv_sec = ut->ut_tv.tv_sec;
 	tv.tv_usec = ut->ut_tv.tv_usec;
 
-	if (strtimeval_iso(&tv, ISO_TIMESTAMP_COMMA_GT, time_string,
-			   sizeof(time_string)) != 0)
+	time_end = put_time(time_string, &tv);
+	if (!time_end)
 		return;
+
 	cleanse(ut->ut_id);
 	cleanse(ut->ut_user);
 	cleanse(ut->ut_line);
 	cleanse(ut->ut_host);
 
-	/*            type pid    id       user     line     host     addr    time */
-	fprintf(out, "[%d] [%05d] [%-4.4s] [%-*.*s] [%-*.*s] [%-*.*s] [%-15s] [%s]\n",
-	       ut->ut_type, ut->ut_pid, ut->ut_id,
-	       8, (int)sizeof(ut->ut_user), ut->ut_user,
-	       12, (int)sizeof(ut->ut_line), ut->ut_line,
-	       20, (int)sizeof(ut->ut_host), ut->ut_host,
-	       addr_string, time_string);
+	/* [type] [pid] [id] [user] [line] [host] [addr] [time] */
+	p = line;
+	*p++ = '[';
+	p = put_num(p, ut->ut_type, 0);
+	p = put_sep(p);
+	p = put_num(p, ut->ut_pid, 5);
+	p = put_sep(p);
+	p = put_str(p, ut->ut_id, 4, 4);
+	p = put_sep(p);
+	p = put_str(p, ut->ut_user, sizeof(ut->ut_user), 8);
+	p = put_sep(p);
+	p = put_str(p, ut->ut_line, sizeof(ut->ut_line), 12);
+	p = put_sep(p);
+	p = put_str(p, ut->ut_host, sizeof(ut->ut_host), 20);
+	p = put_sep(p);
+	p = put_str(p, addr_string ? addr_string : "(null)", INET6_ADDRSTRLEN, 15);
+	p = put_sep(p);
+
+	memcpy(p, time_string, time_end - time_string);
+	p += time_end - time_string;
+	*p++ = ']';
+	*p++ = '\n';
+
+	fwrite(line, 1, p - line, out);
+}
+
+/* reads the records by large blocks, returns number of the records */
+static size_t dump_records(FILE *in, FILE *out)
+{
+	static struct utmpx *recs;
+	size_t i, n, count = 0;
+
+	if (!recs)
+		recs = xmalloc(UTMPDUMP_NRECS * sizeof(*recs));
+
+	while ((n = fread(recs, sizeof(*recs), UTMPDUMP_NRECS, in)) > 0) {
+		for (i = 0; i < n; i++) {
+			if (!is_filtered(&recs[i]))
+				print_utline(&recs[i], out);
+		}
+		count += n;
+		if (n < UTMPDUMP_NRECS)
+			break;
+	}
+	return count;
 }
 
 #ifdef HAVE_INOTIFY_INIT
@@ -127,7 +318,6 @@ static void roll_file(const char *filename, off_t *size, FILE *out)
 {
 	FILE *in;
 	struct stat st;
-	struct utmpx ut;
 	off_t pos;
 
 	if (!(in = fopen(filename, "r")))
@@ -139,10 +329,8 @@ static void roll_file(const char *filename, off_t *size, FILE *out)
 	if (st.st_size == *size)
 		goto done;
 
-	if (fseek(in, *size, SEEK_SET) != (off_t) -1) {
-		while (fread(&ut, sizeof(ut), 1, in) == 1)
-			print_utline(&ut, out);
-	}
+	if (fseek(in, *size, SEEK_SET) != (off_t) -1)
+		dump_records(in, out);
 
 	pos = ftello(in);
 	/* If we've successfully read something, use the file position, this
@@ -213,8 +401,7 @@ static FILE *dump(FILE *in, const char *filename, int follow, FILE *out)
 	if (follow)
 		ignore_result( fseek(in, -10 * sizeof(ut), SEEK_END) );
 
-	while (fread(&ut, sizeof(ut), 1, in) == 1)
-		print_utline(&ut, out);
+	dump_records(in, out);
 
 	if (!follow)
 		return in;
@@ -227,8 +414,7 @@ static FILE *dump(FILE *in, const char *filename, int follow, FILE *out)
 		/* fallback for systems without inotify or with non-free
 		 * inotify instances */
 		for (;;) {
-			while (fread(&ut, sizeof(ut), 1, in) == 1)
-				print_utline(&ut, out);
+			dump_records(in, out);
 			sleep(1);
 		}
 
@@ -238,63 +424,114 @@ static FILE *dump(FILE *in, const char *filename, int follow, FILE *out)
 
 /* This function won't work properly if there's a ']' or a ' ' in the real
  * token.  Thankfully, this should never happen.  */
-static int gettok(char *line, char *dest, int size, int eatspace)
+static char *next_token(char **line)
 {
-	int bpos, epos, eaten;
+	char *tok, *end;
 
-	bpos = strchr(line, '[') - line;
-	if (bpos < 0)
+	tok = strchr(*line, '[');
+	if (!tok)
 		errx(EXIT_FAILURE, _("Extraneous newline in file. Exiting."));
-
-	line += 1 + bpos;
-	epos = strchr(line, ']') - line;
-	if (epos < 0)
+	tok++;
+	end = strchr(tok, ']');
+	if (!end)
 		errx(EXIT_FAILURE, _("Extraneous newline in file. Exiting."));
+	*end = '\0';
+	*line = end + 1;
+
+	return tok;
+}
 
-	line[epos] = '\0';
-	eaten = bpos + epos + 1;
+static char *gettok(char *line, char *dest, int size, int eatspace)
+{
+	char *tok = next_token(&line);
 
 	if (eatspace) {
 		char *t;
-		if ((t = strchr(line, ' ')))
+		if ((t = strchr(tok, ' ')))
 			*t = 0;
 	}
-	strncpy(dest, line, size);
+	strncpy(dest, tok, size);
+
+	return line;
+}
 
-	return eaten + 1;
+/* as sscanf(line, "[%hd] [%d] [%4c] "), returns end of the parsed data */
+static char *parse_header(char *p, struct utmpx *ut)
+{
+	char *end;
+
+	if (*p != '[')
+		return p;
+	ut->ut_type = (short) strtol(++p, &end, 10);
+	if (end == p || *end != ']')
+		return end;
+	p = (char *) skip_space(end + 1);
+
+	if (*p != '[')
+		return p;
+	ut->ut_pid = (pid_t) strtol(++p, &end, 10);
+	if (end == p || *end != ']')
+		return end;
+	p = (char *) skip_space(end + 1);
+
+	if (*p != '[' || strnlen(p + 1, 4) < 4)
+		return p;
+	memcpy(ut->ut_id, p + 1, 4);
+	return p + 5;
 }
 
 static void undump(FILE *in, FILE *out)
 {
+	struct ul_linereader lr;
 	struct utmpx ut;
-	char s_addr[INET6_ADDRSTRLEN + 1], s_time[29], *linestart, *line;
+	char s_addr[INET6_ADDRSTRLEN + 1], *line, *tmp = NULL;
+	ssize_t sz;
+
+	ul_init_linereader(&lr, fileno(in));
 
-	linestart = xmalloc(1024 * sizeof(*linestart));
-	s_time[28] = 0;
+	while ((sz = ul_linereader_next(&lr, &line)) > 0) {
+		char *s_time;
 
-	while (fgets(linestart, 1023, in)) {
-		line = linestart;
+		/* the last line is not terminated, and maybe even there is
+		 * no space behind it in the buffer */
+		if (line[sz - 1] == '\n')
+			line[sz - 1] = '\0';
+		else {
+			free(tmp);
+			line = tmp = xstrndup(line, sz);
+		}
 		memset(&ut, '\0', sizeof(ut));
-		sscanf(line, "[%hd] [%d] [%4c] ", &ut.ut_type, &ut.ut_pid, ut.ut_id);
-
-		line += 19;
-		line += gettok(line, ut.ut_user, sizeof(ut.ut_user), 1);
-		line += gettok(line, ut.ut_line, sizeof(ut.ut_line), 1);
-		line += gettok(line, ut.ut_host, sizeof(ut.ut_host), 1);
-		line += gettok(line, s_addr, sizeof(s_addr) - 1, 1);
-		gettok(line, s_time, sizeof(s_time) - 1, 0);
+		memset(s_addr, '\0', sizeof(s_addr));
+
+		line = parse_header(line, &ut);
+		line = gettok(line, ut.ut_user, sizeof(ut.ut_user), 1);
+		line = gettok(line, ut.ut_line, sizeof(ut.ut_line), 1);
+		line = gettok(line, ut.ut_host, sizeof(ut.ut_host), 1);
+		line = gettok(line, s_addr, sizeof(s_addr) - 1, 1);
+		s_time = next_token(&line);
+		/* compatible with the original 28 bytes buffer, the excessive
+		 * subsecond digits are ignored */
+		if (strnlen(s_time, 29) > 28)
+			s_time[28] = '\0';
+
 		if (strchr(s_addr, '.'))
 			inet_pton(AF_INET, s_addr, &(ut.ut_addr_v6));
 		else
 			inet_pton(AF_INET6, s_addr, &(ut.ut_addr_v6));
 
-		ut.ut_tv.tv_sec = strtotime(s_time);
+		ut.ut_tv.tv_sec = parse_time(s_time);
 		ut.ut_tv.tv_usec = strtousec(s_time);
 
-		ignore_result( fwrite(&ut, sizeof(ut), 1, out) );
+		if (!is_filtered(&ut))
+			ignore_result( fwrite(&ut, sizeof(ut), 1, out) );
+	}
+	if (sz < 0) {
+		errno = -sz;
+		err(EXIT_FAILURE, _("read failed"));
 	}
 
-	free(linestart);
+	free(tmp);
+	ul_free_linereader(&lr);
 }
 
 static void __attribute__((__noreturn__)) usage(void)
@@ -312,6 +549,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -f, --follow         output appended data as the file grows\n"), out);
 	fputs(_(" -r, --reverse        write back dumped data into utmp file\n"), out);
 	fputs(_(" -o, --output <file>  write to file instead of standard output\n"), out);
+	fputs(_(" -s, --since <time>   write only the records since the specified time\n"), out);
+	fputs(_(" -t, --until <time>   write only the records until the specified time\n"), out);
+	fputs(_(" -u, --user <name>    write only the records of the specified user\n"), out);
 	printf(USAGE_HELP_OPTIONS(22));
 
 	printf(USAGE_MAN_TAIL("utmpdump(1)"));
@@ -321,6 +561,7 @@ static void __attribute__((__noreturn__)) usage(void)
 int main(int argc, char **argv)
 {
 	int c;
+	usec_t p;
 	FILE *in = NULL, *out = NULL;
 	int reverse = 0, follow = 0;
 	const char *filename = NULL;
@@ -329,6 +570,9 @@ int main(int argc, char **argv)
 		{ "follow",  no_argument,       NULL, 'f' },
 		{ "reverse", no_argument,       NULL, 'r' },
 		{ "output",  required_argument, NULL, 'o' },
+		{ "since",   required_argument, NULL, 's' },
+		{ "until",   required_argument, NULL, 't' },
+		{ "user",    required_argument, NULL, 'u' },
 		{ "help",    no_argument,       NULL, 'h' },
 		{ "version", no_argument,       NULL, 'V' },
 		{ NULL, 0, NULL, 0 }
@@ -339,7 +583,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "fro:hV", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "fro:s:t:u:hV", longopts, NULL)) != -1) {
 		switch (c) {
 		case 'r':
 			reverse = 1;
@@ -356,6 +600,22 @@ int main(int argc, char **argv)
 				    optarg);
 			break;
 
+		case 's':
+			if (parse_timestamp(optarg, &p) < 0)
+				errx(EXIT_FAILURE, _("invalid time value \"%s\""), optarg);
+			filter.since = p;
+			break;
+
+		case 't':
+			if (parse_timestamp(optarg, &p) < 0)
+				errx(EXIT_FAILURE, _("invalid time value \"%s\""), optarg);
+			filter.until = p;
+			break;
+
+		case 'u':
+			filter.user = optarg;
+			break;
+
 		case 'h':
 			usage();
 		case 'V':
@@ -367,6 +627,9 @@ int main(int argc, char **argv)
 
 	if (!out)
 		out = stdout;
+	/* the appended data have to be visible immediately when following */
+	if (!follow)
+		setvbuf(out, NULL, _IOFBF, UTMPDUMP_BUFSZ);
 
 	if (optind < argc) {
 		filename = argv[optind];
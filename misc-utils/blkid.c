@@ -18,6 +18,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <getopt.h>
+#include <dirent.h>
 
 #define OUTPUT_FULL		(1 << 0)
 #define OUTPUT_VALUE_ONLY	(1 << 1)
@@ -25,12 +26,14 @@
 #define OUTPUT_PRETTY_LIST	(1 << 3)		/* deprecated */
 #define OUTPUT_UDEV_LIST	(1 << 4)		/* deprecated */
 #define OUTPUT_EXPORT_LIST	(1 << 5)
+#define OUTPUT_JSON		(1 << 6)
 
 #define BLKID_EXIT_NOTFOUND	2	/* token or device not found */
 #define BLKID_EXIT_OTHER	4	/* bad usage or other error */
 #define BLKID_EXIT_AMBIVAL	8	/* ambivalent low-level probing detected */
 
 #include <blkid.h>
+#include <libsmartcols.h>
 
 #include "ismounted.h"
 
@@ -42,16 +45,34 @@
 
 #include "nls.h"
 #include "ttyutils.h"
+#include "pathnames.h"
+#include "path.h"
+#include "sysfs.h"
 
 #define XALLOC_EXIT_CODE    BLKID_EXIT_OTHER    /* x.*alloc(), xstrndup() */
 #include "xalloc.h"
 
+/* -o json */
+struct blkid_json {
+	struct libscols_table	*table;
+	struct libscols_line	*line;		/* the current device */
+	const char		**tags;		/* the columns */
+	size_t			ntags;
+};
+
 struct blkid_control {
 	int output;
+	struct blkid_json *json;
+	unsigned int nthreads;
+	unsigned int nfound;	/* --all: number of detected devices */
 	uintmax_t offset;
 	uintmax_t size;
 	char *show[128];
+	int fltr_usage;
+	int fltr_flag;
+	char **fltr_type;
 	unsigned int
+		all:1,
 		eval:1,
 		gc:1,
 		lookup:1,
@@ -79,7 +100,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(	" -d, --no-encoding          don't encode non-printing characters\n"), out);
 	fputs(_(	" -g, --garbage-collect      garbage collect the blkid cache\n"), out);
 	fputs(_(	" -o, --output <format>      output format; can be one of:\n"
-			"                              value, device, export or full; (default: full)\n"), out);
+			"                              value, device, export, json or full; (default: full)\n"), out);
 	fputs(_(	" -k, --list-filesystems     list all known filesystems/RAIDs and exit\n"), out);
 	fputs(_(	" -s, --match-tag <tag>      show specified tag(s) (default show all tags)\n"), out);
 	fputs(_(	" -t, --match-token <token>  find device with a specific token (NAME=value pair)\n"), out);
@@ -95,6 +116,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(	" -u, --usages <list>        filter by \"usage\" (e.g. -u filesystem,raid)\n"), out);
 	fputs(_(	" -n, --match-types <list>   filter by filesystem type (e.g. -n vfat,ext3)\n"), out);
 	fputs(_(	" -D, --no-part-details      don't print info from partition table\n"), out);
+	fputs(_(	"     --all                  probe all block devices from sysfs\n"), out);
+	fputs(_(	"     --parallel <num>       number of threads to probe the devices\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(28));
@@ -302,11 +325,120 @@ static int has_item(const struct blkid_control *ctl, const char *item)
 	return 0;
 }
 
+/* the tags printed by -o json if no -s is specified */
+static const char *json_tags[] = {
+	"TYPE", "SEC_TYPE", "LABEL", "LABEL_FATBOOT", "UUID", "UUID_SUB",
+	"VERSION", "USAGE", "BLOCK_SIZE", "PTTYPE", "PTUUID",
+	"PART_ENTRY_SCHEME", "PART_ENTRY_NAME", "PART_ENTRY_UUID",
+	"PART_ENTRY_TYPE", "PART_ENTRY_FLAGS", "PART_ENTRY_NUMBER",
+	"PART_ENTRY_OFFSET", "PART_ENTRY_SIZE", "PART_ENTRY_DISK"
+};
+
+static const char *json_topology_tags[] = {
+	"MINIMUM_IO_SIZE", "OPTIMAL_IO_SIZE", "PHYSICAL_SECTOR_SIZE",
+	"LOGICAL_SECTOR_SIZE", "ALIGNMENT_OFFSET"
+};
+
+static int is_json_number(const char *name)
+{
+	return strcmp(name, "BLOCK_SIZE") == 0 ||
+	       strcmp(name, "PART_ENTRY_NUMBER") == 0 ||
+	       strcmp(name, "PART_ENTRY_OFFSET") == 0 ||
+	       strcmp(name, "PART_ENTRY_SIZE") == 0 ||
+	       strstr(name, "_IO_SIZE") || strstr(name, "_SECTOR_SIZE") ||
+	       strcmp(name, "ALIGNMENT_OFFSET") == 0;
+}
+
+static void json_add_tag(struct blkid_json *js, const char *name)
+{
+	struct libscols_column *cl;
+
+	cl = scols_table_new_column(js->table, name, 0, SCOLS_FL_NOEXTREMES);
+	if (!cl)
+		err(BLKID_EXIT_OTHER, _("failed to allocate output column"));
+	if (is_json_number(name))
+		scols_column_set_json_type(cl, SCOLS_JSON_NUMBER);
+
+	js->tags = xrealloc(js->tags, (js->ntags + 1) * sizeof(char *));
+	js->tags[js->ntags++] = name;
+}
+
+/*
+ * The devices are printed to one JSON document, every device is printed
+ * (and freed) when the next device is added, so the memory does not grow
+ * with number of devices.
+ */
+static void init_json(struct blkid_control *ctl)
+{
+	struct blkid_json *js = xcalloc(1, sizeof(*js));
+	size_t i;
+
+	scols_init_debug(0);
+
+	js->table = scols_new_table();
+	if (!js->table)
+		err(BLKID_EXIT_OTHER, _("failed to allocate output table"));
+	scols_table_enable_json(js->table, 1);
+	scols_table_set_name(js->table, "devices");
+	scols_table_enable_streaming(js->table, 1);
+
+	if (!scols_table_new_column(js->table, "DEVNAME", 0, SCOLS_FL_NOEXTREMES))
+		err(BLKID_EXIT_OTHER, _("failed to allocate output column"));
+
+	if (ctl->show[0]) {
+		for (i = 0; ctl->show[i]; i++)
+			json_add_tag(js, ctl->show[i]);
+	} else {
+		if (!ctl->lowprobe || ctl->lowprobe_superblocks)
+			for (i = 0; i < ARRAY_SIZE(json_tags); i++)
+				json_add_tag(js, json_tags[i]);
+		if (ctl->lowprobe_topology)
+			for (i = 0; i < ARRAY_SIZE(json_topology_tags); i++)
+				json_add_tag(js, json_topology_tags[i]);
+	}
+	ctl->json = js;
+}
+
+static void print_json_value(const struct blkid_control *ctl, int num,
+			const char *devname, const char *value,
+			const char *name, size_t valsz)
+{
+	struct blkid_json *js = ctl->json;
+	size_t i;
+
+	if (num == 1) {
+		js->line = scols_table_new_line(js->table, NULL);
+		if (!js->line || scols_line_set_data(js->line, 0, devname))
+			err(BLKID_EXIT_OTHER, _("failed to allocate output line"));
+	}
+	for (i = 0; i < js->ntags; i++) {
+		if (strcmp(js->tags[i], name) != 0)
+			continue;
+		if (scols_line_refer_data(js->line, i + 1, xstrndup(value, valsz)))
+			err(BLKID_EXIT_OTHER, _("failed to add output data"));
+		break;
+	}
+}
+
+static void finish_json(struct blkid_control *ctl)
+{
+	if (!ctl->json)
+		return;
+	scols_print_table(ctl->json->table);
+	scols_unref_table(ctl->json->table);
+	free(ctl->json->tags);
+	free(ctl->json);
+	ctl->json = NULL;
+}
+
 static void print_value(const struct blkid_control *ctl, int num,
 			const char *devname, const char *value,
 			const char *name, size_t valsz)
 {
-	if (ctl->output & OUTPUT_VALUE_ONLY) {
+	if (ctl->output & OUTPUT_JSON) {
+		print_json_value(ctl, num, devname, value, name, valsz);
+
+	} else if (ctl->output & OUTPUT_VALUE_ONLY) {
 		fputs(value, stdout);
 		fputc('\n', stdout);
 
@@ -370,7 +502,7 @@ static void print_tags(const struct blkid_control *ctl, blkid_dev dev)
 
 	if (num > 1) {
 		if (!(ctl->output & (OUTPUT_VALUE_ONLY | OUTPUT_UDEV_LIST |
-						OUTPUT_EXPORT_LIST)))
+						OUTPUT_EXPORT_LIST | OUTPUT_JSON)))
 			printf("\n");
 		first = 0;
 	}
@@ -493,33 +625,46 @@ static int lowprobe_topology(blkid_probe pr)
 	return blkid_do_fullprobe(pr);
 }
 
-static int lowprobe_device(blkid_probe pr, const char *devname,
-			   struct blkid_control *ctl)
+static int lowprobe_setup(blkid_probe pr, struct blkid_control *ctl)
 {
-	const char *data;
-	const char *name;
-	int nvals = 0, n, num = 1;
-	size_t len;
-	int fd;
-	int rc = 0;
-	static int first = 1;
+	if (!ctl->lowprobe_superblocks)
+		return 0;
 
-	fd = open(devname, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
-	if (fd < 0) {
-		warn(_("error: %s"), devname);
-		return BLKID_EXIT_NOTFOUND;
-	}
-	errno = 0;
-	if (blkid_probe_set_device(pr, fd, ctl->offset, ctl->size)) {
-		if (errno)
-			warn(_("error: %s"), devname);
-		goto done;
-	}
+	blkid_probe_set_superblocks_flags(pr,
+		BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
+		BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE |
+		BLKID_SUBLKS_USAGE | BLKID_SUBLKS_VERSION);
+
+	if (ctl->fltr_usage &&
+	    blkid_probe_filter_superblocks_usage(pr, ctl->fltr_flag, ctl->fltr_usage))
+		return -1;
+
+	else if (ctl->fltr_type &&
+		 blkid_probe_filter_superblocks_type(pr, ctl->fltr_flag, ctl->fltr_type))
+		return -1;
+	return 0;
+}
+
+static int lowprobe_probe(blkid_probe pr, struct blkid_control *ctl)
+{
+	int rc = 0;
 
 	if (ctl->lowprobe_topology)
 		rc = lowprobe_topology(pr);
 	if (rc >= 0 && ctl->lowprobe_superblocks)
 		rc = lowprobe_superblocks(pr, ctl);
+	return rc;
+}
+
+static int lowprobe_print(blkid_probe pr, const char *devname, int rc,
+			  struct blkid_control *ctl)
+{
+	const char *data;
+	const char *name;
+	int nvals = 0, n, num = 1;
+	size_t len;
+	static int first = 1;
+
 	if (rc < 0)
 		goto done;
 
@@ -547,7 +692,7 @@ static int lowprobe_device(blkid_probe pr, const char *devname,
 	if (first)
 		first = 0;
 
-	if (nvals >= 1 && !(ctl->output & (OUTPUT_VALUE_ONLY |
+	if (nvals >= 1 && !(ctl->output & (OUTPUT_VALUE_ONLY | OUTPUT_JSON |
 					OUTPUT_UDEV_LIST | OUTPUT_EXPORT_LIST)))
 		printf("\n");
 done:
@@ -560,7 +705,6 @@ done:
 				"to see more details)"),
 				devname);
 	}
-	close(fd);
 
 	if (rc == -2)
 		return BLKID_EXIT_AMBIVAL;	/* ambivalent probing result */
@@ -570,6 +714,103 @@ done:
 	return 0;		/* success */
 }
 
+static int lowprobe_device(blkid_probe pr, const char *devname,
+			   struct blkid_control *ctl)
+{
+	int fd, rc;
+
+	fd = open(devname, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+	if (fd < 0) {
+		warn(_("error: %s"), devname);
+		return BLKID_EXIT_NOTFOUND;
+	}
+	errno = 0;
+	if (blkid_probe_set_device(pr, fd, ctl->offset, ctl->size)) {
+		if (errno)
+			warn(_("error: %s"), devname);
+		close(fd);
+		return BLKID_EXIT_NOTFOUND;
+	}
+
+	rc = lowprobe_probe(pr, ctl);
+	rc = lowprobe_print(pr, devname, rc, ctl);
+	close(fd);
+
+	return rc;
+}
+
+/* blkid_probe_devices() callbacks */
+static int lowprobe_batch_probe(blkid_probe pr, void *data)
+{
+	struct blkid_control *ctl = (struct blkid_control *) data;
+
+	if (lowprobe_setup(pr, ctl))
+		return -1;
+	return lowprobe_probe(pr, ctl);
+}
+
+static int lowprobe_batch_done(blkid_probe pr, const char *devname, int rc,
+			       void *data)
+{
+	struct blkid_control *ctl = (struct blkid_control *) data;
+
+	if (!pr) {
+		errno = -rc;
+		warn(_("error: %s"), devname);
+		rc = BLKID_EXIT_NOTFOUND;
+	} else
+		rc = lowprobe_print(pr, devname, rc, ctl);
+
+	/* don't stop on the first device without a signature */
+	if (ctl->all) {
+		if (!rc)
+			ctl->nfound++;
+		rc = 0;
+	}
+	return rc;
+}
+
+/*
+ * Returns the block devices from sysfs (including partitions), the devices
+ * with zero size (e.g. unused loop devices) are ignored.
+ */
+static char **get_all_devices(unsigned int *ndevs)
+{
+	struct dirent **namelist;
+	char **devs = NULL;
+	int i, n;
+
+	*ndevs = 0;
+
+	n = scandir(_PATH_SYS_CLASS "/block", &namelist, NULL, versionsort);
+	if (n < 0)
+		err(BLKID_EXIT_OTHER, _("cannot open %s"), _PATH_SYS_CLASS "/block");
+
+	devs = xcalloc(n ? n : 1, sizeof(char *));
+
+	for (i = 0; i < n; i++) {
+		char *name = namelist[i]->d_name;
+		struct path_cxt *pc;
+		uint64_t size = 0;
+
+		if (*name == '.')
+			goto next;
+		pc = ul_new_path(_PATH_SYS_CLASS "/block/%s", name);
+		if (pc) {
+			ul_path_read_u64(pc, &size, "size");
+			ul_unref_path(pc);
+		}
+		if (size) {
+			sysfs_devname_sys_to_dev(name);
+			xasprintf(&devs[(*ndevs)++], "/dev/%s", name);
+		}
+next:
+		free(namelist[i]);
+	}
+	free(namelist);
+	return devs;
+}
+
 /* converts comma separated list to BLKID_USAGE_* mask */
 static int list_to_usage(const char *list, int *flag)
 {
@@ -655,20 +896,23 @@ static void free_types_list(char *list[])
 
 int main(int argc, char **argv)
 {
-	struct blkid_control ctl = { .output = OUTPUT_FULL, 0 };
+	struct blkid_control ctl = { .output = OUTPUT_FULL, .fltr_flag = BLKID_FLTR_ONLYIN };
 	blkid_cache cache = NULL;
 	char **devices = NULL;
 	char *search_type = NULL, *search_value = NULL;
 	char *read = NULL;
-	int fltr_usage = 0;
-	char **fltr_type = NULL;
-	int fltr_flag = BLKID_FLTR_ONLYIN;
 	unsigned int numdev = 0, numtag = 0;
 	int err = BLKID_EXIT_OTHER;
 	unsigned int i;
 	int c;
 
+	enum {
+		OPT_ALL = CHAR_MAX + 1,
+		OPT_PARALLEL
+	};
 	static const struct option longopts[] = {
+		{ "all",	      no_argument,	 NULL, OPT_ALL },
+		{ "parallel",	      required_argument, NULL, OPT_PARALLEL },
 		{ "cache-file",	      required_argument, NULL, 'c' },
 		{ "no-encoding",      no_argument,	 NULL, 'd' },
 		{ "no-part-details",  no_argument,       NULL, 'D' },
@@ -725,10 +969,10 @@ int main(int argc, char **argv)
 			search_type = xstrdup("LABEL");
 			break;
 		case 'n':
-			fltr_type = list_to_types(optarg, &fltr_flag);
+			ctl.fltr_type = list_to_types(optarg, &ctl.fltr_flag);
 			break;
 		case 'u':
-			fltr_usage = list_to_usage(optarg, &fltr_flag);
+			ctl.fltr_usage = list_to_usage(optarg, &ctl.fltr_flag);
 			break;
 		case 'U':
 			ctl.eval = 1;
@@ -764,6 +1008,8 @@ int main(int argc, char **argv)
 				ctl.output = OUTPUT_UDEV_LIST;
 			else if (!strcmp(optarg, "export"))
 				ctl.output = OUTPUT_EXPORT_LIST;
+			else if (!strcmp(optarg, "json"))
+				ctl.output = OUTPUT_JSON;
 			else if (!strcmp(optarg, "full"))
 				ctl.output = 0;
 			else
@@ -808,6 +1054,12 @@ int main(int argc, char **argv)
 		case 'w':
 			/* ignore - backward compatibility */
 			break;
+		case OPT_ALL:
+			ctl.all = 1;
+			break;
+		case OPT_PARALLEL:
+			ctl.nthreads = strtou32_or_err(optarg, _("invalid number of threads"));
+			break;
 		case 'h':
 			usage();
 			break;
@@ -819,8 +1071,17 @@ int main(int argc, char **argv)
 	if (ctl.lowprobe_topology || ctl.lowprobe_superblocks)
 		ctl.lowprobe = 1;
 
+	if (ctl.all) {
+		if (!ctl.lowprobe)
+			errx(BLKID_EXIT_OTHER, _("--all is supported only "
+					"in the low-level probing mode"));
+		if (optind < argc)
+			errx(BLKID_EXIT_OTHER, _("--all and device names are "
+					"mutually exclusive"));
+		devices = get_all_devices(&numdev);
+
 	/* The rest of the args are device names */
-	if (optind < argc) {
+	} else if (optind < argc) {
 		devices = xcalloc(argc - optind, sizeof(char *));
 		while (optind < argc)
 			devices[numdev++] = argv[optind++];
@@ -843,6 +1104,14 @@ int main(int argc, char **argv)
 	}
 	err = BLKID_EXIT_NOTFOUND;
 
+	if (ctl.output & OUTPUT_JSON) {
+		if (ctl.eval)
+			errx(BLKID_EXIT_OTHER,
+			     _("The evaluation mode does not "
+			       "support 'json' output format"));
+		init_json(&ctl);
+	}
+
 	if (ctl.eval == 0 && (ctl.output & OUTPUT_PRETTY_LIST)) {
 		if (ctl.lowprobe)
 			errx(BLKID_EXIT_OTHER,
@@ -857,7 +1126,7 @@ int main(int argc, char **argv)
 		 */
 		blkid_probe pr;
 
-		if (!numdev)
+		if (!numdev && !ctl.all)
 			errx(BLKID_EXIT_OTHER,
 			     _("The low-level probing mode "
 			       "requires a device"));
@@ -870,26 +1139,25 @@ int main(int argc, char **argv)
 		if (!pr)
 			goto exit;
 
-		if (ctl.lowprobe_superblocks) {
-			blkid_probe_set_superblocks_flags(pr,
-				BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
-				BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE |
-				BLKID_SUBLKS_USAGE | BLKID_SUBLKS_VERSION);
-
-
-			if (fltr_usage &&
-			    blkid_probe_filter_superblocks_usage(pr, fltr_flag, fltr_usage))
-				goto exit;
-
-			else if (fltr_type &&
-				 blkid_probe_filter_superblocks_type(pr, fltr_flag, fltr_type))
-				goto exit;
-		}
+		if (lowprobe_setup(pr, &ctl))
+			goto exit;
 
-		for (i = 0; i < numdev; i++) {
-			err = lowprobe_device(pr, devices[i], &ctl);
-			if (err)
-				break;
+		if ((numdev > 1 || ctl.all) && !ctl.offset && !ctl.size) {
+			/* probe independent devices in parallel */
+			err = blkid_probe_devices((const char **) devices, numdev,
+					ctl.nthreads, BLKID_PROBEDEVS_ORDERED,
+					lowprobe_batch_probe,
+					lowprobe_batch_done, &ctl);
+			if (err < 0)
+				err = BLKID_EXIT_OTHER;
+			else if (ctl.all)
+				err = ctl.nfound ? 0 : BLKID_EXIT_NOTFOUND;
+		} else {
+			for (i = 0; i < numdev; i++) {
+				err = lowprobe_device(pr, devices[i], &ctl);
+				if (err)
+					break;
+			}
 		}
 		blkid_free_probe(pr);
 	} else if (ctl.eval) {
@@ -953,11 +1221,16 @@ int main(int argc, char **argv)
 	}
 
 exit:
+	finish_json(&ctl);
 	free(search_type);
 	free(search_value);
-	free_types_list(fltr_type);
+	free_types_list(ctl.fltr_type);
 	if (!ctl.lowprobe && !ctl.eval)
 		blkid_put_cache(cache);
+	if (ctl.all) {
+		for (i = 0; i < numdev; i++)
+			free(devices[i]);
+	}
 	free(devices);
 	return err;
 }
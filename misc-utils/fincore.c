@@ -21,10 +21,15 @@
 
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <stdio.h>
 #include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "c.h"
 #include "nls.h"
@@ -42,6 +47,34 @@
    e.g. 128MB on x86_64. ( = N_PAGES_IN_WINDOW * 4096 ). */
 #define N_PAGES_IN_WINDOW ((size_t)(32 * 1024))
 
+/* number of files taken by a thread at once */
+#define N_FILES_IN_BATCH 16
+
+/*
+ * cachestat() returns the numbers without mmap(), it's available since
+ * Linux 6.5. The syscall number is the same for all architectures except
+ * alpha.
+ */
+#ifndef SYS_cachestat
+# if defined(__alpha__)
+#  define SYS_cachestat 561
+# else
+#  define SYS_cachestat 451
+# endif
+#endif
+
+struct fincore_cachestat_range {
+	uint64_t off;
+	uint64_t len;			/* 0 means to the end of file */
+};
+
+struct fincore_cachestat {
+	uint64_t nr_cache;
+	uint64_t nr_dirty;
+	uint64_t nr_writeback;
+	uint64_t nr_evicted;
+	uint64_t nr_recently_evicted;
+};
 
 struct colinfo {
 	const char *name;
@@ -54,7 +87,15 @@ enum {
 	COL_PAGES,
 	COL_SIZE,
 	COL_FILE,
-	COL_RES
+	COL_RES,
+	COL_DIRTY_PAGES,
+	COL_DIRTY,
+	COL_WRITEBACK_PAGES,
+	COL_WRITEBACK,
+	COL_EVICTED_PAGES,
+	COL_EVICTED,
+	COL_RECENTLY_EVICTED_PAGES,
+	COL_RECENTLY_EVICTED
 };
 
 static struct colinfo infos[] = {
@@ -62,20 +103,62 @@ static struct colinfo infos[] = {
 	[COL_RES]    = { "RES",      5, SCOLS_FL_RIGHT, N_("file data resident in memory in bytes")},
 	[COL_SIZE]   = { "SIZE",     5, SCOLS_FL_RIGHT, N_("size of the file")},
 	[COL_FILE]   = { "FILE",     4, 0, N_("file name")},
+	[COL_DIRTY_PAGES] = { "DIRTY_PAGES", 1, SCOLS_FL_RIGHT, N_("number of dirty pages")},
+	[COL_DIRTY]  = { "DIRTY",    5, SCOLS_FL_RIGHT, N_("number of dirty bytes")},
+	[COL_WRITEBACK_PAGES] = { "WRITEBACK_PAGES", 1, SCOLS_FL_RIGHT, N_("number of pages marked for writeback")},
+	[COL_WRITEBACK] = { "WRITEBACK", 5, SCOLS_FL_RIGHT, N_("number of bytes marked for writeback")},
+	[COL_EVICTED_PAGES] = { "EVICTED_PAGES", 1, SCOLS_FL_RIGHT, N_("number of evicted pages")},
+	[COL_EVICTED] = { "EVICTED", 5, SCOLS_FL_RIGHT, N_("number of evicted bytes")},
+	[COL_RECENTLY_EVICTED_PAGES] = { "RECENTLY_EVICTED_PAGES", 1, SCOLS_FL_RIGHT, N_("number of recently evicted pages")},
+	[COL_RECENTLY_EVICTED] = { "RECENTLY_EVICTED", 5, SCOLS_FL_RIGHT, N_("number of recently evicted bytes")},
 };
 
 static int columns[ARRAY_SIZE(infos) * 2] = {-1};
 static size_t ncolumns;
 
+/*
+ * The files and the directories in order they will be printed. The
+ * directories are read before the files are counted, the files are counted
+ * by all threads and the numbers are added to the parent directories at the
+ * end.
+ */
+struct fincore_entry {
+	char *name;
+	ssize_t parent;			/* index of the directory, or -1 */
+
+	off_t file_size;
+	off_t count_incore;
+	off_t count_dirty;		/* from cachestat() only */
+	off_t count_writeback;
+	off_t count_evicted;
+	off_t count_recently_evicted;
+
+	int rc;				/* <0 on error, 0 success, 1 ignore */
+	unsigned int is_dir : 1,
+		     has_cachestat : 1;
+};
+
 struct fincore_control {
 	const size_t pagesize;
 
 	struct libscols_table *tb;		/* output */
 
+	struct fincore_entry *ents;
+	size_t nents;
+	size_t nalloc;
+	size_t next_ent;			/* the first not counted entry */
+	size_t nthreads;
+
+	int no_cachestat;			/* cachestat() is not supported */
+
+	off_t offset;				/* --offset, page aligned */
+	off_t length;				/* --length, 0 means to the end */
+
 	unsigned int bytes : 1,
 		     noheadings : 1,
 		     raw : 1,
-		     json : 1;
+		     json : 1,
+		     recursive : 1;
 };
 
 
@@ -106,10 +189,38 @@ static const struct colinfo *get_column_info(int num)
 	return &infos[ get_column_id(num) ];
 }
 
+static char *format_size(struct fincore_control *ctl, uintmax_t sz)
+{
+	char *tmp;
+
+	if (ctl->bytes)
+		xasprintf(&tmp, "%ju", sz);
+	else
+		tmp = size_to_human_string(SIZE_SUFFIX_1LETTER, sz);
+	return tmp;
+}
+
+static off_t get_cachestat_count(struct fincore_entry *ent, int id)
+{
+	switch (id) {
+	case COL_DIRTY_PAGES:
+	case COL_DIRTY:
+		return ent->count_dirty;
+	case COL_WRITEBACK_PAGES:
+	case COL_WRITEBACK:
+		return ent->count_writeback;
+	case COL_EVICTED_PAGES:
+	case COL_EVICTED:
+		return ent->count_evicted;
+	case COL_RECENTLY_EVICTED_PAGES:
+	case COL_RECENTLY_EVICTED:
+		return ent->count_recently_evicted;
+	}
+	return 0;
+}
+
 static int add_output_data(struct fincore_control *ctl,
-			   const char *name,
-			   off_t file_size,
-			   off_t count_incore)
+			   struct fincore_entry *ent)
 {
 	size_t i;
 	char *tmp;
@@ -127,28 +238,38 @@ static int add_output_data(struct fincore_control *ctl,
 
 		switch(get_column_id(i)) {
 		case COL_FILE:
-			rc = scols_line_set_data(ln, i, name);
+			rc = scols_line_set_data(ln, i, ent->name);
 			break;
 		case COL_PAGES:
-			xasprintf(&tmp, "%jd",  (intmax_t) count_incore);
+			xasprintf(&tmp, "%jd",  (intmax_t) ent->count_incore);
 			rc = scols_line_refer_data(ln, i, tmp);
 			break;
 		case COL_RES:
-		{
-			uintmax_t res = (uintmax_t) count_incore * ctl->pagesize;
-
-			if (ctl->bytes)
-				xasprintf(&tmp, "%ju", res);
-			else
-				tmp = size_to_human_string(SIZE_SUFFIX_1LETTER, res);
+			tmp = format_size(ctl, (uintmax_t) ent->count_incore * ctl->pagesize);
 			rc = scols_line_refer_data(ln, i, tmp);
 			break;
-		}
 		case COL_SIZE:
-			if (ctl->bytes)
-				xasprintf(&tmp, "%jd", (intmax_t) file_size);
-			else
-				tmp = size_to_human_string(SIZE_SUFFIX_1LETTER, file_size);
+			tmp = format_size(ctl, ent->file_size);
+			rc = scols_line_refer_data(ln, i, tmp);
+			break;
+		case COL_DIRTY_PAGES:
+		case COL_WRITEBACK_PAGES:
+		case COL_EVICTED_PAGES:
+		case COL_RECENTLY_EVICTED_PAGES:
+			if (!ent->has_cachestat)
+				break;
+			xasprintf(&tmp, "%jd",
+				  (intmax_t) get_cachestat_count(ent, get_column_id(i)));
+			rc = scols_line_refer_data(ln, i, tmp);
+			break;
+		case COL_DIRTY:
+		case COL_WRITEBACK:
+		case COL_EVICTED:
+		case COL_RECENTLY_EVICTED:
+			if (!ent->has_cachestat)
+				break;
+			tmp = format_size(ctl, (uintmax_t) ctl->pagesize *
+					get_cachestat_count(ent, get_column_id(i)));
 			rc = scols_line_refer_data(ln, i, tmp);
 			break;
 		default:
@@ -165,9 +286,9 @@ static int add_output_data(struct fincore_control *ctl,
 static int do_mincore(struct fincore_control *ctl,
 		      void *window, const size_t len,
 		      const char *name,
+		      unsigned char *vec,
 		      off_t *count_incore)
 {
-	static unsigned char vec[N_PAGES_IN_WINDOW];
 	int n = (len / ctl->pagesize) + ((len % ctl->pagesize)? 1: 0);
 
 	if (mincore (window, len, vec) < 0) {
@@ -190,17 +311,19 @@ static int do_mincore(struct fincore_control *ctl,
 static int fincore_fd (struct fincore_control *ctl,
 		       int fd,
 		       const char *name,
-		       off_t file_size,
+		       off_t start,
+		       off_t end,
+		       unsigned char *vec,
 		       off_t *count_incore)
 {
 	size_t window_size = N_PAGES_IN_WINDOW * ctl->pagesize;
 	off_t file_offset, len;
 	int rc = 0;
 
-	for (file_offset = 0; file_offset < file_size; file_offset += len) {
+	for (file_offset = start; file_offset < end; file_offset += len) {
 		void  *window = NULL;
 
-		len = file_size - file_offset;
+		len = end - file_offset;
 		if (len >= (off_t) window_size)
 			len = window_size;
 
@@ -211,7 +334,7 @@ static int fincore_fd (struct fincore_control *ctl,
 			break;
 		}
 
-		rc = do_mincore(ctl, window, len, name, count_incore);
+		rc = do_mincore(ctl, window, len, name, vec, count_incore);
 		if (rc)
 			break;
 
@@ -221,14 +344,46 @@ static int fincore_fd (struct fincore_control *ctl,
 	return rc;
 }
 
+/*
+ * Returns: <0 on error, 0 success, the caller falls back to mincore() on
+ * error.
+ */
+static int fincore_cachestat(struct fincore_control *ctl, int fd,
+			     struct fincore_entry *ent)
+{
+	struct fincore_cachestat_range range = {
+		.off = ctl->offset,
+		.len = ctl->length
+	};
+	struct fincore_cachestat cs;
+
+	if (__atomic_load_n(&ctl->no_cachestat, __ATOMIC_RELAXED))
+		return -ENOSYS;
+
+	if (syscall(SYS_cachestat, fd, &range, &cs, 0) != 0) {
+		if (errno == ENOSYS)
+			__atomic_store_n(&ctl->no_cachestat, 1, __ATOMIC_RELAXED);
+		return -errno;
+	}
+
+	ent->count_incore = cs.nr_cache;
+	ent->count_dirty = cs.nr_dirty;
+	ent->count_writeback = cs.nr_writeback;
+	ent->count_evicted = cs.nr_evicted;
+	ent->count_recently_evicted = cs.nr_recently_evicted;
+	ent->has_cachestat = 1;
+	return 0;
+}
+
 /*
  * Returns: <0 on error, 0 success, 1 ignore.
  */
 static int fincore_name(struct fincore_control *ctl,
-			const char *name,
-			struct stat *sb,
-			off_t *count_incore)
+			struct fincore_entry *ent,
+			unsigned char *vec)
 {
+	const char *name = ent->name;
+	struct stat sb;
 	int fd;
 	int rc = 0;
 
@@ -237,22 +392,162 @@ static int fincore_name(struct fincore_control *ctl,
 		return -errno;
 	}
 
-	if (fstat (fd, sb) < 0) {
+	if (fstat (fd, &sb) < 0) {
 		warn(_("failed to do fstat: %s"), name);
 		close (fd);
 		return -errno;
 	}
+	ent->file_size = sb.st_size;
 
-	if (S_ISDIR(sb->st_mode))
+	if (S_ISDIR(sb.st_mode))
 		rc = 1;			/* ignore */
 
-	else if (sb->st_size)
-		rc = fincore_fd(ctl, fd, name, sb->st_size, count_incore);
+	else if (sb.st_size > ctl->offset && fincore_cachestat(ctl, fd, ent) != 0) {
+		off_t end = sb.st_size;
+
+		if (ctl->length && ctl->offset + ctl->length < end)
+			end = ctl->offset + ctl->length;
+		rc = fincore_fd(ctl, fd, name, ctl->offset, end, vec,
+				&ent->count_incore);
+	}
 
 	close (fd);
 	return rc;
 }
 
+static size_t add_entry(struct fincore_control *ctl, char *name,
+			ssize_t parent, int is_dir)
+{
+	struct fincore_entry *ent;
+
+	if (ctl->nents == ctl->nalloc) {
+		ctl->nalloc = ctl->nalloc ? ctl->nalloc * 2 : 1024;
+		ctl->ents = xrealloc(ctl->ents, ctl->nalloc * sizeof(*ent));
+	}
+	ent = &ctl->ents[ctl->nents];
+	memset(ent, 0, sizeof(*ent));
+	ent->name = name;
+	ent->parent = parent;
+	ent->is_dir = is_dir;
+	ent->has_cachestat = is_dir;	/* cleared by the files without */
+
+	return ctl->nents++;
+}
+
+/* adds the directory content, the subdirectories are added recursively */
+static void add_dir(struct fincore_control *ctl, size_t idx)
+{
+	struct dirent *d;
+	DIR *dir;
+
+	dir = opendir(ctl->ents[idx].name);
+	if (!dir) {
+		warn(_("failed to open: %s"), ctl->ents[idx].name);
+		ctl->ents[idx].rc = -errno;
+		return;
+	}
+
+	while ((d = readdir(dir))) {
+		const char *dirname = ctl->ents[idx].name;
+		int type = d->d_type;
+		char *name;
+
+		if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+			continue;
+
+		if (type == DT_UNKNOWN) {
+			struct stat sb;
+
+			if (fstatat(dirfd(dir), d->d_name, &sb, AT_SYMLINK_NOFOLLOW) != 0)
+				continue;
+			type = S_ISDIR(sb.st_mode) ? DT_DIR :
+			       S_ISREG(sb.st_mode) ? DT_REG : DT_UNKNOWN;
+		}
+		/* the symlinks, devices etc. are not followed */
+		if (type != DT_DIR && type != DT_REG)
+			continue;
+
+		xasprintf(&name, "%s%s%s", dirname,
+			  *dirname && dirname[strlen(dirname) - 1] == '/' ? "" : "/",
+			  d->d_name);
+		if (type == DT_DIR)
+			add_dir(ctl, add_entry(ctl, name, idx, 1));
+		else
+			add_entry(ctl, name, idx, 0);
+	}
+	closedir(dir);
+}
+
+static void add_path(struct fincore_control *ctl, char *name)
+{
+	struct stat sb;
+
+	if (ctl->recursive && stat(name, &sb) == 0 && S_ISDIR(sb.st_mode))
+		add_dir(ctl, add_entry(ctl, xstrdup(name), -1, 1));
+	else
+		add_entry(ctl, xstrdup(name), -1, 0);
+}
+
+/* counts the files, called by all threads */
+static void *count_worker(void *data)
+{
+	struct fincore_control *ctl = data;
+	unsigned char *vec = xcalloc(N_PAGES_IN_WINDOW, 1);
+
+	for (;;) {
+		size_t i, first = __atomic_fetch_add(&ctl->next_ent,
+					N_FILES_IN_BATCH, __ATOMIC_RELAXED);
+
+		if (first >= ctl->nents)
+			break;
+		for (i = first; i < first + N_FILES_IN_BATCH && i < ctl->nents; i++) {
+			struct fincore_entry *ent = &ctl->ents[i];
+
+			if (!ent->is_dir)
+				ent->rc = fincore_name(ctl, ent, vec);
+		}
+	}
+	free(vec);
+	return NULL;
+}
+
+static void count_entries(struct fincore_control *ctl)
+{
+	pthread_t *threads;
+	size_t i;
+
+	threads = xcalloc(ctl->nthreads, sizeof(pthread_t));
+	for (i = 1; i < ctl->nthreads; i++) {
+		int rc = pthread_create(&threads[i], NULL, count_worker, ctl);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, _("failed to create thread"));
+		}
+	}
+	count_worker(ctl);
+
+	for (i = 1; i < ctl->nthreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	/* the subdirectories are always after the parent directory */
+	for (i = ctl->nents; i > 0; i--) {
+		struct fincore_entry *ent = &ctl->ents[i - 1], *dir;
+
+		if (ent->parent < 0 || ent->rc != 0)
+			continue;
+		dir = &ctl->ents[ent->parent];
+		dir->file_size += ent->file_size;
+		dir->count_incore += ent->count_incore;
+		dir->count_dirty += ent->count_dirty;
+		dir->count_writeback += ent->count_writeback;
+		dir->count_evicted += ent->count_evicted;
+		dir->count_recently_evicted += ent->count_recently_evicted;
+		if (!ent->has_cachestat)
+			dir->has_cachestat = 0;
+	}
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -265,8 +560,12 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -J, --json            use JSON output format\n"), out);
 	fputs(_(" -b, --bytes           print sizes in bytes rather than in human readable format\n"), out);
 	fputs(_(" -n, --noheadings      don't print headings\n"), out);
+	fputs(_(" -O, --offset <num>    count pages from the offset, must be page aligned\n"), out);
+	fputs(_(" -l, --length <num>    count pages only for the number of bytes\n"), out);
 	fputs(_(" -o, --output <list>   output columns\n"), out);
 	fputs(_(" -r, --raw             use raw output format\n"), out);
+	fputs(_(" -R, --recursive       count the files in directories recursively\n"), out);
+	fputs(_(" -t, --threads <num>   number of threads to count the files\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(23));
@@ -289,7 +588,8 @@ int main(int argc, char ** argv)
 	char *outarg = NULL;
 
 	struct fincore_control ctl = {
-		.pagesize = getpagesize()
+		.pagesize = getpagesize(),
+		.nthreads = 1
 	};
 
 	static const struct option longopts[] = {
@@ -300,6 +600,10 @@ int main(int argc, char ** argv)
 		{ "help",	no_argument, NULL, 'h' },
 		{ "json",       no_argument, NULL, 'J' },
 		{ "raw",        no_argument, NULL, 'r' },
+		{ "recursive",  no_argument, NULL, 'R' },
+		{ "offset",     required_argument, NULL, 'O' },
+		{ "length",     required_argument, NULL, 'l' },
+		{ "threads",    required_argument, NULL, 't' },
 		{ NULL, 0, NULL, 0 },
 	};
 
@@ -308,7 +612,7 @@ int main(int argc, char ** argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long (argc, argv, "bno:JrVh", longopts, NULL)) != -1) {
+	while ((c = getopt_long (argc, argv, "bl:no:O:JrRt:Vh", longopts, NULL)) != -1) {
 		switch (c) {
 		case 'b':
 			ctl.bytes = 1;
@@ -325,6 +629,20 @@ int main(int argc, char ** argv)
 		case 'r':
 			ctl.raw = 1;
 			break;
+		case 'R':
+			ctl.recursive = 1;
+			break;
+		case 'O':
+			ctl.offset = strtosize_or_err(optarg, _("failed to parse offset"));
+			break;
+		case 'l':
+			ctl.length = strtosize_or_err(optarg, _("failed to parse length"));
+			break;
+		case 't':
+			ctl.nthreads = strtou32_or_err(optarg, _("invalid number of threads"));
+			if (!ctl.nthreads)
+				errx(EXIT_FAILURE, _("invalid number of threads"));
+			break;
 		case 'V':
 			print_version(EXIT_SUCCESS);
 		case 'h':
@@ -334,6 +652,10 @@ int main(int argc, char ** argv)
 		}
 	}
 
+	/* mmap() and cachestat() use pages */
+	if ((uintmax_t) ctl.offset % ctl.pagesize)
+		errx(EXIT_FAILURE, _("offset is not aligned to page size"));
+
 	if (optind == argc) {
 		warnx(_("no file specified"));
 		errtryhelp(EXIT_FAILURE);
@@ -378,6 +700,10 @@ int main(int argc, char ** argv)
 				break;
 			case COL_SIZE:
 			case COL_RES:
+			case COL_DIRTY:
+			case COL_WRITEBACK:
+			case COL_EVICTED:
+			case COL_RECENTLY_EVICTED:
 				if (!ctl.bytes)
 					break;
 				/* fallthrough */
@@ -388,14 +714,17 @@ int main(int argc, char ** argv)
 		}
 	}
 
-	for(; optind < argc; optind++) {
-		char *name = argv[optind];
-		struct stat sb;
-		off_t count_incore = 0;
+	for(; optind < argc; optind++)
+		add_path(&ctl, argv[optind]);
+
+	count_entries(&ctl);
+
+	for (i = 0; i < ctl.nents; i++) {
+		struct fincore_entry *ent = &ctl.ents[i];
 
-		switch (fincore_name(&ctl, name, &sb, &count_incore)) {
+		switch (ent->rc) {
 		case 0:
-			add_output_data(&ctl, name, sb.st_size, count_incore);
+			add_output_data(&ctl, ent);
 			break;
 		case 1:
 			break; /* ignore */
@@ -403,7 +732,9 @@ int main(int argc, char ** argv)
 			rc = EXIT_FAILURE;
 			break;
 		}
+		free(ent->name);
 	}
+	free(ctl.ents);
 
 	scols_print_table(ctl.tb);
 	scols_unref_table(ctl.tb);
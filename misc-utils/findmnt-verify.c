@@ -14,34 +14,49 @@
 #include "c.h"
 #include "strutils.h"
 #include "xalloc.h"
+#include "ranges.h"
 
 #include "findmnt.h"
 
+#define VERIFY_THREADS	8	/* max number of threads */
+
+/*
+ * The entries are verified by more threads (the stat() of the sources and
+ * targets may be slow for network and SAN paths), the messages are
+ * collected in the per-entry buffer and printed in the table order.
+ */
 struct verify_context {
 	struct libmnt_fs	*fs;
 	struct libmnt_table	*tb;
 
-	char	**fs_ary;
-	size_t	fs_num;
-	size_t  fs_alloc;
+	FILE	*out;		/* messages */
+	char	*outbuf;
+	size_t	outsz;
 
+	int	rc;
 	int	nwarnings;
 	int	nerrors;
 
 	unsigned int	target_printed : 1,
+			check_order : 1,
 			no_fsck : 1;
 };
 
+/* supported filesystems, read once, sorted */
+static char	**fs_ary;
+static size_t	fs_num;
+static size_t	fs_alloc;
+
 static void verify_mesg(struct verify_context *vfy, char type, const char *fmt, va_list ap)
 {
 	if (!vfy->target_printed) {
-		fprintf(stdout, "%s\n", mnt_fs_get_target(vfy->fs));
+		fprintf(vfy->out, "%s\n", mnt_fs_get_target(vfy->fs));
 		vfy->target_printed = 1;
 	}
 
-	fprintf(stdout, "   [%c] ", type);
-	vfprintf(stdout, fmt, ap);
-	fputc('\n', stdout);
+	fprintf(vfy->out, "   [%c] ", type);
+	vfprintf(vfy->out, fmt, ap);
+	fputc('\n', vfy->out);
 }
 
 static int verify_warn(struct verify_context *vfy, const char *fmt, ...)
@@ -268,40 +283,53 @@ static int verify_swaparea(struct verify_context *vfy)
 	return 0;
 }
 
-static int is_supported_filesystem(struct verify_context *vfy, const char *name)
+static int cmp_filesystems(const void *a, const void *b)
 {
-	size_t n;
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
 
-	if (!vfy->fs_num)
+static int is_supported_filesystem(const char *name)
+{
+	if (!fs_num)
 		return 0;
 
-	for (n = 0; n < vfy->fs_num; n++ ) {
-		if (strcmp(vfy->fs_ary[n], name) == 0)
-			return 1;
-	}
-
-	return 0;
+	return bsearch(&name, fs_ary, fs_num, sizeof(char *), cmp_filesystems) != NULL;
 }
 
-static int add_filesystem(struct verify_context *vfy, const char *name)
+/* the list is sorted (and duplicates removed) by sort_filesystems() */
+static int add_filesystem(const char *name)
 {
 	#define MYCHUNK	16
 
-	if (is_supported_filesystem(vfy, name))
-		return 0;
-
-	if (vfy->fs_alloc == 0 || vfy->fs_num + 1 <= vfy->fs_alloc) {
-		vfy->fs_alloc = ((vfy->fs_alloc + 1 + MYCHUNK) / MYCHUNK) * MYCHUNK;
-		vfy->fs_ary = xrealloc(vfy->fs_ary, vfy->fs_alloc * sizeof(char *));
+	if (fs_num == fs_alloc) {
+		fs_alloc += MYCHUNK;
+		fs_ary = xrealloc(fs_ary, fs_alloc * sizeof(char *));
 	}
 
-	vfy->fs_ary[vfy->fs_num] = xstrdup(name);
-	vfy->fs_num++;
+	fs_ary[fs_num] = xstrdup(name);
+	fs_num++;
 
 	return 0;
 }
 
-static int read_proc_filesystems(struct verify_context *vfy)
+static void sort_filesystems(void)
+{
+	size_t i, n = 0;
+
+	if (!fs_num)
+		return;
+
+	qsort(fs_ary, fs_num, sizeof(char *), cmp_filesystems);
+	for (i = 1; i < fs_num; i++) {
+		if (strcmp(fs_ary[n], fs_ary[i]) == 0)
+			free(fs_ary[i]);
+		else
+			fs_ary[++n] = fs_ary[i];
+	}
+	fs_num = n + 1;
+}
+
+static int read_proc_filesystems(void)
 {
 	int rc = 0;
 	FILE *f;
@@ -328,7 +356,7 @@ static int read_proc_filesystems(struct verify_context *vfy)
 		if ((t = strchr(cp, ' ')) != NULL)
 			*t = 0;
 
-		rc = add_filesystem(vfy, cp);
+		rc = add_filesystem(cp);
 		if (rc)
 			break;
 	}
@@ -336,7 +364,7 @@ static int read_proc_filesystems(struct verify_context *vfy)
 	return rc;
 }
 
-static int read_kernel_filesystems(struct verify_context *vfy)
+static int read_kernel_filesystems(void)
 {
 	int rc = 0;
 #ifdef __linux__
@@ -377,7 +405,7 @@ static int read_kernel_filesystems(struct verify_context *vfy)
 			continue;
 		*p = '\0';
 
-		rc = add_filesystem(vfy, name);
+		rc = add_filesystem(name);
 		if (rc)
 			break;
 	}
@@ -414,7 +442,7 @@ static int verify_fstype(struct verify_context *vfy)
 		else if (strcmp(type, "xfs") == 0)
 			vfy->no_fsck = 1;
 
-		if (!isswap && !isauto && !none && !is_supported_filesystem(vfy, type))
+		if (!isswap && !isauto && !none && !is_supported_filesystem(type))
 			verify_warn(vfy, _("%s seems unsupported by the current kernel"), type);
 	}
 	realtype = mnt_get_fstype(src, &ambi, cache);
@@ -432,7 +460,7 @@ static int verify_fstype(struct verify_context *vfy)
 		if (type && !isauto && strcmp(type, realtype) != 0)
 			return verify_err(vfy, _("%s does not match with on-disk %s"), type, realtype);
 
-		if (!isswap && !is_supported_filesystem(vfy, realtype))
+		if (!isswap && !is_supported_filesystem(realtype))
 			return verify_err(vfy, _("on-disk %s seems unsupported by the current kernel"), realtype);
 
 		verify_ok(vfy, _("FS type is %s"), realtype);
@@ -474,11 +502,44 @@ static int verify_filesystem(struct verify_context *vfy)
 	return rc;
 }
 
+static void verify_entry(struct verify_context *vfy)
+{
+	vfy->out = open_memstream(&vfy->outbuf, &vfy->outsz);
+	if (!vfy->out)
+		err(EXIT_FAILURE, _("cannot allocate memory"));
+
+	if (vfy->check_order)
+		vfy->rc = verify_order(vfy);
+	if (!vfy->rc)
+		vfy->rc = verify_filesystem(vfy);
+
+	fclose(vfy->out);
+	vfy->out = NULL;
+}
+
+static void verify_range(void *data, size_t range __attribute__((__unused__)),
+			 size_t first, size_t last)
+{
+	struct verify_context *vfys = data;
+	size_t i;
+
+	for (i = first; i < last; i++)
+		verify_entry(&vfys[i]);
+}
+
+static void verify_entries(struct verify_context *vfys, size_t nvfys)
+{
+	ul_run_ranges(nvfys, 1, VERIFY_THREADS, verify_range, vfys);
+}
+
 int verify_table(struct libmnt_table *tb)
 {
-	struct verify_context vfy = { .nerrors = 0 };
+	struct verify_context *vfys = NULL;
 	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	size_t i, nvfys = 0, nalloc = 0;
 	int rc = 0;		/* overall return code (alloc errors, etc.) */
+	int nerrors = 0, nwarnings = 0;
 	int check_order = is_listall_mode();
 	static int has_read_fs = 0;
 
@@ -488,40 +549,60 @@ int verify_table(struct libmnt_table *tb)
 		goto done;
 	}
 
-	vfy.tb = tb;
-
 	if (has_read_fs == 0) {
-		read_proc_filesystems(&vfy);
-		read_kernel_filesystems(&vfy);
+		read_proc_filesystems();
+		read_kernel_filesystems();
+		sort_filesystems();
 		has_read_fs = 1;
 	}
 
-	while (rc == 0 && (vfy.fs = get_next_fs(tb, itr))) {
-		vfy.target_printed = 0;
-		vfy.no_fsck = 0;
+	/* the matching entries, get_next_fs() is not thread-safe */
+	while ((fs = get_next_fs(tb, itr))) {
+		if (nvfys == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			vfys = xrealloc(vfys, nalloc * sizeof(*vfys));
+		}
+		memset(&vfys[nvfys], 0, sizeof(*vfys));
+		vfys[nvfys].fs = fs;
+		vfys[nvfys].tb = tb;
+		vfys[nvfys].check_order = check_order;
 
-		if (check_order)
-			rc = verify_order(&vfy);
-		if (!rc)
-			rc = verify_filesystem(&vfy);
+		/* the options are parsed on demand, not by the threads */
+		mnt_fs_get_option(fs, "noauto", NULL, NULL);
+		nvfys++;
 
 		if (flags & FL_FIRSTONLY)
 			break;
 		flags |= FL_NOSWAPMATCH;
 	}
 
+	verify_entries(vfys, nvfys);
+
+	for (i = 0; i < nvfys; i++) {
+		struct verify_context *vfy = &vfys[i];
+
+		if (rc == 0) {
+			if (vfy->outsz)
+				fwrite(vfy->outbuf, 1, vfy->outsz, stdout);
+			nerrors += vfy->nerrors;
+			nwarnings += vfy->nwarnings;
+			rc = vfy->rc;
+		}
+		free(vfy->outbuf);
+	}
+	free(vfys);
 done:
 	mnt_free_iter(itr);
 
 	/* summary */
-	if (vfy.nerrors || parse_nerrors || vfy.nwarnings) {
+	if (nerrors || parse_nerrors || nwarnings) {
 		fputc('\n', stderr);
 		fprintf(stderr, P_("%d parse error", "%d parse errors", parse_nerrors), parse_nerrors);
-		fprintf(stderr, P_(", %d error",     ", %d errors", vfy.nerrors), vfy.nerrors);
-		fprintf(stderr, P_(", %d warning",   ", %d warnings", vfy.nwarnings), vfy.nwarnings);
+		fprintf(stderr, P_(", %d error",     ", %d errors", nerrors), nerrors);
+		fprintf(stderr, P_(", %d warning",   ", %d warnings", nwarnings), nwarnings);
 		fputc('\n', stderr);
 	} else
 		fprintf(stdout, _("Success, no errors or warnings detected\n"));
 
-	return rc != 0 ? rc : vfy.nerrors + parse_nerrors;
+	return rc != 0 ? rc : nerrors + parse_nerrors;
 }
@@ -143,7 +143,7 @@ static inline size_t err_columns_index(size_t arysz, size_t idx)
 		((ary)[ err_columns_index(ARRAY_SIZE(ary), (n)) ] = (id))
 
 /* poll actions (parsed --poll=<list> */
-#define FINDMNT_NACTIONS	4		/* mount, umount, move, remount */
+#define FINDMNT_NACTIONS	5		/* mount, umount, move, remount, propagation */
 static int actions[FINDMNT_NACTIONS];
 static int nactions;
 
@@ -329,6 +329,8 @@ static int poll_action_name_to_id(const char *name, size_t namesz)
 		id = MNT_TABDIFF_UMOUNT;
 	else if (strncasecmp(name, "remount", namesz) == 0 && namesz == 7)
 		id = MNT_TABDIFF_REMOUNT;
+	else if (strncasecmp(name, "propagation", namesz) == 0 && namesz == 11)
+		id = MNT_TABDIFF_PROPAGATION;
 	else
 		warnx(_("unknown action: %s"), name);
 
@@ -658,6 +660,9 @@ static char *get_tabdiff_data(struct libmnt_fs *old_fs,
 		case MNT_TABDIFF_MOVE:
 			str = _("move");
 			break;
+		case MNT_TABDIFF_PROPAGATION:
+			str = _("propagation");
+			break;
 		default:
 			str = _("unknown");
 			break;
@@ -702,6 +707,7 @@ static struct libscols_line *add_line(struct libscols_table *table, struct libmn
 	}
 
 	scols_line_set_userdata(line, fs);
+	mnt_fs_set_userdata(fs, line);		/* see has_line() */
 	return line;
 }
 
@@ -723,25 +729,10 @@ static struct libscols_line *add_tabdiff_line(struct libscols_table *table, stru
 	return line;
 }
 
-static int has_line(struct libscols_table *table, struct libmnt_fs *fs)
+/* returns 1 if @fs is already in the output table */
+static int has_line(struct libmnt_fs *fs)
 {
-	struct libscols_line *ln;
-	struct libscols_iter *itr;
-	int rc = 0;
-
-	itr = scols_new_iter(SCOLS_ITER_FORWARD);
-	if (!itr)
-		return 0;
-
-	while (scols_table_next_line(table, itr, &ln) == 0) {
-		if ((struct libmnt_fs *) scols_line_get_userdata(ln) == fs) {
-			rc = 1;
-			break;
-		}
-	}
-
-	scols_free_iter(itr);
-	return rc;
+	return mnt_fs_get_userdata(fs) != NULL;
 }
 
 /* reads filesystems from @tb (libmount) and fillin @table (output table) */
@@ -759,7 +750,7 @@ static int create_treenode(struct libscols_table *table, struct libmnt_table *tb
 			goto leave;
 		parent_line = NULL;
 
-	} else if ((flags & FL_SUBMOUNTS) && has_line(table, fs))
+	} else if ((flags & FL_SUBMOUNTS) && has_line(fs))
 		return 0;
 
 	itr = mnt_new_iter(MNT_ITER_FORWARD);
@@ -824,6 +815,11 @@ static struct libmnt_table *parse_tabfiles(char **files,
 		return NULL;
 	}
 	mnt_table_set_parser_errcb(tb, parser_errcb);
+	if (tabtype == TABTYPE_KERNEL) {
+		mnt_table_enable_arena(tb, 1);
+		/* options are often not necessary at all (e.g. -T) */
+		mnt_table_enable_lazy_parse(tb, 1);
+	}
 
 	do {
 		/* NULL means that libmount will use default paths */
@@ -837,6 +833,9 @@ static struct libmnt_table *parse_tabfiles(char **files,
 			rc = mnt_table_parse_mtab(tb, path);
 			break;
 		case TABTYPE_KERNEL:
+			/* listmount() is cheaper than to parse mountinfo */
+			if (!path && mnt_table_fetch_listmount(tb, MNT_STATMNT_ALL) == 0)
+				break;
 			if (!path)
 				path = access(_PATH_PROC_MOUNTINFO, R_OK) == 0 ?
 					      _PATH_PROC_MOUNTINFO :
@@ -998,7 +997,12 @@ struct libmnt_fs *get_next_fs(struct libmnt_table *tb,
 		 *    findmnt [-l] <spec> [-O <options>] [-t <types>]
 		 */
 again:
-		if (mnt_table_find_next_fs(tb, itr, match_func,  NULL, &fs) != 0)
+		if (get_match(COL_TARGET) && !(flags & FL_INVERT)) {
+			/* use the table index rather than walk all entries */
+			if (mnt_table_find_next_target(tb, itr, get_match(COL_TARGET),
+						match_func, NULL, &fs) != 0)
+				fs = NULL;
+		} else if (mnt_table_find_next_fs(tb, itr, match_func,  NULL, &fs) != 0)
 			fs = NULL;
 
 		if (!fs &&
@@ -1228,6 +1232,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -A, --all              disable all built-in filters, print all filesystems\n"), out);
 	fputs(_(" -a, --ascii            use ASCII chars for tree formatting\n"), out);
 	fputs(_(" -b, --bytes            print sizes in bytes rather than in human readable format\n"), out);
+	fputs(_("     --cbor             use CBOR binary output format\n"), out);
 	fputs(_(" -C, --nocanonicalize   don't canonicalize when comparing paths\n"), out);
 	fputs(_(" -c, --canonicalize     canonicalize printed paths\n"), out);
 	fputs(_(" -D, --df               imitate the output of df(1)\n"), out);
@@ -1294,7 +1299,8 @@ int main(int argc, char *argv[])
 		FINDMNT_OPT_TREE,
 		FINDMNT_OPT_OUTPUT_ALL,
 		FINDMNT_OPT_PSEUDO,
-		FINDMNT_OPT_REAL
+		FINDMNT_OPT_REAL,
+		FINDMNT_OPT_CBOR
 	};
 
 	static const struct option longopts[] = {
@@ -1310,6 +1316,7 @@ int main(int argc, char *argv[])
 		{ "help",	    no_argument,       NULL, 'h'		 },
 		{ "invert",	    no_argument,       NULL, 'i'		 },
 		{ "json",	    no_argument,       NULL, 'J'		 },
+		{ "cbor",	    no_argument,       NULL, FINDMNT_OPT_CBOR	 },
 		{ "kernel",	    no_argument,       NULL, 'k'		 },
 		{ "list",	    no_argument,       NULL, 'l'		 },
 		{ "mountpoint",	    required_argument, NULL, 'M'		 },
@@ -1344,7 +1351,7 @@ int main(int argc, char *argv[])
 	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
 		{ 'C', 'c'},			/* [no]canonicalize */
 		{ 'C', 'e' },			/* nocanonicalize, evaluate */
-		{ 'J', 'P', 'r','x' },		/* json,pairs,raw,verify */
+		{ 'J', 'P', 'r','x', FINDMNT_OPT_CBOR },	/* json,pairs,raw,verify,cbor */
 		{ 'M', 'T' },			/* mountpoint, target */
 		{ 'N','k','m','s' },		/* task,kernel,mtab,fstab */
 		{ 'P','l','r','x' },		/* pairs,list,raw,verify */
@@ -1509,6 +1516,9 @@ int main(int argc, char *argv[])
 		case FINDMNT_OPT_PSEUDO:
 			flags |= FL_PSEUDO;
 			break;
+		case FINDMNT_OPT_CBOR:
+			flags |= FL_JSON | FL_CBOR;
+			break;
 		case FINDMNT_OPT_REAL:
 			flags |= FL_REAL;
 			break;
@@ -1637,12 +1647,19 @@ int main(int argc, char *argv[])
 	scols_table_enable_raw(table,        !!(flags & FL_RAW));
 	scols_table_enable_export(table,     !!(flags & FL_EXPORT));
 	scols_table_enable_json(table,       !!(flags & FL_JSON));
+	scols_table_enable_cbor(table,       !!(flags & FL_CBOR));
 	scols_table_enable_ascii(table,      !!(flags & FL_ASCII));
 	scols_table_enable_noheadings(table, !!(flags & FL_NOHEADINGS));
 
 	if (flags & FL_JSON)
 		scols_table_set_name(table, "filesystems");
 
+	/* the column widths don't depend on data for these formats, so print
+	 * the list immediately rather than keep all the lines in memory */
+	if (!(flags & (FL_TREE | FL_SUBMOUNTS | FL_POLL))
+	    && (flags & (FL_RAW | FL_EXPORT | FL_JSON)))
+		scols_table_enable_streaming(table, 1);
+
 	for (i = 0; i < ncolumns; i++) {
 		struct libscols_column *cl;
 		int fl = get_column_flags(i);
@@ -28,6 +28,7 @@ enum {
 	FL_EXPORT	= (1 << 23),
 	FL_TREE		= (1 << 24),
 	FL_JSON		= (1 << 25),
+	FL_CBOR		= (1 << 26),	/* with FL_JSON */
 };
 
 extern struct libmnt_cache *cache;
@@ -31,6 +31,11 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#ifdef HAVE_LINUX_FS_H
+# include <linux/fs.h>
+#endif
 #ifdef HAVE_PCRE
 # define PCRE2_CODE_UNIT_WIDTH 8
 # include <pcre2.h>
@@ -40,30 +45,75 @@
 #include "xalloc.h"
 #include "nls.h"
 #include "closestream.h"
+#include "crc32c.h"
+#include "fileutils.h"
+#include "strutils.h"
 
-#define NHASH   (1<<17)  /* Must be a power of 2! */
+#define NHASH   (1<<12)  /* initial hash size, must be a power of 2 */
+#define NLOCKS  256      /* hash locks, must be a power of 2 and <= NHASH */
 #define NBUF    64
+#define NSLOTS  64       /* hash slots taken by a thread at once */
+#define IOBUFSZ (64 * 1024)
+#define DEDUPESZ (16 * 1024 * 1024)	/* bytes per FIDEDUPERANGE request */
 
+/*
+ * The directories are read and the files are added to the hash in the first
+ * pass, the files are compared and linked in the second pass.
+ *
+ * The first pass is done by all threads; the directories found by any thread
+ * are added to a shared stack and the idle threads take the directories from
+ * the stack. The hash is protected by NLOCKS locks; the hash is resized when
+ * it has more buckets than slots, the resize write-locks the whole hash.
+ *
+ * The second pass is done for every (size, mtime) bucket independently, so
+ * the threads compare files from different buckets at the same time. The
+ * files in the bucket are processed in the order they have been found.
+ *
+ * The files are compared in three steps: checksum of the first and the last
+ * NBUF words (the first pass), checksum of the whole content (calculated
+ * only if necessary, at most once for every file) and the final byte by byte
+ * comparison, which is done only for the files to be linked. With --reflink
+ * the final comparison is done by kernel as a part of FIDEDUPERANGE and the
+ * content checksum is used only if it is already known from the cache.
+ *
+ * The directories are kept in memory for the whole run and the files keep
+ * only the basename and the directory pointer. With --partitions the first
+ * pass writes the files to temporary files (all files from one bucket to the
+ * same file) and the second pass loads and links one file at a time, so only
+ * a part of all the files is in memory at the same time.
+ */
 struct hardlink_file;
 
 struct hardlink_hash {
 	struct hardlink_hash *next;
-	struct hardlink_file *chain;
+	struct hardlink_file *chain;	/* files in order they have been found */
+	struct hardlink_file *last;
 	off_t size;
 	time_t mtime;
 };
 
 struct hardlink_dir {
-	struct hardlink_dir *next;
-	char name[];
+	struct hardlink_dir *next;	/* directories stack, the first pass */
+	struct hardlink_dir *parent;	/* NULL for command line directory */
+	char name[];			/* basename or command line path */
 };
 
 struct hardlink_file {
 	struct hardlink_file *next;
+	struct hardlink_dir *dir;	/* NULL for command line file */
 	ino_t ino;
 	dev_t dev;
-	unsigned int cksum;
-	char name[];
+	int64_t mtime;			/* in nanoseconds */
+	int64_t ctime;			/* in nanoseconds, for the --cache only */
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+	unsigned int cksum;		/* the first and the last NBUF words */
+	uint32_t digest;		/* the whole content */
+	unsigned int
+		has_digest:1,
+		namelen:31;
+	char name[];			/* basename or command line path */
 };
 
 struct hardlink_dynstr {
@@ -71,11 +121,58 @@ struct hardlink_dynstr {
 	size_t alloc;
 };
 
-struct hardlink_ctl {
-	struct hardlink_dir *dirs;
-	struct hardlink_hash *hps[NHASH];
-	char iobuf1[BUFSIZ];
-	char iobuf2[BUFSIZ];
+/*
+ * --cache file record; the file is a header and the records, all in the host
+ * byte order. The cache is not used for a different header.
+ */
+#define HARDLINK_CACHE_MAGIC	"hlcache"
+#define HARDLINK_CACHE_VERSION	2
+
+struct hardlink_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t recsize;
+	uint64_t nrecs;
+};
+
+struct hardlink_cache_rec {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime;			/* in nanoseconds */
+	int64_t ctime;			/* in nanoseconds */
+	uint32_t cksum;
+	uint32_t digest;
+	uint32_t has_digest;
+	uint32_t reserved;
+};
+
+struct hardlink_cache {
+	void *map;			/* the old cache file */
+	size_t mapsz;
+	const struct hardlink_cache_rec *recs;
+	size_t nrecs;
+	size_t *index;			/* record number + 1, open addressing */
+	size_t mask;
+
+	FILE *out;			/* the new cache file */
+	char *outname;
+	uint64_t nout;
+};
+
+struct hardlink_ctl;
+
+struct hardlink_worker {
+	struct hardlink_ctl *ctl;
+	pthread_t thread;
+	struct hardlink_dynstr path;
+	struct hardlink_dynstr path1;	/* the second pass */
+	struct hardlink_dynstr path2;
+#ifdef HAVE_PCRE
+	pcre2_match_data *match_data;
+#endif
+	char iobuf1[IOBUFSZ];
+	char iobuf2[IOBUFSZ];
 	/* summary counters */
 	unsigned long long ndirs;
 	unsigned long long nobjects;
@@ -83,12 +180,42 @@ struct hardlink_ctl {
 	unsigned long long ncomp;
 	unsigned long long nlinks;
 	unsigned long long nsaved;
+};
+
+struct hardlink_ctl {
+	struct hardlink_hash **hps;
+	size_t hsize;			/* number of slots, power of 2 */
+	size_t nbuckets;		/* number of (size, mtime) buckets */
+	pthread_rwlock_t hlock;		/* write-locked for resize */
+	pthread_mutex_t hlocks[NLOCKS];
+
+	/* --partitions temporary files */
+	FILE **parts;
+	size_t nparts;
+
+	/* directories stack, the first pass */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct hardlink_dir *dirs;
+	size_t nbusy;			/* threads reading a directory */
+
+	size_t next_slot;		/* first not processed hash slot, the second pass */
+
+	struct hardlink_worker *workers;
+	size_t nworkers;
+
+	const char *cache_path;
+	struct hardlink_cache cache;	/* read-only after start */
+#ifdef HAVE_PCRE
+	pcre2_code *re;
+#endif
 	/* current device */
 	dev_t dev;
 	/* flags */
 	unsigned int verbose;
 	unsigned int
 		no_link:1,
+		reflink:1,
 		content_only:1,
 		force:1;
 };
@@ -96,9 +223,29 @@ struct hardlink_ctl {
 struct hardlink_ctl global_ctl;
 
 __attribute__ ((always_inline))
-static inline unsigned int hash(off_t size, time_t mtime)
+static inline uint64_t hash(off_t size, time_t mtime)
 {
-	return (size ^ mtime) & (NHASH - 1);
+	uint64_t h = ((uint64_t) size * 0x9e3779b97f4a7c15ULL) ^ (uint64_t) mtime;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	return h ^ (h >> 29);
+}
+
+__attribute__ ((always_inline))
+static inline int64_t timespec_to_ns(const struct timespec *ts)
+{
+	return (int64_t) ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static void ns_to_timespec(int64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+	if (ts->tv_nsec < 0) {
+		ts->tv_sec--;
+		ts->tv_nsec += 1000000000;
+	}
 }
 
 __attribute__ ((always_inline))
@@ -117,23 +264,41 @@ static inline int stcmp(struct stat *st1, struct stat *st2, int content_scope)
 static void print_summary(void)
 {
 	struct hardlink_ctl const *const ctl = &global_ctl;
+	struct hardlink_worker sum = { .ndirs = 0 };
+	size_t i;
 
 	if (!ctl->verbose)
 		return;
 
-	if (ctl->verbose > 1 && ctl->nlinks)
+	for (i = 0; i < ctl->nworkers; i++) {
+		struct hardlink_worker *w = &ctl->workers[i];
+
+		sum.ndirs += w->ndirs;
+		sum.nobjects += w->nobjects;
+		sum.nregfiles += w->nregfiles;
+		sum.ncomp += w->ncomp;
+		sum.nlinks += w->nlinks;
+		sum.nsaved += w->nsaved;
+	}
+
+	if (ctl->verbose > 1 && sum.nlinks)
 		fputc('\n', stdout);
 
-	printf(_("Directories:   %9lld\n"), ctl->ndirs);
-	printf(_("Objects:       %9lld\n"), ctl->nobjects);
-	printf(_("Regular files: %9lld\n"), ctl->nregfiles);
-	printf(_("Comparisons:   %9lld\n"), ctl->ncomp);
-	printf(  "%s%9lld\n", (ctl->no_link ?
-	       _("Would link:    ") :
-	       _("Linked:        ")), ctl->nlinks);
+	printf(_("Directories:   %9lld\n"), sum.ndirs);
+	printf(_("Objects:       %9lld\n"), sum.nobjects);
+	printf(_("Regular files: %9lld\n"), sum.nregfiles);
+	printf(_("Comparisons:   %9lld\n"), sum.ncomp);
+	if (ctl->reflink)
+		printf(  "%s%9lld\n", (ctl->no_link ?
+		       _("Would dedupe:  ") :
+		       _("Deduplicated:  ")), sum.nlinks);
+	else
+		printf(  "%s%9lld\n", (ctl->no_link ?
+		       _("Would link:    ") :
+		       _("Linked:        ")), sum.nlinks);
 	printf(  "%s %9lld\n", (ctl->no_link ?
 	       _("Would save:   ") :
-	       _("Saved:        ")), ctl->nsaved);
+	       _("Saved:        ")), sum.nsaved);
 }
 
 static void __attribute__((__noreturn__)) usage(void)
@@ -150,6 +315,10 @@ static void __attribute__((__noreturn__)) usage(void)
 	puts(_(" -v, --verbose          print summary after hardlinking"));
 	puts(_(" -vv                    print every hardlinked file and summary"));
 	puts(_(" -f, --force            force hardlinking across filesystems"));
+	puts(_(" -j, --threads <num>    number of threads to read and compare files"));
+	puts(_(" -C, --cache <file>     keep the file checksums in the file"));
+	puts(_(" -P, --partitions <num> keep only part of the files in memory"));
+	puts(_(" -r, --reflink          share extents instead of hardlinking"));
 	puts(_(" -x, --exclude <regex>  exclude files matching pattern"));
 
 	fputs(USAGE_SEPARATOR, stdout);
@@ -181,45 +350,500 @@ static void growstr(struct hardlink_dynstr *str, size_t newlen)
 	str->buf = xrealloc(str->buf, str->alloc = add2(newlen, 1));
 }
 
-static void process_path(struct hardlink_ctl *ctl, const char *name)
+static void push_dir(struct hardlink_ctl *ctl, struct hardlink_dir *dp)
 {
-	struct stat st, st2, st3;
+	pthread_mutex_lock(&ctl->lock);
+	dp->next = ctl->dirs;
+	ctl->dirs = dp;
+	pthread_cond_signal(&ctl->cond);
+	pthread_mutex_unlock(&ctl->lock);
+}
+
+/* returns NULL when all directories have been read */
+static struct hardlink_dir *pop_dir(struct hardlink_ctl *ctl)
+{
+	struct hardlink_dir *dp;
+
+	pthread_mutex_lock(&ctl->lock);
+	while (!ctl->dirs && ctl->nbusy)
+		pthread_cond_wait(&ctl->cond, &ctl->lock);
+	dp = ctl->dirs;
+	if (dp) {
+		ctl->dirs = dp->next;
+		ctl->nbusy++;
+	}
+	pthread_mutex_unlock(&ctl->lock);
+	return dp;
+}
+
+static void done_dir(struct hardlink_ctl *ctl)
+{
+	pthread_mutex_lock(&ctl->lock);
+	ctl->nbusy--;
+	if (!ctl->nbusy && !ctl->dirs)
+		pthread_cond_broadcast(&ctl->cond);
+	pthread_mutex_unlock(&ctl->lock);
+}
+
+/* doubles the hash size */
+static void grow_hash(struct hardlink_ctl *ctl)
+{
+	struct hardlink_hash **hps;
+	size_t i, sz;
+
+	pthread_rwlock_wrlock(&ctl->hlock);
+	if (ctl->nbuckets <= ctl->hsize) {
+		/* resized by another thread */
+		pthread_rwlock_unlock(&ctl->hlock);
+		return;
+	}
+	sz = ctl->hsize * 2;
+	hps = xcalloc(sz, sizeof(*hps));
+
+	for (i = 0; i < ctl->hsize; i++) {
+		struct hardlink_hash *hp, *next;
+
+		for (hp = ctl->hps[i]; hp; hp = next) {
+			size_t x = hash(hp->size, hp->mtime) & (sz - 1);
+
+			next = hp->next;
+			hp->next = hps[x];
+			hps[x] = hp;
+		}
+	}
+	free(ctl->hps);
+	ctl->hps = hps;
+	ctl->hsize = sz;
+	pthread_rwlock_unlock(&ctl->hlock);
+}
+
+static void add_file(struct hardlink_ctl *ctl, struct hardlink_file *fp,
+		     off_t size, time_t mtime)
+{
+	uint64_t hsh = hash(size, mtime);
+	pthread_mutex_t *lock = &ctl->hlocks[hsh & (NLOCKS - 1)];
+	struct hardlink_hash *hp;
+	size_t x;
+	int grow = 0;
+
+	/* the same lock for the bucket in the resized hash */
+	pthread_rwlock_rdlock(&ctl->hlock);
+	pthread_mutex_lock(lock);
+
+	x = hsh & (ctl->hsize - 1);
+	for (hp = ctl->hps[x]; hp; hp = hp->next) {
+		if (hp->size == size && hp->mtime == mtime)
+			break;
+	}
+	if (!hp) {
+		hp = xmalloc(sizeof(*hp));
+		hp->size = size;
+		hp->mtime = mtime;
+		hp->chain = hp->last = NULL;
+		hp->next = ctl->hps[x];
+		ctl->hps[x] = hp;
+		grow = __atomic_add_fetch(&ctl->nbuckets, 1, __ATOMIC_RELAXED)
+			> ctl->hsize;
+	}
+	fp->next = NULL;
+	if (hp->last)
+		hp->last->next = fp;
+	else
+		hp->chain = fp;
+	hp->last = fp;
+
+	pthread_mutex_unlock(lock);
+	pthread_rwlock_unlock(&ctl->hlock);
+
+	if (grow)
+		grow_hash(ctl);
+}
+
+/*
+ * Writes the file to the --partitions temporary file. The directory pointer
+ * is valid for the whole run, so the record is the same as in memory.
+ */
+static void spill_file(struct hardlink_ctl *ctl, struct hardlink_file *fp,
+		       off_t size, time_t mtime)
+{
+	FILE *f = ctl->parts[(hash(size, mtime) >> 32) % ctl->nparts];
+	int64_t key[2] = { size, mtime };
+
+	flockfile(f);
+	if (fwrite(key, sizeof(key), 1, f) != 1 ||
+	    fwrite(fp, sizeof(*fp) + fp->namelen + 1, 1, f) != 1)
+		err(EXIT_FAILURE, _("cannot write temporary file"));
+	funlockfile(f);
+	free(fp);
+}
+
+/* reads the --partitions temporary file to the hash */
+static void load_part(struct hardlink_ctl *ctl, FILE *f)
+{
+	struct hardlink_file hdr, *fp;
+	int64_t key[2];
+
+	if (fflush(f) != 0 || fseeko(f, 0, SEEK_SET) != 0)
+		goto fail;
+
+	while (fread(key, sizeof(key), 1, f) == 1) {
+		if (fread(&hdr, sizeof(hdr), 1, f) != 1)
+			goto fail;
+		fp = xmalloc(add3(sizeof(*fp), hdr.namelen, 1));
+		memcpy(fp, &hdr, sizeof(hdr));
+		if (fread(fp->name, hdr.namelen + 1, 1, f) != 1)
+			goto fail;
+		add_file(ctl, fp, key[0], key[1]);
+	}
+	if (ferror(f))
+		goto fail;
+	fclose(f);
+	return;
+fail:
+	err(EXIT_FAILURE, _("cannot read temporary file"));
+}
+
+/* deallocates all the buckets after the second pass */
+static void reset_hash(struct hardlink_ctl *ctl)
+{
+	size_t i;
+
+	for (i = 0; i < ctl->hsize; i++) {
+		while (ctl->hps[i]) {
+			struct hardlink_hash *hp = ctl->hps[i];
+
+			while (hp->chain) {
+				struct hardlink_file *fp = hp->chain;
+
+				hp->chain = fp->next;
+				free(fp);
+			}
+			ctl->hps[i] = hp->next;
+			free(hp);
+		}
+	}
+	ctl->nbuckets = 0;
+	ctl->next_slot = 0;
+}
+
+/* writes path of the directory to @str, returns length of the path */
+static size_t dir_path(struct hardlink_dynstr *str, const struct hardlink_dir *dp)
+{
+	size_t len = 0, namelen = strlen(dp->name);
+
+	if (dp->parent)
+		len = add2(dir_path(str, dp->parent), 1);
+
+	growstr(str, add2(len, namelen));
+	if (len)
+		str->buf[len - 1] = '/';
+	memcpy(str->buf + len, dp->name, namelen + 1);
+	return len + namelen;
+}
+
+static const char *file_path(struct hardlink_dynstr *str,
+			     const struct hardlink_file *fp)
+{
+	size_t len = 0;
+
+	if (fp->dir)
+		len = add2(dir_path(str, fp->dir), 1);
+
+	growstr(str, add2(len, fp->namelen));
+	if (len)
+		str->buf[len - 1] = '/';
+	memcpy(str->buf + len, fp->name, fp->namelen + 1);
+	return str->buf;
+}
+
+static inline size_t cache_hash(uint64_t dev, uint64_t ino)
+{
+	uint64_t h = (dev * 0x9e3779b97f4a7c15ULL) ^ ino;
+
+	return (size_t) (h ^ (h >> 29));
+}
+
+static void cache_load(struct hardlink_ctl *ctl)
+{
+	struct hardlink_cache *c = &ctl->cache;
+	const struct hardlink_cache_header *hdr;
+	struct stat st;
+	size_t i, sz;
+	int fd;
+
+	fd = open(ctl->cache_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			warn(_("cannot open %s"), ctl->cache_path);
+		return;
+	}
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(*hdr))
+		goto bad;
+
+	/* the records are used directly from the page cache */
+	c->mapsz = st.st_size;
+	c->map = mmap(NULL, c->mapsz, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (c->map == MAP_FAILED) {
+		c->map = NULL;
+		goto bad;
+	}
+
+	hdr = c->map;
+	if (memcmp(hdr->magic, HARDLINK_CACHE_MAGIC, sizeof(hdr->magic)) != 0
+	    || hdr->version != HARDLINK_CACHE_VERSION
+	    || hdr->recsize != sizeof(struct hardlink_cache_rec)
+	    || hdr->nrecs != (c->mapsz - sizeof(*hdr)) / sizeof(struct hardlink_cache_rec))
+		goto bad;
+	close(fd);
+
+	c->recs = (const struct hardlink_cache_rec *) (hdr + 1);
+	c->nrecs = hdr->nrecs;
+
+	for (sz = 64; sz < c->nrecs * 2; sz <<= 1)
+		;
+	c->index = xcalloc(sz, sizeof(size_t));
+	c->mask = sz - 1;
+
+	for (i = 0; i < c->nrecs; i++) {
+		size_t x = cache_hash(c->recs[i].dev, c->recs[i].ino) & c->mask;
+
+		while (c->index[x])
+			x = (x + 1) & c->mask;
+		c->index[x] = i + 1;
+	}
+	return;
+bad:
+	warnx(_("%s: ignore invalid cache file"), ctl->cache_path);
+	close(fd);
+	if (c->map)
+		munmap(c->map, c->mapsz);
+	c->map = NULL;
+}
+
+/* the old cache is not used after the first pass */
+static void cache_unload(struct hardlink_ctl *ctl)
+{
+	struct hardlink_cache *c = &ctl->cache;
+
+	if (c->map)
+		munmap(c->map, c->mapsz);
+	free(c->index);
+	c->map = NULL;
+	c->index = NULL;
+	c->recs = NULL;
+	c->nrecs = 0;
+}
+
+static const struct hardlink_cache_rec *cache_lookup(struct hardlink_ctl *ctl,
+						     struct stat *st)
+{
+	struct hardlink_cache *c = &ctl->cache;
+	size_t x;
+
+	if (!c->index)
+		return NULL;
+
+	for (x = cache_hash(st->st_dev, st->st_ino) & c->mask; c->index[x];
+	     x = (x + 1) & c->mask) {
+		const struct hardlink_cache_rec *r = &c->recs[c->index[x] - 1];
+
+		if (r->dev == (uint64_t) st->st_dev
+		    && r->ino == (uint64_t) st->st_ino
+		    && r->size == (uint64_t) st->st_size
+		    && r->mtime == timespec_to_ns(&st->st_mtim)
+		    && r->ctime == timespec_to_ns(&st->st_ctim))
+			return r;
+	}
+	return NULL;
+}
+
+static void cache_write_header(struct hardlink_cache *c)
+{
+	struct hardlink_cache_header hdr = { .magic = HARDLINK_CACHE_MAGIC };
+
+	hdr.version = HARDLINK_CACHE_VERSION;
+	hdr.recsize = sizeof(struct hardlink_cache_rec);
+	hdr.nrecs = c->nout;
+	fwrite(&hdr, sizeof(hdr), 1, c->out);
+}
+
+/* creates the new cache as a temporary file, see cache_close() */
+static void cache_open(struct hardlink_ctl *ctl)
+{
+	struct hardlink_cache *c = &ctl->cache;
+	int fd;
+
+	xasprintf(&c->outname, "%s.XXXXXX", ctl->cache_path);
+	fd = mkstemp_cloexec(c->outname);
+	if (fd < 0 || !(c->out = fdopen(fd, "w"))) {
+		warn(_("cannot create %s"), c->outname);
+		if (fd >= 0) {
+			close(fd);
+			unlink(c->outname);
+		}
+		free(c->outname);
+		c->outname = NULL;
+		return;
+	}
+	cache_write_header(c);
+}
+
+/* writes not linked files; the linked files have a new inode now */
+static void cache_write(struct hardlink_ctl *ctl)
+{
+	struct hardlink_cache *c = &ctl->cache;
+	size_t i;
+
+	if (!c->out)
+		return;
+
+	for (i = 0; i < ctl->hsize; i++) {
+		struct hardlink_hash *hp;
+
+		for (hp = ctl->hps[i]; hp; hp = hp->next) {
+			struct hardlink_file *fp;
+
+			for (fp = hp->chain; fp; fp = fp->next) {
+				struct hardlink_cache_rec r = {
+					.dev = fp->dev,
+					.ino = fp->ino,
+					.size = hp->size,
+					.mtime = fp->mtime,
+					.ctime = fp->ctime,
+					.cksum = fp->cksum,
+					.digest = fp->has_digest ? fp->digest : 0,
+					.has_digest = fp->has_digest
+				};
+				fwrite(&r, sizeof(r), 1, c->out);
+				c->nout++;
+			}
+		}
+	}
+}
+
+/* rewrites the header with the number of records and replaces the old cache */
+static void cache_close(struct hardlink_ctl *ctl)
+{
+	struct hardlink_cache *c = &ctl->cache;
+
+	if (!c->out)
+		return;
+
+	if (fseek(c->out, 0, SEEK_SET) == 0)
+		cache_write_header(c);
+
+	if (close_stream(c->out) != 0) {
+		warn(_("cannot write %s"), c->outname);
+		unlink(c->outname);
+	} else if (rename(c->outname, ctl->cache_path) != 0) {
+		warn(_("cannot rename %s to %s"), c->outname, ctl->cache_path);
+		unlink(c->outname);
+	}
+	free(c->outname);
+	c->outname = NULL;
+	c->out = NULL;
+}
+
+static unsigned int add_cksum(unsigned int cksum, unsigned int *buf, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (cksum + buf[i] < cksum)
+			cksum += buf[i] + 1;
+		else
+			cksum += buf[i];
+	}
+	return cksum;
+}
+
+static struct hardlink_file *new_file(struct hardlink_dir *dir,
+				      const char *name, size_t namelen,
+				      struct stat *st, unsigned int cksum)
+{
+	struct hardlink_file *fp = xmalloc(add3(sizeof(*fp), namelen, 1));
+
+	fp->dir = dir;
+	fp->ino = st->st_ino;
+	fp->dev = st->st_dev;
+	fp->mode = st->st_mode;
+	fp->uid = st->st_uid;
+	fp->gid = st->st_gid;
+	fp->mtime = timespec_to_ns(&st->st_mtim);
+	fp->ctime = timespec_to_ns(&st->st_ctim);
+	fp->cksum = cksum;
+	fp->has_digest = 0;
+	fp->namelen = namelen;
+	memcpy(fp->name, name, namelen + 1);
+	return fp;
+}
+
+static void insert_file(struct hardlink_ctl *ctl, struct hardlink_file *fp,
+			struct stat *st)
+{
+	time_t mtime = ctl->content_only ? 0 : st->st_mtime;
+
+	if (ctl->nparts)
+		spill_file(ctl, fp, st->st_size, mtime);
+	else
+		add_file(ctl, fp, st->st_size, mtime);
+}
+
+/*
+ * The first pass; adds directory to the stack or file to the hash. The @name
+ * is the basename in the @parent directory and @path is the whole path.
+ */
+static void process_path(struct hardlink_worker *w, struct hardlink_dir *parent,
+			 const char *name, const char *path)
+{
+	struct hardlink_ctl *ctl = w->ctl;
+	struct stat st;
 	const size_t namelen = strlen(name);
 
-	ctl->nobjects++;
-	if (lstat(name, &st))
+	w->nobjects++;
+	if (lstat(path, &st))
 		return;
 
 	if (st.st_dev != ctl->dev && !ctl->force) {
 		if (ctl->dev)
 			errx(EXIT_FAILURE,
 			     _("%s is on different filesystem than the rest "
-			       "(use -f option to override)."), name);
+			       "(use -f option to override)."), path);
 		ctl->dev = st.st_dev;
 	}
 	if (S_ISDIR(st.st_mode)) {
 		struct hardlink_dir *dp = xmalloc(add3(sizeof(*dp), namelen, 1));
 		memcpy(dp->name, name, namelen + 1);
-		dp->next = ctl->dirs;
-		ctl->dirs = dp;
+		dp->parent = parent;
+		push_dir(ctl, dp);
 
 	} else if (S_ISREG(st.st_mode)) {
-		int fd, i;
-		struct hardlink_file *fp, *fp2;
-		struct hardlink_hash *hp;
-		const char *n1, *n2;
+		int fd;
+		struct hardlink_file *fp;
 		unsigned int buf[NBUF];
 		int cksumsize = sizeof(buf);
 		unsigned int cksum;
-		time_t mtime = ctl->content_only ? 0 : st.st_mtime;
-		unsigned int hsh = hash(st.st_size, mtime);
-		off_t fsize;
+		const struct hardlink_cache_rec *rec;
+
+		if (namelen >= 1U << 31)
+			return;
 
-		ctl->nregfiles++;
+		w->nregfiles++;
 		if (ctl->verbose > 1)
-			printf("%s\n", name);
+			printf("%s\n", path);
+
+		rec = cache_lookup(ctl, &st);
+		if (rec) {
+			fp = new_file(parent, name, namelen, &st, rec->cksum);
+			if (rec->has_digest) {
+				fp->digest = rec->digest;
+				fp->has_digest = 1;
+			}
+			insert_file(ctl, fp, &st);
+			return;
+		}
 
-		fd = open(name, O_RDONLY);
+		fd = open(path, O_RDONLY);
 		if (fd < 0)
 			return;
 
@@ -233,170 +857,429 @@ static void process_path(struct hardlink_ctl *ctl, const char *name)
 			return;
 		}
 		cksumsize = (cksumsize + sizeof(buf[0]) - 1) / sizeof(buf[0]);
-		for (i = 0, cksum = 0; i < cksumsize; i++) {
-			if (cksum + buf[i] < cksum)
-				cksum += buf[i] + 1;
-			else
-				cksum += buf[i];
+		cksum = add_cksum(0, buf, cksumsize);
+
+		/* the files with the same header usually differ at the end */
+		if ((size_t)st.st_size > sizeof(buf)) {
+			if (pread(fd, buf, sizeof(buf), st.st_size - sizeof(buf))
+			    != (ssize_t) sizeof(buf)) {
+				close(fd);
+				return;
+			}
+			cksum = add_cksum(cksum, buf, NBUF);
 		}
-		for (hp = ctl->hps[hsh]; hp; hp = hp->next) {
-			if (hp->size == st.st_size && hp->mtime == mtime)
-				break;
+		close(fd);
+
+		fp = new_file(parent, name, namelen, &st, cksum);
+		insert_file(ctl, fp, &st);
+	}
+}
+
+static void process_dir(struct hardlink_worker *w, struct hardlink_dir *dp)
+{
+	struct hardlink_dynstr *nam1 = &w->path;
+	DIR *dh;
+	struct dirent *di;
+	size_t nam1baselen = dir_path(nam1, dp);
+
+	growstr(nam1, add2(nam1baselen, 1));
+	nam1->buf[nam1baselen++] = '/';
+	nam1->buf[nam1baselen] = 0;
+	dh = opendir(nam1->buf);
+
+	if (dh == NULL)
+		return;
+	w->ndirs++;
+
+	while ((di = readdir(dh)) != NULL) {
+		if (!di->d_name[0])
+			continue;
+		if (di->d_name[0] == '.') {
+			if (!di->d_name[1] || !strcmp(di->d_name, ".."))
+				continue;
 		}
-		if (!hp) {
-			hp = xmalloc(sizeof(*hp));
-			hp->size = st.st_size;
-			hp->mtime = mtime;
-			hp->chain = NULL;
-			hp->next = ctl->hps[hsh];
-			ctl->hps[hsh] = hp;
+#ifdef HAVE_PCRE
+		if (w->ctl->re && pcre2_match(w->ctl->re, /* compiled regex */
+				      (PCRE2_SPTR) di->d_name, strlen(di->d_name), 0, /* start at offset 0 */
+				      0, /* default options */
+				      w->match_data, /* block for storing the result */
+				      NULL) /* use default match context */
+		    >=0) {
+			if (w->ctl->verbose) {
+				nam1->buf[nam1baselen] = 0;
+				printf(_("Skipping %s%s\n"), nam1->buf, di->d_name);
+			}
+			continue;
 		}
-		for (fp = hp->chain; fp; fp = fp->next) {
-			if (fp->cksum == cksum)
-				break;
+#endif
+		{
+			size_t subdirlen;
+			growstr(nam1,
+				add2(nam1baselen, subdirlen =
+				     strlen(di->d_name)));
+			memcpy(&nam1->buf[nam1baselen], di->d_name,
+			       add2(subdirlen, 1));
 		}
-		for (fp2 = fp; fp2 && fp2->cksum == cksum; fp2 = fp2->next) {
-			if (fp2->ino == st.st_ino && fp2->dev == st.st_dev) {
-				close(fd);
-				return;
-			}
+		process_path(w, dp, &nam1->buf[nam1baselen], nam1->buf);
+	}
+	closedir(dh);
+}
+
+static void *walk_worker(void *data)
+{
+	struct hardlink_worker *w = data;
+	struct hardlink_dir *dp;
+
+	while ((dp = pop_dir(w->ctl))) {
+		process_dir(w, dp);
+		done_dir(w->ctl);
+	}
+	return NULL;
+}
+
+/* calculates checksum of the whole file content, the file offset is not used */
+static int get_digest(struct hardlink_worker *w, struct hardlink_file *fp,
+		      const char *name, int fd, off_t size)
+{
+	uint32_t crc = ~0U;
+	off_t off = 0;
+
+	if (fp->has_digest)
+		return 0;
+
+	while (off < size) {
+		ssize_t rsize = size - off > (off_t) sizeof(w->iobuf1) ?
+				(ssize_t) sizeof(w->iobuf1) : size - off;
+
+		if (pread(fd, w->iobuf1, rsize, off) != rsize) {
+			warn(_("cannot read %s"), name);
+			return -1;
 		}
-		for (fp2 = fp; fp2 && fp2->cksum == cksum; fp2 = fp2->next) {
+		crc = crc32c(crc, w->iobuf1, rsize);
+		off += rsize;
+	}
+	fp->digest = crc;
+	fp->has_digest = 1;
+	return 0;
+}
 
-			if (!lstat(fp2->name, &st2) && S_ISREG(st2.st_mode) &&
-			    !stcmp(&st, &st2, ctl->content_only) &&
-			    st2.st_ino != st.st_ino &&
-			    st2.st_dev == st.st_dev) {
+#ifdef FIDEDUPERANGE
+/*
+ * Shares extents of the @fd2 file with the @fd file. Returns 0 on success, 1
+ * if the files differ or -1 on error.
+ */
+static int dedupe_file(int fd, int fd2, off_t size, const char *name)
+{
+	struct file_dedupe_range *range;
+	struct file_dedupe_range_info *info;
+	off_t off = 0;
+	int rc = 0;
 
-				int fd2 = open(fp2->name, O_RDONLY);
-				if (fd2 < 0)
-					continue;
+	range = xcalloc(1, sizeof(*range) + sizeof(*info));
+	info = &range->info[0];
+	range->dest_count = 1;
+	info->dest_fd = fd;
 
-				if (fstat(fd2, &st2) || !S_ISREG(st2.st_mode)
-				    || st2.st_size == 0) {
-					close(fd2);
-					continue;
-				}
-				ctl->ncomp++;
-				lseek(fd, 0, SEEK_SET);
-
-				for (fsize = st.st_size; fsize > 0;
-				     fsize -= (off_t)sizeof(ctl->iobuf1)) {
-					ssize_t xsz;
-					ssize_t rsize = fsize > (ssize_t) sizeof(ctl->iobuf1) ?
-							(ssize_t) sizeof(ctl->iobuf1) : fsize;
-
-					if ((xsz = read(fd, ctl->iobuf1, rsize)) != rsize)
-						warn(_("cannot read %s"), name);
-					else if ((xsz = read(fd2, ctl->iobuf2, rsize)) != rsize)
-						warn(_("cannot read %s"), fp2->name);
-
-					if (xsz != rsize) {
-						close(fd);
-						close(fd2);
-						return;
-					}
-					if (memcmp(ctl->iobuf1, ctl->iobuf2, rsize))
-						break;
-				}
+	/* the kernel may dedupe less than requested */
+	while (off < size) {
+		range->src_offset = off;
+		range->src_length = size - off > DEDUPESZ ? DEDUPESZ : size - off;
+		info->dest_offset = off;
+
+		if (ioctl(fd2, FIDEDUPERANGE, range) != 0) {
+			warn(_("cannot dedupe %s"), name);
+			rc = -1;
+			break;
+		}
+		if (info->status == FILE_DEDUPE_RANGE_DIFFERS) {
+			rc = 1;
+			break;
+		}
+		if (info->status < 0 || info->bytes_deduped == 0) {
+			errno = info->status < 0 ? -info->status : EINVAL;
+			warn(_("cannot dedupe %s"), name);
+			rc = -1;
+			break;
+		}
+		off += info->bytes_deduped;
+	}
+	free(range);
+	return rc;
+}
+#endif
+
+/*
+ * The second pass; compares the file @fp with the already processed files
+ * with the same size and mtime in @chain, and links it to the first file with
+ * the same content. Returns 0 if the file should be added to the @chain.
+ */
+static int link_file(struct hardlink_worker *w, struct hardlink_hash *hp,
+		     struct hardlink_file *chain, struct hardlink_file *fp)
+{
+	struct hardlink_ctl *ctl = w->ctl;
+	struct stat st, st2, st3;
+	struct hardlink_file *fp2;
+	const char *n1, *n2, *name = file_path(&w->path1, fp), *name2;
+	off_t fsize;
+	int fd = -1;
+
+	/* the file as it has been found by the first pass */
+	memset(&st, 0, sizeof(st));
+	st.st_ino = fp->ino;
+	st.st_dev = fp->dev;
+	st.st_mode = fp->mode;
+	st.st_uid = fp->uid;
+	st.st_gid = fp->gid;
+	st.st_size = hp->size;
+	ns_to_timespec(fp->mtime, &st.st_mtim);
+
+	for (; chain; chain = chain->next) {
+		if (chain->cksum == fp->cksum)
+			break;
+	}
+	for (fp2 = chain; fp2 && fp2->cksum == fp->cksum; fp2 = fp2->next) {
+		if (fp2->ino == st.st_ino && fp2->dev == st.st_dev)
+			return 1;
+	}
+
+	for (fp2 = chain; fp2 && fp2->cksum == fp->cksum; fp2 = fp2->next) {
+
+		/* the content checksums are known, no I/O is necessary */
+		if (fp->has_digest && fp2->has_digest && fp->digest != fp2->digest)
+			continue;
+
+		name2 = file_path(&w->path2, fp2);
+
+		if (!lstat(name2, &st2) && S_ISREG(st2.st_mode) &&
+		    !stcmp(&st, &st2, ctl->content_only) &&
+		    st2.st_ino != st.st_ino &&
+		    st2.st_dev == st.st_dev) {
+
+			int fd2, rc;
+
+			/* the file is opened only if really necessary */
+			if (fd < 0 && (fd = open(name, O_RDONLY)) < 0)
+				return 1;
+
+			fd2 = open(name2, O_RDONLY);
+			if (fd2 < 0)
+				continue;
+
+			if (fstat(fd2, &st2) || !S_ISREG(st2.st_mode)
+			    || st2.st_size == 0) {
+				close(fd2);
+				continue;
+			}
+#ifdef FIDEDUPERANGE
+			if (ctl->reflink && !ctl->no_link) {
+				/* the contents are compared by kernel */
+				w->ncomp++;
+				rc = dedupe_file(fd, fd2, st.st_size, name);
 				close(fd2);
-				if (fsize > 0)
+				if (rc > 0)
 					continue;
-				if (lstat(name, &st3)) {
-					warn(_("cannot stat %s"), name);
-					close(fd);
-					return;
-				}
-				st3.st_atime = st.st_atime;
-				if (stcmp(&st, &st3, 0)) {
-					warnx(_("file %s changed underneath us"), name);
+				close(fd);
+				if (rc < 0)
+					return 1;
+				w->nlinks++;
+				w->nsaved += ((st.st_size + 4095) / 4096) * 4096;
+				if (ctl->verbose > 1)
+					printf(_(" %s %s to %s, %s %jd\n"),
+						_("Deduplicated"), name2, name,
+						_("saved"), (intmax_t)st.st_size);
+				return 1;
+			}
+#endif
+			if (get_digest(w, fp, name, fd, st.st_size)) {
+				close(fd);
+				close(fd2);
+				return 1;
+			}
+			if (get_digest(w, fp2, name2, fd2, st.st_size)
+			    || fp->digest != fp2->digest) {
+				close(fd2);
+				continue;
+			}
+			w->ncomp++;
+			lseek(fd, 0, SEEK_SET);
+
+			for (fsize = st.st_size; fsize > 0;
+			     fsize -= (off_t)sizeof(w->iobuf1)) {
+				ssize_t xsz;
+				ssize_t rsize = fsize > (ssize_t) sizeof(w->iobuf1) ?
+						(ssize_t) sizeof(w->iobuf1) : fsize;
+
+				if ((xsz = read(fd, w->iobuf1, rsize)) != rsize)
+					warn(_("cannot read %s"), name);
+				else if ((xsz = read(fd2, w->iobuf2, rsize)) != rsize)
+					warn(_("cannot read %s"), name2);
+
+				if (xsz != rsize) {
 					close(fd);
-					return;
+					close(fd2);
+					return 1;
 				}
-				n1 = fp2->name;
-				n2 = name;
-
-				if (!ctl->no_link) {
-					const char *suffix =
-					    ".$$$___cleanit___$$$";
-					const size_t suffixlen = strlen(suffix);
-					size_t n2len = strlen(n2);
-					struct hardlink_dynstr nam2 = { NULL, 0 };
-
-					growstr(&nam2, add2(n2len, suffixlen));
-					memcpy(nam2.buf, n2, n2len);
-					memcpy(&nam2.buf[n2len], suffix,
-					       suffixlen + 1);
-					/* First create a temporary link to n1 under a new name */
-					if (link(n1, nam2.buf)) {
-						warn(_("failed to hardlink %s to %s (create temporary link as %s failed)"),
-							n1, n2, nam2.buf);
-						free(nam2.buf);
-						continue;
-					}
-					/* Then rename into place over the existing n2 */
-					if (rename(nam2.buf, n2)) {
-						warn(_("failed to hardlink %s to %s (rename temporary link to %s failed)"),
-							n1, n2, n2);
-						/* Something went wrong, try to remove the now redundant temporary link */
-						if (unlink(nam2.buf))
-							warn(_("failed to remove temporary link %s"), nam2.buf);
-						free(nam2.buf);
-						continue;
-					}
+				if (memcmp(w->iobuf1, w->iobuf2, rsize))
+					break;
+			}
+			close(fd2);
+			if (fsize > 0)
+				continue;
+			if (lstat(name, &st3)) {
+				warn(_("cannot stat %s"), name);
+				close(fd);
+				return 1;
+			}
+			st3.st_atime = st.st_atime;
+			if (stcmp(&st, &st3, 0)) {
+				warnx(_("file %s changed underneath us"), name);
+				close(fd);
+				return 1;
+			}
+			n1 = name2;
+			n2 = name;
+
+			if (!ctl->no_link) {
+				const char *suffix =
+				    ".$$$___cleanit___$$$";
+				const size_t suffixlen = strlen(suffix);
+				size_t n2len = strlen(n2);
+				struct hardlink_dynstr nam2 = { NULL, 0 };
+
+				growstr(&nam2, add2(n2len, suffixlen));
+				memcpy(nam2.buf, n2, n2len);
+				memcpy(&nam2.buf[n2len], suffix,
+				       suffixlen + 1);
+				/* First create a temporary link to n1 under a new name */
+				if (link(n1, nam2.buf)) {
+					warn(_("failed to hardlink %s to %s (create temporary link as %s failed)"),
+						n1, n2, nam2.buf);
 					free(nam2.buf);
+					continue;
 				}
-				ctl->nlinks++;
-				if (st3.st_nlink > 1) {
-					/* We actually did not save anything this time, since the link second argument
-					   had some other links as well.  */
-					if (ctl->verbose > 1)
-						printf(_(" %s %s to %s\n"),
-							(ctl->no_link ? _("Would link") : _("Linked")),
-							n1, n2);
-				} else {
-					ctl->nsaved += ((st.st_size + 4095) / 4096) * 4096;
-					if (ctl->verbose > 1)
-						printf(_(" %s %s to %s, %s %jd\n"),
-							(ctl->no_link ? _("Would link") : _("Linked")),
-							n1, n2,
-							(ctl->no_link ? _("would save") : _("saved")),
-							(intmax_t)st.st_size);
+				/* Then rename into place over the existing n2 */
+				if (rename(nam2.buf, n2)) {
+					warn(_("failed to hardlink %s to %s (rename temporary link to %s failed)"),
+						n1, n2, n2);
+					/* Something went wrong, try to remove the now redundant temporary link */
+					if (unlink(nam2.buf))
+						warn(_("failed to remove temporary link %s"), nam2.buf);
+					free(nam2.buf);
+					continue;
 				}
-				close(fd);
-				return;
+				free(nam2.buf);
+			}
+			w->nlinks++;
+			if (st3.st_nlink > 1 && !ctl->reflink) {
+				/* We actually did not save anything this time, since the link second argument
+				   had some other links as well.  */
+				if (ctl->verbose > 1)
+					printf(_(" %s %s to %s\n"),
+						(!ctl->no_link ? _("Linked") :
+						 ctl->reflink ? _("Would dedupe") : _("Would link")),
+						n1, n2);
+			} else {
+				w->nsaved += ((st.st_size + 4095) / 4096) * 4096;
+				if (ctl->verbose > 1)
+					printf(_(" %s %s to %s, %s %jd\n"),
+						(!ctl->no_link ? _("Linked") :
+						 ctl->reflink ? _("Would dedupe") : _("Would link")),
+						n1, n2,
+						(ctl->no_link ? _("would save") : _("saved")),
+						(intmax_t)st.st_size);
 			}
+			close(fd);
+			return 1;
 		}
-		fp2 = xmalloc(add3(sizeof(*fp2), namelen, 1));
+	}
+	if (fd >= 0)
 		close(fd);
-		fp2->ino = st.st_ino;
-		fp2->dev = st.st_dev;
-		fp2->cksum = cksum;
-		memcpy(fp2->name, name, namelen + 1);
-
-		if (fp) {
-			fp2->next = fp->next;
-			fp->next = fp2;
+	return 0;
+}
+
+static void link_files(struct hardlink_worker *w, struct hardlink_hash *hp)
+{
+	struct hardlink_file *chain = NULL, *fp, *next;
+
+	for (fp = hp->chain; fp; fp = next) {
+		struct hardlink_file *fp2;
+
+		next = fp->next;
+		if (link_file(w, hp, chain, fp)) {
+			free(fp);
+			continue;
+		}
+
+		/* keep the files with the same checksum together */
+		for (fp2 = chain; fp2; fp2 = fp2->next) {
+			if (fp2->cksum == fp->cksum)
+				break;
+		}
+		if (fp2) {
+			fp->next = fp2->next;
+			fp2->next = fp;
 		} else {
-			fp2->next = hp->chain;
-			hp->chain = fp2;
+			fp->next = chain;
+			chain = fp;
 		}
-		return;
 	}
+	hp->chain = chain;
+}
+
+static void *link_worker(void *data)
+{
+	struct hardlink_worker *w = data;
+	struct hardlink_ctl *ctl = w->ctl;
+
+	for (;;) {
+		size_t i, first;
+
+		pthread_mutex_lock(&ctl->lock);
+		first = ctl->next_slot;
+		ctl->next_slot += NSLOTS;
+		pthread_mutex_unlock(&ctl->lock);
+
+		if (first >= ctl->hsize)
+			break;
+		for (i = first; i < first + NSLOTS && i < ctl->hsize; i++) {
+			struct hardlink_hash *hp;
+
+			for (hp = ctl->hps[i]; hp; hp = hp->next)
+				link_files(w, hp);
+		}
+	}
+	return NULL;
+}
+
+/* runs @fn in all workers, the first worker is the main thread */
+static void run_workers(struct hardlink_ctl *ctl, void *(*fn)(void *))
+{
+	size_t i;
+
+	for (i = 1; i < ctl->nworkers; i++) {
+		int rc = pthread_create(&ctl->workers[i].thread, NULL,
+					fn, &ctl->workers[i]);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, _("failed to create thread"));
+		}
+	}
+	fn(&ctl->workers[0]);
+
+	for (i = 1; i < ctl->nworkers; i++)
+		pthread_join(ctl->workers[i].thread, NULL);
 }
 
 int main(int argc, char **argv)
 {
 	int ch;
 	int i;
+	size_t nthreads = 1, k;
 #ifdef HAVE_PCRE
 	int errornumber;
 	PCRE2_SIZE erroroffset;
-	pcre2_code *re = NULL;
 	PCRE2_SPTR exclude_pattern = NULL;
-	pcre2_match_data *match_data = NULL;
 #endif
-	struct hardlink_dynstr nam1 = { NULL, 0 };
 	struct hardlink_ctl *ctl = &global_ctl;
 
 	static const struct option longopts[] = {
@@ -404,6 +1287,10 @@ int main(int argc, char **argv)
 		{ "dry-run",    no_argument, NULL, 'n' },
 		{ "exclude",    required_argument, NULL, 'x' },
 		{ "force",      no_argument, NULL, 'f' },
+		{ "threads",    required_argument, NULL, 'j' },
+		{ "cache",      required_argument, NULL, 'C' },
+		{ "partitions", required_argument, NULL, 'P' },
+		{ "reflink",    no_argument, NULL, 'r' },
 		{ "help",       no_argument, NULL, 'h' },
 		{ "verbose",    no_argument, NULL, 'v' },
 		{ "version",    no_argument, NULL, 'V' },
@@ -415,7 +1302,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((ch = getopt_long(argc, argv, "cnvfx:Vh", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "cnvfj:C:P:rx:Vh", longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'n':
 			ctl->no_link = 1;
@@ -429,6 +1316,25 @@ int main(int argc, char **argv)
 		case 'f':
 			ctl->force = 1;
 			break;
+		case 'j':
+			nthreads = strtou32_or_err(optarg, _("invalid number of threads"));
+			if (!nthreads)
+				errx(EXIT_FAILURE, _("invalid number of threads"));
+			break;
+		case 'C':
+			ctl->cache_path = optarg;
+			break;
+		case 'P':
+			ctl->nparts = strtou32_or_err(optarg, _("invalid number of partitions"));
+			break;
+		case 'r':
+#ifdef FIDEDUPERANGE
+			ctl->reflink = 1;
+#else
+			errx(EXIT_FAILURE,
+			     _("option --reflink not supported (built without FIDEDUPERANGE)"));
+#endif
+			break;
 		case 'x':
 #ifdef HAVE_PCRE
 			exclude_pattern = (PCRE2_SPTR) optarg;
@@ -453,76 +1359,77 @@ int main(int argc, char **argv)
 
 #ifdef HAVE_PCRE
 	if (exclude_pattern) {
-		re = pcre2_compile(exclude_pattern, /* the pattern */
+		ctl->re = pcre2_compile(exclude_pattern, /* the pattern */
 				   PCRE2_ZERO_TERMINATED, /* indicates pattern is zero-terminate */
 				   0, /* default options */
 				   &errornumber, &erroroffset, NULL); /* use default compile context */
-		if (!re) {
+		if (!ctl->re) {
 			PCRE2_UCHAR buffer[256];
 			pcre2_get_error_message(errornumber, buffer,
 						sizeof(buffer));
 			errx(EXIT_FAILURE, _("pattern error at offset %d: %s"),
 				(int)erroroffset, buffer);
 		}
-		match_data = pcre2_match_data_create_from_pattern(re, NULL);
 	}
 #endif
+	pthread_mutex_init(&ctl->lock, NULL);
+	pthread_cond_init(&ctl->cond, NULL);
+	pthread_rwlock_init(&ctl->hlock, NULL);
+	for (k = 0; k < NLOCKS; k++)
+		pthread_mutex_init(&ctl->hlocks[k], NULL);
+	ctl->hsize = NHASH;
+	ctl->hps = xcalloc(ctl->hsize, sizeof(*ctl->hps));
+
+	if (ctl->nparts) {
+		ctl->parts = xcalloc(ctl->nparts, sizeof(FILE *));
+		for (k = 0; k < ctl->nparts; k++) {
+			char *tmp = NULL;
+
+			ctl->parts[k] = xfmkstemp(&tmp, NULL, "hardlink");
+			if (!ctl->parts[k])
+				err(EXIT_FAILURE, _("cannot create temporary file"));
+			unlink(tmp);
+			free(tmp);
+		}
+	}
+
+	ctl->workers = xcalloc(nthreads, sizeof(struct hardlink_worker));
+	for (k = 0; k < nthreads; k++) {
+		ctl->workers[k].ctl = ctl;
+#ifdef HAVE_PCRE
+		if (ctl->re)
+			ctl->workers[k].match_data =
+				pcre2_match_data_create_from_pattern(ctl->re, NULL);
+#endif
+	}
+	ctl->nworkers = nthreads;
+
+	if (ctl->cache_path)
+		cache_load(ctl);
+
 	atexit(print_summary);
 
 	for (i = optind; i < argc; i++)
-		process_path(ctl, argv[i]);
+		process_path(&ctl->workers[0], NULL, argv[i], argv[i]);
 
-	while (ctl->dirs) {
-		DIR *dh;
-		struct dirent *di;
-		struct hardlink_dir *dp = ctl->dirs;
-		size_t nam1baselen = strlen(dp->name);
+	run_workers(ctl, walk_worker);
 
-		ctl->dirs = dp->next;
-		growstr(&nam1, add2(nam1baselen, 1));
-		memcpy(nam1.buf, dp->name, nam1baselen);
-		free(dp);
-		nam1.buf[nam1baselen++] = '/';
-		nam1.buf[nam1baselen] = 0;
-		dh = opendir(nam1.buf);
-
-		if (dh == NULL)
-			continue;
-		ctl->ndirs++;
+	if (ctl->cache_path) {
+		cache_unload(ctl);
+		cache_open(ctl);
+	}
 
-		while ((di = readdir(dh)) != NULL) {
-			if (!di->d_name[0])
-				continue;
-			if (di->d_name[0] == '.') {
-				if (!di->d_name[1] || !strcmp(di->d_name, ".."))
-					continue;
-			}
-#ifdef HAVE_PCRE
-			if (re && pcre2_match(re, /* compiled regex */
-					      (PCRE2_SPTR) di->d_name, strlen(di->d_name), 0, /* start at offset 0 */
-					      0, /* default options */
-					      match_data, /* block for storing the result */
-					      NULL) /* use default match context */
-			    >=0) {
-				if (ctl->verbose) {
-					nam1.buf[nam1baselen] = 0;
-					printf(_("Skipping %s%s\n"), nam1.buf, di->d_name);
-				}
-				continue;
-			}
-#endif
-			{
-				size_t subdirlen;
-				growstr(&nam1,
-					add2(nam1baselen, subdirlen =
-					     strlen(di->d_name)));
-				memcpy(&nam1.buf[nam1baselen], di->d_name,
-				       add2(subdirlen, 1));
-			}
-			process_path(ctl, nam1.buf);
-		}
-		closedir(dh);
+	if (!ctl->nparts) {
+		run_workers(ctl, link_worker);
+		cache_write(ctl);
+	}
+	for (k = 0; k < ctl->nparts; k++) {
+		load_part(ctl, ctl->parts[k]);
+		run_workers(ctl, link_worker);
+		cache_write(ctl);
+		reset_hash(ctl);
 	}
 
+	cache_close(ctl);
 	return 0;
 }
@@ -70,8 +70,9 @@ enum {
 };
 
 #ifdef UL_HAVE_PIDFD
-# include <poll.h>
+# include <sys/epoll.h>
 # include "list.h"
+# include "monotonic.h"
 struct timeouts {
 	int period;
 	int sig;
@@ -79,9 +80,16 @@ struct timeouts {
 };
 #endif
 
+/* the process to be signaled */
+struct kill_proc {
+	const char *arg;	/* command line argument */
+	pid_t pid;
+	int fd;			/* pidfd or -1 */
+	unsigned int done:1;	/* exited or failed */
+};
+
 struct kill_control {
 	char *arg;
-	pid_t pid;
 	int numsig;
 #ifdef HAVE_SIGQUEUE
 	union sigval sigdata;
@@ -377,78 +385,240 @@ static char **parse_arguments(int argc, char **argv, struct kill_control *ctl)
 	return argv;
 }
 
+static void add_proc(struct kill_proc **procs, size_t *nprocs,
+		     const char *arg, pid_t pid, int fd)
+{
+	struct kill_proc *p;
+
+	if (*nprocs % 32 == 0)
+		*procs = xrealloc(*procs, (*nprocs + 32) * sizeof(struct kill_proc));
+	p = &(*procs)[(*nprocs)++];
+	p->arg = arg;
+	p->pid = pid;
+	p->fd = fd;
+	p->done = 0;
+}
+
 #ifdef UL_HAVE_PIDFD
-static int kill_with_timeout(const struct kill_control *ctl)
+static void init_siginfo(const struct kill_control *ctl, siginfo_t *info, int sig)
 {
-	int pfd, n;
-	struct pollfd p = { 0 };
-	siginfo_t info = { 0 };
+	memset(info, 0, sizeof(*info));
+	info->si_code = SI_QUEUE;
+	info->si_signo = sig;
+	info->si_uid = getuid();
+	info->si_pid = getpid();
+#ifdef HAVE_SIGQUEUE
+	if (ctl->use_sigval)
+		info->si_value = ctl->sigdata;
+	else
+#endif
+		info->si_value.sival_int = ctl->numsig;
+}
+
+/*
+ * Opens pidfd for the current process of the @ps iterator. The process is
+ * verified by its /proc directory after the open, so the pidfd does not refer
+ * to an another process that reused the PID.
+ */
+static int open_proc_pidfd(struct proc_processes *ps, pid_t pid)
+{
+	int fd = pidfd_open(pid, 0);
+
+	if (fd < 0)
+		return -1;
+	if (!proc_processes_read(ps, "stat", NULL)) {
+		close(fd);
+		errno = ESRCH;
+		return -1;
+	}
+	return fd;
+}
+
+static int64_t now_msec(void)
+{
+	struct timeval tv;
+
+	gettime_monotonic(&tv);
+	return (int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/*
+ * Waits for all the processes by one epoll set, the follow-up signal is sent
+ * to the processes which are still running when the period is over.
+ */
+static int kill_with_timeout(const struct kill_control *ctl,
+			     struct kill_proc *procs, size_t nprocs)
+{
+	struct epoll_event evs[64];
 	struct list_head *entry;
+	size_t i, pending = 0;
+	siginfo_t info;
+	int efd, rc = 0;
 
-	info.si_code = SI_QUEUE;
-	info.si_signo = ctl->numsig;
-	info.si_uid = getuid();
-	info.si_pid = getpid();
-	info.si_value.sival_int =
-	    ctl->use_sigval != 0 ? ctl->use_sigval : ctl->numsig;
+	efd = epoll_create1(EPOLL_CLOEXEC);
+	if (efd < 0)
+		err(EXIT_FAILURE, _("epoll_create() failed"));
 
-	if ((pfd = pidfd_open(ctl->pid, 0)) < 0)
-		err(EXIT_FAILURE, _("pidfd_open() failed: %d"), ctl->pid);
-	p.fd = pfd;
-	p.events = POLLIN;
+	for (i = 0; i < nprocs; i++) {
+		struct epoll_event ev = { .events = EPOLLIN };
+
+		if (procs[i].done)
+			continue;
+		ev.data.ptr = &procs[i];
+		if (epoll_ctl(efd, EPOLL_CTL_ADD, procs[i].fd, &ev) < 0)
+			err(EXIT_FAILURE, _("epoll_ctl() failed"));
+		pending++;
+	}
 
-	if (pidfd_send_signal(pfd, ctl->numsig, &info, 0) < 0)
-		err(EXIT_FAILURE, _("pidfd_send_signal() failed"));
 	list_for_each(entry, &ctl->follow_ups) {
 		struct timeouts *timeout;
+		int64_t deadline;
+
+		if (!pending)
+			break;
 
 		timeout = list_entry(entry, struct timeouts, follow_ups);
-		n = poll(&p, 1, timeout->period);
-		if (n < 0)
-			err(EXIT_FAILURE, _("poll() failed"));
-		if (n == 0) {
-			info.si_signo = timeout->sig;
+		deadline = now_msec() + timeout->period;
+
+		while (pending) {
+			int64_t left = deadline - now_msec();
+			int n;
+
+			if (left <= 0)
+				break;
+			n = epoll_wait(efd, evs, ARRAY_SIZE(evs), (int) left);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				err(EXIT_FAILURE, _("epoll_wait() failed"));
+			}
+			for (i = 0; i < (size_t) n; i++) {
+				struct kill_proc *p = evs[i].data.ptr;
+
+				epoll_ctl(efd, EPOLL_CTL_DEL, p->fd, NULL);
+				p->done = 1;
+				pending--;
+			}
+		}
+
+		init_siginfo(ctl, &info, timeout->sig);
+		for (i = 0; i < nprocs; i++) {
+			struct kill_proc *p = &procs[i];
+
+			if (p->done)
+				continue;
 			if (ctl->verbose)
 				printf(_("timeout, sending signal %d to pid %d\n"),
-					 timeout->sig, ctl->pid);
-			if (pidfd_send_signal(pfd, timeout->sig, &info, 0) < 0)
-				err(EXIT_FAILURE, _("pidfd_send_signal() failed"));
+					 timeout->sig, p->pid);
+			if (pidfd_send_signal(p->fd, timeout->sig, &info, 0) == 0)
+				continue;
+			if (errno != ESRCH) {
+				warn(_("pidfd_send_signal() failed"));
+				rc++;
+			}
+			epoll_ctl(efd, EPOLL_CTL_DEL, p->fd, NULL);
+			p->done = 1;
+			pending--;
 		}
 	}
-	return 0;
+
+	close(efd);
+	return rc;
 }
 #endif
 
-static int kill_verbose(const struct kill_control *ctl)
+static int kill_verbose(const struct kill_control *ctl, struct kill_proc *p)
 {
 	int rc = 0;
 
 	if (ctl->verbose)
-		printf(_("sending signal %d to pid %d\n"), ctl->numsig, ctl->pid);
-	if (ctl->do_pid) {
-		printf("%ld\n", (long) ctl->pid);
-		return 0;
-	}
+		printf(_("sending signal %d to pid %d\n"), ctl->numsig, p->pid);
 #ifdef UL_HAVE_PIDFD
-	if (ctl->timeout) {
-		rc = kill_with_timeout(ctl);
+	if (p->fd >= 0) {
+		siginfo_t info;
+
+		init_siginfo(ctl, &info, ctl->numsig);
+		rc = pidfd_send_signal(p->fd, ctl->numsig,
+			ctl->use_sigval || ctl->timeout ? &info : NULL, 0);
 	} else
 #endif
 #ifdef HAVE_SIGQUEUE
 	if (ctl->use_sigval)
-		rc = sigqueue(ctl->pid, ctl->numsig, ctl->sigdata);
+		rc = sigqueue(p->pid, ctl->numsig, ctl->sigdata);
 	else
 #endif
-		rc = kill(ctl->pid, ctl->numsig);
+		rc = kill(p->pid, ctl->numsig);
 
-	if (rc < 0)
-		warn(_("sending signal to %s failed"), ctl->arg);
+	if (rc < 0) {
+		warn(_("sending signal to %s failed"), p->arg);
+		p->done = 1;
+	}
 	return rc;
 }
 
+/*
+ * Looks for all the @names by one /proc scan, returns number of the found
+ * processes and sets @found[] for the names.
+ */
+static size_t lookup_names(const struct kill_control *ctl,
+			   char **names, char *found, size_t nnames,
+			   struct kill_proc **procs, size_t *nprocs)
+{
+	struct proc_processes *ps = proc_open_processes();
+	size_t i, ct = 0;
+	pid_t pid;
+
+	if (!ps)
+		return 0;
+	if (!ctl->check_all)
+		proc_processes_filter_by_uid(ps, getuid());
+
+	while (proc_next_pid(ps, &pid) == 0) {
+		const char *procname = proc_processes_get_name(ps);
+		const char *arg = NULL;
+		int fd = -1;
+
+		if (!procname)
+			continue;
+		for (i = 0; i < nnames; i++) {
+			if (strcmp(procname, names[i]) == 0) {
+				found[i] = 1;
+				if (!arg)
+					arg = names[i];
+			}
+		}
+		if (!arg)
+			continue;
+		if (ctl->do_pid) {
+			printf("%ld\n", (long) pid);
+			ct++;
+			continue;
+		}
+#ifdef UL_HAVE_PIDFD
+		fd = open_proc_pidfd(ps, pid);
+		if (fd < 0 && errno == ESRCH)
+			continue;	/* already gone */
+		if (fd < 0 && ctl->timeout) {
+			warn(_("pidfd_open() failed: %d"), pid);
+			add_proc(procs, nprocs, arg, pid, -1);
+			(*procs)[*nprocs - 1].done = 1;
+			ct++;
+			continue;
+		}
+#endif
+		add_proc(procs, nprocs, arg, pid, fd);
+		ct++;
+	}
+	proc_close_processes(ps);
+	return ct;
+}
+
 int main(int argc, char **argv)
 {
 	struct kill_control ctl = { .numsig = SIGTERM };
+	struct kill_proc *procs = NULL;
+	char **names = NULL;
+	size_t i, nprocs = 0, nnames = 0;
 	int nerrs = 0, ct = 0;
 
 	setlocale(LC_ALL, "");
@@ -464,37 +634,63 @@ int main(int argc, char **argv)
 	/* The rest of the arguments should be process ids and names. */
 	for ( ; (ctl.arg = *argv) != NULL; argv++) {
 		char *ep = NULL;
+		pid_t pid;
+		int fd = -1;
 
 		errno = 0;
-		ctl.pid = strtol(ctl.arg, &ep, 10);
-		if (errno == 0 && ep && *ep == '\0' && ctl.arg < ep) {
-			if (kill_verbose(&ctl) != 0)
-				nerrs++;
-			ct++;
-		} else {
-			struct proc_processes *ps = proc_open_processes();
-			int found = 0;
+		pid = strtol(ctl.arg, &ep, 10);
+		if (!(errno == 0 && ep && *ep == '\0' && ctl.arg < ep)) {
+			if (nnames % 16 == 0)
+				names = xrealloc(names, (nnames + 16) * sizeof(char *));
+			names[nnames++] = ctl.arg;
+			continue;
+		}
+		ct++;
+		if (ctl.do_pid) {
+			printf("%ld\n", (long) pid);
+			continue;
+		}
+#ifdef UL_HAVE_PIDFD
+		if (ctl.timeout && (fd = pidfd_open(pid, 0)) < 0) {
+			warn(_("pidfd_open() failed: %d"), pid);
+			nerrs++;
+			continue;
+		}
+#endif
+		add_proc(&procs, &nprocs, ctl.arg, pid, fd);
+	}
 
-			if (!ps)
-				continue;
-			if (!ctl.check_all)
-				proc_processes_filter_by_uid(ps, getuid());
-
-			proc_processes_filter_by_name(ps, ctl.arg);
-			while (proc_next_pid(ps, &ctl.pid) == 0) {
-				if (kill_verbose(&ctl) != 0)
-					nerrs++;
-				ct++;
-				found = 1;
-			}
-			proc_close_processes(ps);
+	/* All the names by one /proc scan */
+	if (nnames) {
+		char *found = xcalloc(nnames, 1);
 
-			if (!found) {
-				nerrs++, ct++;
-				warnx(_("cannot find process \"%s\""), ctl.arg);
-			}
+		ct += lookup_names(&ctl, names, found, nnames, &procs, &nprocs);
+		for (i = 0; i < nnames; i++) {
+			if (found[i])
+				continue;
+			nerrs++, ct++;
+			warnx(_("cannot find process \"%s\""), names[i]);
 		}
+		free(found);
+		free(names);
+	}
+
+	for (i = 0; i < nprocs; i++) {
+		if (procs[i].done)
+			nerrs++;
+		else if (kill_verbose(&ctl, &procs[i]) != 0)
+			nerrs++;
+	}
+
+#ifdef UL_HAVE_PIDFD
+	if (ctl.timeout)
+		nerrs += kill_with_timeout(&ctl, procs, nprocs);
+#endif
+	for (i = 0; i < nprocs; i++) {
+		if (procs[i].fd >= 0)
+			close(procs[i].fd);
 	}
+	free(procs);
 
 #ifdef UL_HAVE_PIDFD
 	while (!list_empty(&ctl.follow_ups)) {
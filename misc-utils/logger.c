@@ -53,6 +53,9 @@
 #include <pwd.h>
 #include <signal.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include "all-io.h"
 #include "c.h"
@@ -63,6 +66,9 @@
 #include "xalloc.h"
 #include "strv.h"
 #include "list.h"
+#include "bitops.h"
+#include "monotonic.h"
+#include "timeutils.h"
 
 #define	SYSLOG_NAMES
 #include <syslog.h>
@@ -100,7 +106,9 @@ enum {
 	OPT_ID,
 	OPT_STRUCTURED_DATA_ID,
 	OPT_STRUCTURED_DATA_PARAM,
-	OPT_OCTET_COUNT
+	OPT_OCTET_COUNT,
+	OPT_BATCH,
+	OPT_JOURNALD_STREAM
 };
 
 /* rfc5424 structured data */
@@ -137,12 +145,16 @@ struct logger_ctl {
 			rfc5424_tq:1,		/* include time quality markup */
 			rfc5424_host:1,		/* include hostname */
 			skip_empty_lines:1,	/* do not send empty lines when processing files */
-			octet_count:1;		/* use RFC6587 octet counting */
+			octet_count:1,		/* use RFC6587 octet counting */
+			batch:1,		/* --batch, read and send stdin by blocks */
+			journald_stream:1;	/* --journald-stream */
 };
 
 #define is_connected(_ctl)	((_ctl)->fd >= 0)
 static void logger_reopen(struct logger_ctl *ctl);
 
+static struct ul_timecache logger_tcache;	/* localtime() of the messages */
+
 /*
  * For tests we want to be able to control datetime outputs
  */
@@ -420,7 +432,7 @@ static char const *rfc3164_current_time(void)
 	};
 
 	logger_gettimeofday(&tv, NULL);
-	localtime_r(&tv.tv_sec, &tm);
+	ul_timecache_tm(&logger_tcache, tv.tv_sec, 0, &tm);
 	snprintf(time, sizeof(time),"%s %2d %2.2d:%2.2d:%2.2d",
 		monthnames[tm.tm_mon], tm.tm_mday,
 		tm.tm_hour, tm.tm_min, tm.tm_sec);
@@ -775,19 +787,14 @@ static void syslog_rfc5424_header(struct logger_ctl *const ctl)
 
 	if (ctl->rfc5424_time) {
 		struct timeval tv;
-		struct tm tm;
+		char buf[ISO_BUFSIZ];
 
+		/* RFC3339 timestamp, the same as ISO 8601 with usec and TZ */
 		logger_gettimeofday(&tv, NULL);
-		if (localtime_r(&tv.tv_sec, &tm) != NULL) {
-			char fmt[64];
-			const size_t i = strftime(fmt, sizeof(fmt),
-						  "%Y-%m-%dT%H:%M:%S.%%06u%z ", &tm);
-			/* patch TZ info to comply with RFC3339 (we left SP at end) */
-			fmt[i - 1] = fmt[i - 2];
-			fmt[i - 2] = fmt[i - 3];
-			fmt[i - 3] = ':';
-			xasprintf(&time, fmt, tv.tv_usec);
-		} else
+		if (strtimeval_iso_cached(&logger_tcache, &tv, ISO_TIMESTAMP_DOT_T,
+					  buf, sizeof(buf)) == 0)
+			xasprintf(&time, "%s ", buf);
+		else
 			err(EXIT_FAILURE, _("localtime() failed"));
 	} else
 		time = xstrdup(NILVALUE);
@@ -1039,6 +1046,669 @@ static void logger_stdin(struct logger_ctl *ctl)
 	free(buf);
 }
 
+/*
+ * --batch mode: stdin is read by large blocks, the header is generated once
+ * per block (all messages from the block share the timestamp) and the
+ * messages are sent by sendmmsg() for datagram sockets or by one writev() for
+ * stream sockets.
+ */
+#define LOGGER_BATCH_MSGS	256
+#define LOGGER_BATCH_BUFSZ	(64 * 1024)
+
+struct logger_batch {
+	struct mmsghdr	msgs[LOGGER_BATCH_MSGS];
+	struct iovec	iov[LOGGER_BATCH_MSGS * 4];
+	char		octet[LOGGER_BATCH_MSGS][24];
+	size_t		nmsgs;
+	size_t		niov;
+	size_t		hdrlen;
+
+	uintmax_t	sent;
+	uintmax_t	dropped;
+};
+
+static void batch_add(struct logger_ctl *ctl, struct logger_batch *b,
+		      const char *msg, size_t len)
+{
+	struct iovec *iov = &b->iov[b->niov];
+	struct mmsghdr *m = &b->msgs[b->nmsgs];
+	size_t n = 0;
+
+	if (ctl->octet_count) {
+		iov[n].iov_base = b->octet[b->nmsgs];
+		iov[n++].iov_len = snprintf(b->octet[b->nmsgs],
+				sizeof(b->octet[0]), "%zu ", b->hdrlen + len);
+	}
+	iov[n].iov_base = ctl->hdr;
+	iov[n++].iov_len = b->hdrlen;
+	iov[n].iov_base = (void *) msg;
+	iov[n++].iov_len = len;
+	if (ctl->socket_type == TYPE_TCP && !ctl->octet_count) {
+		iov[n].iov_base = "\n";
+		iov[n++].iov_len = 1;
+	}
+
+	memset(m, 0, sizeof(*m));
+	m->msg_hdr.msg_iov = iov;
+	m->msg_hdr.msg_iovlen = n;
+
+	b->niov += n;
+	b->nmsgs++;
+}
+
+/* returns number of sent messages, starting at @first */
+static size_t batch_send_dgram(struct logger_ctl *ctl, struct logger_batch *b,
+			       size_t first)
+{
+	size_t i = first;
+
+	while (i < b->nmsgs) {
+#ifdef HAVE_SENDMMSG
+		int rc = sendmmsg(ctl->fd, &b->msgs[i], b->nmsgs - i, MSG_NOSIGNAL);
+
+		if (rc <= 0)
+			break;
+		i += rc;
+#else
+		if (sendmsg(ctl->fd, &b->msgs[i].msg_hdr, MSG_NOSIGNAL) < 0)
+			break;
+		i++;
+#endif
+	}
+	return i;
+}
+
+/*
+ * Returns number of sent messages, starting at @first. The partially written
+ * message is lost (the connection is broken anyway), @partial is set.
+ */
+static size_t batch_send_stream(struct logger_ctl *ctl, struct logger_batch *b,
+				size_t first, int *partial)
+{
+	struct iovec *iov = b->msgs[first].msg_hdr.msg_iov;
+	size_t niov = &b->iov[b->niov] - iov, i;
+	int split = 0;
+
+	while (niov > 0) {
+		ssize_t n = writev(ctl->fd, iov, min(niov, (size_t) IOV_MAX));
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		while (n > 0) {
+			if ((size_t) n >= iov->iov_len) {
+				n -= iov->iov_len;
+				iov++;
+				niov--;
+				split = 0;
+			} else {
+				iov->iov_base = (char *) iov->iov_base + n;
+				iov->iov_len -= n;
+				split = 1;
+				n = 0;
+			}
+		}
+	}
+
+	for (i = first; i < b->nmsgs; i++) {
+		struct msghdr *m = &b->msgs[i].msg_hdr;
+
+		if (m->msg_iov + m->msg_iovlen > iov)
+			break;
+	}
+	*partial = i < b->nmsgs && (split || iov != b->msgs[i].msg_hdr.msg_iov);
+	return i;
+}
+
+static size_t batch_send(struct logger_ctl *ctl, struct logger_batch *b,
+			 size_t first)
+{
+	size_t sent = first;
+	int partial = 0;
+
+	if (ctl->socket_type == TYPE_TCP)
+		sent = batch_send_stream(ctl, b, first, &partial);
+	else
+		sent = batch_send_dgram(ctl, b, first);
+	if (partial) {
+		b->dropped++;
+		sent++;
+	}
+	return sent;
+}
+
+static void batch_flush(struct logger_ctl *ctl, struct logger_batch *b)
+{
+	size_t i, sent = 0;
+
+	if (!b->nmsgs)
+		return;
+
+	if (ctl->stderr_printout) {
+		/* make sure it's terminated for stderr, see batch_add() */
+		int terminated = ctl->socket_type == TYPE_TCP && !ctl->octet_count;
+
+		for (i = 0; i < b->nmsgs; i++) {
+			struct msghdr *m = &b->msgs[i].msg_hdr;
+			struct iovec iov[5];
+
+			memcpy(iov, m->msg_iov, m->msg_iovlen * sizeof(*iov));
+			iov[m->msg_iovlen].iov_base = "\n";
+			iov[m->msg_iovlen].iov_len = 1;
+			ignore_result( writev(STDERR_FILENO, iov,
+				m->msg_iovlen + (terminated ? 0 : 1)) );
+		}
+	}
+
+	if (ctl->noact)
+		sent = b->nmsgs;
+	else {
+		if (!is_connected(ctl))
+			logger_reopen(ctl);
+		if (is_connected(ctl))
+			sent = batch_send(ctl, b, 0);
+		if (sent < b->nmsgs) {
+			/* see write_output(), syslogd may be restarted */
+			logger_reopen(ctl);
+			if (is_connected(ctl))
+				sent = batch_send(ctl, b, sent);
+			if (sent < b->nmsgs)
+				warn(_("send message failed"));
+		}
+	}
+
+	b->dropped += b->nmsgs - sent;
+	b->sent += sent;
+	b->nmsgs = 0;
+	b->niov = 0;
+}
+
+/* returns size of the valid <pri> prefix and sets ctl->pri, see logger_stdin() */
+static size_t batch_prio_prefix(struct logger_ctl *ctl, const char *p,
+				size_t sz, int default_priority)
+{
+	size_t i = 1;
+	int pri = 0;
+
+	if (!sz || *p != '<')
+		return 0;
+	while (i < sz && isdigit(p[i]) && pri <= 191)
+		pri = pri * 10 + p[i++] - '0';
+
+	if (i < sz && p[i] == '>' && pri <= 191) {
+		if (pri < 8)	/* kern facility is forbidden */
+			pri |= 8;
+		ctl->pri = pri;
+		return i + 1;
+	}
+	ctl->pri = default_priority;
+	return 0;
+}
+
+static void logger_stdin_batch(struct logger_ctl *ctl)
+{
+	struct logger_batch *b = xcalloc(1, sizeof(*b));
+	size_t bufsz = LOGGER_BATCH_BUFSZ + ctl->max_message_size + 8;
+	char *const buf = xmalloc(bufsz);
+	int default_priority = ctl->pri;
+	int fd = fileno(stdin), eof = 0;
+	size_t len = 0, max_usrmsg_size;
+
+	while (!eof) {
+		ssize_t n = read(fd, buf + len, bufsz - len);
+		char *p = buf, *end;
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			eof = 1;
+		else
+			len += n;
+		end = buf + len;
+
+		/* one header for all messages from the block */
+		generate_syslog_header(ctl);
+		b->hdrlen = strlen(ctl->hdr);
+		max_usrmsg_size = ctl->max_message_size - b->hdrlen;
+
+		while (p < end) {
+			char *nl = memchr(p, '\n', end - p);
+			size_t sz;
+
+			/* incomplete line, wait for the rest */
+			if (!nl && !eof && (size_t) (end - p) < max_usrmsg_size + 8)
+				break;
+
+			if (ctl->prio_prefix) {
+				int last_pri = ctl->pri;
+
+				p += batch_prio_prefix(ctl, p, end - p, default_priority);
+				if (ctl->pri != last_pri) {
+					/* the batch points to the current header */
+					batch_flush(ctl, b);
+					generate_syslog_header(ctl);
+					b->hdrlen = strlen(ctl->hdr);
+					max_usrmsg_size = ctl->max_message_size - b->hdrlen;
+				}
+			}
+
+			sz = (nl ? nl : end) - p;
+			if (sz > max_usrmsg_size)
+				sz = max_usrmsg_size;
+
+			if (sz > 0 || !ctl->skip_empty_lines) {
+				if (b->nmsgs == LOGGER_BATCH_MSGS)
+					batch_flush(ctl, b);
+				batch_add(ctl, b, p, sz);
+			}
+
+			p += sz;
+			if (p == nl)	/* discard line terminator */
+				p++;
+		}
+
+		/* the messages point to the buffer */
+		batch_flush(ctl, b);
+
+		len = end - p;
+		if (len)
+			memmove(buf, p, len);
+	}
+
+	warnx(_("%ju messages sent, %ju dropped"), b->sent, b->dropped);
+	free(buf);
+	free(b);
+}
+
+/*
+ * --journald-stream mode: the input is a stream of journal entries, every
+ * entry is KEY=value lines terminated by an empty line (see journald_entry()).
+ * The entries are sent by the native journal protocol (one datagram per
+ * entry, more datagrams by one sendmmsg() call), large entries are passed in
+ * sealed memfd. The socket is non-blocking and the entries are kept in a
+ * bounded queue, so the input is always read; the oldest entries are dropped
+ * when the queue is full.
+ */
+#define JOURNALD_QUEUE_MAX	(4 * 1024 * 1024)	/* max size of queued entries */
+#define JOURNALD_BATCH		64			/* entries per sendmmsg() */
+#define JOURNALD_MEMFD_MIN	(128 * 1024)		/* send larger entries by memfd */
+#define JOURNALD_RETRY_MSEC	100			/* reconnect interval */
+#define JOURNALD_RETRY_MAX	50			/* reconnects after end of input */
+#define JOURNALD_BUFSZ		(64 * 1024)
+
+struct journald_qentry {
+	char			*data;		/* serialized entry */
+	size_t			size;
+	struct list_head	entries;
+};
+
+struct journald_stream {
+	int			fd;
+	struct sockaddr_un	addr;
+
+	struct list_head	queue;		/* journald_qentry list */
+	size_t			queued;		/* size of queued entries */
+
+	char			*fields;	/* current entry, KEY=value\n */
+	size_t			fields_sz;
+	size_t			fields_alloc;
+	char			*mesg;		/* current entry, all MESSAGE= lines */
+	size_t			mesg_sz;
+	size_t			mesg_alloc;
+	int			nfields;
+
+	uintmax_t		sent;
+	uintmax_t		dropped;
+	struct timeval		retry;		/* next reconnect time */
+
+	unsigned int		blocked : 1,	/* wait for POLLOUT */
+				failed : 1,	/* wait for reconnect */
+				warned : 1;
+};
+
+static void jstream_append(char **buf, size_t *sz, size_t *alloc,
+			   const void *data, size_t len)
+{
+	if (*sz + len > *alloc) {
+		*alloc = max(*alloc * 2, *sz + len + 256);
+		*buf = xrealloc(*buf, *alloc);
+	}
+	memcpy(*buf + *sz, data, len);
+	*sz += len;
+}
+
+static void jstream_connect(struct logger_ctl *ctl, struct journald_stream *js)
+{
+	if (js->fd >= 0)
+		close(js->fd);
+
+	js->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (js->fd < 0)
+		err(EXIT_FAILURE, _("cannot create socket"));
+
+	if (connect(js->fd, (struct sockaddr *) &js->addr, sizeof(js->addr)) != 0) {
+		if (ctl->unix_socket_errors || !js->warned)
+			warn(_("socket %s"), js->addr.sun_path);
+		js->warned = 1;
+		close(js->fd);
+		js->fd = -1;
+	}
+}
+
+static void jstream_dequeue(struct journald_stream *js, int sent)
+{
+	struct journald_qentry *e = list_first_entry(&js->queue,
+					struct journald_qentry, entries);
+
+	list_del(&e->entries);
+	js->queued -= e->size;
+	if (sent)
+		js->sent++;
+	else
+		js->dropped++;
+	free(e->data);
+	free(e);
+}
+
+/* finishes the current entry and adds it to the queue */
+static void jstream_finish_entry(struct logger_ctl *ctl, struct journald_stream *js)
+{
+	struct journald_qentry *e;
+
+	if (!js->nfields)
+		return;
+
+	if (js->mesg_sz) {
+		/* multi-line message has to use the binary format */
+		if (memchr(js->mesg, '\n', js->mesg_sz)) {
+			uint64_t le = cpu_to_le64(js->mesg_sz);
+
+			jstream_append(&js->fields, &js->fields_sz, &js->fields_alloc,
+				       "MESSAGE\n", 8);
+			jstream_append(&js->fields, &js->fields_sz, &js->fields_alloc,
+				       &le, sizeof(le));
+		} else
+			jstream_append(&js->fields, &js->fields_sz, &js->fields_alloc,
+				       "MESSAGE=", 8);
+		jstream_append(&js->fields, &js->fields_sz, &js->fields_alloc,
+			       js->mesg, js->mesg_sz);
+		jstream_append(&js->fields, &js->fields_sz, &js->fields_alloc,
+			       "\n", 1);
+	}
+
+	e = xcalloc(1, sizeof(*e));
+	INIT_LIST_HEAD(&e->entries);
+	e->size = js->fields_sz;
+	e->data = xmalloc(e->size);
+	memcpy(e->data, js->fields, e->size);
+
+	js->fields_sz = js->mesg_sz = 0;
+	js->nfields = 0;
+
+	if (ctl->noact) {
+		js->sent++;
+		free(e->data);
+		free(e);
+		return;
+	}
+
+	/* bounded queue, the input is never blocked by journald */
+	while (!list_empty(&js->queue) && js->queued + e->size > JOURNALD_QUEUE_MAX)
+		jstream_dequeue(js, 0);
+
+	list_add_tail(&e->entries, &js->queue);
+	js->queued += e->size;
+}
+
+static void jstream_add_line(struct logger_ctl *ctl, struct journald_stream *js,
+			     char *line, size_t sz)
+{
+	while (sz && isspace((unsigned char) line[sz - 1]))
+		sz--;
+	if (!sz) {
+		jstream_finish_entry(ctl, js);
+		return;
+	}
+	if (ctl->stderr_printout)
+		fprintf(stderr, "%.*s\n", (int) sz, line);
+
+	if (sz > 8 && strncmp(line, "MESSAGE=", 8) == 0) {
+		/* all MESSAGE= lines are merged, see journald_entry() */
+		if (js->mesg_sz)
+			jstream_append(&js->mesg, &js->mesg_sz, &js->mesg_alloc, "\n", 1);
+		jstream_append(&js->mesg, &js->mesg_sz, &js->mesg_alloc,
+			       line + 8, sz - 8);
+	} else if (memchr(line, '=', sz)) {
+		jstream_append(&js->fields, &js->fields_sz, &js->fields_alloc,
+			       line, sz);
+		jstream_append(&js->fields, &js->fields_sz, &js->fields_alloc,
+			       "\n", 1);
+	} else
+		return;		/* the binary format is not supported on input */
+
+	js->nfields++;
+}
+
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+static int jstream_send_memfd(struct journald_stream *js, struct journald_qentry *e)
+{
+	struct msghdr mh = { 0 };
+	struct cmsghdr *cmsg;
+	union {
+		struct cmsghdr cmh;
+		char control[CMSG_SPACE(sizeof(int))];
+	} cbuf;
+	int mfd, rc = 0;
+
+	mfd = memfd_create("logger-journal", MFD_ALLOW_SEALING | MFD_CLOEXEC);
+	if (mfd < 0)
+		return -errno;
+	if (write_all(mfd, e->data, e->size) != 0
+	    || fcntl(mfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+				       F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+		rc = -errno;
+		goto done;
+	}
+
+	mh.msg_control = cbuf.control;
+	mh.msg_controllen = CMSG_SPACE(sizeof(int));
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &mfd, sizeof(int));
+
+	if (sendmsg(js->fd, &mh, MSG_NOSIGNAL) < 0)
+		rc = -errno;
+done:
+	close(mfd);
+	return rc;
+}
+#else
+static int jstream_send_memfd(struct journald_stream *js __attribute__((__unused__)),
+			      struct journald_qentry *e __attribute__((__unused__)))
+{
+	return -EMSGSIZE;
+}
+#endif
+
+/* sends the queue; returns 0 or negative errno */
+static int jstream_send(struct journald_stream *js)
+{
+	struct mmsghdr msgs[JOURNALD_BATCH];
+	struct iovec iov[JOURNALD_BATCH];
+
+	while (!list_empty(&js->queue)) {
+		struct list_head *p;
+		struct journald_qentry *e;
+		int n = 0, rc;
+
+		e = list_first_entry(&js->queue, struct journald_qentry, entries);
+		if (e->size >= JOURNALD_MEMFD_MIN) {
+			rc = jstream_send_memfd(js, e);
+			if (rc == -EAGAIN)
+				return rc;
+			if (rc < 0 && rc != -EMSGSIZE)
+				return rc;
+			jstream_dequeue(js, rc == 0);
+			continue;
+		}
+
+		memset(msgs, 0, sizeof(msgs));
+		list_for_each(p, &js->queue) {
+			e = list_entry(p, struct journald_qentry, entries);
+			if (n == JOURNALD_BATCH || e->size >= JOURNALD_MEMFD_MIN)
+				break;
+			iov[n].iov_base = e->data;
+			iov[n].iov_len = e->size;
+			msgs[n].msg_hdr.msg_iov = &iov[n];
+			msgs[n].msg_hdr.msg_iovlen = 1;
+			n++;
+		}
+
+#ifdef HAVE_SENDMMSG
+		rc = sendmmsg(js->fd, msgs, n, MSG_NOSIGNAL);
+#else
+		rc = sendmsg(js->fd, &msgs[0].msg_hdr, MSG_NOSIGNAL) < 0 ? -1 : 1;
+#endif
+		if (rc < 0 && errno == EMSGSIZE) {
+			/* larger than the socket buffer, try memfd */
+			e = list_first_entry(&js->queue, struct journald_qentry, entries);
+			rc = jstream_send_memfd(js, e);
+			if (rc < 0 && rc != -EMSGSIZE)
+				return rc;
+			jstream_dequeue(js, rc == 0);
+			continue;
+		}
+		if (rc < 0)
+			return -errno;
+		while (rc-- > 0)
+			jstream_dequeue(js, 1);
+	}
+	return 0;
+}
+
+static void jstream_flush(struct logger_ctl *ctl, struct journald_stream *js)
+{
+	struct timeval now;
+	int rc;
+
+	if (list_empty(&js->queue) || js->blocked)
+		return;
+
+	if (js->failed) {
+		gettime_monotonic(&now);
+		if (timercmp(&now, &js->retry, <))
+			return;
+		jstream_connect(ctl, js);
+	}
+
+	rc = js->fd >= 0 ? jstream_send(js) : -ENOTCONN;
+	js->blocked = rc == -EAGAIN;
+	js->failed = rc < 0 && rc != -EAGAIN;
+
+	if (js->failed) {
+		/* journald restarted? reconnect later */
+		struct timeval add = { .tv_usec = JOURNALD_RETRY_MSEC * 1000 };
+
+		if (!js->warned && rc != -ENOTCONN) {
+			errno = -rc;
+			warn(_("send message failed"));
+			js->warned = 1;
+		}
+		gettime_monotonic(&now);
+		timeradd(&now, &add, &js->retry);
+	}
+}
+
+static void logger_journald_stream(struct logger_ctl *ctl)
+{
+	struct journald_stream js = { .fd = -1 };
+	const char *path = ctl->unix_socket ? ctl->unix_socket : _PATH_JOURNAL_SOCKET;
+	size_t bufsz = JOURNALD_BUFSZ, len = 0;
+	char *buf = xmalloc(bufsz);
+	int in = fileno(stdin), eof = 0, retries = 0;
+
+	INIT_LIST_HEAD(&js.queue);
+
+	if (strlen(path) >= sizeof(js.addr.sun_path))
+		errx(EXIT_FAILURE, _("openlog %s: pathname too long"), path);
+	js.addr.sun_family = AF_UNIX;
+	strcpy(js.addr.sun_path, path);
+
+	if (!ctl->noact) {
+		jstream_connect(ctl, &js);
+		js.failed = js.fd < 0;
+	}
+
+	while (!eof || (!list_empty(&js.queue) && retries <= JOURNALD_RETRY_MAX)) {
+		struct pollfd fds[2] = {
+			{ .fd = eof ? -1 : in, .events = POLLIN },
+			{ .fd = js.blocked ? js.fd : -1, .events = POLLOUT }
+		};
+		int rc, wait = js.failed || (eof && js.blocked);
+
+		rc = poll(fds, ARRAY_SIZE(fds), wait ? JOURNALD_RETRY_MSEC : -1);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, _("poll failed"));
+		}
+
+		if (fds[0].revents) {
+			ssize_t n = read(in, buf + len, bufsz - len);
+			char *p = buf, *end, *nl;
+
+			if (n <= 0 && !(n < 0 && (errno == EINTR || errno == EAGAIN)))
+				eof = 1;
+			if (n > 0)
+				len += n;
+			end = buf + len;
+
+			while ((nl = memchr(p, '\n', end - p))) {
+				jstream_add_line(ctl, &js, p, nl - p);
+				p = nl + 1;
+			}
+			if (eof) {
+				if (p < end)
+					jstream_add_line(ctl, &js, p, end - p);
+				jstream_finish_entry(ctl, &js);
+				p = end;
+			}
+
+			len = end - p;
+			if (len)
+				memmove(buf, p, len);
+			if (len == bufsz) {
+				/* too long line */
+				bufsz *= 2;
+				buf = xrealloc(buf, bufsz);
+			}
+		}
+		if (fds[1].revents)
+			js.blocked = 0;
+
+		jstream_flush(ctl, &js);
+
+		/* don't wait for broken or stuck journald forever */
+		if (eof && (js.failed || (js.blocked && rc == 0)))
+			retries++;
+	}
+
+	while (!list_empty(&js.queue))
+		jstream_dequeue(&js, 0);
+
+	warnx(_("%ju entries sent, %ju dropped"), js.sent, js.dropped);
+
+	if (js.fd >= 0)
+		close(js.fd);
+	free(js.fields);
+	free(js.mesg);
+	free(buf);
+}
+
 static void logger_close(const struct logger_ctl *ctl)
 {
 	if (ctl->fd != -1 && close(ctl->fd) != 0)
@@ -1061,6 +1731,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -f, --file <file>        log the contents of this file\n"), out);
 	fputs(_(" -e, --skip-empty         do not log empty lines when processing files\n"), out);
 	fputs(_("     --no-act             do everything except the write the log\n"), out);
+	fputs(_("     --batch              read and send stdin by large blocks\n"), out);
 	fputs(_(" -p, --priority <prio>    mark given message with this priority\n"), out);
 	fputs(_("     --octet-count        use rfc6587 octet counting\n"), out);
 	fputs(_("     --prio-prefix        look for a prefix on every line read from stdin\n"), out);
@@ -1083,6 +1754,7 @@ static void __attribute__((__noreturn__)) usage(void)
 #ifdef HAVE_LIBSYSTEMD
 	fputs(_("     --journald[=<file>]  write journald entry\n"), out);
 #endif
+	fputs(_("     --journald-stream    write stream of journald entries from stdin\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(26));
@@ -1140,6 +1812,7 @@ int main(int argc, char **argv)
 		{ "version",	   no_argument,	      0, 'V'		   },
 		{ "help",	   no_argument,	      0, 'h'		   },
 		{ "octet-count",   no_argument,	      0, OPT_OCTET_COUNT   },
+		{ "batch",	   no_argument,	      0, OPT_BATCH	   },
 		{ "prio-prefix",   no_argument,	      0, OPT_PRIO_PREFIX   },
 		{ "rfc3164",	   no_argument,	      0, OPT_RFC3164	   },
 		{ "rfc5424",	   optional_argument, 0, OPT_RFC5424	   },
@@ -1151,6 +1824,7 @@ int main(int argc, char **argv)
 #ifdef HAVE_LIBSYSTEMD
 		{ "journald",	   optional_argument, 0, OPT_JOURNALD	   },
 #endif
+		{ "journald-stream", no_argument,     0, OPT_JOURNALD_STREAM },
 		{ NULL,		   0,		      0, 0		   }
 	};
 
@@ -1220,6 +1894,12 @@ int main(int argc, char **argv)
 		case OPT_PRIO_PREFIX:
 			ctl.prio_prefix = 1;
 			break;
+		case OPT_BATCH:
+			ctl.batch = 1;
+			break;
+		case OPT_JOURNALD_STREAM:
+			ctl.journald_stream = 1;
+			break;
 		case OPT_RFC3164:
 			ctl.syslogfp = syslog_rfc3164_header;
 			break;
@@ -1284,6 +1964,11 @@ int main(int argc, char **argv)
 	}
 #endif
 
+	if (ctl.journald_stream) {
+		logger_journald_stream(&ctl);
+		return EXIT_SUCCESS;
+	}
+
 	/* user overwrites built-in SD-ELEMENT */
 	if (has_structured_data_id(get_user_structured_data(&ctl), "timeQuality"))
 		ctl.rfc5424_tq = 0;
@@ -1307,6 +1992,8 @@ int main(int argc, char **argv)
 	logger_open(&ctl);
 	if (0 < argc)
 		logger_command_line(&ctl, argv);
+	else if (ctl.batch)
+		logger_stdin_batch(&ctl);
 	else
 		/* Note. --file <arg> reopens stdin making the below
 		 * function to be used for file inputs. */
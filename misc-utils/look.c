@@ -53,9 +53,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
 #include <getopt.h>
+#include <unistd.h>
 
 #include "nls.h"
 #include "xalloc.h"
@@ -72,6 +74,10 @@ static int dflag, fflag;
 static int stringlen;
 static char *string;
 static char *comparbuf;
+static size_t pagesize;
+
+/* the probes of the binary search are prefetched only in larger ranges */
+#define PREFETCH_MIN	(64 * 1024)
 
 static char *binary_search (char *, char *);
 static int compare (char *, char *);
@@ -165,6 +171,13 @@ main(int argc, char *argv[])
 #endif
 			err(EXIT_FAILURE, "%s", file);
 	back = front + sb.st_size;
+
+	/* the binary search touches only a few pages of the file */
+	pagesize = getpagesize();
+#ifdef MADV_RANDOM
+	if (sb.st_size)
+		ignore_result( madvise(front, sb.st_size, MADV_RANDOM) );
+#endif
 	return look(front, back);
 }
 
@@ -234,7 +247,39 @@ look(char *front, char *back)
  *	more trouble than it's worth.
  */
 #define	SKIP_PAST_NEWLINE(p, back) \
-	while (p < back && *p++ != '\n')
+	(p = skip_past_newline(p, back))
+
+static inline char *
+skip_past_newline(char *p, char *back)
+{
+	char *nl;
+
+	if (p >= back)
+		return p;
+	nl = memchr(p, '\n', back - p);
+	return nl ? nl + 1 : back;
+}
+
+/*
+ * Asynchronously read the pages of both possible next probes, one of
+ * them is touched by the next iteration.
+ */
+static void
+prefetch_probes(char *front, char *p, char *back)
+{
+#ifdef MADV_WILLNEED
+	char *probes[2] = { front + (p - front) / 2, p + (back - p) / 2 };
+	size_t i;
+
+	if (back - front < PREFETCH_MIN)
+		return;
+	for (i = 0; i < ARRAY_SIZE(probes); i++) {
+		char *pg = (char *) ((uintptr_t) probes[i] & ~(uintptr_t) (pagesize - 1));
+
+		ignore_result( madvise(pg, pagesize, MADV_WILLNEED) );
+	}
+#endif
+}
 
 static char *
 binary_search(char *front, char *back)
@@ -249,6 +294,7 @@ binary_search(char *front, char *back)
 	 * infinitely loop.
 	 */
 	while (p < back && back > front) {
+		prefetch_probes(front, p, back);
 		if (compare(p, back) == GREATER)
 			front = p;
 		else
@@ -293,19 +339,21 @@ linear_search(char *front, char *back)
 static void
 print_from(char *front, char *back)
 {
-	int eol;
+	char *eol;
+
+#ifdef MADV_SEQUENTIAL
+	/* the matching lines are read sequentially */
+	if (front < back) {
+		char *pg = (char *) ((uintptr_t) front & ~(uintptr_t) (pagesize - 1));
 
+		ignore_result( madvise(pg, back - pg, MADV_SEQUENTIAL) );
+	}
+#endif
 	while (front < back && compare(front, back) == EQUAL) {
-		if (compare(front, back) == EQUAL) {
-			eol = 0;
-			while (front < back && !eol) {
-				if (putchar(*front) == EOF)
-					err(EXIT_FAILURE, "stdout");
-				if (*front++ == '\n')
-					eol = 1;
-			}
-		} else
-			SKIP_PAST_NEWLINE(front, back);
+		eol = skip_past_newline(front, back);
+		if (fwrite(front, 1, eol - front, stdout) != (size_t) (eol - front))
+			err(EXIT_FAILURE, "stdout");
+		front = eol;
 	}
 }
 
@@ -330,11 +378,33 @@ compare(char *s2, char *s2end) {
 	int i;
 	char *p;
 
+	if (!dflag) {
+		/* no transformation, the line is only cut at newline */
+		size_t len = min((size_t) (s2end - s2), (size_t) stringlen);
+
+		p = memchr(s2, '\n', len);
+		if (p)
+			len = p - s2;
+
+		if (fflag) {
+			memcpy(comparbuf, s2, len);
+			comparbuf[len] = '\0';
+			i = strncasecmp(comparbuf, string, stringlen);
+		} else {
+			/* memcmp() stops on the first difference as strncmp(),
+			 * and the shorter line is before the string */
+			i = memcmp(s2, string, len);
+			if (i == 0 && len < (size_t) stringlen)
+				i = -1;
+		}
+		return ((i > 0) ? LESS : (i < 0) ? GREATER : EQUAL);
+	}
+
 	/* copy, ignoring things that should be ignored */
 	p = comparbuf;
 	i = stringlen;
 	while(s2 < s2end && *s2 != '\n' && i) {
-		if (!dflag || isalnum(*s2) || isblank(*s2))
+		if (isalnum(*s2) || isblank(*s2))
 		{
 			*p++ = *s2;
 			i--;
@@ -14,11 +14,17 @@
  * dependence is reference by ls_childs from parent device and by ls_parents
  * from child. (Yes, "childs" is used for children ;-)
  *
+ * All devices in devtree->devices are also indexed by name and by device
+ * number in two hash tables, the devices are linked by dev->name_next and
+ * dev->devno_next in the hash buckets.
+ *
  * Copyright (C) 2018 Karel Zak <kzak@redhat.com>
  */
 #include "lsblk.h"
 #include "sysfs.h"
 
+#define DEVTREE_HASHSZ_MIN	64
+
 
 void lsblk_reset_iter(struct lsblk_iter *itr, int direction)
 {
@@ -268,15 +274,89 @@ void lsblk_unref_devtree(struct lsblk_devtree *tr)
 						struct lsblk_device, ls_devices);
 			lsblk_devtree_remove_device(tr, dev);
 		}
+		free(tr->name_hash);
+		free(tr->devno_hash);
 		free(tr);
 	}
 }
 
+static inline dev_t device_get_devno(struct lsblk_device *dev)
+{
+	return makedev(dev->maj, dev->min);
+}
+
+static void devtree_hash_link(struct lsblk_devtree *tr, struct lsblk_device *dev)
+{
+	size_t n = lsblk_hash_string(dev->name) & (tr->hashsz - 1),
+	       d = lsblk_hash_devno(device_get_devno(dev)) & (tr->hashsz - 1);
+
+	dev->name_next = tr->name_hash[n];
+	tr->name_hash[n] = dev;
+
+	dev->devno_next = tr->devno_hash[d];
+	tr->devno_hash[d] = dev;
+}
+
+/* keeps the old tables on allocation error, the lookups are only slower */
+static void devtree_hash_grow(struct lsblk_devtree *tr)
+{
+	struct lsblk_device **names, **devnos;
+	struct lsblk_device *dev = NULL;
+	struct lsblk_iter itr;
+	size_t sz = tr->hashsz ? tr->hashsz * 2 : DEVTREE_HASHSZ_MIN;
+
+	names = calloc(sz, sizeof(struct lsblk_device *));
+	devnos = calloc(sz, sizeof(struct lsblk_device *));
+	if (!names || !devnos) {
+		free(names);
+		free(devnos);
+		return;
+	}
+
+	DBG(TREE, ul_debugobj(tr, "resize hash to %zu", sz));
+
+	free(tr->name_hash);
+	free(tr->devno_hash);
+	tr->name_hash = names;
+	tr->devno_hash = devnos;
+	tr->hashsz = sz;
+
+	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
+	while (lsblk_devtree_next_device(tr, &itr, &dev) == 0)
+		devtree_hash_link(tr, dev);
+}
+
+static void devtree_hash_unlink(struct lsblk_devtree *tr, struct lsblk_device *dev)
+{
+	struct lsblk_device **p;
+
+	p = &tr->name_hash[lsblk_hash_string(dev->name) & (tr->hashsz - 1)];
+	for (; *p; p = &(*p)->name_next) {
+		if (*p == dev) {
+			*p = dev->name_next;
+			break;
+		}
+	}
+
+	p = &tr->devno_hash[lsblk_hash_devno(device_get_devno(dev)) & (tr->hashsz - 1)];
+	for (; *p; p = &(*p)->devno_next) {
+		if (*p == dev) {
+			*p = dev->devno_next;
+			break;
+		}
+	}
+	dev->name_next = dev->devno_next = NULL;
+}
+
 int lsblk_devtree_add_root(struct lsblk_devtree *tr, struct lsblk_device *dev)
 {
 	if (!lsblk_devtree_has_device(tr, dev))
 		lsblk_devtree_add_device(tr, dev);
 
+	/* already a root, for example "lsblk /dev/sda /dev/sda" */
+	if (!list_empty(&dev->ls_roots))
+		return 0;
+
 	/* We don't increment reference counter for tr->roots list. The primary
 	 * reference is tr->devices */
 
@@ -309,6 +389,12 @@ int lsblk_devtree_add_device(struct lsblk_devtree *tr, struct lsblk_device *dev)
 
         DBG(TREE, ul_debugobj(tr, "add device 0x%p [%s]", dev, dev->name));
         list_add_tail(&dev->ls_devices, &tr->devices);
+	tr->ndevices++;
+
+	if (tr->ndevices > tr->hashsz)
+		devtree_hash_grow(tr);		/* links all devices */
+	else
+		devtree_hash_link(tr, dev);
 	return 0;
 }
 
@@ -332,12 +418,13 @@ int lsblk_devtree_next_device(struct lsblk_devtree *tr,
 
 int lsblk_devtree_has_device(struct lsblk_devtree *tr, struct lsblk_device *dev)
 {
-	struct lsblk_device *x = NULL;
-	struct lsblk_iter itr;
+	struct lsblk_device *x;
 
-	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
+	if (!tr->hashsz)
+		return 0;
 
-	while (lsblk_devtree_next_device(tr, &itr, &x) == 0) {
+	x = tr->devno_hash[lsblk_hash_devno(device_get_devno(dev)) & (tr->hashsz - 1)];
+	for (; x; x = x->devno_next) {
 		if (x == dev)
 			return 1;
 	}
@@ -347,12 +434,13 @@ int lsblk_devtree_has_device(struct lsblk_devtree *tr, struct lsblk_device *dev)
 
 struct lsblk_device *lsblk_devtree_get_device(struct lsblk_devtree *tr, const char *name)
 {
-	struct lsblk_device *dev = NULL;
-	struct lsblk_iter itr;
+	struct lsblk_device *dev;
 
-	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
+	if (!tr->hashsz)
+		return NULL;
 
-	while (lsblk_devtree_next_device(tr, &itr, &dev) == 0) {
+	dev = tr->name_hash[lsblk_hash_string(name) & (tr->hashsz - 1)];
+	for (; dev; dev = dev->name_next) {
 		if (strcmp(name, dev->name) == 0)
 			return dev;
 	}
@@ -360,6 +448,22 @@ struct lsblk_device *lsblk_devtree_get_device(struct lsblk_devtree *tr, const ch
 	return NULL;
 }
 
+struct lsblk_device *lsblk_devtree_get_device_by_devno(struct lsblk_devtree *tr, dev_t devno)
+{
+	struct lsblk_device *dev;
+
+	if (!tr->hashsz)
+		return NULL;
+
+	dev = tr->devno_hash[lsblk_hash_devno(devno) & (tr->hashsz - 1)];
+	for (; dev; dev = dev->devno_next) {
+		if (device_get_devno(dev) == devno)
+			return dev;
+	}
+
+	return NULL;
+}
+
 int lsblk_devtree_remove_device(struct lsblk_devtree *tr, struct lsblk_device *dev)
 {
         DBG(TREE, ul_debugobj(tr, "remove device 0x%p [%s]", dev, dev->name));
@@ -367,6 +471,9 @@ int lsblk_devtree_remove_device(struct lsblk_devtree *tr, struct lsblk_device *d
 	if (!lsblk_devtree_has_device(tr, dev))
 		return 1;
 
+	devtree_hash_unlink(tr, dev);
+	tr->ndevices--;
+
 	list_del_init(&dev->ls_roots);
 	list_del_init(&dev->ls_devices);
 	lsblk_unref_device(dev);
@@ -393,9 +500,58 @@ static int device_dedupkey_is_equal(
 	return 0;
 }
 
+/*
+ * De-duplication patterns; the first device (in devno order) for each key
+ */
+struct dedup_pattern {
+	struct lsblk_device	*dev;
+	struct dedup_pattern	*next;		/* in the hash bucket */
+};
+
+struct dedup_patterns {
+	struct dedup_pattern	**hash;
+	struct dedup_pattern	*pool;
+	size_t			hashsz;
+	size_t			npatterns;
+};
+
+static struct lsblk_device *dedup_get_pattern(struct dedup_patterns *pt, const char *key)
+{
+	struct dedup_pattern *p;
+
+	if (!key)
+		return NULL;
+
+	p = pt->hash[lsblk_hash_string(key) & (pt->hashsz - 1)];
+	for (; p; p = p->next) {
+		if (strcmp(p->dev->dedupkey, key) == 0)
+			return p->dev;
+	}
+	return NULL;
+}
+
+static void dedup_add_pattern(struct dedup_patterns *pt, struct lsblk_device *dev)
+{
+	struct dedup_pattern *p = &pt->pool[pt->npatterns++];
+	size_t i = lsblk_hash_string(dev->dedupkey) & (pt->hashsz - 1);
+
+	DBG(TREE, ul_debug("de-duplicate by key: %s", dev->dedupkey));
+
+	p->dev = dev;
+	p->next = pt->hash[i];
+	pt->hash[i] = p;
+}
+
+static int device_is_duplicate(struct dedup_patterns *pt, struct lsblk_device *dev)
+{
+	struct lsblk_device *pattern = dedup_get_pattern(pt, dev->dedupkey);
+
+	return pattern && device_dedupkey_is_equal(dev, pattern);
+}
+
 static void device_dedup_dependencies(
-			struct lsblk_device *dev,
-			struct lsblk_device *pattern)
+			struct dedup_patterns *pt,
+			struct lsblk_device *dev)
 {
 	struct lsblk_iter itr;
 	struct lsblk_devdep *dp;
@@ -405,33 +561,31 @@ static void device_dedup_dependencies(
 	while (device_next_child(dev, &itr, &dp) == 0) {
 		struct lsblk_device *child = dp->child;
 
-		if (device_dedupkey_is_equal(child, pattern)) {
+		if (device_is_duplicate(pt, child)) {
 			DBG(DEV, ul_debugobj(dev, "remove duplicate dependence: 0x%p [%s]",
 						dp->child, dp->child->name));
 			remove_dependence(dp);
 		} else
-			device_dedup_dependencies(child, pattern);
+			device_dedup_dependencies(pt, child);
 	}
 }
 
-static void devtree_dedup(struct lsblk_devtree *tr, struct lsblk_device *pattern)
+static void devtree_dedup(struct lsblk_devtree *tr, struct dedup_patterns *pt)
 {
 	struct lsblk_iter itr;
 	struct lsblk_device *dev = NULL;
 
 	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
 
-	DBG(TREE, ul_debugobj(tr, "de-duplicate by key: %s", pattern->dedupkey));
-
 	while (lsblk_devtree_next_root(tr, &itr, &dev) == 0) {
-		if (device_dedupkey_is_equal(dev, pattern)) {
+		if (device_is_duplicate(pt, dev)) {
 			DBG(TREE, ul_debugobj(tr, "remove duplicate device: 0x%p [%s]",
 						dev, dev->name));
 			/* Note that root list does not use ref-counting; the
 			 * primary reference is ls_devices */
 			list_del_init(&dev->ls_roots);
 		} else
-			device_dedup_dependencies(dev, pattern);
+			device_dedup_dependencies(pt, dev);
 	}
 }
 
@@ -448,9 +602,20 @@ static int cmp_devices_devno(struct list_head *a, struct list_head *b,
 /* Note that dev->dedupkey has to be already set */
 int lsblk_devtree_deduplicate_devices(struct lsblk_devtree *tr)
 {
+	struct dedup_patterns pt = { .hashsz = DEVTREE_HASHSZ_MIN };
 	struct lsblk_device *pattern = NULL;
 	struct lsblk_iter itr;
-	char *last = NULL;
+
+	while (pt.hashsz < tr->ndevices)
+		pt.hashsz <<= 1;
+
+	pt.hash = calloc(pt.hashsz, sizeof(struct dedup_pattern *));
+	pt.pool = calloc(tr->ndevices ? tr->ndevices : 1, sizeof(struct dedup_pattern));
+	if (!pt.hash || !pt.pool) {
+		free(pt.hash);
+		free(pt.pool);
+		return -ENOMEM;
+	}
 
 	list_sort(&tr->devices, cmp_devices_devno, NULL);
 	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
@@ -462,11 +627,16 @@ int lsblk_devtree_deduplicate_devices(struct lsblk_devtree *tr)
 		    pattern->wholedisk->dedupkey &&
 		    strcmp(pattern->dedupkey, pattern->wholedisk->dedupkey) == 0)
 			continue;
-		if (last && strcmp(pattern->dedupkey, last) == 0)
+		if (dedup_get_pattern(&pt, pattern->dedupkey))
 			continue;
 
-		devtree_dedup(tr, pattern);
-		last = pattern->dedupkey;
+		dedup_add_pattern(&pt, pattern);
 	}
+
+	if (pt.npatterns)
+		devtree_dedup(tr, &pt);
+
+	free(pt.hash);
+	free(pt.pool);
 	return 0;
 }
@@ -18,68 +18,210 @@ static int table_parser_errcb(struct libmnt_table *tb __attribute__((__unused__)
 	return 1;
 }
 
-static int is_active_swap(const char *filename)
+/*
+ * All mount and swap entries are indexed by devno and by source path when
+ * the first mountpoint is requested, so the lookup for a device does not
+ * depend on number of the mounted filesystems. The hash chains are in the
+ * reverse order of the tables, so the last mount is found first.
+ */
+struct mnt_entry {
+	struct libmnt_fs	*fs;
+	dev_t			devno;		/* from mountinfo or stat() for swaps */
+	const char		*srcpath;	/* canonicalized source or NULL */
+
+	struct mnt_entry	*devno_next;
+	struct mnt_entry	*path_next;
+
+	unsigned int		is_swap : 1;
+};
+
+static struct mnt_entry *entries;
+static struct mnt_entry **devno_hash, **path_hash;
+static size_t nentries, hashsz;
+
+static struct libmnt_table *parse_table(const char *sysroot_path, int is_swaps)
 {
-	if (!swaps) {
-		swaps = mnt_new_table();
-		if (!swaps)
-			return 0;
-		if (!mntcache)
-			mntcache = mnt_new_cache();
-
-		mnt_table_set_parser_errcb(swaps, table_parser_errcb);
-		mnt_table_set_cache(swaps, mntcache);
-
-		if (!lsblk->sysroot)
-			mnt_table_parse_swaps(swaps, NULL);
-		else {
-			char buf[PATH_MAX];
-			snprintf(buf, sizeof(buf), "%s" _PATH_PROC_SWAPS, lsblk->sysroot);
-			mnt_table_parse_swaps(swaps, buf);
-		}
+	struct libmnt_table *tb = mnt_new_table();
+
+	if (!tb)
+		return NULL;
+	if (!mntcache)
+		mntcache = mnt_new_cache();
+
+	mnt_table_set_parser_errcb(tb, table_parser_errcb);
+	mnt_table_set_cache(tb, mntcache);
+
+	if (!lsblk->sysroot) {
+		if (is_swaps)
+			mnt_table_parse_swaps(tb, NULL);
+		else
+			mnt_table_parse_mtab(tb, NULL);
+	} else {
+		char buf[PATH_MAX];
+
+		snprintf(buf, sizeof(buf), "%s%s", lsblk->sysroot, sysroot_path);
+		if (is_swaps)
+			mnt_table_parse_swaps(tb, buf);
+		else
+			mnt_table_parse_mtab(tb, buf);
 	}
+	return tb;
+}
+
+static const char *canonical_path(const char *path)
+{
+	const char *cn;
 
-	return mnt_table_find_srcpath(swaps, filename, MNT_ITER_BACKWARD) != NULL;
+	if (!path || *path != '/')
+		return NULL;
+	cn = mnt_resolve_path(path, mntcache);
+	return cn ? cn : path;
 }
 
-char *lsblk_device_get_mountpoint(struct lsblk_device *dev)
+static void add_entries(struct libmnt_table *tb, int is_swap)
 {
+	struct libmnt_iter *itr;
 	struct libmnt_fs *fs;
-	const char *fsroot;
 
-	assert(dev);
-	assert(dev->filename);
+	if (!tb)
+		return;
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr)
+		return;
 
-	if (dev->is_mounted || dev->is_swap)
-		return dev->mountpoint;
+	while (mnt_table_next_fs(tb, itr, &fs) == 0) {
+		struct mnt_entry *e = &entries[nentries++];
+		size_t i;
+
+		e->fs = fs;
+		e->is_swap = is_swap;
+		e->srcpath = canonical_path(mnt_fs_get_srcpath(fs));
 
-	if (!mtab) {
-		mtab = mnt_new_table();
-		if (!mtab)
-			return NULL;
-		if (!mntcache)
-			mntcache = mnt_new_cache();
-
-		mnt_table_set_parser_errcb(mtab, table_parser_errcb);
-		mnt_table_set_cache(mtab, mntcache);
-
-		if (!lsblk->sysroot)
-			mnt_table_parse_mtab(mtab, NULL);
-		else {
-			char buf[PATH_MAX];
-			snprintf(buf, sizeof(buf), "%s" _PATH_PROC_MOUNTINFO, lsblk->sysroot);
-			mnt_table_parse_mtab(mtab, buf);
+		if (!is_swap)
+			e->devno = mnt_fs_get_devno(fs);
+		else if (!lsblk->sysroot && e->srcpath) {
+			struct stat st;
+
+			if (stat(e->srcpath, &st) == 0 && S_ISBLK(st.st_mode))
+				e->devno = st.st_rdev;
+		}
+
+		if (e->devno) {
+			i = lsblk_hash_devno(e->devno) & (hashsz - 1);
+			e->devno_next = devno_hash[i];
+			devno_hash[i] = e;
+		}
+		if (e->srcpath) {
+			i = lsblk_hash_string(e->srcpath) & (hashsz - 1);
+			e->path_next = path_hash[i];
+			path_hash[i] = e;
 		}
 	}
+	mnt_free_iter(itr);
+}
+
+static int build_index(void)
+{
+	size_t n;
+
+	if (entries)
+		return 0;
+
+	mtab = parse_table(_PATH_PROC_MOUNTINFO, 0);
+	swaps = parse_table(_PATH_PROC_SWAPS, 1);
+
+	n = (mtab ? mnt_table_get_nents(mtab) : 0)
+	  + (swaps ? mnt_table_get_nents(swaps) : 0);
+
+	for (hashsz = 64; hashsz < n; hashsz <<= 1);
+
+	entries = xcalloc(n ? n : 1, sizeof(struct mnt_entry));
+	devno_hash = xcalloc(hashsz, sizeof(struct mnt_entry *));
+	path_hash = xcalloc(hashsz, sizeof(struct mnt_entry *));
+
+	add_entries(mtab, 0);
+	add_entries(swaps, 1);
+
+	DBG(DEV, ul_debug("indexed %zu mount and swap entries", nentries));
+	return 0;
+}
+
+static inline int is_fsroot(struct mnt_entry *e)
+{
+	const char *root = mnt_fs_get_root(e->fs);
+
+	return !root || strcmp(root, "/") == 0;
+}
+
+/* returns the last entry for the device in the table order */
+static struct mnt_entry *find_entry(dev_t devno, const char *path, int is_swap)
+{
+	struct mnt_entry *e;
 
 	/* Note that maj:min in /proc/self/mountinfo does not have to match with
 	 * devno as returned by stat(), so we have to try devname too
 	 */
-	fs = mnt_table_find_devno(mtab, makedev(dev->maj, dev->min), MNT_ITER_BACKWARD);
-	if (!fs)
-		fs = mnt_table_find_srcpath(mtab, dev->filename, MNT_ITER_BACKWARD);
-	if (!fs) {
-		if (is_active_swap(dev->filename)) {
+	for (e = devno_hash[lsblk_hash_devno(devno) & (hashsz - 1)]; e; e = e->devno_next) {
+		if (e->devno == devno && e->is_swap == is_swap)
+			return e;
+	}
+	if (!path)
+		return NULL;
+	for (e = path_hash[lsblk_hash_string(path) & (hashsz - 1)]; e; e = e->path_next) {
+		if (strcmp(e->srcpath, path) == 0 && e->is_swap == is_swap)
+			return e;
+	}
+	return NULL;
+}
+
+/*
+ * We found bind mount or btrfs subvolume, let's try to get real FS root
+ * mountpoint; it's the last entry for the same device mounted before @e.
+ */
+static struct mnt_entry *find_fsroot_entry(struct mnt_entry *e, dev_t devno, const char *path)
+{
+	struct mnt_entry *x, *best = NULL;
+
+	/* entries[] is in the table order */
+	for (x = devno_hash[lsblk_hash_devno(devno) & (hashsz - 1)]; x; x = x->devno_next) {
+		if (x < e && !x->is_swap && x->devno == devno && is_fsroot(x)) {
+			best = x;
+			break;
+		}
+	}
+	if (path) {
+		for (x = path_hash[lsblk_hash_string(path) & (hashsz - 1)]; x; x = x->path_next) {
+			if (x < e && !x->is_swap && strcmp(x->srcpath, path) == 0
+			    && is_fsroot(x)) {
+				if (!best || x > best)
+					best = x;
+				break;
+			}
+		}
+	}
+	return best ? best : e;
+}
+
+char *lsblk_device_get_mountpoint(struct lsblk_device *dev)
+{
+	struct mnt_entry *e;
+	const char *path;
+	dev_t devno;
+
+	assert(dev);
+	assert(dev->filename);
+
+	if (dev->is_mounted || dev->is_swap)
+		return dev->mountpoint;
+
+	build_index();
+
+	devno = makedev(dev->maj, dev->min);
+	path = canonical_path(dev->filename);
+
+	e = find_entry(devno, path, 0);
+	if (!e) {
+		if (find_entry(devno, path, 1)) {
 			dev->mountpoint = xstrdup("[SWAP]");
 			dev->is_swap = 1;
 		} else
@@ -89,27 +231,11 @@ char *lsblk_device_get_mountpoint(struct lsblk_device *dev)
 	}
 
 	/* found */
-	fsroot = mnt_fs_get_root(fs);
-	if (fsroot && strcmp(fsroot, "/") != 0) {
-		/* hmm.. we found bind mount or btrfs subvolume, let's try to
-		 * get real FS root mountpoint */
-		struct libmnt_fs *rfs;
-		struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_BACKWARD);
-
-		mnt_table_set_iter(mtab, itr, fs);
-		while (mnt_table_next_fs(mtab, itr, &rfs) == 0) {
-			fsroot = mnt_fs_get_root(rfs);
-			if ((!fsroot || strcmp(fsroot, "/") == 0)
-			    && mnt_fs_match_source(rfs, dev->filename, mntcache)) {
-				fs = rfs;
-				break;
-			}
-		}
-		mnt_free_iter(itr);
-	}
+	if (!is_fsroot(e))
+		e = find_fsroot_entry(e, devno, path);
 
-	DBG(DEV, ul_debugobj(dev, "mountpoint: %s", mnt_fs_get_target(fs)));
-	dev->mountpoint = xstrdup(mnt_fs_get_target(fs));
+	DBG(DEV, ul_debugobj(dev, "mountpoint: %s", mnt_fs_get_target(e->fs)));
+	dev->mountpoint = xstrdup(mnt_fs_get_target(e->fs));
 	dev->is_mounted = 1;
 	return dev->mountpoint;
 }
@@ -121,7 +247,16 @@ void lsblk_mnt_init(void)
 
 void lsblk_mnt_deinit(void)
 {
+	free(entries);
+	free(devno_hash);
+	free(path_hash);
+	entries = NULL;
+	devno_hash = path_hash = NULL;
+	nentries = hashsz = 0;
+
 	mnt_unref_table(mtab);
 	mnt_unref_table(swaps);
 	mnt_unref_cache(mntcache);
+	mtab = swaps = NULL;
+	mntcache = NULL;
 }
@@ -1,5 +1,7 @@
 
 #include <blkid.h>
+#include <pthread.h>
+#include <sys/time.h>
 
 #ifdef HAVE_LIBUDEV
 # include <libudev.h>
@@ -10,6 +12,7 @@
 #include "mangle.h"
 #include "path.h"
 #include "nls.h"
+#include "monotonic.h"
 
 #include "lsblk.h"
 
@@ -50,26 +53,18 @@ static struct lsblk_devprop *get_properties_by_udev(struct lsblk_device *dev
 	return NULL;
 }
 #else
-static struct lsblk_devprop *get_properties_by_udev(struct lsblk_device *ld)
+/* returns new properties or NULL if udev does not know the device */
+static struct lsblk_devprop *read_properties_by_udev(struct udev *udev,
+						     const char *name)
 {
 	struct udev_device *dev;
+	struct lsblk_devprop *prop = NULL;
 
-	if (ld->udev_requested)
-		return ld->properties;
-
-	if (!udev)
-		udev = udev_new();	/* global handler */
-	if (!udev)
-		goto done;
-
-	dev = udev_device_new_from_subsystem_sysname(udev, "block", ld->name);
+	dev = udev_device_new_from_subsystem_sysname(udev, "block", name);
 	if (dev) {
 		const char *data;
-		struct lsblk_devprop *prop;
 
-		if (ld->properties)
-			lsblk_device_free_properties(ld->properties);
-		prop = ld->properties = xcalloc(1, sizeof(*ld->properties));
+		prop = xcalloc(1, sizeof(*prop));
 
 		if ((data = udev_device_get_property_value(dev, "ID_FS_LABEL_ENC"))) {
 			prop->label = xstrdup(data);
@@ -114,6 +109,27 @@ static struct lsblk_devprop *get_properties_by_udev(struct lsblk_device *ld)
 			prop->model = xstrdup(data);
 
 		udev_device_unref(dev);
+	}
+
+	return prop;
+}
+
+static struct lsblk_devprop *get_properties_by_udev(struct lsblk_device *ld)
+{
+	struct lsblk_devprop *prop;
+
+	if (ld->udev_requested)
+		return ld->properties;
+
+	if (!udev)
+		udev = udev_new();	/* global handler */
+	if (!udev)
+		goto done;
+
+	prop = read_properties_by_udev(udev, ld->name);
+	if (prop) {
+		lsblk_device_free_properties(ld->properties);
+		ld->properties = prop;
 		DBG(DEV, ul_debugobj(ld, "%s: found udev properties", ld->name));
 	}
 
@@ -155,9 +171,9 @@ static int lookup(char *buf, char *pattern, char **value)
 }
 
 /* read device properties from fake text file (used on --sysroot) */
-static struct lsblk_devprop *get_properties_by_file(struct lsblk_device *ld)
+static struct lsblk_devprop *read_properties_by_file(const char *filename)
 {
-	struct lsblk_devprop *prop;
+	struct lsblk_devprop *prop = NULL;
 	struct path_cxt *pc;
 	FILE *fp = NULL;
 	struct stat sb;
@@ -165,29 +181,22 @@ static struct lsblk_devprop *get_properties_by_file(struct lsblk_device *ld)
 
 	assert(lsblk->sysroot);
 
-	if (ld->file_requested)
-		return ld->properties;
-
-	if (ld->properties || ld->filename) {
-		lsblk_device_free_properties(ld->properties);
-		ld->properties = NULL;
-	}
+	if (!filename)
+		return NULL;
 
 	pc = ul_new_path("/");
 	if (!pc)
 		return NULL;
 	if (ul_path_set_prefix(pc, lsblk->sysroot) != 0)
 		goto done;
-	if (ul_path_stat(pc, &sb, ld->filename) != 0 || !S_ISREG(sb.st_mode))
+	if (ul_path_stat(pc, &sb, filename) != 0 || !S_ISREG(sb.st_mode))
 		goto done;
 
-	fp = ul_path_fopen(pc, "r", ld->filename);
+	fp = ul_path_fopen(pc, "r", filename);
 	if (!fp)
 		goto done;
 
-	prop = ld->properties;
-	if (!prop)
-		prop = ld->properties = xcalloc(1, sizeof(*ld->properties));
+	prop = xcalloc(1, sizeof(*prop));
 
 	while (fgets(buf, sizeof(buf), fp) != NULL) {
 		/* udev based */
@@ -222,6 +231,16 @@ done:
 	if (fp)
 		fclose(fp);
 	ul_unref_path(pc);
+	return prop;
+}
+
+static struct lsblk_devprop *get_properties_by_file(struct lsblk_device *ld)
+{
+	if (ld->file_requested)
+		return ld->properties;
+
+	lsblk_device_free_properties(ld->properties);
+	ld->properties = read_properties_by_file(ld->filename);
 	ld->file_requested = 1;
 
 	DBG(DEV, ul_debugobj(ld, " from fake-file"));
@@ -229,21 +248,21 @@ done:
 }
 
 
-static struct lsblk_devprop *get_properties_by_blkid(struct lsblk_device *dev)
+/* returns new properties or NULL if nothing has been detected */
+static struct lsblk_devprop *read_properties_by_blkid(const char *filename,
+						      uint64_t size)
 {
+	struct lsblk_devprop *prop = NULL;
 	blkid_probe pr = NULL;
 
-	if (dev->blkid_requested)
-		return dev->properties;
-
-	if (!dev->size)
-		goto done;
+	if (!size || !filename)
+		return NULL;
 	if (getuid() != 0)
-		goto done;;				/* no permissions to read from the device */
+		return NULL;			/* no permissions to read from the device */
 
-	pr = blkid_new_probe_from_filename(dev->filename);
+	pr = blkid_new_probe_from_filename(filename);
 	if (!pr)
-		goto done;
+		return NULL;
 
 	blkid_probe_enable_superblocks(pr, 1);
 	blkid_probe_set_superblocks_flags(pr, BLKID_SUBLKS_LABEL |
@@ -254,11 +273,8 @@ static struct lsblk_devprop *get_properties_by_blkid(struct lsblk_device *dev)
 
 	if (!blkid_do_safeprobe(pr)) {
 		const char *data = NULL;
-		struct lsblk_devprop *prop;
 
-		if (dev->properties)
-			lsblk_device_free_properties(dev->properties);
-		prop = dev->properties = xcalloc(1, sizeof(*dev->properties));
+		prop = xcalloc(1, sizeof(*prop));
 
 		if (!blkid_probe_lookup_value(pr, "TYPE", &data, NULL))
 			prop->fstype = xstrdup(data);
@@ -280,12 +296,25 @@ static struct lsblk_devprop *get_properties_by_blkid(struct lsblk_device *dev)
 			prop->partlabel = xstrdup(data);
 		if (!blkid_probe_lookup_value(pr, "PART_ENTRY_FLAGS", &data, NULL))
 			prop->partflags = xstrdup(data);
-
-		DBG(DEV, ul_debugobj(dev, "%s: found blkid properties", dev->name));
 	}
 
-done:
 	blkid_free_probe(pr);
+	return prop;
+}
+
+static struct lsblk_devprop *get_properties_by_blkid(struct lsblk_device *dev)
+{
+	struct lsblk_devprop *prop;
+
+	if (dev->blkid_requested)
+		return dev->properties;
+
+	prop = read_properties_by_blkid(dev->filename, dev->size);
+	if (prop) {
+		lsblk_device_free_properties(dev->properties);
+		dev->properties = prop;
+		DBG(DEV, ul_debugobj(dev, "%s: found blkid properties", dev->name));
+	}
 
 	DBG(DEV, ul_debugobj(dev, " from blkid"));
 	dev->blkid_requested = 1;
@@ -306,6 +335,268 @@ struct lsblk_devprop *lsblk_device_get_properties(struct lsblk_device *dev)
 	return p;
 }
 
+/*
+ * Properties prefetch
+ *
+ * The udev and blkid queries are independent for each device, so they are
+ * executed by a pool of threads before the output table is generated. The
+ * workers don't touch the devices at all, every job has a private copy of the
+ * device names and the result is assigned to the device by the main thread.
+ * The output is generated by the main thread in the tree order as usual.
+ *
+ * A device may block the worker for a very long time (for example multipath
+ * map without paths and with queue_if_no_path). The job is marked as stuck if
+ * it's running longer than the timeout, the device is then printed without
+ * properties and the stuck worker is abandoned.
+ */
+enum {
+	PREFETCH_PENDING = 0,
+	PREFETCH_RUNNING,
+	PREFETCH_DONE,
+	PREFETCH_STUCK
+};
+
+struct prefetch_job {
+	struct lsblk_device	*dev;		/* used by main thread only */
+
+	char			*name;
+	char			*filename;
+	uint64_t		size;
+
+	struct lsblk_devprop	*prop;		/* result */
+	struct timeval		start;
+	int			status;		/* PREFETCH_* */
+};
+
+struct prefetch_pool {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+
+	struct prefetch_job	*jobs;
+	size_t			njobs;
+	size_t			next;		/* first pending job */
+	size_t			nfinished;	/* done or stuck jobs */
+
+	unsigned int		cancel : 1;	/* don't start more jobs */
+};
+
+/* properties already read (or reused by lsblk --watch) */
+static inline int has_properties(struct lsblk_device *dev)
+{
+	return dev->udev_requested || dev->blkid_requested || dev->file_requested;
+}
+
+static struct lsblk_devprop *read_properties(struct prefetch_job *job,
+					     void **udev_cxt)
+{
+	struct lsblk_devprop *prop = NULL;
+
+	if (lsblk->sysroot)
+		return read_properties_by_file(job->filename);
+
+#ifdef HAVE_LIBUDEV
+	/* libudev context must not be shared between threads */
+	if (!*udev_cxt)
+		*udev_cxt = udev_new();
+	if (*udev_cxt)
+		prop = read_properties_by_udev(*udev_cxt, job->name);
+#else
+	(void) udev_cxt;
+#endif
+	if (!prop)
+		prop = read_properties_by_blkid(job->filename, job->size);
+	return prop;
+}
+
+static void *prefetch_worker(void *data)
+{
+	struct prefetch_pool *pool = data;
+	void *udev_cxt = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->cancel && pool->next < pool->njobs) {
+		struct prefetch_job *job = &pool->jobs[pool->next++];
+		struct lsblk_devprop *prop;
+
+		job->status = PREFETCH_RUNNING;
+		gettime_monotonic(&job->start);
+		pthread_mutex_unlock(&pool->lock);
+
+		prop = read_properties(job, &udev_cxt);
+
+		pthread_mutex_lock(&pool->lock);
+		if (job->status == PREFETCH_STUCK) {
+			/* too late, the main thread has given up */
+			lsblk_device_free_properties(prop);
+			continue;
+		}
+		job->prop = prop;
+		job->status = PREFETCH_DONE;
+		pool->nfinished++;
+		pthread_cond_signal(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+#ifdef HAVE_LIBUDEV
+	udev_unref(udev_cxt);
+#endif
+	return NULL;
+}
+
+/* marks jobs running longer than @timeout as stuck, returns number of stuck jobs */
+static size_t prefetch_check_stuck(struct prefetch_pool *pool, unsigned int timeout)
+{
+	struct timeval now;
+	size_t i, nstuck = 0;
+
+	gettime_monotonic(&now);
+
+	for (i = 0; i < pool->next; i++) {
+		struct prefetch_job *job = &pool->jobs[i];
+
+		if (job->status == PREFETCH_RUNNING
+		    && now.tv_sec - job->start.tv_sec >= (time_t) timeout) {
+			DBG(DEV, ul_debug("%s: probing timed out", job->name));
+			job->status = PREFETCH_STUCK;
+			pool->nfinished++;
+		}
+		if (job->status == PREFETCH_STUCK)
+			nstuck++;
+	}
+	return nstuck;
+}
+
+/*
+ * Reads properties for all devices in the tree by @nthreads threads. The
+ * devices which are not answering within @timeout seconds are printed without
+ * properties. Returns number of the stuck devices.
+ */
+size_t lsblk_devtree_prefetch_properties(struct lsblk_devtree *tr,
+				size_t nthreads, unsigned int timeout)
+{
+	struct prefetch_pool *pool;
+	struct lsblk_iter itr;
+	struct lsblk_device *dev = NULL;
+	pthread_t *threads;
+	size_t i, n = 0, nrunning = 0, nstuck = 0;
+
+	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
+	while (lsblk_devtree_next_device(tr, &itr, &dev) == 0) {
+		if (!has_properties(dev))
+			n++;
+	}
+	if (n < 2 || nthreads < 2)
+		return 0;	/* nothing to do, properties are read on demand */
+	if (nthreads > n)
+		nthreads = n;
+
+	DBG(TREE, ul_debugobj(tr, "prefetch properties of %zu devices by %zu threads",
+				n, nthreads));
+
+	pool = xcalloc(1, sizeof(*pool));
+	pool->jobs = xcalloc(n, sizeof(struct prefetch_job));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+
+	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
+	while (lsblk_devtree_next_device(tr, &itr, &dev) == 0) {
+		struct prefetch_job *job;
+
+		if (has_properties(dev))
+			continue;
+		job = &pool->jobs[pool->njobs++];
+
+		job->dev = dev;
+		job->name = xstrdup(dev->name);
+		job->filename = dev->filename ? xstrdup(dev->filename) : NULL;
+		job->size = dev->size;
+	}
+
+	/* the library may initialize debug mask on the first use */
+	blkid_init_debug(0);
+
+	threads = xcalloc(nthreads, sizeof(pthread_t));
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, prefetch_worker, pool) != 0)
+			break;
+		nrunning++;
+	}
+	if (!nrunning) {
+		/* fallback to on demand reading */
+		free(threads);
+		goto done;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->nfinished < pool->njobs) {
+		struct timeval now;
+		struct timespec ts;
+
+		gettimeofday(&now, NULL);
+		ts.tv_sec = now.tv_sec + 1;
+		ts.tv_nsec = now.tv_usec * 1000;
+		pthread_cond_timedwait(&pool->cond, &pool->lock, &ts);
+
+		nstuck = prefetch_check_stuck(pool, timeout);
+		if (nstuck >= nrunning) {
+			/* all workers are blocked, the rest is read on demand */
+			pool->cancel = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < nrunning; i++) {
+		if (nstuck)
+			pthread_detach(threads[i]);
+		else
+			pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+done:
+	pthread_mutex_lock(&pool->lock);
+	pool->cancel = 1;
+
+	for (i = 0; i < pool->njobs; i++) {
+		struct prefetch_job *job = &pool->jobs[i];
+
+		dev = job->dev;
+		switch (job->status) {
+		case PREFETCH_DONE:
+			lsblk_device_free_properties(dev->properties);
+			dev->properties = job->prop;
+			job->prop = NULL;
+			dev->udev_requested = dev->blkid_requested = dev->file_requested = 1;
+			break;
+		case PREFETCH_STUCK:
+			warnx(_("%s: device does not respond, properties are not available"),
+					dev->filename ? dev->filename : dev->name);
+			dev->udev_requested = dev->blkid_requested = dev->file_requested = 1;
+			break;
+		default:
+			break;
+		}
+		if (job->status != PREFETCH_STUCK && job->status != PREFETCH_RUNNING) {
+			free(job->name);
+			free(job->filename);
+			job->name = job->filename = NULL;
+		}
+		job->dev = NULL;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (!nstuck) {
+		pthread_mutex_destroy(&pool->lock);
+		pthread_cond_destroy(&pool->cond);
+		free(pool->jobs);
+		free(pool);
+	}
+	/* else the pool is still used by the abandoned workers */
+
+	return nstuck;
+}
+
 void lsblk_properties_deinit(void)
 {
 #ifdef HAVE_LIBUDEV
@@ -0,0 +1,355 @@
+/*
+ * lsblk --watch
+ *
+ * The block devices are monitored by udev monitor (when lsblk is compiled
+ * with libudev, the events are sent after udev database update) or by
+ * kernel uevent netlink socket. The mount table is monitored by libmount
+ * monitor. The events are collected until the system is quiet, and the names
+ * of the changed devices are kept for the next devtree update.
+ */
+#include <poll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#ifdef HAVE_LIBUDEV
+# include <libudev.h>
+#endif
+#include <libmount.h>
+
+#include "c.h"
+#include "xalloc.h"
+#include "nls.h"
+#include "strutils.h"
+
+#include "lsblk.h"
+
+#define WATCH_SETTLE_MSEC	100	/* wait for more events */
+#define WATCH_SETTLE_MAX	10	/* max number of the settle periods */
+#define UEVENT_BUFSZ		8192
+
+struct lsblk_watch {
+#ifdef HAVE_LIBUDEV
+	struct udev		*udev;
+	struct udev_monitor	*udev_mon;
+#endif
+	int			uevent_fd;	/* kernel uevents, without udev */
+	struct libmnt_monitor	*mnt_mon;
+
+	char			**names;	/* changed devices */
+	size_t			nnames;
+	size_t			nallocated;
+
+	unsigned int		mounts_changed : 1;
+};
+
+static void watch_add_name(struct lsblk_watch *wa, const char *name)
+{
+	if (!name || lsblk_watch_device_changed(wa, name))
+		return;
+
+	DBG(DEV, ul_debug("watch: %s changed", name));
+
+	if (wa->nnames == wa->nallocated) {
+		wa->nallocated = wa->nallocated ? wa->nallocated * 2 : 16;
+		wa->names = xrealloc(wa->names, wa->nallocated * sizeof(char *));
+	}
+	wa->names[wa->nnames++] = xstrdup(name);
+}
+
+static int open_uevent_socket(void)
+{
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1			/* kernel events */
+	};
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -errno;
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		int rc = -errno;
+		close(fd);
+		return rc;
+	}
+	return fd;
+}
+
+struct lsblk_watch *lsblk_new_watch(void)
+{
+	struct lsblk_watch *wa = xcalloc(1, sizeof(*wa));
+
+	wa->uevent_fd = -1;
+
+#ifdef HAVE_LIBUDEV
+	wa->udev = udev_new();
+	if (wa->udev)
+		wa->udev_mon = udev_monitor_new_from_netlink(wa->udev, "udev");
+	if (wa->udev_mon
+	    && (udev_monitor_filter_add_match_subsystem_devtype(wa->udev_mon, "block", NULL) != 0
+		|| udev_monitor_enable_receiving(wa->udev_mon) != 0)) {
+		udev_monitor_unref(wa->udev_mon);
+		wa->udev_mon = NULL;
+	}
+	if (!wa->udev_mon)
+#endif
+	{
+		wa->uevent_fd = open_uevent_socket();
+		if (wa->uevent_fd < 0) {
+			errno = -wa->uevent_fd;
+			err(EXIT_FAILURE, _("cannot open uevent socket"));
+		}
+	}
+
+	wa->mnt_mon = mnt_new_monitor();
+	if (!wa->mnt_mon || mnt_monitor_enable_kernel(wa->mnt_mon, 1) != 0)
+		err(EXIT_FAILURE, _("cannot initialize mount monitor"));
+
+	return wa;
+}
+
+void lsblk_free_watch(struct lsblk_watch *wa)
+{
+	if (!wa)
+		return;
+
+	lsblk_watch_reset(wa);
+	free(wa->names);
+
+#ifdef HAVE_LIBUDEV
+	udev_monitor_unref(wa->udev_mon);
+	udev_unref(wa->udev);
+#endif
+	if (wa->uevent_fd >= 0)
+		close(wa->uevent_fd);
+	mnt_unref_monitor(wa->mnt_mon);
+	free(wa);
+}
+
+/* forgets all changes */
+void lsblk_watch_reset(struct lsblk_watch *wa)
+{
+	size_t i;
+
+	for (i = 0; i < wa->nnames; i++)
+		free(wa->names[i]);
+	wa->nnames = 0;
+	wa->mounts_changed = 0;
+}
+
+int lsblk_watch_device_changed(struct lsblk_watch *wa, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < wa->nnames; i++) {
+		if (strcmp(wa->names[i], name) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+int lsblk_watch_mounts_changed(struct lsblk_watch *wa)
+{
+	return wa->mounts_changed;
+}
+
+/*
+ * The uevent message is "<action>@<devpath>\0" followed by "KEY=value\0"
+ * pairs. Returns sysfs name of the block device or NULL.
+ */
+static const char *parse_uevent(char *buf, size_t sz)
+{
+	const char *devpath = NULL;
+	int is_block = 0;
+	size_t i = strnlen(buf, sz) + 1;
+
+	while (i < sz) {
+		char *key = buf + i;
+
+		i += strnlen(key, sz - i) + 1;
+		if (strcmp(key, "SUBSYSTEM=block") == 0)
+			is_block = 1;
+		else if (startswith(key, "DEVPATH="))
+			devpath = key + 8;
+	}
+	if (!is_block || !devpath)
+		return NULL;
+
+	return strrchr(devpath, '/') ? strrchr(devpath, '/') + 1 : devpath;
+}
+
+static void read_uevents(struct lsblk_watch *wa)
+{
+	char buf[UEVENT_BUFSZ];
+	ssize_t sz;
+
+	while ((sz = recv(wa->uevent_fd, buf, sizeof(buf) - 1, MSG_DONTWAIT)) > 0) {
+		buf[sz] = '\0';
+		watch_add_name(wa, parse_uevent(buf, sz));
+	}
+}
+
+#ifdef HAVE_LIBUDEV
+static void read_udev_events(struct lsblk_watch *wa)
+{
+	struct udev_device *dev;
+
+	while ((dev = udev_monitor_receive_device(wa->udev_mon))) {
+		watch_add_name(wa, udev_device_get_sysname(dev));
+		udev_device_unref(dev);
+	}
+}
+#endif
+
+static void read_mount_events(struct lsblk_watch *wa)
+{
+	while (mnt_monitor_next_change(wa->mnt_mon, NULL, NULL) == 0)
+		wa->mounts_changed = 1;
+}
+
+/* returns number of file descriptors with events or -1 on error */
+static int watch_poll(struct lsblk_watch *wa, int timeout)
+{
+	struct pollfd fds[2] = {
+		{ .fd = wa->uevent_fd, .events = POLLIN },
+		{ .fd = mnt_monitor_get_fd(wa->mnt_mon), .events = POLLIN }
+	};
+	int rc;
+
+#ifdef HAVE_LIBUDEV
+	if (wa->udev_mon)
+		fds[0].fd = udev_monitor_get_fd(wa->udev_mon);
+#endif
+	rc = poll(fds, ARRAY_SIZE(fds), timeout);
+	if (rc <= 0)
+		return rc;
+
+	if (fds[0].revents & POLLIN) {
+#ifdef HAVE_LIBUDEV
+		if (wa->udev_mon)
+			read_udev_events(wa);
+		else
+#endif
+			read_uevents(wa);
+	}
+	if (fds[1].revents & POLLIN)
+		read_mount_events(wa);
+	return rc;
+}
+
+/*
+ * Waits for changes. Returns 0 when any block device or any mount has been
+ * changed, or negative number on error.
+ */
+int lsblk_watch_wait(struct lsblk_watch *wa)
+{
+	int rc, n;
+
+	do {
+		rc = watch_poll(wa, -1);
+		if (rc < 0 && errno != EINTR)
+			return -errno;
+	} while (!wa->nnames && !wa->mounts_changed);
+
+	/* one hotplug usually generates more events, wait for the rest */
+	for (n = 0; n < WATCH_SETTLE_MAX; n++) {
+		rc = watch_poll(wa, WATCH_SETTLE_MSEC);
+		if (rc == 0)
+			break;
+		if (rc < 0 && errno != EINTR)
+			return -errno;
+	}
+	return 0;
+}
+
+/*
+ * Diff output; prints lines removed from @old and added in @new, the order
+ * of the lines is preserved.
+ */
+struct diff_line {
+	const char	*str;
+	size_t		idx;
+	int		matched;
+};
+
+static size_t split_lines(char *str, struct diff_line **lines)
+{
+	size_t n = 0, nalloc = 0;
+	char *p;
+
+	*lines = NULL;
+	for (p = str; p && *p; ) {
+		char *end = strchr(p, '\n');
+
+		if (end)
+			*end = '\0';
+		if (n == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			*lines = xrealloc(*lines, nalloc * sizeof(struct diff_line));
+		}
+		(*lines)[n].str = p;
+		(*lines)[n].idx = n;
+		(*lines)[n].matched = 0;
+		n++;
+		p = end ? end + 1 : NULL;
+	}
+	return n;
+}
+
+static int cmp_lines_str(const void *a, const void *b)
+{
+	const struct diff_line *x = a, *y = b;
+	int rc = strcmp(x->str, y->str);
+
+	return rc ? rc : cmp_numbers(x->idx, y->idx);
+}
+
+static int cmp_lines_idx(const void *a, const void *b)
+{
+	return cmp_numbers(((const struct diff_line *) a)->idx,
+			   ((const struct diff_line *) b)->idx);
+}
+
+void lsblk_watch_print_diff(FILE *out, const char *old, const char *new)
+{
+	struct diff_line *ol, *nl;
+	char *o = xstrdup(old), *n = xstrdup(new);
+	size_t no, nn, i, j;
+
+	no = split_lines(o, &ol);
+	nn = split_lines(n, &nl);
+
+	/* match the same lines */
+	qsort(ol, no, sizeof(struct diff_line), cmp_lines_str);
+	qsort(nl, nn, sizeof(struct diff_line), cmp_lines_str);
+
+	for (i = 0, j = 0; i < no && j < nn; ) {
+		int rc = strcmp(ol[i].str, nl[j].str);
+
+		if (rc == 0) {
+			ol[i++].matched = 1;
+			nl[j++].matched = 1;
+		} else if (rc < 0)
+			i++;
+		else
+			j++;
+	}
+
+	qsort(ol, no, sizeof(struct diff_line), cmp_lines_idx);
+	qsort(nl, nn, sizeof(struct diff_line), cmp_lines_idx);
+
+	for (i = 0; i < no; i++) {
+		if (!ol[i].matched)
+			fprintf(out, "-%s\n", ol[i].str);
+	}
+	for (i = 0; i < nn; i++) {
+		if (!nl[i].matched)
+			fprintf(out, "+%s\n", nl[i].str);
+	}
+
+	free(ol);
+	free(nl);
+	free(o);
+	free(n);
+}
@@ -59,6 +59,16 @@ UL_DEBUG_DEFINE_MASKNAMES(lsblk) = UL_DEBUG_EMPTY_MASKNAMES;
 #define LSBLK_EXIT_SOMEOK 64
 #define LSBLK_EXIT_ALLFAILED 32
 
+/* --watch modes */
+enum {
+	LSBLK_WATCH_FULL = 1,
+	LSBLK_WATCH_DIFF
+};
+
+/* properties prefetch defaults */
+#define LSBLK_PREFETCH_THREADS	8
+#define LSBLK_PREFETCH_TIMEOUT	10	/* seconds */
+
 static int column_id_to_number(int id);
 
 /* column IDs */
@@ -127,6 +137,7 @@ enum {
 	LSBLK_EXPORT =		(1 << 3),
 	LSBLK_TREE =		(1 << 4),
 	LSBLK_JSON =		(1 << 5),
+	LSBLK_CBOR =		(1 << 6),	/* with LSBLK_JSON */
 };
 
 /* Types used for qsort() and JSON */
@@ -534,7 +545,8 @@ static char *get_subsystems(struct lsblk_device *dev)
 
 #define is_parsable(_l)	(scols_table_is_raw((_l)->table) || \
 			 scols_table_is_export((_l)->table) || \
-			 scols_table_is_json((_l)->table))
+			 scols_table_is_json((_l)->table) || \
+			 scols_table_is_cbor((_l)->table))
 
 static char *mk_name(const char *name)
 {
@@ -562,21 +574,6 @@ static char *mk_dm_name(const char *name)
 	return p;
 }
 
-/* stores data to scols cell userdata (invisible and independent on output)
- * to make the original values accessible for sort functions
- */
-static void set_sortdata_u64(struct libscols_line *ln, int col, uint64_t x)
-{
-	struct libscols_cell *ce = scols_line_get_cell(ln, col);
-	uint64_t *data;
-
-	if (!ce)
-		return;
-	data = xmalloc(sizeof(uint64_t));
-	*data = x;
-	scols_cell_set_userdata(ce, data);
-}
-
 /* do not modify *data on any error */
 static void str2u64(const char *str, uint64_t *data)
 {
@@ -593,26 +590,6 @@ static void str2u64(const char *str, uint64_t *data)
 	*data = num;
 }
 
-static void unref_sortdata(struct libscols_table *tb)
-{
-	struct libscols_iter *itr;
-	struct libscols_line *ln;
-
-	if (!tb || !lsblk->sort_col)
-		return;
-	itr = scols_new_iter(SCOLS_ITER_FORWARD);
-	if (!itr)
-		return;
-	while (scols_table_next_line(tb, itr, &ln) == 0) {
-		struct libscols_cell *ce = scols_line_get_column_cell(ln,
-								lsblk->sort_col);
-		void *data = scols_cell_get_userdata(ce);
-		free(data);
-	}
-
-	scols_free_iter(itr);
-}
-
 static char *get_vfs_attribute(struct lsblk_device *dev, int id)
 {
 	char *sizestr;
@@ -1106,8 +1083,9 @@ static void device_to_scols(
 			uint64_t sortdata = (uint64_t) -1;
 
 			data = device_get_data(dev, parent, id, &sortdata);
+			/* binary data for scols_cmpnum_cells() */
 			if (data && sortdata != (uint64_t) -1)
-				set_sortdata_u64(ln, i, sortdata);
+				scols_cell_set_u64(scols_line_get_cell(ln, i), sortdata);
 		}
 		DBG(DEV, ul_debugobj(dev, " refer data[%zu]=\"%s\"", i, data));
 		if (data && scols_line_refer_data(ln, i, data))
@@ -1132,6 +1110,44 @@ static void device_to_scols(
 	ul_path_close_dirfd(dev->sysfs);
 }
 
+/*
+ * Returns 1 if any column (including hidden sort and dedup columns) requires
+ * udev, blkid or --sysroot properties
+ */
+static int columns_need_properties(void)
+{
+	size_t i;
+
+	for (i = 0; i < ncolumns; i++) {
+		switch (get_column_id(i)) {
+		case COL_OWNER:
+		case COL_GROUP:
+		case COL_MODE:
+			if (!lsblk->sysroot)
+				break;
+			return 1;
+		case COL_FSTYPE:
+		case COL_FSVERSION:
+		case COL_LABEL:
+		case COL_UUID:
+		case COL_PTUUID:
+		case COL_PTTYPE:
+		case COL_PARTTYPE:
+		case COL_PARTTYPENAME:
+		case COL_PARTLABEL:
+		case COL_PARTUUID:
+		case COL_PARTFLAGS:
+		case COL_WWN:
+		case COL_MODEL:
+		case COL_SERIAL:
+			return 1;
+		default:
+			break;
+		}
+	}
+	return 0;
+}
+
 /*
  * Walks on tree and adds one line for each device to the smartcols table
  */
@@ -1445,6 +1461,13 @@ static int __process_one_device(struct lsblk_devtree *tr, char *devname, dev_t d
 		return -EINVAL;
 	}
 
+	dev = lsblk_devtree_get_device_by_devno(tr, devno);
+	if (dev && !list_empty(&dev->ls_roots)) {
+		DBG(DEV, ul_debugobj(dev, "%s: already processed", dev->name));
+		return 0;
+	}
+	dev = NULL;
+
 	/* TODO: sysfs_devno_to_devname() internally initializes path_cxt, it
 	 * would be better to use ul_new_sysfs_path() + sysfs_blkdev_get_name()
 	 * and reuse path_cxt for initialize_device()
@@ -1690,25 +1713,6 @@ static void parse_includes(const char *str0)
 	}
 }
 
-/*
- * see set_sortdata_u64() and columns initialization in main()
- */
-static int cmp_u64_cells(struct libscols_cell *a,
-			 struct libscols_cell *b,
-			 __attribute__((__unused__)) void *data)
-{
-	uint64_t *adata = (uint64_t *) scols_cell_get_userdata(a),
-		 *bdata = (uint64_t *) scols_cell_get_userdata(b);
-
-	if (adata == NULL && bdata == NULL)
-		return 0;
-	if (adata == NULL)
-		return -1;
-	if (bdata == NULL)
-		return 1;
-	return *adata == *bdata ? 0 : *adata >= *bdata ? 1 : -1;
-}
-
 static void device_set_dedupkey(
 			struct lsblk_device *dev,
 			struct lsblk_device *parent,
@@ -1746,6 +1750,173 @@ static void devtree_set_dedupkeys(struct lsblk_devtree *tr, int id)
 		device_set_dedupkey(dev, NULL, id);
 }
 
+/*
+ * Reads devices specified on command line (from @first argument) or all
+ * devices into the tree. Returns exit status.
+ */
+static int read_devtree(struct lsblk_devtree *tr, int argc, char *argv[], int first)
+{
+	int status;
+
+	if (first == argc) {
+		int rc = lsblk->inverse ?
+			process_all_devices_inverse(tr) :
+			process_all_devices(tr);
+
+		status = rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	} else {
+		int cnt = 0, cnt_err = 0;
+
+		while (first < argc) {
+			if (process_one_device(tr, argv[first++]) != 0)
+				cnt_err++;
+			cnt++;
+		}
+		status = cnt == 0	? EXIT_FAILURE :	/* nothing */
+			 cnt == cnt_err	? LSBLK_EXIT_ALLFAILED :/* all failed */
+			 cnt_err	? LSBLK_EXIT_SOMEOK :	/* some ok */
+					  EXIT_SUCCESS;		/* all success */
+	}
+	return status;
+}
+
+/*
+ * Adds the complete devices tree to the output table
+ */
+static void devtree_to_table(struct lsblk_devtree *tr)
+{
+	if (columns_need_properties())
+		lsblk_devtree_prefetch_properties(tr, lsblk->nthreads,
+						  lsblk->probe_timeout);
+
+	if (lsblk->dedup_id > -1) {
+		devtree_set_dedupkeys(tr, lsblk->dedup_id);
+		lsblk_devtree_deduplicate_devices(tr);
+	}
+
+	devtree_to_scols(tr, lsblk->table);
+
+	if (lsblk->sort_col)
+		scols_sort_table(lsblk->table, lsblk->sort_col);
+	if (lsblk->force_tree_order)
+		scols_sort_table_by_tree(lsblk->table);
+}
+
+/*
+ * Moves already read udev/blkid properties from @old to @tr for devices
+ * without any event since the last update.
+ */
+static void devtree_reuse_properties(struct lsblk_devtree *tr,
+				     struct lsblk_devtree *old,
+				     struct lsblk_watch *wa)
+{
+	struct lsblk_iter itr;
+	struct lsblk_device *dev = NULL;
+
+	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
+
+	while (lsblk_devtree_next_device(tr, &itr, &dev) == 0) {
+		struct lsblk_device *o = lsblk_devtree_get_device(old, dev->name);
+
+		if (!o || o->maj != dev->maj || o->min != dev->min
+		    || lsblk_watch_device_changed(wa, dev->name))
+			continue;
+
+		DBG(DEV, ul_debugobj(dev, "%s: reuse properties", dev->name));
+		lsblk_device_free_properties(dev->properties);
+		dev->properties = o->properties;
+		dev->udev_requested = o->udev_requested;
+		dev->blkid_requested = o->blkid_requested;
+		dev->file_requested = o->file_requested;
+		o->properties = NULL;
+	}
+}
+
+static char *table_to_string(void)
+{
+	char *data = NULL;
+
+	if (scols_print_table_to_string(lsblk->table, &data) != 0 || !data)
+		err(EXIT_FAILURE, _("failed to print output table"));
+
+	scols_table_remove_lines(lsblk->table);
+	return data;
+}
+
+static void print_string(const char *data)
+{
+	size_t sz = strlen(data);
+
+	fputs(data, stdout);
+	if (sz && data[sz - 1] != '\n')
+		fputc('\n', stdout);
+	fflush(stdout);
+}
+
+/*
+ * lsblk --watch; prints the table and then again (or the differences) after
+ * every change. The devices tree is read again, but udev and blkid are asked
+ * only for the changed devices.
+ */
+static int watch_devices(struct lsblk_devtree **tr, int argc, char *argv[],
+			 int first, int diff)
+{
+	struct lsblk_watch *wa;
+	char *last;
+	int rc;
+
+	/* subscribe before the tree is read to not lose any event */
+	wa = lsblk_new_watch();
+
+	read_devtree(*tr, argc, argv, first);
+	devtree_to_table(*tr);
+	last = table_to_string();
+	print_string(last);
+
+	while ((rc = lsblk_watch_wait(wa)) == 0) {
+		struct lsblk_devtree *x;
+		char *data;
+
+		x = lsblk_new_devtree();
+		if (!x)
+			err(EXIT_FAILURE, _("failed to allocate device tree"));
+		if (lsblk_watch_mounts_changed(wa))
+			lsblk_mnt_deinit();	/* read mountpoints again */
+
+		read_devtree(x, argc, argv, first);
+		devtree_reuse_properties(x, *tr, wa);
+		lsblk_watch_reset(wa);
+
+		lsblk_unref_devtree(*tr);
+		*tr = x;
+
+		devtree_to_table(*tr);
+		data = table_to_string();
+
+		if (strcmp(data, last) == 0) {
+			DBG(TREE, ul_debug("watch: output not changed"));
+			free(data);
+			continue;
+		}
+		if (diff) {
+			lsblk_watch_print_diff(stdout, last, data);
+			fflush(stdout);
+		} else {
+			fputc('\n', stdout);
+			print_string(data);
+		}
+		free(last);
+		last = data;
+	}
+
+	free(last);
+	lsblk_free_watch(wa);
+
+	errno = -rc;
+	warn(_("failed to wait for events"));
+	return EXIT_FAILURE;
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -1783,7 +1954,12 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -t, --topology       output info about topology\n"), out);
 	fputs(_(" -z, --zoned          print zone model\n"), out);
 	fputs(_(" -x, --sort <column>  sort output by <column>\n"), out);
+	fputs(_("     --cbor           use CBOR binary output format\n"), out);
 	fputs(_("     --sysroot <dir>  use specified directory as system root\n"), out);
+	fputs(_("     --threads <num>  number of threads to read device properties\n"), out);
+	fputs(_("     --watch[=<mode>] print changes, <mode> is 'full' (default) or 'diff'\n"), out);
+	fputs(_("     --probe-timeout <sec>\n"
+		"                      skip properties of devices not responding in time\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(22));
 
@@ -1810,16 +1986,22 @@ int main(int argc, char *argv[])
 		.sort_id = -1,
 		.dedup_id = -1,
 		.flags = LSBLK_TREE,
-		.tree_id = COL_NAME
+		.tree_id = COL_NAME,
+		.nthreads = LSBLK_PREFETCH_THREADS,
+		.probe_timeout = LSBLK_PREFETCH_TIMEOUT
 	};
 	struct lsblk_devtree *tr = NULL;
 	int c, status = EXIT_FAILURE;
 	char *outarg = NULL;
 	size_t i;
-	int force_tree = 0, has_tree_col = 0;
+	int force_tree = 0, has_tree_col = 0, watch = 0;
 
 	enum {
-		OPT_SYSROOT = CHAR_MAX + 1
+		OPT_SYSROOT = CHAR_MAX + 1,
+		OPT_CBOR,
+		OPT_THREADS,
+		OPT_PROBE_TIMEOUT,
+		OPT_WATCH
 	};
 
 	static const struct option longopts[] = {
@@ -1831,6 +2013,7 @@ int main(int argc, char *argv[])
 		{ "zoned",      no_argument,       NULL, 'z' },
 		{ "help",	no_argument,       NULL, 'h' },
 		{ "json",       no_argument,       NULL, 'J' },
+		{ "cbor",       no_argument,       NULL, OPT_CBOR },
 		{ "output",     required_argument, NULL, 'o' },
 		{ "output-all", no_argument,       NULL, 'O' },
 		{ "merge",      no_argument,       NULL, 'M' },
@@ -1849,6 +2032,9 @@ int main(int argc, char *argv[])
 		{ "scsi",       no_argument,       NULL, 'S' },
 		{ "sort",	required_argument, NULL, 'x' },
 		{ "sysroot",    required_argument, NULL, OPT_SYSROOT },
+		{ "threads",    required_argument, NULL, OPT_THREADS },
+		{ "probe-timeout", required_argument, NULL, OPT_PROBE_TIMEOUT },
+		{ "watch",      optional_argument, NULL, OPT_WATCH },
 		{ "tree",       optional_argument, NULL, 'T' },
 		{ "version",    no_argument,       NULL, 'V' },
 		{ NULL, 0, NULL, 0 },
@@ -1857,7 +2043,7 @@ int main(int argc, char *argv[])
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
 		{ 'D','O' },
 		{ 'I','e' },
-		{ 'J', 'P', 'r' },
+		{ 'J', 'P', 'r', OPT_CBOR },
 		{ 'O','S' },
 		{ 'O','f' },
 		{ 'O','m' },
@@ -1909,6 +2095,9 @@ int main(int argc, char *argv[])
 		case 'J':
 			lsblk->flags |= LSBLK_JSON;
 			break;
+		case OPT_CBOR:
+			lsblk->flags |= LSBLK_JSON | LSBLK_CBOR;
+			break;
 		case 'l':
 			lsblk->flags &= ~LSBLK_TREE; /* disable the default */
 			break;
@@ -1994,6 +2183,24 @@ int main(int argc, char *argv[])
 		case OPT_SYSROOT:
 			lsblk->sysroot = optarg;
 			break;
+		case OPT_THREADS:
+			lsblk->nthreads = strtou32_or_err(optarg, _("invalid threads argument"));
+			if (!lsblk->nthreads)
+				errx(EXIT_FAILURE, _("invalid threads argument"));
+			break;
+		case OPT_WATCH:
+			if (!optarg || strcmp(optarg, "full") == 0)
+				watch = LSBLK_WATCH_FULL;
+			else if (strcmp(optarg, "diff") == 0)
+				watch = LSBLK_WATCH_DIFF;
+			else
+				errx(EXIT_FAILURE, _("unsupported watch mode: %s"), optarg);
+			break;
+		case OPT_PROBE_TIMEOUT:
+			lsblk->probe_timeout = strtou32_or_err(optarg, _("invalid timeout argument"));
+			if (!lsblk->probe_timeout)
+				errx(EXIT_FAILURE, _("invalid timeout argument"));
+			break;
 		case 'E':
 			lsblk->dedup_id = column_name_to_id(optarg, strlen(optarg));
 			if (lsblk->dedup_id >= 0)
@@ -2020,6 +2227,11 @@ int main(int argc, char *argv[])
 	if (force_tree)
 		lsblk->flags |= LSBLK_TREE;
 
+	if (watch && lsblk->sysroot)
+		errx(EXIT_FAILURE, _("--watch is unsupported with --sysroot"));
+	if (watch == LSBLK_WATCH_DIFF && (lsblk->flags & LSBLK_JSON))
+		errx(EXIT_FAILURE, _("--watch=diff is unsupported for JSON output"));
+
 	check_sysdevblock();
 
 	if (!ncolumns) {
@@ -2074,6 +2286,7 @@ int main(int argc, char *argv[])
 	scols_table_enable_export(lsblk->table, !!(lsblk->flags & LSBLK_EXPORT));
 	scols_table_enable_ascii(lsblk->table, !!(lsblk->flags & LSBLK_ASCII));
 	scols_table_enable_json(lsblk->table, !!(lsblk->flags & LSBLK_JSON));
+	scols_table_enable_cbor(lsblk->table, !!(lsblk->flags & LSBLK_CBOR));
 	scols_table_enable_noheadings(lsblk->table, !!(lsblk->flags & LSBLK_NOHEADINGS));
 
 	if (lsblk->flags & LSBLK_JSON)
@@ -2114,9 +2327,9 @@ int main(int argc, char *argv[])
 		if (!lsblk->sort_col && lsblk->sort_id == id) {
 			lsblk->sort_col = cl;
 			scols_column_set_cmpfunc(cl,
-				ci->type == COLTYPE_NUM     ? cmp_u64_cells :
-				ci->type == COLTYPE_SIZE    ? cmp_u64_cells :
-			        ci->type == COLTYPE_SORTNUM ? cmp_u64_cells : scols_cmpstr_cells,
+				ci->type == COLTYPE_NUM     ? scols_cmpnum_cells :
+				ci->type == COLTYPE_SIZE    ? scols_cmpnum_cells :
+			        ci->type == COLTYPE_SORTNUM ? scols_cmpnum_cells : scols_cmpstr_cells,
 				NULL);
 		}
 		if (lsblk->flags & LSBLK_JSON) {
@@ -2142,44 +2355,17 @@ int main(int argc, char *argv[])
 	if (!tr)
 		err(EXIT_FAILURE, _("failed to allocate device tree"));
 
-	if (optind == argc) {
-		int rc = lsblk->inverse ?
-			process_all_devices_inverse(tr) :
-			process_all_devices(tr);
-
-		status = rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
-	} else {
-		int cnt = 0, cnt_err = 0;
-
-		while (optind < argc) {
-			if (process_one_device(tr, argv[optind++]) != 0)
-				cnt_err++;
-			cnt++;
-		}
-		status = cnt == 0	? EXIT_FAILURE :	/* nothing */
-			 cnt == cnt_err	? LSBLK_EXIT_ALLFAILED :/* all failed */
-			 cnt_err	? LSBLK_EXIT_SOMEOK :	/* some ok */
-					  EXIT_SUCCESS;		/* all success */
-	}
-
-	if (lsblk->dedup_id > -1) {
-		devtree_set_dedupkeys(tr, lsblk->dedup_id);
-		lsblk_devtree_deduplicate_devices(tr);
+	if (watch) {
+		status = watch_devices(&tr, argc, argv, optind, watch == LSBLK_WATCH_DIFF);
+		goto leave;
 	}
 
-	devtree_to_scols(tr, lsblk->table);
-
-	if (lsblk->sort_col)
-		scols_sort_table(lsblk->table, lsblk->sort_col);
-	if (lsblk->force_tree_order)
-		scols_sort_table_by_tree(lsblk->table);
+	status = read_devtree(tr, argc, argv, optind);
+	devtree_to_table(tr);
 
 	scols_print_table(lsblk->table);
 
 leave:
-	if (lsblk->sort_col)
-		unref_sortdata(lsblk->table);
-
 	scols_unref_table(lsblk->table);
 
 	lsblk_mnt_deinit();
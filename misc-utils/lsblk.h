@@ -44,6 +44,9 @@ struct lsblk {
 	const char *sysroot;
 	int flags;			/* LSBLK_* */
 
+	size_t nthreads;		/* properties prefetch threads */
+	unsigned int probe_timeout;	/* seconds, for properties prefetch */
+
 	unsigned int all_devices:1;	/* print all devices, including empty */
 	unsigned int bytes:1;		/* print SIZE in bytes */
 	unsigned int inverse:1;		/* print inverse dependencies */
@@ -101,6 +104,9 @@ struct lsblk_device {
 	struct list_head	ls_roots;	/* item in devtree->roots list */
 	struct list_head	ls_devices;	/* item in devtree->devices list */
 
+	struct lsblk_device	*name_next;	/* in devtree->name_hash bucket */
+	struct lsblk_device	*devno_next;	/* in devtree->devno_hash bucket */
+
 	struct lsblk_device	*wholedisk;	/* for partitions */
 
 	struct libscols_line	*scols_line;
@@ -153,6 +159,11 @@ struct lsblk_devtree {
 
 	struct list_head	roots;		/* tree root devices */
 	struct list_head	devices;	/* all devices */
+	size_t			ndevices;
+
+	struct lsblk_device	**name_hash;	/* devices by name */
+	struct lsblk_device	**devno_hash;	/* devices by devno */
+	size_t			hashsz;		/* power of 2 */
 
 	unsigned int	is_inverse : 1;		/* inverse tree */
 };
@@ -188,6 +199,28 @@ struct lsblk_iter {
 	} while(0)
 
 
+/* hash functions for devtree and mountpoints indexes */
+static inline size_t lsblk_hash_string(const char *str)
+{
+	uint32_t h = 2166136261U;	/* FNV-1a */
+
+	for (; *str; str++) {
+		h ^= (unsigned char) *str;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static inline size_t lsblk_hash_devno(dev_t devno)
+{
+	uint64_t h = (uint64_t) devno;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t) h;
+}
+
 /* lsblk-mnt.c */
 extern void lsblk_mnt_init(void);
 extern void lsblk_mnt_deinit(void);
@@ -198,9 +231,21 @@ extern char *lsblk_device_get_mountpoint(struct lsblk_device *dev);
 extern void lsblk_device_free_properties(struct lsblk_devprop *p);
 extern struct lsblk_devprop *lsblk_device_get_properties(struct lsblk_device *dev);
 extern void lsblk_properties_deinit(void);
+extern size_t lsblk_devtree_prefetch_properties(struct lsblk_devtree *tr,
+				size_t nthreads, unsigned int timeout);
 
 extern const char *lsblk_parttype_code_to_string(const char *code, const char *pttype);
 
+/* lsblk-watch.c */
+struct lsblk_watch;
+extern struct lsblk_watch *lsblk_new_watch(void);
+extern void lsblk_free_watch(struct lsblk_watch *wa);
+extern void lsblk_watch_reset(struct lsblk_watch *wa);
+extern int lsblk_watch_wait(struct lsblk_watch *wa);
+extern int lsblk_watch_device_changed(struct lsblk_watch *wa, const char *name);
+extern int lsblk_watch_mounts_changed(struct lsblk_watch *wa);
+extern void lsblk_watch_print_diff(FILE *out, const char *old, const char *new);
+
 /* lsblk-devtree.c */
 void lsblk_reset_iter(struct lsblk_iter *itr, int direction);
 struct lsblk_device *lsblk_new_device(void);
@@ -231,6 +276,7 @@ int lsblk_devtree_next_device(struct lsblk_devtree *tr,
                             struct lsblk_device **dev);
 int lsblk_devtree_has_device(struct lsblk_devtree *tr, struct lsblk_device *dev);
 struct lsblk_device *lsblk_devtree_get_device(struct lsblk_devtree *tr, const char *name);
+struct lsblk_device *lsblk_devtree_get_device_by_devno(struct lsblk_devtree *tr, dev_t devno);
 int lsblk_devtree_remove_device(struct lsblk_devtree *tr, struct lsblk_device *dev);
 int lsblk_devtree_deduplicate_devices(struct lsblk_devtree *tr);
 
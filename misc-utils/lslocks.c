@@ -82,6 +82,8 @@ static struct colinfo infos[] = {
 	[COL_BLOCKER] = { "BLOCKER", 0, SCOLS_FL_RIGHT, N_("PID of the process blocking the lock") }
 };
 
+#define LSLOCKS_HASHSZ_MIN	64
+
 static int columns[ARRAY_SIZE(infos) * 2];
 static size_t ncolumns;
 
@@ -110,8 +112,37 @@ struct lock {
 		     blocked   :1;
 	uint64_t size;
 	int id;
+
+	struct lock *id_next;		/* locks_hash */
 };
 
+/* the locked files opened by the process */
+struct lock_fd {
+	ino_t		ino;
+	dev_t		dev;
+	char		*path;
+	uint64_t	size;
+
+	struct lock_fd	*next;		/* lock_proc->fds hash */
+};
+
+/* all locks of the process share one /proc/PID/fd scan */
+struct lock_proc {
+	pid_t		pid;
+
+	struct lock_fd	**fds;		/* hash by inode number */
+	size_t		fds_hashsz;	/* power of 2 */
+
+	struct lock_proc *next;		/* procs hash */
+};
+
+static struct lock_proc **procs;
+static size_t procs_hashsz, nprocs;
+
+/* not blocked locks by ID, for BLOCKER column */
+static struct lock **locks_hash;
+static size_t locks_hashsz;
+
 static void rem_lock(struct lock *lock)
 {
 	if (!lock)
@@ -155,63 +186,205 @@ static char *get_fallback_filename(dev_t dev)
 	return res;
 }
 
+static inline size_t lslocks_hash(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static size_t hashsz_for(size_t n)
+{
+	size_t sz = LSLOCKS_HASHSZ_MIN;
+
+	while (sz < n)
+		sz <<= 1;
+	return sz;
+}
+
 /*
- * Return the absolute path of a file from
- * a given inode number (and its size)
+ * Reads all file descriptors of the process. Only the first descriptor is
+ * kept for the same file.
  */
-static char *get_filename_sz(ino_t inode, pid_t lock_pid, size_t *size)
+static void read_proc_fds(struct lock_proc *pr)
 {
-	struct stat sb;
+	struct lock_fd **ary = NULL;
+	size_t i, n = 0, nalloc = 0;
 	struct dirent *dp;
 	DIR *dirp;
-	size_t len;
+	char path[PATH_MAX], sym[PATH_MAX];
 	int fd;
-	char path[PATH_MAX], sym[PATH_MAX], *ret = NULL;
-
-	*size = 0;
-	memset(path, 0, sizeof(path));
-	memset(sym, 0, sizeof(sym));
 
 	/*
 	 * We know the pid so we don't have to
 	 * iterate the *entire* filesystem searching
 	 * for the damn file.
 	 */
-	sprintf(path, "/proc/%d/fd/", lock_pid);
+	snprintf(path, sizeof(path), "/proc/%d/fd/", pr->pid);
 	if (!(dirp = opendir(path)))
-		return NULL;
-
-	if ((len = strlen(path)) >= (sizeof(path) - 2))
-		goto out;
+		return;
 
-	if ((fd = dirfd(dirp)) < 0 )
+	if ((fd = dirfd(dirp)) < 0)
 		goto out;
 
 	while ((dp = readdir(dirp))) {
-		if (!strcmp(dp->d_name, ".") ||
-		    !strcmp(dp->d_name, ".."))
-			continue;
+		struct lock_fd *lf;
+		struct stat sb;
+		ssize_t len;
 
 		/* care only for numerical descriptors */
 		if (!strtol(dp->d_name, (char **) NULL, 10))
 			continue;
 
-		if (!fstatat(fd, dp->d_name, &sb, 0)
-		    && inode != sb.st_ino)
+		if (fstatat(fd, dp->d_name, &sb, 0) != 0)
 			continue;
 
 		if ((len = readlinkat(fd, dp->d_name, sym, sizeof(sym) - 1)) < 1)
-			goto out;
-
-		*size = sb.st_size;
+			continue;
 		sym[len] = '\0';
 
-		ret = xstrdup(sym);
-		break;
+		lf = xcalloc(1, sizeof(*lf));
+		lf->ino = sb.st_ino;
+		lf->dev = sb.st_dev;
+		lf->size = sb.st_size;
+		lf->path = xstrdup(sym);
+
+		if (n == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			ary = xrealloc(ary, nalloc * sizeof(*ary));
+		}
+		ary[n++] = lf;
 	}
+
+	pr->fds_hashsz = hashsz_for(n);
+	pr->fds = xcalloc(pr->fds_hashsz, sizeof(*pr->fds));
+
+	/* link backward, the first descriptor is at the head of the bucket */
+	for (i = n; i > 0; i--) {
+		struct lock_fd *lf = ary[i - 1];
+		size_t h = lslocks_hash(lf->ino) & (pr->fds_hashsz - 1);
+
+		lf->next = pr->fds[h];
+		pr->fds[h] = lf;
+	}
+	free(ary);
 out:
 	closedir(dirp);
-	return ret;
+}
+
+static void procs_hash_link(struct lock_proc *pr)
+{
+	size_t h = lslocks_hash(pr->pid) & (procs_hashsz - 1);
+
+	pr->next = procs[h];
+	procs[h] = pr;
+}
+
+static struct lock_proc *get_proc(pid_t lock_pid)
+{
+	struct lock_proc *pr;
+
+	if (procs_hashsz) {
+		pr = procs[lslocks_hash(lock_pid) & (procs_hashsz - 1)];
+		for (; pr; pr = pr->next) {
+			if (pr->pid == lock_pid)
+				return pr;
+		}
+	}
+
+	if (nprocs >= procs_hashsz) {
+		struct lock_proc **old = procs;
+		size_t i, oldsz = procs_hashsz;
+
+		procs_hashsz = oldsz ? oldsz * 2 : LSLOCKS_HASHSZ_MIN;
+		procs = xcalloc(procs_hashsz, sizeof(*procs));
+
+		for (i = 0; i < oldsz; i++) {
+			struct lock_proc *next;
+
+			for (pr = old[i]; pr; pr = next) {
+				next = pr->next;
+				procs_hash_link(pr);
+			}
+		}
+		free(old);
+	}
+
+	pr = xcalloc(1, sizeof(*pr));
+	pr->pid = lock_pid;
+	read_proc_fds(pr);
+
+	procs_hash_link(pr);
+	nprocs++;
+	return pr;
+}
+
+static void free_procs(void)
+{
+	size_t i;
+
+	for (i = 0; i < procs_hashsz; i++) {
+		struct lock_proc *pr, *next;
+
+		for (pr = procs[i]; pr; pr = next) {
+			size_t j;
+
+			next = pr->next;
+			for (j = 0; j < pr->fds_hashsz; j++) {
+				struct lock_fd *lf, *lnext;
+
+				for (lf = pr->fds[j]; lf; lf = lnext) {
+					lnext = lf->next;
+					free(lf->path);
+					free(lf);
+				}
+			}
+			free(pr->fds);
+			free(pr);
+		}
+	}
+	free(procs);
+	procs = NULL;
+	procs_hashsz = nprocs = 0;
+}
+
+/*
+ * Return the absolute path of a file from
+ * a given inode number (and its size)
+ *
+ * The device number from /proc/locks does not have to be the same as
+ * st_dev (e.g. btrfs subvolumes), so the device is only preferred when
+ * more files have the same inode number.
+ */
+static char *get_filename_sz(ino_t inode, dev_t dev, pid_t lock_pid, size_t *size)
+{
+	struct lock_proc *pr;
+	struct lock_fd *lf, *res = NULL;
+
+	*size = 0;
+
+	pr = get_proc(lock_pid);
+	if (!pr->fds_hashsz)
+		return NULL;
+
+	lf = pr->fds[lslocks_hash(inode) & (pr->fds_hashsz - 1)];
+	for (; lf; lf = lf->next) {
+		if (lf->ino != inode)
+			continue;
+		if (lf->dev == dev) {
+			res = lf;
+			break;
+		}
+		if (!res)
+			res = lf;
+	}
+
+	if (!res)
+		return NULL;
+
+	*size = res->size;
+	return xstrdup(res->path);
 }
 
 /*
@@ -307,7 +480,7 @@ static int get_local_locks(struct list_head *locks)
 			}
 		}
 
-		l->path = get_filename_sz(inode, l->pid, &sz);
+		l->path = get_filename_sz(inode, dev, l->pid, &sz);
 
 		/* no permissions -- ignore */
 		if (!l->path && no_inaccessible) {
@@ -326,6 +499,7 @@ static int get_local_locks(struct list_head *locks)
 	}
 
 	fclose(fp);
+	free_procs();
 	return 0;
 }
 
@@ -360,21 +534,58 @@ static inline struct colinfo *get_column_info(unsigned num)
 	return &infos[ get_column_id(num) ];
 }
 
-static pid_t get_blocker(int id, struct list_head *locks)
+static int has_column(int id)
+{
+	size_t i;
+
+	for (i = 0; i < ncolumns; i++)
+		if (columns[i] == id)
+			return 1;
+	return 0;
+}
+
+/* the first not blocked lock in the @locks list is the blocker */
+static void hash_locks(struct list_head *locks)
 {
 	struct list_head *p;
+	size_t n = 0;
 
-	list_for_each(p, locks) {
+	list_for_each(p, locks)
+		n++;
+
+	locks_hashsz = hashsz_for(n);
+	locks_hash = xcalloc(locks_hashsz, sizeof(*locks_hash));
+
+	list_for_each_backwardly(p, locks) {
 		struct lock *l = list_entry(p, struct lock, locks);
+		size_t h;
 
-		if (l->id == id && !l->blocked)
+		if (l->blocked)
+			continue;
+
+		h = lslocks_hash((unsigned int) l->id) & (locks_hashsz - 1);
+		l->id_next = locks_hash[h];
+		locks_hash[h] = l;
+	}
+}
+
+static pid_t get_blocker(int id)
+{
+	struct lock *l;
+
+	if (!locks_hashsz)
+		return 0;
+
+	l = locks_hash[lslocks_hash((unsigned int) id) & (locks_hashsz - 1)];
+	for (; l; l = l->id_next) {
+		if (l->id == id)
 			return l->pid;
 	}
 
 	return 0;
 }
 
-static void add_scols_line(struct libscols_table *table, struct lock *l, struct list_head *locks)
+static void add_scols_line(struct libscols_table *table, struct lock *l)
 {
 	size_t i;
 	struct libscols_line *line;
@@ -431,7 +642,7 @@ static void add_scols_line(struct libscols_table *table, struct lock *l, struct
 		case COL_BLOCKER:
 		{
 			pid_t bl = l->blocked && l->id ?
-						get_blocker(l->id, locks) : 0;
+						get_blocker(l->id) : 0;
 			if (bl)
 				xasprintf(&str, "%d", (int) bl);
 		}
@@ -495,6 +706,9 @@ static int show_locks(struct list_head *locks)
 
 	}
 
+	if (has_column(COL_BLOCKER))
+		hash_locks(locks);
+
 	/* prepare data for output */
 	list_for_each(p, locks) {
 		struct lock *l = list_entry(p, struct lock, locks);
@@ -502,7 +716,7 @@ static int show_locks(struct list_head *locks)
 		if (pid && pid != l->pid)
 			continue;
 
-		add_scols_line(table, l, locks);
+		add_scols_line(table, l);
 	}
 
 	/* destroy the list */
@@ -510,6 +724,9 @@ static int show_locks(struct list_head *locks)
 		struct lock *l = list_entry(p, struct lock, locks);
 		rem_lock(l);
 	}
+	free(locks_hash);
+	locks_hash = NULL;
+	locks_hashsz = 0;
 
 	scols_print_table(table);
 	scols_unref_table(table);
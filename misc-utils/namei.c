@@ -26,6 +26,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <search.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/param.h>
@@ -44,6 +46,10 @@
 #define MAXSYMLINKS 256
 #endif
 
+#ifndef O_PATH
+# define O_PATH	0
+#endif
+
 #define NAMEI_NOLINKS	(1 << 1)
 #define NAMEI_MODES	(1 << 2)
 #define NAMEI_MNTS	(1 << 3)
@@ -62,10 +68,156 @@ struct namei {
 	int		noent;		/* this item not existing (stores errno from stat()) */
 };
 
+/*
+ * lstat() and readlink() results shared by all the paths. The cache is a
+ * trie of the path components, every component is resolved only once and
+ * relative to the file descriptor of the parent directory.
+ */
+struct namei_cache {
+	char			*name;		/* component name */
+	struct namei_cache	*parent;
+	void			*children;	/* tsearch() tree */
+
+	struct stat		st;		/* component lstat() */
+	int			noent;		/* errno from lstat() */
+	char			*sym;		/* symlink target */
+	int			symerr;		/* errno from readlink() */
+
+	int			fd;		/* O_PATH directory or -1 */
+	int			fderr;		/* errno from open() */
+	struct namei_cache	*nextfd;	/* list of the open directories */
+};
+
 static int flags;
 static struct idcache *gcache;	/* groupnames */
 static struct idcache *ucache;	/* usernames */
 
+static struct namei_cache cache_root = { .name = "/", .fd = -1 };
+static struct namei_cache cache_cwd = { .name = ".", .fd = AT_FDCWD };
+static struct namei_cache *cache_fds;	/* open directories */
+
+static int cmp_cache(const void *a, const void *b)
+{
+	return strcmp(((const struct namei_cache *) a)->name,
+		      ((const struct namei_cache *) b)->name);
+}
+
+/* closes all the directories, they are reopened on demand */
+static int cache_close_fds(void)
+{
+	int n = 0;
+
+	while (cache_fds) {
+		struct namei_cache *next = cache_fds->nextfd;
+
+		close(cache_fds->fd);
+		cache_fds->fd = -1;
+		cache_fds->nextfd = NULL;
+		cache_fds = next;
+		n++;
+	}
+	return n;
+}
+
+static int cache_dirfd(struct namei_cache *dir)
+{
+	if (dir->fd != -1 || dir->fderr)
+		return dir->fd;
+
+	if (!dir->parent)
+		dir->fd = open("/", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	else {
+		int pfd = cache_dirfd(dir->parent);
+
+		if (pfd == -1) {
+			dir->fderr = dir->parent->fderr;
+			return -1;
+		}
+		/* follow symlinks as lstat() does for the path prefix */
+		dir->fd = openat(pfd, dir->name, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	}
+
+	if (dir->fd < 0) {
+		dir->fd = -1;
+		if ((errno == EMFILE || errno == ENFILE) && cache_close_fds())
+			return cache_dirfd(dir);
+		dir->fderr = errno;
+		return -1;
+	}
+	dir->nextfd = cache_fds;
+	cache_fds = dir;
+	return dir->fd;
+}
+
+static struct namei_cache *cache_lookup(struct namei_cache *dir, const char *name)
+{
+	struct namei_cache key = { .name = (char *) name }, *ent, **x;
+	char sym[PATH_MAX];
+	ssize_t sz;
+	int fd;
+
+	x = tsearch(&key, &dir->children, cmp_cache);
+	if (!x)
+		err(EXIT_FAILURE, _("failed to allocate cache"));
+	if (*x != &key)
+		return *x;
+
+	ent = xcalloc(1, sizeof(*ent));
+	ent->name = xstrdup(name);
+	ent->parent = dir;
+	ent->fd = -1;
+	*x = ent;		/* replace the key, the name is the same */
+
+	fd = cache_dirfd(dir);
+	if (fd == -1) {
+		ent->noent = dir->fderr;
+		return ent;
+	}
+	if (fstatat(fd, name, &ent->st, AT_SYMLINK_NOFOLLOW) != 0) {
+		ent->noent = errno;
+		return ent;
+	}
+	if (S_ISLNK(ent->st.st_mode)) {
+		sz = readlinkat(fd, name, sym, sizeof(sym));
+		if (sz < 1)
+			ent->symerr = sz < 0 ? errno : EINVAL;
+		else
+			ent->sym = xstrndup(sym, sz);
+	}
+	return ent;
+}
+
+/* returns the directory @path (@len bytes) in the cache */
+static struct namei_cache *cache_walk(const char *path, size_t len)
+{
+	struct namei_cache *dir = *path == '/' ? &cache_root : &cache_cwd;
+	char *tmp = xstrndup(path, len), *p, *save = NULL;
+
+	for (p = strtok_r(tmp, "/", &save); p; p = strtok_r(NULL, "/", &save))
+		dir = cache_lookup(dir, p);
+	free(tmp);
+	return dir;
+}
+
+static void cache_free(void *data)
+{
+	struct namei_cache *ent = data;
+
+	tdestroy(ent->children, cache_free);
+	if (ent->parent) {
+		free(ent->name);
+		free(ent->sym);
+		free(ent);
+	}
+}
+
+static void free_cache(void)
+{
+	cache_close_fds();
+	tdestroy(cache_root.children, cache_free);
+	tdestroy(cache_cwd.children, cache_free);
+}
+
 static void
 free_namei(struct namei *nm)
 {
@@ -79,15 +231,17 @@ free_namei(struct namei *nm)
 }
 
 static void
-readlink_to_namei(struct namei *nm, const char *path)
+readlink_to_namei(struct namei *nm, const char *path, struct namei_cache *ent)
 {
-	char sym[PATH_MAX];
+	const char *sym = ent->sym;
 	ssize_t sz;
 	int isrel = 0;
 
-	sz = readlink(path, sym, sizeof(sym));
-	if (sz < 1)
+	if (!sym) {
+		errno = ent->symerr;
 		err(EXIT_FAILURE, _("failed to read symlink: %s"), path);
+	}
+	sz = strlen(sym);
 	if (*sym != '/') {
 		char *p = strrchr(path, '/');
 
@@ -138,26 +292,25 @@ dotdot_stat(const char *dirname, struct stat *st)
 }
 
 static struct namei *
-new_namei(struct namei *parent, const char *path, const char *fname, int lev)
+new_namei(struct namei *parent, const char *path, struct namei_cache *ent, int lev)
 {
 	struct namei *nm;
 
-	if (!fname)
-		return NULL;
 	nm = xcalloc(1, sizeof(*nm));
 	if (parent)
 		parent->next = nm;
 
 	nm->level = lev;
-	nm->name = xstrdup(fname);
+	nm->name = xstrdup(ent->name);
 
-	if (lstat(path, &nm->st) != 0) {
-		nm->noent = errno;
+	if (ent->noent) {
+		nm->noent = ent->noent;
 		return nm;
 	}
+	nm->st = ent->st;
 
 	if (S_ISLNK(nm->st.st_mode))
-		readlink_to_namei(nm, path);
+		readlink_to_namei(nm, path, ent);
 	if (flags & NAMEI_OWNERS) {
 		add_uid(ucache, nm->st.st_uid);
 		add_gid(gcache, nm->st.st_gid);
@@ -183,6 +336,7 @@ static struct namei *
 add_namei(struct namei *parent, const char *orgpath, int start, struct namei **last)
 {
 	struct namei *nm = NULL, *first = NULL;
+	struct namei_cache *dir;
 	char *fname, *end, *path;
 	int level = 0;
 
@@ -194,12 +348,16 @@ add_namei(struct namei *parent, const char *orgpath, int start, struct namei **l
 	}
 	path = xstrdup(orgpath);
 	fname = path + start;
+	dir = start ? cache_walk(path, start) : &cache_cwd;
 
 	/* root directory */
 	if (*fname == '/') {
 		while (*fname == '/')
 			fname++; /* eat extra '/' */
-		first = nm = new_namei(nm, "/", "/", level);
+		dir = &cache_root;
+		if (!dir->st.st_mode && !dir->noent && lstat("/", &dir->st) != 0)
+			dir->noent = errno;
+		first = nm = new_namei(nm, "/", dir, level);
 	}
 
 	for (end = fname; fname && end; ) {
@@ -210,7 +368,8 @@ add_namei(struct namei *parent, const char *orgpath, int start, struct namei **l
 				*end = '\0';
 
 			/* create a new entry */
-			nm = new_namei(nm, path, fname, level);
+			dir = cache_lookup(dir, fname);
+			nm = new_namei(nm, path, dir, level);
 		} else
 			end = NULL;
 		if (!first)
@@ -442,6 +601,7 @@ main(int argc, char **argv)
 		}
 	}
 
+	free_cache();
 	free_idcache(ucache);
 	free_idcache(gcache);
 
@@ -32,19 +32,66 @@ for i in $@; do N=`echo "$i" | sed "s/$FROM/$TO/g"`; mv "$i" "$N"; done
 #include <termios.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifndef HAVE_RENAMEAT2
+# include <sys/syscall.h>
+#endif
 
 #include "nls.h"
 #include "xalloc.h"
 #include "c.h"
 #include "closestream.h"
+#include "optutils.h"
 #include "rpmatch.h"
 
 #define RENAME_EXIT_SOMEOK	2
 #define RENAME_EXIT_NOTHING	4
 #define RENAME_EXIT_UNEXPLAINED	64
 
+#ifndef RENAME_NOREPLACE
+# define RENAME_NOREPLACE	(1 << 0)
+#endif
+
+#ifndef O_PATH
+# define O_PATH	O_RDONLY
+#endif
+
 static int tty_cbreak = 0;
 
+/* the directory of the previous file */
+static char *dir_name;
+static int dir_fd = -1;
+
+#ifndef HAVE_RENAMEAT2
+static int renameat2(int olddirfd, const char *oldpath, int newdirfd,
+		     const char *newpath, unsigned int flags)
+{
+# ifdef SYS_renameat2
+	return syscall(SYS_renameat2, olddirfd, oldpath, newdirfd, newpath, flags);
+# else
+	errno = ENOSYS;
+	return -1;
+# endif
+}
+#endif
+
+/*
+ * Returns file descriptor of the directory @s (@len bytes), the descriptor
+ * is kept open for the next files in the same directory.
+ */
+static int get_dirfd(const char *s, size_t len)
+{
+	if (dir_name && strlen(dir_name) == len && memcmp(dir_name, s, len) == 0)
+		return dir_fd;
+
+	if (dir_fd >= 0)
+		close(dir_fd);
+	free(dir_name);
+
+	dir_name = xstrndup(s, len);
+	dir_fd = open(len ? dir_name : "/", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	return dir_fd;
+}
+
 static int string_replace(char *from, char *to, char *s, char *orig, char **newname)
 {
 	char *p, *q, *where;
@@ -165,22 +212,51 @@ static int do_symlink(char *from, char *to, char *s, int verbose, int noact,
 static int do_file(char *from, char *to, char *s, int verbose, int noact,
                    int nooverwrite, int interactive)
 {
-	char *newname = NULL, *file=NULL;
-	int ret = 1;
+	char *newname = NULL, *file=NULL, *base = s, *newbase;
+	int ret = 1, dfd = AT_FDCWD, rc;
 
-	if (access(s, F_OK) != 0) {
+	if (strchr(from, '/') == NULL && strchr(to, '/') == NULL)
+		file = strrchr(s, '/');
+	if (file) {
+		/* the same directory, use names relative to the directory */
+		dfd = get_dirfd(s, file - s);
+		if (dfd >= 0)
+			base = file + 1;
+		else
+			dfd = AT_FDCWD;
+	}
+
+	if (faccessat(dfd, base, F_OK, 0) != 0) {
 		warn(_("%s: not accessible"), s);
 		return 2;
 	}
 
-	if (strchr(from, '/') == NULL && strchr(to, '/') == NULL)
-		file = strrchr(s, '/');
 	if (file == NULL)
 		file = s;
 	if (string_replace(from, to, file, s, &newname) != 0)
 		return 0;
+	newbase = newname + (base - s);
+
+	if (nooverwrite && !noact) {
+		/* let the kernel check it atomically */
+		rc = renameat2(dfd, base, dfd, newbase, RENAME_NOREPLACE);
+		if (rc == 0)
+			goto done;
+		if (errno != ENOSYS && errno != EINVAL) {
+			if (errno == EEXIST) {
+				if (verbose)
+					printf(_("Skipping existing file: `%s'\n"), newname);
+				ret = 0;
+			} else {
+				warn(_("%s: rename to %s failed"), s, newname);
+				ret = 2;
+			}
+			goto done;
+		}
+		/* unsupported by kernel or filesystem */
+	}
 
-	if ((nooverwrite || interactive) && access(newname, F_OK) != 0)
+	if ((nooverwrite || interactive) && faccessat(dfd, newbase, F_OK, 0) != 0)
 		nooverwrite = interactive = 0;
 
 	if (nooverwrite || (interactive && (noact || ask(newname) != 0))) {
@@ -188,10 +264,11 @@ static int do_file(char *from, char *to, char *s, int verbose, int noact,
 			printf(_("Skipping existing file: `%s'\n"), newname);
 		ret = 0;
 	}
-	else if (!noact && rename(s, newname) != 0) {
+	else if (!noact && renameat(dfd, base, dfd, newbase) != 0) {
 		warn(_("%s: rename to %s failed"), s, newname);
 		ret = 2;
 	}
+done:
 	if (verbose && (noact || ret == 1))
 		printf("`%s' -> `%s'\n", s, newname);
 	free(newname);
@@ -205,6 +282,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	fprintf(out,
 	      _(" %s [options] <expression> <replacement> <file>...\n"),
 		program_invocation_short_name);
+	fprintf(out,
+	      _(" %s [options] --null <expression> <replacement> [<file>...]\n"),
+		program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_("Rename files.\n"), out);
@@ -215,6 +295,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -n, --no-act        do not make any changes\n"), out);
 	fputs(_(" -o, --no-overwrite  don't overwrite existing files\n"), out);
 	fputs(_(" -i, --interactive   prompt before overwrite\n"), out);
+	fputs(_(" -0, --null          read NUL-separated files from stdin\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(21));
 	printf(USAGE_MAN_TAIL("rename(1)"));
@@ -225,6 +306,7 @@ int main(int argc, char **argv)
 {
 	char *from, *to;
 	int i, c, ret = 0, verbose = 0, noact = 0, nooverwrite = 0, interactive = 0;
+	int fromstdin = 0;
 	struct termios tio;
 	int (*do_rename)(char *from, char *to, char *s, int verbose, int noact,
 	                 int nooverwrite, int interactive) = do_file;
@@ -237,15 +319,23 @@ int main(int argc, char **argv)
 		{"no-overwrite", no_argument, NULL, 'o'},
 		{"interactive", no_argument, NULL, 'i'},
 		{"symlink", no_argument, NULL, 's'},
+		{"null", no_argument, NULL, '0'},
 		{NULL, 0, NULL, 0}
 	};
+	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
+		{ '0', 'i' },
+		{ 0 }
+	};
+	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
 
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "vsVhnoi", longopts, NULL)) != -1)
+	while ((c = getopt_long(argc, argv, "vsVhnoi0", longopts, NULL)) != -1) {
+		err_exclusive_options(c, longopts, excl, excl_st);
+
 		switch (c) {
 		case 'n':
 			noact = 1;
@@ -264,6 +354,9 @@ int main(int argc, char **argv)
 		case 's':
 			do_rename = do_symlink;
 			break;
+		case '0':
+			fromstdin = 1;
+			break;
 
 		case 'V':
 			print_version(EXIT_SUCCESS);
@@ -272,11 +365,12 @@ int main(int argc, char **argv)
 		default:
 			errtryhelp(EXIT_FAILURE);
 		}
+	}
 
 	argc -= optind;
 	argv += optind;
 
-	if (argc < 3) {
+	if (argc < (fromstdin ? 2 : 3)) {
 		warnx(_("not enough arguments"));
 		errtryhelp(EXIT_FAILURE);
 	}
@@ -298,6 +392,22 @@ int main(int argc, char **argv)
 	for (i = 2; i < argc; i++)
 		ret |= do_rename(from, to, argv[i], verbose, noact, nooverwrite, interactive);
 
+	if (fromstdin) {
+		char *name = NULL;
+		size_t namesz = 0;
+
+		while (getdelim(&name, &namesz, '\0', stdin) > 0) {
+			if (*name)
+				ret |= do_rename(from, to, name, verbose, noact,
+						 nooverwrite, interactive);
+		}
+		free(name);
+	}
+
+	if (dir_fd >= 0)
+		close(dir_fd);
+	free(dir_name);
+
 	switch (ret) {
 	case 0:
 		return RENAME_EXIT_NOTHING;
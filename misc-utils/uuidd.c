@@ -23,13 +23,16 @@
 #include <string.h>
 #include <getopt.h>
 #include <sys/signalfd.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
 
 #include "uuid.h"
 #include "uuidd.h"
 #include "all-io.h"
 #include "c.h"
 #include "closestream.h"
+#include "list.h"
+#include "xalloc.h"
 #include "strutils.h"
 #include "optutils.h"
 #include "monotonic.h"
@@ -44,15 +47,107 @@
 /* length of binary representation of UUID */
 #define UUID_LEN	(sizeof(uuid_t))
 
+/* max size of one reply */
+#define UUIDD_REPLY_MAX		1024
+
+/* max size of not yet written replies, the requests are not read if exceeded */
+#define UUIDD_CONN_MAXOUT	(64 * 1024)
+
+/* max number of events from one epoll_wait() */
+#define UUIDD_MAX_EVENTS	64
+
+/* max number of shared memory rings (one ring for every client UID) */
+#define UUIDD_MAX_RINGS		16
+
+/* rings refill interval in msec */
+#define UUIDD_RING_REFILL	50
+
+/* the rings are refilled only if used in the last number of usec */
+#define UUIDD_RING_ACTIVE	1000000
+
+/* number of refill intervals, the slot is reclaimed if TAKEN so long time */
+#define UUIDD_RING_RECLAIM	20
+
+/* number of log2 latency histogram buckets (nsec) */
+#define UUIDD_LATENCY_BUCKETS	32
+
+/* statistics for UUIDD_OP_STATS */
+struct uuidd_stats {
+	uint64_t	requests[UUIDD_MAX_OP + 1];	/* per operation */
+	uint64_t	invalid;			/* unknown operations */
+	uint64_t	uuids;				/* generated UUIDs */
+	uint64_t	bulk_uuids;			/* UUIDs by bulk requests */
+	uint64_t	bulk_max;			/* max bulk request size */
+	uint64_t	conns;				/* accepted connections */
+	uint64_t	pipeline_max;			/* max requests from one read() */
+	uint64_t	queue_max;			/* max events from one epoll_wait() */
+	uint64_t	ring_refills;
+	uint64_t	ring_reclaims;
+	uint64_t	latency[UUIDD_LATENCY_BUCKETS];	/* request service time */
+};
+
+static const char *op_names[] = {
+	[UUIDD_OP_GETPID]		= "getpid",
+	[UUIDD_OP_GET_MAXOP]		= "get-maxop",
+	[UUIDD_OP_TIME_UUID]		= "time",
+	[UUIDD_OP_RANDOM_UUID]		= "random",
+	[UUIDD_OP_BULK_TIME_UUID]	= "bulk-time",
+	[UUIDD_OP_BULK_RANDOM_UUID]	= "bulk-random",
+	[UUIDD_OP_TIME_V7_UUID]		= "time-v7",
+	[UUIDD_OP_BULK_TIME_V7_UUID]	= "bulk-time-v7",
+	[UUIDD_OP_GET_RING]		= "get-ring",
+	[UUIDD_OP_STATS]		= "stats"
+};
+
+struct uuidd_ring_ent {
+	uid_t			uid;
+	int			fd;		/* memfd */
+	size_t			size;
+	struct uuidd_ring	*ring;
+	unsigned int		taken[UUIDD_RING_NSLOTS]; /* refills in TAKEN state */
+	struct list_head	rings;		/* member of uuidd_cxt_t->rings */
+};
+
+/*
+ * Client connection. The connection is kept open after reply, so the client
+ * can send more requests, and several requests may be sent at once
+ * (pipelined) without waiting for the replies.
+ */
+struct uuidd_conn {
+	int			fd;
+	uid_t			uid;		/* peer UID */
+	uint32_t		events;		/* epoll events */
+	int			sendfd;		/* fd to send or -1 */
+	size_t			sendfd_off;	/* send it with this output byte */
+	struct list_head	conns;		/* member of uuidd_cxt_t->conns */
+
+	char			req[1 + sizeof(int)];	/* incomplete request */
+	size_t			reqlen;
+
+	char			*out;		/* replies to write */
+	size_t			outlen;
+	size_t			outoff;		/* already written */
+	size_t			outsz;		/* allocated size */
+};
+
 /* server loop control structure */
 struct uuidd_cxt_t {
 	const char	*cleanup_pidfile;
 	const char	*cleanup_socket;
 	uint32_t	timeout;
+	int		sock;		/* listening socket */
+	int		efd;		/* epoll */
+	struct list_head conns;		/* client connections */
+	struct list_head rings;		/* shared memory rings */
+	size_t		nrings;
+	struct timeval	ring_used;	/* last rings activity */
+	size_t		nconns;		/* current connections */
+	struct uuidd_stats stats;
 	unsigned int	debug: 1,
 			quiet: 1,
 			no_fork: 1,
-			no_sock: 1;
+			no_sock: 1,
+			accept_paused: 1;
 };
 
 static void __attribute__((__noreturn__)) usage(void)
@@ -69,7 +164,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -k, --kill              kill running daemon\n"), out);
 	fputs(_(" -r, --random            test random-based generation\n"), out);
 	fputs(_(" -t, --time              test time-based generation\n"), out);
+	fputs(_(" -7, --time-v7           test time-ordered (v7) generation\n"), out);
 	fputs(_(" -n, --uuids <num>       request number of uuids\n"), out);
+	fputs(_("     --stats             print statistics of running daemon\n"), out);
 	fputs(_(" -P, --no-pid            do not create pid file\n"), out);
 	fputs(_(" -F, --no-fork           do not daemonize using double-fork\n"), out);
 	fputs(_(" -S, --socket-activation do not create listening socket\n"), out);
@@ -104,7 +201,8 @@ static int call_daemon(const char *socket_path, int op, char *buf,
 	struct sockaddr_un srv_addr;
 
 	if (((op == UUIDD_OP_BULK_TIME_UUID) ||
-	     (op == UUIDD_OP_BULK_RANDOM_UUID)) && !num) {
+	     (op == UUIDD_OP_BULK_RANDOM_UUID) ||
+	     (op == UUIDD_OP_BULK_TIME_V7_UUID)) && !num) {
 		if (err_context)
 			*err_context = _("bad arguments");
 		errno = EINVAL;
@@ -129,14 +227,16 @@ static int call_daemon(const char *socket_path, int op, char *buf,
 		return -1;
 	}
 
-	if (op == UUIDD_OP_BULK_RANDOM_UUID) {
+	if ((op == UUIDD_OP_BULK_RANDOM_UUID) ||
+	    (op == UUIDD_OP_BULK_TIME_V7_UUID)) {
 		if ((*num) * UUID_LEN > buflen - 4)
 			*num = (buflen - 4) / UUID_LEN;
 	}
 	op_buf[0] = op;
 	op_len = 1;
 	if ((op == UUIDD_OP_BULK_TIME_UUID) ||
-	    (op == UUIDD_OP_BULK_RANDOM_UUID)) {
+	    (op == UUIDD_OP_BULK_RANDOM_UUID) ||
+	    (op == UUIDD_OP_BULK_TIME_V7_UUID)) {
 		memcpy(op_buf + 1, num, sizeof(int));
 		op_len += sizeof(int);
 	}
@@ -170,7 +270,8 @@ static int call_daemon(const char *socket_path, int op, char *buf,
 		else
 			*num = -1;
 	}
-	if ((ret > 0) && (op == UUIDD_OP_BULK_RANDOM_UUID)) {
+	if ((ret > 0) && ((op == UUIDD_OP_BULK_RANDOM_UUID) ||
+			  (op == UUIDD_OP_BULK_TIME_V7_UUID))) {
 		if (reply_len >= (int) sizeof(int))
 			memcpy(buf, num, sizeof(int));
 		else
@@ -270,6 +371,16 @@ static int create_socket(struct uuidd_cxt_t *uuidd_cxt,
 
 static void __attribute__((__noreturn__)) all_done(const struct uuidd_cxt_t *uuidd_cxt, int ret)
 {
+	struct list_head *p;
+
+	if (uuidd_cxt->rings.next) {
+		/* don't use the rings after exit */
+		list_for_each(p, &uuidd_cxt->rings) {
+			struct uuidd_ring_ent *re = list_entry(p,
+						struct uuidd_ring_ent, rings);
+			__atomic_store_n(&re->ring->closed, 1, __ATOMIC_RELEASE);
+		}
+	}
 	if (uuidd_cxt->cleanup_pidfile)
 		unlink(uuidd_cxt->cleanup_pidfile);
 	if (uuidd_cxt->cleanup_socket)
@@ -304,27 +415,620 @@ static void timeout_handler(int sig __attribute__((__unused__)),
 		errx(EXIT_FAILURE, _("timed out"));
 }
 
+/* the bulk requests are followed by number of UUIDs */
+static inline int is_bulk_op(int op)
+{
+	return op == UUIDD_OP_BULK_TIME_UUID ||
+	       op == UUIDD_OP_BULK_RANDOM_UUID ||
+	       op == UUIDD_OP_BULK_TIME_V7_UUID;
+}
+
+/*
+ * Generates reply for the request @op to @reply_buf (UUIDD_REPLY_MAX bytes).
+ * Returns length of the reply or -1 for unknown operation.
+ */
+static int32_t process_request(struct uuidd_cxt_t *uuidd_cxt,
+			       int op, int num, char *reply_buf)
+{
+	int32_t			reply_len;
+	uuid_t			uu;
+	char			str[UUID_STR_LEN], *cp;
+	int			i;
+
+	if (uuidd_cxt->debug) {
+		if (is_bulk_op(op))
+			fprintf(stderr, _("operation %d, incoming num = %d\n"),
+			       op, num);
+		else
+			fprintf(stderr, _("operation %d\n"), op);
+	}
+
+	switch (op) {
+	case UUIDD_OP_GETPID:
+		sprintf(reply_buf, "%d", getpid());
+		reply_len = strlen(reply_buf) + 1;
+		break;
+	case UUIDD_OP_GET_MAXOP:
+		sprintf(reply_buf, "%d", UUIDD_MAX_OP);
+		reply_len = strlen(reply_buf) + 1;
+		break;
+	case UUIDD_OP_TIME_UUID:
+		num = 1;
+		__uuid_generate_time(uu, &num);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated time UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_RANDOM_UUID:
+		num = 1;
+		__uuid_generate_random(uu, &num);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated random UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_BULK_TIME_UUID:
+		__uuid_generate_time(uu, &num);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, P_("Generated time UUID %s "
+					   "and %d following\n",
+					   "Generated time UUID %s "
+					   "and %d following\n", num - 1),
+			       str, num - 1);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		memcpy(reply_buf + reply_len, &num, sizeof(num));
+		reply_len += sizeof(num);
+		break;
+	case UUIDD_OP_BULK_RANDOM_UUID:
+		if (num < 0)
+			num = 1;
+		if (num > 1000)
+			num = 1000;
+		if (num * UUID_LEN > (int) (UUIDD_REPLY_MAX - sizeof(num)))
+			num = (UUIDD_REPLY_MAX - sizeof(num)) / UUID_LEN;
+		__uuid_generate_random((unsigned char *) reply_buf +
+				      sizeof(num), &num);
+		if (uuidd_cxt->debug) {
+			fprintf(stderr, P_("Generated %d UUID:\n",
+					   "Generated %d UUIDs:\n", num), num);
+			for (i = 0, cp = reply_buf + sizeof(num);
+			     i < num;
+			     i++, cp += UUID_LEN) {
+				uuid_unparse((unsigned char *)cp, str);
+				fprintf(stderr, "\t%s\n", str);
+			}
+		}
+		reply_len = (num * UUID_LEN) + sizeof(num);
+		memcpy(reply_buf, &num, sizeof(num));
+		break;
+	case UUIDD_OP_TIME_V7_UUID:
+		num = 1;
+		uuid_generate_time_v7(uu);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated time-v7 UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_BULK_TIME_V7_UUID:
+		if (num < 0)
+			num = 1;
+		if (num > 1000)
+			num = 1000;
+		if (num * UUID_LEN > (int) (UUIDD_REPLY_MAX - sizeof(num)))
+			num = (UUIDD_REPLY_MAX - sizeof(num)) / UUID_LEN;
+		uuid_generate_time_v7_bulk((uuid_t *) (reply_buf +
+					   sizeof(num)), num);
+		if (uuidd_cxt->debug) {
+			fprintf(stderr, P_("Generated %d time-v7 UUID:\n",
+					   "Generated %d time-v7 UUIDs:\n", num), num);
+			for (i = 0, cp = reply_buf + sizeof(num);
+			     i < num;
+			     i++, cp += UUID_LEN) {
+				uuid_unparse((unsigned char *)cp, str);
+				fprintf(stderr, "\t%s\n", str);
+			}
+		}
+		reply_len = (num * UUID_LEN) + sizeof(num);
+		memcpy(reply_buf, &num, sizeof(num));
+		break;
+	default:
+		if (uuidd_cxt->debug)
+			fprintf(stderr, _("Invalid operation %d\n"), op);
+		return -1;
+	}
+
+	/* all operations between TIME_UUID and BULK_TIME_V7_UUID generate UUIDs */
+	if (op >= UUIDD_OP_TIME_UUID && op <= UUIDD_OP_BULK_TIME_V7_UUID) {
+		uuidd_cxt->stats.uuids += num;
+		if (is_bulk_op(op)) {
+			uuidd_cxt->stats.bulk_uuids += num;
+			uuidd_cxt->stats.bulk_max = max(uuidd_cxt->stats.bulk_max,
+							(uint64_t) num);
+		}
+	}
+	return reply_len;
+}
+
+/* returns the upper bound (nsec) of the latency histogram @q quantile */
+static uint64_t latency_quantile(const struct uuidd_stats *st, double q)
+{
+	uint64_t total = 0, sum = 0;
+	size_t i;
+
+	for (i = 0; i < UUIDD_LATENCY_BUCKETS; i++)
+		total += st->latency[i];
+	if (!total)
+		return 0;
+	for (i = 0; i < UUIDD_LATENCY_BUCKETS; i++) {
+		sum += st->latency[i];
+		if (sum >= total * q)
+			break;
+	}
+	return (uint64_t) 1 << (i + 1);
+}
+
+/* counts the request and its service time since @start */
+static void account_request(struct uuidd_cxt_t *uuidd_cxt, int op,
+			    const struct timespec *start)
+{
+	struct uuidd_stats *st = &uuidd_cxt->stats;
+	struct timespec now;
+	uint64_t ns;
+	size_t b = 0;
+
+	if (op >= 0 && op <= UUIDD_MAX_OP)
+		st->requests[op]++;
+	else
+		st->invalid++;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (now.tv_sec - start->tv_sec) * 1000000000ULL
+	     + now.tv_nsec - start->tv_nsec;
+	while (ns >>= 1)
+		b++;
+	st->latency[min(b, (size_t) UUIDD_LATENCY_BUCKETS - 1)]++;
+}
+
+/*
+ * Replies to UUIDD_OP_STATS, the reply is a string with "<name> <value>"
+ * lines.
+ */
+static int32_t stats_request(struct uuidd_cxt_t *uuidd_cxt, char *reply_buf)
+{
+	const struct uuidd_stats *st = &uuidd_cxt->stats;
+	size_t i, sz = UUIDD_REPLY_MAX, len = 0;
+
+	if (uuidd_cxt->debug)
+		fprintf(stderr, _("operation %d\n"), UUIDD_OP_STATS);
+
+#define stats_add(_name, _val) \
+	do { \
+		int _n = snprintf(reply_buf + len, sz - len, "%s %" PRIu64 "\n", \
+				  _name, (uint64_t) (_val)); \
+		if (_n > 0 && (size_t) _n < sz - len) \
+			len += _n; \
+	} while (0)
+
+	for (i = 0; i < ARRAY_SIZE(op_names); i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "requests-%s", op_names[i]);
+		stats_add(name, st->requests[i]);
+	}
+	stats_add("requests-invalid", st->invalid);
+	stats_add("uuids", st->uuids);
+	stats_add("bulk-uuids", st->bulk_uuids);
+	stats_add("bulk-max", st->bulk_max);
+	stats_add("connections", uuidd_cxt->nconns);
+	stats_add("connections-total", st->conns);
+	stats_add("pipeline-max", st->pipeline_max);
+	stats_add("queue-max", st->queue_max);
+	stats_add("rings", uuidd_cxt->nrings);
+	stats_add("ring-refills", st->ring_refills);
+	stats_add("ring-reclaims", st->ring_reclaims);
+	stats_add("clock-seq-bumps", __uuid_get_clock_bumps());
+	stats_add("latency-p50-ns", latency_quantile(st, 0.5));
+	stats_add("latency-p99-ns", latency_quantile(st, 0.99));
+#undef stats_add
+
+	return len + 1;		/* including terminating zero */
+}
+
+static int64_t ring_time_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Refills EMPTY slots, reclaims slots TAKEN for too long time, and refreshes
+ * too old READY slots. Returns number of slots used by clients since the
+ * last refill.
+ */
+static int refill_ring(struct uuidd_cxt_t *uuidd_cxt, struct uuidd_ring_ent *re)
+{
+	struct uuidd_ring *ring = re->ring;
+	int64_t now = ring_time_now();
+	uint32_t i;
+	int used = 0;
+
+	for (i = 0; i < ring->nslots; i++) {
+		struct uuidd_ring_slot *sl = &ring->slots[i];
+		uint64_t st = __atomic_load_n(&sl->state, __ATOMIC_ACQUIRE);
+		uint64_t fill;
+		int num;
+
+		switch (UUIDD_SLOT_STATUS(st)) {
+		case UUIDD_SLOT_EMPTY:
+			used++;
+			break;
+		case UUIDD_SLOT_TAKEN:
+			if (++re->taken[i] < UUIDD_RING_RECLAIM)
+				continue;
+			uuidd_cxt->stats.ring_reclaims++;
+			break;
+		case UUIDD_SLOT_READY:
+			if (now - sl->time < UUIDD_RING_MAXAGE)
+				continue;
+			break;
+		default:
+			continue;
+		}
+
+		/* new generation, the TAKEN -> EMPTY by client will fail */
+		re->taken[i] = 0;
+		fill = UUIDD_SLOT_STATE(st + 4, UUIDD_SLOT_FILLING);
+		if (!__atomic_compare_exchange_n(&sl->state, &st, fill, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			continue;
+
+		num = UUIDD_RING_RANGE;
+		__uuid_generate_time(sl->uu, &num);
+		uuidd_cxt->stats.ring_refills++;
+		sl->num = num;
+		sl->time = now;
+		__atomic_store_n(&sl->state,
+				 UUIDD_SLOT_STATE(fill, UUIDD_SLOT_READY),
+				 __ATOMIC_RELEASE);
+	}
+	return used;
+}
+
+/* returns the ring for @uid, the ring is created on the first request */
+static struct uuidd_ring_ent *get_ring(struct uuidd_cxt_t *uuidd_cxt, uid_t uid)
+{
+	struct uuidd_ring_ent *re;
+	struct list_head *p;
+
+	list_for_each(p, &uuidd_cxt->rings) {
+		re = list_entry(p, struct uuidd_ring_ent, rings);
+		if (re->uid == uid)
+			return re;
+	}
+
+#ifdef HAVE_MEMFD_CREATE
+	if (uuidd_cxt->nrings >= UUIDD_MAX_RINGS)
+		return NULL;
+
+	re = xcalloc(1, sizeof(*re));
+	re->uid = uid;
+	re->size = sizeof(struct uuidd_ring)
+		   + UUIDD_RING_NSLOTS * sizeof(struct uuidd_ring_slot);
+
+	re->fd = memfd_create("uuidd-ring", MFD_CLOEXEC);
+	if (re->fd < 0 || ftruncate(re->fd, re->size) != 0)
+		goto fail;
+	re->ring = mmap(NULL, re->size, PROT_READ | PROT_WRITE,
+			MAP_SHARED, re->fd, 0);
+	if (re->ring == MAP_FAILED)
+		goto fail;
+
+	re->ring->magic = UUIDD_RING_MAGIC;
+	re->ring->nslots = UUIDD_RING_NSLOTS;
+	refill_ring(uuidd_cxt, re);
+
+	INIT_LIST_HEAD(&re->rings);
+	list_add_tail(&re->rings, &uuidd_cxt->rings);
+	uuidd_cxt->nrings++;
+
+	if (uuidd_cxt->debug)
+		fprintf(stderr, _("Created ring for UID %u\n"), (unsigned int) uid);
+	return re;
+fail:
+	if (uuidd_cxt->debug)
+		warn(_("cannot create ring"));
+	if (re->fd >= 0)
+		close(re->fd);
+	free(re);
+#endif
+	return NULL;
+}
+
+/* returns true if the rings have been used recently */
+static int rings_active(struct uuidd_cxt_t *uuidd_cxt)
+{
+	struct timeval now, diff;
+
+	if (list_empty(&uuidd_cxt->rings))
+		return 0;
+
+	gettime_monotonic(&now);
+	timersub(&now, &uuidd_cxt->ring_used, &diff);
+	return diff.tv_sec * 1000000 + diff.tv_usec < UUIDD_RING_ACTIVE;
+}
+
+static void refill_rings(struct uuidd_cxt_t *uuidd_cxt)
+{
+	struct list_head *p;
+	int used = 0;
+
+	list_for_each(p, &uuidd_cxt->rings)
+		used += refill_ring(uuidd_cxt,
+				list_entry(p, struct uuidd_ring_ent, rings));
+	if (used)
+		gettime_monotonic(&uuidd_cxt->ring_used);
+}
+
+/*
+ * Replies to UUIDD_OP_GET_RING, the reply is the size of the ring and the
+ * ring file descriptor is attached to the reply. The reply is empty if the
+ * ring is not available.
+ */
+static int32_t ring_request(struct uuidd_cxt_t *uuidd_cxt,
+			    struct uuidd_conn *cn, char *reply_buf)
+{
+	struct uuidd_ring_ent *re;
+	uint32_t sz;
+
+	if (uuidd_cxt->debug)
+		fprintf(stderr, _("operation %d\n"), UUIDD_OP_GET_RING);
+
+	if (cn->sendfd >= 0 || cn->uid == (uid_t) -1)
+		return 0;	/* only one pending fd per connection */
+	re = get_ring(uuidd_cxt, cn->uid);
+	if (!re)
+		return 0;
+
+	cn->sendfd = re->fd;
+	cn->sendfd_off = cn->outlen + sizeof(int32_t);	/* after the length */
+	gettime_monotonic(&uuidd_cxt->ring_used);
+
+	sz = re->size;
+	memcpy(reply_buf, &sz, sizeof(sz));
+	return sizeof(sz);
+}
+
+/* sends @buf with the file descriptor @fd */
+static ssize_t send_with_fd(int sock, const char *buf, size_t len, int fd)
+{
+	union {
+		struct cmsghdr	cmh;
+		char		buf[CMSG_SPACE(sizeof(int))];
+	} cbuf;
+	struct msghdr msg = { .msg_name = NULL };
+	struct cmsghdr *cmh;
+	struct iovec iov;
+
+	iov.iov_base = (char *) buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	memset(&cbuf, 0, sizeof(cbuf));
+	msg.msg_control = cbuf.buf;
+	msg.msg_controllen = sizeof(cbuf.buf);
+
+	cmh = CMSG_FIRSTHDR(&msg);
+	cmh->cmsg_level = SOL_SOCKET;
+	cmh->cmsg_type = SCM_RIGHTS;
+	cmh->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmh), &fd, sizeof(int));
+
+	return sendmsg(sock, &msg, MSG_NOSIGNAL);
+}
+
+static void conn_set_events(struct uuidd_cxt_t *uuidd_cxt, struct uuidd_conn *cn)
+{
+	struct epoll_event ev = { .events = 0, .data.ptr = cn };
+
+	/* don't read more requests if the client does not read replies */
+	if (cn->outlen - cn->outoff < UUIDD_CONN_MAXOUT)
+		ev.events |= EPOLLIN;
+	if (cn->outoff < cn->outlen)
+		ev.events |= EPOLLOUT;
+	if (ev.events == cn->events)
+		return;
+	if (epoll_ctl(uuidd_cxt->efd, EPOLL_CTL_MOD, cn->fd, &ev) < 0)
+		err(EXIT_FAILURE, _("epoll_ctl failed"));
+	cn->events = ev.events;
+}
+
+static void conn_close(struct uuidd_cxt_t *uuidd_cxt, struct uuidd_conn *cn)
+{
+	epoll_ctl(uuidd_cxt->efd, EPOLL_CTL_DEL, cn->fd, NULL);
+	close(cn->fd);
+	list_del(&cn->conns);
+	free(cn->out);
+	free(cn);
+	uuidd_cxt->nconns--;
+
+	/* a file descriptor is available again */
+	if (uuidd_cxt->accept_paused) {
+		struct epoll_event ev = { .events = EPOLLIN,
+					  .data.ptr = &uuidd_cxt->sock };
+
+		if (epoll_ctl(uuidd_cxt->efd, EPOLL_CTL_ADD, uuidd_cxt->sock, &ev) < 0)
+			err(EXIT_FAILURE, _("epoll_ctl failed"));
+		uuidd_cxt->accept_paused = 0;
+	}
+}
+
+static void conn_append(struct uuidd_conn *cn, const char *data, size_t sz)
+{
+	if (cn->outlen + sz > cn->outsz) {
+		cn->outsz = max(cn->outsz * 2, cn->outlen + sz);
+		cn->out = xrealloc(cn->out, cn->outsz);
+	}
+	memcpy(cn->out + cn->outlen, data, sz);
+	cn->outlen += sz;
+}
+
+/* Writes pending replies. Returns 0 or -1 if the connection is broken. */
+static int conn_flush(struct uuidd_conn *cn)
+{
+	while (cn->outoff < cn->outlen) {
+		size_t len = cn->outlen - cn->outoff;
+		ssize_t ret;
+
+		if (cn->sendfd >= 0 && cn->outoff < cn->sendfd_off)
+			len = cn->sendfd_off - cn->outoff;
+
+		if (cn->sendfd >= 0 && cn->outoff == cn->sendfd_off) {
+			ret = send_with_fd(cn->fd, cn->out + cn->outoff,
+					   len, cn->sendfd);
+			if (ret > 0)
+				cn->sendfd = -1;
+		} else
+			ret = send(cn->fd, cn->out + cn->outoff, len,
+				   MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return 0;
+			return -1;
+		}
+		cn->outoff += ret;
+	}
+	cn->outoff = cn->outlen = 0;
+	return 0;
+}
+
+/*
+ * Reads and processes all complete requests, the replies are added to the
+ * connection output buffer. Returns 0 or -1 if the connection is closed
+ * or broken.
+ */
+static int conn_read(struct uuidd_cxt_t *uuidd_cxt, struct uuidd_conn *cn)
+{
+	char		buf[512], reply_buf[UUIDD_REPLY_MAX];
+	ssize_t		len, i;
+	uint64_t	nreqs = 0;
+
+	len = read(cn->fd, buf, sizeof(buf));
+	if (len < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (len <= 0) {
+		if (len < 0 && uuidd_cxt->debug)
+			warn(_("read failed"));
+		return -1;
+	}
+
+	for (i = 0; i < len; i++) {
+		struct timespec start;
+		int32_t reply_len;
+		int op, num = 0;
+
+		cn->req[cn->reqlen++] = buf[i];
+		op = cn->req[0];
+		if (is_bulk_op(op)) {
+			if (cn->reqlen < sizeof(cn->req))
+				continue;
+			memcpy(&num, cn->req + 1, sizeof(num));
+		}
+		cn->reqlen = 0;
+		nreqs++;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (op == UUIDD_OP_GET_RING)
+			reply_len = ring_request(uuidd_cxt, cn, reply_buf);
+		else if (op == UUIDD_OP_STATS)
+			reply_len = stats_request(uuidd_cxt, reply_buf);
+		else
+			reply_len = process_request(uuidd_cxt, op, num, reply_buf);
+		account_request(uuidd_cxt, op, &start);
+		if (reply_len < 0)
+			return -1;
+		conn_append(cn, (char *) &reply_len, sizeof(reply_len));
+		conn_append(cn, reply_buf, reply_len);
+	}
+	uuidd_cxt->stats.pipeline_max = max(uuidd_cxt->stats.pipeline_max, nreqs);
+	return 0;
+}
+
+static uid_t get_peer_uid(int fd)
+{
+	struct ucred cr;
+	socklen_t sz = sizeof(cr);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cr, &sz) != 0)
+		return (uid_t) -1;
+	return cr.uid;
+}
+
+static void accept_conns(struct uuidd_cxt_t *uuidd_cxt)
+{
+	for (;;) {
+		struct epoll_event ev = { .events = EPOLLIN };
+		struct uuidd_conn *cn;
+		int ns;
+
+		ns = accept4(uuidd_cxt->sock, NULL, NULL,
+			     SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (ns < 0) {
+			if (errno == EAGAIN || errno == EINTR ||
+			    errno == ECONNABORTED)
+				return;
+			if (errno == EMFILE || errno == ENFILE) {
+				/* wait for conn_close() */
+				if (uuidd_cxt->debug)
+					warn(_("cannot accept new connection"));
+				epoll_ctl(uuidd_cxt->efd, EPOLL_CTL_DEL,
+					  uuidd_cxt->sock, NULL);
+				uuidd_cxt->accept_paused = 1;
+				return;
+			}
+			err(EXIT_FAILURE, "accept");
+		}
+
+		cn = xcalloc(1, sizeof(*cn));
+		cn->fd = ns;
+		cn->events = ev.events;
+		cn->sendfd = -1;
+		cn->uid = get_peer_uid(ns);
+		INIT_LIST_HEAD(&cn->conns);
+		list_add_tail(&cn->conns, &uuidd_cxt->conns);
+		uuidd_cxt->nconns++;
+		uuidd_cxt->stats.conns++;
+
+		ev.data.ptr = cn;
+		if (epoll_ctl(uuidd_cxt->efd, EPOLL_CTL_ADD, ns, &ev) < 0)
+			err(EXIT_FAILURE, _("epoll_ctl failed"));
+	}
+}
+
 static void server_loop(const char *socket_path, const char *pidfile_path,
 			struct uuidd_cxt_t *uuidd_cxt)
 {
-	struct sockaddr_un	from_addr;
-	socklen_t		fromlen;
-	int32_t			reply_len = 0;
-	uuid_t			uu;
-	char			reply_buf[1024], *cp;
-	char			op, str[UUID_STR_LEN];
-	int			i, ns, len;
-	int			num;		/* intentionally uninitialized */
+	char			reply_buf[1024];
 	int			s = 0;
 	int			fd_pidfile = -1;
-	int			ret;
-	struct pollfd		pfd[2];
+	int			ret, i;
+	struct epoll_event	ev, events[UUIDD_MAX_EVENTS];
 	sigset_t		sigmask;
 	int			sigfd;
-	enum {
-				POLLFD_SIGNAL = 0,
-				POLLFD_SOCKET
-	};
 
 #ifdef HAVE_LIBSYSTEMD
 	if (!uuidd_cxt->no_sock)	/* no_sock implies no_fork and no_pid */
@@ -400,131 +1104,76 @@ static void server_loop(const char *socket_path, const char *pidfile_path,
 	if ((sigfd = signalfd(-1, &sigmask, 0)) < 0)
 		err(EXIT_FAILURE, _("cannot set signal handler"));
 
-	pfd[POLLFD_SIGNAL].fd = sigfd;
-	pfd[POLLFD_SOCKET].fd = s;
-	pfd[POLLFD_SIGNAL].events = pfd[POLLFD_SOCKET].events = POLLIN | POLLERR | POLLHUP;
+	uuidd_cxt->sock = s;
+	uuidd_cxt->efd = epoll_create1(EPOLL_CLOEXEC);
+	if (uuidd_cxt->efd < 0)
+		err(EXIT_FAILURE, _("cannot create epoll"));
+	INIT_LIST_HEAD(&uuidd_cxt->conns);
+	INIT_LIST_HEAD(&uuidd_cxt->rings);
+
+	if (fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) < 0)
+		err(EXIT_FAILURE, "fcntl");
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &sigfd;
+	if (epoll_ctl(uuidd_cxt->efd, EPOLL_CTL_ADD, sigfd, &ev) < 0)
+		err(EXIT_FAILURE, _("epoll_ctl failed"));
+	ev.data.ptr = &uuidd_cxt->sock;
+	if (epoll_ctl(uuidd_cxt->efd, EPOLL_CTL_ADD, s, &ev) < 0)
+		err(EXIT_FAILURE, _("epoll_ctl failed"));
 
 	while (1) {
-		ret = poll(pfd, ARRAY_SIZE(pfd),
+		int active = rings_active(uuidd_cxt);
+
+		ret = epoll_wait(uuidd_cxt->efd, events, ARRAY_SIZE(events),
+				active ? UUIDD_RING_REFILL :
 				uuidd_cxt->timeout ?
 					(int) uuidd_cxt->timeout * 1000 : -1);
 		if (ret < 0) {
-			if (errno == EAGAIN)
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			warn(_("epoll failed"));
+			all_done(uuidd_cxt, EXIT_FAILURE);
+		}
+		if (active || (ret > 0 && !list_empty(&uuidd_cxt->rings))) {
+			/* any request also wakes up rings refill */
+			if (ret > 0)
+				gettime_monotonic(&uuidd_cxt->ring_used);
+			refill_rings(uuidd_cxt);
+			if (ret == 0)
 				continue;
-			warn(_("poll failed"));
-				all_done(uuidd_cxt, EXIT_FAILURE);
 		}
-		if (ret == 0) {		/* true when poll() times out */
+		uuidd_cxt->stats.queue_max = max(uuidd_cxt->stats.queue_max,
+						 (uint64_t) ret);
+		if (ret == 0) {		/* true when epoll_wait() times out */
 			if (uuidd_cxt->debug)
 				fprintf(stderr, _("timeout [%d sec]\n"), uuidd_cxt->timeout),
 			all_done(uuidd_cxt, EXIT_SUCCESS);
 		}
-		if (pfd[POLLFD_SIGNAL].revents != 0)
-			handle_signal(uuidd_cxt, sigfd);
-		if (pfd[POLLFD_SOCKET].revents == 0)
-			continue;
-		fromlen = sizeof(from_addr);
-		ns = accept(s, (struct sockaddr *) &from_addr, &fromlen);
-		if (ns < 0) {
-			if ((errno == EAGAIN) || (errno == EINTR))
-				continue;
-			else
-				err(EXIT_FAILURE, "accept");
-		}
-		len = read(ns, &op, 1);
-		if (len != 1) {
-			if (len < 0)
-				warn(_("read failed"));
-			else
-				warnx(_("error reading from client, len = %d"),
-						len);
-			goto shutdown_socket;
-		}
-		if ((op == UUIDD_OP_BULK_TIME_UUID) ||
-		    (op == UUIDD_OP_BULK_RANDOM_UUID)) {
-			if (read_all(ns, (char *) &num, sizeof(num)) != 4)
-				goto shutdown_socket;
-			if (uuidd_cxt->debug)
-				fprintf(stderr, _("operation %d, incoming num = %d\n"),
-				       op, num);
-		} else if (uuidd_cxt->debug)
-			fprintf(stderr, _("operation %d\n"), op);
 
-		switch (op) {
-		case UUIDD_OP_GETPID:
-			sprintf(reply_buf, "%d", getpid());
-			reply_len = strlen(reply_buf) + 1;
-			break;
-		case UUIDD_OP_GET_MAXOP:
-			sprintf(reply_buf, "%d", UUIDD_MAX_OP);
-			reply_len = strlen(reply_buf) + 1;
-			break;
-		case UUIDD_OP_TIME_UUID:
-			num = 1;
-			__uuid_generate_time(uu, &num);
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, _("Generated time UUID: %s\n"), str);
-			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			break;
-		case UUIDD_OP_RANDOM_UUID:
-			num = 1;
-			__uuid_generate_random(uu, &num);
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, _("Generated random UUID: %s\n"), str);
+		for (i = 0; i < ret; i++) {
+			struct uuidd_conn *cn;
+
+			if (events[i].data.ptr == &sigfd) {
+				handle_signal(uuidd_cxt, sigfd);
+				continue;
 			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			break;
-		case UUIDD_OP_BULK_TIME_UUID:
-			__uuid_generate_time(uu, &num);
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, P_("Generated time UUID %s "
-						   "and %d following\n",
-						   "Generated time UUID %s "
-						   "and %d following\n", num - 1),
-				       str, num - 1);
+			if (events[i].data.ptr == &uuidd_cxt->sock) {
+				accept_conns(uuidd_cxt);
+				continue;
 			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			memcpy(reply_buf + reply_len, &num, sizeof(num));
-			reply_len += sizeof(num);
-			break;
-		case UUIDD_OP_BULK_RANDOM_UUID:
-			if (num < 0)
-				num = 1;
-			if (num > 1000)
-				num = 1000;
-			if (num * UUID_LEN > (int) (sizeof(reply_buf) - sizeof(num)))
-				num = (sizeof(reply_buf) - sizeof(num)) / UUID_LEN;
-			__uuid_generate_random((unsigned char *) reply_buf +
-					      sizeof(num), &num);
-			if (uuidd_cxt->debug) {
-				fprintf(stderr, P_("Generated %d UUID:\n",
-						   "Generated %d UUIDs:\n", num), num);
-				for (i = 0, cp = reply_buf + sizeof(num);
-				     i < num;
-				     i++, cp += UUID_LEN) {
-					uuid_unparse((unsigned char *)cp, str);
-					fprintf(stderr, "\t%s\n", str);
-				}
+
+			/* all replies for requests from one read() are
+			 * written by one send() */
+			cn = events[i].data.ptr;
+			if (((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			      && conn_read(uuidd_cxt, cn) != 0)
+			    || conn_flush(cn) != 0) {
+				conn_close(uuidd_cxt, cn);
+				continue;
 			}
-			reply_len = (num * UUID_LEN) + sizeof(num);
-			memcpy(reply_buf, &num, sizeof(num));
-			break;
-		default:
-			if (uuidd_cxt->debug)
-				fprintf(stderr, _("Invalid operation %d\n"), op);
-			goto shutdown_socket;
+			conn_set_events(uuidd_cxt, cn);
 		}
-		write_all(ns, (char *) &reply_len, sizeof(reply_len));
-		write_all(ns, reply_buf, reply_len);
-	shutdown_socket:
-		close(ns);
 	}
 }
 
@@ -542,12 +1191,15 @@ int main(int argc, char **argv)
 	char		str[UUID_STR_LEN];
 	uuid_t		uu;
 	int		i, c, ret;
-	int		do_type = 0, do_kill = 0, num = 0;
+	int		do_type = 0, do_kill = 0, do_stats = 0, num = 0;
 	int		no_pid = 0;
 	int		s_flag = 0;
 
 	struct uuidd_cxt_t uuidd_cxt = { .timeout = 0 };
 
+	enum {
+		OPT_STATS = CHAR_MAX + 1
+	};
 	static const struct option longopts[] = {
 		{"pid", required_argument, NULL, 'p'},
 		{"socket", required_argument, NULL, 's'},
@@ -555,7 +1207,9 @@ int main(int argc, char **argv)
 		{"kill", no_argument, NULL, 'k'},
 		{"random", no_argument, NULL, 'r'},
 		{"time", no_argument, NULL, 't'},
+		{"time-v7", no_argument, NULL, '7'},
 		{"uuids", required_argument, NULL, 'n'},
+		{"stats", no_argument, NULL, OPT_STATS},
 		{"no-pid", no_argument, NULL, 'P'},
 		{"no-fork", no_argument, NULL, 'F'},
 		{"socket-activation", no_argument, NULL, 'S'},
@@ -568,7 +1222,7 @@ int main(int argc, char **argv)
 	static const ul_excl_t excl[] = {
 		{ 'P', 'p' },
 		{ 'd', 'q' },
-		{ 'r', 't' },
+		{ '7', 'r', 't' },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -579,7 +1233,7 @@ int main(int argc, char **argv)
 	close_stdout_atexit();
 
 	while ((c =
-		getopt_long(argc, argv, "p:s:T:krtn:PFSdqVh", longopts,
+		getopt_long(argc, argv, "p:s:T:krt7n:PFSdqVh", longopts,
 			    NULL)) != -1) {
 		err_exclusive_options(c, longopts, excl, excl_st);
 		switch (c) {
@@ -589,6 +1243,9 @@ int main(int argc, char **argv)
 		case 'k':
 			do_kill++;
 			break;
+		case OPT_STATS:
+			do_stats = 1;
+			break;
 		case 'n':
 			num = strtou32_or_err(optarg,
 						_("failed to parse --uuids"));
@@ -625,6 +1282,9 @@ int main(int argc, char **argv)
 		case 't':
 			do_type = UUIDD_OP_TIME_UUID;
 			break;
+		case '7':
+			do_type = UUIDD_OP_TIME_V7_UUID;
+			break;
 		case 'T':
 			uuidd_cxt.timeout = strtou32_or_err(optarg,
 						_("failed to parse --timeout"));
@@ -651,7 +1311,20 @@ int main(int argc, char **argv)
 			"Ignoring --socket."));
 
 	if (num && do_type) {
-		ret = call_daemon(socket_path, do_type + 2, buf,
+		int op;
+
+		switch (do_type) {
+		case UUIDD_OP_TIME_UUID:
+			op = UUIDD_OP_BULK_TIME_UUID;
+			break;
+		case UUIDD_OP_TIME_V7_UUID:
+			op = UUIDD_OP_BULK_TIME_V7_UUID;
+			break;
+		default:
+			op = UUIDD_OP_BULK_RANDOM_UUID;
+			break;
+		}
+		ret = call_daemon(socket_path, op, buf,
 				  sizeof(buf), &num, &err_context);
 		if (ret < 0)
 			err(EXIT_FAILURE, _("error calling uuidd daemon (%s)"),
@@ -693,6 +1366,17 @@ int main(int argc, char **argv)
 		return EXIT_SUCCESS;
 	}
 
+	if (do_stats) {
+		ret = call_daemon(socket_path, UUIDD_OP_STATS, buf,
+				  sizeof(buf) - 1, 0, &err_context);
+		if (ret < 0)
+			err(EXIT_FAILURE, _("error calling uuidd daemon (%s)"),
+					err_context ? : _("unexpected error"));
+		buf[ret] = '\0';
+		fputs(buf, stdout);
+		return EXIT_SUCCESS;
+	}
+
 	if (do_kill) {
 		ret = call_daemon(socket_path, UUIDD_OP_GETPID, buf, sizeof(buf), 0, NULL);
 		if ((ret > 0) && ((do_kill = atoi((char *) buf)) > 0)) {
@@ -12,11 +12,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "uuid.h"
 #include "nls.h"
 #include "c.h"
+#include "all-io.h"
 #include "closestream.h"
+#include "strutils.h"
+#include "xalloc.h"
+#include "linereader.h"
+
+/* number of UUIDs generated and written at once */
+#define UUIDGEN_BATCH	4096
+
+/* --output formats */
+enum {
+	OUT_TEXT = 0,
+	OUT_HEX,
+	OUT_BINARY
+};
 
 static void __attribute__((__noreturn__)) usage(void)
 {
@@ -31,11 +47,16 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -r, --random        generate random-based uuid\n"), out);
 	fputs(_(" -t, --time          generate time-based uuid\n"), out);
+	fputs(_(" -7, --time-v7       generate time-ordered (v7) uuid\n"), out);
 	fputs(_(" -n, --namespace ns  generate hash-based uuid in this namespace\n"), out);
 	fputs(_(" -N, --name name     generate hash-based uuid from this name\n"), out);
+	fputs(_(" -F, --name-file file\n"
+		"                     generate hash-based uuids from the lines of file\n"), out);
 	fputs(_(" -m, --md5           generate md5 hash\n"), out);
 	fputs(_(" -s, --sha1          generate sha1 hash\n"), out);
 	fputs(_(" -x, --hex           interpret name as hex string\n"), out);
+	fputs(_(" -C, --count num     generate more uuids in one run\n"), out);
+	fputs(_(" -o, --output fmt    output format: text, hex or binary\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(18));
 	printf(USAGE_MAN_TAIL("uuidgen(1)"));
@@ -78,26 +99,176 @@ badstring:
 	return value2;
 }
 
+static int parse_output_format(const char *fmt)
+{
+	if (strcmp(fmt, "text") == 0)
+		return OUT_TEXT;
+	if (strcmp(fmt, "hex") == 0)
+		return OUT_HEX;
+	if (strcmp(fmt, "binary") == 0)
+		return OUT_BINARY;
+
+	fprintf(stderr, "%s: unsupported output format '%s'\n", program_invocation_short_name, fmt);
+	errtryhelp(EXIT_FAILURE);
+}
+
+static void generate_uuids(int type, uuid_t *uu, size_t n)
+{
+	size_t i;
+
+	switch (type) {
+	case UUID_TYPE_DCE_RANDOM:
+		uuid_generate_random_bulk(uu, n);
+		break;
+	case UUID_TYPE_DCE_TIME_V7:
+		uuid_generate_time_v7_bulk(uu, n);
+		break;
+	case UUID_TYPE_DCE_TIME:
+		/* libuuid reserves bigger and bigger ranges from uuidd */
+		for (i = 0; i < n; i++)
+			uuid_generate_time(uu[i]);
+		break;
+	default:
+		for (i = 0; i < n; i++)
+			uuid_generate(uu[i]);
+		break;
+	}
+}
+
+static void write_uuids(int fmt, const uuid_t *uu, size_t n, char *buf);
+
+/*
+ * Generates hash-based UUIDs from the lines of @filename ("-" for stdin) by
+ * the bulk functions, the lines of one batch are copied to @arena.
+ */
+static void generate_from_file(int type, const uuid_t ns, const char *filename,
+			       int is_hex, int fmt)
+{
+	struct ul_linereader lr;
+	char *arena = NULL, *line, **names, *buf;
+	size_t arenasz = 0, used = 0, n = 0, *lens, *offs, i;
+	uuid_t *uus;
+	ssize_t sz;
+	int fd;
+
+	fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+	if (fd < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), filename);
+
+	names = xmalloc(UUIDGEN_BATCH * sizeof(char *));
+	lens = xmalloc(UUIDGEN_BATCH * sizeof(size_t));
+	offs = xmalloc(UUIDGEN_BATCH * sizeof(size_t));
+	uus = xmalloc(UUIDGEN_BATCH * sizeof(uuid_t));
+	buf = xmalloc(UUIDGEN_BATCH * UUID_STR_LEN);
+
+	ul_init_linereader(&lr, fd);
+	do {
+		sz = ul_linereader_next(&lr, &line);
+		if (sz < 0)
+			err(EXIT_FAILURE, _("read failed: %s"), filename);
+		if (sz > 0) {
+			size_t len = sz;
+			char *name = line;
+
+			if (line[len - 1] == '\n')
+				len--;
+			if (is_hex)
+				name = unhex(line, &len);
+			if (used + len > arenasz) {
+				arenasz = max(arenasz * 2, used + len);
+				arena = xrealloc(arena, arenasz);
+			}
+			memcpy(arena + used, name, len);
+			offs[n] = used;
+			lens[n++] = len;
+			used += len;
+			if (is_hex)
+				free(name);
+		}
+		if (n == UUIDGEN_BATCH || (sz == 0 && n)) {
+			for (i = 0; i < n; i++)
+				names[i] = arena + offs[i];
+			if (type == UUID_TYPE_DCE_MD5)
+				uuid_generate_md5_bulk(uus, ns, (const char * const *) names, lens, n);
+			else
+				uuid_generate_sha1_bulk(uus, ns, (const char * const *) names, lens, n);
+			write_uuids(fmt, (const uuid_t *) uus, n, buf);
+			n = used = 0;
+		}
+	} while (sz > 0);
+
+	ul_free_linereader(&lr);
+	if (fd != STDIN_FILENO)
+		close(fd);
+	free(arena);
+	free(names);
+	free(lens);
+	free(offs);
+	free(uus);
+	free(buf);
+}
+
+/* returns number of bytes in @buf */
+static size_t format_uuids(int fmt, const uuid_t *uu, size_t n, char *buf)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *p = buf;
+	size_t i, k;
+
+	switch (fmt) {
+	case OUT_BINARY:
+		memcpy(buf, uu, n * sizeof(uuid_t));
+		return n * sizeof(uuid_t);
+	case OUT_HEX:
+		for (i = 0; i < n; i++) {
+			for (k = 0; k < sizeof(uuid_t); k++) {
+				*p++ = hex[uu[i][k] >> 4];
+				*p++ = hex[uu[i][k] & 0xf];
+			}
+			*p++ = '\n';
+		}
+		return p - buf;
+	default:
+		/* the strings are UUID_STR_LEN long, replace the terminators */
+		uuid_unparse_many(uu, buf, n);
+		for (i = 1; i <= n; i++)
+			buf[i * UUID_STR_LEN - 1] = '\n';
+		return n * UUID_STR_LEN;
+	}
+}
+
+static void write_uuids(int fmt, const uuid_t *uu, size_t n, char *buf)
+{
+	size_t sz = format_uuids(fmt, uu, n, buf);
+
+	if (write_all(STDOUT_FILENO, buf, sz))
+		err(EXIT_FAILURE, _("write failed"));
+}
+
 int
 main (int argc, char *argv[])
 {
 	int    c;
-	int    do_type = 0, is_hex = 0;
-	char   str[UUID_STR_LEN];
-	char   *namespace = NULL, *name = NULL;
+	int    do_type = 0, is_hex = 0, fmt = OUT_TEXT;
+	char   *namespace = NULL, *name = NULL, *namefile = NULL, *buf;
 	size_t namelen = 0;
-	uuid_t ns, uu;
+	uint64_t count = 1;
+	uuid_t ns, uu, *uus;
 
 	static const struct option longopts[] = {
 		{"random", no_argument, NULL, 'r'},
 		{"time", no_argument, NULL, 't'},
+		{"time-v7", no_argument, NULL, '7'},
 		{"version", no_argument, NULL, 'V'},
 		{"help", no_argument, NULL, 'h'},
 		{"namespace", required_argument, NULL, 'n'},
 		{"name", required_argument, NULL, 'N'},
+		{"name-file", required_argument, NULL, 'F'},
 		{"md5", no_argument, NULL, 'm'},
 		{"sha1", no_argument, NULL, 's'},
 		{"hex", no_argument, NULL, 'x'},
+		{"count", required_argument, NULL, 'C'},
+		{"output", required_argument, NULL, 'o'},
 		{NULL, 0, NULL, 0}
 	};
 
@@ -106,7 +277,7 @@ main (int argc, char *argv[])
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "rtVhn:N:msx", longopts, NULL)) != -1)
+	while ((c = getopt_long(argc, argv, "rt7Vhn:N:F:msxC:o:", longopts, NULL)) != -1)
 		switch (c) {
 		case 't':
 			do_type = UUID_TYPE_DCE_TIME;
@@ -114,12 +285,18 @@ main (int argc, char *argv[])
 		case 'r':
 			do_type = UUID_TYPE_DCE_RANDOM;
 			break;
+		case '7':
+			do_type = UUID_TYPE_DCE_TIME_V7;
+			break;
 		case 'n':
 			namespace = optarg;
 			break;
 		case 'N':
 			name = optarg;
 			break;
+		case 'F':
+			namefile = optarg;
+			break;
 		case 'm':
 			do_type = UUID_TYPE_DCE_MD5;
 			break;
@@ -129,6 +306,12 @@ main (int argc, char *argv[])
 		case 'x':
 			is_hex = 1;
 			break;
+		case 'C':
+			count = strtou64_or_err(optarg, _("invalid count argument"));
+			break;
+		case 'o':
+			fmt = parse_output_format(optarg);
+			break;
 
 		case 'h':
 			usage();
@@ -138,9 +321,16 @@ main (int argc, char *argv[])
 			errtryhelp(EXIT_FAILURE);
 		}
 
+	if (name && namefile) {
+		fprintf(stderr, "%s: --name and --name-file are mutually exclusive\n", program_invocation_short_name);
+		errtryhelp(EXIT_FAILURE);
+	}
 	if (namespace) {
-		if (!name) {
-			fprintf(stderr, "%s: --namespace requires --name argument\n", program_invocation_short_name);
+		/* names from standard input, e.g. "cat names | uuidgen -s -n @dns" */
+		if (!name && !namefile && !isatty(STDIN_FILENO))
+			namefile = "-";
+		if (!name && !namefile) {
+			fprintf(stderr, "%s: --namespace requires --name or --name-file argument\n", program_invocation_short_name);
 			errtryhelp(EXIT_FAILURE);
 		}
 		if (do_type != UUID_TYPE_DCE_MD5 && do_type != UUID_TYPE_DCE_SHA1) {
@@ -148,8 +338,9 @@ main (int argc, char *argv[])
 			errtryhelp(EXIT_FAILURE);
 		}
 	} else {
-		if (name) {
-			fprintf(stderr, "%s: --name requires --namespace argument\n", program_invocation_short_name);
+		if (name || namefile) {
+			fprintf(stderr, "%s: %s requires --namespace argument\n", program_invocation_short_name,
+					name ? "--name" : "--name-file");
 			errtryhelp(EXIT_FAILURE);
 		}
 		if (do_type == UUID_TYPE_DCE_MD5 || do_type == UUID_TYPE_DCE_SHA1) {
@@ -158,6 +349,11 @@ main (int argc, char *argv[])
 		}
 	}
 
+	if (count > 1 && (do_type == UUID_TYPE_DCE_MD5 || do_type == UUID_TYPE_DCE_SHA1)) {
+		fprintf(stderr, "%s: --count is unsupported for hash-based uuids\n", program_invocation_short_name);
+		errtryhelp(EXIT_FAILURE);
+	}
+
 	if (name) {
 		namelen = strlen(name);
 		if (is_hex)
@@ -165,12 +361,6 @@ main (int argc, char *argv[])
 	}
 
 	switch (do_type) {
-	case UUID_TYPE_DCE_TIME:
-		uuid_generate_time(uu);
-		break;
-	case UUID_TYPE_DCE_RANDOM:
-		uuid_generate_random(uu);
-		break;
 	case UUID_TYPE_DCE_MD5:
 	case UUID_TYPE_DCE_SHA1:
 		if (namespace[0] == '@' && namespace[1] != '\0') {
@@ -188,19 +378,34 @@ main (int argc, char *argv[])
 				errtryhelp(EXIT_FAILURE);
 			}
 		}
+		if (namefile) {
+			generate_from_file(do_type, ns, namefile, is_hex, fmt);
+			buf = NULL;
+			break;
+		}
 		if (do_type == UUID_TYPE_DCE_MD5)
 			uuid_generate_md5(uu, ns, name, namelen);
 		else
 			uuid_generate_sha1(uu, ns, name, namelen);
+
+		buf = xmalloc(UUID_STR_LEN);
+		write_uuids(fmt, (const uuid_t *) &uu, 1, buf);
 		break;
 	default:
-		uuid_generate(uu);
-		break;
-	}
+		uus = xmalloc(min(count, (uint64_t) UUIDGEN_BATCH) * sizeof(uuid_t));
+		buf = xmalloc(min(count, (uint64_t) UUIDGEN_BATCH) * UUID_STR_LEN);
 
-	uuid_unparse(uu, str);
+		while (count > 0) {
+			size_t n = min(count, (uint64_t) UUIDGEN_BATCH);
 
-	printf("%s\n", str);
+			generate_uuids(do_type, uus, n);
+			write_uuids(fmt, (const uuid_t *) uus, n, buf);
+			count -= n;
+		}
+		free(uus);
+		break;
+	}
+	free(buf);
 
 	if (is_hex)
 		free(name);
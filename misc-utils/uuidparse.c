@@ -37,6 +37,8 @@
  */
 
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
 #include <libsmartcols.h>
 #include <stdint.h>
@@ -48,6 +50,7 @@
 #include <uuid.h>
 
 #include "c.h"
+#include "carefulputc.h"
 #include "closestream.h"
 #include "nls.h"
 #include "optutils.h"
@@ -82,11 +85,25 @@ static const struct colinfo infos[] = {
 static int columns[ARRAY_SIZE(infos) * 2];
 static size_t ncolumns;
 
+static struct ul_timecache tcache;	/* localtime() of the UUIDs */
+
+/* --stream input buffer and number of UUIDs parsed at once */
+#define STREAM_BUFSIZ	(64 * 1024)
+#define STREAM_BATCH	256
+
 struct control {
 	unsigned int
 		json:1,
 		no_headings:1,
-		raw:1;
+		raw:1,
+		stream:1;
+};
+
+/* the last --stream timestamp, only microseconds differ within the second */
+struct time_cache {
+	time_t	sec;
+	char	str[ISO_BUFSIZ * 4];	/* raw escaped or plain for JSON */
+	char	*usec;			/* microseconds in str[] */
 };
 
 static void __attribute__((__noreturn__)) usage(void)
@@ -101,6 +118,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	puts(_(" -n, --noheadings       don't print headings"));
 	puts(_(" -o, --output <list>    COLUMNS to display (see below)"));
 	puts(_(" -r, --raw              use the raw output format"));
+	puts(_(" -s, --stream           print UUIDs as they are read, without a table"));
 	printf(USAGE_HELP_OPTIONS(24));
 
 	fputs(USAGE_COLUMNS, stdout);
@@ -138,6 +156,49 @@ static const struct colinfo *get_column_info(int num)
 	return &infos[get_column_id(num)];
 }
 
+static const char *get_variant_name(int variant)
+{
+	switch (variant) {
+	case UUID_VARIANT_NCS:
+		return "NCS";
+	case UUID_VARIANT_DCE:
+		return "DCE";
+	case UUID_VARIANT_MICROSOFT:
+		return "Microsoft";
+	default:
+		return _("other");
+	}
+}
+
+static const char *get_type_name(int type, char const *const uuid)
+{
+	switch (type) {
+	case 0:
+		if (strspn(uuid, "0-") == 36)
+			return _("nil");
+		return _("unknown");
+	case 1:
+		return _("time-based");
+	case 2:
+		return "DCE";
+	case 3:
+		return _("name-based");
+	case 4:
+		return _("random");
+	case 5:
+		return _("sha1-based");
+	case 7:
+		return _("time-v7");
+	default:
+		return _("unknown");
+	}
+}
+
+static inline int has_time(int variant, int type)
+{
+	return variant == UUID_VARIANT_DCE && (type == 1 || type == 7);
+}
+
 static void fill_table_row(struct libscols_table *tb, char const *const uuid)
 {
 	static struct libscols_line *ln;
@@ -168,67 +229,25 @@ static void fill_table_row(struct libscols_table *tb, char const *const uuid)
 			str = xstrdup(uuid);
 			break;
 		case COL_VARIANT:
-			if (invalid) {
-				str = xstrdup(_("invalid"));
-				break;
-			}
-			switch (variant) {
-			case UUID_VARIANT_NCS:
-				str = xstrdup("NCS");
-				break;
-			case UUID_VARIANT_DCE:
-				str = xstrdup("DCE");
-				break;
-			case UUID_VARIANT_MICROSOFT:
-				str = xstrdup("Microsoft");
-				break;
-			default:
-				str = xstrdup(_("other"));
-			}
+			str = xstrdup(invalid ? _("invalid") :
+					get_variant_name(variant));
 			break;
 		case COL_TYPE:
-			if (invalid) {
-				str = xstrdup(_("invalid"));
-				break;
-			}
-			switch (type) {
-			case 0:
-				if (strspn(uuid, "0-") == 36)
-					str = xstrdup(_("nil"));
-				else
-					str = xstrdup(_("unknown"));
-				break;
-			case 1:
-				str = xstrdup(_("time-based"));
-				break;
-			case 2:
-				str = xstrdup("DCE");
-				break;
-			case 3:
-				str = xstrdup(_("name-based"));
-				break;
-			case 4:
-				str = xstrdup(_("random"));
-				break;
-			case 5:
-				str = xstrdup(_("sha1-based"));
-				break;
-			default:
-				str = xstrdup(_("unknown"));
-			}
+			str = xstrdup(invalid ? _("invalid") :
+					get_type_name(type, uuid));
 			break;
 		case COL_TIME:
 			if (invalid) {
 				str = xstrdup(_("invalid"));
 				break;
 			}
-			if (variant == UUID_VARIANT_DCE && type == 1) {
+			if (has_time(variant, type)) {
 				struct timeval tv;
 				char date_buf[ISO_BUFSIZ];
 
 				uuid_time(buf, &tv);
-				strtimeval_iso(&tv, ISO_TIMESTAMP_COMMA,
-					       date_buf, sizeof(date_buf));
+				strtimeval_iso_cached(&tcache, &tv, ISO_TIMESTAMP_COMMA,
+						      date_buf, sizeof(date_buf));
 				str = xstrdup(date_buf);
 			}
 			break;
@@ -280,6 +299,258 @@ static void print_output(struct control const *const ctrl, int argc,
 	scols_unref_table(tb);
 }
 
+/*
+ * The --stream mode does not use libsmartcols; the lines are the same as
+ * the raw or JSON table output, but they are written as soon as the input
+ * is parsed, so the memory use does not depend on the input size.
+ */
+static void stream_put(struct control const *const ctrl, const char *str)
+{
+	if (ctrl->json) {
+		if (!*str)
+			fputs("null", stdout);
+		else
+			fputs_quoted_json(str, stdout);
+	} else
+		fputs_nonblank(str, stdout);
+}
+
+static const char *stream_time(struct control const *const ctrl,
+			       struct time_cache *tc, const uuid_t uu)
+{
+	struct timeval tv;
+	char usec[8];
+
+	uuid_time(uu, &tv);
+
+	if (!tc->usec || tc->sec != tv.tv_sec) {
+		char date_buf[ISO_BUFSIZ], *p, *o = tc->str;
+
+		if (strtimeval_iso_cached(&tcache, &tv, ISO_TIMESTAMP_COMMA,
+					  date_buf, sizeof(date_buf)))
+			return "";
+		tc->usec = NULL;
+		for (p = date_buf; *p; p++) {
+			/* the same as fputs_nonblank(), but for the cache */
+			if (!ctrl->json && (isblank((unsigned char) *p) ||
+					    !isprint((unsigned char) *p)))
+				o += sprintf(o, "\\x%02x", (unsigned char) *p);
+			else
+				*o++ = *p;
+			if (*p == ',')
+				tc->usec = o;
+		}
+		*o = '\0';
+		tc->sec = tv.tv_sec;
+		if (!tc->usec)
+			return tc->str;
+	}
+
+	/* the timestamp is "<date>,<usec><zone>" */
+	snprintf(usec, sizeof(usec), "%06ld", (long) tv.tv_usec);
+	memcpy(tc->usec, usec, 6);
+	return tc->str;
+}
+
+static void stream_header(struct control const *const ctrl)
+{
+	size_t i;
+
+	if (ctrl->json) {
+		fputs("{\n   \"uuids\": [\n", stdout);
+		return;
+	}
+	if (ctrl->no_headings)
+		return;
+	for (i = 0; i < ncolumns; i++) {
+		if (i)
+			fputc(' ', stdout);
+		fputs(get_column_info(i)->name, stdout);
+	}
+	fputc('\n', stdout);
+}
+
+static void stream_line(struct control const *const ctrl,
+			struct time_cache *tc,
+			const char *str, const uuid_t uu, int invalid)
+{
+	int variant = -1, type = -1;
+	size_t i;
+
+	if (!invalid) {
+		variant = uuid_variant(uu);
+		type = uuid_type(uu);
+	}
+
+	if (ctrl->json)
+		fputs("      {", stdout);
+
+	for (i = 0; i < ncolumns; i++) {
+		const struct colinfo *col = get_column_info(i);
+		const char *data;
+
+		if (i)
+			fputs(ctrl->json ? ", " : " ", stdout);
+		if (ctrl->json) {
+			fputs_quoted_json_lower(col->name, stdout);
+			fputc(':', stdout);
+		}
+
+		switch (get_column_id(i)) {
+		case COL_UUID:
+			if (!invalid) {
+				/* valid UUID does not need to be encoded */
+				if (ctrl->json)
+					fputc('"', stdout);
+				fwrite(str, 1, UUID_STR_LEN - 1, stdout);
+				if (ctrl->json)
+					fputc('"', stdout);
+				continue;
+			}
+			data = str;
+			break;
+		case COL_VARIANT:
+			data = invalid ? _("invalid") : get_variant_name(variant);
+			break;
+		case COL_TYPE:
+			data = invalid ? _("invalid") : get_type_name(type, str);
+			break;
+		case COL_TIME:
+			if (invalid)
+				data = _("invalid");
+			else if (has_time(variant, type)) {
+				data = stream_time(ctrl, tc, uu);
+				if (*data) {
+					/* already encoded */
+					if (ctrl->json)
+						fputc('"', stdout);
+					fputs(data, stdout);
+					if (ctrl->json)
+						fputc('"', stdout);
+					continue;
+				}
+			} else
+				data = "";
+			break;
+		default:
+			abort();
+		}
+		stream_put(ctrl, data);
+	}
+
+	/* JSON line separator is printed by the next line */
+	if (ctrl->json)
+		fputc('}', stdout);
+	else
+		fputc('\n', stdout);
+}
+
+static void stream_words(struct control const *const ctrl,
+			 struct time_cache *tc,
+			 const char **words, size_t nwords, size_t *nlines)
+{
+	uuid_t uus[STREAM_BATCH];
+	size_t i;
+
+	assert(nwords <= STREAM_BATCH);
+
+	/* the invalid strings are null UUIDs, but so is the valid nil UUID */
+	if (uuid_parse_many(words, uus, nwords) == 0) {
+		for (i = 0; i < nwords; i++) {
+			if (ctrl->json)
+				fputs((*nlines)++ ? ",\n" : "", stdout);
+			stream_line(ctrl, tc, words[i], uus[i], 0);
+		}
+		return;
+	}
+	for (i = 0; i < nwords; i++) {
+		int invalid = uuid_is_null(uus[i])
+			      && uuid_parse(words[i], uus[i]) != 0;
+
+		if (ctrl->json)
+			fputs((*nlines)++ ? ",\n" : "", stdout);
+		stream_line(ctrl, tc, words[i], uus[i], invalid);
+	}
+}
+
+static void stream_output(struct control const *const ctrl, int argc,
+			  char **argv)
+{
+	struct time_cache tc = { .usec = NULL };
+	const char *words[STREAM_BATCH];
+	size_t nwords = 0, nlines = 0;
+
+	stream_header(ctrl);
+
+	if (argc) {
+		int i;
+
+		for (i = 0; i < argc; i++) {
+			words[nwords++] = argv[i];
+			if (nwords == STREAM_BATCH) {
+				stream_words(ctrl, &tc, words, nwords, &nlines);
+				nwords = 0;
+			}
+		}
+	} else {
+		char *buf = xmalloc(STREAM_BUFSIZ + 1);
+		size_t len = 0;
+		int eof = 0;
+
+		while (!eof) {
+			ssize_t rc = read(STDIN_FILENO, buf + len,
+					  STREAM_BUFSIZ - len);
+			char *p, *end, *w = NULL;
+
+			if (rc < 0) {
+				if (errno == EINTR)
+					continue;
+				err(EXIT_FAILURE, _("read failed"));
+			}
+			if (rc == 0)
+				eof = 1;
+			len += rc;
+			end = buf + len;
+
+			for (p = buf; p < end; p++) {
+				if (isspace((unsigned char) *p))
+					continue;
+				w = p;
+				while (p < end && !isspace((unsigned char) *p))
+					p++;
+				/* incomplete word, read the rest (words longer
+				 * than buffer are split) */
+				if (p == end && !eof
+				    && !(w == buf && len == STREAM_BUFSIZ))
+					break;
+				*p = '\0';
+				words[nwords++] = w;
+				w = NULL;
+				if (nwords == STREAM_BATCH) {
+					stream_words(ctrl, &tc, words, nwords, &nlines);
+					nwords = 0;
+				}
+			}
+			if (nwords) {
+				stream_words(ctrl, &tc, words, nwords, &nlines);
+				nwords = 0;
+			}
+			/* move the incomplete word to the begin of the buffer */
+			if (w) {
+				len = end - w;
+				memmove(buf, w, len);
+			} else
+				len = 0;
+		}
+		free(buf);
+	}
+	if (nwords)
+		stream_words(ctrl, &tc, words, nwords, &nlines);
+
+	if (ctrl->json)
+		fputs(nlines ? "\n   ]\n}\n" : "   ]\n}\n", stdout);
+}
+
 int main(int argc, char **argv)
 {
 	struct control ctrl = { 0 };
@@ -291,6 +562,7 @@ int main(int argc, char **argv)
 		{"noheadings", no_argument,       NULL, 'n'},
 		{"output",     required_argument, NULL, 'o'},
 		{"raw",        no_argument,       NULL, 'r'},
+		{"stream",     no_argument,       NULL, 's'},
 		{"version",    no_argument,       NULL, 'V'},
 		{"help",       no_argument,       NULL, 'h'},
 		{NULL, 0, NULL, 0}
@@ -306,7 +578,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "Jno:rVh", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "Jno:rsVh", longopts, NULL)) != -1) {
 		err_exclusive_options(c, longopts, excl, excl_st);
 		switch (c) {
 		case 'J':
@@ -321,6 +593,9 @@ int main(int argc, char **argv)
 		case 'r':
 			ctrl.raw = 1;
 			break;
+		case 's':
+			ctrl.stream = 1;
+			break;
 
 		case 'V':
 			print_version(EXIT_SUCCESS);
@@ -343,7 +618,10 @@ int main(int argc, char **argv)
 				     &ncolumns, column_name_to_id) < 0)
 		return EXIT_FAILURE;
 
-	print_output(&ctrl, argc, argv);
+	if (ctrl.stream)
+		stream_output(&ctrl, argc, argv);
+	else
+		print_output(&ctrl, argc, argv);
 
 	return EXIT_SUCCESS;
 }
@@ -86,6 +86,12 @@ enum {
 	ALL_DIRS = BIN_DIR | MAN_DIR | SRC_DIR
 };
 
+/* directory entry, @order is position in readdir() output */
+struct wh_entry {
+	char	*name;
+	size_t	order;
+};
+
 /* directories */
 struct wh_dirlist {
 	int	type;
@@ -93,6 +99,13 @@ struct wh_dirlist {
 	ino_t	st_ino;
 	char	*path;
 
+	/* the directory is read only once for all the looked up names, the
+	 * entries are sorted by name to find the possible matches by
+	 * binary search */
+	struct wh_entry	*entries;
+	size_t		nentries;
+	unsigned int	scanned : 1;
+
 	struct wh_dirlist *next;
 };
 
@@ -368,6 +381,18 @@ static void construct_dirlist(struct wh_dirlist **ls,
 	return;
 }
 
+static void free_entries(struct wh_dirlist *ls)
+{
+	size_t i;
+
+	for (i = 0; i < ls->nentries; i++)
+		free(ls->entries[i].name);
+	free(ls->entries);
+	ls->entries = NULL;
+	ls->nentries = 0;
+	ls->scanned = 0;
+}
+
 static void free_dirlist(struct wh_dirlist **ls0, int type)
 {
 	struct wh_dirlist *prev = NULL, *next, *ls = *ls0;
@@ -380,6 +405,7 @@ static void free_dirlist(struct wh_dirlist **ls0, int type)
 		if (ls->type & type) {
 			next = ls->next;
 			DBG(LIST, ul_debugobj(*ls0, " free: %s", ls->path));
+			free_entries(ls);
 			free(ls->path);
 			free(ls);
 			ls = next;
@@ -429,33 +455,132 @@ static int filename_equal(const char *cp, const char *dp)
 	return 0;
 }
 
-static void findin(const char *dir, const char *pattern, int *count, char **wait)
+static int cmp_entries(const void *a, const void *b)
+{
+	return strcmp(((const struct wh_entry *) a)->name,
+		      ((const struct wh_entry *) b)->name);
+}
+
+static int cmp_orders(const void *a, const void *b)
+{
+	return cmp_numbers((*(struct wh_entry * const *) a)->order,
+			   (*(struct wh_entry * const *) b)->order);
+}
+
+static void scan_dir(struct wh_dirlist *ls)
 {
 	DIR *dirp;
 	struct dirent *dp;
+	size_t nalloc = 0;
+
+	ls->scanned = 1;
 
-	dirp = opendir(dir);
+	dirp = opendir(ls->path);
 	if (dirp == NULL)
 		return;
 
-	DBG(SEARCH, ul_debug("find '%s' in '%s'", pattern, dir));
+	DBG(SEARCH, ul_debug("scan '%s'", ls->path));
 
 	while ((dp = readdir(dirp)) != NULL) {
-		if (!filename_equal(pattern, dp->d_name))
+		if (ls->nentries == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			ls->entries = xrealloc(ls->entries,
+					       nalloc * sizeof(struct wh_entry));
+		}
+		ls->entries[ls->nentries].name = xstrdup(dp->d_name);
+		ls->entries[ls->nentries].order = ls->nentries;
+		ls->nentries++;
+	}
+	closedir(dirp);
+
+	if (ls->nentries)
+		qsort(ls->entries, ls->nentries, sizeof(struct wh_entry), cmp_entries);
+}
+
+/* returns position of the first entry >= @name */
+static size_t find_entry(struct wh_dirlist *ls, const char *name)
+{
+	size_t lo = 0, hi = ls->nentries;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (strcmp(ls->entries[mid].name, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Adds the matching entries with @prefix to @res. The pattern is always a
+ * prefix of the matching name (maybe behind "s."), so only the entries
+ * with the prefix are compared by filename_equal().
+ */
+static void find_prefixed(struct wh_dirlist *ls, const char *pattern,
+			  const char *prefix, struct wh_entry ***res, size_t *nres,
+			  size_t *nalloc)
+{
+	size_t i, len = strlen(prefix);
+
+	for (i = find_entry(ls, prefix); i < ls->nentries; i++) {
+		const char *name = ls->entries[i].name;
+
+		if (strncmp(name, prefix, len) != 0)
+			break;
+		if (!filename_equal(pattern, name))
+			continue;
+		if (*nres == *nalloc) {
+			*nalloc = *nalloc ? *nalloc * 2 : 16;
+			*res = xrealloc(*res, *nalloc * sizeof(struct wh_entry *));
+		}
+		(*res)[(*nres)++] = &ls->entries[i];
+	}
+}
+
+static void findin(struct wh_dirlist *ls, const char *pattern, int *count, char **wait)
+{
+	const char *dir = ls->path;
+	struct wh_entry **res = NULL;
+	size_t nres = 0, nalloc = 0, i;
+	char *sprefix;
+
+	if (!ls->scanned)
+		scan_dir(ls);
+	if (!ls->nentries)
+		return;
+
+	DBG(SEARCH, ul_debug("find '%s' in '%s'", pattern, dir));
+
+	xasprintf(&sprefix, "s.%s", pattern);
+	find_prefixed(ls, pattern, pattern, &res, &nres, &nalloc);
+	find_prefixed(ls, pattern, sprefix, &res, &nres, &nalloc);
+	free(sprefix);
+
+	/* print in the readdir() order, the both ranges may overlap */
+	if (nres > 1)
+		qsort(res, nres, sizeof(struct wh_entry *), cmp_orders);
+
+	for (i = 0; i < nres; i++) {
+		const char *name;
+
+		if (i > 0 && res[i] == res[i - 1])
 			continue;
+		name = res[i]->name;
 
 		if (uflag && *count == 0)
-			xasprintf(wait, "%s/%s", dir, dp->d_name);
+			xasprintf(wait, "%s/%s", dir, name);
 
 		else if (uflag && *count == 1 && *wait) {
-			printf("%s: %s %s/%s", pattern, *wait, dir,  dp->d_name);
+			printf("%s: %s %s/%s", pattern, *wait, dir, name);
 			free(*wait);
 			*wait = NULL;
 		} else
-			printf(" %s/%s", dir, dp->d_name);
+			printf(" %s/%s", dir, name);
 		++(*count);
 	}
-	closedir(dirp);
+	free(res);
 	return;
 }
 
@@ -485,7 +610,7 @@ static void lookup(const char *pattern, struct wh_dirlist *ls, int want)
 
 	for (; ls; ls = ls->next) {
 		if ((ls->type & want) && ls->path)
-			findin(ls->path, patbuf, &count, &wait);
+			findin(ls, patbuf, &count, &wait);
 	}
 
 	free(wait);
@@ -43,6 +43,7 @@
 #include "closestream.h"
 #include "optutils.h"
 #include "blkdev.h"
+#include "ranges.h"
 
 struct wipe_desc {
 	loff_t		offset;		/* magic string offset */
@@ -57,7 +58,8 @@ struct wipe_desc {
 	struct wipe_desc	*next;
 
 	unsigned int	on_disk : 1,
-			is_parttable : 1;
+			is_parttable : 1,
+			is_ignored : 1;		/* nested partition table */
 
 };
 
@@ -69,6 +71,7 @@ struct wipe_control {
 	struct wipe_desc *offsets;		/* -o <offset> -o <offset> ... */
 
 	size_t		ndevs;			/* number of devices to probe */
+	size_t		nthreads;		/* --parallel <num> */
 
 	char		**reread;		/* devices to BLKRRPART */
 	size_t		nrereads;		/* size of reread */
@@ -83,6 +86,21 @@ struct wipe_control {
 			parsable : 1;
 };
 
+/*
+ * One device argument. The devices are probed (and wiped) by do_read() or
+ * do_wipe() and the results are reported by report_read() or report_wipe()
+ * in the order of the arguments, with --parallel more devices are probed at
+ * the same time.
+ */
+struct wipe_job {
+	struct wipe_control	ctl;		/* copy with devname and offsets */
+	struct wipe_desc	*found;		/* signatures in the probing order */
+	blkid_probe		pr;		/* opened for wipe */
+
+	unsigned int		need_force : 1,
+				reread : 1;
+};
+
 
 /* column IDs */
 enum {
@@ -461,18 +479,10 @@ static void free_wipe(struct wipe_desc *wp)
 	}
 }
 
-static void do_wipe_real(struct wipe_control *ctl, blkid_probe pr,
-			struct wipe_desc *w)
+static void print_wiped(struct wipe_control *ctl, struct wipe_desc *w)
 {
 	size_t i;
 
-	if (blkid_do_wipe(pr, ctl->noact) != 0)
-		err(EXIT_FAILURE, _("%s: failed to erase %s magic string at offset 0x%08jx"),
-		     ctl->devname, w->type, (intmax_t)w->offset);
-
-	if (ctl->quiet)
-		return;
-
 	printf(P_("%s: %zd byte was erased at offset 0x%08jx (%s): ",
 		  "%s: %zd bytes were erased at offset 0x%08jx (%s): ",
 		  w->len),
@@ -486,6 +496,61 @@ static void do_wipe_real(struct wipe_control *ctl, blkid_probe pr,
 	putchar('\n');
 }
 
+static int cmp_wipe_offsets(const void *a, const void *b)
+{
+	const struct wipe_desc *wa = *(struct wipe_desc * const *) a,
+			       *wb = *(struct wipe_desc * const *) b;
+
+	return cmp_numbers(wa->offset, wb->offset);
+}
+
+/*
+ * Erases all the not ignored magic strings from the @wp0 list. The strings are sorted by
+ * offset, the overlapping and adjacent strings are merged and every merged
+ * range is zeroed by one write.
+ */
+static void do_wipe_real(struct wipe_control *ctl, int fd, struct wipe_desc *wp0)
+{
+	struct wipe_desc *w, **ary;
+	unsigned char *zeros = NULL;
+	size_t i, j, n = 0, zerosz = 0;
+
+	for (w = wp0; w; w = w->next) {
+		if (!w->is_ignored)
+			n++;
+	}
+	if (!n)
+		return;
+
+	ary = xmalloc(n * sizeof(struct wipe_desc *));
+	for (i = 0, w = wp0; w; w = w->next) {
+		if (!w->is_ignored)
+			ary[i++] = w;
+	}
+	qsort(ary, n, sizeof(struct wipe_desc *), cmp_wipe_offsets);
+
+	for (i = 0; !ctl->noact && i < n; i = j) {
+		loff_t start = ary[i]->offset,
+		       end = ary[i]->offset + ary[i]->len;
+
+		for (j = i + 1; j < n && ary[j]->offset <= end; j++)
+			end = max(end, (loff_t) (ary[j]->offset + ary[j]->len));
+
+		if ((size_t) (end - start) > zerosz) {
+			zerosz = end - start;
+			zeros = xrealloc(zeros, zerosz);
+			memset(zeros, 0, zerosz);
+		}
+		if (lseek(fd, start, SEEK_SET) == (off_t) -1
+		    || write_all(fd, zeros, end - start) != 0)
+			err(EXIT_FAILURE, _("%s: failed to erase %s magic string at offset 0x%08jx"),
+			     ctl->devname, ary[i]->type, (intmax_t)ary[i]->offset);
+	}
+
+	free(zeros);
+	free(ary);
+}
+
 static void do_backup(struct wipe_desc *wp, const char *base)
 {
 	char *fname = NULL;
@@ -532,19 +597,26 @@ static void rereadpt(int fd, const char *devname)
 }
 #endif
 
-static int do_wipe(struct wipe_control *ctl)
+/*
+ * Probes and erases the device, the results are kept in @job for
+ * report_wipe() and the device is kept open for the re-read of the
+ * partition table.
+ */
+static void do_wipe(struct wipe_job *job)
 {
-	int mode = O_RDWR, reread = 0, need_force = 0;
+	struct wipe_control *ctl = &job->ctl;
+	int mode = O_RDWR;
 	blkid_probe pr;
 	char *backup = NULL;
-	struct wipe_desc *w;
+	struct wipe_desc **last = &job->found;
 
 	if (!ctl->force)
 		mode |= O_EXCL;
 
 	pr = new_probe(ctl->devname, mode);
 	if (!pr)
-		return -errno;
+		return;
+	job->pr = pr;
 
 	if (ctl->backup) {
 		const char *home = getenv ("HOME");
@@ -556,60 +628,80 @@ static int do_wipe(struct wipe_control *ctl)
 		free(tmp);
 	}
 
+	/*
+	 * All the signatures are found by one probing, the found signatures
+	 * are hidden (as for --no-act) and wiped after the probing.
+	 */
 	while (blkid_do_probe(pr) == 0) {
-		int wiped = 0;
 		size_t len = 0;
 		loff_t offset = 0;
 		struct wipe_desc *wp;
 
 		wp = get_desc_for_probe(ctl, NULL, pr, &offset, &len);
+
+		/* hide the signature for libblkid to try another magic
+		 * string for the same superblock, otherwise libblkid will
+		 * continue with another superblock. Don't forget that the
+		 * same superblock could be detected by more magic strings
+		 * */
+		if (len) {
+			blkid_probe_hide_range(pr, offset, len);
+			blkid_probe_step_back(pr);
+		}
 		if (!wp)
-			goto done;
+			continue;
+
+		*last = wp;
+		last = &wp->next;
 
 		if (!ctl->force
 		    && wp->is_parttable
 		    && !blkid_probe_is_wholedisk(pr)) {
-			warnx(_("%s: ignoring nested \"%s\" partition table "
-				"on non-whole disk device"), ctl->devname, wp->type);
-			need_force = 1;
-			goto done;
+			wp->is_ignored = 1;
+			job->need_force = 1;
+			continue;
 		}
 
 		if (backup)
 			do_backup(wp, backup);
-		do_wipe_real(ctl, pr, wp);
-		if (wp->is_parttable)
-			reread = 1;
-		wiped = 1;
-	done:
-		if (!wiped && len) {
-			/* if the offset has not been wiped (probably because
-			 * filtered out by -t or -o) we need to hide it for
-			 * libblkid to try another magic string for the same
-			 * superblock, otherwise libblkid will continue with
-			 * another superblock. Don't forget that the same
-			 * superblock could be detected by more magic strings
-			 * */
-			blkid_probe_hide_range(pr, offset, len);
-			blkid_probe_step_back(pr);
-		}
-		free_wipe(wp);
+		if (wp->is_parttable && (mode & O_EXCL))
+			job->reread = 1;
+	}
+
+	do_wipe_real(ctl, blkid_probe_get_fd(pr), job->found);
+	fsync(blkid_probe_get_fd(pr));
+	free(backup);
+}
+
+static void report_wipe(struct wipe_control *ctl, struct wipe_job *job)
+{
+	struct wipe_desc *w, *o;
+
+	if (!job->pr)
+		return;
+
+	for (w = job->found; w; w = w->next) {
+		if (w->is_ignored)
+			warnx(_("%s: ignoring nested \"%s\" partition table "
+				"on non-whole disk device"), job->ctl.devname, w->type);
+		else if (!ctl->quiet)
+			print_wiped(&job->ctl, w);
 	}
 
-	for (w = ctl->offsets; w; w = w->next) {
+	/* the offset is reported only if not found on any previous device */
+	for (w = ctl->offsets, o = job->ctl.offsets; w; w = w->next, o = o->next) {
+		w->on_disk |= o->on_disk;
 		if (!w->on_disk && !ctl->quiet)
 			warnx(_("%s: offset 0x%jx not found"),
-					ctl->devname, (uintmax_t)w->offset);
+					job->ctl.devname, (uintmax_t)w->offset);
 	}
 
-	if (need_force)
+	if (job->need_force)
 		warnx(_("Use the --force option to force erase."));
 
-	fsync(blkid_probe_get_fd(pr));
-
 #ifdef BLKRRPART
-	if (reread && (mode & O_EXCL)) {
-		if (ctl->ndevs > 1) {
+	if (job->reread) {
+		if (job->ctl.ndevs > 1) {
 			/*
 			 * We're going to probe more device, let's postpone
 			 * re-read PT ioctl until all is erased to avoid
@@ -619,16 +711,107 @@ static int do_wipe(struct wipe_control *ctl)
 			if (!ctl->reread)
 				ctl->reread = xcalloc(ctl->ndevs, sizeof(char *));
 
-			ctl->reread[ctl->nrereads++] = ctl->devname;
+			ctl->reread[ctl->nrereads++] = job->ctl.devname;
 		} else
-			rereadpt(blkid_probe_get_fd(pr), ctl->devname);
+			rereadpt(blkid_probe_get_fd(job->pr), job->ctl.devname);
 	}
 #endif
 
-	close(blkid_probe_get_fd(pr));
-	blkid_free_probe(pr);
-	free(backup);
-	return 0;
+	close(blkid_probe_get_fd(job->pr));
+	blkid_free_probe(job->pr);
+	job->pr = NULL;
+}
+
+static void do_read(struct wipe_job *job)
+{
+	job->found = read_offsets(&job->ctl);
+}
+
+static void report_read(struct wipe_control *ctl __attribute__((__unused__)),
+			struct wipe_job *job)
+{
+	if (job->found)
+		add_to_output(&job->ctl, job->found);
+}
+
+static void init_job(struct wipe_control *ctl, struct wipe_job *job,
+		     char *devname, size_t ndevs)
+{
+	struct wipe_desc *w;
+
+	memset(job, 0, sizeof(*job));
+	job->ctl = *ctl;
+	job->ctl.devname = devname;
+	job->ctl.ndevs = ndevs;
+
+	/* -o <offset> "found" flags are per device */
+	job->ctl.offsets = NULL;
+	for (w = ctl->offsets; w; w = w->next)
+		add_offset(&job->ctl.offsets, w->offset);
+}
+
+static void free_job(struct wipe_job *job)
+{
+	free_wipe(job->found);
+	free_wipe(job->ctl.offsets);
+}
+
+/* the jobs processed by more threads */
+struct wipe_jobs {
+	struct wipe_job		*jobs;
+	void			(*fn)(struct wipe_job *);
+};
+
+static void run_range(void *data, size_t range __attribute__((__unused__)),
+		      size_t first, size_t last)
+{
+	struct wipe_jobs *wj = data;
+	size_t i;
+
+	for (i = first; i < last; i++)
+		wj->fn(&wj->jobs[i]);
+}
+
+/*
+ * Runs @fn for all the device arguments and reports the results in the
+ * order of the arguments. Without --parallel every device is reported
+ * immediately after @fn.
+ */
+static void run_jobs(struct wipe_control *ctl, char **devs, size_t ndevs,
+		     void (*fn)(struct wipe_job *),
+		     void (*report)(struct wipe_control *, struct wipe_job *))
+{
+	struct wipe_jobs wj;
+	struct wipe_job *jobs;
+	size_t i;
+
+	if (ctl->nthreads <= 1 || ndevs <= 1) {
+		struct wipe_job job;
+
+		for (i = 0; i < ndevs; i++) {
+			init_job(ctl, &job, devs[i], ndevs - i);
+			fn(&job);
+			report(ctl, &job);
+			free_job(&job);
+		}
+		return;
+	}
+
+	jobs = xcalloc(ndevs, sizeof(struct wipe_job));
+
+	for (i = 0; i < ndevs; i++)
+		init_job(ctl, &jobs[i], devs[i], ndevs - i);
+
+	wj.jobs = jobs;
+	wj.fn = fn;
+	ul_run_ranges(ndevs, 1, ctl->nthreads, run_range, &wj);
+
+	for (i = 0; i < ndevs; i++) {
+		report(ctl, &jobs[i]);
+		free_job(&jobs[i]);
+	}
+
+	free(jobs);
 }
 
 
@@ -652,6 +835,7 @@ usage(void)
 	puts(_(" -n, --no-act        do everything except the actual write() call"));
 	puts(_(" -o, --offset <num>  offset to erase, in bytes"));
 	puts(_(" -O, --output <list> COLUMNS to display (see below)"));
+	puts(_("     --parallel <num> probe and wipe up to <num> devices at once"));
 	puts(_(" -p, --parsable      print out in parsable instead of printable format"));
 	puts(_(" -q, --quiet         suppress output messages"));
 	puts(_(" -t, --types <list>  limit the set of filesystem, RAIDs or partition tables"));
@@ -677,6 +861,10 @@ main(int argc, char **argv)
 	int c;
 	char *outarg = NULL;
 
+	enum {
+		OPT_PARALLEL = CHAR_MAX + 1
+	};
+
 	static const struct option longopts[] = {
 	    { "all",       no_argument,       NULL, 'a' },
 	    { "backup",    no_argument,       NULL, 'b' },
@@ -691,6 +879,7 @@ main(int argc, char **argv)
 	    { "json",      no_argument,       NULL, 'J'},
 	    { "noheadings",no_argument,       NULL, 'i'},
 	    { "output",    required_argument, NULL, 'O'},
+	    { "parallel",  required_argument, NULL, OPT_PARALLEL },
 	    { NULL,        0, NULL, 0 }
 	};
 
@@ -745,6 +934,10 @@ main(int argc, char **argv)
 		case 't':
 			ctl.type_pattern = optarg;
 			break;
+		case OPT_PARALLEL:
+			ctl.nthreads = strtou32_or_err(optarg,
+					 _("invalid parallel argument"));
+			break;
 
 		case 'h':
 			usage();
@@ -789,28 +982,14 @@ main(int argc, char **argv)
 			return EXIT_FAILURE;
 
 		init_output(&ctl);
-
-		while (optind < argc) {
-			struct wipe_desc *wp;
-
-			ctl.devname = argv[optind++];
-			wp = read_offsets(&ctl);
-			if (wp)
-				add_to_output(&ctl, wp);
-			free_wipe(wp);
-		}
+		run_jobs(&ctl, argv + optind, argc - optind, do_read, report_read);
 		finalize_output(&ctl);
 	} else {
 		/*
 		 * Erase
 		 */
 		ctl.ndevs = argc - optind;
-
-		while (optind < argc) {
-			ctl.devname = argv[optind++];
-			do_wipe(&ctl);
-			ctl.ndevs--;
-		}
+		run_jobs(&ctl, argv + optind, argc - optind, do_wipe, report_wipe);
 
 #ifdef BLKRRPART
 		/* Re-read partition tables on whole-disk devices. This is
@@ -122,12 +122,20 @@ struct chrt_ctl {
 	uint64_t deadline;
 	uint64_t period;
 
+	const char *cgroup;			/* --cgroup <path> */
+
 	unsigned int all_tasks : 1,		/* all threads of the PID */
 		     reset_on_fork : 1,		/* SCHED_RESET_ON_FORK */
 		     altered : 1,		/* sched_set**() used */
+		     bulk : 1,			/* read PIDs from stdin */
 		     verbose : 1;		/* verbose output */
 };
 
+enum {
+	OPT_BULK = CHAR_MAX + 1,
+	OPT_CGROUP
+};
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -136,7 +144,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_("Set policy:\n"
 	" chrt [options] <priority> <command> [<arg>...]\n"
-	" chrt [options] --pid <priority> <pid>\n"), out);
+	" chrt [options] --pid <priority> <pid>\n"
+	" chrt [options] --bulk [<priority>]\n"
+	" chrt [options] --cgroup <path> <priority>\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_("Get policy:\n"
 	" chrt [options] -p <pid>\n"), out);
@@ -162,6 +172,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -a, --all-tasks      operate on all the tasks (threads) for a given pid\n"), out);
 	fputs(_(" -m, --max            show min and max valid priorities\n"), out);
 	fputs(_(" -p, --pid            operate on existing given pid\n"), out);
+	fputs(_("     --bulk           read \"<pid> [<priority>]\" lines from stdin\n"), out);
+	fputs(_("     --cgroup <path>  operate on all the tasks in the cgroup\n"), out);
 	fputs(_(" -v, --verbose        display status information\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -415,6 +427,118 @@ static void set_sched(struct chrt_ctl *ctl)
 	ctl->altered = 1;
 }
 
+static int is_valid_priority(struct chrt_ctl *ctl, int priority)
+{
+	return sched_get_priority_min(ctl->policy) <= priority
+	       && priority <= sched_get_priority_max(ctl->policy);
+}
+
+static int parse_priority(const char *str, int *priority)
+{
+	char *end = NULL;
+	long x;
+
+	errno = 0;
+	x = strtol(str, &end, 10);
+	if (errno || end == str || *end || x < 0 || x > INT_MAX)
+		return -EINVAL;
+	*priority = (int) x;
+	return 0;
+}
+
+/* sets policy for the task (or all its threads), returns number of errors */
+static size_t set_sched_bulk_one(struct chrt_ctl *ctl, pid_t pid)
+{
+	struct proc_tasks *ts;
+	size_t nerrs = 0;
+	pid_t tid;
+
+	if (!ctl->all_tasks) {
+		if (set_sched_one(ctl, pid) == -1) {
+			warn(_("failed to set pid %d's policy"), pid);
+			return 1;
+		}
+		if (ctl->verbose)
+			show_sched_pid_info(ctl, pid);
+		return 0;
+	}
+
+	ts = proc_open_tasks(pid);
+	if (!ts) {
+		warn(_("cannot obtain the list of tasks for pid %d"), pid);
+		return 1;
+	}
+	while (!proc_next_tid(ts, &tid)) {
+		if (set_sched_one(ctl, tid) == -1) {
+			warn(_("failed to set tid %d's policy"), tid);
+			nerrs++;
+		} else if (ctl->verbose)
+			show_sched_pid_info(ctl, tid);
+	}
+	proc_close_tasks(ts);
+	return nerrs;
+}
+
+/*
+ * Sets the policy for all tasks from stdin (or from the cgroup). The
+ * priority from the line is used if specified, otherwise @priority (-1
+ * if not specified on command line). The errors are reported for the tasks
+ * and it continues with the next task.
+ *
+ * Returns: number of errors
+ */
+static size_t set_sched_bulk(struct chrt_ctl *ctl, int priority)
+{
+	struct proc_tasks *ts;
+	size_t nerrs = 0;
+	char *param;
+	pid_t pid;
+	int rc;
+
+	ts = ctl->cgroup ? proc_open_cgroup_tasks(ctl->cgroup) :
+			   proc_open_tasks_stream(stdin);
+	if (!ts)
+		err(EXIT_FAILURE, _("cannot obtain the list of tasks"));
+
+	ctl->altered = 1;
+
+	while ((rc = proc_next_tid_param(ts, &pid, &param)) != 1) {
+		if (rc == -EINVAL) {
+			warnx(_("invalid line: %s"), param);
+			nerrs++;
+			continue;
+		}
+		if (rc < 0) {
+			warn(_("cannot read the list of tasks"));
+			nerrs++;
+			break;
+		}
+
+		ctl->priority = priority;
+		if (param && parse_priority(param, &ctl->priority) != 0) {
+			warnx(_("pid %d: invalid priority argument: %s"), pid, param);
+			nerrs++;
+			continue;
+		}
+		if (ctl->priority < 0) {
+			warnx(_("pid %d: no priority specified"), pid);
+			nerrs++;
+			continue;
+		}
+		if (!is_valid_priority(ctl, ctl->priority)) {
+			warnx(_("pid %d: unsupported priority value for the policy: %d"),
+					pid, ctl->priority);
+			nerrs++;
+			continue;
+		}
+
+		nerrs += set_sched_bulk_one(ctl, pid);
+	}
+
+	proc_close_tasks(ts);
+	return nerrs;
+}
+
 int main(int argc, char **argv)
 {
 	struct chrt_ctl _ctl = { .pid = -1, .policy = SCHED_RR }, *ctl = &_ctl;
@@ -437,6 +561,8 @@ int main(int argc, char **argv)
 		{ "reset-on-fork",  no_argument,       NULL, 'R' },
 		{ "verbose",	no_argument, NULL, 'v' },
 		{ "version",	no_argument, NULL, 'V' },
+		{ "bulk",	no_argument, NULL, OPT_BULK },
+		{ "cgroup",	required_argument, NULL, OPT_CGROUP },
 		{ NULL,		no_argument, NULL, 0 }
 	};
 
@@ -498,6 +624,12 @@ int main(int argc, char **argv)
 		case 'D':
 			ctl->deadline = strtou64_or_err(optarg, _("invalid deadline argument"));
 			break;
+		case OPT_BULK:
+			ctl->bulk = 1;
+			break;
+		case OPT_CGROUP:
+			ctl->cgroup = optarg;
+			break;
 
 		case 'V':
 			print_version(EXIT_SUCCESS);
@@ -508,7 +640,14 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (((ctl->pid > -1) && argc - optind < 1) ||
+	if (ctl->bulk || ctl->cgroup) {
+		if (ctl->pid > -1 || (ctl->bulk && ctl->cgroup)
+		    || (ctl->bulk && argc - optind > 1)
+		    || (ctl->cgroup && argc - optind != 1)) {
+			warnx(_("bad usage"));
+			errtryhelp(EXIT_FAILURE);
+		}
+	} else if (((ctl->pid > -1) && argc - optind < 1) ||
 	    ((ctl->pid == -1) && argc - optind < 2)) {
 		warnx(_("bad usage"));
 		errtryhelp(EXIT_FAILURE);
@@ -521,7 +660,10 @@ int main(int argc, char **argv)
 	}
 
 	errno = 0;
-	ctl->priority = strtos32_or_err(argv[optind], _("invalid priority argument"));
+	if (ctl->bulk && argc == optind)
+		ctl->priority = -1;
+	else
+		ctl->priority = strtos32_or_err(argv[optind], _("invalid priority argument"));
 
 #ifdef SCHED_RESET_ON_FORK
 	if (ctl->reset_on_fork && ctl->policy != SCHED_FIFO && ctl->policy != SCHED_RR)
@@ -547,10 +689,17 @@ int main(int argc, char **argv)
 	if (ctl->runtime || ctl->deadline || ctl->period)
 		errx(EXIT_FAILURE, _("SCHED_DEADLINE is unsupported"));
 #endif
+	if (ctl->bulk || ctl->cgroup) {
+		if (ctl->priority != -1 && !is_valid_priority(ctl, ctl->priority))
+			errx(EXIT_FAILURE,
+			     _("unsupported priority value for the policy: %d: see --max for valid range"),
+			     ctl->priority);
+		return set_sched_bulk(ctl, ctl->priority) ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
 	if (ctl->pid == -1)
 		ctl->pid = 0;
-	if (ctl->priority < sched_get_priority_min(ctl->policy) ||
-	    sched_get_priority_max(ctl->policy) < ctl->priority)
+	if (!is_valid_priority(ctl, ctl->priority))
 		errx(EXIT_FAILURE,
 		     _("unsupported priority value for the policy: %d: see --max for valid range"),
 		     ctl->priority);
@@ -18,6 +18,7 @@
 #include "strutils.h"
 #include "c.h"
 #include "closestream.h"
+#include "procutils.h"
 
 static int tolerant;
 
@@ -44,6 +45,11 @@ enum {
 	IOPRIO_WHO_USER,
 };
 
+enum {
+	OPT_BULK = CHAR_MAX + 1,
+	OPT_CGROUP
+};
+
 #define IOPRIO_CLASS_SHIFT	(13)
 #define IOPRIO_PRIO_MASK	((1UL << IOPRIO_CLASS_SHIFT) - 1)
 
@@ -68,6 +74,47 @@ static int parse_ioclass(const char *str)
 	return -1;
 }
 
+/* returns class for class name or number, or -1 */
+static int parse_ioclass_arg(const char *str)
+{
+	char *end = NULL;
+	long x;
+
+	if (!isdigit((unsigned char) *str))
+		return parse_ioclass(str);
+
+	errno = 0;
+	x = strtol(str, &end, 10);
+	if (errno || *end || x > INT_MAX)
+		return -1;
+	return x;
+}
+
+/* checks the class and returns the class data to use */
+static int check_ioclass(int ioclass, int data, int has_data)
+{
+	switch (ioclass) {
+		case IOPRIO_CLASS_NONE:
+			if (has_data && !tolerant)
+				warnx(_("ignoring given class data for none class"));
+			data = 0;
+			break;
+		case IOPRIO_CLASS_RT:
+		case IOPRIO_CLASS_BE:
+			break;
+		case IOPRIO_CLASS_IDLE:
+			if (has_data && !tolerant)
+				warnx(_("ignoring given class data for idle class"));
+			data = 7;
+			break;
+		default:
+			if (!tolerant)
+				warnx(_("unknown prio class %d"), ioclass);
+			break;
+	}
+	return data;
+}
+
 static void ioprio_print(int pid, int who)
 {
 	int ioprio = ioprio_get(who, pid);
@@ -98,6 +145,86 @@ static void ioprio_setid(int which, int ioclass, int data, int who)
 		err(EXIT_FAILURE, _("ioprio_set failed"));
 }
 
+/*
+ * Sets class and data for all tasks from stdin (or from the cgroup), the
+ * "<pid> [<class> [<classdata>]]" lines may overwrite the command line
+ * setting. The errors are reported for the tasks and it continues with
+ * the next task.
+ *
+ * Returns: number of errors
+ */
+static size_t ioprio_set_bulk(const char *cgroup, int ioclass, int data, int has_data)
+{
+	struct proc_tasks *ts;
+	size_t nerrs = 0;
+	char *param;
+	pid_t pid;
+	int rc;
+
+	ts = cgroup ? proc_open_cgroup_tasks(cgroup) :
+		      proc_open_tasks_stream(stdin);
+	if (!ts)
+		err(EXIT_FAILURE, _("cannot obtain the list of tasks"));
+
+	data = check_ioclass(ioclass, data, has_data);
+
+	while ((rc = proc_next_tid_param(ts, &pid, &param)) != 1) {
+		int cl = ioclass, dt = data;
+
+		if (rc == -EINVAL) {
+			warnx(_("invalid line: %s"), param);
+			nerrs++;
+			continue;
+		}
+		if (rc < 0) {
+			warn(_("cannot read the list of tasks"));
+			nerrs++;
+			break;
+		}
+
+		if (param) {
+			char *cls = param, *num;
+			int dt_set = 0;
+
+			num = strpbrk(param, " \t");
+			if (num) {
+				*num++ = '\0';
+				num = (char *) skip_space(num);
+			}
+			cl = parse_ioclass_arg(cls);
+			if (cl < 0) {
+				warnx(_("pid %d: unknown scheduling class: '%s'"), pid, cls);
+				nerrs++;
+				continue;
+			}
+			dt = 4;
+			if (num) {
+				char *end = NULL;
+
+				errno = 0;
+				dt = (int) strtol(num, &end, 10);
+				if (errno || end == num || *end) {
+					warnx(_("pid %d: invalid class data argument: '%s'"),
+							pid, num);
+					nerrs++;
+					continue;
+				}
+				dt_set = 1;
+			}
+			dt = check_ioclass(cl, dt, dt_set);
+		}
+
+		if (ioprio_set(IOPRIO_WHO_PROCESS, pid, IOPRIO_PRIO_VALUE(cl, dt)) == -1
+		    && !tolerant) {
+			warn(_("failed to set pid %d's I/O scheduling"), pid);
+			nerrs++;
+		}
+	}
+
+	proc_close_tasks(ts);
+	return nerrs;
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -105,6 +232,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fprintf(out,  _(" %1$s [options] -p <pid>...\n"
 			" %1$s [options] -P <pgid>...\n"
 			" %1$s [options] -u <uid>...\n"
+			" %1$s [options] --bulk\n"
+			" %1$s [options] --cgroup <path>\n"
 			" %1$s [options] <command>\n"), program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -119,6 +248,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -P, --pgid <pgrp>...   act on already running processes in these groups\n"), out);
 	fputs(_(" -t, --ignore           ignore failures\n"), out);
 	fputs(_(" -u, --uid <uid>...     act on already running processes owned by these users\n"), out);
+	fputs(_("     --bulk             read \"<pid> [<class> [<classdata>]]\" lines from stdin\n"), out);
+	fputs(_("     --cgroup <path>    act on all the tasks in the cgroup\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(24));
@@ -131,8 +262,8 @@ static void __attribute__((__noreturn__)) usage(void)
 int main(int argc, char **argv)
 {
 	int data = 4, set = 0, ioclass = IOPRIO_CLASS_BE, c;
-	int which = 0, who = 0;
-	const char *invalid_msg = NULL;
+	int which = 0, who = 0, bulk = 0;
+	const char *invalid_msg = NULL, *cgroup = NULL;
 
 	static const struct option longopts[] = {
 		{ "classdata", required_argument, NULL, 'n' },
@@ -143,6 +274,8 @@ int main(int argc, char **argv)
 		{ "pgid",      required_argument, NULL, 'P' },
 		{ "uid",       required_argument, NULL, 'u' },
 		{ "version",   no_argument,       NULL, 'V' },
+		{ "bulk",      no_argument,       NULL, OPT_BULK },
+		{ "cgroup",    required_argument, NULL, OPT_CGROUP },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -197,6 +330,12 @@ int main(int argc, char **argv)
 		case 't':
 			tolerant = 1;
 			break;
+		case OPT_BULK:
+			bulk = 1;
+			break;
+		case OPT_CGROUP:
+			cgroup = optarg;
+			break;
 
 		case 'V':
 			print_version(EXIT_SUCCESS);
@@ -206,26 +345,17 @@ int main(int argc, char **argv)
 			errtryhelp(EXIT_FAILURE);
 		}
 
-	switch (ioclass) {
-		case IOPRIO_CLASS_NONE:
-			if ((set & 1) && !tolerant)
-				warnx(_("ignoring given class data for none class"));
-			data = 0;
-			break;
-		case IOPRIO_CLASS_RT:
-		case IOPRIO_CLASS_BE:
-			break;
-		case IOPRIO_CLASS_IDLE:
-			if ((set & 1) && !tolerant)
-				warnx(_("ignoring given class data for idle class"));
-			data = 7;
-			break;
-		default:
-			if (!tolerant)
-				warnx(_("unknown prio class %d"), ioclass);
-			break;
+	if (bulk || cgroup) {
+		if (who || (bulk && cgroup) || optind != argc) {
+			warnx(_("bad usage"));
+			errtryhelp(EXIT_FAILURE);
+		}
+		return ioprio_set_bulk(cgroup, ioclass, data, set & 1) ?
+				EXIT_FAILURE : EXIT_SUCCESS;
 	}
 
+	data = check_ioclass(ioclass, data, set & 1);
+
 	if (!set && !which && optind == argc)
 		/*
 		 * ionice without options, print the current ioprio
@@ -26,15 +26,20 @@
 #include <sched.h>
 #include <stddef.h>
 #include <string.h>
+#include <dirent.h>
 
 #include "cpuset.h"
 #include "nls.h"
 #include "strutils.h"
 #include "xalloc.h"
 #include "procutils.h"
+#include "path.h"
 #include "c.h"
 #include "closestream.h"
 
+#define _PATH_SYS_CPU		"/sys/devices/system/cpu"
+#define _PATH_SYS_NODE		"/sys/devices/system/node"
+
 struct taskset {
 	pid_t		pid;		/* task PID */
 	cpu_set_t	*set;		/* task CPU mask */
@@ -45,11 +50,34 @@ struct taskset {
 			get_only:1;	/* print the mask, but not modify */
 };
 
+enum {
+	OPT_BULK = CHAR_MAX + 1,
+	OPT_CGROUP,
+	OPT_SPREAD
+};
+
+/* topology units for --spread */
+enum {
+	SPREAD_NONE = 0,
+	SPREAD_CORE,
+	SPREAD_L3,
+	SPREAD_NUMA
+};
+
+struct spread {
+	int		maxcpus;
+	size_t		setsize;
+	cpu_set_t	**units;	/* CPUs of the units, ordered by the first CPU */
+	size_t		nunits;
+};
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
 	fprintf(out,
-		_("Usage: %s [options] [mask | cpu-list] [pid|cmd [args...]]\n\n"),
+		_("Usage: %1$s [options] [mask | cpu-list] [pid|cmd [args...]]\n"
+		  "       %1$s [options] --bulk [mask | cpu-list]\n"
+		  "       %1$s [options] --cgroup <path> <mask | cpu-list>\n\n"),
 		program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -61,6 +89,10 @@ static void __attribute__((__noreturn__)) usage(void)
 		" -a, --all-tasks         operate on all the tasks (threads) for a given pid\n"
 		" -p, --pid               operate on existing given pid\n"
 		" -c, --cpu-list          display and specify cpus in list format\n"
+		"     --bulk              read \"<pid> [mask | cpu-list]\" lines from stdin\n"
+		"     --cgroup <path>     operate on all the tasks in the cgroup\n"
+		"     --spread <unit>     assign the tasks round-robin to the CPU cores,\n"
+		"                           L3 caches or NUMA nodes (core, l3 or numa)\n"
 		));
 	printf(USAGE_HELP_OPTIONS(25));
 
@@ -75,7 +107,11 @@ static void __attribute__((__noreturn__)) usage(void)
 		"List format uses a comma-separated list instead of a mask:\n"
 		"    %1$s -pc 0,3,7-11 700\n"
 		"Ranges in list format can take a stride argument:\n"
-		"    e.g. 0-31:2 is equivalent to mask 0x55555555\n"),
+		"    e.g. 0-31:2 is equivalent to mask 0x55555555\n"
+		"Many tasks can be set by one call:\n"
+		"    printf '700 03\\n701 0c\\n' | %1$s --bulk\n"
+		"Threads can be spread over the cores of the current affinity:\n"
+		"    %1$s --spread=core -a -p 700\n"),
 		program_invocation_short_name);
 
 	printf(USAGE_MAN_TAIL("taskset(1)"));
@@ -136,19 +172,332 @@ static void do_taskset(struct taskset *ts, size_t setsize, cpu_set_t *set)
 	}
 }
 
+static int parse_spread(const char *str)
+{
+	if (strcmp(str, "core") == 0)
+		return SPREAD_CORE;
+	if (strcmp(str, "l3") == 0)
+		return SPREAD_L3;
+	if (strcmp(str, "numa") == 0)
+		return SPREAD_NUMA;
+
+	errx(EXIT_FAILURE, _("unsupported spread unit: %s"), str);
+}
+
+/* adds CPUs of the unit (restricted to @allowed) if not already added */
+static void spread_add_unit(struct spread *sp, cpu_set_t *unit, cpu_set_t *allowed)
+{
+	size_t i;
+
+	CPU_AND_S(sp->setsize, unit, unit, allowed);
+	if (CPU_COUNT_S(sp->setsize, unit) == 0)
+		goto free;
+
+	for (i = 0; i < sp->nunits; i++) {
+		if (CPU_EQUAL_S(sp->setsize, sp->units[i], unit))
+			goto free;
+	}
+	sp->units = xrealloc(sp->units, (sp->nunits + 1) * sizeof(cpu_set_t *));
+	sp->units[sp->nunits++] = unit;
+	return;
+free:
+	cpuset_free(unit);
+}
+
+/* returns the CPUs sharing the L3 cache with @cpu (or the package CPUs) */
+static cpu_set_t *read_l3_unit(struct spread *sp, struct path_cxt *syscpu, int cpu)
+{
+	cpu_set_t *unit = NULL;
+	int i, level;
+
+	for (i = 0; ul_path_accessf(syscpu, F_OK, "cpu%d/cache/index%d", cpu, i) == 0; i++) {
+		if (ul_path_readf_s32(syscpu, &level, "cpu%d/cache/index%d/level", cpu, i) != 0
+		    || level != 3)
+			continue;
+		if (ul_path_readf_cpulist(syscpu, &unit, sp->maxcpus,
+				"cpu%d/cache/index%d/shared_cpu_list", cpu, i) == 0)
+			return unit;
+	}
+
+	/* no L3 cache, use the package */
+	if (ul_path_readf_cpulist(syscpu, &unit, sp->maxcpus,
+				"cpu%d/topology/core_siblings_list", cpu) == 0)
+		return unit;
+	return NULL;
+}
+
+static inline int is_node_dirent(struct dirent *d)
+{
+	return
+		d &&
+#ifdef _DIRENT_HAVE_D_TYPE
+		(d->d_type == DT_DIR || d->d_type == DT_UNKNOWN) &&
+#endif
+		strncmp(d->d_name, "node", 4) == 0 &&
+		isdigit_string(d->d_name + 4);
+}
+
+static void read_numa_units(struct spread *sp, cpu_set_t *allowed)
+{
+	struct path_cxt *sysnode;
+	struct dirent *d;
+	DIR *dir;
+
+	sysnode = ul_new_path(_PATH_SYS_NODE);
+	if (!sysnode)
+		err(EXIT_FAILURE, _("failed to initialize %s handler"), _PATH_SYS_NODE);
+
+	dir = ul_path_opendir(sysnode, NULL);
+	while (dir && (d = readdir(dir))) {
+		cpu_set_t *unit = NULL;
+
+		if (is_node_dirent(d)
+		    && ul_path_readf_cpuset(sysnode, &unit, sp->maxcpus,
+				"%s/cpumap", d->d_name) == 0)
+			spread_add_unit(sp, unit, allowed);
+	}
+	if (dir)
+		closedir(dir);
+	ul_unref_path(sysnode);
+}
+
+static int cmp_units(const void *a, const void *b, void *data)
+{
+	cpu_set_t *x = *((cpu_set_t * const *) a);
+	cpu_set_t *y = *((cpu_set_t * const *) b);
+	struct spread *sp = (struct spread *) data;
+	int i;
+
+	for (i = 0; i < sp->maxcpus; i++) {
+		int ix = CPU_ISSET_S(i, sp->setsize, x),
+		    iy = CPU_ISSET_S(i, sp->setsize, y);
+
+		if (ix != iy)
+			return ix ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Reads the topology units from sysfs, only the @allowed CPUs are used.
+ * The CPUs without the topology information (or without NUMA nodes) are
+ * in one unit.
+ */
+static void read_spread_units(struct spread *sp, int kind, cpu_set_t *allowed)
+{
+	struct path_cxt *syscpu;
+	cpu_set_t *rest;
+	size_t i;
+	int cpu;
+
+	if (kind == SPREAD_NUMA)
+		read_numa_units(sp, allowed);
+	else {
+		syscpu = ul_new_path(_PATH_SYS_CPU);
+		if (!syscpu)
+			err(EXIT_FAILURE, _("failed to initialize %s handler"), _PATH_SYS_CPU);
+
+		for (cpu = 0; cpu < sp->maxcpus; cpu++) {
+			cpu_set_t *unit = NULL;
+
+			if (!CPU_ISSET_S(cpu, sp->setsize, allowed))
+				continue;
+			if (kind == SPREAD_L3)
+				unit = read_l3_unit(sp, syscpu, cpu);
+			else
+				ul_path_readf_cpulist(syscpu, &unit, sp->maxcpus,
+					"cpu%d/topology/thread_siblings_list", cpu);
+			if (unit)
+				spread_add_unit(sp, unit, allowed);
+		}
+		ul_unref_path(syscpu);
+	}
+
+	/* allowed CPUs not in any unit */
+	rest = cpuset_alloc(sp->maxcpus, NULL, NULL);
+	if (!rest)
+		err(EXIT_FAILURE, _("cpuset_alloc failed"));
+	memcpy(rest, allowed, sp->setsize);
+	for (i = 0; i < sp->nunits; i++) {
+		for (cpu = 0; cpu < sp->maxcpus; cpu++) {
+			if (CPU_ISSET_S(cpu, sp->setsize, sp->units[i]))
+				CPU_CLR_S(cpu, sp->setsize, rest);
+		}
+	}
+	spread_add_unit(sp, rest, allowed);
+
+	qsort_r(sp->units, sp->nunits, sizeof(cpu_set_t *), cmp_units, sp);
+}
+
+static void free_spread(struct spread *sp)
+{
+	size_t i;
+
+	for (i = 0; i < sp->nunits; i++)
+		cpuset_free(sp->units[i]);
+	free(sp->units);
+}
+
+/*
+ * Assigns the task (or all threads of the process) round-robin to the
+ * topology units. The units are restricted to @set or to the current
+ * affinity of @pid.
+ */
+static void do_taskset_spread(struct taskset *ts, int kind, pid_t pid,
+			      int all_tasks, int maxcpus, cpu_set_t *set)
+{
+	struct spread sp = { .maxcpus = maxcpus, .setsize = CPU_ALLOC_SIZE(maxcpus) };
+	cpu_set_t *allowed = set;
+	size_t n = 0;
+
+	if (!allowed) {
+		allowed = cpuset_alloc(maxcpus, NULL, NULL);
+		if (!allowed)
+			err(EXIT_FAILURE, _("cpuset_alloc failed"));
+		if (sched_getaffinity(pid, sp.setsize, allowed) < 0)
+			err_affinity(pid, 0);
+	}
+
+	read_spread_units(&sp, kind, allowed);
+	if (!sp.nunits)
+		errx(EXIT_FAILURE, _("no CPUs to spread the tasks over"));
+
+	if (all_tasks) {
+		struct proc_tasks *tasks = proc_open_tasks(pid);
+
+		if (!tasks)
+			err(EXIT_FAILURE, _("cannot obtain the list of tasks"));
+		while (!proc_next_tid(tasks, &ts->pid))
+			do_taskset(ts, sp.setsize, sp.units[n++ % sp.nunits]);
+		proc_close_tasks(tasks);
+	} else {
+		ts->pid = pid;
+		do_taskset(ts, sp.setsize, sp.units[0]);
+	}
+
+	free_spread(&sp);
+	if (allowed != set)
+		cpuset_free(allowed);
+}
+
+static int parse_cpus(struct taskset *ts, const char *str,
+		      cpu_set_t *set, size_t setsize)
+{
+	if (ts->use_list)
+		return cpulist_parse(str, set, setsize, 0);
+	return cpumask_parse(str, set, setsize);
+}
+
+/* sets affinity for the task (or all its threads), returns number of errors */
+static size_t set_affinity_bulk(pid_t pid, int all_tasks,
+				size_t setsize, cpu_set_t *set)
+{
+	struct proc_tasks *tasks;
+	size_t nerrs = 0;
+	pid_t tid;
+
+	if (!all_tasks) {
+		if (sched_setaffinity(pid, setsize, set) == 0)
+			return 0;
+		warn(_("failed to set pid %d's affinity"), pid);
+		return 1;
+	}
+
+	tasks = proc_open_tasks(pid);
+	if (!tasks) {
+		warn(_("cannot obtain the list of tasks for pid %d"), pid);
+		return 1;
+	}
+	while (!proc_next_tid(tasks, &tid)) {
+		if (sched_setaffinity(tid, setsize, set) < 0) {
+			warn(_("failed to set pid %d's affinity"), tid);
+			nerrs++;
+		}
+	}
+	proc_close_tasks(tasks);
+	return nerrs;
+}
+
+/*
+ * Sets affinity for all tasks from the list, the mask (or cpu-list) from the
+ * line is used if specified, otherwise @set. The errors are reported for the
+ * tasks and it continues with the next task.
+ *
+ * Returns: number of errors
+ */
+static size_t do_taskset_bulk(struct taskset *ts, struct proc_tasks *tasks,
+			      int all_tasks, size_t setsize, cpu_set_t *set)
+{
+	cpu_set_t *line_set;
+	char *last = NULL, *param;
+	size_t nerrs = 0;
+	pid_t pid;
+	int rc;
+
+	line_set = cpuset_alloc(get_max_number_of_cpus(), NULL, NULL);
+	if (!line_set)
+		err(EXIT_FAILURE, _("cpuset_alloc failed"));
+
+	while ((rc = proc_next_tid_param(tasks, &pid, &param)) != 1) {
+		cpu_set_t *cur = set;
+
+		if (rc == -EINVAL) {
+			warnx(_("invalid line: %s"), param);
+			nerrs++;
+			continue;
+		}
+		if (rc < 0) {
+			warn(_("cannot read the list of tasks"));
+			nerrs++;
+			break;
+		}
+
+		if (param) {
+			/* usually the same setting for many tasks */
+			if (!last || strcmp(last, param) != 0) {
+				free(last);
+				last = NULL;
+				if (parse_cpus(ts, param, line_set, setsize)) {
+					warnx(ts->use_list ?
+						_("failed to parse CPU list: %s") :
+						_("failed to parse CPU mask: %s"), param);
+					nerrs++;
+					continue;
+				}
+				last = xstrdup(param);
+			}
+			cur = line_set;
+		} else if (!cur) {
+			warnx(_("pid %d: no CPU mask specified"), pid);
+			nerrs++;
+			continue;
+		}
+
+		nerrs += set_affinity_bulk(pid, all_tasks, setsize, cur);
+	}
+
+	free(last);
+	cpuset_free(line_set);
+	return nerrs;
+}
+
 int main(int argc, char **argv)
 {
 	cpu_set_t *new_set;
 	pid_t pid = 0;
-	int c, all_tasks = 0;
+	int c, all_tasks = 0, bulk = 0, spread = SPREAD_NONE;
 	int ncpus;
 	size_t new_setsize, nbits;
+	const char *cgroup = NULL;
 	struct taskset ts;
 
 	static const struct option longopts[] = {
 		{ "all-tasks",	0, NULL, 'a' },
 		{ "pid",	0, NULL, 'p' },
 		{ "cpu-list",	0, NULL, 'c' },
+		{ "bulk",	0, NULL, OPT_BULK },
+		{ "cgroup",	1, NULL, OPT_CGROUP },
+		{ "spread",	1, NULL, OPT_SPREAD },
 		{ "help",	0, NULL, 'h' },
 		{ "version",	0, NULL, 'V' },
 		{ NULL,		0, NULL,  0  }
@@ -173,6 +522,15 @@ int main(int argc, char **argv)
 		case 'c':
 			ts.use_list = 1;
 			break;
+		case OPT_BULK:
+			bulk = 1;
+			break;
+		case OPT_CGROUP:
+			cgroup = optarg;
+			break;
+		case OPT_SPREAD:
+			spread = parse_spread(optarg);
+			break;
 
 		case 'V':
 			print_version(EXIT_SUCCESS);
@@ -183,7 +541,19 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if ((!pid && argc - optind < 2)
+	if (spread) {
+		if (!pid || bulk || cgroup || argc - optind > 2) {
+			warnx(_("bad usage"));
+			errtryhelp(EXIT_FAILURE);
+		}
+	} else if (bulk || cgroup) {
+		if (pid || (bulk && cgroup)
+		    || (bulk && argc - optind > 1)
+		    || (cgroup && argc - optind != 1)) {
+			warnx(_("bad usage"));
+			errtryhelp(EXIT_FAILURE);
+		}
+	} else if ((!pid && argc - optind < 2)
 	    || (pid && (argc - optind < 1 || argc - optind > 2))) {
 		warnx(_("bad usage"));
 		errtryhelp(EXIT_FAILURE);
@@ -193,6 +563,35 @@ int main(int argc, char **argv)
 	if (ncpus <= 0)
 		errx(EXIT_FAILURE, _("cannot determine NR_CPUS; aborting"));
 
+	if (bulk || cgroup) {
+		struct proc_tasks *tasks;
+		size_t nerrs;
+
+		new_set = NULL;
+		new_setsize = CPU_ALLOC_SIZE(ncpus);
+		if (argc - optind == 1) {
+			new_set = cpuset_alloc(ncpus, &new_setsize, NULL);
+			if (!new_set)
+				err(EXIT_FAILURE, _("cpuset_alloc failed"));
+			if (parse_cpus(&ts, argv[optind], new_set, new_setsize))
+				errx(EXIT_FAILURE, ts.use_list ?
+					_("failed to parse CPU list: %s") :
+					_("failed to parse CPU mask: %s"),
+					argv[optind]);
+		}
+
+		tasks = cgroup ? proc_open_cgroup_tasks(cgroup) :
+				 proc_open_tasks_stream(stdin);
+		if (!tasks)
+			err(EXIT_FAILURE, _("cannot obtain the list of tasks"));
+
+		nerrs = do_taskset_bulk(&ts, tasks, all_tasks, new_setsize, new_set);
+
+		proc_close_tasks(tasks);
+		cpuset_free(new_set);
+		return nerrs ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
 	/*
 	 * the ts->set is always used for the sched_getaffinity call
 	 * On the sched_getaffinity the kernel demands a user mask of
@@ -227,7 +626,13 @@ int main(int argc, char **argv)
 		     argv[optind]);
 	}
 
-	if (all_tasks && pid) {
+	if (spread) {
+		int only_pid = ts.get_only;
+
+		ts.get_only = 0;
+		do_taskset_spread(&ts, spread, pid, all_tasks, ncpus,
+				  only_pid ? NULL : new_set);
+	} else if (all_tasks && pid) {
 		struct proc_tasks *tasks = proc_open_tasks(pid);
 		while (!proc_next_tid(tasks, &ts.pid))
 			do_taskset(&ts, new_setsize, new_set);
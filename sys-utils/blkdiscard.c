@@ -32,6 +32,8 @@
 #include <limits.h>
 #include <getopt.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -43,6 +45,8 @@
 #include "c.h"
 #include "closestream.h"
 #include "monotonic.h"
+#include "sysfs.h"
+#include "xalloc.h"
 
 #ifndef BLKDISCARD
 # define BLKDISCARD	_IO(0x12,119)
@@ -56,12 +60,66 @@
 # define BLKZEROOUT	_IO(0x12,127)
 #endif
 
+/* --step auto fallback, if the limits are not available in sysfs */
+#define DEFAULT_STEP	(1024 * 1024 * 1024)
+#define STEP_AUTO	UINT64_MAX
+
 enum {
 	ACT_DISCARD = 0,	/* default */
 	ACT_ZEROOUT,
 	ACT_SECURE
 };
 
+/*
+ * The requests queue for --threads; every thread takes the next step from
+ * the range, so the requests are in flight at the same time.
+ *
+ * The ul_uring wrapper (lib/uring.c) is not used here, it supports only
+ * reads and writes, and io_uring has no discard or zero-out operation for
+ * block devices (except IORING_OP_URING_CMD in Linux >= 6.12). The blocking
+ * ioctls in threads are the portable way to keep more requests in flight.
+ */
+struct discard_queue {
+	pthread_mutex_t lock;
+	const char *path;
+	int fd;
+	int act;
+	int verbose;
+
+	uint64_t next;			/* the first not requested byte */
+	uint64_t end;
+	uint64_t step;
+	uint64_t done;			/* bytes done by all threads */
+
+	int errnum;			/* errno of the first failed request */
+	uint64_t erroff;
+
+	struct timeval start;		/* progress */
+	struct timeval last;
+};
+
+static const char *act_ioctl_name(int act)
+{
+	switch (act) {
+	case ACT_ZEROOUT:
+		return "BLKZEROOUT";
+	case ACT_SECURE:
+		return "BLKSECDISCARD";
+	}
+	return "BLKDISCARD";
+}
+
+static int do_request(int fd, int act, uint64_t range[2])
+{
+	switch (act) {
+	case ACT_ZEROOUT:
+		return ioctl(fd, BLKZEROOUT, range);
+	case ACT_SECURE:
+		return ioctl(fd, BLKSECDISCARD, range);
+	}
+	return ioctl(fd, BLKDISCARD, range);
+}
+
 static void print_stats(int act, char *path, uint64_t stats[])
 {
 	switch (act) {
@@ -77,6 +135,133 @@ static void print_stats(int act, char *path, uint64_t stats[])
 	}
 }
 
+static void print_throughput(int act, const char *path, uint64_t bytes,
+			     struct timeval *start, struct timeval *now)
+{
+	double sec = (now->tv_sec - start->tv_sec)
+			+ (now->tv_usec - start->tv_usec) / 1000000.0;
+	char *str = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE,
+			sec > 0 ? (uint64_t) (bytes / sec) : bytes);
+
+	if (act == ACT_ZEROOUT)
+		printf(_("%s: Zero-filled %" PRIu64 " bytes in %.1f seconds (%s/s)\n"),
+			path, bytes, sec, str);
+	else
+		printf(_("%s: Discarded %" PRIu64 " bytes in %.1f seconds (%s/s)\n"),
+			path, bytes, sec, str);
+	free(str);
+}
+
+static void *queue_worker(void *data)
+{
+	struct discard_queue *q = data;
+
+	pthread_mutex_lock(&q->lock);
+	while (!q->errnum && q->next < q->end) {
+		uint64_t range[2] = { q->next, min(q->step, q->end - q->next) };
+		int rc;
+
+		q->next += range[1];
+		pthread_mutex_unlock(&q->lock);
+
+		rc = do_request(q->fd, q->act, range);
+
+		pthread_mutex_lock(&q->lock);
+		if (rc) {
+			if (!q->errnum) {
+				q->errnum = errno;
+				q->erroff = range[0];
+			}
+			break;
+		}
+		q->done += range[1];
+
+		/* reporting progress at most once per second */
+		if (q->verbose) {
+			struct timeval now;
+
+			gettime_monotonic(&now);
+			if (now.tv_sec > q->last.tv_sec &&
+			    (now.tv_usec >= q->last.tv_usec || now.tv_sec > q->last.tv_sec + 1)) {
+				print_throughput(q->act, q->path, q->done, &q->start, &now);
+				q->last = now;
+			}
+		}
+	}
+	pthread_mutex_unlock(&q->lock);
+	return NULL;
+}
+
+static void run_queue(struct discard_queue *q, size_t nthreads)
+{
+	pthread_t *threads = xcalloc(nthreads, sizeof(pthread_t));
+	struct timeval now;
+	size_t i;
+
+	pthread_mutex_init(&q->lock, NULL);
+	gettime_monotonic(&q->start);
+	q->last = q->start;
+
+	for (i = 1; i < nthreads; i++) {
+		int rc = pthread_create(&threads[i], NULL, queue_worker, q);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, _("failed to create thread"));
+		}
+	}
+	queue_worker(q);
+
+	for (i = 1; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	if (q->errnum) {
+		errno = q->errnum;
+		err(EXIT_FAILURE, _("%s: %s ioctl failed at offset %" PRIu64),
+			q->path, act_ioctl_name(q->act), q->erroff);
+	}
+	if (q->verbose) {
+		gettime_monotonic(&now);
+		print_throughput(q->act, q->path, q->done, &q->start, &now);
+	}
+}
+
+/*
+ * Returns the step by the device limits; the requests are not split by
+ * kernel, and they are aligned to the discard granularity.
+ */
+static uint64_t get_auto_step(dev_t devno, int act, int secsize)
+{
+	struct path_cxt *pc, *wholedisk = NULL;
+	uint64_t max = 0, gran = 0;
+	dev_t disk = 0;
+
+	pc = ul_new_sysfs_path(devno, NULL, NULL);
+	if (!pc)
+		return DEFAULT_STEP;
+
+	/* the queue attributes are provided for whole devices only */
+	if (sysfs_blkdev_get_wholedisk(pc, NULL, 0, &disk) == 0 && disk
+	    && disk != devno) {
+		wholedisk = ul_new_sysfs_path(disk, NULL, NULL);
+		if (wholedisk)
+			sysfs_blkdev_set_parent(pc, wholedisk);
+	}
+
+	ul_path_read_u64(pc, &max, act == ACT_ZEROOUT ?
+				"queue/write_zeroes_max_bytes" :
+				"queue/discard_max_bytes");
+	ul_path_read_u64(pc, &gran, "queue/discard_granularity");
+
+	ul_unref_path(pc);
+	ul_unref_path(wholedisk);
+
+	if (gran && act != ACT_ZEROOUT)
+		max -= max % gran;
+	max -= max % secsize;
+	return max ? max : DEFAULT_STEP;
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -91,7 +276,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -f, --force         disable all checking\n"), out);
 	fputs(_(" -o, --offset <num>  offset in bytes to discard from\n"), out);
 	fputs(_(" -l, --length <num>  length of bytes to discard from the offset\n"), out);
-	fputs(_(" -p, --step <num>    size of the discard iterations within the offset\n"), out);
+	fputs(_(" -p, --step <num>    size of the discard iterations within the offset,\n"
+		"                       or 'auto' to use the device limits\n"), out);
+	fputs(_(" -t, --threads <num> number of discard requests in flight\n"), out);
 	fputs(_(" -s, --secure        perform secure discard\n"), out);
 	fputs(_(" -z, --zeroout       zero-fill rather than discard\n"), out);
 	fputs(_(" -v, --verbose       print aligned length and offset\n"), out);
@@ -112,6 +299,7 @@ int main(int argc, char **argv)
 	char *path;
 	int c, fd, verbose = 0, secsize, force = 0;
 	uint64_t end, blksize, step, range[2], stats[2];
+	size_t nthreads = 1;
 	struct stat sb;
 	struct timeval now, last;
 	int act = ACT_DISCARD;
@@ -123,6 +311,7 @@ int main(int argc, char **argv)
 	    { "force",     no_argument,       NULL, 'f' },
 	    { "length",    required_argument, NULL, 'l' },
 	    { "step",      required_argument, NULL, 'p' },
+	    { "threads",   required_argument, NULL, 't' },
 	    { "secure",    no_argument,       NULL, 's' },
 	    { "verbose",   no_argument,       NULL, 'v' },
 	    { "zeroout",   no_argument,       NULL, 'z' },
@@ -138,7 +327,7 @@ int main(int argc, char **argv)
 	range[1] = ULLONG_MAX;
 	step = 0;
 
-	while ((c = getopt_long(argc, argv, "hfVsvo:l:p:z", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hfVsvo:l:p:t:z", longopts, NULL)) != -1) {
 		switch(c) {
 		case 'f':
 			force = 1;
@@ -152,9 +341,18 @@ int main(int argc, char **argv)
 					_("failed to parse offset"));
 			break;
 		case 'p':
-			step = strtosize_or_err(optarg,
+			if (strcmp(optarg, "auto") == 0)
+				step = STEP_AUTO;
+			else
+				step = strtosize_or_err(optarg,
 					_("failed to parse step"));
 			break;
+		case 't':
+			nthreads = strtou32_or_err(optarg,
+					_("failed to parse number of threads"));
+			if (!nthreads)
+				errx(EXIT_FAILURE, _("invalid number of threads"));
+			break;
 		case 's':
 			act = ACT_SECURE;
 			break;
@@ -210,6 +408,10 @@ int main(int argc, char **argv)
 	if (end < range[0] || end > blksize)
 		end = blksize;
 
+	/* more requests in flight need more requests */
+	if (step == STEP_AUTO || (!step && nthreads > 1))
+		step = get_auto_step(sb.st_rdev, act, secsize);
+
 	range[1] = (step > 0) ? step : end - range[0];
 
 	/* check length alignment to the sector size */
@@ -217,6 +419,22 @@ int main(int argc, char **argv)
 		errx(EXIT_FAILURE, _("%s: length %" PRIu64 " is not aligned "
 			 "to sector size %i"), path, range[1], secsize);
 
+	if (nthreads > 1) {
+		struct discard_queue q = {
+			.path = path,
+			.fd = fd,
+			.act = act,
+			.verbose = verbose,
+			.next = range[0],
+			.end = end,
+			.step = range[1]
+		};
+
+		run_queue(&q, nthreads);
+		close(fd);
+		return EXIT_SUCCESS;
+	}
+
 	stats[0] = range[0], stats[1] = 0;
 	gettime_monotonic(&last);
 
@@ -224,20 +442,9 @@ int main(int argc, char **argv)
 		if (range[0] + range[1] > end)
 			range[1] = end - range[0];
 
-		switch (act) {
-		case ACT_ZEROOUT:
-			if (ioctl(fd, BLKZEROOUT, &range))
-				 err(EXIT_FAILURE, _("%s: BLKZEROOUT ioctl failed"), path);
-			break;
-		case ACT_SECURE:
-			if (ioctl(fd, BLKSECDISCARD, &range))
-				err(EXIT_FAILURE, _("%s: BLKSECDISCARD ioctl failed"), path);
-			break;
-		case ACT_DISCARD:
-			if (ioctl(fd, BLKDISCARD, &range))
-				err(EXIT_FAILURE, _("%s: BLKDISCARD ioctl failed"), path);
-			break;
-		}
+		if (do_request(fd, act, range))
+			err(EXIT_FAILURE, _("%s: %s ioctl failed"), path,
+				act_ioctl_name(act));
 
 		stats[1] += range[1];
 
@@ -28,6 +28,7 @@
 #include <limits.h>
 #include <getopt.h>
 #include <time.h>
+#include <errno.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -43,6 +44,7 @@
 #include "blkdev.h"
 #include "sysfs.h"
 #include "optutils.h"
+#include "ranges.h"
 
 struct blkzone_control;
 
@@ -149,7 +151,7 @@ done:
 /*
  * blkzone report
  */
-#define DEF_REPORT_LEN		(1U << 12) /* 4k zones per report (256k kzalloc) */
+#define MAX_REPORT_LEN		(1U << 17) /* 128k zones per report (8M buffer) */
 
 static const char *type_text[] = {
 	"RESERVED",
@@ -174,7 +176,8 @@ static int blkzone_report(struct blkzone_control *ctl)
 {
 	struct blk_zone_report *zi;
 	unsigned long zonesize;
-	uint32_t i, nr_zones;
+	uint32_t i, nr_zones, report_len;
+	const char *fmt;
 	int fd;
 
 	fd = init_device(ctl, O_RDONLY);
@@ -194,12 +197,17 @@ static int blkzone_report(struct blkzone_control *ctl)
 	else
 		nr_zones = 1 + (ctl->total_sectors - ctl->offset) / zonesize;
 
+	/* the buffer is large enough for all the zones on usual devices */
+	report_len = min(nr_zones, MAX_REPORT_LEN);
 	zi = xmalloc(sizeof(struct blk_zone_report) +
-		     (DEF_REPORT_LEN * sizeof(struct blk_zone)));
+		     (report_len * sizeof(struct blk_zone)));
+
+	fmt = _("  start: 0x%09"PRIx64", len 0x%06"PRIx64", wptr 0x%06"PRIx64
+		" reset:%u non-seq:%u, zcond:%2u(%s) [type: %u(%s)]\n");
 
 	while (nr_zones && ctl->offset < ctl->total_sectors) {
 
-		zi->nr_zones = min(nr_zones, DEF_REPORT_LEN);
+		zi->nr_zones = min(nr_zones, report_len);
 		zi->sector = ctl->offset;
 
 		if (ioctl(fd, BLKREPORTZONE, zi) == -1)
@@ -225,9 +233,7 @@ static int blkzone_report(struct blkzone_control *ctl)
 				break;
 			}
 
-			printf(_("  start: 0x%09"PRIx64", len 0x%06"PRIx64", wptr 0x%06"PRIx64
-			 	" reset:%u non-seq:%u, zcond:%2u(%s) [type: %u(%s)]\n"),
-				start, len, (type == 0x1) ? 0 : wp - start,
+			printf(fmt, start, len, (type == 0x1) ? 0 : wp - start,
 				entry->reset, entry->non_seq,
 				cond, condition_str[cond & (ARRAY_SIZE(condition_str) - 1)],
 				type, type_text[type]);
@@ -247,10 +253,62 @@ static int blkzone_report(struct blkzone_control *ctl)
 
 /*
  * blkzone reset
+ *
+ * The large ranges are split to zone aligned parts and the parts are reset
+ * by more threads at the same time. The whole device is always reset by one
+ * ioctl, the kernel may use one "reset all" command for it.
  */
+#define RESET_THREADS		8	/* max number of threads */
+#define RESET_PERTHREAD		1024	/* min number of zones per thread */
+
+struct blkzone_reset {
+	int			fd;
+	uint64_t		offset;		/* first sector */
+	uint64_t		zlen;		/* number of sectors */
+	unsigned long		zonesize;
+	int			rcs[RESET_THREADS];	/* errno for every range */
+};
+
+static void reset_range(void *data, size_t range, size_t first, size_t last)
+{
+	struct blkzone_reset *rs = data;
+	struct blk_zone_range za;
+	uint64_t start = (uint64_t) first * rs->zonesize,
+		 end = (uint64_t) last * rs->zonesize;
+
+	za.sector = rs->offset + start;
+	za.nr_sectors = min(end, rs->zlen) - start;
+
+	if (ioctl(rs->fd, BLKRESETZONE, &za) == -1)
+		rs->rcs[range] = errno;
+}
+
+static int reset_ranges(int fd, uint64_t offset, uint64_t zlen,
+			unsigned long zonesize, int whole)
+{
+	struct blkzone_reset rs = {
+		.fd = fd,
+		.offset = offset,
+		.zlen = zlen,
+		.zonesize = zonesize
+	};
+	uint64_t nzones = (zlen + zonesize - 1) / zonesize;
+	size_t i, nranges;
+
+	nranges = ul_run_ranges(nzones, RESET_PERTHREAD,
+				whole ? 1 : RESET_THREADS, reset_range, &rs);
+
+	for (i = 0; i < nranges; i++) {
+		if (rs.rcs[i]) {
+			errno = rs.rcs[i];
+			return -1;
+		}
+	}
+	return 0;
+}
+
 static int blkzone_reset(struct blkzone_control *ctl)
 {
-	struct blk_zone_range za = { .sector = 0 };
 	unsigned long zonesize;
 	uint64_t zlen;
 	int fd;
@@ -285,10 +343,8 @@ static int blkzone_reset(struct blkzone_control *ctl)
 			"to zone size %lu"),
 			ctl->devname, ctl->length, zonesize);
 
-	za.sector = ctl->offset;
-	za.nr_sectors = zlen;
-
-	if (ioctl(fd, BLKRESETZONE, &za) == -1)
+	if (reset_ranges(fd, ctl->offset, zlen, zonesize,
+			 ctl->offset == 0 && zlen == ctl->total_sectors) == -1)
 		err(EXIT_FAILURE, _("%s: BLKRESETZONE ioctl failed"), ctl->devname);
 	else if (ctl->verbose)
 		printf(_("%s: successfully reset in range from %" PRIu64 ", to %" PRIu64),
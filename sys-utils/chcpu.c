@@ -52,6 +52,7 @@
 
 static cpu_set_t *onlinecpus;
 static int maxcpus;
+static int show_progress;
 
 #define is_cpu_online(cpu) (CPU_ISSET_S((cpu), CPU_ALLOC_SIZE(maxcpus), onlinecpus))
 #define num_online_cpus()  (CPU_COUNT_S(CPU_ALLOC_SIZE(maxcpus), onlinecpus))
@@ -66,20 +67,104 @@ enum {
 	CMD_CPU_DISPATCH_VERTICAL,
 };
 
+/* CPU to enable or disable */
+struct cpu_req {
+	int	cpu;
+	int	primary;	/* the first thread of the core */
+};
+
+static int is_primary_thread(struct path_cxt *sys, int cpu)
+{
+	size_t setsize = CPU_ALLOC_SIZE(maxcpus);
+	cpu_set_t *siblings = NULL;
+	int first = cpu, i;
+
+	if (ul_path_readf_cpulist(sys, &siblings, maxcpus,
+			"cpu%d/topology/thread_siblings_list", cpu) != 0 || !siblings)
+		return 1;
+
+	for (i = 0; i < maxcpus; i++) {
+		if (CPU_ISSET_S(i, setsize, siblings)) {
+			first = i;
+			break;
+		}
+	}
+	cpuset_free(siblings);
+	return first == cpu;
+}
+
+/* SMT siblings first, the core goes offline with its last thread */
+static int cmp_disable_order(const void *a, const void *b)
+{
+	const struct cpu_req *x = a, *y = b;
+
+	if (x->primary != y->primary)
+		return x->primary - y->primary;
+	return x->cpu - y->cpu;
+}
+
+/* the cores first, the siblings join an already running core */
+static int cmp_enable_order(const void *a, const void *b)
+{
+	const struct cpu_req *x = a, *y = b;
+
+	if (x->primary != y->primary)
+		return y->primary - x->primary;
+	return x->cpu - y->cpu;
+}
+
+/* prints status message, prefixed by the progress for --progress */
+static void __attribute__ ((__format__ (__printf__, 3, 4)))
+	cpu_message(size_t cur, size_t total, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (show_progress)
+		printf("[%zu/%zu] ", cur, total);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	if (show_progress)
+		fflush(stdout);
+}
+
 /* returns:   0 = success
  *          < 0 = failure
  *          > 0 = partial success
  */
 static int cpu_enable(struct path_cxt *sys, cpu_set_t *cpu_set, size_t setsize, int enable)
 {
+	struct cpu_req *reqs;
+	size_t i, nreqs = 0;
 	int cpu;
 	int online, rc;
-	int configured = -1;
+	int configured;
 	int fails = 0;
 
+	reqs = xcalloc(CPU_COUNT_S(setsize, cpu_set) + 1, sizeof(*reqs));
+
 	for (cpu = 0; cpu < maxcpus; cpu++) {
 		if (!CPU_ISSET_S(cpu, setsize, cpu_set))
 			continue;
+		reqs[nreqs].cpu = cpu;
+		if (CPU_COUNT_S(setsize, cpu_set) > 1)
+			reqs[nreqs].primary = is_primary_thread(sys, cpu);
+		nreqs++;
+	}
+
+	/* The kernel serializes CPU hotplug, so the order is the only thing
+	 * that matters. It's better to offline the SMT siblings first and
+	 * online them last, the tasks are not migrated back and forth between
+	 * the threads of the same core. */
+	if (nreqs > 1)
+		qsort(reqs, nreqs, sizeof(*reqs),
+		      enable ? cmp_enable_order : cmp_disable_order);
+
+	for (i = 0; i < nreqs; i++) {
+		cpu = reqs[i].cpu;
+		configured = -1;
+		online = -1;
+
 		if (ul_path_accessf(sys, F_OK, "cpu%d", cpu) != 0) {
 			warnx(_("CPU %u does not exist"), cpu);
 			fails++;
@@ -93,11 +178,11 @@ static int cpu_enable(struct path_cxt *sys, cpu_set_t *cpu_set, size_t setsize,
 		if (ul_path_readf_s32(sys, &online, "cpu%d/online", cpu) == 0
 		    && online == 1
 		    && enable == 1) {
-			printf(_("CPU %u is already enabled\n"), cpu);
+			cpu_message(i + 1, nreqs, _("CPU %u is already enabled\n"), cpu);
 			continue;
 		}
 		if (online == 0 && enable == 0) {
-			printf(_("CPU %u is already disabled\n"), cpu);
+			cpu_message(i + 1, nreqs, _("CPU %u is already disabled\n"), cpu);
 			continue;
 		}
 		if (ul_path_accessf(sys, F_OK, "cpu%d/configure", cpu) == 0)
@@ -111,7 +196,7 @@ static int cpu_enable(struct path_cxt *sys, cpu_set_t *cpu_set, size_t setsize,
 				warn(_("CPU %u enable failed"), cpu);
 				fails++;
 			} else
-				printf(_("CPU %u enabled\n"), cpu);
+				cpu_message(i + 1, nreqs, _("CPU %u enabled\n"), cpu);
 		} else {
 			if (onlinecpus && num_online_cpus() == 1) {
 				warnx(_("CPU %u disable failed (last enabled CPU)"), cpu);
@@ -123,13 +208,14 @@ static int cpu_enable(struct path_cxt *sys, cpu_set_t *cpu_set, size_t setsize,
 				warn(_("CPU %u disable failed"), cpu);
 				fails++;
 			} else {
-				printf(_("CPU %u disabled\n"), cpu);
+				cpu_message(i + 1, nreqs, _("CPU %u disabled\n"), cpu);
 				if (onlinecpus)
 					CPU_CLR_S(cpu, setsize, onlinecpus);
 			}
 		}
 	}
 
+	free(reqs);
 	return fails == 0 ? 0 : fails == maxcpus ? -1 : 1;
 }
 
@@ -252,6 +338,7 @@ static void __attribute__((__noreturn__)) usage(void)
 		" -g, --deconfigure <cpu-list>  deconfigure cpus\n"
 		" -p, --dispatch <mode>         set dispatching mode\n"
 		" -r, --rescan                  trigger rescan of cpus\n"
+		"     --progress                print progress of --enable and --disable\n"
 		), stdout);
 	printf(USAGE_HELP_OPTIONS(31));
 
@@ -267,6 +354,9 @@ int main(int argc, char *argv[])
 	int cmd = -1;
 	int c, rc;
 
+	enum {
+		OPT_PROGRESS = CHAR_MAX + 1
+	};
 	static const struct option longopts[] = {
 		{ "configure",	required_argument, NULL, 'c' },
 		{ "deconfigure",required_argument, NULL, 'g' },
@@ -274,6 +364,7 @@ int main(int argc, char *argv[])
 		{ "dispatch",	required_argument, NULL, 'p' },
 		{ "enable",	required_argument, NULL, 'e' },
 		{ "help",	no_argument,       NULL, 'h' },
+		{ "progress",	no_argument,       NULL, OPT_PROGRESS },
 		{ "rescan",	no_argument,       NULL, 'r' },
 		{ "version",	no_argument,       NULL, 'V' },
 		{ NULL,		0, NULL, 0 }
@@ -341,6 +432,9 @@ int main(int argc, char *argv[])
 		case 'r':
 			cmd = CMD_CPU_RESCAN;
 			break;
+		case OPT_PROGRESS:
+			show_progress = 1;
+			break;
 
 		case 'h':
 			usage();
@@ -358,16 +452,16 @@ int main(int argc, char *argv[])
 
 	switch (cmd) {
 	case CMD_CPU_ENABLE:
-		rc = cpu_enable(sys, cpu_set, maxcpus, 1);
+		rc = cpu_enable(sys, cpu_set, setsize, 1);
 		break;
 	case CMD_CPU_DISABLE:
-		rc = cpu_enable(sys, cpu_set, maxcpus, 0);
+		rc = cpu_enable(sys, cpu_set, setsize, 0);
 		break;
 	case CMD_CPU_CONFIGURE:
-		rc = cpu_configure(sys, cpu_set, maxcpus, 1);
+		rc = cpu_configure(sys, cpu_set, setsize, 1);
 		break;
 	case CMD_CPU_DECONFIGURE:
-		rc = cpu_configure(sys, cpu_set, maxcpus, 0);
+		rc = cpu_configure(sys, cpu_set, setsize, 0);
 		break;
 	case CMD_CPU_RESCAN:
 		rc = cpu_rescan(sys);
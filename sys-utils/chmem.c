@@ -22,7 +22,7 @@
 #include <stdlib.h>
 #include <getopt.h>
 #include <assert.h>
-#include <dirent.h>
+#include <errno.h>
 
 #include "c.h"
 #include "nls.h"
@@ -33,19 +33,21 @@
 #include "closestream.h"
 #include "xalloc.h"
 
+#include "memblocks.h"
+
 /* partial success, otherwise we return regular EXIT_{SUCCESS,FAILURE} */
 #define CHMEM_EXIT_SOMEOK		64
 
-#define _PATH_SYS_MEMORY		"/sys/devices/system/memory"
-
 struct chmem_desc {
 	struct path_cxt	*sysmem;	/* _PATH_SYS_MEMORY handler */
-	struct dirent	**dirs;
-	int		ndirs;
+	uint64_t	*indexes;	/* sorted memory block numbers */
+	size_t		nindexes;
 	uint64_t	block_size;
 	uint64_t	start;
 	uint64_t	end;
 	uint64_t	size;
+	int		zone_id;	/* requested zone or -1 */
+	unsigned int	enable	   : 1;
 	unsigned int	use_blocks : 1;
 	unsigned int	is_size	   : 1;
 	unsigned int	verbose	   : 1;
@@ -58,36 +60,35 @@ enum {
 	CMD_NONE
 };
 
-enum zone_id {
-	ZONE_DMA = 0,
-	ZONE_DMA32,
-	ZONE_NORMAL,
-	ZONE_HIGHMEM,
-	ZONE_MOVABLE,
-	ZONE_DEVICE,
+/* what to do with a memory block, see block_action() */
+enum {
+	MEMORY_ACT_NONE = 0,		/* already in the requested state */
+	MEMORY_ACT_MISMATCH,		/* not in the requested zone */
+	MEMORY_ACT_ONLINE,
+	MEMORY_ACT_ONLINE_MOVABLE,
+	MEMORY_ACT_ONLINE_KERNEL,
+	MEMORY_ACT_OFFLINE
 };
 
-static char *zone_names[] = {
-	[ZONE_DMA]	= "DMA",
-	[ZONE_DMA32]	= "DMA32",
-	[ZONE_NORMAL]	= "Normal",
-	[ZONE_HIGHMEM]	= "Highmem",
-	[ZONE_MOVABLE]	= "Movable",
-	[ZONE_DEVICE]	= "Device",
+static const char *act_names[] = {
+	[MEMORY_ACT_ONLINE]		= "online",
+	[MEMORY_ACT_ONLINE_MOVABLE]	= "online_movable",
+	[MEMORY_ACT_ONLINE_KERNEL]	= "online_kernel",
+	[MEMORY_ACT_OFFLINE]		= "offline"
 };
 
-/*
- * name must be null-terminated
- */
-static int zone_name_to_id(const char *name)
+/* returns 1 if @zone_id is valid zone for the block, or the first valid zone */
+static int has_zone(struct memory_block *blk, int zone_id, int first)
 {
-	size_t i;
+	int i;
 
-	for (i = 0; i < ARRAY_SIZE(zone_names); i++) {
-		if (!strcasecmp(name, zone_names[i]))
-			return i;
+	for (i = 0; i < blk->nr_zones; i++) {
+		if (blk->zones[i] == zone_id)
+			return 1;
+		if (first)
+			break;
 	}
-	return -1;
+	return 0;
 }
 
 static void idxtostr(struct chmem_desc *desc, uint64_t idx, char *buf, size_t bufsz)
@@ -101,65 +102,134 @@ static void idxtostr(struct chmem_desc *desc, uint64_t idx, char *buf, size_t bu
 		 idx, start, end);
 }
 
-static int chmem_size(struct chmem_desc *desc, int enable, int zone_id)
+static void read_block(struct chmem_desc *desc, uint64_t index,
+		       struct memory_block *blk)
 {
-	char *name, *onoff, line[BUFSIZ], str[BUFSIZ];
-	uint64_t size, index;
-	const char *zn;
-	int i, rc;
+	memory_block_read(desc->sysmem, index,
+			  desc->have_zones ? MEMORY_READ_ZONES : 0, blk);
+}
 
-	size = desc->size;
-	onoff = enable ? "online" : "offline";
-	i = enable ? 0 : desc->ndirs - 1;
+/*
+ * Returns MEMORY_ACT_* for the block. The zone is selected from the valid
+ * zones of the block, so the state is written only once with the right
+ * online_* keyword.
+ */
+static int block_action(struct chmem_desc *desc, struct memory_block *blk)
+{
+	if (!desc->enable) {
+		if (blk->state == MEMORY_STATE_OFFLINE)
+			return MEMORY_ACT_NONE;
+		if (desc->have_zones && desc->zone_id >= 0
+		    && !has_zone(blk, desc->zone_id, 1))
+			return MEMORY_ACT_MISMATCH;
+		return MEMORY_ACT_OFFLINE;
+	}
 
-	if (enable && zone_id >= 0) {
-		if (zone_id == ZONE_MOVABLE)
-			onoff = "online_movable";
-		else
-			onoff = "online_kernel";
+	if (blk->state == MEMORY_STATE_ONLINE)
+		return MEMORY_ACT_NONE;
+	if (desc->zone_id >= 0) {
+		if (desc->have_zones && !has_zone(blk, desc->zone_id, 0))
+			return MEMORY_ACT_MISMATCH;
+		return desc->zone_id == ZONE_MOVABLE ?
+				MEMORY_ACT_ONLINE_MOVABLE : MEMORY_ACT_ONLINE_KERNEL;
 	}
+	/* By default, use zone Movable for online, if valid */
+	if (desc->have_zones && has_zone(blk, ZONE_MOVABLE, 0))
+		return MEMORY_ACT_ONLINE_MOVABLE;
+	return MEMORY_ACT_ONLINE;
+}
+
+/* merges the blocks with the same action to ranges */
+static int is_mergeable(struct memory_block *curr, struct memory_block *blk,
+			void *data)
+{
+	struct chmem_desc *desc = data;
+
+	if (curr->index + curr->count != blk->index)
+		return 0;
+	return block_action(desc, curr) == block_action(desc, blk);
+}
+
+/* reads @count blocks starting at desc->indexes[@first] in one pass */
+static void scan_blocks(struct chmem_desc *desc, size_t first, size_t count,
+			struct memory_scan *sc)
+{
+	memset(sc, 0, sizeof(*sc));
+	sc->indexes = desc->indexes + first;
+	sc->nindexes = count;
+	sc->flags = desc->have_zones ? MEMORY_READ_ZONES : 0;
+	sc->mergeable = is_mergeable;
+	sc->data = desc;
+
+	memory_scan_blocks(desc->sysmem, sc);
+}
+
+/*
+ * Writes the new state of the block. The valid zones are read before the
+ * first write, if onlining of the block fails then the block is read again
+ * and the write is retried if the valid zones have been changed meanwhile.
+ */
+static int set_block(struct chmem_desc *desc, uint64_t index, int act)
+{
+	struct memory_block blk;
+	int rc, errsv, act2;
+
+	rc = ul_path_writef_string(desc->sysmem, act_names[act],
+				   "memory%"PRIu64"/state", index);
+	if (rc == 0 || !desc->enable || !desc->have_zones)
+		return rc;
+
+	errsv = errno;
+	read_block(desc, index, &blk);
+	act2 = block_action(desc, &blk);
+	if (act2 != act && act2 >= MEMORY_ACT_ONLINE)
+		return ul_path_writef_string(desc->sysmem, act_names[act2],
+					     "memory%"PRIu64"/state", index);
+	errno = errsv;
+	return rc;
+}
+
+static int chmem_size(struct chmem_desc *desc)
+{
+	char str[BUFSIZ];
+	struct memory_scan sc;
+	uint64_t size, index, k;
+	size_t n;
+	int rc, act, enable = desc->enable;
+
+	size = desc->size;
+	scan_blocks(desc, 0, desc->nindexes, &sc);
 
-	for (; i >= 0 && i < desc->ndirs && size; i += enable ? 1 : -1) {
-		name = desc->dirs[i]->d_name;
-		index = strtou64_or_err(name + 6, _("Failed to parse index"));
+	/* enable from the first block, disable from the last block */
+	for (n = 0; n < sc.nblocks && size; n++) {
+		struct memory_block *range = &sc.blocks[enable ? n : sc.nblocks - n - 1];
 
-		if (ul_path_readf_buffer(desc->sysmem, line, sizeof(line), "%s/state", name) > 0
-		    && strncmp(onoff, line, 6) == 0)
+		act = block_action(desc, range);
+		if (act < MEMORY_ACT_ONLINE)
 			continue;
 
-		if (desc->have_zones) {
-			ul_path_readf_buffer(desc->sysmem, line, sizeof(line), "%s/valid_zones", name);
-			if (zone_id >= 0) {
-				zn = zone_names[zone_id];
-				if (enable && !strcasestr(line, zn))
-					continue;
-				if (!enable && strncasecmp(line, zn, strlen(zn)))
-					continue;
-			} else if (enable) {
-				/* By default, use zone Movable for online, if valid */
-				if (strcasestr(line, zone_names[ZONE_MOVABLE]))
-					onoff = "online_movable";
+		for (k = 0; k < range->count && size; k++) {
+			index = range->index + (enable ? k : range->count - k - 1);
+
+			idxtostr(desc, index, str, sizeof(str));
+			rc = set_block(desc, index, act);
+			if (rc != 0 && desc->verbose) {
+				if (enable)
+					fprintf(stdout, _("%s enable failed\n"), str);
 				else
-					onoff = "online";
+					fprintf(stdout, _("%s disable failed\n"), str);
+			} else if (rc == 0 && desc->verbose) {
+				if (enable)
+					fprintf(stdout, _("%s enabled\n"), str);
+				else
+					fprintf(stdout, _("%s disabled\n"), str);
 			}
+			if (rc == 0)
+				size--;
 		}
-
-		idxtostr(desc, index, str, sizeof(str));
-		rc = ul_path_writef_string(desc->sysmem, onoff, "%s/state", name);
-		if (rc != 0 && desc->verbose) {
-			if (enable)
-				fprintf(stdout, _("%s enable failed\n"), str);
-			else
-				fprintf(stdout, _("%s disable failed\n"), str);
-		} else if (rc == 0 && desc->verbose) {
-			if (enable)
-				fprintf(stdout, _("%s enabled\n"), str);
-			else
-				fprintf(stdout, _("%s disabled\n"), str);
-		}
-		if (rc == 0)
-			size--;
 	}
+	memory_scan_reset(&sc);
+
 	if (size) {
 		uint64_t bytes;
 		char *sizestr;
@@ -175,93 +245,75 @@ static int chmem_size(struct chmem_desc *desc, int enable, int zone_id)
 	return size == 0 ? 0 : size == desc->size ? -1 : 1;
 }
 
-static int chmem_range(struct chmem_desc *desc, int enable, int zone_id)
+static int chmem_range(struct chmem_desc *desc)
 {
-	char *name, *onoff, line[BUFSIZ], str[BUFSIZ];
-	uint64_t index, todo;
-	const char *zn;
-	int i, rc;
+	char str[BUFSIZ];
+	struct memory_scan sc;
+	uint64_t index, todo, k;
+	size_t first, last, n;
+	int rc, act, enable = desc->enable;
 
 	todo = desc->end - desc->start + 1;
-	onoff = enable ? "online" : "offline";
 
-	if (enable && zone_id >= 0) {
-		if (zone_id == ZONE_MOVABLE)
-			onoff = "online_movable";
-		else
-			onoff = "online_kernel";
+	first = memory_find_index(desc->indexes, desc->nindexes, desc->start);
+	for (last = first; last < desc->nindexes; last++) {
+		if (desc->indexes[last] > desc->end)
+			break;
 	}
+	scan_blocks(desc, first, last - first, &sc);
 
-	for (i = 0; i < desc->ndirs; i++) {
-		name = desc->dirs[i]->d_name;
-		index = strtou64_or_err(name + 6, _("Failed to parse index"));
-		if (index < desc->start)
-			continue;
-		if (index > desc->end)
-			break;
-		idxtostr(desc, index, str, sizeof(str));
-		if (ul_path_readf_buffer(desc->sysmem, line, sizeof(line), "%s/state", name) > 0
-		    && strncmp(onoff, line, 6) == 0) {
-			if (desc->verbose && enable)
-				fprintf(stdout, _("%s already enabled\n"), str);
-			else if (desc->verbose && !enable)
-				fprintf(stdout, _("%s already disabled\n"), str);
-			todo--;
-			continue;
-		}
+	for (n = 0; n < sc.nblocks; n++) {
+		struct memory_block *range = &sc.blocks[n];
+
+		act = block_action(desc, range);
 
-		if (desc->have_zones) {
-			ul_path_readf_buffer(desc->sysmem, line, sizeof(line), "%s/valid_zones", name);
-			if (zone_id >= 0) {
-				zn = zone_names[zone_id];
-				if (enable && !strcasestr(line, zn)) {
+		for (k = 0; k < range->count; k++) {
+			index = range->index + k;
+			idxtostr(desc, index, str, sizeof(str));
+
+			if (act == MEMORY_ACT_NONE) {
+				if (desc->verbose && enable)
+					fprintf(stdout, _("%s already enabled\n"), str);
+				else if (desc->verbose && !enable)
+					fprintf(stdout, _("%s already disabled\n"), str);
+				todo--;
+				continue;
+			}
+			if (act == MEMORY_ACT_MISMATCH) {
+				if (enable)
 					warnx(_("%s enable failed: Zone mismatch"), str);
-					continue;
-				}
-				if (!enable && strncasecmp(line, zn, strlen(zn))) {
-					warnx(_("%s disable failed: Zone mismatch"), str);
-					continue;
-				}
-			} else if (enable) {
-				/* By default, use zone Movable for online, if valid */
-				if (strcasestr(line, zone_names[ZONE_MOVABLE]))
-					onoff = "online_movable";
 				else
-					onoff = "online";
+					warnx(_("%s disable failed: Zone mismatch"), str);
+				continue;
 			}
-		}
 
-		rc = ul_path_writef_string(desc->sysmem, onoff, "%s/state", name);
-		if (rc != 0) {
-			if (enable)
-				warn(_("%s enable failed"), str);
-			else
-				warn(_("%s disable failed"), str);
-		} else if (desc->verbose) {
-			if (enable)
-				fprintf(stdout, _("%s enabled\n"), str);
-			else
-				fprintf(stdout, _("%s disabled\n"), str);
+			rc = set_block(desc, index, act);
+			if (rc != 0) {
+				if (enable)
+					warn(_("%s enable failed"), str);
+				else
+					warn(_("%s disable failed"), str);
+			} else if (desc->verbose) {
+				if (enable)
+					fprintf(stdout, _("%s enabled\n"), str);
+				else
+					fprintf(stdout, _("%s disabled\n"), str);
+			}
+			if (rc == 0)
+				todo--;
 		}
-		if (rc == 0)
-			todo--;
 	}
-	return todo == 0 ? 0 : todo == desc->end - desc->start + 1 ? -1 : 1;
-}
+	memory_scan_reset(&sc);
 
-static int filter(const struct dirent *de)
-{
-	if (strncmp("memory", de->d_name, 6))
-		return 0;
-	return isdigit_string(de->d_name + 6);
+	return todo == 0 ? 0 : todo == desc->end - desc->start + 1 ? -1 : 1;
 }
 
 static void read_info(struct chmem_desc *desc)
 {
 	char line[128];
 
-	desc->ndirs = scandir(_PATH_SYS_MEMORY, &desc->dirs, filter, versionsort);
-	if (desc->ndirs <= 0)
+	if (memory_read_indexes(desc->sysmem, &desc->indexes, &desc->nindexes) != 0
+	    || !desc->nindexes)
 		err(EXIT_FAILURE, _("Failed to read %s"), _PATH_SYS_MEMORY);
 	ul_path_read_buffer(desc->sysmem, line, sizeof(line), "block_size_bytes");
 	desc->block_size = strtoumax(line, NULL, 16);
@@ -344,8 +396,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	printf(USAGE_HELP_OPTIONS(20));
 
 	fputs(_("\nSupported zones:\n"), out);
-	for (i = 0; i < ARRAY_SIZE(zone_names); i++)
-		fprintf(out, " %s\n", zone_names[i]);
+	for (i = 0; i < ZONE_NONE; i++)
+		fprintf(out, " %s\n", memory_zone_name(i));
 
 	printf(USAGE_MAN_TAIL("chmem(8)"));
 
@@ -355,7 +407,7 @@ static void __attribute__((__noreturn__)) usage(void)
 int main(int argc, char **argv)
 {
 	struct chmem_desc _desc = { 0 }, *desc = &_desc;
-	int cmd = CMD_NONE, zone_id = -1;
+	int cmd = CMD_NONE;
 	char *zone = NULL;
 	int c, rc;
 
@@ -432,18 +484,21 @@ int main(int argc, char **argv)
 	else if (zone)
 		warnx(_("zone ignored, no valid_zones sysfs attribute present"));
 
+	desc->zone_id = -1;
 	if (zone && desc->have_zones) {
-		zone_id = zone_name_to_id(zone);
-		if (zone_id == -1) {
+		desc->zone_id = memory_zone_id(zone);
+		if (desc->zone_id >= ZONE_NONE) {
 			warnx(_("unknown memory zone: %s"), zone);
 			errtryhelp(EXIT_FAILURE);
 		}
 	}
 
+	desc->enable = cmd == CMD_MEMORY_ENABLE ? 1 : 0;
+
 	if (desc->is_size)
-		rc = chmem_size(desc, cmd == CMD_MEMORY_ENABLE ? 1 : 0, zone_id);
+		rc = chmem_size(desc);
 	else
-		rc = chmem_range(desc, cmd == CMD_MEMORY_ENABLE ? 1 : 0, zone_id);
+		rc = chmem_range(desc);
 
 	ul_unref_path(desc->sysmem);
 
@@ -29,14 +29,22 @@
 #include "path.h"
 #include "strutils.h"
 #include "closestream.h"
+#include "procutils.h"
+#include "xalloc.h"
+
+enum {
+	OPT_CGROUP = CHAR_MAX + 1,
+	OPT_NAME
+};
 
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
 	fputs(USAGE_HEADER, out);
 	fprintf(out,
-	      _(" %1$s [options] -p pid\n"
-		" %1$s [options] -n number -p pid\n"
+	      _(" %1$s [options] -p pid...\n"
+		" %1$s [options] -n number -p pid...\n"
+		" %1$s [options] [-n number] --cgroup path | --name name\n"
 		" %1$s [options] -n number [--] command [args...]]\n"),
 		program_invocation_short_name);
 
@@ -45,7 +53,9 @@ static void __attribute__((__noreturn__)) usage(void)
 
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -n, --adjust <num>     specify the adjust score value\n"), out);
-	fputs(_(" -p, --pid <num>        process ID\n"), out);
+	fputs(_(" -p, --pid <num>        process ID, may be used more than once\n"), out);
+	fputs(_("     --cgroup <path>    act on all the processes in the cgroup\n"), out);
+	fputs(_("     --name <name>      act on all the processes with the name\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(24));
 	printf(USAGE_MAN_TAIL("choom(1)"));
@@ -77,15 +87,89 @@ static int set_score_adj(struct path_cxt *pc, int adj)
 	return ul_path_write_s64(pc, adj, "oom_score_adj");
 }
 
+static void add_pid(pid_t **pids, size_t *npids, pid_t pid)
+{
+	if (*npids % 64 == 0)
+		*pids = xrealloc(*pids, (*npids + 64) * sizeof(pid_t));
+	(*pids)[(*npids)++] = pid;
+}
+
+static void add_cgroup_pids(pid_t **pids, size_t *npids, const char *cgroup)
+{
+	struct proc_tasks *ts = proc_open_cgroup_procs(cgroup);
+	pid_t pid;
+
+	if (!ts)
+		err(EXIT_FAILURE, _("cannot obtain the list of tasks"));
+	while (proc_next_tid(ts, &pid) == 0)
+		add_pid(pids, npids, pid);
+	proc_close_tasks(ts);
+}
+
+static void add_name_pids(pid_t **pids, size_t *npids, const char *name)
+{
+	struct proc_processes *ps = proc_open_processes();
+	pid_t pid;
+
+	if (!ps)
+		err(EXIT_FAILURE, _("cannot obtain the list of tasks"));
+	proc_processes_filter_by_name(ps, name);
+	while (proc_next_pid(ps, &pid) == 0)
+		add_pid(pids, npids, pid);
+	proc_close_processes(ps);
+}
+
+/*
+ * Shows or changes the setting of one process from the list. The errors are
+ * reported and the caller continues with the next process.
+ */
+static int choom_pid(pid_t pid, int adj, int has_adj)
+{
+	struct path_cxt *pc = ul_new_path("/proc/%d", (int) pid);
+	int score, old;
+
+	if (!pc)
+		err(EXIT_FAILURE, _("failed to alloc procfs handler"));
+
+	if (ul_path_read_s32(pc, &old, "oom_score_adj") != 0) {
+		warn(_("pid %d: failed to read OOM score adjust value"), pid);
+		goto fail;
+	}
+	if (!has_adj) {
+		if (ul_path_read_s32(pc, &score, "oom_score") != 0) {
+			warn(_("pid %d: failed to read OOM score value"), pid);
+			goto fail;
+		}
+		printf(_("pid %d's current OOM score: %d\n"), pid, score);
+		printf(_("pid %d's current OOM score adjust value: %d\n"), pid, old);
+	} else {
+		if (set_score_adj(pc, adj)) {
+			warn(_("pid %d: failed to set score adjust value"), pid);
+			goto fail;
+		}
+		printf(_("pid %d's OOM score adjust value changed from %d to %d\n"), pid, old, adj);
+	}
+
+	ul_unref_path(pc);
+	return 0;
+fail:
+	ul_unref_path(pc);
+	return -1;
+}
+
 int main(int argc, char **argv)
 {
-	pid_t pid = 0;
+	pid_t pid = 0, *pids = NULL;
+	size_t i, npids = 0, nerrs = 0;
+	const char *cgroup = NULL, *name = NULL;
 	int c, adj = 0, has_adj = 0;
 	struct path_cxt *pc = NULL;
 
 	static const struct option longopts[] = {
 		{ "adjust",  required_argument, NULL, 'n' },
 		{ "pid",     required_argument, NULL, 'p' },
+		{ "cgroup",  required_argument, NULL, OPT_CGROUP },
+		{ "name",    required_argument, NULL, OPT_NAME },
 		{ "help",    no_argument,       NULL, 'h' },
 		{ "version", no_argument,       NULL, 'V' },
 		{ NULL,      0,                 NULL,  0  }
@@ -100,6 +184,13 @@ int main(int argc, char **argv)
 		switch (c) {
 		case 'p':
 			pid = strtos32_or_err(optarg, _("invalid PID argument"));
+			add_pid(&pids, &npids, pid);
+			break;
+		case OPT_CGROUP:
+			cgroup = optarg;
+			break;
+		case OPT_NAME:
+			name = optarg;
 			break;
 		case 'n':
 			adj = strtos32_or_err(optarg, _("invalid adjust argument"));
@@ -115,6 +206,28 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (npids > 1 || cgroup || name) {
+		if (optind < argc) {
+			warnx(_("invalid argument: %s"), argv[optind]);
+			errtryhelp(EXIT_FAILURE);
+		}
+		/* all the processes by one process */
+		if (cgroup)
+			add_cgroup_pids(&pids, &npids, cgroup);
+		if (name)
+			add_name_pids(&pids, &npids, name);
+		if (!npids)
+			errx(EXIT_FAILURE, _("no process found"));
+
+		for (i = 0; i < npids; i++) {
+			if (choom_pid(pids[i], adj, has_adj) != 0)
+				nerrs++;
+		}
+		free(pids);
+		return nerrs ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	free(pids);
+
 	if (optind < argc && pid) {
 		warnx(_("invalid argument: %s"), argv[optind]);
 		errtryhelp(EXIT_FAILURE);
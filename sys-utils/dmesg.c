@@ -20,6 +20,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "c.h"
 #include "colors.h"
@@ -90,8 +93,20 @@ static const struct dmesg_color colors[] =
 	[DMESG_COLOR_SEGFAULT]	= { "segfault", UL_COLOR_HALFBRIGHT UL_COLOR_RED }
 };
 
-#define dmesg_enable_color(_id) \
-		color_scheme_enable(colors[_id].scheme, colors[_id].dflt);
+/* the color sequences are resolved only once */
+static void dmesg_enable_color(int id)
+{
+	static const char *seqs[ARRAY_SIZE(colors)];
+	static char resolved[ARRAY_SIZE(colors)];
+
+	if (!resolved[id]) {
+		seqs[id] = color_scheme_get_sequence(colors[id].scheme,
+						     colors[id].dflt);
+		resolved[id] = 1;
+	}
+	if (seqs[id])
+		color_enable(seqs[id]);
+}
 
 /*
  * Priority and facility names
@@ -161,6 +176,24 @@ enum {
 };
 #define is_timefmt(c, f) ((c)->time_fmt == (DMESG_TIMEFTM_ ##f))
 
+/* stdout buffer size if not --follow */
+#define DMESG_OUTBUF_SIZE	(128 * 1024)
+
+/*
+ * localtime() and the formatted timestamps are the same for all records
+ * within the same second, and localtime() of the next second is usually
+ * calculated from the cached day.
+ */
+struct dmesg_timecache {
+	struct ul_timecache tmcache;
+	time_t		time;
+	struct tm	tm;
+	char		ctime[64];	/* record_ctime() */
+	char		iso[32];	/* ISO 8601 date and time */
+	char		isotz[16];	/* ISO 8601 timezone */
+	unsigned int	valid : 1;
+};
+
 struct dmesg_control {
 	/* bit arrays -- see include/bitops.h */
 	char levels[ARRAY_SIZE(level_names) / NBBY + 1];
@@ -168,6 +201,7 @@ struct dmesg_control {
 
 	struct timeval	lasttime;	/* last printed timestamp */
 	struct tm	lasttm;		/* last localtime */
+	struct dmesg_timecache tcache;	/* last record_localtime() */
 	struct timeval	boot_time;	/* system boot time */
 
 	int		action;		/* SYSLOG_ACTION_* */
@@ -186,14 +220,22 @@ struct dmesg_control {
 	 */
 	char		*filename;
 	char		*mmap_buff;
+	const char	*sockpath;	/* --output-socket <path> */
 	size_t		pagesize;
+	time_t		file_mtime;	/* --file st_mtime, to verify index */
 	unsigned int	time_fmt;	/* time format */
 
+	uint64_t	since;		/* --since, usec since boot */
+	uint64_t	until;		/* --until, usec since boot */
+
 	unsigned int	follow:1,	/* wait for new messages */
 			raw:1,		/* raw mode */
 			noesc:1,	/* no escape */
 			fltr_lev:1,	/* filter out by levels[] */
 			fltr_fac:1,	/* filter out by facilities[] */
+			fltr_time:1,	/* filter out by since and until */
+			mkindex:1,	/* --index, (re)build file index */
+			indexing:1,	/* parse all for the index */
 			decode:1,	/* use "facility: level: " prefix */
 			pager:1,	/* pipe output into a pager */
 			color:1,	/* colorize messages */
@@ -209,6 +251,7 @@ struct dmesg_record {
 	int		level;
 	int		facility;
 	struct timeval  tv;
+	uint64_t	seqnum;		/* kmsg sequence number */
 
 	const char	*next;		/* buffer with next unparsed record */
 	size_t		next_size;	/* size of the next buffer */
@@ -221,6 +264,7 @@ struct dmesg_record {
 		(_r)->level = -1; \
 		(_r)->tv.tv_sec = 0; \
 		(_r)->tv.tv_usec = 0; \
+		(_r)->seqnum = 0; \
 	} while (0)
 
 static int read_kmsg(struct dmesg_control *ctl);
@@ -277,6 +321,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -F, --file <file>           use the file instead of the kernel log buffer\n"), out);
 	fputs(_(" -f, --facility <list>       restrict output to defined facilities\n"), out);
 	fputs(_(" -H, --human                 human readable output\n"), out);
+	fputs(_("     --index                 (re)build index of the --file for faster filtering\n"), out);
 	fputs(_(" -k, --kernel                display kernel messages\n"), out);
 	fprintf(out,
 	      _(" -L, --color[=<when>]        colorize messages (%s, %s or %s)\n"), "auto", "always", "never");
@@ -290,8 +335,11 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_("     --noescape              don't escape unprintable character\n"), out);
 	fputs(_(" -S, --syslog                force to use syslog(2) rather than /dev/kmsg\n"), out);
 	fputs(_(" -s, --buffer-size <size>    buffer size to query the kernel ring buffer\n"), out);
+	fputs(_("     --since <time>          display messages since the specified time\n"), out);
+	fputs(_("     --until <time>          display messages until the specified time\n"), out);
 	fputs(_(" -u, --userspace             display userspace messages\n"), out);
 	fputs(_(" -w, --follow                wait for new messages\n"), out);
+	fputs(_("     --output-socket <path>  stream messages to consumers on UNIX socket\n"), out);
 	fputs(_(" -x, --decode                decode facility and level to readable string\n"), out);
 	fputs(_(" -d, --show-delta            show time delta between printed messages\n"), out);
 	fputs(_(" -e, --reltime               show local time and time delta in readable format\n"), out);
@@ -533,6 +581,7 @@ static ssize_t mmap_file_buffer(struct dmesg_control *ctl, char **buf)
 		err(EXIT_FAILURE, _("cannot mmap: %s"), ctl->filename);
 	ctl->mmap_buff = *buf;
 	ctl->pagesize = getpagesize();
+	ctl->file_mtime = st.st_mtime;
 	close(fd);
 
 	return st.st_size;
@@ -615,11 +664,22 @@ static int fwrite_hex(const char *buf, size_t size, FILE *out)
 	return 0;
 }
 
+static void write_span(const char *span, size_t size, FILE *out)
+{
+	if (size && fwrite(span, 1, size, out) != size) {
+		if (errno != EPIPE)
+			err(EXIT_FAILURE, _("write failed"));
+		exit(EXIT_SUCCESS);
+	}
+}
+
 /*
  * Prints to 'out' and non-printable chars are replaced with \x<hex> sequences.
+ * The printable chars are written by one fwrite() for each continuous span.
  */
 static void safe_fwrite(struct dmesg_control *ctl, const char *buf, size_t size, int indent, FILE *out)
 {
+	const char *span = buf;		/* not yet written printable chars */
 	size_t i;
 #ifdef HAVE_WIDECHAR
 	mbstate_t s;
@@ -637,10 +697,16 @@ static void safe_fwrite(struct dmesg_control *ctl, const char *buf, size_t size,
 				goto doprint;
 			}
 #ifdef HAVE_WIDECHAR
-			len = mbrtowc(&wc, p, size - i, &s);
+			/* ASCII is single byte in all multibyte locales */
+			if ((unsigned char) *p < 0x80)
+				len = 1;
+			else
+				len = mbrtowc(&wc, p, size - i, &s);
 
-			if (len == 0)				/* L'\0' */
+			if (len == 0) {				/* L'\0' */
+				write_span(span, p - span, out);
 				return;
+			}
 
 			if (len == (size_t)-1 || len == (size_t)-2) {		/* invalid sequence */
 				memset(&s, 0, sizeof (s));
@@ -661,21 +727,23 @@ static void safe_fwrite(struct dmesg_control *ctl, const char *buf, size_t size,
 		}
 
 doprint:
-		if (hex)
+		if (hex) {
+			write_span(span, p - span, out);
 			rc = fwrite_hex(p, len, out);
-		else if (*p == '\n' && *(p + 1) && indent) {
-		        rc = fwrite(p, 1, len, out) != len;
-			if (fprintf(out, "%*s", indent, "") != indent)
-				rc |= 1;
+		} else if (*p == '\n' && *(p + 1) && indent) {
+			write_span(span, p - span + len, out);
+			rc = fprintf(out, "%*s", indent, "") != indent;
 		} else
-			rc = fwrite(p, 1, len, out) != len;
+			continue;	/* add to the span */
 
 		if (rc != 0) {
 			if (errno != EPIPE)
 				err(EXIT_FAILURE, _("write failed"));
 			exit(EXIT_SUCCESS);
 		}
+		span = p + len;
 	}
+	write_span(span, buf + size - span, out);
 }
 
 static const char *skip_item(const char *begin, const char *end, const char *sep)
@@ -738,7 +806,8 @@ static int get_next_syslog_record(struct dmesg_control *ctl,
 			continue;	/* error or empty line? */
 
 		if (*begin == '<') {
-			if (ctl->fltr_lev || ctl->fltr_fac || ctl->decode || ctl->color)
+			if (ctl->fltr_lev || ctl->fltr_fac || ctl->decode ||
+			    ctl->color || ctl->indexing)
 				begin = parse_faclev(begin + 1, &rec->facility,
 						     &rec->level);
 			else
@@ -748,7 +817,7 @@ static int get_next_syslog_record(struct dmesg_control *ctl,
 		if (*begin == '[' && (*(begin + 1) == ' ' ||
 				      isdigit(*(begin + 1)))) {
 
-			if (!is_timefmt(ctl, NONE))
+			if (!is_timefmt(ctl, NONE) || ctl->fltr_time || ctl->indexing)
 				begin = parse_syslog_timestamp(begin + 1, &rec->tv);
 			else
 				begin = skip_item(begin, end, "]");
@@ -775,6 +844,11 @@ static int get_next_syslog_record(struct dmesg_control *ctl,
 	return 1;
 }
 
+static inline uint64_t record_usec(const struct dmesg_record *rec)
+{
+	return (uint64_t) rec->tv.tv_sec * USEC_PER_SEC + rec->tv.tv_usec;
+}
+
 static int accept_record(struct dmesg_control *ctl, struct dmesg_record *rec)
 {
 	if (ctl->fltr_lev && (rec->facility < 0 ||
@@ -785,6 +859,13 @@ static int accept_record(struct dmesg_control *ctl, struct dmesg_record *rec)
 			      !isset(ctl->facilities, rec->facility)))
 		return 0;
 
+	if (ctl->fltr_time) {
+		uint64_t usec = record_usec(rec);
+
+		if (usec < ctl->since || usec > ctl->until)
+			return 0;
+	}
+
 	return 1;
 }
 
@@ -822,20 +903,36 @@ static struct tm *record_localtime(struct dmesg_control *ctl,
 				   struct dmesg_record *rec,
 				   struct tm *tm)
 {
+	struct dmesg_timecache *tc = &ctl->tcache;
 	time_t t = ctl->boot_time.tv_sec + rec->tv.tv_sec;
-	return localtime_r(&t, tm);
+
+	if (!tc->valid || tc->time != t) {
+		if (ul_timecache_tm(&tc->tmcache, t, 0, &tc->tm) != 0)
+			return NULL;
+		tc->time = t;
+		tc->valid = 1;
+		*tc->ctime = *tc->iso = *tc->isotz = '\0';
+	}
+	*tm = tc->tm;
+	return tm;
 }
 
 static char *record_ctime(struct dmesg_control *ctl,
 			  struct dmesg_record *rec,
 			  char *buf, size_t bufsiz)
 {
+	struct dmesg_timecache *tc = &ctl->tcache;
 	struct tm tm;
 
-	record_localtime(ctl, rec, &tm);
+	*buf = '\0';
+	if (!record_localtime(ctl, rec, &tm))
+		return buf;
 
-	if (strftime(buf, bufsiz, "%a %b %e %H:%M:%S %Y", &tm) == 0)
-		*buf = '\0';
+	if (!*tc->ctime &&
+	    strftime(tc->ctime, sizeof(tc->ctime), "%a %b %e %H:%M:%S %Y", &tm) == 0)
+		return buf;
+
+	xstrncpy(buf, tc->ctime, bufsiz);
 	return buf;
 }
 
@@ -846,15 +943,27 @@ static char *short_ctime(struct tm *tm, char *buf, size_t bufsiz)
 	return buf;
 }
 
+/* ISO_TIMESTAMP_COMMA_T, the second and timezone parts are cached */
 static char *iso_8601_time(struct dmesg_control *ctl, struct dmesg_record *rec,
 			   char *buf, size_t bufsz)
 {
-	struct timeval tv = {
-		.tv_sec = ctl->boot_time.tv_sec + rec->tv.tv_sec,
-		.tv_usec = rec->tv.tv_usec
-	};
+	struct dmesg_timecache *tc = &ctl->tcache;
+	struct tm tm;
+	int len;
+
+	if (!record_localtime(ctl, rec, &tm))
+		return NULL;
+
+	if (!*tc->iso
+	    && (strtm_iso(&tm, ISO_DATE | ISO_TIME | ISO_T, tc->iso, sizeof(tc->iso)) != 0
+		|| strtm_iso(&tm, ISO_TIMEZONE, tc->isotz, sizeof(tc->isotz)) != 0)) {
+		*tc->iso = '\0';
+		return NULL;
+	}
 
-	if (strtimeval_iso(&tv,	ISO_TIMESTAMP_COMMA_T, buf, bufsz) != 0)
+	len = snprintf(buf, bufsz, "%s,%06ld%s", tc->iso,
+		       (long) rec->tv.tv_usec, tc->isotz);
+	if (len < 0 || (size_t) len >= bufsz)
 		return NULL;
 
 	return buf;
@@ -1081,6 +1190,231 @@ done:
  * Prints the 'buf' kernel ring buffer; the messages are filtered out according
  * to 'levels' and 'facilities' bitarrays.
  */
+/*
+ * The --file index is "<file>.index" file: header followed by entries, every
+ * entry describes a range of the records (about DMESG_INDEX_CHUNK bytes,
+ * always on record boundary) by timestamps range and bitmasks of the used
+ * levels and facilities. The ranges which cannot match --since, --until,
+ * --level and --facility are never read. The index is in host byte order and
+ * it is ignored if the file size or mtime does not match.
+ */
+#define DMESG_INDEX_MAGIC	"DMESGIX1"
+#define DMESG_INDEX_SUFFIX	".index"
+#define DMESG_INDEX_CHUNK	(64 * 1024)
+
+struct dmesg_index_header {
+	char		magic[8];
+	uint64_t	filesize;	/* indexed file size */
+	int64_t		mtime;		/* indexed file st_mtime */
+	uint64_t	nentries;
+};
+
+struct dmesg_index_entry {
+	uint64_t	offset;		/* first record of the range */
+	uint64_t	size;		/* size of the range */
+	uint64_t	min_usec;	/* timestamps range */
+	uint64_t	max_usec;
+	uint32_t	levels;		/* bitmask of used levels */
+	uint32_t	facilities;	/* bitmask of used facilities */
+};
+
+static char *get_index_filename(struct dmesg_control *ctl)
+{
+	char *name;
+
+	xasprintf(&name, "%s%s", ctl->filename, DMESG_INDEX_SUFFIX);
+	return name;
+}
+
+static struct dmesg_index_entry *build_index(struct dmesg_control *ctl,
+					     const char *buf, size_t size,
+					     size_t *nents)
+{
+	struct dmesg_record rec = { .next = buf, .next_size = size };
+	struct dmesg_index_entry *ents = NULL, *ent = NULL;
+	char *mmap_buff = ctl->mmap_buff;
+	size_t n = 0, nalloc = 0;
+
+	/* don't unmap, the buffer will be printed later */
+	ctl->mmap_buff = NULL;
+	ctl->indexing = 1;
+
+	while (rec.next) {
+		const char *start = rec.next;
+		uint64_t usec;
+
+		if (get_next_syslog_record(ctl, &rec) != 0)
+			break;
+
+		if (!ent || (uint64_t) (start - buf) - ent->offset >= DMESG_INDEX_CHUNK) {
+			if (n == nalloc) {
+				nalloc = nalloc ? nalloc * 2 : 64;
+				ents = xrealloc(ents, nalloc * sizeof(*ents));
+			}
+			ent = &ents[n++];
+			memset(ent, 0, sizeof(*ent));
+			ent->offset = start - buf;
+			ent->min_usec = UINT64_MAX;
+		}
+
+		usec = record_usec(&rec);
+		if (usec < ent->min_usec)
+			ent->min_usec = usec;
+		if (usec > ent->max_usec)
+			ent->max_usec = usec;
+		if (rec.level >= 0)
+			ent->levels |= 1U << (rec.level & 7);
+		if (rec.facility >= 32)
+			ent->facilities = UINT32_MAX;
+		else if (rec.facility >= 0)
+			ent->facilities |= 1U << rec.facility;
+
+		ent->size = (rec.next ? rec.next : buf + size) - buf - ent->offset;
+	}
+
+	ctl->indexing = 0;
+	ctl->mmap_buff = mmap_buff;
+
+	*nents = n;
+	return ents;
+}
+
+static int write_index(struct dmesg_control *ctl, size_t size,
+		       struct dmesg_index_entry *ents, size_t nents)
+{
+	struct dmesg_index_header hdr = {
+		.magic = DMESG_INDEX_MAGIC,
+		.filesize = size,
+		.mtime = ctl->file_mtime,
+		.nentries = nents
+	};
+	char *name = get_index_filename(ctl), *tmp;
+	int fd, rc = 0;
+
+	xasprintf(&tmp, "%s.XXXXXX", name);
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		rc = -errno;
+		goto done;
+	}
+	if (fchmod(fd, 0644) != 0
+	    || write_all(fd, &hdr, sizeof(hdr)) != 0
+	    || write_all(fd, ents, nents * sizeof(*ents)) != 0)
+		rc = -errno;
+	if (close(fd) != 0 && !rc)
+		rc = -errno;
+	if (!rc && rename(tmp, name) != 0)
+		rc = -errno;
+	if (rc)
+		unlink(tmp);
+done:
+	if (rc) {
+		errno = -rc;
+		warn(_("cannot write index %s"), name);
+	}
+	free(tmp);
+	free(name);
+	return rc;
+}
+
+static struct dmesg_index_entry *read_index(struct dmesg_control *ctl,
+					    size_t size, size_t *nents)
+{
+	struct dmesg_index_header hdr;
+	struct dmesg_index_entry *ents = NULL;
+	char *name = get_index_filename(ctl);
+	uint64_t end = 0, i;
+	struct stat st;
+	int fd;
+
+	fd = open(name, O_RDONLY | O_CLOEXEC);
+	free(name);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) != 0
+	    || read_all(fd, (char *) &hdr, sizeof(hdr)) != sizeof(hdr)
+	    || memcmp(hdr.magic, DMESG_INDEX_MAGIC, sizeof(hdr.magic)) != 0
+	    || hdr.filesize != size
+	    || hdr.mtime != (int64_t) ctl->file_mtime
+	    || hdr.nentries == 0
+	    || hdr.nentries > (uint64_t) st.st_size / sizeof(*ents))
+		goto fail;
+
+	ents = xmalloc(hdr.nentries * sizeof(*ents));
+	if (read_all(fd, (char *) ents, hdr.nentries * sizeof(*ents))
+			!= (ssize_t) (hdr.nentries * sizeof(*ents)))
+		goto fail;
+
+	/* the ranges have to be sorted and within the file */
+	for (i = 0; i < hdr.nentries; i++) {
+		if (ents[i].offset < end || ents[i].size > size
+		    || ents[i].offset > size - ents[i].size)
+			goto fail;
+		end = ents[i].offset + ents[i].size;
+	}
+
+	close(fd);
+	*nents = hdr.nentries;
+	return ents;
+fail:
+	close(fd);
+	free(ents);
+	return NULL;
+}
+
+static int index_entry_wanted(struct dmesg_control *ctl,
+			      const struct dmesg_index_entry *ent,
+			      uint32_t levels, uint32_t facilities)
+{
+	if (ctl->fltr_time && (ent->max_usec < ctl->since ||
+			       ent->min_usec > ctl->until))
+		return 0;
+	if (ctl->fltr_lev && !(ent->levels & levels))
+		return 0;
+	if (ctl->fltr_fac && !(ent->facilities & facilities))
+		return 0;
+	return 1;
+}
+
+static void print_indexed_buffer(struct dmesg_control *ctl, const char *buf,
+				 const struct dmesg_index_entry *ents, size_t nents)
+{
+	uint32_t levels = 0, facilities = 0;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(level_names); i++) {
+		if (isset(ctl->levels, i))
+			levels |= 1U << i;
+	}
+	for (i = 0; i < ARRAY_SIZE(facility_names) && i < 32; i++) {
+		if (isset(ctl->facilities, i))
+			facilities |= 1U << i;
+	}
+
+	for (i = 0; i < nents; i++) {
+		struct dmesg_record rec = {
+			.next = buf + ents[i].offset,
+			.next_size = ents[i].size
+		};
+		char *page;
+
+		if (!index_entry_wanted(ctl, &ents[i], levels, facilities))
+			continue;
+
+		/* unmap the skipped part of the file */
+		page = (char *) buf + (ents[i].offset & ~((uint64_t) ctl->pagesize - 1));
+		if (ctl->mmap_buff < page) {
+			munmap(ctl->mmap_buff, page - ctl->mmap_buff);
+			ctl->mmap_buff = page;
+		}
+
+		while (get_next_syslog_record(ctl, &rec) == 0)
+			print_record(ctl, &rec);
+	}
+}
+
 static void print_buffer(struct dmesg_control *ctl,
 			const char *buf, size_t size)
 {
@@ -1091,6 +1425,24 @@ static void print_buffer(struct dmesg_control *ctl,
 		return;
 	}
 
+	if (ctl->mmap_buff &&
+	    (ctl->mkindex || ctl->fltr_time || ctl->fltr_lev || ctl->fltr_fac)) {
+		struct dmesg_index_entry *ents;
+		size_t nents = 0;
+
+		if (ctl->mkindex) {
+			ents = build_index(ctl, buf, size, &nents);
+			write_index(ctl, size, ents, nents);
+		} else
+			ents = read_index(ctl, size, &nents);
+
+		if (ents) {
+			print_indexed_buffer(ctl, buf, ents, nents);
+			free(ents);
+			return;
+		}
+	}
+
 	while (get_next_syslog_record(ctl, &rec) == 0)
 		print_record(ctl, &rec);
 }
@@ -1112,7 +1464,7 @@ static int init_kmsg(struct dmesg_control *ctl)
 {
 	int mode = O_RDONLY;
 
-	if (!ctl->follow)
+	if (!ctl->follow || ctl->sockpath)
 		mode |= O_NONBLOCK;
 	else
 		setlinebuf(stdout);
@@ -1137,7 +1489,7 @@ static int init_kmsg(struct dmesg_control *ctl)
 	 * read_kmsg().
 	 */
 	ctl->kmsg_first_read = read_kmsg_one(ctl);
-	if (ctl->kmsg_first_read < 0) {
+	if (ctl->kmsg_first_read < 0 && !(ctl->sockpath && errno == EAGAIN)) {
 		close(ctl->kmsg);
 		ctl->kmsg = -1;
 		return -1;
@@ -1177,7 +1529,7 @@ static int parse_kmsg_record(struct dmesg_control *ctl,
 
 	/* A) priority and facility */
 	if (ctl->fltr_lev || ctl->fltr_fac || ctl->decode ||
-	    ctl->raw || ctl->color)
+	    ctl->raw || ctl->color || ctl->sockpath)
 		p = parse_faclev(p, &rec->facility, &rec->level);
 	else
 		p = skip_item(p, end, ",");
@@ -1185,12 +1537,14 @@ static int parse_kmsg_record(struct dmesg_control *ctl,
 		goto mesg;
 
 	/* B) sequence number */
+	if (ctl->sockpath)
+		rec->seqnum = strtoull(p, NULL, 10);
 	p = skip_item(p, end, ",;");
 	if (LAST_KMSG_FIELD(p))
 		goto mesg;
 
 	/* C) timestamp */
-	if (is_timefmt(ctl, NONE))
+	if (is_timefmt(ctl, NONE) && !ctl->sockpath && !ctl->fltr_time)
 		p = skip_item(p, end, ",;");
 	else
 		p = parse_kmsg_timestamp(p, &rec->tv);
@@ -1270,6 +1624,331 @@ static int read_kmsg(struct dmesg_control *ctl)
 	return 0;
 }
 
+/*
+ * --output-socket
+ *
+ * The records from /dev/kmsg are parsed only once, serialized and kept in
+ * memory (the history), and streamed to all consumers connected to the UNIX
+ * socket. Every consumer sends the sequence number of the first wanted
+ * record (8 bytes in host byte order) after connect; zero means all records
+ * from the history, UINT64_MAX only new records. A reconnecting consumer
+ * sends the last received sequence number + 1 and continues without
+ * duplicates. The history is limited, the lagging consumers lose the oldest
+ * records (the gap is visible by the sequence numbers).
+ *
+ * The stream is a sequence of struct dmesg_sockrec headers, every header is
+ * followed by the message text.
+ */
+#define DMESG_SOCKET_HISTORY	(4 * 1024 * 1024)	/* max history size in bytes */
+#define DMESG_SOCKET_CLIENTS	64			/* max number of consumers */
+
+struct dmesg_sockrec {
+	uint32_t	size;		/* size of the message text */
+	int16_t		level;		/* or -1 */
+	int16_t		facility;	/* or -1 */
+	uint64_t	seqnum;		/* kmsg sequence number */
+	uint64_t	usec;		/* monotonic timestamp */
+};
+
+struct dmesg_histrec {
+	size_t		size;		/* size of data[] */
+	uint64_t	seqnum;
+	char		data[];		/* struct dmesg_sockrec and message */
+};
+
+struct dmesg_client {
+	int		fd;
+	uint64_t	next;		/* seqnum of the next record */
+	size_t		offset;		/* sent bytes of the next record */
+
+	unsigned char	req[sizeof(uint64_t)];	/* first wanted seqnum */
+	size_t		reqsz;
+};
+
+struct dmesg_socket {
+	int			fd;
+
+	struct dmesg_histrec	**hist;		/* records sorted by seqnum */
+	size_t			first;		/* the oldest record in hist[] */
+	size_t			nhist;		/* hist[] used size (including first) */
+	size_t			nalloc;
+	size_t			histsz;		/* bytes in the history */
+
+	struct dmesg_client	clients[DMESG_SOCKET_CLIENTS];
+	size_t			nclients;
+};
+
+static int open_output_socket(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		errx(EXIT_FAILURE, _("socket path too long: %s"), path);
+	xstrncpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+	/* stale socket from the previous run */
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd < 0)
+		err(EXIT_FAILURE, _("cannot create socket"));
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+	    || listen(fd, DMESG_SOCKET_CLIENTS) != 0)
+		err(EXIT_FAILURE, _("cannot listen on %s"), path);
+	return fd;
+}
+
+static void close_client(struct dmesg_socket *so, size_t idx)
+{
+	close(so->clients[idx].fd);
+	so->clients[idx] = so->clients[--so->nclients];
+}
+
+/* returns index of the first record with seqnum >= @seqnum */
+static size_t find_histrec(struct dmesg_socket *so, uint64_t seqnum)
+{
+	size_t lo = so->first, hi = so->nhist;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (so->hist[mid]->seqnum < seqnum)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void drop_oldest_histrec(struct dmesg_socket *so)
+{
+	struct dmesg_histrec *hr = so->hist[so->first];
+	size_t i;
+
+	/* the record is partially sent, the stream can't be continued */
+	for (i = 0; i < so->nclients; ) {
+		struct dmesg_client *cl = &so->clients[i];
+
+		if (cl->offset && cl->next == hr->seqnum)
+			close_client(so, i);
+		else
+			i++;
+	}
+
+	so->histsz -= hr->size;
+	free(hr);
+	so->first++;
+
+	if (so->first > so->nhist / 2) {
+		so->nhist -= so->first;
+		memmove(so->hist, so->hist + so->first,
+			so->nhist * sizeof(struct dmesg_histrec *));
+		so->first = 0;
+	}
+}
+
+static void add_histrec(struct dmesg_socket *so, struct dmesg_record *rec)
+{
+	struct dmesg_histrec *hr;
+	struct dmesg_sockrec sr = {
+		.size = rec->mesg_size,
+		.level = rec->level,
+		.facility = rec->facility,
+		.seqnum = rec->seqnum,
+		.usec = (uint64_t) rec->tv.tv_sec * 1000000 + rec->tv.tv_usec
+	};
+
+	hr = xmalloc(sizeof(*hr) + sizeof(sr) + rec->mesg_size);
+	hr->size = sizeof(sr) + rec->mesg_size;
+	hr->seqnum = rec->seqnum;
+	memcpy(hr->data, &sr, sizeof(sr));
+	memcpy(hr->data + sizeof(sr), rec->mesg, rec->mesg_size);
+
+	while (so->nhist > so->first && so->histsz + hr->size > DMESG_SOCKET_HISTORY)
+		drop_oldest_histrec(so);
+
+	if (so->nhist == so->nalloc) {
+		so->nalloc = so->nalloc ? so->nalloc * 2 : 1024;
+		so->hist = xrealloc(so->hist, so->nalloc * sizeof(struct dmesg_histrec *));
+	}
+	so->hist[so->nhist++] = hr;
+	so->histsz += hr->size;
+}
+
+/* reads all available records from /dev/kmsg */
+static void read_kmsg_records(struct dmesg_control *ctl, struct dmesg_socket *so,
+			      ssize_t sz)
+{
+	struct dmesg_record rec;
+
+	do {
+		if (sz <= 0)
+			break;
+		*(ctl->kmsg_buf + sz) = '\0';
+
+		if (parse_kmsg_record(ctl, &rec, ctl->kmsg_buf, (size_t) sz) == 0
+		    && accept_record(ctl, &rec))
+			add_histrec(so, &rec);
+
+		sz = read_kmsg_one(ctl);
+	} while (1);
+
+	if (sz < 0 && errno != EAGAIN && errno != EINTR)
+		err(EXIT_FAILURE, _("read kernel buffer failed"));
+}
+
+static void accept_client(struct dmesg_socket *so)
+{
+	int fd;
+
+	while ((fd = accept4(so->fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+		struct dmesg_client *cl;
+
+		if (so->nclients == DMESG_SOCKET_CLIENTS) {
+			warnx(_("too many consumers, connection refused"));
+			close(fd);
+			continue;
+		}
+		cl = &so->clients[so->nclients++];
+		memset(cl, 0, sizeof(*cl));
+		cl->fd = fd;
+	}
+}
+
+/* returns 0 on success, or -1 if the consumer has to be closed */
+static int read_client_request(struct dmesg_socket *so, struct dmesg_client *cl)
+{
+	ssize_t ret;
+	uint64_t next;
+
+	ret = read(cl->fd, cl->req + cl->reqsz, sizeof(cl->req) - cl->reqsz);
+	if (ret < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -1;
+	if (ret == 0)
+		return -1;
+	cl->reqsz += ret;
+	if (cl->reqsz < sizeof(cl->req))
+		return 0;
+
+	memcpy(&next, cl->req, sizeof(next));
+	if (next == UINT64_MAX)
+		next = so->nhist > so->first ?
+			so->hist[so->nhist - 1]->seqnum + 1 : 0;
+	cl->next = next;
+	return 0;
+}
+
+/* returns 0 on success, or -1 if the consumer has to be closed */
+static int write_client(struct dmesg_socket *so, struct dmesg_client *cl)
+{
+	size_t idx = find_histrec(so, cl->next);
+
+	while (idx < so->nhist) {
+		struct dmesg_histrec *hr = so->hist[idx];
+		ssize_t ret;
+
+		if (hr->seqnum != cl->next)	/* lost records */
+			cl->offset = 0;
+
+		ret = send(cl->fd, hr->data + cl->offset, hr->size - cl->offset,
+			   MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (ret < 0)
+			return errno == EAGAIN || errno == EINTR ? 0 : -1;
+
+		cl->next = hr->seqnum;
+		cl->offset += ret;
+		if (cl->offset < hr->size)
+			return 0;
+
+		cl->next = hr->seqnum + 1;
+		cl->offset = 0;
+		idx++;
+	}
+	return 0;
+}
+
+static int client_has_data(struct dmesg_socket *so, struct dmesg_client *cl)
+{
+	return cl->reqsz == sizeof(cl->req)
+		&& so->nhist > so->first
+		&& so->hist[so->nhist - 1]->seqnum >= cl->next;
+}
+
+/*
+ * Reads /dev/kmsg and streams the records to the consumers, never returns.
+ */
+static void __attribute__((__noreturn__)) follow_socket(struct dmesg_control *ctl)
+{
+	struct dmesg_socket so = { .fd = -1 };
+	struct pollfd fds[DMESG_SOCKET_CLIENTS + 2];
+	size_t i;
+
+	if (ctl->method != DMESG_METHOD_KMSG || ctl->kmsg < 0)
+		errx(EXIT_FAILURE, _("--output-socket requires /dev/kmsg"));
+
+	so.fd = open_output_socket(ctl->sockpath);
+	read_kmsg_records(ctl, &so, ctl->kmsg_first_read);
+
+	while (1) {
+		size_t nfds = 0;
+
+		fds[nfds].fd = ctl->kmsg;
+		fds[nfds++].events = POLLIN;
+		fds[nfds].fd = so.fd;
+		fds[nfds++].events = POLLIN;
+
+		for (i = 0; i < so.nclients; i++) {
+			struct dmesg_client *cl = &so.clients[i];
+
+			fds[nfds].fd = cl->fd;
+			fds[nfds++].events = cl->reqsz < sizeof(cl->req) ? POLLIN :
+					     client_has_data(&so, cl) ? POLLOUT : 0;
+		}
+
+		if (poll(fds, nfds, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, _("poll failed"));
+		}
+
+		/* consumers; in reverse order as close_client() reorders the array */
+		for (i = so.nclients; i > 0; i--) {
+			struct dmesg_client *cl = &so.clients[i - 1];
+			short ev = fds[i + 1].revents;
+			int rc = 0;
+
+			if (!ev)
+				continue;
+			if (ev & (POLLERR | POLLHUP | POLLNVAL))
+				rc = -1;
+			else if (ev & POLLIN)
+				rc = read_client_request(&so, cl);
+			if (rc == 0 && client_has_data(&so, cl))
+				rc = write_client(&so, cl);
+			if (rc)
+				close_client(&so, i - 1);
+		}
+
+		if (fds[1].revents & POLLIN)
+			accept_client(&so);
+
+		if (fds[0].revents & POLLIN) {
+			read_kmsg_records(ctl, &so, read_kmsg_one(ctl));
+
+			/* new records, try to send them immediately */
+			for (i = so.nclients; i > 0; i--) {
+				struct dmesg_client *cl = &so.clients[i - 1];
+
+				if (client_has_data(&so, cl) && write_client(&so, cl))
+					close_client(&so, i - 1);
+			}
+		}
+	}
+}
+
 static int which_time_format(const char *s)
 {
 	if (!strcmp(s, "notime"))
@@ -1303,6 +1982,32 @@ static inline int dmesg_get_boot_time(struct timeval *tv)
 # define dmesg_get_boot_time	get_boot_time
 #endif
 
+/*
+ * Returns --since/--until time in usec since boot. The number is seconds since
+ * boot (the log timestamp), anything else is parsed as date and converted by
+ * the boot time, the result is inaccurate after suspend/resume as --ctime.
+ */
+static uint64_t parse_since_until(struct dmesg_control *ctl, const char *str)
+{
+	usec_t usec, boot;
+	char *end = NULL;
+	double sec;
+
+	errno = 0;
+	sec = strtod(str, &end);
+	if (errno == 0 && end != str && *end == '\0' && sec >= 0)
+		return sec * USEC_PER_SEC;
+
+	if (parse_timestamp(str, &usec) != 0)
+		errx(EXIT_FAILURE, _("invalid time value \"%s\""), str);
+
+	if (!ctl->boot_time.tv_sec && dmesg_get_boot_time(&ctl->boot_time) != 0)
+		err(EXIT_FAILURE, _("cannot get boot time"));
+
+	boot = (usec_t) ctl->boot_time.tv_sec * USEC_PER_SEC + ctl->boot_time.tv_usec;
+	return usec > boot ? usec - boot : 0;
+}
+
 int main(int argc, char *argv[])
 {
 	char *buf = NULL;
@@ -1317,12 +2022,17 @@ int main(int argc, char *argv[])
 		.method = DMESG_METHOD_KMSG,
 		.kmsg = -1,
 		.time_fmt = DMESG_TIMEFTM_TIME,
+		.until = UINT64_MAX,
 		.indent = 0,
 	};
 	int colormode = UL_COLORMODE_UNDEF;
 	enum {
 		OPT_TIME_FORMAT = CHAR_MAX + 1,
-		OPT_NOESC
+		OPT_NOESC,
+		OPT_SOCKET,
+		OPT_SINCE,
+		OPT_UNTIL,
+		OPT_INDEX
 	};
 
 	static const struct option longopts[] = {
@@ -1338,6 +2048,7 @@ int main(int argc, char *argv[])
 		{ "follow",        no_argument,       NULL, 'w' },
 		{ "human",         no_argument,       NULL, 'H' },
 		{ "help",          no_argument,	      NULL, 'h' },
+		{ "index",         no_argument,       NULL, OPT_INDEX },
 		{ "kernel",        no_argument,       NULL, 'k' },
 		{ "level",         required_argument, NULL, 'l' },
 		{ "syslog",        no_argument,       NULL, 'S' },
@@ -1345,10 +2056,13 @@ int main(int argc, char *argv[])
 		{ "read-clear",    no_argument,	      NULL, 'c' },
 		{ "reltime",       no_argument,       NULL, 'e' },
 		{ "show-delta",    no_argument,	      NULL, 'd' },
+		{ "since",         required_argument, NULL, OPT_SINCE },
+		{ "until",         required_argument, NULL, OPT_UNTIL },
 		{ "ctime",         no_argument,       NULL, 'T' },
 		{ "noescape",      no_argument,       NULL, OPT_NOESC },
 		{ "notime",        no_argument,       NULL, 't' },
 		{ "nopager",       no_argument,       NULL, 'P' },
+		{ "output-socket", required_argument, NULL, OPT_SOCKET },
 		{ "userspace",     no_argument,       NULL, 'u' },
 		{ "version",       no_argument,	      NULL, 'V' },
 		{ "time-format",   required_argument, NULL, OPT_TIME_FORMAT },
@@ -1466,6 +2180,10 @@ int main(int argc, char *argv[])
 		case 'w':
 			ctl.follow = 1;
 			break;
+		case OPT_SOCKET:
+			ctl.sockpath = optarg;
+			ctl.follow = 1;
+			break;
 		case 'x':
 			ctl.decode = 1;
 			break;
@@ -1475,6 +2193,17 @@ int main(int argc, char *argv[])
 		case OPT_NOESC:
 			ctl.noesc = 1;
 			break;
+		case OPT_SINCE:
+			ctl.since = parse_since_until(&ctl, optarg);
+			ctl.fltr_time = 1;
+			break;
+		case OPT_UNTIL:
+			ctl.until = parse_since_until(&ctl, optarg);
+			ctl.fltr_time = 1;
+			break;
+		case OPT_INDEX:
+			ctl.mkindex = 1;
+			break;
 
 		case 'h':
 			usage();
@@ -1490,6 +2219,9 @@ int main(int argc, char *argv[])
 		errtryhelp(EXIT_FAILURE);
 	}
 
+	if (ctl.mkindex && ctl.method != DMESG_METHOD_MMAP)
+		errx(EXIT_FAILURE, _("--index requires --file"));
+
 	if ((is_timefmt(&ctl, RELTIME) ||
 	     is_timefmt(&ctl, CTIME)   ||
 	     is_timefmt(&ctl, ISO8601))
@@ -1519,6 +2251,10 @@ int main(int argc, char *argv[])
 	if (ctl.pager)
 		pager_redirect();
 
+	/* the output is written by large blocks, see also init_kmsg() */
+	if (!ctl.follow)
+		setvbuf(stdout, NULL, _IOFBF, DMESG_OUTBUF_SIZE);
+
 	switch (ctl.action) {
 	case SYSLOG_ACTION_READ_ALL:
 	case SYSLOG_ACTION_READ_CLEAR:
@@ -1527,14 +2263,17 @@ int main(int argc, char *argv[])
 
 		if (ctl.raw
 		    && ctl.method != DMESG_METHOD_KMSG
-		    && (ctl.fltr_lev || ctl.fltr_fac))
-			    errx(EXIT_FAILURE, _("--raw can be used together with --level or "
-				 "--facility only when reading messages from /dev/kmsg"));
+		    && (ctl.fltr_lev || ctl.fltr_fac || ctl.fltr_time))
+			    errx(EXIT_FAILURE, _("--raw can be used together with --level, "
+				 "--facility, --since or --until only when reading "
+				 "messages from /dev/kmsg"));
 
 		/* only kmsg supports multi-line messages */
 		if (ctl.force_prefix && ctl.method != DMESG_METHOD_KMSG)
 			ctl.force_prefix = 0;
 
+		if (ctl.sockpath)
+			follow_socket(&ctl);
 		if (ctl.pager)
 			pager_redirect();
 		n = read_buffer(&ctl, &buf);
@@ -38,6 +38,12 @@
 # include <sys/syscall.h>
 #endif
 
+#ifdef HAVE_LINUX_FIEMAP_H
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+# include <linux/fiemap.h>
+#endif
+
 #if defined(HAVE_LINUX_FALLOC_H) && \
     (!defined(FALLOC_FL_KEEP_SIZE) || !defined(FALLOC_FL_PUNCH_HOLE) || \
      !defined(FALLOC_FL_COLLAPSE_RANGE) || !defined(FALLOC_FL_ZERO_RANGE) || \
@@ -72,6 +78,7 @@
 #include "closestream.h"
 #include "xalloc.h"
 #include "optutils.h"
+#include "uring.h"
 
 static int verbose;
 static char *filename;
@@ -94,11 +101,13 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -n, --keep-size      maintain the apparent size of the file\n"), out);
 	fputs(_(" -o, --offset <num>   offset for range operations, in bytes\n"), out);
 	fputs(_(" -p, --punch-hole     replace a range with a hole (implies -n)\n"), out);
+	fputs(_(" -s, --sparsify       like --dig-holes, but read only written extents\n"), out);
 	fputs(_(" -z, --zero-range     zero and ensure allocation of a range\n"), out);
 #ifdef HAVE_POSIX_FALLOCATE
 	fputs(_(" -x, --posix          use posix_fallocate(3) instead of fallocate(2)\n"), out);
 #endif
-	fputs(_(" -v, --verbose        verbose mode\n"), out);
+	fputs(_(" -v, --verbose        verbose mode, twice to report progress\n"), out);
+	fputs(_("     --dry-run        only count zeroes for --dig-holes or --sparsify\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(22));
@@ -151,41 +160,120 @@ static void xposix_fallocate(int fd, off_t offset, off_t length)
 }
 #endif
 
-/* The real buffer size has to be bufsize + sizeof(uintptr_t) */
-static int is_nul(void *buf, size_t bufsize)
+/*
+ * The first bytes are checked directly and the rest of the buffer is compared
+ * with itself shifted by the checked size, so the work is done by memcmp(),
+ * which is vectorized by libc.
+ */
+static int is_nul(const void *buf, size_t bufsize)
 {
-	typedef uintptr_t word;
-	void const *vp;
-	char const *cbuf = buf, *cp;
-	word const *wp = buf;
+	const unsigned char *p = buf;
+	size_t i, head = min(bufsize, (size_t) 16);
 
-	/* set sentinel */
-	memset((char *) buf + bufsize, '\1', sizeof(word));
+	for (i = 0; i < head; i++) {
+		if (p[i])
+			return 0;
+	}
+	return bufsize == head || memcmp(p, p + head, bufsize - head) == 0;
+}
 
-	/* Find first nonzero *word*, or the word with the sentinel.  */
-	while (*wp++ == 0)
-		continue;
+/*
+ * The data are read in large chunks and checked per filesystem block. With
+ * io_uring the next chunk is read while the current one is checked.
+ */
+#define DIG_CHUNKSZ	(1024 * 1024)
+
+struct dig_ctl {
+	int		fd;
+	size_t		bufsz;		/* filesystem block size */
+	size_t		chunksz;	/* read() size */
+	char		*bufs[2];	/* the current and the read-ahead chunk */
+	struct ul_uring	ring;
+
+	off_t		hole_start;	/* not punched zero blocks */
+	off_t		hole_sz;
+
+	uintmax_t	ct;		/* zeros found */
+	uintmax_t	skipped;	/* unwritten or shared extents */
+	uintmax_t	done;		/* processed bytes (for progress) */
+	uintmax_t	total;
+	int		last_pct;
+#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
+	off_t		cache_start;
+#endif
+	unsigned int	dry_run : 1,
+			progress : 1;
+};
 
-	/* Find the first nonzero *byte*, or the sentinel.  */
-	vp = wp - 1;
-	cp = vp;
+static void dig_punch(struct dig_ctl *dig)
+{
+	if (!dig->hole_sz)
+		return;
+	if (!dig->dry_run)
+		xfallocate(dig->fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
+			   dig->hole_start, dig->hole_sz);
+	dig->ct += dig->hole_sz;
+	dig->hole_sz = dig->hole_start = 0;
+}
 
-	while (*cp++ == 0)
-		continue;
+static void dig_progress(struct dig_ctl *dig, off_t n, int last)
+{
+	int pct;
+
+	dig->done += n;
+	if (!dig->progress || !dig->total)
+		return;
+
+	pct = (int) (dig->done * 100 / dig->total);
+	if (pct == dig->last_pct && !last)
+		return;
+	dig->last_pct = pct;
+	fprintf(stdout, _("\r%s: %3d%% processed"), filename, min(pct, 100));
+	if (last)
+		fputc('\n', stdout);
+	fflush(stdout);
+}
 
-	return cbuf + bufsize < cp;
+/* submits read of the chunk at @off to @buf, returns 1 if queued */
+static int dig_readahead(struct dig_ctl *dig, char *buf, off_t off, off_t end)
+{
+	size_t want = min((off_t) dig->chunksz, end - off);
+
+	if (!ul_uring_is_ready(&dig->ring)
+	    || ul_uring_prep_rw(&dig->ring, UL_URING_READ, dig->fd,
+				buf, want, off, 0) != 0)
+		return 0;
+	if (ul_uring_submit(&dig->ring, 0) <= 0) {
+		/* the request is not in flight, use pread() */
+		ul_uring_deinit(&dig->ring);
+		return 0;
+	}
+	return 1;
 }
 
-static void dig_holes(int fd, off_t file_off, off_t len)
+/*
+ * Waits for the read-ahead of the chunk at @off. The failed request (for
+ * example, old kernels don't support IORING_OP_READ) is repeated by pread().
+ */
+static ssize_t dig_readahead_wait(struct dig_ctl *dig, char *buf,
+				  size_t want, off_t off)
+{
+	int res = 0;
+
+	if (ul_uring_wait_completion(&dig->ring, NULL, &res) != 1)
+		err(EXIT_FAILURE, _("%s: read failed"), filename);
+	if (res < 0) {
+		ul_uring_deinit(&dig->ring);
+		return pread(dig->fd, buf, want, off);
+	}
+	return res;
+}
+
+/*
+ * Reads the data area [off, end) and punches holes for the zero blocks.
+ */
+static void dig_range(struct dig_ctl *dig, off_t off, off_t end)
 {
-	off_t file_end = len ? file_off + len : 0;
-	off_t hole_start = 0, hole_sz = 0;
-	uintmax_t ct = 0;
-	size_t  bufsz;
-	char *buf;
-	struct stat st;
-#if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
-	off_t cache_start = file_off;
 	/*
 	 * We don't want to call POSIX_FADV_DONTNEED to discard cached
 	 * data in PAGE_SIZE steps. IMHO it's overkill (too many syscalls).
@@ -194,91 +282,232 @@ static void dig_holes(int fd, off_t file_off, off_t len)
 	 * a good compromise.
 	 *					    -- kzak Feb-2014
 	 */
+#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
 	const size_t cachesz = getpagesize() * 256;
 #endif
 
-	if (fstat(fd, &st) != 0)
-		err(EXIT_FAILURE, _("stat of %s failed"), filename);
+#if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
+	(void) posix_fadvise(dig->fd, off, end, POSIX_FADV_SEQUENTIAL);
+#endif
+	int cur = 0, queued = 0;
+
+	while (off < end) {
+		size_t want = min((off_t) dig->chunksz, end - off), pos, n;
+		char *buf = dig->bufs[cur];
+		ssize_t rsz;
+
+		if (queued)
+			rsz = dig_readahead_wait(dig, buf, want, off);
+		else
+			rsz = pread(dig->fd, buf, want, off);
+		queued = 0;
+
+		if (rsz < 0 && errno)
+			err(EXIT_FAILURE, _("%s: read failed"), filename);
+		if (end && rsz > 0 && off > end - rsz)
+			rsz = end - off;
+		if (rsz <= 0)
+			break;
 
-	bufsz = st.st_blksize;
+		if (off + rsz < end) {
+			queued = dig_readahead(dig, dig->bufs[!cur], off + rsz, end);
+			if (queued)
+				cur = !cur;
+		}
 
-	if (lseek(fd, file_off, SEEK_SET) < 0)
-		err(EXIT_FAILURE, _("seek on %s failed"), filename);
+		/* check the chunk per block, the blocks are aligned to
+		 * the filesystem block size, adjacent zero blocks are
+		 * punched by one call */
+		for (pos = 0; pos < (size_t) rsz; pos += n) {
+			n = dig->bufsz - (off + pos) % dig->bufsz;
+			if (n > (size_t) rsz - pos)
+				n = rsz - pos;
+
+			if (is_nul(buf + pos, n)) {
+				if (!dig->hole_sz)		/* new hole detected */
+					dig->hole_start = off + pos;
+				dig->hole_sz += n;
+			} else
+				dig_punch(dig);
+		}
 
-	/* buffer + extra space for is_nul() sentinel */
-	buf = xmalloc(bufsz + sizeof(uintptr_t));
+#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
+		/* discard cached data */
+		if (off - dig->cache_start > (off_t) cachesz) {
+			size_t clen = off - dig->cache_start;
+
+			clen = (clen / cachesz) * cachesz;
+			(void) posix_fadvise(dig->fd, dig->cache_start, clen, POSIX_FADV_DONTNEED);
+			dig->cache_start = dig->cache_start + clen;
+		}
+#endif
+		off += rsz;
+		dig_progress(dig, rsz, 0);
+	}
+	dig_punch(dig);
+}
+
+/* walks the data areas by SEEK_DATA and SEEK_HOLE */
+static void dig_seek_data(struct dig_ctl *dig, off_t file_off, off_t file_end)
+{
 	while (file_end == 0 || file_off < file_end) {
 		/*
 		 * Detect data area (skip holes)
 		 */
 		off_t end, off;
 
-		off = lseek(fd, file_off, SEEK_DATA);
+		off = lseek(dig->fd, file_off, SEEK_DATA);
 		if ((off == -1 && errno == ENXIO) ||
 		    (file_end && off >= file_end))
 			break;
 
-		end = lseek(fd, off, SEEK_HOLE);
+		end = lseek(dig->fd, off, SEEK_HOLE);
 		if (file_end && end > file_end)
 			end = file_end;
 
 		if (off < 0 || end < 0)
 			break;
 
-#if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
-		(void) posix_fadvise(fd, off, end, POSIX_FADV_SEQUENTIAL);
-#endif
-		/*
-		 * Dig holes in the area
-		 */
-		while (off < end) {
-			ssize_t rsz = pread(fd, buf, bufsz, off);
-			if (rsz < 0 && errno)
-				err(EXIT_FAILURE, _("%s: read failed"), filename);
-			if (end && rsz > 0 && off > end - rsz)
-				rsz = end - off;
-			if (rsz <= 0)
-				break;
-
-			if (is_nul(buf, rsz)) {
-				if (!hole_sz)				/* new hole detected */
-					hole_start = off;
-				hole_sz += rsz;
-			 } else if (hole_sz) {
-				xfallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
-					   hole_start, hole_sz);
-				ct += hole_sz;
-				hole_sz = hole_start = 0;
-			}
+		dig_progress(dig, off - file_off, 0);
+		dig_range(dig, off, end);
+		file_off = end;
+	}
+}
 
-#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
-			/* discard cached data */
-			if (off - cache_start > (off_t) cachesz) {
-				size_t clen = off - cache_start;
+#if defined(HAVE_LINUX_FIEMAP_H) && defined(FS_IOC_FIEMAP)
+# define DIG_NEXTENTS	256
 
-				clen = (clen / cachesz) * cachesz;
-				(void) posix_fadvise(fd, cache_start, clen, POSIX_FADV_DONTNEED);
-				cache_start = cache_start + clen;
+/*
+ * Walks the extents map, only the written and not shared extents are read.
+ * The unwritten (preallocated) extents are read as zeros without any I/O and
+ * punching shared (reflinked) extents does not free any space, so these are
+ * skipped.
+ *
+ * Returns: 0 on success, -1 if FIEMAP is not supported.
+ */
+static int dig_fiemap(struct dig_ctl *dig, off_t file_off, off_t file_end)
+{
+	struct fiemap *fm;
+	off_t pos = file_off;
+	int last = 0;
+
+	fm = xcalloc(1, sizeof(*fm) + DIG_NEXTENTS * sizeof(struct fiemap_extent));
+
+	while (!last && pos < file_end) {
+		off_t prev = pos;
+		size_t i;
+
+		fm->fm_start = pos;
+		fm->fm_length = file_end - pos;
+		fm->fm_flags = FIEMAP_FLAG_SYNC;
+		fm->fm_extent_count = DIG_NEXTENTS;
+		fm->fm_mapped_extents = 0;
+
+		if (ioctl(dig->fd, FS_IOC_FIEMAP, fm) < 0) {
+			if (pos == file_off && (errno == EOPNOTSUPP || errno == ENOTTY)) {
+				free(fm);
+				return -1;
 			}
-#endif
-			off += rsz;
+			err(EXIT_FAILURE, _("%s: FIEMAP failed"), filename);
 		}
-		if (hole_sz) {
-			xfallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
-					hole_start, hole_sz);
-			ct += hole_sz;
+		if (!fm->fm_mapped_extents)
+			break;
+
+		for (i = 0; i < fm->fm_mapped_extents; i++) {
+			struct fiemap_extent *fe = &fm->fm_extents[i];
+			off_t off = max((off_t) fe->fe_logical, pos);
+			off_t end = min((off_t) (fe->fe_logical + fe->fe_length), file_end);
+
+			if (fe->fe_flags & FIEMAP_EXTENT_LAST)
+				last = 1;
+			if (end <= off)
+				continue;
+
+			dig_progress(dig, off - pos, 0);
+			if (fe->fe_flags & (FIEMAP_EXTENT_UNWRITTEN |
+					    FIEMAP_EXTENT_SHARED |
+					    FIEMAP_EXTENT_DATA_INLINE)) {
+				dig->skipped += end - off;
+				dig_progress(dig, end - off, 0);
+			} else
+				dig_range(dig, off, end);
+			pos = end;
 		}
-		file_off = off;
+		if (pos == prev)
+			break;
 	}
 
-	free(buf);
+	free(fm);
+	return 0;
+}
+#endif /* HAVE_LINUX_FIEMAP_H && FS_IOC_FIEMAP */
+
+static void dig_holes(int fd, off_t file_off, off_t len, int fiemap,
+		      int dry_run)
+{
+	struct dig_ctl dig = { .fd = fd, .last_pct = -1 };
+	off_t file_end = len ? file_off + len : 0;
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+		err(EXIT_FAILURE, _("stat of %s failed"), filename);
+
+	dig.bufsz = st.st_blksize;
+	dig.chunksz = dig.bufsz >= DIG_CHUNKSZ ? dig.bufsz :
+					DIG_CHUNKSZ / dig.bufsz * dig.bufsz;
+	dig.dry_run = dry_run ? 1 : 0;
+	dig.progress = verbose > 1 && isatty(STDOUT_FILENO);
+#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
+	dig.cache_start = file_off;
+#endif
+	if (!file_end || file_end > st.st_size)
+		file_end = st.st_size;
+	if (file_end > file_off)
+		dig.total = file_end - file_off;
+
+	if (lseek(fd, file_off, SEEK_SET) < 0)
+		err(EXIT_FAILURE, _("seek on %s failed"), filename);
+
+	dig.bufs[0] = xmalloc(dig.chunksz);
+	if (ul_uring_init(&dig.ring, 2) == 0)
+		dig.bufs[1] = xmalloc(dig.chunksz);
+
+#if defined(HAVE_LINUX_FIEMAP_H) && defined(FS_IOC_FIEMAP)
+	if (!fiemap || dig_fiemap(&dig, file_off, file_end) != 0)
+#endif
+	{
+		if (fiemap && verbose)
+			warnx(_("%s: extent map is not supported, using SEEK_DATA"),
+					filename);
+		dig_seek_data(&dig, file_off, file_end);
+	}
+
+	if (dig.progress)
+		dig_progress(&dig, dig.total - min(dig.done, dig.total), 1);
+	if (ul_uring_is_ready(&dig.ring))
+		ul_uring_deinit(&dig.ring);
+	free(dig.bufs[0]);
+	free(dig.bufs[1]);
 
 	if (verbose) {
-		char *str = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE, ct);
-		fprintf(stdout, _("%s: %s (%ju bytes) converted to sparse holes.\n"),
-				filename, str, ct);
+		char *str = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE, dig.ct);
+
+		if (dig.dry_run)
+			fprintf(stdout, _("%s: %s (%ju bytes) may be converted to sparse holes.\n"),
+					filename, str, dig.ct);
+		else
+			fprintf(stdout, _("%s: %s (%ju bytes) converted to sparse holes.\n"),
+					filename, str, dig.ct);
 		free(str);
-	}
+
+		if (fiemap) {
+			str = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE, dig.skipped);
+			fprintf(stdout, _("%s: %s (%ju bytes) in unwritten or shared extents skipped.\n"),
+					filename, str, dig.skipped);
+			free(str);
+		}
+	} else if (dig.dry_run)
+		printf("%ju\n", dig.ct);
 }
 
 int main(int argc, char **argv)
@@ -287,10 +516,15 @@ int main(int argc, char **argv)
 	int	fd;
 	int	mode = 0;
 	int	dig = 0;
+	int	fiemap = 0;
+	int	dry_run = 0;
 	int posix = 0;
 	loff_t	length = -2LL;
 	loff_t	offset = 0;
 
+	enum {
+		OPT_DRY_RUN = CHAR_MAX + 1
+	};
 	static const struct option longopts[] = {
 	    { "help",           no_argument,       NULL, 'h' },
 	    { "version",        no_argument,       NULL, 'V' },
@@ -298,6 +532,8 @@ int main(int argc, char **argv)
 	    { "punch-hole",     no_argument,       NULL, 'p' },
 	    { "collapse-range", no_argument,       NULL, 'c' },
 	    { "dig-holes",      no_argument,       NULL, 'd' },
+	    { "sparsify",       no_argument,       NULL, 's' },
+	    { "dry-run",        no_argument,       NULL, OPT_DRY_RUN },
 	    { "insert-range",   no_argument,       NULL, 'i' },
 	    { "zero-range",     no_argument,       NULL, 'z' },
 	    { "offset",         required_argument, NULL, 'o' },
@@ -308,9 +544,9 @@ int main(int argc, char **argv)
 	};
 
 	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
-		{ 'c', 'd', 'p', 'z' },
+		{ 'c', 'd', 'p', 's', 'z' },
 		{ 'c', 'n' },
-		{ 'x', 'c', 'd', 'i', 'n', 'p', 'z'},
+		{ 'x', 'c', 'd', 'i', 'n', 'p', 's', 'z'},
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -320,7 +556,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "hvVncpdizxl:o:", longopts, NULL))
+	while ((c = getopt_long(argc, argv, "hvVncpdiszxl:o:", longopts, NULL))
 			!= -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
@@ -332,6 +568,12 @@ int main(int argc, char **argv)
 		case 'd':
 			dig = 1;
 			break;
+		case 's':
+			dig = fiemap = 1;
+			break;
+		case OPT_DRY_RUN:
+			dry_run = 1;
+			break;
 		case 'i':
 			mode |= FALLOC_FL_INSERT_RANGE;
 			break;
@@ -378,6 +620,8 @@ int main(int argc, char **argv)
 	if (optind != argc)
 		errx(EXIT_FAILURE, _("unexpected number of arguments"));
 
+	if (dry_run && !dig)
+		errx(EXIT_FAILURE, _("--dry-run requires --dig-holes or --sparsify"));
 	if (dig) {
 		/* for --dig-holes the default is analyze all file */
 		if (length == -2LL)
@@ -396,13 +640,13 @@ int main(int argc, char **argv)
 
 	/* O_CREAT makes sense only for the default fallocate(2) behavior
 	 * when mode is no specified and new space is allocated */
-	fd = open(filename, O_RDWR | (!dig && !mode ? O_CREAT : 0),
+	fd = open(filename, (dry_run ? O_RDONLY : O_RDWR) | (!dig && !mode ? O_CREAT : 0),
 		  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
 	if (fd < 0)
 		err(EXIT_FAILURE, _("cannot open %s"), filename);
 
 	if (dig)
-		dig_holes(fd, offset, length);
+		dig_holes(fd, offset, length, fiemap, dry_run);
 #ifdef HAVE_POSIX_FALLOCATE
 	else if (posix)
 		xposix_fallocate(fd, offset, length);
@@ -32,9 +32,12 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
 #include <linux/fs.h>
 
 #include "nls.h"
@@ -43,6 +46,8 @@
 #include "closestream.h"
 #include "pathnames.h"
 #include "sysfs.h"
+#include "xalloc.h"
+#include "monotonic.h"
 
 #include <libmount.h>
 
@@ -56,15 +61,43 @@ struct fstrim_range {
 #define FITRIM		_IOWR('X', 121, struct fstrim_range)
 #endif
 
+/* filesystem to trim by fstrim_all() */
+struct fstrim_job {
+	const char *path;
+	const char *devname;
+	dev_t disk;		/* whole-disk, or 0 if unknown */
+	size_t seq;		/* order in the mount table */
+	int rc;
+};
+
 struct fstrim_control {
 	struct fstrim_range range;
+	uint64_t chunk;			/* bytes per FITRIM, 0 for all at once */
+	uint64_t rate;			/* trimmed bytes per second, 0 for unlimited */
+
+	/* --all jobs, sorted by disk for --parallel */
+	struct fstrim_job *jobs;
+	size_t njobs;
+	size_t next_job;		/* first not started job */
+	pthread_mutex_t lock;
+	size_t nthreads;		/* number of disks trimmed at once */
 
 	unsigned int verbose : 1,
 		     quiet   : 1,
 		     fstab   : 1,
-		     dryrun : 1;
+		     dryrun : 1,
+		     parallel : 1,
+		     progress : 1;
 };
 
+/* set by SIGINT or SIGTERM, checked between the chunks */
+static volatile sig_atomic_t interrupted;
+
+static void sig_handler(int sig __attribute__((__unused__)))
+{
+	interrupted = 1;
+}
+
 static int is_directory(const char *path, int silent)
 {
 	struct stat sb;
@@ -82,6 +115,118 @@ static int is_directory(const char *path, int silent)
 	return 1;
 }
 
+/* returns: 0 = success, 1 = unsupported, < 0 = error */
+static int do_fitrim(const char *path, int fd, struct fstrim_range *range)
+{
+	int rc;
+
+	errno = 0;
+	if (ioctl(fd, FITRIM, range) == 0)
+		return 0;
+
+	switch (errno) {
+	case EBADF:
+	case ENOTTY:
+	case EOPNOTSUPP:
+		rc = 1;
+		break;
+	default:
+		rc = -errno;
+	}
+	if (rc < 0)
+		warn(_("%s: FITRIM ioctl failed"), path);
+	return rc;
+}
+
+static void print_progress(const char *path, uint64_t trimmed,
+			   uint64_t off, uint64_t start, uint64_t end)
+{
+	char *str = size_to_human_string(
+			SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE, trimmed);
+	int pct = end > start ? (off - start) * 100.0 / (end - start) : 100;
+
+	printf(_("%s: %s trimmed, offset %" PRIu64 " (%d%%)\n"),
+		path, str, off, min(pct, 100));
+	free(str);
+}
+
+/*
+ * Splits the range to --chunk pieces and throttles FITRIM calls by --rate.
+ * The end of the range is estimated by the filesystem size, the rest of the
+ * range after the estimate is trimmed by the last FITRIM call.
+ *
+ * Returns the same as do_fitrim(), the range length is updated to the number
+ * of trimmed bytes.
+ */
+static int fstrim_chunks(struct fstrim_control *ctl, const char *path, int fd,
+			 struct fstrim_range *range)
+{
+	uint64_t off = range->start, end, fsend, trimmed = 0;
+	struct timeval begin, last, now;
+	struct statfs sfs;
+	int rc = 0;
+
+	end = range->start + range->len;
+	if (end < range->start)
+		end = ULLONG_MAX;
+	fsend = end;
+	if (fstatfs(fd, &sfs) == 0 && (uint64_t) sfs.f_blocks * sfs.f_bsize < end)
+		fsend = max((uint64_t) sfs.f_blocks * sfs.f_bsize, off);
+
+	gettime_monotonic(&begin);
+	last = begin;
+
+	while (off < end) {
+		struct fstrim_range r = {
+			.start = off,
+			.minlen = range->minlen
+		};
+		int is_last = off >= fsend;
+
+		r.len = is_last ? end - off : min(ctl->chunk, fsend - off);
+		off += r.len;
+
+		rc = do_fitrim(path, fd, &r);
+		if (rc == -EINVAL && is_last && trimmed) {
+			rc = 0;		/* behind the end of the filesystem */
+			break;
+		}
+		if (rc)
+			break;
+		trimmed += r.len;
+		if (is_last)
+			break;
+
+		gettime_monotonic(&now);
+
+		/* reporting progress at most once per second */
+		if (ctl->progress && now.tv_sec > last.tv_sec &&
+		    (now.tv_usec >= last.tv_usec || now.tv_sec > last.tv_sec + 1)) {
+			print_progress(path, trimmed, off, range->start, fsend);
+			last = now;
+		}
+
+		if (ctl->rate) {
+			double elapsed = (now.tv_sec - begin.tv_sec)
+				+ (now.tv_usec - begin.tv_usec) / 1000000.0;
+			double expected = (double) trimmed / ctl->rate;
+
+			if (expected > elapsed)
+				xusleep((expected - elapsed) * 1000000);
+		}
+
+		if (interrupted) {
+			warnx(_("%s: interrupted, resume with --offset %" PRIu64),
+				path, off);
+			rc = -EINTR;
+			break;
+		}
+	}
+
+	range->len = trimmed;
+	return rc;
+}
+
 /* returns: 0 = success, 1 = unsupported, < 0 = error */
 static int fstrim_filesystem(struct fstrim_control *ctl, const char *path, const char *devname)
 {
@@ -113,21 +258,12 @@ static int fstrim_filesystem(struct fstrim_control *ctl, const char *path, const
 		goto done;
 	}
 
-	errno = 0;
-	if (ioctl(fd, FITRIM, &range)) {
-		switch (errno) {
-		case EBADF:
-		case ENOTTY:
-		case EOPNOTSUPP:
-			rc = 1;
-			break;
-		default:
-			rc = -errno;
-		}
-		if (rc < 0)
-			warn(_("%s: FITRIM ioctl failed"), path);
+	if (ctl->chunk)
+		rc = fstrim_chunks(ctl, path, fd, &range);
+	else
+		rc = do_fitrim(path, fd, &range);
+	if (rc)
 		goto done;
-	}
 
 	if (ctl->verbose) {
 		char *str = size_to_human_string(
@@ -153,13 +289,16 @@ done:
 	return rc;
 }
 
-static int has_discard(const char *devname, struct path_cxt **wholedisk)
+static int has_discard(const char *devname, struct path_cxt **wholedisk,
+			dev_t *diskno)
 {
 	struct path_cxt *pc = NULL;
 	uint64_t dg = 0;
 	dev_t disk = 0, dev;
 	int rc = -1, rdonly = 0;
 
+	*diskno = 0;
+
 	dev = sysfs_devname_to_devno(devname);
 	if (!dev)
 		goto fail;
@@ -177,6 +316,7 @@ static int has_discard(const char *devname, struct path_cxt **wholedisk)
 	rc = sysfs_blkdev_get_wholedisk(pc, NULL, 0, &disk);
 	if (rc != 0 || !disk)
 		goto fail;
+	*diskno = disk;
 
 	if (dev != disk) {
 		/* Partition, try reuse whole-disk context if valid for the
@@ -207,6 +347,100 @@ fail:
 }
 
 
+static int cmp_jobs(const void *a, const void *b)
+{
+	const struct fstrim_job *ja = a, *jb = b;
+
+	if (ja->disk != jb->disk)
+		return ja->disk < jb->disk ? -1 : 1;
+	return ja->seq < jb->seq ? -1 : ja->seq > jb->seq ? 1 : 0;
+}
+
+static void run_job(struct fstrim_control *ctl, struct fstrim_job *job)
+{
+	if (interrupted) {
+		job->rc = -EINTR;	/* not started */
+		return;
+	}
+	/*
+	 * We're able to detect that the device supports discard, but
+	 * things also depend on filesystem or device mapping, for
+	 * example LUKS (by default) does not support FSTRIM.
+	 *
+	 * This is reason why we ignore EOPNOTSUPP and ENOTTY errors
+	 * from discard ioctl.
+	 */
+	job->rc = fstrim_filesystem(ctl, job->path, job->devname);
+	if (job->rc == 1 && !ctl->quiet)
+		warnx(_("%s: the discard operation is not supported"), job->path);
+}
+
+/*
+ * Trims all filesystems on one disk, one by one. The jobs are sorted by disk
+ * for --parallel, otherwise all jobs are in one group.
+ */
+static void *jobs_worker(void *data)
+{
+	struct fstrim_control *ctl = data;
+
+	for (;;) {
+		size_t first, last;
+
+		pthread_mutex_lock(&ctl->lock);
+		first = last = ctl->next_job;
+		if (ctl->parallel) {
+			while (last < ctl->njobs
+			       && ctl->jobs[last].disk == ctl->jobs[first].disk)
+				last++;
+		} else
+			last = ctl->njobs;
+		ctl->next_job = last;
+		pthread_mutex_unlock(&ctl->lock);
+
+		if (first == last)
+			break;
+		for (; first < last; first++)
+			run_job(ctl, &ctl->jobs[first]);
+	}
+	return NULL;
+}
+
+static void run_jobs(struct fstrim_control *ctl)
+{
+	pthread_t *threads = NULL;
+	size_t i, nthreads = 1;
+
+	if (ctl->parallel) {
+		size_t ndisks = 0;
+
+		qsort(ctl->jobs, ctl->njobs, sizeof(struct fstrim_job), cmp_jobs);
+		for (i = 0; i < ctl->njobs; i++) {
+			if (i == 0 || ctl->jobs[i].disk != ctl->jobs[i - 1].disk)
+				ndisks++;
+		}
+		nthreads = ctl->nthreads && ctl->nthreads < ndisks ?
+					ctl->nthreads : ndisks;
+	}
+
+	pthread_mutex_init(&ctl->lock, NULL);
+	if (nthreads > 1)
+		threads = xcalloc(nthreads, sizeof(pthread_t));
+
+	for (i = 1; i < nthreads; i++) {
+		int rc = pthread_create(&threads[i], NULL, jobs_worker, ctl);
+		if (rc) {
+			errno = rc;
+			err(MNT_EX_FAIL, _("failed to create thread"));
+		}
+	}
+	jobs_worker(ctl);
+
+	for (i = 1; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	pthread_mutex_destroy(&ctl->lock);
+}
+
 static int uniq_fs_target_cmp(
 		struct libmnt_table *tb __attribute__((__unused__)),
 		struct libmnt_fs *a,
@@ -242,6 +476,7 @@ static int fstrim_all(struct fstrim_control *ctl)
 	struct libmnt_cache *cache = NULL;
 	struct path_cxt *wholedisk = NULL;
 	int cnt = 0, cnt_err = 0;
+	size_t i;
 	const char *filename = _PATH_PROC_MOUNTINFO;
 
 	mnt_init_debug(0);
@@ -317,11 +552,13 @@ static int fstrim_all(struct fstrim_control *ctl)
 
 	mnt_reset_iter(itr, MNT_ITER_BACKWARD);
 
-	/* Do FITRIM */
+	/* Select filesystems to FITRIM */
 	while (mnt_table_next_fs(tab, itr, &fs) == 0) {
 		const char *src = mnt_fs_get_srcpath(fs),
 			   *tgt = mnt_fs_get_target(fs);
+		struct fstrim_job *job;
 		char *path;
+		dev_t disk;
 		int rc = 1;
 
 		/* Is it really accessible mountpoint? Not all mountpoints are
@@ -342,27 +579,30 @@ static int fstrim_all(struct fstrim_control *ctl)
 		}
 
 		if (!is_directory(tgt, 1) ||
-		    !has_discard(src, &wholedisk))
+		    !has_discard(src, &wholedisk, &disk))
 			continue;
-		cnt++;
 
-		/*
-		 * We're able to detect that the device supports discard, but
-		 * things also depend on filesystem or device mapping, for
-		 * example LUKS (by default) does not support FSTRIM.
-		 *
-		 * This is reason why we ignore EOPNOTSUPP and ENOTTY errors
-		 * from discard ioctl.
-		 */
-		rc = fstrim_filesystem(ctl, tgt, src);
-		if (rc < 0)
-		       cnt_err++;
-		else if (rc == 1 && !ctl->quiet)
-			warnx(_("%s: the discard operation is not supported"), tgt);
+		ctl->jobs = xrealloc(ctl->jobs, (ctl->njobs + 1) * sizeof(*job));
+		job = &ctl->jobs[ctl->njobs];
+		job->path = tgt;
+		job->devname = src;
+		job->disk = disk;
+		job->seq = ctl->njobs++;
+		job->rc = 0;
 	}
 	mnt_free_iter(itr);
-
 	ul_unref_path(wholedisk);
+
+	/* Do FITRIM */
+	run_jobs(ctl);
+
+	for (i = 0; i < ctl->njobs; i++) {
+		cnt++;
+		if (ctl->jobs[i].rc < 0)
+			cnt_err++;
+	}
+	free(ctl->jobs);
+
 	mnt_unref_table(tab);
 	mnt_unref_cache(cache);
 
@@ -392,6 +632,11 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -m, --minimum <num> the minimum extent length to discard\n"), out);
 	fputs(_(" -v, --verbose       print number of discarded bytes\n"), out);
 	fputs(_("     --quiet         suppress trim error messages\n"), out);
+	fputs(_("     --chunk <num>   the number of bytes to discard by one request\n"), out);
+	fputs(_("     --rate <num>    the maximum number of discarded bytes per second\n"), out);
+	fputs(_("     --progress      print progress of chunked discard\n"), out);
+	fputs(_("     --parallel[=<num>]\n"
+		"                     trim filesystems on different disks at the same time\n"), out);
 	fputs(_(" -n, --dry-run       does everything, but trim\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -412,7 +657,11 @@ int main(int argc, char **argv)
 			.range = { .len = ULLONG_MAX }
 	};
 	enum {
-		OPT_QUIET = CHAR_MAX + 1
+		OPT_QUIET = CHAR_MAX + 1,
+		OPT_PARALLEL,
+		OPT_CHUNK,
+		OPT_RATE,
+		OPT_PROGRESS
 	};
 
 	static const struct option longopts[] = {
@@ -425,6 +674,10 @@ int main(int argc, char **argv)
 	    { "minimum",   required_argument, NULL, 'm' },
 	    { "verbose",   no_argument,       NULL, 'v' },
 	    { "quiet",     no_argument,       NULL, OPT_QUIET },
+	    { "parallel",  optional_argument, NULL, OPT_PARALLEL },
+	    { "chunk",     required_argument, NULL, OPT_CHUNK },
+	    { "rate",      required_argument, NULL, OPT_RATE },
+	    { "progress",  no_argument,       NULL, OPT_PROGRESS },
 	    { "dry-run",   no_argument,       NULL, 'n' },
 	    { NULL, 0, NULL, 0 }
 	};
@@ -463,6 +716,25 @@ int main(int argc, char **argv)
 		case OPT_QUIET:
 			ctl.quiet = 1;
 			break;
+		case OPT_CHUNK:
+			ctl.chunk = strtosize_or_err(optarg,
+					_("failed to parse chunk size"));
+			if (!ctl.chunk)
+				errx(EXIT_FAILURE, _("invalid chunk size"));
+			break;
+		case OPT_RATE:
+			ctl.rate = strtosize_or_err(optarg,
+					_("failed to parse rate"));
+			break;
+		case OPT_PROGRESS:
+			ctl.progress = 1;
+			break;
+		case OPT_PARALLEL:
+			ctl.parallel = 1;
+			if (optarg)
+				ctl.nthreads = strtou32_or_err(optarg,
+						_("failed to parse number of disks"));
+			break;
 		case 'h':
 			usage();
 		case 'V':
@@ -482,6 +754,20 @@ int main(int argc, char **argv)
 		warnx(_("unexpected number of arguments"));
 		errtryhelp(EXIT_FAILURE);
 	}
+	if (ctl.parallel && !all)
+		errx(EXIT_FAILURE, _("--parallel requires --all or --fstab"));
+
+	/* --rate and --progress need more requests */
+	if (!ctl.chunk && (ctl.rate || ctl.progress))
+		ctl.chunk = 1024 * 1024 * 1024;
+
+	if (ctl.chunk) {
+		struct sigaction sa = { .sa_handler = sig_handler };
+
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+	}
 
 	if (all)
 		return fstrim_all(&ctl);	/* MNT_EX_* codes */
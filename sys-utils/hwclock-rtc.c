@@ -205,6 +205,9 @@ static int do_rtc_read_ioctl(int rtc_fd, struct tm *tm)
  * interrupts are used by the kernel for the system clock, so aren't at
  * the user's disposal.
  */
+/* RTC poll interval if there are no update interrupts */
+#define RTC_POLL_USEC	200
+
 static int busywait_for_rtc_clock_tick(const struct hwclock_control *ctl,
 				       const int rtc_fd)
 {
@@ -227,13 +230,15 @@ static int busywait_for_rtc_clock_tick(const struct hwclock_control *ctl,
 	/*
 	 * Wait for change.  Should be within a second, but in case
 	 * something weird happens, we have a time limit (1.5s) on this loop
-	 * to reduce the impact of this failure.
+	 * to reduce the impact of this failure.  The clock is polled every
+	 * RTC_POLL_USEC rather than in a CPU spin loop.
 	 */
 	gettime_monotonic(&begin);
 	do {
 		rc = do_rtc_read_ioctl(rtc_fd, &nowtime);
 		if (rc || start_time.tm_sec != nowtime.tm_sec)
 			break;
+		xusleep(RTC_POLL_USEC);
 		gettime_monotonic(&now);
 		if (time_diff(now, begin) > 1.5) {
 			warnx(_("Timed out waiting for time change."));
@@ -69,6 +69,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <time.h>
@@ -128,6 +129,12 @@ struct adjtime {
 	 * To which time zone, local or UTC, we most recently set the
 	 * hardware clock.
 	 */
+	/* line 4 */
+	double rtc_delay;
+	/*
+	 * Measured delay between setting the RTC and its next update, or -1
+	 * if not measured yet.
+	 */
 };
 
 static void hwclock_init_debug(const char *str)
@@ -225,6 +232,7 @@ static int read_adjtime(const struct hwclock_control *ctl,
 	char line1[81];		/* String: first line of adjtime file */
 	char line2[81];		/* String: second line of adjtime file */
 	char line3[81];		/* String: third line of adjtime file */
+	char line4[81];		/* String: fourth line of adjtime file */
 
 	if (access(ctl->adj_file_name, R_OK) != 0)
 		return EXIT_SUCCESS;
@@ -241,6 +249,8 @@ static int read_adjtime(const struct hwclock_control *ctl,
 		line2[0] = '\0';	/* In case fgets fails */
 	if (!fgets(line3, sizeof(line3), adjfile))
 		line3[0] = '\0';	/* In case fgets fails */
+	if (!fgets(line4, sizeof(line4), adjfile))
+		line4[0] = '\0';	/* In case fgets fails */
 
 	fclose(adjfile);
 
@@ -263,6 +273,10 @@ static int read_adjtime(const struct hwclock_control *ctl,
 		}
 	}
 
+	if (sscanf(line4, "%lf", &adjtime_p->rtc_delay) != 1
+	    || adjtime_p->rtc_delay < 0 || adjtime_p->rtc_delay >= 1)
+		adjtime_p->rtc_delay = -1.0;
+
 	if (ctl->verbose) {
 		printf(_
 		       ("Last drift adjustment done at %ld seconds after 1969\n"),
@@ -273,6 +287,9 @@ static int read_adjtime(const struct hwclock_control *ctl,
 		       (adjtime_p->local_utc ==
 			LOCAL) ? _("local") : (adjtime_p->local_utc ==
 					       UTC) ? _("UTC") : _("unknown"));
+		if (adjtime_p->rtc_delay >= 0)
+			printf(_("Measured RTC delay is %.6f seconds\n"),
+			       adjtime_p->rtc_delay);
 	}
 
 	return EXIT_SUCCESS;
@@ -456,6 +473,39 @@ unknown:
 	return 0.5;
 }
 
+/*
+ * Measure the delay between setting the Hardware Clock at "settime" and its
+ * next update. The clock updates one second after the set minus the delay,
+ * so the delay is known when we catch the update. The result is cached in
+ * the adjtime file and used by the next set of the clock.
+ */
+static void
+measure_hardware_delay(const struct hwclock_control *ctl,
+		       struct adjtime *adjtime,
+		       const struct timeval settime)
+{
+	struct timeval ticktime;
+	double elapsed;
+
+	if (ur->synchronize_to_clock_tick(ctl))
+		return;
+	gettimeofday(&ticktime, NULL);
+
+	elapsed = time_diff(ticktime, settime);
+	if (elapsed <= 0 || elapsed > 1.1) {
+		if (ctl->verbose)
+			printf(_("RTC update %.6f seconds after set, "
+				 "delay not measured\n"), elapsed);
+		return;
+	}
+	/* the wakeup latency makes the update look a bit late */
+	adjtime->rtc_delay = elapsed < 1 ? 1 - elapsed : 0;
+	adjtime->dirty = 1;
+
+	if (ctl->verbose)
+		printf(_("Measured RTC delay: %.6f seconds\n"),
+		       adjtime->rtc_delay);
+}
 
 /*
  * Set the Hardware Clock to the time "sethwtime", in local time zone or
@@ -478,6 +528,7 @@ unknown:
  */
 static void
 set_hardware_clock_exact(const struct hwclock_control *ctl,
+			 struct adjtime *adjtime,
 			 const time_t sethwtime,
 			 const struct timeval refsystime)
 {
@@ -500,7 +551,8 @@ set_hardware_clock_exact(const struct hwclock_control *ctl,
 	 * then apply sethwtime to the Hardware Clock at refsystime+500ms, so
 	 * that when the Hardware Clock ticks forward to sethwtime+1s half a
 	 * second later at refsystime+1000ms, everything is in sync.  So we
-	 * spin, waiting for gettimeofday() to return a time at or after that
+	 * sleep by clock_nanosleep() to the absolute target time and check
+	 * that gettimeofday() returns a time at or after that
 	 * time (refsystime+500ms) up to a tolerance value, initially 1ms.  If
 	 * we miss that time due to being preempted for some other process,
 	 * then we increase the margin a little bit (initially 1ms, doubling
@@ -513,7 +565,7 @@ set_hardware_clock_exact(const struct hwclock_control *ctl,
 	 * 1:02:03, with reference time (current system time) = 6:07:08.250.
 	 * We want the Hardware Clock to update to 1:02:04 at 6:07:09.250 on
 	 * the system clock, and the first such update will occur 0.500
-	 * seconds after we write to the Hardware Clock, so we spin until the
+	 * seconds after we write to the Hardware Clock, so we sleep until the
 	 * system clock reads 6:07:08.750.  If we get there, great, but let's
 	 * imagine the system is so heavily loaded that our process is
 	 * preempted and by the time we get to run again, the system clock
@@ -524,6 +576,11 @@ set_hardware_clock_exact(const struct hwclock_control *ctl,
 	 * then at 6:07:13.250 (5 seconds after the reference time), the
 	 * Hardware Clock will update to 1:02:08 (5 seconds after the
 	 * originally requested time), and all is well thereafter.
+	 *
+	 * The delay is --delay, or the delay measured by the previous set of
+	 * the clock and cached in the adjtime file, or a guess based on the
+	 * RTC type. If there is nothing cached, the delay is measured after
+	 * the set by waiting for the next RTC update.
 	 */
 
 	time_t newhwtime = sethwtime;
@@ -535,12 +592,22 @@ set_hardware_clock_exact(const struct hwclock_control *ctl,
 	struct timeval targetsystime;
 	struct timeval nowsystime;
 	struct timeval prevsystime = refsystime;
+	struct timespec targetts;
 	double deltavstarget;
+	int measure = 0;
 
 	if (ctl->rtc_delay != -1.0)        /* --delay specified */
 		delay = ctl->rtc_delay;
-	else
+	else if (adjtime->rtc_delay >= 0)  /* measured last time */
+		delay = adjtime->rtc_delay;
+	else {
 		delay = get_hardware_delay(ctl);
+		measure = !ctl->testing && !ctl->noadjfile;
+	}
+#ifdef PR_SET_TIMERSLACK
+	/* the default 50us slack is too much for the wakeup */
+	prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+#endif
 
 	if (ctl->verbose)
 		printf(_("Using delay: %.6f seconds\n"), delay);
@@ -574,7 +641,13 @@ set_hardware_clock_exact(const struct hwclock_control *ctl,
 				     nowsystime.tv_sec, nowsystime.tv_usec,
 				     targetsystime.tv_sec,
 				     targetsystime.tv_usec, deltavstarget));
-			continue;  /* not there yet - keep spinning */
+			/* not there yet - sleep and check again */
+			targetts.tv_sec = targetsystime.tv_sec;
+			targetts.tv_nsec = targetsystime.tv_usec * 1000;
+			while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME,
+					       &targetts, NULL) == EINTR)
+				;
+			continue;
 		} else if (deltavstarget <= target_time_tolerance_secs) {
 			/* Close enough to the target time; done waiting. */
 			break;
@@ -622,6 +695,9 @@ set_hardware_clock_exact(const struct hwclock_control *ctl,
 		       refsystime.tv_sec, refsystime.tv_usec);
 
 	set_hardware_clock(ctl, newhwtime);
+
+	if (measure)
+		measure_hardware_delay(ctl, adjtime, nowsystime);
 }
 
 static int
@@ -865,6 +941,12 @@ static int save_adjtime(const struct hwclock_control *ctl,
 		  adjtime->not_adjusted,
 		  adjtime->last_calib_time,
 		  (adjtime->local_utc == LOCAL) ? "LOCAL" : "UTC");
+	if (adjtime->rtc_delay >= 0) {
+		char *tmp = content;
+
+		xasprintf(&content, "%s%f\n", tmp, adjtime->rtc_delay);
+		free(tmp);
+	}
 
 	if (ctl->verbose){
 		printf(_("New %s data:\n%s"),
@@ -920,7 +1002,7 @@ do_adjustment(const struct hwclock_control *ctl, struct adjtime *adjtime_p,
 			printf(_("Not setting clock because drift factor %f is far too high.\n"),
 				adjtime_p->drift_factor);
 	} else {
-		set_hardware_clock_exact(ctl, hclocktime.tv_sec,
+		set_hardware_clock_exact(ctl, adjtime_p, hclocktime.tv_sec,
 					 time_inc(read_time,
 						  -(hclocktime.tv_usec / 1E6)));
 		adjtime_p->last_adj_time = hclocktime.tv_sec;
@@ -1054,7 +1136,7 @@ manipulate_clock(const struct hwclock_control *ctl, const time_t set_time,
 	if (ctl->show || ctl->get) {
 		return display_time(startup_hclocktime);
 	} else if (ctl->set) {
-		set_hardware_clock_exact(ctl, set_time, startup_time);
+		set_hardware_clock_exact(ctl, adjtime, set_time, startup_time);
 		if (!ctl->noadjfile)
 			adjust_drift_factor(ctl, adjtime, t2tv(set_time),
 					    startup_hclocktime);
@@ -1075,7 +1157,8 @@ manipulate_clock(const struct hwclock_control *ctl, const time_t set_time,
 		gettimeofday(&nowtime, NULL);
 		reftime.tv_sec = nowtime.tv_sec;
 		reftime.tv_usec = 0;
-		set_hardware_clock_exact(ctl, (time_t) reftime.tv_sec, reftime);
+		set_hardware_clock_exact(ctl, adjtime,
+					 (time_t) reftime.tv_sec, reftime);
 		if (!ctl->noadjfile)
 			adjust_drift_factor(ctl, adjtime, nowtime,
 					    hclocktime);
@@ -1173,7 +1256,9 @@ int main(int argc, char **argv)
 			.rtc_delay = -1.0	/* unspecified */
 	};
 	struct timeval startup_time;
-	struct adjtime adjtime = { 0 };
+	struct adjtime adjtime = {
+			.rtc_delay = -1.0	/* not measured */
+	};
 	/*
 	 * The time we started up, in seconds into the epoch, including
 	 * fractions.
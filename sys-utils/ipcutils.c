@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <fcntl.h>
 
 #include "c.h"
 #include "nls.h"
@@ -7,6 +8,7 @@
 #include "pathnames.h"
 #include "ipcutils.h"
 #include "strutils.h"
+#include "linereader.h"
 
 #ifndef SEMVMX
 # define SEMVMX  32767	/* <= 32767 semaphore maximum value */
@@ -15,6 +17,72 @@
 # define SHMMIN 1	/* min shared segment size in bytes */
 #endif
 
+/* max number of columns in /proc/sysvipc/{shm,sem,msg} */
+#define SYSVIPC_MAXFIELDS	16
+
+/*
+ * The /proc/sysvipc tables are huge on systems with many IPC objects, so
+ * the files are read by large blocks (ul_linereader) and the numbers are
+ * parsed without sscanf(). All columns are decimal numbers, except the
+ * "perms" column (the 3rd column) which is octal.
+ *
+ * Returns number of parsed columns.
+ */
+static size_t sysvipc_parse_line(const char *p, size_t len,
+				 uint64_t *vals, size_t nvals)
+{
+	const char *end = p + len;
+	size_t n = 0;
+
+	while (n < nvals) {
+		unsigned int base = n == 2 ? 8 : 10;
+		uint64_t x = 0;
+		int neg = 0;
+
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		if (p < end && *p == '-') {
+			neg = 1;
+			p++;
+		}
+		if (p == end || *p < '0' || *p >= (char) ('0' + base))
+			break;
+		for (; p < end && *p >= '0' && *p < (char) ('0' + base); p++)
+			x = x * base + (*p - '0');
+
+		vals[n++] = neg ? -x : x;
+	}
+	return n;
+}
+
+/*
+ * Opens the table and skips the header line. Returns -1 if the table is
+ * not available.
+ */
+static int sysvipc_open(const char *path, struct ul_linereader *lr)
+{
+	char *line;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	ul_init_linereader(lr, fd);
+	if (ul_linereader_next(lr, &line) <= 0) {
+		ul_free_linereader(lr);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void sysvipc_close(struct ul_linereader *lr, int fd)
+{
+	ul_free_linereader(lr);
+	close(fd);
+}
+
 
 int ipc_msg_get_limits(struct ipc_limits *lim)
 {
@@ -99,47 +167,46 @@ int ipc_shm_get_limits(struct ipc_limits *lim)
 
 int ipc_shm_get_info(int id, struct shm_data **shmds)
 {
-	FILE *f;
-	int i = 0, maxid;
-	char buf[BUFSIZ];
+	struct ul_linereader lr;
+	int i = 0, maxid, fd;
+	char *line;
+	ssize_t sz;
 	struct shm_data *p;
 	struct shmid_ds dummy;
 
 	p = *shmds = xcalloc(1, sizeof(struct shm_data));
 	p->next = NULL;
 
-	f = fopen(_PATH_PROC_SYSV_SHM, "r");
-	if (!f)
+	fd = sysvipc_open(_PATH_PROC_SYSV_SHM, &lr);
+	if (fd < 0)
 		goto shm_fallback;
 
-	while (fgetc(f) != '\n');		/* skip header */
+	while ((sz = ul_linereader_next(&lr, &line)) > 0) {
+		uint64_t v[SYSVIPC_MAXFIELDS];
+		size_t n;
 
-	while (fgets(buf, sizeof(buf), f) != NULL) {
 		/* scan for the first 14-16 columns (e.g. Linux 2.6.32 has 14) */
-		p->shm_rss = 0xdead;
-		p->shm_swp = 0xdead;
-		if (sscanf(buf,
-			  "%d %d  %o %"SCNu64 " %u %u  "
-			  "%"SCNu64 " %u %u %u %u %"SCNi64 " %"SCNi64 " %"SCNi64
-			  " %"SCNu64 " %"SCNu64 "\n",
-			   &p->shm_perm.key,
-			   &p->shm_perm.id,
-			   &p->shm_perm.mode,
-			   &p->shm_segsz,
-			   &p->shm_cprid,
-			   &p->shm_lprid,
-			   &p->shm_nattch,
-			   &p->shm_perm.uid,
-			   &p->shm_perm.gid,
-			   &p->shm_perm.cuid,
-			   &p->shm_perm.cgid,
-			   &p->shm_atim,
-			   &p->shm_dtim,
-			   &p->shm_ctim,
-			   &p->shm_rss,
-			   &p->shm_swp) < 14)
+		n = sysvipc_parse_line(line, sz, v, 16);
+		if (n < 14)
 			continue; /* invalid line, skipped */
 
+		p->shm_perm.key = (key_t) v[0];
+		p->shm_perm.id = (int) v[1];
+		p->shm_perm.mode = (unsigned int) v[2];
+		p->shm_segsz = v[3];
+		p->shm_cprid = (pid_t) v[4];
+		p->shm_lprid = (pid_t) v[5];
+		p->shm_nattch = v[6];
+		p->shm_perm.uid = (uid_t) v[7];
+		p->shm_perm.gid = (gid_t) v[8];
+		p->shm_perm.cuid = (uid_t) v[9];
+		p->shm_perm.cgid = (gid_t) v[10];
+		p->shm_atim = (int64_t) v[11];
+		p->shm_dtim = (int64_t) v[12];
+		p->shm_ctim = (int64_t) v[13];
+		p->shm_rss = n > 14 ? v[14] : 0xdead;
+		p->shm_swp = n > 15 ? v[15] : 0xdead;
+
 		if (id > -1) {
 			/* ID specified */
 			if (id == p->shm_perm.id) {
@@ -157,7 +224,7 @@ int ipc_shm_get_info(int id, struct shm_data **shmds)
 
 	if (i == 0)
 		free(*shmds);
-	fclose(f);
+	sysvipc_close(&lr, fd);
 	return i;
 
 	/* Fallback; /proc or /sys file(s) missing. */
@@ -216,6 +283,8 @@ void ipc_shm_free_info(struct shm_data *shmds)
 
 static void get_sem_elements(struct sem_data *p)
 {
+	union semun arg;
+	unsigned short *vals;
 	size_t i;
 
 	if (!p || !p->sem_nsems || p->sem_perm.id < 0)
@@ -223,13 +292,17 @@ static void get_sem_elements(struct sem_data *p)
 
 	p->elements = xcalloc(p->sem_nsems, sizeof(struct sem_elem));
 
+	/* all values by one call, there is no such call for the counters */
+	vals = xcalloc(p->sem_nsems, sizeof(unsigned short));
+	arg.array = vals;
+	if (semctl(p->sem_perm.id, 0, GETALL, arg) < 0)
+		err(EXIT_FAILURE, _("%s failed"), "semctl(GETALL)");
+
+	arg.val = 0;
 	for (i = 0; i < p->sem_nsems; i++) {
 		struct sem_elem *e = &p->elements[i];
-		union semun arg = { .val = 0 };
 
-		e->semval = semctl(p->sem_perm.id, i, GETVAL, arg);
-		if (e->semval < 0)
-			err(EXIT_FAILURE, _("%s failed"), "semctl(GETVAL)");
+		e->semval = vals[i];
 
 		e->ncount = semctl(p->sem_perm.id, i, GETNCNT, arg);
 		if (e->ncount < 0)
@@ -243,12 +316,15 @@ static void get_sem_elements(struct sem_data *p)
 		if (e->pid < 0)
 			err(EXIT_FAILURE, _("%s failed"), "semctl(GETPID)");
 	}
+	free(vals);
 }
 
 int ipc_sem_get_info(int id, struct sem_data **semds)
 {
-	FILE *f;
-	int i = 0, maxid;
+	struct ul_linereader lr;
+	int i = 0, maxid, fd;
+	char *line;
+	ssize_t sz;
 	struct sem_data *p;
 	struct seminfo dummy;
 	union semun arg;
@@ -256,28 +332,27 @@ int ipc_sem_get_info(int id, struct sem_data **semds)
 	p = *semds = xcalloc(1, sizeof(struct sem_data));
 	p->next = NULL;
 
-	f = fopen(_PATH_PROC_SYSV_SEM, "r");
-	if (!f)
+	fd = sysvipc_open(_PATH_PROC_SYSV_SEM, &lr);
+	if (fd < 0)
 		goto sem_fallback;
 
-	while (fgetc(f) != '\n') ;	/* skip header */
-
-	while (feof(f) == 0) {
-		if (fscanf(f,
-			   "%d %d  %o %" SCNu64 " %u %u %u %u %"
-			    SCNi64 " %" SCNi64 "\n",
-			   &p->sem_perm.key,
-			   &p->sem_perm.id,
-			   &p->sem_perm.mode,
-			   &p->sem_nsems,
-			   &p->sem_perm.uid,
-			   &p->sem_perm.gid,
-			   &p->sem_perm.cuid,
-			   &p->sem_perm.cgid,
-			   &p->sem_otime,
-			   &p->sem_ctime) != 10)
+	while ((sz = ul_linereader_next(&lr, &line)) > 0) {
+		uint64_t v[SYSVIPC_MAXFIELDS];
+
+		if (sysvipc_parse_line(line, sz, v, 10) != 10)
 			continue;
 
+		p->sem_perm.key = (key_t) v[0];
+		p->sem_perm.id = (int) v[1];
+		p->sem_perm.mode = (unsigned int) v[2];
+		p->sem_nsems = v[3];
+		p->sem_perm.uid = (uid_t) v[4];
+		p->sem_perm.gid = (gid_t) v[5];
+		p->sem_perm.cuid = (uid_t) v[6];
+		p->sem_perm.cgid = (gid_t) v[7];
+		p->sem_otime = (int64_t) v[8];
+		p->sem_ctime = (int64_t) v[9];
+
 		if (id > -1) {
 			/* ID specified */
 			if (id == p->sem_perm.id) {
@@ -296,7 +371,7 @@ int ipc_sem_get_info(int id, struct sem_data **semds)
 
 	if (i == 0)
 		free(*semds);
-	fclose(f);
+	sysvipc_close(&lr, fd);
 	return i;
 
 	/* Fallback; /proc or /sys file(s) missing. */
@@ -355,8 +430,10 @@ void ipc_sem_free_info(struct sem_data *semds)
 
 int ipc_msg_get_info(int id, struct msg_data **msgds)
 {
-	FILE *f;
-	int i = 0, maxid;
+	struct ul_linereader lr;
+	int i = 0, maxid, fd;
+	char *line;
+	ssize_t sz;
 	struct msg_data *p;
 	struct msqid_ds dummy;
 	struct msqid_ds msgseg;
@@ -364,32 +441,31 @@ int ipc_msg_get_info(int id, struct msg_data **msgds)
 	p = *msgds = xcalloc(1, sizeof(struct msg_data));
 	p->next = NULL;
 
-	f = fopen(_PATH_PROC_SYSV_MSG, "r");
-	if (!f)
+	fd = sysvipc_open(_PATH_PROC_SYSV_MSG, &lr);
+	if (fd < 0)
 		goto msg_fallback;
 
-	while (fgetc(f) != '\n') ;	/* skip header */
-
-	while (feof(f) == 0) {
-		if (fscanf(f,
-			   "%d %d  %o  %" SCNu64 " %" SCNu64
-			   " %u %u %u %u %u %u %" SCNi64 " %" SCNi64 " %" SCNi64 "\n",
-			   &p->msg_perm.key,
-			   &p->msg_perm.id,
-			   &p->msg_perm.mode,
-			   &p->q_cbytes,
-			   &p->q_qnum,
-			   &p->q_lspid,
-			   &p->q_lrpid,
-			   &p->msg_perm.uid,
-			   &p->msg_perm.gid,
-			   &p->msg_perm.cuid,
-			   &p->msg_perm.cgid,
-			   &p->q_stime,
-			   &p->q_rtime,
-			   &p->q_ctime) != 14)
+	while ((sz = ul_linereader_next(&lr, &line)) > 0) {
+		uint64_t v[SYSVIPC_MAXFIELDS];
+
+		if (sysvipc_parse_line(line, sz, v, 14) != 14)
 			continue;
 
+		p->msg_perm.key = (key_t) v[0];
+		p->msg_perm.id = (int) v[1];
+		p->msg_perm.mode = (unsigned int) v[2];
+		p->q_cbytes = v[3];
+		p->q_qnum = v[4];
+		p->q_lspid = (pid_t) v[5];
+		p->q_lrpid = (pid_t) v[6];
+		p->msg_perm.uid = (uid_t) v[7];
+		p->msg_perm.gid = (gid_t) v[8];
+		p->msg_perm.cuid = (uid_t) v[9];
+		p->msg_perm.cgid = (gid_t) v[10];
+		p->q_stime = (int64_t) v[11];
+		p->q_rtime = (int64_t) v[12];
+		p->q_ctime = (int64_t) v[13];
+
 		if (id > -1) {
 			/* ID specified */
 			if (id == p->msg_perm.id) {
@@ -409,7 +485,7 @@ int ipc_msg_get_info(int id, struct msg_data **msgds)
 
 	if (i == 0)
 		free(*msgds);
-	fclose(f);
+	sysvipc_close(&lr, fd);
 	return i;
 
 	/* Fallback; /proc or /sys file(s) missing. */
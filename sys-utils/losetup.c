@@ -26,6 +26,7 @@
 #include "xalloc.h"
 #include "canonicalize.h"
 #include "pathnames.h"
+#include "ranges.h"
 
 enum {
 	A_CREATE = 1,		/* setup a new device */
@@ -59,6 +60,9 @@ static int no_headings;
 static int raw;
 static int json;
 
+#define LOSETUP_LIST_THREADS	8	/* max number of threads */
+#define LOSETUP_LIST_PERTHREAD	64	/* min number of devices per thread */
+
 struct colinfo {
 	const char *name;
 	double whint;
@@ -224,88 +228,139 @@ static int delete_all_loops(struct loopdev_cxt *lc)
 	return res;
 }
 
-static int set_scols_data(struct loopdev_cxt *lc, struct libscols_line *ln)
+/* returns allocated string for the column @id */
+static char *get_column_data(struct loopdev_cxt *lc, int id)
+{
+	const char *p = NULL;
+	char *np = NULL;
+	uint64_t x = 0;
+
+	switch (id) {
+	case COL_NAME:
+		p = loopcxt_get_device(lc);
+		break;
+	case COL_BACK_FILE:
+		np = loopcxt_get_backing_file(lc);
+		break;
+	case COL_OFFSET:
+		if (loopcxt_get_offset(lc, &x) == 0)
+			xasprintf(&np, "%jd", x);
+		break;
+	case COL_SIZELIMIT:
+		if (loopcxt_get_sizelimit(lc, &x) == 0)
+			xasprintf(&np, "%jd", x);
+		break;
+	case COL_BACK_MAJMIN:
+	{
+		dev_t dev = 0;
+		if (loopcxt_get_backing_devno(lc, &dev) == 0 && dev)
+			xasprintf(&np, "%8u:%-3u", major(dev), minor(dev));
+		break;
+	}
+	case COL_MAJMIN:
+	{
+		struct stat st;
+
+		if (loopcxt_get_device(lc)
+		    && stat(loopcxt_get_device(lc), &st) == 0
+		    && S_ISBLK(st.st_mode)
+		    && major(st.st_rdev) == LOOPDEV_MAJOR)
+			xasprintf(&np, "%3u:%-3u", major(st.st_rdev),
+					           minor(st.st_rdev));
+		break;
+	}
+	case COL_BACK_INO:
+	{
+		ino_t ino = 0;
+		if (loopcxt_get_backing_inode(lc, &ino) == 0 && ino)
+			xasprintf(&np, "%ju", ino);
+		break;
+	}
+	case COL_AUTOCLR:
+		p = loopcxt_is_autoclear(lc) ? "1" : "0";
+		break;
+	case COL_RO:
+		p = loopcxt_is_readonly(lc) ? "1" : "0";
+		break;
+	case COL_DIO:
+		p = loopcxt_is_dio(lc) ? "1" : "0";
+		break;
+	case COL_PARTSCAN:
+		p = loopcxt_is_partscan(lc) ? "1" : "0";
+		break;
+	case COL_LOGSEC:
+		if (loopcxt_get_blocksize(lc, &x) == 0)
+			xasprintf(&np, "%jd", x);
+		break;
+	}
+
+	return p ? xstrdup(p) : np;
+}
+
+/* reads all columns for the current device to @data[ncolumns] */
+static void get_device_data(struct loopdev_cxt *lc, char **data)
 {
 	size_t i;
 
-	for (i = 0; i < ncolumns; i++) {
-		const char *p = NULL;			/* external data */
-		char *np = NULL;			/* allocated here */
-		uint64_t x = 0;
-		int rc = 0;
-
-		switch(get_column_id(i)) {
-		case COL_NAME:
-			p = loopcxt_get_device(lc);
-			break;
-		case COL_BACK_FILE:
-			p = loopcxt_get_backing_file(lc);
-			break;
-		case COL_OFFSET:
-			if (loopcxt_get_offset(lc, &x) == 0)
-				xasprintf(&np, "%jd", x);
-			break;
-		case COL_SIZELIMIT:
-			if (loopcxt_get_sizelimit(lc, &x) == 0)
-				xasprintf(&np, "%jd", x);
-			break;
-		case COL_BACK_MAJMIN:
-		{
-			dev_t dev = 0;
-			if (loopcxt_get_backing_devno(lc, &dev) == 0 && dev)
-				xasprintf(&np, "%8u:%-3u", major(dev), minor(dev));
-			break;
-		}
-		case COL_MAJMIN:
-		{
-			struct stat st;
-
-			if (loopcxt_get_device(lc)
-			    && stat(loopcxt_get_device(lc), &st) == 0
-			    && S_ISBLK(st.st_mode)
-			    && major(st.st_rdev) == LOOPDEV_MAJOR)
-				xasprintf(&np, "%3u:%-3u", major(st.st_rdev),
-						           minor(st.st_rdev));
-			break;
-		}
-		case COL_BACK_INO:
-		{
-			ino_t ino = 0;
-			if (loopcxt_get_backing_inode(lc, &ino) == 0 && ino)
-				xasprintf(&np, "%ju", ino);
-			break;
-		}
-		case COL_AUTOCLR:
-			p = loopcxt_is_autoclear(lc) ? "1" : "0";
-			break;
-		case COL_RO:
-			p = loopcxt_is_readonly(lc) ? "1" : "0";
-			break;
-		case COL_DIO:
-			p = loopcxt_is_dio(lc) ? "1" : "0";
-			break;
-		case COL_PARTSCAN:
-			p = loopcxt_is_partscan(lc) ? "1" : "0";
-			break;
-		case COL_LOGSEC:
-			if (loopcxt_get_blocksize(lc, &x) == 0)
-				xasprintf(&np, "%jd", x);
-			break;
-		default:
-			return -EINVAL;
-		}
+	/* all sysfs attributes by one call */
+	loopcxt_read_attrs(lc);
+
+	for (i = 0; i < ncolumns; i++)
+		data[i] = get_column_data(lc, get_column_id(i));
+}
 
+static void add_scols_line(struct libscols_table *tb, char **data)
+{
+	struct libscols_line *ln;
+	size_t i;
 
-		if (p)
-			rc = scols_line_set_data(ln, i, p);	/* calls strdup() */
-		else if (np)
-			rc = scols_line_refer_data(ln, i, np);	/* only refers */
+	ln = scols_table_new_line(tb, NULL);
+	if (!ln)
+		err(EXIT_FAILURE, _("failed to allocate output line"));
 
-		if (rc)
+	for (i = 0; i < ncolumns; i++) {
+		if (data[i] && scols_line_refer_data(ln, i, data[i]))
 			err(EXIT_FAILURE, _("failed to add output data"));
 	}
+}
 
-	return 0;
+/* the listed devices and ncolumns items of data for every device */
+struct list_data {
+	char		**devices;
+	char		**data;
+};
+
+static void list_range(void *data, size_t range __attribute__((__unused__)),
+		       size_t first, size_t last)
+{
+	struct list_data *ld = data;
+	struct loopdev_cxt lc;
+	size_t i;
+
+	if (loopcxt_init(&lc, 0))
+		err(EXIT_FAILURE, _("failed to initialize loopcxt"));
+
+	for (i = first; i < last; i++) {
+		if (loopcxt_set_device(&lc, ld->devices[i]))
+			err(EXIT_FAILURE, _("%s: failed to use device"),
+					ld->devices[i]);
+		get_device_data(&lc, &ld->data[i * ncolumns]);
+	}
+
+	loopcxt_deinit(&lc);
+}
+
+/*
+ * Reads columns for all @devices. The devices are independent, so many devices
+ * are read by more threads, every thread reads continuous range of the
+ * devices. The output order is not affected.
+ */
+static void list_devices(char **devices, size_t ndevices, char **data)
+{
+	struct list_data ld = { .devices = devices, .data = data };
+
+	ul_run_ranges(ndevices, LOSETUP_LIST_PERTHREAD, LOSETUP_LIST_THREADS,
+		      list_range, &ld);
 }
 
 static int show_table(struct loopdev_cxt *lc,
@@ -315,7 +370,7 @@ static int show_table(struct loopdev_cxt *lc,
 {
 	struct stat sbuf, *st = &sbuf;
 	struct libscols_table *tb;
-	struct libscols_line *ln;
+	char **data;
 	int rc = 0;
 	size_t i;
 
@@ -343,14 +398,15 @@ static int show_table(struct loopdev_cxt *lc,
 
 	/* only one loopdev requested (already assigned to loopdev_cxt) */
 	if (loopcxt_get_device(lc)) {
-		ln = scols_table_new_line(tb, NULL);
-		if (!ln)
-			err(EXIT_FAILURE, _("failed to allocate output line"));
-		rc = set_scols_data(lc, ln);
+		data = xcalloc(ncolumns, sizeof(char *));
+		get_device_data(lc, data);
+		add_scols_line(tb, data);
+		free(data);
 
 	/* list all loopdevs */
 	} else {
-		char *cn_file = NULL;
+		char *cn_file = NULL, **devices = NULL;
+		size_t ndevices = 0, nalloc = 0;
 
 		rc = loopcxt_init_iterator(lc, LOOPITER_FL_USED);
 		if (rc)
@@ -371,17 +427,25 @@ static int show_table(struct loopdev_cxt *lc,
 				if (!used)
 					continue;
 			}
-
-			ln = scols_table_new_line(tb, NULL);
-			if (!ln)
-				err(EXIT_FAILURE, _("failed to allocate output line"));
-			rc = set_scols_data(lc, ln);
-			if (rc)
-				break;
+			if (ndevices == nalloc) {
+				nalloc = nalloc ? nalloc * 2 : 64;
+				devices = xrealloc(devices, nalloc * sizeof(char *));
+			}
+			devices[ndevices++] = xstrdup(loopcxt_get_device(lc));
 		}
 
 		loopcxt_deinit_iterator(lc);
 		free(cn_file);
+
+		data = xcalloc(ndevices * ncolumns + 1, sizeof(char *));
+		list_devices(devices, ndevices, data);
+
+		for (i = 0; i < ndevices; i++) {
+			add_scols_line(tb, &data[i * ncolumns]);
+			free(devices[i]);
+		}
+		free(devices);
+		free(data);
 	}
 done:
 	if (rc == 0)
@@ -477,6 +541,7 @@ static int create_loop(struct loopdev_cxt *lc,
 {
 	int hasdev = loopcxt_has_device(lc);
 	int rc = 0;
+	unsigned int attempt = 0;
 
 	/* losetup --find --noverlap file.img */
 	if (!hasdev && nooverlap) {
@@ -572,8 +637,10 @@ static int create_loop(struct loopdev_cxt *lc,
 		rc = loopcxt_setup_device(lc);
 		if (rc == 0)
 			break;			/* success */
-		if (errno == EBUSY && !hasdev)
+		if (errno == EBUSY && !hasdev) {
+			loopcxt_busy_backoff(lc, attempt++);
 			continue;
+		}
 
 		/* errors */
 		errpre = hasdev && loopcxt_get_fd(lc) < 0 ?
@@ -0,0 +1,217 @@
+/*
+ * lscpu --snapshot
+ *
+ * Copies the /sys and /proc files used by lscpu to a directory. The layout is
+ * the same as for the regression tests dumps (see tests/ts/lscpu/mk-input.sh),
+ * so the snapshot is usable by "lscpu --sysroot <dir>" on any machine and
+ * the snapshots from different machines are possible to compare by diff(1).
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "c.h"
+#include "nls.h"
+#include "xalloc.h"
+#include "all-io.h"
+#include "fileutils.h"
+#include "strutils.h"
+#include "closestream.h"
+
+#include "lscpu.h"
+
+/* single files, all optional */
+static const char *snapshot_files[] = {
+	"/proc/cpuinfo",
+	"/proc/sysinfo",
+	"/proc/bus/pci/devices",
+	"/proc/xen/capabilities",
+	"/proc/sys/kernel/osrelease",
+	"/proc/device-tree/compatible",
+	"/proc/device-tree/ibm,partition-name",
+	"/proc/device-tree/hmc-managed?",
+	"/proc/device-tree/chosen/qemu,graphic-width",
+	_PATH_SYS_HYP_FEATURES
+};
+
+/* directories copied with all subdirectories */
+static const char *snapshot_dirs[] = {
+	_PATH_SYS_CPU
+};
+
+static void snapshot_mkdir(const char *path)
+{
+	if (mkdir_p(path, 0755) != 0)
+		err(EXIT_FAILURE, _("cannot create directory %s"), path);
+}
+
+/* creates parent directories for @path */
+static void snapshot_mkparent(const char *path)
+{
+	char *dir = xstrdup(path);
+	char *p = strrchr(dir, '/');
+
+	if (p && p != dir) {
+		*p = '\0';
+		snapshot_mkdir(dir);
+	}
+	free(dir);
+}
+
+/*
+ * Many sysfs files are not readable (permissions, unsupported by hardware,
+ * etc.), these files are silently ignored. Returns 0 on success, 1 if the
+ * file has been skipped.
+ */
+static int snapshot_file(const char *src, const char *dst)
+{
+	char buf[BUFSIZ];
+	ssize_t sz;
+	int in, out;
+
+	in = open(src, O_RDONLY | O_CLOEXEC);
+	if (in < 0)
+		return 1;
+
+	sz = read_all(in, buf, sizeof(buf));
+	if (sz < 0) {
+		close(in);
+		return 1;
+	}
+
+	snapshot_mkparent(dst);
+	out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), dst);
+
+	do {
+		if (write_all(out, buf, sz) != 0)
+			err(EXIT_FAILURE, _("write failed: %s"), dst);
+	} while (sz == sizeof(buf) && (sz = read_all(in, buf, sizeof(buf))) > 0);
+
+	close(in);
+	if (close_fd(out) != 0)
+		err(EXIT_FAILURE, _("write failed: %s"), dst);
+	return 0;
+}
+
+static void snapshot_link(const char *src, const char *dst)
+{
+	char link[PATH_MAX];
+	ssize_t sz = readlink(src, link, sizeof(link) - 1);
+
+	if (sz < 0)
+		return;
+	link[sz] = '\0';
+
+	snapshot_mkparent(dst);
+	if (symlink(link, dst) != 0 && errno != EEXIST)
+		err(EXIT_FAILURE, _("cannot create symlink %s"), dst);
+}
+
+/* the symlinks are not followed, the (relative) links are copied */
+static void snapshot_tree(const char *src, const char *dst)
+{
+	struct dirent *d;
+	DIR *dir;
+
+	dir = opendir(src);
+	if (!dir)
+		return;
+
+	snapshot_mkdir(dst);
+
+	while ((d = readdir(dir))) {
+		char *s = NULL, *t = NULL;
+		struct stat st;
+
+		if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+			continue;
+
+		xasprintf(&s, "%s/%s", src, d->d_name);
+		xasprintf(&t, "%s/%s", dst, d->d_name);
+
+		if (lstat(s, &st) == 0) {
+			if (S_ISDIR(st.st_mode))
+				snapshot_tree(s, t);
+			else if (S_ISLNK(st.st_mode))
+				snapshot_link(s, t);
+			else if (S_ISREG(st.st_mode) && (st.st_mode & S_IRUSR))
+				snapshot_file(s, t);
+		}
+		free(s);
+		free(t);
+	}
+	closedir(dir);
+}
+
+/* node<N>/cpumap only, the node directories contain a lot of memory stuff */
+static void snapshot_nodes(const char *prefix, const char *dst)
+{
+	struct dirent *d;
+	char *src = NULL;
+	DIR *dir;
+
+	xasprintf(&src, "%s" _PATH_SYS_NODE, prefix ? prefix : "");
+	dir = opendir(src);
+	if (!dir)
+		goto done;
+
+	while ((d = readdir(dir))) {
+		char *s = NULL, *t = NULL;
+
+		if (strncmp(d->d_name, "node", 4) != 0 || !isdigit_string(d->d_name + 4))
+			continue;
+
+		xasprintf(&s, "%s/%s/cpumap", src, d->d_name);
+		xasprintf(&t, "%s" _PATH_SYS_NODE "/%s/cpumap", dst, d->d_name);
+		snapshot_file(s, t);
+		free(s);
+		free(t);
+	}
+	closedir(dir);
+done:
+	free(src);
+}
+
+/*
+ * Writes snapshot of the system (or of the @prefix sysroot) to @dst
+ * directory.
+ */
+void lscpu_write_snapshot(const char *prefix, const char *dst)
+{
+	size_t i;
+
+	if (!prefix)
+		prefix = "";
+
+	snapshot_mkdir(dst);
+
+	for (i = 0; i < ARRAY_SIZE(snapshot_files); i++) {
+		char *s = NULL, *t = NULL;
+
+		xasprintf(&s, "%s%s", prefix, snapshot_files[i]);
+		xasprintf(&t, "%s%s", dst, snapshot_files[i]);
+		snapshot_file(s, t);
+		free(s);
+		free(t);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(snapshot_dirs); i++) {
+		char *s = NULL, *t = NULL;
+
+		xasprintf(&s, "%s%s", prefix, snapshot_dirs[i]);
+		xasprintf(&t, "%s%s", dst, snapshot_dirs[i]);
+		snapshot_tree(s, t);
+		free(s);
+		free(t);
+	}
+
+	snapshot_nodes(prefix, dst);
+}
@@ -62,17 +62,12 @@
 #include "closestream.h"
 #include "optutils.h"
 #include "fileutils.h"
+#include "ranges.h"
 
 #include "lscpu.h"
 
 #define CACHE_MAX 100
 
-/* /sys paths */
-#define _PATH_SYS_SYSTEM	"/sys/devices/system"
-#define _PATH_SYS_HYP_FEATURES	"/sys/hypervisor/properties/features"
-#define _PATH_SYS_CPU		_PATH_SYS_SYSTEM "/cpu"
-#define _PATH_SYS_NODE		_PATH_SYS_SYSTEM "/node"
-
 /* Xen Domain feature flag used for /sys/hypervisor/properties/features */
 #define XENFEAT_supervisor_mode_kernel		3
 #define XENFEAT_mmu_pt_update_preserve_ad	5
@@ -1075,37 +1070,297 @@ static int add_cpuset_to_array(cpu_set_t **ary, int *items, cpu_set_t *set)
 	return 1;
 }
 
-static void
-read_topology(struct lscpu_desc *desc, int idx)
+/*
+ * The per-CPU sysfs attributes are read by scan_cpus() to struct cpu_scan
+ * (in parallel on large systems, every thread uses its own path handler) and
+ * then applied to the description by read_topology(), read_cache(), etc. in
+ * the CPUs order.
+ *
+ * The masks are kept as strings and the same masks (e.g. shared_cpu_map of
+ * the L3 cache is the same for all CPUs in the socket) are parsed only once.
+ */
+enum {
+	SIB_THREAD = 0,
+	SIB_CORE,
+	SIB_BOOK,
+	SIB_DRAWER,
+	NSIBLINGS
+};
+
+static const char *siblings_names[NSIBLINGS] = {
+	[SIB_THREAD] = "thread_siblings",
+	[SIB_CORE]   = "core_siblings",
+	[SIB_BOOK]   = "book_siblings",
+	[SIB_DRAWER] = "drawer_siblings"
+};
+
+static const char *siblings_ids[NSIBLINGS] = {
+	[SIB_THREAD] = "core_id",
+	[SIB_CORE]   = "physical_package_id",
+	[SIB_BOOK]   = "book_id",
+	[SIB_DRAWER] = "drawer_id"
+};
+
+#define LSCPU_SCAN_THREADS	8	/* max number of threads */
+#define LSCPU_SCAN_PERTHREAD	32	/* min number of CPUs per thread */
+
+struct cpu_scan {
+	char		*siblings[NSIBLINGS];	/* topology masks */
+	int		ids[NSIBLINGS];		/* core, socket, book and drawer ID */
+
+	char		**cachemaps;		/* shared_cpu_map for each cache */
+	char		*hascache;		/* cache index directory exists */
+
+	char		polarization[64];
+	int		address;
+	int		configured;
+	int		maxmhz;
+	int		minmhz;
+
+	unsigned int	scanned : 1,
+			has_topology : 1,
+			has_polarization : 1,
+			has_address : 1,
+			has_configured : 1,
+			has_maxmhz : 1,
+			has_minmhz : 1;
+};
+
+struct cpu_scan_data {
+	struct lscpu_desc	*desc;
+	struct cpu_scan		*scans;
+};
+
+/* set of already used masks, open addressing by mask string */
+struct mask_set {
+	const char	**strs;
+	size_t		size;		/* power of 2 */
+};
+
+static void mask_set_init(struct mask_set *ms, size_t nitems)
+{
+	ms->size = 16;
+	while (ms->size < nitems * 2)
+		ms->size <<= 1;
+	ms->strs = xcalloc(ms->size, sizeof(char *));
+}
+
+static void mask_set_deinit(struct mask_set *ms)
+{
+	free(ms->strs);
+	ms->strs = NULL;
+}
+
+static size_t hash_mask(const char *str)
+{
+	size_t h = 5381;
+
+	while (*str)
+		h = h * 33 + (unsigned char) *str++;
+	return h;
+}
+
+/* returns 1 if @str is a new mask, 0 if already in the set */
+static int mask_set_add(struct mask_set *ms, const char *str)
+{
+	size_t i = hash_mask(str) & (ms->size - 1);
+
+	while (ms->strs[i]) {
+		if (strcmp(ms->strs[i], str) == 0)
+			return 0;
+		i = (i + 1) & (ms->size - 1);
+	}
+	ms->strs[i] = str;
+	return 1;
+}
+
+/* returns parsed mask, or NULL if @str is NULL or the mask already has been used */
+static cpu_set_t *mask_set_parse(struct mask_set *ms, const char *str)
+{
+	cpu_set_t *set;
+	size_t setsize;
+
+	if (!str || !mask_set_add(ms, str))
+		return NULL;
+
+	set = cpuset_alloc(maxcpus, &setsize, NULL);
+	if (!set)
+		err(EXIT_FAILURE, _("failed to allocate cpu set"));
+	if (cpumask_parse(str, set, setsize)) {
+		cpuset_free(set);
+		return NULL;
+	}
+	return set;
+}
+
+static void scan_cpu(struct lscpu_desc *desc, struct path_cxt *pc,
+		     int idx, struct cpu_scan *cs)
 {
-	cpu_set_t *thread_siblings, *core_siblings;
-	cpu_set_t *book_siblings, *drawer_siblings;
-	int coreid, socketid, bookid, drawerid;
 	int i, num = real_cpu_num(desc, idx);
 
-	if (ul_path_accessf(desc->syscpu, F_OK, "cpu%d/topology/thread_siblings", num) != 0)
+	cs->scanned = 1;
+
+	if (ul_path_accessf(pc, F_OK, "cpu%d/topology/thread_siblings", num) == 0) {
+		cs->has_topology = 1;
+		for (i = 0; i < NSIBLINGS; i++) {
+			if (ul_path_readf_string(pc, &cs->siblings[i],
+					"cpu%d/topology/%s", num, siblings_names[i]) <= 0) {
+				free(cs->siblings[i]);
+				cs->siblings[i] = NULL;
+			}
+			if (ul_path_readf_s32(pc, &cs->ids[i],
+					"cpu%d/topology/%s", num, siblings_ids[i]) != 0)
+				cs->ids[i] = -1;
+		}
+	}
+
+	if (desc->ncaches) {
+		cs->cachemaps = xcalloc(desc->ncaches, sizeof(char *));
+		cs->hascache = xcalloc(desc->ncaches, sizeof(char));
+
+		for (i = 0; i < desc->ncaches; i++) {
+			if (ul_path_accessf(pc, F_OK, "cpu%d/cache/index%d", num, i) != 0)
+				continue;
+			cs->hascache[i] = 1;
+			if (ul_path_readf_string(pc, &cs->cachemaps[i],
+					"cpu%d/cache/index%d/shared_cpu_map", num, i) <= 0) {
+				free(cs->cachemaps[i]);
+				cs->cachemaps[i] = NULL;
+			}
+		}
+	}
+
+	if (desc->dispatching >= 0
+	    && ul_path_accessf(pc, F_OK, "cpu%d/polarization", num) == 0) {
+		cs->has_polarization = 1;
+		ul_path_readf_buffer(pc, cs->polarization, sizeof(cs->polarization),
+				"cpu%d/polarization", num);
+	}
+	if (ul_path_accessf(pc, F_OK, "cpu%d/address", num) == 0) {
+		cs->has_address = 1;
+		ul_path_readf_s32(pc, &cs->address, "cpu%d/address", num);
+	}
+	if (ul_path_accessf(pc, F_OK, "cpu%d/configure", num) == 0) {
+		cs->has_configured = 1;
+		ul_path_readf_s32(pc, &cs->configured, "cpu%d/configure", num);
+	}
+	if (ul_path_readf_s32(pc, &cs->maxmhz, "cpu%d/cpufreq/cpuinfo_max_freq", num) == 0)
+		cs->has_maxmhz = 1;
+	if (ul_path_readf_s32(pc, &cs->minmhz, "cpu%d/cpufreq/cpuinfo_min_freq", num) == 0)
+		cs->has_minmhz = 1;
+}
+
+static inline int is_scanned_cpu(struct lscpu_desc *desc, int idx)
+{
+	/* only consider present CPUs */
+	return !desc->present ||
+		CPU_ISSET_S(real_cpu_num(desc, idx), CPU_ALLOC_SIZE(maxcpus), desc->present);
+}
+
+/* the ranges other than the first one are scanned by threads with own handler */
+static void scan_cpus_range(void *data, size_t range, size_t first, size_t last)
+{
+	struct cpu_scan_data *sd = data;
+	struct lscpu_desc *desc = sd->desc;
+	struct path_cxt *pc = desc->syscpu;
+	size_t i;
+
+	if (range) {
+		pc = ul_new_path(_PATH_SYS_CPU);
+		if (!pc)
+			err(EXIT_FAILURE, _("failed to initialize CPUs sysfs handler"));
+		if (desc->prefix)
+			ul_path_set_prefix(pc, desc->prefix);
+	}
+
+	for (i = first; i < last; i++) {
+		if (is_scanned_cpu(desc, i))
+			scan_cpu(desc, pc, i, &sd->scans[i]);
+	}
+
+	if (range)
+		ul_unref_path(pc);
+}
+
+/* the number of caches is the same for all CPUs, use the first present CPU */
+static void count_caches(struct lscpu_desc *desc)
+{
+	int i, num;
+
+	for (i = 0; i < desc->ncpuspos; i++) {
+		if (is_scanned_cpu(desc, i))
+			break;
+	}
+	if (i == desc->ncpuspos)
 		return;
 
-	ul_path_readf_cpuset(desc->syscpu, &thread_siblings, maxcpus,
-					"cpu%d/topology/thread_siblings", num);
-	ul_path_readf_cpuset(desc->syscpu, &core_siblings, maxcpus,
-					"cpu%d/topology/core_siblings", num);
-	ul_path_readf_cpuset(desc->syscpu, &book_siblings, maxcpus,
-					"cpu%d/topology/book_siblings", num);
-	ul_path_readf_cpuset(desc->syscpu, &drawer_siblings, maxcpus,
-					"cpu%d/topology/drawer_siblings", num);
+	num = real_cpu_num(desc, i);
+	while (ul_path_accessf(desc->syscpu, F_OK,
+				"cpu%d/cache/index%d",
+				num, desc->ncaches) == 0)
+		desc->ncaches++;
+
+	if (desc->ncaches)
+		desc->caches = xcalloc(desc->ncaches, sizeof(*desc->caches));
+}
+
+static struct cpu_scan *scan_cpus(struct lscpu_desc *desc)
+{
+	struct cpu_scan_data sd;
+	struct cpu_scan *scans;
+
+	count_caches(desc);
+
+	scans = xcalloc(desc->ncpuspos, sizeof(struct cpu_scan));
+
+	sd.desc = desc;
+	sd.scans = scans;
+	ul_run_ranges(desc->ncpuspos, LSCPU_SCAN_PERTHREAD, LSCPU_SCAN_THREADS,
+		      scan_cpus_range, &sd);
+	return scans;
+}
+
+static void free_scans(struct lscpu_desc *desc, struct cpu_scan *scans)
+{
+	int i, j;
+
+	for (i = 0; i < desc->ncpuspos; i++) {
+		struct cpu_scan *cs = &scans[i];
+
+		for (j = 0; j < NSIBLINGS; j++)
+			free(cs->siblings[j]);
+		if (cs->cachemaps) {
+			for (j = 0; j < desc->ncaches; j++)
+				free(cs->cachemaps[j]);
+			free(cs->cachemaps);
+		}
+		free(cs->hascache);
+	}
+	free(scans);
+}
 
-	if (ul_path_readf_s32(desc->syscpu, &coreid, "cpu%d/topology/core_id", num) != 0)
-		coreid = -1;
+static void
+read_topology(struct lscpu_desc *desc, int idx, struct cpu_scan *cs,
+	      struct mask_set *sets)
+{
+	cpu_set_t *thread_siblings, *core_siblings;
+	cpu_set_t *book_siblings, *drawer_siblings;
+	int coreid, socketid, bookid, drawerid;
+	int i;
 
-	if (ul_path_readf_s32(desc->syscpu, &socketid, "cpu%d/topology/physical_package_id", num) != 0)
-		socketid = -1;
+	if (!cs->has_topology)
+		return;
 
-	if (ul_path_readf_s32(desc->syscpu, &bookid, "cpu%d/topology/book_id", num) != 0)
-		bookid = -1;
+	/* NULL if the same mask has been already used */
+	thread_siblings = mask_set_parse(&sets[SIB_THREAD], cs->siblings[SIB_THREAD]);
+	core_siblings = mask_set_parse(&sets[SIB_CORE], cs->siblings[SIB_CORE]);
+	book_siblings = mask_set_parse(&sets[SIB_BOOK], cs->siblings[SIB_BOOK]);
+	drawer_siblings = mask_set_parse(&sets[SIB_DRAWER], cs->siblings[SIB_DRAWER]);
 
-	if (ul_path_readf_s32(desc->syscpu, &drawerid, "cpu%d/topology/drawer_id", num) != 0)
-		drawerid = -1;
+	coreid = cs->ids[SIB_THREAD];
+	socketid = cs->ids[SIB_CORE];
+	bookid = cs->ids[SIB_BOOK];
+	drawerid = cs->ids[SIB_DRAWER];
 
 	if (!desc->coremaps) {
 		int ndrawers, nbooks, nsockets, ncores, nthreads;
@@ -1160,13 +1415,13 @@ read_topology(struct lscpu_desc *desc, int idx)
 		for (i = 0; i < desc->ncpuspos; i++)
 			desc->coreids[i] = desc->socketids[i] = -1;
 
-		if (book_siblings) {
+		if (cs->siblings[SIB_BOOK]) {
 			desc->bookmaps = xcalloc(desc->ncpuspos, sizeof(cpu_set_t *));
 			desc->bookids = xcalloc(desc->ncpuspos, sizeof(*desc->bookids));
 			for (i = 0; i < desc->ncpuspos; i++)
 				desc->bookids[i] = -1;
 		}
-		if (drawer_siblings) {
+		if (cs->siblings[SIB_DRAWER]) {
 			desc->drawermaps = xcalloc(desc->ncpuspos, sizeof(cpu_set_t *));
 			desc->drawerids = xcalloc(desc->ncpuspos, sizeof(*desc->drawerids));
 			for (i = 0; i < desc->ncpuspos; i++)
@@ -1174,70 +1429,68 @@ read_topology(struct lscpu_desc *desc, int idx)
 		}
 	}
 
-	add_cpuset_to_array(desc->socketmaps, &desc->nsockets, core_siblings);
+	if (core_siblings)
+		add_cpuset_to_array(desc->socketmaps, &desc->nsockets, core_siblings);
 	desc->coreids[idx] = coreid;
-	add_cpuset_to_array(desc->coremaps, &desc->ncores, thread_siblings);
+	if (thread_siblings)
+		add_cpuset_to_array(desc->coremaps, &desc->ncores, thread_siblings);
 	desc->socketids[idx] = socketid;
 
-	if (book_siblings && desc->bookmaps && desc->bookids) {
-		add_cpuset_to_array(desc->bookmaps, &desc->nbooks, book_siblings);
+	if (cs->siblings[SIB_BOOK] && desc->bookmaps && desc->bookids) {
+		if (book_siblings)
+			add_cpuset_to_array(desc->bookmaps, &desc->nbooks, book_siblings);
 		desc->bookids[idx] = bookid;
-	}
-	if (drawer_siblings && desc->drawermaps && desc->drawerids) {
-		add_cpuset_to_array(desc->drawermaps, &desc->ndrawers, drawer_siblings);
+	} else if (book_siblings)
+		cpuset_free(book_siblings);
+
+	if (cs->siblings[SIB_DRAWER] && desc->drawermaps && desc->drawerids) {
+		if (drawer_siblings)
+			add_cpuset_to_array(desc->drawermaps, &desc->ndrawers, drawer_siblings);
 		desc->drawerids[idx] = drawerid;
-	}
+	} else if (drawer_siblings)
+		cpuset_free(drawer_siblings);
 }
 
 static void
-read_polarization(struct lscpu_desc *desc, int idx)
+read_polarization(struct lscpu_desc *desc, int idx, struct cpu_scan *cs)
 {
-	char mode[64];
-	int num = real_cpu_num(desc, idx);
+	const char *mode = cs->polarization;
 
-	if (desc->dispatching < 0)
-		return;
-	if (ul_path_accessf(desc->syscpu, F_OK, "cpu%d/polarization", num) != 0)
+	if (!cs->has_polarization)
 		return;
 	if (!desc->polarization)
 		desc->polarization = xcalloc(desc->ncpuspos, sizeof(int));
 
-	ul_path_readf_buffer(desc->syscpu, mode, sizeof(mode), "cpu%d/polarization", num);
-
-	if (strncmp(mode, "vertical:low", sizeof(mode)) == 0)
+	if (strncmp(mode, "vertical:low", sizeof(cs->polarization)) == 0)
 		desc->polarization[idx] = POLAR_VLOW;
-	else if (strncmp(mode, "vertical:medium", sizeof(mode)) == 0)
+	else if (strncmp(mode, "vertical:medium", sizeof(cs->polarization)) == 0)
 		desc->polarization[idx] = POLAR_VMEDIUM;
-	else if (strncmp(mode, "vertical:high", sizeof(mode)) == 0)
+	else if (strncmp(mode, "vertical:high", sizeof(cs->polarization)) == 0)
 		desc->polarization[idx] = POLAR_VHIGH;
-	else if (strncmp(mode, "horizontal", sizeof(mode)) == 0)
+	else if (strncmp(mode, "horizontal", sizeof(cs->polarization)) == 0)
 		desc->polarization[idx] = POLAR_HORIZONTAL;
 	else
 		desc->polarization[idx] = POLAR_UNKNOWN;
 }
 
 static void
-read_address(struct lscpu_desc *desc, int idx)
+read_address(struct lscpu_desc *desc, int idx, struct cpu_scan *cs)
 {
-	int num = real_cpu_num(desc, idx);
-
-	if (ul_path_accessf(desc->syscpu, F_OK, "cpu%d/address", num) != 0)
+	if (!cs->has_address)
 		return;
 	if (!desc->addresses)
 		desc->addresses = xcalloc(desc->ncpuspos, sizeof(int));
-	ul_path_readf_s32(desc->syscpu, &desc->addresses[idx], "cpu%d/address", num);
+	desc->addresses[idx] = cs->address;
 }
 
 static void
-read_configured(struct lscpu_desc *desc, int idx)
+read_configured(struct lscpu_desc *desc, int idx, struct cpu_scan *cs)
 {
-	int num = real_cpu_num(desc, idx);
-
-	if (ul_path_accessf(desc->syscpu, F_OK, "cpu%d/configure", num) != 0)
+	if (!cs->has_configured)
 		return;
 	if (!desc->configured)
 		desc->configured = xcalloc(desc->ncpuspos, sizeof(int));
-	ul_path_readf_s32(desc->syscpu, &desc->configured[idx], "cpu%d/configure", num);
+	desc->configured[idx] = cs->configured;
 }
 
 /* Read overall maximum frequency of cpu */
@@ -1288,29 +1541,23 @@ cpu_min_mhz(struct lscpu_desc *desc, char *buf, size_t bufsz)
 
 
 static void
-read_max_mhz(struct lscpu_desc *desc, int idx)
+read_max_mhz(struct lscpu_desc *desc, int idx, struct cpu_scan *cs)
 {
-	int num = real_cpu_num(desc, idx);
-	int mhz;
-
-	if (ul_path_readf_s32(desc->syscpu, &mhz, "cpu%d/cpufreq/cpuinfo_max_freq", num) != 0)
+	if (!cs->has_maxmhz)
 		return;
 	if (!desc->maxmhz)
 		desc->maxmhz = xcalloc(desc->ncpuspos, sizeof(char *));
-	xasprintf(&desc->maxmhz[idx], "%.4f", (float) mhz / 1000);
+	xasprintf(&desc->maxmhz[idx], "%.4f", (float) cs->maxmhz / 1000);
 }
 
 static void
-read_min_mhz(struct lscpu_desc *desc, int idx)
+read_min_mhz(struct lscpu_desc *desc, int idx, struct cpu_scan *cs)
 {
-	int num = real_cpu_num(desc, idx);
-	int mhz;
-
-	if (ul_path_readf_s32(desc->syscpu, &mhz, "cpu%d/cpufreq/cpuinfo_min_freq", num) != 0)
+	if (!cs->has_minmhz)
 		return;
 	if (!desc->minmhz)
 		desc->minmhz = xcalloc(desc->ncpuspos, sizeof(char *));
-	xasprintf(&desc->minmhz[idx], "%.4f", (float) mhz / 1000);
+	xasprintf(&desc->minmhz[idx], "%.4f", (float) cs->minmhz / 1000);
 }
 
 static int
@@ -1323,28 +1570,18 @@ cachecmp(const void *a, const void *b)
 }
 
 static void
-read_cache(struct lscpu_desc *desc, int idx)
+read_cache(struct lscpu_desc *desc, int idx, struct cpu_scan *cs,
+	   struct mask_set *sets)
 {
 	char buf[256];
 	int i;
 	int num = real_cpu_num(desc, idx);
 
-	if (!desc->ncaches) {
-		while (ul_path_accessf(desc->syscpu, F_OK,
-					"cpu%d/cache/index%d",
-					num, desc->ncaches) == 0)
-			desc->ncaches++;
-
-		if (!desc->ncaches)
-			return;
-		desc->caches = xcalloc(desc->ncaches, sizeof(*desc->caches));
-	}
 	for (i = 0; i < desc->ncaches; i++) {
 		struct cpu_cache *ca = &desc->caches[i];
 		cpu_set_t *map;
 
-		if (ul_path_accessf(desc->syscpu, F_OK,
-					"cpu%d/cache/index%d", num, i) != 0)
+		if (!cs->hascache || !cs->hascache[i])
 			continue;
 		if (!ca->name) {
 			int type = 0;
@@ -1391,13 +1628,51 @@ read_cache(struct lscpu_desc *desc, int idx)
 		}
 
 		/* information about how CPUs share different caches */
-		ul_path_readf_cpuset(desc->syscpu, &map, maxcpus,
-				  "cpu%d/cache/index%d/shared_cpu_map", num, i);
-
 		if (!ca->sharedmaps)
 			ca->sharedmaps = xcalloc(desc->ncpuspos, sizeof(cpu_set_t *));
-		add_cpuset_to_array(ca->sharedmaps, &ca->nsharedmaps, map);
+
+		map = mask_set_parse(&sets[i], cs->cachemaps[i]);
+		if (map)
+			add_cpuset_to_array(ca->sharedmaps, &ca->nsharedmaps, map);
+	}
+}
+
+static void read_cpus(struct lscpu_desc *desc)
+{
+	struct mask_set topo[NSIBLINGS], *caches = NULL;
+	struct cpu_scan *scans;
+	int i;
+
+	scans = scan_cpus(desc);
+
+	for (i = 0; i < NSIBLINGS; i++)
+		mask_set_init(&topo[i], desc->ncpuspos);
+	if (desc->ncaches) {
+		caches = xcalloc(desc->ncaches, sizeof(struct mask_set));
+		for (i = 0; i < desc->ncaches; i++)
+			mask_set_init(&caches[i], desc->ncpuspos);
 	}
+
+	for (i = 0; i < desc->ncpuspos; i++) {
+		struct cpu_scan *cs = &scans[i];
+
+		if (!cs->scanned)
+			continue;
+		read_topology(desc, i, cs, topo);
+		read_cache(desc, i, cs, caches);
+		read_polarization(desc, i, cs);
+		read_address(desc, i, cs);
+		read_configured(desc, i, cs);
+		read_max_mhz(desc, i, cs);
+		read_min_mhz(desc, i, cs);
+	}
+
+	for (i = 0; i < NSIBLINGS; i++)
+		mask_set_deinit(&topo[i]);
+	for (i = 0; i < desc->ncaches; i++)
+		mask_set_deinit(&caches[i]);
+	free(caches);
+	free_scans(desc, scans);
 }
 
 static inline int is_node_dirent(struct dirent *d)
@@ -2056,7 +2331,7 @@ print_summary(struct lscpu_desc *desc, struct lscpu_modifier *mod)
 		 */
 		set = cpuset_alloc(maxcpus, NULL, NULL);
 		if (!set)
-			err(EXIT_FAILURE, _("failed to callocate cpu set"));
+			err(EXIT_FAILURE, _("failed to allocate cpu set"));
 		CPU_ZERO_S(setsize, set);
 		for (i = 0; i < desc->ncpuspos; i++) {
 			int cpu = real_cpu_num(desc, i);
@@ -2246,6 +2521,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -e, --extended[=<list>] print out an extended readable format\n"), out);
 	fputs(_(" -p, --parse[=<list>]    print out a parsable format\n"), out);
 	fputs(_(" -s, --sysroot <dir>     use specified directory as system root\n"), out);
+	fputs(_("     --snapshot <dir>    copy the system data to directory for --sysroot\n"), out);
 	fputs(_(" -x, --hex               print hexadecimal masks rather than lists of CPUs\n"), out);
 	fputs(_(" -y, --physical          print physical instead of logical IDs\n"), out);
 	fputs(_("     --output-all        print all available columns for -e, -p or -C\n"), out);
@@ -2269,13 +2545,14 @@ int main(int argc, char *argv[])
 {
 	struct lscpu_modifier _mod = { .mode = OUTPUT_SUMMARY }, *mod = &_mod;
 	struct lscpu_desc _desc = { .flags = NULL }, *desc = &_desc;
-	int c, i, all = 0;
+	int c, all = 0;
+	const char *snapshot = NULL;
 	int columns[ARRAY_SIZE(coldescs_cpu)], ncolumns = 0;
 	int cpu_modifier_specified = 0;
-	size_t setsize;
 
 	enum {
 		OPT_OUTPUT_ALL = CHAR_MAX + 1,
+		OPT_SNAPSHOT
 	};
 	static const struct option longopts[] = {
 		{ "all",        no_argument,       NULL, 'a' },
@@ -2292,6 +2569,7 @@ int main(int argc, char *argv[])
 		{ "hex",	no_argument,	   NULL, 'x' },
 		{ "version",	no_argument,	   NULL, 'V' },
 		{ "output-all",	no_argument,	   NULL, OPT_OUTPUT_ALL },
+		{ "snapshot",	required_argument, NULL, OPT_SNAPSHOT },
 		{ NULL,		0, NULL, 0 }
 	};
 
@@ -2368,6 +2646,9 @@ int main(int argc, char *argv[])
 		case OPT_OUTPUT_ALL:
 			all = 1;
 			break;
+		case OPT_SNAPSHOT:
+			snapshot = optarg;
+			break;
 
 		case 'h':
 			usage();
@@ -2400,6 +2681,11 @@ int main(int argc, char *argv[])
 		errtryhelp(EXIT_FAILURE);
 	}
 
+	if (snapshot) {
+		lscpu_write_snapshot(desc->prefix, snapshot);
+		return EXIT_SUCCESS;
+	}
+
 	/* set default cpu display mode if none was specified */
 	if (!mod->online && !mod->offline) {
 		mod->online = 1;
@@ -2424,21 +2710,7 @@ int main(int argc, char *argv[])
 
 	read_basicinfo(desc, mod);
 
-	setsize = CPU_ALLOC_SIZE(maxcpus);
-
-	for (i = 0; i < desc->ncpuspos; i++) {
-		/* only consider present CPUs */
-		if (desc->present &&
-		    !CPU_ISSET_S(real_cpu_num(desc, i), setsize, desc->present))
-			continue;
-		read_topology(desc, i);
-		read_cache(desc, i);
-		read_polarization(desc, i);
-		read_address(desc, i);
-		read_configured(desc, i);
-		read_max_mhz(desc, i);
-		read_min_mhz(desc, i);
-	}
+	read_cpus(desc);
 
 	if (desc->caches)
 		qsort(desc->caches, desc->ncaches,
@@ -208,7 +208,14 @@ struct lscpu_modifier {
 			physical:1;	/* use physical numbers */
 };
 
+/* /sys paths */
+#define _PATH_SYS_SYSTEM	"/sys/devices/system"
+#define _PATH_SYS_HYP_FEATURES	"/sys/hypervisor/properties/features"
+#define _PATH_SYS_CPU		_PATH_SYS_SYSTEM "/cpu"
+#define _PATH_SYS_NODE		_PATH_SYS_SYSTEM "/node"
+
 extern int read_hypervisor_dmi(void);
+extern void lscpu_write_snapshot(const char *prefix, const char *dir);
 extern void arm_cpu_decode(struct lscpu_desc *desc);
 
 #endif /* LSCPU_H */
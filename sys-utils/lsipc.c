@@ -40,6 +40,7 @@
 #include "procutils.h"
 #include "ipcutils.h"
 #include "timeutils.h"
+#include "idcache.h"
 
 /*
  * time modes
@@ -246,20 +247,72 @@ static const struct lsipc_coldesc *get_column_desc(int num)
 	return &coldescs[ get_column_id(num) ];
 }
 
-static char *get_username(struct passwd **pw, uid_t id)
+static struct idcache *ucache, *gcache;
+
+static char *get_username(uid_t id)
+{
+	struct identry *ent;
+
+	add_uid(ucache, id);
+	ent = get_id(ucache, id);
+
+	return ent && ent->name ? xstrdup(ent->name) : NULL;
+}
+
+static char *get_groupname(gid_t id)
 {
-	if (!*pw || (*pw)->pw_uid != id)
-		*pw = getpwuid(id);
+	struct identry *ent;
+
+	add_gid(gcache, id);
+	ent = get_id(gcache, id);
 
-	return *pw ? xstrdup((*pw)->pw_name) : NULL;
+	return ent && ent->name ? xstrdup(ent->name) : NULL;
 }
 
-static char *get_groupname(struct group **gr, gid_t id)
+static int has_names_column(void)
 {
-	if (!*gr || (*gr)->gr_gid != id)
-		*gr = getgrgid(id);
+	size_t n;
+
+	for (n = 0; n < ncolumns; n++) {
+		switch (get_column_id(n)) {
+		case COL_OWNER:
+		case COL_CUSER:
+		case COL_CGROUP:
+		case COL_USER:
+		case COL_GROUP:
+			return 1;
+		}
+	}
+	return 0;
+}
 
-	return *gr ? xstrdup((*gr)->gr_name) : NULL;
+/* all owners of the IPC objects, to resolve the names at once */
+struct ipc_ids {
+	unsigned long int	*uids;
+	unsigned long int	*gids;
+	size_t			nids;
+	size_t			nalloc;
+};
+
+static void add_ipc_ids(struct ipc_ids *ids, struct ipc_stat *st)
+{
+	if (ids->nids + 2 > ids->nalloc) {
+		ids->nalloc = ids->nalloc ? ids->nalloc * 2 : 256;
+		ids->uids = xrealloc(ids->uids, ids->nalloc * sizeof(unsigned long int));
+		ids->gids = xrealloc(ids->gids, ids->nalloc * sizeof(unsigned long int));
+	}
+	ids->uids[ids->nids] = st->uid;
+	ids->gids[ids->nids++] = st->gid;
+	ids->uids[ids->nids] = st->cuid;
+	ids->gids[ids->nids++] = st->cgid;
+}
+
+static void resolve_ipc_ids(struct ipc_ids *ids)
+{
+	add_uids(ucache, ids->uids, ids->nids);
+	add_gids(gcache, ids->gids, ids->nids);
+	free(ids->uids);
+	free(ids->gids);
 }
 
 static int parse_time_mode(const char *s)
@@ -440,6 +493,7 @@ static int print_table(struct lsipc_control *ctl, struct libscols_table *tb)
 	return 0;
 }
 static struct timeval now;
+static struct ul_timecache tcache;
 
 static char *make_time(int mode, time_t time)
 {
@@ -451,17 +505,17 @@ static char *make_time(int mode, time_t time)
 		struct tm tm;
 		char *s;
 
-		localtime_r(&time, &tm);
+		ul_timecache_tm(&tcache, time, 0, &tm);
 		asctime_r(&tm, buf);
 		if (*(s = buf + strlen(buf) - 1) == '\n')
 			*s = '\0';
 		break;
 	}
 	case TIME_SHORT:
-		strtime_short(&time, &now, 0, buf, sizeof(buf));
+		strtime_short_cached(&tcache, &time, &now, 0, buf, sizeof(buf));
 		break;
 	case TIME_ISO:
-		strtime_iso(&time, ISO_TIMESTAMP_T, buf, sizeof(buf));
+		strtime_iso_cached(&tcache, &time, ISO_TIMESTAMP_T, buf, sizeof(buf));
 		break;
 	default:
 		errx(EXIT_FAILURE, _("unsupported time type"));
@@ -535,8 +589,6 @@ static void setup_sem_elements_columns(struct libscols_table *tb)
 static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 {
 	struct libscols_line *ln;
-	struct passwd *pw = NULL, *cpw = NULL;
-	struct group *gr = NULL, *cgr = NULL;
 	struct sem_data *semds, *semdsp;
 	char *arg = NULL;
 
@@ -547,6 +599,14 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 			warnx(_("id %d not found"), id);
 		return;
 	}
+	if (id < 0 && has_names_column()) {
+		struct ipc_ids ids = { .nids = 0 };
+		struct sem_data *p;
+
+		for (p = semds; p->next != NULL; p = p->next)
+			add_ipc_ids(&ids, &p->sem_perm);
+		resolve_ipc_ids(&ids);
+	}
 	for (semdsp = semds;  semdsp->next != NULL || id > -1; semdsp = semdsp->next) {
 		size_t n;
 
@@ -566,7 +626,7 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_OWNER:
-				arg = get_username(&pw, semdsp->sem_perm.uid);
+				arg = get_username(semdsp->sem_perm.uid);
 				if (!arg)
 					xasprintf(&arg, "%u", semdsp->sem_perm.uid);
 				rc = scols_line_refer_data(ln, n, arg);
@@ -585,7 +645,7 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CUSER:
-				arg = get_username(&cpw, semdsp->sem_perm.cuid);
+				arg = get_username(semdsp->sem_perm.cuid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -594,7 +654,7 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CGROUP:
-				arg = get_groupname(&cgr, semdsp->sem_perm.cgid);
+				arg = get_groupname(semdsp->sem_perm.cgid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -603,7 +663,7 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_USER:
-				arg = get_username(&pw, semdsp->sem_perm.uid);
+				arg = get_username(semdsp->sem_perm.uid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -612,7 +672,7 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_GROUP:
-				arg = get_groupname(&gr, semdsp->sem_perm.gid);
+				arg = get_groupname(semdsp->sem_perm.gid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -729,8 +789,6 @@ static void do_sem_global(struct libscols_table *tb)
 static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 {
 	struct libscols_line *ln;
-	struct passwd *pw = NULL;
-	struct group *gr = NULL;
 	struct msg_data *msgds, *msgdsp;
 	char *arg = NULL;
 
@@ -739,6 +797,14 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 			warnx(_("id %d not found"), id);
 		return;
 	}
+	if (id < 0 && has_names_column()) {
+		struct ipc_ids ids = { .nids = 0 };
+		struct msg_data *p;
+
+		for (p = msgds; p->next != NULL; p = p->next)
+			add_ipc_ids(&ids, &p->msg_perm);
+		resolve_ipc_ids(&ids);
+	}
 	scols_table_set_name(tb, "messages");
 
 	for (msgdsp = msgds; msgdsp->next != NULL || id > -1 ; msgdsp = msgdsp->next) {
@@ -748,14 +814,6 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 		if (!ln)
 			err(EXIT_FAILURE, _("failed to allocate output line"));
 
-		/* no need to call getpwuid() for the same user */
-		if (!(pw && pw->pw_uid == msgdsp->msg_perm.uid))
-			pw = getpwuid(msgdsp->msg_perm.uid);
-
-		/* no need to call getgrgid() for the same user */
-		if (!(gr && gr->gr_gid == msgdsp->msg_perm.gid))
-			gr = getgrgid(msgdsp->msg_perm.gid);
-
 		for (n = 0; n < ncolumns; n++) {
 			int rc = 0;
 
@@ -769,7 +827,7 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_OWNER:
-				arg = get_username(&pw, msgdsp->msg_perm.uid);
+				arg = get_username(msgdsp->msg_perm.uid);
 				if (!arg)
 					xasprintf(&arg, "%u", msgdsp->msg_perm.uid);
 				rc = scols_line_refer_data(ln, n, arg);
@@ -788,7 +846,7 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CUSER:
-				arg = get_username(&pw, msgdsp->msg_perm.cuid);
+				arg = get_username(msgdsp->msg_perm.cuid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -797,7 +855,7 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CGROUP:
-				arg = get_groupname(&gr, msgdsp->msg_perm.cgid);
+				arg = get_groupname(msgdsp->msg_perm.cgid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -806,7 +864,7 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_USER:
-				arg = get_username(&pw, msgdsp->msg_perm.uid);
+				arg = get_username(msgdsp->msg_perm.uid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -815,7 +873,7 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_GROUP:
-				arg = get_groupname(&gr,msgdsp->msg_perm.gid);
+				arg = get_groupname(msgdsp->msg_perm.gid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -889,8 +947,6 @@ static void do_msg_global(struct libscols_table *tb)
 static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 {
 	struct libscols_line *ln;
-	struct passwd *pw = NULL;
-	struct group *gr = NULL;
 	struct shm_data *shmds, *shmdsp;
 	char *arg = NULL;
 
@@ -899,6 +955,14 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 			warnx(_("id %d not found"), id);
 		return;
 	}
+	if (id < 0 && has_names_column()) {
+		struct ipc_ids ids = { .nids = 0 };
+		struct shm_data *p;
+
+		for (p = shmds; p->next != NULL; p = p->next)
+			add_ipc_ids(&ids, &p->shm_perm);
+		resolve_ipc_ids(&ids);
+	}
 
 	scols_table_set_name(tb, "sharedmemory");
 
@@ -922,7 +986,7 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_OWNER:
-				arg = get_username(&pw, shmdsp->shm_perm.uid);
+				arg = get_username(shmdsp->shm_perm.uid);
 				if (!arg)
 					xasprintf(&arg, "%u", shmdsp->shm_perm.uid);
 				rc = scols_line_refer_data(ln, n, arg);
@@ -941,7 +1005,7 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CUSER:
-				arg = get_username(&pw, shmdsp->shm_perm.cuid);
+				arg = get_username(shmdsp->shm_perm.cuid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -950,7 +1014,7 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CGROUP:
-				arg = get_groupname(&gr, shmdsp->shm_perm.cgid);
+				arg = get_groupname(shmdsp->shm_perm.cgid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -959,7 +1023,7 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_USER:
-				arg = get_username(&pw, shmdsp->shm_perm.uid);
+				arg = get_username(shmdsp->shm_perm.uid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -968,7 +1032,7 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_GROUP:
-				arg = get_groupname(&gr, shmdsp->shm_perm.gid);
+				arg = get_groupname(shmdsp->shm_perm.gid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -1306,6 +1370,28 @@ int main(int argc, char *argv[])
 	if (!tb)
 		return EXIT_FAILURE;
 
+	ucache = new_idcache();
+	if (!ucache)
+		err(EXIT_FAILURE, _("failed to allocate UID cache"));
+	gcache = new_idcache();
+	if (!gcache)
+		err(EXIT_FAILURE, _("failed to allocate GID cache"));
+	idcache_set_flags(ucache, IDCACHE_FLAGS_NEGATIVE);
+	idcache_set_flags(gcache, IDCACHE_FLAGS_NEGATIVE);
+
+	/* the column widths don't depend on data for these formats, so
+	 * print the lines immediately rather than keep all IPC objects */
+	switch (ctl->outmode) {
+	case OUT_EXPORT:
+	case OUT_NEWLINE:
+	case OUT_RAW:
+	case OUT_JSON:
+		scols_table_enable_streaming(tb, 1);
+		break;
+	default:
+		break;
+	}
+
 	if (global)
 		scols_table_set_name(tb, "ipclimits");
 
@@ -1331,6 +1417,8 @@ int main(int argc, char *argv[])
 	print_table(ctl, tb);
 
 	scols_unref_table(tb);
+	free_idcache(ucache);
+	free_idcache(gcache);
 	free(ctl);
 
 	return EXIT_SUCCESS;
@@ -34,41 +34,13 @@
 #include <optutils.h>
 #include <libsmartcols.h>
 
-#define _PATH_SYS_MEMORY		"/sys/devices/system/memory"
-
-#define MEMORY_STATE_ONLINE		0
-#define MEMORY_STATE_OFFLINE		1
-#define MEMORY_STATE_GOING_OFFLINE	2
-#define MEMORY_STATE_UNKNOWN		3
-
-enum zone_id {
-	ZONE_DMA = 0,
-	ZONE_DMA32,
-	ZONE_NORMAL,
-	ZONE_HIGHMEM,
-	ZONE_MOVABLE,
-	ZONE_DEVICE,
-	ZONE_NONE,
-	ZONE_UNKNOWN,
-	MAX_NR_ZONES,
-};
-
-struct memory_block {
-	uint64_t	index;
-	uint64_t	count;
-	int		state;
-	int		node;
-	int		nr_zones;
-	int		zones[MAX_NR_ZONES];
-	unsigned int	removable:1;
-};
+#include "memblocks.h"
 
 struct lsmem {
 	struct path_cxt		*sysmem;		/* _PATH_SYS_MEMORY directory handler */
-	struct dirent		**dirs;
-	int			ndirs;
-	struct memory_block	*blocks;
-	int			nblocks;
+	uint64_t		*indexes;		/* sorted memory block numbers */
+	size_t			nindexes;
+	struct memory_scan	scan;
 	uint64_t		block_size;
 	uint64_t		mem_online;
 	uint64_t		mem_offline;
@@ -102,17 +74,6 @@ enum {
 	COL_ZONES,
 };
 
-static char *zone_names[] = {
-	[ZONE_DMA]	= "DMA",
-	[ZONE_DMA32]	= "DMA32",
-	[ZONE_NORMAL]	= "Normal",
-	[ZONE_HIGHMEM]	= "Highmem",
-	[ZONE_MOVABLE]	= "Movable",
-	[ZONE_DEVICE]	= "Device",
-	[ZONE_NONE]	= "None",	/* block contains more than one zone, can't be offlined */
-	[ZONE_UNKNOWN]	= "Unknown",
-};
-
 /* column names */
 struct coldesc {
 	const char	*name;		/* header */
@@ -148,20 +109,6 @@ static inline size_t err_columns_index(size_t arysz, size_t idx)
 	return idx;
 }
 
-/*
- * name must be null-terminated
- */
-static int zone_name_to_id(const char *name)
-{
-	size_t i;
-
-	for (i = 0; i < ARRAY_SIZE(zone_names); i++) {
-		if (!strcasecmp(name, zone_names[i]))
-			return i;
-	}
-	return ZONE_UNKNOWN;
-}
-
 #define add_column(ary, n, id)	\
 		((ary)[ err_columns_index(ARRAY_SIZE(ary), (n)) ] = (id))
 
@@ -285,9 +232,9 @@ static void add_scols_line(struct lsmem *lsmem, struct memory_block *blk)
 				for (j = 0; j < blk->nr_zones; j++) {
 					zone_id = blk->zones[j];
 					if (strlen(valid_zones) +
-					    strlen(zone_names[zone_id]) > BUFSIZ - 2)
+					    strlen(memory_zone_name(zone_id)) > BUFSIZ - 2)
 						break;
-					strcat(valid_zones, zone_names[zone_id]);
+					strcat(valid_zones, memory_zone_name(zone_id));
 					if (j + 1 < blk->nr_zones)
 						strcat(valid_zones, "/");
 				}
@@ -303,10 +250,10 @@ static void add_scols_line(struct lsmem *lsmem, struct memory_block *blk)
 
 static void fill_scols_table(struct lsmem *lsmem)
 {
-	int i;
+	size_t i;
 
-	for (i = 0; i < lsmem->nblocks; i++)
-		add_scols_line(lsmem, &lsmem->blocks[i]);
+	for (i = 0; i < lsmem->scan.nblocks; i++)
+		add_scols_line(lsmem, &lsmem->scan.blocks[i]);
 }
 
 static void print_summary(struct lsmem *lsmem)
@@ -332,81 +279,12 @@ static void print_summary(struct lsmem *lsmem)
 	}
 }
 
-static int memory_block_get_node(struct lsmem *lsmem, char *name)
-{
-	struct dirent *de;
-	DIR *dir;
-	int node;
-
-	dir = ul_path_opendir(lsmem->sysmem, name);
-	if (!dir)
-		err(EXIT_FAILURE, _("Failed to open %s"), name);
-
-	node = -1;
-	while ((de = readdir(dir)) != NULL) {
-		if (strncmp("node", de->d_name, 4))
-			continue;
-		if (!isdigit_string(de->d_name + 4))
-			continue;
-		node = strtol(de->d_name + 4, NULL, 10);
-		break;
-	}
-	closedir(dir);
-	return node;
-}
-
-static void memory_block_read_attrs(struct lsmem *lsmem, char *name,
-				    struct memory_block *blk)
+static int is_mergeable(struct memory_block *curr, struct memory_block *blk,
+			void *data)
 {
-	char *line = NULL;
-	int i, x = 0;
-
-	memset(blk, 0, sizeof(*blk));
-
-	blk->count = 1;
-	blk->state = MEMORY_STATE_UNKNOWN;
-	blk->index = strtoumax(name + 6, NULL, 10); /* get <num> of "memory<num>" */
-
-	if (ul_path_readf_s32(lsmem->sysmem, &x, "%s/removable", name) == 0)
-		blk->removable = x == 1;
-
-	if (ul_path_readf_string(lsmem->sysmem, &line, "%s/state", name) > 0) {
-		if (strcmp(line, "offline") == 0)
-			blk->state = MEMORY_STATE_OFFLINE;
-		else if (strcmp(line, "online") == 0)
-			blk->state = MEMORY_STATE_ONLINE;
-		else if (strcmp(line, "going-offline") == 0)
-			blk->state = MEMORY_STATE_GOING_OFFLINE;
-		free(line);
-	}
-
-	if (lsmem->have_nodes)
-		blk->node = memory_block_get_node(lsmem, name);
-
-	blk->nr_zones = 0;
-	if (lsmem->have_zones &&
-	    ul_path_readf_string(lsmem->sysmem, &line, "%s/valid_zones", name) > 0) {
-
-		char *token = strtok(line, " ");
-
-		for (i = 0; token && i < MAX_NR_ZONES; i++) {
-			blk->zones[i] = zone_name_to_id(token);
-			blk->nr_zones++;
-			token = strtok(NULL, " ");
-		}
-
-		free(line);
-	}
-}
-
-static int is_mergeable(struct lsmem *lsmem, struct memory_block *blk)
-{
-	struct memory_block *curr;
+	struct lsmem *lsmem = data;
 	int i;
 
-	if (!lsmem->nblocks)
-		return 0;
-	curr = &lsmem->blocks[lsmem->nblocks - 1];
 	if (lsmem->list_all)
 		return 0;
 	if (curr->index + curr->count != blk->index)
@@ -433,35 +311,24 @@ static int is_mergeable(struct lsmem *lsmem, struct memory_block *blk)
 
 static void read_info(struct lsmem *lsmem)
 {
-	struct memory_block blk;
 	char buf[128];
-	int i;
 
 	if (ul_path_read_buffer(lsmem->sysmem, buf, sizeof(buf), "block_size_bytes") <= 0)
 		err(EXIT_FAILURE, _("failed to read memory block size"));
 	lsmem->block_size = strtoumax(buf, NULL, 16);
 
-	for (i = 0; i < lsmem->ndirs; i++) {
-		memory_block_read_attrs(lsmem, lsmem->dirs[i]->d_name, &blk);
-		if (blk.state == MEMORY_STATE_ONLINE)
-			lsmem->mem_online += lsmem->block_size;
-		else
-			lsmem->mem_offline += lsmem->block_size;
-		if (is_mergeable(lsmem, &blk)) {
-			lsmem->blocks[lsmem->nblocks - 1].count++;
-			continue;
-		}
-		lsmem->nblocks++;
-		lsmem->blocks = xrealloc(lsmem->blocks, lsmem->nblocks * sizeof(blk));
-		*&lsmem->blocks[lsmem->nblocks - 1] = blk;
-	}
-}
+	/* the blocks are merged to the ranges during the scan */
+	lsmem->scan.indexes = lsmem->indexes;
+	lsmem->scan.nindexes = lsmem->nindexes;
+	lsmem->scan.flags = (lsmem->have_nodes ? MEMORY_READ_NODES : 0)
+			  | (lsmem->have_zones ? MEMORY_READ_ZONES : 0);
+	lsmem->scan.mergeable = is_mergeable;
+	lsmem->scan.data = lsmem;
 
-static int memory_block_filter(const struct dirent *de)
-{
-	if (strncmp("memory", de->d_name, 6))
-		return 0;
-	return isdigit_string(de->d_name + 6);
+	memory_scan_blocks(lsmem->sysmem, &lsmem->scan);
+
+	lsmem->mem_online = lsmem->scan.nonline * lsmem->block_size;
+	lsmem->mem_offline = lsmem->scan.noffline * lsmem->block_size;
 }
 
 static void read_basic_info(struct lsmem *lsmem)
@@ -473,11 +340,11 @@ static void read_basic_info(struct lsmem *lsmem)
 
 	ul_path_get_abspath(lsmem->sysmem, dir, sizeof(dir), NULL);
 
-	lsmem->ndirs = scandir(dir, &lsmem->dirs, memory_block_filter, versionsort);
-	if (lsmem->ndirs <= 0)
+	if (memory_read_indexes(lsmem->sysmem, &lsmem->indexes, &lsmem->nindexes) != 0
+	    || !lsmem->nindexes)
 		err(EXIT_FAILURE, _("Failed to read %s"), dir);
 
-	if (memory_block_get_node(lsmem, lsmem->dirs[0]->d_name) != -1)
+	if (memory_block_get_node(lsmem->sysmem, lsmem->indexes[0]) != -1)
 		lsmem->have_nodes = 1;
 
 	/* The valid_zones sysmem attribute was introduced with kernel 3.18 */
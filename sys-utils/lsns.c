@@ -26,6 +26,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <fcntl.h>
 #include <wchar.h>
 #include <libsmartcols.h>
 #include <libmount.h>
@@ -49,6 +50,8 @@
 #include "strutils.h"
 #include "namespace.h"
 #include "idcache.h"
+#include "all-io.h"
+#include "ranges.h"
 
 #include "debug.h"
 
@@ -62,6 +65,10 @@ UL_DEBUG_DEFINE_MASKNAMES(lsns) = UL_DEBUG_EMPTY_MASKNAMES;
 
 #define LSNS_NETNS_UNUSABLE -2
 
+#define LSNS_HASHSZ_MIN		64
+#define LSNS_SCAN_THREADS	8	/* max number of threads */
+#define LSNS_SCAN_PERTHREAD	1024	/* min number of processes per thread */
+
 #define DBG(m, x)       __UL_DBG(lsns, LSNS_DEBUG_, m, x)
 #define ON_DBG(m, x)    __UL_DBG_CALL(lsns, LSNS_DEBUG_, m, x)
 
@@ -142,6 +149,8 @@ struct lsns_namespace {
 
 	struct list_head namespaces;	/* lsns->processes member */
 	struct list_head processes;	/* head of lsns_process *siblings */
+
+	struct lsns_namespace *hash_next;	/* lsns->ns_hash bucket */
 };
 
 struct lsns_process {
@@ -158,14 +167,29 @@ struct lsns_process {
 
 	struct libscols_line *outline;
 	struct lsns_process *parent;
+	struct lsns_process *hash_next;	/* lsns->proc_hash bucket */
 
 	int netnsid;
+	unsigned int has_uid : 1;
 };
 
+/*
+ * The namespaces are indexed by inode number and processes by PID in two hash
+ * tables, the items are linked by hash_next in the hash buckets.
+ */
 struct lsns {
 	struct list_head processes;
 	struct list_head namespaces;
 
+	struct lsns_namespace **ns_hash;
+	size_t	ns_hashsz;		/* power of 2 */
+	size_t	nnamespaces;
+
+	struct lsns_process **proc_hash;
+	size_t	proc_hashsz;		/* power of 2 */
+
+	int	procfd;			/* /proc directory */
+
 	pid_t	fltr_pid;	/* filter out by PID */
 	ino_t	fltr_ns;	/* filter out by namespace */
 	int	fltr_types[ARRAY_SIZE(ns_names)];
@@ -182,13 +206,17 @@ struct lsns {
 	struct libmnt_table *tab;
 };
 
+/* netnsid by net namespace inode number */
 struct netnsid_cache {
 	ino_t ino;
 	int   id;
-	struct list_head netnsids;
+	pid_t pid;			/* process to open the namespace */
+	struct netnsid_cache *next;	/* hash bucket */
 };
 
-static struct list_head netnsids_cache;
+static struct netnsid_cache **netnsids_hash;
+static size_t netnsids_hashsz;		/* power of 2 */
+static size_t nnetnsids;
 
 static int netlink_fd = -1;
 
@@ -249,12 +277,21 @@ static inline const struct colinfo *get_column_info(unsigned num)
 	return &infos[ get_column_id(num) ];
 }
 
-static int get_ns_ino(int dir, const char *nsname, ino_t *ino)
+static inline size_t lsns_hash(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x;
+}
+
+/* @dir is /proc */
+static int get_ns_ino(int dir, pid_t pid, const char *nsname, ino_t *ino)
 {
 	struct stat st;
-	char path[16];
+	char path[64];
 
-	snprintf(path, sizeof(path), "ns/%s", nsname);
+	snprintf(path, sizeof(path), "%d/ns/%s", (int) pid, nsname);
 
 	if (fstatat(dir, path, &st, 0) != 0)
 		return -errno;
@@ -262,61 +299,77 @@ static int get_ns_ino(int dir, const char *nsname, ino_t *ino)
 	return 0;
 }
 
-static int parse_proc_stat(FILE *fp, pid_t *pid, char *state, pid_t *ppid)
+static int parse_proc_stat(char *line, pid_t *pid, char *state, pid_t *ppid)
 {
-	char *line = NULL, *p;
-	size_t len = 0;
-	int rc;
-
-	if (getline(&line, &len, fp) < 0) {
-		rc = -errno;
-		goto error;
-	}
+	char *p;
 
 	p = strrchr(line, ')');
 	if (p == NULL ||
 	    sscanf(line, "%d (", pid) != 1 ||
-	    sscanf(p, ") %c %d*[^\n]", state, ppid) != 2) {
-		rc = -EINVAL;
-		goto error;
-	}
-	rc = 0;
-
-error:
-	free(line);
-	return rc;
+	    sscanf(p, ") %c %d*[^\n]", state, ppid) != 2)
+		return -EINVAL;
+	return 0;
 }
 
 #ifdef HAVE_LINUX_NET_NAMESPACE_H
-static int netnsid_cache_find(ino_t netino, int *netnsid)
+
+/* max number of RTM_GETNSID requests (and open namespaces) in flight */
+#define LSNS_NETNSID_BATCH	64
+
+static struct netnsid_cache *netnsid_cache_find(ino_t netino)
 {
-	struct list_head *p;
+	struct netnsid_cache *e;
 
-	list_for_each(p, &netnsids_cache) {
-		struct netnsid_cache *e = list_entry(p,
-						     struct netnsid_cache,
-						     netnsids);
-		if (e->ino == netino) {
-			*netnsid = e->id;
-			return 1;
-		}
+	if (!netnsids_hashsz)
+		return NULL;
+
+	e = netnsids_hash[lsns_hash(netino) & (netnsids_hashsz - 1)];
+	for (; e; e = e->next) {
+		if (e->ino == netino)
+			return e;
 	}
+	return NULL;
+}
 
-	return 0;
+static void netnsid_cache_link(struct netnsid_cache *e)
+{
+	size_t n = lsns_hash(e->ino) & (netnsids_hashsz - 1);
+
+	e->next = netnsids_hash[n];
+	netnsids_hash[n] = e;
 }
 
-static void netnsid_cache_add(ino_t netino, int netnsid)
+static struct netnsid_cache *netnsid_cache_add(ino_t netino, int netnsid)
 {
 	struct netnsid_cache *e;
 
+	if (nnetnsids >= netnsids_hashsz) {
+		struct netnsid_cache **old = netnsids_hash;
+		size_t i, oldsz = netnsids_hashsz;
+
+		netnsids_hashsz = oldsz ? oldsz * 2 : LSNS_HASHSZ_MIN;
+		netnsids_hash = xcalloc(netnsids_hashsz, sizeof(*netnsids_hash));
+
+		for (i = 0; i < oldsz; i++) {
+			struct netnsid_cache *next;
+
+			for (e = old[i]; e; e = next) {
+				next = e->next;
+				netnsid_cache_link(e);
+			}
+		}
+		free(old);
+	}
+
 	e = xcalloc(1, sizeof(*e));
 	e->ino = netino;
 	e->id  = netnsid;
-	INIT_LIST_HEAD(&e->netnsids);
-	list_add(&e->netnsids, &netnsids_cache);
+	netnsid_cache_link(e);
+	nnetnsids++;
+	return e;
 }
 
-static int get_netnsid_via_netlink_send_request(int target_fd)
+static int get_netnsid_via_netlink_send_request(int target_fd, uint32_t seq)
 {
 	unsigned char req[NLMSG_SPACE(sizeof(struct rtgenmsg))
 			  + RTA_SPACE(sizeof(int32_t))];
@@ -327,9 +380,11 @@ static int get_netnsid_via_netlink_send_request(int target_fd)
 		(req + NLMSG_SPACE(sizeof(struct rtgenmsg)));
 	int32_t *fd = RTA_DATA(rta);
 
+	memset(req, 0, sizeof(req));
 	nlh->nlmsg_len = sizeof(req);
 	nlh->nlmsg_flags = NLM_F_REQUEST;
 	nlh->nlmsg_type = RTM_GETNSID;
+	nlh->nlmsg_seq = seq;
 	rt->rtgen_family = AF_UNSPEC;
 	rta->rta_type = NETNSA_FD;
 	rta->rta_len = RTA_SPACE(sizeof(int32_t));
@@ -340,120 +395,179 @@ static int get_netnsid_via_netlink_send_request(int target_fd)
 	return 0;
 }
 
-static int get_netnsid_via_netlink_recv_response(int *netnsid)
+/* returns netnsid from RTM_NEWNSID reply */
+static int get_netnsid_from_response(struct nlmsghdr *nlh)
 {
-	unsigned char res[NLMSG_SPACE(sizeof(struct rtgenmsg))
-			  + ((RTA_SPACE(sizeof(int32_t))
-			      < RTA_SPACE(sizeof(struct nlmsgerr)))
-			     ? RTA_SPACE(sizeof(struct nlmsgerr))
-			     : RTA_SPACE(sizeof(int32_t)))];
+	struct rtattr *rta;
 	int rtalen;
-	ssize_t reslen;
 
-	struct nlmsghdr *nlh;
-	struct rtattr *rta;
+	if (nlh->nlmsg_type != RTM_NEWNSID)
+		return LSNS_NETNS_UNUSABLE;
 
-	reslen = recv(netlink_fd, res, sizeof(res), 0);
-	if (reslen < 0)
-		return -1;
+	rtalen = NLMSG_PAYLOAD(nlh, sizeof(struct rtgenmsg));
+	rta = (struct rtattr *)((char *) NLMSG_DATA(nlh)
+				+ NLMSG_ALIGN(sizeof(struct rtgenmsg)));
 
-	nlh = (struct nlmsghdr *)res;
-	if (!(NLMSG_OK(nlh, (size_t)reslen)
-	      && nlh->nlmsg_type == RTM_NEWNSID))
-		return -1;
+	for (; RTA_OK(rta, rtalen); rta = RTA_NEXT(rta, rtalen)) {
+		if (rta->rta_type == NETNSA_NSID)
+			return *(int *)RTA_DATA(rta);
+	}
+	return LSNS_NETNS_UNUSABLE;
+}
 
-	rtalen = NLMSG_PAYLOAD(nlh, sizeof(struct rtgenmsg));
-	rta = (struct rtattr *)(res + NLMSG_SPACE(sizeof(struct rtgenmsg)));
-	if (!(RTA_OK(rta, rtalen)
-	      && rta->rta_type == NETNSA_NSID))
-		return -1;
+/*
+ * Receives replies for @nsent requests, the request sequence number is
+ * position in @batch.
+ */
+static void get_netnsid_via_netlink_recv_responses(struct netnsid_cache **batch,
+						   size_t nbatch, size_t nsent)
+{
+	unsigned char res[8192];
+	size_t nrecv = 0;
 
-	*netnsid = *(int *)RTA_DATA(rta);
+	while (nrecv < nsent) {
+		struct nlmsghdr *nlh;
+		ssize_t reslen;
 
-	return 0;
+		reslen = recv(netlink_fd, res, sizeof(res), 0);
+		if (reslen < 0)
+			return;		/* the rest is unusable */
+
+		nlh = (struct nlmsghdr *) res;
+		for (; NLMSG_OK(nlh, (size_t) reslen); nlh = NLMSG_NEXT(nlh, reslen)) {
+			if (nlh->nlmsg_seq >= nbatch || !batch[nlh->nlmsg_seq])
+				continue;
+			batch[nlh->nlmsg_seq]->id = get_netnsid_from_response(nlh);
+			batch[nlh->nlmsg_seq] = NULL;
+			nrecv++;
+		}
+	}
 }
 
-static int get_netnsid_via_netlink(int dir, const char *path)
+/*
+ * Sends RTM_GETNSID requests for more namespaces at once and then collects
+ * the replies, so there is no round trip per namespace.
+ */
+static void get_netnsids_via_netlink(struct lsns *ls,
+				     struct netnsid_cache **ents, size_t nents)
 {
-	int netnsid;
-	int target_fd;
+	struct netnsid_cache *batch[LSNS_NETNSID_BATCH];
+	int fds[LSNS_NETNSID_BATCH];
+	size_t i, j, n, nsent;
 
-	if (netlink_fd < 0)
-		return LSNS_NETNS_UNUSABLE;
+	for (i = 0; i < nents; i += n) {
+		n = min(nents - i, (size_t) LSNS_NETNSID_BATCH);
+		nsent = 0;
 
-	target_fd = openat(dir, path, O_RDONLY);
-	if (target_fd < 0)
-		return LSNS_NETNS_UNUSABLE;
+		for (j = 0; j < n; j++) {
+			char path[64];
 
-	if (get_netnsid_via_netlink_send_request(target_fd) < 0) {
-		netnsid = LSNS_NETNS_UNUSABLE;
-		goto out;
-	}
+			batch[j] = NULL;
+			snprintf(path, sizeof(path), "%d/ns/net", (int) ents[i + j]->pid);
+			fds[j] = openat(ls->procfd, path, O_RDONLY | O_CLOEXEC);
+			if (fds[j] < 0)
+				continue;
+			if (get_netnsid_via_netlink_send_request(fds[j], j) == 0) {
+				batch[j] = ents[i + j];
+				nsent++;
+			}
+		}
 
-	if (get_netnsid_via_netlink_recv_response(&netnsid) < 0) {
-		netnsid = LSNS_NETNS_UNUSABLE;
-		goto out;
-	}
+		DBG(NS, ul_debug("netnsid: %zu requests sent", nsent));
+		get_netnsid_via_netlink_recv_responses(batch, n, nsent);
 
- out:
-	close(target_fd);
-	return netnsid;
+		for (j = 0; j < n; j++) {
+			if (fds[j] >= 0)
+				close(fds[j]);
+		}
+	}
 }
 
-static int get_netnsid(int dir, ino_t netino)
+static void read_netnsids(struct lsns *ls)
 {
-	int netnsid;
+	struct netnsid_cache **ents = NULL;
+	size_t nents = 0, nalloc = 0;
+	struct list_head *p;
+
+	if (netlink_fd < 0)
+		return;
 
-	if (!netnsid_cache_find(netino, &netnsid)) {
-		netnsid = get_netnsid_via_netlink(dir, "ns/net");
-		netnsid_cache_add(netino, netnsid);
+	/* unique namespaces, the first process is used to open the namespace */
+	list_for_each(p, &ls->processes) {
+		struct lsns_process *proc = list_entry(p, struct lsns_process, processes);
+		ino_t ino = proc->ns_ids[LSNS_ID_NET];
+		struct netnsid_cache *e;
+
+		if (!ino || netnsid_cache_find(ino))
+			continue;
+
+		e = netnsid_cache_add(ino, LSNS_NETNS_UNUSABLE);
+		e->pid = proc->pid;
+
+		if (nents == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			ents = xrealloc(ents, nalloc * sizeof(*ents));
+		}
+		ents[nents++] = e;
 	}
 
-	return netnsid;
+	get_netnsids_via_netlink(ls, ents, nents);
+	free(ents);
+
+	list_for_each(p, &ls->processes) {
+		struct lsns_process *proc = list_entry(p, struct lsns_process, processes);
+		struct netnsid_cache *e = netnsid_cache_find(proc->ns_ids[LSNS_ID_NET]);
+
+		if (e)
+			proc->netnsid = e->id;
+	}
 }
 #else
-static int get_netnsid(int dir __attribute__((__unused__)),
-		       ino_t netino __attribute__((__unused__)))
+static void read_netnsids(struct lsns *ls __attribute__((__unused__)))
 {
-	return LSNS_NETNS_UNUSABLE;
 }
 #endif /* HAVE_LINUX_NET_NAMESPACE_H */
 
-static int read_process(struct lsns *ls, pid_t pid)
+/*
+ * Reads the process by paths relative to /proc, so no directory is opened for
+ * the process. This is called from more threads, don't use any global
+ * resource here.
+ */
+static int read_process(struct lsns *ls, pid_t pid, struct lsns_process **res)
 {
 	struct lsns_process *p = NULL;
-	char buf[BUFSIZ];
-	DIR *dir;
+	char path[64], buf[BUFSIZ];
 	int rc = 0, fd;
-	FILE *f = NULL;
+	ssize_t sz;
 	size_t i;
 	struct stat st;
 
 	DBG(PROC, ul_debug("reading %d", (int) pid));
 
-	snprintf(buf, sizeof(buf), "/proc/%d", pid);
-	dir = opendir(buf);
-	if (!dir)
+	snprintf(path, sizeof(path), "%d", (int) pid);
+	if (fstatat(ls->procfd, path, &st, 0) != 0)
 		return -errno;
 
 	p = xcalloc(1, sizeof(*p));
 	p->netnsid = LSNS_NETNS_UNUSABLE;
+	p->uid = st.st_uid;
+	p->has_uid = 1;
 
-	if (fstat(dirfd(dir), &st) == 0) {
-		p->uid = st.st_uid;
-		add_uid(uid_cache, st.st_uid);
-	}
-
-	fd = openat(dirfd(dir), "stat", O_RDONLY);
+	snprintf(path, sizeof(path), "%d/stat", (int) pid);
+	fd = openat(ls->procfd, path, O_RDONLY | O_CLOEXEC);
 	if (fd < 0) {
 		rc = -errno;
 		goto done;
 	}
-	if (!(f = fdopen(fd, "r"))) {
+	sz = read_all(fd, buf, sizeof(buf) - 1);
+	if (sz < 0)
 		rc = -errno;
+	close(fd);
+	if (sz < 0)
 		goto done;
-	}
-	rc = parse_proc_stat(f, &p->pid, &p->state, &p->ppid);
+	buf[sz] = '\0';
+
+	rc = parse_proc_stat(buf, &p->pid, &p->state, &p->ppid);
 	if (rc < 0)
 		goto done;
 	rc = 0;
@@ -464,76 +578,205 @@ static int read_process(struct lsns *ls, pid_t pid)
 		if (!ls->fltr_types[i])
 			continue;
 
-		rc = get_ns_ino(dirfd(dir), ns_names[i], &p->ns_ids[i]);
+		rc = get_ns_ino(ls->procfd, pid, ns_names[i], &p->ns_ids[i]);
 		if (rc && rc != -EACCES && rc != -ENOENT)
 			goto done;
-		if (i == LSNS_ID_NET)
-			p->netnsid = get_netnsid(dirfd(dir), p->ns_ids[i]);
 		rc = 0;
 	}
 
 	INIT_LIST_HEAD(&p->processes);
-
-	DBG(PROC, ul_debugobj(p, "new pid=%d", p->pid));
-	list_add_tail(&p->processes, &ls->processes);
 done:
-	if (f)
-		fclose(f);
-	closedir(dir);
 	if (rc)
 		free(p);
+	else
+		*res = p;
 	return rc;
 }
 
+/* the scanned processes */
+struct lsns_scan {
+	struct lsns		*ls;
+	const pid_t		*pids;
+	struct lsns_process	**procs;	/* result for every pid */
+	int			*rcs;		/* read_process() return codes */
+};
+
+static void scan_range(void *data, size_t range __attribute__((__unused__)),
+		       size_t first, size_t last)
+{
+	struct lsns_scan *sc = data;
+	size_t i;
+
+	for (i = first; i < last; i++)
+		sc->rcs[i] = read_process(sc->ls, sc->pids[i], &sc->procs[i]);
+}
+
+/*
+ * Reads all processes by more threads, every thread reads continuous range
+ * of the PIDs.
+ */
+static void scan_processes(struct lsns *ls, const pid_t *pids, size_t npids,
+			   struct lsns_process **procs, int *rcs)
+{
+	struct lsns_scan sc = {
+		.ls = ls,
+		.pids = pids,
+		.procs = procs,
+		.rcs = rcs
+	};
+
+	ul_run_ranges(npids, LSNS_SCAN_PERTHREAD, LSNS_SCAN_THREADS,
+		      scan_range, &sc);
+}
+
+static struct lsns_process *get_process(struct lsns *ls, pid_t pid)
+{
+	struct lsns_process *proc;
+
+	if (!ls->proc_hashsz)
+		return NULL;
+
+	proc = ls->proc_hash[lsns_hash(pid) & (ls->proc_hashsz - 1)];
+	for (; proc; proc = proc->hash_next) {
+		if (proc->pid == pid)
+			return proc;
+	}
+	return NULL;
+}
+
+static void add_process(struct lsns *ls, struct lsns_process *proc)
+{
+	size_t n = lsns_hash(proc->pid) & (ls->proc_hashsz - 1);
+
+	DBG(PROC, ul_debugobj(proc, "new pid=%d", proc->pid));
+
+	if (proc->has_uid)
+		add_uid(uid_cache, proc->uid);
+
+	list_add_tail(&proc->processes, &ls->processes);
+
+	proc->hash_next = ls->proc_hash[n];
+	ls->proc_hash[n] = proc;
+}
+
 static int read_processes(struct lsns *ls)
 {
 	struct proc_processes *proc = NULL;
-	pid_t pid;
-	int rc = 0;
+	struct lsns_process **procs = NULL;
+	struct list_head *p;
+	pid_t pid, *pids = NULL;
+	size_t i, npids = 0, nalloc = 0, nuids = 0;
+	unsigned long int *uids;
+	int rc = 0, *rcs = NULL;
 
 	DBG(PROC, ul_debug("opening /proc"));
 
-	if (!(proc = proc_open_processes())) {
+	ls->procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (ls->procfd < 0 || !(proc = proc_open_processes())) {
 		rc = -errno;
 		goto done;
 	}
 
 	while (proc_next_pid(proc, &pid) == 0) {
-		rc = read_process(ls, pid);
+		if (npids == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 1024;
+			pids = xrealloc(pids, nalloc * sizeof(pid_t));
+		}
+		pids[npids++] = pid;
+	}
+
+	procs = xcalloc(npids + 1, sizeof(struct lsns_process *));
+	rcs = xcalloc(npids + 1, sizeof(int));
+	scan_processes(ls, pids, npids, procs, rcs);
+
+	for (ls->proc_hashsz = LSNS_HASHSZ_MIN; ls->proc_hashsz < npids; )
+		ls->proc_hashsz *= 2;
+	ls->proc_hash = xcalloc(ls->proc_hashsz, sizeof(struct lsns_process *));
+
+	/* resolve all the owners at once */
+	uids = xcalloc(npids + 1, sizeof(unsigned long int));
+	for (i = 0; i < npids; i++) {
+		if (!rcs[i] && procs[i]->has_uid)
+			uids[nuids++] = procs[i]->uid;
+	}
+	add_uids(uid_cache, uids, nuids);
+	free(uids);
+
+	for (i = 0; i < npids; i++) {
+		rc = rcs[i];
 		if (rc && rc != -EACCES && rc != -ENOENT)
 			break;
+		if (!rc)
+			add_process(ls, procs[i]);
+		procs[i] = NULL;
 		rc = 0;
 	}
+	for (; i < npids; i++)
+		free(procs[i]);
+
+	/* parent->child relations */
+	list_for_each(p, &ls->processes) {
+		struct lsns_process *xproc = list_entry(p, struct lsns_process, processes);
+
+		xproc->parent = get_process(ls, xproc->ppid);
+		if (xproc->parent == xproc)
+			xproc->parent = NULL;
+	}
+
+	if (ls->fltr_types[LSNS_ID_NET])
+		read_netnsids(ls);
 done:
 	DBG(PROC, ul_debug("closing /proc"));
 	proc_close_processes(proc);
+	free(pids);
+	free(procs);
+	free(rcs);
 	return rc;
 }
 
 static struct lsns_namespace *get_namespace(struct lsns *ls, ino_t ino)
 {
-	struct list_head *p;
+	struct lsns_namespace *ns;
 
-	list_for_each(p, &ls->namespaces) {
-		struct lsns_namespace *ns = list_entry(p, struct lsns_namespace, namespaces);
+	if (!ls->ns_hashsz)
+		return NULL;
 
+	ns = ls->ns_hash[lsns_hash(ino) & (ls->ns_hashsz - 1)];
+	for (; ns; ns = ns->hash_next) {
 		if (ns->id == ino)
 			return ns;
 	}
 	return NULL;
 }
 
-static int namespace_has_process(struct lsns_namespace *ns, pid_t pid)
+static int namespace_has_process(struct lsns *ls, struct lsns_namespace *ns, pid_t pid)
+{
+	struct lsns_process *proc = get_process(ls, pid);
+
+	return proc && proc->ns_ids[ns->type] == ns->id;
+}
+
+static void ns_hash_link(struct lsns *ls, struct lsns_namespace *ns)
+{
+	size_t n = lsns_hash(ns->id) & (ls->ns_hashsz - 1);
+
+	ns->hash_next = ls->ns_hash[n];
+	ls->ns_hash[n] = ns;
+}
+
+static void ns_hash_grow(struct lsns *ls)
 {
 	struct list_head *p;
+	size_t sz = ls->ns_hashsz ? ls->ns_hashsz * 2 : LSNS_HASHSZ_MIN;
 
-	list_for_each(p, &ns->processes) {
-		struct lsns_process *proc = list_entry(p, struct lsns_process, ns_siblings[ns->type]);
+	DBG(NS, ul_debug("resize hash to %zu", sz));
 
-		if (proc->pid == pid)
-			return 1;
-	}
-	return 0;
+	free(ls->ns_hash);
+	ls->ns_hash = xcalloc(sz, sizeof(struct lsns_namespace *));
+	ls->ns_hashsz = sz;
+
+	list_for_each(p, &ls->namespaces)
+		ns_hash_link(ls, list_entry(p, struct lsns_namespace, namespaces));
 }
 
 static struct lsns_namespace *add_namespace(struct lsns *ls, int type, ino_t ino)
@@ -552,25 +795,20 @@ static struct lsns_namespace *add_namespace(struct lsns *ls, int type, ino_t ino
 	ns->id = ino;
 
 	list_add_tail(&ns->namespaces, &ls->namespaces);
+
+	if (ls->nnamespaces >= ls->ns_hashsz)
+		ns_hash_grow(ls);
+	else
+		ns_hash_link(ls, ns);
+	ls->nnamespaces++;
 	return ns;
 }
 
-static int add_process_to_namespace(struct lsns *ls, struct lsns_namespace *ns, struct lsns_process *proc)
+static int add_process_to_namespace(struct lsns_namespace *ns, struct lsns_process *proc)
 {
-	struct list_head *p;
-
 	DBG(NS, ul_debugobj(ns, "add process [%p] pid=%d to %s[%ju]",
 		proc, proc->pid, ns_names[ns->type], (uintmax_t)ns->id));
 
-	list_for_each(p, &ls->processes) {
-		struct lsns_process *xproc = list_entry(p, struct lsns_process, processes);
-
-		if (xproc->pid == proc->ppid)		/* my parent */
-			proc->parent = xproc;
-		else if (xproc->ppid == proc->pid)	/* my child */
-			xproc->parent = proc;
-	}
-
 	list_add_tail(&proc->ns_siblings[ns->type], &ns->processes);
 	ns->nprocs++;
 
@@ -620,7 +858,7 @@ static int read_namespaces(struct lsns *ls)
 				if (!ns)
 					return -ENOMEM;
 			}
-			add_process_to_namespace(ls, ns, proc);
+			add_process_to_namespace(ns, proc);
 		}
 	}
 
@@ -837,7 +1075,7 @@ static int show_namespaces(struct lsns *ls)
 	list_for_each(p, &ls->namespaces) {
 		struct lsns_namespace *ns = list_entry(p, struct lsns_namespace, namespaces);
 
-		if (ls->fltr_pid != 0 && !namespace_has_process(ns, ls->fltr_pid))
+		if (ls->fltr_pid != 0 && !namespace_has_process(ls, ns, ls->fltr_pid))
 			continue;
 
 		add_scols_line(ls, tab, ns, ns->proc);
@@ -964,10 +1202,10 @@ int main(int argc, char *argv[])
 
 	lsns_init_debug();
 	memset(&ls, 0, sizeof(ls));
+	ls.procfd = -1;
 
 	INIT_LIST_HEAD(&ls.processes);
 	INIT_LIST_HEAD(&ls.namespaces);
-	INIT_LIST_HEAD(&netnsids_cache);
 
 	while ((c = getopt_long(argc, argv,
 				"Jlp:o:nruhVt:W", long_opts, NULL)) != -1) {
@@ -1093,6 +1331,8 @@ int main(int argc, char *argv[])
 	}
 
 	mnt_free_table(ls.tab);
+	if (ls.procfd >= 0)
+		close(ls.procfd);
 	if (netlink_fd >= 0)
 		close(netlink_fd);
 	free_idcache(uid_cache);
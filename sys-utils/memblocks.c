@@ -0,0 +1,305 @@
+/*
+ * memblocks.c - memory blocks enumeration, shared by lsmem and chmem
+ *
+ * The huge systems have hundreds of thousands memory blocks. The blocks are
+ * enumerated by one readdir() and sorted by number (no versionsort), all
+ * attributes of the block are read by one ul_path_read_attrs() call, and the
+ * NUMA node is guessed from the previous block, so readdir() of the block
+ * directory is necessary only on node boundaries.
+ *
+ * memory_scan_blocks() reads the blocks by more threads, every thread reads
+ * continuous range of the blocks and immediately merges the blocks to ranges
+ * (by mergeable() callback), the ranges are merged on threads boundaries
+ * after the scan. The per-block data are never kept in memory.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#include "c.h"
+#include "nls.h"
+#include "xalloc.h"
+#include "strutils.h"
+#include "ranges.h"
+
+#include "memblocks.h"
+
+#define MEMORY_SCAN_THREADS	8	/* max number of threads */
+#define MEMORY_SCAN_PERTHREAD	512	/* min number of blocks per thread */
+
+static const char *zone_names[] = {
+	[ZONE_DMA]	= "DMA",
+	[ZONE_DMA32]	= "DMA32",
+	[ZONE_NORMAL]	= "Normal",
+	[ZONE_HIGHMEM]	= "Highmem",
+	[ZONE_MOVABLE]	= "Movable",
+	[ZONE_DEVICE]	= "Device",
+	[ZONE_NONE]	= "None",	/* block contains more than one zone, can't be offlined */
+	[ZONE_UNKNOWN]	= "Unknown",
+};
+
+const char *memory_zone_name(int id)
+{
+	if (id < 0 || (size_t) id >= ARRAY_SIZE(zone_names))
+		return NULL;
+	return zone_names[id];
+}
+
+/*
+ * name must be null-terminated
+ */
+int memory_zone_id(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(zone_names); i++) {
+		if (!strcasecmp(name, zone_names[i]))
+			return i;
+	}
+	return ZONE_UNKNOWN;
+}
+
+static int cmp_indexes(const void *a, const void *b)
+{
+	return cmp_numbers(*(const uint64_t *) a, *(const uint64_t *) b);
+}
+
+/*
+ * Returns sorted numbers of all "memory<N>" directories, or negative number
+ * on error.
+ */
+int memory_read_indexes(struct path_cxt *sysmem, uint64_t **indexes, size_t *nindexes)
+{
+	struct dirent *de;
+	size_t n = 0, nalloc = 0;
+	uint64_t *ary = NULL;
+	DIR *dir;
+
+	dir = ul_path_opendir(sysmem, NULL);
+	if (!dir)
+		return -errno;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (strncmp("memory", de->d_name, 6) != 0
+		    || !isdigit_string(de->d_name + 6))
+			continue;
+		if (n == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 256;
+			ary = xrealloc(ary, nalloc * sizeof(uint64_t));
+		}
+		ary[n++] = strtoumax(de->d_name + 6, NULL, 10);
+	}
+	closedir(dir);
+
+	if (n)
+		qsort(ary, n, sizeof(uint64_t), cmp_indexes);
+	*indexes = ary;
+	*nindexes = n;
+	return 0;
+}
+
+/* returns position of the first block >= @index */
+size_t memory_find_index(const uint64_t *indexes, size_t nindexes, uint64_t index)
+{
+	size_t lo = 0, hi = nindexes;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (indexes[mid] < index)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int get_node(struct path_cxt *sysmem, uint64_t index, int hint)
+{
+	struct dirent *de;
+	DIR *dir;
+	int node;
+
+	/* the continuous blocks usually belong to the same node */
+	if (hint >= 0 && ul_path_accessf(sysmem, F_OK,
+				"memory%"PRIu64"/node%d", index, hint) == 0)
+		return hint;
+
+	dir = ul_path_opendirf(sysmem, "memory%"PRIu64, index);
+	if (!dir)
+		err(EXIT_FAILURE, _("Failed to open memory%"PRIu64), index);
+
+	node = -1;
+	while ((de = readdir(dir)) != NULL) {
+		if (strncmp("node", de->d_name, 4))
+			continue;
+		if (!isdigit_string(de->d_name + 4))
+			continue;
+		node = strtol(de->d_name + 4, NULL, 10);
+		break;
+	}
+	closedir(dir);
+	return node;
+}
+
+int memory_block_get_node(struct path_cxt *sysmem, uint64_t index)
+{
+	return get_node(sysmem, index, -1);
+}
+
+static void read_block(struct path_cxt *sysmem, uint64_t index, int flags,
+		       struct memory_block *blk, int nodehint)
+{
+	char removable[32], state[32], zones[BUFSIZ], name[sizeof("memory") + 20];
+	struct ul_path_attr attrs[] = {
+		{ .name = "removable", .buf = removable, .bufsz = sizeof(removable) },
+		{ .name = "state", .buf = state, .bufsz = sizeof(state) },
+		{ .name = "valid_zones", .buf = zones, .bufsz = sizeof(zones) }
+	};
+
+	memset(blk, 0, sizeof(*blk));
+
+	blk->count = 1;
+	blk->state = MEMORY_STATE_UNKNOWN;
+	blk->index = index;
+
+	/* all attributes by one call, valid_zones only if supported */
+	snprintf(name, sizeof(name), "memory%"PRIu64, index);
+	ul_path_read_attrs(sysmem, name, attrs,
+			   flags & MEMORY_READ_ZONES ? 3 : 2);
+
+	if (attrs[0].rc > 0)
+		blk->removable = strtol(removable, NULL, 10) == 1;
+
+	if (attrs[1].rc > 0) {
+		if (strcmp(state, "offline") == 0)
+			blk->state = MEMORY_STATE_OFFLINE;
+		else if (strcmp(state, "online") == 0)
+			blk->state = MEMORY_STATE_ONLINE;
+		else if (strcmp(state, "going-offline") == 0)
+			blk->state = MEMORY_STATE_GOING_OFFLINE;
+	}
+
+	if (flags & MEMORY_READ_NODES)
+		blk->node = get_node(sysmem, index, nodehint);
+
+	if ((flags & MEMORY_READ_ZONES) && attrs[2].rc > 0) {
+		char *save = NULL, *token = strtok_r(zones, " ", &save);
+
+		while (token && blk->nr_zones < MAX_NR_ZONES) {
+			blk->zones[blk->nr_zones++] = memory_zone_id(token);
+			token = strtok_r(NULL, " ", &save);
+		}
+	}
+}
+
+void memory_block_read(struct path_cxt *sysmem, uint64_t index, int flags,
+		       struct memory_block *blk)
+{
+	read_block(sysmem, index, flags, blk, -1);
+}
+
+/* scan result for continuous range of the blocks */
+struct memory_range_scan {
+	struct memory_scan	*sc;
+	struct path_cxt		*sysmem;	/* used by the current thread */
+
+	struct memory_block	*blocks;
+	size_t			nblocks;
+	size_t			nalloc;
+	uint64_t		nonline;
+	uint64_t		noffline;
+};
+
+static void add_range(struct memory_range_scan *rs, struct memory_block *blk)
+{
+	struct memory_scan *sc = rs->sc;
+
+	if (rs->nblocks && sc->mergeable
+	    && sc->mergeable(&rs->blocks[rs->nblocks - 1], blk, sc->data)) {
+		rs->blocks[rs->nblocks - 1].count += blk->count;
+		return;
+	}
+	if (rs->nblocks == rs->nalloc) {
+		rs->nalloc = rs->nalloc ? rs->nalloc * 2 : 64;
+		rs->blocks = xrealloc(rs->blocks, rs->nalloc * sizeof(*blk));
+	}
+	rs->blocks[rs->nblocks++] = *blk;
+}
+
+/* reads blocks sc->indexes[first..last) to the @range ranges[] item */
+static void scan_range(void *data, size_t range, size_t first, size_t last)
+{
+	struct memory_range_scan *rs = (struct memory_range_scan *) data + range;
+	struct path_cxt *pc = rs->sysmem;
+	struct memory_block blk;
+	int node = -1;
+	size_t i;
+
+	if (range) {
+		/* path_cxt is not thread safe */
+		pc = ul_new_path("%s", ul_path_get_dir(rs->sysmem));
+		if (!pc)
+			err(EXIT_FAILURE, _("failed to initialize %s handler"),
+					ul_path_get_dir(rs->sysmem));
+		if (ul_path_get_prefix(rs->sysmem))
+			ul_path_set_prefix(pc, ul_path_get_prefix(rs->sysmem));
+	}
+
+	for (i = first; i < last; i++) {
+		read_block(pc, rs->sc->indexes[i], rs->sc->flags, &blk, node);
+		if (blk.state == MEMORY_STATE_ONLINE)
+			rs->nonline++;
+		else
+			rs->noffline++;
+		node = blk.node;
+		add_range(rs, &blk);
+	}
+
+	if (range)
+		ul_unref_path(pc);
+}
+
+/*
+ * Reads all sc->indexes blocks and merges them to sc->blocks ranges.
+ */
+void memory_scan_blocks(struct path_cxt *sysmem, struct memory_scan *sc)
+{
+	struct memory_range_scan ranges[MEMORY_SCAN_THREADS];
+	size_t i, j, nranges;
+
+	memory_scan_reset(sc);
+
+	memset(ranges, 0, sizeof(ranges));
+	for (i = 0; i < MEMORY_SCAN_THREADS; i++) {
+		ranges[i].sc = sc;
+		ranges[i].sysmem = sysmem;
+	}
+
+	nranges = ul_run_ranges(sc->nindexes, MEMORY_SCAN_PERTHREAD,
+				MEMORY_SCAN_THREADS, scan_range, ranges);
+
+	/* merge the ranges, ranges[0] is the result */
+	for (i = 1; i < nranges; i++) {
+		for (j = 0; j < ranges[i].nblocks; j++)
+			add_range(&ranges[0], &ranges[i].blocks[j]);
+		ranges[0].nonline += ranges[i].nonline;
+		ranges[0].noffline += ranges[i].noffline;
+		free(ranges[i].blocks);
+	}
+
+	sc->blocks = ranges[0].blocks;
+	sc->nblocks = ranges[0].nblocks;
+	sc->nonline = ranges[0].nonline;
+	sc->noffline = ranges[0].noffline;
+}
+
+void memory_scan_reset(struct memory_scan *sc)
+{
+	free(sc->blocks);
+	sc->blocks = NULL;
+	sc->nblocks = 0;
+	sc->nonline = 0;
+	sc->noffline = 0;
+}
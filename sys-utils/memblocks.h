@@ -0,0 +1,76 @@
+#ifndef UTIL_LINUX_MEMBLOCKS_H
+#define UTIL_LINUX_MEMBLOCKS_H
+
+#include <stdint.h>
+
+#include "path.h"
+
+#define _PATH_SYS_MEMORY		"/sys/devices/system/memory"
+
+#define MEMORY_STATE_ONLINE		0
+#define MEMORY_STATE_OFFLINE		1
+#define MEMORY_STATE_GOING_OFFLINE	2
+#define MEMORY_STATE_UNKNOWN		3
+
+enum zone_id {
+	ZONE_DMA = 0,
+	ZONE_DMA32,
+	ZONE_NORMAL,
+	ZONE_HIGHMEM,
+	ZONE_MOVABLE,
+	ZONE_DEVICE,
+	ZONE_NONE,
+	ZONE_UNKNOWN,
+	MAX_NR_ZONES,
+};
+
+struct memory_block {
+	uint64_t	index;
+	uint64_t	count;
+	int		state;
+	int		node;
+	int		nr_zones;
+	int		zones[MAX_NR_ZONES];
+	unsigned int	removable:1;
+};
+
+/* memory_block_read() and memory_scan flags */
+#define MEMORY_READ_NODES	(1 << 0)	/* read NUMA node */
+#define MEMORY_READ_ZONES	(1 << 1)	/* read valid_zones */
+
+/*
+ * Returns 1 if @blk (one block or already merged range) directly follows
+ * @curr and should be merged to @curr.
+ */
+typedef int (*memory_mergeable_t)(struct memory_block *curr,
+				  struct memory_block *blk, void *data);
+
+struct memory_scan {
+	const uint64_t		*indexes;	/* sorted block numbers */
+	size_t			nindexes;
+	int			flags;		/* MEMORY_READ_* */
+
+	memory_mergeable_t	mergeable;	/* NULL: don't merge */
+	void			*data;		/* mergeable() data */
+
+	/* results */
+	struct memory_block	*blocks;
+	size_t			nblocks;
+	uint64_t		nonline;	/* number of online blocks */
+	uint64_t		noffline;	/* number of not online blocks */
+};
+
+extern const char *memory_zone_name(int id);
+extern int memory_zone_id(const char *name);
+
+extern int memory_read_indexes(struct path_cxt *sysmem, uint64_t **indexes, size_t *nindexes);
+extern size_t memory_find_index(const uint64_t *indexes, size_t nindexes, uint64_t index);
+
+extern int memory_block_get_node(struct path_cxt *sysmem, uint64_t index);
+extern void memory_block_read(struct path_cxt *sysmem, uint64_t index, int flags,
+			      struct memory_block *blk);
+
+extern void memory_scan_blocks(struct path_cxt *sysmem, struct memory_scan *sc);
+extern void memory_scan_reset(struct memory_scan *sc);
+
+#endif /* UTIL_LINUX_MEMBLOCKS_H */
@@ -225,6 +225,65 @@ static int mount_all(struct libmnt_context *cxt)
 	return rc;
 }
 
+struct mount_all_status {
+	int nsucc;
+	int nerrs;
+};
+
+/* called in the child process */
+static int mount_all_excode(struct libmnt_context *cxt, struct libmnt_fs *fs,
+			    int mntrc, void *data __attribute__((__unused__)))
+{
+	int rc = mk_exit_code(cxt, mntrc);
+
+	/* Note that MNT_EX_SUCCESS return code does not mean that FS has been
+	 * really mounted (e.g. nofail option) */
+	if (rc == MNT_EX_SUCCESS && mnt_context_get_status(cxt)
+	    && mnt_context_is_verbose(cxt))
+		printf("%-25s: successfully mounted\n", mnt_fs_get_target(fs));
+	return rc;
+}
+
+/* called in the parent process in fstab order */
+static void mount_all_report(struct libmnt_context *cxt, struct libmnt_fs *fs,
+			     int status, int ignored, void *data)
+{
+	struct mount_all_status *st = (struct mount_all_status *) data;
+
+	if (ignored) {
+		if (mnt_context_is_verbose(cxt))
+			printf(ignored == 1 ? _("%-25s: ignored\n") :
+					      _("%-25s: already mounted\n"),
+					mnt_fs_get_target(fs));
+	} else if (status == MNT_EX_SUCCESS)
+		st->nsucc++;
+	else
+		st->nerrs++;
+}
+
+/*
+ * mount -a --parallel
+ */
+static int mount_all_parallel(struct libmnt_context *cxt, size_t nworkers)
+{
+	struct mount_all_status st = { .nsucc = 0 };
+	int rc;
+
+	rc = mnt_context_mount_parallel(cxt, nworkers, mount_all_excode,
+					mount_all_report, &st);
+	if (rc) {
+		warn(_("failed to mount filesystems"));
+		return MNT_EX_SYSERR;
+	}
+
+	if (st.nerrs == 0)
+		rc = MNT_EX_SUCCESS;		/* all success */
+	else if (st.nsucc == 0)
+		rc = MNT_EX_FAIL;		/* all failed */
+	else
+		rc = MNT_EX_SOMEOK;		/* some success, some failed */
+	return rc;
+}
 
 /*
  * mount -a -o remount
@@ -451,6 +510,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	" -c, --no-canonicalize   don't canonicalize paths\n"
 	" -f, --fake              dry run; skip the mount(2) syscall\n"
 	" -F, --fork              fork off for each device (use with -a)\n"
+	"     --parallel[=<num>]  mount by <num> processes in dependency order (use with -a)\n"
 	" -T, --fstab <path>      alternative file to /etc/fstab\n"));
 	fprintf(out, _(
 	" -i, --internal-only     don't call the mount.<type> helpers\n"));
@@ -584,6 +644,7 @@ int main(int argc, char **argv)
 	int oper = 0, is_move = 0;
 	int propa = 0;
 	int optmode = 0, optmode_mode = 0, optmode_src = 0;
+	size_t parallel = 0;
 
 	enum {
 		MOUNT_OPT_SHARED = CHAR_MAX + 1,
@@ -599,7 +660,8 @@ int main(int argc, char **argv)
 		MOUNT_OPT_SOURCE,
 		MOUNT_OPT_OPTMODE,
 		MOUNT_OPT_OPTSRC,
-		MOUNT_OPT_OPTSRC_FORCE
+		MOUNT_OPT_OPTSRC_FORCE,
+		MOUNT_OPT_PARALLEL
 	};
 
 	static const struct option longopts[] = {
@@ -641,11 +703,13 @@ int main(int argc, char **argv)
 		{ "options-source",   required_argument, NULL, MOUNT_OPT_OPTSRC      },
 		{ "options-source-force",   no_argument, NULL, MOUNT_OPT_OPTSRC_FORCE},
 		{ "namespace",        required_argument, NULL, 'N'                   },
+		{ "parallel",         optional_argument, NULL, MOUNT_OPT_PARALLEL    },
 		{ NULL, 0, NULL, 0 }
 	};
 
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
 		{ 'B','M','R' },			/* bind,move,rbind */
+		{ 'F', MOUNT_OPT_PARALLEL },	/* fork,parallel */
 		{ 'L','U', MOUNT_OPT_SOURCE },	/* label,uuid,source */
 		{ 0 }
 	};
@@ -826,6 +890,15 @@ int main(int argc, char **argv)
 		case MOUNT_OPT_OPTSRC_FORCE:
 			optmode |= MNT_OMODE_FORCE;
 			break;
+		case MOUNT_OPT_PARALLEL:
+			if (optarg)
+				parallel = strtou32_or_err(optarg,
+						_("invalid number of processes"));
+			else {
+				long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+				parallel = ncpus > 0 ? ncpus : 1;
+			}
+			break;
 
 		case 'h':
 			mnt_free_context(cxt);
@@ -893,6 +966,8 @@ int main(int argc, char **argv)
 		 */
 		if (has_remount_flag(cxt))
 			rc = remount_all(cxt);
+		else if (parallel)
+			rc = mount_all_parallel(cxt, parallel);
 		else
 			rc = mount_all(cxt);
 		goto done;
@@ -39,6 +39,7 @@
 #include "c.h"
 #include "closestream.h"
 #include "pathnames.h"
+#include "mount-api-utils.h"
 
 struct mountpoint_control {
 	char *path;
@@ -51,13 +52,73 @@ struct mountpoint_control {
 		quiet:1;
 };
 
+/* only mountpoints and devnos are necessary, so use listmount() if possible */
+static struct libmnt_table *read_mountpoints(void)
+{
+	struct libmnt_table *tb = mnt_new_table();
+
+	mnt_table_enable_lazy_parse(tb, 1);
+	if (tb && mnt_table_fetch_listmount(tb, MNT_STATMNT_TARGET) != 0
+	       && mnt_table_parse_file(tb, _PATH_PROC_MOUNTINFO) != 0) {
+		mnt_unref_table(tb);
+		tb = NULL;
+	}
+	return tb;
+}
+
+/*
+ * Asks the kernel about the path only, without the mount table. Returns 1 if
+ * the path is a mountpoint, 0 if not, or -1 if the kernel is too old to answer
+ * (or the devno is requested and statmount() is not available).
+ */
+static int fast_dir_to_device(struct mountpoint_control *ctl)
+{
+#ifdef UL_HAVE_STATX
+	struct ul_statx stx = { 0 };
+
+	if (ul_statx(AT_FDCWD, ctl->path,
+		     ctl->nofollow ? AT_SYMLINK_NOFOLLOW : 0,
+		     ctl->fs_devno ? UL_STATX_MNT_ID_UNIQUE : 0, &stx) != 0)
+		return -1;
+
+	/* STATX_ATTR_MOUNT_ROOT since Linux 5.8 */
+	if (!(stx.stx_attributes_mask & UL_STATX_ATTR_MOUNT_ROOT))
+		return -1;
+	if (!(stx.stx_attributes & UL_STATX_ATTR_MOUNT_ROOT))
+		return 0;
+	if (!ctl->fs_devno)
+		return 1;
+
+# ifdef UL_HAVE_MOUNT_API_LISTMOUNT
+	/* st_dev is not the filesystem devno for example on btrfs subvolumes */
+	if (stx.stx_mask & UL_STATX_MNT_ID_UNIQUE) {
+		struct ul_statmount sm = { 0 };
+
+		if (ul_statmount(stx.stx_mnt_id, UL_STATMOUNT_SB_BASIC,
+				 &sm, sizeof(sm)) == 0
+		    && (sm.mask & UL_STATMOUNT_SB_BASIC)) {
+			ctl->dev = makedev(sm.sb_dev_major, sm.sb_dev_minor);
+			return 1;
+		}
+	}
+# endif
+#endif
+	return -1;
+}
+
 static int dir_to_device(struct mountpoint_control *ctl)
 {
-	struct libmnt_table *tb = mnt_new_table_from_file(_PATH_PROC_MOUNTINFO);
+	struct libmnt_table *tb;
 	struct libmnt_fs *fs;
 	struct libmnt_cache *cache;
-	int rc = -1;
+	int rc;
+
+	rc = fast_dir_to_device(ctl);
+	if (rc >= 0)
+		return rc == 1 ? 0 : -1;
 
+	rc = -1;
+	tb = read_mountpoints();
 	if (!tb) {
 		/*
 		 * Fallback. Traditional way to detect mountpoints. This way
@@ -0,0 +1,328 @@
+/*
+ * mountsnapd(8) - mount table snapshot daemon
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The daemon keeps one parsed mount table (incl. utab) and serializes it to
+ * a sealed memfd on each change. Clients get the memfd by the unix socket
+ * and map the snapshot read-only, see LIBMOUNT_SNAPSHOT in libmount.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <libmount.h>
+
+#ifdef HAVE_LIBSYSTEMD
+# include <systemd/sd-daemon.h>
+#endif
+
+#include "c.h"
+#include "nls.h"
+#include "closestream.h"
+#include "pathnames.h"
+#include "strutils.h"
+
+struct mountsnapd_ctl {
+	struct libmnt_table	*tb;
+	int			snapfd;		/* the current snapshot */
+	const char		*cleanup_socket;
+
+	unsigned int	debug : 1,
+			quiet : 1,
+			no_sock : 1;		/* socket activation */
+};
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	FILE *out = stdout;
+
+	fputs(USAGE_HEADER, out);
+	fprintf(out, _(" %s [options]\n"), program_invocation_short_name);
+	fputs(USAGE_SEPARATOR, out);
+	fputs(_("A daemon for sharing the mount table snapshot.\n"), out);
+	fputs(USAGE_OPTIONS, out);
+	fputs(_(" -s, --socket <path>     path to socket\n"), out);
+	fputs(_(" -S, --socket-activation do not create listening socket\n"), out);
+	fputs(_(" -d, --debug             run in debugging mode\n"), out);
+	fputs(_(" -q, --quiet             turn on quiet mode\n"), out);
+	fputs(USAGE_SEPARATOR, out);
+	printf(USAGE_HELP_OPTIONS(25));
+	printf(USAGE_MAN_TAIL("mountsnapd(8)"));
+	exit(EXIT_SUCCESS);
+}
+
+static int create_socket(struct mountsnapd_ctl *ctl, const char *socket_path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	mode_t save_umask;
+	int s;
+
+	s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (s < 0)
+		err(EXIT_FAILURE, _("couldn't create unix stream socket"));
+
+	xstrncpy(addr.sun_path, socket_path, sizeof(addr.sun_path));
+	unlink(socket_path);
+
+	/* the snapshot is world-readable as /proc/self/mountinfo */
+	save_umask = umask(0);
+	if (bind(s, (const struct sockaddr *) &addr, sizeof(addr)) < 0)
+		err(EXIT_FAILURE, _("couldn't bind unix socket %s"), socket_path);
+	umask(save_umask);
+	ctl->cleanup_socket = socket_path;
+
+	if (listen(s, SOMAXCONN) < 0)
+		err(EXIT_FAILURE, _("couldn't listen on unix socket %s"), socket_path);
+	return s;
+}
+
+static void __attribute__((__noreturn__)) all_done(struct mountsnapd_ctl *ctl, int ret)
+{
+	if (ctl->cleanup_socket)
+		unlink(ctl->cleanup_socket);
+	exit(ret);
+}
+
+/* reads the current mount table and replaces the snapshot */
+static int update_snapshot(struct mountsnapd_ctl *ctl)
+{
+	int fd, rc;
+
+	if (mnt_table_is_empty(ctl->tb))
+		rc = mnt_table_parse_mtab(ctl->tb, NULL);
+	else
+		rc = mnt_table_refresh(ctl->tb, NULL, NULL);
+	if (rc < 0) {
+		if (!ctl->quiet)
+			warnx(_("failed to read mount table"));
+		return rc;
+	}
+
+	fd = memfd_create("libmount-snapshot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		if (!ctl->quiet)
+			warn(_("cannot create memfd"));
+		return -errno;
+	}
+
+	rc = mnt_table_write_snapshot(ctl->tb, fd);
+	if (!rc && fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+				       F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+		rc = -errno;
+	if (rc) {
+		if (!ctl->quiet)
+			warnx(_("failed to write snapshot"));
+		close(fd);
+		return rc;
+	}
+
+	if (ctl->snapfd >= 0)
+		close(ctl->snapfd);
+	ctl->snapfd = fd;
+
+	if (ctl->debug)
+		fprintf(stderr, _("snapshot updated: %d entries\n"),
+				mnt_table_get_nents(ctl->tb));
+	return 0;
+}
+
+/* sends the snapshot file descriptor to the client */
+static void send_snapshot(struct mountsnapd_ctl *ctl, int ns)
+{
+	union {
+		struct cmsghdr	cmh;
+		char		buf[CMSG_SPACE(sizeof(int))];
+	} cbuf;
+	struct msghdr msg = { .msg_name = NULL };
+	struct cmsghdr *cmh;
+	struct iovec iov;
+	char x = 0;
+
+	iov.iov_base = &x;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	memset(&cbuf, 0, sizeof(cbuf));
+	msg.msg_control = cbuf.buf;
+	msg.msg_controllen = sizeof(cbuf.buf);
+
+	cmh = CMSG_FIRSTHDR(&msg);
+	cmh->cmsg_level = SOL_SOCKET;
+	cmh->cmsg_type = SCM_RIGHTS;
+	cmh->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmh), &ctl->snapfd, sizeof(int));
+
+	if (sendmsg(ns, &msg, MSG_NOSIGNAL) != 1 && ctl->debug)
+		warn(_("failed to send snapshot"));
+}
+
+static void server_loop(struct mountsnapd_ctl *ctl, const char *socket_path)
+{
+	struct libmnt_monitor *mn;
+	struct pollfd pfd[3];
+	sigset_t sigmask;
+	int s = -1, sigfd, mnfd;
+	enum {
+		POLLFD_SIGNAL = 0,
+		POLLFD_SOCKET,
+		POLLFD_MONITOR
+	};
+
+	if (!ctl->no_sock)
+		s = create_socket(ctl, socket_path);
+#ifdef HAVE_LIBSYSTEMD
+	else {
+		const int r = sd_listen_fds(0);
+
+		if (r < 0) {
+			errno = r * -1;
+			err(EXIT_FAILURE, _("sd_listen_fds() failed"));
+		} else if (r != 1)
+			errx(EXIT_FAILURE,
+			     _("one file descriptor expected, check mountsnapd.socket"));
+		s = SD_LISTEN_FDS_START + 0;
+	}
+#endif
+
+	mn = mnt_new_monitor();
+	if (!mn
+	    || mnt_monitor_enable_kernel(mn, 1) != 0
+	    || mnt_monitor_enable_userspace(mn, 1, NULL) != 0
+	    || (mnfd = mnt_monitor_get_fd(mn)) < 0)
+		err(EXIT_FAILURE, _("cannot initialize libmount monitor"));
+
+	ctl->tb = mnt_new_table();
+	if (!ctl->tb)
+		err(EXIT_FAILURE, _("failed to initialize libmount table"));
+	/* listmount() is cheaper than to parse mountinfo */
+	mnt_table_enable_listmount(ctl->tb, MNT_STATMNT_ALL);
+
+	if (update_snapshot(ctl) != 0)
+		all_done(ctl, EXIT_FAILURE);
+
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGHUP);
+	sigaddset(&sigmask, SIGINT);
+	sigaddset(&sigmask, SIGTERM);
+	sigaddset(&sigmask, SIGPIPE);
+	sigprocmask(SIG_BLOCK, &sigmask, NULL);
+	if ((sigfd = signalfd(-1, &sigmask, SFD_CLOEXEC)) < 0)
+		err(EXIT_FAILURE, _("cannot set signal handler"));
+
+	pfd[POLLFD_SIGNAL].fd = sigfd;
+	pfd[POLLFD_SOCKET].fd = s;
+	pfd[POLLFD_MONITOR].fd = mnfd;
+	pfd[POLLFD_SIGNAL].events = pfd[POLLFD_SOCKET].events =
+		pfd[POLLFD_MONITOR].events = POLLIN | POLLERR | POLLHUP;
+
+	while (1) {
+		int ns;
+
+		if (poll(pfd, ARRAY_SIZE(pfd), -1) < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			warn(_("poll failed"));
+			all_done(ctl, EXIT_FAILURE);
+		}
+		if (pfd[POLLFD_SIGNAL].revents != 0) {
+			struct signalfd_siginfo info;
+
+			if (read(sigfd, &info, sizeof(info)) == sizeof(info)
+			    && info.ssi_signo == SIGPIPE)
+				continue;	/* ignored */
+			all_done(ctl, EXIT_SUCCESS);
+		}
+
+		/* update the snapshot before the client is served */
+		if (pfd[POLLFD_MONITOR].revents != 0) {
+			while (mnt_monitor_next_change(mn, NULL, NULL) == 0);
+			update_snapshot(ctl);
+		}
+
+		if (pfd[POLLFD_SOCKET].revents == 0)
+			continue;
+		ns = accept4(s, NULL, NULL, SOCK_CLOEXEC);
+		if (ns < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "accept");
+		}
+		send_snapshot(ctl, ns);
+		close(ns);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *socket_path = _PATH_MOUNTSNAPD_SOCKET;
+	struct mountsnapd_ctl ctl = { .snapfd = -1 };
+	int c;
+
+	static const struct option longopts[] = {
+		{"socket", required_argument, NULL, 's'},
+		{"socket-activation", no_argument, NULL, 'S'},
+		{"debug", no_argument, NULL, 'd'},
+		{"quiet", no_argument, NULL, 'q'},
+		{"version", no_argument, NULL, 'V'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	setlocale(LC_ALL, "");
+	bindtextdomain(PACKAGE, LOCALEDIR);
+	textdomain(PACKAGE);
+	close_stdout_atexit();
+
+	while ((c = getopt_long(argc, argv, "s:SdqVh", longopts, NULL)) != -1) {
+		switch (c) {
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'S':
+#ifdef HAVE_LIBSYSTEMD
+			ctl.no_sock = 1;
+#else
+			errx(EXIT_FAILURE, _("mountsnapd has been built without "
+					     "support for socket activation"));
+#endif
+			break;
+		case 'd':
+			ctl.debug = 1;
+			break;
+		case 'q':
+			ctl.quiet = 1;
+			break;
+		case 'V':
+			print_version(EXIT_SUCCESS);
+		case 'h':
+			usage();
+		default:
+			errtryhelp(EXIT_FAILURE);
+		}
+	}
+
+	if (strlen(socket_path) >= sizeof(((struct sockaddr_un *)0)->sun_path))
+		errx(EXIT_FAILURE, _("socket name too long: %s"), socket_path);
+
+	/* don't ask ourselves for the snapshot */
+	unsetenv("LIBMOUNT_SNAPSHOT");
+
+	server_loop(&ctl, socket_path);
+	return EXIT_SUCCESS;
+}
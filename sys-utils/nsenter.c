@@ -41,6 +41,7 @@
 #include "closestream.h"
 #include "namespace.h"
 #include "exec_shell.h"
+#include "pidfd-utils.h"
 
 static struct namespace_file {
 	int nstype;
@@ -106,6 +107,7 @@ static void __attribute__((__noreturn__)) usage(void)
 static pid_t namespace_target_pid = 0;
 static int root_fd = -1;
 static int wd_fd = -1;
+static int pid_fd = -1;
 
 static void open_target_fd(int *fd, const char *type, const char *path)
 {
@@ -170,6 +172,39 @@ static int is_same_namespace(pid_t a, pid_t b, const char *type)
 	return a_ino == b_ino;
 }
 
+/*
+ * Since Linux 5.8 setns() accepts pidfd and enters all the namespaces of the
+ * process by one call. It's used if all the namespaces are from the --target
+ * process, it does not require to open the /proc/<pid>/ns/ files and the
+ * namespaces are from the same process even if the PID is reused.
+ *
+ * Returns: 0 on success, 1 if not supported (the /proc/<pid>/ns/ files are
+ * opened), or exits on error.
+ */
+static int enter_pidfd_namespaces(int namespaces)
+{
+	struct namespace_file *nsfile;
+
+	if (setns(pid_fd, namespaces) == 0) {
+		close(pid_fd);
+		pid_fd = -1;
+		return 0;
+	}
+	if (errno != EINVAL)
+		err(EXIT_FAILURE, _("reassociate to namespaces of PID %d failed"),
+				(int) namespace_target_pid);
+
+	/* old kernel (or an invalid combination of the namespaces, let's
+	 * report it per namespace) */
+	close(pid_fd);
+	pid_fd = -1;
+
+	for (nsfile = namespace_files; nsfile->nstype; nsfile++)
+		if (nsfile->nstype & namespaces)
+			open_namespace_fd(nsfile->nstype, NULL);
+	return 1;
+}
+
 static void continue_as_child(void)
 {
 	pid_t child = fork();
@@ -374,15 +409,31 @@ int main(int argc, char *argv[])
 	}
 
 	/*
-	 * Open remaining namespace and directory descriptors.
+	 * Open remaining namespace and directory descriptors. If all the
+	 * namespaces are from the target process, only its pidfd is opened.
 	 */
 	for (nsfile = namespace_files; nsfile->nstype; nsfile++)
-		if (nsfile->nstype & namespaces)
-			open_namespace_fd(nsfile->nstype, NULL);
+		if (nsfile->fd >= 0)
+			break;
+#ifdef UL_HAVE_PIDFD
+	if (namespaces && !nsfile->nstype && namespace_target_pid)
+		pid_fd = pidfd_open(namespace_target_pid, 0);
+#endif
+	if (pid_fd < 0) {
+		for (nsfile = namespace_files; nsfile->nstype; nsfile++)
+			if (nsfile->nstype & namespaces)
+				open_namespace_fd(nsfile->nstype, NULL);
+	}
 	if (do_rd)
 		open_target_fd(&root_fd, "root", NULL);
 	if (do_wd)
 		open_target_fd(&wd_fd, "cwd", NULL);
+#ifdef UL_HAVE_PIDFD
+	/* the directories are from the pidfd process if it's still alive */
+	if (pid_fd >= 0 && (do_rd || do_wd)
+	    && pidfd_send_signal(pid_fd, 0, NULL, 0) != 0)
+		err(EXIT_FAILURE, _("failed to check PID %d"), (int) namespace_target_pid);
+#endif
 
 	/*
 	 * Update namespaces variable to contain all requested namespaces
@@ -412,12 +463,18 @@ int main(int argc, char *argv[])
 	 * privileging it then we enter the user namespace first
 	 * (because the initial setns will fail).
 	 */
-	for (pass = 0; pass < 2; pass ++) {
+	if ((namespaces & CLONE_NEWPID) && do_fork == -1)
+		do_fork = 1;
+
+	if (pid_fd >= 0 && enter_pidfd_namespaces(namespaces) == 0)
+		pass = 2;	/* all done */
+	else
+		pass = 0;
+
+	for (; pass < 2; pass ++) {
 		for (nsfile = namespace_files + 1 - pass; nsfile->nstype; nsfile++) {
 			if (nsfile->fd < 0)
 				continue;
-			if (nsfile->nstype == CLONE_NEWPID && do_fork == -1)
-				do_fork = 1;
 			if (setns(nsfile->fd, nsfile->nstype)) {
 				if (pass != 0)
 					err(EXIT_FAILURE,
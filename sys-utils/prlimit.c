@@ -35,6 +35,7 @@
 #include "strutils.h"
 #include "list.h"
 #include "closestream.h"
+#include "procutils.h"
 
 #ifndef RLIMIT_RTTIME
 # define RLIMIT_RTTIME 15
@@ -108,6 +109,7 @@ enum {
 	COL_SOFT,
 	COL_HARD,
 	COL_UNITS,
+	COL_PID,
 };
 
 /* column names */
@@ -125,6 +127,7 @@ static struct colinfo infos[] = {
 	[COL_SOFT]    = { "SOFT",        0.1,  SCOLS_FL_RIGHT, N_("soft limit")},
 	[COL_HARD]    = { "HARD",        1,    SCOLS_FL_RIGHT, N_("hard limit (ceiling)")},
 	[COL_UNITS]   = { "UNITS",       0.1,  SCOLS_FL_TRUNC, N_("units")},
+	[COL_PID]     = { "PID",         5,    SCOLS_FL_RIGHT, N_("process ID")},
 };
 
 static int columns[ARRAY_SIZE(infos) * 2];
@@ -141,6 +144,10 @@ static int ncolumns;
 static pid_t pid; /* calling process (default) */
 static int verbose;
 
+/* the processes selected by more --pid, --cgroup or --name */
+static pid_t *pids;
+static size_t npids;
+
 #ifndef HAVE_PRLIMIT
 # include <sys/syscall.h>
 static int prlimit(pid_t p, int resource,
@@ -159,7 +166,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_HEADER, out);
 
 	fprintf(out,
-		_(" %s [options] [-p PID]\n"), program_invocation_short_name);
+		_(" %s [options] [-p PID]...\n"), program_invocation_short_name);
+	fprintf(out,
+		_(" %s [options] --cgroup PATH | --name NAME\n"), program_invocation_short_name);
 	fprintf(out,
 		_(" %s [options] COMMAND\n"), program_invocation_short_name);
 
@@ -167,7 +176,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_("Show or change the resource limits of a process.\n"), out);
 
 	fputs(_("\nGeneral Options:\n"), out);
-	fputs(_(" -p, --pid <pid>        process id\n"
+	fputs(_(" -p, --pid <pid>        process id, may be used more than once\n"
+		"     --cgroup <path>    act on all the processes in the cgroup\n"
+		"     --name <name>      act on all the processes with the name\n"
 		" -o, --output <list>    define which output columns to use\n"
 		"     --noheadings       don't print headings\n"
 		"     --raw              use the raw output format\n"
@@ -253,6 +264,9 @@ static void add_scols_line(struct libscols_table *table, struct prlimit *l)
 		case COL_UNITS:
 			str = l->desc->unit ? xstrdup(_(l->desc->unit)) : NULL;
 			break;
+		case COL_PID:
+			xasprintf(&str, "%d", (int) (pid ? pid : getpid()));
+			break;
 		default:
 			break;
 		}
@@ -286,11 +300,10 @@ static void rem_prlim(struct prlimit *lim)
 	free(lim);
 }
 
-static int show_limits(struct list_head *lims)
+static struct libscols_table *new_limits_table(void)
 {
-	int i;
-	struct list_head *p, *pnext;
 	struct libscols_table *table;
+	int i;
 
 	table = scols_new_table();
 	if (!table)
@@ -305,6 +318,13 @@ static int show_limits(struct list_head *lims)
 		if (!scols_table_new_column(table, col->name, col->whint, col->flags))
 			err(EXIT_FAILURE, _("failed to allocate output column"));
 	}
+	return table;
+}
+
+static int show_limits(struct list_head *lims)
+{
+	struct list_head *p, *pnext;
+	struct libscols_table *table = new_limits_table();
 
 	list_for_each_safe(p, pnext, lims) {
 		struct prlimit *lim = list_entry(p, struct prlimit, lims);
@@ -337,6 +357,21 @@ static void get_unknown_hardsoft(struct prlimit *lim)
 		lim->rlim.rlim_max = old.rlim_max;
 }
 
+static void print_new_limit(struct prlimit *lim, struct rlimit *new)
+{
+	printf(_("New %s limit for pid %d: "), lim->desc->name,
+		pid ? pid : getpid());
+	if (new->rlim_cur == RLIM_INFINITY)
+		printf("<%s", _("unlimited"));
+	else
+		printf("<%ju", (uintmax_t)new->rlim_cur);
+
+	if (new->rlim_max == RLIM_INFINITY)
+		printf(":%s>\n", _("unlimited"));
+	else
+		printf(":%ju>\n", (uintmax_t)new->rlim_max);
+}
+
 static void do_prlimit(struct list_head *lims)
 {
 	struct list_head *p, *pnext;
@@ -358,19 +393,8 @@ static void do_prlimit(struct list_head *lims)
 		} else
 			old = &lim->rlim;
 
-		if (verbose && new) {
-			printf(_("New %s limit for pid %d: "), lim->desc->name,
-				pid ? pid : getpid());
-			if (new->rlim_cur == RLIM_INFINITY)
-				printf("<%s", _("unlimited"));
-			else
-				printf("<%ju", (uintmax_t)new->rlim_cur);
-
-			if (new->rlim_max == RLIM_INFINITY)
-				printf(":%s>\n", _("unlimited"));
-			else
-				printf(":%ju>\n", (uintmax_t)new->rlim_max);
-		}
+		if (verbose && new)
+			print_new_limit(lim, new);
 
 		if (prlimit(pid, lim->desc->resource, new, old) == -1)
 			err(EXIT_FAILURE, lim->modify ?
@@ -383,6 +407,113 @@ static void do_prlimit(struct list_head *lims)
 	}
 }
 
+/*
+ * Sets or shows the limits for all the processes from pids[]. The unknown
+ * soft or hard limits are read for each process. The errors are reported
+ * and it continues with the next limit or process.
+ *
+ * Returns: number of errors
+ */
+static size_t do_prlimit_bulk(struct list_head *lims)
+{
+	struct libscols_table *table = NULL;
+	struct list_head *p, *pnext;
+	size_t i, nerrs = 0;
+
+	for (i = 0; i < npids; i++) {
+		pid = pids[i];
+
+		list_for_each(p, lims) {
+			struct prlimit *lim = list_entry(p, struct prlimit, lims);
+			struct prlimit cur = *lim;
+			struct rlimit old;
+
+			if (!lim->modify) {
+				if (prlimit(pid, lim->desc->resource, NULL, &cur.rlim) == -1) {
+					warn(_("pid %d: failed to get the %s resource limit"),
+							pid, lim->desc->name);
+					nerrs++;
+					continue;
+				}
+				if (!table)
+					table = new_limits_table();
+				add_scols_line(table, &cur);
+				continue;
+			}
+
+			if (lim->modify != (PRLIMIT_HARD | PRLIMIT_SOFT)) {
+				if (prlimit(pid, lim->desc->resource, NULL, &old) == -1) {
+					warn(_("pid %d: failed to get old %s limit"),
+							pid, lim->desc->name);
+					nerrs++;
+					continue;
+				}
+				if (!(lim->modify & PRLIMIT_SOFT))
+					cur.rlim.rlim_cur = old.rlim_cur;
+				else
+					cur.rlim.rlim_max = old.rlim_max;
+			}
+			if ((cur.rlim.rlim_cur > cur.rlim.rlim_max) &&
+			    (cur.rlim.rlim_cur != RLIM_INFINITY ||
+			     cur.rlim.rlim_max != RLIM_INFINITY)) {
+				warnx(_("pid %d: the soft limit %s cannot exceed the hard limit"),
+						pid, lim->desc->name);
+				nerrs++;
+				continue;
+			}
+			if (verbose)
+				print_new_limit(lim, &cur.rlim);
+
+			if (prlimit(pid, lim->desc->resource, &cur.rlim, NULL) == -1) {
+				warn(_("pid %d: failed to set the %s resource limit"),
+						pid, lim->desc->name);
+				nerrs++;
+			}
+		}
+	}
+
+	if (table) {
+		scols_print_table(table);
+		scols_unref_table(table);
+	}
+	list_for_each_safe(p, pnext, lims)
+		rem_prlim(list_entry(p, struct prlimit, lims));
+
+	return nerrs;
+}
+
+static void add_pid(pid_t x)
+{
+	if (npids % 64 == 0)
+		pids = xrealloc(pids, (npids + 64) * sizeof(pid_t));
+	pids[npids++] = x;
+}
+
+static void add_cgroup_pids(const char *cgroup)
+{
+	struct proc_tasks *ts = proc_open_cgroup_procs(cgroup);
+	pid_t x;
+
+	if (!ts)
+		err(EXIT_FAILURE, _("cannot obtain the list of tasks"));
+	while (proc_next_tid(ts, &x) == 0)
+		add_pid(x);
+	proc_close_tasks(ts);
+}
+
+static void add_name_pids(const char *name)
+{
+	struct proc_processes *ps = proc_open_processes();
+	pid_t x;
+
+	if (!ps)
+		err(EXIT_FAILURE, _("cannot obtain the list of tasks"));
+	proc_processes_filter_by_name(ps, name);
+	while (proc_next_pid(ps, &x) == 0)
+		add_pid(x);
+	proc_close_processes(ps);
+}
+
 static int get_range(char *str, rlim_t *soft, rlim_t *hard, int *found)
 {
 	char *end = NULL;
@@ -479,11 +610,14 @@ int main(int argc, char **argv)
 {
 	int opt;
 	struct list_head lims;
+	const char *cgroup = NULL, *name = NULL;
 
 	enum {
 		VERBOSE_OPTION = CHAR_MAX + 1,
 		RAW_OPTION,
-		NOHEADINGS_OPTION
+		NOHEADINGS_OPTION,
+		CGROUP_OPTION,
+		NAME_OPTION
 	};
 
 	static const struct option longopts[] = {
@@ -510,6 +644,8 @@ int main(int argc, char **argv)
 		{ "noheadings", no_argument, NULL, NOHEADINGS_OPTION },
 		{ "raw",        no_argument, NULL, RAW_OPTION },
 		{ "verbose",    no_argument, NULL, VERBOSE_OPTION },
+		{ "cgroup",     required_argument, NULL, CGROUP_OPTION },
+		{ "name",       required_argument, NULL, NAME_OPTION },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -580,9 +716,14 @@ int main(int argc, char **argv)
 			break;
 
 		case 'p':
-			if (pid)
-				errx(EXIT_FAILURE, _("option --pid may be specified only once"));
 			pid = strtos32_or_err(optarg, _("invalid PID argument"));
+			add_pid(pid);
+			break;
+		case CGROUP_OPTION:
+			cgroup = optarg;
+			break;
+		case NAME_OPTION:
+			name = optarg;
 			break;
 		case 'o':
 			ncolumns = string_to_idarray(optarg,
@@ -609,10 +750,12 @@ int main(int argc, char **argv)
 			errtryhelp(EXIT_FAILURE);
 		}
 	}
-	if (argc > optind && pid)
-		errx(EXIT_FAILURE, _("options --pid and COMMAND are mutually exclusive"));
+	if (argc > optind && (pid || cgroup || name))
+		errx(EXIT_FAILURE, _("options --pid, --cgroup, --name and COMMAND are mutually exclusive"));
 	if (!ncolumns) {
 		/* default columns */
+		if (npids > 1 || cgroup || name)
+			columns[ncolumns++] = COL_PID;
 		columns[ncolumns++] = COL_RES;
 		columns[ncolumns++] = COL_HELP;
 		columns[ncolumns++] = COL_SOFT;
@@ -630,6 +773,23 @@ int main(int argc, char **argv)
 			add_prlim(NULL, &lims, n);
 	}
 
+	if (npids > 1 || cgroup || name) {
+		/* all the processes by one process */
+		size_t nerrs;
+
+		if (cgroup)
+			add_cgroup_pids(cgroup);
+		if (name)
+			add_name_pids(name);
+		if (!npids)
+			errx(EXIT_FAILURE, _("no process found"));
+
+		nerrs = do_prlimit_bulk(&lims);
+		free(pids);
+		return nerrs ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	free(pids);
+
 	do_prlimit(&lims);
 
 	if (!list_empty(&lims))
@@ -46,6 +46,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
@@ -54,6 +55,8 @@
 #include "nls.h"
 #include "xalloc.h"
 #include "closestream.h"
+#include "strutils.h"
+#include "all-io.h"
 
 #define S_LEN 128
 
@@ -61,6 +64,20 @@
 static char defaultmap[]="/boot/System.map";
 static char defaultpro[]="/proc/profile";
 
+/* System.map text symbol */
+struct map_symbol {
+	unsigned long long	addr;
+	char			*name;
+	char			mode;
+};
+
+/* the map is parsed only once, also for --interval */
+struct profile_map {
+	struct map_symbol	*syms;
+	size_t			nsyms;
+	unsigned long long	add0;		/* _stext */
+};
+
 static FILE *myopen(char *name, char *mode, int *flag)
 {
 	int len = strlen(name);
@@ -97,6 +114,343 @@ static char *boot_uname_r_str(void)
 	return s;
 }
 
+/*
+ * Parses "<hex-address> <mode> <name>" line, the line does not have to be
+ * terminated. Returns 0 on success.
+ */
+static int parse_map_line(const char *p, const char *end,
+			  unsigned long long *addr, char *mode,
+			  const char **name, size_t *namesz)
+{
+	const char *x = p;
+
+	*addr = 0;
+	for (; p < end; p++) {
+		int d;
+
+		if (*p >= '0' && *p <= '9')
+			d = *p - '0';
+		else if (*p >= 'a' && *p <= 'f')
+			d = *p - 'a' + 10;
+		else if (*p >= 'A' && *p <= 'F')
+			d = *p - 'A' + 10;
+		else
+			break;
+		*addr = (*addr << 4) | d;
+	}
+	if (p == x)
+		return -1;
+
+	while (p < end && *p == ' ')
+		p++;
+	if (p == end)
+		return -1;
+	*mode = *p;
+	while (p < end && *p != ' ')
+		p++;
+	while (p < end && *p == ' ')
+		p++;
+	if (p == end)
+		return -1;
+
+	*name = p;
+	while (p < end && *p != ' ')
+		p++;
+	*namesz = min((size_t) (p - *name), (size_t) S_LEN - 1);
+	return 0;
+}
+
+static int is_name(const char *name, size_t namesz, const char *str)
+{
+	return strlen(str) == namesz && memcmp(name, str, namesz) == 0;
+}
+
+/* maps regular files, read()s the output of zcat */
+static char *read_map_file(char *mapFile, size_t *sz, int *mapped)
+{
+	struct stat st;
+	FILE *map;
+	char *data = NULL;
+	size_t bufsz = 0;
+	int popenMap;		/* flag to tell if popen() has been used */
+
+	map = myopen(mapFile, "r", &popenMap);
+	if (map == NULL)
+		return NULL;
+
+	*mapped = 0;
+	*sz = 0;
+
+	if (!popenMap && fstat(fileno(map), &st) == 0 && S_ISREG(st.st_mode)) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+			    fileno(map), 0);
+		if (data != MAP_FAILED) {
+			madvise(data, st.st_size, MADV_SEQUENTIAL);
+			*sz = st.st_size;
+			*mapped = 1;
+			fclose(map);
+			return data;
+		}
+		data = NULL;
+	}
+
+	for (;;) {
+		ssize_t n;
+
+		if (bufsz - *sz < BUFSIZ) {
+			bufsz = bufsz ? bufsz * 2 : 1024 * 1024;
+			data = xrealloc(data, bufsz);
+		}
+		n = read(fileno(map), data + *sz, bufsz - *sz);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			err(EXIT_FAILURE, "%s", mapFile);
+		if (n == 0)
+			break;
+		*sz += n;
+	}
+	popenMap ? pclose(map) : fclose(map);
+	return data;
+}
+
+/*
+ * Reads the symbols from _stext to _etext (or to the first not text symbol).
+ * The absolute symbols are kept, the decision whether to ignore them depends
+ * on the profile, see print_profile().
+ */
+static void load_map(struct profile_map *pm, char *mapFile)
+{
+	char *data, *p, *end;
+	size_t sz, allocated = 0;
+	int maplineno = 1, mapped;
+
+	data = read_map_file(mapFile, &sz, &mapped);
+	if (data == NULL && mapFile == defaultmap) {
+		mapFile = boot_uname_r_str();
+		data = read_map_file(mapFile, &sz, &mapped);
+	}
+	if (data == NULL)
+		err(EXIT_FAILURE, "%s", mapFile);
+
+	memset(pm, 0, sizeof(*pm));
+
+	for (p = data, end = data + sz; p < end; maplineno++) {
+		char *eol = memchr(p, '\n', end - p);
+		unsigned long long addr;
+		const char *name;
+		size_t namesz;
+		char mode;
+
+		if (!eol)
+			eol = end;
+		if (parse_map_line(p, eol, &addr, &mode, &name, &namesz) != 0)
+			errx(EXIT_FAILURE, _("%s(%i): wrong map line"), mapFile,
+			     maplineno);
+		p = eol + 1;
+
+		if (!pm->nsyms) {
+			/* only elf works like this */
+			if (!is_name(name, namesz, "_stext") &&
+			    !is_name(name, namesz, "__stext"))
+				continue;
+			pm->add0 = addr;
+		} else if (!is_name(name, namesz, "_etext") &&
+			   !is_name(name, namesz, "__etext") &&
+			   mode != 'T' && mode != 't' &&
+			   mode != 'W' && mode != 'w' &&
+			   mode != 'A' && mode != '?')
+			break;	/* only text is profiled */
+
+		if (pm->nsyms == allocated) {
+			allocated = allocated ? allocated * 2 : 4096;
+			pm->syms = xrealloc(pm->syms, allocated * sizeof(*pm->syms));
+		}
+		pm->syms[pm->nsyms].addr = addr;
+		pm->syms[pm->nsyms].mode = mode;
+		pm->syms[pm->nsyms].name = xstrndup(name, namesz);
+		pm->nsyms++;
+
+		/* the kernel only profiles up to _etext */
+		if (is_name(name, namesz, "_etext") ||
+		    is_name(name, namesz, "__etext"))
+			break;
+	}
+
+	if (!pm->add0)
+		errx(EXIT_FAILURE, _("can't find \"_stext\" in %s"), mapFile);
+
+	if (mapped)
+		munmap(data, sz);
+	else
+		free(data);
+}
+
+/* Use an fd for the profiling buffer, to skip stdio overhead */
+static unsigned int *read_profile(char *proFile, size_t *len, int optNative)
+{
+	static int reversed_warned;
+	unsigned int *buf;
+	int proFd;
+	ssize_t rc;
+
+	if (((proFd = open(proFile, O_RDONLY)) < 0)
+	    || ((int)(*len = lseek(proFd, 0, SEEK_END)) < 0)
+	    || (lseek(proFd, 0, SEEK_SET) < 0))
+		err(EXIT_FAILURE, "%s", proFile);
+	if (!*len)
+		errx(EXIT_FAILURE, "%s: %s", proFile, _("input file is empty"));
+
+	buf = xmalloc(*len);
+
+	rc = read_all(proFd, (char *) buf, *len);
+	if (rc < 0 || (size_t) rc != *len)
+		err(EXIT_FAILURE, "%s", proFile);
+	close(proFd);
+
+	if (!optNative) {
+		int entries = *len / sizeof(*buf);
+		int big = 0, small = 0;
+		unsigned *p;
+		size_t i;
+
+		for (p = buf + 1; p < buf + entries; p++) {
+			if (*p & ~0U << ((unsigned) sizeof(*buf) * 4U))
+				big++;
+			if (*p & ((1U << ((unsigned) sizeof(*buf) * 4U)) - 1U))
+				small++;
+		}
+		if (big > small) {
+			if (!reversed_warned++)
+				warnx(_("Assuming reversed byte order. "
+					"Use -n to force native byte order."));
+			for (p = buf; p < buf + entries; p++)
+				for (i = 0; i < sizeof(*buf) / 2; i++) {
+					unsigned char *b = (unsigned char *)p;
+					unsigned char tmp;
+					tmp = b[i];
+					b[i] = b[sizeof(*buf) - i - 1];
+					b[sizeof(*buf) - i - 1] = tmp;
+				}
+		}
+	}
+	return buf;
+}
+
+static int optAll, optVerbose, optBins, optSub;
+
+static void print_profile(struct profile_map *pm, unsigned int *buf, size_t len)
+{
+	size_t nbufs = len / sizeof(*buf), indx = 1, i;
+	unsigned long long add0 = pm->add0, fn_add, next_add;
+	unsigned int step = buf[0], total = 0, fn_len;
+	unsigned int *sum;		/* sum[i] = buf[1] + ... + buf[i - 1] */
+	const char *fn_name;
+
+	if (!step)
+		errx(EXIT_FAILURE, _("profile sampling step is zero"));
+
+	/* the symbols are summarized without the loop over the buckets */
+	sum = xmalloc((nbufs + 1) * sizeof(*sum));
+	sum[0] = sum[1] = 0;
+	for (i = 1; i < nbufs; i++)
+		sum[i + 1] = sum[i] + buf[i];
+
+	fn_add = pm->syms[0].addr;
+	fn_name = pm->syms[0].name;
+
+	for (i = 1; i < pm->nsyms; i++) {
+		struct map_symbol *sym = &pm->syms[i];
+		unsigned int this = 0;
+		size_t last;
+
+		next_add = sym->addr;
+
+		/* ignore any LEADING (before a '[tT]' symbol
+		 * is found) Absolute symbols and __init_end
+		 * because some architectures place it before
+		 * .text section */
+		if ((sym->mode == 'A' || sym->mode == '?') &&
+		    strcmp(sym->name, "_etext") && strcmp(sym->name, "__etext")) {
+			if (total == 0 || !strcmp(sym->name, "__init_end"))
+				continue;
+			break;	/* only text is profiled */
+		}
+
+		if (indx >= nbufs)
+			errx(EXIT_FAILURE,
+			     _("profile address out of range. Wrong map file?"));
+
+		last = (next_add - add0) / step;
+		if (last > nbufs)
+			last = nbufs;
+
+		if (optBins) {
+			int header_printed = 0;
+			size_t x;
+
+			for (x = indx; x < last; x++) {
+				if (!buf[x] && !optAll)
+					continue;
+				if (!header_printed) {
+					printf("%s:\n", fn_name);
+					header_printed = 1;
+				}
+				printf("\t%llx\t%u\n",
+				       (unsigned long long) (x - 1) * step + add0,
+				       buf[x]);
+			}
+		}
+		if (indx < last) {
+			this = sum[last] - sum[indx];
+			indx = last;
+		}
+		total += this;
+
+		if (optBins) {
+			if (optVerbose || this > 0)
+				printf("  total\t\t\t\t%u\n", this);
+		} else if ((this || optAll) &&
+			   (fn_len = next_add - fn_add) != 0) {
+			if (optVerbose)
+				printf("%016llx %-40s %6u %8.4f\n", fn_add,
+				       fn_name, this, this / (double)fn_len);
+			else
+				printf("%6u %-40s %8.4f\n",
+				       this, fn_name, this / (double)fn_len);
+			if (optSub) {
+				unsigned long long scan;
+
+				for (scan = (fn_add - add0) / step + 1;
+				     scan < (next_add - add0) / step && scan < nbufs;
+				     scan++) {
+					unsigned long long addr;
+					addr = (scan - 1) * step + add0;
+					printf("\t%#llx\t%s+%#llx\t%u\n",
+					       addr, fn_name, addr - fn_add,
+					       buf[scan]);
+				}
+			}
+		}
+
+		fn_add = next_add;
+		fn_name = sym->name;
+	}
+
+	/* clock ticks, out of kernel text - probably modules */
+	printf("%6u %s\n", buf[nbufs - 1], "*unknown*");
+
+	/* trailer */
+	if (optVerbose)
+		printf("%016x %-40s %6u %8.4f\n",
+		       0, "total", total, total / (double)(fn_add - add0));
+	else
+		printf("%6u %-40s %8.4f\n",
+		       total, _("total"), total / (double)(fn_add - add0));
+
+	free(sum);
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -121,6 +475,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -s, --counters            print individual counters within functions\n"), out);
 	fputs(_(" -r, --reset               reset all the counters (root only)\n"), out);
 	fputs(_(" -n, --no-auto             disable byte order auto-detection\n"), out);
+	fputs(_("     --interval <secs>     print the profile again every <secs> seconds\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(27));
 	printf(USAGE_MAN_TAIL("readprofile(8)"));
@@ -129,25 +484,17 @@ static void __attribute__((__noreturn__)) usage(void)
 
 int main(int argc, char **argv)
 {
-	FILE *map;
-	int proFd;
+	struct profile_map pm;
 	char *mapFile, *proFile, *mult = NULL;
-	size_t len = 0, indx = 1;
-	unsigned long long add0 = 0;
-	unsigned int step;
-	unsigned int *buf, total, fn_len;
-	unsigned long long fn_add = 0, next_add; /* current and next address */
-	char fn_name[S_LEN], next_name[S_LEN];	/* current and next name */
-	char mode[8];
+	size_t len = 0;
+	unsigned int *buf;
+	uint32_t interval = 0;
 	int c;
-	ssize_t rc;
-	int optAll = 0, optInfo = 0, optReset = 0, optVerbose = 0, optNative = 0;
-	int optBins = 0, optSub = 0;
-	char mapline[S_LEN];
-	int maplineno = 1;
-	int popenMap;		/* flag to tell if popen() has been used */
-	int header_printed;
+	int optInfo = 0, optReset = 0, optNative = 0;
 
+	enum {
+		OPT_INTERVAL = CHAR_MAX + 1
+	};
 	static const struct option longopts[] = {
 		{"mapfile", required_argument, NULL, 'm'},
 		{"profile", required_argument, NULL, 'p'},
@@ -159,13 +506,12 @@ int main(int argc, char **argv)
 		{"counters", no_argument, NULL, 's'},
 		{"reset", no_argument, NULL, 'r'},
 		{"no-auto", no_argument, NULL, 'n'},
+		{"interval", required_argument, NULL, OPT_INTERVAL},
 		{"version", no_argument, NULL, 'V'},
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
 
-#define next (current^1)
-
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
 	textdomain(PACKAGE);
@@ -206,6 +552,11 @@ int main(int argc, char **argv)
 		case 'v':
 			optVerbose++;
 			break;
+		case OPT_INTERVAL:
+			interval = strtou32_or_err(optarg, _("invalid interval argument"));
+			if (!interval)
+				errx(EXIT_FAILURE, _("invalid interval argument"));
+			break;
 
 		case 'V':
 			print_version(EXIT_SUCCESS);
@@ -241,169 +592,26 @@ int main(int argc, char **argv)
 		exit(EXIT_SUCCESS);
 	}
 
-	/* Use an fd for the profiling buffer, to skip stdio overhead */
-	if (((proFd = open(proFile, O_RDONLY)) < 0)
-	    || ((int)(len = lseek(proFd, 0, SEEK_END)) < 0)
-	    || (lseek(proFd, 0, SEEK_SET) < 0))
-		err(EXIT_FAILURE, "%s", proFile);
-	if (!len)
-		errx(EXIT_FAILURE, "%s: %s", proFile, _("input file is empty"));
-
-	buf = xmalloc(len);
-
-	rc = read(proFd, buf, len);
-	if (rc < 0 || (size_t) rc != len)
-		err(EXIT_FAILURE, "%s", proFile);
-	close(proFd);
-
-	if (!optNative) {
-		int entries = len / sizeof(*buf);
-		int big = 0, small = 0;
-		unsigned *p;
-		size_t i;
-
-		for (p = buf + 1; p < buf + entries; p++) {
-			if (*p & ~0U << ((unsigned) sizeof(*buf) * 4U))
-				big++;
-			if (*p & ((1U << ((unsigned) sizeof(*buf) * 4U)) - 1U))
-				small++;
-		}
-		if (big > small) {
-			warnx(_("Assuming reversed byte order. "
-				"Use -n to force native byte order."));
-			for (p = buf; p < buf + entries; p++)
-				for (i = 0; i < sizeof(*buf) / 2; i++) {
-					unsigned char *b = (unsigned char *)p;
-					unsigned char tmp;
-					tmp = b[i];
-					b[i] = b[sizeof(*buf) - i - 1];
-					b[sizeof(*buf) - i - 1] = tmp;
-				}
-		}
-	}
-
-	step = buf[0];
+	buf = read_profile(proFile, &len, optNative);
 	if (optInfo) {
-		printf(_("Sampling_step: %u\n"), step);
+		printf(_("Sampling_step: %u\n"), buf[0]);
 		exit(EXIT_SUCCESS);
 	}
 
-	total = 0;
-
-	map = myopen(mapFile, "r", &popenMap);
-	if (map == NULL && mapFile == defaultmap) {
-		mapFile = boot_uname_r_str();
-		map = myopen(mapFile, "r", &popenMap);
-	}
-	if (map == NULL)
-		err(EXIT_FAILURE, "%s", mapFile);
+	load_map(&pm, mapFile);
 
-	while (fgets(mapline, S_LEN, map)) {
-		if (sscanf(mapline, "%llx %7[^\n ] %127[^\n ]", &fn_add, mode, fn_name) != 3)
-			errx(EXIT_FAILURE, _("%s(%i): wrong map line"), mapFile,
-			     maplineno);
-		/* only elf works like this */
-		if (!strcmp(fn_name, "_stext") || !strcmp(fn_name, "__stext")) {
-			add0 = fn_add;
+	for (;;) {
+		print_profile(&pm, buf, len);
+		free(buf);
+		if (!interval)
 			break;
-		}
-		maplineno++;
-	}
 
-	if (!add0)
-		errx(EXIT_FAILURE, _("can't find \"_stext\" in %s"), mapFile);
-
-	/*
-	 * Main loop.
-	 */
-	while (fgets(mapline, S_LEN, map)) {
-		unsigned int this = 0;
-		int done = 0;
-
-		if (sscanf(mapline, "%llx %7[^\n ] %127[^\n ]", &next_add, mode, next_name) != 3)
-			errx(EXIT_FAILURE, _("%s(%i): wrong map line"), mapFile,
-			     maplineno);
-		header_printed = 0;
-
-		/* the kernel only profiles up to _etext */
-		if (!strcmp(next_name, "_etext") ||
-		    !strcmp(next_name, "__etext"))
-			done = 1;
-		else {
-			/* ignore any LEADING (before a '[tT]' symbol
-			 * is found) Absolute symbols and __init_end
-			 * because some architectures place it before
-			 * .text section */
-			if ((*mode == 'A' || *mode == '?')
-			    && (total == 0 || !strcmp(next_name, "__init_end")))
-				continue;
-			if (*mode != 'T' && *mode != 't' &&
-			    *mode != 'W' && *mode != 'w')
-				break;	/* only text is profiled */
-		}
-
-		if (indx >= len / sizeof(*buf))
-			errx(EXIT_FAILURE,
-			     _("profile address out of range. Wrong map file?"));
-
-		while (indx < (next_add - add0) / step) {
-			if (optBins && (buf[indx] || optAll)) {
-				if (!header_printed) {
-					printf("%s:\n", fn_name);
-					header_printed = 1;
-				}
-				printf("\t%llx\t%u\n", (indx - 1) * step + add0,
-				       buf[indx]);
-			}
-			this += buf[indx++];
-		}
-		total += this;
-
-		if (optBins) {
-			if (optVerbose || this > 0)
-				printf("  total\t\t\t\t%u\n", this);
-		} else if ((this || optAll) &&
-			   (fn_len = next_add - fn_add) != 0) {
-			if (optVerbose)
-				printf("%016llx %-40s %6u %8.4f\n", fn_add,
-				       fn_name, this, this / (double)fn_len);
-			else
-				printf("%6u %-40s %8.4f\n",
-				       this, fn_name, this / (double)fn_len);
-			if (optSub) {
-				unsigned long long scan;
-
-				for (scan = (fn_add - add0) / step + 1;
-				     scan < (next_add - add0) / step;
-				     scan++) {
-					unsigned long long addr;
-					addr = (scan - 1) * step + add0;
-					printf("\t%#llx\t%s+%#llx\t%u\n",
-					       addr, fn_name, addr - fn_add,
-					       buf[scan]);
-				}
-			}
-		}
-
-		fn_add = next_add;
-		strcpy(fn_name, next_name);
-
-		maplineno++;
-		if (done)
-			break;
+		/* only the profile is read again, the map is cached */
+		fflush(stdout);
+		sleep(interval);
+		putchar('\n');
+		buf = read_profile(proFile, &len, optNative);
 	}
 
-	/* clock ticks, out of kernel text - probably modules */
-	printf("%6u %s\n", buf[len / sizeof(*buf) - 1], "*unknown*");
-
-	/* trailer */
-	if (optVerbose)
-		printf("%016x %-40s %6u %8.4f\n",
-		       0, "total", total, total / (double)(fn_add - add0));
-	else
-		printf("%6u %-40s %8.4f\n",
-		       total, _("total"), total / (double)(fn_add - add0));
-
-	popenMap ? pclose(map) : fclose(map);
 	exit(EXIT_SUCCESS);
 }
@@ -11,6 +11,7 @@
 #include <fcntl.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <sys/ioctl.h>
 
 #include <libsmartcols.h>
 
@@ -23,6 +24,9 @@
 #include "strutils.h"
 #include "optutils.h"
 #include "closestream.h"
+#include "monotonic.h"
+#include "sysfs.h"
+#include "ranges.h"
 
 #include "swapheader.h"
 #include "swapprober.h"
@@ -64,8 +68,15 @@
 # define swapon(path, flags) syscall(SYS_swapon, path, flags)
 #endif
 
+#ifndef BLKDISCARD
+# define BLKDISCARD	_IO(0x12,119)
+#endif
+
 #define MAX_PAGESIZE	(64 * 1024)
 
+/* --discard-offload step */
+#define DISCARD_STEP	(1024 * 1024 * 1024)
+
 #ifndef UUID_STR_LEN
 # define UUID_STR_LEN	37
 #endif
@@ -116,6 +127,8 @@ struct swap_device {
 	const char *label;		/* swap label */
 	const char *uuid;		/* unique identifier */
 	unsigned int pagesize;
+	unsigned long long swapsize;	/* valid swap area or 0 */
+	unsigned int isblk : 1;		/* block device */
 };
 
 /* control struct */
@@ -130,6 +143,8 @@ struct swapon_ctl {
 		bytes:1,		/* display --show in bytes */
 		fix_page_size:1,	/* reinitialize page size */
 		no_heading:1,		/* toggle --show headers */
+		parallel:1,		/* --all on more disks at once */
+		discard_offload:1,	/* discard by BLKDISCARD before swapon */
 		raw:1,			/* toggle --show alignment */
 		show:1,			/* display --show information */
 		verbose:1;		/* be chatty */
@@ -524,6 +539,8 @@ static int swapon_checks(const struct swapon_ctl *ctl, struct swap_device *dev)
 		goto err;
 	}
 
+	dev->isblk = S_ISBLK(st.st_mode) ? 1 : 0;
+
 	permMask = S_ISBLK(st.st_mode) ? 07007 : 07077;
 	if ((st.st_mode & permMask) != 0)
 		warnx(_("%s: insecure permissions %04o, %04o suggested."),
@@ -577,6 +594,7 @@ static int swapon_checks(const struct swapon_ctl *ctl, struct swap_device *dev)
 					dev->path, swapsize);
 
 		} else if (syspg < 0 || (unsigned int) syspg != dev->pagesize) {
+			/* dev->swapsize is not set, the area may be reinitialized */
 			if (ctl->fix_page_size) {
 				int rc;
 
@@ -591,7 +609,8 @@ static int swapon_checks(const struct swapon_ctl *ctl, struct swap_device *dev)
 				warnx(_("%s: swap format pagesize does not match. "
 					"(Use --fixpgsz to reinitialize it.)"),
 					dev->path);
-		}
+		} else
+			dev->swapsize = swapsize;
 	} else if (sig == SIG_SWSUSPEND) {
 		/* We have to reinitialize swap with old (=useless) software suspend
 		 * data. The problem is that if we don't do it, then we get data
@@ -614,12 +633,54 @@ err:
 	return -1;
 }
 
+static double time_diff(const struct timeval *a, const struct timeval *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_usec - a->tv_usec) / 1E6;
+}
+
+/*
+ * Discards the swap area (without the header page) by BLKDISCARD in steps,
+ * rather than by the kernel in swapon(2). Returns 0 on success.
+ */
+static int swap_discard_area(const struct swapon_ctl *ctl, const struct swap_device *dev)
+{
+	uint64_t range[2], off = dev->pagesize;
+	struct timeval start, now;
+	int fd, rc = 0;
+
+	fd = open(dev->path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	gettime_monotonic(&start);
+	while (off < dev->swapsize) {
+		range[0] = off;
+		range[1] = min((uint64_t) DISCARD_STEP, (uint64_t) dev->swapsize - off);
+
+		if (ioctl(fd, BLKDISCARD, &range) < 0) {
+			rc = -errno;
+			break;
+		}
+		off += range[1];
+	}
+	close(fd);
+
+	if (ctl->verbose && rc == 0) {
+		gettime_monotonic(&now);
+		printf(_("%s: discarded %llu bytes in %.3f seconds\n"), dev->path,
+			(unsigned long long) (dev->swapsize - dev->pagesize),
+			time_diff(&start, &now));
+	}
+	return rc;
+}
+
 static int do_swapon(const struct swapon_ctl *ctl,
 		     const struct swap_prop *prop,
 		     const char *spec,
 		     int canonic)
 {
 	struct swap_device dev = { .path = NULL };
+	struct timeval start, now;
 	int status;
 	int flags = 0;
 	int priority;
@@ -666,12 +727,37 @@ static int do_swapon(const struct swapon_ctl *ctl,
 			flags |= prop->discard;
 	}
 
+	/*
+	 * The single-time discard is done by BLKDISCARD rather than by
+	 * swapon(2); the kernel discard is still used on failure.
+	 */
+	if (ctl->discard_offload && dev.isblk && dev.swapsize &&
+	    (flags & SWAP_FLAG_DISCARD) && !(flags & SWAP_FLAG_DISCARD_PAGES)) {
+		int rc = swap_discard_area(ctl, &dev);
+
+		if (rc == 0) {
+			int pages = !(flags & SWAP_FLAG_DISCARD_ONCE);
+
+			flags &= ~SWAP_FLAGS_DISCARD_VALID;
+			if (pages)
+				flags |= SWAP_FLAG_DISCARD | SWAP_FLAG_DISCARD_PAGES;
+		} else if (ctl->verbose)
+			warnx(_("%s: discard failed, leaving it on swapon: %s"),
+				dev.path, strerror(-rc));
+	}
+
 	if (ctl->verbose)
 		printf(_("swapon %s\n"), dev.path);
 
+	gettime_monotonic(&start);
 	status = swapon(dev.path, flags);
 	if (status < 0)
 		warn(_("%s: swapon failed"), dev.path);
+	else if (ctl->verbose) {
+		gettime_monotonic(&now);
+		printf(_("%s: swapon took %.3f seconds\n"), dev.path,
+			time_diff(&start, &now));
+	}
 
 	return status;
 }
@@ -722,16 +808,106 @@ static int parse_options(struct swap_prop *props, const char *options)
 }
 
 
+/*
+ * swapon --all --parallel: the areas are grouped by whole disks, the groups
+ * are activated at the same time (one thread per disk) and the areas on the
+ * same disk one after another in the fstab order.
+ */
+struct swapon_area {
+	char			*device;
+	struct swap_prop	prop;
+	dev_t			disk;
+};
+
+struct swapon_group {
+	const struct swapon_ctl	*ctl;
+	struct swapon_area	**areas;
+	size_t			nareas;
+	int			status;
+};
+
+static dev_t get_area_disk(const char *device)
+{
+	struct stat st;
+	dev_t devno, disk = 0;
+
+	if (stat(device, &st) != 0)
+		return 0;
+
+	devno = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+	if (sysfs_devno_to_wholedisk(devno, NULL, 0, &disk) != 0 || !disk)
+		disk = devno;
+	return disk;
+}
+
+static void activate_groups(void *data, size_t range __attribute__((__unused__)),
+			    size_t first, size_t last)
+{
+	struct swapon_group *groups = data;
+	size_t i, j;
+
+	for (i = first; i < last; i++) {
+		struct swapon_group *gr = &groups[i];
+
+		for (j = 0; j < gr->nareas; j++)
+			gr->status |= do_swapon(gr->ctl, &gr->areas[j]->prop,
+						gr->areas[j]->device, TRUE);
+	}
+}
+
+static int swapon_areas(struct swapon_ctl *ctl, struct swapon_area *areas, size_t nareas)
+{
+	struct swapon_group *groups;
+	size_t i, j, ngroups = 0;
+	int status = 0;
+
+	groups = xcalloc(nareas, sizeof(struct swapon_group));
+
+	for (i = 0; i < nareas; i++) {
+		struct swapon_group *gr = NULL;
+
+		for (j = 0; j < ngroups; j++) {
+			if (groups[j].areas[0]->disk == areas[i].disk) {
+				gr = &groups[j];
+				break;
+			}
+		}
+		if (!gr) {
+			gr = &groups[ngroups++];
+			gr->ctl = ctl;
+			gr->areas = xcalloc(nareas, sizeof(struct swapon_area *));
+		}
+		gr->areas[gr->nareas++] = &areas[i];
+	}
+
+	/* every group (disk) by own thread */
+	if (ngroups)
+		ul_run_ranges(ngroups, 1, ngroups, activate_groups, groups);
+
+	for (i = 0; i < ngroups; i++) {
+		status |= groups[i].status;
+		free(groups[i].areas);
+	}
+
+	free(groups);
+	return status;
+}
+
 static int swapon_all(struct swapon_ctl *ctl)
 {
 	struct libmnt_table *tb = get_fstab();
 	struct libmnt_iter *itr;
 	struct libmnt_fs *fs;
+	struct swapon_area *areas = NULL;
+	size_t i, nareas = 0, nalloc = 0;
 	int status = 0;
+	struct timeval start, now;
 
 	if (!tb)
 		err(EXIT_FAILURE, _("failed to parse %s"), mnt_get_fstab_path());
 
+	gettime_monotonic(&start);
+
 	itr = mnt_new_iter(MNT_ITER_FORWARD);
 	if (!itr)
 		err(EXIT_FAILURE, _("failed to initialize libmount iterator"));
@@ -776,8 +952,42 @@ static int swapon_all(struct swapon_ctl *ctl)
 			continue;
 		}
 
-		/* swapon */
-		status |= do_swapon(ctl, &prop, device, TRUE);
+		if (!ctl->parallel) {
+			/* swapon */
+			status |= do_swapon(ctl, &prop, device, TRUE);
+			continue;
+		}
+
+		for (i = 0; i < nareas; i++) {
+			if (strcmp(areas[i].device, device) == 0)
+				break;
+		}
+		if (i < nareas) {
+			if (ctl->verbose)
+				warnx(_("%s: already active -- ignored"), device);
+			continue;
+		}
+		if (nareas == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 8;
+			areas = xrealloc(areas, nalloc * sizeof(struct swapon_area));
+		}
+		areas[nareas].device = xstrdup(device);
+		areas[nareas].prop = prop;
+		areas[nareas].disk = get_area_disk(device);
+		nareas++;
+	}
+
+	if (nareas)
+		status |= swapon_areas(ctl, areas, nareas);
+	for (i = 0; i < nareas; i++)
+		free(areas[i].device);
+	free(areas);
+
+	if (ctl->verbose && ctl->parallel) {
+		gettime_monotonic(&now);
+		printf(P_("%zu swap area activated in %.3f seconds\n",
+			  "%zu swap areas activated in %.3f seconds\n", nareas),
+			nareas, time_diff(&start, &now));
 	}
 
 	mnt_free_iter(itr);
@@ -803,6 +1013,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -f, --fixpgsz            reinitialize the swap space if necessary\n"), out);
 	fputs(_(" -o, --options <list>     comma-separated list of swap options\n"), out);
 	fputs(_(" -p, --priority <prio>    specify the priority of the swap device\n"), out);
+	fputs(_("     --parallel           with --all, enable swaps on more disks at once\n"), out);
+	fputs(_("     --discard-offload    do the single-time discard before swapon\n"), out);
 	fputs(_(" -s, --summary            display summary about used swap devices (DEPRECATED)\n"), out);
 	fputs(_("     --show[=<columns>]   display summary in definable table\n"), out);
 	fputs(_("     --noheadings         don't print table heading (with --show)\n"), out);
@@ -847,7 +1059,9 @@ int main(int argc, char *argv[])
 		NOHEADINGS_OPTION,
 		RAW_OPTION,
 		SHOW_OPTION,
-		OPT_LIST_TYPES
+		OPT_LIST_TYPES,
+		PARALLEL_OPTION,
+		DISCARD_OFFLOAD_OPTION
 	};
 
 	static const struct option long_opts[] = {
@@ -866,6 +1080,8 @@ int main(int argc, char *argv[])
 		{ "noheadings", no_argument,       NULL, NOHEADINGS_OPTION },
 		{ "raw",        no_argument,       NULL, RAW_OPTION        },
 		{ "bytes",      no_argument,       NULL, BYTES_OPTION      },
+		{ "parallel",   no_argument,       NULL, PARALLEL_OPTION   },
+		{ "discard-offload", no_argument,  NULL, DISCARD_OFFLOAD_OPTION },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -963,6 +1179,12 @@ int main(int argc, char *argv[])
 		case BYTES_OPTION:
 			ctl.bytes = 1;
 			break;
+		case PARALLEL_OPTION:
+			ctl.parallel = 1;
+			break;
+		case DISCARD_OFFLOAD_OPTION:
+			ctl.discard_offload = 1;
+			break;
 		case 0:
 			break;
 
@@ -989,7 +1211,7 @@ int main(int argc, char *argv[])
 		return status;
 	}
 
-	if (ctl.props.no_fail && !ctl.all) {
+	if ((ctl.props.no_fail || ctl.parallel) && !ctl.all) {
 		warnx(_("bad usage"));
 		errtryhelp(EXIT_FAILURE);
 	}
@@ -35,6 +35,7 @@
 #include "closestream.h"
 #include "pathnames.h"
 #include "canonicalize.h"
+#include "strutils.h"
 
 #define XALLOC_EXIT_CODE MNT_EX_SYSERR
 #include "xalloc.h"
@@ -98,6 +99,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -n, --no-mtab           don't write to /etc/mtab\n"), out);
 	fputs(_(" -l, --lazy              detach the filesystem now, clean up things later\n"), out);
 	fputs(_(" -O, --test-opts <list>  limit the set of filesystems (use with -a)\n"), out);
+	fputs(_("     --parallel[=<num>]  unmount by <num> processes in dependency order (use with -a or -R)\n"), out);
 	fputs(_(" -R, --recursive         recursively unmount a target with all its children\n"), out);
 	fputs(_(" -r, --read-only         in case unmounting fails, try to remount read-only\n"), out);
 	fputs(_(" -t, --types <list>      limit the set of filesystem types\n"), out);
@@ -209,6 +211,42 @@ static int umount_all(struct libmnt_context *cxt)
 	return rc;
 }
 
+/* called in the child process */
+static int umount_all_excode(struct libmnt_context *cxt, struct libmnt_fs *fs,
+			     int mntrc, void *data __attribute__((__unused__)))
+{
+	int rc = mk_exit_code(cxt, mntrc);
+
+	if (rc == MNT_EX_SUCCESS && mnt_context_is_verbose(cxt))
+		printf("%-25s: successfully unmounted\n", mnt_fs_get_target(fs));
+	return rc;
+}
+
+/* called in the parent process in reverse mtab order */
+static void umount_all_report(struct libmnt_context *cxt, struct libmnt_fs *fs,
+			      int status, int ignored, void *data)
+{
+	int *rc = (int *) data;
+
+	if (ignored) {
+		if (mnt_context_is_verbose(cxt))
+			printf(_("%-25s: ignored\n"), mnt_fs_get_target(fs));
+	} else
+		*rc |= status;
+}
+
+static int umount_all_parallel(struct libmnt_context *cxt, size_t nworkers)
+{
+	int rc = 0;
+
+	if (mnt_context_umount_parallel(cxt, nworkers, umount_all_excode,
+					umount_all_report, &rc)) {
+		warn(_("failed to unmount filesystems"));
+		return MNT_EX_SYSERR;
+	}
+	return rc;
+}
+
 static int umount_one(struct libmnt_context *cxt, const char *spec)
 {
 	int rc;
@@ -320,7 +358,32 @@ done:
 	return rc;
 }
 
-static int umount_recursive(struct libmnt_context *cxt, const char *spec)
+/* called in the parent process in the recursive umount order */
+static void umount_tree_report(struct libmnt_context *cxt __attribute__((__unused__)),
+			       struct libmnt_fs *fs __attribute__((__unused__)),
+			       int status, int ignored, void *data)
+{
+	int *rc = (int *) data;
+
+	if (!ignored)
+		*rc |= status;
+}
+
+static int umount_tree_parallel(struct libmnt_context *cxt,
+		struct libmnt_table *tb, struct libmnt_fs *fs, size_t nworkers)
+{
+	int rc = 0;
+
+	if (mnt_context_umount_tree_parallel(cxt, tb, fs, nworkers,
+				umount_all_excode, umount_tree_report, &rc)) {
+		warn(_("failed to unmount %s"), mnt_fs_get_target(fs));
+		return MNT_EX_SYSERR;
+	}
+	return rc;
+}
+
+static int umount_recursive(struct libmnt_context *cxt, const char *spec,
+			    size_t nworkers)
 {
 	struct libmnt_table *tb;
 	struct libmnt_fs *fs;
@@ -334,7 +397,9 @@ static int umount_recursive(struct libmnt_context *cxt, const char *spec)
 	mnt_context_disable_swapmatch(cxt, 1);
 
 	fs = mnt_table_find_target(tb, spec, MNT_ITER_BACKWARD);
-	if (fs)
+	if (fs && nworkers)
+		rc = umount_tree_parallel(cxt, tb, fs, nworkers);
+	else if (fs)
 		rc = umount_do_recurse(cxt, tb, fs);
 	else {
 		rc = MNT_EX_USAGE;
@@ -450,9 +515,11 @@ int main(int argc, char **argv)
 	int c, rc = 0, all = 0, recursive = 0, alltargets = 0;
 	struct libmnt_context *cxt;
 	char *types = NULL;
+	size_t parallel = 0;
 
 	enum {
 		UMOUNT_OPT_FAKE = CHAR_MAX + 1,
+		UMOUNT_OPT_PARALLEL
 	};
 
 	static const struct option longopts[] = {
@@ -474,6 +541,7 @@ int main(int argc, char **argv)
 		{ "verbose",         no_argument,       NULL, 'v'             },
 		{ "version",         no_argument,       NULL, 'V'             },
 		{ "namespace",       required_argument, NULL, 'N'             },
+		{ "parallel",        optional_argument, NULL, UMOUNT_OPT_PARALLEL },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -525,6 +593,15 @@ int main(int argc, char **argv)
 		case UMOUNT_OPT_FAKE:
 			mnt_context_enable_fake(cxt, TRUE);
 			break;
+		case UMOUNT_OPT_PARALLEL:
+			if (optarg)
+				parallel = strtou32_or_err(optarg,
+						_("invalid number of processes"));
+			else {
+				long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+				parallel = ncpus > 0 ? ncpus : 1;
+			}
+			break;
 		case 'f':
 			mnt_context_enable_force(cxt, TRUE);
 			break;
@@ -592,7 +669,10 @@ int main(int argc, char **argv)
 			types = "noproc,nodevfs,nodevpts,nosysfs,norpc_pipefs,nonfsd,noselinuxfs";
 
 		mnt_context_set_fstype_pattern(cxt, types);
-		rc = umount_all(cxt);
+		if (parallel)
+			rc = umount_all_parallel(cxt, parallel);
+		else
+			rc = umount_all(cxt);
 
 	} else if (argc < 1) {
 		warnx(_("bad usage"));
@@ -603,7 +683,7 @@ int main(int argc, char **argv)
 			rc += umount_alltargets(cxt, *argv++, recursive);
 	} else if (recursive) {
 		while (argc--)
-			rc += umount_recursive(cxt, *argv++);
+			rc += umount_recursive(cxt, *argv++, parallel);
 	} else {
 		while (argc--) {
 			char *path = *argv;
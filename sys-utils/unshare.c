@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/prctl.h>
+#include <sys/statfs.h>
 #include <grp.h>
 
 /* we only need some defines missing in sys/mount.h, no libmount linkage */
@@ -45,6 +46,7 @@
 #include "all-io.h"
 #include "signames.h"
 #include "strutils.h"
+#include "statfs_magic.h"
 
 /* synchronize parent and child by pipe */
 #define PIPE_SYNC_BYTE	0x06
@@ -70,6 +72,8 @@ static struct namespace_file {
 
 static int npersists;	/* number of persistent namespaces */
 
+static const char *template_dir;	/* --template */
+
 enum {
 	SETGROUPS_NONE = -1,
 	SETGROUPS_DENY = 0,
@@ -248,6 +252,88 @@ static void bind_ns_files_from_child(pid_t *child, int fds[2])
 	}
 }
 
+/* returns path of the namespace file in the template directory */
+static char *template_path(struct namespace_file *ns)
+{
+	char *path;
+
+	/* "ns/<type>" -> "<dir>/<type>" */
+	xasprintf(&path, "%s/%s", template_dir, ns->name + 3);
+	return path;
+}
+
+/*
+ * Returns 1 if all the namespaces are persisted in the template directory,
+ * 0 if none of them.
+ */
+static int template_is_ready(int flags)
+{
+	struct namespace_file *ns;
+	int ready = 0, missing = 0;
+
+	for (ns = namespace_files; ns->name; ns++) {
+		struct statfs sfs;
+		char *path;
+
+		if (!(ns->type & flags))
+			continue;
+		path = template_path(ns);
+		if (statfs(path, &sfs) == 0 && sfs.f_type == STATFS_NSFS_MAGIC)
+			ready++;
+		else
+			missing++;
+		free(path);
+	}
+	if (ready && missing)
+		errx(EXIT_FAILURE, _("incomplete namespaces template %s"), template_dir);
+	return ready ? 1 : 0;
+}
+
+/* the namespaces will be created and persisted by bind_ns_files() */
+static void template_create(int flags)
+{
+	struct namespace_file *ns;
+
+	for (ns = namespace_files; ns->name; ns++) {
+		char *path;
+		int fd;
+
+		if (!(ns->type & flags))
+			continue;
+		path = template_path(ns);
+		fd = open(path, O_RDONLY | O_CREAT | O_CLOEXEC, 0444);
+		if (fd < 0)
+			err(EXIT_FAILURE, _("cannot open %s"), path);
+		close(fd);
+		set_ns_target(ns->type, path);
+	}
+}
+
+/*
+ * Enters the persisted namespaces, the user namespace first, so the other
+ * namespaces are entered with the capabilities from the user namespace.
+ */
+static void template_enter(int flags)
+{
+	struct namespace_file *ns;
+
+	for (ns = namespace_files; ns->name; ns++) {
+		char *path;
+		int fd;
+
+		if (!(ns->type & flags))
+			continue;
+		path = template_path(ns);
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			err(EXIT_FAILURE, _("cannot open %s"), path);
+		if (setns(fd, ns->type) != 0)
+			err(EXIT_FAILURE, _("reassociate to namespace '%s' failed"), path);
+		close(fd);
+		free(path);
+	}
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -279,6 +365,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	        "                           modify mount propagation in mount namespace\n"), out);
 	fputs(_(" --setgroups allow|deny    control the setgroups syscall in user namespaces\n"), out);
 	fputs(_(" --keep-caps               retain capabilities granted in user namespaces\n"), out);
+	fputs(_(" --template <dir>          persist the namespaces to <dir> the first time,\n"
+		"                             enter them from <dir> next time\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_(" -R, --root=<dir>	    run the command with root directory set to <dir>\n"), out);
 	fputs(_(" -w, --wd=<dir>	    change working directory to <dir>\n"), out);
@@ -300,6 +388,7 @@ int main(int argc, char *argv[])
 		OPT_SETGROUPS,
 		OPT_KILLCHILD,
 		OPT_KEEPCAPS,
+		OPT_TEMPLATE,
 	};
 	static const struct option longopts[] = {
 		{ "help",          no_argument,       NULL, 'h'             },
@@ -321,6 +410,7 @@ int main(int argc, char *argv[])
 		{ "propagation",   required_argument, NULL, OPT_PROPAGATION },
 		{ "setgroups",     required_argument, NULL, OPT_SETGROUPS   },
 		{ "keep-caps",     no_argument,       NULL, OPT_KEEPCAPS    },
+		{ "template",      required_argument, NULL, OPT_TEMPLATE    },
 		{ "setuid",	   required_argument, NULL, 'S'		    },
 		{ "setgid",	   required_argument, NULL, 'G'		    },
 		{ "root",	   required_argument, NULL, 'R'		    },
@@ -342,7 +432,7 @@ int main(int argc, char *argv[])
 	int force_uid = 0, force_gid = 0;
 	uid_t uid = 0, real_euid = geteuid();
 	gid_t gid = 0, real_egid = getegid();
-	int keepcaps = 0;
+	int keepcaps = 0, entered = 0;
 
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
@@ -443,6 +533,9 @@ int main(int argc, char *argv[])
 		case 'w':
 			newdir = optarg;
 			break;
+		case OPT_TEMPLATE:
+			template_dir = optarg;
+			break;
 
 		case 'h':
 			usage();
@@ -453,13 +546,31 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (npersists && (unshare_flags & CLONE_NEWNS))
+	if (template_dir) {
+		if (npersists)
+			errx(EXIT_FAILURE, _("--template and persistent namespace "
+					"files are mutually exclusive"));
+		if (!unshare_flags)
+			errx(EXIT_FAILURE, _("no namespace specified for --template"));
+		if (unshare_flags & CLONE_NEWPID)
+			errx(EXIT_FAILURE, _("PID namespace is not supported by --template"));
+
+		/* the maps, setgroups, propagation and /proc are already
+		 * set in the persisted namespaces */
+		if (template_is_ready(unshare_flags)) {
+			template_enter(unshare_flags);
+			entered = 1;
+		} else
+			template_create(unshare_flags);
+	}
+
+	if (!entered && npersists && (unshare_flags & CLONE_NEWNS))
 		bind_ns_files_from_child(&pid, fds);
 
-	if (-1 == unshare(unshare_flags))
+	if (!entered && -1 == unshare(unshare_flags))
 		err(EXIT_FAILURE, _("unshare failed"));
 
-	if (npersists) {
+	if (!entered && npersists) {
 		if (pid && (unshare_flags & CLONE_NEWNS)) {
 			int rc;
 			char ch = PIPE_SYNC_BYTE;
@@ -512,7 +623,7 @@ int main(int argc, char *argv[])
          * has been disabled unless /proc/self/setgroups is written
          * first to permanently disable the ability to call setgroups
          * in that user namespace. */
-        switch (mapuser) {
+        switch (entered ? MAP_USER_NONE : mapuser) {
         case MAP_USER_ROOT:
 		if (setgrpcmd == SETGROUPS_ALLOW)
 			errx(EXIT_FAILURE, _("options --setgroups=allow and "
@@ -532,11 +643,11 @@ int main(int argc, char *argv[])
 		map_id(_PATH_PROC_GIDMAP, real_egid, real_egid);
                 break;
         case MAP_USER_NONE:
-	        if (setgrpcmd != SETGROUPS_NONE)
+	        if (setgrpcmd != SETGROUPS_NONE && !entered)
 		        setgroups_control(setgrpcmd);
         }
 
-	if ((unshare_flags & CLONE_NEWNS) && propagation)
+	if ((unshare_flags & CLONE_NEWNS) && propagation && !entered)
 		set_propagation(propagation);
 
 	if (newroot) {
@@ -548,7 +659,7 @@ int main(int argc, char *argv[])
 	if (newdir && chdir(newdir))
 		err(EXIT_FAILURE, _("cannot chdir to '%s'"), newdir);
 
-	if (procmnt) {
+	if (procmnt && !entered) {
 		if (!newroot && mount("none", procmnt, NULL, MS_PRIVATE|MS_REC, NULL) != 0)
 			err(EXIT_FAILURE, _("umount %s failed"), procmnt);
 		if (mount("proc", procmnt, "proc", MS_NOSUID|MS_NOEXEC|MS_NODEV, NULL) != 0)
@@ -23,6 +23,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #include <dirent.h>
 
@@ -36,7 +37,6 @@
 #include "sysfs.h"
 #include "optutils.h"
 #include "ismounted.h"
-#include "strv.h"
 #include "path.h"
 #include "pathnames.h"
 
@@ -112,9 +112,10 @@ static const char *mm_stat_names[] = {
 struct zram {
 	char	devname[32];
 	struct	path_cxt *sysfs;	/* device specific sysfs directory */
-	char	**mm_stat;
+	uint64_t mm_stat[ARRAY_SIZE(mm_stat_names)];	/* parsed mm_stat */
 
 	unsigned int mm_stat_probed : 1,
+		     has_mm_stat : 1,
 		     control_probed : 1,
 		     has_control : 1;	/* has /sys/class/zram-control/ */
 };
@@ -151,9 +152,8 @@ static int column_name_to_id(const char *name, size_t namesz)
 static void zram_reset_stat(struct zram *z)
 {
 	if (z) {
-		strv_free(z->mm_stat);
-		z->mm_stat = NULL;
 		z->mm_stat_probed = 0;
+		z->has_mm_stat = 0;
 	}
 }
 
@@ -321,13 +321,18 @@ static int zram_control_remove(struct zram *z)
 	return ul_path_write_u64(ctl, n, "hot_remove");
 }
 
-static struct zram *find_free_zram(void)
+/*
+ * Returns the first free device, the devices are checked from *@first and
+ * *@first is updated to the next device, so more free devices are found
+ * without checking the already used devices again.
+ */
+static struct zram *find_free_zram(size_t *first)
 {
 	struct zram *z = new_zram(NULL);
 	size_t i;
 	int isfree = 0;
 
-	for (i = 0; isfree == 0; i++) {
+	for (i = *first; isfree == 0; i++) {
 		DBG(fprintf(stderr, "find free: checking zram%zu", i));
 		zram_set_devname(z, NULL, i);
 		if (!zram_exist(z) && zram_control_add(z) != 0)
@@ -338,9 +343,34 @@ static struct zram *find_free_zram(void)
 		free_zram(z);
 		z = NULL;
 	}
+	*first = i;
 	return z;
 }
 
+/*
+ * Linux >= 4.1 uses /sys/block/zram<id>/mm_stat, the file is read and parsed
+ * only once for all the columns.
+ */
+static void zram_read_mm_stat(struct zram *z, struct path_cxt *sysfs)
+{
+	char *str = NULL, *tok, *save = NULL;
+	size_t n = 0;
+
+	z->mm_stat_probed = 1;
+	if (ul_path_read_string(sysfs, &str, "mm_stat") <= 0 || !str)
+		goto done;
+
+	for (tok = strtok_r(str, " ", &save);
+	     tok && n < ARRAY_SIZE(mm_stat_names);
+	     tok = strtok_r(NULL, " ", &save))
+		z->mm_stat[n++] = strtou64_or_err(tok, _("Failed to parse mm_stat"));
+
+	/* make sure kernel provides mm_stat as expected */
+	z->has_mm_stat = n == ARRAY_SIZE(mm_stat_names);
+done:
+	free(str);
+}
+
 static char *get_mm_stat(struct zram *z, size_t idx, int bytes)
 {
 	struct path_cxt *sysfs;
@@ -355,27 +385,15 @@ static char *get_mm_stat(struct zram *z, size_t idx, int bytes)
 	if (!sysfs)
 		return NULL;
 
-	/* Linux >= 4.1 uses /sys/block/zram<id>/mm_stat */
-	if (!z->mm_stat && !z->mm_stat_probed) {
-		if (ul_path_read_string(sysfs, &str, "mm_stat") > 0 && str) {
-			z->mm_stat = strv_split(str, " ");
+	if (!z->mm_stat_probed)
+		zram_read_mm_stat(z, sysfs);
 
-			/* make sure kernel provides mm_stat as expected */
-			if (strv_length(z->mm_stat) < ARRAY_SIZE(mm_stat_names)) {
-				strv_free(z->mm_stat);
-				z->mm_stat = NULL;
-			}
+	if (z->has_mm_stat) {
+		num = z->mm_stat[idx];
+		if (bytes) {
+			xasprintf(&str, "%" PRIu64, num);
+			return str;
 		}
-		z->mm_stat_probed = 1;
-		free(str);
-		str = NULL;
-	}
-
-	if (z->mm_stat) {
-		if (bytes)
-			return xstrdup(z->mm_stat[idx]);
-
-		num = strtou64_or_err(z->mm_stat[idx], _("Failed to parse mm_stat"));
 		return size_to_human_string(SIZE_SUFFIX_1LETTER, num);
 	}
 
@@ -391,6 +409,133 @@ static char *get_mm_stat(struct zram *z, size_t idx, int bytes)
 	return NULL;
 }
 
+/* resets and configures the device, returns 0 on success */
+static int zram_setup(struct zram *z, uint64_t size, uint64_t nstreams,
+		      const char *algorithm)
+{
+	if (zram_set_u64parm(z, "reset", 1)) {
+		warn(_("%s: failed to reset"), z->devname);
+		return -1;
+	}
+	if (nstreams &&
+	    zram_set_u64parm(z, "max_comp_streams", nstreams)) {
+		warn(_("%s: failed to set number of streams"), z->devname);
+		return -1;
+	}
+	if (algorithm &&
+	    zram_set_strparm(z, "comp_algorithm", algorithm)) {
+		warn(_("%s: failed to set algorithm"), z->devname);
+		return -1;
+	}
+	if (zram_set_u64parm(z, "disksize", size)) {
+		warn(_("%s: failed to set disksize (%ju bytes)"),
+			z->devname, size);
+		return -1;
+	}
+	return 0;
+}
+
+/* one line of the --batch file */
+struct zram_spec {
+	uintmax_t	size;
+	uint64_t	nstreams;
+	char		*algorithm;
+};
+
+/*
+ * The line is "<size> [algorithm=<name>] [streams=<number>]", empty lines
+ * and lines starting with '#' are ignored. Returns 1 for the ignored lines,
+ * 0 on success and -1 on parse error.
+ */
+static int parse_spec_line(char *line, struct zram_spec *sp)
+{
+	char *tok, *save = NULL;
+
+	memset(sp, 0, sizeof(*sp));
+	tok = strtok_r(line, " \t\n", &save);
+	if (!tok || *tok == '#')
+		return 1;
+	if (strtosize(tok, &sp->size) != 0)
+		return -1;
+
+	while ((tok = strtok_r(NULL, " \t\n", &save))) {
+		if (strncmp(tok, "algorithm=", 10) == 0 && tok[10])
+			sp->algorithm = tok + 10;
+		else if (strncmp(tok, "streams=", 8) == 0
+			 && isdigit_string(tok + 8))
+			sp->nstreams = strtoumax(tok + 8, NULL, 10);
+		else
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Configures a free device for every line of @filename ("-" for stdin). The
+ * whole file is parsed before the first device is touched, the free devices
+ * are found (or added by hot_add) by one scan.
+ */
+static int create_batch(const char *filename)
+{
+	struct zram_spec *specs = NULL;
+	size_t i, nspecs = 0, nalloc = 0, first = 0, len = 0;
+	char *line = NULL, **lines = NULL;
+	int lineno = 0, rc = 0;
+	FILE *f;
+
+	if (strcmp(filename, "-") == 0)
+		f = stdin;
+	else if (!(f = fopen(filename, "r" UL_CLOEXECSTR)))
+		err(EXIT_FAILURE, _("cannot open %s"), filename);
+
+	while (getline(&line, &len, f) != -1) {
+		struct zram_spec sp;
+		int x;
+
+		lineno++;
+		x = parse_spec_line(line, &sp);
+		if (x < 0)
+			errx(EXIT_FAILURE, _("%s:%d: parse error"), filename, lineno);
+		if (x > 0)
+			continue;
+		if (nspecs == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			specs = xrealloc(specs, nalloc * sizeof(*specs));
+			lines = xrealloc(lines, nalloc * sizeof(*lines));
+		}
+		/* the algorithm points to the line */
+		lines[nspecs] = line;
+		specs[nspecs++] = sp;
+		line = NULL;
+		len = 0;
+	}
+	free(line);
+	if (f != stdin)
+		fclose(f);
+
+	for (i = 0; i < nspecs; i++) {
+		struct zram *z = find_free_zram(&first);
+
+		if (!z) {
+			warnx(_("no free zram device found"));
+			rc = 1;
+			break;
+		}
+		if (zram_setup(z, specs[i].size, specs[i].nstreams,
+			       specs[i].algorithm) == 0)
+			printf("%s\n", z->devname);
+		else
+			rc = 1;
+		free_zram(z);
+	}
+
+	for (i = 0; i < nspecs; i++)
+		free(lines[i]);
+	free(lines);
+	free(specs);
+	return rc;
+}
+
 static void fill_table_row(struct libscols_table *tb, struct zram *z)
 {
 	static struct libscols_line *ln;
@@ -546,6 +691,7 @@ static void __attribute__((__noreturn__)) usage(void)
 
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -a, --algorithm lzo|lz4|lz4hc|deflate|842   compression algorithm to use\n"), out);
+	fputs(_("     --batch <file>        set up a free device for every line of the file\n"), out);
 	fputs(_(" -b, --bytes               print sizes in bytes rather than in human readable format\n"), out);
 	fputs(_(" -f, --find                find a free device\n"), out);
 	fputs(_(" -n, --noheadings          don't print headings\n"), out);
@@ -576,7 +722,8 @@ enum {
 	A_STATUS,
 	A_CREATE,
 	A_FINDONLY,
-	A_RESET
+	A_RESET,
+	A_BATCH
 };
 
 int main(int argc, char **argv)
@@ -585,14 +732,18 @@ int main(int argc, char **argv)
 	char *algorithm = NULL;
 	int rc = 0, c, find = 0, act = A_NONE;
 	struct zram *zram = NULL;
+	const char *batch = NULL;
+	size_t first = 0;
 
 	enum {
 		OPT_RAW = CHAR_MAX + 1,
-		OPT_LIST_TYPES
+		OPT_LIST_TYPES,
+		OPT_BATCH
 	};
 
 	static const struct option longopts[] = {
 		{ "algorithm", required_argument, NULL, 'a' },
+		{ "batch",     required_argument, NULL, OPT_BATCH },
 		{ "bytes",     no_argument, NULL, 'b' },
 		{ "find",      no_argument, NULL, 'f' },
 		{ "help",      no_argument, NULL, 'h' },
@@ -607,9 +758,10 @@ int main(int argc, char **argv)
 		{ NULL, 0, NULL, 0 }
 	};
 
-	static const ul_excl_t excl[] = {
+	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
 		{ 'f', 'o', 'r' },
 		{ 'o', 'r', 's' },
+		{ 'a', 'f', 'o', 'r', 's', 't', OPT_BATCH },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -657,6 +809,10 @@ int main(int argc, char **argv)
 		case OPT_RAW:
 			raw = 1;
 			break;
+		case OPT_BATCH:
+			batch = optarg;
+			act = A_BATCH;
+			break;
 		case 'n':
 			no_headings = 1;
 			break;
@@ -676,6 +832,10 @@ int main(int argc, char **argv)
 	if (act == A_NONE)
 		act = find ? A_FINDONLY : A_STATUS;
 
+	if (act == A_BATCH && optind < argc)
+		errx(EXIT_FAILURE, _("option --batch is mutually exclusive "
+				     "with <device>"));
+
 	if (act != A_RESET && optind + 1 < argc)
 		errx(EXIT_FAILURE, _("only one <device> at a time is allowed"));
 
@@ -722,7 +882,7 @@ int main(int argc, char **argv)
 		}
 		break;
 	case A_FINDONLY:
-		zram = find_free_zram();
+		zram = find_free_zram(&first);
 		if (!zram)
 			errx(EXIT_FAILURE, _("no free zram device found"));
 		printf("%s\n", zram->devname);
@@ -730,7 +890,7 @@ int main(int argc, char **argv)
 		break;
 	case A_CREATE:
 		if (find) {
-			zram = find_free_zram();
+			zram = find_free_zram(&first);
 			if (!zram)
 				errx(EXIT_FAILURE, _("no free zram device found"));
 		} else if (optind == argc)
@@ -741,24 +901,15 @@ int main(int argc, char **argv)
 				err(EXIT_FAILURE, "%s", zram->devname);
 		}
 
-		if (zram_set_u64parm(zram, "reset", 1))
-			err(EXIT_FAILURE, _("%s: failed to reset"), zram->devname);
-
-		if (nstreams &&
-		    zram_set_u64parm(zram, "max_comp_streams", nstreams))
-			err(EXIT_FAILURE, _("%s: failed to set number of streams"), zram->devname);
-
-		if (algorithm &&
-		    zram_set_strparm(zram, "comp_algorithm", algorithm))
-			err(EXIT_FAILURE, _("%s: failed to set algorithm"), zram->devname);
-
-		if (zram_set_u64parm(zram, "disksize", size))
-			err(EXIT_FAILURE, _("%s: failed to set disksize (%ju bytes)"),
-				zram->devname, size);
+		if (zram_setup(zram, size, nstreams, algorithm))
+			exit(EXIT_FAILURE);
 		if (find)
 			printf("%s\n", zram->devname);
 		free_zram(zram);
 		break;
+	case A_BATCH:
+		rc = create_batch(batch);
+		break;
 	}
 
 	ul_unref_path(__control);
@@ -130,9 +130,13 @@
 /* Displayed before the login prompt. */
 #ifdef	SYSV_STYLE
 #  define ISSUE_SUPPORT
+#  include "closestream.h"
+#  include "fileutils.h"
+#  define AGETTY_CACHE_DIR	"/run"
+#  define AGETTY_CACHE_FILENAME	AGETTY_CACHE_DIR "/agetty.issue-cache"
+#  define AGETTY_CACHE_MAXSZ	(4 * 1024 * 1024)
 #  if defined(HAVE_SCANDIRAT) && defined(HAVE_OPENAT)
 #    include <dirent.h>
-#    include "fileutils.h"
 #    define ISSUEDIR_SUPPORT
 #    define ISSUEDIR_EXT	".issue"
 #    define ISSUEDIR_EXTSIZ	(sizeof(ISSUEDIR_EXT) - 1)
@@ -166,7 +170,8 @@ struct issue {
 	char *mem_old;
 #endif
 	unsigned int do_tcsetattr : 1,
-		     do_tcrestore : 1;
+		     do_tcrestore : 1,
+		     is_cache : 1;		/* expands for AGETTY_CACHE_FILENAME */
 };
 
 /*
@@ -1704,6 +1709,10 @@ static int wait_for_term_input(int fd)
 		} else if (netlink_fd >= 0 && FD_ISSET(netlink_fd, &rfds)) {
 			if (!process_netlink())
 				continue;
+#ifdef ISSUE_SUPPORT
+			/* the cached addresses are obsolete */
+			unlink(AGETTY_CACHE_FILENAME);
+#endif
 
 		/* Just drain the inotify buffer */
 		} else if (inotify_fd >= 0 && FD_ISSET(inotify_fd, &rfds)) {
@@ -1810,30 +1819,79 @@ static void show_issue(struct options *op __attribute__((__unused__)))
 
 #else /* ISSUE_SUPPORT */
 
-static int issuefile_read_stream(
-		struct issue *ie, FILE *f,
-		struct options *op, struct termios *tp)
+static void issue_open_output(struct issue *ie)
 {
-	struct stat st;
-	int c;
-
-	if (fstat(fileno(f), &st) || !S_ISREG(st.st_mode))
-		return 1;
-
 	if (!ie->output) {
 		free(ie->mem);
 		ie->mem_sz = 0;
 		ie->mem = NULL;
 		ie->output = open_memstream(&ie->mem, &ie->mem_sz);
 	}
+}
+
+/*
+ * The tty, time and users escapes are kept in the cache, the others are
+ * expanded and the backslashes in the result are escaped.
+ */
+static void output_cached_special_char(struct issue *ie,
+				unsigned char c,
+				struct options *op,
+				struct termios *tp,
+				FILE *fp)
+{
+	FILE *out = ie->output;
+	char *buf = NULL;
+	size_t bufsz = 0, i;
+
+	if (c && strchr("lbdtuU", c)) {
+		putc('\\', out);
+		putc(c, out);
+		return;
+	}
+
+	ie->output = open_memstream(&buf, &bufsz);
+	if (ie->output) {
+		output_special_char(ie, c, op, tp, fp);
+		fclose(ie->output);
+	}
+	ie->output = out;
+
+	for (i = 0; i < bufsz; i++) {
+		if (buf[i] == '\\')
+			putc('\\', out);
+		putc(buf[i], out);
+	}
+	free(buf);
+}
+
+static void issue_read_stream(
+		struct issue *ie, FILE *f,
+		struct options *op, struct termios *tp)
+{
+	int c;
+
+	issue_open_output(ie);
 
 	while ((c = getc(f)) != EOF) {
-		if (c == '\\')
-			output_special_char(ie, getc(f), op, tp, f);
-		else
+		if (c != '\\')
 			putc(c, ie->output);
+		else if (ie->is_cache)
+			output_cached_special_char(ie, getc(f), op, tp, f);
+		else
+			output_special_char(ie, getc(f), op, tp, f);
 	}
+}
+
+static int issuefile_read_stream(
+		struct issue *ie, FILE *f,
+		struct options *op, struct termios *tp)
+{
+	struct stat st;
+
+	if (fstat(fileno(f), &st) || !S_ISREG(st.st_mode))
+		return 1;
 
+	issue_read_stream(ie, f, op, tp);
 	return 0;
 }
 
@@ -1867,6 +1925,238 @@ static int issue_is_changed(struct issue *ie)
 }
 #endif
 
+static void issue_read_default(struct issue *ie,
+			       struct options *op,
+			       struct termios *tp)
+{
+	int has_file = 0;
+
+	/* The default /etc/issue and optional /etc/issue.d directory as
+	 * extension to the file. The /etc/issue.d directory is ignored if
+	 * there is no /etc/issue file. The file may be empty or symlink.
+	 */
+	if (access(_PATH_ISSUE, F_OK|R_OK) == 0) {
+		issuefile_read(ie, _PATH_ISSUE, op, tp);
+		issuedir_read(ie, _PATH_ISSUEDIR, op, tp);
+		return;
+	}
+
+	/* Fallback @runstatedir (usually /run) -- the file is not required to
+	 * read the dir.
+	 */
+	if (issuefile_read(ie, _PATH_RUNSTATEDIR "/" _PATH_ISSUE_FILENAME, op, tp) == 0)
+		has_file++;
+	if (issuedir_read(ie, _PATH_RUNSTATEDIR "/" _PATH_ISSUE_DIRNAME, op, tp) == 0)
+		has_file++;
+	if (has_file)
+		return;
+
+	/* Fallback @sysconfstaticdir (usually /usr/lib) -- the file is not
+	 * required to read the dir
+	 */
+	issuefile_read(ie, _PATH_SYSCONFSTATICDIR "/" _PATH_ISSUE_FILENAME, op, tp); 
+	issuedir_read(ie, _PATH_SYSCONFSTATICDIR "/" _PATH_ISSUE_DIRNAME, op, tp);
+}
+
+/*
+ * The default issue files are the same for all agetty instances, so the
+ * host specific escapes are expanded only once and the result is shared in
+ * AGETTY_CACHE_FILENAME. The first line of the cache is a key made from
+ * mtimes of all the possible issue and os-release files and from uname(2);
+ * if the key does not match, the cache is ignored and replaced. The cache
+ * with network addresses is removed when netlink reports an address change.
+ *
+ * The cache file format is:
+ *
+ *	<key>\n
+ *	<do_tcsetattr> <has_output> <netlink groups>\n
+ *	<issue with tty, time and users escapes>
+ */
+static void issue_cache_key_path(FILE *key, const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		fprintf(key, "%s:- ", path);
+		return;
+	}
+	fprintf(key, "%s:%ld.%09ld:%jd ", path, (long) st.st_mtim.tv_sec,
+			st.st_mtim.tv_nsec, (intmax_t) st.st_size);
+
+#ifdef ISSUEDIR_SUPPORT
+	if (S_ISDIR(st.st_mode)) {
+		struct dirent **namelist = NULL;
+		int dd, nfiles, i;
+
+		dd = open(path, O_RDONLY|O_CLOEXEC|O_DIRECTORY);
+		if (dd < 0)
+			return;
+		nfiles = scandirat(dd, ".", &namelist, issuedir_filter, versionsort);
+		for (i = 0; i < nfiles; i++) {
+			const char *name = namelist[i]->d_name;
+
+			if (fstatat(dd, name, &st, 0) == 0)
+				fprintf(key, "%s:%ld.%09ld:%jd ", name,
+					(long) st.st_mtim.tv_sec,
+					st.st_mtim.tv_nsec, (intmax_t) st.st_size);
+			free(namelist[i]);
+		}
+		free(namelist);
+		close(dd);
+	}
+#endif
+}
+
+static char *issue_cache_key(void)
+{
+	struct utsname uts;
+	char *key = NULL, *dom;
+	size_t keysz = 0;
+	FILE *f;
+
+	f = open_memstream(&key, &keysz);
+	if (!f)
+		return NULL;
+
+	fputs("agetty-issue-cache-1 ", f);
+	issue_cache_key_path(f, _PATH_ISSUE);
+	issue_cache_key_path(f, _PATH_ISSUEDIR);
+	issue_cache_key_path(f, _PATH_RUNSTATEDIR "/" _PATH_ISSUE_FILENAME);
+	issue_cache_key_path(f, _PATH_RUNSTATEDIR "/" _PATH_ISSUE_DIRNAME);
+	issue_cache_key_path(f, _PATH_SYSCONFSTATICDIR "/" _PATH_ISSUE_FILENAME);
+	issue_cache_key_path(f, _PATH_SYSCONFSTATICDIR "/" _PATH_ISSUE_DIRNAME);
+	issue_cache_key_path(f, _PATH_OS_RELEASE_ETC);
+	issue_cache_key_path(f, _PATH_OS_RELEASE_USR);
+
+	uname(&uts);
+	dom = xgetdomainname();
+	fprintf(f, "%s %s %s %s %s %s", uts.sysname, uts.nodename,
+			uts.release, uts.version, uts.machine, dom ? dom : "");
+	free(dom);
+
+	fclose(f);
+	if (key && strchr(key, '\n')) {
+		free(key);
+		key = NULL;
+	}
+	return key;
+}
+
+/* returns: 0 on success, 1 if there is no valid cache */
+static int issue_cache_read(const char *key, struct issue *cache,
+			    unsigned int *groups)
+{
+	struct stat st;
+	size_t keysz = strlen(key);
+	unsigned int tcset, has_output;
+	char *buf = NULL, *p, *end;
+	int fd, rc = 1;
+
+	fd = open(AGETTY_CACHE_FILENAME, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return 1;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)
+	    || (size_t) st.st_size <= keysz || st.st_size > AGETTY_CACHE_MAXSZ)
+		goto done;
+
+	buf = malloc(st.st_size + 1);
+	if (!buf)
+		log_err(_("failed to allocate memory: %m"));
+	if (read_all(fd, buf, st.st_size) != (ssize_t) st.st_size)
+		goto done;
+	buf[st.st_size] = '\0';
+	end = buf + st.st_size;
+
+	if (memcmp(buf, key, keysz) != 0 || buf[keysz] != '\n')
+		goto done;
+	p = buf + keysz + 1;
+	if (sscanf(p, "%u %u %u", &tcset, &has_output, groups) != 3)
+		goto done;
+	p = memchr(p, '\n', end - p);
+	if (!p)
+		goto done;
+	p++;
+
+	cache->do_tcsetattr = tcset ? 1 : 0;
+	if (has_output) {
+		cache->mem_sz = end - p;
+		memmove(buf, p, cache->mem_sz);
+		cache->mem = buf;
+		buf = NULL;
+	}
+	rc = 0;
+done:
+	free(buf);
+	close(fd);
+	return rc;
+}
+
+static void issue_cache_write(const char *key, struct issue *cache,
+			      unsigned int groups)
+{
+	char *tmpname = NULL;
+	FILE *f;
+
+	f = xfmkstemp(&tmpname, AGETTY_CACHE_DIR, "agetty.issue-cache");
+	if (!f)
+		return;		/* unprivileged, e.g. --show-issue */
+
+	fchmod(fileno(f), S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	fprintf(f, "%s\n%u %u %u\n", key, cache->do_tcsetattr,
+			cache->mem ? 1 : 0, groups);
+	if (cache->mem_sz)
+		fwrite(cache->mem, 1, cache->mem_sz, f);
+
+	if (close_stream(f) != 0 || rename(tmpname, AGETTY_CACHE_FILENAME) != 0)
+		unlink(tmpname);
+	free(tmpname);
+}
+
+/* returns: 0 if the default issue has been read by the cache */
+static int issue_cache_eval(struct issue *ie,
+			    struct options *op,
+			    struct termios *tp)
+{
+	struct issue cache = { .is_cache = 1 };
+	unsigned int groups = 0;
+	char *key;
+
+	key = issue_cache_key();
+	if (!key)
+		return 1;
+
+	if (issue_cache_read(key, &cache, &groups) != 0) {
+		issue_read_default(&cache, op, tp);
+		if (cache.output) {
+			fclose(cache.output);
+			cache.output = NULL;
+		}
+#ifdef AGETTY_RELOAD
+		groups = netlink_groups;
+#endif
+		issue_cache_write(key, &cache, groups);
+	}
+	free(key);
+
+#ifdef AGETTY_RELOAD
+	netlink_groups = groups;
+#endif
+	if (cache.do_tcsetattr)
+		ie->do_tcsetattr = 1;
+	if (cache.mem_sz) {
+		FILE *f = fmemopen(cache.mem, cache.mem_sz, "r");
+
+		if (f) {
+			issue_read_stream(ie, f, op, tp);
+			fclose(f);
+		}
+	} else if (cache.mem)
+		issue_open_output(ie);
+
+	free(cache.mem);
+	return 0;
+}
+
 static void print_issue_file(struct issue *ie,
 			     struct options *op,
 			     struct termios *tp)
@@ -1912,8 +2202,6 @@ static void eval_issue_file(struct issue *ie,
 			    struct options *op,
 			    struct termios *tp)
 {
-	int has_file = 0;
-
 #ifdef AGETTY_RELOAD
 	netlink_groups = 0;
 #endif
@@ -1937,32 +2225,8 @@ static void eval_issue_file(struct issue *ie,
 	}
 
 
-	/* The default /etc/issue and optional /etc/issue.d directory as
-	 * extension to the file. The /etc/issue.d directory is ignored if
-	 * there is no /etc/issue file. The file may be empty or symlink.
-	 */
-	if (access(_PATH_ISSUE, F_OK|R_OK) == 0) {
-		issuefile_read(ie, _PATH_ISSUE, op, tp);
-		issuedir_read(ie, _PATH_ISSUEDIR, op, tp);
-		goto done;
-	}
-
-	/* Fallback @runstatedir (usually /run) -- the file is not required to
-	 * read the dir.
-	 */
-	if (issuefile_read(ie, _PATH_RUNSTATEDIR "/" _PATH_ISSUE_FILENAME, op, tp) == 0)
-		has_file++;
-	if (issuedir_read(ie, _PATH_RUNSTATEDIR "/" _PATH_ISSUE_DIRNAME, op, tp) == 0)
-		has_file++;
-	if (has_file)
-		goto done;
-
-	/* Fallback @sysconfstaticdir (usually /usr/lib) -- the file is not
-	 * required to read the dir
-	 */
-	issuefile_read(ie, _PATH_SYSCONFSTATICDIR "/" _PATH_ISSUE_FILENAME, op, tp); 
-	issuedir_read(ie, _PATH_SYSCONFSTATICDIR "/" _PATH_ISSUE_DIRNAME, op, tp);
-
+	if (issue_cache_eval(ie, op, tp) != 0)
+		issue_read_default(ie, op, tp);
 done:
 
 #ifdef AGETTY_RELOAD
@@ -2929,7 +3193,13 @@ err:
 static void reload_agettys(void)
 {
 #ifdef AGETTY_RELOAD
-	int fd = open(AGETTY_RELOAD_FILENAME, O_CREAT|O_CLOEXEC|O_WRONLY,
+	int fd;
+
+#ifdef ISSUE_SUPPORT
+	/* force the agettys to expand the issue files again */
+	unlink(AGETTY_CACHE_FILENAME);
+#endif
+	fd = open(AGETTY_RELOAD_FILENAME, O_CREAT|O_CLOEXEC|O_WRONLY,
 					      S_IRUSR|S_IWUSR);
 	if (fd < 0)
 		err(EXIT_FAILURE, _("cannot open %s"), AGETTY_RELOAD_FILENAME);
@@ -14,6 +14,7 @@
 #include "closestream.h"
 #include "nls.h"
 #include "strutils.h"
+#include "all-io.h"
 #include "script-playutils.h"
 
 UL_DEBUG_DEFINE_MASK(scriptreplay);
@@ -29,7 +30,15 @@ UL_DEBUG_DEFINE_MASKNAMES(scriptreplay) = UL_DEBUG_EMPTY_MASKNAMES;
  *
  * The step data are stored in log files, the right log file for the step is
  * selected from replay_setup.
+ *
+ * The seek to the recorded time uses index of the timing file. The index is
+ * built by one pass over the timing file (the data logs are not read), and
+ * every REPLAY_INDEX_STEP entries it keeps the recorded time and positions in
+ * the timing file and in all the data logs.
  */
+#define REPLAY_INDEX_STEP	1024
+#define REPLAY_COPY_BUFSZ	(64 * 1024)
+
 enum {
 	REPLAY_TIMING_SIMPLE,		/* timing info in classic "<delta> <offset>" format */
 	REPLAY_TIMING_MULTI		/* multiple streams in format "<type> <delta> <offset|etc> */
@@ -54,6 +63,12 @@ struct replay_step {
 	struct replay_log *data;
 };
 
+struct replay_index {
+	struct timeval	time;		/* recorded time before the entry */
+	off_t		timing_off;	/* position of the entry in the timing file */
+	int		timing_line;
+};
+
 struct replay_setup {
 	struct replay_log	*logs;
 	size_t			nlogs;
@@ -64,6 +79,15 @@ struct replay_setup {
 	const char		*timing_filename;
 	int			timing_format;
 	int			timing_line;
+	struct timeval		timing_time;	/* recorded time of the current position */
+	struct timeval		delay_cut;	/* already seeked part of the next delay */
+
+	struct replay_index	*index;
+	off_t			*index_offs;	/* nindex * nlogs data logs positions */
+	size_t			nindex;
+
+	char			*linebuf;	/* for index reader */
+	size_t			linebufsz;
 
 	struct timeval		delay_max;
 	struct timeval		delay_min;
@@ -111,6 +135,9 @@ void replay_free_setup(struct replay_setup *stp)
 		return;
 
 	free(stp->logs);
+	free(stp->index);
+	free(stp->index_offs);
+	free(stp->linebuf);
 	free(stp->step.name);
 	free(stp->step.value);
 	free(stp);
@@ -433,6 +460,7 @@ int replay_get_next_step(struct replay_setup *stp, char *streams, struct replay_
 		}
 
 		DBG(TIMING, ul_debug(" step entry is '%c'", step->type));
+		timerinc(&stp->timing_time, &step->delay);
 
 		log = replay_get_stream_log(stp, step->type);
 		if (log) {
@@ -461,6 +489,15 @@ done:
 	if (timerisset(&ignored_delay))
 		timerinc(&step->delay, &ignored_delay);
 
+	/* the first step after seek, remove the already skipped time */
+	if (timerisset(&stp->delay_cut)) {
+		if (timercmp(&step->delay, &stp->delay_cut, >))
+			timersub(&step->delay, &stp->delay_cut, &step->delay);
+		else
+			timerclear(&step->delay);
+		timerclear(&stp->delay_cut);
+	}
+
 	DBG(TIMING, ul_debug("reading next step done [rc=%d delay=%ld.%06ld (ignored=%ld.%06ld) size=%zu]",
 				rc,
 				step->delay.tv_sec, step->delay.tv_usec,
@@ -488,12 +525,50 @@ done:
 	return rc;
 }
 
+/* copies @size bytes from @f to @fd; return: 0 = success, <0 = error, 1 = EOF */
+static int copy_log_data(FILE *f, size_t size, int cr2nl, int fd)
+{
+	char buf[REPLAY_COPY_BUFSZ];
+	size_t ct;
+	int rc = 0;
+
+	for (ct = size; ct > 0; ) {
+		size_t len, cc;
+
+		cc = ct > sizeof(buf) ? sizeof(buf): ct;
+		len = fread(buf, 1, cc, f);
+
+		if (!len) {
+			DBG(LOG, ul_debug("log data emit: failed to read log %m"));
+			break;
+		}
+
+		if (cr2nl) {
+			char *p = buf, *end = buf + len;
+
+			while ((p = memchr(p, 0x0D, end - p)))
+				*p++ = '\n';
+		}
+
+		ct -= len;
+		if (write_all(fd, buf, len)) {
+			rc = -errno;
+			DBG(LOG, ul_debug("log data emit: failed write data %m"));
+			break;
+		}
+	}
+
+	if (ct && ferror(f))
+		rc = -errno;
+	if (ct && feof(f))
+		rc = 1;
+	return rc;
+}
+
 /* return: 0 = success, <0 = error, 1 = done (EOF) */
 int replay_emit_step_data(struct replay_setup *stp, struct replay_step *step, int fd)
 {
-	size_t ct;
 	int rc = 0, cr2nl = 0;
-	char buf[BUFSIZ];
 
 	assert(stp);
 	assert(step);
@@ -531,40 +606,320 @@ int replay_emit_step_data(struct replay_setup *stp, struct replay_step *step, in
 		break;
 	}
 
-	for (ct = step->size; ct > 0; ) {
-		size_t len, cc;
+	rc = copy_log_data(step->data->fp, step->size, cr2nl, fd);
 
-		cc = ct > sizeof(buf) ? sizeof(buf): ct;
-		len = fread(buf, 1, cc, step->data->fp);
+	DBG(LOG, ul_debug("log data emitted [rc=%d size=%zu]", rc, step->size));
+	return rc;
+}
 
-		if (!len) {
-			DBG(LOG, ul_debug("log data emit: failed to read log %m"));
+/*
+ * Reads the next timing entry without the name and value of the signal and
+ * header entries. It's used to build the index and to skip the entries,
+ * so it's faster than the fscanf() based replay_get_next_step().
+ *
+ * returns: 0 = success, <0 = error, 1 = EOF
+ */
+static int read_timing_entry(struct replay_setup *stp, char *type,
+			     struct timeval *delay, size_t *size)
+{
+	char *p, *end;
+	ssize_t len;
+	int i;
+
+	errno = 0;
+	len = getline(&stp->linebuf, &stp->linebufsz, stp->timing_fp);
+	if (len < 0)
+		return ferror(stp->timing_fp) ? -errno : 1;
+
+	p = stp->linebuf;
+	if (stp->timing_format == REPLAY_TIMING_SIMPLE)
+		*type = stp->default_type;
+	else {
+		*type = *p++;
+		while (isblank((unsigned char) *p))
+			p++;
+	}
+
+	/* "<sec>.<usec>" where <usec> is at most 6 digits (see fscanf()) */
+	errno = 0;
+	delay->tv_sec = strtol(p, &end, 10);
+	if (errno || end == p || *end != '.')
+		return -EINVAL;
+	p = end + 1;
+	delay->tv_usec = 0;
+	for (i = 0; i < 6 && isdigit((unsigned char) *p); i++, p++)
+		delay->tv_usec = delay->tv_usec * 10 + (*p - '0');
+
+	*size = 0;
+	if (*type == 'I' || *type == 'O') {
+		unsigned long long x;
+
+		errno = 0;
+		x = strtoull(p, &end, 10);
+		if (errno || end == p)
+			return -EINVAL;
+		*size = x;
+	}
+	return 0;
+}
+
+static void add_index(struct replay_setup *stp, const struct timeval *tm,
+		      off_t timing_off, int timing_line, const off_t *offs)
+{
+	struct replay_index *ix;
+
+	if ((stp->nindex & (stp->nindex - 1)) == 0) {
+		size_t n = stp->nindex ? stp->nindex * 2 : 16;
+
+		stp->index = xrealloc(stp->index, n * sizeof(*ix));
+		stp->index_offs = xrealloc(stp->index_offs,
+					   n * stp->nlogs * sizeof(off_t));
+	}
+
+	ix = &stp->index[stp->nindex];
+	ix->time = *tm;
+	ix->timing_off = timing_off;
+	ix->timing_line = timing_line;
+	memcpy(&stp->index_offs[stp->nindex * stp->nlogs], offs,
+	       stp->nlogs * sizeof(off_t));
+	stp->nindex++;
+}
+
+/* reads the current positions of all data logs to @offs */
+static int get_logs_offsets(struct replay_setup *stp, off_t *offs)
+{
+	size_t i;
+
+	for (i = 0; i < stp->nlogs; i++) {
+		offs[i] = 0;
+		if (stp->logs[i].noseek)
+			continue;
+		offs[i] = ftello(stp->logs[i].fp);
+		if (offs[i] < 0)
+			return -errno;
+	}
+	return 0;
+}
+
+static int set_logs_offsets(struct replay_setup *stp, const off_t *offs)
+{
+	size_t i;
+
+	for (i = 0; i < stp->nlogs; i++) {
+		if (stp->logs[i].noseek)
+			continue;
+		if (fseeko(stp->logs[i].fp, offs[i], SEEK_SET) != 0)
+			return -errno;
+	}
+	return 0;
+}
+
+/*
+ * Builds index from the current position to the end of the timing file. The
+ * current position is not modified.
+ */
+static int replay_build_index(struct replay_setup *stp)
+{
+	struct timeval tm = stp->timing_time;
+	int rc, line = stp->timing_line;
+	size_t nentries = 0;
+	off_t start, off, *offs;
+
+	start = off = ftello(stp->timing_fp);
+	if (start < 0)
+		return -errno;
+
+	offs = xcalloc(stp->nlogs ? stp->nlogs : 1, sizeof(off_t));
+	rc = get_logs_offsets(stp, offs);
+
+	while (rc == 0) {
+		struct replay_log *log;
+		struct timeval delay;
+		size_t size;
+		char type;
+
+		if (nentries++ % REPLAY_INDEX_STEP == 0)
+			add_index(stp, &tm, off, line, offs);
+
+		rc = read_timing_entry(stp, &type, &delay, &size);
+		if (rc)
 			break;
+		off = ftello(stp->timing_fp);
+		timerinc(&tm, &delay);
+		line++;
+
+		log = replay_get_stream_log(stp, type);
+		if (log && !log->noseek)
+			offs[log - stp->logs] += size;
+	}
+	free(offs);
+
+	DBG(TIMING, ul_debug("index: %zu entries, %zu checkpoints [rc=%d]",
+				nentries - 1, stp->nindex, rc));
+	if (rc < 0)
+		return rc;
+
+	if (fseeko(stp->timing_fp, start, SEEK_SET) != 0)
+		return -errno;
+	return 0;
+}
+
+/* returns the last checkpoint with time <= @tm */
+static struct replay_index *replay_find_index(struct replay_setup *stp,
+					      const struct timeval *tm)
+{
+	size_t lo = 0, hi = stp->nindex;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (timercmp(&stp->index[mid].time, tm, >))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo ? &stp->index[lo - 1] : NULL;
+}
+
+/*
+ * Returns the log if all @streams data are in one log and the log contains
+ * only wanted streams, so the data may be copied by one range.
+ */
+static struct replay_log *get_bulk_log(struct replay_setup *stp, const char *streams)
+{
+	struct replay_log *res = NULL;
+	const char *p;
+	size_t i;
+
+	if (!streams)
+		return NULL;
+	for (p = streams; *p; p++) {
+		if (*p != 'I' && *p != 'O')
+			return NULL;	/* signals and headers are per entry */
+	}
+	for (i = 0; i < stp->nlogs; i++) {
+		struct replay_log *log = &stp->logs[i];
+
+		if (log->noseek || !strpbrk(log->streams, streams))
+			continue;
+		if (res)
+			return NULL;
+		for (p = log->streams; *p; p++) {
+			if (!strchr(streams, *p))
+				return NULL;
+		}
+		res = log;
+	}
+	if (res && stp->crmode == REPLAY_CRMODE_AUTO && strchr(res->streams, 'I')
+	    && strchr(res->streams, 'O'))
+		return NULL;	/* '\r' conversion differs for the entries */
+	return res;
+}
+
+/*
+ * Moves to the recorded time @tm (the original time of the session, the
+ * divisor and max delay do not matter); the next replay_get_next_step()
+ * returns the first step which ends after @tm. If @fd is not negative, the
+ * data of the @streams before @tm are written to the @fd without delays
+ * (signals and headers are ignored).
+ *
+ * returns: 0 = success, <0 = error, 1 = done (EOF)
+ */
+int replay_seek_time(struct replay_setup *stp, char *streams,
+		     const struct timeval *tm, int fd)
+{
+	struct replay_log *bulk = NULL;
+	off_t bulk_start = 0;
+	int rc = 0;
+
+	assert(stp);
+	assert(stp->timing_fp);
+	assert(tm);
+
+	DBG(TIMING, ul_debug("seek to %ld.%06ld", tm->tv_sec, tm->tv_usec));
+
+	if (timercmp(tm, &stp->timing_time, <))
+		return 0;		/* seek backward is unsupported */
+	if (!stp->index) {
+		rc = replay_build_index(stp);
+		if (rc)
+			return rc;
+	}
+
+	if (fd >= 0) {
+		bulk = get_bulk_log(stp, streams);
+		if (bulk) {
+			bulk_start = ftello(bulk->fp);
+			if (bulk_start < 0)
+				rc = -errno;
 		}
+	}
 
-		if (cr2nl) {
-			size_t i;
+	/* jump to the nearest checkpoint, except if all data have to be emitted */
+	if (rc == 0 && (fd < 0 || bulk)) {
+		struct replay_index *ix = replay_find_index(stp, tm);
 
-			for (i = 0; i < len; i++) {
-				if (buf[i] == 0x0D)
-					buf[i] = '\n';
-			}
+		if (ix && ix->timing_off > ftello(stp->timing_fp)) {
+			DBG(TIMING, ul_debug(" jump to line %d", ix->timing_line));
+			if (fseeko(stp->timing_fp, ix->timing_off, SEEK_SET) != 0)
+				rc = -errno;
+			else
+				rc = set_logs_offsets(stp, &stp->index_offs[
+						(ix - stp->index) * stp->nlogs]);
+			stp->timing_time = ix->time;
+			stp->timing_line = ix->timing_line;
 		}
+	}
 
-		ct -= len;
-		cc = write(fd, buf, len);
-		if (cc != len) {
-			rc = -errno;
-			DBG(LOG, ul_debug("log data emit: failed write data %m"));
+	/* walk to the entry which ends after @tm */
+	while (rc == 0) {
+		struct replay_log *log;
+		struct timeval delay, end;
+		off_t off = ftello(stp->timing_fp);
+		size_t size;
+		char type;
+
+		rc = read_timing_entry(stp, &type, &delay, &size);
+		if (rc)
+			break;
+
+		timeradd(&stp->timing_time, &delay, &end);
+		if (timercmp(&end, tm, >)) {
+			if (fseeko(stp->timing_fp, off, SEEK_SET) != 0)
+				rc = -errno;
+			timersub(tm, &stp->timing_time, &stp->delay_cut);
 			break;
 		}
+		stp->timing_time = end;
+		stp->timing_line++;
+
+		log = replay_get_stream_log(stp, type);
+		if (!log || log->noseek || !size)
+			continue;
+		if (fd >= 0 && !bulk && is_wanted_stream(type, streams)) {
+			int cr2nl = stp->crmode == REPLAY_CRMODE_ALWAYS ||
+				    (stp->crmode == REPLAY_CRMODE_AUTO && type == 'I');
+
+			rc = copy_log_data(log->fp, size, cr2nl, fd);
+		} else
+			rc = replay_seek_log(log, size);
 	}
 
-	if (ct && ferror(step->data->fp))
-		rc = -errno;
-	if (ct && feof(step->data->fp))
-		rc = 1;
+	/* emit all the skipped data by one range */
+	if (bulk && rc >= 0) {
+		off_t end = ftello(bulk->fp);
+		int cr2nl = stp->crmode == REPLAY_CRMODE_ALWAYS ||
+			    (stp->crmode == REPLAY_CRMODE_AUTO && strchr(bulk->streams, 'I'));
 
-	DBG(LOG, ul_debug("log data emitted [rc=%d size=%zu]", rc, step->size));
+		if (end < 0 || fseeko(bulk->fp, bulk_start, SEEK_SET) != 0)
+			rc = -errno;
+		else {
+			int xrc = copy_log_data(bulk->fp, end - bulk_start, cr2nl, fd);
+			if (xrc)
+				rc = xrc;
+		}
+	}
+
+	DBG(TIMING, ul_debug("seek done [rc=%d, line=%d]", rc, stp->timing_line));
 	return rc;
 }
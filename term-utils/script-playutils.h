@@ -46,5 +46,6 @@ int replay_step_is_empty(struct replay_step *step);
 int replay_get_next_step(struct replay_setup *stp, char *streams, struct replay_step **xstep);
 
 int replay_emit_step_data(struct replay_setup *stp, struct replay_step *step, int fd);
+int replay_seek_time(struct replay_setup *stp, char *streams, const struct timeval *tm, int fd);
 
 #endif /* UTIL_LINUX_SCRIPT_PLAYUTILS_H */
@@ -88,6 +88,14 @@ UL_DEBUG_DEFINE_MASKNAMES(script) = UL_DEBUG_EMPTY_MASKNAMES;
 
 #define DEFAULT_TYPESCRIPT_FILENAME "typescript"
 
+/*
+ * The logs are fully buffered by large buffers (the timing entries are only a
+ * few bytes), without --flush the dirty logs are flushed from the pty mainloop
+ * once per SCRIPT_FLUSH_INTERVAL rather than by every buffer overflow.
+ */
+#define SCRIPT_LOG_BUFSZ	(64 * 1024)
+#define SCRIPT_FLUSH_INTERVAL	1		/* seconds */
+
 /*
  * Script is driven by stream (stdout/stdin) activity. It's possible to
  * associate arbitrary number of log files with the stream. We have two basic
@@ -144,7 +152,8 @@ struct script_control {
 	 flush:1,		/* flush after each write */
 	 quiet:1,		/* suppress most output */
 	 force:1,		/* write output to links */
-	 isterm:1;		/* is child process running as terminal */
+	 isterm:1,		/* is child process running as terminal */
+	 flush_pending:1;	/* flush timer is armed */
 };
 
 static ssize_t log_info(struct script_control *ctl, const char *name, const char *msgfmt, ...);
@@ -382,6 +391,7 @@ static int log_start(struct script_control *ctl,
 		warn(_("cannot open %s"), log->filename);
 		return -errno;
 	}
+	setvbuf(log->fp, NULL, _IOFBF, SCRIPT_LOG_BUFSZ);
 
 	/* write header, etc. */
 	switch (log->format) {
@@ -442,11 +452,12 @@ static int logging_start(struct script_control *ctl)
 static ssize_t log_write(struct script_control *ctl,
 		      struct script_stream *stream,
 		      struct script_log *log,
+		      const struct timeval *now,
 		      char *obuf, size_t bytes)
 {
 	int rc;
 	ssize_t ssz = 0;
-	struct timeval now, delta;
+	struct timeval delta;
 
 	if (!log->fp)
 		return 0;
@@ -467,28 +478,26 @@ static ssize_t log_write(struct script_control *ctl,
 	case SCRIPT_FMT_TIMING_SIMPLE:
 		DBG(IO, ul_debug("  log timing info"));
 
-		gettime_monotonic(&now);
-		timersub(&now, &log->oldtime, &delta);
+		timersub(now, &log->oldtime, &delta);
 		ssz = fprintf(log->fp, "%ld.%06ld %zd\n",
 			(long)delta.tv_sec, (long)delta.tv_usec, bytes);
 		if (ssz < 0)
 			return -errno;
 
-		log->oldtime = now;
+		log->oldtime = *now;
 		break;
 
 	case SCRIPT_FMT_TIMING_MULTI:
 		DBG(IO, ul_debug("  log multi-stream timing info"));
 
-		gettime_monotonic(&now);
-		timersub(&now, &log->oldtime, &delta);
+		timersub(now, &log->oldtime, &delta);
 		ssz = fprintf(log->fp, "%c %ld.%06ld %zd\n",
 			stream->ident,
 			(long)delta.tv_sec, (long)delta.tv_usec, bytes);
 		if (ssz < 0)
 			return -errno;
 
-		log->oldtime = now;
+		log->oldtime = *now;
 		break;
 	default:
 		break;
@@ -506,9 +515,13 @@ static ssize_t log_stream_activity(
 {
 	size_t i;
 	ssize_t outsz = 0;
+	struct timeval now;
+
+	/* the same time for all logs */
+	gettime_monotonic(&now);
 
 	for (i = 0; i < stream->nlogs; i++) {
-		ssize_t ssz = log_write(ctl, stream, stream->logs[i], buf, bytes);
+		ssize_t ssz = log_write(ctl, stream, stream->logs[i], &now, buf, bytes);
 
 		if (ssz < 0)
 			return ssz;
@@ -638,6 +651,10 @@ static void callback_child_die(
 
 	ctl->child = (pid_t) -1;
 	ctl->childstatus = status;
+
+	/* the rest is flushed by logging_done() */
+	ctl->flush_pending = 0;
+	ul_pty_set_mainloop_time(ctl->pty, NULL);
 }
 
 static void callback_child_sigstop(
@@ -673,6 +690,15 @@ static int callback_log_stream_activity(void *data, int fd, char *buf, size_t bu
 
 	ctl->outsz += ssz;
 
+	/* schedule flush of the logs */
+	if (ssz && !ctl->flush && !ctl->flush_pending && ctl->child > 0) {
+		struct timeval now, interval = { .tv_sec = SCRIPT_FLUSH_INTERVAL };
+
+		gettime_monotonic(&now);
+		timeradd(&now, &interval, &now);
+		ul_pty_set_mainloop_time(ctl->pty, &now);
+		ctl->flush_pending = 1;
+	}
 
 	/* check output limit */
 	if (ctl->maxsz != 0 && ctl->outsz >= ctl->maxsz) {
@@ -732,6 +758,18 @@ static int callback_flush_logs(void *data)
 	return 0;
 }
 
+static int callback_mainloop(void *data)
+{
+	struct script_control *ctl = (struct script_control *) data;
+
+	DBG(IO, ul_debug("flush timer"));
+
+	ctl->flush_pending = 0;
+	ul_pty_set_mainloop_time(ctl->pty, NULL);
+
+	return callback_flush_logs(ctl);
+}
+
 static void die_if_link(struct script_control *ctl, const char *filename)
 {
 	struct stat s;
@@ -929,6 +967,7 @@ int main(int argc, char **argv)
 	cb->log_stream_activity = callback_log_stream_activity;
 	cb->log_signal = callback_log_signal;
 	cb->flush_logs = callback_flush_logs;
+	cb->mainloop = callback_mainloop;
 
 	if (!ctl.quiet) {
 		printf(_("Script started"));
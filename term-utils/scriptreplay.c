@@ -63,6 +63,7 @@ usage(void)
 
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_("     --summary           display overview about recorded session and exit\n"), out);
+	fputs(_("     --start <time>      fast-forward to the time (in seconds) of the session\n"), out);
 	fputs(_(" -d, --divisor <num>     speed up or slow down execution with time divisor\n"), out);
 	fputs(_(" -m, --maxdelay <num>    wait at most this many seconds between updates\n"), out);
 	fputs(_(" -x, --stream <name>     stream type (out, in, signal or info)\n"), out);
@@ -124,7 +125,7 @@ int
 main(int argc, char *argv[])
 {
 	static const struct timeval mindelay = { .tv_sec = 0, .tv_usec = 100 };
-	struct timeval maxdelay;
+	struct timeval maxdelay, start;
 
 	struct replay_setup *setup = NULL;
 	struct replay_step *step = NULL;
@@ -137,7 +138,8 @@ main(int argc, char *argv[])
 	int diviopt = FALSE, idx;
 	int ch, rc, crmode = REPLAY_CRMODE_AUTO, summary = 0;
 	enum {
-		OPT_SUMMARY = CHAR_MAX + 1
+		OPT_SUMMARY = CHAR_MAX + 1,
+		OPT_START
 	};
 
 	static const struct option longopts[] = {
@@ -152,6 +154,7 @@ main(int argc, char *argv[])
 		{ "maxdelay",	required_argument,	0, 'm' },
 		{ "stream",     required_argument,	0, 'x' },
 		{ "summary",    no_argument,            0, OPT_SUMMARY },
+		{ "start",      required_argument,      0, OPT_START },
 		{ "version",	no_argument,		0, 'V' },
 		{ "help",	no_argument,		0, 'h' },
 		{ NULL,		0, 0, 0 }
@@ -174,6 +177,7 @@ main(int argc, char *argv[])
 
 	replay_init_debug();
 	timerclear(&maxdelay);
+	timerclear(&start);
 
 	while ((ch = getopt_long(argc, argv, "B:c:I:O:T:t:s:d:m:x:Vh", longopts, NULL)) != -1) {
 
@@ -226,6 +230,9 @@ main(int argc, char *argv[])
 		case OPT_SUMMARY:
 			summary = 1;
 			break;
+		case OPT_START:
+			strtotimeval_or_err(optarg, &start, _("failed to parse start time argument"));
+			break;
 		case 'V':
 			print_version(EXIT_SUCCESS);
 		case 'h':
@@ -286,7 +293,12 @@ main(int argc, char *argv[])
 		replay_set_delay_max(setup, &maxdelay);
 	replay_set_delay_min(setup, &mindelay);
 
-	do {
+	rc = 0;
+	if (timerisset(&start))
+		rc = replay_seek_time(setup, streams, &start,
+				      summary ? -1 : STDOUT_FILENO);
+
+	while (rc == 0) {
 		rc = replay_get_next_step(setup, streams, &step);
 		if (rc)
 			break;
@@ -298,7 +310,7 @@ main(int argc, char *argv[])
 				delay_for(delay);
 		}
 		rc = replay_emit_step_data(setup, step, STDOUT_FILENO);
-	} while (rc == 0);
+	}
 
 	if (step && rc < 0)
 		err(EXIT_FAILURE, _("%s: log file error"), replay_step_get_filename(step));
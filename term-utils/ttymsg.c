@@ -43,6 +43,7 @@
 #include <sys/types.h>
 #include <sys/param.h>
 #include <sys/uio.h>
+#include <poll.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <dirent.h>
@@ -54,7 +55,10 @@
 #include <stdlib.h>
 
 #include "nls.h"
+#include "c.h"
+#include "xalloc.h"
 #include "closestream.h"
+#include "monotonic.h"
 #include "pathnames.h"
 #include "ttymsg.h"
 
@@ -188,3 +192,195 @@ ttymsg(struct iovec *iov, size_t iovcnt, char *line, int tmout) {
 		_exit(EXIT_SUCCESS);
 	return NULL;
 }
+
+/* terminal with not yet written message */
+struct ttymsg_tty {
+	char		*device;
+	int		fd;
+	size_t		done;		/* already written bytes */
+	struct timeval	deadline;
+};
+
+/* returns: 0 on success, 1 if the message is not written yet, <0 on error */
+static int ttymsg_write(struct ttymsg_tty *tty, const char *buf, size_t bufsz)
+{
+	while (tty->done < bufsz) {
+		ssize_t wret = write(tty->fd, buf + tty->done, bufsz - tty->done);
+
+		if (wret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+			/*
+			 * We get ENODEV on a slip line if we're running as
+			 * root, and EIO if the line just went away.
+			 */
+			if (errno == ENODEV || errno == EIO)
+				return 0;
+			warn("%s", tty->device);
+			return -errno;
+		}
+		tty->done += wret;
+	}
+	return 0;
+}
+
+static void ttymsg_close(struct ttymsg_tty *tty)
+{
+	close(tty->fd);
+	tty->fd = -1;
+	free(tty->device);
+	tty->device = NULL;
+}
+
+/*
+ * Waits for the first writable or expired terminal, returns the number of
+ * still pending terminals; the array is compacted.
+ */
+static size_t ttymsg_poll(struct ttymsg_tty *ttys, struct pollfd *fds,
+			  size_t nttys, const char *buf, size_t bufsz,
+			  int *nerrs)
+{
+	struct timeval now, left;
+	size_t i, n;
+	int tmout = 0, ready;
+
+	gettime_monotonic(&now);
+	for (i = 0; i < nttys; i++) {
+		int ms;
+
+		if (timercmp(&ttys[i].deadline, &now, <))
+			ms = 0;
+		else {
+			timersub(&ttys[i].deadline, &now, &left);
+			ms = left.tv_sec * 1000 + (left.tv_usec + 999) / 1000;
+		}
+		if (i == 0 || ms < tmout)
+			tmout = ms;
+
+		fds[i].fd = ttys[i].fd;
+		fds[i].events = POLLOUT;
+		fds[i].revents = 0;
+	}
+
+	ready = poll(fds, nttys, tmout);
+	if (ready < 0 && errno != EINTR) {
+		warn(_("poll failed"));
+		(*nerrs)++;
+		for (i = 0; i < nttys; i++)
+			ttymsg_close(&ttys[i]);
+		return 0;
+	}
+	gettime_monotonic(&now);
+
+	for (i = 0, n = 0; i < nttys; i++) {
+		struct ttymsg_tty *tty = &ttys[i];
+
+		if (ready > 0 && fds[i].revents) {
+			int rc = ttymsg_write(tty, buf, bufsz);
+
+			if (rc < 0)
+				(*nerrs)++;
+			if (rc <= 0) {
+				ttymsg_close(tty);
+				continue;
+			}
+		}
+		if (!timercmp(&tty->deadline, &now, >)) {
+			/* the terminal does not read, give up silently */
+			ttymsg_close(tty);
+			continue;
+		}
+		if (n != i)
+			ttys[n] = *tty;
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Display the contents of a uio structure on all the terminals @lines.
+ * The terminals are opened and written in non-blocking mode and the slow
+ * ones are waited for by poll() in parallel, up to tmout seconds for each
+ * terminal, so nothing is forked. The unexpected errors are reported by
+ * warn(), the "normal" errors are ignored as by ttymsg().
+ *
+ * Returns number of errors.
+ */
+int ttymsg_all(struct iovec *iov, size_t iovcnt,
+	       char **lines, size_t nlines, int tmout)
+{
+	struct ttymsg_tty *ttys;
+	struct pollfd *fds;
+	size_t i, bufsz = 0, nttys = 0, maxttys;
+	long openmax;
+	char *buf, *p;
+	int nerrs = 0;
+
+	if (!nlines)
+		return 0;
+
+	for (i = 0; i < iovcnt; i++)
+		bufsz += iov[i].iov_len;
+	p = buf = xmalloc(bufsz ? bufsz : 1);
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+
+	/* keep some file descriptors for the rest of the process */
+	openmax = sysconf(_SC_OPEN_MAX);
+	maxttys = openmax > 64 ? (size_t) openmax - 32 : 32;
+	if (maxttys > nlines)
+		maxttys = nlines;
+
+	ttys = xcalloc(maxttys, sizeof(*ttys));
+	fds = xcalloc(maxttys, sizeof(*fds));
+
+	for (i = 0; i < nlines; i++) {
+		struct ttymsg_tty *tty;
+		int rc;
+
+		while (nttys == maxttys)
+			nttys = ttymsg_poll(ttys, fds, nttys, buf, bufsz, &nerrs);
+
+		tty = &ttys[nttys];
+		xasprintf(&tty->device, "%s%s", _PATH_DEV, lines[i]);
+		tty->done = 0;
+
+		/*
+		 * open will fail on slip lines or exclusive-use lines
+		 * if not running as root; not an error.
+		 */
+		tty->fd = open(tty->device, O_WRONLY|O_NONBLOCK|O_NOCTTY|O_CLOEXEC);
+		if (tty->fd < 0) {
+			if (errno != EBUSY && errno != EACCES) {
+				warn("%s", tty->device);
+				nerrs++;
+			}
+			free(tty->device);
+			tty->device = NULL;
+			continue;
+		}
+
+		rc = ttymsg_write(tty, buf, bufsz);
+		if (rc < 0)
+			nerrs++;
+		if (rc <= 0) {
+			ttymsg_close(tty);
+			continue;
+		}
+		gettime_monotonic(&tty->deadline);
+		tty->deadline.tv_sec += tmout;
+		nttys++;
+	}
+
+	while (nttys)
+		nttys = ttymsg_poll(ttys, fds, nttys, buf, bufsz, &nerrs);
+
+	free(fds);
+	free(ttys);
+	free(buf);
+	return nerrs;
+}
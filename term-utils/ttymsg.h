@@ -2,5 +2,7 @@
 #define UTIL_LINUX_TERM_TTYMSG_H
 
 char *ttymsg(struct iovec *iov, size_t iovcnt, char *line, int tmout);
+int ttymsg_all(struct iovec *iov, size_t iovcnt,
+	       char **lines, size_t nlines, int tmout);
 
 #endif /* UTIL_LINUX_TERM_TTYMSG_H */
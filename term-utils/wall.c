@@ -182,8 +182,9 @@ int main(int argc, char **argv)
 	int ch;
 	struct iovec iov;
 	struct utmpx *utmpptr;
-	char *p;
 	char line[sizeof(utmpptr->ut_line) + 1];
+	char **lines = NULL;
+	size_t nlines = 0, i;
 	int print_banner = TRUE;
 	struct group_workspace *group_buf = NULL;
 	char *mbuf, *fname = NULL;
@@ -264,10 +265,18 @@ int main(int argc, char **argv)
 			continue;
 
 		mem2strcpy(line, utmpptr->ut_line, sizeof(utmpptr->ut_line), sizeof(line));
-		if ((p = ttymsg(&iov, 1, line, timeout)) != NULL)
-			warnx("%s", p);
+		if (nlines % 64 == 0)
+			lines = xrealloc(lines, (nlines + 64) * sizeof(char *));
+		lines[nlines++] = xstrdup(line);
 	}
 	endutxent();
+
+	/* write to all the terminals in parallel */
+	ttymsg_all(&iov, 1, lines, nlines, timeout);
+
+	for (i = 0; i < nlines; i++)
+		free(lines[i]);
+	free(lines);
 	free(mbuf);
 	free_group_workspace(group_buf);
 	exit(EXIT_SUCCESS);
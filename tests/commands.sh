@@ -2,6 +2,7 @@
 TS_TESTUSER=${TS_TESTUSER:-"nobody"}
 
 # helpers
+TS_HELPER_BLKID_PROBE="${ts_helpersdir}test_blkid_probe"
 TS_HELPER_BYTESWAP="${ts_helpersdir}test_byteswap"
 TS_HELPER_CPUSET="${ts_helpersdir}test_cpuset"
 TS_HELPER_DMESG="${ts_helpersdir}test_dmesg"
@@ -9,16 +10,23 @@ TS_HELPER_ISLOCAL="${ts_helpersdir}test_islocal"
 TS_HELPER_ISMOUNTED="${ts_helpersdir}test_ismounted"
 TS_HELPER_LIBFDISK_GPT="${ts_helpersdir}test_fdisk_gpt"
 TS_HELPER_LIBFDISK_MKPART="${ts_helpersdir}sample-fdisk-mkpart"
+TS_HELPER_LIBMOUNT_CACHE="${ts_helpersdir}test_mount_cache"
 TS_HELPER_LIBMOUNT_CONTEXT="${ts_helpersdir}test_mount_context"
+TS_HELPER_LIBMOUNT_CONTEXT_PARALLEL="${ts_helpersdir}test_mount_context_parallel"
 TS_HELPER_LIBFDISK_MKPART_FULLSPEC="${ts_helpersdir}sample-fdisk-mkpart-fullspec"
 TS_HELPER_LIBMOUNT_LOCK="${ts_helpersdir}test_mount_lock"
+TS_HELPER_LIBMOUNT_OPTLIST="${ts_helpersdir}test_mount_optlist"
 TS_HELPER_LIBMOUNT_OPTSTR="${ts_helpersdir}test_mount_optstr"
 TS_HELPER_LIBMOUNT_TABDIFF="${ts_helpersdir}test_mount_tab_diff"
 TS_HELPER_LIBMOUNT_TAB="${ts_helpersdir}test_mount_tab"
+TS_HELPER_LIBMOUNT_SNAPSHOT="${ts_helpersdir}test_mount_tab_snapshot"
 TS_HELPER_LIBMOUNT_UPDATE="${ts_helpersdir}test_mount_tab_update"
 TS_HELPER_LIBMOUNT_UTILS="${ts_helpersdir}test_mount_utils"
 TS_HELPER_LIBMOUNT_DEBUG="${ts_helpersdir}test_mount_debug"
+TS_HELPER_LIBSMARTCOLS_DATAFUNC="${ts_helpersdir}sample-scols-datafunc"
 TS_HELPER_LIBSMARTCOLS_FROMFILE="${ts_helpersdir}sample-scols-fromfile"
+TS_HELPER_LIBSMARTCOLS_STREAMING="${ts_helpersdir}sample-scols-streaming"
+TS_HELPER_LIBSMARTCOLS_SORT="${ts_helpersdir}sample-scols-sort"
 TS_HELPER_LIBSMARTCOLS_TITLE="${ts_helpersdir}sample-scols-title"
 TS_HELPER_PYLIBMOUNT_CONTEXT="$top_srcdir/libmount/python/test_mount_context.py"
 TS_HELPER_PYLIBMOUNT_TAB="$top_srcdir/libmount/python/test_mount_tab.py"
@@ -26,19 +34,25 @@ TS_HELPER_PYLIBMOUNT_UPDATE="$top_srcdir/libmount/python/test_mount_tab_update.p
 TS_HELPER_LOGGER="${ts_helpersdir}test_logger"
 TS_HELPER_LOGINDEFS="${ts_helpersdir}test_logindefs"
 TS_HELPER_MD5="${ts_helpersdir}test_md5"
+TS_HELPER_MD5_MULTI="${ts_helpersdir}test_md5_multi"
 TS_HELPER_SHA1="${ts_helpersdir}test_sha1"
+TS_HELPER_SHA1_MULTI="${ts_helpersdir}test_sha1_multi"
 TS_HELPER_MKFS_MINIX="${ts_helpersdir}test_mkfs_minix"
 TS_HELPER_MORE=${TS_HELPER_MORE-"${ts_helpersdir}test_more"}
 TS_HELPER_PARTITIONS="${ts_helpersdir}sample-partitions"
 TS_HELPER_PATHS="${ts_helpersdir}test_pathnames"
+TS_HELPER_PERFSTAT="${ts_helpersdir}test_perfstat"
+TS_HELPER_RANGES="${ts_helpersdir}test_ranges"
 TS_HELPER_SCRIPT="${ts_helpersdir}test_script"
 TS_HELPER_SIGRECEIVE="${ts_helpersdir}test_sigreceive"
 TS_HELPER_STRERROR="${ts_helpersdir}test_strerror"
 TS_HELPER_STRUTILS="${ts_helpersdir}test_strutils"
 TS_HELPER_SYSINFO="${ts_helpersdir}test_sysinfo"
+TS_HELPER_TIMEUTILS="${ts_helpersdir}test_timeutils"
 TS_HELPER_TIOCSTI="${ts_helpersdir}test_tiocsti"
 TS_HELPER_UUID_PARSER="${ts_helpersdir}test_uuid_parser"
 TS_HELPER_UUID_NAMESPACE="${ts_helpersdir}test_uuid_namespace"
+TS_HELPER_UUID_FORK="${ts_helpersdir}test_uuid_fork"
 TS_HELPER_MBSENCODE="${ts_helpersdir}test_mbsencode"
 TS_HELPER_CAL="${ts_helpersdir}test_cal"
 
@@ -107,4 +121,5 @@ TS_CMD_UUIDPARSE=${TS_CMD_UUIDPARSE-"${ts_commandsdir}uuidparse"}
 TS_CMD_WHEREIS=${TS_CMD_WHEREIS-"${ts_commandsdir}whereis"}
 TS_CMD_WIPEFS=${TS_CMD_WIPEFS-"${ts_commandsdir}wipefs"}
 TS_CMD_CHRT=${TS_CMD_CHRT-"${ts_commandsdir}chrt"}
+TS_CMD_TASKSET=${TS_CMD_TASKSET-"${ts_commandsdir}taskset"}
 TS_CMD_CHFN=${TS_CMD_CHFN-"${ts_commandsdir}chfn"}
@@ -331,6 +331,15 @@ function ts_init_env {
 	TS_PARSABLE=$(ts_has_option "parsable" "$*")
 	[ "$TS_PARSABLE" = "yes" ] || TS_PARSABLE="$TS_PARALLEL"
 
+	TS_PERF=$(ts_has_option "perf" "$*")
+	TS_PERF_BASELINE=$(ts_option_argument "perf-baseline" "$*")
+	TS_PERF_THRESHOLD=$(ts_option_argument "perf-threshold" "$*")
+	TS_PERF_THRESHOLD=${TS_PERF_THRESHOLD:-20}
+	TS_PERF_LOOPS=$(ts_option_argument "perf-loops" "$*")
+	TS_PERF_LOOPS=${TS_PERF_LOOPS:-3}
+	TS_PERF_SCALE=$(ts_option_argument "perf-scale" "$*")
+	TS_PERF_SCALE=${TS_PERF_SCALE:-1}
+
 	tmp=$( ts_has_option "memcheck-valgrind" "$*")
 	if [ "$tmp" == "yes" -a -f /usr/bin/valgrind ]; then
 		TS_VALGRIND_CMD="/usr/bin/valgrind"
@@ -406,6 +415,7 @@ function ts_init {
 
 	[ "$is_fake" == "yes" ] && ts_skip "fake mode"
 	[ "$TS_OPTIONAL" == "yes" -a "$is_force" != "yes" ] && ts_skip "optional"
+	[ "$TS_PERF_TEST" == "yes" -a "$TS_PERF" != "yes" ] && ts_skip "perf mode only"
 }
 
 function ts_init_suid {
@@ -456,6 +466,47 @@ function ts_run {
 	"${args[@]}" "$@"
 }
 
+# compares result of the performance test with the baseline
+function ts_perf_check {
+	local metric="$1"
+	local value="$2"
+	local base
+
+	[ -f "$TS_PERF_BASELINE" ] || return 0
+	[ "$value" = "-" ] && return 0
+
+	base=$(grep -F "\"$TS_NS\":" "$TS_PERF_BASELINE" | \
+		sed -n "s/.*\"$metric\": \([0-9]\+\).*/\1/p")
+	[ -z "$base" ] && return 0
+
+	if [ $(( $value * 100 )) -gt $(( $base * (100 + $TS_PERF_THRESHOLD) )) ]; then
+		echo "$metric: $value, baseline: $base (threshold $TS_PERF_THRESHOLD%)" >> $TS_OUTPUT
+	fi
+}
+
+# executes the command by test_perfstat helper as sub-test <name>, the output
+# of the command is ignored, the result is saved to $TS_OUTPUT.perf (merged to
+# tests/perf.json by run.sh) and compared with --perf-baseline=<file>
+function ts_perf_run {
+	local wall insn rss res
+
+	ts_init_subtest "$1"
+	shift
+	rm -f $TS_OUTPUT.perf
+
+	res=$("$TS_HELPER_PERFSTAT" "$TS_PERF_LOOPS" "$@" 2>> $TS_ERRLOG)
+	if [ $? -eq 0 ]; then
+		read wall insn rss <<< "$res"
+		echo "$TS_NS $wall $insn $rss" > $TS_OUTPUT.perf
+
+		ts_perf_check "wall_ns" "$wall"
+		ts_perf_check "instructions" "$insn"
+		ts_perf_check "maxrss_kb" "$rss"
+	fi
+
+	ts_finalize_subtest
+}
+
 function ts_gen_diff_from {
 	local res=0
 	local expected="$1"
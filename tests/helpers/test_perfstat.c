@@ -0,0 +1,159 @@
+/*
+ * test_perfstat - measure command for the performance tests
+ *
+ * Usage: test_perfstat <loops> <command> [<argument> ...]
+ *
+ * The command is executed <loops> times (standard output is redirected to
+ * /dev/null) and the minimal wall time, the minimal number of the user space
+ * instructions (if supported by kernel and hardware, otherwise "-") and the
+ * maximal resident set size are printed as "<wall_ns> <instructions> <maxrss_kb>".
+ *
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+#ifdef HAVE_LINUX_PERF_EVENT_H
+# include <linux/perf_event.h>
+#endif
+
+#if defined(HAVE_LINUX_PERF_EVENT_H) && defined(SYS_perf_event_open)
+/* counts instructions of @pid and its children since exec() */
+static int open_counter(pid_t pid)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.disabled = 1;
+	attr.enable_on_exec = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+}
+#else
+static int open_counter(pid_t pid __attribute__((__unused__)))
+{
+	return -1;
+}
+#endif
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* returns exit status of the command, the results are in @wall, @insn and @rss */
+static int run(char **argv, uint64_t *wall, int64_t *insn, long *rss)
+{
+	struct rusage ru;
+	uint64_t start, count;
+	int pfd[2], status, fd;
+	pid_t pid;
+	char c = 0;
+
+	if (pipe(pfd) != 0)
+		return -1;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		/* wait for the counter */
+		close(pfd[1]);
+		if (read(pfd[0], &c, 1) != 1)
+			_exit(EXIT_FAILURE);
+		close(pfd[0]);
+		fd = open("/dev/null", O_WRONLY);
+		if (fd >= 0 && fd != STDOUT_FILENO) {
+			dup2(fd, STDOUT_FILENO);
+			close(fd);
+		}
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+
+	close(pfd[0]);
+	fd = open_counter(pid);
+
+	start = now_ns();
+	if (write(pfd[1], &c, 1) != 1)
+		return -1;
+	close(pfd[1]);
+
+	if (wait4(pid, &status, 0, &ru) != pid)
+		return -1;
+	*wall = now_ns() - start;
+	*rss = ru.ru_maxrss;
+	*insn = -1;
+
+	if (fd >= 0) {
+		if (read(fd, &count, sizeof(count)) == sizeof(count))
+			*insn = count;
+		close(fd);
+	}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t wall_min = 0;
+	int64_t insn_min = -1;
+	long rss_max = 0;
+	int loops, i, rc = 0;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <loops> <command> [<argument> ...]\n",
+				argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	loops = atoi(argv[1]);
+	if (loops < 1)
+		loops = 1;
+
+	for (i = 0; i < loops; i++) {
+		uint64_t wall;
+		int64_t insn;
+		long rss;
+
+		rc = run(argv + 2, &wall, &insn, &rss);
+		if (rc != 0) {
+			fprintf(stderr, "%s: %s failed (status %d)\n",
+				argv[0], argv[2], rc);
+			return EXIT_FAILURE;
+		}
+		if (!wall_min || wall < wall_min)
+			wall_min = wall;
+		if (insn >= 0 && (insn_min < 0 || insn < insn_min))
+			insn_min = insn;
+		if (rss > rss_max)
+			rss_max = rss;
+	}
+
+	if (insn_min >= 0)
+		printf("%"PRIu64" %"PRId64" %ld\n", wall_min, insn_min, rss_max);
+	else
+		printf("%"PRIu64" - %ld\n", wall_min, rss_max);
+	return EXIT_SUCCESS;
+}
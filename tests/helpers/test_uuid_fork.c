@@ -0,0 +1,62 @@
+/*
+ * Checks that the parent and the child don't share time based UUIDs
+ * reserved before fork().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../libuuid/src/uuid.h"
+
+#define NUUIDS	3
+
+int main(void)
+{
+	uuid_t first, parent[NUUIDS], child[NUUIDS];
+	int fds[2], status, i, k, dups = 0;
+	pid_t pid;
+
+	if (pipe(fds) != 0) {
+		perror("pipe");
+		return EXIT_FAILURE;
+	}
+
+	uuid_generate_time_safe(first);
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return EXIT_FAILURE;
+	}
+	if (pid == 0) {
+		for (i = 0; i < NUUIDS; i++)
+			uuid_generate_time_safe(child[i]);
+		if (write(fds[1], child, sizeof(child)) != sizeof(child))
+			_exit(EXIT_FAILURE);
+		_exit(EXIT_SUCCESS);
+	}
+
+	for (i = 0; i < NUUIDS; i++)
+		uuid_generate_time_safe(parent[i]);
+
+	close(fds[1]);
+	if (read(fds[0], child, sizeof(child)) != sizeof(child)
+	    || waitpid(pid, &status, 0) != pid
+	    || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+		fprintf(stderr, "child failed\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < NUUIDS; i++) {
+		if (uuid_compare(first, child[i]) == 0)
+			dups++;
+		for (k = 0; k < NUUIDS; k++)
+			if (uuid_compare(parent[i], child[k]) == 0)
+				dups++;
+	}
+
+	printf("%d UUIDs shared by parent and child\n", dups);
+	return dups ? EXIT_FAILURE : EXIT_SUCCESS;
+}
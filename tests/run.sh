@@ -26,6 +26,7 @@ top_srcdir=
 top_builddir=
 paraller_jobs=1
 has_asan_opt=
+perf_mode=
 
 function num_cpus()
 {
@@ -107,6 +108,28 @@ while [ -n "$1" ]; do
 	--exclude=*)
 		EXCLUDETESTS="${1##--exclude=}"
 		;;
+	--perf)
+		OPTS="$OPTS $1"
+		perf_mode="yes"
+		;;
+	--perf-baseline=*)
+		tmp="${1##--perf-baseline=}"
+		if [ ! -f "$tmp" ]; then
+			echo "cannot access baseline '$tmp'"
+			exit 1
+		fi
+		OPTS="$OPTS --perf-baseline=$(cd $(dirname $tmp) && pwd)/$(basename $tmp)"
+		;;
+	--perf-threshold=* |\
+	--perf-loops=* |\
+	--perf-scale=*)
+		tmp="${1#--perf-*=}"
+		if ! [ "$tmp" -ge 0 ] 2>/dev/null; then
+			echo "invalid argument '$tmp' for ${1%%=*}="
+			exit 1
+		fi
+		OPTS="$OPTS $1"
+		;;
 	--*)
 		echo "Unknown option $1"
 		echo "Usage: "
@@ -127,6 +150,11 @@ while [ -n "$1" ]; do
 		echo "  --parallel=<num>      number of parallel test jobs, default: num cpus"
 		echo "  --parsable            use parsable output (default on --parallel)"
 		echo "  --exclude=<list>      exclude tests by list '<utilname>/<testname> ..'"
+		echo "  --perf                run performance tests (tests/ts/perf by default)"
+		echo "  --perf-baseline=<file> compare with results of the previous --perf run"
+		echo "  --perf-threshold=<num> allowed regression in percents, default: 20"
+		echo "  --perf-loops=<num>    number of runs of the measured commands, default: 3"
+		echo "  --perf-scale=<num>    multiply size of the performance workloads"
 		echo
 		exit 1
 		;;
@@ -161,6 +189,13 @@ if [ -z "$has_asan_opt" ]; then
 	fi
 fi
 
+# Performance tests only by default, executed sequentially to be comparable
+if [ "$perf_mode" = "yes" ]; then
+	[ -z "$SUBTESTS" ] && SUBTESTS="perf"
+	paraller_jobs=1
+	find "$top_builddir/tests/output" -name '*.perf' -delete 2>/dev/null
+fi
+
 declare -a comps
 if [ -n "$SUBTESTS" ]; then
 	# selected tests only
@@ -200,6 +235,10 @@ unset LIBMOUNT_DEBUG
 unset LIBBLKID_DEBUG
 unset LIBFDISK_DEBUG
 unset LIBSMARTCOLS_DEBUG
+unset LIBMOUNT_TRACE
+unset LIBBLKID_TRACE
+unset LIBFDISK_TRACE
+unset LIBSMARTCOLS_TRACE
 
 echo
 echo "-------------------- util-linux regression tests --------------------"
@@ -236,6 +275,20 @@ fi
 declare -a fail_file
 fail_file=( $( < $top_builddir/tests/failures ) ) || exit 1
 rm -f $top_builddir/tests/failures
+
+# Merge results of the performance tests to JSON, usable as --perf-baseline=
+if [ "$perf_mode" = "yes" ]; then
+	find "$top_builddir/tests/output" -name '*.perf' | sort | xargs -r cat |
+	awk 'BEGIN { print "{" }
+	     {
+		if (n++) print ","
+		printf "\t\"%s\": { \"wall_ns\": %s, \"instructions\": %s, \"maxrss_kb\": %s }",
+			$1, $2, $3 == "-" ? "null" : $3, $4
+	     }
+	     END { if (n) print ""; print "}" }' > $top_builddir/tests/perf.json
+	echo
+	echo "  Performance results: $top_builddir/tests/perf.json"
+fi
 echo
 echo "---------------------------------------------------------------------"
 if [ ${#fail_file[@]} -eq 0 ]; then
@@ -40,12 +40,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
 #include <unistd.h>
 
 #include "nls.h"
 #include "strutils.h"
 #include "c.h"
+#include "linereader.h"
 #include "widechar.h"
 #include "closestream.h"
 
@@ -72,89 +74,137 @@ static void __attribute__((__noreturn__)) usage(void)
 	exit(EXIT_SUCCESS);
 }
 
-static int process_input(unsigned long first, unsigned long last)
+static signed char ascii_width[128];
+
+static void init_widths(void)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(ascii_width); i++) {
+		int w = wcwidth(i);
+		ascii_width[i] = w < 0 ? 0 : w;
+	}
+}
+
+/*
+ * Reads the next character from @line, returns number of bytes, 0 at the end
+ * of the line or -1 on invalid multibyte sequence.
+ */
+static int next_char(const char *line, size_t len, wchar_t *wc, int *w,
+		     mbstate_t *st __attribute__((__unused__)))
 {
+	size_t n = 1;
+
+	if (!len)
+		return 0;
+	if (!(*line & 0x80)) {
+		*wc = *line;
+		*w = ascii_width[(unsigned char) *line];
+		return 1;
+	}
+#ifdef HAVE_WIDECHAR
+	n = mbrtowc(wc, line, len, st);
+	if (n == (size_t) -1 || n == (size_t) -2)
+		return -1;
+	if (n == 0)
+		n = 1;
+#else
+	*wc = *line;
+#endif
+	*w = wcwidth(*wc);
+	if (*w < 0)
+		*w = 0;
+	return n;
+}
+
+static void put_spaces(unsigned long from, unsigned long to)
+{
+	for (; from < to; from++)
+		putchar(' ');
+}
+
+/*
+ * Returns 0 at the end of the input (or on invalid multibyte sequence), or 1
+ * when the line is terminated by newline.
+ */
+static int process_line(const char *line, size_t len,
+			unsigned long first, unsigned long last)
+{
+	const char *end = line + len, *p = line;
 	unsigned long ct = 0;
-	wint_t c;
-	unsigned long i;
-	int w;
-	int padding;
+	mbstate_t st;
+	wchar_t c;
+	int n, w = 0, eilseq = 0;
 
+	memset(&st, 0, sizeof(st));
+
+	/* Output characters before the first column */
 	for (;;) {
-		c = getwc(stdin);
-		if (c == WEOF)
+		n = next_char(p, end - p, &c, &w, &st);
+		if (n <= 0) {
+			fwrite(line, 1, p - line, stdout);
 			return 0;
+		}
 		if (c == '\t')
 			w = ((ct + 8) & ~7) - ct;
 		else if (c == '\b')
 			w = (ct ? ct - 1 : 0) - ct;
-		else {
-			w = wcwidth(c);
-			if (w < 0)
-				w = 0;
-		}
 		ct += w;
-		if (c == '\n') {
-			putwc(c, stdout);
-			ct = 0;
-			continue;
-
-		}
-		if (!first || ct < first) {
-			putwc(c, stdout);
+		if (c == '\n' || !first || ct < first) {
+			p += n;
+			if (c == '\n') {
+				fwrite(line, 1, p - line, stdout);
+				return 1;
+			}
 			continue;
 		}
 		break;
 	}
+	fwrite(line, 1, p - line, stdout);
+	p += n;
 
-	for (i = ct - w + 1; i < first; i++)
-		putwc(' ', stdout);
+	put_spaces(ct - w + 1, first);
 
 	/* Loop getting rid of characters */
 	while (!last || ct < last) {
-		c = getwc(stdin);
-		if (c == WEOF)
+		n = next_char(p, end - p, &c, &w, &st);
+		if (n <= 0)
 			return 0;
+		p += n;
 		if (c == '\n') {
-			putwc(c, stdout);
+			putchar('\n');
 			return 1;
 		}
 		if (c == '\t')
 			ct = (ct + 8) & ~7;
 		else if (c == '\b')
 			ct = ct ? ct - 1 : 0;
-		else {
-			w = wcwidth(c);
-			if (w < 0)
-				w = 0;
+		else
 			ct += w;
-		}
 	}
 
-	padding = 0;
-
 	/* Output last of the line */
-	for (;;) {
-		c = getwc(stdin);
-		if (c == WEOF)
-			break;
-		if (c == '\n') {
-			putwc(c, stdout);
-			return 1;
-		}
-		if (padding == 0 && last < ct) {
-			for (i = last; i < ct; i++)
-				putwc(' ', stdout);
-			padding = 1;
-		}
-		putwc(c, stdout);
+	line = p;
+	if (!ul_is_ascii(p, end - p)) {
+		while ((n = next_char(p, end - p, &c, &w, &st)) > 0)
+			p += n;
+		if (n < 0)
+			eilseq = 1;	/* stop on invalid multibyte sequence */
+		end = p;
 	}
-	return 0;
+	if (line < end && *line != '\n' && last < ct)
+		put_spaces(last, ct);
+	fwrite(line, 1, end - line, stdout);
+
+	return !eilseq && end > line && *(end - 1) == '\n';
 }
 
 int main(int argc, char **argv)
 {
 	unsigned long first = 0, last = 0;
+	struct ul_linereader lr;
+	char *line;
+	ssize_t len;
 	int opt;
 
 	static const struct option longopts[] = {
@@ -185,8 +235,15 @@ int main(int argc, char **argv)
 	if (argc > 2)
 		last = strtoul_or_err(*++argv, _("second argument"));
 
-	while (process_input(first, last))
-		;
+	init_widths();
+	ul_init_linereader(&lr, STDIN_FILENO);
+
+	while ((len = ul_linereader_next(&lr, &line)) > 0) {
+		if (!process_line(line, len, first, last))
+			break;
+	}
+
+	ul_free_linereader(&lr);
 
 	fflush(stdout);
 	return EXIT_SUCCESS;
@@ -80,12 +80,15 @@ struct column_control {
 	const char *tab_colnoextrem;	/* --table-noextreme */
 	const char *tab_colwrap;	/* --table-wrap */
 	const char *tab_colhide;	/* --table-hide */
+	const char *tab_widths;		/* --table-widths */
+	size_t tab_stream;		/* --table-stream, number of sampled lines */
 
 	const char *tree;
 	const char *tree_id;
 	const char *tree_parent;
 
 	wchar_t *input_separator;
+	char *input_separator_bytes;	/* ASCII-only separator for the byte fast path */
 	const char *output_separator;
 
 	wchar_t	**ents;		/* input entries */
@@ -96,7 +99,9 @@ struct column_control {
 		     json :1,
 		     header_repeat :1,
 		     tab_empty_lines :1,	/* --table-empty-lines */
-		     tab_noheadings :1;
+		     tab_noheadings :1,
+		     tab_streaming :1,		/* stream started */
+		     utf8 :1;			/* UTF-8 locale */
 };
 
 static size_t width(const wchar_t *str)
@@ -189,6 +194,68 @@ static wchar_t *local_wcstok(struct column_control const *const ctl, wchar_t *p,
 	return result;
 }
 
+/*
+ * The same as local_wcstok(), but for the multibyte strings.
+ */
+static char *local_strtok(struct column_control const *const ctl, char *p,
+			  char **state)
+{
+	char *result = NULL;
+
+	if (ctl->greedy)
+		return strtok_r(p, ctl->input_separator_bytes, state);
+	if (!p) {
+		if (!*state)
+			return NULL;
+		p = *state;
+	}
+	result = p;
+	p = strpbrk(result, ctl->input_separator_bytes);
+	if (!p)
+		*state = NULL;
+	else {
+		*p = '\0';
+		*state = p + 1;
+	}
+	return result;
+}
+
+/*
+ * Returns 1 if the line could be split to the columns without conversion to
+ * wide chars. The ASCII separators cannot be a part of the UTF-8 multibyte
+ * sequence, so it's enough to verify that the line is ASCII or valid UTF-8.
+ */
+static int is_bytes_line(struct column_control const *const ctl, const char *str)
+{
+	const unsigned char *p;
+
+	if (!ctl->input_separator_bytes)
+		return 0;
+
+	for (p = (const unsigned char *) str; *p; p++) {
+		if (*p & 0x80)
+			break;
+	}
+	if (!*p)
+		return 1;
+#ifdef HAVE_WIDECHAR
+	if (ctl->utf8 && mbstowcs(NULL, str, 0) != (size_t) -1)
+		return 1;
+#endif
+	return 0;
+}
+
+static char *separator_to_bytes(const char *sep)
+{
+	const unsigned char *p;
+
+	for (p = (const unsigned char *) sep; *p; p++) {
+		if (*p & 0x80)
+			return NULL;
+	}
+	return xstrdup(sep);
+}
+
 static char **split_or_error(const char *str, const char *errmsg)
 {
 	char **res = strv_split(str, ",");
@@ -427,6 +494,104 @@ static void modify_table(struct column_control *ctl)
 }
 
 
+/*
+ * --table-stream: the column widths are set from the first lines (and from
+ * --table-widths) and then every line is printed by libsmartcols when the
+ * next line is added, so the memory does not depend on the input size.
+ */
+static void set_stream_widths(struct column_control *ctl)
+{
+	size_t i, ncols = scols_table_get_ncols(ctl->tab);
+	size_t *widths = xcalloc(ncols, sizeof(size_t));
+	struct libscols_iter *itr;
+	struct libscols_line *ln;
+	char **user = NULL;
+
+	itr = scols_new_iter(SCOLS_ITER_FORWARD);
+	if (!itr)
+		err_oom();
+	while (scols_table_next_line(ctl->tab, itr, &ln) == 0) {
+		for (i = 0; i < ncols; i++) {
+			struct libscols_cell *ce = scols_line_get_cell(ln, i);
+			const char *data = ce ? scols_cell_get_data(ce) : NULL;
+
+			if (data)
+				widths[i] = max(widths[i], mbs_safe_width(data));
+		}
+	}
+	scols_free_iter(itr);
+
+	if (ctl->tab_widths)
+		user = split_or_error(ctl->tab_widths, _("failed to parse --table-widths list"));
+
+	for (i = 0; i < ncols; i++) {
+		struct libscols_column *cl = scols_table_get_column(ctl->tab, i);
+
+		/* zero means the width from the sampled lines */
+		if (user && i < strv_length(user)) {
+			uint32_t w = strtou32_or_err(user[i], _("invalid --table-widths argument"));
+			if (w)
+				widths[i] = w;
+		}
+		scols_column_set_whint(cl, widths[i] ? widths[i] : 1);
+	}
+
+	strv_free(user);
+	free(widths);
+}
+
+static void start_stream(struct column_control *ctl)
+{
+	set_stream_widths(ctl);
+	modify_table(ctl);
+
+	/* the already sampled lines are printed when the next line is added */
+	scols_table_enable_streaming(ctl->tab, 1);
+	ctl->tab_streaming = 1;
+}
+
+/* adds @data (the function takes over the string) as the next cell */
+static void add_data_to_line(struct column_control *ctl,
+			     struct libscols_line **ln, size_t *n, char *data)
+{
+	/* columns cannot be added to the stream, use the last one */
+	if (ctl->tab_streaming && *ln && scols_table_get_ncols(ctl->tab) < *n + 1) {
+		struct libscols_cell *ce = scols_line_get_cell(*ln, *n - 1);
+		char *tmp = data;
+
+		xasprintf(&data, "%s %s", scols_cell_get_data(ce) ? : "", tmp);
+		free(tmp);
+		if (scols_line_refer_data(*ln, *n - 1, data))
+			err(EXIT_FAILURE, _("failed to add output data"));
+		return;
+	}
+
+	if (scols_table_get_ncols(ctl->tab) < *n + 1) {
+		if (scols_table_is_json(ctl->tab))
+			errx(EXIT_FAILURE, _("line %zu: for JSON the name of the "
+				"column %zu is required"),
+				scols_table_get_nlines(ctl->tab) + 1,
+				*n + 1);
+		scols_table_new_column(ctl->tab, NULL, 0, 0);
+	}
+	if (!*ln) {
+		*ln = scols_table_new_line(ctl->tab, NULL);
+		if (!*ln)
+			err(EXIT_FAILURE, _("failed to allocate output line"));
+	}
+
+	if (scols_line_refer_data(*ln, *n, data))
+		err(EXIT_FAILURE, _("failed to add output data"));
+	(*n)++;
+}
+
+static void line_added_to_table(struct column_control *ctl)
+{
+	if (ctl->tab_stream && !ctl->tab_streaming
+	    && scols_table_get_nlines(ctl->tab) >= ctl->tab_stream)
+		start_stream(ctl);
+}
+
 static int add_line_to_table(struct column_control *ctl, wchar_t *wcs)
 {
 	wchar_t *wcdata, *sv = NULL;
@@ -437,31 +602,34 @@ static int add_line_to_table(struct column_control *ctl, wchar_t *wcs)
 		init_table(ctl);
 
 	while ((wcdata = local_wcstok(ctl, wcs, &sv))) {
-		char *data;
-
-		if (scols_table_get_ncols(ctl->tab) < n + 1) {
-			if (scols_table_is_json(ctl->tab))
-				errx(EXIT_FAILURE, _("line %zu: for JSON the name of the "
-					"column %zu is required"),
-					scols_table_get_nlines(ctl->tab) + 1,
-					n + 1);
-			scols_table_new_column(ctl->tab, NULL, 0, 0);
-		}
-		if (!ln) {
-			ln = scols_table_new_line(ctl->tab, NULL);
-			if (!ln)
-				err(EXIT_FAILURE, _("failed to allocate output line"));
-		}
+		char *data = wcs_to_mbs(wcdata);
 
-		data = wcs_to_mbs(wcdata);
 		if (!data)
 			err(EXIT_FAILURE, _("failed to allocate output data"));
-		if (scols_line_refer_data(ln, n, data))
-			err(EXIT_FAILURE, _("failed to add output data"));
-		n++;
+		add_data_to_line(ctl, &ln, &n, data);
 		wcs = NULL;
 	}
 
+	line_added_to_table(ctl);
+	return 0;
+}
+
+/* the fast path for ASCII and UTF-8 lines, see is_bytes_line() */
+static int add_bytes_to_table(struct column_control *ctl, char *str)
+{
+	char *data, *sv = NULL;
+	size_t n = 0;
+	struct libscols_line *ln = NULL;
+
+	if (!ctl->tab)
+		init_table(ctl);
+
+	while ((data = local_strtok(ctl, str, &sv))) {
+		add_data_to_line(ctl, &ln, &n, xstrdup(data));
+		str = NULL;
+	}
+
+	line_added_to_table(ctl);
 	return 0;
 }
 
@@ -506,6 +674,11 @@ static int read_input(struct column_control *ctl, FILE *fp)
 			continue;
 		}
 
+		if (ctl->mode == COLUMN_MODE_TABLE && is_bytes_line(ctl, buf)) {
+			rc = add_bytes_to_table(ctl, buf);
+			continue;
+		}
+
 		wcs = mbs_to_wcs(buf);
 		if (!wcs) {
 			/*
@@ -642,6 +815,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -W, --table-wrap <columns>       wrap text in the columns when necessary\n"), out);
 	fputs(_(" -L, --table-empty-lines          don't ignore empty lines\n"), out);
 	fputs(_(" -J, --json                       use JSON output format for table\n"), out);
+	fputs(_("     --table-stream[=<lines>]     print the table continuously, widths from the first lines\n"), out);
+	fputs(_("     --table-widths <list>        comma separated widths of the columns for --table-stream\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_(" -r, --tree <column>              column to use tree-like output for the table\n"), out);
@@ -672,6 +847,10 @@ int main(int argc, char **argv)
 
 	int c;
 	unsigned int eval = 0;		/* exit value */
+	enum {
+		OPT_TABLE_STREAM = CHAR_MAX + 1,
+		OPT_TABLE_WIDTHS
+	};
 
 	static const struct option longopts[] =
 	{
@@ -690,7 +869,9 @@ int main(int argc, char **argv)
 		{ "table-noheadings",    no_argument,       NULL, 'd' },
 		{ "table-order",         required_argument, NULL, 'O' },
 		{ "table-right",         required_argument, NULL, 'R' },
+		{ "table-stream",        optional_argument, NULL, OPT_TABLE_STREAM },
 		{ "table-truncate",      required_argument, NULL, 'T' },
+		{ "table-widths",        required_argument, NULL, OPT_TABLE_WIDTHS },
 		{ "table-wrap",          required_argument, NULL, 'W' },
 		{ "table-empty-lines",   no_argument,       NULL, 'L' },
 		{ "table-header-repeat", no_argument,       NULL, 'e' },
@@ -714,6 +895,7 @@ int main(int argc, char **argv)
 
 	ctl.output_separator = "  ";
 	ctl.input_separator = mbs_to_wcs("\t ");
+	ctl.input_separator_bytes = separator_to_bytes("\t ");
 
 	while ((c = getopt_long(argc, argv, "c:dE:eH:hi:JLN:n:O:o:p:R:r:s:T:tVW:x", longopts, NULL)) != -1) {
 
@@ -769,6 +951,8 @@ int main(int argc, char **argv)
 		case 's':
 			free(ctl.input_separator);
 			ctl.input_separator = mbs_to_wcs(optarg);
+			free(ctl.input_separator_bytes);
+			ctl.input_separator_bytes = separator_to_bytes(optarg);
 			ctl.greedy = 0;
 			break;
 		case 'T':
@@ -783,6 +967,15 @@ int main(int argc, char **argv)
 		case 'x':
 			ctl.mode = COLUMN_MODE_FILLROWS;
 			break;
+		case OPT_TABLE_STREAM:
+			ctl.tab_stream = optarg ? strtou32_or_err(optarg,
+					_("invalid --table-stream argument")) : 1000;
+			if (!ctl.tab_stream)
+				ctl.tab_stream = 1;
+			break;
+		case OPT_TABLE_WIDTHS:
+			ctl.tab_widths = optarg;
+			break;
 
 		case 'h':
 			usage();
@@ -795,6 +988,9 @@ int main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
+#ifdef HAVE_WIDECHAR
+	ctl.utf8 = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+#endif
 	if (ctl.termwidth == (size_t) -1)
 		ctl.termwidth = get_terminal_width(80);
 
@@ -808,12 +1004,16 @@ int main(int argc, char **argv)
 	if (ctl.mode != COLUMN_MODE_TABLE
 	    && (ctl.tab_order || ctl.tab_name || ctl.tab_colwrap ||
 		ctl.tab_colhide || ctl.tab_coltrunc || ctl.tab_colnoextrem ||
-		ctl.tab_colright || ctl.tab_colnames))
+		ctl.tab_colright || ctl.tab_colnames || ctl.tab_stream ||
+		ctl.tab_widths))
 		errx(EXIT_FAILURE, _("option --table required for all --table-*"));
 
 	if (ctl.tab_colnames == NULL && ctl.json)
 		errx(EXIT_FAILURE, _("option --table-columns required for --json"));
 
+	if (ctl.tab_widths && !ctl.tab_stream)
+		errx(EXIT_FAILURE, _("option --table-stream required for --table-widths"));
+
 	if (!*argv)
 		eval += read_input(&ctl, stdin);
 	else
@@ -838,8 +1038,14 @@ int main(int argc, char **argv)
 
 	switch (ctl.mode) {
 	case COLUMN_MODE_TABLE:
-		if (ctl.tab && scols_table_get_nlines(ctl.tab)) {
-			modify_table(&ctl);
+		if (ctl.tab && ctl.tab_streaming)
+			eval = scols_print_table(ctl.tab);
+		else if (ctl.tab && scols_table_get_nlines(ctl.tab)) {
+			/* short input, use the same widths as for the stream */
+			if (ctl.tab_stream)
+				start_stream(&ctl);
+			else
+				modify_table(&ctl);
 			eval = scols_print_table(ctl.tab);
 		}
 		break;
@@ -40,12 +40,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "hexdump.h"
 #include "xalloc.h"
 #include "c.h"
 #include "nls.h"
 #include "colors.h"
 
+#define HEXDUMP_INBUFSZ		(1024 * 1024)
+
 static void doskip(const char *, int, struct hexdump *);
 static u_char *get(struct hexdump *);
 
@@ -236,6 +239,140 @@ static void bpad(struct hexdump_pr *pr)
 		;
 }
 
+/*
+ * Specialized code for the built-in formats. The generic code calls printf()
+ * for every conversion, the kernels below compose the whole line in a buffer.
+ * Only complete blocks are printed this way; the last incomplete block is
+ * padded by the generic code.
+ */
+static const char hexdigits[] = "0123456789abcdef";
+static char printable[256];
+
+static void init_kernels(void)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(printable); i++)
+		printable[i] = isprint(i) ? i : '.';
+
+	/* compose more lines before write() */
+	if (!isatty(STDOUT_FILENO))
+		setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+}
+
+/* "%0<width>llx" */
+static char *put_address(char *p, off_t addr, int width)
+{
+	unsigned long long x = addr;
+	char tmp[sizeof(x) * 2];
+	int n = 0;
+
+	do {
+		tmp[n++] = hexdigits[x & 0xf];
+		x >>= 4;
+	} while (x);
+	while (n < width)
+		tmp[n++] = '0';
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+static inline uint16_t get_uint16(const unsigned char *bp)
+{
+	uint16_t x;
+
+	memcpy(&x, bp, sizeof(x));	/* host byte order as in print() */
+	return x;
+}
+
+static inline char *put_hex(char *p, unsigned int x, int digits)
+{
+	while (digits--)
+		*p++ = hexdigits[(x >> (digits * 4)) & 0xf];
+	return p;
+}
+
+static inline char *put_oct(char *p, unsigned int x, int digits)
+{
+	while (digits--)
+		*p++ = '0' + ((x >> (digits * 3)) & 07);
+	return p;
+}
+
+static inline char *put_dec5(char *p, unsigned int x)
+{
+	int i;
+
+	for (i = 4; i >= 0; i--) {
+		p[i] = '0' + x % 10;
+		x /= 10;
+	}
+	return p + 5;
+}
+
+/* returns size of the line composed for 16 bytes block in @buf */
+static size_t kernel_line(int kernel, char *buf, off_t addr, const unsigned char *bp)
+{
+	char *p = buf;
+	int i;
+
+	switch (kernel) {
+	case HEXDUMP_KERNEL_DEFAULT:		/* "%07.7_ax " 8/2 "%04x " */
+		p = put_address(p, addr, 7);
+		for (i = 0; i < 16; i += 2) {
+			*p++ = ' ';
+			p = put_hex(p, get_uint16(bp + i), 4);
+		}
+		break;
+	case HEXDUMP_KERNEL_HEX2:		/* "%07.7_ax " 8/2 "   %04x " */
+		p = put_address(p, addr, 7);
+		for (i = 0; i < 16; i += 2) {
+			memcpy(p, "    ", 4);
+			p = put_hex(p + 4, get_uint16(bp + i), 4);
+		}
+		break;
+	case HEXDUMP_KERNEL_DECIMAL2:		/* "%07.7_ax " 8/2 "  %05u " */
+		p = put_address(p, addr, 7);
+		for (i = 0; i < 16; i += 2) {
+			memcpy(p, "   ", 3);
+			p = put_dec5(p + 3, get_uint16(bp + i));
+		}
+		break;
+	case HEXDUMP_KERNEL_OCTAL2:		/* "%07.7_ax " 8/2 " %06o " */
+		p = put_address(p, addr, 7);
+		for (i = 0; i < 16; i += 2) {
+			memcpy(p, "  ", 2);
+			p = put_oct(p + 2, get_uint16(bp + i), 6);
+		}
+		break;
+	case HEXDUMP_KERNEL_OCTAL1:		/* "%07.7_ax " 16/1 "%03o " */
+		p = put_address(p, addr, 7);
+		for (i = 0; i < 16; i++) {
+			*p++ = ' ';
+			p = put_oct(p, bp[i], 3);
+		}
+		break;
+	case HEXDUMP_KERNEL_CANONICAL:
+		/* "%08.8_ax  " 8/1 "%02x " "  " 8/1 "%02x " "  |" 16/1 "%_p" "|" */
+		p = put_address(p, addr, 8);
+		for (i = 0; i < 16; i++) {
+			*p++ = ' ';
+			if (i == 0 || i == 8)
+				*p++ = ' ';
+			p = put_hex(p, bp[i], 2);
+		}
+		memcpy(p, "  |", 3);
+		p += 3;
+		for (i = 0; i < 16; i++)
+			*p++ = printable[bp[i]];
+		*p++ = '|';
+		break;
+	}
+	*p++ = '\n';
+	return p - buf;
+}
+
 void display(struct hexdump *hex)
 {
 	register struct list_head *fs;
@@ -248,7 +385,18 @@ void display(struct hexdump *hex)
 	unsigned char savech = 0, *savebp;
 	struct list_head *p, *q, *r;
 
+	if (hex->kernel)
+		init_kernels();
+
 	while ((bp = get(hex)) != NULL) {
+		if (hex->kernel && (!eaddress || address + hex->blocksize <= eaddress)) {
+			char line[128];
+			size_t sz = kernel_line(hex->kernel, line, address, bp);
+
+			fwrite(line, 1, sz, stdout);
+			continue;
+		}
+
 		fs = &hex->fshead; savebp = bp; saveaddress = address;
 
 		list_for_each(p, fs) {
@@ -323,6 +471,78 @@ void display(struct hexdump *hex)
 
 static char **_argv;
 
+/* returns the kernel file offset after SEEK_HOLE from @pos */
+static off_t find_hole(struct hexdump *hex, int fd, off_t pos)
+{
+	off_t kpos = lseek(fd, 0, SEEK_CUR), hole;
+
+	hole = lseek(fd, pos, SEEK_HOLE);
+	if (hole < 0)
+		hex->holes = 0;
+
+	/* don't confuse stdio */
+	lseek(fd, kpos, SEEK_SET);
+	return hole;
+}
+
+/*
+ * The zero blocks after zero @last block are squeezed to "*", so it's
+ * unnecessary to read them, and the holes in sparse files are skipped by
+ * SEEK_DATA. The next hole position is cached, so this is cheap for the
+ * zero blocks which are not in a hole. Returns number of skipped bytes.
+ */
+static off_t skip_hole(struct hexdump *hex, const u_char *last)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+	int fd = fileno(stdin);
+	off_t cur, data, n;
+
+	if (!hex->holes)
+		return 0;
+
+	if (hex->holes < 0) {
+		struct stat st;
+
+		/* ftello() is a syscall, then the position is counted */
+		hex->inpos = ftello(stdin);
+		if (hex->inpos < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+			hex->holes = 0;
+			return 0;
+		}
+		hex->holes = 1;
+		hex->insize = st.st_size;
+		hex->hole = find_hole(hex, fd, hex->inpos);
+	}
+	cur = hex->inpos;
+	if (!hex->holes || cur < hex->hole
+	    || last[0] || memcmp(last, last + 1, hex->blocksize - 1))
+		return 0;
+
+	data = lseek(fd, cur, SEEK_DATA);
+	if (data < 0 && errno == ENXIO)
+		data = hex->insize;		/* hole at the end of the file */
+	if (data < 0) {
+		hex->holes = 0;
+		data = cur;
+	}
+
+	n = (data - cur) / hex->blocksize * hex->blocksize;
+	if (hex->length != -1 && n > hex->length)
+		n = hex->length / hex->blocksize * hex->blocksize;
+
+	/* sets the kernel offset and drops stdio buffer */
+	if (fseeko(stdin, cur + n, SEEK_SET) != 0)
+		err(EXIT_FAILURE, "%s", _argv[-1]);
+	hex->inpos = cur + n;
+
+	if (hex->holes && data < hex->insize)
+		hex->hole = find_hole(hex, fd, data);
+	return n;
+#else
+	return 0;
+#endif
+}
+
 static u_char *
 get(struct hexdump *hex)
 {
@@ -342,6 +562,8 @@ get(struct hexdump *hex)
 	}
 	need = hex->blocksize, nread = 0;
 	while (TRUE) {
+		off_t skipped;
+
 		/*
 		 * if read the right number of bytes, or at EOF for one file,
 		 * and no other files are available, zero-pad the rest of the
@@ -365,6 +587,17 @@ get(struct hexdump *hex)
 			warnx(_("all input file arguments failed"));
 			goto retnul;
 		}
+		if (need == hex->blocksize && (vflag == WAIT || vflag == DUP)
+		    && (skipped = skip_hole(hex, savp)) > 0) {
+			if (vflag == WAIT)
+				printf("*\n");
+			vflag = DUP;
+			address += skipped;
+			if (hex->length != -1)
+				hex->length -= skipped;
+			ateof = 0;
+			continue;
+		}
 		n = fread((char *)curp + nread, sizeof(unsigned char),
 		    hex->length == -1 ? need : min(hex->length, need), stdin);
 		if (!n) {
@@ -374,6 +607,7 @@ get(struct hexdump *hex)
 			continue;
 		}
 		ateof = 0;
+		hex->inpos += n;
 		if (hex->length != -1)
 			hex->length -= n;
 		if (!(need -= n)) {
@@ -416,12 +650,14 @@ int next(char **argv, struct hexdump *hex)
 				++_argv;
 				continue;
 			}
+			setvbuf(stdin, NULL, _IOFBF, HEXDUMP_INBUFSZ);
 			statok = done = 1;
 		} else {
 			if (done++)
 				return(0);
 			statok = 0;
 		}
+		hex->holes = -1;
 		if (hex->skip)
 			doskip(statok ? *_argv : "stdin", statok, hex);
 		if (*_argv)
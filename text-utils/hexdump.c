@@ -61,6 +61,7 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 {
 	int ch;
 	int colormode = UL_COLORMODE_UNDEF;
+	int kernel = HEXDUMP_KERNEL_NONE, nformats = 0;
 	char *hex_offt = "\"%07.7_Ax\n\"";
 
 
@@ -85,26 +86,35 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 	while ((ch = getopt_long(argc, argv, "bcCde:f:L::n:os:vxhV", longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'b':
+			kernel = HEXDUMP_KERNEL_OCTAL1;
+			nformats++;
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 16/1 \"%03o \" \"\\n\"", hex);
 			break;
 		case 'c':
+			nformats++;
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 16/1 \"%3_c \" \"\\n\"", hex);
 			break;
 		case 'C':
+			kernel = HEXDUMP_KERNEL_CANONICAL;
+			nformats++;
 			add_fmt("\"%08.8_Ax\n\"", hex);
 			add_fmt("\"%08.8_ax  \" 8/1 \"%02x \" \"  \" 8/1 \"%02x \" ", hex);
 			add_fmt("\"  |\" 16/1 \"%_p\" \"|\\n\"", hex);
 			break;
 		case 'd':
+			kernel = HEXDUMP_KERNEL_DECIMAL2;
+			nformats++;
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \"  %05u \" \"\\n\"", hex);
 			break;
 		case 'e':
+			nformats++;
 			add_fmt(optarg, hex);
 			break;
 		case 'f':
+			nformats++;
 			addfile(optarg, hex);
 			break;
 		case 'L':
@@ -117,6 +127,8 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 			hex->length = strtosize_or_err(optarg, _("failed to parse length"));
 			break;
 		case 'o':
+			kernel = HEXDUMP_KERNEL_OCTAL2;
+			nformats++;
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \" %06o \" \"\\n\"", hex);
 			break;
@@ -127,6 +139,8 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 			vflag = ALL;
 			break;
 		case 'x':
+			kernel = HEXDUMP_KERNEL_HEX2;
+			nformats++;
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \"   %04x \" \"\\n\"", hex);
 			break;
@@ -141,9 +155,14 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 	}
 
 	if (list_empty(&hex->fshead)) {
+		kernel = HEXDUMP_KERNEL_DEFAULT;
+		nformats++;
 		add_fmt(hex_offt, hex);
 		add_fmt("\"%07.7_ax \" 8/2 \"%04x \" \"\\n\"", hex);
 	}
+	/* the specialized code is usable only for one built-in format */
+	if (nformats == 1)
+		hex->kernel = kernel;
 	colors_init (colormode, "hexdump");
 	return optind;
 }
@@ -208,6 +227,9 @@ int main(int argc, char **argv)
 			hex->blocksize = tfs->bcnt;
 	}
 
+	if (hex->blocksize != 16)
+		hex->kernel = HEXDUMP_KERNEL_NONE;
+
 	/* rewrite the rules, do syntax checking */
 	list_for_each(p, &hex->fshead)
 		rewrite_rules(list_entry(p, struct hexdump_fs, fslist), hex);
@@ -86,12 +86,28 @@ struct hexdump_fs {			/* format strings */
 	int bcnt;
 };
 
+/* the built-in formats with specialized display code, see display() */
+enum {
+	HEXDUMP_KERNEL_NONE = 0,	/* -e, -f or more formats */
+	HEXDUMP_KERNEL_DEFAULT,		/* no format option */
+	HEXDUMP_KERNEL_OCTAL1,		/* -b */
+	HEXDUMP_KERNEL_CANONICAL,	/* -C */
+	HEXDUMP_KERNEL_DECIMAL2,	/* -d */
+	HEXDUMP_KERNEL_OCTAL2,		/* -o */
+	HEXDUMP_KERNEL_HEX2		/* -x */
+};
+
 struct hexdump {
   struct list_head fshead;				/* head of format strings */
   ssize_t blocksize;			/* data block size */
   int exitval;				/* final exit value */
   ssize_t length;			/* max bytes to read */
   off_t skip;				/* bytes to skip */
+  int kernel;				/* HEXDUMP_KERNEL_* */
+  int holes;				/* current file: -1 unknown, 0 no holes */
+  off_t hole;				/* current file: start of the next hole */
+  off_t inpos;				/* current file: read position */
+  off_t insize;				/* current file: size */
 };
 
 extern struct hexdump_fu *endfu;
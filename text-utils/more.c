@@ -99,6 +99,8 @@
 #define SHELL_LINE	1000
 #define COMMAND_BUF	200
 #define REGERR_BUF	NUM_COLUMNS
+#define LINE_INDEX_STEP	32	/* every 32th line offset is in the index */
+#define BLOCK_SZ	(256 * 1024)	/* initial block_buf size */
 
 #define TERM_AUTO_RIGHT_MARGIN    "am"
 #define TERM_CEOL                 "xhp"
@@ -154,6 +156,13 @@ struct more_control {
 	char *clear_rest;		/* clear rest of screen */
 	int num_columns;		/* number of columns */
 	char *previous_search;		/* previous search() buf[] item */
+	long *line_index;		/* offsets of every LINE_INDEX_STEP line */
+	size_t line_index_num;		/* number of line_index[] offsets */
+	size_t line_index_alloc;	/* allocated line_index[] size */
+	long line_index_end;		/* file offset the index is built up to */
+	long line_index_lines;		/* number of lines before line_index_end */
+	char *block_buf;		/* buffer for large reads */
+	size_t block_sz;		/* size of block_buf buffer */
 	struct {
 		long row_num;		/* row number */
 		long line_num;		/* line number */
@@ -177,6 +186,7 @@ struct more_control {
 		hard_tabs:1,		/* print spaces instead of '\t' */
 		hard_tty:1,		/* is this hard copy terminal (a printer or such) */
 		is_paused:1,		/* is output paused */
+		line_index_ok:1,	/* the file is regular, line_index[] is usable */
 		no_quit_dialog:1,	/* suppress quit dialog */
 		no_scroll:1,		/* do not scroll, clear the screen and then display text */
 		no_tty_in:1,		/* is input in interactive mode */
@@ -305,6 +315,94 @@ static int more_ungetc(struct more_control *ctl, int c, FILE *stream)
 	return ungetc(c, stream);
 }
 
+/* Reads the file from @pos to block_buf by pread(), so the stream position
+ * is not affected.  Returns number of the read bytes, 0 on EOF or error. */
+static size_t read_block(struct more_control *ctl, FILE *f, long pos, size_t off)
+{
+	ssize_t n;
+
+	if (!ctl->block_buf) {
+		ctl->block_sz = BLOCK_SZ;
+		ctl->block_buf = xmalloc(ctl->block_sz + 1);
+	}
+	do {
+		n = pread(fileno(f), ctl->block_buf + off, ctl->block_sz - off, pos);
+	} while (n < 0 && errno == EINTR);
+
+	return n < 0 ? 0 : n;
+}
+
+/* Extends line_index[] to contain the line @line, or to the end of the file. */
+static void index_lines(struct more_control *ctl, FILE *f, long line)
+{
+	if (ctl->line_index_num == 0) {
+		ctl->line_index_alloc = 1024;
+		ctl->line_index = xrealloc(ctl->line_index,
+					   ctl->line_index_alloc * sizeof(long));
+		ctl->line_index[ctl->line_index_num++] = 0;
+	}
+	while ((long) (ctl->line_index_num - 1) * LINE_INDEX_STEP < line) {
+		size_t n = read_block(ctl, f, ctl->line_index_end, 0);
+		char *p = ctl->block_buf, *end = p + n;
+
+		if (n == 0)
+			break;
+		while ((p = memchr(p, '\n', end - p)) != NULL) {
+			p++;
+			if (++ctl->line_index_lines % LINE_INDEX_STEP)
+				continue;
+			if (ctl->line_index_num == ctl->line_index_alloc) {
+				ctl->line_index_alloc *= 2;
+				ctl->line_index = xrealloc(ctl->line_index,
+						ctl->line_index_alloc * sizeof(long));
+			}
+			ctl->line_index[ctl->line_index_num++] =
+				ctl->line_index_end + (p - ctl->block_buf);
+		}
+		ctl->line_index_end += n;
+	}
+}
+
+/* Moves to the begin of the @line of the regular file (the line numbers
+ * are counted from 0).  Returns 0 on success, or 1 if the file is shorter;
+ * then the file is at EOF and current_line is the number of the lines. */
+static int seek_line(struct more_control *ctl, FILE *f, long line)
+{
+	size_t i;
+	long pos, cur;
+
+	index_lines(ctl, f, line);
+
+	i = line / LINE_INDEX_STEP;
+	if (i >= ctl->line_index_num)
+		i = ctl->line_index_num - 1;
+	pos = ctl->line_index[i];
+	cur = i * LINE_INDEX_STEP;
+
+	/* the rest of the lines from the indexed line */
+	while (cur < line) {
+		size_t n = read_block(ctl, f, pos, 0);
+		char *p = ctl->block_buf, *end = p + n;
+
+		if (n == 0)
+			break;
+		while (cur < line && (p = memchr(p, '\n', end - p)) != NULL) {
+			p++;
+			cur++;
+		}
+		pos += (cur < line ? end : p) - ctl->block_buf;
+	}
+
+	more_fseek(ctl, f, pos);
+	ctl->current_line = cur;
+	if (cur < line) {
+		/* as if the file was read up to EOF by more_getc() */
+		more_getc(ctl, f);
+		return 1;
+	}
+	return 0;
+}
+
 /* magic --
  *	check for file magic numbers.  This code would best be shared
  *	with the file(1) program or, perhaps, more should not try to be
@@ -356,6 +454,9 @@ static FILE *checkf(struct more_control *ctl, char *fs, int *clearfirst)
 	}
 	ctl->current_line = 0;
 	ctl->file_position = 0;
+	ctl->line_index_num = 0;
+	ctl->line_index_end = ctl->line_index_lines = 0;
+	ctl->line_index_ok = S_ISREG(st.st_mode) ? 1 : 0;
 	if ((f = fopen(fs, "r")) == NULL) {
 		fflush(stdout);
 		warn(_("cannot open %s"), fs);
@@ -1264,6 +1365,11 @@ static void skip_lines(struct more_control *ctl, int n, FILE *f)
 {
 	int c;
 
+	if (ctl->line_index_ok) {
+		if (n > 0)
+			seek_line(ctl, f, ctl->current_line + n);
+		return;
+	}
 	while (n > 0) {
 		while ((c = more_getc(ctl, f)) != '\n')
 			if (c == EOF)
@@ -1301,6 +1407,84 @@ static void read_line(struct more_control *ctl, FILE *f)
 	*p = '\0';
 }
 
+static size_t count_lines(const char *p, const char *end)
+{
+	size_t n = 0;
+
+	while ((p = memchr(p, '\n', end - p)) != NULL) {
+		p++;
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Searches the regular file from @pos for the @n-th line matching @re.  The
+ * file is read by large blocks of the whole lines and @block_re (the same
+ * pattern compiled with REG_NEWLINE) is tried for the whole block, only the
+ * blocks with a match are searched line by line.  The patterns matching the
+ * empty string (e.g. "^$") would be tried on every position of the block, so
+ * these are always matched line by line.  Returns 0 and number of the lines
+ * before the matching line in @nlines, 1 if not found, or -1 if the file
+ * contains NUL bytes and has to be searched by the original way.
+ */
+static int search_blocks(struct more_control *ctl, regex_t *re,
+			 regex_t *block_re, FILE *f, long pos, int n, long *nlines)
+{
+	int by_lines = regexec(re, "", 0, NULL, 0) == 0;
+
+	*nlines = 0;
+
+	for (;;) {
+		size_t sz = read_block(ctl, f, pos, 0), len;
+		char *buf = ctl->block_buf, *p, *last;
+		int eof = sz < ctl->block_sz;
+
+		/* read until there is at least one whole line in the block */
+		while (!eof && !memrchr(buf, '\n', sz)) {
+			size_t n;
+
+			ctl->block_sz *= 2;
+			ctl->block_buf = buf = xrealloc(buf, ctl->block_sz + 1);
+			n = read_block(ctl, f, pos + sz, sz);
+			eof = n < ctl->block_sz - sz;
+			sz += n;
+		}
+		if (sz == 0)
+			return 1;
+		if (memchr(buf, '\0', sz))
+			return -1;
+
+		/* the incomplete last line is searched in the next block */
+		last = memrchr(buf, '\n', sz);
+		len = !eof && last ? (size_t) (last + 1 - buf) : sz;
+		buf[len] = '\0';
+
+		if (!by_lines && regexec(block_re, buf, 0, NULL,
+				buf[len - 1] == '\n' ? REG_NOTEOL : 0) != 0)
+			*nlines += count_lines(buf, buf + len);
+		else {
+			for (p = buf; p < buf + len; ) {
+				char *nl = memchr(p, '\n', buf + len - p);
+				int rc;
+
+				if (nl)
+					*nl = '\0';
+				rc = regexec(re, p, 0, NULL, 0);
+				if (nl)
+					*nl = '\n';
+				if (rc == 0 && --n == 0)
+					return 0;
+				(*nlines)++;
+				p = nl ? nl + 1 : buf + len;
+			}
+		}
+		pos += len;
+		if (eof)
+			return 1;
+	}
+}
+
 /* Search for nth occurrence of regular expression contained in buf in
  * the file */
 static void search(struct more_control *ctl, char buf[], FILE *file, int n)
@@ -1311,7 +1495,7 @@ static void search(struct more_control *ctl, char buf[], FILE *file, int n)
 	long line3;
 	int lncount;
 	int saveln, rc;
-	regex_t re;
+	regex_t re, block_re;
 
 	ctl->context.line_num = saveln = ctl->current_line;
 	ctl->context.row_num = startline;
@@ -1323,6 +1507,40 @@ static void search(struct more_control *ctl, char buf[], FILE *file, int n)
 		regerror(rc, &re, s, sizeof s);
 		more_error(ctl, s);
 	}
+	if (ctl->line_index_ok && regcomp(&block_re, buf, REG_NOSUB | REG_NEWLINE) == 0) {
+		long nlines;
+
+		rc = search_blocks(ctl, &re, &block_re, file, startline, n, &nlines);
+		regfree(&block_re);
+		if (rc == 0) {
+			regfree(&re);
+			if (nlines + 1 > 3) {
+				putchar('\n');
+				if (ctl->clear_line_ends)
+					putp(ctl->erase_line);
+				fputs(_("...skipping\n"), stdout);
+			}
+			/* show two lines before the matching line */
+			if (nlines > 2)
+				seek_line(ctl, file, saveln + nlines - 2);
+			else {
+				more_fseek(ctl, file, startline);
+				ctl->current_line = saveln;
+			}
+			if (ctl->no_scroll) {
+				if (ctl->clear_line_ends) {
+					putp(ctl->go_home);
+					putp(ctl->erase_line);
+				} else
+					more_clear_screen(ctl);
+			}
+			return;
+		}
+		if (rc == 1) {
+			regfree(&re);
+			goto eof;
+		}
+	}
 	while (!feof(file)) {
 		line3 = line2;
 		line2 = line1;
@@ -1365,6 +1583,7 @@ static void search(struct more_control *ctl, char buf[], FILE *file, int n)
 	}
 	regfree(&re);
 	if (feof(file)) {
+eof:
 		if (!ctl->no_tty_in) {
 			ctl->current_line = saveln;
 			more_fseek(ctl, file, startline);
@@ -1500,6 +1719,14 @@ static int more_key_command(struct more_control *ctl, char *filename, FILE *f)
 				putp(ctl->erase_line);
 			putchar('\n');
 
+			if (ctl->line_index_ok) {
+				if (seek_line(ctl, f, ctl->current_line + nlines)) {
+					retval = 0;
+					done++;
+					goto endsw;
+				}
+				nlines = 0;
+			}
 			while (nlines > 0) {
 				while ((c = more_getc(ctl, f)) != '\n')
 					if (c == EOF) {
@@ -2093,6 +2320,8 @@ int main(int argc, char **argv)
 	free(ctl.previous_search);
 	free(initbuf);
 	free(ctl.line_buf);
+	free(ctl.line_index);
+	free(ctl.block_buf);
 	reset_tty();
 	exit(EXIT_SUCCESS);
 }
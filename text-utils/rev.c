@@ -55,11 +55,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <getopt.h>
 
 #include "nls.h"
 #include "xalloc.h"
+#include "linereader.h"
 #include "widechar.h"
 #include "c.h"
 #include "closestream.h"
@@ -85,24 +87,50 @@ static void __attribute__((__noreturn__)) usage(void)
 	exit(EXIT_SUCCESS);
 }
 
-static void reverse_str(wchar_t *str, size_t n)
+/*
+ * Writes @len bytes of @line to @out in the reverse order of the characters.
+ * Returns -1 on invalid multibyte sequence.
+ */
+static int reverse_line(const char *line, size_t len, char *out)
 {
 	size_t i;
 
-	for (i = 0; i < n / 2; ++i) {
-		wchar_t tmp = str[i];
-		str[i] = str[n - 1 - i];
-		str[n - 1 - i] = tmp;
+	if (ul_is_ascii(line, len)) {
+		for (i = 0; i < len; i++)
+			out[len - 1 - i] = line[i];
+		return 0;
+	}
+#ifdef HAVE_WIDECHAR
+	{
+		mbstate_t st;
+
+		memset(&st, 0, sizeof(st));
+		for (i = 0; i < len; ) {
+			size_t n = mbrlen(line + i, len - i, &st);
+
+			if (n == (size_t) -1 || n == (size_t) -2)
+				return -1;
+			if (n == 0)
+				n = 1;		/* L'\0' */
+			memcpy(out + len - i - n, line + i, n);
+			i += n;
+		}
 	}
+#else
+	for (i = 0; i < len; i++)
+		out[len - 1 - i] = line[i];
+#endif
+	return 0;
 }
 
 int main(int argc, char *argv[])
 {
 	char const *filename = "stdin";
-	wchar_t *buf;
-	size_t len, bufsiz = BUFSIZ;
-	FILE *fp = stdin;
-	int ch, rval = EXIT_SUCCESS;
+	struct ul_linereader lr;
+	char *line, *out = NULL;
+	size_t outsz = 0;
+	ssize_t len;
+	int fd, ch, rval = EXIT_SUCCESS;
 
 	static const struct option longopts[] = {
 		{ "version",    no_argument,       NULL, 'V' },
@@ -131,11 +159,12 @@ int main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
-	buf = xmalloc(bufsiz * sizeof(wchar_t));
+	ul_init_linereader(&lr, STDIN_FILENO);
 
 	do {
+		fd = STDIN_FILENO;
 		if (*argv) {
-			if ((fp = fopen(*argv, "r")) == NULL) {
+			if ((fd = open(*argv, O_RDONLY | O_CLOEXEC)) < 0) {
 				warn(_("cannot open %s"), *argv );
 				rval = EXIT_FAILURE;
 				++argv;
@@ -143,41 +172,36 @@ int main(int argc, char *argv[])
 			}
 			filename = *argv++;
 		}
+		ul_reset_linereader(&lr, fd);
 
-		while (fgetws(buf, bufsiz, fp)) {
-			len = wcslen(buf);
-
-			if (len == 0)
-				continue;
+		while ((len = ul_linereader_next(&lr, &line)) > 0) {
+			int nl = line[len - 1] == '\n';
 
-			/* This is my hack from setpwnam.c -janl */
-			while (buf[len-1] != '\n' && !feof(fp)) {
-				/* Extend input buffer if it failed getting the whole line */
-				/* So now we double the buffer size */
-				bufsiz *= 2;
-
-				buf = xrealloc(buf, bufsiz * sizeof(wchar_t));
-
-				/* And fill the rest of the buffer */
-				if (!fgetws(&buf[len], bufsiz/2, fp))
-					break;
-
-				len = wcslen(buf);
+			if (nl)
+				len--;
+			if ((size_t) len > outsz) {
+				outsz = len;
+				out = xrealloc(out, outsz);
+			}
+			if (reverse_line(line, len, out) != 0) {
+				len = -EILSEQ;
+				break;
 			}
-			if (buf[len - 1] == '\n')
-				buf[len--] = '\0';
-			reverse_str(buf, len);
-			fputws(buf, stdout);
+			fwrite(out, 1, len, stdout);
+			if (nl)
+				putchar('\n');
 		}
-		if (ferror(fp)) {
+		if (len < 0) {
+			errno = -len;
 			warn("%s", filename);
 			rval = EXIT_FAILURE;
 		}
-		if (fp != stdin)
-			fclose(fp);
+		if (fd != STDIN_FILENO)
+			close(fd);
 	} while(*argv);
 
-	free(buf);
+	ul_free_linereader(&lr);
+	free(out);
 	return rval;
 }
 